@@ -2788,14 +2788,26 @@ void tool_print_ctrls(
 int
 tool_write_ldif( int type, char *name, char *value, ber_len_t vallen )
 {
-	char	*ldif;
-
-	if (( ldif = ldif_put_wrap( type, name, value, vallen, ldif_wrap )) == NULL ) {
-		return( -1 );
-	}
-
-	fputs( ldif, stdout );
-	ber_memfree( ldif );
+	/* reused from line to line */
+	static char	*buf;
+	static ber_len_t	bufsize;
+	ber_len_t	need;
+	char	*p;
+
+	need = LDIF_SIZE_NEEDED_WRAP( name ? strlen( name ) : 0, vallen,
+		ldif_wrap ) + 1;
+	if ( need > bufsize ) {
+		p = ber_memrealloc( buf, need );
+		if ( p == NULL ) {
+			return( -1 );
+		}
+		buf = p;
+		bufsize = need;
+	}
+
+	p = buf;
+	ldif_sput_wrap( &p, type, name, value, vallen, ldif_wrap );
+	fwrite( buf, 1, p - buf, stdout );
 
 	return( 0 );
 }
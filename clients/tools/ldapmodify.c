@@ -71,8 +71,26 @@
 
 static int	ldapadd;
 static char *rejfile = NULL;
+static FILE *rejfp = NULL;
 static LDAP	*ld = NULL;
 
+/* Requests sent but not answered yet, with -E window */
+typedef struct pending_req {
+	int		pr_msgid;
+	int		pr_op;		/* expected result type */
+	unsigned long	pr_lineno;
+	char		*pr_dn;		/* as given, for messages */
+	char		*pr_ndn;	/* normalized, for ordering */
+	char		*pr_rec;	/* the record, for -S */
+} pending_req;
+
+static int		window = 0;
+static pending_req	*pending = NULL;
+static int		npending = 0;
+static int		pending_rc = 0;	/* last error of a pipelined request */
+static char		*currec = NULL;	/* record being processed, for -S */
+static unsigned long	curline = 0;
+
 static int process_ldif_rec LDAP_P(( char *rbuf, unsigned long lineno ));
 static int domodify LDAP_P((
 	const struct berval *dn,
@@ -93,9 +111,23 @@ static int process_response(
 	int msgid,
 	int res,
 	const struct berval *dn );
+static int check_response(
+	LDAP *ld,
+	LDAPMessage *res,
+	int op );
+static void write_reject(
+	int rc,
+	const char *rec );
+static int pipeline_wait LDAP_P(( const char *ndn, int max ));
+static int pipeline_add LDAP_P((
+	int msgid,
+	int op,
+	const struct berval *dn,
+	char *ndn ));
 
 static int txn = 0;
 static int txnabort = 0;
+static int txnbulk = 0;
 struct berval *txn_id = NULL;
 
 void
@@ -116,7 +148,9 @@ usage( void )
 	fprintf( stderr, _("  -M         enable Manage DSA IT control (-MM to make critical)\n"));
 	fprintf( stderr, _("  -P version protocol version (default: 3)\n"));
  	fprintf( stderr,
-		_("             [!]txn=<commit|abort>         (transaction)\n"));
+		_("             [!]txn=<commit|abort|bulk>    (transaction)\n"));
+	fprintf( stderr,
+		_("             window=<n>                    (keep up to <n> requests outstanding)\n"));
 	fprintf( stderr, _("  -S file    write skipped modifications to `file'\n"));
 
 	tool_common_usage();
@@ -167,6 +201,8 @@ handle_private_option( int i )
 			if( cvalue != NULL ) {
 				if( strcasecmp( cvalue, "abort" ) == 0 ) {
 					txnabort=1;
+				} else if( strcasecmp( cvalue, "bulk" ) == 0 ) {
+					txnbulk=1;
 				} else if( strcasecmp( cvalue, "commit" ) != 0 ) {
 					fprintf( stderr, _("Invalid value for txn control, %s\n"),
 						cvalue );
@@ -175,6 +211,24 @@ handle_private_option( int i )
 			}
 
 			txn = 1 + crit;
+		} else if ( strcasecmp( control, "window" ) == 0 ) {
+			/* Pipelining, not a control */
+			if ( cvalue == NULL || lutil_atoi( &window, cvalue ) != 0 ||
+				window < 1 )
+			{
+				fprintf( stderr, _("Invalid value for window, %s\n"),
+					cvalue ? cvalue : "" );
+				exit( EXIT_FAILURE );
+			}
+			if ( window > 1 ) {
+				pending = calloc( window, sizeof( pending_req ));
+				if ( pending == NULL ) {
+					perror( "malloc" );
+					exit( EXIT_FAILURE );
+				}
+			} else {
+				window = 0;
+			}
 		} else
 		{
 			fprintf( stderr, _("Invalid modify extension name: %s\n"),
@@ -209,9 +263,7 @@ int
 main( int argc, char **argv )
 {
 	char		*rbuf = NULL, *rejbuf = NULL;
-	FILE		*rejfp;
 	struct LDIFFP *ldiffp = NULL, ldifdummy = {0};
-	char		*matched_msg, *error_msg;
 	int		rc, retval, ldifrc;
 	int		len;
 	int		i = 0, lmax = 0;
@@ -235,8 +287,6 @@ main( int argc, char **argv )
 			retval = EXIT_FAILURE;
 			goto fail;
 		}
-	} else {
-		rejfp = NULL;
 	}
 
 	if ( infile != NULL ) {
@@ -259,8 +309,17 @@ main( int argc, char **argv )
 	}
 
 	if( txn ) {
-		/* start transaction */
-		rc = ldap_txn_start_s( ld, NULL, NULL, &txn_id );
+		LDAPControl bulk, *bulkctrls[2] = { NULL, NULL };
+
+		/* start transaction, settling each update on its own if bulk */
+		if( txnbulk ) {
+			bulk.ldctl_oid = LDAP_CONTROL_X_TXN_BULK;
+			BER_BVZERO( &bulk.ldctl_value );
+			bulk.ldctl_iscritical = 1;
+			bulkctrls[0] = &bulk;
+		}
+		rc = ldap_txn_start_s( ld, txnbulk ? bulkctrls : NULL, NULL,
+			&txn_id );
 		if( rc != LDAP_SUCCESS || !txn_id ) {
 			tool_perror( "ldap_txn_start_s", rc, NULL, NULL, NULL, NULL );
 			if( txn > 1 ) {
@@ -282,9 +341,10 @@ main( int argc, char **argv )
 
 	rc = 0;
 	retval = 0;
+	ldifrc = 0;
 	lineno = 1;
-	while (( rc == 0 || contoper ) && ( ldifrc = ldif_read_record( ldiffp, &nextline,
-		&rbuf, &lmax )) > 0 )
+	while (( rc == 0 || contoper ) && ( pending_rc == 0 || contoper ) &&
+		( ldifrc = ldif_read_record( ldiffp, &nextline, &rbuf, &lmax )) > 0 )
 	{
 		if ( rejfp ) {
 			len = strlen( rbuf );
@@ -296,37 +356,28 @@ main( int argc, char **argv )
 			memcpy( rejbuf, rbuf, len+1 );
 		}
 
+		/* a pipelined request takes the record over */
+		currec = rejbuf;
+		curline = lineno;
 		rc = process_ldif_rec( rbuf, lineno );
 		lineno = nextline+1;
 
 		if ( rc ) retval = rc;
 		if ( rc && rejfp ) {
-			fprintf(rejfp, _("# Error: %s (%d)"), ldap_err2string(rc), rc);
-
-			matched_msg = NULL;
-			ldap_get_option(ld, LDAP_OPT_MATCHED_DN, &matched_msg);
-			if ( matched_msg != NULL ) {
-				if ( *matched_msg != '\0' ) {
-					fprintf( rejfp, _(", matched DN: %s"), matched_msg );
-				}
-				ldap_memfree( matched_msg );
-			}
-
-			error_msg = NULL;
-			ldap_get_option(ld, LDAP_OPT_DIAGNOSTIC_MESSAGE, &error_msg);
-			if ( error_msg != NULL ) {
-				if ( *error_msg != '\0' ) {
-					fprintf( rejfp, _(", additional info: %s"), error_msg );
-				}
-				ldap_memfree( error_msg );
-			}
-			fprintf( rejfp, "\n%s\n", rejbuf );
+			write_reject( rc, rejbuf );
 		}
 
-		if (rejfp) ber_memfree( rejbuf );
+		if ( currec ) ber_memfree( currec );
+		currec = NULL;
 	}
 	ber_memfree( rbuf );
 
+	/* collect the responses still outstanding */
+	if ( window && pipeline_wait( NULL, 0 ) )
+		retval = LDAP_CANCELLED;
+	if ( pending_rc )
+		retval = pending_rc;
+
 	if ( ldifrc < 0 )
 		retval = LDAP_OTHER;
 
@@ -353,6 +404,8 @@ fail:;
 		ldif_close( ldiffp );
 	}
 
+	free( pending );
+
 	tool_exit( ld, retval );
 }
 
@@ -511,6 +564,17 @@ domodify(
 
 	if ( !dont ) {
 		int	msgid;
+		char	*ndn = NULL;
+
+		if ( window ) {
+			ldap_dn_normalize( dn->bv_val, LDAP_DN_FORMAT_LDAP, &ndn,
+				LDAP_DN_FORMAT_LDAPV3 );
+			if ( pipeline_wait( ndn ? ndn : dn->bv_val, window - 1 ) ) {
+				ldap_memfree( ndn );
+				rc = LDAP_CANCELLED;
+				goto done;
+			}
+		}
 		if ( newentry ) {
 			rc = ldap_add_ext( ld, dn->bv_val, pmods, pctrls, NULL, &msgid );
 		} else {
@@ -522,6 +586,12 @@ domodify(
 			fprintf( stderr, _("%s: update failed: %s\n"), prog, dn->bv_val );
 			tool_perror( newentry ? "ldap_add" : "ldap_modify",
 				rc, NULL, NULL, NULL, NULL );
+			ldap_memfree( ndn );
+			goto done;
+		}
+		if ( window ) {
+			rc = pipeline_add( msgid,
+				newentry ? LDAP_RES_ADD : LDAP_RES_MODIFY, dn, ndn );
 			goto done;
 		}
 		rc = process_response( ld, msgid,
@@ -553,10 +623,26 @@ dodelete(
 	assert( dn->bv_val != NULL );
 	printf( _("%sdeleting entry \"%s\"\n"), dont ? "!" : "", dn->bv_val );
 	if ( !dont ) {
+		char	*ndn = NULL;
+
+		if ( window ) {
+			ldap_dn_normalize( dn->bv_val, LDAP_DN_FORMAT_LDAP, &ndn,
+				LDAP_DN_FORMAT_LDAPV3 );
+			if ( pipeline_wait( ndn ? ndn : dn->bv_val, window - 1 ) ) {
+				ldap_memfree( ndn );
+				rc = LDAP_CANCELLED;
+				goto done;
+			}
+		}
 		rc = ldap_delete_ext( ld, dn->bv_val, pctrls, NULL, &msgid );
 		if ( rc != LDAP_SUCCESS ) {
 			fprintf( stderr, _("%s: delete failed: %s\n"), prog, dn->bv_val );
 			tool_perror( "ldap_delete", rc, NULL, NULL, NULL, NULL );
+			ldap_memfree( ndn );
+			goto done;
+		}
+		if ( window ) {
+			rc = pipeline_add( msgid, LDAP_RES_DELETE, dn, ndn );
 			goto done;
 		}
 		rc = process_response( ld, msgid, LDAP_RES_DELETE, dn );
@@ -595,6 +681,12 @@ dorename(
 			newrdn->bv_val, deleteoldrdn ? _("do not ") : "" );
 	}
 	if ( !dont ) {
+		/* a rename moves a whole subtree, let everything before
+		 * it finish and wait for its result */
+		if ( window && pipeline_wait( NULL, 0 ) ) {
+			rc = LDAP_CANCELLED;
+			goto done;
+		}
 		rc = ldap_rename( ld, dn->bv_val, newrdn->bv_val,
 						  ( newsup && newsup->bv_val ) ? newsup->bv_val : NULL,
 						  deleteoldrdn, pctrls, NULL, &msgid );
@@ -642,11 +734,8 @@ static int process_response(
 	const struct berval *dn )
 {
 	LDAPMessage	*res;
-	int		rc = LDAP_OTHER, msgtype;
+	int		rc = LDAP_OTHER;
 	struct timeval	tv = { 0, 0 };
-	int		err;
-	char		*text = NULL, *matched = NULL, **refs = NULL;
-	LDAPControl	**ctrls = NULL;
 
 	assert( dn != NULL );
 	for ( ; ; ) {
@@ -669,6 +758,20 @@ static int process_response(
 		}
 	}
 
+	return check_response( ld, res, op );
+}
+
+/* Report the result in res, which is freed */
+static int check_response(
+	LDAP *ld,
+	LDAPMessage *res,
+	int op )
+{
+	int		rc, msgtype;
+	int		err;
+	char		*text = NULL, *matched = NULL, **refs = NULL;
+	LDAPControl	**ctrls = NULL;
+
 	msgtype = ldap_msgtype( res );
 
 	rc = ldap_parse_result( ld, res, &err, &matched, &text, &refs, &ctrls, 1 );
@@ -695,3 +798,155 @@ static int process_response(
 
 	return rc;
 }
+
+static void
+write_reject( int rc, const char *rec )
+{
+	char		*matched_msg, *error_msg;
+
+	fprintf(rejfp, _("# Error: %s (%d)"), ldap_err2string(rc), rc);
+
+	matched_msg = NULL;
+	ldap_get_option(ld, LDAP_OPT_MATCHED_DN, &matched_msg);
+	if ( matched_msg != NULL ) {
+		if ( *matched_msg != '\0' ) {
+			fprintf( rejfp, _(", matched DN: %s"), matched_msg );
+		}
+		ldap_memfree( matched_msg );
+	}
+
+	error_msg = NULL;
+	ldap_get_option(ld, LDAP_OPT_DIAGNOSTIC_MESSAGE, &error_msg);
+	if ( error_msg != NULL ) {
+		if ( *error_msg != '\0' ) {
+			fprintf( rejfp, _(", additional info: %s"), error_msg );
+		}
+		ldap_memfree( error_msg );
+	}
+	fprintf( rejfp, "\n%s\n", rec );
+}
+
+/* Whether two normalized DNs are the same or one is below the other */
+static int
+dn_related( const char *a, const char *b )
+{
+	size_t la = strlen( a ), lb = strlen( b );
+
+	if ( la > lb ) {
+		const char *t = a; a = b; b = t;
+		la = lb; lb = strlen( b );
+	}
+	if ( la == 0 )
+		return 1;
+	if ( la == lb )
+		return strcasecmp( a, b ) == 0;
+	return b[lb - la - 1] == ',' && strcasecmp( b + lb - la, a ) == 0;
+}
+
+/*
+ * Collect responses to pipelined requests until no more than max are
+ * outstanding and none of them is for ndn, an entry above it or an
+ * entry below it. The server may run the requests of a connection in
+ * any order, so those have to complete before ndn is sent.
+ * Returns nonzero if interrupted.
+ */
+static int
+pipeline_wait( const char *ndn, int max )
+{
+	LDAPMessage	*res;
+	struct timeval	tv;
+	int		i, rc, msgid;
+
+	for ( ;; ) {
+		if ( npending <= max ) {
+			if ( ndn == NULL )
+				return 0;
+			for ( i = 0; i < npending; i++ ) {
+				if ( dn_related( ndn, pending[i].pr_ndn ))
+					break;
+			}
+			if ( i == npending )
+				return 0;
+		}
+
+		tv.tv_sec = 0;
+		tv.tv_usec = 100000;
+		rc = ldap_result( ld, LDAP_RES_ANY, LDAP_MSG_ALL, &tv, &res );
+		if ( npending && tool_check_abandon( ld, pending[0].pr_msgid )) {
+			for ( i = 1; i < npending; i++ )
+				tool_check_abandon( ld, pending[i].pr_msgid );
+			if ( rc > 0 )
+				ldap_msgfree( res );
+			return -1;
+		}
+		if ( rc == -1 ) {
+			ldap_get_option( ld, LDAP_OPT_RESULT_CODE, &rc );
+			tool_perror( "ldap_result", rc, NULL, NULL, NULL, NULL );
+			/* nothing more will arrive */
+			for ( i = 0; i < npending; i++ ) {
+				if ( rejfp )
+					write_reject( rc, pending[i].pr_rec );
+				ber_memfree( pending[i].pr_rec );
+				ldap_memfree( pending[i].pr_ndn );
+				free( pending[i].pr_dn );
+			}
+			npending = 0;
+			pending_rc = rc;
+			return 0;
+		}
+		if ( rc == 0 )
+			continue;
+
+		msgid = ldap_msgid( res );
+		for ( i = 0; i < npending; i++ ) {
+			if ( pending[i].pr_msgid == msgid )
+				break;
+		}
+		if ( i == npending ) {
+			/* e.g. a notice of disconnection */
+			ldap_msgfree( res );
+			continue;
+		}
+
+		rc = check_response( ld, res, pending[i].pr_op );
+		if ( rc != LDAP_SUCCESS ) {
+			fprintf( stderr, _("%s: update failed: %s (line %lu)\n"),
+				prog, pending[i].pr_dn, pending[i].pr_lineno );
+			if ( rejfp )
+				write_reject( rc, pending[i].pr_rec );
+			pending_rc = rc;
+		} else if ( verbose ) {
+			printf( _("%s complete: %s\n"),
+				res2str( pending[i].pr_op ) + BER_STRLENOF( "ldap_" ),
+				pending[i].pr_dn );
+		}
+		ber_memfree( pending[i].pr_rec );
+		ldap_memfree( pending[i].pr_ndn );
+		free( pending[i].pr_dn );
+		pending[i] = pending[--npending];
+	}
+}
+
+/* Remember a request sent with -E window, its result is collected
+ * by pipeline_wait(). Takes ndn over.
+ */
+static int
+pipeline_add( int msgid, int op, const struct berval *dn, char *ndn )
+{
+	pending_req *pr = &pending[npending];
+
+	assert( npending < window );
+	pr->pr_msgid = msgid;
+	pr->pr_op = op;
+	pr->pr_lineno = curline;
+	pr->pr_dn = strdup( dn->bv_val );
+	pr->pr_ndn = ndn ? ndn : ldap_strdup( dn->bv_val );
+	pr->pr_rec = currec;
+	currec = NULL;
+	if ( pr->pr_dn == NULL || pr->pr_ndn == NULL ) {
+		perror( "malloc" );
+		exit( EXIT_FAILURE );
+	}
+	npending++;
+	return LDAP_SUCCESS;
+}
@@ -1673,6 +1673,23 @@ getNextPage:
 }
 
 
+/* Take what has already arrived without flushing the output, so
+ * large results are written in full buffers; flush before waiting.
+ */
+static int
+search_result( LDAP *ld, int all, struct timeval *tvp, LDAPMessage **res )
+{
+	struct timeval	poll = { 0, 0 };
+	int		rc;
+
+	rc = ldap_result( ld, LDAP_RES_ANY, all, &poll, res );
+	if ( rc == 0 ) {
+		fflush( stdout );
+		rc = ldap_result( ld, LDAP_RES_ANY, all, tvp, res );
+	}
+	return rc;
+}
+
 static int dosearch(
 	LDAP	*ld,
 	char	*base,
@@ -1781,7 +1798,7 @@ again:
 		tv.tv_sec = timelimit;
 	}
 
-	while ((rc = ldap_result( ld, LDAP_RES_ANY,
+	while ((rc = search_result( ld,
 		sortattr ? LDAP_MSG_ALL : LDAP_MSG_ONE,
 		tvp, &res )) > 0 )
 	{
@@ -1879,7 +1896,6 @@ again:
 		}
 
 		ldap_msgfree( res );
-		fflush( stdout );
 	}
 
 done:
@@ -1925,6 +1941,54 @@ done:
 	return( rc2 );
 }
 
+static void
+print_value( char *type, struct berval *val )
+{
+	char	tmpfname[ 256 ];
+	char	url[ 256 ];
+	FILE	*tmpfp;
+	int	tmpfd;
+
+	if ( vals2tmp > 1 || ( vals2tmp &&
+		ldif_is_not_printable( val->bv_val, val->bv_len )))
+	{
+		/* write value to file */
+		snprintf( tmpfname, sizeof tmpfname,
+			"%s" LDAP_DIRSEP "ldapsearch-%s-XXXXXX",
+			tmpdir, type );
+		tmpfp = NULL;
+
+		tmpfd = mkstemp( tmpfname );
+
+		if ( tmpfd < 0  ) {
+			perror( tmpfname );
+			return;
+		}
+
+		if (( tmpfp = fdopen( tmpfd, "w")) == NULL ) {
+			perror( tmpfname );
+			return;
+		}
+
+		if ( fwrite( val->bv_val, val->bv_len, 1, tmpfp ) == 0 ) {
+			perror( tmpfname );
+			fclose( tmpfp );
+			return;
+		}
+
+		fclose( tmpfp );
+
+		snprintf( url, sizeof url, "%s%s", urlpre,
+			&tmpfname[strlen(tmpdir) + sizeof(LDAP_DIRSEP) - 1] );
+
+		urlize( url );
+		tool_write_ldif( LDIF_PUT_URL, type, url, strlen( url ));
+
+	} else {
+		tool_write_ldif( LDIF_PUT_VALUE, type, val->bv_val, val->bv_len );
+	}
+}
+
 /* This is the proposed new way of doing things.
  * It is more efficient, but the API is non-standard.
  */
@@ -1935,13 +1999,11 @@ print_entry(
 	int		attrsonly)
 {
 	char		*ufn = NULL;
-	char	tmpfname[ 256 ];
-	char	url[ 256 ];
-	int			i, rc;
+	int			rc;
 	BerElement		*ber = NULL;
-	struct berval		bv, *bvals, **bvp = &bvals;
+	struct berval		bv;
+	ber_len_t		len;
 	LDAPControl **ctrls = NULL;
-	FILE		*tmpfp;
 
 	rc = ldap_get_dn_ber( ld, entry, &ber, &bv );
 
@@ -1972,63 +2034,36 @@ print_entry(
 
 	if( ufn != NULL ) ldap_memfree( ufn );
 
-	if ( attrsonly ) bvp = NULL;
+	/* Walk the attributes in place: the type is terminated in the
+	 * message buffer, the values are passed on by length, and no
+	 * array of them is built.
+	 */
+	while ( ber != NULL && ber_peek_tag( ber, &len ) != LBER_DEFAULT ) {
+		ber_tag_t	tag;
+		char		*last;
 
-	for ( rc = ldap_get_attribute_ber( ld, entry, ber, &bv, bvp );
-		rc == LDAP_SUCCESS;
-		rc = ldap_get_attribute_ber( ld, entry, ber, &bv, bvp ) )
-	{
-		if (bv.bv_val == NULL) break;
+		if ( ber_scanf( ber, "{m" /*}*/, &bv ) == LBER_ERROR ) {
+			break;
+		}
 
 		if ( attrsonly ) {
 			tool_write_ldif( LDIF_PUT_NOVALUE, bv.bv_val, NULL, 0 );
+			if ( ber_scanf( ber, /*{*/ "x}" ) == LBER_ERROR ) {
+				break;
+			}
+			continue;
+		}
 
-		} else if ( bvals ) {
-			for ( i = 0; bvals[i].bv_val != NULL; i++ ) {
-				if ( vals2tmp > 1 || ( vals2tmp &&
-					ldif_is_not_printable( bvals[i].bv_val, bvals[i].bv_len )))
-				{
-					int tmpfd;
-					/* write value to file */
-					snprintf( tmpfname, sizeof tmpfname,
-						"%s" LDAP_DIRSEP "ldapsearch-%s-XXXXXX",
-						tmpdir, bv.bv_val );
-					tmpfp = NULL;
-
-					tmpfd = mkstemp( tmpfname );
-
-					if ( tmpfd < 0  ) {
-						perror( tmpfname );
-						continue;
-					}
-
-					if (( tmpfp = fdopen( tmpfd, "w")) == NULL ) {
-						perror( tmpfname );
-						continue;
-					}
-
-					if ( fwrite( bvals[ i ].bv_val,
-						bvals[ i ].bv_len, 1, tmpfp ) == 0 )
-					{
-						perror( tmpfname );
-						fclose( tmpfp );
-						continue;
-					}
-
-					fclose( tmpfp );
-
-					snprintf( url, sizeof url, "%s%s", urlpre,
-						&tmpfname[strlen(tmpdir) + sizeof(LDAP_DIRSEP) - 1] );
-
-					urlize( url );
-					tool_write_ldif( LDIF_PUT_URL, bv.bv_val, url, strlen( url ));
+		for ( tag = ber_first_element( ber, &len, &last );
+			tag != LBER_DEFAULT;
+			tag = ber_next_element( ber, &len, last ) )
+		{
+			struct berval	val;
 
-				} else {
-					tool_write_ldif( LDIF_PUT_VALUE, bv.bv_val,
-						bvals[ i ].bv_val, bvals[ i ].bv_len );
-				}
+			if ( ber_get_stringbv( ber, &val, LBER_BV_NOTERM ) == LBER_DEFAULT ) {
+				break;
 			}
-			ber_memfree( bvals );
+			print_value( bv.bv_val, &val );
 		}
 	}
 
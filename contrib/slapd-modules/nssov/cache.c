@@ -0,0 +1,262 @@
+/* cache.c - nssov response cache */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2008-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "nssov.h"
+
+#include "lutil.h"
+
+/*
+ * Encoded responses to the passwd, group and netgroup lookups are kept
+ * here, keyed by the request action, its raw parameters and the identity
+ * of the caller, since access controls may give different callers
+ * different answers. A response is reused until it expires or until
+ * any write to the database, which flushes the whole cache; the response
+ * to a group enumeration thus serves as a snapshot of the group map
+ * between updates.
+ *
+ * Entries are kept in an AVL tree for lookups and on a list in order of
+ * last use, the least recently used one is dropped when the cache is
+ * full.
+ */
+
+typedef struct nssov_cache_entry {
+	int32_t ce_action;
+	struct berval ce_args;
+	struct berval ce_ndn;
+	struct berval ce_resp;
+	time_t ce_expire;
+	struct nssov_cache_entry *ce_prev, *ce_next;
+} nssov_cache_entry;
+
+static int
+nssov_cache_cmp( const void *v1, const void *v2 )
+{
+	const nssov_cache_entry *c1 = v1, *c2 = v2;
+	int rc;
+
+	if ( c1->ce_action != c2->ce_action )
+		return c1->ce_action < c2->ce_action ? -1 : 1;
+	rc = c1->ce_args.bv_len - c2->ce_args.bv_len;
+	if ( rc == 0 )
+		rc = memcmp( c1->ce_args.bv_val, c2->ce_args.bv_val, c1->ce_args.bv_len );
+	if ( rc == 0 )
+		rc = ber_bvcmp( &c1->ce_ndn, &c2->ce_ndn );
+	return rc;
+}
+
+static void
+nssov_cache_entry_free( void *v )
+{
+	ch_free( v );
+}
+
+/* unlink from the LRU list, caller holds ni_cache_mutex */
+static void
+nssov_cache_unlink( nssov_info *ni, nssov_cache_entry *ce )
+{
+	if ( ce->ce_prev )
+		ce->ce_prev->ce_next = ce->ce_next;
+	else
+		ni->ni_cache_head = ce->ce_next;
+	if ( ce->ce_next )
+		ce->ce_next->ce_prev = ce->ce_prev;
+	else
+		ni->ni_cache_tail = ce->ce_prev;
+	ce->ce_prev = ce->ce_next = NULL;
+}
+
+/* put at the head of the LRU list, caller holds ni_cache_mutex */
+static void
+nssov_cache_link( nssov_info *ni, nssov_cache_entry *ce )
+{
+	ce->ce_prev = NULL;
+	ce->ce_next = ni->ni_cache_head;
+	if ( ni->ni_cache_head )
+		ni->ni_cache_head->ce_prev = ce;
+	else
+		ni->ni_cache_tail = ce;
+	ni->ni_cache_head = ce;
+}
+
+/* caller holds ni_cache_mutex */
+static void
+nssov_cache_drop( nssov_info *ni, nssov_cache_entry *ce )
+{
+	nssov_cache_unlink( ni, ce );
+	avl_delete( &ni->ni_cache, ce, nssov_cache_cmp );
+	ni->ni_cache_num--;
+	nssov_cache_entry_free( ce );
+}
+
+/* Read the parameters of a cacheable request without consuming them.
+ * Returns -1 if the request is not cacheable. The parameters end up in
+ * buf, which must be at least NSSOV_CACHE_MAXARGS bytes. */
+int
+nssov_cache_args( TFILE *fp, int32_t action, char *buf, struct berval *args )
+{
+	int32_t len;
+
+	args->bv_val = buf;
+	args->bv_len = 0;
+
+	switch ( action ) {
+	case NSLCD_ACTION_PASSWD_ALL:
+	case NSLCD_ACTION_GROUP_ALL:
+		return 0;
+
+	case NSLCD_ACTION_PASSWD_BYUID:
+	case NSLCD_ACTION_GROUP_BYGID:
+		len = 0;
+		break;
+
+	case NSLCD_ACTION_PASSWD_BYNAME:
+	case NSLCD_ACTION_GROUP_BYNAME:
+	case NSLCD_ACTION_GROUP_BYMEMBER:
+	case NSLCD_ACTION_NETGROUP_BYNAME:
+		len = -1;
+		break;
+
+	default:
+		return -1;
+	}
+
+	tio_mark( fp );
+	if ( tio_read( fp, buf, sizeof(int32_t) ) )
+		goto fail;
+	args->bv_len = sizeof(int32_t);
+	if ( len < 0 ) {
+		AC_MEMCPY( &len, buf, sizeof(int32_t) );
+		len = ntohl( len );
+		if ( len < 0 || len > NSSOV_CACHE_MAXARGS - (int32_t)sizeof(int32_t) ||
+			tio_read( fp, buf + sizeof(int32_t), len ) )
+			goto fail;
+		args->bv_len += len;
+	}
+	if ( tio_reset( fp ) == 0 )
+		return 0;
+
+fail:
+	/* let the request handler deal with whatever is left */
+	tio_reset( fp );
+	return -1;
+}
+
+/* Send a cached response. Returns 0 on a hit, otherwise the current
+ * generation of the cache is returned in gen, to be passed on to
+ * nssov_cache_put() once the response has been produced. */
+int
+nssov_cache_get( nssov_info *ni, TFILE *fp, int32_t action,
+	struct berval *args, struct berval *ndn, unsigned long *gen )
+{
+	nssov_cache_entry ce, *cp;
+	struct berval resp = BER_BVNULL;
+	time_t now = slap_get_time();
+	int rc;
+
+	ce.ce_action = action;
+	ce.ce_args = *args;
+	ce.ce_ndn = *ndn;
+
+	ldap_pvt_thread_mutex_lock( &ni->ni_cache_mutex );
+	*gen = ni->ni_cache_gen;
+	cp = avl_find( ni->ni_cache, &ce, nssov_cache_cmp );
+	if ( cp ) {
+		if ( cp->ce_expire <= now ) {
+			nssov_cache_drop( ni, cp );
+		} else {
+			nssov_cache_unlink( ni, cp );
+			nssov_cache_link( ni, cp );
+			ber_dupbv( &resp, &cp->ce_resp );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &ni->ni_cache_mutex );
+
+	if ( BER_BVISNULL( &resp ))
+		return -1;
+
+	Debug( LDAP_DEBUG_TRACE, "nssov_cache_get: hit for action %d\n",
+		(int)action );
+
+	/* consume the request parameters and replay the response */
+	rc = 0;
+	if ( args->bv_len && tio_skip( fp, args->bv_len ))
+		rc = -1;
+	if ( rc == 0 && tio_write( fp, resp.bv_val, resp.bv_len ))
+		rc = -1;
+	ch_free( resp.bv_val );
+	if ( rc )
+		Debug( LDAP_DEBUG_ANY, "nssov: error writing cached response to client\n" );
+	return 0;
+}
+
+void
+nssov_cache_put( nssov_info *ni, unsigned long gen, int32_t action,
+	struct berval *args, struct berval *ndn, void *resp, size_t len )
+{
+	nssov_cache_entry *ce;
+	char *ptr;
+
+	if ( ni->ni_cache_max <= 0 )
+		return;
+
+	ce = ch_malloc( sizeof(nssov_cache_entry) + args->bv_len +
+		ndn->bv_len + 1 + len );
+	ce->ce_action = action;
+	ptr = (char *)(ce+1);
+	ce->ce_args.bv_val = ptr;
+	ce->ce_args.bv_len = args->bv_len;
+	AC_MEMCPY( ptr, args->bv_val, args->bv_len );
+	ptr += args->bv_len;
+	ce->ce_ndn.bv_val = ptr;
+	ce->ce_ndn.bv_len = ndn->bv_len;
+	ptr = lutil_strncopy( ptr, ndn->bv_val, ndn->bv_len );
+	*ptr++ = '\0';
+	ce->ce_resp.bv_val = ptr;
+	ce->ce_resp.bv_len = len;
+	AC_MEMCPY( ptr, resp, len );
+	ce->ce_expire = slap_get_time() + ni->ni_cache_ttl;
+	ce->ce_prev = ce->ce_next = NULL;
+
+	ldap_pvt_thread_mutex_lock( &ni->ni_cache_mutex );
+	/* drop it if the database changed while it was being produced, or
+	 * if another thread got there first */
+	if ( gen != ni->ni_cache_gen ||
+		avl_insert( &ni->ni_cache, ce, nssov_cache_cmp, avl_dup_error ))
+	{
+		ldap_pvt_thread_mutex_unlock( &ni->ni_cache_mutex );
+		nssov_cache_entry_free( ce );
+		return;
+	}
+	nssov_cache_link( ni, ce );
+	ni->ni_cache_num++;
+	while ( ni->ni_cache_num > ni->ni_cache_max )
+		nssov_cache_drop( ni, ni->ni_cache_tail );
+	ldap_pvt_thread_mutex_unlock( &ni->ni_cache_mutex );
+}
+
+void
+nssov_cache_flush( nssov_info *ni )
+{
+	ldap_pvt_thread_mutex_lock( &ni->ni_cache_mutex );
+	ni->ni_cache_gen++;
+	if ( ni->ni_cache ) {
+		avl_free( ni->ni_cache, nssov_cache_entry_free );
+		ni->ni_cache = NULL;
+		ni->ni_cache_head = ni->ni_cache_tail = NULL;
+		ni->ni_cache_num = 0;
+	}
+	ldap_pvt_thread_mutex_unlock( &ni->ni_cache_mutex );
+}
@@ -68,6 +68,7 @@ struct tio_fileinfo {
   int readtimeout;
   int writetimeout;
   int read_resettable; /* whether the tio_reset() function can be called */
+  struct tio_buffer capture; /* copy of written data, see tio_capture() */
 #ifdef DEBUG_TIO_STATS
   /* this is used to collect statistics on the use of the streams
      and can be used to tune the buffer sizes */
@@ -145,6 +146,7 @@ TFILE *tio_fdopen(int fd, int readtimeout, int writetimeout,
   fp->readtimeout = readtimeout;
   fp->writetimeout = writetimeout;
   fp->read_resettable = 0;
+  fp->capture.buffer = NULL;
 #ifdef DEBUG_TIO_STATS
   fp->byteswritten = 0;
   fp->bytesread = 0;
@@ -416,12 +418,42 @@ static int tio_flush_nonblock(TFILE *fp)
   return tio_writebuf(fp);
 }
 
+/* append the data to the capture buffer, if any; capturing is silently
+   abandoned if the data would grow it beyond its maximum size */
+static void tio_capture_append(TFILE *fp, const void *buf, size_t count)
+{
+  uint8_t *tmp;
+  size_t newsz;
+  if (fp->capture.buffer == NULL)
+    return;
+  if (fp->capture.len + count > fp->capture.size)
+  {
+    newsz = fp->capture.size;
+    while (newsz < fp->capture.len + count)
+      newsz *= 2;
+    if ((fp->capture.maxsize > 0) && (newsz > fp->capture.maxsize))
+      newsz = fp->capture.maxsize;
+    if ((fp->capture.len + count > newsz) ||
+        ((tmp = realloc(fp->capture.buffer, newsz)) == NULL))
+    {
+      free(fp->capture.buffer);
+      fp->capture.buffer = NULL;
+      return;
+    }
+    fp->capture.buffer = tmp;
+    fp->capture.size = newsz;
+  }
+  memcpy(fp->capture.buffer + fp->capture.len, buf, count);
+  fp->capture.len += count;
+}
+
 int tio_write(TFILE *fp, const void *buf, size_t count)
 {
   size_t fr;
   uint8_t *tmp;
   size_t newsz;
   const uint8_t *ptr = (const uint8_t *)buf;
+  tio_capture_append(fp, buf, count);
   /* keep filling the buffer until we have buffered everything */
   while (count > 0)
   {
@@ -471,6 +503,27 @@ int tio_write(TFILE *fp, const void *buf, size_t count)
   return 0;
 }
 
+int tio_capture(TFILE *fp, size_t maxsize)
+{
+  free(fp->capture.buffer);
+  fp->capture.size = 1024;
+  if ((maxsize > 0) && (fp->capture.size > maxsize))
+    fp->capture.size = maxsize;
+  fp->capture.maxsize = maxsize;
+  fp->capture.start = 0;
+  fp->capture.len = 0;
+  fp->capture.buffer = (uint8_t *)malloc(fp->capture.size);
+  return (fp->capture.buffer == NULL) ? -1 : 0;
+}
+
+void *tio_captured(TFILE *fp, size_t *len)
+{
+  void *buf = fp->capture.buffer;
+  *len = fp->capture.len;
+  fp->capture.buffer = NULL;
+  return buf;
+}
+
 int tio_close(TFILE *fp)
 {
   int retv;
@@ -489,6 +542,7 @@ int tio_close(TFILE *fp)
   memset(fp->writebuffer.buffer, 0, fp->writebuffer.size);
   free(fp->readbuffer.buffer);
   free(fp->writebuffer.buffer);
+  free(fp->capture.buffer);
   /* free the tio struct itself */
   free(fp);
   /* return the result of the earlier operations */
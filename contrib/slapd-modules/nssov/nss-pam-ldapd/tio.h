@@ -67,6 +67,15 @@ int tio_write(TFILE *fp, const void *buf, size_t count);
 /* Write out all buffered data to the stream. */
 int tio_flush(TFILE *fp);
 
+/* Start keeping a copy of all data written to the stream from now on,
+   up to maxsize bytes (0 for no limit). */
+int tio_capture(TFILE *fp, size_t maxsize);
+
+/* Stop capturing and return the data written since tio_capture(), the
+   caller should free() it. Returns NULL if capturing was abandoned because
+   the data exceeded the maximum size. */
+void *tio_captured(TFILE *fp, size_t *len);
+
 /* Flush the streams and closes the underlying file descriptor. */
 int tio_close(TFILE *fp);
 
@@ -41,7 +41,7 @@ AttributeDescription *nssov_pam_svc_ad;
 
 /* buffer sizes for I/O */
 #define READBUFFER_MINSIZE 32
-#define READBUFFER_MAXSIZE 64
+#define READBUFFER_MAXSIZE (2*NSSOV_CACHE_MAXARGS)	/* room to peek at cache keys */
 #define WRITEBUFFER_MINSIZE 64
 #define WRITEBUFFER_MAXSIZE 64*1024
 
@@ -296,6 +296,10 @@ static void handleconnection(nssov_info *ni,int sock,Operation *op)
   char authid[sizeof("gidNumber=4294967295+uidNumber=424967295,cn=peercred,cn=external,cn=auth")];
   char peerbuf[8];
   struct berval peerbv = { sizeof(peerbuf), peerbuf };
+  char argbuf[NSSOV_CACHE_MAXARGS];
+  struct berval args;
+  unsigned long gen;
+  int cacheable = 0, rc = 0;
 
   /* log connection */
   if (LUTIL_GETPEEREID(sock,&uid,&gid,&peerbv))
@@ -332,6 +336,16 @@ static void handleconnection(nssov_info *ni,int sock,Operation *op)
     (void)tio_close(fp);
     return;
   }
+  /* answer from the cache if we can, otherwise record the response */
+  if (ni->ni_cache_ttl > 0 && nssov_cache_args(fp,action,argbuf,&args)==0)
+  {
+    if (nssov_cache_get(ni,fp,action,&args,&op->o_ndn,&gen)==0)
+    {
+      (void)tio_close(fp);
+      return;
+    }
+    cacheable = (tio_capture(fp,NSSOV_CACHE_MAXRESP)==0);
+  }
   /* handle request */
   switch (action)
   {
@@ -340,20 +354,20 @@ static void handleconnection(nssov_info *ni,int sock,Operation *op)
     case NSLCD_ACTION_ETHER_BYNAME:     (void)nssov_ether_byname(ni,fp,op); break;
     case NSLCD_ACTION_ETHER_BYETHER:    (void)nssov_ether_byether(ni,fp,op); break;
     case NSLCD_ACTION_ETHER_ALL:        (void)nssov_ether_all(ni,fp,op); break;
-    case NSLCD_ACTION_GROUP_BYNAME:     (void)nssov_group_byname(ni,fp,op); break;
-    case NSLCD_ACTION_GROUP_BYGID:      (void)nssov_group_bygid(ni,fp,op); break;
-    case NSLCD_ACTION_GROUP_BYMEMBER:   (void)nssov_group_bymember(ni,fp,op); break;
-    case NSLCD_ACTION_GROUP_ALL:        (void)nssov_group_all(ni,fp,op); break;
+    case NSLCD_ACTION_GROUP_BYNAME:     rc=nssov_group_byname(ni,fp,op); break;
+    case NSLCD_ACTION_GROUP_BYGID:      rc=nssov_group_bygid(ni,fp,op); break;
+    case NSLCD_ACTION_GROUP_BYMEMBER:   rc=nssov_group_bymember(ni,fp,op); break;
+    case NSLCD_ACTION_GROUP_ALL:        rc=nssov_group_all(ni,fp,op); break;
     case NSLCD_ACTION_HOST_BYNAME:      (void)nssov_host_byname(ni,fp,op); break;
     case NSLCD_ACTION_HOST_BYADDR:      (void)nssov_host_byaddr(ni,fp,op); break;
     case NSLCD_ACTION_HOST_ALL:         (void)nssov_host_all(ni,fp,op); break;
-    case NSLCD_ACTION_NETGROUP_BYNAME:  (void)nssov_netgroup_byname(ni,fp,op); break;
+    case NSLCD_ACTION_NETGROUP_BYNAME:  rc=nssov_netgroup_byname(ni,fp,op); break;
     case NSLCD_ACTION_NETWORK_BYNAME:   (void)nssov_network_byname(ni,fp,op); break;
     case NSLCD_ACTION_NETWORK_BYADDR:   (void)nssov_network_byaddr(ni,fp,op); break;
     case NSLCD_ACTION_NETWORK_ALL:      (void)nssov_network_all(ni,fp,op); break;
-    case NSLCD_ACTION_PASSWD_BYNAME:    (void)nssov_passwd_byname(ni,fp,op); break;
-    case NSLCD_ACTION_PASSWD_BYUID:     (void)nssov_passwd_byuid(ni,fp,op); break;
-    case NSLCD_ACTION_PASSWD_ALL:       (void)nssov_passwd_all(ni,fp,op); break;
+    case NSLCD_ACTION_PASSWD_BYNAME:    rc=nssov_passwd_byname(ni,fp,op); break;
+    case NSLCD_ACTION_PASSWD_BYUID:     rc=nssov_passwd_byuid(ni,fp,op); break;
+    case NSLCD_ACTION_PASSWD_ALL:       rc=nssov_passwd_all(ni,fp,op); break;
     case NSLCD_ACTION_PROTOCOL_BYNAME:  (void)nssov_protocol_byname(ni,fp,op); break;
     case NSLCD_ACTION_PROTOCOL_BYNUMBER:(void)nssov_protocol_bynumber(ni,fp,op); break;
     case NSLCD_ACTION_PROTOCOL_ALL:     (void)nssov_protocol_all(ni,fp,op); break;
@@ -375,6 +389,15 @@ static void handleconnection(nssov_info *ni,int sock,Operation *op)
       Debug( LDAP_DEBUG_ANY,"nssov: invalid request id: %d",(int)action );
       break;
   }
+  if (cacheable)
+  {
+    void *resp;
+    size_t len;
+    resp = tio_captured(fp,&len);
+    if (resp != NULL && rc == 0)
+      nssov_cache_put(ni,gen,action,&args,&op->o_ndn,resp,len);
+    free(resp);
+  }
   /* we're done with the request */
   (void)tio_close(fp);
   return;
@@ -560,6 +583,18 @@ static ConfigTable nsscfg[] = {
 			"DESC 'Password Manager Pwd' "
 			"EQUALITY octetStringMatch "
 			"SYNTAX OMsOctetString SINGLE-VALUE )", NULL, NULL },
+	{ "nssov-cache-ttl", "seconds", 2, 2, 0, ARG_OFFSET|ARG_INT,
+		(void *)offsetof(struct nssov_info, ni_cache_ttl),
+		"(OLcfgCtAt:3.15 NAME 'olcNssCacheTTL' "
+			"DESC 'Seconds to keep passwd, group and netgroup responses, 0 disables' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "nssov-cache-size", "entries", 2, 2, 0, ARG_OFFSET|ARG_INT,
+		(void *)offsetof(struct nssov_info, ni_cache_max),
+		"(OLcfgCtAt:3.16 NAME 'olcNssCacheSize' "
+			"DESC 'Maximum number of cached responses' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0,0,0, ARG_IGNORED }
 };
 
@@ -571,7 +606,8 @@ static ConfigOCs nssocs[] = {
 		"MAY ( olcNssSsd $ olcNssMap $ olcNssPam $ olcNssPamDefHost $ "
 			"olcNssPamGroupDN $ olcNssPamGroupAD $ "
 			"olcNssPamMinUid $ olcNssPamMaxUid $ olcNssPamSession $ "
-			"olcNssPamTemplateAD $ olcNssPamTemplate ) )",
+			"olcNssPamTemplateAD $ olcNssPamTemplate $ "
+			"olcNssCacheTTL $ olcNssCacheSize ) )",
 		Cft_Overlay, nsscfg },
 	{ NULL, 0, NULL }
 };
@@ -795,6 +831,9 @@ nssov_db_init(
 	ni->ni_db = be->bd_self;
 	ni->ni_pam_opts = NI_PAM_UID2DN;
 
+	ni->ni_cache_max = 4096;
+	ldap_pvt_thread_mutex_init( &ni->ni_cache_mutex );
+
 	return 0;
 }
 
@@ -803,9 +842,38 @@ nssov_db_destroy(
 	BackendDB *be,
 	ConfigReply *cr )
 {
+	slap_overinst *on = (slap_overinst *)be->bd_info;
+	nssov_info *ni = on->on_bi.bi_private;
+
+	if ( ni ) {
+		nssov_cache_flush( ni );
+		ldap_pvt_thread_mutex_destroy( &ni->ni_cache_mutex );
+	}
 	return 0;
 }
 
+/* any successful write may change what the maps look like */
+static int
+nssov_response( Operation *op, SlapReply *rs )
+{
+	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
+	nssov_info *ni = on->on_bi.bi_private;
+
+	if ( rs->sr_type == REP_RESULT && rs->sr_err == LDAP_SUCCESS &&
+		ni->ni_cache_ttl > 0 )
+	{
+		switch ( op->o_tag ) {
+		case LDAP_REQ_ADD:
+		case LDAP_REQ_DELETE:
+		case LDAP_REQ_MODIFY:
+		case LDAP_REQ_MODRDN:
+			nssov_cache_flush( ni );
+			break;
+		}
+	}
+	return SLAP_CB_CONTINUE;
+}
+
 static int
 nssov_db_open(
 	BackendDB *be,
@@ -975,6 +1043,7 @@ nssov_initialize( void )
 	nssov.on_bi.bi_db_destroy = nssov_db_destroy;
 	nssov.on_bi.bi_db_open = nssov_db_open;
 	nssov.on_bi.bi_db_close = nssov_db_close;
+	nssov.on_response = nssov_response;
 
 	nssov.on_bi.bi_cf_ocs = nssocs;
 
@@ -92,6 +92,15 @@ typedef struct nssov_info
 	struct berval ni_pam_password_prohibit_message;
 	struct berval ni_pam_pwdmgr_dn;
 	struct berval ni_pam_pwdmgr_pwd;
+
+	/* response cache, see cache.c */
+	int ni_cache_ttl;
+	int ni_cache_max;
+	int ni_cache_num;
+	unsigned long ni_cache_gen;	/* bumped by every flush */
+	Avlnode *ni_cache;
+	struct nssov_cache_entry *ni_cache_head, *ni_cache_tail;
+	ldap_pvt_thread_mutex_t ni_cache_mutex;
 } nssov_info;
 
 #define NI_PAM_USERHOST		1	/* old style host checking */
@@ -107,6 +116,17 @@ typedef struct nssov_info
 extern AttributeDescription *nssov_pam_host_ad;
 extern AttributeDescription *nssov_pam_svc_ad;
 
+/* largest request parameters and response kept in the cache */
+#define NSSOV_CACHE_MAXARGS	256
+#ifndef NSSOV_CACHE_MAXRESP
+#define NSSOV_CACHE_MAXRESP	(16*1024*1024)
+#endif
+
+int nssov_cache_args(TFILE *fp,int32_t action,char *buf,struct berval *args);
+int nssov_cache_get(nssov_info *ni,TFILE *fp,int32_t action,struct berval *args,struct berval *ndn,unsigned long *gen);
+void nssov_cache_put(nssov_info *ni,unsigned long gen,int32_t action,struct berval *args,struct berval *ndn,void *resp,size_t len);
+void nssov_cache_flush(nssov_info *ni);
+
 /* Read the default configuration file. */
 void nssov_cfg_init(nssov_info *ni,const char *fname);
 
@@ -341,7 +361,8 @@ int pam_pwmod(nssov_info *ni,TFILE *fp,Operation *op,uid_t calleruid);
 	op->o_bd->be_search( op, &rs ); \
 	filter_free_x( op, op->ors_filter, 1 ); \
 	WRITE_INT32(fp,NSLCD_RESULT_END); \
-    return 0; \
+    /* a failed search is not a response worth caching */ \
+    return rs.sr_err == LDAP_SUCCESS ? 0 : 1; \
   }
 
 #endif /* NSSOV_H */
@@ -59,6 +59,14 @@ struct tavlnode {
 	signed char		avl_bf;
 };
 
+typedef struct iavlnode IAvlnode;
+
+struct iavlnode {
+	struct iavlnode	*avl_link[2];
+	struct iavlnode	*avl_up;
+	signed char		avl_bf;
+};
+
 #ifdef AVL_INTERNAL
 
 /* balance factor values */
@@ -153,6 +161,44 @@ tavl_end LDAP_P((TAvlnode *, int direction));
 LDAP_AVL_F( TAvlnode* )
 tavl_next LDAP_P((TAvlnode *, int direction));
 
+/* Intrusive trees: an IAvlnode is embedded in each element, at offset
+ * avl_offset. See iavl.c.
+ */
+typedef struct iavltree {
+	IAvlnode	*avl_root;
+	AVL_CMP		avl_cmp;
+	int			avl_offset;
+} IAvltree;
+
+#define	IAVL_INIT(type,member,cmp)	{ NULL, (cmp), offsetof(type, member) }
+
+LDAP_AVL_F( void )
+iavl_init LDAP_P((IAvltree *, AVL_CMP, int offset));
+
+LDAP_AVL_F( int )
+iavl_free LDAP_P((IAvltree *, AVL_FREE dfree));
+
+LDAP_AVL_F( int )
+iavl_insert LDAP_P((IAvltree *, void*, AVL_DUP));
+
+LDAP_AVL_F( void* )
+iavl_remove LDAP_P((IAvltree *, void*));
+
+LDAP_AVL_F( void* )
+iavl_delete LDAP_P((IAvltree *, const void*));
+
+LDAP_AVL_F( void* )
+iavl_find LDAP_P((IAvltree *, const void*));
+
+LDAP_AVL_F( void* )
+iavl_find3 LDAP_P((IAvltree *, const void*, int *ret));
+
+LDAP_AVL_F( void* )
+iavl_end LDAP_P((IAvltree *, int direction));
+
+LDAP_AVL_F( void* )
+iavl_next LDAP_P((IAvltree *, void*, int direction));
+
 /* apply traversal types */
 #define AVL_PREORDER	1
 #define AVL_INORDER	2
@@ -99,6 +99,7 @@ LDAP_BEGIN_DECL
 #define LBER_OPT_BER_TOTAL_BYTES		0x04
 #define LBER_OPT_BER_BYTES_TO_WRITE		0x05
 #define LBER_OPT_BER_MEMCTX				0x06
+#define LBER_OPT_BER_BYTES_UNFLUSHED	0x07	/* get only */
 
 #define LBER_OPT_DEBUG_LEVEL	LBER_OPT_BER_DEBUG
 #define LBER_OPT_REMAINING_BYTES	LBER_OPT_BER_REMAINING_BYTES
@@ -431,6 +432,21 @@ LBER_F( int )
 ber_put_set LDAP_P((
 	BerElement *ber ));
 
+LBER_F( ber_len_t )
+ber_sizeof_int LDAP_P((
+	ber_int_t num ));
+
+LBER_F( ber_len_t )
+ber_sizeof_header LDAP_P((
+	ber_tag_t tag,
+	ber_len_t len ));
+
+LBER_F( int )
+ber_put_header LDAP_P((
+	BerElement *ber,
+	ber_tag_t tag,
+	ber_len_t len ));
+
 LBER_F( int )
 ber_printf LDAP_P((
 	BerElement *ber,
@@ -591,6 +607,9 @@ LBER_V( Sockbuf_IO ) ber_sockbuf_io_readahead;
 LBER_V( Sockbuf_IO ) ber_sockbuf_io_fd;
 LBER_V( Sockbuf_IO ) ber_sockbuf_io_debug;
 LBER_V( Sockbuf_IO ) ber_sockbuf_io_udp;
+/* only defined if liblber was built with zlib; the argument is
+ * a pointer to the int compression level, or NULL for the default */
+LBER_V( Sockbuf_IO ) ber_sockbuf_io_zlib;
 
 /*
  * LBER memory.c
@@ -60,6 +60,12 @@ ber_pvt_log_printf LDAP_P((
 	const char *fmt,
 	... )) LDAP_GCCATTR((format(printf, 3, 4)));
 
+/*
+ * io.c
+ */
+LBER_F( void )
+ber_pvt_ber_recycle LDAP_P(( BerElement *ber, ber_len_t maxsize ));
+
 /*
  * sockbuf.c
  */
@@ -132,6 +132,8 @@ LDAP_BEGIN_DECL
 #define	LDAP_OPT_CONNECT_CB			0x5011	/* connection callbacks */
 #define	LDAP_OPT_SESSION_REFCNT		0x5012	/* session reference count */
 #define	LDAP_OPT_KEEPCONN		0x5013	/* keep the connection on read error or NoD */
+#define	LDAP_OPT_CONCURRENT		0x5014	/* one thread reads responses for all waiters */
+#define	LDAP_OPT_RESOLV_CACHE_TTL	0x5015	/* seconds to cache name lookups */
 
 /* OpenLDAP TLS options */
 #define LDAP_OPT_X_TLS				0x6000
@@ -161,6 +163,9 @@ LDAP_BEGIN_DECL
 #define LDAP_OPT_X_TLS_KEY			0x6018
 #define LDAP_OPT_X_TLS_PEERKEY_HASH	0x6019
 #define LDAP_OPT_X_TLS_REQUIRE_SAN	0x601a
+#define LDAP_OPT_X_TLS_SESSION_CACHE	0x601b	/* OpenSSL only */
+#define LDAP_OPT_X_TLS_TICKET_LIFETIME	0x601c	/* OpenSSL only */
+#define LDAP_OPT_X_TLS_KTLS		0x601d	/* OpenSSL only */
 
 #define LDAP_OPT_X_TLS_NEVER	0
 #define LDAP_OPT_X_TLS_HARD		1
@@ -320,6 +325,7 @@ typedef struct ldapcontrol {
 #define LDAP_CONTROL_VALSORT			"1.3.6.1.4.1.4203.666.5.14"
 #define	LDAP_CONTROL_X_DEREF			"1.3.6.1.4.1.4203.666.5.16"
 #define	LDAP_CONTROL_X_WHATFAILED		"1.3.6.1.4.1.4203.666.5.17"
+#define	LDAP_CONTROL_X_MEMBEROF_BARRIER	"1.3.6.1.4.1.4203.666.5.19"
 
 /* LDAP Chaining Behavior Control *//* work in progress */
 /* <draft-sermersheim-ldap-chaining>;
@@ -422,6 +428,13 @@ typedef struct ldapcontrol {
 #define LDAP_EXOP_VERIFY_CREDENTIALS	"1.3.6.1.4.1.4203.666.6.5"
 #define LDAP_EXOP_X_VERIFY_CREDENTIALS	LDAP_EXOP_VERIFY_CREDENTIALS
 
+/* zlib compression of the rest of the LDAP stream (experimental) */
+#define LDAP_EXOP_X_START_COMPRESS	"1.3.6.1.4.1.4203.666.6.6"
+
+/* search templates registered per connection (experimental) */
+#define LDAP_EXOP_X_SEARCH_TEMPLATE	"1.3.6.1.4.1.4203.666.6.7"
+#define LDAP_CONTROL_X_SEARCH_TEMPLATE	"1.3.6.1.4.1.4203.666.5.20"
+
 #define LDAP_TAG_EXOP_VERIFY_CREDENTIALS_COOKIE	 ((ber_tag_t) 0x80U)
 #define LDAP_TAG_EXOP_VERIFY_CREDENTIALS_SCREDS	 ((ber_tag_t) 0x81U)
 #define LDAP_TAG_EXOP_VERIFY_CREDENTIALS_CONTROLS ((ber_tag_t) 0xa2U) /* context specific + constructed + 2 */
@@ -454,6 +467,8 @@ typedef struct ldapcontrol {
 #define LDAP_CONTROL_TXN_SPEC			LDAP_TXN ".2"
 #define LDAP_EXOP_TXN_END				LDAP_TXN ".3"
 #define LDAP_EXOP_TXN_ABORTED_NOTICE	LDAP_TXN ".4"
+/* bulk update: failed updates are rolled back without aborting the txn */
+#define LDAP_CONTROL_X_TXN_BULK		"1.3.6.1.4.1.4203.666.5.18"
 
 /* LDAP Features */
 #define LDAP_FEATURE_ALL_OP_ATTRS	"1.3.6.1.4.1.4203.1.5.1"	/* RFC 3673 */
@@ -1878,6 +1893,22 @@ ldap_msgdelete LDAP_P((
 	LDAP *ld,
 	int msgid ));
 
+/* Completion Callback Prototype; the callback owns msg */
+typedef void (LDAP_RESULT_PROC) LDAP_P((
+	LDAP *ld, LDAPMessage *msg,
+	void *params ));
+
+LDAP_F( int )
+ldap_set_result_proc LDAP_P((
+	LDAP *ld,
+	int msgid,
+	LDAP_RESULT_PROC *result_proc,
+	void *params ));
+
+LDAP_F( int )
+ldap_process_input LDAP_P((
+	LDAP *ld ));
+
 
 /*
  * in search.c:
@@ -1901,6 +1932,22 @@ ldap_search_ext LDAP_P((
 	int				sizelimit,
 	int				*msgidp ));
 
+LDAP_F( int )
+ldap_search_async LDAP_P((
+	LDAP			*ld,
+	LDAP_CONST char	*base,
+	int				scope,
+	LDAP_CONST char	*filter,
+	char			**attrs,
+	int				attrsonly,
+	LDAPControl		**serverctrls,
+	LDAPControl		**clientctrls,
+	struct timeval	*timeout,
+	int				sizelimit,
+	LDAP_RESULT_PROC	*result_proc,
+	void			*params,
+	int				*msgidp ));
+
 LDAP_F( int )
 ldap_search_ext_s LDAP_P((
 	LDAP			*ld,
@@ -0,0 +1,97 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#ifndef LDAP_OMAP_H
+#define LDAP_OMAP_H 1
+
+#include <ldap_cdefs.h>
+
+LDAP_BEGIN_DECL
+
+/* Concurrent ordered map. Lookups and walks take no lock, inserts
+ * and deletes are serialized by a mutex. Readers bracket their use
+ * of the map with ldap_pvt_omap_rlock() and ldap_pvt_omap_runlock(),
+ * and may keep using the elements they found until then. Elements
+ * removed from the map are passed to the free function once no
+ * reader can still see them.
+ *
+ * The compare function gets a key and an element, as with avl_find().
+ * A thread must not insert or delete while it holds a read lock.
+ */
+
+typedef struct ldap_pvt_omap ldap_pvt_omap_t;
+
+typedef int (ldap_pvt_omap_cmp_f) LDAP_P(( const void *key, const void *data ));
+typedef void (ldap_pvt_omap_free_f) LDAP_P(( void *data ));
+
+LDAP_F( int )
+ldap_pvt_omap_init LDAP_P((
+	ldap_pvt_omap_t **mapp,
+	ldap_pvt_omap_cmp_f *cmp,
+	ldap_pvt_omap_free_f *dfree ));
+
+/* frees all elements, no other thread may use the map */
+LDAP_F( void )
+ldap_pvt_omap_destroy LDAP_P((
+	ldap_pvt_omap_t *map ));
+
+/* returns the token to pass to ldap_pvt_omap_runlock() */
+LDAP_F( int )
+ldap_pvt_omap_rlock LDAP_P((
+	ldap_pvt_omap_t *map ));
+
+LDAP_F( void )
+ldap_pvt_omap_runlock LDAP_P((
+	ldap_pvt_omap_t *map,
+	int token ));
+
+LDAP_F( void * )
+ldap_pvt_omap_find LDAP_P((
+	ldap_pvt_omap_t *map,
+	const void *key ));
+
+/* cursor walk in ascending order, under a read lock */
+LDAP_F( void * )
+ldap_pvt_omap_first LDAP_P((
+	ldap_pvt_omap_t *map,
+	void **cursor ));
+
+LDAP_F( void * )
+ldap_pvt_omap_next LDAP_P((
+	ldap_pvt_omap_t *map,
+	void **cursor ));
+
+/* returns 0, or -1 and the element with the same key in *dup */
+LDAP_F( int )
+ldap_pvt_omap_insert LDAP_P((
+	ldap_pvt_omap_t *map,
+	void *data,
+	void **dup ));
+
+/* returns the element removed, or NULL. If the map has a free
+ * function, the element belongs to the map from now on.
+ */
+LDAP_F( void * )
+ldap_pvt_omap_delete LDAP_P((
+	ldap_pvt_omap_t *map,
+	const void *key ));
+
+LDAP_F( int )
+ldap_pvt_omap_count LDAP_P((
+	ldap_pvt_omap_t *map ));
+
+LDAP_END_DECL
+
+#endif
@@ -57,6 +57,12 @@ ldap_pvt_thread_get_concurrency LDAP_P(( void ));
 LDAP_F( int )
 ldap_pvt_thread_set_concurrency LDAP_P(( int ));
 
+LDAP_F( int )
+ldap_pvt_thread_check_affinity LDAP_P(( const char *cpus ));
+
+LDAP_F( int )
+ldap_pvt_thread_set_affinity LDAP_P(( const char *cpus ));
+
 #define LDAP_PVT_THREAD_CREATE_JOINABLE 0
 #define LDAP_PVT_THREAD_CREATE_DETACHED 1
 
@@ -218,6 +224,20 @@ ldap_pvt_thread_pool_submit2 LDAP_P((
 	void *arg,
 	void **cookie ));
 
+LDAP_F( int )
+ldap_pvt_thread_pool_submit_bulk LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	ldap_pvt_thread_start_t *start,
+	void *arg ));
+
+LDAP_F( int )
+ldap_pvt_thread_pool_submit_group LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	ldap_pvt_thread_start_t *start,
+	void *arg,
+	int bulk,
+	int group ));
+
 LDAP_F( int )
 ldap_pvt_thread_pool_retract LDAP_P((
 	void *cookie ));
@@ -239,6 +259,27 @@ ldap_pvt_thread_pool_queues LDAP_P((
 	ldap_pvt_thread_pool_t *pool,
 	int numqs ));
 
+LDAP_F( int )
+ldap_pvt_thread_pool_steal LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	int steal ));
+
+LDAP_F( int )
+ldap_pvt_thread_pool_reserve LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	int numqs ));
+
+LDAP_F( int )
+ldap_pvt_thread_pool_adapt LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	int min_threads,
+	int wait_usec ));
+
+LDAP_F( int )
+ldap_pvt_thread_pool_affinity LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	char **groups ));
+
 #ifndef LDAP_PVT_THREAD_H_DONE
 typedef enum {
 	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN = -1,
@@ -253,7 +294,9 @@ typedef enum {
 	LDAP_PVT_THREAD_POOL_PARAM_ACTIVE_MAX,
 	LDAP_PVT_THREAD_POOL_PARAM_PENDING_MAX,
 	LDAP_PVT_THREAD_POOL_PARAM_BACKLOAD_MAX,
-	LDAP_PVT_THREAD_POOL_PARAM_STATE
+	LDAP_PVT_THREAD_POOL_PARAM_STATE,
+	LDAP_PVT_THREAD_POOL_PARAM_LIMIT,
+	LDAP_PVT_THREAD_POOL_PARAM_WAIT
 } ldap_pvt_thread_pool_param_t;
 #endif /* !LDAP_PVT_THREAD_H_DONE */
 
@@ -23,19 +23,28 @@ LDAP_BEGIN_DECL
 typedef struct re_s {
 	struct timeval next_sched;
 	struct timeval interval;
-	LDAP_STAILQ_ENTRY(re_s) tnext; /* it includes running */
+	LDAP_TAILQ_ENTRY(re_s) tnext; /* it includes running */
 	LDAP_STAILQ_ENTRY(re_s) rnext;
 	ldap_pvt_thread_start_t *routine;
 	void *arg;
 	char *tname;
 	char *tspec;
 	void *pool_cookie;
+	int heap_idx;	/* in rq_heap, or -1 while deferred */
 } re_t;
 
+/* Scheduled tasks are kept in a binary heap ordered by next_sched,
+ * deferred ones only in task_list.
+ */
 typedef struct runqueue_s {
-	LDAP_STAILQ_HEAD(l, re_s) task_list;
+	LDAP_TAILQ_HEAD(l, re_s) task_list;
 	LDAP_STAILQ_HEAD(rl, re_s) run_list;
 	ldap_pvt_thread_mutex_t	rq_mutex;
+	struct re_s **rq_heap;
+	int rq_nheap;
+	int rq_maxheap;
+	int rq_ntasks;	/* rq_heap has room for all of them */
+	void (*rq_wake)( void );	/* called when the next task is due sooner */
 } runqueue_t;
 
 LDAP_F( struct re_s* )
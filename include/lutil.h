@@ -190,6 +190,30 @@ LDAP_LUTIL_F( int )
 lutil_tm2gtime LDAP_P((
 	struct lutil_tm *, struct lutil_timet * ));
 
+/* A CSN of the current form, YYYYmmddHHMMSS.uuuuuuZ#cccccc#sid#mmmmmm */
+#define LUTIL_CSNSTR_LEN	40
+
+typedef struct lutil_csn {
+	struct lutil_tm cs_time;	/* tm_usub is the change count */
+	unsigned int cs_sid;
+	unsigned int cs_mod;
+} lutil_csn;
+
+/* Parse and validate a CSN string */
+LDAP_LUTIL_F( int )
+lutil_csnparse LDAP_P((
+	const char *str, size_t len, lutil_csn *csn ));
+
+/* Get just the SID of a CSN string */
+LDAP_LUTIL_F( int )
+lutil_csnsid LDAP_P((
+	const char *str, size_t len ));
+
+/* Format a CSN, buf must hold LUTIL_CSNSTR_LEN + 1 chars */
+LDAP_LUTIL_F( size_t )
+lutil_csnstr LDAP_P((
+	const lutil_csn *csn, char *buf, size_t len ));
+
 #ifdef _WIN32
 LDAP_LUTIL_F( void )
 lutil_slashpath LDAP_P(( char* path ));
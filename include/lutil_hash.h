@@ -71,6 +71,25 @@ lutil_HASH64Final LDAP_P((
 	unsigned char digest[LUTIL_HASH64_BYTES],
 	lutil_HASH_CTX *context));
 
+/* wyhash-style 64 bit hash, reads 8 octets at a time. Each update
+ * is hashed as a whole and chained to the previous one, so the same
+ * octets fed in different pieces give different hashes.
+ */
+LDAP_LUTIL_F( void )
+lutil_WYHASH64Init LDAP_P((
+	lutil_HASH_CTX *context));
+
+LDAP_LUTIL_F( void )
+lutil_WYHASH64Update LDAP_P((
+	lutil_HASH_CTX *context,
+	unsigned char const *buf,
+	ber_len_t len));
+
+LDAP_LUTIL_F( void )
+lutil_WYHASH64Final LDAP_P((
+	unsigned char digest[LUTIL_HASH64_BYTES],
+	lutil_HASH_CTX *context));
+
 #endif /* HAVE_LONG_LONG */
 
 LDAP_END_DECL
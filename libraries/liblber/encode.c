@@ -193,6 +193,20 @@ ber_put_int_or_enum(
 	return ber_write( ber, (char *) ptr, &data[sizeof(data)] - ptr, 0 );
 }
 
+/* Number of content octets ber_put_int() writes for num */
+ber_len_t
+ber_sizeof_int( ber_int_t num )
+{
+	ber_uint_t unum = num;
+	ber_len_t len = 1;
+
+	if ( num < 0 )
+		unum = ~unum;
+	for ( ; unum >= 0x80; unum >>= 8 )
+		len++;
+	return len;
+}
+
 int
 ber_put_enum(
 	BerElement *ber,
@@ -341,6 +355,44 @@ ber_put_boolean(
 }
 
 
+/*
+ * Encoders that know the length of a constructed element's contents
+ * up front can write its tag and definite length directly, and then
+ * the contents, instead of starting a sequence or set and having its
+ * contents moved down over the unused length octets when it is put.
+ */
+
+/* Number of tag and length octets of an element with len content octets */
+ber_len_t
+ber_sizeof_header( ber_tag_t tag, ber_len_t len )
+{
+	ber_len_t n = 2;
+
+	while ( (tag >>= 8) != 0 )
+		n++;
+	if ( len >= 0x80 ) {
+		do {
+			n++;
+		} while ( (len >>= 8) != 0 );
+	}
+	return n;
+}
+
+int
+ber_put_header( BerElement *ber, ber_tag_t tag, ber_len_t len )
+{
+	unsigned char header[HEADER_SIZE], *ptr;
+
+	if ( len > MAXINT_BERSIZE ) {
+		return -1;
+	}
+
+	ptr = ber_prepend_len( &header[sizeof(header)], len );
+	ptr = ber_prepend_tag( ptr, tag );
+
+	return ber_write( ber, (char *) ptr, &header[sizeof(header)] - ptr, 0 );
+}
+
 /* Max number of length octets in a sequence or set, normally 5 */
 #define SOS_LENLEN (1 + (sizeof(ber_elem_size_t) > MAXINT_BERSIZE_OCTETS ? \
 		(ber_len_t) sizeof(ber_elem_size_t) : MAXINT_BERSIZE_OCTETS))
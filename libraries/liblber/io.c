@@ -174,6 +174,7 @@ ber_realloc( BerElement *ber, ber_len_t len )
 
 	ber->ber_buf = buf;
 	ber->ber_end = buf + total;
+	ber->ber_bufsize = 0;
 	ber->ber_ptr = buf + offset;
 	if ( sos_offset )
 		ber->ber_sos_ptr = buf + sos_offset;
@@ -192,6 +193,7 @@ ber_free_buf( BerElement *ber )
 
 	ber->ber_buf = NULL;
 	ber->ber_sos_ptr = NULL;
+	ber->ber_bufsize = 0;
 	ber->ber_valid = LBER_UNINITIALIZED;
 }
 
@@ -514,7 +516,8 @@ ber_get_next(
 	 */
 
 	if (ber->ber_rwptr == NULL) {
-		assert( ber->ber_buf == NULL );
+		/* ber_buf may only be set if kept by ber_pvt_ber_recycle() */
+		assert( ber->ber_buf == NULL || ber->ber_bufsize != 0 );
 		ber->ber_rwptr = (char *) &ber->ber_len-1;
 		ber->ber_ptr = ber->ber_rwptr;
 		ber->ber_tag = 0;
@@ -622,7 +625,7 @@ ber_get_next(
 			return LBER_DEFAULT;
 		}
 
-		if (ber->ber_buf==NULL) {
+		{
 			ber_len_t l = ber->ber_rwptr - ber->ber_ptr;
 			/* ber->ber_ptr is always <= ber->ber->ber_rwptr.
 			 * make sure ber->ber_len agrees with what we've
@@ -632,9 +635,18 @@ ber_get_next(
 				sock_errset(ERANGE);
 				return LBER_DEFAULT;
 			}
-			ber->ber_buf = (char *) ber_memalloc_x( ber->ber_len + 1, ber->ber_memctx );
+			/* reuse a recycled buffer if it is large enough */
+			if ( ber->ber_buf != NULL && ber->ber_bufsize <= ber->ber_len ) {
+				ber_memfree_x( ber->ber_buf, ber->ber_memctx );
+				ber->ber_buf = NULL;
+			}
 			if (ber->ber_buf==NULL) {
-				return LBER_DEFAULT;
+				ber->ber_buf = (char *) ber_memalloc_x( ber->ber_len + 1, ber->ber_memctx );
+				if (ber->ber_buf==NULL) {
+					ber->ber_bufsize = 0;
+					return LBER_DEFAULT;
+				}
+				ber->ber_bufsize = ber->ber_len + 1;
 			}
 			ber->ber_end = ber->ber_buf + ber->ber_len;
 			if (sblen) {
@@ -687,6 +699,39 @@ done:
 	return LBER_DEFAULT;
 }
 
+/*
+ * Reset a BerElement filled by ber_get_next() so it can be handed to
+ * ber_get_next() again, keeping its buffer if it is no larger than
+ * maxsize.  A following PDU that fits is read into the same buffer.
+ */
+void
+ber_pvt_ber_recycle( BerElement *ber, ber_len_t maxsize )
+{
+	char *buf;
+	ber_len_t bufsize;
+
+	assert( ber != NULL );
+	assert( LBER_VALID( ber ) );
+
+	buf = ber->ber_buf;
+	bufsize = ber->ber_bufsize;
+	if ( buf != NULL && ( bufsize == 0 || bufsize > maxsize ) ) {
+		ber_memfree_x( buf, ber->ber_memctx );
+		buf = NULL;
+		bufsize = 0;
+	}
+
+	ber->ber_tag = LBER_DEFAULT;
+	ber->ber_len = 0;
+	ber->ber_usertag = 0;
+	ber->ber_buf = buf;
+	ber->ber_ptr = NULL;
+	ber->ber_end = NULL;
+	ber->ber_sos_ptr = NULL;
+	ber->ber_rwptr = NULL;
+	ber->ber_bufsize = bufsize;
+}
+
 char *
 ber_start( BerElement* ber )
 {
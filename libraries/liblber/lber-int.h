@@ -104,6 +104,8 @@ struct berelement {
 	 *   ber_ptr       End of encoded data to write.
 	 * When input from a Sockbuf:
 	 *   See ber_get_next().
+	 *   ber_bufsize   Allocated size of ber_buf, which may be larger
+	 *                 than the PDU when kept by ber_pvt_ber_recycle().
 	 */
 
 	/* Do not change the order of these 3 fields! see ber_get_next */
@@ -120,6 +122,7 @@ struct berelement {
 
 	char		*ber_rwptr;
 	void		*ber_memctx;
+	ber_len_t	ber_bufsize;
 };
 #define LBER_VALID(ber)	((ber)->ber_valid==LBER_VALID_BERELEMENT)
 
@@ -101,6 +101,13 @@ ber_get_option(
 		*((ber_len_t *) outvalue) = ber_pvt_ber_write(ber);
 		return LBER_OPT_SUCCESS;
 
+	case LBER_OPT_BER_BYTES_UNFLUSHED:
+		/* what ber_flush2() has yet to write, at the end of the buffer */
+		assert( LBER_VALID( ber ) );
+		*((ber_len_t *) outvalue) = ber->ber_rwptr == NULL
+			? ber_pvt_ber_write(ber) : (ber_len_t)(ber->ber_ptr - ber->ber_rwptr);
+		return LBER_OPT_SUCCESS;
+
 	case LBER_OPT_BER_MEMCTX:
 		assert( LBER_VALID( ber ) );
 		*((void **) outvalue) = ber->ber_memctx;
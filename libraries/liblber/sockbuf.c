@@ -204,6 +204,8 @@ ber_sockbuf_add_io( Sockbuf *sb, Sockbuf_IO *sbio, int layer, void *arg )
 	*q = d;
 
 	if ( sbio->sbi_setup != NULL && ( sbio->sbi_setup( d, arg ) < 0 ) ) {
+		*q = p;
+		LBER_FREE( d );
 		return -1;
 	}
 
@@ -986,3 +988,285 @@ Sockbuf_IO ber_sockbuf_io_udp =
 };
 
 #endif	/* LDAP_CONNECTIONLESS */
+
+#ifdef HAVE_ZLIB
+
+/*
+ * Compression layer
+ *
+ * Everything written goes into one deflate stream that is flushed with
+ * Z_SYNC_FLUSH after each write, so the peer can decode every PDU as
+ * soon as it arrives while later PDUs still compress against the ones
+ * before them.  Both sides must push the layer at the same point of
+ * the stream, e.g. once a Start Compression extended op succeeded.
+ *
+ * Like TLS, a write that could not be sent completely must be retried
+ * with the same data: the input was already consumed into the deflate
+ * stream and its length is returned once the output is gone.
+ */
+
+#include <zlib.h>
+
+#define SB_ZLIB_CHUNK	32768
+
+struct sb_zlib {
+	z_stream	sz_in;		/* inflate state, used by the reader */
+	Sockbuf_Buf	sz_inbuf;	/* compressed data from below */
+	Sockbuf_Buf	sz_plain;	/* inflated data not read yet */
+	int		sz_inmore;	/* inflate may hold more output */
+	z_stream	sz_out;		/* deflate state, used by the writer */
+	Sockbuf_Buf	sz_outbuf;	/* compressed data not written yet */
+	ber_len_t	sz_outlen;	/* input consumed into sz_outbuf */
+};
+
+static int
+sb_zlib_setup( Sockbuf_IO_Desc *sbiod, void *arg )
+{
+	struct sb_zlib	*p;
+	int		level = Z_DEFAULT_COMPRESSION;
+
+	assert( sbiod != NULL );
+
+	if ( arg != NULL )
+		level = *((int *)arg);
+
+	p = LBER_CALLOC( 1, sizeof( *p ) );
+	if ( p == NULL ) return -1;
+
+	if ( inflateInit( &p->sz_in ) != Z_OK ) {
+		LBER_FREE( p );
+		return -1;
+	}
+	if ( deflateInit( &p->sz_out, level ) != Z_OK ) {
+		inflateEnd( &p->sz_in );
+		LBER_FREE( p );
+		return -1;
+	}
+	ber_pvt_sb_buf_init( &p->sz_inbuf );
+	ber_pvt_sb_buf_init( &p->sz_plain );
+	ber_pvt_sb_buf_init( &p->sz_outbuf );
+	if ( ber_pvt_sb_grow_buffer( &p->sz_inbuf, SB_ZLIB_CHUNK ) < 0 ||
+		ber_pvt_sb_grow_buffer( &p->sz_plain, SB_ZLIB_CHUNK ) < 0 )
+	{
+		ber_pvt_sb_buf_destroy( &p->sz_inbuf );
+		ber_pvt_sb_buf_destroy( &p->sz_plain );
+		deflateEnd( &p->sz_out );
+		inflateEnd( &p->sz_in );
+		LBER_FREE( p );
+		return -1;
+	}
+
+	sbiod->sbiod_pvt = p;
+	return 0;
+}
+
+static int
+sb_zlib_remove( Sockbuf_IO_Desc *sbiod )
+{
+	struct sb_zlib	*p;
+
+	assert( sbiod != NULL );
+
+	p = (struct sb_zlib *)sbiod->sbiod_pvt;
+
+	if ( p->sz_in.avail_in || p->sz_inmore ||
+		p->sz_plain.buf_ptr != p->sz_plain.buf_end ||
+		p->sz_outbuf.buf_ptr != p->sz_outbuf.buf_end )
+		return -1;
+
+	inflateEnd( &p->sz_in );
+	deflateEnd( &p->sz_out );
+	ber_pvt_sb_buf_destroy( &p->sz_inbuf );
+	ber_pvt_sb_buf_destroy( &p->sz_plain );
+	ber_pvt_sb_buf_destroy( &p->sz_outbuf );
+	LBER_FREE( p );
+	sbiod->sbiod_pvt = NULL;
+
+	return 0;
+}
+
+/* Inflate what was read so far into the empty sz_plain buffer */
+static int
+sb_zlib_inflate( struct sb_zlib *p )
+{
+	Sockbuf_Buf	*b = &p->sz_plain;
+	int		rc;
+
+	p->sz_in.next_out = (Bytef *)b->buf_base + b->buf_end;
+	p->sz_in.avail_out = b->buf_size - b->buf_end;
+	rc = inflate( &p->sz_in, Z_SYNC_FLUSH );
+	b->buf_end = b->buf_size - p->sz_in.avail_out;
+
+	/* output is only held back when there was no room for it */
+	p->sz_inmore = ( p->sz_in.avail_out == 0 );
+
+	/* anything else is corrupt data, or the peer ended the stream */
+	return ( rc == Z_OK || rc == Z_BUF_ERROR ) ? 0 : -1;
+}
+
+/*
+ * A short read tells ber_get_next() that nothing more is available
+ * right now, so everything that can be inflated without reading
+ * from below is returned first.
+ */
+static ber_slen_t
+sb_zlib_read( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	struct sb_zlib	*p;
+	ber_slen_t	ret;
+	ber_len_t	got = 0;
+
+	assert( sbiod != NULL );
+	assert( SOCKBUF_VALID( sbiod->sbiod_sb ) );
+	assert( sbiod->sbiod_next != NULL );
+
+	p = (struct sb_zlib *)sbiod->sbiod_pvt;
+
+	for (;;) {
+		got += ber_pvt_sb_copy_out( &p->sz_plain, (char *)buf + got,
+			len - got );
+		if ( got == len ) break;
+
+		if ( p->sz_in.avail_in == 0 && !p->sz_inmore ) {
+			if ( got ) break;
+			ret = LBER_SBIOD_READ_NEXT( sbiod, p->sz_inbuf.buf_base,
+				p->sz_inbuf.buf_size );
+			if ( ret <= 0 ) return ret;
+			p->sz_in.next_in = (Bytef *)p->sz_inbuf.buf_base;
+			p->sz_in.avail_in = ret;
+		}
+
+		if ( sb_zlib_inflate( p ) < 0 ) {
+			/* the next read reports it */
+			if ( got ) break;
+			sock_errset( EIO );
+			return -1;
+		}
+	}
+
+	return got;
+}
+
+static ber_slen_t
+sb_zlib_write( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	struct sb_zlib	*p;
+	ber_slen_t	ret;
+	int		rc, err;
+
+	assert( sbiod != NULL );
+	assert( SOCKBUF_VALID( sbiod->sbiod_sb ) );
+	assert( sbiod->sbiod_next != NULL );
+
+	p = (struct sb_zlib *)sbiod->sbiod_pvt;
+
+	/* finish the previous write first */
+	if ( p->sz_outbuf.buf_ptr != p->sz_outbuf.buf_end ) {
+		ret = ber_pvt_sb_do_write( sbiod, &p->sz_outbuf );
+		if ( ret < 0 ) return ret;
+		if ( p->sz_outbuf.buf_ptr != p->sz_outbuf.buf_end ) {
+			sock_errset( EWOULDBLOCK );
+			return -1;
+		}
+		ret = p->sz_outlen;
+		p->sz_outlen = 0;
+		return ret;
+	}
+
+	if ( len > SB_ZLIB_CHUNK )
+		len = SB_ZLIB_CHUNK;
+	if ( ber_pvt_sb_grow_buffer( &p->sz_outbuf,
+		deflateBound( &p->sz_out, len ) + 16 ) < 0 )
+	{
+		sock_errset( ENOMEM );
+		return -1;
+	}
+
+	p->sz_out.next_in = buf;
+	p->sz_out.avail_in = len;
+	do {
+		if ( p->sz_outbuf.buf_end == p->sz_outbuf.buf_size &&
+			ber_pvt_sb_grow_buffer( &p->sz_outbuf,
+				p->sz_outbuf.buf_size + 1 ) < 0 )
+		{
+			sock_errset( ENOMEM );
+			return -1;
+		}
+		p->sz_out.next_out = (Bytef *)p->sz_outbuf.buf_base +
+			p->sz_outbuf.buf_end;
+		p->sz_out.avail_out = p->sz_outbuf.buf_size - p->sz_outbuf.buf_end;
+		rc = deflate( &p->sz_out, Z_SYNC_FLUSH );
+		p->sz_outbuf.buf_end = p->sz_outbuf.buf_size - p->sz_out.avail_out;
+		if ( rc == Z_STREAM_ERROR ) {
+			sock_errset( EIO );
+			return -1;
+		}
+	} while ( p->sz_out.avail_out == 0 );
+
+	ret = ber_pvt_sb_do_write( sbiod, &p->sz_outbuf );
+	if ( ret < 0 ) {
+		err = sock_errno();
+		if ( err != EWOULDBLOCK && err != EAGAIN ) return ret;
+	}
+	if ( p->sz_outbuf.buf_ptr != p->sz_outbuf.buf_end ) {
+		p->sz_outlen = len;
+		sock_errset( EWOULDBLOCK );
+		return -1;
+	}
+
+	return len;
+}
+
+static int
+sb_zlib_close( Sockbuf_IO_Desc *sbiod )
+{
+	struct sb_zlib	*p;
+
+	assert( sbiod != NULL );
+
+	/* nothing pending can be delivered anymore */
+	p = (struct sb_zlib *)sbiod->sbiod_pvt;
+	p->sz_in.avail_in = 0;
+	p->sz_inmore = 0;
+	p->sz_plain.buf_ptr = p->sz_plain.buf_end = 0;
+	p->sz_outbuf.buf_ptr = p->sz_outbuf.buf_end = 0;
+	return 0;
+}
+
+static int
+sb_zlib_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg )
+{
+	struct sb_zlib	*p;
+
+	p = (struct sb_zlib *)sbiod->sbiod_pvt;
+
+	if ( opt == LBER_SB_OPT_DATA_READY ) {
+		/* Compressed input may only hold the end of a flush, so
+		 * only inflated data counts; a reader told otherwise
+		 * would block on the socket.
+		 */
+		if ( p->sz_plain.buf_ptr == p->sz_plain.buf_end &&
+			( p->sz_in.avail_in || p->sz_inmore ) &&
+			sb_zlib_inflate( p ) < 0 )
+		{
+			/* let the next read report it */
+			return 1;
+		}
+		if ( p->sz_plain.buf_ptr != p->sz_plain.buf_end ) {
+			return 1;
+		}
+	}
+
+	return LBER_SBIOD_CTRL_NEXT( sbiod, opt, arg );
+}
+
+Sockbuf_IO ber_sockbuf_io_zlib = {
+	sb_zlib_setup,		/* sbi_setup */
+	sb_zlib_remove,		/* sbi_remove */
+	sb_zlib_ctrl,		/* sbi_ctrl */
+	sb_zlib_read,		/* sbi_read */
+	sb_zlib_write,		/* sbi_write */
+	sb_zlib_close		/* sbi_close */
+};
+
+#endif	/* HAVE_ZLIB */
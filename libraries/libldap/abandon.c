@@ -80,6 +80,8 @@ ldap_abandon_ext(
 
 	LDAP_MUTEX_UNLOCK( &ld->ld_req_mutex );
 
+	ldap_int_result_proc_drop( ld, msgid );
+
 	return rc;
 }
 
@@ -114,9 +116,33 @@ ldap_pvt_discard(
 	LDAP_MUTEX_LOCK( &ld->ld_req_mutex );
 	rc = do_abandon( ld, msgid, msgid, NULL, 0 );
 	LDAP_MUTEX_UNLOCK( &ld->ld_req_mutex );
+	ldap_int_result_proc_drop( ld, msgid );
 	return rc;
 }
 
+/*
+ * Returns the first referral spawned, directly or not,
+ * by lr that has not been abandoned yet
+ */
+static LDAPRequest *
+find_child_to_abandon( LDAPRequest *lr )
+{
+	LDAPRequest	*child, *found;
+
+	for ( child = lr->lr_child; child != NULL; child = child->lr_refnext ) {
+		if ( !child->lr_abandoned ) {
+			return child;
+		}
+
+		found = find_child_to_abandon( child );
+		if ( found != NULL ) {
+			return found;
+		}
+	}
+
+	return NULL;
+}
+
 static int
 do_abandon(
 	LDAP *ld,
@@ -135,23 +161,18 @@ do_abandon(
 
 	/* find the request that we are abandoning */
 start_again:;
-	lr = ld->ld_requests;
-	while ( lr != NULL ) {
-		/* this message */
-		if ( lr->lr_msgid == msgid ) {
-			break;
-		}
+	lr = ldap_int_request_find( ld, msgid );
+	if ( lr != NULL && lr->lr_origid == msgid ) {
+		LDAPRequest	*child = find_child_to_abandon( lr );
 
 		/* child: abandon it */
-		if ( lr->lr_origid == msgid && !lr->lr_abandoned ) {
-			(void)do_abandon( ld, lr->lr_origid, lr->lr_msgid,
+		if ( child != NULL ) {
+			(void)do_abandon( ld, child->lr_origid, child->lr_msgid,
 				sctrls, sendabandon );
 
 			/* restart, as lr may now be dangling... */
 			goto start_again;
 		}
-
-		lr = lr->lr_next;
 	}
 
 	if ( lr != NULL ) {
@@ -179,12 +200,7 @@ start_again:;
 
 	/* fetch again the request that we are abandoning */
 	if ( lr != NULL ) {
-		for ( lr = ld->ld_requests; lr != NULL; lr = lr->lr_next ) {
-			/* this message */
-			if ( lr->lr_msgid == msgid ) {
-				break;
-			}
-		}
+		lr = ldap_int_request_find( ld, msgid );
 	}
 
 	err = 0;
@@ -210,6 +210,77 @@ static int srv_cmp(const void *aa, const void *bb){
 	return b->weight - a->weight;
 }
 
+/*
+ * SRV answers are kept for the smaller of their DNS TTL and
+ * LDAP_OPT_RESOLV_CACHE_TTL, and used past that if the resolver
+ * fails.  Protected by ldap_int_resolv_mutex.
+ */
+typedef struct srv_cache {
+	struct srv_cache *sc_next;
+	char *sc_request;
+	time_t sc_expires;
+	int sc_count;
+	srv_record *sc_records;
+} srv_cache;
+
+#define SRV_CACHE_MAX	16
+static srv_cache *srv_cache_head;
+
+static srv_cache *srv_cache_find(const char *request) {
+	srv_cache *sc;
+
+	for (sc = srv_cache_head; sc; sc = sc->sc_next) {
+		if (!strcasecmp(sc->sc_request, request))
+			break;
+	}
+	return sc;
+}
+
+static srv_record *srv_cache_get(srv_cache *sc) {
+	srv_record *a = LDAP_MALLOC(sc->sc_count * sizeof(srv_record));
+
+	if (a)
+		AC_MEMCPY(a, sc->sc_records, sc->sc_count * sizeof(srv_record));
+	return a;
+}
+
+static void srv_cache_put(const char *request, srv_record *a, int n, int ttl) {
+	srv_cache *sc = srv_cache_find(request), **scp;
+	srv_record *dup;
+	int i;
+
+	dup = LDAP_MALLOC(n * sizeof(srv_record));
+	if (!dup)
+		return;
+	AC_MEMCPY(dup, a, n * sizeof(srv_record));
+
+	if (!sc) {
+		/* drop the oldest entry if full */
+		for (scp = &srv_cache_head, i = 1; *scp && (*scp)->sc_next;
+			scp = &(*scp)->sc_next, i++)
+			;
+		if (i >= SRV_CACHE_MAX && *scp) {
+			LDAP_FREE((*scp)->sc_request);
+			LDAP_FREE((*scp)->sc_records);
+			LDAP_FREE(*scp);
+			*scp = NULL;
+		}
+		sc = LDAP_CALLOC(1, sizeof(srv_cache));
+		if (!sc || !(sc->sc_request = LDAP_STRDUP(request))) {
+			LDAP_FREE(sc);
+			LDAP_FREE(dup);
+			return;
+		}
+		sc->sc_next = srv_cache_head;
+		srv_cache_head = sc;
+	} else {
+		LDAP_FREE(sc->sc_records);
+	}
+	sc->sc_records = dup;
+	sc->sc_count = n;
+	sc->sc_expires = time(0L) + ttl;
+}
+
 static void srv_shuffle(srv_record *a, int n) {
 	int i, j, total = 0, r, p;
 
@@ -257,6 +328,8 @@ int ldap_domain2hostlist(
     int rc, len, cur = 0;
     unsigned char reply[DNSBUFSIZ];
     int hostent_count=0;
+    srv_cache *sc;
+    int cache_ttl = LDAP_INT_GLOBAL_OPT()->ldo_resolv_ttl, min_ttl;
 
 	assert( domain != NULL );
 	assert( list != NULL );
@@ -273,6 +346,12 @@ int ldap_domain2hostlist(
     LDAP_MUTEX_LOCK(&ldap_int_resolv_mutex);
 
     rc = LDAP_UNAVAILABLE;
+    sc = cache_ttl > 0 ? srv_cache_find(request) : NULL;
+    if (sc && sc->sc_expires > time(0L)) {
+	goto cached;
+    }
+    min_ttl = cache_ttl;
+
 #ifdef NS_HFIXEDSZ
 	/* Bind 8/9 interface */
     len = res_query(request, ns_c_in, ns_t_srv, reply, sizeof(reply));
@@ -287,6 +366,10 @@ int ldap_domain2hostlist(
 
     len = res_query(request, C_IN, T_SRV, reply, sizeof(reply));
 #endif
+    if (len < 0 && sc) {
+	/* the previous answer beats none at all */
+	goto cached;
+    }
     if (len >= 0) {
 	unsigned char *p;
 	char host[DNSBUFSIZ];
@@ -339,6 +422,8 @@ int ldap_domain2hostlist(
 		priority = (p[0] << 8) | p[1];
 		weight = (p[2] << 8) | p[3];
 		port = (p[4] << 8) | p[5];
+		if (ttl < min_ttl)
+		    min_ttl = ttl;
 
 		if ( port == 0 || host[ 0 ] == '\0' ) {
 		    goto add_size;
@@ -361,6 +446,18 @@ add_size:;
 	}
 	if (!hostent_head) goto out;
     qsort(hostent_head, hostent_count, sizeof(srv_record), srv_cmp);
+	if (cache_ttl > 0 && min_ttl > 0)
+		srv_cache_put(request, hostent_head, hostent_count, min_ttl);
+
+	if (0) {
+cached:
+		hostent_head = srv_cache_get(sc);
+		if (!hostent_head) {
+			rc = LDAP_NO_MEMORY;
+			goto out;
+		}
+		hostent_count = sc->sc_count;
+	}
 
 	if (!srv_seed)
 		srv_srand(time(0L));
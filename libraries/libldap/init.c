@@ -94,6 +94,8 @@ static const struct ol_attribute {
 	{0, ATTR_OPTION,	"HOST",			NULL,	LDAP_OPT_HOST_NAME}, /* deprecated */
 	{0, ATTR_OPTION,	"URI",			NULL,	LDAP_OPT_URI}, /* replaces HOST/PORT */
 	{0, ATTR_BOOL,		"REFERRALS",	NULL,	LDAP_BOOL_REFERRALS},
+	{0, ATTR_INT,		"RESOLV_CACHE_TTL",	NULL,
+		offsetof(struct ldapoptions, ldo_resolv_ttl)},
 #if 0
 	/* This should only be allowed via ldap_set_option(3) */
 	{0, ATTR_BOOL,		"RESTART",		NULL,	LDAP_BOOL_RESTART},
@@ -128,6 +130,7 @@ static const struct ol_attribute {
 
 #ifdef HAVE_OPENSSL
 	{0, ATTR_TLS,	"TLS_CRLCHECK",		NULL,	LDAP_OPT_X_TLS_CRLCHECK},
+	{0, ATTR_TLS,	"TLS_KTLS",		NULL,	LDAP_OPT_X_TLS_KTLS},
 #endif
 #ifdef HAVE_GNUTLS
 	{0, ATTR_TLS,	"TLS_CRLFILE",			NULL,	LDAP_OPT_X_TLS_CRLFILE},
@@ -603,6 +606,7 @@ void ldap_int_initialize_global_options( struct ldapoptions *gopts, int *dbglvl
 	gopts->ldo_keepalive_probes = 0;
 	gopts->ldo_keepalive_interval = 0;
 	gopts->ldo_keepalive_idle = 0;
+	gopts->ldo_resolv_ttl = 0;
 
 #ifdef LDAP_R_COMPILE
 	ldap_pvt_thread_mutex_init( &gopts->ldo_mutex );
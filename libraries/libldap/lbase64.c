@@ -62,10 +62,32 @@ ldap_int_decode_b64_inplace( struct berval *value )
 	byte = value->bv_val;
 	end = value->bv_val + value->bv_len;
 
+	/* fast path: quads of plain digits, checked all at once; an
+	 * invalid char has its high bit set, or maps to 0xff */
 	for ( p = value->bv_val, value->bv_len = 0;
-		p < end;
+		end - p > 4;
 		p += 4, value->bv_len += 3 )
 	{
+		unsigned char	n0, n1, n2, n3;
+
+		n0 = b642nib[ p[0] & 0x7f ];
+		n1 = b642nib[ p[1] & 0x7f ];
+		n2 = b642nib[ p[2] & 0x7f ];
+		n3 = b642nib[ p[3] & 0x7f ];
+		if ( ( ( p[0] | p[1] | p[2] | p[3] ) & 0x80 ) ||
+			( ( n0 | n1 | n2 | n3 ) & 0xc0 ) )
+		{
+			/* let the careful loop below sort it out */
+			break;
+		}
+
+		byte[0] = n0 << 2 | n1 >> 4;
+		byte[1] = n1 << 4 | n2 >> 2;
+		byte[2] = n2 << 6 | n3;
+		byte += 3;
+	}
+
+	for ( ; p < end; p += 4, value->bv_len += 3 ) {
 		int i;
 		for ( i = 0; i < 4; i++ ) {
 			if ( p[i] != '=' && (p[i] & 0x80 ||
@@ -147,6 +147,7 @@ LDAP_BEGIN_DECL
 #define	LDAP_BOOL_CONNECT_ASYNC		4
 #define	LDAP_BOOL_SASL_NOCANON		5
 #define	LDAP_BOOL_KEEPCONN		6
+#define	LDAP_BOOL_CONCURRENT		7
 
 #define LDAP_BOOLEANS	unsigned long
 #define LDAP_BOOL(n)	((LDAP_BOOLEANS)1 << (n))
@@ -169,6 +170,8 @@ struct ldapmsg {
 	struct ldapmsg	*lm_chain;	/* for search - next msg in the resp */
 	struct ldapmsg	*lm_chain_tail;
 	struct ldapmsg	*lm_next;	/* next response */
+	struct ldapmsg	*lm_prev;	/* previous response */
+	struct ldapmsg	*lm_hnext;	/* next response in msgid bucket */
 	time_t	lm_time;	/* used to maintain cache */
 };
 
@@ -187,6 +190,9 @@ struct ldaptls {
 	struct berval	lt_cacert;
 	struct berval	lt_cert;
 	struct berval	lt_key;
+	int		lt_sess_cache;		/* OpenSSL only */
+	int		lt_ticket_lifetime;	/* OpenSSL only */
+	int		lt_ktls;		/* OpenSSL only */
 };
 #endif
 
@@ -231,6 +237,8 @@ struct ldapoptions {
 	ber_int_t ldo_keepalive_probes;
 	ber_int_t ldo_keepalive_interval;
 
+	ber_int_t ldo_resolv_ttl;	/* DNS/host lookup cache lifetime */
+
 	int		ldo_refhoplimit;	/* limit on referral nesting */
 
 	/* LDAPv3 server and client controls */
@@ -250,7 +258,7 @@ struct ldapoptions {
 
 	LDAP_BOOLEANS ldo_booleans;	/* boolean options */
 
-#define LDAP_LDO_NULLARG	,0,0,0,0 ,{0},{0} ,0,0,0,0, 0,0,0,0, 0,0, 0,0,0,0,0,0, 0, 0
+#define LDAP_LDO_NULLARG	,0,0,0,0 ,{0},{0} ,0,0,0,0, 0,0,0,0,0, 0,0, 0,0,0,0,0,0, 0, 0
 
 #ifdef LDAP_CONNECTIONLESS
 #define	LDAP_IS_UDP(ld)		((ld)->ld_options.ldo_is_udp)
@@ -281,6 +289,9 @@ struct ldapoptions {
 #define ldo_tls_cacert	ldo_tls_info.lt_cacert
 #define ldo_tls_cert	ldo_tls_info.lt_cert
 #define ldo_tls_key	ldo_tls_info.lt_key
+#define ldo_tls_sess_cache	ldo_tls_info.lt_sess_cache
+#define ldo_tls_ticket_lifetime	ldo_tls_info.lt_ticket_lifetime
+#define ldo_tls_ktls	ldo_tls_info.lt_ktls
    	int			ldo_tls_mode;
    	int			ldo_tls_require_cert;
 	int			ldo_tls_impl;
@@ -370,8 +381,17 @@ typedef struct ldapreq {
 	struct ldapreq	*lr_refnext;	/* next referral spawned */
 	struct ldapreq	*lr_prev;	/* previous request */
 	struct ldapreq	*lr_next;	/* next request */
+	struct ldapreq	*lr_hnext;	/* next request in msgid bucket */
 } LDAPRequest;
 
+/*
+ * Outstanding requests and queued responses are also indexed by
+ * msgid, in chained hash tables whose size is a power of two and
+ * grows with the number of entries
+ */
+#define LDAP_MSGID_HASH_MIN	32
+#define LDAP_MSGID_BUCKET(msgid, size)	((unsigned)(msgid) & ((size) - 1))
+
 /*
  * structure for client cache
  */
@@ -420,6 +440,36 @@ struct ldap_common {
 #define	ld_requests		ldc->ldc_requests
 #define	ld_responses		ldc->ldc_responses
 
+	/* protected by req_mutex */
+	LDAPRequest	**ldc_req_hash;	/* outstanding requests by msgid */
+	int		ldc_req_hsize;
+	int		ldc_nrequests;
+#define	ld_req_hash		ldc->ldc_req_hash
+#define	ld_req_hsize		ldc->ldc_req_hsize
+#define	ld_nrequests		ldc->ldc_nrequests
+
+	/* protected by res_mutex */
+	LDAPMessage	**ldc_res_hash;	/* outstanding responses by msgid */
+	int		ldc_res_hsize;
+	int		ldc_nresponses;
+#define	ld_res_hash		ldc->ldc_res_hash
+#define	ld_res_hsize		ldc->ldc_res_hsize
+#define	ld_nresponses		ldc->ldc_nresponses
+
+	/* protected by res_mutex; used with LDAP_OPT_CONCURRENT */
+	int		ldc_reader;	/* a thread is reading responses */
+	struct ldapwaiter *ldc_waiters;	/* threads waiting for it */
+#define	ld_reader		ldc->ldc_reader
+#define	ld_waiters		ldc->ldc_waiters
+
+	/* protected by res_mutex */
+	struct ldapresultproc **ldc_proc_hash;	/* completion callbacks by msgid */
+	int		ldc_proc_hsize;
+	int		ldc_nprocs;
+#define	ld_proc_hash		ldc->ldc_proc_hash
+#define	ld_proc_hsize		ldc->ldc_proc_hsize
+#define	ld_nprocs		ldc->ldc_nprocs
+
 	/* protected by abandon_mutex */
 	ber_len_t	ldc_nabandoned;
 	ber_int_t	*ldc_abandoned;	/* array of abandoned requests */
@@ -439,6 +489,8 @@ struct ldap_common {
 #define	ld_conns		ldc->ldc_conns
 	void		*ldc_selectinfo;/* platform specifics for select */
 #define	ld_selectinfo		ldc->ldc_selectinfo
+	void		*ldc_selectsnap;/* copy used by the concurrent reader */
+#define	ld_selectsnap		ldc->ldc_selectsnap
 
 	/* ldap_common refcnt - free only if 0 */
 	/* protected by ldc_mutex */
@@ -714,6 +766,9 @@ LDAP_F (char *) ldap_host_connected_to( Sockbuf *sb,
 #endif
 
 LDAP_F (int) ldap_int_select( LDAP *ld, struct timeval *timeout );
+LDAP_F (void *) ldap_int_select_snapshot( LDAP *ld, void *snap );
+LDAP_F (int) ldap_int_select_unlocked( void *snap, struct timeval *timeout );
+LDAP_F (void) ldap_int_select_merge( LDAP *ld, void *snap );
 LDAP_F (void *) ldap_new_select_info( void );
 LDAP_F (void) ldap_free_select_info( void *sip );
 LDAP_F (void) ldap_mark_select_write( LDAP *ld, Sockbuf *sb );
@@ -747,6 +802,8 @@ LDAP_F (int) ldap_send_server_request( LDAP *ld, BerElement *ber,
 	LDAPConn *lc, LDAPreqinfo *bind, int noconn, int m_res );
 LDAP_F (LDAPConn *) ldap_new_connection( LDAP *ld, LDAPURLDesc **srvlist,
 	int use_ldsb, int connect, LDAPreqinfo *bind, int m_req, int m_res );
+LDAP_F (void) ldap_int_request_link( LDAP *ld, LDAPRequest *lr );
+LDAP_F (LDAPRequest *) ldap_int_request_find( LDAP *ld, ber_int_t msgid );
 LDAP_F (LDAPRequest *) ldap_find_request_by_msgid( LDAP *ld, ber_int_t msgid );
 LDAP_F (void) ldap_return_request( LDAP *ld, LDAPRequest *lr, int freeit );
 LDAP_F (void) ldap_free_request( LDAP *ld, LDAPRequest *lr );
@@ -764,6 +821,8 @@ LDAP_F (int) ldap_int_flush_request( LDAP *ld, LDAPRequest *lr );
  * in result.c:
  */
 LDAP_F (const char *) ldap_int_msgtype2str( ber_tag_t tag );
+LDAP_F (void) ldap_int_result_proc_drop( LDAP *ld, ber_int_t msgid );
+LDAP_F (void) ldap_int_result_procs_free( LDAP *ld );
 
 /*
  * in search.c
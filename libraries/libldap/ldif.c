@@ -94,7 +94,7 @@ ldif_parse_line2(
 	int		*freeval
 )
 {
-	char	*s, *p, *d; 
+	char	*s, *p, *d, *e;
 	int	b64, url;
 
 	BER_BVZERO( type );
@@ -154,12 +154,30 @@ ldif_parse_line2(
 		s++;
 	}
 
-	/* check for continued line markers that should be deleted */
-	for ( p = s, d = s; *p; p++ ) {
-		if ( *p != CONTINUED_LINE_MARKER )
-			*d++ = *p;
+	/* check for continued line markers that should be deleted;
+	 * most values have none, and the others have long runs
+	 * of plain text between them, so move those in one go */
+	e = s + strlen( s );
+	d = memchr( s, CONTINUED_LINE_MARKER, e - s );
+	if ( d == NULL ) {
+		d = e;
+	} else {
+		for ( p = d; p < e; ) {
+			char *q;
+
+			while ( p < e && *p == CONTINUED_LINE_MARKER ) {
+				p++;
+			}
+			q = memchr( p, CONTINUED_LINE_MARKER, e - p );
+			if ( q == NULL ) {
+				q = e;
+			}
+			AC_MEMCPY( d, p, q - p );
+			d += q - p;
+			p = q;
+		}
+		*d = '\0';
 	}
-	*d = '\0';
 
 	if ( b64 ) {
 		char *byte = s;
@@ -608,6 +626,17 @@ ldif_sput_wrap(
 		bits |= (byte[1] & 0xff) << 8;
 		bits |= (byte[2] & 0xff);
 
+		/* the whole quad fits on this line */
+		if ( len + 4 <= wrap ) {
+			(*out)[0] = nib2b64[ (bits >> 18) & 0x3f ];
+			(*out)[1] = nib2b64[ (bits >> 12) & 0x3f ];
+			(*out)[2] = nib2b64[ (bits >> 6) & 0x3f ];
+			(*out)[3] = nib2b64[ bits & 0x3f ];
+			*out += 4;
+			len += 4;
+			continue;
+		}
+
 		for ( i = 0; i < 4; i++, len++, bits <<= 6 ) {
 			if ( len >= wrap ) {
 				*(*out)++ = '\n';
@@ -708,7 +737,7 @@ int ldif_is_not_printable(
 	{
 		ber_len_t i;
 
-		for ( i = 0; val[i]; i++ ) {
+		for ( i = 0; i < vlen; i++ ) {
 			if ( !isascii( val[i] ) || !isprint( (unsigned char) val[i] ) ) {
 				return 1;
 			}
@@ -790,8 +819,8 @@ ldif_read_record(
 	char        **bufp,     /* ptr to malloced output buffer           */
 	int         *buflenp )  /* ptr to length of *bufp                  */
 {
-	char        line[LDIF_MAXLINE], *nbufp;
-	ber_len_t   lcur = 0, len;
+	char        *line, *nbufp;
+	ber_len_t   lcur = 0, len = 0;
 	int         last_ch = '\n', found_entry = 0, stop, top_comment = 0;
 
 	for ( stop = 0;  !stop;  last_ch = line[len-1] ) {
@@ -809,8 +838,21 @@ ldif_read_record(
 				break;
 			}
 		}
+		/* lines are read in place, at the end of the record;
+		 * those that do not belong to it are just not kept */
+		if ( *buflenp - lcur <= LDIF_MAXLINE ) {
+			*buflenp = lcur + 2 * LDIF_MAXLINE;
+			nbufp = ber_memrealloc( *bufp, *buflenp );
+			if( nbufp == NULL ) {
+				return 0;
+			}
+			*bufp = nbufp;
+		}
+		line = *bufp + lcur;
+		line[0] = '\0';
+
 		if ( !stop ) {
-			if ( fgets( line, sizeof( line ), lfp->fp ) == NULL ) {
+			if ( fgets( line, LDIF_MAXLINE, lfp->fp ) == NULL ) {
 				stop = 1;
 				len = 0;
 			} else {
@@ -899,17 +941,11 @@ ldif_read_record(
 		}
 
 last:
-		if ( *buflenp - lcur <= len ) {
-			*buflenp += len + LDIF_MAXLINE;
-			nbufp = ber_memrealloc( *bufp, *buflenp );
-			if( nbufp == NULL ) {
-				return 0;
-			}
-			*bufp = nbufp;
-		}
-		strcpy( *bufp + lcur, line );
 		lcur += len;
 	}
 
+	/* drop the separator line, or whatever else was read past the end */
+	(*bufp)[lcur] = '\0';
+
 	return( found_entry );
 }
@@ -0,0 +1,322 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2003-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include <ac/stdlib.h>
+#include <ac/string.h>
+
+#include "ldap-int.h"
+
+#ifdef LDAP_R_COMPILE
+
+#include "ldap_pvt_thread.h"
+#include "ldap_omap.h"
+
+/*
+ * A skiplist. Writers hold om_mutex and publish each new link with a
+ * release store, bottom level first, so a reader that sees a node at
+ * some level also sees it at the levels below. A deleted node is
+ * unlinked top down but keeps its own links, so a reader standing on
+ * it can carry on.
+ *
+ * Deleted nodes are freed after every reader that could have reached
+ * them is gone. Readers count themselves in one of two slots, picked
+ * by om_epoch. A writer flips om_epoch only when the slot of the
+ * previous epoch is empty; at that point the nodes deleted before the
+ * previous flip can no longer be seen by anyone and are freed, and
+ * the nodes deleted since become the next batch. Nothing ever waits
+ * for readers.
+ *
+ * Without the GNU atomic builtins, readers take om_mutex.
+ */
+
+#define OMAP_MAXLEVEL	16
+
+typedef struct omap_node {
+	void *on_data;
+	struct omap_node *on_retired;
+	int on_height;
+	struct omap_node *on_next[1];
+} omap_node;
+
+struct ldap_pvt_omap {
+	ldap_pvt_thread_mutex_t om_mutex;
+	ldap_pvt_omap_cmp_f *om_cmp;
+	ldap_pvt_omap_free_f *om_free;
+	int om_count;
+	unsigned int om_seed;
+	unsigned int om_epoch;
+	unsigned long om_readers[2];
+	omap_node *om_retired[2];	/* since the last flip, before it */
+	omap_node *om_head;
+};
+
+#ifdef __GNUC__
+#define OMAP_GET(p)	__atomic_load_n( &(p), __ATOMIC_ACQUIRE )
+#define OMAP_SET(p, v)	__atomic_store_n( &(p), (v), __ATOMIC_RELEASE )
+#else
+#define OMAP_GET(p)	(p)
+#define OMAP_SET(p, v)	((p) = (v))
+#endif
+
+static omap_node *
+omap_node_alloc( void *data, int height )
+{
+	omap_node *n;
+
+	n = LDAP_MALLOC( sizeof(omap_node) + (height - 1) * sizeof(omap_node *));
+	if ( n ) {
+		n->on_data = data;
+		n->on_retired = NULL;
+		n->on_height = height;
+	}
+	return n;
+}
+
+int
+ldap_pvt_omap_init(
+	ldap_pvt_omap_t **mapp,
+	ldap_pvt_omap_cmp_f *cmp,
+	ldap_pvt_omap_free_f *dfree )
+{
+	ldap_pvt_omap_t *map;
+	int i;
+
+	map = LDAP_CALLOC( 1, sizeof(ldap_pvt_omap_t) );
+	if ( map == NULL )
+		return -1;
+	map->om_head = omap_node_alloc( NULL, OMAP_MAXLEVEL );
+	if ( map->om_head == NULL ) {
+		LDAP_FREE( map );
+		return -1;
+	}
+	for ( i = 0; i < OMAP_MAXLEVEL; i++ )
+		map->om_head->on_next[i] = NULL;
+	ldap_pvt_thread_mutex_init( &map->om_mutex );
+	map->om_cmp = cmp;
+	map->om_free = dfree;
+	map->om_seed = 0x2545f491;
+	*mapp = map;
+	return 0;
+}
+
+static void
+omap_free_list( ldap_pvt_omap_t *map, omap_node *n )
+{
+	omap_node *next;
+
+	for ( ; n; n = next ) {
+		next = n->on_retired;
+		if ( map->om_free )
+			map->om_free( n->on_data );
+		LDAP_FREE( n );
+	}
+}
+
+void
+ldap_pvt_omap_destroy( ldap_pvt_omap_t *map )
+{
+	omap_node *n, *next;
+
+	omap_free_list( map, map->om_retired[0] );
+	omap_free_list( map, map->om_retired[1] );
+	for ( n = map->om_head->on_next[0]; n; n = next ) {
+		next = n->on_next[0];
+		if ( map->om_free )
+			map->om_free( n->on_data );
+		LDAP_FREE( n );
+	}
+	LDAP_FREE( map->om_head );
+	ldap_pvt_thread_mutex_destroy( &map->om_mutex );
+	LDAP_FREE( map );
+}
+
+int
+ldap_pvt_omap_rlock( ldap_pvt_omap_t *map )
+{
+#ifdef __GNUC__
+	unsigned int e;
+
+	for (;;) {
+		e = __atomic_load_n( &map->om_epoch, __ATOMIC_SEQ_CST );
+		__atomic_fetch_add( &map->om_readers[e], 1, __ATOMIC_SEQ_CST );
+		if ( __atomic_load_n( &map->om_epoch, __ATOMIC_SEQ_CST ) == e )
+			return e;
+		/* a writer flipped meanwhile, count ourselves in the new slot */
+		__atomic_fetch_sub( &map->om_readers[e], 1, __ATOMIC_SEQ_CST );
+	}
+#else
+	ldap_pvt_thread_mutex_lock( &map->om_mutex );
+	return 0;
+#endif
+}
+
+void
+ldap_pvt_omap_runlock( ldap_pvt_omap_t *map, int token )
+{
+#ifdef __GNUC__
+	__atomic_fetch_sub( &map->om_readers[token], 1, __ATOMIC_SEQ_CST );
+#else
+	ldap_pvt_thread_mutex_unlock( &map->om_mutex );
+#endif
+}
+
+/* Free what can be freed and start a new batch, under om_mutex */
+static void
+omap_reclaim( ldap_pvt_omap_t *map )
+{
+#ifdef __GNUC__
+	unsigned int e = map->om_epoch;
+
+	if ( __atomic_load_n( &map->om_readers[!e], __ATOMIC_SEQ_CST ))
+		return;
+	__atomic_store_n( &map->om_epoch, !e, __ATOMIC_SEQ_CST );
+#endif
+	omap_free_list( map, map->om_retired[1] );
+	map->om_retired[1] = map->om_retired[0];
+	map->om_retired[0] = NULL;
+}
+
+void *
+ldap_pvt_omap_find( ldap_pvt_omap_t *map, const void *key )
+{
+	omap_node *x = map->om_head, *n;
+	int i, rc;
+
+	for ( i = OMAP_MAXLEVEL - 1; i >= 0; i-- ) {
+		while (( n = OMAP_GET( x->on_next[i] ))) {
+			rc = map->om_cmp( key, n->on_data );
+			if ( rc == 0 )
+				return n->on_data;
+			if ( rc < 0 )
+				break;
+			x = n;
+		}
+	}
+	return NULL;
+}
+
+void *
+ldap_pvt_omap_first( ldap_pvt_omap_t *map, void **cursor )
+{
+	omap_node *n = OMAP_GET( map->om_head->on_next[0] );
+
+	*cursor = n;
+	return n ? n->on_data : NULL;
+}
+
+void *
+ldap_pvt_omap_next( ldap_pvt_omap_t *map, void **cursor )
+{
+	omap_node *n = *cursor;
+
+	if ( n )
+		n = OMAP_GET( n->on_next[0] );
+	*cursor = n;
+	return n ? n->on_data : NULL;
+}
+
+/* Fill in the last node before key at each level, under om_mutex */
+static omap_node *
+omap_search( ldap_pvt_omap_t *map, const void *key, omap_node **prev )
+{
+	omap_node *x = map->om_head, *n;
+	int i;
+
+	for ( i = OMAP_MAXLEVEL - 1; i >= 0; i-- ) {
+		while (( n = x->on_next[i] ) &&
+			map->om_cmp( key, n->on_data ) > 0 )
+			x = n;
+		prev[i] = x;
+	}
+	n = x->on_next[0];
+	if ( n && map->om_cmp( key, n->on_data ) == 0 )
+		return n;
+	return NULL;
+}
+
+int
+ldap_pvt_omap_insert( ldap_pvt_omap_t *map, void *data, void **dup )
+{
+	omap_node *prev[OMAP_MAXLEVEL], *n;
+	unsigned int r;
+	int i, height;
+
+	ldap_pvt_thread_mutex_lock( &map->om_mutex );
+	n = omap_search( map, data, prev );
+	if ( n ) {
+		if ( dup )
+			*dup = n->on_data;
+		ldap_pvt_thread_mutex_unlock( &map->om_mutex );
+		return -1;
+	}
+
+	/* one in four nodes goes up a level */
+	r = map->om_seed;
+	r ^= r << 13;
+	r ^= r >> 17;
+	r ^= r << 5;
+	map->om_seed = r;
+	for ( height = 1; height < OMAP_MAXLEVEL && !( r & 3 ); r >>= 2 )
+		height++;
+
+	n = omap_node_alloc( data, height );
+	if ( n == NULL ) {
+		ldap_pvt_thread_mutex_unlock( &map->om_mutex );
+		if ( dup )
+			*dup = NULL;
+		return -1;
+	}
+	for ( i = 0; i < height; i++ )
+		n->on_next[i] = prev[i]->on_next[i];
+	for ( i = 0; i < height; i++ )
+		OMAP_SET( prev[i]->on_next[i], n );
+	map->om_count++;
+	ldap_pvt_thread_mutex_unlock( &map->om_mutex );
+	return 0;
+}
+
+void *
+ldap_pvt_omap_delete( ldap_pvt_omap_t *map, const void *key )
+{
+	omap_node *prev[OMAP_MAXLEVEL], *n;
+	void *data = NULL;
+	int i;
+
+	ldap_pvt_thread_mutex_lock( &map->om_mutex );
+	n = omap_search( map, key, prev );
+	if ( n ) {
+		for ( i = n->on_height - 1; i >= 0; i-- )
+			OMAP_SET( prev[i]->on_next[i], n->on_next[i] );
+		data = n->on_data;
+		n->on_retired = map->om_retired[0];
+		map->om_retired[0] = n;
+		map->om_count--;
+	}
+	omap_reclaim( map );
+	ldap_pvt_thread_mutex_unlock( &map->om_mutex );
+	return data;
+}
+
+int
+ldap_pvt_omap_count( ldap_pvt_omap_t *map )
+{
+	return map->om_count;
+}
+
+#endif /* LDAP_R_COMPILE */
@@ -394,6 +394,16 @@ ldap_get_option(
 		rc = LDAP_OPT_SUCCESS;
 		break;
 
+	case LDAP_OPT_CONCURRENT:
+		* (int *) outvalue = (int) LDAP_BOOL_GET(lo, LDAP_BOOL_CONCURRENT);
+		rc = LDAP_OPT_SUCCESS;
+		break;
+
+	case LDAP_OPT_RESOLV_CACHE_TTL:
+		* (int *) outvalue = lo->ldo_resolv_ttl;
+		rc = LDAP_OPT_SUCCESS;
+		break;
+
 	case LDAP_OPT_X_KEEPALIVE_IDLE:
 		* (int *) outvalue = lo->ldo_keepalive_idle;
 		rc = LDAP_OPT_SUCCESS;
@@ -511,6 +521,15 @@ ldap_set_option(
 		}
 		rc = LDAP_OPT_SUCCESS;
 		break;
+
+	case LDAP_OPT_CONCURRENT:
+		if(invalue == LDAP_OPT_OFF) {
+			LDAP_BOOL_CLR(lo, LDAP_BOOL_CONCURRENT);
+		} else {
+			LDAP_BOOL_SET(lo, LDAP_BOOL_CONCURRENT);
+		}
+		rc = LDAP_OPT_SUCCESS;
+		break;
 	/* options which can withstand invalue == NULL */
 	case LDAP_OPT_SERVER_CONTROLS: {
 			LDAPControl *const *controls =
@@ -793,6 +812,7 @@ ldap_set_option(
 	case LDAP_OPT_TIMEOUT:
 	case LDAP_OPT_NETWORK_TIMEOUT:
 	case LDAP_OPT_CONNECT_CB:
+	case LDAP_OPT_RESOLV_CACHE_TTL:
 	case LDAP_OPT_X_KEEPALIVE_IDLE:
 	case LDAP_OPT_X_KEEPALIVE_PROBES :
 	case LDAP_OPT_X_KEEPALIVE_INTERVAL :
@@ -904,6 +924,14 @@ ldap_set_option(
 		}
 		rc = LDAP_OPT_SUCCESS;
 		break;
+	case LDAP_OPT_RESOLV_CACHE_TTL:
+		if ( * (const int *) invalue < 0 ) {
+			rc = LDAP_OPT_ERROR;
+			break;
+		}
+		lo->ldo_resolv_ttl = * (const int *) invalue;
+		rc = LDAP_OPT_SUCCESS;
+		break;
 	case LDAP_OPT_X_KEEPALIVE_IDLE:
 		lo->ldo_keepalive_idle = * (const int *) invalue;
 		rc = LDAP_OPT_SUCCESS;
@@ -524,6 +524,432 @@ ldap_int_connect_cbs(LDAP *ld, Sockbuf *sb, ber_socket_t *s, LDAPURLDesc *srv, s
 	return 0;
 }
 
+#if defined( HAVE_GETADDRINFO ) && defined( HAVE_INET_NTOP )
+typedef struct ldap_addr {
+	int		la_family;
+	ber_socklen_t	la_len;
+	union {
+		struct sockaddr		sa;
+		struct sockaddr_in	sin;
+#ifdef LDAP_PF_INET6
+		struct sockaddr_in6	sin6;
+#endif
+	} la_addr;
+} ldap_addr;
+
+/*
+ * Resolved addresses are kept for LDAP_OPT_RESOLV_CACHE_TTL seconds,
+ * so that a burst of reconnects to the same server does not queue up
+ * on the resolver mutex.  getaddrinfo(3) does not report the DNS TTL,
+ * so the option is the lifetime of every entry.  An expired entry is
+ * still used if the resolver fails temporarily.
+ * Protected by ldap_int_resolv_mutex.
+ */
+typedef struct ldap_resolv_entry {
+	struct ldap_resolv_entry	*re_next;
+	char		*re_host;
+	char		re_serv[7];
+	int		re_family;
+	int		re_socktype;
+	time_t		re_expires;
+	int		re_naddrs;
+	ldap_addr	*re_addrs;
+} ldap_resolv_entry;
+
+#define LDAP_RESOLV_CACHE_MAX	64
+static ldap_resolv_entry *ldap_int_resolv_cache;
+
+static ldap_addr *
+ldap_int_addrs_dup( ldap_addr *addrs, int naddrs )
+{
+	ldap_addr *dup = LDAP_MALLOC( naddrs * sizeof(ldap_addr) );
+
+	if ( dup != NULL ) {
+		AC_MEMCPY( dup, addrs, naddrs * sizeof(ldap_addr) );
+	}
+	return dup;
+}
+
+static void
+ldap_int_resolv_cache_put( LDAP *ld, ldap_resolv_entry **rep,
+	const char *host, const char *serv, int family, int socktype,
+	ldap_addr *addrs, int naddrs )
+{
+	ldap_resolv_entry *re = rep ? *rep : NULL, **last;
+	ldap_addr *dup;
+	int n;
+
+	dup = ldap_int_addrs_dup( addrs, naddrs );
+	if ( dup == NULL ) {
+		return;
+	}
+
+	if ( re != NULL ) {
+		/* unlink, it goes back to the head */
+		*rep = re->re_next;
+		LDAP_FREE( re->re_addrs );
+
+	} else {
+		re = LDAP_CALLOC( 1, sizeof(ldap_resolv_entry) );
+		if ( re == NULL || ( re->re_host = LDAP_STRDUP( host ) ) == NULL ) {
+			LDAP_FREE( re );
+			LDAP_FREE( dup );
+			return;
+		}
+		strcpy( re->re_serv, serv );
+		re->re_family = family;
+		re->re_socktype = socktype;
+
+		/* drop the least recently resolved entry if full */
+		for ( last = &ldap_int_resolv_cache, n = 1; *last && (*last)->re_next;
+			last = &(*last)->re_next, n++ )
+			;
+		if ( n >= LDAP_RESOLV_CACHE_MAX && *last ) {
+			LDAP_FREE( (*last)->re_host );
+			LDAP_FREE( (*last)->re_addrs );
+			LDAP_FREE( *last );
+			*last = NULL;
+		}
+	}
+
+	re->re_addrs = dup;
+	re->re_naddrs = naddrs;
+	re->re_expires = time( NULL ) + ld->ld_options.ldo_resolv_ttl;
+	re->re_next = ldap_int_resolv_cache;
+	ldap_int_resolv_cache = re;
+}
+
+static struct addrinfo *
+ldap_int_next_family( struct addrinfo *ai, int family, int same )
+{
+	for ( ; ai != NULL; ai = ai->ai_next ) {
+		if ( ( ai->ai_family == family ) == same ) {
+			break;
+		}
+	}
+	return ai;
+}
+
+/*
+ * Resolve host, returning its addresses with the address families
+ * interleaved, starting with the one getaddrinfo(3) prefers, as the
+ * parallel connect in RFC 8305 expects.
+ */
+static int
+ldap_int_getaddrs( LDAP *ld, const char *host, const char *serv,
+	int socktype, ldap_addr **addrsp, int *naddrsp )
+{
+	struct addrinfo hints, *res, *sai;
+	ldap_resolv_entry *re, **rep;
+	struct addrinfo *cur[2];
+	ldap_addr *addrs = NULL;
+	int ttl = ld->ld_options.ldo_resolv_ttl;
+	int err, n, i, first;
+
+	memset( &hints, '\0', sizeof(hints) );
+#ifdef USE_AI_ADDRCONFIG /* FIXME: configure test needed */
+	/* Use AI_ADDRCONFIG only on systems where its known to be needed. */
+	hints.ai_flags = AI_ADDRCONFIG;
+#endif
+	hints.ai_family = ldap_int_inet4or6;
+	hints.ai_socktype = socktype;
+
+	/* most getaddrinfo(3) use non-threadsafe resolver libraries */
+	LDAP_MUTEX_LOCK(&ldap_int_resolv_mutex);
+
+	for ( rep = &ldap_int_resolv_cache; ( re = *rep ) != NULL;
+		rep = &re->re_next )
+	{
+		if ( re->re_socktype == socktype &&
+			re->re_family == hints.ai_family &&
+			strcmp( re->re_serv, serv ) == 0 &&
+			strcasecmp( re->re_host, host ) == 0 )
+		{
+			break;
+		}
+	}
+
+	if ( re != NULL && ttl > 0 && re->re_expires > time( NULL ) ) {
+		Debug2(LDAP_DEBUG_TRACE,
+			"ldap_connect_to_host: using cached addresses of %s:%s\n",
+			host, serv );
+		goto cached;
+	}
+
+	err = getaddrinfo( host, serv, &hints, &res );
+
+	if ( err != 0 ) {
+		if ( re != NULL && ttl > 0 && err == EAI_AGAIN ) {
+			Debug2(LDAP_DEBUG_TRACE,
+				"ldap_connect_to_host: getaddrinfo failed: %s, "
+				"using expired addresses of %s\n",
+				AC_GAI_STRERROR(err), host );
+			goto cached;
+		}
+		LDAP_MUTEX_UNLOCK(&ldap_int_resolv_mutex);
+		return err;
+	}
+
+	for ( n = 0, sai = res; sai != NULL; sai = sai->ai_next ) {
+		n++;
+	}
+	addrs = LDAP_MALLOC( n * sizeof(ldap_addr) );
+	if ( addrs == NULL ) {
+		freeaddrinfo( res );
+		LDAP_MUTEX_UNLOCK(&ldap_int_resolv_mutex);
+		return EAI_MEMORY;
+	}
+
+	/* take the preferred family first, then alternate */
+	first = res->ai_family;
+	cur[0] = ldap_int_next_family( res, first, 1 );
+	cur[1] = ldap_int_next_family( res, first, 0 );
+	for ( n = 0, i = 0; cur[0] != NULL || cur[1] != NULL; i = !i ) {
+		if ( cur[i] == NULL ) {
+			i = !i;
+		}
+		sai = cur[i];
+		cur[i] = ldap_int_next_family( sai->ai_next, first, !i );
+
+		if( sai->ai_addr == NULL ) {
+			Debug0(LDAP_DEBUG_TRACE,
+				"ldap_connect_to_host: getaddrinfo "
+				"ai_addr is NULL?\n" );
+			continue;
+		}
+#ifndef LDAP_PF_INET6
+		if ( sai->ai_family == AF_INET6 ) continue;
+#endif
+		if ( sai->ai_addrlen > sizeof(addrs[n].la_addr) ) {
+			continue;
+		}
+		addrs[n].la_family = sai->ai_family;
+		addrs[n].la_len = sai->ai_addrlen;
+		AC_MEMCPY( &addrs[n].la_addr, sai->ai_addr, sai->ai_addrlen );
+		n++;
+	}
+	freeaddrinfo( res );
+
+	if ( ttl > 0 && n > 0 ) {
+		ldap_int_resolv_cache_put( ld, re ? rep : NULL, host, serv,
+			hints.ai_family, socktype, addrs, n );
+	}
+
+	LDAP_MUTEX_UNLOCK(&ldap_int_resolv_mutex);
+
+	*addrsp = addrs;
+	*naddrsp = n;
+	return 0;
+
+cached:
+	addrs = ldap_int_addrs_dup( re->re_addrs, re->re_naddrs );
+	n = re->re_naddrs;
+
+	LDAP_MUTEX_UNLOCK(&ldap_int_resolv_mutex);
+
+	if ( addrs == NULL ) {
+		return EAI_MEMORY;
+	}
+	*addrsp = addrs;
+	*naddrsp = n;
+	return 0;
+}
+
+static void
+ldap_int_trace_addr( ldap_addr *la, const char *serv )
+{
+	switch (la->la_family) {
+#ifdef LDAP_PF_INET6
+		case AF_INET6: {
+			char addr[INET6_ADDRSTRLEN];
+			inet_ntop( AF_INET6, &la->la_addr.sin6.sin6_addr,
+				addr, sizeof addr);
+			Debug2(LDAP_DEBUG_TRACE,
+			      "ldap_connect_to_host: Trying %s %s\n",
+				addr, serv );
+		} break;
+#endif
+		case AF_INET: {
+			char addr[INET_ADDRSTRLEN];
+			inet_ntop( AF_INET, &la->la_addr.sin.sin_addr,
+				addr, sizeof addr);
+			Debug2(LDAP_DEBUG_TRACE,
+			      "ldap_connect_to_host: Trying %s:%s\n",
+				addr, serv );
+		} break;
+	}
+}
+
+#ifdef HAVE_POLL
+#define LDAP_CONNECT_ATTEMPT_DELAY	250	/* msec, as in RFC 8305 */
+
+static long
+ldap_int_elapsed( struct timeval *start )
+{
+	struct timeval now;
+
+	gettimeofday( &now, NULL );
+	return ( now.tv_sec - start->tv_sec ) * 1000L +
+		( now.tv_usec - start->tv_usec ) / 1000L;
+}
+
+/*
+ * Connect to the first of addrs that answers: a new attempt is started
+ * whenever the previous one failed or has not completed within
+ * LDAP_CONNECT_ATTEMPT_DELAY, keeping the earlier ones going, so an
+ * unreachable address costs a fraction of a second instead of a full
+ * network timeout.  The network timeout bounds the whole sequence.
+ */
+static int
+ldap_int_connect_parallel( LDAP *ld, Sockbuf *sb, int proto, int socktype,
+	LDAPURLDesc *srv, ldap_addr *addrs, int naddrs, const char *serv )
+{
+	struct pollfd *fds;
+	int *idx;
+	struct timeval start;
+	long elapsed, last = -LDAP_CONNECT_ATTEMPT_DELAY, limit = -1;
+	ber_socket_t s = AC_SOCKET_INVALID;
+	int npending = 0, next = 0, win = -1, timeout, i, rc, err = 0;
+
+	fds = LDAP_MALLOC( naddrs * ( sizeof(struct pollfd) + sizeof(int) ) );
+	if ( fds == NULL ) {
+		return -1;
+	}
+	idx = (int *)( fds + naddrs );
+
+	if ( ld->ld_options.ldo_tm_net.tv_sec >= 0 ) {
+		limit = TV2MILLISEC( &ld->ld_options.ldo_tm_net );
+	}
+	gettimeofday( &start, NULL );
+
+	for ( ;; ) {
+		elapsed = ldap_int_elapsed( &start );
+		if ( limit >= 0 && elapsed >= limit ) {
+			err = ETIMEDOUT;
+			break;
+		}
+
+		if ( next < naddrs &&
+			( npending == 0 || elapsed - last >= LDAP_CONNECT_ATTEMPT_DELAY ) )
+		{
+			ldap_addr *la = &addrs[next++];
+
+			s = ldap_int_socket( ld, la->la_family, socktype );
+			if ( s == AC_SOCKET_INVALID ) {
+				continue;
+			}
+			if ( ldap_int_prepare_socket( ld, s, proto ) == -1 ||
+				ldap_pvt_ndelay_on( ld, s ) == -1 )
+			{
+				ldap_pvt_close_socket( ld, s );
+				continue;
+			}
+			ldap_int_trace_addr( la, serv );
+
+			do {
+				rc = connect( s, &la->la_addr.sa, la->la_len );
+				err = rc == AC_SOCKET_ERROR ? sock_errno() : 0;
+			} while ( err == EINTR &&
+				LDAP_BOOL_GET( &ld->ld_options, LDAP_BOOL_RESTART ) );
+
+			if ( rc != AC_SOCKET_ERROR ) {
+				win = next - 1;
+				break;
+			}
+			if ( err != EINPROGRESS && err != EWOULDBLOCK ) {
+				Debug1(LDAP_DEBUG_TRACE, "connect errno: %d\n", err );
+				ldap_pvt_close_socket( ld, s );
+				continue;
+			}
+			fds[npending].fd = s;
+			fds[npending].events = POLL_WRITE;
+			idx[npending] = next - 1;
+			npending++;
+			last = elapsed;
+			continue;
+		}
+
+		if ( npending == 0 ) {
+			break;
+		}
+
+		timeout = INFTIM;
+		if ( next < naddrs ) {
+			timeout = last + LDAP_CONNECT_ATTEMPT_DELAY - elapsed;
+		}
+		if ( limit >= 0 && ( timeout == INFTIM || limit - elapsed < timeout ) ) {
+			timeout = limit - elapsed;
+		}
+
+		for ( i = 0; i < npending; i++ ) {
+			fds[i].revents = 0;
+		}
+		rc = poll( fds, npending, timeout );
+		if ( rc == AC_SOCKET_ERROR ) {
+			err = sock_errno();
+			if ( err == EINTR &&
+				LDAP_BOOL_GET( &ld->ld_options, LDAP_BOOL_RESTART ) )
+			{
+				continue;
+			}
+			break;
+		}
+
+		for ( i = 0; i < npending; ) {
+			int so_errno = 0;
+			ber_socklen_t len = sizeof(so_errno);
+
+			if ( fds[i].revents == 0 ) {
+				i++;
+				continue;
+			}
+			if ( getsockopt( fds[i].fd, SOL_SOCKET, SO_ERROR,
+					(void *)&so_errno, &len ) == 0 && so_errno == 0 )
+			{
+				s = fds[i].fd;
+				win = idx[i];
+				fds[i] = fds[--npending];
+				idx[i] = idx[npending];
+				break;
+			}
+			Debug2(LDAP_DEBUG_TRACE, "ldap_connect_to_host: "
+				"fd: %d connect errno: %d\n", fds[i].fd, so_errno );
+			err = so_errno;
+			ldap_pvt_close_socket( ld, fds[i].fd );
+			fds[i] = fds[--npending];
+			idx[i] = idx[npending];
+			/* don't wait to try the next one */
+			last = -LDAP_CONNECT_ATTEMPT_DELAY;
+		}
+		if ( win >= 0 ) {
+			break;
+		}
+	}
+
+	for ( i = 0; i < npending; i++ ) {
+		ldap_pvt_close_socket( ld, fds[i].fd );
+	}
+	LDAP_FREE( fds );
+
+	if ( win < 0 ) {
+		ldap_pvt_set_errno( err ? err : ECONNREFUSED );
+		return -1;
+	}
+
+	Debug1(LDAP_DEBUG_TRACE, "ldap_connect_to_host: fd: %d connected\n", s );
+	if ( ldap_pvt_ndelay_off( ld, s ) == -1 ) {
+		ldap_pvt_close_socket( ld, s );
+		return -1;
+	}
+	rc = ldap_int_connect_cbs( ld, sb, &s, srv, &addrs[win].la_addr.sa );
+	if ( rc ) {
+		ldap_pvt_close_socket( ld, s );
+	}
+	return rc;
+}
+#endif /* HAVE_POLL */
+#endif /* HAVE_GETADDRINFO && HAVE_INET_NTOP */
+
 int
 ldap_connect_to_host(LDAP *ld, Sockbuf *sb,
 	int proto, LDAPURLDesc *srv,
@@ -536,8 +962,8 @@ ldap_connect_to_host(LDAP *ld, Sockbuf *sb,
 
 #if defined( HAVE_GETADDRINFO ) && defined( HAVE_INET_NTOP )
 	char serv[7];
-	int err;
-	struct addrinfo hints, *res, *sai;
+	int err, i, naddrs;
+	ldap_addr *addrs;
 #else
 	int i;
 	int use_hp = 0;
@@ -580,21 +1006,9 @@ ldap_connect_to_host(LDAP *ld, Sockbuf *sb,
 	}
 
 #if defined( HAVE_GETADDRINFO ) && defined( HAVE_INET_NTOP )
-	memset( &hints, '\0', sizeof(hints) );
-#ifdef USE_AI_ADDRCONFIG /* FIXME: configure test needed */
-	/* Use AI_ADDRCONFIG only on systems where its known to be needed. */
-	hints.ai_flags = AI_ADDRCONFIG;
-#endif
-	hints.ai_family = ldap_int_inet4or6;
-	hints.ai_socktype = socktype;
 	snprintf(serv, sizeof serv, "%d", port );
 
-	/* most getaddrinfo(3) use non-threadsafe resolver libraries */
-	LDAP_MUTEX_LOCK(&ldap_int_resolv_mutex);
-
-	err = getaddrinfo( host, serv, &hints, &res );
-
-	LDAP_MUTEX_UNLOCK(&ldap_int_resolv_mutex);
+	err = ldap_int_getaddrs( ld, host, serv, socktype, &addrs, &naddrs );
 
 	if ( err != 0 ) {
 		Debug1(LDAP_DEBUG_TRACE,
@@ -604,19 +1018,18 @@ ldap_connect_to_host(LDAP *ld, Sockbuf *sb,
 	}
 	rc = -1;
 
-	for( sai=res; sai != NULL; sai=sai->ai_next) {
-		if( sai->ai_addr == NULL ) {
-			Debug0(LDAP_DEBUG_TRACE,
-				"ldap_connect_to_host: getaddrinfo "
-				"ai_addr is NULL?\n" );
-			continue;
-		}
-
-#ifndef LDAP_PF_INET6
-		if ( sai->ai_family == AF_INET6 ) continue;
+#ifdef HAVE_POLL
+	if ( naddrs > 1 && !async && proto == LDAP_PROTO_TCP ) {
+		rc = ldap_int_connect_parallel( ld, sb, proto, socktype, srv,
+			addrs, naddrs, serv );
+		LDAP_FREE( addrs );
+		return rc;
+	}
 #endif
+
+	for( i = 0; i < naddrs; i++ ) {
 		/* we assume AF_x and PF_x are equal for all x */
-		s = ldap_int_socket( ld, sai->ai_family, socktype );
+		s = ldap_int_socket( ld, addrs[i].la_family, socktype );
 		if ( s == AC_SOCKET_INVALID ) {
 			continue;
 		}
@@ -626,33 +1039,12 @@ ldap_connect_to_host(LDAP *ld, Sockbuf *sb,
 			break;
 		}
 
-		switch (sai->ai_family) {
-#ifdef LDAP_PF_INET6
-			case AF_INET6: {
-				char addr[INET6_ADDRSTRLEN];
-				inet_ntop( AF_INET6,
-					&((struct sockaddr_in6 *)sai->ai_addr)->sin6_addr,
-					addr, sizeof addr);
-				Debug2(LDAP_DEBUG_TRACE,
-				      "ldap_connect_to_host: Trying %s %s\n",
-					addr, serv );
-			} break;
-#endif
-			case AF_INET: {
-				char addr[INET_ADDRSTRLEN];
-				inet_ntop( AF_INET,
-					&((struct sockaddr_in *)sai->ai_addr)->sin_addr,
-					addr, sizeof addr);
-				Debug2(LDAP_DEBUG_TRACE,
-				      "ldap_connect_to_host: Trying %s:%s\n",
-					addr, serv );
-			} break;
-		}
+		ldap_int_trace_addr( &addrs[i], serv );
 
 		rc = ldap_pvt_connect( ld, s,
-			sai->ai_addr, sai->ai_addrlen, async );
+			&addrs[i].la_addr.sa, addrs[i].la_len, async );
 		if ( rc == 0 || rc == -2 ) {
-			err = ldap_int_connect_cbs( ld, sb, &s, srv, sai->ai_addr );
+			err = ldap_int_connect_cbs( ld, sb, &s, srv, &addrs[i].la_addr.sa );
 			if ( err )
 				rc = err;
 			else
@@ -660,7 +1052,7 @@ ldap_connect_to_host(LDAP *ld, Sockbuf *sb,
 		}
 		ldap_pvt_close_socket(ld, s);
 	}
-	freeaddrinfo(res);
+	LDAP_FREE( addrs );
 
 #else
 	if (! inet_aton( host, &in ) ) {
@@ -1114,19 +1506,15 @@ ldap_int_ip_init( void )
 #endif
 
 
-int
-ldap_int_select( LDAP *ld, struct timeval *timeout )
+static int
+ldap_int_select_info( struct selectinfo *sip, struct timeval *timeout )
 {
 	int rc;
-	struct selectinfo	*sip;
-
-	Debug0( LDAP_DEBUG_TRACE, "ldap_int_select\n" );
 
 #ifndef HAVE_POLL
 	if ( ldap_int_tblsize == 0 ) ldap_int_ip_init();
 #endif
 
-	sip = (struct selectinfo *)ld->ld_selectinfo;
 	assert( sip != NULL );
 
 #ifdef HAVE_POLL
@@ -1145,3 +1533,90 @@ ldap_int_select( LDAP *ld, struct timeval *timeout )
 
 	return rc;
 }
+
+int
+ldap_int_select( LDAP *ld, struct timeval *timeout )
+{
+	Debug0( LDAP_DEBUG_TRACE, "ldap_int_select\n" );
+
+	return ldap_int_select_info( (struct selectinfo *)ld->ld_selectinfo,
+		timeout );
+}
+
+/*
+ * With LDAP_OPT_CONCURRENT, the reading thread waits for input
+ * without holding ld_conn_mutex, so other threads may meanwhile
+ * add or remove descriptors; it waits on a private copy of the
+ * select info instead, and merges the outcome back afterwards.
+ */
+
+/* protected by conn_mutex */
+void *
+ldap_int_select_snapshot( LDAP *ld, void *snap )
+{
+	if ( snap == NULL ) {
+		snap = ldap_new_select_info();
+		if ( snap == NULL ) {
+			return NULL;
+		}
+	}
+
+#ifdef HAVE_POLL
+	{
+		struct selectinfo	*sip = (struct selectinfo *)ld->ld_selectinfo,
+					*ssip = (struct selectinfo *)snap;
+
+		ssip->si_maxfd = sip->si_maxfd;
+		AC_MEMCPY( ssip->si_fds, sip->si_fds,
+			sip->si_maxfd * sizeof( struct pollfd ) );
+	}
+#else
+	AC_MEMCPY( snap, ld->ld_selectinfo, sizeof( struct selectinfo ) );
+#endif
+
+	return snap;
+}
+
+int
+ldap_int_select_unlocked( void *snap, struct timeval *timeout )
+{
+	Debug0( LDAP_DEBUG_TRACE, "ldap_int_select_unlocked\n" );
+
+	return ldap_int_select_info( (struct selectinfo *)snap, timeout );
+}
+
+/* protected by conn_mutex */
+void
+ldap_int_select_merge( LDAP *ld, void *snap )
+{
+	struct selectinfo	*sip = (struct selectinfo *)ld->ld_selectinfo,
+				*ssip = (struct selectinfo *)snap;
+
+#ifdef HAVE_POLL
+	int	i, j;
+
+	for ( i = 0; i < sip->si_maxfd; i++ ) {
+		sip->si_fds[i].revents = 0;
+		for ( j = 0; j < ssip->si_maxfd; j++ ) {
+			if ( ssip->si_fds[j].fd == sip->si_fds[i].fd ) {
+				sip->si_fds[i].revents = ssip->si_fds[j].revents
+					& sip->si_fds[i].events;
+				break;
+			}
+		}
+	}
+#else
+	int	i;
+
+	sip->si_use_readfds = ssip->si_use_readfds;
+	sip->si_use_writefds = ssip->si_use_writefds;
+	for ( i = 0; i < ldap_int_tblsize; i++ ) {
+		if ( !FD_ISSET( i, &sip->si_readfds ) ) {
+			FD_CLR( i, &sip->si_use_readfds );
+		}
+		if ( !FD_ISSET( i, &sip->si_writefds ) ) {
+			FD_CLR( i, &sip->si_use_writefds );
+		}
+	}
+#endif
+}
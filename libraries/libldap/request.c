@@ -399,12 +399,7 @@ ldap_send_server_request(
 		}
 	}
 
-	lr->lr_prev = NULL;
-	lr->lr_next = ld->ld_requests;
-	if ( lr->lr_next != NULL ) {
-		lr->lr_next->lr_prev = lr;
-	}
-	ld->ld_requests = lr;
+	ldap_int_request_link( ld, lr );
 
 	ld->ld_errno = LDAP_SUCCESS;
 	if ( ldap_int_flush_request( ld, lr ) == -1 ) {
@@ -944,6 +939,119 @@ ldap_dump_requests_and_responses( LDAP *ld )
 }
 #endif /* LDAP_DEBUG */
 
+/* protected by req_mutex */
+static void
+ldap_int_request_rehash( LDAP *ld )
+{
+	LDAPRequest	**hash, *lr;
+	int		size;
+	unsigned	b;
+
+	for ( size = ld->ld_req_hsize ? ld->ld_req_hsize : LDAP_MSGID_HASH_MIN;
+		size < ld->ld_nrequests; size <<= 1 )
+		/* grow */ ;
+
+	hash = (LDAPRequest **)LDAP_CALLOC( size, sizeof( LDAPRequest * ) );
+	if ( hash == NULL ) {
+		/* keep the current table, if any; chains just get longer */
+		return;
+	}
+
+	for ( lr = ld->ld_requests; lr != NULL; lr = lr->lr_next ) {
+		b = LDAP_MSGID_BUCKET( lr->lr_msgid, size );
+		lr->lr_hnext = hash[ b ];
+		hash[ b ] = lr;
+	}
+
+	if ( ld->ld_req_hash != NULL ) {
+		LDAP_FREE( ld->ld_req_hash );
+	}
+	ld->ld_req_hash = hash;
+	ld->ld_req_hsize = size;
+}
+
+/*
+ * Prepends lr to the list of outstanding requests
+ * and indexes it by msgid.
+ */
+/* protected by req_mutex */
+void
+ldap_int_request_link( LDAP *ld, LDAPRequest *lr )
+{
+	lr->lr_prev = NULL;
+	lr->lr_next = ld->ld_requests;
+	if ( lr->lr_next != NULL ) {
+		lr->lr_next->lr_prev = lr;
+	}
+	ld->ld_requests = lr;
+
+	if ( ++ld->ld_nrequests > ld->ld_req_hsize ) {
+		LDAPRequest	**old = ld->ld_req_hash;
+
+		ldap_int_request_rehash( ld );
+		if ( ld->ld_req_hash != old ) {
+			return;
+		}
+	}
+
+	if ( ld->ld_req_hash != NULL ) {
+		unsigned	b = LDAP_MSGID_BUCKET( lr->lr_msgid, ld->ld_req_hsize );
+
+		lr->lr_hnext = ld->ld_req_hash[ b ];
+		ld->ld_req_hash[ b ] = lr;
+	}
+}
+
+/* protected by req_mutex */
+static void
+ldap_int_request_unhash( LDAP *ld, LDAPRequest *lr )
+{
+	LDAPRequest	**lrp;
+
+	if ( ld->ld_req_hash == NULL ) {
+		return;
+	}
+
+	for ( lrp = &ld->ld_req_hash[ LDAP_MSGID_BUCKET( lr->lr_msgid, ld->ld_req_hsize ) ];
+		*lrp != NULL; lrp = &(*lrp)->lr_hnext )
+	{
+		if ( *lrp == lr ) {
+			*lrp = lr->lr_hnext;
+			lr->lr_hnext = NULL;
+			ld->ld_nrequests--;
+			break;
+		}
+	}
+}
+
+/*
+ * Candidates for msgid: its hash bucket, or the whole list
+ * if the table could not be allocated
+ */
+#define LDAP_REQ_FIRST(ld, msgid) ( (ld)->ld_req_hash \
+	? (ld)->ld_req_hash[ LDAP_MSGID_BUCKET( (msgid), (ld)->ld_req_hsize ) ] \
+	: (ld)->ld_requests )
+#define LDAP_REQ_NEXT(ld, lr) ( (ld)->ld_req_hash ? (lr)->lr_hnext : (lr)->lr_next )
+
+/*
+ * Returns the outstanding request with the given msgid, if any,
+ * regardless of its status; no reference is taken.
+ */
+/* protected by req_mutex */
+LDAPRequest *
+ldap_int_request_find( LDAP *ld, ber_int_t msgid )
+{
+	LDAPRequest	*lr;
+
+	for ( lr = LDAP_REQ_FIRST( ld, msgid ); lr != NULL; lr = LDAP_REQ_NEXT( ld, lr ) ) {
+		if ( lr->lr_msgid == msgid ) {
+			break;
+		}
+	}
+
+	return lr;
+}
+
 /* protected by req_mutex */
 static void
 ldap_free_request_int( LDAP *ld, LDAPRequest *lr )
@@ -972,6 +1080,8 @@ ldap_free_request_int( LDAP *ld, LDAPRequest *lr )
 		lr->lr_next->lr_prev = lr->lr_prev;
 	}
 
+	ldap_int_request_unhash( ld, lr );
+
 	if ( lr->lr_refcnt > 0 ) {
 		lr->lr_refcnt = -lr->lr_refcnt;
 
@@ -1650,7 +1760,7 @@ ldap_find_request_by_msgid( LDAP *ld, ber_int_t msgid )
 {
 	LDAPRequest	*lr;
 
-	for ( lr = ld->ld_requests; lr != NULL; lr = lr->lr_next ) {
+	for ( lr = LDAP_REQ_FIRST( ld, msgid ); lr != NULL; lr = LDAP_REQ_NEXT( ld, lr ) ) {
 		if ( lr->lr_status == LDAP_REQST_COMPLETED ) {
 			continue;	/* Skip completed requests */
 		}
@@ -1669,7 +1779,7 @@ ldap_return_request( LDAP *ld, LDAPRequest *lrx, int freeit )
 {
 	LDAPRequest	*lr;
 
-	for ( lr = ld->ld_requests; lr != NULL; lr = lr->lr_next ) {
+	for ( lr = LDAP_REQ_FIRST( ld, lrx->lr_msgid ); lr != NULL; lr = LDAP_REQ_NEXT( ld, lr ) ) {
 		if ( lr == lrx ) {
 			if ( lr->lr_refcnt > 0 ) {
 				lr->lr_refcnt--;
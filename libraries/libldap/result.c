@@ -78,6 +78,302 @@ static LDAPMessage * chkResponseList LDAP_P(( LDAP *ld, int msgid, int all));
 
 #define LDAP_MSG_X_KEEP_LOOKING		(-2)
 
+#ifdef LDAP_R_COMPILE
+/* longest wait for input with LDAP_OPT_CONCURRENT */
+#define LDAP_CONCURRENT_SLICE	{ 0, 100000 }
+#endif /* LDAP_R_COMPILE */
+
+/*
+ * Candidates for msgid: its hash bucket, or the whole list
+ * if the table could not be allocated
+ */
+#define LDAP_RES_FIRST(ld, msgid) ( (ld)->ld_res_hash \
+	? (ld)->ld_res_hash[ LDAP_MSGID_BUCKET( (msgid), (ld)->ld_res_hsize ) ] \
+	: (ld)->ld_responses )
+#define LDAP_RES_NEXT(ld, lm) ( (ld)->ld_res_hash ? (lm)->lm_hnext : (lm)->lm_next )
+
+/* protected by res_mutex */
+static void
+ldap_int_response_rehash( LDAP *ld )
+{
+	LDAPMessage	**hash, *lm;
+	int		size;
+	unsigned	b;
+
+	for ( size = ld->ld_res_hsize ? ld->ld_res_hsize : LDAP_MSGID_HASH_MIN;
+		size < ld->ld_nresponses; size <<= 1 )
+		/* grow */ ;
+
+	hash = (LDAPMessage **)LDAP_CALLOC( size, sizeof( LDAPMessage * ) );
+	if ( hash == NULL ) {
+		/* keep the current table, if any; chains just get longer */
+		return;
+	}
+
+	for ( lm = ld->ld_responses; lm != NULL; lm = lm->lm_next ) {
+		b = LDAP_MSGID_BUCKET( lm->lm_msgid, size );
+		lm->lm_hnext = hash[ b ];
+		hash[ b ] = lm;
+	}
+
+	if ( ld->ld_res_hash != NULL ) {
+		LDAP_FREE( ld->ld_res_hash );
+	}
+	ld->ld_res_hash = hash;
+	ld->ld_res_hsize = size;
+}
+
+/*
+ * Prepends lm to the list of outstanding responses
+ * and indexes it by msgid.
+ */
+/* protected by res_mutex */
+static void
+ldap_int_response_link( LDAP *ld, LDAPMessage *lm )
+{
+	lm->lm_prev = NULL;
+	lm->lm_next = ld->ld_responses;
+	if ( lm->lm_next != NULL ) {
+		lm->lm_next->lm_prev = lm;
+	}
+	ld->ld_responses = lm;
+
+	if ( ++ld->ld_nresponses > ld->ld_res_hsize ) {
+		LDAPMessage	**old = ld->ld_res_hash;
+
+		ldap_int_response_rehash( ld );
+		if ( ld->ld_res_hash != old ) {
+			return;
+		}
+	}
+
+	if ( ld->ld_res_hash != NULL ) {
+		unsigned	b = LDAP_MSGID_BUCKET( lm->lm_msgid, ld->ld_res_hsize );
+
+		lm->lm_hnext = ld->ld_res_hash[ b ];
+		ld->ld_res_hash[ b ] = lm;
+	}
+}
+
+/*
+ * Puts nlm in place of lm, both in the list of outstanding
+ * responses and in the index; they must share the msgid.
+ * If nlm is NULL, lm is just removed.
+ */
+/* protected by res_mutex */
+static void
+ldap_int_response_replace( LDAP *ld, LDAPMessage *lm, LDAPMessage *nlm )
+{
+	LDAPMessage	*next = nlm ? nlm : lm->lm_next;
+
+	if ( nlm != NULL ) {
+		assert( nlm->lm_msgid == lm->lm_msgid );
+		nlm->lm_prev = lm->lm_prev;
+		nlm->lm_next = lm->lm_next;
+		if ( lm->lm_next != NULL ) {
+			lm->lm_next->lm_prev = nlm;
+		}
+	} else if ( lm->lm_next != NULL ) {
+		lm->lm_next->lm_prev = lm->lm_prev;
+	}
+
+	if ( lm->lm_prev != NULL ) {
+		lm->lm_prev->lm_next = next;
+	} else {
+		assert( ld->ld_responses == lm );
+		ld->ld_responses = next;
+	}
+
+	if ( ld->ld_res_hash != NULL ) {
+		LDAPMessage	**lmp;
+
+		for ( lmp = &ld->ld_res_hash[ LDAP_MSGID_BUCKET( lm->lm_msgid, ld->ld_res_hsize ) ];
+			*lmp != NULL; lmp = &(*lmp)->lm_hnext )
+		{
+			if ( *lmp == lm ) {
+				if ( nlm != NULL ) {
+					nlm->lm_hnext = lm->lm_hnext;
+					*lmp = nlm;
+				} else {
+					*lmp = lm->lm_hnext;
+				}
+				break;
+			}
+		}
+	}
+
+	if ( nlm == NULL ) {
+		ld->ld_nresponses--;
+	}
+
+	lm->lm_prev = NULL;
+	lm->lm_next = NULL;
+	lm->lm_hnext = NULL;
+}
+
+#define ldap_int_response_unlink( ld, lm )	ldap_int_response_replace( (ld), (lm), NULL )
+
+/* protected by res_mutex */
+static LDAPMessage *
+ldap_int_response_find( LDAP *ld, ber_int_t msgid )
+{
+	LDAPMessage	*lm;
+
+	for ( lm = LDAP_RES_FIRST( ld, msgid ); lm != NULL; lm = LDAP_RES_NEXT( ld, lm ) ) {
+		if ( lm->lm_msgid == msgid ) {
+			break;
+		}
+	}
+
+	return lm;
+}
+
+#ifdef LDAP_R_COMPILE
+/* a thread waiting for the reading thread to queue its response */
+typedef struct ldapwaiter {
+	ber_int_t		lw_msgid;
+	ldap_pvt_thread_cond_t	lw_cond;
+	struct ldapwaiter	*lw_next;
+} LDAPWaiter;
+
+#define LDAP_WAKE_READY		0	/* those whose response is queued */
+#define LDAP_WAKE_ALL		1	/* everybody, e.g. to check timeouts */
+#define LDAP_WAKE_READER	2	/* also one to take over reading */
+
+/* protected by res_mutex */
+static void
+ldap_int_wake_waiters( LDAP *ld, int how )
+{
+	LDAPWaiter	*lw;
+
+	for ( lw = ld->ld_waiters; lw != NULL; lw = lw->lw_next ) {
+		if ( how == LDAP_WAKE_ALL ||
+			( how == LDAP_WAKE_READER && lw == ld->ld_waiters ) ||
+			( lw->lw_msgid == LDAP_RES_ANY ? ld->ld_responses != NULL
+				: ldap_int_response_find( ld, lw->lw_msgid ) != NULL ) )
+		{
+			ldap_pvt_thread_cond_signal( &lw->lw_cond );
+		}
+	}
+}
+#endif /* LDAP_R_COMPILE */
+
+/* a completion callback registered with ldap_set_result_proc() */
+typedef struct ldapresultproc {
+	ber_int_t		lp_msgid;
+	LDAP_RESULT_PROC	*lp_proc;
+	void			*lp_params;
+	struct ldapresultproc	*lp_next;
+} LDAPResultProc;
+
+/* protected by res_mutex */
+static LDAPResultProc **
+ldap_int_result_proc_slot( LDAP *ld, ber_int_t msgid )
+{
+	LDAPResultProc	**lpp;
+
+	if ( ld->ld_proc_hash == NULL ) {
+		return NULL;
+	}
+
+	for ( lpp = &ld->ld_proc_hash[ LDAP_MSGID_BUCKET( msgid, ld->ld_proc_hsize ) ];
+		*lpp != NULL; lpp = &(*lpp)->lp_next )
+	{
+		if ( (*lpp)->lp_msgid == msgid ) {
+			break;
+		}
+	}
+
+	return lpp;
+}
+
+/* protected by res_mutex */
+static int
+ldap_int_result_proc_rehash( LDAP *ld )
+{
+	LDAPResultProc	**hash, *lp, *next;
+	int		i, size;
+	unsigned	b;
+
+	for ( size = ld->ld_proc_hsize ? ld->ld_proc_hsize : LDAP_MSGID_HASH_MIN;
+		size < ld->ld_nprocs; size <<= 1 )
+		/* grow */ ;
+
+	hash = (LDAPResultProc **)LDAP_CALLOC( size, sizeof( LDAPResultProc * ) );
+	if ( hash == NULL ) {
+		/* ok as long as there is a table; chains just get longer */
+		return ld->ld_proc_hash == NULL ? -1 : 0;
+	}
+
+	for ( i = 0; i < ld->ld_proc_hsize; i++ ) {
+		for ( lp = ld->ld_proc_hash[ i ]; lp != NULL; lp = next ) {
+			next = lp->lp_next;
+			b = LDAP_MSGID_BUCKET( lp->lp_msgid, size );
+			lp->lp_next = hash[ b ];
+			hash[ b ] = lp;
+		}
+	}
+
+	if ( ld->ld_proc_hash != NULL ) {
+		LDAP_FREE( ld->ld_proc_hash );
+	}
+	ld->ld_proc_hash = hash;
+	ld->ld_proc_hsize = size;
+
+	return 0;
+}
+
+/* protected by res_mutex */
+static void
+ldap_int_result_proc_unlink( LDAP *ld, LDAPResultProc **lpp )
+{
+	LDAPResultProc	*lp = *lpp;
+
+	*lpp = lp->lp_next;
+	ld->ld_nprocs--;
+	LDAP_FREE( lp );
+}
+
+/*
+ * Forgets the completion callback for msgid, if any;
+ * called when the operation is abandoned
+ */
+void
+ldap_int_result_proc_drop( LDAP *ld, ber_int_t msgid )
+{
+	LDAPResultProc	**lpp;
+
+	LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
+	lpp = ldap_int_result_proc_slot( ld, msgid );
+	if ( lpp != NULL && *lpp != NULL ) {
+		ldap_int_result_proc_unlink( ld, lpp );
+	}
+	LDAP_MUTEX_UNLOCK( &ld->ld_res_mutex );
+}
+
+/* protected by res_mutex */
+void
+ldap_int_result_procs_free( LDAP *ld )
+{
+	LDAPResultProc	*lp, *next;
+	int		i;
+
+	if ( ld->ld_proc_hash == NULL ) {
+		return;
+	}
+
+	for ( i = 0; i < ld->ld_proc_hsize; i++ ) {
+		for ( lp = ld->ld_proc_hash[ i ]; lp != NULL; lp = next ) {
+			next = lp->lp_next;
+			LDAP_FREE( lp );
+		}
+	}
+	LDAP_FREE( ld->ld_proc_hash );
+	ld->ld_proc_hash = NULL;
+	ld->ld_proc_hsize = 0;
+	ld->ld_nprocs = 0;
+}
+
 
 /*
  * ldap_result - wait for an ldap result response to a message from the
@@ -123,6 +419,221 @@ ldap_result(
 	return rc;
 }
 
+/*
+ * ldap_set_result_proc - have the responses to msgid handed to
+ * result_proc, one message at a time, by ldap_process_input().  The
+ * callback owns each message it gets and must ldap_msgfree() it.  The
+ * registration lapses once the final response to msgid is delivered;
+ * one for LDAP_RES_UNSOLICITED (0) stays until replaced.  A NULL
+ * result_proc removes the registration.
+ *
+ * Example:
+ *	ldap_set_result_proc( ld, msgid, search_done, &ctx )
+ */
+int
+ldap_set_result_proc(
+	LDAP *ld,
+	int msgid,
+	LDAP_RESULT_PROC *result_proc,
+	void *params )
+{
+	LDAPResultProc	**lpp, *lp;
+	int		rc = LDAP_SUCCESS;
+
+	assert( ld != NULL );
+
+	Debug2( LDAP_DEBUG_TRACE, "ldap_set_result_proc ld %p msgid %d\n",
+		(void *)ld, msgid );
+
+	if ( msgid < 0 ) {
+		return LDAP_PARAM_ERROR;
+	}
+
+	LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
+	lpp = ldap_int_result_proc_slot( ld, msgid );
+	if ( lpp != NULL && *lpp != NULL ) {
+		if ( result_proc == NULL ) {
+			ldap_int_result_proc_unlink( ld, lpp );
+		} else {
+			(*lpp)->lp_proc = result_proc;
+			(*lpp)->lp_params = params;
+		}
+
+	} else if ( result_proc != NULL ) {
+		lp = (LDAPResultProc *)LDAP_MALLOC( sizeof( LDAPResultProc ) );
+		if ( lp == NULL ||
+			( ++ld->ld_nprocs > ld->ld_proc_hsize &&
+			  ldap_int_result_proc_rehash( ld ) != 0 ) )
+		{
+			if ( lp != NULL ) {
+				ld->ld_nprocs--;
+				LDAP_FREE( lp );
+			}
+			rc = LDAP_NO_MEMORY;
+
+		} else {
+			lpp = &ld->ld_proc_hash[ LDAP_MSGID_BUCKET( msgid, ld->ld_proc_hsize ) ];
+			lp->lp_msgid = msgid;
+			lp->lp_proc = result_proc;
+			lp->lp_params = params;
+			lp->lp_next = *lpp;
+			*lpp = lp;
+		}
+	}
+	LDAP_MUTEX_UNLOCK( &ld->ld_res_mutex );
+
+	if ( rc != LDAP_SUCCESS ) {
+		ld->ld_errno = rc;
+	}
+	return rc;
+}
+
+/*
+ * Appends lm to the queued responses with the same msgid,
+ * or queues it on its own
+ */
+/* protected by res_mutex */
+static void
+ldap_int_response_queue( LDAP *ld, LDAPMessage *lm )
+{
+	LDAPMessage	*l = ldap_int_response_find( ld, lm->lm_msgid );
+
+	if ( l == NULL ) {
+		lm->lm_chain_tail = lm;
+		ldap_int_response_link( ld, lm );
+		return;
+	}
+
+	l->lm_chain_tail->lm_chain = lm;
+	l->lm_chain_tail = lm;
+}
+
+/*
+ * Hands each queued response that has a completion callback to it.
+ * Returns the number of messages delivered.
+ */
+/* protected by res_mutex, which is released while callbacks run */
+static int
+ldap_int_result_dispatch( LDAP *ld )
+{
+	LDAPMessage		*lm;
+	LDAPResultProc		**lpp = NULL;
+	LDAP_RESULT_PROC	*proc;
+	void			*params;
+	int			n = 0;
+
+	while ( ld->ld_nprocs > 0 ) {
+		for ( lm = ld->ld_responses; lm != NULL; lm = lm->lm_next ) {
+			lpp = ldap_int_result_proc_slot( ld, lm->lm_msgid );
+			if ( lpp != NULL && *lpp != NULL ) {
+				break;
+			}
+		}
+		if ( lm == NULL ) {
+			break;
+		}
+
+		proc = (*lpp)->lp_proc;
+		params = (*lpp)->lp_params;
+
+		/* takes care of abandoned messages, too */
+		lm = chkResponseList( ld, lm->lm_msgid, LDAP_MSG_ONE );
+		if ( lm == NULL ) {
+			continue;
+		}
+
+		switch ( lm->lm_msgtype ) {
+		case LDAP_RES_SEARCH_ENTRY:
+		case LDAP_RES_SEARCH_REFERENCE:
+		case LDAP_RES_INTERMEDIATE:
+			break;
+
+		default:
+			if ( lm->lm_msgid != LDAP_RES_UNSOLICITED ) {
+				ldap_int_result_proc_unlink( ld, lpp );
+			}
+			break;
+		}
+
+		LDAP_MUTEX_UNLOCK( &ld->ld_res_mutex );
+		proc( ld, lm, params );
+		LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
+		n++;
+	}
+
+	return n;
+}
+
+/*
+ * ldap_process_input - read what the default connection has to offer
+ * and run the completion callbacks of the responses it carries.  Meant
+ * for external event loops: call it whenever the descriptor returned
+ * by LDAP_OPT_DESC is readable.  It never waits in ldap_int_select()
+ * and only reads again while complete messages keep coming; still, a
+ * message that arrives in pieces makes a blocking socket wait for the
+ * rest, so event loops should make the descriptor non-blocking.
+ * Responses without a callback stay queued for ldap_result().
+ * Returns the number of messages delivered, or -1 if the connection
+ * failed (ld_errno is set).
+ *
+ * Example:
+ *	ldap_get_option( ld, LDAP_OPT_DESC, &fd );
+ *	... when fd is readable ...
+ *	ldap_process_input( ld );
+ */
+int
+ldap_process_input( LDAP *ld )
+{
+	LDAPConn	*lc;
+	LDAPMessage	*lm;
+	ber_tag_t	tag = LDAP_MSG_X_KEEP_LOOKING;
+	int		n;
+
+	assert( ld != NULL );
+
+	Debug1( LDAP_DEBUG_TRACE, "ldap_process_input ld %p\n", (void *)ld );
+
+	if (ld->ld_errno == LDAP_LOCAL_ERROR || ld->ld_errno == LDAP_SERVER_DOWN)
+		return -1;
+
+	LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
+	LDAP_MUTEX_LOCK( &ld->ld_conn_mutex );
+	LDAP_MUTEX_LOCK( &ld->ld_req_mutex );
+	/* finish sending a request the socket could not take at once */
+	if ( ld->ld_requests &&
+		ld->ld_requests->lr_status == LDAP_REQST_WRITING )
+	{
+		(void)ldap_int_flush_request( ld, ld->ld_requests );
+	}
+	lc = ld->ld_defconn;
+	if ( lc != NULL && lc->lconn_status == LDAP_CONNST_CONNECTED ) {
+		/* Don't let it get freed out from under us */
+		++lc->lconn_refcnt;
+		do {
+			lm = NULL;
+			tag = try_read1msg( ld, LDAP_RES_ANY, LDAP_MSG_ONE, lc, &lm );
+			if ( lm != NULL ) {
+				ldap_int_response_queue( ld, lm );
+			}
+		} while ( lm != NULL &&
+			ber_sockbuf_ctrl( lc->lconn_sb, LBER_SB_OPT_DATA_READY, NULL ) );
+
+		/* Only take locks if we're really freeing */
+		if ( lc->lconn_refcnt <= 1 ) {
+			ldap_free_connection( ld, lc, 0, 1 );
+		} else {
+			--lc->lconn_refcnt;
+		}
+	}
+	LDAP_MUTEX_UNLOCK( &ld->ld_req_mutex );
+	LDAP_MUTEX_UNLOCK( &ld->ld_conn_mutex );
+
+	n = ldap_int_result_dispatch( ld );
+	LDAP_MUTEX_UNLOCK( &ld->ld_res_mutex );
+
+	return tag == (ber_tag_t)-1 ? -1 : n;
+}
+
 /* protected by res_mutex */
 static LDAPMessage *
 chkResponseList(
@@ -130,8 +641,7 @@ chkResponseList(
 	int msgid,
 	int all)
 {
-	LDAPMessage	*lm, **lastlm, *nextlm;
-	int		cnt = 0;
+	LDAPMessage	*lm, *nextlm, *tmp;
 
 	/*
 	 * Look through the list of responses we have received on
@@ -146,10 +656,14 @@ chkResponseList(
 		"ldap_chkResponseList ld %p msgid %d all %d\n",
 		(void *)ld, msgid, all );
 
-	lastlm = &ld->ld_responses;
-	for ( lm = ld->ld_responses; lm != NULL; lm = nextlm ) {
-		nextlm = lm->lm_next;
-		++cnt;
+	if ( msgid == LDAP_RES_ANY ) {
+		lm = ld->ld_responses;
+	} else {
+		lm = ldap_int_response_find( ld, msgid );
+	}
+
+	for ( ; lm != NULL; lm = nextlm ) {
+		nextlm = msgid == LDAP_RES_ANY ? lm->lm_next : NULL;
 
 		if ( ldap_abandoned( ld, lm->lm_msgid ) ) {
 			Debug2( LDAP_DEBUG_ANY,
@@ -171,52 +685,47 @@ chkResponseList(
 			}
 
 			/* Remove this entry from list */
-			*lastlm = nextlm;
+			ldap_int_response_unlink( ld, lm );
 
 			ldap_msgfree( lm );
 
 			continue;
 		}
 
-		if ( msgid == LDAP_RES_ANY || lm->lm_msgid == msgid ) {
-			LDAPMessage	*tmp;
-
-			if ( all == LDAP_MSG_ONE ||
-				all == LDAP_MSG_RECEIVED ||
-				msgid == LDAP_RES_UNSOLICITED )
-			{
-				break;
-			}
-
-			tmp = lm->lm_chain_tail;
-			if ( tmp->lm_msgtype == LDAP_RES_SEARCH_ENTRY ||
-				tmp->lm_msgtype == LDAP_RES_SEARCH_REFERENCE ||
-				tmp->lm_msgtype == LDAP_RES_INTERMEDIATE )
-			{
-				tmp = NULL;
-			}
+		if ( all == LDAP_MSG_ONE ||
+			all == LDAP_MSG_RECEIVED ||
+			msgid == LDAP_RES_UNSOLICITED )
+		{
+			break;
+		}
 
-			if ( tmp == NULL ) {
-				lm = NULL;
-			}
+		tmp = lm->lm_chain_tail;
+		if ( tmp->lm_msgtype == LDAP_RES_SEARCH_ENTRY ||
+			tmp->lm_msgtype == LDAP_RES_SEARCH_REFERENCE ||
+			tmp->lm_msgtype == LDAP_RES_INTERMEDIATE )
+		{
+			tmp = NULL;
+		}
 
-			break;
+		if ( tmp == NULL ) {
+			lm = NULL;
 		}
-		lastlm = &lm->lm_next;
+
+		break;
 	}
 
 	if ( lm != NULL ) {
 		/* Found an entry, remove it from the list */
 		if ( all == LDAP_MSG_ONE && lm->lm_chain != NULL ) {
-			*lastlm = lm->lm_chain;
-			lm->lm_chain->lm_next = lm->lm_next;
-			lm->lm_chain->lm_chain_tail = ( lm->lm_chain_tail != lm ) ? lm->lm_chain_tail : lm->lm_chain;
+			LDAPMessage	*chain = lm->lm_chain;
+
+			chain->lm_chain_tail = ( lm->lm_chain_tail != lm ) ? lm->lm_chain_tail : lm->lm_chain;
+			ldap_int_response_replace( ld, lm, chain );
 			lm->lm_chain = NULL;
 			lm->lm_chain_tail = NULL;
 		} else {
-			*lastlm = lm->lm_next;
+			ldap_int_response_unlink( ld, lm );
 		}
-		lm->lm_next = NULL;
 	}
 
 #ifdef LDAP_DEBUG
@@ -248,12 +757,19 @@ wait4msg(
 			start_time_tv = { 0 },
 			*tvp = NULL;
 	LDAPConn	*lc;
+#ifdef LDAP_R_COMPILE
+	int		concurrent, reading = 0;
+#endif /* LDAP_R_COMPILE */
 
 	assert( ld != NULL );
 	assert( result != NULL );
 
 	LDAP_ASSERT_MUTEX_OWNER( &ld->ld_res_mutex );
 
+#ifdef LDAP_R_COMPILE
+	concurrent = LDAP_BOOL_GET( &ld->ld_options, LDAP_BOOL_CONCURRENT );
+#endif /* LDAP_R_COMPILE */
+
 	if ( timeout == NULL && ld->ld_options.ldo_tm_api.tv_sec >= 0 ) {
 		tv = ld->ld_options.ldo_tm_api;
 		timeout = &tv;
@@ -297,8 +813,42 @@ wait4msg(
 		if ( ( *result = chkResponseList( ld, msgid, all ) ) != NULL ) {
 			rc = (*result)->lm_msgtype;
 
+#ifdef LDAP_R_COMPILE
+		} else if ( concurrent && ld->ld_reader && !reading ) {
+			/* another thread is reading; sleep until it queues
+			 * something, or gives up reading */
+			if ( tvp != NULL && tv.tv_sec == 0 && tv.tv_usec == 0 ) {
+				rc = 0;
+				ld->ld_errno = LDAP_TIMEOUT;
+				break;
+			}
+			{
+				LDAPWaiter	lw, **lwp;
+
+				lw.lw_msgid = msgid;
+				ldap_pvt_thread_cond_init( &lw.lw_cond );
+				lw.lw_next = ld->ld_waiters;
+				ld->ld_waiters = &lw;
+
+				ldap_pvt_thread_cond_wait( &lw.lw_cond, &ld->ld_res_mutex );
+
+				for ( lwp = &ld->ld_waiters; *lwp != &lw; lwp = &(*lwp)->lw_next )
+					/* find */ ;
+				*lwp = lw.lw_next;
+				ldap_pvt_thread_cond_destroy( &lw.lw_cond );
+			}
+#endif /* LDAP_R_COMPILE */
+
 		} else {
 			int lc_ready = 0;
+#ifdef LDAP_R_COMPILE
+			int wake = LDAP_WAKE_READY;
+
+			if ( concurrent && !reading ) {
+				ld->ld_reader = 1;
+				reading = 1;
+			}
+#endif /* LDAP_R_COMPILE */
 
 			LDAP_MUTEX_LOCK( &ld->ld_conn_mutex );
 			for ( lc = ld->ld_conns; lc != NULL; lc = lc->lconn_next ) {
@@ -311,10 +861,42 @@ wait4msg(
 			}
 
 			if ( !lc_ready ) {
+				struct timeval	*stvp = tvp;
 				int err;
-				rc = ldap_int_select( ld, tvp );
-				if ( rc == -1 ) {
+#ifdef LDAP_R_COMPILE
+				struct timeval	slice = LDAP_CONCURRENT_SLICE;
+				void		*snap = NULL;
+
+				if ( reading ) {
+					snap = ldap_int_select_snapshot( ld, ld->ld_selectsnap );
+				}
+				if ( snap != NULL ) {
+					/* let others send and check their queue
+					 * while we wait, but not for too long */
+					ld->ld_selectsnap = snap;
+					if ( ld->ld_waiters != NULL ) {
+						ldap_int_wake_waiters( ld, LDAP_WAKE_READY );
+					}
+					if ( tvp == NULL || tvp->tv_sec > slice.tv_sec ||
+						( tvp->tv_sec == slice.tv_sec &&
+						  tvp->tv_usec > slice.tv_usec ) )
+					{
+						stvp = &slice;
+					}
+					LDAP_MUTEX_UNLOCK( &ld->ld_conn_mutex );
+					LDAP_MUTEX_UNLOCK( &ld->ld_res_mutex );
+					rc = ldap_int_select_unlocked( snap, stvp );
 					err = sock_errno();
+					LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
+					LDAP_MUTEX_LOCK( &ld->ld_conn_mutex );
+					ldap_int_select_merge( ld, snap );
+				} else
+#endif /* LDAP_R_COMPILE */
+				{
+					rc = ldap_int_select( ld, stvp );
+					err = sock_errno();
+				}
+				if ( rc == -1 ) {
 #ifdef LDAP_DEBUG
 					Debug1( LDAP_DEBUG_TRACE,
 						"ldap_int_select returned -1: errno %d\n",
@@ -322,17 +904,22 @@ wait4msg(
 #endif
 				}
 
-				if ( rc == 0 || ( rc == -1 && (
+				if ( rc == 0 && stvp != tvp ) {
+					rc = LDAP_MSG_X_KEEP_LOOKING;	/* slice expired: loop */
+#ifdef LDAP_R_COMPILE
+					wake = LDAP_WAKE_ALL;
+#endif /* LDAP_R_COMPILE */
+
+				} else if ( rc == 0 || ( rc == -1 && (
 					!LDAP_BOOL_GET(&ld->ld_options, LDAP_BOOL_RESTART)
 						|| err != EINTR ) ) )
 				{
 					ld->ld_errno = (rc == -1 ? LDAP_SERVER_DOWN :
 						LDAP_TIMEOUT);
 					LDAP_MUTEX_UNLOCK( &ld->ld_conn_mutex );
-					return( rc );
-				}
+					break;
 
-				if ( rc == -1 ) {
+				} else if ( rc == -1 ) {
 					rc = LDAP_MSG_X_KEEP_LOOKING;	/* select interrupted: loop */
 
 				} else {
@@ -381,6 +968,13 @@ wait4msg(
 					rc = -1;
 			}
 			LDAP_MUTEX_UNLOCK( &ld->ld_conn_mutex );
+
+#ifdef LDAP_R_COMPILE
+			/* on timeout, let waiters check their own */
+			if ( wake == LDAP_WAKE_ALL && ld->ld_waiters != NULL ) {
+				ldap_int_wake_waiters( ld, wake );
+			}
+#endif /* LDAP_R_COMPILE */
 		}
 
 		if ( rc == LDAP_MSG_X_KEEP_LOOKING && tvp != NULL ) {
@@ -430,6 +1024,16 @@ wait4msg(
 		}
 	}
 
+#ifdef LDAP_R_COMPILE
+	if ( reading ) {
+		/* let one of the waiters take over */
+		ld->ld_reader = 0;
+		if ( ld->ld_waiters != NULL ) {
+			ldap_int_wake_waiters( ld, LDAP_WAKE_READER );
+		}
+	}
+#endif /* LDAP_R_COMPILE */
+
 	return( rc );
 }
 
@@ -444,7 +1048,7 @@ try_read1msg(
 	LDAPMessage **result )
 {
 	BerElement	*ber;
-	LDAPMessage	*newmsg, *l, *prev;
+	LDAPMessage	*newmsg, *l;
 	ber_int_t	id;
 	ber_tag_t	tag;
 	ber_len_t	len;
@@ -1038,8 +1642,7 @@ nextresp2:
 			}
 			/* set up response chain */
 			if ( tmp == NULL ) {
-				newmsg->lm_next = ld->ld_responses;
-				ld->ld_responses = newmsg;
+				ldap_int_response_link( ld, newmsg );
 				chain_head = newmsg;
 			} else {
 				tmp->lm_chain = newmsg;
@@ -1100,13 +1703,7 @@ nextresp2:
 	 * search response.
 	 */
 
-	prev = NULL;
-	for ( l = ld->ld_responses; l != NULL; l = l->lm_next ) {
-		if ( l->lm_msgid == newmsg->lm_msgid ) {
-			break;
-		}
-		prev = l;
-	}
+	l = ldap_int_response_find( ld, newmsg->lm_msgid );
 
 	/* not part of an existing search response */
 	if ( l == NULL ) {
@@ -1115,8 +1712,7 @@ nextresp2:
 			goto exit;
 		}
 
-		newmsg->lm_next = ld->ld_responses;
-		ld->ld_responses = newmsg;
+		ldap_int_response_link( ld, newmsg );
 		goto exit;
 	}
 
@@ -1129,11 +1725,7 @@ nextresp2:
 
 	/* return the whole chain if that's what we were looking for */
 	if ( foundit ) {
-		if ( prev == NULL ) {
-			ld->ld_responses = l->lm_next;
-		} else {
-			prev->lm_next = l->lm_next;
-		}
+		ldap_int_response_unlink( ld, l );
 		*result = l;
 	}
 
@@ -1305,7 +1897,7 @@ ldap_msgfree( LDAPMessage *lm )
 int
 ldap_msgdelete( LDAP *ld, int msgid )
 {
-	LDAPMessage	*lm, *prev;
+	LDAPMessage	*lm;
 	int		rc = 0;
 
 	assert( ld != NULL );
@@ -1314,23 +1906,13 @@ ldap_msgdelete( LDAP *ld, int msgid )
 		(void *)ld, msgid );
 
 	LDAP_MUTEX_LOCK( &ld->ld_res_mutex );
-	prev = NULL;
-	for ( lm = ld->ld_responses; lm != NULL; lm = lm->lm_next ) {
-		if ( lm->lm_msgid == msgid ) {
-			break;
-		}
-		prev = lm;
-	}
+	lm = ldap_int_response_find( ld, msgid );
 
 	if ( lm == NULL ) {
 		rc = -1;
 
 	} else {
-		if ( prev == NULL ) {
-			ld->ld_responses = lm->lm_next;
-		} else {
-			prev->lm_next = lm->lm_next;
-		}
+		ldap_int_response_unlink( ld, lm );
 	}
 	LDAP_MUTEX_UNLOCK( &ld->ld_res_mutex );
 	if ( lm ) {
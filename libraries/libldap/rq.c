@@ -36,6 +36,75 @@
 #include "ldap_queue.h"
 #include "ldap_rq.h"
 
+#define RQ_BEFORE(a,b)	((a)->next_sched.tv_sec < (b)->next_sched.tv_sec)
+#define RQ_FIRST(rq)	((rq)->rq_nheap ? (rq)->rq_heap[0]->next_sched.tv_sec : 0)
+
+static void
+rq_heap_set( struct runqueue_s *rq, int i, struct re_s *entry )
+{
+	rq->rq_heap[i] = entry;
+	entry->heap_idx = i;
+}
+
+/* Move the task at i up or down to its place in the heap */
+static void
+rq_heap_fix( struct runqueue_s *rq, int i )
+{
+	struct re_s *entry = rq->rq_heap[i];
+	int j;
+
+	while ( i > 0 ) {
+		j = ( i - 1 ) / 2;
+		if ( !RQ_BEFORE( entry, rq->rq_heap[j] ))
+			break;
+		rq_heap_set( rq, i, rq->rq_heap[j] );
+		i = j;
+	}
+	for (;;) {
+		j = 2 * i + 1;
+		if ( j >= rq->rq_nheap )
+			break;
+		if ( j + 1 < rq->rq_nheap &&
+			RQ_BEFORE( rq->rq_heap[j + 1], rq->rq_heap[j] ))
+			j++;
+		if ( !RQ_BEFORE( rq->rq_heap[j], entry ))
+			break;
+		rq_heap_set( rq, i, rq->rq_heap[j] );
+		i = j;
+	}
+	rq_heap_set( rq, i, entry );
+}
+
+static void
+rq_heap_add( struct runqueue_s *rq, struct re_s *entry )
+{
+	assert( rq->rq_nheap < rq->rq_maxheap );
+	rq_heap_set( rq, rq->rq_nheap++, entry );
+	rq_heap_fix( rq, entry->heap_idx );
+}
+
+static void
+rq_heap_del( struct runqueue_s *rq, struct re_s *entry )
+{
+	struct re_s *last = rq->rq_heap[--rq->rq_nheap];
+	int i = entry->heap_idx;
+
+	entry->heap_idx = -1;
+	if ( last != entry ) {
+		rq_heap_set( rq, i, last );
+		rq_heap_fix( rq, i );
+	}
+}
+
+/* Tell the scheduler if the first task is now due before first was */
+static void
+rq_wake( struct runqueue_s *rq, time_t first )
+{
+	if ( rq->rq_wake && rq->rq_nheap &&
+		( !first || rq->rq_heap[0]->next_sched.tv_sec < first ))
+		rq->rq_wake();
+}
+
 struct re_s *
 ldap_pvt_runqueue_insert(
 	struct runqueue_s* rq,
@@ -47,6 +116,18 @@ ldap_pvt_runqueue_insert(
 )
 {
 	struct re_s* entry;
+	time_t first = RQ_FIRST( rq );
+
+	/* make room to schedule every task, resched can't fail */
+	if ( rq->rq_ntasks == rq->rq_maxheap ) {
+		int max = rq->rq_maxheap ? rq->rq_maxheap * 2 : 16;
+		struct re_s **heap = LDAP_REALLOC( rq->rq_heap,
+			max * sizeof( struct re_s * ));
+		if ( heap == NULL )
+			return NULL;
+		rq->rq_heap = heap;
+		rq->rq_maxheap = max;
+	}
 
 	entry = (struct re_s *) LDAP_CALLOC( 1, sizeof( struct re_s ));
 	if ( entry ) {
@@ -58,7 +139,10 @@ ldap_pvt_runqueue_insert(
 		entry->arg = arg;
 		entry->tname = tname;
 		entry->tspec = tspec;
-		LDAP_STAILQ_INSERT_HEAD( &rq->task_list, entry, tnext );
+		LDAP_TAILQ_INSERT_TAIL( &rq->task_list, entry, tnext );
+		rq->rq_ntasks++;
+		rq_heap_add( rq, entry );
+		rq_wake( rq, first );
 	}
 	return entry;
 }
@@ -72,7 +156,7 @@ ldap_pvt_runqueue_find(
 {
 	struct re_s* e;
 
-	LDAP_STAILQ_FOREACH( e, &rq->task_list, tnext ) {
+	LDAP_TAILQ_FOREACH( e, &rq->task_list, tnext ) {
 		if ( e->routine == routine && e->arg == arg )
 			return e;
 	}
@@ -85,16 +169,12 @@ ldap_pvt_runqueue_remove(
 	struct re_s* entry
 )
 {
-	struct re_s* e;
-
-	LDAP_STAILQ_FOREACH( e, &rq->task_list, tnext ) {
-		if ( e == entry)
-			break;
-	}
+	assert( entry->heap_idx < 0 || rq->rq_heap[entry->heap_idx] == entry );
 
-	assert( e == entry );
-
-	LDAP_STAILQ_REMOVE( &rq->task_list, entry, re_s, tnext );
+	if ( entry->heap_idx >= 0 )
+		rq_heap_del( rq, entry );
+	LDAP_TAILQ_REMOVE( &rq->task_list, entry, tnext );
+	rq->rq_ntasks--;
 
 	LDAP_FREE( entry );
 }
@@ -107,10 +187,10 @@ ldap_pvt_runqueue_next_sched(
 {
 	struct re_s* entry;
 
-	entry = LDAP_STAILQ_FIRST( &rq->task_list );
-	if ( entry == NULL || entry->next_sched.tv_sec == 0 ) {
+	if ( !rq->rq_nheap ) {
 		return NULL;
 	} else {
+		entry = rq->rq_heap[0];
 		*next_run = entry->next_sched;
 		return entry;
 	}
@@ -157,17 +237,9 @@ ldap_pvt_runqueue_resched(
 	int defer
 )
 {
-	struct re_s* prev;
-	struct re_s* e;
-
-	LDAP_STAILQ_FOREACH( e, &rq->task_list, tnext ) {
-		if ( e == entry )
-			break;
-	}
+	time_t first = RQ_FIRST( rq );
 
-	assert ( e == entry );
-
-	LDAP_STAILQ_REMOVE( &rq->task_list, entry, re_s, tnext );
+	assert( entry->heap_idx < 0 || rq->rq_heap[entry->heap_idx] == entry );
 
 	if ( !defer ) {
 		entry->next_sched.tv_sec = time( NULL ) + entry->interval.tv_sec;
@@ -175,32 +247,15 @@ ldap_pvt_runqueue_resched(
 		entry->next_sched.tv_sec = 0;
 	}
 
-	if ( LDAP_STAILQ_EMPTY( &rq->task_list )) {
-		LDAP_STAILQ_INSERT_HEAD( &rq->task_list, entry, tnext );
-	} else if ( entry->next_sched.tv_sec == 0 ) {
-		LDAP_STAILQ_INSERT_TAIL( &rq->task_list, entry, tnext );
+	if ( entry->heap_idx < 0 ) {
+		if ( !defer )
+			rq_heap_add( rq, entry );
+	} else if ( defer ) {
+		rq_heap_del( rq, entry );
 	} else {
-		prev = NULL;
-		LDAP_STAILQ_FOREACH( e, &rq->task_list, tnext ) {
-			if ( e->next_sched.tv_sec == 0 ) {
-				if ( prev == NULL ) {
-					LDAP_STAILQ_INSERT_HEAD( &rq->task_list, entry, tnext );
-				} else {
-					LDAP_STAILQ_INSERT_AFTER( &rq->task_list, prev, entry, tnext );
-				}
-				return;
-			} else if ( e->next_sched.tv_sec > entry->next_sched.tv_sec ) {
-				if ( prev == NULL ) {
-					LDAP_STAILQ_INSERT_HEAD( &rq->task_list, entry, tnext );
-				} else {
-					LDAP_STAILQ_INSERT_AFTER( &rq->task_list, prev, entry, tnext );
-				}
-				return;
-			}
-			prev = e;
-		}
-		LDAP_STAILQ_INSERT_TAIL( &rq->task_list, entry, tnext );
+		rq_heap_fix( rq, entry->heap_idx );
 	}
+	rq_wake( rq, first );
 }
 
 int
@@ -208,16 +263,10 @@ ldap_pvt_runqueue_persistent_backload(
 	struct runqueue_s* rq
 )
 {
-	struct re_s* e;
-	int count = 0;
+	int count;
 
 	ldap_pvt_thread_mutex_lock( &rq->rq_mutex );
-	if ( !LDAP_STAILQ_EMPTY( &rq->task_list )) {
-		LDAP_STAILQ_FOREACH( e, &rq->task_list, tnext ) {
-			if ( e->next_sched.tv_sec == 0 )
-				count++;
-		}
-	}
+	count = rq->rq_ntasks - rq->rq_nheap;
 	ldap_pvt_thread_mutex_unlock( &rq->rq_mutex );
 	return count;
 }
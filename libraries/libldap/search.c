@@ -70,6 +70,53 @@ ldap_search_ext(
 		attrsonly, sctrls, cctrls, timeout, sizelimit, -1, msgidp );
 }
 
+/*
+ * ldap_search_async - initiate an ldap search operation whose
+ * responses are handed to result_proc by ldap_process_input(),
+ * instead of being collected with ldap_result().
+ *
+ * Example:
+ *	ldap_search_async( ld, "dc=example,dc=com", LDAP_SCOPE_SUBTREE,
+ *	    "cn~=bob", attrs, attrsonly, sctrls, ctrls, timeout, sizelimit,
+ *	    search_done, &ctx, &msgid );
+ */
+int
+ldap_search_async(
+	LDAP *ld,
+	LDAP_CONST char *base,
+	int scope,
+	LDAP_CONST char *filter,
+	char **attrs,
+	int attrsonly,
+	LDAPControl **sctrls,
+	LDAPControl **cctrls,
+	struct timeval *timeout,
+	int sizelimit,
+	LDAP_RESULT_PROC *result_proc,
+	void *params,
+	int *msgidp )
+{
+	int rc;
+
+	if ( result_proc == NULL ) {
+		return LDAP_PARAM_ERROR;
+	}
+
+	rc = ldap_pvt_search( ld, base, scope, filter, attrs,
+		attrsonly, sctrls, cctrls, timeout, sizelimit, -1, msgidp );
+	if ( rc != LDAP_SUCCESS ) {
+		return rc;
+	}
+
+	rc = ldap_set_result_proc( ld, *msgidp, result_proc, params );
+	if ( rc != LDAP_SUCCESS ) {
+		(void)ldap_abandon_ext( ld, *msgidp, NULL, NULL );
+		ld->ld_errno = rc;
+	}
+
+	return rc;
+}
+
 int
 ldap_pvt_search(
 	LDAP *ld,
@@ -13,6 +13,10 @@
  * <http://www.OpenLDAP.org/license.html>.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1			/* Needed for glibc cpu_set_t */
+#endif
+
 #include "portable.h"
 
 #include <stdio.h>
@@ -29,6 +33,10 @@
 #include "ldap_pvt_thread.h" /* Get the thread interface */
 #include "ldap_thr_debug.h"  /* May redirect thread initialize/destroy calls */
 
+#if defined( HAVE_PTHREADS ) && defined( HAVE_SCHED_H )
+#include <sched.h>
+#endif
+
 
 /*
  * Common LDAP thread routines
@@ -108,4 +116,70 @@ ldap_pvt_thread_sleep(
 }
 #endif
 
+#if defined( HAVE_PTHREADS ) && defined( CPU_SETSIZE )
+/* Parse a CPU list like "0-3,8,10-11" */
+static int
+ldap_int_thread_cpulist( const char *cpus, cpu_set_t *set )
+{
+	const char *p = cpus;
+	char *next;
+	unsigned long lo, hi;
+
+	CPU_ZERO( set );
+	for (;;) {
+		lo = strtoul( p, &next, 10 );
+		if ( next == p )
+			return -1;
+		hi = lo;
+		p = next;
+		if ( *p == '-' ) {
+			p++;
+			hi = strtoul( p, &next, 10 );
+			if ( next == p || hi < lo )
+				return -1;
+			p = next;
+		}
+		if ( hi >= CPU_SETSIZE )
+			return -1;
+		for ( ; lo <= hi; lo++ )
+			CPU_SET( lo, set );
+		if ( *p == '\0' )
+			break;
+		if ( *p++ != ',' )
+			return -1;
+	}
+	return 0;
+}
+#endif
+
+/* Check that cpus is a valid CPU list and that threads can be bound */
+int
+ldap_pvt_thread_check_affinity( const char *cpus )
+{
+#if defined( HAVE_PTHREADS ) && defined( CPU_SETSIZE )
+	cpu_set_t set;
+
+	return ldap_int_thread_cpulist( cpus, &set );
+#else
+	return -1;
+#endif
+}
+
+/* Restrict the calling thread to the CPUs in the list */
+int
+ldap_pvt_thread_set_affinity( const char *cpus )
+{
+#if defined( HAVE_PTHREADS ) && defined( CPU_SETSIZE )
+	cpu_set_t set;
+
+	if ( cpus == NULL )
+		return 0;
+	if ( ldap_int_thread_cpulist( cpus, &set ))
+		return -1;
+	return pthread_setaffinity_np( pthread_self(), sizeof(set), &set ) ? -1 : 0;
+#else
+	return cpus ? -1 : 0;
+#endif
+}
+
 #endif /* LDAP_R_COMPILE */
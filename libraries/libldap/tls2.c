@@ -643,6 +643,21 @@ ldap_pvt_tls_config( LDAP *ld, int option, const char *arg )
 			return ldap_pvt_tls_set_option( ld, option, &i );
 		}
 		return -1;
+	case LDAP_OPT_X_TLS_KTLS:	/* OpenSSL only */
+		i = -1;
+		if ( strcasecmp( arg, "on" ) == 0 ||
+			strcasecmp( arg, "yes" ) == 0 ||
+			strcasecmp( arg, "true" ) == 0 ) {
+			i = 1;
+		} else if ( strcasecmp( arg, "off" ) == 0 ||
+			strcasecmp( arg, "no" ) == 0 ||
+			strcasecmp( arg, "false" ) == 0 ) {
+			i = 0;
+		}
+		if (i >= 0) {
+			return ldap_pvt_tls_set_option( ld, option, &i );
+		}
+		return -1;
 #endif
 	}
 	return -1;
@@ -723,6 +738,15 @@ ldap_pvt_tls_get_option( LDAP *ld, int option, void *arg )
 	case LDAP_OPT_X_TLS_CRLCHECK:	/* OpenSSL only */
 		*(int *)arg = lo->ldo_tls_crlcheck;
 		break;
+	case LDAP_OPT_X_TLS_SESSION_CACHE:	/* OpenSSL only */
+		*(int *)arg = lo->ldo_tls_sess_cache;
+		break;
+	case LDAP_OPT_X_TLS_TICKET_LIFETIME:	/* OpenSSL only */
+		*(int *)arg = lo->ldo_tls_ticket_lifetime;
+		break;
+	case LDAP_OPT_X_TLS_KTLS:	/* OpenSSL only */
+		*(int *)arg = lo->ldo_tls_ktls;
+		break;
 #endif
 	case LDAP_OPT_X_TLS_CIPHER_SUITE:
 		*(char **)arg = lo->ldo_tls_ciphersuite ?
@@ -948,6 +972,18 @@ ldap_pvt_tls_set_option( LDAP *ld, int option, void *arg )
 			return 0;
 		}
 		return -1;
+	case LDAP_OPT_X_TLS_SESSION_CACHE:	/* OpenSSL only */
+		if ( !arg || *(int *)arg < 0 ) return -1;
+		lo->ldo_tls_sess_cache = *(int *)arg;
+		return 0;
+	case LDAP_OPT_X_TLS_TICKET_LIFETIME:	/* OpenSSL only */
+		if ( !arg || *(int *)arg < 0 ) return -1;
+		lo->ldo_tls_ticket_lifetime = *(int *)arg;
+		return 0;
+	case LDAP_OPT_X_TLS_KTLS:	/* OpenSSL only */
+		if ( !arg ) return -1;
+		lo->ldo_tls_ktls = *(int *)arg ? 1 : 0;
+		return 0;
 #endif
 	case LDAP_OPT_X_TLS_CIPHER_SUITE:
 		if ( lo->ldo_tls_ciphersuite ) LDAP_FREE( lo->ldo_tls_ciphersuite );
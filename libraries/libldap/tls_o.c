@@ -36,6 +36,7 @@
 
 #include "ldap-int.h"
 #include "ldap-tls.h"
+#include "ldap_queue.h"
 
 #ifdef HAVE_OPENSSL_SSL_H
 #include <openssl/ssl.h>
@@ -46,6 +47,9 @@
 #include <openssl/bn.h>
 #include <openssl/rsa.h>
 #include <openssl/dh.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000
+#include <openssl/core_names.h>
+#endif
 #endif
 
 #if OPENSSL_VERSION_NUMBER >= 0x10100000
@@ -66,6 +70,8 @@ static void tlso_info_cb( const SSL *ssl, int where, int ret );
 static int tlso_verify_cb( int ok, X509_STORE_CTX *ctx );
 static int tlso_verify_ok( int ok, X509_STORE_CTX *ctx );
 static int tlso_seed_PRNG( const char *randfile );
+static int tlso_cache_idx = -1;
+static CRYPTO_EX_free tlso_cache_free;
 #if OPENSSL_VERSION_NUMBER < 0x10100000
 /*
  * OpenSSL 1.1 API and later has new locking code
@@ -227,6 +233,9 @@ tlso_init( void )
 
 	tlso_bio_method = tlso_bio_setup();
 
+	tlso_cache_idx = SSL_CTX_get_ex_new_index( 0, NULL, NULL, NULL,
+		tlso_cache_free );
+
 	return 0;
 }
 
@@ -275,6 +284,383 @@ tlso_ctx_free ( tls_ctx *ctx )
 	SSL_CTX_free( c );
 }
 
+/*
+ * Server session cache and session ticket keys.  When configured, they
+ * replace OpenSSL's internal session cache, whose single lock every
+ * handshake contends for, and its ticket key, which never changes for
+ * the life of the context.
+ *
+ * Sessions are kept DER encoded in TLSO_SESS_SHARDS shards, each with
+ * its own lock, hash chains and LRU list.  A full shard drops its least
+ * recently used session, so the cache holds at most lt_sess_cache
+ * sessions.  Ticket keys are replaced every lt_ticket_lifetime seconds;
+ * tickets under the previous key are still accepted, and renewed.
+ */
+#define TLSO_SESS_SHARDS	16
+
+typedef struct tlso_sess {
+	struct tlso_sess *ts_next;	/* hash chain */
+	LDAP_TAILQ_ENTRY(tlso_sess) ts_lru;
+	unsigned int ts_idlen;
+	unsigned char ts_id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+	int ts_len;
+	unsigned char ts_der[1];
+} tlso_sess;
+
+typedef struct tlso_shard {
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_t sh_mutex;
+#endif
+	tlso_sess **sh_hash;
+	unsigned int sh_hmask;
+	int sh_count;
+	LDAP_TAILQ_HEAD(tlso_lru, tlso_sess) sh_lru;
+} tlso_shard;
+
+typedef struct tlso_tkey {
+	unsigned char tk_name[16];
+	unsigned char tk_aes[32];
+	unsigned char tk_hmac[32];
+	time_t tk_born;		/* 0 if unused */
+} tlso_tkey;
+
+typedef struct tlso_cache {
+	int tc_max;		/* per shard */
+	int tc_lifetime;
+	tlso_shard tc_shards[TLSO_SESS_SHARDS];
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_t tc_tkmutex;
+#endif
+	tlso_tkey tc_tkeys[2];	/* current, previous */
+} tlso_cache;
+
+static void
+tlso_cache_free( void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+	int idx, long argl, void *argp )
+{
+	tlso_cache *tc = ptr;
+	tlso_sess *ts;
+	int i;
+
+	if ( !tc )
+		return;
+
+	for ( i = 0; i < TLSO_SESS_SHARDS; i++ ) {
+		tlso_shard *sh = &tc->tc_shards[i];
+
+		while (( ts = LDAP_TAILQ_FIRST( &sh->sh_lru )) != NULL ) {
+			LDAP_TAILQ_REMOVE( &sh->sh_lru, ts, ts_lru );
+			LDAP_FREE( ts );
+		}
+		LDAP_FREE( sh->sh_hash );
+#ifdef LDAP_R_COMPILE
+		ldap_pvt_thread_mutex_destroy( &sh->sh_mutex );
+#endif
+	}
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_destroy( &tc->tc_tkmutex );
+#endif
+	OPENSSL_cleanse( tc->tc_tkeys, sizeof( tc->tc_tkeys ));
+	LDAP_FREE( tc );
+}
+
+static tlso_cache *
+tlso_ssl_cache( SSL *ssl )
+{
+	return SSL_CTX_get_ex_data( SSL_get_SSL_CTX( ssl ), tlso_cache_idx );
+}
+
+/* FNV-1a; the top bits pick the shard, the low ones the chain */
+static unsigned int
+tlso_sess_hash( const unsigned char *id, unsigned int idlen )
+{
+	unsigned int h = 2166136261U;
+
+	while ( idlen-- ) {
+		h ^= *id++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/* Find a session in its shard, which must be locked */
+static tlso_sess **
+tlso_sess_find( tlso_shard *sh, unsigned int h,
+	const unsigned char *id, unsigned int idlen )
+{
+	tlso_sess **tsp;
+
+	for ( tsp = &sh->sh_hash[h & sh->sh_hmask]; *tsp; tsp = &(*tsp)->ts_next ) {
+		if ( (*tsp)->ts_idlen == idlen &&
+			!memcmp( (*tsp)->ts_id, id, idlen ))
+			break;
+	}
+	return tsp;
+}
+
+static void
+tlso_sess_unlink( tlso_shard *sh, tlso_sess **tsp )
+{
+	tlso_sess *ts = *tsp;
+
+	*tsp = ts->ts_next;
+	LDAP_TAILQ_REMOVE( &sh->sh_lru, ts, ts_lru );
+	sh->sh_count--;
+	LDAP_FREE( ts );
+}
+
+static int
+tlso_sess_new_cb( SSL *ssl, SSL_SESSION *sess )
+{
+	tlso_cache *tc = tlso_ssl_cache( ssl );
+	tlso_shard *sh;
+	tlso_sess *ts, **tsp;
+	const unsigned char *id;
+	unsigned char *p;
+	unsigned int idlen, h;
+	int len;
+
+	id = SSL_SESSION_get_id( sess, &idlen );
+	len = i2d_SSL_SESSION( sess, NULL );
+	if ( !tc || idlen == 0 || idlen > sizeof( ts->ts_id ) || len <= 0 )
+		return 0;
+
+	ts = LDAP_MALLOC( offsetof( tlso_sess, ts_der ) + len );
+	if ( !ts )
+		return 0;
+	ts->ts_idlen = idlen;
+	AC_MEMCPY( ts->ts_id, id, idlen );
+	p = ts->ts_der;
+	ts->ts_len = i2d_SSL_SESSION( sess, &p );
+
+	h = tlso_sess_hash( id, idlen );
+	sh = &tc->tc_shards[h >> 28];
+	LDAP_MUTEX_LOCK( &sh->sh_mutex );
+	tsp = tlso_sess_find( sh, h, id, idlen );
+	if ( *tsp ) {
+		tlso_sess_unlink( sh, tsp );
+	} else if ( sh->sh_count >= tc->tc_max ) {
+		tlso_sess *old = LDAP_TAILQ_LAST( &sh->sh_lru, tlso_lru );
+
+		tlso_sess_unlink( sh, tlso_sess_find( sh,
+			tlso_sess_hash( old->ts_id, old->ts_idlen ),
+			old->ts_id, old->ts_idlen ));
+		tsp = tlso_sess_find( sh, h, id, idlen );
+	}
+	ts->ts_next = NULL;
+	*tsp = ts;
+	LDAP_TAILQ_INSERT_HEAD( &sh->sh_lru, ts, ts_lru );
+	sh->sh_count++;
+	LDAP_MUTEX_UNLOCK( &sh->sh_mutex );
+
+	/* We kept a copy, not a reference */
+	return 0;
+}
+
+static SSL_SESSION *
+tlso_sess_get_cb( SSL *ssl, const unsigned char *id, int idlen, int *copy )
+{
+	tlso_cache *tc = tlso_ssl_cache( ssl );
+	tlso_shard *sh;
+	tlso_sess *ts;
+	SSL_SESSION *sess = NULL;
+	const unsigned char *p;
+	unsigned int h;
+
+	*copy = 0;
+	if ( !tc || idlen <= 0 )
+		return NULL;
+
+	h = tlso_sess_hash( id, idlen );
+	sh = &tc->tc_shards[h >> 28];
+	LDAP_MUTEX_LOCK( &sh->sh_mutex );
+	ts = *tlso_sess_find( sh, h, id, idlen );
+	if ( ts ) {
+		LDAP_TAILQ_REMOVE( &sh->sh_lru, ts, ts_lru );
+		LDAP_TAILQ_INSERT_HEAD( &sh->sh_lru, ts, ts_lru );
+		p = ts->ts_der;
+		sess = d2i_SSL_SESSION( NULL, &p, ts->ts_len );
+	}
+	LDAP_MUTEX_UNLOCK( &sh->sh_mutex );
+
+	/* OpenSSL checks the timeout, and removes it if expired */
+	return sess;
+}
+
+static void
+tlso_sess_remove_cb( SSL_CTX *ctx, SSL_SESSION *sess )
+{
+	tlso_cache *tc = SSL_CTX_get_ex_data( ctx, tlso_cache_idx );
+	tlso_shard *sh;
+	tlso_sess **tsp;
+	const unsigned char *id;
+	unsigned int idlen, h;
+
+	id = SSL_SESSION_get_id( sess, &idlen );
+	if ( !tc || idlen == 0 )
+		return;
+
+	h = tlso_sess_hash( id, idlen );
+	sh = &tc->tc_shards[h >> 28];
+	LDAP_MUTEX_LOCK( &sh->sh_mutex );
+	tsp = tlso_sess_find( sh, h, id, idlen );
+	if ( *tsp )
+		tlso_sess_unlink( sh, tsp );
+	LDAP_MUTEX_UNLOCK( &sh->sh_mutex );
+}
+
+static int
+tlso_tkey_new( tlso_tkey *tk, time_t now )
+{
+	if ( RAND_bytes( tk->tk_name, sizeof( tk->tk_name )) <= 0 ||
+		RAND_bytes( tk->tk_aes, sizeof( tk->tk_aes )) <= 0 ||
+		RAND_bytes( tk->tk_hmac, sizeof( tk->tk_hmac )) <= 0 )
+		return -1;
+	tk->tk_born = now;
+	return 0;
+}
+
+/*
+ * Copy out the current key, or with a name, the key that encrypted a
+ * ticket, replacing the current key first if it is too old.
+ * Returns 0 if there is no such key, 2 if the ticket should be renewed.
+ */
+static int
+tlso_tkey_get( tlso_cache *tc, const unsigned char *name, tlso_tkey *tk )
+{
+	tlso_tkey *cur = &tc->tc_tkeys[0], *prev = &tc->tc_tkeys[1];
+	time_t now = time( NULL );
+	int rc = 0;
+
+	LDAP_MUTEX_LOCK( &tc->tc_tkmutex );
+	if ( now - cur->tk_born >= tc->tc_lifetime ) {
+		tlso_tkey fresh;
+
+		if ( tlso_tkey_new( &fresh, now ) == 0 ) {
+			*prev = *cur;
+			*cur = fresh;
+		}
+		OPENSSL_cleanse( &fresh, sizeof( fresh ));
+	}
+	if ( !name || !memcmp( name, cur->tk_name, sizeof( cur->tk_name ))) {
+		*tk = *cur;
+		rc = 1;
+	} else if ( prev->tk_born &&
+		now - prev->tk_born < 2 * tc->tc_lifetime &&
+		!memcmp( name, prev->tk_name, sizeof( prev->tk_name )))
+	{
+		*tk = *prev;
+		rc = 2;
+	}
+	LDAP_MUTEX_UNLOCK( &tc->tc_tkmutex );
+	return rc;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000
+static int
+tlso_ticket_cb( SSL *ssl, unsigned char *name, unsigned char *iv,
+	EVP_CIPHER_CTX *ectx, EVP_MAC_CTX *hctx, int enc )
+#else
+static int
+tlso_ticket_cb( SSL *ssl, unsigned char *name, unsigned char *iv,
+	EVP_CIPHER_CTX *ectx, HMAC_CTX *hctx, int enc )
+#endif
+{
+	tlso_cache *tc = tlso_ssl_cache( ssl );
+	const EVP_CIPHER *cipher = EVP_aes_256_cbc();
+	tlso_tkey tk;
+	int rc;
+
+	if ( !tc )
+		return -1;
+
+	rc = tlso_tkey_get( tc, enc ? NULL : name, &tk );
+	if ( rc == 0 )
+		return 0;	/* unknown or expired key, do a full handshake */
+
+	if ( enc ) {
+		AC_MEMCPY( name, tk.tk_name, sizeof( tk.tk_name ));
+		if ( RAND_bytes( iv, EVP_CIPHER_iv_length( cipher )) <= 0 ||
+			!EVP_EncryptInit_ex( ectx, cipher, NULL, tk.tk_aes, iv ))
+			rc = -1;
+	} else if ( !EVP_DecryptInit_ex( ectx, cipher, NULL, tk.tk_aes, iv )) {
+		rc = -1;
+	}
+	if ( rc > 0 ) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000
+		OSSL_PARAM params[2];
+
+		params[0] = OSSL_PARAM_construct_utf8_string(
+			OSSL_MAC_PARAM_DIGEST, (char *) "SHA256", 0 );
+		params[1] = OSSL_PARAM_construct_end();
+		if ( !EVP_MAC_init( hctx, tk.tk_hmac, sizeof( tk.tk_hmac ), params ))
+			rc = -1;
+#else
+		if ( !HMAC_Init_ex( hctx, tk.tk_hmac, sizeof( tk.tk_hmac ),
+			EVP_sha256(), NULL ))
+			rc = -1;
+#endif
+	}
+	OPENSSL_cleanse( &tk, sizeof( tk ));
+	return rc;
+}
+
+static int
+tlso_cache_init( tlso_ctx *ctx, struct ldaptls *lt )
+{
+	tlso_cache *tc;
+	unsigned int hsize;
+	int i;
+
+	tc = LDAP_CALLOC( 1, sizeof( tlso_cache ));
+	if ( !tc )
+		return -1;
+
+	tc->tc_max = ( lt->lt_sess_cache + TLSO_SESS_SHARDS - 1 ) / TLSO_SESS_SHARDS;
+	for ( hsize = 1; hsize < (unsigned) tc->tc_max; hsize <<= 1 )
+		;
+	for ( i = 0; i < TLSO_SESS_SHARDS; i++ ) {
+		tlso_shard *sh = &tc->tc_shards[i];
+
+#ifdef LDAP_R_COMPILE
+		ldap_pvt_thread_mutex_init( &sh->sh_mutex );
+#endif
+		LDAP_TAILQ_INIT( &sh->sh_lru );
+		sh->sh_hmask = hsize - 1;
+		sh->sh_hash = LDAP_CALLOC( hsize, sizeof( tlso_sess * ));
+		if ( !sh->sh_hash ) {
+			tc->tc_max = 0;
+		}
+	}
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_init( &tc->tc_tkmutex );
+#endif
+	/* Freed along with ctx from now on */
+	SSL_CTX_set_ex_data( ctx, tlso_cache_idx, tc );
+
+	if ( lt->lt_sess_cache > 0 ) {
+		if ( !tc->tc_max )
+			return -1;
+		SSL_CTX_set_session_cache_mode( ctx, SSL_SESS_CACHE_SERVER |
+			SSL_SESS_CACHE_NO_INTERNAL );
+		SSL_CTX_sess_set_new_cb( ctx, tlso_sess_new_cb );
+		SSL_CTX_sess_set_get_cb( ctx, tlso_sess_get_cb );
+		SSL_CTX_sess_set_remove_cb( ctx, tlso_sess_remove_cb );
+	}
+
+	if ( lt->lt_ticket_lifetime > 0 ) {
+		tc->tc_lifetime = lt->lt_ticket_lifetime;
+		if ( tlso_tkey_new( &tc->tc_tkeys[0], time( NULL )) < 0 )
+			return -1;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000
+		SSL_CTX_set_tlsext_ticket_key_evp_cb( ctx, tlso_ticket_cb );
+#else
+		SSL_CTX_set_tlsext_ticket_key_cb( ctx, tlso_ticket_cb );
+#endif
+	}
+	return 0;
+}
+
 /*
  * initialize a new TLS context
  */
@@ -287,6 +673,15 @@ tlso_ctx_init( struct ldapoptions *lo, struct ldaptls *lt, int is_server )
 	if ( is_server ) {
 		SSL_CTX_set_session_id_context( ctx,
 			(const unsigned char *) "OpenLDAP", sizeof("OpenLDAP")-1 );
+
+		if (( lt->lt_sess_cache > 0 || lt->lt_ticket_lifetime > 0 ) &&
+			tlso_cache_init( ctx, lt ) < 0 )
+		{
+			Debug0( LDAP_DEBUG_ANY,
+				"TLS: could not set up session cache.\n" );
+			tlso_report_error();
+			return -1;
+		}
 	}
 
 #ifdef SSL_OP_NO_TLSv1
@@ -313,6 +708,11 @@ tlso_ctx_init( struct ldapoptions *lo, struct ldaptls *lt, int is_server )
 	else if ( lo->ldo_tls_protocol_min > LDAP_OPT_X_TLS_PROTOCOL_SSL2 )
 		SSL_CTX_set_options( ctx, SSL_OP_NO_SSLv2 );
 
+#ifdef SSL_OP_ENABLE_KTLS
+	if ( lt->lt_ktls )
+		SSL_CTX_set_options( ctx, SSL_OP_ENABLE_KTLS );
+#endif
+
 	if ( lo->ldo_tls_ciphersuite &&
 		!SSL_CTX_set_cipher_list( ctx, lt->lt_ciphersuite ) )
 	{
@@ -526,6 +926,13 @@ tlso_session_connect( LDAP *ld, tls_session *sess, const char *name_in )
 #endif
 	/* Caller expects 0 = success, OpenSSL returns 1 = success */
 	rc = SSL_connect( s ) - 1;
+#ifdef SSL_OP_ENABLE_KTLS
+	if ( rc == 0 && ( SSL_get_options( s ) & SSL_OP_ENABLE_KTLS )) {
+		Debug2( LDAP_DEBUG_TRACE, "TLS: kernel offload send=%d recv=%d\n",
+			(int)BIO_get_ktls_send( SSL_get_wbio( s )),
+			(int)BIO_get_ktls_recv( SSL_get_rbio( s )) );
+	}
+#endif
 	return rc;
 }
 
@@ -533,9 +940,18 @@ static int
 tlso_session_accept( tls_session *sess )
 {
 	tlso_session *s = (tlso_session *)sess;
+	int rc;
 
 	/* Caller expects 0 = success, OpenSSL returns 1 = success */
-	return SSL_accept( s ) - 1;
+	rc = SSL_accept( s ) - 1;
+#ifdef SSL_OP_ENABLE_KTLS
+	if ( rc == 0 && ( SSL_get_options( s ) & SSL_OP_ENABLE_KTLS )) {
+		Debug2( LDAP_DEBUG_TRACE, "TLS: kernel offload send=%d recv=%d\n",
+			(int)BIO_get_ktls_send( SSL_get_wbio( s )),
+			(int)BIO_get_ktls_recv( SSL_get_rbio( s )) );
+	}
+#endif
+	return rc;
 }
 
 static int
@@ -1163,11 +1579,39 @@ tlso_bio_setup( void )
 	return method;
 }
 
+#ifdef SSL_OP_ENABLE_KTLS
+/*
+ * Kernel TLS needs a socket BIO on the descriptor itself, so the
+ * layers below are bypassed.  Only allow that when nothing but the
+ * debug layer sits on top of the TCP provider; a buffering layer
+ * such as readahead may already hold bytes of the handshake.
+ */
+static ber_socket_t
+tlso_sb_ktls_fd( Sockbuf_IO_Desc *sbiod, tlso_session *s )
+{
+	Sockbuf_IO_Desc *next;
+
+	if ( !( SSL_get_options( s ) & SSL_OP_ENABLE_KTLS ))
+		return AC_SOCKET_INVALID;
+
+	for ( next = sbiod->sbiod_next; next; next = next->sbiod_next ) {
+		if ( next->sbiod_io == &ber_sockbuf_io_tcp && !next->sbiod_next )
+			return sbiod->sbiod_sb->sb_fd;
+		if ( next->sbiod_io != &ber_sockbuf_io_debug )
+			break;
+	}
+	return AC_SOCKET_INVALID;
+}
+#endif
+
 static int
 tlso_sb_setup( Sockbuf_IO_Desc *sbiod, void *arg )
 {
 	struct tls_data		*p;
 	BIO			*bio;
+#ifdef SSL_OP_ENABLE_KTLS
+	ber_socket_t		fd;
+#endif
 
 	assert( sbiod != NULL );
 
@@ -1178,8 +1622,16 @@ tlso_sb_setup( Sockbuf_IO_Desc *sbiod, void *arg )
 	
 	p->session = arg;
 	p->sbiod = sbiod;
-	bio = BIO_new( tlso_bio_method );
-	BIO_set_data( bio, p );
+#ifdef SSL_OP_ENABLE_KTLS
+	fd = tlso_sb_ktls_fd( sbiod, p->session );
+	if ( fd != AC_SOCKET_INVALID ) {
+		bio = BIO_new_socket( fd, BIO_NOCLOSE );
+	} else
+#endif
+	{
+		bio = BIO_new( tlso_bio_method );
+		BIO_set_data( bio, p );
+	}
 	SSL_set_bio( p->session, bio, bio );
 	sbiod->sbiod_pvt = p;
 	return 0;
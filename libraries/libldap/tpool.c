@@ -94,6 +94,7 @@ typedef struct ldap_int_thread_task_s {
 	ldap_pvt_thread_start_t *ltt_start_routine;
 	void *ltt_arg;
 	struct ldap_int_thread_poolq_s *ltt_queue;
+	unsigned long ltt_time;		/* usec when submitted */
 } ldap_int_thread_task_t;
 
 typedef LDAP_STAILQ_HEAD(tcq, ldap_int_thread_task_s) ldap_int_tpool_plist_t;
@@ -103,6 +104,9 @@ struct ldap_int_thread_poolq_s {
 
 	struct ldap_int_thread_pool_s *ltp_pool;
 
+	/* position in ltp_wqs, selects the queue's CPU group */
+	int ltp_index;
+
 	/* protect members below */
 	ldap_pvt_thread_mutex_t ltp_mutex;
 
@@ -132,8 +136,28 @@ struct ldap_int_thread_poolq_s {
 	int ltp_active_count;		/* Active, not paused/idle tasks */
 	int ltp_open_count;			/* Number of threads */
 	int ltp_starting;			/* Currently starting threads */
+
+	/* Adaptive thread limit between ltp_adapt_min and ltp_max_count,
+	 * 0 when the pool does not adapt */
+	int ltp_adapt_count;
+	int ltp_adapt_min;
+
+	/* Queue wait of the tasks started in the current interval,
+	 * and the average of the last complete interval */
+	unsigned long ltp_wait_start;
+	unsigned long ltp_wait_sum;
+	unsigned long ltp_wait_num;
+	unsigned long ltp_wait_avg;
 };
 
+/* Threads a queue may open */
+#define POOLQ_LIMIT(pq) ((pq)->ltp_adapt_count && \
+	(pq)->ltp_adapt_count < (pq)->ltp_max_count ? \
+	(pq)->ltp_adapt_count : (pq)->ltp_max_count)
+
+/* Interval over which queue wait is averaged, in usec */
+#define ADAPT_INTERVAL	100000
+
 struct ldap_int_thread_pool_s {
 	LDAP_STAILQ_ENTRY(ldap_int_thread_pool_s) ltp_next;
 
@@ -176,6 +200,25 @@ struct ldap_int_thread_pool_s {
 
 	/* Max pending + paused + idle tasks, negated when ltp_finishing */
 	int ltp_max_pending;
+
+	/* Idle threads take pending tasks from other queues, and tasks
+	 * submitted by a pool thread prefer that thread's own queue */
+	int ltp_steal;
+
+	/* Number of leading queues that do not take bulk tasks */
+	int ltp_reserved;
+
+	/* Adapt the thread count to keep the average queue wait
+	 * below ltp_adapt_wait usec, with at least ltp_adapt_min
+	 * threads.  Disabled when ltp_adapt_wait is 0. */
+	int ltp_adapt_min;
+	int ltp_adapt_wait;
+
+	/* CPU lists the threads of queue i are bound to, cycling
+	 * through the ltp_ngroups groups.  Tasks submitted for group
+	 * g prefer the queues bound to it. */
+	char **ltp_affinity;
+	int ltp_ngroups;
 };
 
 static ldap_int_tpool_plist_t empty_pending_list =
@@ -189,6 +232,11 @@ static LDAP_STAILQ_HEAD(tpq, ldap_int_thread_pool_s)
 static ldap_pvt_thread_mutex_t ldap_pvt_thread_pool_mutex;
 
 static void *ldap_int_thread_pool_wrapper( void *pool );
+static void ldap_int_thread_pool_adapt_queues(
+	struct ldap_int_thread_pool_s *pool );
+static int ldap_int_thread_pool_enqueue( ldap_pvt_thread_pool_t *tpool,
+	ldap_pvt_thread_start_t *start_routine, void *arg,
+	void **cookie, int bulk, int group );
 
 static ldap_pvt_thread_key_t	ldap_tpool_key;
 
@@ -260,6 +308,7 @@ ldap_pvt_thread_pool_init_q (
 		}
 		pool->ltp_wqs[i] = (struct ldap_int_thread_poolq_s *)(((size_t)ptr + CACHELINE-1) & ~(CACHELINE-1));
 		pool->ltp_wqs[i]->ltp_free = ptr;
+		pool->ltp_wqs[i]->ltp_index = i;
 	}
 
 	pool->ltp_numqs = numqs;
@@ -356,12 +405,49 @@ ldap_pvt_thread_pool_submit2 (
 	ldap_pvt_thread_pool_t *tpool,
 	ldap_pvt_thread_start_t *start_routine, void *arg,
 	void **cookie )
+{
+	return ldap_int_thread_pool_enqueue( tpool, start_routine, arg, cookie, 0, -1 );
+}
+
+/* Submit a task that must leave the reserved queues alone */
+int
+ldap_pvt_thread_pool_submit_bulk (
+	ldap_pvt_thread_pool_t *tpool,
+	ldap_pvt_thread_start_t *start_routine, void *arg )
+{
+	return ldap_int_thread_pool_enqueue( tpool, start_routine, arg, NULL, 1, -1 );
+}
+
+/* Submit a task that should run on the queues of CPU group group */
+int
+ldap_pvt_thread_pool_submit_group (
+	ldap_pvt_thread_pool_t *tpool,
+	ldap_pvt_thread_start_t *start_routine, void *arg,
+	int bulk, int group )
+{
+	return ldap_int_thread_pool_enqueue( tpool, start_routine, arg, NULL, bulk, group );
+}
+
+static unsigned long
+ldap_int_thread_pool_usec( void )
+{
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return (unsigned long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int
+ldap_int_thread_pool_enqueue (
+	ldap_pvt_thread_pool_t *tpool,
+	ldap_pvt_thread_start_t *start_routine, void *arg,
+	void **cookie, int bulk, int group )
 {
 	struct ldap_int_thread_pool_s *pool;
 	struct ldap_int_thread_poolq_s *pq;
 	ldap_int_thread_task_t *task;
 	ldap_pvt_thread_t thr;
-	int i, j;
+	int i, j, first = 0;
 
 	if (tpool == NULL)
 		return(-1);
@@ -371,10 +457,54 @@ ldap_pvt_thread_pool_submit2 (
 	if (pool == NULL)
 		return(-1);
 
-	if ( pool->ltp_numqs > 1 ) {
-		int min = pool->ltp_wqs[0]->ltp_max_pending + pool->ltp_wqs[0]->ltp_max_count;
-		int min_x = 0, cnt;
-		for ( i = 0; i < pool->ltp_numqs; i++ ) {
+	/* bulk tasks only go to the queues after the reserved ones */
+	if ( bulk && pool->ltp_reserved > 0 ) {
+		first = pool->ltp_reserved;
+		if ( first >= pool->ltp_numqs )
+			first = pool->ltp_numqs - 1;
+	}
+
+	i = -1;
+	if ( pool->ltp_numqs > 1 && pool->ltp_steal ) {
+		ldap_int_thread_userctx_t *ctx = ldap_pvt_thread_pool_context();
+
+		/* stay on the submitting thread's queue while it has an
+		 * idle thread to pick the task up */
+		pq = ctx->ltu_pq;
+		if ( pq && pq->ltp_pool == pool && pq->ltp_open_count >
+			pq->ltp_starting + pq->ltp_active_count + pq->ltp_pending_count )
+		{
+			for ( i = first; i < pool->ltp_numqs; i++ )
+				if ( pool->ltp_wqs[i] == pq ) break;
+			if ( i == pool->ltp_numqs )
+				i = -1;
+		}
+	}
+
+	if ( i < 0 && group >= 0 && pool->ltp_ngroups > 1 ) {
+		/* the least loaded queue of the group */
+		int min = 0, cnt;
+
+		group %= pool->ltp_ngroups;
+		for ( j = first; j < pool->ltp_numqs; j++ ) {
+			if ( j % pool->ltp_ngroups != group )
+				continue;
+			cnt = pool->ltp_wqs[j]->ltp_active_count + pool->ltp_wqs[j]->ltp_pending_count;
+			if ( i < 0 || cnt < min ) {
+				min = cnt;
+				i = j;
+			}
+			if ( !pool->ltp_wqs[j]->ltp_active_count )
+				break;
+		}
+	}
+
+	if ( i >= 0 ) {
+		/* keep i */
+	} else if ( pool->ltp_numqs > first + 1 ) {
+		int min = pool->ltp_wqs[first]->ltp_max_pending + pool->ltp_wqs[first]->ltp_max_count;
+		int min_x = first, cnt;
+		for ( i = first; i < pool->ltp_numqs; i++ ) {
 			/* take first queue that has nothing active */
 			if ( !pool->ltp_wqs[i]->ltp_active_count ) {
 				min_x = i;
@@ -388,7 +518,7 @@ ldap_pvt_thread_pool_submit2 (
 		}
 		i = min_x;
 	} else
-		i = 0;
+		i = first;
 
 	j = i;
 	while(1) {
@@ -397,8 +527,8 @@ ldap_pvt_thread_pool_submit2 (
 			break;
 		}
 		ldap_pvt_thread_mutex_unlock(&pool->ltp_wqs[i]->ltp_mutex);
-		i++;
-		i %= pool->ltp_numqs;
+		if ( ++i == pool->ltp_numqs )
+			i = first;
 		if ( i == j )
 			return -1;
 	}
@@ -416,6 +546,7 @@ ldap_pvt_thread_pool_submit2 (
 	task->ltt_start_routine = start_routine;
 	task->ltt_arg = arg;
 	task->ltt_queue = pq;
+	task->ltt_time = ldap_int_thread_pool_usec();
 	if ( cookie )
 		*cookie = task;
 
@@ -427,7 +558,7 @@ ldap_pvt_thread_pool_submit2 (
 
 	/* should we open (create) a thread? */
 	if (pq->ltp_open_count < pq->ltp_active_count+pq->ltp_pending_count &&
-		pq->ltp_open_count < pq->ltp_max_count)
+		pq->ltp_open_count < POOLQ_LIMIT(pq))
 	{
 		pq->ltp_starting++;
 		pq->ltp_open_count++;
@@ -598,6 +729,7 @@ ldap_pvt_thread_pool_queues(
 			pq->ltp_free = ptr;
 			pool->ltp_wqs[i] = pq;
 			pq->ltp_pool = pool;
+			pq->ltp_index = i;
 			rc = ldap_pvt_thread_mutex_init(&pq->ltp_mutex);
 			if (rc != 0)
 				return(rc);
@@ -625,9 +757,162 @@ ldap_pvt_thread_pool_queues(
 		}
 	}
 	pool->ltp_numqs = numqs;
+	ldap_int_thread_pool_adapt_queues(pool);
+	return 0;
+}
+
+/* Bind the threads of the pool's queues to the given CPU groups,
+ * NULL to leave them unbound.  Applies to threads started later.
+ */
+int
+ldap_pvt_thread_pool_affinity(
+	ldap_pvt_thread_pool_t *tpool,
+	char **groups )
+{
+	struct ldap_int_thread_pool_s *pool;
+	char **dup = NULL;
+	int i, n = 0;
+
+	if (tpool == NULL)
+		return(-1);
+
+	pool = *tpool;
+
+	if (pool == NULL)
+		return(-1);
+
+	if ( groups ) {
+		for ( n = 0; groups[n]; n++ )
+			if ( ldap_pvt_thread_check_affinity( groups[n] ))
+				return(-1);
+		if ( n ) {
+			dup = LDAP_CALLOC( n + 1, sizeof(char *) );
+			if ( dup == NULL )
+				return(-1);
+			for ( i = 0; i < n; i++ ) {
+				dup[i] = LDAP_STRDUP( groups[i] );
+				if ( dup[i] == NULL ) {
+					LDAP_VFREE( dup );
+					return(-1);
+				}
+			}
+		}
+	}
+
+	ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
+	groups = pool->ltp_affinity;
+	pool->ltp_affinity = dup;
+	pool->ltp_ngroups = n;
+	ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
+
+	if ( groups )
+		LDAP_VFREE( groups );
+	return 0;
+}
+
+/* Enable or disable work stealing between the queues of this pool. */
+int
+ldap_pvt_thread_pool_steal(
+	ldap_pvt_thread_pool_t *tpool,
+	int steal )
+{
+	struct ldap_int_thread_pool_s *pool;
+
+	if (tpool == NULL)
+		return(-1);
+
+	pool = *tpool;
+
+	if (pool == NULL)
+		return(-1);
+
+	pool->ltp_steal = steal;
+	return 0;
+}
+
+/* Keep the first numqs queues of this pool free of bulk tasks.
+ * At least one queue always remains available to them. */
+int
+ldap_pvt_thread_pool_reserve(
+	ldap_pvt_thread_pool_t *tpool,
+	int numqs )
+{
+	struct ldap_int_thread_pool_s *pool;
+
+	if (numqs < 0 || tpool == NULL)
+		return(-1);
+
+	pool = *tpool;
+
+	if (pool == NULL)
+		return(-1);
+
+	pool->ltp_reserved = numqs;
+	return 0;
+}
+
+/* Let the number of threads adapt to the queue wait of submitted
+ * tasks: each queue opens more threads, up to its share of the
+ * maximum, while the average wait exceeds wait_usec, and lets idle
+ * threads go while it is well below.  At least min_threads are kept.
+ * wait_usec = 0 disables adapting; every thread up to the maximum
+ * may then be opened as before. */
+int
+ldap_pvt_thread_pool_adapt(
+	ldap_pvt_thread_pool_t *tpool,
+	int min_threads,
+	int wait_usec )
+{
+	struct ldap_int_thread_pool_s *pool;
+
+	if (min_threads < 0 || wait_usec < 0 || tpool == NULL)
+		return(-1);
+
+	pool = *tpool;
+
+	if (pool == NULL)
+		return(-1);
+
+	pool->ltp_adapt_min = min_threads;
+	pool->ltp_adapt_wait = wait_usec;
+	ldap_int_thread_pool_adapt_queues(pool);
 	return 0;
 }
 
+/* Spread the adaptive settings of the pool over its queues */
+static void
+ldap_int_thread_pool_adapt_queues(
+	struct ldap_int_thread_pool_s *pool )
+{
+	struct ldap_int_thread_poolq_s *pq;
+	int i, min, remmin;
+
+	min = pool->ltp_adapt_min / pool->ltp_numqs;
+	remmin = pool->ltp_adapt_min % pool->ltp_numqs;
+
+	for (i=0; i<pool->ltp_numqs; i++) {
+		pq = pool->ltp_wqs[i];
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		pq->ltp_adapt_min = min;
+		if (remmin) {
+			pq->ltp_adapt_min++;
+			remmin--;
+		}
+		if (pq->ltp_adapt_min < 1)
+			pq->ltp_adapt_min = 1;
+		if (pq->ltp_adapt_min > pq->ltp_max_count)
+			pq->ltp_adapt_min = pq->ltp_max_count;
+
+		if (!pool->ltp_adapt_wait)
+			pq->ltp_adapt_count = 0;
+		else if (pq->ltp_adapt_count < pq->ltp_adapt_min)
+			pq->ltp_adapt_count = pq->ltp_adapt_min;
+		else if (pq->ltp_adapt_count > pq->ltp_max_count)
+			pq->ltp_adapt_count = pq->ltp_max_count;
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	}
+}
+
 /* Set max #threads.  value <= 0 means max supported #threads (LDAP_MAXTHR) */
 int
 ldap_pvt_thread_pool_maxthreads(
@@ -665,6 +950,7 @@ ldap_pvt_thread_pool_maxthreads(
 			remthr--;
 		}
 	}
+	ldap_int_thread_pool_adapt_queues(pool);
 	return(0);
 }
 
@@ -734,6 +1020,8 @@ ldap_pvt_thread_pool_query(
 					case LDAP_PVT_THREAD_POOL_PARAM_BACKLOAD:
 						count += pq->ltp_pending_count + pq->ltp_active_count;
 						break;
+					default:
+						break;
 				}
 				ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 			}
@@ -742,6 +1030,27 @@ ldap_pvt_thread_pool_query(
 		}
 		break;
 
+	case LDAP_PVT_THREAD_POOL_PARAM_LIMIT:
+	case LDAP_PVT_THREAD_POOL_PARAM_WAIT:
+		{
+			int i;
+			unsigned long wait = 0;
+			count = 0;
+			for (i=0; i<pool->ltp_numqs; i++) {
+				struct ldap_int_thread_poolq_s *pq = pool->ltp_wqs[i];
+				ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+				count += POOLQ_LIMIT(pq);
+				wait += pq->ltp_wait_avg;
+				ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+			}
+			if (param == LDAP_PVT_THREAD_POOL_PARAM_WAIT) {
+				/* average queue wait in usec */
+				wait /= pool->ltp_numqs;
+				count = wait > INT_MAX ? INT_MAX : (int)wait;
+			}
+		}
+		break;
+
 	case LDAP_PVT_THREAD_POOL_PARAM_ACTIVE_MAX:
 		break;
 
@@ -932,12 +1241,92 @@ ldap_pvt_thread_pool_free ( ldap_pvt_thread_pool_t *tpool )
 		}
 	}
 	LDAP_FREE(pool->ltp_wqs);
+	if (pool->ltp_affinity)
+		LDAP_VFREE(pool->ltp_affinity);
 	LDAP_FREE(pool);
 	*tpool = NULL;
 	ldap_int_has_thread_pool = 0;
 	return(0);
 }
 
+/* Account for the queue wait of a task taken off pq, and adjust the
+ * adaptive thread limit of pq after each interval.  Called with pq's
+ * lock held. */
+static void
+ldap_int_thread_pool_waited(
+	struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq,
+	ldap_int_thread_task_t *task )
+{
+	unsigned long now = ldap_int_thread_pool_usec();
+
+	pq->ltp_wait_sum += now - task->ltt_time;
+	pq->ltp_wait_num++;
+	if (now - pq->ltp_wait_start < ADAPT_INTERVAL)
+		return;
+
+	pq->ltp_wait_avg = pq->ltp_wait_sum / pq->ltp_wait_num;
+	pq->ltp_wait_start = now;
+	pq->ltp_wait_sum = 0;
+	pq->ltp_wait_num = 0;
+
+	if (!pq->ltp_adapt_count)
+		return;
+
+	if (pq->ltp_wait_avg > (unsigned long)pool->ltp_adapt_wait) {
+		/* tasks are waiting too long, allow a quarter more threads */
+		if (pq->ltp_adapt_count < pq->ltp_max_count) {
+			pq->ltp_adapt_count += pq->ltp_adapt_count / 4 + 1;
+			if (pq->ltp_adapt_count > pq->ltp_max_count)
+				pq->ltp_adapt_count = pq->ltp_max_count;
+		}
+	} else if (pq->ltp_wait_avg < (unsigned long)pool->ltp_adapt_wait / 4 &&
+		pq->ltp_adapt_count > pq->ltp_adapt_min &&
+		pq->ltp_open_count > pq->ltp_starting + pq->ltp_active_count)
+	{
+		/* well below target with idle threads, let one of them go */
+		pq->ltp_adapt_count--;
+		if (pq->ltp_open_count > POOLQ_LIMIT(pq))
+			ldap_pvt_thread_cond_signal(&pq->ltp_cond);
+	}
+}
+
+/* Take the first pending task of another queue than pq, if one can
+ * be had without waiting for its lock.  Called with pq's lock held. */
+static ldap_int_thread_task_t *
+ldap_int_thread_pool_steal(
+	struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq )
+{
+	struct ldap_int_thread_poolq_s *vq;
+	ldap_int_thread_task_t *task = NULL;
+	int i, j, numqs = pool->ltp_numqs;
+
+	for (i=0; i<numqs; i++)
+		if (pool->ltp_wqs[i] == pq) break;
+
+	/* reserved threads must not end up running bulk tasks */
+	if (i < pool->ltp_reserved)
+		return NULL;
+
+	for (j=1; j<=numqs && task == NULL; j++) {
+		vq = pool->ltp_wqs[(i+j) % numqs];
+		/* unlocked peek, leave quiet queues alone */
+		if (vq == pq || LDAP_STAILQ_EMPTY(vq->ltp_work_list))
+			continue;
+		if (ldap_pvt_thread_mutex_trylock(&vq->ltp_mutex) != 0)
+			continue;
+		task = LDAP_STAILQ_FIRST(vq->ltp_work_list);
+		if (task != NULL) {
+			LDAP_STAILQ_REMOVE_HEAD(vq->ltp_work_list, ltt_next.q);
+			vq->ltp_pending_count--;
+			ldap_int_thread_pool_waited(pool, vq, task);
+		}
+		ldap_pvt_thread_mutex_unlock(&vq->ltp_mutex);
+	}
+	return task;
+}
+
 /* Thread loop.  Accept and handle submitted tasks. */
 static void *
 ldap_int_thread_pool_wrapper ( 
@@ -963,6 +1352,14 @@ ldap_int_thread_pool_wrapper (
 
 	ldap_pvt_thread_key_setdata( ldap_tpool_key, &ctx );
 
+	if (pool->ltp_ngroups) {
+		ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
+		if (pool->ltp_ngroups)
+			ldap_pvt_thread_set_affinity(
+				pool->ltp_affinity[pq->ltp_index % pool->ltp_ngroups] );
+		ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
+	}
+
 	if (pool->ltp_pause) {
 		ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
 		/* thread_keys[] is read-only when paused */
@@ -989,6 +1386,18 @@ ldap_int_thread_pool_wrapper (
 	for (;;) {
 		work_list = pq->ltp_work_list; /* help the compiler a bit */
 		task = LDAP_STAILQ_FIRST(work_list);
+		if (task == NULL && pool->ltp_steal && !pool->ltp_pause &&
+			(task = ldap_int_thread_pool_steal(pool, pq)) != NULL)
+		{
+			/* still counted as active in our own queue */
+			ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+
+			task->ltt_start_routine(&ctx, task->ltt_arg);
+
+			ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+			LDAP_SLIST_INSERT_HEAD(&pq->ltp_free_list, task, ltt_next.l);
+			continue;
+		}
 		if (task == NULL) {	/* paused or no pending tasks */
 			if (--(pq->ltp_active_count) < 1) {
 				if (pool->ltp_pause) {
@@ -1003,10 +1412,11 @@ ldap_int_thread_pool_wrapper (
 			}
 
 			do {
-				if (pool->ltp_finishing || pq->ltp_open_count > pq->ltp_max_count) {
+				if (pool->ltp_finishing || pq->ltp_open_count > POOLQ_LIMIT(pq)) {
 					/* Not paused, and either finishing or too many
 					 * threads running (can happen if ltp_max_count
-					 * was reduced).  Let this thread die.
+					 * or the adaptive limit was reduced).  Let this
+					 * thread die.
 					 */
 					goto done;
 				}
@@ -1046,6 +1456,7 @@ ldap_int_thread_pool_wrapper (
 
 		LDAP_STAILQ_REMOVE_HEAD(work_list, ltt_next.q);
 		pq->ltp_pending_count--;
+		ldap_int_thread_pool_waited(pool, pq, task);
 		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 
 		task->ltt_start_routine(&ctx, task->ltt_arg);
@@ -111,6 +111,10 @@ ldap_ld_free(
 	while ( ld->ld_requests != NULL ) {
 		ldap_free_request( ld, ld->ld_requests );
 	}
+	if ( ld->ld_req_hash != NULL ) {
+		LDAP_FREE( ld->ld_req_hash );
+		ld->ld_req_hash = NULL;
+	}
 	LDAP_MUTEX_UNLOCK( &ld->ld_req_mutex );
 	LDAP_MUTEX_LOCK( &ld->ld_conn_mutex );
 
@@ -124,6 +128,11 @@ ldap_ld_free(
 		next = lm->lm_next;
 		ldap_msgfree( lm );
 	}
+	if ( ld->ld_res_hash != NULL ) {
+		LDAP_FREE( ld->ld_res_hash );
+		ld->ld_res_hash = NULL;
+	}
+	ldap_int_result_procs_free( ld );
 
 	if ( ld->ld_abandoned != NULL ) {
 		LDAP_FREE( ld->ld_abandoned );
@@ -170,6 +179,11 @@ ldap_ld_free(
 		ld->ld_selectinfo = NULL;
 	}
 
+	if ( ld->ld_selectsnap != NULL ) {
+		ldap_free_select_info( ld->ld_selectsnap );
+		ld->ld_selectsnap = NULL;
+	}
+
 	if ( ld->ld_options.ldo_defludp != NULL ) {
 		ldap_free_urllist( ld->ld_options.ldo_defludp );
 		ld->ld_options.ldo_defludp = NULL;
@@ -303,6 +303,14 @@ typedef void (MDB_rel_func)(MDB_val *item, void *oldptr, void *newptr, void *rel
 #define MDB_NORDAHEAD	0x800000
 	/** don't initialize malloc'd memory before writing to datafile */
 #define MDB_NOMEMINIT	0x1000000
+	/** advise the OS to back the map with huge pages */
+#define MDB_HUGEPAGES	0x2000000
+	/** read in the top levels of the trees when opening */
+#define MDB_PREFAULT	0x4000000
+	/** interleave the pages read by #MDB_PREFAULT over NUMA nodes */
+#define MDB_INTERLEAVE	0x40000000
+	/** commit without waiting for the disk, for #mdb_txn_begin() only */
+#define MDB_DEFERSYNC	0x2000
 /** @} */
 
 /**	@defgroup	mdb_dbi_open	Database Flags
@@ -463,6 +471,28 @@ typedef struct MDB_stat {
 	size_t		ms_entries;			/**< Number of data items */
 } MDB_stat;
 
+/** Number of buckets in the histograms of #MDB_walkstat */
+#define MDB_WALK_BUCKETS	32
+
+/** @brief Detailed statistics for a database, from #mdb_stat_walk()
+ *
+ * The histograms count items by the bit length of a size: bucket 0
+ * is size 0, and bucket n holds sizes from 2^(n-1) to 2^n-1. Pages
+ * and items of the duplicates of #MDB_DUPSORT keys are included.
+ */
+typedef struct MDB_walkstat {
+	size_t		mw_branch_pages;	/**< Number of internal (non-leaf) pages */
+	size_t		mw_leaf_pages;		/**< Number of leaf pages */
+	size_t		mw_overflow_pages;	/**< Number of overflow pages */
+	size_t		mw_entries;			/**< Number of data items */
+	size_t		mw_branch_used;		/**< Bytes used on internal pages */
+	size_t		mw_leaf_used;		/**< Bytes used on leaf pages */
+	size_t		mw_fill[10];		/**< Leaf pages by tenths of the page used */
+	size_t		mw_keysize[MDB_WALK_BUCKETS];	/**< Keys by size */
+	size_t		mw_datasize[MDB_WALK_BUCKETS];	/**< Data items by size */
+	size_t		mw_overflow[MDB_WALK_BUCKETS];	/**< Overflow items by pages */
+} MDB_walkstat;
+
 /** @brief Information about the environment */
 typedef struct MDB_envinfo {
 	void	*me_mapaddr;			/**< Address of map, if fixed */
@@ -614,6 +644,27 @@ int  mdb_env_create(MDB_env **env);
 	 *		caller is expected to overwrite all of the memory that was
 	 *		reserved in that case.
 	 *		This flag may be changed at any time using #mdb_env_set_flags().
+	 *	<li>#MDB_HUGEPAGES
+	 *		Advise the OS to back the memory map with huge pages, to cut the
+	 *		TLB misses of page walks across a large map. This is only advice:
+	 *		whether file mappings get huge pages depends on the OS and the
+	 *		filesystem. The option is only implemented where madvise()
+	 *		supports MADV_HUGEPAGE.
+	 *	<li>#MDB_PREFAULT
+	 *		Read in the top levels of the trees when opening the environment:
+	 *		the branch pages of the main DB, the free DB and all named DBs.
+	 *		Each level is requested from the OS as a whole before it is walked,
+	 *		so the first searches need not wait for those pages one at a time.
+	 *		Leaf pages are left alone, so this reads a small fraction of
+	 *		the map.
+	 *	<li>#MDB_INTERLEAVE
+	 *		With #MDB_PREFAULT, place the pages it reads in round-robin over
+	 *		all allowed NUMA nodes, instead of on the node of the opening
+	 *		thread. These pages are used by every search, from every node.
+	 *		Other pages are placed by the memory policy of the thread which
+	 *		first touches them, as the OS ignores mapping policies for shared
+	 *		file mappings. Run the process under an interleave policy to
+	 *		spread those too. The option is only implemented on Linux.
 	 * </ul>
 	 * @param[in] mode The UNIX permissions to set on created files and semaphores.
 	 * This parameter is ignored on Windows.
@@ -705,6 +756,107 @@ int  mdb_env_copy2(MDB_env *env, const char *path, unsigned int flags);
 	 */
 int  mdb_env_copyfd2(MDB_env *env, mdb_filehandle_t fd, unsigned int flags);
 
+	/** @brief Copy an LMDB environment to the specified path, with options,
+	 *	on several threads.
+	 *
+	 * This function may be used to make a backup of an existing environment.
+	 * No lockfile is created, since it gets recreated at need. See
+	 * #mdb_env_copy2() for further details.
+	 * @note This call can trigger significant file size growth if run in
+	 * parallel with write transactions, because it employs a read-only
+	 * transaction. See long-lived transactions under @ref caveats_sec.
+	 * @param[in] env An environment handle returned by #mdb_env_create(). It
+	 * must have already been opened successfully.
+	 * @param[in] path The directory in which the copy will reside. This
+	 * directory must already exist and be writable but must otherwise be
+	 * empty.
+	 * @param[in] flags Special options for this operation.
+	 * See #mdb_env_copy2() for options.
+	 * @param[in] threads With #MDB_CP_COMPACT, the number of threads walking
+	 * the named databases of the environment concurrently. Large databases
+	 * are split into subtrees walked separately. 0 or 1 performs the usual
+	 * single walker copy, as does an environment without named databases.
+	 * Not supported on Windows.
+	 * @param[in] rate The maximum number of bytes per second to write,
+	 * or 0 for no limit. Not supported on Windows.
+	 * @return A non-zero error value on failure and 0 on success.
+	 */
+int  mdb_env_copy3(MDB_env *env, const char *path, unsigned int flags,
+	unsigned int threads, size_t rate);
+
+	/** @brief Copy an LMDB environment to the specified file descriptor,
+	 *	with options, on several threads.
+	 *
+	 * See #mdb_env_copy3() for further details. Several threads are only
+	 * used if the file descriptor is seekable, they write their pages
+	 * at their offsets from the current position of the file.
+	 * @param[in] env An environment handle returned by #mdb_env_create(). It
+	 * must have already been opened successfully.
+	 * @param[in] fd The filedescriptor to write the copy to. It must
+	 * have already been opened for Write access.
+	 * @param[in] flags Special options for this operation.
+	 * See #mdb_env_copy2() for options.
+	 * @param[in] threads Number of threads, see #mdb_env_copy3().
+	 * @param[in] rate Bytes per second, see #mdb_env_copy3().
+	 * @return A non-zero error value on failure and 0 on success.
+	 */
+int  mdb_env_copyfd3(MDB_env *env, mdb_filehandle_t fd, unsigned int flags,
+	unsigned int threads, size_t rate);
+
+	/** @brief Write a delta backup of an LMDB environment.
+	 *
+	 * A delta backup holds the pages which changed since a previous
+	 * backup, so that it can be brought up to date by #mdb_env_apply_delta().
+	 * Pages carry no transaction ID, so the changed pages are found by
+	 * comparing hashes of all pages with a page map of the previous
+	 * backup, written by the call that made it.
+	 * Without a previous backup, the delta holds a full copy, as
+	 * #mdb_env_copyfd() would write, and can be applied to an empty
+	 * directory.
+	 * @note This call can trigger significant file size growth if run in
+	 * parallel with write transactions, because it employs a read-only
+	 * transaction. See long-lived transactions under @ref caveats_sec.
+	 * @param[in] env An environment handle returned by #mdb_env_create(). It
+	 * must have already been opened successfully.
+	 * @param[in] fd The filedescriptor to write the delta to. It must
+	 * have already been opened for Write access.
+	 * @param[in] base The filedescriptor to read the page map of the
+	 * previous backup from, or -1 (INVALID_HANDLE_VALUE on Windows) for none.
+	 * @param[in] map The filedescriptor to write the page map of the new
+	 * backup to. It must differ from \b base; the caller only replaces
+	 * the previous map once the delta has been stored.
+	 * @return A non-zero error value on failure and 0 on success. Some
+	 * possible errors are:
+	 * <ul>
+	 *	<li>#MDB_INVALID - \b base is not a page map.
+	 *	<li>#MDB_INCOMPATIBLE - \b base is the map of an environment
+	 *		with another page size.
+	 * </ul>
+	 */
+int  mdb_env_copyfd_delta(MDB_env *env, mdb_filehandle_t fd,
+	mdb_filehandle_t base, mdb_filehandle_t map);
+
+	/** @brief Apply a delta backup to a backup of an LMDB environment.
+	 *
+	 * The environment at \b path must not be open. It must be the backup
+	 * the delta was made against, or not exist yet for a delta without
+	 * one. The meta pages are written last, so if this fails midway the
+	 * same delta can be applied again.
+	 * @param[in] path The directory of the backup, or its data file with
+	 * #MDB_NOSUBDIR.
+	 * @param[in] fd The filedescriptor to read the delta from.
+	 * @param[in] flags 0 or #MDB_NOSUBDIR.
+	 * @return A non-zero error value on failure and 0 on success. Some
+	 * possible errors are:
+	 * <ul>
+	 *	<li>#MDB_INVALID - \b fd is not a delta backup, or is truncated.
+	 *	<li>#MDB_INCOMPATIBLE - the backup at \b path is not the one the
+	 *		delta was made against.
+	 * </ul>
+	 */
+int  mdb_env_apply_delta(const char *path, mdb_filehandle_t fd,
+	unsigned int flags);
+
 	/** @brief Return statistics about the LMDB environment.
 	 *
 	 * @param[in] env An environment handle returned by #mdb_env_create()
@@ -728,6 +880,12 @@ int  mdb_env_info(MDB_env *env, MDB_envinfo *stat);
 	 * the OS buffers upon commit as well, unless the environment was
 	 * opened with #MDB_NOSYNC or in part #MDB_NOMETASYNC. This call is
 	 * not valid if the environment was opened with #MDB_RDONLY.
+	 *
+	 * Commits made with #MDB_DEFERSYNC since the last call are flushed,
+	 * then their meta page is written, which makes them durable and
+	 * visible to read-only transactions. The write lock is only held
+	 * while the meta page is written, so this call must not be made
+	 * by a thread which has a write transaction open.
 	 * @param[in] env An environment handle returned by #mdb_env_create()
 	 * @param[in] force If non-zero, force a synchronous flush.  Otherwise
 	 *  if the environment has the #MDB_NOSYNC flag set the flushes
@@ -955,6 +1113,19 @@ int  mdb_env_set_assert(MDB_env *env, MDB_assert_func *func);
 	 * <ul>
 	 *	<li>#MDB_RDONLY
 	 *		This transaction will not perform any write operations.
+	 *	<li>#MDB_DEFERSYNC
+	 *		Don't wait for the disk when committing this write transaction.
+	 *		#mdb_txn_commit() writes the dirty pages and releases the write
+	 *		lock, but leaves the meta page of the transaction in the lock
+	 *		file. Later write transactions, in any process, build on it.
+	 *		Read-only transactions don't see the changes until the next
+	 *		#mdb_env_sync() has synced the data pages and written the
+	 *		meta page, so a system crash loses the deferred commits but
+	 *		never damages the database. The deferred commits are also lost
+	 *		if the last process using the environment exits without calling
+	 *		#mdb_env_sync() or #mdb_env_close(). A commit without this flag
+	 *		makes all earlier deferred commits durable too. The flag is
+	 *		ignored with #MDB_WRITEMAP, #MDB_NOLOCK and #MDB_NOSYNC.
 	 * </ul>
 	 * @param[out] txn Address where the new #MDB_txn handle will be stored
 	 * @return A non-zero error value on failure and 0 on success. Some possible
@@ -1141,6 +1312,28 @@ int  mdb_dbi_open(MDB_txn *txn, const char *name, unsigned int flags, MDB_dbi *d
 	 */
 int  mdb_stat(MDB_txn *txn, MDB_dbi dbi, MDB_stat *stat);
 
+	/** @brief Retrieve detailed statistics for a database.
+	 *
+	 * Unlike #mdb_stat() this reads every branch and leaf page of the
+	 * database, so it takes time proportional to its size. Overflow
+	 * pages are not read.
+	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #mdb_dbi_open()
+	 * @param[out] stat The address of an #MDB_walkstat structure
+	 * 	where the statistics will be copied
+	 * @param[in] threads The number of threads walking the subtrees of
+	 * the database concurrently in a read-only transaction. 0 or 1
+	 * walks on the calling thread. Not supported on Windows.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 *	<li>MDB_CORRUPTED - a page of the database was not as expected.
+	 * </ul>
+	 */
+int  mdb_stat_walk(MDB_txn *txn, MDB_dbi dbi, MDB_walkstat *stat,
+	unsigned int threads);
+
 	/** @brief Retrieve the DB flags for a database handle.
 	 *
 	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
@@ -1259,6 +1452,32 @@ int  mdb_set_relfunc(MDB_txn *txn, MDB_dbi dbi, MDB_rel_func *rel);
 	 */
 int  mdb_set_relctx(MDB_txn *txn, MDB_dbi dbi, void *ctx);
 
+	/** @brief Keep the branch pages of a database locked in memory.
+	 *
+	 * For random reads of a database larger than RAM, this keeps the OS
+	 * from evicting the branch pages, so a lookup faults in at most its
+	 * leaf page. The pages are locked with mlock() (VirtualLock() on
+	 * Windows) and the set is brought up to date whenever a write txn of
+	 * this environment handle commits, by walking only the pages that
+	 * txn wrote. Commits made through other handles or processes are
+	 * caught up with a full walk at the next commit made here. Locking is
+	 * best effort: it is subject to the memory lock limits of the
+	 * process, and a failure is only reported if it happens here.
+	 * The setting lasts until the DBI is closed and is not persistent.
+	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #mdb_dbi_open()
+	 * @param[in] pin Non-zero to lock the branch pages, zero to unlock them.
+	 * With a read-only txn the change takes effect at once, otherwise
+	 * when \b txn commits.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 *	<li>ENOMEM, EPERM, EAGAIN - pages could not be locked.
+	 * </ul>
+	 */
+int  mdb_set_pinned(MDB_txn *txn, MDB_dbi dbi, int pin);
+
 	/** @brief Get items from a database.
 	 *
 	 * This function retrieves key/data pairs from the database. The address
@@ -1507,6 +1726,35 @@ int  mdb_cursor_get(MDB_cursor *cursor, MDB_val *key, MDB_val *data,
 int  mdb_cursor_put(MDB_cursor *cursor, MDB_val *key, MDB_val *data,
 				unsigned int flags);
 
+	/** @brief Store a sorted run of key/data pairs by cursor.
+	 *
+	 * This function stores the pairs in order, as a series of calls to
+	 * #mdb_cursor_put() would. When a key sorts right after the one the
+	 * cursor was left on, it is inserted there without searching the
+	 * tree again, and a leaf page that fills up at its end is split
+	 * between the old and new keys, as with #MDB_APPEND. Loading keys
+	 * in ascending order thus fills pages in place, even when they do
+	 * not sort after all the keys already in the database. Keys that do
+	 * not follow the cursor are simply stored as by #mdb_cursor_put().
+	 * The cursor is left on the last pair stored, so a run may be split
+	 * across several calls.
+	 * @param[in] cursor A cursor handle returned by #mdb_cursor_open()
+	 * @param[in] key An array of keys, best sorted in ascending order.
+	 * @param[in,out] data An array of data items, one per key.
+	 * @param[in,out] count The number of pairs to store. On return this
+	 * is set to the number of pairs actually stored.
+	 * @param[in] flags Options for this operation. This parameter must be
+	 * set to 0 or a combination of #MDB_NOOVERWRITE, #MDB_NODUPDATA,
+	 * #MDB_APPEND, #MDB_APPENDDUP and #MDB_RESERVE, which apply to each
+	 * pair as described for #mdb_cursor_put(). Reserved space is only
+	 * valid until the next pair is stored, so #MDB_RESERVE is only useful
+	 * with a count of 1.
+	 * @return A non-zero error value on failure and 0 on success. The
+	 * possible errors are those of #mdb_cursor_put().
+	 */
+int  mdb_cursor_put_multiple(MDB_cursor *cursor, MDB_val *key, MDB_val *data,
+				size_t *count, unsigned int flags);
+
 	/** @brief Delete current key/data pair
 	 *
 	 * This function deletes the key/data pair to which the cursor refers.
@@ -73,6 +73,9 @@
 #include <sys/file.h>
 #endif
 #include <fcntl.h>
+#if defined(__linux)
+#include <sys/syscall.h>
+#endif
 #endif
 
 #if defined(__mips) && defined(__linux)
@@ -333,6 +336,29 @@ typedef HANDLE mdb_mutex_t, mdb_mutexref_t;
 	/** For MDB_LOCK_FORMAT: True if readers take a pid lock in the lockfile */
 #define MDB_PIDLOCK			1
 
+	/** @defgroup rslotcas	Lock-free reader slots
+	 *	Reader slots are claimed by compare-and-swap of their pid where
+	 *	the compiler provides it. Only growing the reader table, and the
+	 *	first claim of each process, take the reader table mutex.
+	 *	Without it, MDB_CAS() is a plain test and set under the mutex.
+	 *	@{
+	 */
+#if defined(_WIN32)
+#define MDB_CAS(p, o, n) \
+	(InterlockedCompareExchange((LONG volatile *)(p), (LONG)(n), (LONG)(o)) == (LONG)(o))
+#define MDB_MEMBAR()	MemoryBarrier()
+#define MDB_RSLOT_CAS	1
+#elif (__GNUC__ * 100 + __GNUC_MINOR__ >= 401) || defined(__clang__)
+#define MDB_CAS(p, o, n)	__sync_bool_compare_and_swap(p, o, n)
+#define MDB_MEMBAR()	__sync_synchronize()
+#define MDB_RSLOT_CAS	1
+#else
+#define MDB_CAS(p, o, n)	(*(p) == (o) ? (*(p) = (n), 1) : 0)
+#define MDB_MEMBAR()
+#define MDB_RSLOT_CAS	0
+#endif
+	/** @} */
+
 #ifdef MDB_USE_POSIX_SEM
 
 typedef sem_t *mdb_mutex_t, *mdb_mutexref_t;
@@ -539,7 +565,7 @@ static txnid_t mdb_debug_start;
 	/**	The version number for a database's datafile format. */
 #define MDB_DATA_VERSION	 ((MDB_DEVEL) ? 999 : 1)
 	/**	The version number for a database's lockfile format. */
-#define MDB_LOCK_VERSION	 1
+#define MDB_LOCK_VERSION	 2
 
 	/**	@brief The max size of a key we can write, or 0 for computed max.
 	 *
@@ -746,39 +772,13 @@ typedef struct MDB_txbody {
 		 *	when readers release their slots.
 		 */
 	volatile unsigned	mtb_numreaders;
+		/** A hint where to start looking for a free reader slot.
+		 *	It is bumped past each claimed slot and lowered when
+		 *	a slot is released by a function that knows the table.
+		 */
+	volatile unsigned	mtb_rfree;
 } MDB_txbody;
 
-	/** The actual reader table definition. */
-typedef struct MDB_txninfo {
-	union {
-		MDB_txbody mtb;
-#define mti_magic	mt1.mtb.mtb_magic
-#define mti_format	mt1.mtb.mtb_format
-#define mti_rmutex	mt1.mtb.mtb_rmutex
-#define mti_rmname	mt1.mtb.mtb_rmname
-#define mti_txnid	mt1.mtb.mtb_txnid
-#define mti_numreaders	mt1.mtb.mtb_numreaders
-		char pad[(sizeof(MDB_txbody)+CACHELINE-1) & ~(CACHELINE-1)];
-	} mt1;
-	union {
-#if defined(_WIN32) || defined(MDB_USE_POSIX_SEM)
-		char mt2_wmname[MNAME_LEN];
-#define	mti_wmname	mt2.mt2_wmname
-#else
-		mdb_mutex_t	mt2_wmutex;
-#define mti_wmutex	mt2.mt2_wmutex
-#endif
-		char pad[(MNAME_LEN+CACHELINE-1) & ~(CACHELINE-1)];
-	} mt2;
-	MDB_reader	mti_readers[1];
-} MDB_txninfo;
-
-	/** Lockfile format signature: version, features and field layout */
-#define MDB_LOCK_FORMAT \
-	((uint32_t) \
-	 ((MDB_LOCK_VERSION) \
-	  /* Flags which describe functionality */ \
-	  + (((MDB_PIDLOCK) != 0) << 16)))
 /** @} */
 
 /** Common header for all page types. The page type depends on #mp_flags.
@@ -1063,6 +1063,62 @@ typedef union MDB_metabuf {
 	} mb_metabuf;
 } MDB_metabuf;
 
+	/** Commits made with #MDB_DEFERSYNC which are not on disk yet.
+	 *	These live in the lock file next to the reader table, so that
+	 *	writers in any process build on them. A meta page is only
+	 *	written once the data pages of its txn have been synced.
+	 */
+typedef struct MDB_pendbody {
+		/** The ID of the last deferred commit. It is only ahead of
+		 *	#mti_txnid while some deferred commits have not been synced.
+		 */
+	volatile txnid_t	mpb_txnid;
+		/** The meta info of the last deferred commit of either parity.
+		 *	A slot is valid if its mm_txnid is above #mti_txnid.
+		 */
+	MDB_meta	mpb_meta[NUM_METAS];
+} MDB_pendbody;
+
+	/** The actual reader table definition. */
+typedef struct MDB_txninfo {
+	union {
+		MDB_txbody mtb;
+#define mti_magic	mt1.mtb.mtb_magic
+#define mti_format	mt1.mtb.mtb_format
+#define mti_rmutex	mt1.mtb.mtb_rmutex
+#define mti_rmname	mt1.mtb.mtb_rmname
+#define mti_txnid	mt1.mtb.mtb_txnid
+#define mti_numreaders	mt1.mtb.mtb_numreaders
+#define mti_rfree	mt1.mtb.mtb_rfree
+		char pad[(sizeof(MDB_txbody)+CACHELINE-1) & ~(CACHELINE-1)];
+	} mt1;
+	union {
+#if defined(_WIN32) || defined(MDB_USE_POSIX_SEM)
+		char mt2_wmname[MNAME_LEN];
+#define	mti_wmname	mt2.mt2_wmname
+#else
+		mdb_mutex_t	mt2_wmutex;
+#define mti_wmutex	mt2.mt2_wmutex
+#endif
+		char pad[(MNAME_LEN+CACHELINE-1) & ~(CACHELINE-1)];
+	} mt2;
+	union {
+		MDB_pendbody mt3_pend;
+#define mti_ptxnid	mt3.mt3_pend.mpb_txnid
+#define mti_pmeta	mt3.mt3_pend.mpb_meta
+		char pad[(sizeof(MDB_pendbody)+CACHELINE-1) & ~(CACHELINE-1)];
+	} mt3;
+	MDB_reader	mti_readers[1];
+} MDB_txninfo;
+
+	/** Lockfile format signature: version, features and field layout */
+#define MDB_LOCK_FORMAT \
+	((uint32_t) \
+	 ((MDB_LOCK_VERSION) \
+	  /* Flags which describe functionality */ \
+	  + (((MDB_PIDLOCK) != 0) << 16) \
+	  + (((MDB_RSLOT_CAS) != 0) << 17)))
+
 	/** Auxiliary DB info.
 	 *	The information here is mostly static/read-only. There is
 	 *	only a single copy of this record in the environment.
@@ -1073,6 +1129,7 @@ typedef struct MDB_dbx {
 	MDB_cmp_func	*md_dcmp;	/**< function for comparing data items */
 	MDB_rel_func	*md_rel;	/**< user relocate function */
 	void		*md_relctx;		/**< user-provided context for md_rel */
+	int			md_pinned;		/**< branch pages are locked, see #mdb_set_pinned() */
 } MDB_dbx;
 
 	/** A database transaction.
@@ -1141,8 +1198,9 @@ struct MDB_txn {
  *	@{
  */
 	/** #mdb_txn_begin() flags */
-#define MDB_TXN_BEGIN_FLAGS	MDB_RDONLY
+#define MDB_TXN_BEGIN_FLAGS	(MDB_RDONLY|MDB_DEFERSYNC)
 #define MDB_TXN_RDONLY		MDB_RDONLY	/**< read-only transaction */
+#define MDB_TXN_DEFERSYNC	MDB_DEFERSYNC	/**< commit without syncing */
 	/* internal txn flags */
 #define MDB_TXN_WRITEMAP	MDB_WRITEMAP	/**< copy of #MDB_env flag in writers */
 #define MDB_TXN_FINISHED	0x01		/**< txn is finished or never began */
@@ -1250,6 +1308,8 @@ typedef struct MDB_xcursor {
 typedef struct MDB_pgstate {
 	pgno_t		*mf_pghead;	/**< Reclaimed freeDB pages, or NULL before use */
 	txnid_t		mf_pglast;	/**< ID of last used record, or 0 if !mf_pghead */
+	/** No run of this many contiguous pages in mf_pghead, or 0 if unknown */
+	unsigned	mf_pgnorun;
 } MDB_pgstate;
 
 	/** The database environment. */
@@ -1292,6 +1352,7 @@ struct MDB_env {
 	MDB_pgstate	me_pgstate;		/**< state of old pages from freeDB */
 #	define		me_pglast	me_pgstate.mf_pglast
 #	define		me_pghead	me_pgstate.mf_pghead
+#	define		me_pgnorun	me_pgstate.mf_pgnorun
 	MDB_page	*me_dpages;		/**< list of malloc'd blocks for re-use */
 	/** IDL of pages that became unused in a write txn */
 	MDB_IDL		me_free_pgs;
@@ -1305,6 +1366,10 @@ struct MDB_env {
 	unsigned int	me_maxkey;	/**< max size of a key */
 #endif
 	int		me_live_reader;		/**< have liveness lock in reader table */
+	/** IDL of the branch pages locked in memory for #mdb_set_pinned() */
+	MDB_IDL		me_pinned;
+	/** The txn whose snapshot #me_pinned matches, 0 to rebuild it */
+	txnid_t		me_pintxnid;
 #ifdef _WIN32
 	int		me_pidquery;		/**< Used in OpenProcess */
 #endif
@@ -1378,6 +1443,10 @@ static int	mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata,
 static int  mdb_env_read_header(MDB_env *env, MDB_meta *meta);
 static MDB_meta *mdb_env_pick_meta(const MDB_env *env);
 static int  mdb_env_write_meta(MDB_txn *txn);
+static int  mdb_env_put_meta(MDB_env *env, MDB_meta *meta, HANDLE mfd);
+static int  mdb_env_pending(MDB_env *env, MDB_meta *pm);
+static void mdb_env_defer_meta(MDB_txn *txn);
+static int  mdb_env_sync_deferred(MDB_env *env, int force);
 #if defined(MDB_USE_POSIX_MUTEX) && !defined(MDB_ROBUST_SUPPORTED) /* Drop unused excl arg */
 # define mdb_env_close0(env, excl) mdb_env_close1(env)
 #endif
@@ -2108,6 +2177,12 @@ mdb_find_oldest(MDB_txn *txn)
 					oldest = mr;
 			}
 		}
+		/* Until deferred commits are synced, the last meta page
+		 * on disk refers to the pages they freed.
+		 */
+		mr = txn->mt_env->me_txns->mti_txnid;
+		if (oldest > mr)
+			oldest = mr;
 	}
 	return oldest;
 }
@@ -2131,6 +2206,32 @@ mdb_page_dirty(MDB_txn *txn, MDB_page *mp)
 	txn->mt_dirty_room--;
 }
 
+/** Find a run of contiguous pages in me_pghead[] that includes one of
+ * the pages just merged into it. The rest was already searched.
+ * @param[in] mop me_pghead[].
+ * @param[in] ids the merged pages, sorted like \b mop.
+ * @param[in] n2 the number of pages wanted, minus 1.
+ * @return the index of the last page of the run nearest the tail
+ * of \b mop, or 0 if none.
+ */
+static unsigned
+mdb_pghead_run(pgno_t *mop, pgno_t *ids, unsigned n2)
+{
+	unsigned i, k, t, x, found = 0, len = mop[0];
+
+	/* From the tail, so the first run found is usually the best */
+	for (i = ids[0]; i; i--) {
+		x = mdb_midl_search(mop, ids[i]);
+		if (x + n2 <= found)
+			break;
+		for (k = x; k < len && k - x < n2 && mop[k+1] == mop[k]-1; k++) ;
+		for (t = x; t > 1 && k - t < n2 && mop[t-1] == mop[t]+1; t--) ;
+		if (k - t == n2 && k > found)
+			found = k;
+	}
+	return found;
+}
+
 /** Allocate page numbers and memory for writing.  Maintain me_pglast,
  * me_pghead and mt_next_pgno.  Set #MDB_TXN_ERROR on failure.
  *
@@ -2190,24 +2291,27 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 		goto fail;
 	}
 
+	/* Seek a big enough contiguous page range. Prefer
+	 * pages at the tail, just truncating the list. Skip
+	 * the scan if an earlier one ruled out this size.
+	 */
+	if (mop_len > n2 && (!env->me_pgnorun || (unsigned)num < env->me_pgnorun)) {
+		i = mop_len;
+		do {
+			pgno = mop[i];
+			if (mop[i-n2] == pgno+n2)
+				goto search_done;
+		} while (--i > n2);
+		env->me_pgnorun = num;
+	}
+	if (mop_len > n2 && --retry < 0)
+		goto use_new;
+
 	for (op = MDB_FIRST;; op = MDB_NEXT) {
 		MDB_val key, data;
 		MDB_node *leaf;
 		pgno_t *idl;
 
-		/* Seek a big enough contiguous page range. Prefer
-		 * pages at the tail, just truncating the list.
-		 */
-		if (mop_len > n2) {
-			i = mop_len;
-			do {
-				pgno = mop[i];
-				if (mop[i-n2] == pgno+n2)
-					goto search_done;
-			} while (--i > n2);
-			if (--retry < 0)
-				break;
-		}
 
 		if (op == MDB_FIRST) {	/* 1st iteration */
 			/* Prepare to fetch more and coalesce */
@@ -2279,8 +2383,25 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 		/* Merge in descending sorted order */
 		mdb_midl_xmerge(mop, idl);
 		mop_len = mop[0];
+
+		/* Only the merged pages can complete a range. Searching
+		 * around them keeps long freeDB scans from going
+		 * quadratic in the size of me_pghead.
+		 */
+		if (mop_len > n2) {
+			i = n2 ? mdb_pghead_run(mop, idl, n2) : mop_len;
+			if (i) {
+				pgno = mop[i];
+				env->me_pgnorun = 0;
+				goto search_done;
+			}
+			env->me_pgnorun = num;
+			if (--retry < 0)
+				break;
+		}
 	}
 
+use_new:
 	/* Use new pages from the map when nothing suitable in the freeDB */
 	i = 0;
 	pgno = txn->mt_next_pgno;
@@ -2506,8 +2627,9 @@ fail:
 	return rc;
 }
 
-int
-mdb_env_sync(MDB_env *env, int force)
+/** Flush the data pages of the datafile, see #mdb_env_sync(). */
+static int
+mdb_env_sync0(MDB_env *env, int force)
 {
 	int rc = 0;
 	if (env->me_flags & MDB_RDONLY)
@@ -2536,6 +2658,18 @@ mdb_env_sync(MDB_env *env, int force)
 	return rc;
 }
 
+int
+mdb_env_sync(MDB_env *env, int force)
+{
+	MDB_txninfo *ti = env->me_txns;
+
+	if (env->me_flags & MDB_RDONLY)
+		return EACCES;
+	if (ti && ti->mti_ptxnid > ti->mti_txnid)
+		return mdb_env_sync_deferred(env, force);
+	return mdb_env_sync0(env, force);
+}
+
 /** Back up parent txn's cursors, then grab the originals for tracking */
 static int
 mdb_cursor_shadow(MDB_txn *src, MDB_txn *dst)
@@ -2669,6 +2803,96 @@ mdb_reader_pid(MDB_env *env, enum Pidlock_op op, MDB_PID_T pid)
 #endif
 }
 
+/** Claim a slot in the reader table.
+ *
+ * Free slots are claimed by compare-and-swap of their pid, starting
+ * at the #mti_rfree hint. The mutex is taken only to grow the table,
+ * to search it from the start once it is full, and for the first
+ * claim of a process. The latter keeps #mdb_reader_check0() from
+ * mistaking a new process with the pid of a dead one for the dead one:
+ * it rechecks the pid under the mutex before clearing its slots.
+ *
+ * Slots released by exiting threads do not lower the hint, so they
+ * are found again once the hint passes them or the table is full.
+ * @param[in] env The environment.
+ * @param[in] pid The pid of this process.
+ * @param[in] tid The id of this thread.
+ * @param[out] rp The claimed slot.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_reader_claim(MDB_env *env, MDB_PID_T pid, MDB_THR_T tid, MDB_reader **rp)
+{
+	MDB_txninfo *ti = env->me_txns;
+	mdb_mutexref_t rmutex = env->me_rmutex;
+	MDB_reader *r;
+	unsigned int i, nr;
+	int rc, j, first = !env->me_live_reader, locked = 0;
+
+	if (first) {
+		rc = mdb_reader_pid(env, Pidset, pid);
+		if (rc)
+			return rc;
+	}
+	if (first || !MDB_RSLOT_CAS) {
+		if (LOCK_MUTEX(rc, env, rmutex))
+			return rc;
+		locked = 1;
+	}
+
+	for (;;) {
+		nr = ti->mti_numreaders;
+		for (i = ti->mti_rfree; i < nr; i++) {
+			r = &ti->mti_readers[i];
+			if (r->mr_pid == 0 && MDB_CAS(&r->mr_pid, 0, pid))
+				goto claimed;
+		}
+		if (locked)
+			break;
+		if (LOCK_MUTEX(rc, env, rmutex))
+			return rc;
+		locked = 1;
+	}
+
+	if (nr < env->me_maxreaders) {
+		/* Only growers touch the slot past mti_numreaders,
+		 * and they hold the mutex. Publish it claimed.
+		 */
+		i = nr;
+		r = &ti->mti_readers[i];
+		r->mr_txnid = (txnid_t)-1;
+		r->mr_pid = pid;
+		MDB_MEMBAR();
+		ti->mti_numreaders = nr + 1;
+		goto claimed;
+	}
+	for (i = 0; i < nr; i++) {
+		r = &ti->mti_readers[i];
+		if (r->mr_pid == 0 && MDB_CAS(&r->mr_pid, 0, pid))
+			goto claimed;
+	}
+	UNLOCK_MUTEX(rmutex);
+	return MDB_READERS_FULL;
+
+claimed:
+	/* Until it is reset, a stale mr_txnid can only
+	 * hold back the reuse of pages.
+	 */
+	r->mr_txnid = (txnid_t)-1;
+	r->mr_tid = tid;
+	ti->mti_rfree = i + 1;
+	/* mdb_env_close() clears our slots below me_close_readers */
+	while ((j = env->me_close_readers) <= (int)i &&
+		!MDB_CAS(&env->me_close_readers, j, (int)i + 1))
+		;
+	if (locked)
+		UNLOCK_MUTEX(rmutex);
+	if (first)
+		env->me_live_reader = 1;
+	*rp = r;
+	return MDB_SUCCESS;
+}
+
 /** Common code for #mdb_txn_begin() and #mdb_txn_renew().
  * @param[in] txn the transaction handle to initialize
  * @return 0 on success, non-zero on failure.
@@ -2679,7 +2903,7 @@ mdb_txn_renew0(MDB_txn *txn)
 	MDB_env *env = txn->mt_env;
 	MDB_txninfo *ti = env->me_txns;
 	MDB_meta *meta;
-	unsigned int i, nr, flags = txn->mt_flags;
+	unsigned int i, flags = txn->mt_flags;
 	uint16_t x;
 	int rc, new_notls = 0;
 
@@ -2697,40 +2921,10 @@ mdb_txn_renew0(MDB_txn *txn)
 			} else {
 				MDB_PID_T pid = env->me_pid;
 				MDB_THR_T tid = pthread_self();
-				mdb_mutexref_t rmutex = env->me_rmutex;
-
-				if (!env->me_live_reader) {
-					rc = mdb_reader_pid(env, Pidset, pid);
-					if (rc)
-						return rc;
-					env->me_live_reader = 1;
-				}
 
-				if (LOCK_MUTEX(rc, env, rmutex))
+				rc = mdb_reader_claim(env, pid, tid, &r);
+				if (rc)
 					return rc;
-				nr = ti->mti_numreaders;
-				for (i=0; i<nr; i++)
-					if (ti->mti_readers[i].mr_pid == 0)
-						break;
-				if (i == env->me_maxreaders) {
-					UNLOCK_MUTEX(rmutex);
-					return MDB_READERS_FULL;
-				}
-				r = &ti->mti_readers[i];
-				/* Claim the reader slot, carefully since other code
-				 * uses the reader table un-mutexed: First reset the
-				 * slot, next publish it in mti_numreaders.  After
-				 * that, it is safe for mdb_env_close() to touch it.
-				 * When it will be closed, we can finally claim it.
-				 */
-				r->mr_pid = 0;
-				r->mr_txnid = (txnid_t)-1;
-				r->mr_tid = tid;
-				if (i == nr)
-					ti->mti_numreaders = ++nr;
-				env->me_close_readers = nr;
-				r->mr_pid = pid;
-				UNLOCK_MUTEX(rmutex);
 
 				new_notls = (env->me_flags & MDB_NOTLS);
 				if (!new_notls && (rc=pthread_setspecific(env->me_txkey, r))) {
@@ -2753,6 +2947,11 @@ mdb_txn_renew0(MDB_txn *txn)
 				return rc;
 			txn->mt_txnid = ti->mti_txnid;
 			meta = env->me_metas[txn->mt_txnid & 1];
+			if (ti->mti_ptxnid > txn->mt_txnid) {
+				/* build on the last deferred commit */
+				txn->mt_txnid = ti->mti_ptxnid;
+				meta = &ti->mti_pmeta[txn->mt_txnid & 1];
+			}
 		} else {
 			meta = mdb_env_pick_meta(env);
 			txn->mt_txnid = meta->mm_txnid;
@@ -2831,6 +3030,11 @@ mdb_txn_begin(MDB_env *env, MDB_txn *parent, unsigned int flags, MDB_txn **ret)
 
 	flags &= MDB_TXN_BEGIN_FLAGS;
 	flags |= env->me_flags & MDB_WRITEMAP;
+	/* Deferred meta pages need the lock file, and a writemap
+	 * would have to msync the whole map to honor them.
+	 */
+	if ((flags & (MDB_RDONLY|MDB_WRITEMAP)) || !env->me_txns)
+		flags &= ~MDB_DEFERSYNC;
 
 	if (env->me_flags & MDB_RDONLY & ~flags) /* write txn in RDONLY env */
 		return EACCES;
@@ -2993,7 +3197,11 @@ mdb_txn_end(MDB_txn *txn, unsigned mode)
 			if (!(env->me_flags & MDB_NOTLS)) {
 				txn->mt_u.reader = NULL; /* txn does not own reader */
 			} else if (mode & MDB_END_SLOT) {
-				txn->mt_u.reader->mr_pid = 0;
+				MDB_reader *r = txn->mt_u.reader;
+				unsigned int i = r - env->me_txns->mti_readers;
+				r->mr_pid = 0;
+				if (i < env->me_txns->mti_rfree)
+					env->me_txns->mti_rfree = i;
 				txn->mt_u.reader = NULL;
 			} /* else txn owns the slot until it does MDB_END_SLOT */
 		}
@@ -3018,6 +3226,7 @@ mdb_txn_end(MDB_txn *txn, unsigned mode)
 			/* me_pgstate: */
 			env->me_pghead = NULL;
 			env->me_pglast = 0;
+			env->me_pgnorun = 0;
 
 			env->me_txn = NULL;
 			mode = 0;	/* txn == env->me_txn0, do not free() it */
@@ -3254,6 +3463,7 @@ mdb_freelist_save(MDB_txn *txn)
 		loose[0] = count;
 		mdb_midl_sort(loose);
 		mdb_midl_xmerge(mop, loose);
+		env->me_pgnorun = 0;
 		txn->mt_loose_pgs = NULL;
 		txn->mt_loose_count = 0;
 		mop_len = mop[0];
@@ -3441,12 +3651,218 @@ done:
 	return MDB_SUCCESS;
 }
 
+#ifdef _WIN32
+#define MDB_MLOCK(addr, len)	(VirtualLock(addr, len) ? 0 : ErrCode())
+#define MDB_MUNLOCK(addr, len)	VirtualUnlock(addr, len)
+#else
+#define MDB_MLOCK(addr, len)	(mlock(addr, len) ? ErrCode() : 0)
+#define MDB_MUNLOCK(addr, len)	munlock(addr, len)
+#endif
+
+/** Check if a page was written by a write txn. */
+static int
+mdb_page_written(MDB_txn *txn, pgno_t pgno)
+{
+	MDB_ID2L dl = txn->mt_u.dirty_list;
+	MDB_IDL sl = txn->mt_spill_pgs;
+	unsigned x;
+
+	x = mdb_mid2l_search(dl, pgno);
+	if (x <= dl[0].mid && dl[x].mid == pgno)
+		return 1;
+	if (sl) {
+		x = mdb_midl_search(sl, pgno << 1);
+		if (x <= sl[0] && sl[x] == (pgno << 1))
+			return 1;
+	}
+	return 0;
+}
+
+/** Add the branch pages of a tree to an IDL.
+ * @param[in] mc A cursor to get pages with.
+ * @param[in] pgno The root of the tree.
+ * @param[in] depth The depth of the tree.
+ * @param[in] full If zero, only descend into pages written by this txn.
+ * @param[in,out] pins The IDL.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_pin_walk(MDB_cursor *mc, pgno_t pgno, unsigned int depth, int full,
+	MDB_IDL *pins)
+{
+	MDB_page *mp;
+	pgno_t child;
+	unsigned int i;
+	int rc;
+
+	if (depth < 2)
+		return MDB_SUCCESS;
+	if ((rc = mdb_page_get(mc, pgno, &mp, NULL)) != 0)
+		return rc;
+	if (!IS_BRANCH(mp))
+		return MDB_CORRUPTED;
+	if ((rc = mdb_midl_append(pins, pgno)) != 0)
+		return rc;
+	for (i = 0; i < NUMKEYS(mp); i++) {
+		child = NODEPGNO(NODEPTR(mp, i));
+		if (!full && !mdb_page_written(mc->mc_txn, child))
+			continue;
+		if ((rc = mdb_pin_walk(mc, child, depth-1, full, pins)) != 0)
+			return rc;
+	}
+	return MDB_SUCCESS;
+}
+
+/** Find the branch pages of the pinned DBs in the snapshot of a txn.
+ *
+ * If #me_pinned matches the snapshot before a write txn, it is only
+ * brought up to date: the pages this txn freed are dropped, and only
+ * pages this txn wrote are walked. Otherwise all the trees are walked.
+ * A write txn must call this after its last change, before its dirty
+ * pages are flushed.
+ * @param[in] txn The txn.
+ * @param[out] ret The new sorted IDL for #mdb_pin_apply(), or NULL if
+ *	nothing is or was pinned.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_pin_collect(MDB_txn *txn, MDB_IDL *ret)
+{
+	MDB_env *env = txn->mt_env;
+	MDB_IDL pins, old = env->me_pinned, freed = txn->mt_free_pgs;
+	MDB_cursor mc;
+	MDB_xcursor mx;
+	MDB_dbi dbi;
+	unsigned int i, j;
+	int full, rc = MDB_SUCCESS;
+
+	*ret = NULL;
+	for (dbi = MAIN_DBI; dbi < txn->mt_numdbs; dbi++)
+		if (txn->mt_dbxs[dbi].md_pinned)
+			break;
+	if (dbi == txn->mt_numdbs && !(old && old[0]))
+		return MDB_SUCCESS;
+
+	full = !old || (txn->mt_flags & MDB_TXN_RDONLY) ||
+		env->me_pintxnid != txn->mt_txnid - 1;
+	if (!(pins = mdb_midl_alloc(full || !old[0] ? MDB_IDL_UM_MAX : old[0])))
+		return ENOMEM;
+	if (!full) {
+		for (i = 1; i <= old[0]; i++) {
+			j = mdb_midl_search(freed, old[i]);
+			if (j <= freed[0] && freed[j] == old[i])
+				continue;
+			pins[++pins[0]] = old[i];
+		}
+	}
+
+	for (; dbi < txn->mt_numdbs; dbi++) {
+		if (!txn->mt_dbxs[dbi].md_pinned)
+			continue;
+		if (!full && !(txn->mt_dbflags[dbi] & DB_DIRTY))
+			continue;
+		if (TXN_DBI_CHANGED(txn, dbi)) {
+			rc = MDB_BAD_DBI;
+			break;
+		}
+		/* this loads the root of a stale DB */
+		mdb_cursor_init(&mc, txn, dbi, &mx);
+		if (txn->mt_dbs[dbi].md_root == P_INVALID)
+			continue;
+		if (!full && !mdb_page_written(txn, txn->mt_dbs[dbi].md_root))
+			continue;
+		rc = mdb_pin_walk(&mc, txn->mt_dbs[dbi].md_root,
+			txn->mt_dbs[dbi].md_depth, full, &pins);
+		if (rc)
+			break;
+	}
+	if (rc) {
+		mdb_midl_free(pins);
+		return rc;
+	}
+
+	mdb_midl_sort(pins);
+	for (i = j = 1; i <= pins[0]; i++)
+		if (j == 1 || pins[i] != pins[j-1])
+			pins[j++] = pins[i];
+	pins[0] = j - 1;
+	*ret = pins;
+	return MDB_SUCCESS;
+}
+
+/** Lock or unlock a run of pages in memory. */
+static int
+mdb_pin_run(MDB_env *env, pgno_t pgno, pgno_t count, int lock)
+{
+	char *addr = env->me_map + pgno * env->me_psize;
+	size_t len = count * env->me_psize;
+
+	if (!count)
+		return MDB_SUCCESS;
+	if (!lock) {
+		MDB_MUNLOCK(addr, len);
+		return MDB_SUCCESS;
+	}
+	return MDB_MLOCK(addr, len);
+}
+
+/** Replace #me_pinned by an IDL from #mdb_pin_collect(), locking
+ * pages which are new and unlocking those which are gone.
+ * @param[in] env The environment.
+ * @param[in] pins The new IDL. It is freed or taken over.
+ * @param[in] txnid The txn whose snapshot it matches.
+ * @return 0, or the first error from locking pages.
+ */
+static int
+mdb_pin_apply(MDB_env *env, MDB_IDL pins, txnid_t txnid)
+{
+	MDB_IDL old = env->me_pinned;
+	unsigned int i = 1, j = 1, n = old ? old[0] : 0;
+	pgno_t lo[2] = {0, 0}, cnt[2] = {0, 0}, pg;
+	int lock, rc = MDB_SUCCESS, rc2;
+
+	/* Both are sorted in descending order, so runs grow down */
+	while (i <= n || j <= pins[0]) {
+		if (j > pins[0] || (i <= n && old[i] > pins[j])) {
+			pg = old[i++];
+			lock = 0;
+		} else if (i > n || pins[j] > old[i]) {
+			pg = pins[j++];
+			lock = 1;
+		} else {
+			i++;
+			j++;
+			continue;
+		}
+		if (cnt[lock] && pg + 1 == lo[lock]) {
+			lo[lock] = pg;
+			cnt[lock]++;
+			continue;
+		}
+		rc2 = mdb_pin_run(env, lo[lock], cnt[lock], lock);
+		if (!rc)
+			rc = rc2;
+		lo[lock] = pg;
+		cnt[lock] = 1;
+	}
+	mdb_pin_run(env, lo[0], cnt[0], 0);
+	rc2 = mdb_pin_run(env, lo[1], cnt[1], 1);
+	if (!rc)
+		rc = rc2;
+
+	mdb_midl_free(old);
+	env->me_pinned = pins;
+	env->me_pintxnid = txnid;
+	return rc;
+}
+
 int
 mdb_txn_commit(MDB_txn *txn)
 {
 	int		rc;
 	unsigned int i, end_mode;
 	MDB_env	*env;
+	MDB_IDL	pins = NULL;
 
 	if (txn == NULL)
 		return EINVAL;
@@ -3614,8 +4030,12 @@ mdb_txn_commit(MDB_txn *txn)
 	mdb_cursors_close(txn, 0);
 
 	if (!txn->mt_u.dirty_list[0].mid &&
-		!(txn->mt_flags & (MDB_TXN_DIRTY|MDB_TXN_SPILLS)))
+		!(txn->mt_flags & (MDB_TXN_DIRTY|MDB_TXN_SPILLS))) {
+		/* Nothing to write, but mdb_set_pinned() may wait for us */
+		if (!env->me_pintxnid && !mdb_pin_collect(txn, &pins) && pins)
+			mdb_pin_apply(env, pins, txn->mt_txnid - 1);
 		goto done;
+	}
 
 	DPRINTF(("committing txn %"Z"u %p on mdbenv %p, root page %"Z"u",
 	    txn->mt_txnid, (void*)txn, (void*)env, txn->mt_dbs[MAIN_DBI].md_root));
@@ -3647,6 +4067,12 @@ mdb_txn_commit(MDB_txn *txn)
 	if (rc)
 		goto fail;
 
+	/* Pages are only pinned on a best effort basis,
+	 * a failure here just means a full walk next time.
+	 */
+	if (mdb_pin_collect(txn, &pins))
+		env->me_pintxnid = 0;
+
 	mdb_midl_free(env->me_pghead);
 	env->me_pghead = NULL;
 	mdb_midl_shrink(&txn->mt_free_pgs);
@@ -3655,17 +4081,26 @@ mdb_txn_commit(MDB_txn *txn)
 	mdb_audit(txn);
 #endif
 
-	if ((rc = mdb_page_flush(txn, 0)) ||
-		(rc = mdb_env_sync(env, 0)) ||
-		(rc = mdb_env_write_meta(txn)))
+	if ((rc = mdb_page_flush(txn, 0)))
 		goto fail;
+	if ((txn->mt_flags & MDB_TXN_DEFERSYNC) && !(env->me_flags & MDB_NOSYNC)) {
+		mdb_env_defer_meta(txn);
+	} else if ((rc = mdb_env_sync0(env, 0)) ||
+		(rc = mdb_env_write_meta(txn))) {
+		goto fail;
+	}
 	end_mode = MDB_END_COMMITTED|MDB_END_UPDATE;
+	if (pins) {
+		mdb_pin_apply(env, pins, txn->mt_txnid);
+		pins = NULL;
+	}
 
 done:
 	mdb_txn_end(txn, end_mode);
 	return MDB_SUCCESS;
 
 fail:
+	mdb_midl_free(pins);
 	mdb_txn_abort(txn);
 	return rc;
 }
@@ -3811,16 +4246,13 @@ static int
 mdb_env_write_meta(MDB_txn *txn)
 {
 	MDB_env *env;
-	MDB_meta	meta, metab, *mp;
+	MDB_meta	meta, pending[NUM_METAS], *mp;
 	unsigned flags;
 	size_t mapsize;
-	off_t off;
-	int rc, len, toggle;
+	int rc, toggle;
 	char *ptr;
 	HANDLE mfd;
-#ifdef _WIN32
-	OVERLAPPED ov;
-#else
+#ifndef _WIN32
 	int r2;
 #endif
 
@@ -3863,25 +4295,79 @@ mdb_env_write_meta(MDB_txn *txn)
 		}
 		goto done;
 	}
-	metab.mm_txnid = mp->mm_txnid;
-	metab.mm_last_pg = mp->mm_last_pg;
-
 	meta.mm_mapsize = mapsize;
 	meta.mm_dbs[FREE_DBI] = txn->mt_dbs[FREE_DBI];
 	meta.mm_dbs[MAIN_DBI] = txn->mt_dbs[MAIN_DBI];
 	meta.mm_last_pg = txn->mt_next_pgno - 1;
 	meta.mm_txnid = txn->mt_txnid;
 
-	off = offsetof(MDB_meta, mm_mapsize);
-	ptr = (char *)&meta + off;
-	len = sizeof(MDB_meta) - off;
-	off += (char *)mp - env->me_map;
-
 	/* Write to the SYNC fd unless MDB_NOSYNC/MDB_NOMETASYNC.
 	 * (me_mfd goes to the same file as me_fd, but writing to it
 	 * also syncs to disk.  Avoids a separate fdatasync() call.)
 	 */
 	mfd = (flags & (MDB_NOSYNC|MDB_NOMETASYNC)) ? env->me_fd : env->me_mfd;
+
+	/* Our slot may hold the current meta page, if deferred commits
+	 * went before us. Their data is synced, so write one of them to
+	 * the other slot first.
+	 */
+	if (env->me_txns && !((txn->mt_txnid ^ env->me_txns->mti_txnid) & 1) &&
+		mdb_env_pending(env, pending)) {
+		rc = mdb_env_put_meta(env, &pending[0], mfd);
+		if (rc)
+			return rc;
+	}
+	return mdb_env_put_meta(env, &meta, mfd);
+
+done:
+	/* Memory ordering issues are irrelevant; since the entire writer
+	 * is wrapped by wmutex, all of these changes will become visible
+	 * after the wmutex is unlocked. Since the DB is multi-version,
+	 * readers will get consistent data regardless of how fresh or
+	 * how stale their view of these values is.
+	 */
+	if (env->me_txns)
+		env->me_txns->mti_txnid = txn->mt_txnid;
+
+	return MDB_SUCCESS;
+
+fail:
+	env->me_flags |= MDB_FATAL_ERROR;
+	return rc;
+}
+
+/** Write a meta page to the slot of its txnid and make it current.
+ * The caller must hold the write lock and have synced the data
+ * pages it refers to.
+ * @param[in] env the environment handle
+ * @param[in] meta the meta info, with mm_mapsize and all that follows
+ * @param[in] mfd the file handle to write with
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_env_put_meta(MDB_env *env, MDB_meta *meta, HANDLE mfd)
+{
+	MDB_meta	metab, *mp;
+	off_t off;
+	int rc, len;
+	char *ptr;
+#ifdef _WIN32
+	OVERLAPPED ov;
+#else
+	int r2;
+#endif
+
+	mp = env->me_metas[meta->mm_txnid & 1];
+	DPRINTF(("writing meta page %d for root page %"Z"u",
+		(int)(meta->mm_txnid & 1), meta->mm_dbs[MAIN_DBI].md_root));
+	metab.mm_txnid = mp->mm_txnid;
+	metab.mm_last_pg = mp->mm_last_pg;
+
+	off = offsetof(MDB_meta, mm_mapsize);
+	ptr = (char *)meta + off;
+	len = sizeof(MDB_meta) - off;
+	off += (char *)mp - env->me_map;
+
 #ifdef _WIN32
 	{
 		memset(&ov, 0, sizeof(ov));
@@ -3904,8 +4390,8 @@ retry_write:
 		 * Write some old data back, to prevent it from being used.
 		 * Use the non-SYNC fd; we know it will fail anyway.
 		 */
-		meta.mm_last_pg = metab.mm_last_pg;
-		meta.mm_txnid = metab.mm_txnid;
+		meta->mm_last_pg = metab.mm_last_pg;
+		meta->mm_txnid = metab.mm_txnid;
 #ifdef _WIN32
 		memset(&ov, 0, sizeof(ov));
 		ov.Offset = off;
@@ -3914,25 +4400,115 @@ retry_write:
 		r2 = pwrite(env->me_fd, ptr, len, off);
 		(void)r2;	/* Silence warnings. We don't care about pwrite's return value */
 #endif
-fail:
 		env->me_flags |= MDB_FATAL_ERROR;
 		return rc;
 	}
 	/* MIPS has cache coherency issues, this is a no-op everywhere else */
 	CACHEFLUSH(env->me_map + off, len, DCACHE);
-done:
-	/* Memory ordering issues are irrelevant; since the entire writer
-	 * is wrapped by wmutex, all of these changes will become visible
-	 * after the wmutex is unlocked. Since the DB is multi-version,
-	 * readers will get consistent data regardless of how fresh or
-	 * how stale their view of these values is.
-	 */
+	/* As in #mdb_env_write_meta(), the wmutex orders this for writers */
 	if (env->me_txns)
-		env->me_txns->mti_txnid = txn->mt_txnid;
+		env->me_txns->mti_txnid = meta->mm_txnid;
 
 	return MDB_SUCCESS;
 }
 
+/** Copy the deferred meta pages that may be written, oldest first.
+ * A meta page must not go to the slot of #mti_txnid while readers
+ * may be picking that one up, so the first one returned always has
+ * the other parity. The caller must hold the write lock.
+ * @param[in] env the environment handle
+ * @param[out] pm array of #NUM_METAS for the meta info
+ * @return the number of meta pages copied.
+ */
+static int
+mdb_env_pending(MDB_env *env, MDB_meta *pm)
+{
+	MDB_txninfo *ti = env->me_txns;
+	txnid_t last = ti->mti_txnid;
+	int n = 0, toggle = last & 1;
+
+	if (ti->mti_ptxnid <= last || ti->mti_pmeta[toggle ^ 1].mm_txnid <= last)
+		return 0;
+	pm[n++] = ti->mti_pmeta[toggle ^ 1];
+	if (ti->mti_pmeta[toggle].mm_txnid > last)
+		pm[n++] = ti->mti_pmeta[toggle];
+	return n;
+}
+
+/** Leave the meta info of an #MDB_DEFERSYNC commit in the lock file,
+ * where the next writer picks it up. The caller holds the write lock.
+ * @param[in] txn the committing transaction
+ */
+static void
+mdb_env_defer_meta(MDB_txn *txn)
+{
+	MDB_env *env = txn->mt_env;
+	MDB_txninfo *ti = env->me_txns;
+	MDB_meta *mp = &ti->mti_pmeta[txn->mt_txnid & 1], *prev;
+	size_t mapsize;
+
+	if (ti->mti_ptxnid > ti->mti_txnid)
+		prev = &ti->mti_pmeta[ti->mti_ptxnid & 1];
+	else
+		prev = env->me_metas[ti->mti_txnid & 1];
+	mapsize = prev->mm_mapsize;
+	/* Persist any increases of mapsize config */
+	if (mapsize < env->me_mapsize)
+		mapsize = env->me_mapsize;
+
+	/* A writer dying in here leaves the slot invalid, not torn */
+	mp->mm_txnid = 0;
+	MDB_MEMBAR();
+	mp->mm_mapsize = mapsize;
+	mp->mm_dbs[FREE_DBI] = txn->mt_dbs[FREE_DBI];
+	mp->mm_dbs[MAIN_DBI] = txn->mt_dbs[MAIN_DBI];
+	mp->mm_last_pg = txn->mt_next_pgno - 1;
+	MDB_MEMBAR();
+	mp->mm_txnid = txn->mt_txnid;
+	ti->mti_ptxnid = txn->mt_txnid;
+}
+
+/** Make the #MDB_DEFERSYNC commits durable, see #mdb_env_sync().
+ * The data pages are synced without holding the write lock, so
+ * writers keep committing meanwhile. Their commits are left for
+ * the next call.
+ */
+static int
+mdb_env_sync_deferred(MDB_env *env, int force)
+{
+	MDB_txninfo *ti = env->me_txns;
+	MDB_meta pm[NUM_METAS];
+	txnid_t upto;
+	HANDLE mfd;
+	int i, n, rc;
+
+	mfd = (env->me_flags & (MDB_NOSYNC|MDB_NOMETASYNC)) ? env->me_fd : env->me_mfd;
+	if (LOCK_MUTEX(rc, env, env->me_wmutex))
+		return rc;
+	upto = ti->mti_ptxnid;
+	for (;;) {
+		n = mdb_env_pending(env, pm);
+		UNLOCK_MUTEX(env->me_wmutex);
+		/* The data pages of these commits are all written */
+		if ((rc = mdb_env_sync0(env, force)) || !n)
+			return rc;
+		if (LOCK_MUTEX(rc, env, env->me_wmutex))
+			return rc;
+		for (i=0; i<n; i++) {
+			/* Skip what a commit or another sync wrote meanwhile */
+			if (pm[i].mm_txnid <= ti->mti_txnid ||
+				!((pm[i].mm_txnid ^ ti->mti_txnid) & 1))
+				continue;
+			if ((rc = mdb_env_put_meta(env, &pm[i], mfd)))
+				break;
+		}
+		if (rc || ti->mti_txnid >= upto)
+			break;
+	}
+	UNLOCK_MUTEX(env->me_wmutex);
+	return rc;
+}
+
 /** Check both meta pages to see which one is newer.
  * @param[in] env the environment handle
  * @return newest #MDB_meta.
@@ -4041,6 +4617,12 @@ mdb_env_map(MDB_env *env, void *addr)
 #endif /* POSIX_MADV_RANDOM */
 #endif /* MADV_RANDOM */
 	}
+#ifdef MADV_HUGEPAGE
+	if (flags & MDB_HUGEPAGES) {
+		/* Only advice, the OS may not back file mappings with huge pages */
+		madvise(env->me_map, env->me_mapsize, MADV_HUGEPAGE);
+	}
+#endif
 #endif /* _WIN32 */
 
 	/* Can happen because the address argument to mmap() is just a
@@ -4071,6 +4653,8 @@ mdb_env_set_mapsize(MDB_env *env, size_t size)
 		if (env->me_txn)
 			return EINVAL;
 		meta = mdb_env_pick_meta(env);
+		if (env->me_txns && env->me_txns->mti_ptxnid > meta->mm_txnid)
+			meta = &env->me_txns->mti_pmeta[env->me_txns->mti_ptxnid & 1];
 		if (!size)
 			size = meta->mm_mapsize;
 		{
@@ -4080,6 +4664,10 @@ mdb_env_set_mapsize(MDB_env *env, size_t size)
 				size = minsize;
 		}
 		munmap(env->me_map, env->me_mapsize);
+		/* that dropped the page locks */
+		if (env->me_pinned)
+			env->me_pinned[0] = 0;
+		env->me_pintxnid = 0;
 		env->me_mapsize = size;
 		old = (env->me_flags & MDB_FIXEDMAP) ? env->me_map : NULL;
 		rc = mdb_env_map(env, old);
@@ -4560,6 +5148,8 @@ mdb_env_share_locks(MDB_env *env, int *excl)
 	MDB_meta *meta = mdb_env_pick_meta(env);
 
 	env->me_txns->mti_txnid = meta->mm_txnid;
+	/* deferred commits of earlier users were never synced */
+	env->me_txns->mti_ptxnid = 0;
 
 #ifdef _WIN32
 	{
@@ -4908,6 +5498,7 @@ mdb_env_setup_locks(MDB_env *env, MDB_name *fname, int mode, int *excl)
 		env->me_txns->mti_format = MDB_LOCK_FORMAT;
 		env->me_txns->mti_txnid = 0;
 		env->me_txns->mti_numreaders = 0;
+		env->me_txns->mti_rfree = 0;
 
 	} else {
 		if (env->me_txns->mti_magic != MDB_MAGIC) {
@@ -4951,12 +5542,141 @@ fail:
 	 */
 #define	CHANGEABLE	(MDB_NOSYNC|MDB_NOMETASYNC|MDB_MAPASYNC|MDB_NOMEMINIT)
 #define	CHANGELESS	(MDB_FIXEDMAP|MDB_NOSUBDIR|MDB_RDONLY| \
-	MDB_WRITEMAP|MDB_NOTLS|MDB_NOLOCK|MDB_NORDAHEAD)
+	MDB_WRITEMAP|MDB_NOTLS|MDB_NOLOCK|MDB_NORDAHEAD| \
+	MDB_HUGEPAGES|MDB_PREFAULT|MDB_INTERLEAVE)
 
 #if VALID_FLAGS & PERSISTENT_FLAGS & (CHANGEABLE|CHANGELESS)
 # error "Persistent DB flags & env flags overlap, but both go in mm_flags"
 #endif
 
+#if defined(__linux) && defined(SYS_get_mempolicy) && defined(SYS_set_mempolicy)
+#define MDB_MEMPOLICY	1
+#define MDB_MPOL_INTERLEAVE	3
+#define MDB_MPOL_F_MEMS_ALLOWED	4
+	/** Bits in a NUMA node mask, plus the one the kernel drops */
+#define MDB_NODEMASK_BITS	1024
+#endif
+
+	/** A page queued by #mdb_env_prefault() */
+typedef struct MDB_pfpage {
+	pgno_t		pf_pgno;
+	unsigned	pf_depth;	/**< levels from this page down to the leaves */
+	int			pf_main;	/**< page of the main DB */
+} MDB_pfpage;
+
+/** Read in the top levels of the trees, for #MDB_PREFAULT.
+ *
+ *	These are the branch pages of the free DB, the main DB and the
+ *	named DBs, plus the leaves of the main DB which hold the named DB
+ *	records. They are walked level by level, and the OS is asked to
+ *	read in each level before it is looked at, so its pages are read
+ *	in parallel. With #MDB_INTERLEAVE this thread interleaves the
+ *	memory it faults in over the NUMA nodes while walking, so pages
+ *	shared by all threads are not all on the node of the opener.
+ *	Failures are ignored, this is only a hint.
+ * @param[in] env An environment handle.
+ */
+static void ESECT
+mdb_env_prefault(MDB_env *env)
+{
+	MDB_txn *txn;
+	MDB_cursor mc;
+	MDB_page *mp;
+	MDB_node *node;
+	MDB_db *db;
+	MDB_pfpage *cur = NULL, *next = NULL, *tmp;
+	size_t ncur = 0, nnext, size = 0, i;
+	unsigned int j;
+#ifdef MDB_MEMPOLICY
+	unsigned long omask[MDB_NODEMASK_BITS / (CHAR_BIT * sizeof(long))];
+	unsigned long mask[MDB_NODEMASK_BITS / (CHAR_BIT * sizeof(long))];
+	int omode, interleaved = 0;
+
+	if ((env->me_flags & MDB_INTERLEAVE) &&
+		!syscall(SYS_get_mempolicy, &omode, omask, MDB_NODEMASK_BITS + 1, NULL, 0) &&
+		!syscall(SYS_get_mempolicy, NULL, mask, MDB_NODEMASK_BITS + 1, NULL,
+			MDB_MPOL_F_MEMS_ALLOWED) &&
+		!syscall(SYS_set_mempolicy, MDB_MPOL_INTERLEAVE, mask, MDB_NODEMASK_BITS + 1))
+		interleaved = 1;
+#endif
+
+	if (mdb_txn_begin(env, NULL, MDB_RDONLY, &txn))
+		goto done;
+	mdb_cursor_init(&mc, txn, MAIN_DBI, NULL);
+
+	size = 64;
+	if (!(cur = malloc(size * sizeof(MDB_pfpage))) ||
+		!(next = malloc(size * sizeof(MDB_pfpage))))
+		goto abort;
+	for (j = FREE_DBI; j <= MAIN_DBI; j++) {
+		db = &txn->mt_dbs[j];
+		if (db->md_root != P_INVALID) {
+			cur[ncur].pf_pgno = db->md_root;
+			cur[ncur].pf_depth = db->md_depth;
+			cur[ncur].pf_main = j == MAIN_DBI;
+			ncur++;
+		}
+	}
+
+	while (ncur) {
+#ifdef MADV_WILLNEED
+		for (i = 0; i < ncur; i++)
+			madvise(env->me_map + cur[i].pf_pgno * env->me_psize,
+				env->me_psize, MADV_WILLNEED);
+#endif
+		nnext = 0;
+		for (i = 0; i < ncur; i++) {
+			if (mdb_page_get(&mc, cur[i].pf_pgno, &mp, NULL))
+				continue;
+			if (nnext + NUMKEYS(mp) > size) {
+				size = (nnext + NUMKEYS(mp)) * 2;
+				if (!(tmp = realloc(cur, size * sizeof(MDB_pfpage))))
+					goto abort;
+				cur = tmp;
+				if (!(tmp = realloc(next, size * sizeof(MDB_pfpage))))
+					goto abort;
+				next = tmp;
+			}
+			for (j = 0; j < NUMKEYS(mp); j++) {
+				node = NODEPTR(mp, j);
+				if (IS_BRANCH(mp)) {
+					/* Leave out the leaves, but for the main DB */
+					if (cur[i].pf_depth < 3 && !cur[i].pf_main)
+						break;
+					next[nnext].pf_pgno = NODEPGNO(node);
+					next[nnext].pf_depth = cur[i].pf_depth - 1;
+					next[nnext].pf_main = cur[i].pf_main;
+					nnext++;
+				} else if (cur[i].pf_main &&
+					(node->mn_flags & (F_SUBDATA|F_DUPDATA)) == F_SUBDATA) {
+					db = (MDB_db *)NODEDATA(node);
+					if (db->md_root == P_INVALID)
+						continue;
+					next[nnext].pf_pgno = db->md_root;
+					next[nnext].pf_depth = db->md_depth;
+					next[nnext].pf_main = 0;
+					nnext++;
+				}
+			}
+		}
+		tmp = cur;
+		cur = next;
+		next = tmp;
+		ncur = nnext;
+	}
+
+abort:
+	free(cur);
+	free(next);
+	mdb_txn_abort(txn);
+done:
+#ifdef MDB_MEMPOLICY
+	if (interleaved)
+		syscall(SYS_set_mempolicy, omode, omask, MDB_NODEMASK_BITS + 1);
+#endif
+	return;
+}
+
 int ESECT
 mdb_env_open(MDB_env *env, const char *path, unsigned int flags, mdb_mode_t mode)
 {
@@ -5048,6 +5768,8 @@ mdb_env_open(MDB_env *env, const char *path, unsigned int flags, mdb_mode_t mode
 			}
 		}
 	}
+	if (!rc && (flags & MDB_PREFAULT))
+		mdb_env_prefault(env);
 
 leave:
 	if (rc) {
@@ -5080,6 +5802,7 @@ mdb_env_close0(MDB_env *env, int excl)
 	free(env->me_dirty_list);
 	free(env->me_txn0);
 	mdb_midl_free(env->me_free_pgs);
+	mdb_midl_free(env->me_pinned);
 
 	if (env->me_flags & MDB_ENV_TXKEY) {
 		pthread_key_delete(env->me_txkey);
@@ -5111,8 +5834,11 @@ mdb_env_close0(MDB_env *env, int excl)
 		 * our readers), and clear each reader atomically.
 		 */
 		for (i = env->me_close_readers; --i >= 0; )
-			if (env->me_txns->mti_readers[i].mr_pid == pid)
+			if (env->me_txns->mti_readers[i].mr_pid == pid) {
 				env->me_txns->mti_readers[i].mr_pid = 0;
+				if ((unsigned)i < env->me_txns->mti_rfree)
+					env->me_txns->mti_rfree = i;
+			}
 #ifdef _WIN32
 		if (env->me_rmutex) {
 			CloseHandle(env->me_rmutex);
@@ -5173,6 +5899,11 @@ mdb_env_close(MDB_env *env)
 	if (env == NULL)
 		return;
 
+	/* Don't leave deferred commits to the next opener */
+	if (env->me_txns && env->me_txns->mti_ptxnid > env->me_txns->mti_txnid &&
+		!(env->me_flags & (MDB_RDONLY|MDB_FATAL_ERROR)))
+		mdb_env_sync(env, 1);
+
 	VGMEMP_DESTROY(env);
 	while ((dp = env->me_dpages) != NULL) {
 		VGMEMP_DEFINED(&dp->mp_next, sizeof(dp->mp_next));
@@ -5750,6 +6481,7 @@ release:
 		while (j>i)
 			mop[j--] = pg++;
 		mop[0] += ovpages;
+		env->me_pgnorun = 0;
 	} else {
 		rc = mdb_midl_append_range(&txn->mt_free_pgs, pg, ovpages);
 		if (rc)
@@ -6548,6 +7280,8 @@ mdb_cursor_touch(MDB_cursor *mc)
 
 /** Do not spill pages to disk if txn is getting full, may fail instead */
 #define MDB_NOSPILL	0x8000
+/** Insert right after the current key, as checked by #mdb_cursor_putpos() */
+#define MDB_PUTNEXT	0x4000
 
 int
 mdb_cursor_put(MDB_cursor *mc, MDB_val *key, MDB_val *data,
@@ -6616,7 +7350,13 @@ mdb_cursor_put(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 	} else {
 		int exact = 0;
 		MDB_val d2;
-		if (flags & MDB_APPEND) {
+		if (flags & MDB_PUTNEXT) {
+			flags ^= MDB_PUTNEXT;
+			mc->mc_ki[mc->mc_top]++;
+			if (mc->mc_xcursor)
+				mc->mc_xcursor->mx_cursor.mc_flags &= ~(C_INITIALIZED|C_EOF);
+			rc = MDB_NOTFOUND;
+		} else if (flags & MDB_APPEND) {
 			MDB_val k2;
 			rc = mdb_cursor_last(mc, &k2, &d2);
 			if (rc == 0) {
@@ -7078,6 +7818,93 @@ bad_sub:
 	return rc;
 }
 
+/** Check whether a key goes right after the current cursor position.
+ * This is the case if it sorts between the current key and the next
+ * one on the page or, at the end of the page, the separator of the
+ * next leaf page. Keys of a sorted run can then be inserted without
+ * searching the tree for each of them.
+ * @param[in] mc The cursor, as left by the previous insert.
+ * @param[in] key The key to insert next.
+ * @return 0 if the key must be searched for, 1 if it goes within the
+ * current page, 2 if it goes at the end of the page, where a split
+ * may leave the preceding keys in place as for #MDB_APPEND, or 3 if
+ * that page is also the last one of the DB.
+ */
+static int
+mdb_cursor_putpos(MDB_cursor *mc, MDB_val *key)
+{
+	MDB_page *mp;
+	MDB_node *node;
+	MDB_val k2;
+	unsigned int ki;
+	int i;
+
+	if ((mc->mc_flags & (C_INITIALIZED|C_EOF|C_SUB|C_DEL)) != C_INITIALIZED)
+		return 0;
+	mp = mc->mc_pg[mc->mc_top];
+	ki = mc->mc_ki[mc->mc_top];
+	if (!IS_LEAF(mp) || ki >= NUMKEYS(mp))
+		return 0;
+
+	if (IS_LEAF2(mp)) {
+		k2.mv_size = mc->mc_db->md_pad;
+		k2.mv_data = LEAF2KEY(mp, ki, k2.mv_size);
+	} else {
+		node = NODEPTR(mp, ki);
+		MDB_GET_KEY2(node, k2);
+	}
+	if (mc->mc_dbx->md_cmp(key, &k2) <= 0)
+		return 0;
+
+	if (ki+1 < NUMKEYS(mp)) {
+		if (IS_LEAF2(mp)) {
+			k2.mv_data = LEAF2KEY(mp, ki+1, k2.mv_size);
+		} else {
+			node = NODEPTR(mp, ki+1);
+			MDB_GET_KEY2(node, k2);
+		}
+		return mc->mc_dbx->md_cmp(key, &k2) < 0;
+	}
+
+	for (i = mc->mc_top-1; i >= 0; i--) {
+		mp = mc->mc_pg[i];
+		if (mc->mc_ki[i]+1u < NUMKEYS(mp)) {
+			node = NODEPTR(mp, mc->mc_ki[i]+1);
+			MDB_GET_KEY2(node, k2);
+			return mc->mc_dbx->md_cmp(key, &k2) < 0 ? 2 : 0;
+		}
+	}
+	return 3;
+}
+
+int
+mdb_cursor_put_multiple(MDB_cursor *mc, MDB_val *key, MDB_val *data,
+    size_t *count, unsigned int flags)
+{
+	size_t i, n;
+	int rc = MDB_SUCCESS, pos;
+
+	if (mc == NULL || key == NULL || data == NULL || count == NULL)
+		return EINVAL;
+	if (flags & ~(MDB_NOOVERWRITE|MDB_NODUPDATA|MDB_RESERVE|MDB_APPEND|MDB_APPENDDUP))
+		return EINVAL;
+
+	n = *count;
+	for (i = 0; i < n; i++) {
+		pos = mdb_cursor_putpos(mc, &key[i]);
+		if (pos == 1 && !(flags & MDB_APPEND))
+			rc = mdb_cursor_put(mc, &key[i], &data[i], flags|MDB_PUTNEXT);
+		else if (pos == 3 || (pos == 2 && !(flags & MDB_APPEND)))
+			rc = mdb_cursor_put(mc, &key[i], &data[i], flags|MDB_PUTNEXT|MDB_APPEND);
+		else
+			rc = mdb_cursor_put(mc, &key[i], &data[i], flags);
+		if (rc)
+			break;
+	}
+	*count = i;
+	return rc;
+}
+
 int
 mdb_cursor_del(MDB_cursor *mc, unsigned int flags)
 {
@@ -9048,6 +9875,56 @@ mdb_put(MDB_txn *txn, MDB_dbi dbi,
 #endif
 #define MDB_EOF		0x10	/**< #mdb_env_copyfd1() is done reading */
 
+	/** Write rate limit of a copy. */
+typedef struct mdb_crate {
+	size_t cr_rate;			/**< Bytes per second, 0 for no limit */
+	size_t cr_done;			/**< Bytes written so far */
+#ifndef _WIN32
+	struct timespec cr_start;
+#endif
+} mdb_crate;
+
+	/** Account for len more bytes written by a copy.
+	 * @return the microseconds to wait to stay below the rate.
+	 */
+static unsigned long ESECT
+mdb_env_crate(mdb_crate *cr, size_t len)
+{
+#ifndef _WIN32
+	struct timespec now;
+	double due, spent;
+
+	if (!cr->cr_rate)
+		return 0;
+	if (!cr->cr_done)
+		clock_gettime(CLOCK_MONOTONIC, &cr->cr_start);
+	cr->cr_done += len;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	spent = (now.tv_sec - cr->cr_start.tv_sec) +
+		(now.tv_nsec - cr->cr_start.tv_nsec) / 1e9;
+	due = (double)cr->cr_done / cr->cr_rate;
+	if (due > spent)
+		return (unsigned long)((due - spent) * 1e6);
+#endif
+	return 0;
+}
+
+static void ESECT
+mdb_env_csleep(unsigned long usec)
+{
+#ifdef _WIN32
+	Sleep(usec / 1000);
+#else
+	struct timespec ts;
+	ts.tv_sec = usec / 1000000;
+	ts.tv_nsec = (usec % 1000000) * 1000;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+struct mdb_pcopy;
+struct mdb_cdb;
+
 	/** State needed for a double-buffering compacting copy. */
 typedef struct mdb_copy {
 	MDB_env *mc_env;
@@ -9066,8 +9943,70 @@ typedef struct mdb_copy {
 	 *	to fail the copy.  Not mutex-protected, LMDB expects atomic int.
 	 */
 	volatile int mc_error;
+	mdb_crate mc_rate;		/**< Rate limit of the writer thread */
+	/** Parallel copy this walker belongs to, or NULL. Its walkers
+	 *	write their one buffer themselves, #mc_wbuf[1] is scratch space.
+	 */
+	struct mdb_pcopy *mc_pc;
+	pgno_t mc_wpgno;		/**< Page number of #mc_wbuf[0] in a parallel copy */
+	struct mdb_cdb *mc_ovdb;	/**< Split DB whose overflow pages go to its region */
+	struct mdb_cdb *mc_subdbs;	/**< Copied named DBs, while walking the main DB */
+	unsigned mc_nsub;
+	unsigned mc_isub;		/**< Next of #mc_subdbs */
 } mdb_copy;
 
+	/** A named DB in a parallel compacting copy. */
+typedef struct mdb_cdb {
+	MDB_db cd_db;			/**< Its record, with the new root once copied */
+	pgno_t cd_root;			/**< Its root in the environment */
+	pgno_t cd_count;		/**< Pages it takes in the copy */
+	/** When split, the page counts and then the new page numbers
+	 *	of the subtrees of its root, or NULL if copied whole.
+	 */
+	pgno_t *cd_kids;
+	unsigned cd_nkids;
+	pgno_t cd_ovnext;		/**< Next page of the overflow region of a split DB */
+	pgno_t cd_ovend;		/**< End of that region */
+} mdb_cdb;
+
+	/** A piece of work of a parallel compacting copy: a whole named
+	 *	DB, or a run of subtrees of the root of a split one.
+	 */
+typedef struct mdb_cunit {
+	mdb_cdb *cu_db;
+	pgno_t cu_base;			/**< First page of the unit in the copy */
+	pgno_t cu_count;		/**< Pages in the unit, without split overflow pages */
+	unsigned cu_lo, cu_hi;	/**< Subtrees [lo,hi) of the root, when split */
+} mdb_cunit;
+
+	/** Shared state of a parallel compacting copy.
+	 *
+	 * All named DBs are counted first, since only those without
+	 * duplicates know their page count from their record. Each one
+	 * then gets its own range of page numbers, and walkers copy them
+	 * concurrently, writing at their offsets in the output. A big DB
+	 * is split below its root. Its subtrees get their own ranges,
+	 * its overflow pages are taken in turn from one shared region,
+	 * and its root is written last. The main DB is walked at the
+	 * end, after all the records of the named DBs are known.
+	 */
+typedef struct mdb_pcopy {
+	MDB_env *pc_env;
+	MDB_txn *pc_txn;
+	HANDLE pc_fd;
+	off_t pc_off;			/**< File offset of page 0 */
+	pthread_mutex_t pc_mutex;	/**< Protects #pc_next, #pc_rate, overflow regions */
+	mdb_cdb *pc_dbs;
+	unsigned pc_ndbs;
+	mdb_cunit **pc_order;	/**< Units, biggest first */
+	unsigned pc_nunits;
+	unsigned pc_next;		/**< Next DB to count, or next unit to copy */
+	int pc_phase;			/**< 0 while counting, 1 while copying */
+	pgno_t pc_split;		/**< Target pages per unit, bigger DBs are split */
+	mdb_crate pc_rate;
+	volatile int pc_error;
+} mdb_pcopy;
+
 	/** Dedicated writer thread for compacting copy. */
 static THREAD_RET ESECT CALL_CONV
 mdb_env_copythr(void *arg)
@@ -9115,6 +10054,9 @@ again:
 #endif
 				break;
 			} else if (len > 0) {
+				unsigned long wait = mdb_env_crate(&my->mc_rate, len);
+				if (wait)
+					mdb_env_csleep(wait);
 				rc = MDB_SUCCESS;
 				ptr += len;
 				wsize -= len;
@@ -9166,6 +10108,109 @@ mdb_env_cthr_toggle(mdb_copy *my, int adjust)
 	return my->mc_error;
 }
 
+#ifndef _WIN32
+	/** Write pages at their offset in the output of a parallel copy. */
+static int ESECT
+mdb_env_cpwrite(mdb_pcopy *pc, char *ptr, size_t size, pgno_t pgno)
+{
+	off_t off = pc->pc_off + (off_t)pgno * pc->pc_env->me_psize;
+	unsigned long wait;
+	ssize_t len;
+
+	while (size > 0) {
+		if (pc->pc_error)
+			return pc->pc_error;
+		len = pwrite(pc->pc_fd, ptr, size > MAX_WRITE ? MAX_WRITE : size, off);
+		if (len < 0)
+			return ErrCode();
+		if (len == 0)
+			return EIO;
+		ptr += len;
+		off += len;
+		size -= len;
+		if (pc->pc_rate.cr_rate) {
+			pthread_mutex_lock(&pc->pc_mutex);
+			wait = mdb_env_crate(&pc->pc_rate, len);
+			pthread_mutex_unlock(&pc->pc_mutex);
+			if (wait)
+				mdb_env_csleep(wait);
+		}
+	}
+	return MDB_SUCCESS;
+}
+
+	/** Write out the buffer of a walker of a parallel copy. */
+static int ESECT
+mdb_env_cpflush(mdb_copy *my)
+{
+	unsigned int psize = my->mc_env->me_psize;
+	int rc = MDB_SUCCESS;
+
+	if (my->mc_wlen[0]) {
+		rc = mdb_env_cpwrite(my->mc_pc, my->mc_wbuf[0], my->mc_wlen[0],
+			my->mc_wpgno);
+		my->mc_wpgno += my->mc_wlen[0] / psize;
+		my->mc_wlen[0] = 0;
+	}
+	if (my->mc_olen[0]) {
+		if (!rc)
+			rc = mdb_env_cpwrite(my->mc_pc, my->mc_over[0], my->mc_olen[0],
+				my->mc_wpgno);
+		my->mc_wpgno += my->mc_olen[0] / psize;
+		my->mc_olen[0] = 0;
+	}
+	if (rc)
+		my->mc_error = rc;
+	return rc;
+}
+
+	/** Copy an overflow page to the region of a split DB.
+	 * @param[in] my walker of a parallel copy.
+	 * @param[in] omp the overflow page.
+	 * @param[out] pgno its page number in the copy.
+	 */
+static int ESECT
+mdb_env_cpover(mdb_copy *my, MDB_page *omp, pgno_t *pgno)
+{
+	mdb_pcopy *pc = my->mc_pc;
+	mdb_cdb *cd = my->mc_ovdb;
+	unsigned int psize = my->mc_env->me_psize;
+	MDB_page *mo = (MDB_page *)my->mc_wbuf[1];
+	pgno_t pg;
+	int rc = MDB_SUCCESS;
+
+	pthread_mutex_lock(&pc->pc_mutex);
+	pg = cd->cd_ovnext;
+	if (cd->cd_ovend - pg < omp->mp_pages)
+		rc = MDB_INCOMPATIBLE;	/* page leak or corrupt DB */
+	else
+		cd->cd_ovnext += omp->mp_pages;
+	pthread_mutex_unlock(&pc->pc_mutex);
+	if (rc)
+		return rc;
+
+	memcpy(mo, omp, psize);
+	mo->mp_pgno = pg;
+	rc = mdb_env_cpwrite(pc, (char *)mo, psize, pg);
+	if (!rc && omp->mp_pages > 1)
+		rc = mdb_env_cpwrite(pc, (char *)omp + psize,
+			(size_t)psize * (omp->mp_pages - 1), pg + 1);
+	*pgno = pg;
+	return rc;
+}
+#endif
+
+	/** Hand off the full buffer of a compacting copy walker. */
+static int ESECT
+mdb_env_cnext(mdb_copy *my)
+{
+#ifndef _WIN32
+	if (my->mc_pc)
+		return mdb_env_cpflush(my);
+#endif
+	return mdb_env_cthr_toggle(my, 1);
+}
+
 	/** Depth-first tree traversal for compacting copy.
 	 * @param[in] my control structure.
 	 * @param[in,out] pg database root.
@@ -9232,12 +10277,21 @@ mdb_env_cwalk(mdb_copy *my, pgno_t *pg, int flags)
 						}
 
 						memcpy(&pg, NODEDATA(ni), sizeof(pg));
-						memcpy(NODEDATA(ni), &my->mc_next_pgno, sizeof(pgno_t));
 						rc = mdb_page_get(&mc, pg, &omp, NULL);
 						if (rc)
 							goto done;
+#ifndef _WIN32
+						if (my->mc_ovdb) {
+							rc = mdb_env_cpover(my, omp, &pg);
+							if (rc)
+								goto done;
+							memcpy(NODEDATA(ni), &pg, sizeof(pgno_t));
+							continue;
+						}
+#endif
+						memcpy(NODEDATA(ni), &my->mc_next_pgno, sizeof(pgno_t));
 						if (my->mc_wlen[toggle] >= MDB_WBUF) {
-							rc = mdb_env_cthr_toggle(my, 1);
+							rc = mdb_env_cnext(my);
 							if (rc)
 								goto done;
 							toggle = my->mc_toggle;
@@ -9250,7 +10304,7 @@ mdb_env_cwalk(mdb_copy *my, pgno_t *pg, int flags)
 						if (omp->mp_pages > 1) {
 							my->mc_olen[toggle] = my->mc_env->me_psize * (omp->mp_pages - 1);
 							my->mc_over[toggle] = (char *)omp + my->mc_env->me_psize;
-							rc = mdb_env_cthr_toggle(my, 1);
+							rc = mdb_env_cnext(my);
 							if (rc)
 								goto done;
 							toggle = my->mc_toggle;
@@ -9266,6 +10320,16 @@ mdb_env_cwalk(mdb_copy *my, pgno_t *pg, int flags)
 							ni = NODEPTR(mp, i);
 						}
 
+						if (my->mc_subdbs) {
+							/* A named DB, already copied */
+							if (my->mc_isub >= my->mc_nsub) {
+								rc = MDB_INCOMPATIBLE;
+								goto done;
+							}
+							memcpy(NODEDATA(ni), &my->mc_subdbs[my->mc_isub++].cd_db,
+								sizeof(db));
+							continue;
+						}
 						memcpy(&db, NODEDATA(ni), sizeof(db));
 						my->mc_toggle = toggle;
 						rc = mdb_env_cwalk(my, &db.md_root, ni->mn_flags & F_DUPDATA);
@@ -9301,7 +10365,7 @@ again:
 			}
 		}
 		if (my->mc_wlen[toggle] >= MDB_WBUF) {
-			rc = mdb_env_cthr_toggle(my, 1);
+			rc = mdb_env_cnext(my);
 			if (rc)
 				goto done;
 			toggle = my->mc_toggle;
@@ -9328,7 +10392,7 @@ done:
 
 	/** Copy environment with compaction. */
 static int ESECT
-mdb_env_copyfd1(MDB_env *env, HANDLE fd)
+mdb_env_copyfd1(MDB_env *env, HANDLE fd, size_t rate)
 {
 	MDB_meta *mm;
 	MDB_page *mp;
@@ -9375,6 +10439,7 @@ mdb_env_copyfd1(MDB_env *env, HANDLE fd)
 	my.mc_next_pgno = NUM_METAS;
 	my.mc_env = env;
 	my.mc_fd = fd;
+	my.mc_rate.cr_rate = rate;
 	rc = THREAD_CREATE(thr, mdb_env_copythr, &my);
 	if (rc)
 		goto done;
@@ -9459,10 +10524,12 @@ done2:
 
 	/** Copy environment as-is. */
 static int ESECT
-mdb_env_copyfd0(MDB_env *env, HANDLE fd)
+mdb_env_copyfd0(MDB_env *env, HANDLE fd, size_t rate)
 {
 	MDB_txn *txn = NULL;
 	mdb_mutexref_t wmutex = NULL;
+	mdb_crate cr = {0};
+	unsigned long wait;
 	int rc;
 	size_t wsize, w3;
 	char *ptr;
@@ -9532,6 +10599,7 @@ mdb_env_copyfd0(MDB_env *env, HANDLE fd)
 			w3 = fsize;
 	}
 	wsize = w3 - wsize;
+	cr.cr_rate = rate;
 	while (wsize > 0) {
 		if (wsize > MAX_WRITE)
 			w2 = MAX_WRITE;
@@ -9545,6 +10613,8 @@ mdb_env_copyfd0(MDB_env *env, HANDLE fd)
 			rc = MDB_SUCCESS;
 			ptr += len;
 			wsize -= len;
+			if ((wait = mdb_env_crate(&cr, len)) != 0)
+				mdb_env_csleep(wait);
 			continue;
 		} else {
 			rc = EIO;
@@ -9557,13 +10627,429 @@ leave:
 	return rc;
 }
 
-int ESECT
-mdb_env_copyfd2(MDB_env *env, HANDLE fd, unsigned int flags)
-{
-	if (flags & MDB_CP_COMPACT)
-		return mdb_env_copyfd1(env, fd);
-	else
-		return mdb_env_copyfd0(env, fd);
+#ifndef _WIN32
+	/** Count the pages under page pg for a parallel copy.
+	 * @param[in] mc cursor for the read txn.
+	 * @param[in] pg the page.
+	 * @param[in] depth levels from pg down to the leaves, 1 for a leaf.
+	 * @param[in] dups nonzero to count the sub-DBs of a dupsort DB too.
+	 *	Otherwise the leaves are not read.
+	 * @param[in,out] count accumulated page count.
+	 */
+static int ESECT
+mdb_env_ccount(MDB_cursor *mc, pgno_t pg, int depth, int dups, pgno_t *count)
+{
+	MDB_page *mp;
+	MDB_node *ni;
+	MDB_db db;
+	unsigned i, n;
+	int rc;
+
+	if (depth <= 1 && !dups) {
+		(*count)++;
+		return MDB_SUCCESS;
+	}
+	rc = mdb_page_get(mc, pg, &mp, NULL);
+	if (rc)
+		return rc;
+	(*count)++;
+	n = NUMKEYS(mp);
+	if (IS_LEAF(mp)) {
+		if (!dups || IS_LEAF2(mp))
+			return MDB_SUCCESS;
+		for (i=0; i<n; i++) {
+			ni = NODEPTR(mp, i);
+			if ((ni->mn_flags & (F_SUBDATA|F_DUPDATA)) == (F_SUBDATA|F_DUPDATA)) {
+				memcpy(&db, NODEDATA(ni), sizeof(db));
+				*count += db.md_branch_pages + db.md_leaf_pages +
+					db.md_overflow_pages;
+			}
+		}
+		return MDB_SUCCESS;
+	}
+	if (depth <= 1)
+		return MDB_CORRUPTED;
+	for (i=0; i<n; i++) {
+		rc = mdb_env_ccount(mc, NODEPGNO(NODEPTR(mp, i)), depth-1, dups, count);
+		if (rc)
+			break;
+	}
+	return rc;
+}
+
+	/** Count the pages of a named DB, and decide whether to split it. */
+static int ESECT
+mdb_env_cpcount(mdb_pcopy *pc, mdb_cdb *cd)
+{
+	MDB_db *db = &cd->cd_db;
+	MDB_cursor mc = {0};
+	MDB_page *mp;
+	pgno_t sum;
+	unsigned i;
+	int rc;
+
+	cd->cd_root = db->md_root;
+	cd->cd_count = 0;
+	if (db->md_root == P_INVALID)
+		return MDB_SUCCESS;
+	mc.mc_txn = pc->pc_txn;
+	/* The sub-DBs of duplicates are not in the DB's counts */
+	if (db->md_flags & MDB_DUPSORT)
+		return mdb_env_ccount(&mc, db->md_root, db->md_depth, 1, &cd->cd_count);
+
+	cd->cd_count = db->md_branch_pages + db->md_leaf_pages +
+		db->md_overflow_pages;
+	if (cd->cd_count <= pc->pc_split || db->md_depth < 2)
+		return MDB_SUCCESS;
+
+	rc = mdb_page_get(&mc, db->md_root, &mp, NULL);
+	if (rc)
+		return rc;
+	if (!IS_BRANCH(mp))
+		return MDB_CORRUPTED;
+	cd->cd_nkids = NUMKEYS(mp);
+	cd->cd_kids = calloc(cd->cd_nkids, sizeof(pgno_t));
+	if (!cd->cd_kids)
+		return ENOMEM;
+	sum = 1 + db->md_overflow_pages;
+	for (i=0; i<cd->cd_nkids; i++) {
+		rc = mdb_env_ccount(&mc, NODEPGNO(NODEPTR(mp, i)), db->md_depth - 1,
+			0, &cd->cd_kids[i]);
+		if (rc)
+			return rc;
+		sum += cd->cd_kids[i];
+	}
+	if (sum != cd->cd_count)
+		return MDB_INCOMPATIBLE;	/* page leak or corrupt DB */
+	return MDB_SUCCESS;
+}
+
+	/** Copy one unit of a parallel copy. */
+static int ESECT
+mdb_env_cpunit(mdb_copy *my, mdb_cunit *cu)
+{
+	mdb_cdb *cd = cu->cu_db;
+	MDB_cursor mc = {0};
+	MDB_page *mp;
+	pgno_t pg;
+	unsigned j;
+	int rc;
+
+	my->mc_next_pgno = my->mc_wpgno = cu->cu_base;
+	my->mc_wlen[0] = my->mc_olen[0] = 0;
+	if (!cd->cd_kids) {
+		my->mc_ovdb = NULL;
+		rc = mdb_env_cwalk(my, &cd->cd_db.md_root, 0);
+	} else {
+		my->mc_ovdb = cd;
+		mc.mc_txn = my->mc_txn;
+		rc = mdb_page_get(&mc, cd->cd_root, &mp, NULL);
+		for (j = cu->cu_lo; j < cu->cu_hi && !rc; j++) {
+			pg = NODEPGNO(NODEPTR(mp, j));
+			rc = mdb_env_cwalk(my, &pg, 0);
+			cd->cd_kids[j] = pg;
+		}
+	}
+	if (!rc)
+		rc = mdb_env_cpflush(my);
+	if (!rc && my->mc_next_pgno != cu->cu_base + cu->cu_count)
+		rc = MDB_INCOMPATIBLE;	/* page leak or corrupt DB */
+	return rc;
+}
+
+	/** Walker thread of a parallel copy. */
+static THREAD_RET ESECT CALL_CONV
+mdb_env_cpthr(void *arg)
+{
+	mdb_copy *my = arg;
+	mdb_pcopy *pc = my->mc_pc;
+	unsigned i;
+	int rc;
+
+	while (!pc->pc_error) {
+		pthread_mutex_lock(&pc->pc_mutex);
+		i = pc->pc_next++;
+		pthread_mutex_unlock(&pc->pc_mutex);
+		if (pc->pc_phase == 0) {
+			if (i >= pc->pc_ndbs)
+				break;
+			rc = mdb_env_cpcount(pc, &pc->pc_dbs[i]);
+		} else {
+			if (i >= pc->pc_nunits)
+				break;
+			rc = mdb_env_cpunit(my, pc->pc_order[i]);
+		}
+		if (rc)
+			pc->pc_error = rc;
+	}
+	return (THREAD_RET)0;
+}
+
+	/** Run a phase of a parallel copy on all its walkers. */
+static int ESECT
+mdb_env_cprun(mdb_pcopy *pc, mdb_copy *mys, pthread_t *thrs, int nthr, int phase)
+{
+	int i, rc = MDB_SUCCESS;
+
+	pc->pc_phase = phase;
+	pc->pc_next = 0;
+	for (i=0; i<nthr; i++) {
+		rc = THREAD_CREATE(thrs[i], mdb_env_cpthr, &mys[i]);
+		if (rc) {
+			pc->pc_error = rc;
+			break;
+		}
+	}
+	while (--i >= 0)
+		THREAD_FINISH(thrs[i]);
+	return pc->pc_error;
+}
+
+static int
+mdb_cunit_cmp(const void *a, const void *b)
+{
+	pgno_t x = (*(mdb_cunit **)a)->cu_count, y = (*(mdb_cunit **)b)->cu_count;
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+	/** Copy environment with compaction, on several threads.
+	 *	The output must be seekable.
+	 */
+static int ESECT
+mdb_env_copyfd4(MDB_env *env, HANDLE fd, off_t off, unsigned int nthr, size_t rate)
+{
+	mdb_pcopy pc = {0};
+	mdb_copy *mys = NULL;
+	mdb_cunit *units = NULL;
+	pthread_t *thrs = NULL;
+	MDB_txn *txn = NULL;
+	MDB_cursor mc;
+	MDB_page *mp, *mo;
+	MDB_node *ni;
+	MDB_meta *mm;
+	MDB_db *maindb;
+	mdb_cdb *cd;
+	pgno_t base, sum, root;
+	unsigned i, j, n, psize = env->me_psize;
+	int rc;
+
+	rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+	if (rc)
+		return rc;
+	maindb = &txn->mt_dbs[MAIN_DBI];
+	if (maindb->md_root == P_INVALID || (maindb->md_flags & MDB_DUPSORT)) {
+		/* Nothing to share out */
+		mdb_txn_abort(txn);
+		return mdb_env_copyfd1(env, fd, rate);
+	}
+
+	if ((rc = pthread_mutex_init(&pc.pc_mutex, NULL)) != 0)
+		goto done2;
+	pc.pc_env = env;
+	pc.pc_txn = txn;
+	pc.pc_fd = fd;
+	pc.pc_off = off;
+	pc.pc_rate.cr_rate = rate;
+	pc.pc_split = txn->mt_next_pgno / (nthr * 4) + 1;
+
+	/* Find the named DBs, in the order the main DB walk will meet them */
+	pc.pc_dbs = calloc(maindb->md_entries + 1, sizeof(mdb_cdb));
+	mys = calloc(nthr, sizeof(mdb_copy));
+	thrs = calloc(nthr, sizeof(pthread_t));
+	if (!pc.pc_dbs || !mys || !thrs) {
+		rc = ENOMEM;
+		goto done;
+	}
+	mdb_cursor_init(&mc, txn, MAIN_DBI, NULL);
+	rc = mdb_page_search(&mc, NULL, MDB_PS_FIRST);
+	for (; rc == MDB_SUCCESS; rc = mdb_cursor_sibling(&mc, 1)) {
+		mp = mc.mc_pg[mc.mc_top];
+		for (i=0; i<NUMKEYS(mp); i++) {
+			ni = NODEPTR(mp, i);
+			if (!(ni->mn_flags & F_SUBDATA))
+				continue;
+			if (pc.pc_ndbs >= maindb->md_entries) {
+				rc = MDB_CORRUPTED;
+				goto done;
+			}
+			memcpy(&pc.pc_dbs[pc.pc_ndbs++].cd_db, NODEDATA(ni), sizeof(MDB_db));
+		}
+	}
+	if (rc != MDB_NOTFOUND)
+		goto done;
+
+	for (i=0; i<nthr; i++) {
+#ifdef HAVE_MEMALIGN
+		mys[i].mc_wbuf[0] = memalign(env->me_os_psize, MDB_WBUF + psize);
+		if (mys[i].mc_wbuf[0] == NULL) {
+			rc = errno;
+			goto done;
+		}
+#else
+		{
+			void *p;
+			if ((rc = posix_memalign(&p, env->me_os_psize, MDB_WBUF + psize)) != 0)
+				goto done;
+			mys[i].mc_wbuf[0] = p;
+		}
+#endif
+		mys[i].mc_wbuf[1] = mys[i].mc_wbuf[0] + MDB_WBUF;
+		mys[i].mc_env = env;
+		mys[i].mc_txn = txn;
+		mys[i].mc_fd = fd;
+		mys[i].mc_pc = &pc;
+	}
+
+	rc = mdb_env_cprun(&pc, mys, thrs, nthr, 0);
+	if (rc)
+		goto done;
+
+	/* Lay out the units */
+	n = pc.pc_ndbs;
+	for (i=0; i<pc.pc_ndbs; i++)
+		n += pc.pc_dbs[i].cd_nkids;
+	units = calloc(n, sizeof(mdb_cunit));
+	pc.pc_order = calloc(n, sizeof(mdb_cunit *));
+	if (!units || !pc.pc_order) {
+		rc = ENOMEM;
+		goto done;
+	}
+	base = NUM_METAS;
+	for (i=0; i<pc.pc_ndbs; i++) {
+		cd = &pc.pc_dbs[i];
+		if (!cd->cd_kids) {
+			if (cd->cd_count) {
+				units[pc.pc_nunits].cu_db = cd;
+				units[pc.pc_nunits].cu_base = base;
+				units[pc.pc_nunits++].cu_count = cd->cd_count;
+				base += cd->cd_count;
+			}
+			continue;
+		}
+		for (j=0; j<cd->cd_nkids; ) {
+			units[pc.pc_nunits].cu_db = cd;
+			units[pc.pc_nunits].cu_base = base;
+			units[pc.pc_nunits].cu_lo = j;
+			sum = cd->cd_kids[j++];
+			while (j < cd->cd_nkids && sum + cd->cd_kids[j] <= pc.pc_split)
+				sum += cd->cd_kids[j++];
+			units[pc.pc_nunits].cu_hi = j;
+			units[pc.pc_nunits++].cu_count = sum;
+			base += sum;
+		}
+		cd->cd_ovnext = base;
+		base += cd->cd_db.md_overflow_pages;
+		cd->cd_ovend = base;
+		cd->cd_db.md_root = base++;
+	}
+	for (i=0; i<pc.pc_nunits; i++)
+		pc.pc_order[i] = &units[i];
+	qsort(pc.pc_order, pc.pc_nunits, sizeof(mdb_cunit *), mdb_cunit_cmp);
+
+	rc = mdb_env_cprun(&pc, mys, thrs, nthr, 1);
+	if (rc)
+		goto done;
+
+	/* Point the roots of split DBs at their copied subtrees */
+	mo = (MDB_page *)mys[0].mc_wbuf[1];
+	mc.mc_txn = txn;
+	for (i=0; i<pc.pc_ndbs && !rc; i++) {
+		cd = &pc.pc_dbs[i];
+		if (!cd->cd_kids)
+			continue;
+		if (cd->cd_ovnext != cd->cd_ovend) {
+			rc = MDB_INCOMPATIBLE;	/* page leak or corrupt DB */
+			break;
+		}
+		if ((rc = mdb_page_get(&mc, cd->cd_root, &mp, NULL)) != 0)
+			break;
+		mdb_page_copy(mo, mp, psize);
+		mo->mp_pgno = cd->cd_db.md_root;
+		for (j=0; j<cd->cd_nkids; j++) {
+			ni = NODEPTR(mo, j);
+			SETPGNO(ni, cd->cd_kids[j]);
+		}
+		rc = mdb_env_cpwrite(&pc, (char *)mo, psize, mo->mp_pgno);
+	}
+	if (rc)
+		goto done;
+
+	/* Then the main DB, with the new records of the named DBs */
+	mys[0].mc_subdbs = pc.pc_dbs;
+	mys[0].mc_nsub = pc.pc_ndbs;
+	mys[0].mc_ovdb = NULL;
+	mys[0].mc_next_pgno = mys[0].mc_wpgno = base;
+	root = maindb->md_root;
+	rc = mdb_env_cwalk(&mys[0], &root, 0);
+	if (!rc)
+		rc = mdb_env_cpflush(&mys[0]);
+	if (!rc && (mys[0].mc_isub != pc.pc_ndbs ||
+		mys[0].mc_next_pgno != base + maindb->md_branch_pages +
+			maindb->md_leaf_pages + maindb->md_overflow_pages ||
+		root != mys[0].mc_next_pgno - 1))
+		rc = MDB_INCOMPATIBLE;	/* page leak or corrupt DB */
+	if (rc)
+		goto done;
+
+	/* The meta pages go last: an incomplete copy has no valid root */
+	mp = (MDB_page *)mys[0].mc_wbuf[0];
+	memset(mp, 0, NUM_METAS * psize);
+	mp->mp_pgno = 0;
+	mp->mp_flags = P_META;
+	mm = (MDB_meta *)METADATA(mp);
+	mdb_env_init_meta0(env, mm);
+	mm->mm_address = env->me_metas[0]->mm_address;
+
+	mp = (MDB_page *)(mys[0].mc_wbuf[0] + psize);
+	mp->mp_pgno = 1;
+	mp->mp_flags = P_META;
+	*(MDB_meta *)METADATA(mp) = *mm;
+	mm = (MDB_meta *)METADATA(mp);
+	mm->mm_last_pg = root;
+	mm->mm_dbs[MAIN_DBI] = *maindb;
+	mm->mm_dbs[MAIN_DBI].md_root = root;
+	mm->mm_txnid = 1;		/* use metapage 1 */
+	rc = mdb_env_cpwrite(&pc, mys[0].mc_wbuf[0], NUM_METAS * psize, 0);
+
+done:
+	for (i=0; i<nthr && mys; i++)
+		free(mys[i].mc_wbuf[0]);
+	if (pc.pc_dbs) {
+		for (i=0; i<pc.pc_ndbs; i++)
+			free(pc.pc_dbs[i].cd_kids);
+	}
+	free(pc.pc_dbs);
+	free(pc.pc_order);
+	free(units);
+	free(mys);
+	free(thrs);
+	pthread_mutex_destroy(&pc.pc_mutex);
+done2:
+	mdb_txn_abort(txn);
+	return rc;
+}
+#endif
+
+int ESECT
+mdb_env_copyfd3(MDB_env *env, HANDLE fd, unsigned int flags,
+	unsigned int threads, size_t rate)
+{
+	if (!(flags & MDB_CP_COMPACT))
+		return mdb_env_copyfd0(env, fd, rate);
+#ifndef _WIN32
+	if (threads > 1) {
+		off_t off = lseek(fd, 0, SEEK_CUR);
+		if (off != (off_t)-1)
+			return mdb_env_copyfd4(env, fd, off, threads, rate);
+	}
+#endif
+	return mdb_env_copyfd1(env, fd, rate);
+}
+
+int ESECT
+mdb_env_copyfd2(MDB_env *env, HANDLE fd, unsigned int flags)
+{
+	return mdb_env_copyfd3(env, fd, flags, 1, 0);
 }
 
 int ESECT
@@ -9574,6 +11060,13 @@ mdb_env_copyfd(MDB_env *env, HANDLE fd)
 
 int ESECT
 mdb_env_copy2(MDB_env *env, const char *path, unsigned int flags)
+{
+	return mdb_env_copy3(env, path, flags, 1, 0);
+}
+
+int ESECT
+mdb_env_copy3(MDB_env *env, const char *path, unsigned int flags,
+	unsigned int threads, size_t rate)
 {
 	int rc;
 	MDB_name fname;
@@ -9585,7 +11078,7 @@ mdb_env_copy2(MDB_env *env, const char *path, unsigned int flags)
 		mdb_fname_destroy(fname);
 	}
 	if (rc == MDB_SUCCESS) {
-		rc = mdb_env_copyfd2(env, newfd, flags);
+		rc = mdb_env_copyfd3(env, newfd, flags, threads, rate);
 		if (close(newfd) < 0 && rc == MDB_SUCCESS)
 			rc = ErrCode();
 	}
@@ -9598,6 +11091,330 @@ mdb_env_copy(MDB_env *env, const char *path)
 	return mdb_env_copy2(env, path, 0);
 }
 
+	/** Magic of the page map of a delta backup */
+#define MDB_DMAP_MAGIC	0xBEEFD1A0
+	/** Magic of a delta backup */
+#define MDB_DELTA_MAGIC	0xBEEFD17A
+#define MDB_DELTA_VERSION	1
+	/** Page number ending the pages of a delta backup */
+#define MDB_DELTA_END	((uint64_t)-1)
+
+	/** Header of a delta backup, and of the page map of a backup.
+	 *
+	 * Pages carry no txnid, so a delta holds the pages whose contents
+	 * differ from the previous backup, found by comparing a hash of
+	 * each page with the page map of that backup. The map is just the
+	 * header followed by one 64-bit hash per page.
+	 *
+	 * The pages of a delta follow its header, each one preceded by its
+	 * 64-bit page number, ended by #MDB_DELTA_END. The meta pages come
+	 * last, so that a delta which was only partly applied can simply
+	 * be applied again.
+	 */
+typedef struct MDB_dhdr {
+	uint32_t	dh_magic;
+	uint32_t	dh_version;
+	uint32_t	dh_psize;
+	uint32_t	dh_pad;
+	uint64_t	dh_base;	/**< Txn of the backup a delta applies to, 0 if none */
+	uint64_t	dh_txnid;	/**< Txn of the backup made, or described by a map */
+	uint64_t	dh_npages;	/**< Size of that backup in pages */
+} MDB_dhdr;
+
+	/** Hash a page for a delta backup */
+static uint64_t ESECT
+mdb_dpage_hash(const char *ptr, unsigned int psize)
+{
+	const uint64_t *w = (const uint64_t *)ptr;
+	uint64_t h = 0xcbf29ce484222325ULL ^ psize;
+	unsigned int i;
+
+	for (i = 0; i < psize / sizeof(uint64_t); i++) {
+		h = (h ^ w[i]) * 0x9E3779B97F4A7C15ULL;
+		h ^= h >> 32;
+	}
+	return h;
+}
+
+	/** Read exactly len bytes, #MDB_INVALID if the file ends first */
+static int ESECT
+mdb_fread_all(HANDLE fd, void *buf, size_t len)
+{
+	char *ptr = buf;
+#ifdef _WIN32
+	DWORD n;
+#else
+	ssize_t n;
+#endif
+
+	while (len > 0) {
+#ifdef _WIN32
+		if (!ReadFile(fd, ptr, len > MAX_WRITE ? MAX_WRITE : len, &n, NULL))
+			return ErrCode();
+#else
+		n = read(fd, ptr, len > MAX_WRITE ? MAX_WRITE : len);
+		if (n < 0)
+			return ErrCode();
+#endif
+		if (n == 0)
+			return MDB_INVALID;
+		ptr += n;
+		len -= n;
+	}
+	return MDB_SUCCESS;
+}
+
+	/** Write exactly len bytes, at offset off if it is not -1 */
+static int ESECT
+mdb_fwrite_all(HANDLE fd, const void *buf, size_t len, int64_t off)
+{
+	const char *ptr = buf;
+#ifdef _WIN32
+	DWORD n;
+	OVERLAPPED ov;
+#else
+	ssize_t n;
+#endif
+
+	while (len > 0) {
+#ifdef _WIN32
+		if (off >= 0) {
+			memset(&ov, 0, sizeof(ov));
+			ov.Offset = off & 0xffffffff;
+			ov.OffsetHigh = off >> 16 >> 16;
+		}
+		if (!WriteFile(fd, ptr, len > MAX_WRITE ? MAX_WRITE : len, &n,
+			off >= 0 ? &ov : NULL))
+			return ErrCode();
+#else
+		if (off >= 0)
+			n = pwrite(fd, ptr, len > MAX_WRITE ? MAX_WRITE : len, off);
+		else
+			n = write(fd, ptr, len > MAX_WRITE ? MAX_WRITE : len);
+		if (n < 0)
+			return ErrCode();
+#endif
+		if (n == 0)
+			return EIO;
+		ptr += n;
+		len -= n;
+		if (off >= 0)
+			off += n;
+	}
+	return MDB_SUCCESS;
+}
+
+int ESECT
+mdb_env_copyfd_delta(MDB_env *env, HANDLE fd, HANDLE base, HANDLE map)
+{
+	MDB_txn *txn = NULL;
+	mdb_mutexref_t wmutex = NULL;
+	MDB_dhdr bh = {0}, hdr = {0};
+	unsigned int psize = env->me_psize;
+	size_t chunk = MDB_WBUF / sizeof(uint64_t), fsize = 0, olen = 0;
+	char *metas = NULL, *out = NULL, *ptr;
+	uint64_t *ohash = NULL, *nhash = NULL, pg, n, m, i, x;
+	int rc;
+
+	if (base != INVALID_HANDLE_VALUE) {
+		rc = mdb_fread_all(base, &bh, sizeof(bh));
+		if (rc)
+			return rc;
+		if (bh.dh_magic != MDB_DMAP_MAGIC || bh.dh_version != MDB_DELTA_VERSION)
+			return MDB_INVALID;
+		if (bh.dh_psize != psize)
+			return MDB_INCOMPATIBLE;
+	}
+
+	metas = malloc(NUM_METAS * psize);
+	out = malloc(MDB_WBUF + sizeof(uint64_t) + psize);
+	ohash = malloc(2 * chunk * sizeof(uint64_t));
+	if (!metas || !out || !ohash) {
+		rc = ENOMEM;
+		goto leave;
+	}
+	nhash = ohash + chunk;
+
+	/* Snapshot the meta pages with writers blocked, as #mdb_env_copyfd0() */
+	rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+	if (rc)
+		goto leave;
+	if (env->me_txns) {
+		mdb_txn_end(txn, MDB_END_RESET_TMP);
+		wmutex = env->me_wmutex;
+		if (LOCK_MUTEX(rc, env, wmutex))
+			goto leave;
+		rc = mdb_txn_renew0(txn);
+		if (rc) {
+			UNLOCK_MUTEX(wmutex);
+			goto leave;
+		}
+	}
+	memcpy(metas, env->me_map, NUM_METAS * psize);
+	if (wmutex)
+		UNLOCK_MUTEX(wmutex);
+
+	if ((rc = mdb_fsize(env->me_fd, &fsize)))
+		goto leave;
+	hdr.dh_psize = psize;
+	hdr.dh_version = MDB_DELTA_VERSION;
+	hdr.dh_txnid = txn->mt_txnid;
+	hdr.dh_npages = txn->mt_next_pgno;
+	if (hdr.dh_npages > fsize / psize)
+		hdr.dh_npages = fsize / psize;
+
+	hdr.dh_magic = MDB_DMAP_MAGIC;
+	if ((rc = mdb_fwrite_all(map, &hdr, sizeof(hdr), -1)))
+		goto leave;
+	hdr.dh_magic = MDB_DELTA_MAGIC;
+	hdr.dh_base = bh.dh_txnid;
+	if ((rc = mdb_fwrite_all(fd, &hdr, sizeof(hdr), -1)))
+		goto leave;
+
+	for (pg = 0; pg < hdr.dh_npages; pg += n) {
+		n = hdr.dh_npages - pg;
+		if (n > chunk)
+			n = chunk;
+		m = 0;
+		if (pg < bh.dh_npages) {
+			m = bh.dh_npages - pg;
+			if (m > n)
+				m = n;
+			if ((rc = mdb_fread_all(base, ohash, m * sizeof(uint64_t))))
+				goto leave;
+		}
+		for (i = 0; i < n; i++) {
+			x = pg + i;
+			ptr = x < NUM_METAS ? metas + x * psize : env->me_map + x * psize;
+			nhash[i] = mdb_dpage_hash(ptr, psize);
+			/* The meta pages always go, last */
+			if (x < NUM_METAS || (i < m && ohash[i] == nhash[i]))
+				continue;
+			if (olen >= MDB_WBUF) {
+				if ((rc = mdb_fwrite_all(fd, out, olen, -1)))
+					goto leave;
+				olen = 0;
+			}
+			memcpy(out + olen, &x, sizeof(x));
+			memcpy(out + olen + sizeof(x), ptr, psize);
+			olen += sizeof(x) + psize;
+		}
+		if ((rc = mdb_fwrite_all(map, nhash, n * sizeof(uint64_t), -1)))
+			goto leave;
+	}
+	for (x = 0; x <= NUM_METAS; x++) {
+		if (olen >= MDB_WBUF) {
+			if ((rc = mdb_fwrite_all(fd, out, olen, -1)))
+				goto leave;
+			olen = 0;
+		}
+		if (x == NUM_METAS) {
+			pg = MDB_DELTA_END;
+			memcpy(out + olen, &pg, sizeof(pg));
+			olen += sizeof(pg);
+		} else {
+			memcpy(out + olen, &x, sizeof(x));
+			memcpy(out + olen + sizeof(x), metas + x * psize, psize);
+			olen += sizeof(x) + psize;
+		}
+	}
+	rc = mdb_fwrite_all(fd, out, olen, -1);
+
+leave:
+	mdb_txn_abort(txn);
+	free(ohash);
+	free(out);
+	free(metas);
+	return rc;
+}
+
+int ESECT
+mdb_env_apply_delta(const char *path, HANDLE fd, unsigned int flags)
+{
+	MDB_env dummy;
+	MDB_meta meta;
+	MDB_name fname;
+	MDB_dhdr hdr;
+	HANDLE dfd = INVALID_HANDLE_VALUE;
+	uint64_t pg;
+	char *page = NULL;
+	int rc;
+
+	if ((rc = mdb_fread_all(fd, &hdr, sizeof(hdr))))
+		return rc;
+	if (hdr.dh_magic != MDB_DELTA_MAGIC || hdr.dh_version != MDB_DELTA_VERSION ||
+		hdr.dh_psize < 256 || hdr.dh_psize > MAX_PAGESIZE)
+		return MDB_INVALID;
+
+	memset(&dummy, 0, sizeof(dummy));
+	dummy.me_flags = flags & MDB_NOSUBDIR;
+	rc = mdb_fname_init(path, dummy.me_flags, &fname);
+	if (rc)
+		return rc;
+	rc = mdb_fopen(&dummy, &fname, MDB_O_RDWR, 0644, &dfd);
+	mdb_fname_destroy(fname);
+	if (rc)
+		return rc;
+
+	/* It must be the backup the delta was made against */
+	dummy.me_fd = dfd;
+	rc = mdb_env_read_header(&dummy, &meta);
+	if (rc == ENOENT) {
+		rc = hdr.dh_base ? MDB_INCOMPATIBLE : MDB_SUCCESS;
+	} else if (rc == MDB_SUCCESS) {
+		if (!hdr.dh_base || meta.mm_txnid != hdr.dh_base ||
+			meta.mm_psize != hdr.dh_psize)
+			rc = MDB_INCOMPATIBLE;
+	}
+	if (rc)
+		goto leave;
+
+	page = malloc(hdr.dh_psize);
+	if (!page) {
+		rc = ENOMEM;
+		goto leave;
+	}
+	for (;;) {
+		if ((rc = mdb_fread_all(fd, &pg, sizeof(pg))))
+			break;
+		if (pg == MDB_DELTA_END)
+			break;
+		if (pg >= hdr.dh_npages) {
+			rc = MDB_INVALID;
+			break;
+		}
+		if ((rc = mdb_fread_all(fd, page, hdr.dh_psize)))
+			break;
+		if ((rc = mdb_fwrite_all(dfd, page, hdr.dh_psize,
+			(int64_t)pg * hdr.dh_psize)))
+			break;
+	}
+	if (rc == MDB_SUCCESS) {
+#ifdef _WIN32
+		LONG hi = (LONG)(((int64_t)hdr.dh_npages * hdr.dh_psize) >> 32);
+		if (SetFilePointer(dfd, (LONG)(hdr.dh_npages * hdr.dh_psize), &hi,
+			FILE_BEGIN) == INVALID_SET_FILE_POINTER ||
+			!SetEndOfFile(dfd))
+			rc = ErrCode();
+#else
+		if (ftruncate(dfd, (off_t)hdr.dh_npages * hdr.dh_psize) < 0)
+			rc = ErrCode();
+#endif
+	}
+#ifdef _WIN32
+	if (rc == MDB_SUCCESS && !FlushFileBuffers(dfd))
+#else
+	if (rc == MDB_SUCCESS && fsync(dfd))
+#endif
+		rc = ErrCode();
+
+leave:
+	free(page);
+	if (close(dfd) < 0 && rc == MDB_SUCCESS)
+		rc = ErrCode();
+	return rc;
+}
+
 int ESECT
 mdb_env_set_flags(MDB_env *env, unsigned int flag, int onoff)
 {
@@ -9877,6 +11694,227 @@ mdb_stat(MDB_txn *txn, MDB_dbi dbi, MDB_stat *arg)
 	return mdb_stat0(txn->mt_env, &txn->mt_dbs[dbi], arg);
 }
 
+	/** Histogram bucket of a size in #MDB_walkstat. */
+static unsigned
+mdb_walk_bucket(size_t size)
+{
+	unsigned n = 0;
+	while (size && n < MDB_WALK_BUCKETS-1) {
+		size >>= 1;
+		n++;
+	}
+	return n;
+}
+
+	/** Add a page and everything under it to #mdb_stat_walk() results.
+	 * @param[in] mc cursor for the txn.
+	 * @param[in] pg the page.
+	 * @param[in] depth levels from pg down to the leaves, 1 for a leaf.
+	 * @param[in] dups nonzero if pg is in the sub-DB of a dupsort key,
+	 *	whose keys are the data items.
+	 * @param[in,out] ws the statistics.
+	 */
+static int ESECT
+mdb_walk_page(MDB_cursor *mc, pgno_t pg, int depth, int dups, MDB_walkstat *ws)
+{
+	unsigned psize = mc->mc_txn->mt_env->me_psize;
+	MDB_page *mp, *fp;
+	MDB_node *ni;
+	MDB_db db;
+	size_t used, dsize;
+	unsigned i, j, n;
+	int rc;
+
+	rc = mdb_page_get(mc, pg, &mp, NULL);
+	if (rc)
+		return rc;
+	used = psize - SIZELEFT(mp);
+	n = NUMKEYS(mp);
+	if (IS_BRANCH(mp)) {
+		if (depth <= 1)
+			return MDB_CORRUPTED;
+		ws->mw_branch_pages++;
+		ws->mw_branch_used += used;
+		for (i=0; i<n; i++) {
+			rc = mdb_walk_page(mc, NODEPGNO(NODEPTR(mp, i)), depth-1, dups, ws);
+			if (rc)
+				return rc;
+		}
+		return MDB_SUCCESS;
+	}
+	if (!IS_LEAF(mp) || depth != 1)
+		return MDB_CORRUPTED;
+	ws->mw_leaf_pages++;
+	ws->mw_leaf_used += used;
+	ws->mw_fill[used * 10 / psize < 10 ? used * 10 / psize : 9]++;
+	if (IS_LEAF2(mp)) {
+		ws->mw_entries += n;
+		ws->mw_datasize[mdb_walk_bucket(mp->mp_pad)] += n;
+		return MDB_SUCCESS;
+	}
+	for (i=0; i<n; i++) {
+		ni = NODEPTR(mp, i);
+		if (dups) {
+			ws->mw_entries++;
+			ws->mw_datasize[mdb_walk_bucket(NODEKSZ(ni))]++;
+			continue;
+		}
+		ws->mw_keysize[mdb_walk_bucket(NODEKSZ(ni))]++;
+		dsize = NODEDSZ(ni);
+		if (!(ni->mn_flags & F_DUPDATA)) {
+			ws->mw_entries++;
+			ws->mw_datasize[mdb_walk_bucket(dsize)]++;
+			if (ni->mn_flags & F_BIGDATA) {
+				j = OVPAGES(dsize, psize);
+				ws->mw_overflow_pages += j;
+				ws->mw_overflow[mdb_walk_bucket(j)]++;
+			}
+		} else if (ni->mn_flags & F_SUBDATA) {
+			memcpy(&db, NODEDATA(ni), sizeof(db));
+			rc = mdb_walk_page(mc, db.md_root, db.md_depth, 1, ws);
+			if (rc)
+				return rc;
+		} else {
+			/* Sub-page of duplicates */
+			fp = NODEDATA(ni);
+			j = NUMKEYS(fp);
+			ws->mw_entries += j;
+			if (IS_LEAF2(fp)) {
+				ws->mw_datasize[mdb_walk_bucket(fp->mp_pad)] += j;
+			} else {
+				while (j)
+					ws->mw_datasize[mdb_walk_bucket(NODEKSZ(NODEPTR(fp, --j)))]++;
+			}
+		}
+	}
+	return MDB_SUCCESS;
+}
+
+	/** Add one set of statistics to another. */
+static void
+mdb_walk_add(MDB_walkstat *dst, MDB_walkstat *src)
+{
+	size_t *d = (size_t *)dst, *s = (size_t *)src;
+	unsigned i;
+
+	for (i=0; i<sizeof(MDB_walkstat)/sizeof(size_t); i++)
+		d[i] += s[i];
+}
+
+#ifndef _WIN32
+	/** State shared by the threads of a parallel #mdb_stat_walk(). */
+typedef struct mdb_pwalk {
+	MDB_txn		*pw_txn;
+	MDB_page	*pw_root;
+	int			pw_depth;
+	unsigned	pw_next;	/**< next child of pw_root to walk */
+	int			pw_error;
+	pthread_mutex_t	pw_mutex;
+	MDB_walkstat	pw_stat;
+} mdb_pwalk;
+
+	/** Walker thread of a parallel #mdb_stat_walk(). */
+static THREAD_RET ESECT CALL_CONV
+mdb_walk_thr(void *arg)
+{
+	mdb_pwalk *pw = arg;
+	MDB_cursor mc = {0};
+	MDB_walkstat ws = {0};
+	unsigned i, n = NUMKEYS(pw->pw_root);
+	int rc = MDB_SUCCESS;
+
+	mc.mc_txn = pw->pw_txn;
+	while (!pw->pw_error) {
+		pthread_mutex_lock(&pw->pw_mutex);
+		i = pw->pw_next++;
+		pthread_mutex_unlock(&pw->pw_mutex);
+		if (i >= n)
+			break;
+		rc = mdb_walk_page(&mc, NODEPGNO(NODEPTR(pw->pw_root, i)),
+			pw->pw_depth - 1, 0, &ws);
+		if (rc) {
+			pw->pw_error = rc;
+			break;
+		}
+	}
+	pthread_mutex_lock(&pw->pw_mutex);
+	mdb_walk_add(&pw->pw_stat, &ws);
+	pthread_mutex_unlock(&pw->pw_mutex);
+	return (THREAD_RET)0;
+}
+#endif
+
+int ESECT
+mdb_stat_walk(MDB_txn *txn, MDB_dbi dbi, MDB_walkstat *arg, unsigned int threads)
+{
+	MDB_cursor mc = {0};
+	MDB_db *db;
+	int rc;
+
+	if (!arg || !TXN_DBI_EXIST(txn, dbi, DB_VALID))
+		return EINVAL;
+
+	if (txn->mt_flags & MDB_TXN_BLOCKED)
+		return MDB_BAD_TXN;
+
+	if (txn->mt_dbflags[dbi] & DB_STALE) {
+		MDB_xcursor mx;
+		/* Stale, must read the DB's root. cursor_init does it for us. */
+		mdb_cursor_init(&mc, txn, dbi, &mx);
+	}
+	memset(arg, 0, sizeof(*arg));
+	db = &txn->mt_dbs[dbi];
+	if (db->md_root == P_INVALID)
+		return MDB_SUCCESS;
+	mc.mc_txn = txn;
+
+#ifndef _WIN32
+	/* Readers only map pages, so walkers can share a read txn */
+	if (threads > 1 && (txn->mt_flags & MDB_TXN_RDONLY) && db->md_depth > 1) {
+		mdb_pwalk pw = {0};
+		pthread_t *thrs;
+		MDB_page *mp;
+		unsigned i;
+
+		rc = mdb_page_get(&mc, db->md_root, &mp, NULL);
+		if (rc)
+			return rc;
+		if (!IS_BRANCH(mp))
+			return MDB_CORRUPTED;
+		if (threads > NUMKEYS(mp))
+			threads = NUMKEYS(mp);
+		thrs = malloc(threads * sizeof(pthread_t));
+		if (!thrs)
+			return ENOMEM;
+		if ((rc = pthread_mutex_init(&pw.pw_mutex, NULL)) != 0) {
+			free(thrs);
+			return rc;
+		}
+		pw.pw_txn = txn;
+		pw.pw_root = mp;
+		pw.pw_depth = db->md_depth;
+		for (i=0; i<threads; i++) {
+			rc = THREAD_CREATE(thrs[i], mdb_walk_thr, &pw);
+			if (rc) {
+				pw.pw_error = rc;
+				break;
+			}
+		}
+		while (i)
+			THREAD_FINISH(thrs[--i]);
+		free(thrs);
+		pthread_mutex_destroy(&pw.pw_mutex);
+		if (pw.pw_error)
+			return pw.pw_error;
+		*arg = pw.pw_stat;
+		arg->mw_branch_pages++;
+		arg->mw_branch_used += txn->mt_env->me_psize - SIZELEFT(mp);
+		return MDB_SUCCESS;
+	}
+#endif
+	return mdb_walk_page(&mc, db->md_root, db->md_depth, 0, arg);
+}
+
 void mdb_dbi_close(MDB_env *env, MDB_dbi dbi)
 {
 	char *ptr;
@@ -9887,6 +11925,11 @@ void mdb_dbi_close(MDB_env *env, MDB_dbi dbi)
 	if (ptr) {
 		env->me_dbxs[dbi].md_name.mv_data = NULL;
 		env->me_dbxs[dbi].md_name.mv_size = 0;
+		if (env->me_dbxs[dbi].md_pinned) {
+			/* unlocked at the next commit */
+			env->me_dbxs[dbi].md_pinned = 0;
+			env->me_pintxnid = 0;
+		}
 		env->me_dbflags[dbi] = 0;
 		env->me_dbiseqs[dbi]++;
 		free(ptr);
@@ -10088,6 +12131,35 @@ int mdb_set_relctx(MDB_txn *txn, MDB_dbi dbi, void *ctx)
 	return MDB_SUCCESS;
 }
 
+int mdb_set_pinned(MDB_txn *txn, MDB_dbi dbi, int pin)
+{
+	MDB_env *env;
+	MDB_IDL pins;
+	int rc;
+
+	if (!TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
+		return EINVAL;
+	env = txn->mt_env;
+
+	pin = pin != 0;
+	if (txn->mt_dbxs[dbi].md_pinned == pin)
+		return MDB_SUCCESS;
+	txn->mt_dbxs[dbi].md_pinned = pin;
+	env->me_pintxnid = 0;
+	if (!(txn->mt_flags & MDB_TXN_RDONLY))
+		return MDB_SUCCESS;	/* done when it commits */
+
+	/* Lock them now, the next commit may be far off */
+	if (env->me_txns && LOCK_MUTEX(rc, env, env->me_wmutex))
+		return rc;
+	rc = mdb_pin_collect(txn, &pins);
+	if (rc == MDB_SUCCESS && pins)
+		rc = mdb_pin_apply(env, pins, txn->mt_txnid);
+	if (env->me_txns)
+		UNLOCK_MUTEX(env->me_wmutex);
+	return rc;
+}
+
 int ESECT
 mdb_env_get_maxkeysize(MDB_env *env)
 {
@@ -10221,6 +12293,8 @@ mdb_reader_check0(MDB_env *env, int rlocked, int *dead)
 								DPRINTF(("clear stale reader pid %u txn %"Z"d",
 									(unsigned) pid, mr[j].mr_txnid));
 								mr[j].mr_pid = 0;
+								if (j < env->me_txns->mti_rfree)
+									env->me_txns->mti_rfree = j;
 								count++;
 							}
 					if (rmutex)
@@ -10259,6 +12333,11 @@ mdb_mutex_failed(MDB_env *env, mdb_mutexref_t mutex, int rc)
 			 */
 			meta = mdb_env_pick_meta(env);
 			env->me_txns->mti_txnid = meta->mm_txnid;
+			/* Drop the deferred commits if it died posting one */
+			if (env->me_txns->mti_ptxnid > meta->mm_txnid &&
+				env->me_txns->mti_pmeta[env->me_txns->mti_ptxnid & 1].mm_txnid !=
+				env->me_txns->mti_ptxnid)
+				env->me_txns->mti_ptxnid = meta->mm_txnid;
 			/* env is hosed if the dead thread was ours */
 			if (env->me_txn) {
 				env->me_flags |= MDB_FATAL_ERROR;
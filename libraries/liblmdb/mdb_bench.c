@@ -0,0 +1,653 @@
+/* mdb_bench.c - memory-mapped database benchmark tool */
+/*
+ * Copyright 2011-2020 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Throughput and commit latency of common workloads, for tuning
+ * environment flags. Results are written as tab-separated lines,
+ * one per benchmark, after a '#' header line. POSIX only.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "lmdb.h"
+
+#ifdef	_WIN32
+#define	Z	"I"
+#else
+#define	Z	"z"
+#endif
+
+#define E(expr) CHECK((rc = (expr)) == MDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, mdb_strerror(rc)), abort()))
+
+#define DEFAULT_BENCHES	"fillseq,readseq,readrandom,fillrandom,overwrite," \
+	"dupfill,dupread,readwrite,commit"
+#define DEFAULT_SYNCS	"sync,nometasync,nosync,writemap,writemap+mapasync"
+
+/* Settings from the command line */
+static char *envdir;
+static unsigned int envflags;
+static size_t mapsize = 1024;	/* MB */
+static size_t count = 100000;
+static size_t batch = 1000;
+static size_t dups = 100;
+static size_t ncommits = 1000;
+static unsigned int readers = 4;
+static unsigned int seconds = 5;
+static unsigned long seed = 1;
+
+/* Current run */
+static MDB_env *env;
+static char *flagname;
+static size_t keysize, valsize;
+static char *valbuf;
+
+static const struct {
+	char *name;
+	unsigned int flag;
+} flagnames[] = {
+	{ "sync", 0 },
+	{ "nosync", MDB_NOSYNC },
+	{ "nometasync", MDB_NOMETASYNC },
+	{ "writemap", MDB_WRITEMAP },
+	{ "mapasync", MDB_MAPASYNC },
+	{ "nordahead", MDB_NORDAHEAD },
+	{ "nomeminit", MDB_NOMEMINIT },
+	{ NULL, 0 }
+};
+
+static void usage(char *prog)
+{
+	fprintf(stderr, "usage: %s [-V] [-b benchmarks] [-n count] [-k keysizes] [-v valsizes]\n"
+		"\t[-B batch] [-d dups] [-c commits] [-r readers] [-t seconds] [-m mapsize]\n"
+		"\t[-e flags] [-S syncflags] [-s seed] dbpath\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+/* Parse a '+' separated list of env flag names */
+static int parseflags(char *str, unsigned int *flags)
+{
+	char *s, *p, *next;
+	int i;
+
+	*flags = 0;
+	for (s = str; s; s = next) {
+		p = strchr(s, '+');
+		next = p ? p + 1 : NULL;
+		for (i = 0; flagnames[i].name; i++) {
+			if (p ? (size_t)(p - s) == strlen(flagnames[i].name) &&
+				!strncmp(s, flagnames[i].name, p - s) :
+				!strcmp(s, flagnames[i].name))
+				break;
+		}
+		if (!flagnames[i].name)
+			return -1;
+		*flags |= flagnames[i].flag;
+	}
+	return 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* xorshift64*, one state per thread */
+static unsigned long long rnd(unsigned long long *state)
+{
+	unsigned long long x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 2685821657736338717ULL;
+}
+
+/* Keys are zero-padded decimal, so key order matches numeric order */
+static void mkkey(char *buf, size_t i)
+{
+	char tmp[32];
+	int len = sprintf(tmp, "%"Z"u", i);
+
+	memset(buf, '0', keysize - len);
+	memcpy(buf + keysize - len, tmp, len);
+}
+
+static void report(char *bench, unsigned int threads, size_t ops, double secs,
+	double *lat, size_t nlat)
+{
+	printf("%s\t%s\t%"Z"u\t%"Z"u\t%u\t%"Z"u\t%.3f\t%.0f\t%.3f",
+		bench, flagname, keysize, valsize, threads, ops, secs,
+		secs > 0 ? ops / secs : 0.0, ops ? secs * 1e6 / ops : 0.0);
+	if (nlat) {
+		printf("\t%.1f\t%.1f\t%.1f\t%.1f\n",
+			lat[nlat / 2], lat[nlat * 90 / 100], lat[nlat * 99 / 100],
+			lat[nlat - 1]);
+	} else {
+		printf("\t-\t-\t-\t-\n");
+	}
+	fflush(stdout);
+}
+
+static int dblcmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void openenv(unsigned int flags)
+{
+	char path[4096];
+	int rc;
+
+	snprintf(path, sizeof(path), "%s/data.mdb", envdir);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/lock.mdb", envdir);
+	unlink(path);
+
+	E(mdb_env_create(&env));
+	E(mdb_env_set_mapsize(env, mapsize << 20));
+	E(mdb_env_set_maxdbs(env, 4));
+	E(mdb_env_set_maxreaders(env, readers + 8));
+	E(mdb_env_open(env, envdir, envflags | flags, 0664));
+}
+
+static MDB_dbi opendb(char *name, unsigned int flags)
+{
+	MDB_txn *txn;
+	MDB_dbi dbi;
+	int rc;
+
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	E(mdb_dbi_open(txn, name, flags | MDB_CREATE, &dbi));
+	E(mdb_txn_commit(txn));
+	return dbi;
+}
+
+/* Sequential or random inserts, batch puts per txn */
+static void fill(char *bench, int random, unsigned int flags)
+{
+	MDB_dbi dbi = opendb("main", 0);
+	MDB_txn *txn;
+	MDB_val key, data;
+	unsigned long long rs = seed;
+	char kbuf[512];
+	double t0 = now();
+	size_t i;
+	int rc;
+
+	key.mv_data = kbuf;
+	key.mv_size = keysize;
+	data.mv_data = valbuf;
+	data.mv_size = valsize;
+	for (i = 0; i < count; ) {
+		E(mdb_txn_begin(env, NULL, 0, &txn));
+		do {
+			mkkey(kbuf, random ? rnd(&rs) % count : i);
+			E(mdb_put(txn, dbi, &key, &data, flags));
+		} while (++i % batch && i < count);
+		E(mdb_txn_commit(txn));
+	}
+	report(bench, 1, count, now() - t0, NULL, 0);
+}
+
+static void readseq(void)
+{
+	MDB_dbi dbi = opendb("main", 0);
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	size_t n = 0;
+	double t0 = now();
+	int rc;
+
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+	E(mdb_cursor_open(txn, dbi, &mc));
+	while (mdb_cursor_get(mc, &key, &data, MDB_NEXT) == 0)
+		n++;
+	mdb_cursor_close(mc);
+	mdb_txn_abort(txn);
+	report("readseq", 1, n, now() - t0, NULL, 0);
+}
+
+static void readrandom(void)
+{
+	MDB_dbi dbi = opendb("main", 0);
+	MDB_txn *txn;
+	MDB_val key, data;
+	unsigned long long rs = seed + 1;
+	char kbuf[512];
+	size_t i, found = 0;
+	double t0 = now();
+	int rc;
+
+	key.mv_data = kbuf;
+	key.mv_size = keysize;
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+	for (i = 0; i < count; i++) {
+		mkkey(kbuf, rnd(&rs) % count);
+		if (mdb_get(txn, dbi, &key, &data) == 0)
+			found++;
+	}
+	mdb_txn_abort(txn);
+	report("readrandom", 1, count, now() - t0, NULL, 0);
+	if (found < count)
+		fprintf(stderr, "readrandom: %"Z"u of %"Z"u keys not found\n",
+			count - found, count);
+}
+
+/* Like a back-mdb index DB: short keys, each with a sorted
+ * set of fixed-size IDs, added in increasing ID order.
+ */
+static MDB_dbi opendupdb(void)
+{
+	return opendb("dup", MDB_DUPSORT|MDB_DUPFIXED|MDB_INTEGERDUP);
+}
+
+static void dupfill(void)
+{
+	MDB_dbi dbi = opendupdb();
+	MDB_txn *txn;
+	MDB_val key, data;
+	unsigned long long rs = seed + 2;
+	size_t id, nkeys = (count + dups - 1) / dups;
+	char kbuf[512];
+	double t0 = now();
+	int rc;
+
+	key.mv_data = kbuf;
+	key.mv_size = keysize;
+	data.mv_data = &id;
+	data.mv_size = sizeof(id);
+	for (id = 1; id <= count; ) {
+		E(mdb_txn_begin(env, NULL, 0, &txn));
+		do {
+			mkkey(kbuf, rnd(&rs) % nkeys);
+			E(mdb_put(txn, dbi, &key, &data, 0));
+		} while (id++ % batch && id <= count);
+		E(mdb_txn_commit(txn));
+	}
+	report("dupfill", 1, count, now() - t0, NULL, 0);
+}
+
+/* Fetch the ID sets of random keys in bulk; counts IDs read */
+static void dupread(void)
+{
+	MDB_dbi dbi = opendupdb();
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	unsigned long long rs = seed + 3;
+	size_t i, ids = 0, nkeys = (count + dups - 1) / dups;
+	char kbuf[512];
+	double t0 = now();
+	int rc;
+
+	key.mv_data = kbuf;
+	key.mv_size = keysize;
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+	E(mdb_cursor_open(txn, dbi, &mc));
+	for (i = 0; i < nkeys; i++) {
+		mkkey(kbuf, rnd(&rs) % nkeys);
+		if (mdb_cursor_get(mc, &key, &data, MDB_SET) != 0)
+			continue;
+		rc = mdb_cursor_get(mc, &key, &data, MDB_GET_MULTIPLE);
+		while (rc == 0) {
+			ids += data.mv_size / sizeof(size_t);
+			rc = mdb_cursor_get(mc, &key, &data, MDB_NEXT_MULTIPLE);
+		}
+	}
+	mdb_cursor_close(mc);
+	mdb_txn_abort(txn);
+	report("dupread", 1, ids, now() - t0, NULL, 0);
+}
+
+static volatile int stop;
+
+struct rwarg {
+	MDB_dbi dbi;
+	unsigned long long rs;
+	size_t ops;
+	pthread_t thr;
+};
+
+/* Readers renew their snapshot now and then, as a server would */
+static void *reader(void *arg)
+{
+	struct rwarg *ra = arg;
+	MDB_txn *txn;
+	MDB_val key, data;
+	char kbuf[512];
+	int rc;
+
+	key.mv_data = kbuf;
+	key.mv_size = keysize;
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+	while (!stop) {
+		mkkey(kbuf, rnd(&ra->rs) % count);
+		mdb_get(txn, ra->dbi, &key, &data);
+		if (++ra->ops % 1000 == 0) {
+			mdb_txn_reset(txn);
+			E(mdb_txn_renew(txn));
+		}
+	}
+	mdb_txn_abort(txn);
+	return NULL;
+}
+
+/* Parallel readers with one writer overwriting random keys */
+static void readwrite(void)
+{
+	MDB_dbi dbi = opendb("main", 0);
+	struct rwarg *ra = calloc(readers, sizeof(struct rwarg));
+	MDB_txn *txn;
+	MDB_val key, data;
+	unsigned long long rs = seed + 4;
+	size_t i, rops = 0, wops = 0;
+	char kbuf[512];
+	double t0, secs;
+	int rc;
+
+	if (!ra) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	stop = 0;
+	t0 = now();
+	for (i = 0; i < readers; i++) {
+		ra[i].dbi = dbi;
+		ra[i].rs = seed + 5 + i;
+		rc = pthread_create(&ra[i].thr, NULL, reader, &ra[i]);
+		CHECK(rc == 0, "pthread_create");
+	}
+
+	key.mv_data = kbuf;
+	key.mv_size = keysize;
+	data.mv_data = valbuf;
+	data.mv_size = valsize;
+	while (now() - t0 < seconds) {
+		E(mdb_txn_begin(env, NULL, 0, &txn));
+		do {
+			mkkey(kbuf, rnd(&rs) % count);
+			E(mdb_put(txn, dbi, &key, &data, 0));
+		} while (++wops % batch);
+		E(mdb_txn_commit(txn));
+	}
+	stop = 1;
+	for (i = 0; i < readers; i++) {
+		pthread_join(ra[i].thr, NULL);
+		rops += ra[i].ops;
+	}
+	secs = now() - t0;
+	free(ra);
+	report("readwrite-read", readers, rops, secs, NULL, 0);
+	report("readwrite-write", 1, wops, secs, NULL, 0);
+}
+
+/* Latency of single-put commits, for each set of sync flags.
+ * Each set gets a fresh environment.
+ */
+static void commit(char *syncs)
+{
+	char *list = strdup(syncs), *s, *last;
+	double *lat = malloc(ncommits * sizeof(double));
+	char *saved = flagname;
+	unsigned long long rs = seed + 6;
+	char kbuf[512];
+	int rc;
+
+	if (!list || !lat) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	mdb_env_close(env);
+	for (s = strtok_r(list, ",", &last); s; s = strtok_r(NULL, ",", &last)) {
+		MDB_dbi dbi;
+		MDB_txn *txn;
+		MDB_val key, data;
+		unsigned int flags;
+		double t0, t1;
+		size_t i;
+
+		if (parseflags(s, &flags)) {
+			fprintf(stderr, "unknown flags %s\n", s);
+			exit(EXIT_FAILURE);
+		}
+		openenv(flags);
+		dbi = opendb("main", 0);
+		flagname = s;
+		key.mv_data = kbuf;
+		key.mv_size = keysize;
+		data.mv_data = valbuf;
+		data.mv_size = valsize;
+		t0 = now();
+		for (i = 0; i < ncommits; i++) {
+			t1 = now();
+			E(mdb_txn_begin(env, NULL, 0, &txn));
+			mkkey(kbuf, rnd(&rs) % count);
+			E(mdb_put(txn, dbi, &key, &data, 0));
+			E(mdb_txn_commit(txn));
+			lat[i] = (now() - t1) * 1e6;
+		}
+		t1 = now() - t0;
+		qsort(lat, ncommits, sizeof(double), dblcmp);
+		report("commit", 1, ncommits, t1, lat, ncommits);
+		mdb_env_close(env);
+	}
+	flagname = saved;
+	free(lat);
+	free(list);
+	openenv(0);
+}
+
+static void run(char *benches, char *syncs)
+{
+	char *list = strdup(benches), *s, *last;
+
+	if (!list) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	openenv(0);
+	for (s = strtok_r(list, ",", &last); s; s = strtok_r(NULL, ",", &last)) {
+		if (!strcmp(s, "fillseq"))
+			fill(s, 0, MDB_APPEND);
+		else if (!strcmp(s, "fillrandom") || !strcmp(s, "overwrite"))
+			fill(s, 1, 0);
+		else if (!strcmp(s, "readseq"))
+			readseq();
+		else if (!strcmp(s, "readrandom"))
+			readrandom();
+		else if (!strcmp(s, "dupfill"))
+			dupfill();
+		else if (!strcmp(s, "dupread"))
+			dupread();
+		else if (!strcmp(s, "readwrite"))
+			readwrite();
+		else if (!strcmp(s, "commit"))
+			commit(syncs);
+		else
+			fprintf(stderr, "unknown benchmark %s, skipped\n", s);
+	}
+	mdb_env_close(env);
+	free(list);
+}
+
+static int parsesizes(char *str, size_t *sizes, int max)
+{
+	char *end;
+	int n = 0;
+
+	for (;;) {
+		if (n == max)
+			return -1;
+		sizes[n] = strtoul(str, &end, 0);
+		if (end == str || (*end && *end != ','))
+			return -1;
+		n++;
+		if (!*end)
+			return n;
+		str = end + 1;
+	}
+}
+
+#define MAXSIZES	16
+
+int main(int argc, char *argv[])
+{
+	int i, j, k, nks = 1, nvs = 1;
+	char *prog = argv[0];
+	char *benches = DEFAULT_BENCHES, *syncs = DEFAULT_SYNCS;
+	char *basename = "sync";
+	size_t ks[MAXSIZES] = { 16 }, vs[MAXSIZES] = { 100 };
+	char *end, tmp[32];
+
+	if (argc < 2) {
+		usage(prog);
+	}
+
+	/* -b: comma separated list of benchmarks to run, in order
+	 * -n: number of records
+	 * -k, -v: comma separated key and value sizes; the benchmarks
+	 *     are run for each combination, in a fresh environment
+	 * -B: puts per write txn
+	 * -d: average number of IDs per key for dupfill
+	 * -c: number of commits for commit
+	 * -r: reader threads for readwrite
+	 * -t: duration of readwrite
+	 * -m: map size in MB
+	 * -e: '+' separated env flags for all benchmarks
+	 * -S: comma separated sets of flags for commit
+	 * -s: random seed
+	 * -V: print version and exit
+	 */
+	while ((i = getopt(argc, argv, "Vb:n:k:v:B:d:c:r:t:m:e:S:s:")) != EOF) {
+		switch(i) {
+		case 'V':
+			printf("%s\n", MDB_VERSION_STRING);
+			exit(0);
+			break;
+		case 'b':
+			benches = optarg;
+			break;
+		case 'n':
+			count = strtoul(optarg, &end, 0);
+			if (*end || !count)
+				usage(prog);
+			break;
+		case 'k':
+			nks = parsesizes(optarg, ks, MAXSIZES);
+			if (nks < 0)
+				usage(prog);
+			break;
+		case 'v':
+			nvs = parsesizes(optarg, vs, MAXSIZES);
+			if (nvs < 0)
+				usage(prog);
+			break;
+		case 'B':
+			batch = strtoul(optarg, &end, 0);
+			if (*end || !batch)
+				usage(prog);
+			break;
+		case 'd':
+			dups = strtoul(optarg, &end, 0);
+			if (*end || !dups)
+				usage(prog);
+			break;
+		case 'c':
+			ncommits = strtoul(optarg, &end, 0);
+			if (*end || !ncommits)
+				usage(prog);
+			break;
+		case 'r':
+			readers = strtoul(optarg, &end, 0);
+			if (*end || !readers)
+				usage(prog);
+			break;
+		case 't':
+			seconds = strtoul(optarg, &end, 0);
+			if (*end || !seconds)
+				usage(prog);
+			break;
+		case 'm':
+			mapsize = strtoul(optarg, &end, 0);
+			if (*end || !mapsize)
+				usage(prog);
+			break;
+		case 'e':
+			if (parseflags(optarg, &envflags))
+				usage(prog);
+			basename = optarg;
+			break;
+		case 'S':
+			syncs = optarg;
+			break;
+		case 's':
+			seed = strtoul(optarg, &end, 0);
+			if (*end || !seed)
+				usage(prog);
+			break;
+		default:
+			usage(prog);
+		}
+	}
+
+	if (optind != argc - 1)
+		usage(prog);
+	envdir = argv[optind];
+
+	sprintf(tmp, "%"Z"u", count);
+	for (i = 0; i < nks; i++) {
+		if (ks[i] < strlen(tmp) || ks[i] > 511) {
+			fprintf(stderr, "key size %"Z"u not in %d..511\n", ks[i],
+				(int)strlen(tmp));
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (j = 0; j < nvs; j++) {
+		if (!vs[j]) {
+			fprintf(stderr, "value size must be nonzero\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	printf("#bench\tflags\tkeysize\tvalsize\tthreads\tops\tsecs\tops/sec\tusec/op"
+		"\tp50\tp90\tp99\tmax\n");
+	for (i = 0; i < nks; i++) {
+		for (j = 0; j < nvs; j++) {
+			keysize = ks[i];
+			valsize = vs[j];
+			valbuf = malloc(valsize);
+			if (!valbuf) {
+				fprintf(stderr, "out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+			for (k = 0; k < (int)valsize; k++)
+				valbuf[k] = 'a' + k % 26;
+			flagname = basename;
+			run(benches, syncs);
+			free(valbuf);
+		}
+	}
+	return EXIT_SUCCESS;
+}
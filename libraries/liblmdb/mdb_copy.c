@@ -14,11 +14,23 @@
 #ifdef _WIN32
 #include <windows.h>
 #define	MDB_STDOUT	GetStdHandle(STD_OUTPUT_HANDLE)
+#define	MDB_STDIN	GetStdHandle(STD_INPUT_HANDLE)
+#define	MDB_BADFD	INVALID_HANDLE_VALUE
+#define	fd_close(fd)	CloseHandle(fd)
+#define	fd_rename(from, to)	(!MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING))
 #else
+#include <fcntl.h>
+#include <unistd.h>
 #define	MDB_STDOUT	1
+#define	MDB_STDIN	0
+#define	MDB_BADFD	(-1)
+#define	fd_close(fd)	close(fd)
+#define	fd_rename(from, to)	rename(from, to)
 #endif
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include "lmdb.h"
 
@@ -27,6 +39,56 @@ sighandle(int sig)
 {
 }
 
+static mdb_filehandle_t
+fd_open(const char *name, int wr)
+{
+#ifdef _WIN32
+	return CreateFileA(name, wr ? GENERIC_WRITE : GENERIC_READ, 0, NULL,
+		wr ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+#else
+	return open(name, wr ? O_WRONLY|O_CREAT|O_TRUNC : O_RDONLY, 0600);
+#endif
+}
+
+	/* Write a delta backup against the backup described by the page
+	 * map in mapname, if there is one, and replace the map.
+	 */
+static int
+copy_delta(MDB_env *env, const char *mapname, const char *dstname)
+{
+	mdb_filehandle_t base, map, fd = MDB_STDOUT;
+	char *newname;
+	int rc;
+
+	newname = malloc(strlen(mapname) + sizeof(".new"));
+	if (!newname)
+		return ENOMEM;
+	sprintf(newname, "%s.new", mapname);
+	base = fd_open(mapname, 0);
+	map = fd_open(newname, 1);
+	if (map == MDB_BADFD) {
+		rc = errno;
+		goto leave;
+	}
+	if (dstname && (fd = fd_open(dstname, 1)) == MDB_BADFD) {
+		rc = errno;
+		fd_close(map);
+		goto leave;
+	}
+	rc = mdb_env_copyfd_delta(env, fd, base, map);
+	if (fd_close(map) && !rc)
+		rc = errno;
+	if (dstname && fd_close(fd) && !rc)
+		rc = errno;
+	if (!rc && fd_rename(newname, mapname))
+		rc = errno;
+leave:
+	if (base != MDB_BADFD)
+		fd_close(base);
+	free(newname);
+	return rc;
+}
+
 int main(int argc,char * argv[])
 {
 	int rc;
@@ -34,12 +96,37 @@ int main(int argc,char * argv[])
 	const char *progname = argv[0], *act;
 	unsigned flags = MDB_RDONLY;
 	unsigned cpflags = 0;
+	unsigned threads = 1;
+	size_t rate = 0;
+	char *end, *mapname = NULL, *delta = NULL;
 
 	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
 		if (argv[1][1] == 'n' && argv[1][2] == '\0')
 			flags |= MDB_NOSUBDIR;
 		else if (argv[1][1] == 'c' && argv[1][2] == '\0')
 			cpflags |= MDB_CP_COMPACT;
+		else if (argv[1][1] == 'j' && argv[1][2] == '\0' && argc > 2) {
+			threads = strtoul(argv[2], &end, 0);
+			if (*end || !threads)
+				argc = 0;
+			argc--, argv++;
+		} else if (argv[1][1] == 'i' && argv[1][2] == '\0' && argc > 2) {
+			mapname = argv[2];
+			argc--, argv++;
+		} else if (argv[1][1] == 'a' && argv[1][2] == '\0' && argc > 2) {
+			delta = argv[2];
+			argc--, argv++;
+		} else if (argv[1][1] == 'r' && argv[1][2] == '\0' && argc > 2) {
+			rate = strtoul(argv[2], &end, 0);
+			switch (*end) {
+			case 'g': case 'G': rate <<= 10;	/* FALLTHRU */
+			case 'm': case 'M': rate <<= 10;	/* FALLTHRU */
+			case 'k': case 'K': rate <<= 10; end++;
+			}
+			if (*end)
+				argc = 0;
+			argc--, argv++;
+		}
 		else if (argv[1][1] == 'V' && argv[1][2] == '\0') {
 			printf("%s\n", MDB_VERSION_STRING);
 			exit(0);
@@ -47,11 +134,25 @@ int main(int argc,char * argv[])
 			argc = 0;
 	}
 
-	if (argc<2 || argc>3) {
-		fprintf(stderr, "usage: %s [-V] [-c] [-n] srcpath [dstpath]\n", progname);
+	if (argc<2 || argc>3 || (delta && (argc != 2 || mapname))) {
+		fprintf(stderr, "usage: %s [-V] [-c] [-j threads] [-r rate] [-i map] [-n] srcpath [dstpath]\n"
+			"       %s [-n] -a delta dstpath\n", progname, progname);
 		exit(EXIT_FAILURE);
 	}
 
+	if (delta) {
+		mdb_filehandle_t fd = MDB_STDIN;
+		act = "applying delta";
+		if (strcmp(delta, "-") && (fd = fd_open(delta, 0)) == MDB_BADFD)
+			rc = errno;
+		else
+			rc = mdb_env_apply_delta(argv[1], fd, flags & MDB_NOSUBDIR);
+		if (rc)
+			fprintf(stderr, "%s: %s failed, error %d (%s)\n",
+				progname, act, rc, mdb_strerror(rc));
+		return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
 #ifdef SIGPIPE
 	signal(SIGPIPE, sighandle);
 #endif
@@ -68,10 +169,12 @@ int main(int argc,char * argv[])
 	}
 	if (rc == MDB_SUCCESS) {
 		act = "copying";
-		if (argc == 2)
-			rc = mdb_env_copyfd2(env, MDB_STDOUT, cpflags);
+		if (mapname)
+			rc = copy_delta(env, mapname, argc == 3 ? argv[2] : NULL);
+		else if (argc == 2)
+			rc = mdb_env_copyfd3(env, MDB_STDOUT, cpflags, threads, rate);
 		else
-			rc = mdb_env_copy2(env, argv[2], cpflags);
+			rc = mdb_env_copy3(env, argv[2], cpflags, threads, rate);
 	}
 	if (rc)
 		fprintf(stderr, "%s: %s failed, error %d (%s)\n",
@@ -21,14 +21,30 @@
 #include "lmdb.h"
 
 #ifdef _WIN32
+#include <windows.h>
 #define Z	"I"
+#define THREAD_RET	DWORD WINAPI
+typedef HANDLE thread_t;
+#define THREAD_CREATE(thr,start,arg) \
+	(((thr) = CreateThread(NULL, 0, start, arg, 0, NULL)) ? 0 : GetLastError())
+#define THREAD_FINISH(thr) \
+	(WaitForSingleObject(thr, INFINITE) ? GetLastError() : (CloseHandle(thr), 0))
 #else
+#include <pthread.h>
 #define Z	"z"
+#define THREAD_RET	void *
+typedef pthread_t thread_t;
+#define THREAD_CREATE(thr,start,arg)	pthread_create(&thr,NULL,start,arg)
+#define THREAD_FINISH(thr)	pthread_join(thr,NULL)
 #endif
 
 #define PRINT	1
+#define BINARY	2
 static int mode;
 
+/* Length word that terminates a binary data section */
+#define BINARY_END	0xffffffffU
+
 typedef struct flagbit {
 	int bit;
 	char *name;
@@ -53,53 +69,78 @@ static void dumpsig( int sig )
 
 static const char hexc[] = "0123456789abcdef";
 
-static void hex(unsigned char c)
+static void hex(FILE *fp, unsigned char c)
 {
-	putchar(hexc[c >> 4]);
-	putchar(hexc[c & 0xf]);
+	putc(hexc[c >> 4], fp);
+	putc(hexc[c & 0xf], fp);
 }
 
-static void text(MDB_val *v)
+static void text(FILE *fp, MDB_val *v)
 {
 	unsigned char *c, *end;
 
-	putchar(' ');
+	putc(' ', fp);
 	c = v->mv_data;
 	end = c + v->mv_size;
 	while (c < end) {
 		if (isprint(*c)) {
 			if (*c == '\\')
-				putchar('\\');
-			putchar(*c);
+				putc('\\', fp);
+			putc(*c, fp);
 		} else {
-			putchar('\\');
-			hex(*c);
+			putc('\\', fp);
+			hex(fp, *c);
 		}
 		c++;
 	}
-	putchar('\n');
+	putc('\n', fp);
 }
 
-static void byte(MDB_val *v)
+static void byte(FILE *fp, MDB_val *v)
 {
 	unsigned char *c, *end;
 
-	putchar(' ');
+	putc(' ', fp);
 	c = v->mv_data;
 	end = c + v->mv_size;
 	while (c < end) {
-		hex(*c++);
+		hex(fp, *c++);
 	}
-	putchar('\n');
+	putc('\n', fp);
+}
+
+/* Big-endian 32 bit length, followed by the raw bytes */
+static void binlen(FILE *fp, unsigned int len)
+{
+	putc(len >> 24, fp);
+	putc((len >> 16) & 0xff, fp);
+	putc((len >> 8) & 0xff, fp);
+	putc(len & 0xff, fp);
+}
+
+static int binary(FILE *fp, MDB_val *v)
+{
+	if (v->mv_size >= BINARY_END)
+		return MDB_BAD_VALSIZE;
+	binlen(fp, v->mv_size);
+	if (v->mv_size && fwrite(v->mv_data, v->mv_size, 1, fp) != 1)
+		return errno;
+	return MDB_SUCCESS;
 }
 
-/* Dump in BDB-compatible format */
-static int dumpit(MDB_txn *txn, MDB_dbi dbi, char *name)
+/* Dump in BDB-compatible format.
+ * If lo is given, start at the first key >= lo; if it is
+ * unset the range is empty. If hi is set, stop before the
+ * first key >= hi.
+ */
+static int dumpit(FILE *fp, MDB_txn *txn, MDB_dbi dbi, char *name,
+	MDB_val *lo, MDB_val *hi)
 {
 	MDB_cursor *mc;
 	MDB_stat ms;
 	MDB_val key, data;
 	MDB_envinfo info;
+	MDB_cursor_op op = MDB_FIRST;
 	unsigned int flags;
 	int rc, i;
 
@@ -112,52 +153,318 @@ static int dumpit(MDB_txn *txn, MDB_dbi dbi, char *name)
 	rc = mdb_env_info(mdb_txn_env(txn), &info);
 	if (rc) return rc;
 
-	printf("VERSION=3\n");
-	printf("format=%s\n", mode & PRINT ? "print" : "bytevalue");
+	fprintf(fp, "VERSION=3\n");
+	fprintf(fp, "format=%s\n", mode & BINARY ? "binary" :
+		mode & PRINT ? "print" : "bytevalue");
 	if (name)
-		printf("database=%s\n", name);
-	printf("type=btree\n");
-	printf("mapsize=%" Z "u\n", info.me_mapsize);
+		fprintf(fp, "database=%s\n", name);
+	fprintf(fp, "type=btree\n");
+	fprintf(fp, "mapsize=%" Z "u\n", info.me_mapsize);
 	if (info.me_mapaddr)
-		printf("mapaddr=%p\n", info.me_mapaddr);
-	printf("maxreaders=%u\n", info.me_maxreaders);
+		fprintf(fp, "mapaddr=%p\n", info.me_mapaddr);
+	fprintf(fp, "maxreaders=%u\n", info.me_maxreaders);
 
 	if (flags & MDB_DUPSORT)
-		printf("duplicates=1\n");
+		fprintf(fp, "duplicates=1\n");
 
 	for (i=0; dbflags[i].bit; i++)
 		if (flags & dbflags[i].bit)
-			printf("%s=1\n", dbflags[i].name);
+			fprintf(fp, "%s=1\n", dbflags[i].name);
 
-	printf("db_pagesize=%d\n", ms.ms_psize);
-	printf("HEADER=END\n");
+	fprintf(fp, "db_pagesize=%d\n", ms.ms_psize);
+	fprintf(fp, "HEADER=END\n");
 
 	rc = mdb_cursor_open(txn, dbi, &mc);
 	if (rc) return rc;
 
-	while ((rc = mdb_cursor_get(mc, &key, &data, MDB_NEXT) == MDB_SUCCESS)) {
+	if (lo) {
+		key = *lo;
+		op = MDB_SET_RANGE;
+	}
+
+	while ((!lo || lo->mv_data) &&
+		(rc = mdb_cursor_get(mc, &key, &data, op)) == MDB_SUCCESS) {
+		op = MDB_NEXT;
 		if (gotsig) {
 			rc = EINTR;
 			break;
 		}
-		if (mode & PRINT) {
-			text(&key);
-			text(&data);
+		if (hi && hi->mv_data && mdb_cmp(txn, dbi, &key, hi) >= 0) {
+			rc = MDB_NOTFOUND;
+			break;
+		}
+		if (mode & BINARY) {
+			if ((rc = binary(fp, &key)) || (rc = binary(fp, &data)))
+				break;
+		} else if (mode & PRINT) {
+			text(fp, &key);
+			text(fp, &data);
 		} else {
-			byte(&key);
-			byte(&data);
+			byte(fp, &key);
+			byte(fp, &data);
 		}
 	}
-	printf("DATA=END\n");
+	mdb_cursor_close(mc);
+	if (mode & BINARY)
+		binlen(fp, BINARY_END);
+	else
+		fprintf(fp, "DATA=END\n");
 	if (rc == MDB_NOTFOUND)
 		rc = MDB_SUCCESS;
 
 	return rc;
 }
 
+/* Pick nsplit-1 keys that cut the DB into ranges of roughly
+ * equal key space. The split points are interpolated between
+ * the first and last keys and then snapped to existing keys,
+ * so this only costs a few tree descents but assumes keys are
+ * spread evenly. bounds[0] and bounds[nsplit] are left unset,
+ * as is every bound past the last key. Reverse-ordered keys
+ * are not split at all.
+ */
+static int splitit(MDB_txn *txn, MDB_dbi dbi, int nsplit, MDB_val *bounds)
+{
+	MDB_cursor *mc;
+	MDB_val first, last, key, data;
+	unsigned char *probe = NULL;
+	size_t lo = 0, hi = 0, p, pre = 0;
+	unsigned int flags;
+	int rc, i, j, width = 8, intkey = 0, maxkey;
+
+	for (i=0; i<=nsplit; i++) {
+		bounds[i].mv_size = 0;
+		bounds[i].mv_data = NULL;
+	}
+
+	rc = mdb_dbi_flags(txn, dbi, &flags);
+	if (rc) return rc;
+	if (nsplit < 2 || (flags & MDB_REVERSEKEY))
+		return MDB_SUCCESS;
+
+	rc = mdb_cursor_open(txn, dbi, &mc);
+	if (rc) return rc;
+
+	rc = mdb_cursor_get(mc, &first, &data, MDB_FIRST);
+	if (!rc)
+		rc = mdb_cursor_get(mc, &last, &data, MDB_LAST);
+	if (rc) goto done;
+
+	maxkey = mdb_env_get_maxkeysize(mdb_txn_env(txn));
+	probe = malloc(maxkey + sizeof(size_t));
+	if (!probe) {
+		rc = ENOMEM;
+		goto done;
+	}
+	if ((flags & MDB_INTEGERKEY) && first.mv_size == last.mv_size &&
+		(first.mv_size == sizeof(unsigned int) ||
+		first.mv_size == sizeof(size_t))) {
+		intkey = 1;
+		if (first.mv_size == sizeof(size_t)) {
+			memcpy(&lo, first.mv_data, sizeof(size_t));
+			memcpy(&hi, last.mv_data, sizeof(size_t));
+		} else {
+			unsigned int u;
+			memcpy(&u, first.mv_data, sizeof(u)); lo = u;
+			memcpy(&u, last.mv_data, sizeof(u)); hi = u;
+		}
+	} else {
+		unsigned char *f = first.mv_data, *l = last.mv_data;
+		while (pre < first.mv_size && pre < last.mv_size &&
+			f[pre] == l[pre])
+			pre++;
+		if (pre + width > (size_t)maxkey)
+			width = maxkey - pre;
+		if (width > (int)sizeof(size_t))
+			width = sizeof(size_t);
+		for (j=0; j<width; j++) {
+			lo <<= 8; hi <<= 8;
+			if (pre + j < first.mv_size) lo |= f[pre + j];
+			if (pre + j < last.mv_size) hi |= l[pre + j];
+		}
+		memcpy(probe, first.mv_data, pre);
+	}
+	if (hi <= lo)
+		goto done;
+
+	for (i=1; i<nsplit; i++) {
+		p = lo + (hi - lo) / nsplit * i + (hi - lo) % nsplit * i / nsplit;
+		if (intkey) {
+			if (first.mv_size == sizeof(size_t)) {
+				memcpy(probe, &p, sizeof(size_t));
+			} else {
+				unsigned int u = p;
+				memcpy(probe, &u, sizeof(u));
+			}
+			key.mv_size = first.mv_size;
+		} else {
+			for (j=width-1; j>=0; j--) {
+				probe[pre + j] = p & 0xff;
+				p >>= 8;
+			}
+			key.mv_size = pre + width;
+		}
+		key.mv_data = probe;
+		rc = mdb_cursor_get(mc, &key, &data, MDB_SET_RANGE);
+		if (rc) break;
+		/* points into the map, valid for the life of txn */
+		bounds[i] = key;
+	}
+
+done:
+	free(probe);
+	mdb_cursor_close(mc);
+	if (rc == MDB_NOTFOUND)
+		rc = MDB_SUCCESS;
+	return rc;
+}
+
+typedef struct dumpdb {
+	MDB_dbi dbi;
+	char *name;
+	MDB_val *bounds;
+} dumpdb;
+
+static dumpdb *dbs;
+static int ndbs;
+
+typedef struct dumpjob {
+	MDB_txn *txn;
+	FILE *fp;
+	int idx;
+	int rc;
+	thread_t thr;
+} dumpjob;
+
+/* Write range idx of every database to one stream */
+static THREAD_RET dumpthr(void *arg)
+{
+	dumpjob *job = arg;
+	int i;
+
+	for (i=0; i<ndbs; i++) {
+		job->rc = dumpit(job->fp, job->txn, dbs[i].dbi, dbs[i].name,
+			job->idx ? &dbs[i].bounds[job->idx] : NULL,
+			&dbs[i].bounds[job->idx+1]);
+		if (job->rc)
+			break;
+	}
+	return (THREAD_RET)0;
+}
+
+/* Dump the databases in dbs[] into nsplit streams named
+ * outname.0 .. outname.<nsplit-1>, one thread per stream.
+ * Every thread gets its own read txn; they must all see the
+ * same snapshot, so retry while a writer is committing.
+ */
+static int dumpsplit(MDB_env *env, int nsplit, char *outname)
+{
+	dumpjob *jobs;
+	char *fname;
+	int i, rc = 0, tries;
+
+	jobs = calloc(nsplit, sizeof(dumpjob));
+	fname = malloc(strlen(outname) + 16);
+	if (!jobs || !fname) {
+		free(jobs);
+		return ENOMEM;
+	}
+
+	for (tries = 0; tries < 10; tries++) {
+		for (i=0; i<nsplit; i++) {
+			rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &jobs[i].txn);
+			if (rc) break;
+			if (mdb_txn_id(jobs[i].txn) != mdb_txn_id(jobs[0].txn)) {
+				mdb_txn_abort(jobs[i].txn);
+				rc = MDB_BAD_TXN;
+				break;
+			}
+		}
+		if (!rc) break;
+		while (--i >= 0)
+			mdb_txn_abort(jobs[i].txn);
+		if (rc != MDB_BAD_TXN)
+			goto leave;
+	}
+	if (rc)
+		goto leave;
+
+	for (i=0; i<ndbs; i++) {
+		dbs[i].bounds = calloc(nsplit + 1, sizeof(MDB_val));
+		if (!dbs[i].bounds) {
+			rc = ENOMEM;
+			goto txn_abort;
+		}
+		rc = splitit(jobs[0].txn, dbs[i].dbi, nsplit, dbs[i].bounds);
+		if (rc)
+			goto txn_abort;
+	}
+
+	for (i=0; i<nsplit; i++) {
+		sprintf(fname, "%s.%d", outname, i);
+		jobs[i].idx = i;
+		jobs[i].fp = fopen(fname, "w");
+		if (!jobs[i].fp) {
+			rc = errno;
+			break;
+		}
+	}
+	if (!rc) {
+		for (i=0; i<nsplit; i++) {
+			rc = THREAD_CREATE(jobs[i].thr, dumpthr, &jobs[i]);
+			if (rc) break;
+		}
+		while (--i >= 0) {
+			THREAD_FINISH(jobs[i].thr);
+			if (jobs[i].rc && !rc)
+				rc = jobs[i].rc;
+		}
+	}
+	for (i=0; i<nsplit; i++) {
+		if (jobs[i].fp && fclose(jobs[i].fp) && !rc)
+			rc = errno;
+	}
+
+txn_abort:
+	for (i=0; i<nsplit; i++)
+		mdb_txn_abort(jobs[i].txn);
+leave:
+	for (i=0; i<ndbs; i++)
+		free(dbs[i].bounds);
+	free(fname);
+	free(jobs);
+	return rc;
+}
+
+/* Count the named databases, to size maxdbs for dumpsplit */
+static int countdbs(char *envname, int envflags)
+{
+	MDB_env *env;
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_dbi dbi;
+	MDB_val key;
+	int count = 0;
+
+	if (mdb_env_create(&env))
+		return 0;
+	if (!mdb_env_open(env, envname, envflags | MDB_RDONLY, 0664) &&
+		!mdb_txn_begin(env, NULL, MDB_RDONLY, &txn)) {
+		if (!mdb_open(txn, NULL, 0, &dbi) &&
+			!mdb_cursor_open(txn, dbi, &mc)) {
+			while (mdb_cursor_get(mc, &key, NULL, MDB_NEXT_NODUP) == 0)
+				count++;
+			mdb_cursor_close(mc);
+		}
+		mdb_txn_abort(txn);
+	}
+	mdb_env_close(env);
+	return count;
+}
+
 static void usage(char *prog)
 {
-	fprintf(stderr, "usage: %s [-V] [-f output] [-l] [-n] [-p] [-a|-s subdb] dbpath\n", prog);
+	fprintf(stderr, "usage: %s [-V] [-f output] [-j streams] [-l] [-n] [-p|-b] [-a|-s subdb] dbpath\n", prog);
 	exit(EXIT_FAILURE);
 }
 
@@ -169,8 +476,8 @@ int main(int argc, char *argv[])
 	MDB_dbi dbi;
 	char *prog = argv[0];
 	char *envname;
-	char *subname = NULL;
-	int alldbs = 0, envflags = 0, list = 0;
+	char *subname = NULL, *outname = NULL;
+	int alldbs = 0, envflags = 0, list = 0, nsplit = 0;
 
 	if (argc < 2) {
 		usage(prog);
@@ -180,11 +487,13 @@ int main(int argc, char *argv[])
 	 * -s: dump only the named subDB
 	 * -n: use NOSUBDIR flag on env_open
 	 * -p: use printable characters
+	 * -b: use binary framing
 	 * -f: write to file instead of stdout
+	 * -j: split each DB into N streams written in parallel
 	 * -V: print version and exit
 	 * (default) dump only the main DB
 	 */
-	while ((i = getopt(argc, argv, "af:lnps:V")) != EOF) {
+	while ((i = getopt(argc, argv, "abf:j:lnps:V")) != EOF) {
 		switch(i) {
 		case 'V':
 			printf("%s\n", MDB_VERSION_STRING);
@@ -198,12 +507,16 @@ int main(int argc, char *argv[])
 				usage(prog);
 			alldbs++;
 			break;
+		case 'b':
+			mode |= BINARY;
+			break;
 		case 'f':
-			if (freopen(optarg, "w", stdout) == NULL) {
-				fprintf(stderr, "%s: %s: reopen: %s\n",
-					prog, optarg, strerror(errno));
-				exit(EXIT_FAILURE);
-			}
+			outname = optarg;
+			break;
+		case 'j':
+			nsplit = atoi(optarg);
+			if (nsplit < 1)
+				usage(prog);
 			break;
 		case 'n':
 			envflags |= MDB_NOSUBDIR;
@@ -224,6 +537,23 @@ int main(int argc, char *argv[])
 	if (optind != argc - 1)
 		usage(prog);
 
+	if ((mode & BINARY) && (mode & PRINT))
+		usage(prog);
+
+	if (list)
+		nsplit = 0;
+
+	if (nsplit) {
+		if (!outname) {
+			fprintf(stderr, "%s: -j requires -f\n", prog);
+			exit(EXIT_FAILURE);
+		}
+	} else if (outname && freopen(outname, "w", stdout) == NULL) {
+		fprintf(stderr, "%s: %s: reopen: %s\n",
+			prog, outname, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
 #ifdef SIGPIPE
 	signal(SIGPIPE, dumpsig);
 #endif
@@ -240,7 +570,16 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	if (alldbs || subname) {
+	if (nsplit) {
+		/* every stream needs its own read txn in this thread,
+		 * and every DB stays open until all streams are done
+		 */
+		envflags |= MDB_NOTLS;
+		if (alldbs)
+			mdb_env_set_maxdbs(env, countdbs(envname, envflags) + 2);
+		else if (subname)
+			mdb_env_set_maxdbs(env, 2);
+	} else if (alldbs || subname) {
 		mdb_env_set_maxdbs(env, 2);
 	}
 
@@ -286,8 +625,20 @@ int main(int argc, char *argv[])
 				if (list) {
 					printf("%s\n", str);
 					list++;
+				} else if (nsplit) {
+					/* dumped by dumpsplit() below */
+					dumpdb *d = realloc(dbs, (ndbs+1) * sizeof(dumpdb));
+					if (!d) {
+						rc = ENOMEM;
+						free(str);
+						break;
+					}
+					dbs = d;
+					dbs[ndbs].dbi = db2;
+					dbs[ndbs++].name = str;
+					continue;
 				} else {
-					rc = dumpit(txn, db2, str);
+					rc = dumpit(stdout, txn, db2, str, NULL, NULL);
 					if (rc)
 						break;
 				}
@@ -303,12 +654,34 @@ int main(int argc, char *argv[])
 		} else if (rc == MDB_NOTFOUND) {
 			rc = MDB_SUCCESS;
 		}
+	} else if (nsplit) {
+		dbs = malloc(sizeof(dumpdb));
+		if (dbs) {
+			dbs[0].dbi = dbi;
+			dbs[0].name = subname;
+			ndbs = 1;
+		} else {
+			rc = ENOMEM;
+		}
 	} else {
-		rc = dumpit(txn, dbi, subname);
+		rc = dumpit(stdout, txn, dbi, subname, NULL, NULL);
+	}
+
+	if (nsplit && !rc) {
+		/* publish the DB handles to the stream txns */
+		rc = mdb_txn_commit(txn);
+		txn = NULL;
+		if (!rc)
+			rc = dumpsplit(env, nsplit, outname);
 	}
 	if (rc && rc != MDB_NOTFOUND)
 		fprintf(stderr, "%s: %s: %s\n", prog, envname, mdb_strerror(rc));
 
+	if (alldbs) {
+		for (i=0; i<ndbs; i++)
+			free(dbs[i].name);
+	}
+	free(dbs);
 	mdb_close(env, dbi);
 txn_abort:
 	mdb_txn_abort(txn);
@@ -21,6 +21,8 @@
 
 #define PRINT	1
 #define NOHDR	2
+#define BINARY	4
+#define APPEND	8
 static int mode;
 
 static char *subname = NULL;
@@ -69,6 +71,7 @@ static void readhdr(void)
 	char *ptr;
 
 	flags = 0;
+	mode &= ~(PRINT|BINARY);
 	while (fgets(dbuf.mv_data, dbuf.mv_size, stdin) != NULL) {
 		lineno++;
 		if (!strncmp(dbuf.mv_data, "VERSION=", STRLENOF("VERSION="))) {
@@ -83,6 +86,8 @@ static void readhdr(void)
 		} else if (!strncmp(dbuf.mv_data, "format=", STRLENOF("format="))) {
 			if (!strncmp((char *)dbuf.mv_data+STRLENOF("FORMAT="), "print", STRLENOF("print")))
 				mode |= PRINT;
+			else if (!strncmp((char *)dbuf.mv_data+STRLENOF("FORMAT="), "binary", STRLENOF("binary")))
+				mode |= BINARY;
 			else if (strncmp((char *)dbuf.mv_data+STRLENOF("FORMAT="), "bytevalue", STRLENOF("bytevalue"))) {
 				fprintf(stderr, "%s: line %" Z "d: unsupported FORMAT %s\n",
 					prog, lineno, (char *)dbuf.mv_data+STRLENOF("FORMAT="));
@@ -174,12 +179,50 @@ static int unhex(unsigned char *c2)
 	return c;
 }
 
+/* Read a length-prefixed item written by mdb_dump -b */
+static int readbin(MDB_val *out, MDB_val *buf)
+{
+	unsigned char lbuf[4];
+	size_t len;
+
+	if (fread(lbuf, sizeof(lbuf), 1, stdin) != 1) {
+		Eof = 1;
+		return EOF;
+	}
+	len = ((size_t)lbuf[0] << 24) | (lbuf[1] << 16) | (lbuf[2] << 8) | lbuf[3];
+	if (len == 0xffffffffU)		/* end of data */
+		return EOF;
+	if (len > buf->mv_size) {
+		void *ptr = realloc(buf->mv_data, len);
+		if (!ptr) {
+			Eof = 1;
+			fprintf(stderr, "%s: item %" Z "d: out of memory, item too long\n",
+				prog, lineno);
+			return EOF;
+		}
+		buf->mv_data = ptr;
+		buf->mv_size = len;
+	}
+	if (len && fread(buf->mv_data, len, 1, stdin) != 1) {
+		Eof = 1;
+		badend();
+		return EOF;
+	}
+	lineno++;
+	out->mv_data = buf->mv_data;
+	out->mv_size = len;
+	return 0;
+}
+
 static int readline(MDB_val *out, MDB_val *buf)
 {
 	unsigned char *c1, *c2, *end;
 	size_t len, l2;
 	int c;
 
+	if (mode & BINARY)
+		return readbin(out, buf);
+
 	if (!(mode & NOHDR)) {
 		c = fgetc(stdin);
 		if (c == EOF) {
@@ -278,7 +321,7 @@ badend:
 
 static void usage(void)
 {
-	fprintf(stderr, "usage: %s [-V] [-f input] [-n] [-s name] [-N] [-T] dbpath\n", prog);
+	fprintf(stderr, "usage: %s [-V] [-a] [-f input] [-n] [-s name] [-N] [-T] dbpath\n", prog);
 	exit(EXIT_FAILURE);
 }
 
@@ -289,6 +332,7 @@ int main(int argc, char *argv[])
 	MDB_txn *txn;
 	MDB_cursor *mc;
 	MDB_dbi dbi;
+	MDB_val prevk;
 	char *envname;
 	int envflags = 0, putflags = 0;
 	int dohdr = 0;
@@ -299,19 +343,23 @@ int main(int argc, char *argv[])
 		usage();
 	}
 
-	/* -f: load file instead of stdin
+	/* -a: append records in input order
+	 * -f: load file instead of stdin
 	 * -n: use NOSUBDIR flag on env_open
 	 * -s: load into named subDB
 	 * -N: use NOOVERWRITE on puts
 	 * -T: read plaintext
 	 * -V: print version and exit
 	 */
-	while ((i = getopt(argc, argv, "f:ns:NTV")) != EOF) {
+	while ((i = getopt(argc, argv, "af:ns:NTV")) != EOF) {
 		switch(i) {
 		case 'V':
 			printf("%s\n", MDB_VERSION_STRING);
 			exit(0);
 			break;
+		case 'a':
+			mode |= APPEND;
+			break;
 		case 'f':
 			if (freopen(optarg, "r", stdin) == NULL) {
 				fprintf(stderr, "%s: %s: reopen: %s\n",
@@ -363,6 +411,12 @@ int main(int argc, char *argv[])
 	if (info.me_mapaddr)
 		envflags |= MDB_FIXEDMAP;
 
+	/* a bulk load is redone from scratch if it fails, so don't
+	 * sync each batch; the env is synced once at the end instead
+	 */
+	if (mode & APPEND)
+		envflags |= MDB_NOSYNC;
+
 	rc = mdb_env_open(env, envname, envflags, 0664);
 	if (rc) {
 		fprintf(stderr, "mdb_env_open failed, error %d %s\n", rc, mdb_strerror(rc));
@@ -371,6 +425,8 @@ int main(int argc, char *argv[])
 
 	kbuf.mv_size = mdb_env_get_maxkeysize(env) * 2 + 2;
 	kbuf.mv_data = malloc(kbuf.mv_size);
+	prevk.mv_size = 0;
+	prevk.mv_data = malloc(kbuf.mv_size);
 
 	while(!Eof) {
 		MDB_val key, data;
@@ -399,7 +455,10 @@ int main(int argc, char *argv[])
 			goto txn_abort;
 		}
 
+		prevk.mv_size = 0;
 		while(1) {
+			int appflag = 0;
+
 			rc = readline(&key, &kbuf);
 			if (rc)  /* rc == EOF */
 				break;
@@ -410,7 +469,22 @@ int main(int argc, char *argv[])
 				goto txn_abort;
 			}
 
-			rc = mdb_cursor_put(mc, &key, &data, putflags);
+			if (mode & APPEND) {
+				appflag = MDB_APPEND;
+				if (flags & MDB_DUPSORT) {
+					if (prevk.mv_size == key.mv_size &&
+						!memcmp(prevk.mv_data, key.mv_data, key.mv_size))
+						appflag = MDB_APPEND|MDB_APPENDDUP;
+					else {
+						memcpy(prevk.mv_data, key.mv_data, key.mv_size);
+						prevk.mv_size = key.mv_size;
+					}
+				}
+			}
+			rc = mdb_cursor_put(mc, &key, &data, putflags|appflag);
+			/* out of order for the default comparators, insert normally */
+			if (rc == MDB_KEYEXIST && appflag)
+				rc = mdb_cursor_put(mc, &key, &data, putflags);
 			if (rc == MDB_KEYEXIST && putflags)
 				continue;
 			if (rc) {
@@ -448,6 +522,12 @@ int main(int argc, char *argv[])
 		mdb_dbi_close(env, dbi);
 	}
 
+	if (mode & APPEND) {
+		rc = mdb_env_sync(env, 1);
+		if (rc)
+			fprintf(stderr, "mdb_env_sync failed, error %d %s\n", rc, mdb_strerror(rc));
+	}
+
 txn_abort:
 	mdb_txn_abort(txn);
 env_close:
@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include "lmdb.h"
 
@@ -35,9 +36,69 @@ static void prstat(MDB_stat *ms)
 	printf("  Entries: %"Z"u\n", ms->ms_entries);
 }
 
+static void prhist(char *title, size_t *hist, char *unit)
+{
+	int i;
+
+	printf("  %s:\n", title);
+	for (i=0; i<MDB_WALK_BUCKETS; i++) {
+		if (!hist[i])
+			continue;
+		if (i < 2)
+			printf("    %"Z"u %s: %"Z"u\n", (size_t)i, unit, hist[i]);
+		else if (i < MDB_WALK_BUCKETS-1)
+			printf("    %"Z"u-%"Z"u %s: %"Z"u\n", (size_t)1 << (i-1),
+				((size_t)1 << i) - 1, unit, hist[i]);
+		else
+			printf("    %"Z"u+ %s: %"Z"u\n", (size_t)1 << (i-1), unit, hist[i]);
+	}
+}
+
+static void prwalk(MDB_walkstat *mw, unsigned int psize)
+{
+	int i;
+
+	if (mw->mw_branch_pages)
+		printf("  Branch page fill: %.1f%%\n",
+			100.0 * mw->mw_branch_used / (mw->mw_branch_pages * psize));
+	if (mw->mw_leaf_pages) {
+		printf("  Leaf page fill: %.1f%%\n",
+			100.0 * mw->mw_leaf_used / (mw->mw_leaf_pages * psize));
+		for (i=0; i<10; i++)
+			if (mw->mw_fill[i])
+				printf("    %d-%d%%: %"Z"u\n", i*10, i*10+9 + (i == 9),
+					mw->mw_fill[i]);
+	}
+	printf("  Data items: %"Z"u\n", mw->mw_entries);
+	prhist("Key sizes", mw->mw_keysize, "bytes");
+	prhist("Data sizes", mw->mw_datasize, "bytes");
+	if (mw->mw_overflow_pages)
+		prhist("Overflow items", mw->mw_overflow, "pages");
+}
+
+static int walkdb(MDB_txn *txn, MDB_dbi dbi, unsigned int threads, unsigned int psize)
+{
+	MDB_walkstat mw;
+	int rc;
+
+	rc = mdb_stat_walk(txn, dbi, &mw, threads);
+	if (rc) {
+		fprintf(stderr, "mdb_stat_walk failed, error %d %s\n", rc, mdb_strerror(rc));
+		return rc;
+	}
+	prwalk(&mw, psize);
+	return 0;
+}
+
+static int pgcmp(const void *a, const void *b)
+{
+	size_t x = *(const size_t *)a, y = *(const size_t *)b;
+	return x < y ? -1 : x > y;
+}
+
 static void usage(char *prog)
 {
-	fprintf(stderr, "usage: %s [-V] [-n] [-e] [-r[r]] [-f[f[f]]] [-a|-s subdb] dbpath\n", prog);
+	fprintf(stderr, "usage: %s [-V] [-n] [-e] [-r[r]] [-f[f[f]]] [-d] [-j threads] [-a|-s subdb] dbpath\n", prog);
 	exit(EXIT_FAILURE);
 }
 
@@ -49,10 +110,14 @@ int main(int argc, char *argv[])
 	MDB_dbi dbi;
 	MDB_stat mst;
 	MDB_envinfo mei;
+	unsigned int psize;
 	char *prog = argv[0];
 	char *envname;
 	char *subname = NULL;
 	int alldbs = 0, envinfo = 0, envflags = 0, freinfo = 0, rdrinfo = 0;
+	int deep = 0;
+	unsigned int threads = 1;
+	char *end;
 
 	if (argc < 2) {
 		usage(prog);
@@ -63,11 +128,13 @@ int main(int argc, char *argv[])
 	 * -e: print env info
 	 * -f: print freelist info
 	 * -r: print reader info
+	 * -d: print detailed stats, walking the DBs
+	 * -j: number of threads for -d
 	 * -n: use NOSUBDIR flag on env_open
 	 * -V: print version and exit
 	 * (default) print stat of only the main DB
 	 */
-	while ((i = getopt(argc, argv, "Vaefnrs:")) != EOF) {
+	while ((i = getopt(argc, argv, "Vadefj:nrs:")) != EOF) {
 		switch(i) {
 		case 'V':
 			printf("%s\n", MDB_VERSION_STRING);
@@ -78,12 +145,20 @@ int main(int argc, char *argv[])
 				usage(prog);
 			alldbs++;
 			break;
+		case 'd':
+			deep++;
+			break;
 		case 'e':
 			envinfo++;
 			break;
 		case 'f':
 			freinfo++;
 			break;
+		case 'j':
+			threads = strtoul(optarg, &end, 0);
+			if (*end || !threads)
+				usage(prog);
+			break;
 		case 'n':
 			envflags |= MDB_NOSUBDIR;
 			break;
@@ -120,8 +195,9 @@ int main(int argc, char *argv[])
 		goto env_close;
 	}
 
+	(void)mdb_env_stat(env, &mst);
+	psize = mst.ms_psize;
 	if (envinfo) {
-		(void)mdb_env_stat(env, &mst);
 		(void)mdb_env_info(env, &mei);
 		printf("Environment Info\n");
 		printf("  Map address: %p\n", mei.me_mapaddr);
@@ -156,7 +232,7 @@ int main(int argc, char *argv[])
 	if (freinfo) {
 		MDB_cursor *cursor;
 		MDB_val key, data;
-		size_t pages = 0, *iptr;
+		size_t pages = 0, *iptr, *pgs = NULL, npgs = 0;
 
 		printf("Freelist Status\n");
 		dbi = 0;
@@ -174,6 +250,17 @@ int main(int argc, char *argv[])
 		while ((rc = mdb_cursor_get(cursor, &key, &data, MDB_NEXT)) == 0) {
 			iptr = data.mv_data;
 			pages += *iptr;
+			if (deep) {
+				size_t *p2 = realloc(pgs, pages * sizeof(size_t));
+				if (!p2) {
+					fprintf(stderr, "out of memory\n");
+					rc = ENOMEM;
+					goto txn_abort;
+				}
+				pgs = p2;
+				memcpy(pgs + npgs, iptr + 1, *iptr * sizeof(size_t));
+				npgs = pages;
+			}
 			if (freinfo > 1) {
 				char *bad = "";
 				size_t pg, prev;
@@ -201,6 +288,26 @@ int main(int argc, char *argv[])
 		}
 		mdb_cursor_close(cursor);
 		printf("  Free pages: %"Z"u\n", pages);
+		if (deep) {
+			size_t runs[MDB_WALK_BUCKETS] = {0}, nruns = 0, maxrun = 0, j, span;
+			unsigned int b;
+
+			qsort(pgs, npgs, sizeof(size_t), pgcmp);
+			for (j = 0; j < npgs; j += span) {
+				for (span = 1; j + span < npgs && pgs[j+span] == pgs[j]+span; span++) ;
+				for (b = 0; b < MDB_WALK_BUCKETS-1 && span >> b; b++) ;
+				runs[b]++;
+				nruns++;
+				if (span > maxrun)
+					maxrun = span;
+			}
+			free(pgs);
+			printf("  Free runs: %"Z"u, longest %"Z"u pages\n", nruns, maxrun);
+			prhist("Free runs", runs, "pages");
+			(void)mdb_env_info(env, &mei);
+			printf("  Compacted size estimate: %"Z"u pages\n", mei.me_last_pgno+1 -
+				pages - mst.ms_branch_pages - mst.ms_leaf_pages - mst.ms_overflow_pages);
+		}
 	}
 
 	rc = mdb_open(txn, subname, 0, &dbi);
@@ -216,6 +323,8 @@ int main(int argc, char *argv[])
 	}
 	printf("Status of %s\n", subname ? subname : "Main DB");
 	prstat(&mst);
+	if (deep && (rc = walkdb(txn, dbi, threads, psize)))
+		goto txn_abort;
 
 	if (alldbs) {
 		MDB_cursor *cursor;
@@ -245,6 +354,8 @@ int main(int argc, char *argv[])
 				goto txn_abort;
 			}
 			prstat(&mst);
+			if (deep && (rc = walkdb(txn, db2, threads, psize)))
+				goto txn_abort;
 			mdb_close(env, db2);
 		}
 		mdb_cursor_close(cursor);
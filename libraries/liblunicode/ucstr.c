@@ -110,6 +110,7 @@ struct berval * UTF8bvnormalize(
 {
 	int i, j, len, clen, outpos, ucsoutlen, outsize, last;
 	int didnewbv = 0;
+	unsigned char any;
 	char *out, *outtmp, *s;
 	ac_uint4 *ucs, *p, *ucsout;
 
@@ -141,6 +142,32 @@ struct berval * UTF8bvnormalize(
 	 * the normalization though.
 	 */
 
+	/* Most strings are pure ASCII and only need case folding. Check
+	 * for that in a single pass without branches, which the compiler
+	 * can vectorize.
+	 */
+	for ( i = 0, any = 0; i < len; i++ ) {
+		any |= s[i];
+	}
+	if ( !( any & 0x80 ) ) {
+		if ( !casefold ) {
+			return ber_str2bv_x( s, len, 1, newbv, ctx );
+		}
+		out = (char *) ber_memalloc_x( len + 1, ctx );
+		if ( out == NULL ) {
+			if ( didnewbv )
+				ber_memfree_x( newbv, ctx );
+			return NULL;
+		}
+		for ( i = 0; i < len; i++ ) {
+			out[i] = TOLOWER( s[i] );
+		}
+		out[len] = '\0';
+		newbv->bv_val = out;
+		newbv->bv_len = len;
+		return newbv;
+	}
+
 	/* finish off everything up to character before first non-ascii */
 	if ( LDAP_UTF8_ISASCII( s ) ) {
 		if ( casefold ) {
@@ -51,6 +51,29 @@ static const char Base64[] =
 	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 static const char Pad64 = '=';
 
+/* value of each Base64 digit, 0xff for anything else */
+static const unsigned char Base64rev[0x80] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+	0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b,
+	0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+	0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+	0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
+	0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20,
+	0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30,
+	0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+#define B64VAL(c)	( (unsigned char)(c) < 0x80 \
+	? Base64rev[ (unsigned char)(c) ] : 0xff )
+
 /* (From RFC1521 and draft-ietf-dnssec-secext-03.txt)
    The following encoding technique is taken from RFC 1521 by Borenstein
    and Freed.  It is reproduced here in a slightly edited form for
@@ -192,7 +215,7 @@ lutil_b64_pton(
 	size_t targsize)
 {
 	int tarindex, state, ch;
-	char *pos;
+	unsigned int pos, pos1, pos2, pos3;
 
 	state = 0;
 	tarindex = 0;
@@ -204,16 +227,32 @@ lutil_b64_pton(
 		if (ch == Pad64)
 			break;
 
-		pos = strchr(Base64, ch);
-		if (pos == 0) 		/* A non-base64 character. */
+		pos = B64VAL(ch);
+		if (pos > 0x3f) 	/* A non-base64 character. */
 			return (-1);
 
+		/* Most input comes in whole quads without whitespace or
+		 * padding; those are stored at once. */
+		if (state == 0 && target &&
+			(size_t)tarindex + 3 <= targsize &&
+			(pos1 = B64VAL(src[0])) <= 0x3f &&
+			(pos2 = B64VAL(src[1])) <= 0x3f &&
+			(pos3 = B64VAL(src[2])) <= 0x3f)
+		{
+			target[tarindex]   = pos << 2 | pos1 >> 4;
+			target[tarindex+1] = (pos1 & 0x0f) << 4 | pos2 >> 2;
+			target[tarindex+2] = (pos2 & 0x03) << 6 | pos3;
+			tarindex += 3;
+			src += 3;
+			continue;
+		}
+
 		switch (state) {
 		case 0:
 			if (target) {
 				if ((size_t)tarindex >= targsize)
 					return (-1);
-				target[tarindex] = (pos - Base64) << 2;
+				target[tarindex] = pos << 2;
 			}
 			state = 1;
 			break;
@@ -221,8 +260,8 @@ lutil_b64_pton(
 			if (target) {
 				if ((size_t)tarindex + 1 >= targsize)
 					return (-1);
-				target[tarindex]   |=  (pos - Base64) >> 4;
-				target[tarindex+1]  = ((pos - Base64) & 0x0f)
+				target[tarindex]   |=  pos >> 4;
+				target[tarindex+1]  = (pos & 0x0f)
 							<< 4 ;
 			}
 			tarindex++;
@@ -232,8 +271,8 @@ lutil_b64_pton(
 			if (target) {
 				if ((size_t)tarindex + 1 >= targsize)
 					return (-1);
-				target[tarindex]   |=  (pos - Base64) >> 2;
-				target[tarindex+1]  = ((pos - Base64) & 0x03)
+				target[tarindex]   |=  pos >> 2;
+				target[tarindex+1]  = (pos & 0x03)
 							<< 6;
 			}
 			tarindex++;
@@ -243,7 +282,7 @@ lutil_b64_pton(
 			if (target) {
 				if ((size_t)tarindex >= targsize)
 					return (-1);
-				target[tarindex] |= (pos - Base64);
+				target[tarindex] |= pos;
 			}
 			tarindex++;
 			state = 0;
@@ -0,0 +1,204 @@
+/* csn.c - Change Sequence Number parsing and formatting */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2005-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "lutil.h"
+
+/*
+ * A CSN in its current form has a fixed width,
+ *
+ *	YYYYmmddHHMMSS.uuuuuuZ#cccccc#sid#mmmmmm
+ *
+ * so each field is at a known offset and is converted in place, without
+ * looking for the separators or going through strtol() and snprintf().
+ * Older forms of CSN are left to the callers.
+ */
+
+#define CSN_COUNT	23
+#define CSN_SID		30
+#define CSN_MOD		34
+
+static const char hexdigits[] = "0123456789abcdef";
+
+static const char decpairs[] =
+	"00010203040506070809101112131415161718192021222324"
+	"25262728293031323334353637383940414243444546474849"
+	"50515253545556575859606162636465666768697071727374"
+	"75767778798081828384858687888990919293949596979899";
+
+/* returns the value of n decimal digits, or -1 */
+static int
+csn_dec( const char *s, int n )
+{
+	int i, c, v = 0;
+
+	for ( i = 0; i < n; i++ ) {
+		c = s[i] - '0';
+		if ( (unsigned) c > 9 )
+			return -1;
+		v = v * 10 + c;
+	}
+	return v;
+}
+
+/* returns the value of n hex digits of either case, or -1 */
+static int
+csn_hex( const char *s, int n )
+{
+	int i, c, v = 0;
+
+	for ( i = 0; i < n; i++ ) {
+		c = s[i];
+		if ( (unsigned)( c - '0' ) <= 9 ) {
+			c -= '0';
+		} else {
+			c = ( c | 0x20 ) - 'a';
+			if ( (unsigned) c > 5 )
+				return -1;
+			c += 10;
+		}
+		v = v << 4 | c;
+	}
+	return v;
+}
+
+static int
+csn_separators( const char *s, size_t len )
+{
+	return len == LUTIL_CSNSTR_LEN && s[14] == '.' && s[21] == 'Z' &&
+		s[22] == '#' && s[29] == '#' && s[33] == '#';
+}
+
+/*
+ * Parse a CSN into csn. The date and time are checked as strictly as
+ * for a GeneralizedTime, leap seconds included. Returns 0, or -1 if str
+ * is not a valid CSN of the current form.
+ */
+int
+lutil_csnparse( const char *str, size_t len, lutil_csn *csn )
+{
+	static const int mdays[2][12] = {
+		{ 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 },
+		{ 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 }
+	};
+	int cc, yy, mon, mday, hour, min, sec, usec, leap;
+	int count, sid, mod;
+
+	if ( !csn_separators( str, len ))
+		return -1;
+
+	cc = csn_dec( str, 2 );
+	yy = csn_dec( str + 2, 2 );
+	mon = csn_dec( str + 4, 2 );
+	mday = csn_dec( str + 6, 2 );
+	hour = csn_dec( str + 8, 2 );
+	min = csn_dec( str + 10, 2 );
+	sec = csn_dec( str + 12, 2 );
+	usec = csn_dec( str + 15, 6 );
+	count = csn_hex( str + CSN_COUNT, 6 );
+	sid = csn_hex( str + CSN_SID, 3 );
+	mod = csn_hex( str + CSN_MOD, 6 );
+
+	if (( cc | yy | mon | mday | hour | min | sec | usec |
+		count | sid | mod ) < 0 )
+		return -1;
+
+	/* the same Gregorian rule as the GeneralizedTime syntax */
+	leap = ( yy ? yy : cc ) % 4 == 0;
+	if ( mon < 1 || mon > 12 || mday < 1 || mday > mdays[leap][mon - 1] ||
+		hour > 23 || min > 59 || sec > 60 )
+		return -1;
+
+	csn->cs_time.tm_year = cc * 100 + yy - 1900;
+	csn->cs_time.tm_mon = mon - 1;
+	csn->cs_time.tm_mday = mday;
+	csn->cs_time.tm_hour = hour;
+	csn->cs_time.tm_min = min;
+	csn->cs_time.tm_sec = sec;
+	csn->cs_time.tm_usec = usec;
+	csn->cs_time.tm_usub = count;
+	csn->cs_sid = sid;
+	csn->cs_mod = mod;
+	return 0;
+}
+
+/*
+ * Return the SID of a CSN of the current form, or -1. Only the
+ * separators and the SID itself are looked at.
+ */
+int
+lutil_csnsid( const char *str, size_t len )
+{
+	if ( !csn_separators( str, len ))
+		return -1;
+	return csn_hex( str + CSN_SID, 3 );
+}
+
+static char *
+csn_putdec( char *p, unsigned int v )
+{
+	memcpy( p, decpairs + 2 * ( v % 100 ), 2 );
+	return p + 2;
+}
+
+static char *
+csn_puthex( char *p, unsigned int v, int n )
+{
+	while ( n-- )
+		*p++ = hexdigits[ ( v >> ( 4 * n )) & 0xf ];
+	return p;
+}
+
+/*
+ * Write csn into buf, NUL terminated. Returns the length of the
+ * string, or 0 if buf is too small.
+ */
+size_t
+lutil_csnstr( const lutil_csn *csn, char *buf, size_t len )
+{
+	const struct lutil_tm *tm = &csn->cs_time;
+	unsigned int year = tm->tm_year + 1900;
+	char *p = buf;
+
+	if ( len <= LUTIL_CSNSTR_LEN )
+		return 0;
+
+	p = csn_putdec( p, year / 100 );
+	p = csn_putdec( p, year );
+	p = csn_putdec( p, tm->tm_mon + 1 );
+	p = csn_putdec( p, tm->tm_mday );
+	p = csn_putdec( p, tm->tm_hour );
+	p = csn_putdec( p, tm->tm_min );
+	p = csn_putdec( p, tm->tm_sec );
+	*p++ = '.';
+	p = csn_putdec( p, tm->tm_usec / 10000 );
+	p = csn_putdec( p, tm->tm_usec / 100 );
+	p = csn_putdec( p, tm->tm_usec );
+	*p++ = 'Z';
+	*p++ = '#';
+	p = csn_puthex( p, tm->tm_usub, 6 );
+	*p++ = '#';
+	p = csn_puthex( p, csn->cs_sid, 3 );
+	*p++ = '#';
+	p = csn_puthex( p, csn->cs_mod, 6 );
+	*p = '\0';
+
+	return p - buf;
+}
@@ -139,3 +139,123 @@ lutil_HASH64Final( unsigned char *digest, lutil_HASH_CTX *ctx )
 	digest[7] = (h>>56) & 0xffU;
 }
 #endif /* HAVE_LONG_LONG */
+
+#ifdef HAVE_LONG_LONG
+
+/* 64 bit hash after Wang Yi's wyhash (public domain), final version 3.
+ * Octets are read as little-endian words whatever the host order, so
+ * the hashes stored in indices are portable. The 128 bit products are
+ * computed in pieces where the compiler has no 128 bit type, with the
+ * same results.
+ */
+
+#define WY_P0	0xa0761d6478bd642fULL
+#define WY_P1	0xe7037ed1a0b428dbULL
+#define WY_P2	0x8ebc6af09c88c6e3ULL
+#define WY_P3	0x589965cc75374cc3ULL
+
+static unsigned long long
+wy_mix( unsigned long long a, unsigned long long b )
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 r = (unsigned __int128)a * b;
+
+	return (unsigned long long)r ^ (unsigned long long)(r >> 64);
+#else
+	unsigned long long ha = a >> 32, hb = b >> 32,
+		la = (unsigned)a, lb = (unsigned)b, hi, lo,
+		rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb,
+		t = rl + (rm0 << 32), c = t < rl;
+
+	lo = t + (rm1 << 32);
+	c += lo < t;
+	hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+	return lo ^ hi;
+#endif
+}
+
+static unsigned long long
+wy_r8( const unsigned char *p )
+{
+	return (unsigned long long)p[0] | (unsigned long long)p[1] << 8 |
+		(unsigned long long)p[2] << 16 | (unsigned long long)p[3] << 24 |
+		(unsigned long long)p[4] << 32 | (unsigned long long)p[5] << 40 |
+		(unsigned long long)p[6] << 48 | (unsigned long long)p[7] << 56;
+}
+
+static unsigned long long
+wy_r4( const unsigned char *p )
+{
+	return (unsigned long long)p[0] | (unsigned long long)p[1] << 8 |
+		(unsigned long long)p[2] << 16 | (unsigned long long)p[3] << 24;
+}
+
+/*
+ * Initialize context
+ */
+void
+lutil_WYHASH64Init( lutil_HASH_CTX *ctx )
+{
+	ctx->hash64 = WY_P0;
+}
+
+/*
+ * Update hash
+ */
+void
+lutil_WYHASH64Update(
+    lutil_HASH_CTX	*ctx,
+    const unsigned char		*buf,
+    ber_len_t		len )
+{
+	const unsigned char *p = buf;
+	unsigned long long seed = ctx->hash64, a, b;
+	ber_len_t i = len;
+
+	if ( len <= 16 ) {
+		if ( len >= 4 ) {
+			a = wy_r4( p ) << 32 | wy_r4( p + ((len >> 3) << 2) );
+			b = wy_r4( p + len - 4 ) << 32 |
+				wy_r4( p + len - 4 - ((len >> 3) << 2) );
+		} else if ( len > 0 ) {
+			a = (unsigned long long)p[0] << 16 |
+				(unsigned long long)p[len >> 1] << 8 | p[len - 1];
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		/* three independent lanes keep the multipliers busy */
+		if ( i > 48 ) {
+			unsigned long long s1 = seed, s2 = seed;
+
+			do {
+				seed = wy_mix( wy_r8( p ) ^ WY_P1, wy_r8( p + 8 ) ^ seed );
+				s1 = wy_mix( wy_r8( p + 16 ) ^ WY_P2, wy_r8( p + 24 ) ^ s1 );
+				s2 = wy_mix( wy_r8( p + 32 ) ^ WY_P3, wy_r8( p + 40 ) ^ s2 );
+				p += 48;
+				i -= 48;
+			} while ( i > 48 );
+			seed ^= s1 ^ s2;
+		}
+		while ( i > 16 ) {
+			seed = wy_mix( wy_r8( p ) ^ WY_P1, wy_r8( p + 8 ) ^ seed );
+			p += 16;
+			i -= 16;
+		}
+		a = wy_r8( p + i - 16 );
+		b = wy_r8( p + i - 8 );
+	}
+
+	ctx->hash64 = wy_mix( WY_P1 ^ len, wy_mix( a ^ WY_P1, b ^ seed ) );
+}
+
+/*
+ * Save hash
+ */
+void
+lutil_WYHASH64Final( unsigned char digest[LUTIL_HASH64_BYTES], lutil_HASH_CTX *ctx )
+{
+	lutil_HASH64Final( digest, ctx );
+}
+#endif /* HAVE_LONG_LONG */
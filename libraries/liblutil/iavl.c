@@ -0,0 +1,336 @@
+/* iavl.c - routines to implement an intrusive avl tree */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2005-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/stdlib.h>
+
+#define AVL_INTERNAL
+#include "avl.h"
+
+/*
+ * Intrusive AVL trees - the node is a member of the caller's structure,
+ * so inserting and deleting never allocate. Nodes know their parent, so
+ * a known element can be removed without comparisons, and walking the
+ * tree needs no stack and no state outside the tree.
+ *
+ * The comparison function gets the elements themselves, as with
+ * avl_insert(), so the AVL_CMP functions of plain trees can be reused.
+ */
+
+#define I2E(t,n)	((void *)((char *)(n) - (t)->avl_offset))
+#define E2I(t,e)	((IAvlnode *)((char *)(e) + (t)->avl_offset))
+
+void
+iavl_init( IAvltree *tree, AVL_CMP fcmp, int offset )
+{
+	tree->avl_root = NULL;
+	tree->avl_cmp = fcmp;
+	tree->avl_offset = offset;
+}
+
+/* make c the child of p that o was */
+static void
+iavl_relink( IAvltree *tree, IAvlnode *p, IAvlnode *o, IAvlnode *c )
+{
+	if ( p == NULL )
+		tree->avl_root = c;
+	else
+		p->avl_link[ p->avl_link[1] == o ] = c;
+}
+
+/* rotate x down on side dir, its child on the other side takes its place */
+static IAvlnode *
+iavl_rotate( IAvltree *tree, IAvlnode *x, int dir )
+{
+	IAvlnode *c = x->avl_link[!dir], *p = x->avl_up;
+
+	x->avl_link[!dir] = c->avl_link[dir];
+	if ( c->avl_link[dir] )
+		c->avl_link[dir]->avl_up = x;
+	c->avl_link[dir] = x;
+	x->avl_up = c;
+	c->avl_up = p;
+	iavl_relink( tree, p, x, c );
+	return c;
+}
+
+/* x is out of balance by 2, return the new root of its subtree */
+static IAvlnode *
+iavl_rebalance( IAvltree *tree, IAvlnode *x )
+{
+	int dir = x->avl_bf > 0, s = dir ? RH : LH;
+	IAvlnode *c = x->avl_link[dir], *g;
+
+	if ( c->avl_bf == -s ) {
+		/* double rotation */
+		g = c->avl_link[!dir];
+		iavl_rotate( tree, c, dir );
+		iavl_rotate( tree, x, !dir );
+		if ( g->avl_bf == s ) {
+			x->avl_bf = -s;
+			c->avl_bf = EH;
+		} else if ( g->avl_bf == -s ) {
+			x->avl_bf = EH;
+			c->avl_bf = s;
+		} else {
+			x->avl_bf = c->avl_bf = EH;
+		}
+		g->avl_bf = EH;
+		return g;
+	}
+
+	iavl_rotate( tree, x, !dir );
+	if ( c->avl_bf == EH ) {
+		/* only after a delete, the height is unchanged */
+		x->avl_bf = s;
+		c->avl_bf = -s;
+	} else {
+		x->avl_bf = c->avl_bf = EH;
+	}
+	return c;
+}
+
+/*
+ * iavl_insert -- insert data into the tree. Returns 0 if it was inserted,
+ * otherwise the return value of fdup, which is called as by avl_insert()
+ * with the element already in the tree and data.
+ */
+int
+iavl_insert( IAvltree *tree, void *data, AVL_DUP fdup )
+{
+	IAvlnode *n = E2I( tree, data ), *p = NULL, **q = &tree->avl_root;
+	int cmp, dir = 0;
+
+	while ( *q ) {
+		p = *q;
+		cmp = tree->avl_cmp( data, I2E( tree, p ));
+		if ( cmp == 0 )
+			return (*fdup)( I2E( tree, p ), data );
+		dir = cmp > 0;
+		q = &p->avl_link[dir];
+	}
+
+	n->avl_link[0] = n->avl_link[1] = NULL;
+	n->avl_up = p;
+	n->avl_bf = EH;
+	*q = n;
+
+	/* the subtree on side dir of p grew */
+	while ( p ) {
+		p->avl_bf += dir ? RH : LH;
+		if ( p->avl_bf == EH )
+			break;
+		if ( p->avl_bf != LH && p->avl_bf != RH ) {
+			iavl_rebalance( tree, p );
+			break;
+		}
+		n = p;
+		p = p->avl_up;
+		if ( p )
+			dir = p->avl_link[1] == n;
+	}
+	return 0;
+}
+
+/* put n's in-order successor s in n's place, and n in s's */
+static void
+iavl_swap( IAvltree *tree, IAvlnode *n, IAvlnode *s )
+{
+	IAvlnode *np = n->avl_up, *nl = n->avl_link[0], *nr = n->avl_link[1];
+	IAvlnode *sp = s->avl_up, *sr = s->avl_link[1];
+	signed char bf = n->avl_bf;
+
+	n->avl_bf = s->avl_bf;
+	s->avl_bf = bf;
+
+	iavl_relink( tree, np, n, s );
+	s->avl_up = np;
+	s->avl_link[0] = nl;
+	nl->avl_up = s;
+	if ( nr == s ) {
+		s->avl_link[1] = n;
+		n->avl_up = s;
+	} else {
+		s->avl_link[1] = nr;
+		nr->avl_up = s;
+		sp->avl_link[0] = n;
+		n->avl_up = sp;
+	}
+	n->avl_link[0] = NULL;
+	n->avl_link[1] = sr;
+	if ( sr )
+		sr->avl_up = n;
+}
+
+/*
+ * iavl_remove -- remove data, which must be in the tree, and return it.
+ */
+void *
+iavl_remove( IAvltree *tree, void *data )
+{
+	IAvlnode *n = E2I( tree, data ), *p, *c;
+	int dir, bf;
+
+	if ( n->avl_link[0] && n->avl_link[1] ) {
+		for ( c = n->avl_link[1]; c->avl_link[0]; c = c->avl_link[0] )
+			;
+		iavl_swap( tree, n, c );
+	}
+
+	/* n has at most one child now */
+	p = n->avl_up;
+	c = n->avl_link[ n->avl_link[0] == NULL ];
+	if ( c )
+		c->avl_up = p;
+	if ( p == NULL ) {
+		tree->avl_root = c;
+		return data;
+	}
+	dir = p->avl_link[1] == n;
+	p->avl_link[dir] = c;
+
+	/* the subtree on side dir of p shrank */
+	for (;;) {
+		p->avl_bf -= dir ? RH : LH;
+		if ( p->avl_bf == LH || p->avl_bf == RH )
+			break;
+		if ( p->avl_bf != EH ) {
+			bf = p->avl_link[ p->avl_bf > 0 ]->avl_bf;
+			p = iavl_rebalance( tree, p );
+			if ( bf == EH )
+				break;
+		}
+		n = p;
+		p = p->avl_up;
+		if ( p == NULL )
+			break;
+		dir = p->avl_link[1] == n;
+	}
+	return data;
+}
+
+/*
+ * iavl_find3 -- find the element matching data, or the last one visited
+ * while looking for it; *ret is set to the result of comparing data with
+ * the element returned.
+ */
+void *
+iavl_find3( IAvltree *tree, const void *data, int *ret )
+{
+	IAvlnode *n = tree->avl_root, *prev = NULL;
+	int cmp = -1;
+
+	while ( n ) {
+		prev = n;
+		cmp = tree->avl_cmp( data, I2E( tree, n ));
+		if ( cmp == 0 )
+			break;
+		n = n->avl_link[ cmp > 0 ];
+	}
+	*ret = cmp;
+	return prev ? I2E( tree, prev ) : NULL;
+}
+
+void *
+iavl_find( IAvltree *tree, const void *data )
+{
+	IAvlnode *n = tree->avl_root;
+	int cmp;
+
+	while ( n ) {
+		cmp = tree->avl_cmp( data, I2E( tree, n ));
+		if ( cmp == 0 )
+			return I2E( tree, n );
+		n = n->avl_link[ cmp > 0 ];
+	}
+	return NULL;
+}
+
+/*
+ * iavl_delete -- remove the element matching data and return it,
+ * or NULL if there is none.
+ */
+void *
+iavl_delete( IAvltree *tree, const void *data )
+{
+	void *e = iavl_find( tree, data );
+
+	if ( e )
+		iavl_remove( tree, e );
+	return e;
+}
+
+/* Return the leftmost or rightmost element */
+void *
+iavl_end( IAvltree *tree, int dir )
+{
+	IAvlnode *n = tree->avl_root;
+
+	if ( n == NULL )
+		return NULL;
+	while ( n->avl_link[dir] )
+		n = n->avl_link[dir];
+	return I2E( tree, n );
+}
+
+/* Return the element after data in the given direction */
+void *
+iavl_next( IAvltree *tree, void *data, int dir )
+{
+	IAvlnode *n = E2I( tree, data );
+
+	if ( n->avl_link[dir] ) {
+		for ( n = n->avl_link[dir]; n->avl_link[!dir]; n = n->avl_link[!dir] )
+			;
+		return I2E( tree, n );
+	}
+	while ( n->avl_up && n->avl_up->avl_link[dir] == n )
+		n = n->avl_up;
+	n = n->avl_up;
+	return n ? I2E( tree, n ) : NULL;
+}
+
+/*
+ * iavl_free -- empty the tree, calling dfree on each element if it is
+ * not NULL. Returns the number of elements.
+ */
+int
+iavl_free( IAvltree *tree, AVL_FREE dfree )
+{
+	IAvlnode *n = tree->avl_root, *p;
+	int nn = 0;
+
+	/* post-order, each element is freed after its children */
+	while ( n ) {
+		if ( n->avl_link[0] ) {
+			n = n->avl_link[0];
+		} else if ( n->avl_link[1] ) {
+			n = n->avl_link[1];
+		} else {
+			p = n->avl_up;
+			if ( p )
+				p->avl_link[ p->avl_link[1] == n ] = NULL;
+			if ( dfree )
+				(*dfree)( I2E( tree, n ));
+			nn++;
+			n = p;
+		}
+	}
+	tree->avl_root = NULL;
+	return nn;
+}
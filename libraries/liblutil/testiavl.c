@@ -0,0 +1,149 @@
+/* testiavl.c - Test intrusive AVL code */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2005-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include <ac/stdlib.h>
+
+#define AVL_INTERNAL
+#include "avl.h"
+
+/* Random inserts and deletes, checking the tree against a
+ * membership array after each step.
+ */
+
+#define NITEMS	2000
+#define NSTEPS	200000
+
+typedef struct item {
+	int key;
+	int in;
+	IAvlnode node;
+} item;
+
+static item items[NITEMS];
+
+static int
+item_cmp( const void *a, const void *b )
+{
+	const item *i1 = a, *i2 = b;
+
+	return i1->key - i2->key;
+}
+
+/* returns the height of the subtree, exits on any inconsistency */
+static int
+check( IAvlnode *n, IAvlnode *up )
+{
+	int l, r;
+
+	if ( n == NULL )
+		return 0;
+	if ( n->avl_up != up ) {
+		fprintf( stderr, "bad parent link\n" );
+		exit( EXIT_FAILURE );
+	}
+	l = check( n->avl_left, n );
+	r = check( n->avl_right, n );
+	if ( r - l != n->avl_bf || r - l > 1 || l - r > 1 ) {
+		fprintf( stderr, "bad balance %d (%d-%d)\n", n->avl_bf, r, l );
+		exit( EXIT_FAILURE );
+	}
+	return ( l > r ? l : r ) + 1;
+}
+
+int
+main( int argc, char **argv )
+{
+	IAvltree tree = IAVL_INIT( item, node, item_cmp );
+	item *it, key;
+	int i, n, step, count = 0, ret;
+
+	srand( argc > 1 ? atoi( argv[1] ) : 1 );
+	for ( i = 0; i < NITEMS; i++ )
+		items[i].key = i * 2;
+
+	for ( step = 0; step < NSTEPS; step++ ) {
+		it = &items[ rand() % NITEMS ];
+		if ( it->in ) {
+			if ( rand() & 1 ) {
+				key.key = it->key;
+				if ( iavl_delete( &tree, &key ) != it ) {
+					fprintf( stderr, "delete %d failed\n", it->key );
+					exit( EXIT_FAILURE );
+				}
+			} else {
+				iavl_remove( &tree, it );
+			}
+			it->in = 0;
+			count--;
+		} else {
+			if ( iavl_insert( &tree, it, avl_dup_error )) {
+				fprintf( stderr, "insert %d failed\n", it->key );
+				exit( EXIT_FAILURE );
+			}
+			if ( iavl_insert( &tree, it, avl_dup_error ) != -1 ) {
+				fprintf( stderr, "duplicate %d inserted\n", it->key );
+				exit( EXIT_FAILURE );
+			}
+			it->in = 1;
+			count++;
+		}
+
+		if ( step % 97 )
+			continue;
+
+		check( tree.avl_root, NULL );
+
+		/* walk both ways */
+		n = 0;
+		for ( it = iavl_end( &tree, TAVL_DIR_LEFT ), i = -1; it;
+			it = iavl_next( &tree, it, TAVL_DIR_RIGHT )) {
+			if ( it->key <= i || !it->in ) {
+				fprintf( stderr, "bad order at %d\n", it->key );
+				exit( EXIT_FAILURE );
+			}
+			i = it->key;
+			n++;
+		}
+		for ( it = iavl_end( &tree, TAVL_DIR_RIGHT ); it;
+			it = iavl_next( &tree, it, TAVL_DIR_LEFT ))
+			n--;
+		if ( n || ( i < 0 && count )) {
+			fprintf( stderr, "walk saw the wrong number of items\n" );
+			exit( EXIT_FAILURE );
+		}
+
+		/* odd keys are never present, find3 lands next to them */
+		key.key = ( rand() % NITEMS ) * 2 + 1;
+		it = iavl_find3( &tree, &key, &ret );
+		if ( count && ( !it || !ret || ( ret < 0 ) != ( key.key < it->key ))) {
+			fprintf( stderr, "find3 %d failed\n", key.key );
+			exit( EXIT_FAILURE );
+		}
+	}
+
+	n = iavl_free( &tree, NULL );
+	if ( n != count || tree.avl_root ) {
+		fprintf( stderr, "free saw %d items, expected %d\n", n, count );
+		exit( EXIT_FAILURE );
+	}
+	printf( "ok\n" );
+	return 0;
+}
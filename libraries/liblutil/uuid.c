@@ -387,8 +387,10 @@ lutil_uuidstr_from_normalized(
 	char		*buf,
 	size_t		buflen )
 {
-	unsigned char nibble;
-	int i, d = 0;
+	static const char hexdigits[] = "0123456789abcdef";
+	unsigned char *u = (unsigned char *) uuid;
+	char *p = buf;
+	int i;
 
 	assert( uuid != NULL );
 	assert( buf != NULL );
@@ -398,23 +400,10 @@ lutil_uuidstr_from_normalized(
 
 	for ( i = 0; i < 16; i++ ) {
 		if ( i == 4 || i == 6 || i == 8 || i == 10 ) {
-			buf[(i<<1)+d] = '-';
-			d += 1;
-		}
-
-		nibble = (uuid[i] >> 4) & 0xF;
-		if ( nibble < 10 ) {
-			buf[(i<<1)+d] = nibble + '0';
-		} else {
-			buf[(i<<1)+d] = nibble - 10 + 'a';
-		}
-
-		nibble = (uuid[i]) & 0xF;
-		if ( nibble < 10 ) {
-			buf[(i<<1)+d+1] = nibble + '0';
-		} else {
-			buf[(i<<1)+d+1] = nibble - 10 + 'a';
+			*p++ = '-';
 		}
+		*p++ = hexdigits[ u[i] >> 4 ];
+		*p++ = hexdigits[ u[i] & 0xF ];
 	}
 
 	if ( buflen > 36 ) buf[36] = '\0';
@@ -34,12 +34,30 @@ rewrite_parse_builtin_map(
 		char **argv
 );
 
+/*
+ * Resizes the result cache of each context
+ */
+static int
+rewrite_cache_init_cb(
+		void *c_context,
+		void *c_info
+)
+{
+	if ( rewrite_context_cache_init( (struct rewrite_info *)c_info,
+			(struct rewrite_context *)c_context ) != REWRITE_SUCCESS ) {
+		return -1;
+	}
+
+	return 0;
+}
+
 /*
  * Parses a config line and takes actions to fit content in rewrite structure;
  * lines handled are of the form:
  *
  *      rewriteEngine 		{on|off}
  *      rewriteMaxPasses        numPasses [numPassesPerRule]
+ *      rewriteCache		numEntries
  *      rewriteContext 		contextName [alias aliasedContextName]
  *      rewriteRule 		pattern substPattern [ruleFlags]
  *      rewriteMap 		mapType mapName [mapArgs]
@@ -138,6 +156,35 @@ rewrite_parse(
 		}
 		rc = REWRITE_SUCCESS;
 	
+	/*
+	 * Sets the size of the per-context result caches
+	 */
+	} else if ( strcasecmp( argv[ 0 ], "rewriteCache" ) == 0 ) {
+		if ( argc < 2 ) {
+			Debug( LDAP_DEBUG_ANY,
+					"[%s:%d] rewriteCache needs 'value'\n",
+					fname, lineno );
+			return -1;
+		}
+
+		if ( lutil_atoi( &info->li_cache_size, argv[ 1 ] ) != 0 ) {
+			Debug( LDAP_DEBUG_ANY,
+					"[%s:%d] unable to parse rewriteCache=\"%s\"\n",
+					fname, lineno, argv[ 1 ] );
+			return -1;
+		}
+
+		if ( info->li_cache_size < 0 ) {
+			Debug( LDAP_DEBUG_ANY,
+					"[%s:%d] negative rewriteCache\n",
+					fname, lineno );
+			return -1;
+		}
+
+		rc = avl_apply( info->li_context, rewrite_cache_init_cb,
+				info, -1, AVL_INORDER );
+		rc = ( rc == -1 ) ? REWRITE_ERR : REWRITE_SUCCESS;
+		
 	/*
 	 * Start a new rewrite context and set current context
 	 */
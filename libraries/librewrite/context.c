@@ -140,6 +140,13 @@ rewrite_context_create(
 		return NULL;
 	}
 	memset( context->lc_rule, 0, sizeof( struct rewrite_rule ) );
+
+	if ( rewrite_context_cache_init( info, context ) != REWRITE_SUCCESS ) {
+		free( context->lc_rule );
+		free( context->lc_name );
+		free( context );
+		return NULL;
+	}
 	
 	/*
 	 * Add context to tree
@@ -147,6 +154,7 @@ rewrite_context_create(
 	rc = avl_insert( &info->li_context, (caddr_t)context,
 			rewrite_context_cmp, rewrite_context_dup );
 	if ( rc == -1 ) {
+		rewrite_context_cache_init( NULL, context );
 		free( context->lc_rule );
 		free( context->lc_name );
 		free( context );
@@ -156,6 +164,223 @@ rewrite_context_create(
 	return context;
 }
 
+static void
+rewrite_cache_free(
+		struct rewrite_cache *cache
+)
+{
+	int i;
+
+	for ( i = 0; i < cache->lca_size; i++ ) {
+		struct rewrite_cache_entry *ce = &cache->lca_entries[ i ];
+
+		if ( ce->lce_string ) {
+			free( ce->lce_string );
+		}
+		if ( ce->lce_result ) {
+			free( ce->lce_result );
+		}
+	}
+#ifdef USE_REWRITE_LDAP_PVT_THREADS
+	ldap_pvt_thread_mutex_destroy( &cache->lca_mutex );
+#endif /* USE_REWRITE_LDAP_PVT_THREADS */
+	free( cache->lca_entries );
+	free( cache );
+}
+
+/*
+ * (Re)creates the result cache of a context with the size
+ * set in info; a NULL info, or a null size, removes it
+ */
+int
+rewrite_context_cache_init(
+		struct rewrite_info *info,
+		struct rewrite_context *context
+)
+{
+	struct rewrite_cache *cache;
+
+	assert( context != NULL );
+
+	if ( context->lc_cache ) {
+		rewrite_cache_free( context->lc_cache );
+		context->lc_cache = NULL;
+	}
+
+	if ( info == NULL || info->li_cache_size <= 0 ) {
+		return REWRITE_SUCCESS;
+	}
+
+	cache = calloc( sizeof( struct rewrite_cache ), 1 );
+	if ( cache == NULL ) {
+		return REWRITE_ERR;
+	}
+	cache->lca_entries = calloc( sizeof( struct rewrite_cache_entry ),
+			info->li_cache_size );
+	if ( cache->lca_entries == NULL ) {
+		free( cache );
+		return REWRITE_ERR;
+	}
+	cache->lca_size = info->li_cache_size;
+#ifdef USE_REWRITE_LDAP_PVT_THREADS
+	ldap_pvt_thread_mutex_init( &cache->lca_mutex );
+#endif /* USE_REWRITE_LDAP_PVT_THREADS */
+
+	context->lc_cache = cache;
+
+	return REWRITE_SUCCESS;
+}
+
+static unsigned
+rewrite_cache_hash(
+		const char *string
+)
+{
+	const unsigned char *p = (const unsigned char *)string;
+	unsigned h = 2166136261U;
+
+	for ( ; p[ 0 ] != '\0'; p++ ) {
+		h = ( h ^ p[ 0 ] ) * 16777619U;
+	}
+
+	return h;
+}
+
+/*
+ * Returns 1 and sets result and rc if the result of applying
+ * context to string is known, 0 otherwise
+ */
+int
+rewrite_context_cache_get(
+		struct rewrite_context *context,
+		const char *string,
+		char **result,
+		int *rc
+)
+{
+	struct rewrite_cache *cache = context->lc_cache;
+	struct rewrite_cache_entry *ce;
+	unsigned h;
+	int found = 0;
+
+	if ( cache == NULL || context->lc_nmaps > 0 ) {
+		return 0;
+	}
+
+	h = rewrite_cache_hash( string );
+	ce = &cache->lca_entries[ h % cache->lca_size ];
+
+#ifdef USE_REWRITE_LDAP_PVT_THREADS
+	ldap_pvt_thread_mutex_lock( &cache->lca_mutex );
+#endif /* USE_REWRITE_LDAP_PVT_THREADS */
+	if ( ce->lce_string != NULL && ce->lce_hash == h
+			&& strcmp( ce->lce_string, string ) == 0 ) {
+		if ( ce->lce_same ) {
+			*result = (char *)string;
+		} else if ( ce->lce_result ) {
+			*result = strdup( ce->lce_result );
+		} else {
+			*result = NULL;
+		}
+		*rc = ce->lce_rc;
+		found = ( *result != NULL || ce->lce_result == NULL );
+	}
+#ifdef USE_REWRITE_LDAP_PVT_THREADS
+	ldap_pvt_thread_mutex_unlock( &cache->lca_mutex );
+#endif /* USE_REWRITE_LDAP_PVT_THREADS */
+
+	return found;
+}
+
+/*
+ * Remembers the result of applying context to string
+ */
+void
+rewrite_context_cache_put(
+		struct rewrite_context *context,
+		const char *string,
+		const char *result,
+		int rc
+)
+{
+	struct rewrite_cache *cache = context->lc_cache;
+	struct rewrite_cache_entry *ce;
+	char *s, *r = NULL;
+	unsigned h;
+
+	if ( cache == NULL || context->lc_nmaps > 0 ) {
+		return;
+	}
+
+	s = strdup( string );
+	if ( s == NULL ) {
+		return;
+	}
+	if ( result != NULL && result != string ) {
+		r = strdup( result );
+		if ( r == NULL ) {
+			free( s );
+			return;
+		}
+	}
+
+	h = rewrite_cache_hash( string );
+	ce = &cache->lca_entries[ h % cache->lca_size ];
+
+#ifdef USE_REWRITE_LDAP_PVT_THREADS
+	ldap_pvt_thread_mutex_lock( &cache->lca_mutex );
+#endif /* USE_REWRITE_LDAP_PVT_THREADS */
+	if ( ce->lce_string ) {
+		free( ce->lce_string );
+	}
+	if ( ce->lce_result ) {
+		free( ce->lce_result );
+	}
+	ce->lce_hash = h;
+	ce->lce_string = s;
+	ce->lce_result = r;
+	ce->lce_same = ( result != NULL && result == string );
+	ce->lce_rc = rc;
+#ifdef USE_REWRITE_LDAP_PVT_THREADS
+	ldap_pvt_thread_mutex_unlock( &cache->lca_mutex );
+#endif /* USE_REWRITE_LDAP_PVT_THREADS */
+}
+
+/*
+ * Forgets all the results of a context (e.g. after its rules changed)
+ */
+void
+rewrite_context_cache_flush(
+		struct rewrite_context *context
+)
+{
+	struct rewrite_cache *cache = context->lc_cache;
+	int i;
+
+	if ( cache == NULL ) {
+		return;
+	}
+
+#ifdef USE_REWRITE_LDAP_PVT_THREADS
+	ldap_pvt_thread_mutex_lock( &cache->lca_mutex );
+#endif /* USE_REWRITE_LDAP_PVT_THREADS */
+	for ( i = 0; i < cache->lca_size; i++ ) {
+		struct rewrite_cache_entry *ce = &cache->lca_entries[ i ];
+
+		if ( ce->lce_string ) {
+			free( ce->lce_string );
+			ce->lce_string = NULL;
+		}
+		if ( ce->lce_result ) {
+			free( ce->lce_result );
+			ce->lce_result = NULL;
+		}
+	}
+#ifdef USE_REWRITE_LDAP_PVT_THREADS
+	ldap_pvt_thread_mutex_unlock( &cache->lca_mutex );
+#endif /* USE_REWRITE_LDAP_PVT_THREADS */
+}
+
 /*
  * Finds the next rule according to a goto action statement,
  * or null in case of error.
@@ -463,6 +688,8 @@ rewrite_context_destroy(
 	free( context->lc_rule );
 	context->lc_rule = NULL;
 
+	rewrite_context_cache_init( NULL, context );
+
 	assert( context->lc_name != NULL );
 	free( context->lc_name );
 	context->lc_name = NULL;
@@ -235,10 +235,16 @@ rewrite_session(
 #endif
 	
 	/*
-	 * Applies rewrite context
+	 * Applies rewrite context, unless its result is already known
 	 */
-	rc = rewrite_context_apply( info, &op, context, string, result );
-	assert( op.lo_depth == 0 );
+	if ( !rewrite_context_cache_get( context, string, result, &rc ) ) {
+		rc = rewrite_context_apply( info, &op, context, string, result );
+		assert( op.lo_depth == 0 );
+
+		if ( rc != REWRITE_REGEXEC_ERR ) {
+			rewrite_context_cache_put( context, string, *result, rc );
+		}
+	}
 
 #if 0 /* FIXME: not used anywhere! (debug? then, why strdup?) */	
 	free( op.lo_string );
@@ -225,6 +225,13 @@ struct rewrite_rule {
 	 */
 
 	struct rewrite_subst           *lr_subst;
+
+	/*
+	 * Literal text any matching string must begin/end with,
+	 * checked before running the regex (may be empty)
+	 */
+	struct berval			lr_prefix;
+	struct berval			lr_suffix;
 	
 #define REWRITE_REGEX_ICASE		REG_ICASE
 #define REWRITE_REGEX_EXTENDED		REG_EXTENDED	
@@ -245,6 +252,32 @@ struct rewrite_context {
 	char                           *lc_name;
 	struct rewrite_context         *lc_alias;
 	struct rewrite_rule            *lc_rule;
+
+	/*
+	 * Results only depend on the input string if no rule uses maps;
+	 * only then they can be cached
+	 */
+	int				lc_nmaps;
+	struct rewrite_cache           *lc_cache;
+};
+
+/*
+ * Cache of recent results of a context (direct mapped)
+ */
+struct rewrite_cache_entry {
+	unsigned			lce_hash;
+	char                           *lce_string;
+	char                           *lce_result;
+	int				lce_same;	/* result is the input */
+	int				lce_rc;
+};
+
+struct rewrite_cache {
+	int				lca_size;
+	struct rewrite_cache_entry     *lca_entries;
+#ifdef USE_REWRITE_LDAP_PVT_THREADS
+	ldap_pvt_thread_mutex_t         lca_mutex;
+#endif /* USE_REWRITE_LDAP_PVT_THREADS */
 };
 
 /*
@@ -321,6 +354,12 @@ struct rewrite_info {
 	int                             li_max_passes;
 	int                             li_max_passes_per_rule;
 
+	/*
+	 * Defaults to 0 (no caching);
+	 * use `rewriteCache numEntries' directive to alter
+	 */
+	int                             li_cache_size;
+
 	/*
 	 * Behavior in case a NULL or non-existent context is required
 	 */
@@ -614,6 +653,39 @@ rewrite_context_apply(
 		char **result
 );
 
+/*
+ * Sets up the result cache of a context according to info
+ */
+LDAP_REWRITE_F (int)
+rewrite_context_cache_init(
+		struct rewrite_info *info,
+		struct rewrite_context *context
+);
+
+/*
+ * Looks up/stores the result of applying a context to a string
+ */
+LDAP_REWRITE_F (int)
+rewrite_context_cache_get(
+		struct rewrite_context *context,
+		const char *string,
+		char **result,
+		int *rc
+);
+
+LDAP_REWRITE_F (void)
+rewrite_context_cache_put(
+		struct rewrite_context *context,
+		const char *string,
+		const char *result,
+		int rc
+);
+
+LDAP_REWRITE_F (void)
+rewrite_context_cache_flush(
+		struct rewrite_context *context
+);
+
 LDAP_REWRITE_F (int)
 rewrite_context_destroy(
 		struct rewrite_context **context
@@ -112,6 +112,158 @@ destroy_actions(
 	}
 }
 
+#define REWRITE_REGEX_META	".[]()*+?{}|^$\\"
+
+/*
+ * Returns the literal character at p in an extended regex, if any,
+ * and sets *next past it
+ */
+static int
+literal_char(
+		const char *p,
+		const char **next
+)
+{
+	unsigned char c = (unsigned char)p[ 0 ];
+
+	if ( c == '\\' ) {
+		c = (unsigned char)p[ 1 ];
+		if ( c == '\0' || c >= 0x80 || !ispunct( c ) ) {
+			return -1;
+		}
+		*next = p + 2;
+		return c;
+	}
+
+	if ( c == '\0' || c >= 0x80 || strchr( REWRITE_REGEX_META, c ) ) {
+		return -1;
+	}
+	*next = p + 1;
+	return c;
+}
+
+/*
+ * Extracts the literal text a string must begin with (if the pattern
+ * is anchored by '^') and end with (if it is anchored by '$') to match
+ * the pattern, so that non-matching strings can mostly be told apart
+ * without running the regex.  Only plain ASCII text is considered,
+ * and patterns with alternatives or basic regex syntax are skipped.
+ * Helper for rewrite_rule_compile
+ */
+static int
+rule_literals(
+		struct rewrite_rule *rule,
+		const char *pattern,
+		int flags
+)
+{
+	const char *p, *next;
+	size_t len;
+	char *buf;
+	int c, i;
+
+	if ( !( flags & REWRITE_REGEX_EXTENDED ) || strchr( pattern, '|' ) ) {
+		return REWRITE_SUCCESS;
+	}
+
+	len = strlen( pattern );
+	buf = malloc( len + 1 );
+	if ( buf == NULL ) {
+		return REWRITE_ERR;
+	}
+
+	if ( pattern[ 0 ] == '^' ) {
+		for ( i = 0, p = pattern + 1; ( c = literal_char( p, &next ) ) != -1; p = next ) {
+			/* the char may not be there at all */
+			if ( next[ 0 ] == '*' || next[ 0 ] == '?' || next[ 0 ] == '{' ) {
+				break;
+			}
+			buf[ i++ ] = c;
+			if ( next[ 0 ] == '+' ) {
+				break;
+			}
+		}
+		if ( i > 0 ) {
+			buf[ i ] = '\0';
+			rule->lr_prefix.bv_len = i;
+			rule->lr_prefix.bv_val = strdup( buf );
+			if ( rule->lr_prefix.bv_val == NULL ) {
+				free( buf );
+				return REWRITE_ERR;
+			}
+		}
+	}
+
+	/*
+	 * Only unescaped chars are taken from the end, since
+	 * escapes are ambiguous when scanning backwards
+	 */
+	if ( len > 1 && pattern[ len - 1 ] == '$' && pattern[ len - 2 ] != '\\' ) {
+		for ( i = len - 2; i >= 0; i-- ) {
+			c = (unsigned char)pattern[ i ];
+			if ( c >= 0x80 || strchr( REWRITE_REGEX_META, c ) ) {
+				break;
+			}
+			if ( i > 0 && pattern[ i - 1 ] == '\\' ) {
+				break;
+			}
+		}
+		i++;
+		if ( i < len - 1 ) {
+			rule->lr_suffix.bv_len = len - 1 - i;
+			rule->lr_suffix.bv_val = malloc( rule->lr_suffix.bv_len + 1 );
+			if ( rule->lr_suffix.bv_val == NULL ) {
+				free( buf );
+				return REWRITE_ERR;
+			}
+			AC_MEMCPY( rule->lr_suffix.bv_val, &pattern[ i ],
+					rule->lr_suffix.bv_len );
+			rule->lr_suffix.bv_val[ rule->lr_suffix.bv_len ] = '\0';
+		}
+	}
+
+	free( buf );
+	return REWRITE_SUCCESS;
+}
+
+/*
+ * Tells whether string may match the rule, by its literal
+ * prefix and suffix
+ */
+static int
+rule_literals_match(
+		struct rewrite_rule *rule,
+		const char *string
+)
+{
+	size_t len;
+
+	if ( rule->lr_prefix.bv_len ) {
+		if ( ( rule->lr_flags & REWRITE_REGEX_ICASE )
+			? strncasecmp( string, rule->lr_prefix.bv_val, rule->lr_prefix.bv_len )
+			: strncmp( string, rule->lr_prefix.bv_val, rule->lr_prefix.bv_len ) )
+		{
+			return 0;
+		}
+	}
+
+	if ( rule->lr_suffix.bv_len ) {
+		len = strlen( string );
+		if ( len < rule->lr_suffix.bv_len ) {
+			return 0;
+		}
+		string += len - rule->lr_suffix.bv_len;
+		if ( ( rule->lr_flags & REWRITE_REGEX_ICASE )
+			? strcasecmp( string, rule->lr_suffix.bv_val )
+			: strcmp( string, rule->lr_suffix.bv_val ) )
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
 /*
  */
 int
@@ -126,6 +278,7 @@ rewrite_rule_compile(
 	int flags = REWRITE_REGEX_EXTENDED | REWRITE_REGEX_ICASE;
 	int mode = REWRITE_RECURSE;
 	int max_passes;
+	int i;
 
 	struct rewrite_rule *rule = NULL;
 	struct rewrite_subst *subst = NULL;
@@ -353,6 +506,11 @@ rewrite_rule_compile(
 		goto fail;
 	}
 	
+	if ( rule_literals( rule, pattern, flags ) != REWRITE_SUCCESS ) {
+		regfree( &rule->lr_regex );
+		goto fail;
+	}
+	
 	/*
 	 * Load compiled data into rule
 	 */
@@ -371,10 +529,23 @@ rewrite_rule_compile(
 	 */
 	append_rule( context, rule );
 
+	/*
+	 * Results of contexts using maps may depend on more than the input
+	 */
+	for ( i = 0; i < subst->lt_num_submatch; i++ ) {
+		if ( subst->lt_submatch[ i ].ls_type != REWRITE_SUBMATCH_ASIS ) {
+			context->lc_nmaps++;
+			break;
+		}
+	}
+	rewrite_context_cache_flush( context );
+
 	return REWRITE_SUCCESS;
 
 fail:
 	if ( rule ) {
+		if ( rule->lr_prefix.bv_val ) free( rule->lr_prefix.bv_val );
+		if ( rule->lr_suffix.bv_val ) free( rule->lr_suffix.bv_val );
 		if ( rule->lr_pattern ) free( rule->lr_pattern );
 		if ( rule->lr_subststring ) free( rule->lr_subststring );
 		if ( rule->lr_flagstring ) free( rule->lr_flagstring );
@@ -430,7 +601,11 @@ recurse:;
 	
 	op->lo_num_passes++;
 
-	rc = regexec( &rule->lr_regex, string, nmatch, match, 0 );
+	if ( rule_literals_match( rule, string ) ) {
+		rc = regexec( &rule->lr_regex, string, nmatch, match, 0 );
+	} else {
+		rc = REG_NOMATCH;
+	}
 	if ( rc != 0 ) {
 		if ( *result == NULL && string != arg ) {
 			free( string );
@@ -498,6 +673,14 @@ rewrite_rule_destroy(
 		rewrite_subst_destroy( &rule->lr_subst );
 	}
 
+	if ( rule->lr_prefix.bv_val ) {
+		free( rule->lr_prefix.bv_val );
+	}
+
+	if ( rule->lr_suffix.bv_val ) {
+		free( rule->lr_suffix.bv_val );
+	}
+
 	regfree( &rule->lr_regex );
 
 	destroy_actions( rule->lr_action );
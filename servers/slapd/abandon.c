@@ -75,27 +75,17 @@ do_abandon( Operation *op, SlapReply *rs )
 	ldap_pvt_thread_mutex_lock( &op->o_conn->c_mutex );
 
 	/* Find the operation being abandoned. */
-	LDAP_STAILQ_FOREACH( o, &op->o_conn->c_ops, o_next ) {
-		if ( o->o_msgid == id ) {
-			break;
-		}
-	}
+	o = connection_op_find( op->o_conn, id );
 
 	if ( o == NULL ) {
 		msg = "not found";
-		/* The operation is not active. Just discard it if found.  */
-		LDAP_STAILQ_FOREACH( o, &op->o_conn->c_pending_ops, o_next ) {
-			if ( o->o_msgid == id ) {
-				msg = "discarded";
-				/* FIXME: This traverses c_pending_ops yet again. */
-				LDAP_STAILQ_REMOVE( &op->o_conn->c_pending_ops,
-					o, Operation, o_next );
-				LDAP_STAILQ_NEXT(o, o_next) = NULL;
-				op->o_conn->c_n_ops_pending--;
-				slap_op_free( o, NULL );
-				break;
-			}
-		}
+
+	} else if ( o->o_pending ) {
+		/* The operation is not active. Just discard it. */
+		msg = "discarded";
+		connection_op_remove( op->o_conn, o );
+		op->o_conn->c_n_ops_pending--;
+		slap_op_free( o, NULL );
 
 	} else if ( o->o_tag == LDAP_REQ_BIND
 			|| o->o_tag == LDAP_REQ_UNBIND
@@ -69,7 +69,7 @@ static slap_control_t slap_acl_mask(
 	slap_access_t access );
 
 static int	regex_matches(
-	struct berval *pat, char *str,
+	Operation *op, struct berval *pat, char *str,
 	struct berval *dn_matches, struct berval *val_matches,
 	AclRegexMatches *matches);
 
@@ -120,6 +120,9 @@ slap_access_always_allowed(
 	return 1;
 }
 
+/* Slot of an ACL in AccessControlState.as_memo */
+#define ACL_MEMO_SLOT(a)	( ( (unsigned long)(a) >> 4 ) % ACL_MEMO_SLOTS )
+
 #define MATCHES_DNMAXCOUNT(m) 					\
 	( sizeof ( (m)->dn_data ) / sizeof( *(m)->dn_data ) )
 #define MATCHES_VALMAXCOUNT(m) 					\
@@ -220,6 +223,16 @@ slap_access_allowed(
 
 	if ( state == NULL )
 		state = &acl_state;
+
+	if ( state->as_memo.am_e != e ||
+		state->as_memo.am_ndn.bv_val != e->e_nname.bv_val ||
+		state->as_memo.am_ndn.bv_len != e->e_nname.bv_len )
+	{
+		state->as_memo = state_init.as_memo;
+		state->as_memo.am_e = e;
+		state->as_memo.am_ndn = e->e_nname;
+	}
+
 	if ( state->as_desc == desc &&
 		state->as_access == access &&
 		state->as_vd_acl_present )
@@ -230,7 +243,10 @@ slap_access_allowed(
 			state->as_fe_done--;
 		ACL_PRIV_ASSIGN( mask, state->as_vd_mask );
 	} else {
+		struct AclEntryMemo memo = state->as_memo;
+
 		*state = state_init;
+		state->as_memo = memo;
 
 		a = NULL;
 		count = 0;
@@ -367,6 +383,8 @@ access_allowed_mask(
 {
 	int				ret = 1;
 	int				be_null = 0;
+	int				timed;
+	struct timeval			start;
 
 #ifdef LDAP_DEBUG
 	char				accessmaskbuf[ACCESSMASK_MAXLEN];
@@ -444,6 +462,13 @@ access_allowed_mask(
 	}
 	assert( op->o_bd != NULL );
 
+	/* only the outermost check is timed, group and attribute
+	 * lookups may nest further ones */
+	timed = slap_op_timed();
+	if ( timed && op->o_acl_depth++ == 0 )
+		gettimeofday( &start, NULL );
+	SLAP_PROBE3( acl__start, op->o_connid, e->e_nname.bv_val, attr );
+
 	/* this is enforced in backend_add() */
 	if ( op->o_bd->bd_info->bi_access_allowed ) {
 		/* delegate to backend */
@@ -457,6 +482,10 @@ access_allowed_mask(
 				desc, val, access, state, &mask );
 	}
 
+	if ( timed && --op->o_acl_depth == 0 )
+		op->o_acl_usec += slap_histo_since( &start );
+	SLAP_PROBE2( acl__done, op->o_connid, ret );
+
 	if ( !ret ) {
 		if ( ACL_IS_INVALID( mask ) ) {
 			Debug( LDAP_DEBUG_ACL,
@@ -489,6 +518,82 @@ done:
 }
 
 
+/*
+ * Test the <what> DN pattern of an ACL
+ */
+static int
+slap_acl_dn_match(
+	AccessControl	*a,
+	int		count,
+	Entry		*e,
+	AclRegexMatches	*matches )
+{
+	ber_len_t dnlen = e->e_nname.bv_len;
+
+	if ( a->acl_dn_style == ACL_STYLE_REGEX ) {
+		Debug( LDAP_DEBUG_ACL, "=> dnpat: [%d] %s nsub: %d\n", 
+			count, a->acl_dn_pat.bv_val, (int) a->acl_dn_re.re_nsub );
+		if ( a->acl_dn_tail.bv_len && ( dnlen < a->acl_dn_tail.bv_len ||
+			strncasecmp( e->e_ndn + dnlen - a->acl_dn_tail.bv_len,
+				a->acl_dn_tail.bv_val, a->acl_dn_tail.bv_len ) ) )
+			return 0;
+		if ( regexec ( &a->acl_dn_re, 
+			       e->e_ndn, 
+		 	       matches->dn_count, 
+			       matches->dn_data, 0 ) )
+			return 0;
+
+	} else {
+		ber_len_t patlen;
+
+		Debug( LDAP_DEBUG_ACL, "=> dn: [%d] %s\n", 
+			count, a->acl_dn_pat.bv_val );
+		patlen = a->acl_dn_pat.bv_len;
+		if ( dnlen < patlen )
+			return 0;
+
+		if ( a->acl_dn_style == ACL_STYLE_BASE ) {
+			/* base dn -- entire object DN must match */
+			if ( dnlen != patlen )
+				return 0;
+
+		} else if ( a->acl_dn_style == ACL_STYLE_ONE ) {
+			ber_len_t	rdnlen = 0;
+			ber_len_t	sep = 0;
+
+			if ( dnlen <= patlen )
+				return 0;
+
+			if ( patlen > 0 ) {
+				if ( !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
+					return 0;
+				sep = 1;
+			}
+
+			rdnlen = dn_rdnlen( NULL, &e->e_nname );
+			if ( rdnlen + patlen + sep != dnlen )
+				return 0;
+
+		} else if ( a->acl_dn_style == ACL_STYLE_SUBTREE ) {
+			if ( dnlen > patlen && !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
+				return 0;
+
+		} else if ( a->acl_dn_style == ACL_STYLE_CHILDREN ) {
+			if ( dnlen <= patlen )
+				return 0;
+			if ( !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
+				return 0;
+		}
+
+		if ( strcmp( a->acl_dn_pat.bv_val, e->e_ndn + dnlen - patlen ) != 0 )
+			return 0;
+	}
+
+	Debug( LDAP_DEBUG_ACL, "=> acl_get: [%d] matched\n",
+		count );
+	return 1;
+}
+
 /*
  * slap_acl_get - return the acl applicable to entry e, attribute
  * attr.  the acl returned is suitable for use in subsequent calls to
@@ -508,8 +613,8 @@ slap_acl_get(
 	AccessControlState *state )
 {
 	const char *attr;
-	ber_len_t dnlen;
 	AccessControl *prev;
+	unsigned i;
 
 	assert( e != NULL );
 	assert( count != NULL );
@@ -536,73 +641,34 @@ slap_acl_get(
 		a = a->acl_next;
 	}
 
-	dnlen = e->e_nname.bv_len;
-
  retry:
 	for ( ; a != NULL; prev = a, a = a->acl_next ) {
+		int *memo;
+
 		(*count) ++;
 
 		if ( a != frontendDB->be_acl && state->as_fe_done )
 			state->as_fe_done++;
 
-		if ( a->acl_dn_pat.bv_len || ( a->acl_dn_style != ACL_STYLE_REGEX )) {
-			if ( a->acl_dn_style == ACL_STYLE_REGEX ) {
-				Debug( LDAP_DEBUG_ACL, "=> dnpat: [%d] %s nsub: %d\n", 
-					*count, a->acl_dn_pat.bv_val, (int) a->acl_dn_re.re_nsub );
-				if ( regexec ( &a->acl_dn_re, 
-					       e->e_ndn, 
-				 	       matches->dn_count, 
-					       matches->dn_data, 0 ) )
-					continue;
-
-			} else {
-				ber_len_t patlen;
-
-				Debug( LDAP_DEBUG_ACL, "=> dn: [%d] %s\n", 
-					*count, a->acl_dn_pat.bv_val );
-				patlen = a->acl_dn_pat.bv_len;
-				if ( dnlen < patlen )
-					continue;
-
-				if ( a->acl_dn_style == ACL_STYLE_BASE ) {
-					/* base dn -- entire object DN must match */
-					if ( dnlen != patlen )
-						continue;
-
-				} else if ( a->acl_dn_style == ACL_STYLE_ONE ) {
-					ber_len_t	rdnlen = 0;
-					ber_len_t	sep = 0;
-
-					if ( dnlen <= patlen )
-						continue;
-
-					if ( patlen > 0 ) {
-						if ( !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
-							continue;
-						sep = 1;
-					}
-
-					rdnlen = dn_rdnlen( NULL, &e->e_nname );
-					if ( rdnlen + patlen + sep != dnlen )
-						continue;
-
-				} else if ( a->acl_dn_style == ACL_STYLE_SUBTREE ) {
-					if ( dnlen > patlen && !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
-						continue;
+		i = ACL_MEMO_SLOT( a );
+		if ( state->as_memo.am_ent[i].ae_acl != a ) {
+			state->as_memo.am_ent[i].ae_acl = a;
+			state->as_memo.am_ent[i].ae_flags = 0;
+		}
+		memo = &state->as_memo.am_ent[i].ae_flags;
 
-				} else if ( a->acl_dn_style == ACL_STYLE_CHILDREN ) {
-					if ( dnlen <= patlen )
-						continue;
-					if ( !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
-						continue;
-				}
+		if ( *memo & ACL_MEMO_SKIP )
+			continue;
 
-				if ( strcmp( a->acl_dn_pat.bv_val, e->e_ndn + dnlen - patlen ) != 0 )
-					continue;
+		if ( ( a->acl_dn_pat.bv_len || ( a->acl_dn_style != ACL_STYLE_REGEX )) &&
+			!( *memo & ACL_MEMO_DN ))
+		{
+			if ( !slap_acl_dn_match( a, *count, e, matches ) ) {
+				*memo |= ACL_MEMO_SKIP;
+				continue;
 			}
-
-			Debug( LDAP_DEBUG_ACL, "=> acl_get: [%d] matched\n",
-				*count );
+			if ( a->acl_dn_style != ACL_STYLE_REGEX )
+				*memo |= ACL_MEMO_DN;
 		}
 
 		if ( a->acl_attrs && !ad_inlist( desc, a->acl_attrs ) ) {
@@ -693,11 +759,13 @@ slap_acl_get(
 			}
 		}
 
-		if ( a->acl_filter != NULL ) {
+		if ( a->acl_filter != NULL && !( *memo & ACL_MEMO_FILTER )) {
 			ber_int_t rc = test_filter( NULL, e, a->acl_filter );
 			if ( rc != LDAP_COMPARE_TRUE ) {
+				*memo |= ACL_MEMO_SKIP;
 				continue;
 			}
+			*memo |= ACL_MEMO_FILTER;
 		}
 
 		Debug( LDAP_DEBUG_ACL, "=> acl_get: [%d] attr %s\n",
@@ -836,7 +904,7 @@ acl_mask_dn(
 				return 1;
 			}
 
-			if ( !regex_matches( &bdn->a_pat, opndn->bv_val,
+			if ( !regex_matches( op, &bdn->a_pat, opndn->bv_val,
 				&e->e_nname, NULL, tmp_matchesp ) )
 			{
 				return 1;
@@ -1251,7 +1319,7 @@ slap_acl_mask(
 
 			if ( !ber_bvccmp( &b->a_sockurl_pat, '*' ) ) {
 				if ( b->a_sockurl_style == ACL_STYLE_REGEX) {
-					if ( !regex_matches( &b->a_sockurl_pat, op->o_conn->c_listener_url.bv_val,
+					if ( !regex_matches( op, &b->a_sockurl_pat, op->o_conn->c_listener_url.bv_val,
 							&e->e_nname, val, matches ) ) 
 					{
 						continue;
@@ -1290,7 +1358,7 @@ slap_acl_mask(
 				b->a_domain_pat.bv_val );
 			if ( !ber_bvccmp( &b->a_domain_pat, '*' ) ) {
 				if ( b->a_domain_style == ACL_STYLE_REGEX) {
-					if ( !regex_matches( &b->a_domain_pat, op->o_conn->c_peer_domain.bv_val,
+					if ( !regex_matches( op, &b->a_domain_pat, op->o_conn->c_peer_domain.bv_val,
 							&e->e_nname, val, matches ) ) 
 					{
 						continue;
@@ -1344,7 +1412,7 @@ slap_acl_mask(
 				b->a_peername_pat.bv_val );
 			if ( !ber_bvccmp( &b->a_peername_pat, '*' ) ) {
 				if ( b->a_peername_style == ACL_STYLE_REGEX ) {
-					if ( !regex_matches( &b->a_peername_pat, op->o_conn->c_peer_name.bv_val,
+					if ( !regex_matches( op, &b->a_peername_pat, op->o_conn->c_peer_name.bv_val,
 							&e->e_nname, val, matches ) ) 
 					{
 						continue;
@@ -1496,7 +1564,7 @@ slap_acl_mask(
 				b->a_sockname_pat.bv_val );
 			if ( !ber_bvccmp( &b->a_sockname_pat, '*' ) ) {
 				if ( b->a_sockname_style == ACL_STYLE_REGEX) {
-					if ( !regex_matches( &b->a_sockname_pat, op->o_conn->c_sock_name.bv_val,
+					if ( !regex_matches( op, &b->a_sockname_pat, op->o_conn->c_sock_name.bv_val,
 							&e->e_nname, val, matches ) ) 
 					{
 						continue;
@@ -2057,6 +2125,42 @@ done:
 	return( ret );
 }
 
+/* Whether the access of an operation to the entries of this database
+ * depends only on its identity, so that results computed for one
+ * operation may be shared by others with the same identity: no ACL
+ * clause looks at anything else about their connection.
+ */
+int
+acl_by_identity( BackendDB *be )
+{
+	AccessControl *acls[2], *ac;
+	Access *b;
+	int i;
+
+	acls[0] = be->be_acl;
+	acls[1] = frontendDB->be_acl;
+	for ( i = 0; i < 2; i++ ) {
+		for ( ac = acls[i]; ac; ac = ac->acl_next ) {
+			for ( b = ac->acl_access; b; b = b->a_next ) {
+				if ( !BER_BVISEMPTY( &b->a_realdn_pat ) ||
+					b->a_realdn_at || b->a_realdn_self ||
+					!BER_BVISEMPTY( &b->a_peername_pat ) ||
+					!BER_BVISEMPTY( &b->a_sockname_pat ) ||
+					!BER_BVISEMPTY( &b->a_domain_pat ) ||
+					!BER_BVISEMPTY( &b->a_sockurl_pat ) ||
+					b->a_authz.sai_ssf || b->a_authz.sai_transport_ssf ||
+					b->a_authz.sai_tls_ssf || b->a_authz.sai_sasl_ssf
+#ifdef SLAP_DYNACL
+					|| b->a_dynacl
+#endif
+					)
+					return 0;
+			}
+		}
+	}
+	return 1;
+}
+
 int
 acl_get_part(
 	struct berval	*list,
@@ -2636,8 +2740,80 @@ acl_string_expand(
 	return 0;
 }
 
+/*
+ * Per-thread cache of the <who> regexes compiled by regex_matches(),
+ * keyed by their expanded text; most patterns expand to the same
+ * few strings over and over.
+ */
+#define	ACL_RE_CACHE	16
+typedef struct acl_re_cache {
+	int		rc_next;
+	struct {
+		char		*re_pat;
+		regex_t		re_re;
+	} rc_ent[ACL_RE_CACHE];
+} acl_re_cache;
+
+static void
+acl_re_cache_free( void *key, void *data )
+{
+	acl_re_cache *rc = data;
+	int i;
+
+	for ( i = 0; i < ACL_RE_CACHE; i++ ) {
+		if ( rc->rc_ent[i].re_pat ) {
+			regfree( &rc->rc_ent[i].re_re );
+			ch_free( rc->rc_ent[i].re_pat );
+		}
+	}
+	ch_free( rc );
+}
+
+static regex_t *
+acl_re_cache_get( Operation *op, char *pat )
+{
+	acl_re_cache *rc = NULL;
+	void *data = NULL;
+	int i;
+
+	if ( !op->o_threadctx )
+		return NULL;
+
+	if ( ldap_pvt_thread_pool_getkey( op->o_threadctx,
+			(void *)acl_re_cache_get, &data, NULL ) || !data ) {
+		data = ch_calloc( 1, sizeof( acl_re_cache ) );
+		if ( ldap_pvt_thread_pool_setkey( op->o_threadctx,
+				(void *)acl_re_cache_get, data, acl_re_cache_free,
+				NULL, NULL ) ) {
+			ch_free( data );
+			return NULL;
+		}
+	}
+	rc = data;
+
+	for ( i = 0; i < ACL_RE_CACHE && rc->rc_ent[i].re_pat; i++ ) {
+		if ( !strcmp( rc->rc_ent[i].re_pat, pat ) )
+			return &rc->rc_ent[i].re_re;
+	}
+
+	/* replace the oldest */
+	i = rc->rc_next;
+	rc->rc_next = ( i + 1 ) % ACL_RE_CACHE;
+	if ( rc->rc_ent[i].re_pat ) {
+		regfree( &rc->rc_ent[i].re_re );
+		ch_free( rc->rc_ent[i].re_pat );
+		rc->rc_ent[i].re_pat = NULL;
+	}
+	if ( regcomp( &rc->rc_ent[i].re_re, pat, REG_EXTENDED|REG_ICASE ) )
+		return NULL;
+	rc->rc_ent[i].re_pat = ch_strdup( pat );
+
+	return &rc->rc_ent[i].re_re;
+}
+
 static int
 regex_matches(
+	Operation	*op,
 	struct berval	*pat,		/* pattern to expand and match against */
 	char		*str,		/* string to match against pattern */
 	struct berval	*dn_matches,	/* buffer with $N expansion variables from DN */
@@ -2645,7 +2821,7 @@ regex_matches(
 	AclRegexMatches	*matches	/* offsets in buffer for $N expansion variables */
 )
 {
-	regex_t re;
+	regex_t re, *rep;
 	char newbuf[ACL_BUF_SIZE];
 	struct berval bv;
 	int	rc;
@@ -2663,19 +2839,25 @@ regex_matches(
 			pat->bv_val, str );
 		return( 0 );
 	}
-	rc = regcomp( &re, newbuf, REG_EXTENDED|REG_ICASE );
-	if ( rc ) {
-		char error[ACL_BUF_SIZE];
-		regerror( rc, &re, error, sizeof( error ) );
+	rep = acl_re_cache_get( op, newbuf );
+	if ( rep ) {
+		rc = regexec( rep, str, 0, NULL, 0 );
 
-		Debug( LDAP_DEBUG_TRACE,
-		    "compile( \"%s\", \"%s\") failed %s\n",
-			pat->bv_val, str, error );
-		return( 0 );
-	}
+	} else {
+		rc = regcomp( &re, newbuf, REG_EXTENDED|REG_ICASE );
+		if ( rc ) {
+			char error[ACL_BUF_SIZE];
+			regerror( rc, &re, error, sizeof( error ) );
+
+			Debug( LDAP_DEBUG_TRACE,
+			    "compile( \"%s\", \"%s\") failed %s\n",
+				pat->bv_val, str, error );
+			return( 0 );
+		}
 
-	rc = regexec( &re, str, 0, NULL, 0 );
-	regfree( &re );
+		rc = regexec( &re, str, 0, NULL, 0 );
+		regfree( &re );
+	}
 
 	Debug( LDAP_DEBUG_TRACE,
 	    "=> regex_matches: string:	 %s\n", str );
@@ -66,6 +66,7 @@ static void		access_free( Access *a );
 static int		acl_usage(void);
 
 static void		acl_regex_normalized_dn(const char *src, struct berval *pat);
+static void		acl_regex_tail(struct berval *pat, struct berval *tail);
 
 #ifdef LDAP_DEBUG
 static void		print_acl(Backend *be, AccessControl *a);
@@ -177,6 +178,45 @@ regtest(const char *fname, int lineno, char *pat) {
 	regfree(&re);
 }
 
+/*
+ * Find the literal text a DN regex must end with, so that entries
+ * not ending with it can be rejected without regexec().  Stay on
+ * the safe side: no alternation, and only plain DN characters
+ * between the last metacharacter and the trailing '$'.
+ */
+static void
+acl_regex_tail( struct berval *pat, struct berval *tail )
+{
+	char		*p = pat->bv_val;
+	ber_len_t	i, len = pat->bv_len;
+
+	BER_BVZERO( tail );
+
+	if ( len < 2 || p[ len - 1 ] != '$' || p[ len - 2 ] == '\\' ||
+		strchr( p, '|' ) != NULL )
+	{
+		return;
+	}
+
+	for ( i = len - 1; i > 0; i-- ) {
+		unsigned char c = p[ i - 1 ];
+
+		if ( !isalnum( c ) && strchr( ",= -_", c ) == NULL ) {
+			break;
+		}
+	}
+
+	/* the first character may be part of an escape */
+	if ( i > 0 && p[ i - 1 ] == '\\' ) {
+		i++;
+	}
+
+	if ( i < len - 1 ) {
+		tail->bv_val = &p[ i ];
+		tail->bv_len = len - 1 - i;
+	}
+}
+
 /*
  * Experimental
  *
@@ -327,7 +367,7 @@ parse_acl(
 	int		pos )
 {
 	int		i;
-	char		*left, *right, *style;
+	char		*left, *right = NULL, *style;
 	struct berval	bv;
 	AccessControl	*a = NULL;
 	Access	*b = NULL;
@@ -675,6 +715,7 @@ parse_acl(
 						      fname, lineno, right, err );
 						goto fail;
 					}
+					acl_regex_tail( &a->acl_dn_pat, &a->acl_dn_tail );
 				}
 			}
 
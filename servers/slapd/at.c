@@ -73,14 +73,126 @@ struct aindexrec {
 };
 
 static Avlnode	*attr_index = NULL;
-static Avlnode	*attr_cache = NULL;
+static SlapNameHash	attr_hash;
 static LDAP_STAILQ_HEAD(ATList, AttributeType) attr_list
 	= LDAP_STAILQ_HEAD_INITIALIZER(attr_list);
 
 /* Last hardcoded attribute registered */
 AttributeType *at_sys_tail;
 
-int at_oc_cache;
+/*
+ * Open addressed hash of schema names, shared with oc.c. The AVL
+ * indices stay authoritative for ordering and duplicate detection;
+ * the hash only mirrors their records so that the lookups done for
+ * every attribute and objectClass named in a request avoid a string
+ * compare at each level of the tree. Like the trees, it is only
+ * modified while the server is paused.
+ */
+#define SLAP_NAME_HASH_MIN	256
+
+static struct berval slap_name_hash_deleted;
+
+static unsigned
+slap_name_hash_fold( struct berval *name )
+{
+	unsigned char *p = (unsigned char *)name->bv_val;
+	unsigned char *end = p + name->bv_len;
+	unsigned h = 2166136261U;
+
+	for ( ; p < end; p++ ) {
+		h ^= TOLOWER( *p );
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static void
+slap_name_hash_put( SlapNameHash *nh, unsigned hash, struct berval *name )
+{
+	unsigned i, mask = nh->nh_size - 1;
+
+	for ( i = hash & mask; nh->nh_slots[i].ns_name; i = (i+1) & mask )
+		;
+	nh->nh_slots[i].ns_hash = hash;
+	nh->nh_slots[i].ns_name = name;
+}
+
+int
+slap_name_hash_insert( SlapNameHash *nh, struct berval *name )
+{
+	/* keep at least half the slots empty so probe runs stay short */
+	if ( 2 * ( nh->nh_used + 1 ) > nh->nh_size ) {
+		SlapNameHash old = *nh;
+		unsigned i;
+
+		nh->nh_size = SLAP_NAME_HASH_MIN;
+		while ( nh->nh_size < 4 * ( old.nh_live + 1 ))
+			nh->nh_size <<= 1;
+		nh->nh_slots = ch_calloc( nh->nh_size, sizeof(SlapNameSlot) );
+		for ( i = 0; i < old.nh_size; i++ ) {
+			if ( old.nh_slots[i].ns_name &&
+				old.nh_slots[i].ns_name != &slap_name_hash_deleted )
+				slap_name_hash_put( nh, old.nh_slots[i].ns_hash,
+					old.nh_slots[i].ns_name );
+		}
+		nh->nh_used = nh->nh_live;
+		ch_free( old.nh_slots );
+	}
+
+	slap_name_hash_put( nh, slap_name_hash_fold( name ), name );
+	nh->nh_used++;
+	nh->nh_live++;
+	return 0;
+}
+
+struct berval *
+slap_name_hash_find( SlapNameHash *nh, struct berval *name )
+{
+	unsigned i, mask, hash;
+	SlapNameSlot *ns;
+
+	if ( !nh->nh_live )
+		return NULL;
+
+	hash = slap_name_hash_fold( name );
+	mask = nh->nh_size - 1;
+	for ( i = hash & mask; ( ns = &nh->nh_slots[i] )->ns_name; i = (i+1) & mask ) {
+		if ( ns->ns_hash == hash && ns->ns_name->bv_len == name->bv_len &&
+			ns->ns_name != &slap_name_hash_deleted &&
+			strncasecmp( ns->ns_name->bv_val, name->bv_val, name->bv_len ) == 0 )
+			return ns->ns_name;
+	}
+	return NULL;
+}
+
+/* Remove the slot holding this exact record */
+void
+slap_name_hash_delete( SlapNameHash *nh, struct berval *name )
+{
+	unsigned i, mask;
+
+	if ( !nh->nh_live )
+		return;
+
+	mask = nh->nh_size - 1;
+	for ( i = slap_name_hash_fold( name ) & mask; nh->nh_slots[i].ns_name;
+		i = (i+1) & mask )
+	{
+		if ( nh->nh_slots[i].ns_name == name ) {
+			nh->nh_slots[i].ns_name = &slap_name_hash_deleted;
+			nh->nh_live--;
+			return;
+		}
+	}
+	assert( 0 );
+}
+
+void
+slap_name_hash_destroy( SlapNameHash *nh )
+{
+	ch_free( nh->nh_slots );
+	memset( nh, 0, sizeof(SlapNameHash) );
+}
 
 static int
 attr_index_cmp(
@@ -94,18 +206,6 @@ attr_index_cmp(
 	return (strcasecmp( air1->air_name.bv_val, air2->air_name.bv_val ));
 }
 
-static int
-attr_index_name_cmp(
-    const void	*v_type,
-    const void	*v_air )
-{
-    const struct berval    *type = v_type;
-    const struct aindexrec *air  = v_air;
-	int i = type->bv_len - air->air_name.bv_len;
-	if (i) return i;
-	return (strncasecmp( type->bv_val, air->air_name.bv_val, type->bv_len ));
-}
-
 AttributeType *
 at_find( const char *name )
 {
@@ -122,20 +222,10 @@ at_bvfind( struct berval *name )
 {
 	struct aindexrec *air;
 
-	if ( attr_cache ) {
-		air = avl_find( attr_cache, name, attr_index_name_cmp );
-		if ( air ) return air->air_at;
-	}
-
-	air = avl_find( attr_index, name, attr_index_name_cmp );
+	air = (struct aindexrec *)slap_name_hash_find( &attr_hash, name );
 
-	if ( air ) {
-		if ( air->air_at->sat_flags & SLAP_AT_DELETED ) {
-			air = NULL;
-		} else if (( slapMode & SLAP_TOOL_MODE ) && at_oc_cache ) {
-			avl_insert( &attr_cache, (caddr_t) air,
-				attr_index_cmp, avl_dup_error );
-		}
+	if ( air && ( air->air_at->sat_flags & SLAP_AT_DELETED )) {
+		air = NULL;
 	}
 
 	return air != NULL ? air->air_at : NULL;
@@ -242,6 +332,7 @@ at_delete_names( AttributeType *at )
 		air = (struct aindexrec *)avl_delete( &attr_index,
 			(caddr_t)&tmpair, attr_index_cmp );
 		assert( air != NULL );
+		slap_name_hash_delete( &attr_hash, &air->air_name );
 		ldap_memfree( air );
 		names++;
 	}
@@ -326,6 +417,7 @@ at_destroy( void )
 	}
 
 	avl_free(attr_index, at_destroy_one);
+	slap_name_hash_destroy( &attr_hash );
 
 	if ( slap_schema.si_at_undefined ) {
 		ad_destroy(slap_schema.si_at_undefined->sat_ad);
@@ -503,6 +595,8 @@ at_insert(
 
 				return rc;
 			}
+		} else {
+			slap_name_hash_insert( &attr_hash, &air->air_name );
 		}
 		/* FIX: temporal consistency check */
 		at_bvfind( &air->air_name );
@@ -538,6 +632,7 @@ at_insert(
 					air = (struct aindexrec *)avl_delete( &attr_index,
 						(caddr_t)&tmpair, attr_index_cmp );
 					assert( air != NULL );
+					slap_name_hash_delete( &attr_hash, &air->air_name );
 					ldap_memfree( air );
 				}
 
@@ -549,11 +644,13 @@ at_insert(
 					air = (struct aindexrec *)avl_delete( &attr_index,
 						(caddr_t)&tmpair, attr_index_cmp );
 					assert( air != NULL );
+					slap_name_hash_delete( &attr_hash, &air->air_name );
 					ldap_memfree( air );
 				}
 
 				return rc;
 			}
+			slap_name_hash_insert( &attr_hash, &air->air_name );
 			/* FIX: temporal consistency check */
 			at_bvfind(&air->air_name);
 			names++;
@@ -39,6 +39,7 @@
 #include <ac/time.h>
 
 #include "slap.h"
+#include "lutil_hash.h"
 
 /*
  * Allocate in chunks, minimum of 1000 at a time.
@@ -51,6 +52,38 @@ static slap_list *attr_chunks;
 static Attribute *attrs_list;
 static ldap_pvt_thread_mutex_t attr_mutex;
 
+/*
+ * Each thread keeps a small list of free Attributes of its own, so
+ * that the usual alloc/free pairs don't contend on attr_mutex. The
+ * list is refilled from and spilled to attrs_list in batches. Pool
+ * threads hand theirs back when they exit.
+ */
+#define	ATTR_LOCAL_BATCH	64
+#define	ATTR_LOCAL_MAX	(4*ATTR_LOCAL_BATCH)
+typedef struct attr_local {
+	Attribute *al_list;
+	int al_num;
+	unsigned long al_hits;	/* not yet added to attr_local_hits */
+} attr_local;
+static ldap_pvt_thread_key_t attr_local_key;
+static void *attr_main_ctx;
+static unsigned long attr_local_hits, attr_local_misses;
+
+/*
+ * Index over the normalized values of a large unsorted attribute,
+ * so that repeated equality lookups don't each scan every value.
+ * Slots hold a value index plus one; zero marks an empty slot.
+ */
+#define	ATTR_HASH_MIN	64
+struct AttrValHash {
+	Attribute *ah_attr;	/* owner; shallow copies don't match */
+	BerVarray ah_vals;	/* a_nvals and a_numvals when built */
+	unsigned ah_numvals;
+	unsigned ah_mask;
+	unsigned ah_slots[1];
+};
+static ldap_pvt_thread_mutex_t attr_hash_mutex;
+
 int
 attr_prealloc( int num )
 {
@@ -74,18 +107,97 @@ attr_prealloc( int num )
 	return 0;
 }
 
+/* Return all but keep of the thread's free Attributes to attrs_list */
+static void
+attr_local_spill( attr_local *al, int keep )
+{
+	Attribute *head, *tail;
+
+	if ( al->al_num <= keep )
+		return;
+
+	head = al->al_list;
+	for ( tail = head; --al->al_num > keep; tail = tail->a_next )
+		;
+	al->al_list = tail->a_next;
+	al->al_num = keep;
+
+	ldap_pvt_thread_mutex_lock( &attr_mutex );
+	tail->a_next = attrs_list;
+	attrs_list = head;
+	attr_local_hits += al->al_hits;
+	al->al_hits = 0;
+	ldap_pvt_thread_mutex_unlock( &attr_mutex );
+}
+
+static void
+attr_local_free( void *key, void *data )
+{
+	attr_local *al = data;
+
+	attr_local_spill( al, 0 );
+	if ( al->al_hits ) {
+		ldap_pvt_thread_mutex_lock( &attr_mutex );
+		attr_local_hits += al->al_hits;
+		ldap_pvt_thread_mutex_unlock( &attr_mutex );
+	}
+	ldap_pvt_thread_key_setdata( attr_local_key, NULL );
+	ch_free( al );
+}
+
+static attr_local *
+attr_local_get( void )
+{
+	attr_local *al = NULL;
+	void *ctx;
+
+	ldap_pvt_thread_key_getdata( attr_local_key, (void **)&al );
+	if ( al )
+		return al;
+
+	al = ch_calloc( 1, sizeof( attr_local ));
+	ldap_pvt_thread_key_setdata( attr_local_key, al );
+
+	/* Non-pool threads all share the main thread's context, so
+	 * only pool threads can have theirs cleaned up on exit. The
+	 * others live until shutdown anyway.
+	 */
+	ctx = ldap_pvt_thread_pool_context();
+	if ( ctx != attr_main_ctx )
+		ldap_pvt_thread_pool_setkey( ctx, &attr_local_key, al,
+			attr_local_free, NULL, NULL );
+	return al;
+}
+
 Attribute *
 attr_alloc( AttributeDescription *ad )
 {
 	Attribute *a;
+	attr_local *al = attr_local_get();
 
-	ldap_pvt_thread_mutex_lock( &attr_mutex );
-	if ( !attrs_list )
-		attr_prealloc( CHUNK_SIZE );
-	a = attrs_list;
-	attrs_list = a->a_next;
+	if ( !al->al_list ) {
+		Attribute **ap;
+
+		ldap_pvt_thread_mutex_lock( &attr_mutex );
+		if ( !attrs_list )
+			attr_prealloc( CHUNK_SIZE );
+		al->al_list = attrs_list;
+		for ( ap = &attrs_list; *ap && al->al_num < ATTR_LOCAL_BATCH;
+			ap = &(*ap)->a_next )
+			al->al_num++;
+		attrs_list = *ap;
+		*ap = NULL;
+		attr_local_hits += al->al_hits;
+		al->al_hits = 0;
+		attr_local_misses++;
+		ldap_pvt_thread_mutex_unlock( &attr_mutex );
+	} else {
+		al->al_hits++;
+	}
+	a = al->al_list;
+	al->al_list = a->a_next;
+	al->al_num--;
 	a->a_next = NULL;
-	ldap_pvt_thread_mutex_unlock( &attr_mutex );
 	
 	a->a_desc = ad;
 	if ( ad && ( ad->ad_type->sat_flags & SLAP_AT_SORTED_VAL ))
@@ -94,12 +206,38 @@ attr_alloc( AttributeDescription *ad )
 	return a;
 }
 
+/* Allocations served from thread free lists, and refills of those
+ * lists from attrs_list. Hits are counted as of each thread's last
+ * refill or spill.
+ */
+void
+attr_local_stats( unsigned long *hits, unsigned long *misses )
+{
+	ldap_pvt_thread_mutex_lock( &attr_mutex );
+	*hits = attr_local_hits;
+	*misses = attr_local_misses;
+	ldap_pvt_thread_mutex_unlock( &attr_mutex );
+}
+
 /* Return a list of num attrs */
 Attribute *
 attrs_alloc( int num )
 {
 	Attribute *head = NULL;
 	Attribute **a;
+	attr_local *al = attr_local_get();
+
+	if ( num <= al->al_num ) {
+		al->al_hits += num;
+		head = al->al_list;
+		for ( a = &al->al_list; num > 0; a = &(*a)->a_next ) {
+			al->al_num--;
+			num--;
+		}
+		al->al_list = *a;
+		*a = NULL;
+		return head;
+	}
 
 	ldap_pvt_thread_mutex_lock( &attr_mutex );
 	for ( a = &attrs_list; *a && num > 0; a = &(*a)->a_next ) {
@@ -125,9 +263,116 @@ attrs_alloc( int num )
 }
 
 
+static void
+attr_valhash_free( Attribute *a )
+{
+	if ( ( a->a_flags & SLAP_ATTR_HASHED ) && a->a_hash->ah_attr == a )
+		ch_free( a->a_hash );
+	a->a_hash = NULL;
+	a->a_flags &= ~(SLAP_ATTR_HASHED|SLAP_ATTR_HASH_WANT);
+}
+
+static unsigned
+attr_valhash( struct berval *bv )
+{
+	lutil_HASH_CTX ctx;
+	unsigned char digest[LUTIL_HASH_BYTES];
+	ber_uint_t h;
+
+	lutil_HASHInit( &ctx );
+	lutil_HASHUpdate( &ctx, (unsigned char *)bv->bv_val, bv->bv_len );
+	lutil_HASHFinal( digest, &ctx );
+	AC_MEMCPY( &h, digest, sizeof(h) );
+	return h;
+}
+
+/* A hash is only usable if equality is byte equality of the
+ * normalized values. X-ORDERED values carry an index prefix
+ * that matching ignores.
+ */
+static int
+attr_valhash_ok( Attribute *a, MatchingRule *mr, unsigned flags )
+{
+	if ( ( flags & SLAP_MR_ORDERING ) || a->a_numvals < ATTR_HASH_MIN )
+		return 0;
+	if ( a->a_desc->ad_type->sat_flags & SLAP_AT_ORDERED )
+		return 0;
+	return mr->smr_match == octetStringMatch || mr->smr_match == dnMatch;
+}
+
+static struct AttrValHash *
+attr_valhash_get( Attribute *a )
+{
+	struct AttrValHash *ah;
+	unsigned i, j, mask;
+
+	if ( a->a_flags & SLAP_ATTR_HASHED ) {
+		ah = a->a_hash;
+		if ( ah->ah_attr != a )
+			return NULL;
+		if ( ah->ah_vals == a->a_nvals && ah->ah_numvals == a->a_numvals )
+			return ah;
+	}
+
+	/* Don't pay for a build on a single lookup. a_flags is shared
+	 * by readers of cached entries, so only update it locked.
+	 */
+	ldap_pvt_thread_mutex_lock( &attr_hash_mutex );
+	if ( !( a->a_flags & (SLAP_ATTR_HASH_WANT|SLAP_ATTR_HASHED) )) {
+		a->a_flags |= SLAP_ATTR_HASH_WANT;
+		ldap_pvt_thread_mutex_unlock( &attr_hash_mutex );
+		return NULL;
+	}
+	if ( a->a_flags & SLAP_ATTR_HASHED ) {
+		ah = a->a_hash;
+		if ( ah->ah_vals == a->a_nvals && ah->ah_numvals == a->a_numvals ) {
+			ldap_pvt_thread_mutex_unlock( &attr_hash_mutex );
+			return ah;
+		}
+		/* stale; values only change under an exclusive owner */
+		attr_valhash_free( a );
+	}
+
+	for ( mask = 1; mask < a->a_numvals * 2; mask <<= 1 ) ;
+	ah = ch_calloc( 1, sizeof( struct AttrValHash ) + (mask-1) * sizeof(unsigned) );
+	ah->ah_attr = a;
+	ah->ah_vals = a->a_nvals;
+	ah->ah_numvals = a->a_numvals;
+	ah->ah_mask = --mask;
+	for ( i = 0; i < a->a_numvals; i++ ) {
+		struct berval *bv = &a->a_nvals[i];
+
+		for ( j = attr_valhash( bv ) & mask; ah->ah_slots[j];
+			j = (j + 1) & mask ) {
+			if ( bvmatch( &a->a_nvals[ah->ah_slots[j] - 1], bv ) )
+				break;
+		}
+		/* keep the first of any duplicates, as a scan would */
+		if ( !ah->ah_slots[j] )
+			ah->ah_slots[j] = i + 1;
+	}
+	a->a_hash = ah;
+	a->a_flags |= SLAP_ATTR_HASHED;
+	ldap_pvt_thread_mutex_unlock( &attr_hash_mutex );
+
+	return ah;
+}
+
+/* Release the value index of attributes freed without attr_clean() */
+void
+attrs_valhash_free( Attribute *a )
+{
+	for ( ; a; a = a->a_next ) {
+		if ( a->a_flags & SLAP_ATTR_HASHED )
+			attr_valhash_free( a );
+	}
+}
+
 void
 attr_clean( Attribute *a )
 {
+	if ( a->a_flags & SLAP_ATTR_HASHED )
+		attr_valhash_free( a );
 	if ( a->a_nvals && a->a_nvals != a->a_vals &&
 		!( a->a_flags & SLAP_ATTR_DONT_FREE_VALS )) {
 		if ( a->a_flags & SLAP_ATTR_DONT_FREE_DATA ) {
@@ -151,6 +396,7 @@ attr_clean( Attribute *a )
 	a->a_desc = NULL;
 	a->a_vals = NULL;
 	a->a_nvals = NULL;
+	a->a_hash = NULL;
 #ifdef LDAP_COMP_MATCH
 	a->a_comp_data = NULL;
 #endif
@@ -161,11 +407,13 @@ attr_clean( Attribute *a )
 void
 attr_free( Attribute *a )
 {
+	attr_local *al = attr_local_get();
+
 	attr_clean( a );
-	ldap_pvt_thread_mutex_lock( &attr_mutex );
-	a->a_next = attrs_list;
-	attrs_list = a;
-	ldap_pvt_thread_mutex_unlock( &attr_mutex );
+	a->a_next = al->al_list;
+	al->al_list = a;
+	if ( ++al->al_num > ATTR_LOCAL_MAX )
+		attr_local_spill( al, ATTR_LOCAL_BATCH );
 }
 
 #ifdef LDAP_COMP_MATCH
@@ -190,6 +438,8 @@ attrs_free( Attribute *a )
 {
 	if ( a ) {
 		Attribute *b = (Attribute *)0xBAD, *tail, *next;
+		attr_local *al = attr_local_get();
+		int n = 0;
 
 		/* save tail */
 		tail = a;
@@ -199,14 +449,16 @@ attrs_free( Attribute *a )
 			a->a_next = b;
 			b = a;
 			a = next;
+			n++;
 		} while ( next );
 
-		ldap_pvt_thread_mutex_lock( &attr_mutex );
-		/* replace NULL with current attr list and let attr list
+		/* replace NULL with the thread's free list and let it
 		 * start from last attribute returned to list */
-		tail->a_next = attrs_list;
-		attrs_list = b;
-		ldap_pvt_thread_mutex_unlock( &attr_mutex );
+		tail->a_next = al->al_list;
+		al->al_list = b;
+		al->al_num += n;
+		if ( al->al_num > ATTR_LOCAL_MAX )
+			attr_local_spill( al, ATTR_LOCAL_BATCH );
 	}
 }
 
@@ -296,6 +548,7 @@ attr_valfind(
 {
 	struct berval nval = BER_BVNULL, *cval;
 	MatchingRule *mr;
+	struct AttrValHash *ah;
 	const char *text;
 	int match = -1, rc;
 	unsigned i, n;
@@ -342,6 +595,21 @@ attr_valfind(
 		} while ( n );
 		if ( match < 0 )
 			i++;
+	} else if ( n && attr_valhash_ok( a, mr, flags ) &&
+		( ah = attr_valhash_get( a )) != NULL ) {
+		/* Hashed search */
+		unsigned j;
+
+		i = n;
+		for ( j = attr_valhash( cval ) & ah->ah_mask; ah->ah_slots[j];
+			j = (j + 1) & ah->ah_mask ) {
+			if ( bvmatch( &a->a_nvals[ah->ah_slots[j] - 1], cval ) ) {
+				i = ah->ah_slots[j] - 1;
+				match = 0;
+				break;
+			}
+		}
+		rc = LDAP_SUCCESS;
 	} else {
 	/* Linear search */
 		for ( i = 0; i < n; i++ ) {
@@ -373,6 +641,9 @@ attr_valadd(
 	int		i;
 	BerVarray	v2;
 
+	if ( a->a_flags & SLAP_ATTR_HASHED )
+		attr_valhash_free( a );
+
 	v2 = (BerVarray) SLAP_REALLOC( (char *) a->a_vals,
 		    (a->a_numvals + nn + 1) * sizeof(struct berval) );
 	if( v2 == NULL ) {
@@ -396,9 +667,61 @@ attr_valadd(
 
 	/* If sorted and old vals exist, must insert */
 	if (( a->a_flags & SLAP_ATTR_SORTED_VALS ) && a->a_numvals ) {
-		unsigned slot;
-		int j, rc;
+		unsigned slot, *slots = NULL;
+		int j, k, rc;
 		v2 = nvals ? nvals : vals;
+
+		/* slap_mods_check() hands us values already in index order.
+		 * Then every insertion point can be found up front and the
+		 * arrays merged in one pass, instead of shifting the tail of
+		 * the attribute once per value.
+		 */
+		if ( nn > 1 ) {
+			unsigned flags = SLAP_MR_EQUALITY | SLAP_MR_VALUE_OF_ASSERTION_SYNTAX |
+				SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH | SLAP_MR_ATTRIBUTE_VALUE_NORMALIZED_MATCH;
+			const char *text;
+			int match;
+
+			slots = ch_malloc( nn * sizeof(unsigned) );
+			for ( i = 0; i < nn; i++ ) {
+				rc = attr_valfind( a, flags, &v2[i], &slots[i], NULL );
+				if ( rc != LDAP_NO_SUCH_ATTRIBUTE ) {
+					ch_free( slots );
+					if ( rc == LDAP_SUCCESS )
+						rc = LDAP_TYPE_OR_VALUE_EXISTS;
+					return rc;
+				}
+				if ( i == 0 || slots[i] > slots[i-1] )
+					continue;
+				if ( slots[i] == slots[i-1] &&
+					value_match( &match, a->a_desc,
+						a->a_desc->ad_type->sat_equality, flags,
+						&v2[i-1], &v2[i], &text ) == LDAP_SUCCESS &&
+					match < 0 )
+					continue;
+				/* not in order, insert one by one */
+				ch_free( slots );
+				slots = NULL;
+				break;
+			}
+		}
+		if ( slots ) {
+			j = a->a_numvals - 1;
+			k = a->a_numvals + nn - 1;
+			for ( i = nn - 1; i >= 0; i--, k-- ) {
+				for ( ; j >= (int)slots[i]; j--, k-- ) {
+					a->a_vals[k] = a->a_vals[j];
+					if ( nvals )
+						a->a_nvals[k] = a->a_nvals[j];
+				}
+				ber_dupbv( &a->a_nvals[k], &v2[i] );
+				if ( nvals )
+					ber_dupbv( &a->a_vals[k], &vals[i] );
+			}
+			ch_free( slots );
+			a->a_numvals += nn;
+			nn = 0;
+		}
 		for ( i = 0; i < nn; i++ ) {
 			rc = attr_valfind( a, SLAP_MR_EQUALITY | SLAP_MR_VALUE_OF_ASSERTION_SYNTAX |
 				SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH | SLAP_MR_ATTRIBUTE_VALUE_NORMALIZED_MATCH,
@@ -504,6 +827,7 @@ attr_normalize(
 {
 	int		rc = LDAP_SUCCESS;
 	BerVarray	nvals = NULL;
+	slap_prof_ctx_t	pc;
 
 	*nvalsp = NULL;
 
@@ -511,7 +835,9 @@ attr_normalize(
 		desc->ad_type->sat_equality->smr_normalize )
 	{
 		int	i;
-		
+
+		SLAP_PROF_BEGIN( pc, SLAP_PROF_NORMALIZE );
+
 		for ( i = 0; !BER_BVISNULL( &vals[i] ); i++ );
 
 		nvals = slap_sl_calloc( sizeof(struct berval), i + 1, memctx );
@@ -529,6 +855,7 @@ attr_normalize(
 		}
 		BER_BVZERO( &nvals[i] );
 		*nvalsp = nvals;
+		SLAP_PROF_END( pc, SLAP_PROF_NORMALIZE );
 	}
 
 	if ( rc != LDAP_SUCCESS && nvals != NULL ) {
@@ -705,6 +1032,9 @@ int
 attr_init( void )
 {
 	ldap_pvt_thread_mutex_init( &attr_mutex );
+	ldap_pvt_thread_mutex_init( &attr_hash_mutex );
+	ldap_pvt_thread_key_create( &attr_local_key );
+	attr_main_ctx = ldap_pvt_thread_pool_context();
 	return 0;
 }
 
@@ -718,5 +1048,7 @@ attr_destroy( void )
 		free( a );
 	}
 	ldap_pvt_thread_mutex_destroy( &attr_mutex );
+	ldap_pvt_thread_mutex_destroy( &attr_hash_mutex );
+	ldap_pvt_thread_key_destroy( attr_local_key );
 	return 0;
 }
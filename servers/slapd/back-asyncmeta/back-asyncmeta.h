@@ -245,6 +245,8 @@ typedef struct a_metacommon_t {
 typedef struct a_metatarget_t {
 	char			*mt_uri;
 	ldap_pvt_thread_mutex_t	mt_uri_mutex;
+	/* per-URI probe results; only touched by the health check task */
+	ldap_uri_health_t	*mt_health;
 
 	/* TODO: we might want to enable different strategies
 	 * for different targets */
@@ -331,17 +333,37 @@ typedef struct a_metatarget_t {
 /* the interval of the timeout checking loop in microseconds
  * possibly make this configurable? */
 #define META_BACK_CFG_MAX_TIMEOUT_LOOP          0x70000
+/* max responses of one search handled in a row before the
+ * other operations sharing the target connection get a turn */
+#define META_BACK_SEARCH_BURST			64
 	slap_mask_t		mt_rep_flags;
 	int                     mt_timeout_ops;
 } a_metatarget_t;
 
-typedef struct a_metadncache_t {
+/*
+ * The dncache is split in shards, each with its own lock, tree and
+ * LRU list; a DN always hashes to the same shard.
+ */
+typedef struct a_metadncache_shard_t {
 	ldap_pvt_thread_mutex_t mutex;
 	Avlnode			*tree;
+	LDAP_TAILQ_HEAD(a_metadncache_lru, metadncacheentry_t) lru;
+	int			num;
+	int			negative;
+
+	unsigned long		hits;
+	unsigned long		misses;
+} a_metadncache_shard_t;
+
+#define META_DNCACHE_SHARDS	(16)
+
+typedef struct a_metadncache_t {
+	a_metadncache_shard_t	shards[ META_DNCACHE_SHARDS ];
 
 #define META_DNCACHE_DISABLED   (0)
 #define META_DNCACHE_FOREVER    ((time_t)(-1))
 	time_t			ttl;  /* seconds; 0: no cache, -1: no expiry */
+	int			max;  /* entries; 0: no limit */
 } a_metadncache_t;
 
 typedef struct a_metacandidates_t {
@@ -411,6 +433,13 @@ typedef struct a_metainfo_t {
 
 	time_t			mi_idle_timeout;
 	struct re_s *mi_task;
+	time_t			mi_health_interval;
+	struct re_s		*mi_health_task;
+#define META_BACK_HEALTH_TIMEOUT	(5)
+
+	/* monitor */
+	struct berval		mi_monitor_ndn;
+	void			*mi_monitor_cb;
 
 	a_metacommon_t	mi_mc;
 	ldap_extra_t	*mi_ldap_extra;
@@ -548,6 +577,7 @@ asyncmeta_dncache_dup(
 
 #define META_TARGET_NONE	(-1)
 #define META_TARGET_MULTIPLE	(-2)
+#define META_TARGET_NEGATIVE	(-3)	/* known not to exist */
 extern int
 asyncmeta_dncache_get_target(
 	a_metadncache_t		*cache,
@@ -564,9 +594,28 @@ asyncmeta_dncache_delete_entry(
 	a_metadncache_t		*cache,
 	struct berval		*ndn );
 
+extern int
+asyncmeta_dncache_clear_negative(
+	a_metadncache_t		*cache,
+	struct berval		*ndn );
+
 extern void
 asyncmeta_dncache_free( void *entry );
 
+extern void
+asyncmeta_dncache_init( a_metadncache_t *cache );
+
+extern void
+asyncmeta_dncache_destroy( a_metadncache_t *cache );
+
+extern void
+asyncmeta_dncache_stats(
+	a_metadncache_t		*cache,
+	unsigned long		*entries,
+	unsigned long		*negative,
+	unsigned long		*hits,
+	unsigned long		*misses );
+
 extern int
 asyncmeta_subtree_destroy( a_metasubtree_t *ms );
 
@@ -740,6 +789,20 @@ void
 asyncmeta_back_conn_free(
 	            void 		*v_mc );
 
+void
+asyncmeta_back_health_schedule(
+		Backend		*be,
+		time_t		interval );
+
+int
+asyncmeta_back_monitor_db_init( BackendDB *be );
+
+int
+asyncmeta_back_monitor_db_open( BackendDB *be );
+
+int
+asyncmeta_back_monitor_db_close( BackendDB *be );
+
 void asyncmeta_log_msc(a_metasingleconn_t *msc);
 void asyncmeta_log_conns(a_metainfo_t *mi);
 
@@ -59,6 +59,8 @@ enum {
 	LDAP_BACK_CFG_MAX_TIMEOUT_OPS,
 	LDAP_BACK_CFG_MAX_PENDING_OPS,
 	LDAP_BACK_CFG_MAX_TARGET_CONNS,
+	LDAP_BACK_CFG_HEALTH_INTERVAL,
+	LDAP_BACK_CFG_DNCACHE_MAX,
 	LDAP_BACK_CFG_LAST_BASE,
 };
 
@@ -281,6 +283,15 @@ static ConfigTable a_metacfg[] = {
 			"SYNTAX OMsDirectoryString "
 			"SINGLE-VALUE )",
 		NULL, NULL },
+	{ "dncache-max-entries", "entries", 2, 2, 0,
+		ARG_MAGIC|ARG_INT|LDAP_BACK_CFG_DNCACHE_MAX,
+		asyncmeta_back_cf_gen, "( OLcfgDbAt:3.121 "
+			"NAME 'olcDbDnCacheMaxEntries' "
+			"DESC 'Maximum number of DNs in the dncache' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger "
+			"SINGLE-VALUE )",
+		NULL, NULL },
 	{ "bind-timeout", "microseconds", 2, 2, 0,
 		ARG_MAGIC|ARG_ULONG|LDAP_BACK_CFG_BIND_TIMEOUT,
 		asyncmeta_back_cf_gen, "( OLcfgDbAt:3.107 "
@@ -377,6 +388,16 @@ static ConfigTable a_metacfg[] = {
 	  "SINGLE-VALUE )",
 	  NULL, NULL },
 
+	{ "health-check-interval", "interval", 2, 2, 0,
+		ARG_MAGIC|LDAP_BACK_CFG_HEALTH_INTERVAL,
+		asyncmeta_back_cf_gen, "( OLcfgDbAt:3.119 "
+			"NAME 'olcDbHealthCheckInterval' "
+			"DESC 'Interval between probes of the target URIs' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString "
+			"SINGLE-VALUE )",
+		NULL, NULL },
+
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED,
 		NULL, NULL, NULL, NULL }
 };
@@ -410,10 +431,12 @@ static ConfigOCs a_metaocs[] = {
 		"DESC 'Asyncmeta backend configuration' "
 		"SUP olcDatabaseConfig "
 		"MAY ( olcDbDnCacheTtl "
+			"$ olcDbDnCacheMaxEntries "
 			"$ olcDbIdleTimeout "
 			"$ olcDbOnErr "
 			"$ olcDbPseudoRootBindDefer "
 			"$ olcDbConnectionPoolMax "
+			"$ olcDbHealthCheckInterval "
 	                "$ olcDbMaxTimeoutOps"
 	                "$ olcDbMaxPendingOps "
 	                "$ olcDbMaxTargetConns"
@@ -1047,6 +1070,18 @@ asyncmeta_back_cf_gen( ConfigArgs *c )
 			}
 			break;
 
+		case LDAP_BACK_CFG_HEALTH_INTERVAL:
+			if ( mi->mi_health_interval == 0 ) {
+				return 1;
+			} else {
+				char	buf[ SLAP_TEXT_BUFLEN ];
+
+				lutil_unparse_time( buf, sizeof( buf ), mi->mi_health_interval );
+				ber_str2bv( buf, 0, 0, &bv );
+				value_add_one( &c->rvalue_vals, &bv );
+			}
+			break;
+
 		case LDAP_BACK_CFG_ONERR:
 			enum_to_verb( onerr_mode, mi->mi_flags & META_BACK_F_ONERR_MASK, &bv );
 			if ( BER_BVISNULL( &bv )) {
@@ -1486,6 +1521,9 @@ asyncmeta_back_cf_gen( ConfigArgs *c )
 		case LDAP_BACK_CFG_MAX_TARGET_CONNS:
 			c->value_int = mi->mi_max_target_conns;
 			break;
+		case LDAP_BACK_CFG_DNCACHE_MAX:
+			c->value_int = mi->mi_cache.max;
+			break;
 		case LDAP_BACK_CFG_MAX_TIMEOUT_OPS:
 			c->value_int = mi->mi_max_timeout_ops;
 			break;
@@ -1515,6 +1553,13 @@ asyncmeta_back_cf_gen( ConfigArgs *c )
 			mi->mi_idle_timeout = 0;
 			break;
 
+		case LDAP_BACK_CFG_HEALTH_INTERVAL:
+			mi->mi_health_interval = 0;
+			if ( slapMode & SLAP_SERVER_RUNNING ) {
+				asyncmeta_back_health_schedule( c->be, 0 );
+			}
+			break;
+
 		case LDAP_BACK_CFG_ONERR:
 			mi->mi_flags &= ~META_BACK_F_ONERR_MASK;
 			break;
@@ -1717,6 +1762,10 @@ asyncmeta_back_cf_gen( ConfigArgs *c )
 			mi->mi_max_target_conns = 0;
 			break;
 
+		case LDAP_BACK_CFG_DNCACHE_MAX:
+			mi->mi_cache.max = 0;
+			break;
+
 		case LDAP_BACK_CFG_MAX_TIMEOUT_OPS:
 			mi->mi_max_timeout_ops = 0;
 			break;
@@ -2007,6 +2056,15 @@ asyncmeta_back_cf_gen( ConfigArgs *c )
 		mi->mi_max_target_conns = c->value_int;
 	}
 		break;
+	case LDAP_BACK_CFG_DNCACHE_MAX:
+		if (c->value_int < 0) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				  "dncache-max-entries invalid value %d",
+				  c->value_int);
+			return 1;
+		}
+		mi->mi_cache.max = c->value_int;
+		break;
 	case LDAP_BACK_CFG_MAX_TIMEOUT_OPS:
 		if (c->value_int < 0) {
 			snprintf( c->cr_msg, sizeof( c->cr_msg ),
@@ -2108,6 +2166,24 @@ asyncmeta_back_cf_gen( ConfigArgs *c )
 		mi->mi_idle_timeout = (time_t)t;
 		} break;
 
+	case LDAP_BACK_CFG_HEALTH_INTERVAL: {
+	/* interval between active probes of the target URIs */
+		unsigned long	t;
+
+		if ( lutil_parse_time( c->argv[ 1 ], &t ) ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"unable to parse health check interval \"%s\"",
+				c->argv[ 1 ] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+			return 1;
+
+		}
+		mi->mi_health_interval = (time_t)t;
+		if ( slapMode & SLAP_SERVER_RUNNING ) {
+			asyncmeta_back_health_schedule( c->be, mi->mi_health_interval );
+		}
+		} break;
+
 	case LDAP_BACK_CFG_BIND_TIMEOUT:
 	/* bind timeout when connecting to ldap servers */
 		mc->mc_bind_timeout.tv_sec = c->value_ulong/1000000;
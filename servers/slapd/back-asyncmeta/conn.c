@@ -580,6 +580,7 @@ asyncmeta_getconn(
 		if ( op->orr_nnewSup ) {
 			dn_type = META_DNTYPE_NEWPARENT;
 		}
+		dnParent( &ndn, &pndn );
 		break;
 
 	case LDAP_REQ_BIND:
@@ -672,6 +673,51 @@ asyncmeta_getconn(
 	 */
 	if ( mi->mi_cache.ttl != META_DNCACHE_DISABLED ) {
 		cached = i = asyncmeta_dncache_get_target( &mi->mi_cache, &op->o_req_ndn );
+
+		if ( i == META_TARGET_NEGATIVE ) {
+			/* the searchBase (or a superior) is known not to exist */
+			if ( op_type == META_OP_ALLOW_MULTIPLE ) {
+				rs->sr_err = LDAP_NO_SUCH_OBJECT;
+				rs->sr_text = NULL;
+
+				if ( sendok & LDAP_BACK_SENDERR ) {
+					rs->sr_matched = mi->mi_suffix.bv_val;
+					send_ldap_result( op, rs );
+					rs->sr_matched = NULL;
+				}
+				ldap_pvt_thread_mutex_unlock(&mc->mc_om_mutex);
+				if ( alloc_new > 0 ) {
+					asyncmeta_back_conn_free( mc );
+				}
+				return NULL;
+			}
+			cached = i = META_TARGET_NONE;
+		}
+
+		switch ( op->o_tag ) {
+		case LDAP_REQ_ADD:
+			/* the entry is about to be created */
+			( void )asyncmeta_dncache_clear_negative( &mi->mi_cache, &op->o_req_ndn );
+			break;
+
+		case LDAP_REQ_MODRDN: {
+			struct berval	newndn;
+
+			build_new_dn( &newndn,
+				op->orr_nnewSup ? op->orr_nnewSup : &pndn,
+				&op->orr_nnewrdn, op->o_tmpmemctx );
+			( void )asyncmeta_dncache_clear_negative( &mi->mi_cache, &newndn );
+			( void )asyncmeta_dncache_delete_entry( &mi->mi_cache, &op->o_req_ndn );
+			op->o_tmpfree( newndn.bv_val, op->o_tmpmemctx );
+			} break;
+
+		case LDAP_REQ_DELETE:
+			( void )asyncmeta_dncache_delete_entry( &mi->mi_cache, &op->o_req_ndn );
+			break;
+
+		default:
+			break;
+		}
 	}
 
 	if ( op_type == META_OP_REQUIRE_SINGLE ) {
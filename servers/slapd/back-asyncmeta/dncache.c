@@ -30,7 +30,9 @@
 #include "back-asyncmeta.h"
 
 /*
- * The dncache, at present, maps an entry to the target that holds it.
+ * The dncache maps an entry to the target that holds it; negative
+ * entries record that a DN does not exist in any target, and thus
+ * that none of its subordinates does either.
  */
 
 typedef struct metadncacheentry_t {
@@ -38,14 +40,13 @@ typedef struct metadncacheentry_t {
 	int 		target;
 
 	time_t 		lastupdated;
+	LDAP_TAILQ_ENTRY(metadncacheentry_t) lru;
 } metadncacheentry_t;
 
 /*
  * asyncmeta_dncache_cmp
  *
  * compares two struct metadncacheentry; used by avl stuff
- * FIXME: modify avl stuff to delete an entry based on cmp
- * (e.g. when ttl expired?)
  */
 int
 asyncmeta_dncache_cmp(
@@ -81,27 +82,54 @@ asyncmeta_dncache_dup(
 	return ( ber_bvcmp( &cc1->dn, &cc2->dn ) == 0 ) ? -1 : 0;
 }
 
+static a_metadncache_shard_t *
+asyncmeta_dncache_shard(
+	a_metadncache_t	*cache,
+	struct berval	*ndn )
+{
+	unsigned	h = 0;
+	ber_len_t	i;
+
+	for ( i = 0; i < ndn->bv_len; i++ ) {
+		h = h * 31 + (unsigned char)ndn->bv_val[ i ];
+	}
+
+	return &cache->shards[ h % META_DNCACHE_SHARDS ];
+}
+
+/* must be called with the shard locked */
+static void
+asyncmeta_dncache_unlink(
+	a_metadncache_shard_t	*shard,
+	metadncacheentry_t	*entry )
+{
+	(void)avl_delete( &shard->tree, ( caddr_t )entry,
+			asyncmeta_dncache_cmp );
+	LDAP_TAILQ_REMOVE( &shard->lru, entry, lru );
+	shard->num--;
+	if ( entry->target == META_TARGET_NEGATIVE ) {
+		shard->negative--;
+	}
+}
+
 /*
- * asyncmeta_dncache_get_target
- *
- * returns the target a dn belongs to, or -1 in case the dn is not
- * in the cache
+ * looks ndn up in its shard; expired entries are dropped.
+ * If negative is set, only negative entries are considered.
  */
-int
-asyncmeta_dncache_get_target(
+static int
+asyncmeta_dncache_find(
 	a_metadncache_t	*cache,
-	struct berval	*ndn )
+	struct berval	*ndn,
+	int		negative )
 {
+	a_metadncache_shard_t	*shard = asyncmeta_dncache_shard( cache, ndn );
 	metadncacheentry_t	tmp_entry,
 				*entry;
 	int			target = META_TARGET_NONE;
 
-	assert( cache != NULL );
-	assert( ndn != NULL );
-
 	tmp_entry.dn = *ndn;
-	ldap_pvt_thread_mutex_lock( &cache->mutex );
-	entry = ( metadncacheentry_t * )avl_find( cache->tree,
+	ldap_pvt_thread_mutex_lock( &shard->mutex );
+	entry = ( metadncacheentry_t * )avl_find( shard->tree,
 			( caddr_t )&tmp_entry, asyncmeta_dncache_cmp );
 
 	if ( entry != NULL ) {
@@ -111,16 +139,84 @@ asyncmeta_dncache_get_target(
 		 * if cache->ttl = 0 no cache is used; shouldn't get here
 		 * else, cache is used with ttl
 		 */
-		if ( cache->ttl < 0 ) {
+		if ( cache->ttl > 0
+			&& entry->lastupdated + cache->ttl <= slap_get_time() )
+		{
+			asyncmeta_dncache_unlink( shard, entry );
+			asyncmeta_dncache_free( ( void * )entry );
+
+		} else if ( !negative || entry->target == META_TARGET_NEGATIVE ) {
 			target = entry->target;
+			shard->hits++;
+			if ( entry != LDAP_TAILQ_FIRST( &shard->lru ) ) {
+				LDAP_TAILQ_REMOVE( &shard->lru, entry, lru );
+				LDAP_TAILQ_INSERT_HEAD( &shard->lru, entry, lru );
+			}
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &shard->mutex );
 
-		} else {
-			if ( entry->lastupdated+cache->ttl > slap_get_time() ) {
-				target = entry->target;
+	return target;
+}
+
+static int
+asyncmeta_dncache_has_negative(
+	a_metadncache_t	*cache )
+{
+	int	i;
+
+	/* unlocked read: at worst, a concurrent update is missed */
+	for ( i = 0; i < META_DNCACHE_SHARDS; i++ ) {
+		if ( cache->shards[ i ].negative ) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * asyncmeta_dncache_get_target
+ *
+ * returns the target a dn belongs to, META_TARGET_NEGATIVE if the dn
+ * or one of its superiors is known not to exist, or META_TARGET_NONE
+ * in case the dn is not in the cache
+ */
+int
+asyncmeta_dncache_get_target(
+	a_metadncache_t	*cache,
+	struct berval	*ndn )
+{
+	a_metadncache_shard_t	*shard;
+	int			target;
+
+	assert( cache != NULL );
+	assert( ndn != NULL );
+
+	target = asyncmeta_dncache_find( cache, ndn, 0 );
+
+	if ( target == META_TARGET_NONE && asyncmeta_dncache_has_negative( cache ) ) {
+		struct berval	dn = *ndn, pdn;
+
+		while ( !BER_BVISEMPTY( &dn ) ) {
+			dnParent( &dn, &pdn );
+			if ( BER_BVISEMPTY( &pdn ) ) {
+				break;
 			}
+			if ( asyncmeta_dncache_find( cache, &pdn, 1 ) == META_TARGET_NEGATIVE ) {
+				target = META_TARGET_NEGATIVE;
+				break;
+			}
+			dn = pdn;
 		}
 	}
-	ldap_pvt_thread_mutex_unlock( &cache->mutex );
+
+	if ( target == META_TARGET_NONE ) {
+		shard = asyncmeta_dncache_shard( cache, ndn );
+		ldap_pvt_thread_mutex_lock( &shard->mutex );
+		shard->misses++;
+		ldap_pvt_thread_mutex_unlock( &shard->mutex );
+	}
 
 	return target;
 }
@@ -129,7 +225,8 @@ asyncmeta_dncache_get_target(
  * asyncmeta_dncache_update_entry
  *
  * updates target and lastupdated of a struct metadncacheentry if exists,
- * otherwise it gets created; returns -1 in case of error
+ * otherwise it gets created, evicting the least recently used entry
+ * of the shard if full; returns -1 in case of error
  */
 int
 asyncmeta_dncache_update_entry(
@@ -137,7 +234,9 @@ asyncmeta_dncache_update_entry(
 	struct berval	*ndn,
 	int 		target )
 {
+	a_metadncache_shard_t	*shard;
 	metadncacheentry_t	*entry,
+				*victim = NULL,
 				tmp_entry;
 	time_t			curr_time = 0L;
 	int			err = 0;
@@ -155,16 +254,31 @@ asyncmeta_dncache_update_entry(
 	}
 
 	tmp_entry.dn = *ndn;
+	shard = asyncmeta_dncache_shard( cache, ndn );
 
-	ldap_pvt_thread_mutex_lock( &cache->mutex );
-	entry = ( metadncacheentry_t * )avl_find( cache->tree,
+	ldap_pvt_thread_mutex_lock( &shard->mutex );
+	entry = ( metadncacheentry_t * )avl_find( shard->tree,
 			( caddr_t )&tmp_entry, asyncmeta_dncache_cmp );
 
 	if ( entry != NULL ) {
+		if ( entry->target == META_TARGET_NEGATIVE ) {
+			shard->negative--;
+		}
 		entry->target = target;
 		entry->lastupdated = curr_time;
+		if ( entry != LDAP_TAILQ_FIRST( &shard->lru ) ) {
+			LDAP_TAILQ_REMOVE( &shard->lru, entry, lru );
+			LDAP_TAILQ_INSERT_HEAD( &shard->lru, entry, lru );
+		}
 
 	} else {
+		if ( cache->max > 0
+			&& shard->num >= ( cache->max + META_DNCACHE_SHARDS - 1 ) / META_DNCACHE_SHARDS )
+		{
+			victim = LDAP_TAILQ_LAST( &shard->lru, a_metadncache_lru );
+			asyncmeta_dncache_unlink( shard, victim );
+		}
+
 		entry = ch_malloc( sizeof( metadncacheentry_t ) + ndn->bv_len + 1 );
 		if ( entry == NULL ) {
 			err = -1;
@@ -179,12 +293,22 @@ asyncmeta_dncache_update_entry(
 		entry->target = target;
 		entry->lastupdated = curr_time;
 
-		err = avl_insert( &cache->tree, ( caddr_t )entry,
+		err = avl_insert( &shard->tree, ( caddr_t )entry,
 				asyncmeta_dncache_cmp, asyncmeta_dncache_dup );
+		LDAP_TAILQ_INSERT_HEAD( &shard->lru, entry, lru );
+		shard->num++;
+	}
+
+	if ( target == META_TARGET_NEGATIVE ) {
+		shard->negative++;
 	}
 
 error_return:;
-	ldap_pvt_thread_mutex_unlock( &cache->mutex );
+	ldap_pvt_thread_mutex_unlock( &shard->mutex );
+
+	if ( victim != NULL ) {
+		asyncmeta_dncache_free( ( void * )victim );
+	}
 
 	return err;
 }
@@ -194,6 +318,7 @@ asyncmeta_dncache_delete_entry(
 	a_metadncache_t	*cache,
 	struct berval	*ndn )
 {
+	a_metadncache_shard_t	*shard;
 	metadncacheentry_t	*entry,
 				tmp_entry;
 
@@ -201,11 +326,15 @@ asyncmeta_dncache_delete_entry(
 	assert( ndn != NULL );
 
 	tmp_entry.dn = *ndn;
+	shard = asyncmeta_dncache_shard( cache, ndn );
 
-	ldap_pvt_thread_mutex_lock( &cache->mutex );
-	entry = avl_delete( &cache->tree, ( caddr_t )&tmp_entry,
-			asyncmeta_dncache_cmp );
-	ldap_pvt_thread_mutex_unlock( &cache->mutex );
+	ldap_pvt_thread_mutex_lock( &shard->mutex );
+	entry = ( metadncacheentry_t * )avl_find( shard->tree,
+			( caddr_t )&tmp_entry, asyncmeta_dncache_cmp );
+	if ( entry != NULL ) {
+		asyncmeta_dncache_unlink( shard, entry );
+	}
+	ldap_pvt_thread_mutex_unlock( &shard->mutex );
 
 	if ( entry != NULL ) {
 		asyncmeta_dncache_free( ( void * )entry );
@@ -214,6 +343,107 @@ asyncmeta_dncache_delete_entry(
 	return 0;
 }
 
+/*
+ * asyncmeta_dncache_clear_negative
+ *
+ * drops the negative entries of ndn and of its superiors,
+ * e.g. because ndn is about to be created
+ */
+int
+asyncmeta_dncache_clear_negative(
+	a_metadncache_t	*cache,
+	struct berval	*ndn )
+{
+	struct berval	dn = *ndn;
+
+	assert( cache != NULL );
+	assert( ndn != NULL );
+
+	while ( asyncmeta_dncache_has_negative( cache ) && !BER_BVISEMPTY( &dn ) ) {
+		a_metadncache_shard_t	*shard = asyncmeta_dncache_shard( cache, &dn );
+		metadncacheentry_t	*entry,
+					tmp_entry;
+		struct berval		pdn;
+
+		tmp_entry.dn = dn;
+		ldap_pvt_thread_mutex_lock( &shard->mutex );
+		entry = ( metadncacheentry_t * )avl_find( shard->tree,
+				( caddr_t )&tmp_entry, asyncmeta_dncache_cmp );
+		if ( entry != NULL && entry->target == META_TARGET_NEGATIVE ) {
+			asyncmeta_dncache_unlink( shard, entry );
+		} else {
+			entry = NULL;
+		}
+		ldap_pvt_thread_mutex_unlock( &shard->mutex );
+
+		if ( entry != NULL ) {
+			asyncmeta_dncache_free( ( void * )entry );
+		}
+
+		dnParent( &dn, &pdn );
+		dn = pdn;
+	}
+
+	return 0;
+}
+
+void
+asyncmeta_dncache_stats(
+	a_metadncache_t	*cache,
+	unsigned long	*entries,
+	unsigned long	*negative,
+	unsigned long	*hits,
+	unsigned long	*misses )
+{
+	int	i;
+
+	*entries = *negative = *hits = *misses = 0;
+
+	for ( i = 0; i < META_DNCACHE_SHARDS; i++ ) {
+		a_metadncache_shard_t	*shard = &cache->shards[ i ];
+
+		ldap_pvt_thread_mutex_lock( &shard->mutex );
+		*entries += shard->num;
+		*negative += shard->negative;
+		*hits += shard->hits;
+		*misses += shard->misses;
+		ldap_pvt_thread_mutex_unlock( &shard->mutex );
+	}
+}
+
+void
+asyncmeta_dncache_init(
+	a_metadncache_t	*cache )
+{
+	int	i;
+
+	for ( i = 0; i < META_DNCACHE_SHARDS; i++ ) {
+		ldap_pvt_thread_mutex_init( &cache->shards[ i ].mutex );
+		LDAP_TAILQ_INIT( &cache->shards[ i ].lru );
+	}
+}
+
+void
+asyncmeta_dncache_destroy(
+	a_metadncache_t	*cache )
+{
+	int	i;
+
+	for ( i = 0; i < META_DNCACHE_SHARDS; i++ ) {
+		a_metadncache_shard_t	*shard = &cache->shards[ i ];
+
+		ldap_pvt_thread_mutex_lock( &shard->mutex );
+		if ( shard->tree ) {
+			avl_free( shard->tree, asyncmeta_dncache_free );
+			shard->tree = NULL;
+		}
+		LDAP_TAILQ_INIT( &shard->lru );
+		shard->num = shard->negative = 0;
+		ldap_pvt_thread_mutex_unlock( &shard->mutex );
+		ldap_pvt_thread_mutex_destroy( &shard->mutex );
+	}
+}
+
 /*
  * meta_dncache_free
  *
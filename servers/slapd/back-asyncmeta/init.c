@@ -143,7 +143,10 @@ asyncmeta_back_db_init(
 	mi->mi_rebind_f = asyncmeta_back_default_rebind;
 	mi->mi_urllist_f = asyncmeta_back_default_urllist;
 
-	ldap_pvt_thread_mutex_init( &mi->mi_cache.mutex );
+	asyncmeta_dncache_init( &mi->mi_cache );
+
+	/* ignore failures, monitoring is optional */
+	(void)asyncmeta_back_monitor_db_init( be );
 
 	/* safe default */
 	mi->mi_nretries = META_RETRY_DEFAULT;
@@ -227,6 +230,94 @@ asyncmeta_target_finish(
 	return 0;
 }
 
+/*
+ * Probes the URIs of every target with more than one, and puts the
+ * reachable ones first, fastest first, so that new connections
+ * (which try the URIs in order) go to the best available server.
+ */
+static void *
+asyncmeta_back_health_check( void *ctx, void *arg )
+{
+	struct re_s	*rtask = arg;
+	a_metainfo_t	*mi = rtask->arg;
+	int		i;
+
+	for ( i = 0; i < mi->mi_ntargets; i++ ) {
+		a_metatarget_t	*mt = mi->mi_targets[ i ];
+		char		*uris, *newuris = NULL;
+		time_t		timeout;
+
+		ldap_pvt_thread_mutex_lock( &mt->mt_uri_mutex );
+		uris = ch_strdup( mt->mt_uri );
+		ldap_pvt_thread_mutex_unlock( &mt->mt_uri_mutex );
+
+		/* nothing to choose from */
+		if ( strchr( uris, ' ' ) == NULL ) {
+			ch_free( uris );
+			continue;
+		}
+
+		timeout = mt->mt_network_timeout ?
+			mt->mt_network_timeout : META_BACK_HEALTH_TIMEOUT;
+		if ( mi->mi_ldap_extra->uri_probe( uris, &mt->mt_tls, timeout,
+			&mt->mt_health, &newuris ) == LDAP_SUCCESS )
+		{
+			ldap_pvt_thread_mutex_lock( &mt->mt_uri_mutex );
+			if ( strcmp( mt->mt_uri, newuris ) != 0 ) {
+				Debug( LDAP_DEBUG_TRACE,
+					"asyncmeta_back_health_check: target #%d uri=\"%s\"\n",
+					i, newuris );
+				ch_free( mt->mt_uri );
+				mt->mt_uri = newuris;
+				newuris = NULL;
+			}
+			ldap_pvt_thread_mutex_unlock( &mt->mt_uri_mutex );
+		}
+
+		ch_free( uris );
+		if ( newuris ) {
+			ch_free( newuris );
+		}
+	}
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	ldap_pvt_runqueue_resched( &slapd_rq, rtask, 0 );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	return NULL;
+}
+
+/*
+ * (Re)schedules the health check task with the given interval,
+ * or removes it if interval is 0
+ */
+void
+asyncmeta_back_health_schedule( Backend *be, time_t interval )
+{
+	a_metainfo_t	*mi = (a_metainfo_t *)be->be_private;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( interval == 0 ) {
+		if ( mi->mi_health_task != NULL ) {
+			if ( ldap_pvt_runqueue_isrunning( &slapd_rq, mi->mi_health_task ) ) {
+				ldap_pvt_runqueue_stoptask( &slapd_rq, mi->mi_health_task );
+			}
+			ldap_pvt_runqueue_remove( &slapd_rq, mi->mi_health_task );
+			mi->mi_health_task = NULL;
+		}
+
+	} else if ( mi->mi_health_task == NULL ) {
+		mi->mi_health_task = ldap_pvt_runqueue_insert( &slapd_rq,
+			interval, asyncmeta_back_health_check, mi,
+			"asyncmeta_back_health_check", be->be_suffix[0].bv_val );
+
+	} else {
+		mi->mi_health_task->interval.tv_sec = interval;
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
 int
 asyncmeta_back_db_open(
 	Backend		*be,
@@ -270,6 +361,10 @@ asyncmeta_back_db_open(
 	mi->mi_task = ldap_pvt_runqueue_insert( &slapd_rq, 0,
 		asyncmeta_timeout_loop, mi, "asyncmeta_timeout_loop", mi->mi_suffix.bv_val );
 	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	asyncmeta_back_health_schedule( be, mi->mi_health_interval );
+
+	/* monitor setup; failures are not fatal */
+	(void)asyncmeta_back_monitor_db_open( be );
 	return 0;
 }
 
@@ -389,6 +484,8 @@ asyncmeta_back_db_close(
 			ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
 			mi->mi_task = NULL;
 		}
+		asyncmeta_back_health_schedule( be, 0 );
+		(void)asyncmeta_back_monitor_db_close( be );
 		ldap_pvt_thread_mutex_lock( &mi->mi_mc_mutex );
 		asyncmeta_back_stop_miconns( mi );
 		ldap_pvt_thread_mutex_unlock( &mi->mi_mc_mutex );
@@ -424,19 +521,17 @@ asyncmeta_back_db_destroy(
 					ldap_pvt_thread_mutex_destroy( &mt->mt_quarantine_mutex );
 				}
 
+				if ( mt->mt_health != NULL ) {
+					mi->mi_ldap_extra->uri_health_free( mt->mt_health );
+				}
+
 				asyncmeta_target_free( mt );
 			}
 
 			free( mi->mi_targets );
 		}
 
-		ldap_pvt_thread_mutex_lock( &mi->mi_cache.mutex );
-		if ( mi->mi_cache.tree ) {
-			avl_free( mi->mi_cache.tree, asyncmeta_dncache_free );
-		}
-
-		ldap_pvt_thread_mutex_unlock( &mi->mi_cache.mutex );
-		ldap_pvt_thread_mutex_destroy( &mi->mi_cache.mutex );
+		asyncmeta_dncache_destroy( &mi->mi_cache );
 
 		if ( mi->mi_candidates != NULL ) {
 			ber_memfree_x( mi->mi_candidates, NULL );
@@ -553,6 +553,32 @@ asyncmeta_search_last_result(a_metaconn_t *mc, bm_context_t *bc, int candidate,
 		matched = mi->mi_suffix.bv_val;
 	}
 
+	/*
+	 * if all the candidates said the searchBase does not exist,
+	 * and it does not contain the suffix of any target, neither
+	 * it nor its subordinates exist: remember it
+	 */
+	if ( sres == LDAP_NO_SUCH_OBJECT
+		&& mi->mi_cache.ttl != META_DNCACHE_DISABLED
+		&& rs->sr_nentries == 0 )
+	{
+		for ( i = 0; i < mi->mi_ntargets; i++ ) {
+			if ( dnIsSuffix( &mi->mi_targets[ i ]->mt_nsuffix, &op->o_req_ndn ) ) {
+				break;
+			}
+			if ( META_IS_CANDIDATE( &candidates[ i ] )
+				&& candidates[ i ].sr_err != LDAP_NO_SUCH_OBJECT )
+			{
+				break;
+			}
+		}
+
+		if ( i == mi->mi_ntargets ) {
+			( void )asyncmeta_dncache_update_entry( &mi->mi_cache,
+				&op->o_req_ndn, META_TARGET_NEGATIVE );
+		}
+	}
+
 	/*
 	 * In case we returned at least one entry, we return LDAP_SUCCESS
 	 * otherwise, the latter error code we got
@@ -744,6 +770,7 @@ asyncmeta_handle_search_msg(LDAPMessage *res, a_metaconn_t *mc, bm_context_t *bc
 	a_dncookie dc;
 	LDAPMessage *msg;
 	ber_int_t id;
+	int nmsgs = 0;
 
 	rs = &bc->rs;
 	mi = mc->mc_info;
@@ -1188,6 +1215,13 @@ finish:
 	}
 		ldap_msgfree(res);
 		res = NULL;
+		/* Stop after a burst, or as soon as the client falls behind;
+		 * what is left stays queued in the target's LDAP handle and
+		 * is picked up by asyncmeta_op_handle_result() in its next
+		 * round, after the other operations on this connection. */
+		if ( ++nmsgs >= META_BACK_SEARCH_BURST || op->o_conn->c_writewaiter ) {
+			break;
+		}
 		if (candidates[ i ].sr_type != REP_RESULT) {
 			struct timeval	tv = {0};
 			rc = ldap_result( msc->msc_ldr, id, LDAP_MSG_RECEIVED, &tv, &res );
@@ -1479,6 +1513,7 @@ asyncmeta_op_handle_result(void *ctx, void *arg)
 	a_metasingleconn_t *msc;
 	bm_context_t *bc;
 	void *oldctx;
+	int got;
 
 	ldap_pvt_thread_mutex_lock( &mc->mc_om_mutex );
 	rc = ++mc->mc_active;
@@ -1491,6 +1526,7 @@ asyncmeta_op_handle_result(void *ctx, void *arg)
 	oldctx = slap_sl_mem_create(SLAP_SLAB_SIZE, SLAP_SLAB_STACK, ctx, 0);	/* get existing memctx */
 
 again:
+	got = 0;
 	for (j=0; j<ntargets; j++) {
 		i++;
 		if (i >= ntargets) i = 0;
@@ -1518,6 +1554,7 @@ again:
 			ldap_pvt_thread_mutex_unlock( &mc->mc_om_mutex );
 			continue;
 		}
+		got++;
 		rc = ldap_msgtype( msg );
 		if (rc == LDAP_RES_BIND) {
 			if ( LogTest( asyncmeta_debug ) ) {
@@ -1617,6 +1654,13 @@ retry_bc:
 			ldap_msgfree(msg);
 	}
 
+	/* Responses of all targets are merged one at a time, round robin;
+	 * keep going until none has anything left, since messages already
+	 * read into the LDAP handles won't trigger another read event. */
+	if (got) {
+		goto again;
+	}
+
 	ldap_pvt_thread_mutex_lock( &mc->mc_om_mutex );
 	rc = --mc->mc_active;
 	ldap_pvt_thread_mutex_unlock( &mc->mc_om_mutex );
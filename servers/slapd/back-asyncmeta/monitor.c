@@ -0,0 +1,369 @@
+/* monitor.c - monitor asyncmeta backend */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2016-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "slap.h"
+#include "../back-ldap/back-ldap.h"
+#include "back-asyncmeta.h"
+
+#include "../back-monitor/back-monitor.h"
+
+#include "config.h"
+
+static ObjectClass		*oc_olmAsyncMetaDatabase;
+
+static AttributeDescription	*ad_olmDbDnCacheEntries,
+	*ad_olmDbDnCacheNegative, *ad_olmDbDnCacheHits,
+	*ad_olmDbDnCacheMisses;
+
+/*
+ * Asyncmeta database monitor attributes	olmDatabaseAttributes:3
+ * Asyncmeta database monitor objectclasses	olmDatabaseObjectClasses:3
+ */
+
+static struct {
+	char			*name;
+	char			*oid;
+}		s_oid[] = {
+	{ "olmAsyncMetaAttributes",		"olmDatabaseAttributes:3" },
+	{ "olmAsyncMetaObjectClasses",		"olmDatabaseObjectClasses:3" },
+
+	{ NULL }
+};
+
+static struct {
+	char			*desc;
+	AttributeDescription	**ad;
+}		s_at[] = {
+	{ "( olmAsyncMetaAttributes:1 "
+		"NAME ( 'olmDbDnCacheEntries' ) "
+		"DESC 'Number of DNs in the dncache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbDnCacheEntries },
+	{ "( olmAsyncMetaAttributes:2 "
+		"NAME ( 'olmDbDnCacheNegative' ) "
+		"DESC 'Number of DNs in the dncache known not to exist' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbDnCacheNegative },
+	{ "( olmAsyncMetaAttributes:3 "
+		"NAME ( 'olmDbDnCacheHits' ) "
+		"DESC 'Number of dncache lookups that found the DN' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbDnCacheHits },
+	{ "( olmAsyncMetaAttributes:4 "
+		"NAME ( 'olmDbDnCacheMisses' ) "
+		"DESC 'Number of dncache lookups that did not find the DN' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbDnCacheMisses },
+
+	{ NULL }
+};
+
+static struct {
+	char		*desc;
+	ObjectClass	**oc;
+}		s_oc[] = {
+	/* augments an existing object, so it must be AUXILIARY */
+	{ "( olmAsyncMetaObjectClasses:1 "
+		"NAME ( 'olmAsyncMetaDatabase' ) "
+		"SUP top AUXILIARY "
+		"MAY ( "
+			"olmDbDnCacheEntries "
+			"$ olmDbDnCacheNegative "
+			"$ olmDbDnCacheHits "
+			"$ olmDbDnCacheMisses "
+			") )",
+		&oc_olmAsyncMetaDatabase },
+
+	{ NULL }
+};
+
+static int
+asyncmeta_back_monitor_update(
+	Operation	*op,
+	SlapReply	*rs,
+	Entry		*e,
+	void		*priv )
+{
+	a_metainfo_t		*mi = (a_metainfo_t *) priv;
+	Attribute		*a;
+	char			buf[ SLAP_TEXT_BUFLEN ];
+	struct berval		bv;
+	unsigned long		values[ 4 ];
+	AttributeDescription	*ads[ 4 ];
+	int			i;
+
+	asyncmeta_dncache_stats( &mi->mi_cache, &values[ 0 ], &values[ 1 ],
+		&values[ 2 ], &values[ 3 ] );
+	ads[ 0 ] = ad_olmDbDnCacheEntries;
+	ads[ 1 ] = ad_olmDbDnCacheNegative;
+	ads[ 2 ] = ad_olmDbDnCacheHits;
+	ads[ 3 ] = ad_olmDbDnCacheMisses;
+
+	for ( i = 0; i < 4; i++ ) {
+		a = attr_find( e->e_attrs, ads[ i ] );
+		assert( a != NULL );
+		bv.bv_val = buf;
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", values[ i ] );
+		ber_bvreplace( &a->a_vals[ 0 ], &bv );
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+asyncmeta_back_monitor_free(
+	Entry		*e,
+	void		**priv )
+{
+	struct berval	values[ 2 ];
+	Modification	mod = { 0 };
+
+	const char	*text;
+	char		textbuf[ SLAP_TEXT_BUFLEN ];
+
+	int		i;
+
+	/* NOTE: if slap_shutdown != 0, priv might have already been freed */
+	*priv = NULL;
+
+	/* Remove objectClass */
+	mod.sm_op = LDAP_MOD_DELETE;
+	mod.sm_desc = slap_schema.si_ad_objectClass;
+	mod.sm_values = values;
+	mod.sm_numvals = 1;
+	values[ 0 ] = oc_olmAsyncMetaDatabase->soc_cname;
+	BER_BVZERO( &values[ 1 ] );
+
+	(void)modify_delete_values( e, &mod, 1, &text,
+		textbuf, sizeof( textbuf ) );
+	/* don't care too much about return code... */
+
+	/* remove attrs */
+	mod.sm_values = NULL;
+	mod.sm_numvals = 0;
+	for ( i = 0; s_at[ i ].desc != NULL; i++ ) {
+		mod.sm_desc = *s_at[ i ].ad;
+		(void)modify_delete_values( e, &mod, 1, &text,
+			textbuf, sizeof( textbuf ) );
+		/* don't care too much about return code... */
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+asyncmeta_back_monitor_initialize( void )
+{
+	int		i, code;
+	ConfigArgs c;
+	char	*argv[ 3 ];
+
+	static int	asyncmeta_back_monitor_initialized = 0;
+
+	/* set to 0 when successfully initialized; otherwise, remember failure */
+	static int	asyncmeta_back_monitor_initialized_failure = 1;
+
+	if ( asyncmeta_back_monitor_initialized++ ) {
+		return asyncmeta_back_monitor_initialized_failure;
+	}
+
+	if ( backend_info( "monitor" ) == NULL ) {
+		return -1;
+	}
+
+	/* register schema here */
+
+	argv[ 0 ] = "back-asyncmeta monitor";
+	c.argv = argv;
+	c.argc = 3;
+	c.fname = argv[0];
+
+	for ( i = 0; s_oid[ i ].name; i++ ) {
+		c.lineno = i;
+		argv[ 1 ] = s_oid[ i ].name;
+		argv[ 2 ] = s_oid[ i ].oid;
+
+		if ( parse_oidm( &c, 0, NULL ) != 0 ) {
+			Debug( LDAP_DEBUG_ANY, "asyncmeta_back_monitor_initialize: "
+				"unable to add "
+				"objectIdentifier \"%s=%s\"\n",
+				s_oid[ i ].name, s_oid[ i ].oid );
+			return 2;
+		}
+	}
+
+	for ( i = 0; s_at[ i ].desc != NULL; i++ ) {
+		code = register_at( s_at[ i ].desc, s_at[ i ].ad, 1 );
+		if ( code != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY, "asyncmeta_back_monitor_initialize: "
+				"register_at failed for attributeType (%s)\n",
+				s_at[ i ].desc );
+			return 3;
+
+		} else {
+			(*s_at[ i ].ad)->ad_type->sat_flags |= SLAP_AT_HIDE;
+		}
+	}
+
+	for ( i = 0; s_oc[ i ].desc != NULL; i++ ) {
+		code = register_oc( s_oc[ i ].desc, s_oc[ i ].oc, 1 );
+		if ( code != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY, "asyncmeta_back_monitor_initialize: "
+				"register_oc failed for objectClass (%s)\n",
+				s_oc[ i ].desc );
+			return 4;
+
+		} else {
+			(*s_oc[ i ].oc)->soc_flags |= SLAP_OC_HIDE;
+		}
+	}
+
+	return ( asyncmeta_back_monitor_initialized_failure = LDAP_SUCCESS );
+}
+
+/*
+ * call from within asyncmeta_back_db_init()
+ */
+int
+asyncmeta_back_monitor_db_init( BackendDB *be )
+{
+	return asyncmeta_back_monitor_initialize();
+}
+
+/*
+ * call from within asyncmeta_back_db_open()
+ */
+int
+asyncmeta_back_monitor_db_open( BackendDB *be )
+{
+	a_metainfo_t		*mi = (a_metainfo_t *) be->be_private;
+	Attribute		*a, *next;
+	monitor_callback_t	*cb = NULL;
+	int			rc = 0;
+	BackendInfo		*bi;
+	monitor_extra_t		*mbe;
+	struct berval		bv = BER_BVC( "0" );
+
+	if ( !SLAP_DBMONITORING( be ) || !BER_BVISNULL( &mi->mi_monitor_ndn ) ) {
+		return 0;
+	}
+
+	bi = backend_info( "monitor" );
+	if ( !bi || !bi->bi_extra ) {
+		SLAP_DBFLAGS( be ) ^= SLAP_DBFLAG_MONITORING;
+		return 0;
+	}
+	mbe = bi->bi_extra;
+
+	/* don't bother if monitor is not configured */
+	if ( !mbe->is_configured() ) {
+		static int warning = 0;
+
+		if ( warning++ == 0 ) {
+			Debug( LDAP_DEBUG_ANY, "asyncmeta_back_monitor_db_open: "
+				"monitoring disabled; "
+				"configure monitor database to enable\n" );
+		}
+
+		return 0;
+	}
+
+	/* alloc as many as required (plus 1 for objectClass) */
+	a = attrs_alloc( 1 + 4 );
+
+	a->a_desc = slap_schema.si_ad_objectClass;
+	attr_valadd( a, &oc_olmAsyncMetaDatabase->soc_cname, NULL, 1 );
+	next = a->a_next;
+
+	next->a_desc = ad_olmDbDnCacheEntries;
+	attr_valadd( next, &bv, NULL, 1 );
+	next = next->a_next;
+
+	next->a_desc = ad_olmDbDnCacheNegative;
+	attr_valadd( next, &bv, NULL, 1 );
+	next = next->a_next;
+
+	next->a_desc = ad_olmDbDnCacheHits;
+	attr_valadd( next, &bv, NULL, 1 );
+	next = next->a_next;
+
+	next->a_desc = ad_olmDbDnCacheMisses;
+	attr_valadd( next, &bv, NULL, 1 );
+
+	cb = ch_calloc( sizeof( monitor_callback_t ), 1 );
+	cb->mc_update = asyncmeta_back_monitor_update;
+	cb->mc_free = asyncmeta_back_monitor_free;
+	cb->mc_private = (void *)mi;
+
+	/* make sure the database is registered; then add monitor attributes */
+	rc = mbe->register_database( be, &mi->mi_monitor_ndn );
+	if ( rc == 0 ) {
+		rc = mbe->register_entry_attrs( &mi->mi_monitor_ndn, a, cb,
+			NULL, -1, NULL );
+	}
+
+	if ( rc != 0 ) {
+		ch_free( cb );
+		cb = NULL;
+	}
+
+	/* store for cleanup */
+	mi->mi_monitor_cb = (void *)cb;
+
+	/* the monitor keeps its own copy of the attributes */
+	attrs_free( a );
+
+	return rc;
+}
+
+/*
+ * call from within asyncmeta_back_db_close()
+ */
+int
+asyncmeta_back_monitor_db_close( BackendDB *be )
+{
+	a_metainfo_t		*mi = (a_metainfo_t *) be->be_private;
+
+	if ( !BER_BVISNULL( &mi->mi_monitor_ndn ) ) {
+		BackendInfo		*bi = backend_info( "monitor" );
+		monitor_extra_t		*mbe;
+
+		if ( bi && bi->bi_extra && mi->mi_monitor_cb ) {
+			mbe = bi->bi_extra;
+			mbe->unregister_entry_callback( &mi->mi_monitor_ndn,
+				(monitor_callback_t *)mi->mi_monitor_cb,
+				NULL, 0, NULL );
+		}
+
+		BER_BVZERO( &mi->mi_monitor_ndn );
+		mi->mi_monitor_cb = NULL;
+	}
+
+	return 0;
+}
@@ -178,6 +178,17 @@ typedef struct ldapconn_t {
 	unsigned		lc_flags;
 } ldapconn_t;
 
+/*
+ * handle connected (and TLS'd, if configured) ahead of time,
+ * waiting to be taken by a new connection
+ */
+typedef struct ldap_back_warm_t {
+	struct ldap_back_warm_t	*lw_next;
+	LDAP			*lw_ld;
+	int			lw_is_tls;
+	time_t			lw_time;
+} ldap_back_warm_t;
+
 typedef struct ldap_avl_info_t {
 	ldap_pvt_thread_mutex_t		lai_mutex;
 	Avlnode				*lai_tree;
@@ -397,6 +408,24 @@ typedef struct ldapinfo_t {
 	/* must be between LDAP_BACK_CONN_PRIV_MIN
 	 * and LDAP_BACK_CONN_PRIV_MAX ! */
 #define	LDAP_BACK_CONN_PRIV_DEFAULT	(16)
+	/* max operations sharing a pooled connection before another
+	 * one is opened; each still waits for its responses in its
+	 * own thread */
+	int			li_conn_priv_share;
+#define	LDAP_BACK_CONN_SHARE_MAX	(1024)
+
+	/* pool of handles connected ahead of time, replenished
+	 * by a runqueue task ("conn-warm-pool <n>") */
+	int			li_warm_max;
+#define	LDAP_BACK_WARM_MAX		(256)
+#define	LDAP_BACK_WARM_INTERVAL		(1)
+#define	LDAP_BACK_WARM_VERSION(li)	((li)->li_version ? (li)->li_version : LDAP_VERSION3)
+	int			li_warm_num;
+	ldap_back_warm_t	*li_warm;
+	ldap_pvt_thread_mutex_t	li_warm_mutex;
+	struct re_s		*li_warm_task;
+	unsigned long		li_warm_hits;
+	unsigned long		li_warm_misses;
 
 	ldap_monitor_info_t	li_monitor_info;
 
@@ -458,6 +487,13 @@ typedef enum ldap_back_send_t {
 #define LDAP_BACK_PRINT_CONNTREE 0
 #endif /* !LDAP_BACK_PRINT_CONNTREE */
 
+/* per-URI state of active health probes */
+typedef struct ldap_uri_health_t {
+	struct berval		luh_uri;
+	int			luh_up;
+	unsigned long		luh_rtt;	/* smoothed, in microseconds */
+} ldap_uri_health_t;
+
 typedef struct ldap_extra_t {
 	int (*proxy_authz_ctrl)( Operation *op, SlapReply *rs, struct berval *bound_ndn,
 		int version, slap_idassert_t *si, LDAPControl	*ctrl );
@@ -469,6 +505,9 @@ typedef struct ldap_extra_t {
 	int (*retry_info_parse)( char *in, slap_retry_info_t *ri, char *buf, ber_len_t buflen );
 	int (*retry_info_unparse)( slap_retry_info_t *ri, struct berval *bvout );
 	int (*connid2str)( const ldapconn_base_t *lc, char *buf, ber_len_t buflen );
+	int (*uri_probe)( const char *uris, slap_bindconf *sb, time_t timeout,
+		ldap_uri_health_t **healthp, char **urisp );
+	void (*uri_health_free)( ldap_uri_health_t *health );
 } ldap_extra_t;
 
 LDAP_END_DECL
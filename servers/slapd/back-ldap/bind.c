@@ -34,6 +34,7 @@
 #include "back-ldap.h"
 #include "lutil.h"
 #include "lutil_ldap.h"
+#include "ldap_rq.h"
 
 #define LDAP_CONTROL_OBSOLETE_PROXY_AUTHZ	"2.16.840.1.113730.3.4.12"
 
@@ -659,49 +660,47 @@ ldap_back_start_tls(
 }
 #endif /* HAVE_TLS */
 
+/*
+ * Creates a handle to the remote server, set up as configured,
+ * and starts TLS on it if required (see ldap_back_start_tls())
+ */
 static int
-ldap_back_prepare_conn( ldapconn_t *lc, Operation *op, SlapReply *rs, ldap_back_send_t sendok )
+ldap_back_ld_init(
+	ldapinfo_t	*li,
+	LDAP		**ldp,
+	int		version,
+	slap_bindconf	*sb,
+	unsigned	flags,
+	int		protocol,
+	int		*is_tls,
+	const char	**text )
 {
-	ldapinfo_t	*li = (ldapinfo_t *)op->o_bd->be_private;
-	int		version;
 	LDAP		*ld = NULL;
-#ifdef HAVE_TLS
-	int		is_tls = op->o_conn->c_is_tls;
-	int		flags = li->li_flags;
-	time_t		lctime = (time_t)(-1);
-	slap_bindconf *sb;
-#endif /* HAVE_TLS */
+	int		rc;
 
 	ldap_pvt_thread_mutex_lock( &li->li_uri_mutex );
-	rs->sr_err = ldap_initialize( &ld, li->li_uri );
+	rc = ldap_initialize( &ld, li->li_uri );
 	ldap_pvt_thread_mutex_unlock( &li->li_uri_mutex );
-	if ( rs->sr_err != LDAP_SUCCESS ) {
-		goto error_return;
+	if ( rc != LDAP_SUCCESS ) {
+		return rc;
 	}
 
 	if ( li->li_urllist_f ) {
 		ldap_set_urllist_proc( ld, li->li_urllist_f, li->li_urllist_p );
 	}
 
-	/* Set LDAP version. This will always succeed: If the client
-	 * bound with a particular version, then so can we.
-	 */
-	if ( li->li_version != 0 ) {
-		version = li->li_version;
-
-	} else if ( op->o_protocol != 0 ) {
-		version = op->o_protocol;
-
-	} else {
-		/* assume it's an internal op; set to LDAPv3 */
-		version = LDAP_VERSION3;
-	}
 	ldap_set_option( ld, LDAP_OPT_PROTOCOL_VERSION, (const void *)&version );
 
 	/* automatically chase referrals ("chase-referrals [{yes|no}]" statement) */
 	ldap_set_option( ld, LDAP_OPT_REFERRALS,
 		LDAP_BACK_CHASE_REFERRALS( li ) ? LDAP_OPT_ON : LDAP_OPT_OFF );
 
+	/* let the operations sharing a connection wait for their responses
+	 * concurrently ("conn-pool-share <n>" statement) */
+	if ( li->li_conn_priv_share > 1 ) {
+		ldap_set_option( ld, LDAP_OPT_CONCURRENT, LDAP_OPT_ON );
+	}
+
 	if ( li->li_network_timeout > 0 ) {
 		struct timeval		tv;
 
@@ -713,6 +712,252 @@ ldap_back_prepare_conn( ldapconn_t *lc, Operation *op, SlapReply *rs, ldap_back_
 	/* turn on network keepalive, if configured so */
 	slap_client_keepalive(ld, &li->li_tls.sb_keepalive);
 
+#ifdef HAVE_TLS
+	bindconf_tls_set( sb, ld );
+
+	ldap_pvt_thread_mutex_lock( &li->li_uri_mutex );
+	assert( li->li_uri_mutex_do_not_lock == 0 );
+	li->li_uri_mutex_do_not_lock = 1;
+	rc = ldap_back_start_tls( ld, protocol, is_tls,
+			li->li_uri, flags, li->li_timeout[ SLAP_OP_BIND ], text );
+	li->li_uri_mutex_do_not_lock = 0;
+	ldap_pvt_thread_mutex_unlock( &li->li_uri_mutex );
+	if ( rc != LDAP_SUCCESS ) {
+		ldap_unbind_ext( ld, NULL, NULL );
+		*text = "Start TLS failed";
+		return rc;
+	}
+#endif /* HAVE_TLS */
+
+	*ldp = ld;
+
+	return LDAP_SUCCESS;
+}
+
+/*
+ * Takes a handle from the warm pool, if it was prepared the way
+ * ldap_back_ld_init() would prepare it for this connection;
+ * counts hits and misses.
+ */
+static LDAP *
+ldap_back_warm_take(
+	ldapinfo_t	*li,
+	slap_bindconf	*sb,
+	int		version,
+	int		*is_tls )
+{
+	ldap_back_warm_t	*lw;
+	LDAP			*ld = NULL;
+	int			kick = 0;
+
+	if ( li->li_warm_max == 0 ) {
+		return NULL;
+	}
+
+	/* pooled handles are anonymous, set up for regular client
+	 * connections, without propagating the client's TLS */
+	if ( sb != &li->li_tls || version != LDAP_BACK_WARM_VERSION( li ) ) {
+		return NULL;
+	}
+#ifdef HAVE_TLS
+	if ( *is_tls && LDAP_BACK_PROPAGATE_TLS( li ) ) {
+		return NULL;
+	}
+#endif /* HAVE_TLS */
+
+	ldap_pvt_thread_mutex_lock( &li->li_warm_mutex );
+	lw = li->li_warm;
+	if ( lw != NULL ) {
+		li->li_warm = lw->lw_next;
+		li->li_warm_num--;
+		li->li_warm_hits++;
+	} else {
+		li->li_warm_misses++;
+	}
+	ldap_pvt_thread_mutex_unlock( &li->li_warm_mutex );
+
+	if ( lw != NULL ) {
+		ld = lw->lw_ld;
+		*is_tls = lw->lw_is_tls;
+		ch_free( lw );
+	}
+
+	/* replenish right away rather than at the next interval */
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( li->li_warm_task != NULL
+		&& !ldap_pvt_runqueue_isrunning( &slapd_rq, li->li_warm_task ) )
+	{
+		li->li_warm_task->interval.tv_sec = 0;
+		ldap_pvt_runqueue_resched( &slapd_rq, li->li_warm_task, 0 );
+		li->li_warm_task->interval.tv_sec = LDAP_BACK_WARM_INTERVAL;
+		kick = 1;
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	if ( kick ) {
+		slap_wake_listener();
+	}
+
+	return ld;
+}
+
+static void
+ldap_back_warm_free( ldap_back_warm_t *lw )
+{
+	while ( lw != NULL ) {
+		ldap_back_warm_t	*next = lw->lw_next;
+
+		ldap_unbind_ext( lw->lw_ld, NULL, NULL );
+		ch_free( lw );
+		lw = next;
+	}
+}
+
+/*
+ * Drops handles that sat in the pool longer than idle-timeout,
+ * and connects new ones until the pool is full again.
+ */
+static void *
+ldap_back_warm_task( void *ctx, void *arg )
+{
+	struct re_s		*rtask = arg;
+	ldapinfo_t		*li = rtask->arg;
+	ldap_back_warm_t	*lw, **lwp, *stale = NULL;
+	time_t			now = slap_get_time();
+
+	ldap_pvt_thread_mutex_lock( &li->li_warm_mutex );
+	for ( lwp = &li->li_warm; *lwp != NULL; ) {
+		lw = *lwp;
+		if ( li->li_idle_timeout && now - lw->lw_time > li->li_idle_timeout ) {
+			*lwp = lw->lw_next;
+			lw->lw_next = stale;
+			stale = lw;
+			li->li_warm_num--;
+
+		} else {
+			lwp = &lw->lw_next;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &li->li_warm_mutex );
+	ldap_back_warm_free( stale );
+
+	while ( !slapd_shutdown ) {
+		LDAP		*ld = NULL;
+		int		is_tls = 0, n;
+		const char	*text = NULL;
+
+		if ( LDAP_BACK_QUARANTINE( li )
+			&& li->li_isquarantined != LDAP_BACK_FQ_NO )
+		{
+			break;
+		}
+
+		ldap_pvt_thread_mutex_lock( &li->li_warm_mutex );
+		n = li->li_warm_max - li->li_warm_num;
+		ldap_pvt_thread_mutex_unlock( &li->li_warm_mutex );
+		if ( n <= 0 ) {
+			break;
+		}
+
+		if ( ldap_back_ld_init( li, &ld, LDAP_BACK_WARM_VERSION( li ),
+			&li->li_tls, li->li_flags, 0, &is_tls, &text ) != LDAP_SUCCESS )
+		{
+			break;
+		}
+
+		/* StartTLS already connected; otherwise, do it now */
+		if ( !is_tls && ldap_connect( ld ) != LDAP_SUCCESS ) {
+			ldap_unbind_ext( ld, NULL, NULL );
+			break;
+		}
+
+		lw = ch_malloc( sizeof( ldap_back_warm_t ) );
+		lw->lw_ld = ld;
+		lw->lw_is_tls = is_tls;
+		lw->lw_time = now;
+
+		ldap_pvt_thread_mutex_lock( &li->li_warm_mutex );
+		lw->lw_next = li->li_warm;
+		li->li_warm = lw;
+		li->li_warm_num++;
+		ldap_pvt_thread_mutex_unlock( &li->li_warm_mutex );
+	}
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	ldap_pvt_runqueue_resched( &slapd_rq, rtask, 0 );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	return NULL;
+}
+
+/*
+ * Starts the warm pool task, if configured, or stops it
+ */
+void
+ldap_back_warm_schedule( BackendDB *be, int on )
+{
+	ldapinfo_t	*li = (ldapinfo_t *)be->be_private;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( on && li->li_warm_max > 0 ) {
+		if ( li->li_warm_task == NULL ) {
+			li->li_warm_task = ldap_pvt_runqueue_insert( &slapd_rq,
+				LDAP_BACK_WARM_INTERVAL, ldap_back_warm_task, li,
+				"ldap_back_warm_task",
+				be->be_suffix ? be->be_suffix[0].bv_val : "" );
+		}
+
+	} else if ( li->li_warm_task != NULL ) {
+		if ( ldap_pvt_runqueue_isrunning( &slapd_rq, li->li_warm_task ) ) {
+			ldap_pvt_runqueue_stoptask( &slapd_rq, li->li_warm_task );
+		}
+		ldap_pvt_runqueue_remove( &slapd_rq, li->li_warm_task );
+		li->li_warm_task = NULL;
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
+void
+ldap_back_warm_flush( ldapinfo_t *li )
+{
+	ldap_back_warm_t	*lw;
+
+	ldap_pvt_thread_mutex_lock( &li->li_warm_mutex );
+	lw = li->li_warm;
+	li->li_warm = NULL;
+	li->li_warm_num = 0;
+	ldap_pvt_thread_mutex_unlock( &li->li_warm_mutex );
+
+	ldap_back_warm_free( lw );
+}
+
+static int
+ldap_back_prepare_conn( ldapconn_t *lc, Operation *op, SlapReply *rs, ldap_back_send_t sendok )
+{
+	ldapinfo_t	*li = (ldapinfo_t *)op->o_bd->be_private;
+	int		version;
+	LDAP		*ld = NULL;
+	int		is_tls = op->o_conn->c_is_tls;
+	unsigned	flags = li->li_flags;
+	slap_bindconf	*sb = &li->li_tls;
+#ifdef HAVE_TLS
+	time_t		lctime = (time_t)(-1);
+#endif /* HAVE_TLS */
+
+	/* Set LDAP version. This will always succeed: If the client
+	 * bound with a particular version, then so can we.
+	 */
+	if ( li->li_version != 0 ) {
+		version = li->li_version;
+
+	} else if ( op->o_protocol != 0 ) {
+		version = op->o_protocol;
+
+	} else {
+		/* assume it's an internal op; set to LDAPv3 */
+		version = LDAP_VERSION3;
+	}
+
 #ifdef HAVE_TLS
 	if ( LDAP_BACK_CONN_ISPRIV( lc ) ) {
 		/* See "rationale" comment in ldap_back_getconn() */
@@ -724,33 +969,30 @@ ldap_back_prepare_conn( ldapconn_t *lc, Operation *op, SlapReply *rs, ldap_back_
 
 	} else if ( LDAP_BACK_CONN_ISIDASSERT( lc ) ) {
 		sb = &li->li_idassert.si_bc;
-
-	} else {
-		sb = &li->li_tls;
 	}
 
-	bindconf_tls_set( sb, ld );
-
 	/* if required by the bindconf configuration, force TLS */
 	if ( ( sb == &li->li_acl || sb == &li->li_idassert.si_bc ) &&
 		sb->sb_tls_ctx )
 	{
 		flags |= LDAP_BACK_F_USE_TLS;
 	}
+#endif /* HAVE_TLS */
 
-	ldap_pvt_thread_mutex_lock( &li->li_uri_mutex );
-	assert( li->li_uri_mutex_do_not_lock == 0 );
-	li->li_uri_mutex_do_not_lock = 1;
-	rs->sr_err = ldap_back_start_tls( ld, op->o_protocol, &is_tls,
-			li->li_uri, flags, li->li_timeout[ SLAP_OP_BIND ], &rs->sr_text );
-	li->li_uri_mutex_do_not_lock = 0;
-	ldap_pvt_thread_mutex_unlock( &li->li_uri_mutex );
-	if ( rs->sr_err != LDAP_SUCCESS ) {
-		ldap_unbind_ext( ld, NULL, NULL );
-		rs->sr_text = "Start TLS failed";
-		goto error_return;
+	ld = ldap_back_warm_take( li, sb, version, &is_tls );
+	if ( ld != NULL ) {
+		rs->sr_err = LDAP_SUCCESS;
 
-	} else if ( li->li_idle_timeout ) {
+	} else {
+		rs->sr_err = ldap_back_ld_init( li, &ld, version, sb, flags,
+				op->o_protocol, &is_tls, &rs->sr_text );
+		if ( rs->sr_err != LDAP_SUCCESS ) {
+			goto error_return;
+		}
+	}
+
+#ifdef HAVE_TLS
+	if ( li->li_idle_timeout ) {
 		/* only touch when activity actually took place... */
 		lctime = op->o_time;
 	}
@@ -904,14 +1146,28 @@ ldap_back_getconn(
 retry_lock:
 		ldap_pvt_thread_mutex_lock( &li->li_conninfo.lai_mutex );
 		if ( LDAP_BACK_PCONN_ISPRIV( &lc_curr ) ) {
-			/* lookup a conn that's not binding */
+			ldapconn_t	*lc_share = NULL;
+
+			/* lookup a conn that's not binding; if none is idle,
+			 * the least busy one may carry more operations */
 			LDAP_TAILQ_FOREACH( lc,
 				&li->li_conn_priv[ LDAP_BACK_CONN2PRIV( &lc_curr ) ].lic_priv,
 				lc_q )
 			{
-				if ( !LDAP_BACK_CONN_BINDING( lc ) && lc->lc_refcnt == 0 ) {
+				if ( LDAP_BACK_CONN_BINDING( lc ) ) {
+					continue;
+				}
+				if ( lc->lc_refcnt == 0 ) {
 					break;
 				}
+				if ( lc->lc_refcnt < li->li_conn_priv_share
+					&& ( lc_share == NULL || lc->lc_refcnt < lc_share->lc_refcnt ) )
+				{
+					lc_share = lc;
+				}
+			}
+			if ( lc == NULL ) {
+				lc = lc_share;
 			}
 
 			if ( lc != NULL ) {
@@ -31,6 +31,7 @@
 #include "slap.h"
 #include "back-ldap.h"
 #include "config.h"
+#include "ldap_omap.h"
 
 #ifdef LDAP_CONTROL_X_CHAINING_BEHAVIOR
 #define SLAP_CHAINING_DEFAULT				LDAP_CHAINING_PREFERRED
@@ -86,8 +87,8 @@ typedef struct ldap_chain_t {
 	/* current configuration info */
 	ldapinfo_t		*lc_cfg_li;
 
-	/* tree of configured[/generated?] "uri" info */
-	ldap_avl_info_t		lc_lai;
+	/* map of configured[/generated?] "uri" info */
+	ldap_pvt_omap_t		*lc_uris;
 
 	/* max depth in nested referrals chaining */
 	int			lc_max_depth;
@@ -229,27 +230,6 @@ ldap_chain_uri_cmp( const void *c1, const void *c2 )
 	return ber_bvcmp( &li1->li_bvuri[ 0 ], &li2->li_bvuri[ 0 ] );
 }
 
-static int
-ldap_chain_uri_dup( void *c1, void *c2 )
-{
-	ldapinfo_t	*li1 = (ldapinfo_t *)c1;
-	ldapinfo_t	*li2 = (ldapinfo_t *)c2;
-
-	assert( li1->li_bvuri != NULL );
-	assert( !BER_BVISNULL( &li1->li_bvuri[ 0 ] ) );
-	assert( BER_BVISNULL( &li1->li_bvuri[ 1 ] ) );
-
-	assert( li2->li_bvuri != NULL );
-	assert( !BER_BVISNULL( &li2->li_bvuri[ 0 ] ) );
-	assert( BER_BVISNULL( &li2->li_bvuri[ 1 ] ) );
-
-	if ( ber_bvcmp( &li1->li_bvuri[ 0 ], &li2->li_bvuri[ 0 ] ) == 0 ) {
-		return -1;
-	}
-
-	return 0;
-}
-
 /*
  * Search specific response that strips entryDN from entries
  */
@@ -408,6 +388,7 @@ ldap_chain_op(
 			ondn = op->o_req_ndn;
 	ldapinfo_t	li = { 0 }, *lip = NULL;
 	struct berval	bvuri[ 2 ] = { { 0 } };
+	int		token;
 
 	/* NOTE: returned if ref is empty... */
 	int		rc = LDAP_OTHER,
@@ -556,11 +537,11 @@ Document: RFC 4511
 
 		ber_str2bv( li.li_uri, 0, 0, &li.li_bvuri[ 0 ] );
 
-		/* Searches for a ldapinfo in the avl tree */
-		ldap_pvt_thread_mutex_lock( &lc->lc_lai.lai_mutex );
-		lip = (ldapinfo_t *)avl_find( lc->lc_lai.lai_tree, 
-			(caddr_t)&li, ldap_chain_uri_cmp );
-		ldap_pvt_thread_mutex_unlock( &lc->lc_lai.lai_mutex );
+		/* Searches for a ldapinfo in the map; cached entries
+		 * are only removed with the thread pool paused */
+		token = ldap_pvt_omap_rlock( lc->lc_uris );
+		lip = (ldapinfo_t *)ldap_pvt_omap_find( lc->lc_uris, &li );
+		ldap_pvt_omap_runlock( lc->lc_uris, token );
 
 		if ( lip != NULL ) {
 			op->o_bd->be_private = (void *)lip;
@@ -589,16 +570,13 @@ Document: RFC 4511
 			}
 
 			if ( LDAP_CHAIN_CACHE_URI( lc ) ) {
-				ldap_pvt_thread_mutex_lock( &lc->lc_lai.lai_mutex );
-				if ( avl_insert( &lc->lc_lai.lai_tree,
-					(caddr_t)lip, ldap_chain_uri_cmp, ldap_chain_uri_dup ) )
+				if ( ldap_pvt_omap_insert( lc->lc_uris, lip, NULL ) )
 				{
 					/* someone just inserted another;
 					 * don't bother, use this and then
 					 * just free it */
 					temporary = 1;
 				}
-				ldap_pvt_thread_mutex_unlock( &lc->lc_lai.lai_mutex );
 
 			} else {
 				temporary = 1;
@@ -684,6 +662,7 @@ ldap_chain_search(
 	ldap_chain_t	*lc = (ldap_chain_t *)on->on_bi.bi_private;
 	ldapinfo_t	li = { 0 }, *lip = NULL;
 	struct berval	bvuri[ 2 ] = { { 0 } };
+	int		token;
 
 	struct berval	odn = op->o_req_dn,
 			ondn = op->o_req_ndn;
@@ -828,11 +807,11 @@ ldap_chain_search(
 
 		ber_str2bv( li.li_uri, 0, 0, &li.li_bvuri[ 0 ] );
 
-		/* Searches for a ldapinfo in the avl tree */
-		ldap_pvt_thread_mutex_lock( &lc->lc_lai.lai_mutex );
-		lip = (ldapinfo_t *)avl_find( lc->lc_lai.lai_tree, 
-			(caddr_t)&li, ldap_chain_uri_cmp );
-		ldap_pvt_thread_mutex_unlock( &lc->lc_lai.lai_mutex );
+		/* Searches for a ldapinfo in the map; cached entries
+		 * are only removed with the thread pool paused */
+		token = ldap_pvt_omap_rlock( lc->lc_uris );
+		lip = (ldapinfo_t *)ldap_pvt_omap_find( lc->lc_uris, &li );
+		ldap_pvt_omap_runlock( lc->lc_uris, token );
 
 		if ( lip != NULL ) {
 			op->o_bd->be_private = (void *)lip;
@@ -862,16 +841,13 @@ ldap_chain_search(
 			}
 
 			if ( LDAP_CHAIN_CACHE_URI( lc ) ) {
-				ldap_pvt_thread_mutex_lock( &lc->lc_lai.lai_mutex );
-				if ( avl_insert( &lc->lc_lai.lai_tree,
-					(caddr_t)lip, ldap_chain_uri_cmp, ldap_chain_uri_dup ) )
+				if ( ldap_pvt_omap_insert( lc->lc_uris, lip, NULL ) )
 				{
 					/* someone just inserted another;
 					 * don't bother, use this and then
 					 * just free it */
 					temporary = 1;
 				}
-				ldap_pvt_thread_mutex_unlock( &lc->lc_lai.lai_mutex );
 
 			} else {
 				temporary = 1;
@@ -1387,8 +1363,7 @@ fail:
 
 		li->li_uri = ch_strdup( at->a_vals[ 0 ].bv_val );
 		value_add_one( &li->li_bvuri, &at->a_vals[ 0 ] );
-		if ( avl_insert( &lc->lc_lai.lai_tree, (caddr_t)li,
-			ldap_chain_uri_cmp, ldap_chain_uri_dup ) )
+		if ( ldap_pvt_omap_insert( lc->lc_uris, li, NULL ) )
 		{
 			Debug( LDAP_DEBUG_ANY, "slapd-chain: "
 				"database \"%s\" insert failed.\n",
@@ -1450,6 +1425,9 @@ chain_cfadd( Operation *op, SlapReply *rs, Entry *p, ConfigArgs *ca )
 
 	if ( lback->bi_cf_ocs ) {
 		ldap_chain_cfadd_apply_t	lca = { 0 };
+		ldapinfo_t			*li;
+		void				*cursor;
+		int				token;
 
 		lca.op = op;
 		lca.rs = rs;
@@ -1459,8 +1437,14 @@ chain_cfadd( Operation *op, SlapReply *rs, Entry *p, ConfigArgs *ca )
 
 		(void)ldap_chain_cfadd_apply( (void *)lc->lc_common_li, (void *)&lca );
 
-		(void)avl_apply( lc->lc_lai.lai_tree, ldap_chain_cfadd_apply,
-			&lca, 1, AVL_INORDER );
+		token = ldap_pvt_omap_rlock( lc->lc_uris );
+		for ( li = ldap_pvt_omap_first( lc->lc_uris, &cursor ); li;
+			li = ldap_pvt_omap_next( lc->lc_uris, &cursor ) )
+		{
+			if ( ldap_chain_cfadd_apply( li, &lca ) == 1 )
+				break;
+		}
+		ldap_pvt_omap_runlock( lc->lc_uris, token );
 
 		ca->be->be_private = priv;
 	}
@@ -1480,12 +1464,12 @@ chain_lddel( CfEntryInfo *ce, Operation *op )
 	ldapinfo_t	*li = (ldapinfo_t *) ce->ce_be->be_private;
 
 	if ( li != lc->lc_common_li ) {
-		if (! avl_delete( &lc->lc_lai.lai_tree, li, ldap_chain_uri_cmp ) ) {
-			Debug( LDAP_DEBUG_ANY, "slapd-chain: avl_delete failed. "
+		if (! ldap_pvt_omap_delete( lc->lc_uris, li ) ) {
+			Debug( LDAP_DEBUG_ANY, "slapd-chain: delete failed. "
 				"\"%s\" not found.\n", li->li_uri );
 			return -1;
 		}
-	} else if ( lc->lc_lai.lai_tree ) {
+	} else if ( ldap_pvt_omap_count( lc->lc_uris ) ) {
 		Debug( LDAP_DEBUG_ANY, "slapd-chain: cannot delete first underlying "
 			"LDAP database when other databases are still present.\n" );
 		return -1;
@@ -1777,7 +1761,10 @@ ldap_chain_db_init(
 	}
 	memset( lc, 0, sizeof( ldap_chain_t ) );
 	lc->lc_max_depth = 1;
-	ldap_pvt_thread_mutex_init( &lc->lc_lai.lai_mutex );
+	if ( ldap_pvt_omap_init( &lc->lc_uris, ldap_chain_uri_cmp, NULL ) ) {
+		ch_free( lc );
+		return 1;
+	}
 
 	on->on_bi.bi_private = (void *)lc;
 
@@ -1889,9 +1876,8 @@ private_destroy:;
 					goto private_destroy;
 				}
 
-				if ( avl_insert( &lc->lc_lai.lai_tree,
-					(caddr_t)lc->lc_cfg_li,
-					ldap_chain_uri_cmp, ldap_chain_uri_dup ) )
+				if ( ldap_pvt_omap_insert( lc->lc_uris,
+					lc->lc_cfg_li, NULL ) )
 				{
 					Debug( LDAP_DEBUG_ANY, "%s: line %d: "
 						"duplicate URI in slapo-chain.\n",
@@ -1956,15 +1942,25 @@ ldap_chain_db_func(
 				return rc;
 			}
 
-			if ( lc->lc_lai.lai_tree != NULL ) {
+			if ( ldap_pvt_omap_count( lc->lc_uris ) ) {
 				ldap_chain_db_apply_t	lca;
+				ldapinfo_t		*li;
+				void			*cursor;
+				int			token;
 
 				lca.be = &db;
 				lca.func = func;
 
-				rc = avl_apply( lc->lc_lai.lai_tree,
-					ldap_chain_db_apply, (void *)&lca,
-					1, AVL_INORDER ) != AVL_NOMORE;
+				token = ldap_pvt_omap_rlock( lc->lc_uris );
+				for ( li = ldap_pvt_omap_first( lc->lc_uris, &cursor ); li;
+					li = ldap_pvt_omap_next( lc->lc_uris, &cursor ) )
+				{
+					if ( ldap_chain_db_apply( li, &lca ) == 1 ) {
+						rc = 1;
+						break;
+					}
+				}
+				ldap_pvt_omap_runlock( lc->lc_uris, token );
 			}
 		}
 	}
@@ -2031,8 +2027,7 @@ ldap_chain_db_destroy(
 	rc = ldap_chain_db_func( be, db_destroy );
 
 	if ( lc ) {
-		avl_free( lc->lc_lai.lai_tree, NULL );
-		ldap_pvt_thread_mutex_destroy( &lc->lc_lai.lai_mutex );
+		ldap_pvt_omap_destroy( lc->lc_uris );
 		ch_free( lc );
 	}
 
@@ -2171,15 +2166,23 @@ ldap_chain_connection_destroy(
 	ldap_chain_t		*lc = (ldap_chain_t *)on->on_bi.bi_private;
 	void			*private = be->be_private;
 	ldap_chain_conn_apply_t	lca;
-	int			rc;
+	ldapinfo_t		*li;
+	void			*cursor;
+	int			rc = 0, token;
 
 	be->be_private = NULL;
 	lca.be = be;
 	lca.conn = conn;
-	ldap_pvt_thread_mutex_lock( &lc->lc_lai.lai_mutex );
-	rc = avl_apply( lc->lc_lai.lai_tree, ldap_chain_conn_apply,
-		(void *)&lca, 1, AVL_INORDER ) != AVL_NOMORE;
-	ldap_pvt_thread_mutex_unlock( &lc->lc_lai.lai_mutex );
+	token = ldap_pvt_omap_rlock( lc->lc_uris );
+	for ( li = ldap_pvt_omap_first( lc->lc_uris, &cursor ); li;
+		li = ldap_pvt_omap_next( lc->lc_uris, &cursor ) )
+	{
+		if ( ldap_chain_conn_apply( li, &lca ) == 1 ) {
+			rc = 1;
+			break;
+		}
+	}
+	ldap_pvt_omap_runlock( lc->lc_uris, token );
 	be->be_private = private;
 
 	return rc;
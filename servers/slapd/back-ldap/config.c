@@ -59,6 +59,8 @@ enum {
 	LDAP_BACK_CFG_SINGLECONN,
 	LDAP_BACK_CFG_USETEMP,
 	LDAP_BACK_CFG_CONNPOOLMAX,
+	LDAP_BACK_CFG_CONNPOOLSHARE,
+	LDAP_BACK_CFG_CONNWARMPOOL,
 	LDAP_BACK_CFG_CANCEL,
 	LDAP_BACK_CFG_QUARANTINE,
 	LDAP_BACK_CFG_ST_REQUEST,
@@ -245,6 +247,24 @@ static ConfigTable ldapcfg[] = {
 			"SYNTAX OMsInteger "
 			"SINGLE-VALUE )",
 		NULL, NULL },
+	{ "conn-pool-share", "<n>", 2, 2, 0,
+		ARG_MAGIC|ARG_INT|LDAP_BACK_CFG_CONNPOOLSHARE,
+		ldap_back_cf_gen, "( OLcfgDbAt:3.118 "
+			"NAME 'olcDbConnectionPoolShare' "
+			"DESC 'Max operations sharing a pooled connection' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger "
+			"SINGLE-VALUE )",
+		NULL, NULL },
+	{ "conn-warm-pool", "<n>", 2, 2, 0,
+		ARG_MAGIC|ARG_INT|LDAP_BACK_CFG_CONNWARMPOOL,
+		ldap_back_cf_gen, "( OLcfgDbAt:3.120 "
+			"NAME 'olcDbConnectionWarmPool' "
+			"DESC 'Number of connections to the remote server kept open ahead of time' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger "
+			"SINGLE-VALUE )",
+		NULL, NULL },
 #ifdef SLAP_CONTROL_X_SESSION_TRACKING
 	{ "session-tracking-request", "true|FALSE", 2, 2, 0,
 		ARG_MAGIC|ARG_ON_OFF|LDAP_BACK_CFG_ST_REQUEST,
@@ -339,6 +359,8 @@ static ConfigOCs ldapocs[] = {
 			"$ olcDbQuarantine "
 			"$ olcDbUseTemporaryConn "
 			"$ olcDbConnectionPoolMax "
+			"$ olcDbConnectionPoolShare "
+			"$ olcDbConnectionWarmPool "
 #ifdef SLAP_CONTROL_X_SESSION_TRACKING
 			"$ olcDbSessionTrackingRequest "
 #endif /* SLAP_CONTROL_X_SESSION_TRACKING */
@@ -1295,6 +1317,14 @@ ldap_back_cf_gen( ConfigArgs *c )
 			c->value_int = li->li_conn_priv_max;
 			break;
 
+		case LDAP_BACK_CFG_CONNPOOLSHARE:
+			c->value_int = li->li_conn_priv_share;
+			break;
+
+		case LDAP_BACK_CFG_CONNWARMPOOL:
+			c->value_int = li->li_warm_max;
+			break;
+
 		case LDAP_BACK_CFG_CANCEL: {
 			slap_mask_t	mask = LDAP_BACK_F_CANCEL_MASK2;
 
@@ -1484,6 +1514,18 @@ ldap_back_cf_gen( ConfigArgs *c )
 			li->li_conn_priv_max = LDAP_BACK_CONN_PRIV_MIN;
 			break;
 
+		case LDAP_BACK_CFG_CONNPOOLSHARE:
+			li->li_conn_priv_share = 1;
+			break;
+
+		case LDAP_BACK_CFG_CONNWARMPOOL:
+			li->li_warm_max = 0;
+			if ( LDAP_BACK_ISOPEN( li ) ) {
+				ldap_back_warm_schedule( c->be, 0 );
+				ldap_back_warm_flush( li );
+			}
+			break;
+
 		case LDAP_BACK_CFG_QUARANTINE:
 			if ( !LDAP_BACK_QUARANTINE( li ) ) {
 				break;
@@ -1916,6 +1958,45 @@ done_url:;
 		li->li_conn_priv_max = c->value_int;
 		break;
 
+	case LDAP_BACK_CFG_CONNPOOLSHARE:
+		if ( c->value_int < 1
+			|| c->value_int > LDAP_BACK_CONN_SHARE_MAX )
+		{
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"invalid number of operations "
+				"per pooled connection \"%s\" "
+				"in \"conn-pool-share <n> "
+				"(must be between 1 and %d)\"",
+				c->argv[ 1 ],
+				LDAP_BACK_CONN_SHARE_MAX );
+			Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+			return 1;
+		}
+		li->li_conn_priv_share = c->value_int;
+		break;
+
+	case LDAP_BACK_CFG_CONNWARMPOOL:
+		if ( c->value_int < 0
+			|| c->value_int > LDAP_BACK_WARM_MAX )
+		{
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"invalid size of the warm pool \"%s\" "
+				"in \"conn-warm-pool <n> "
+				"(must be between 0 and %d)\"",
+				c->argv[ 1 ],
+				LDAP_BACK_WARM_MAX );
+			Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+			return 1;
+		}
+		li->li_warm_max = c->value_int;
+		if ( LDAP_BACK_ISOPEN( li ) ) {
+			ldap_back_warm_schedule( c->be, li->li_warm_max > 0 );
+			if ( li->li_warm_max == 0 ) {
+				ldap_back_warm_flush( li );
+			}
+		}
+		break;
+
 	case LDAP_BACK_CFG_CANCEL: {
 		slap_mask_t		mask;
 
@@ -0,0 +1,194 @@
+/* health.c - active health and latency probes of remote servers */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include <ac/string.h>
+#include <ac/socket.h>
+#include <ac/time.h>
+
+#include "slap.h"
+#include "back-ldap.h"
+#include "lutil.h"
+
+/*
+ * Reads the root DSE of uri anonymously, bounded by timeout;
+ * on success, *rttp receives the elapsed time in microseconds.
+ */
+static int
+ldap_back_uri_ping(
+	const char	*uri,
+	slap_bindconf	*sb,
+	time_t		timeout,
+	unsigned long	*rttp )
+{
+	LDAP		*ld = NULL;
+	LDAPMessage	*res = NULL;
+	char		*attrs[] = { LDAP_NO_ATTRS, NULL };
+	struct timeval	tv, start, stop;
+	int		version = LDAP_VERSION3;
+	int		rc;
+
+	rc = ldap_initialize( &ld, uri );
+	if ( rc != LDAP_SUCCESS ) {
+		return rc;
+	}
+
+	tv.tv_sec = timeout;
+	tv.tv_usec = 0;
+	ldap_set_option( ld, LDAP_OPT_PROTOCOL_VERSION, &version );
+	ldap_set_option( ld, LDAP_OPT_NETWORK_TIMEOUT, &tv );
+	ldap_set_option( ld, LDAP_OPT_REFERRALS, LDAP_OPT_OFF );
+#ifdef HAVE_TLS
+	if ( sb != NULL ) {
+		bindconf_tls_set( sb, ld );
+	}
+#endif /* HAVE_TLS */
+
+	gettimeofday( &start, NULL );
+	rc = ldap_search_ext_s( ld, "", LDAP_SCOPE_BASE, "(objectClass=*)",
+		attrs, 0, NULL, NULL, &tv, 1, &res );
+	gettimeofday( &stop, NULL );
+
+	if ( res != NULL ) {
+		ldap_msgfree( res );
+	}
+	ldap_unbind_ext( ld, NULL, NULL );
+
+	if ( rc == LDAP_SUCCESS ) {
+		if ( stop.tv_sec < start.tv_sec ) {
+			*rttp = 0;
+		} else {
+			*rttp = ( stop.tv_sec - start.tv_sec ) * 1000000UL
+				+ stop.tv_usec - start.tv_usec;
+		}
+	}
+
+	return rc;
+}
+
+/*
+ * Probes every URI of the space-separated list uris, updates the
+ * per-URI state in *healthp (allocated on first call, and resized
+ * if the list changed) and returns in *urisp a freshly allocated
+ * list with the reachable servers first, ordered by increasing
+ * smoothed round-trip time, and the unreachable ones last.
+ * Ties keep the configured order.
+ */
+int
+ldap_back_uri_probe(
+	const char		*uris,
+	slap_bindconf		*sb,
+	time_t			timeout,
+	ldap_uri_health_t	**healthp,
+	char			**urisp )
+{
+	ldap_uri_health_t	*old = *healthp, *cur, tmp;
+	char			**urllist, *p;
+	int			i, j, n;
+	ber_len_t		len = 0;
+
+	*urisp = NULL;
+
+	urllist = ldap_str2charray( uris, " " );
+	if ( urllist == NULL ) {
+		return LDAP_NO_MEMORY;
+	}
+
+	for ( n = 0; urllist[ n ] != NULL; n++ )
+		/* count */ ;
+
+	cur = ch_calloc( n + 1, sizeof( ldap_uri_health_t ) );
+	for ( i = 0; i < n; i++ ) {
+		unsigned long	rtt = 0;
+		int		rc;
+
+		ber_str2bv( urllist[ i ], 0, 1, &cur[ i ].luh_uri );
+		for ( j = 0; old && !BER_BVISNULL( &old[ j ].luh_uri ); j++ ) {
+			if ( ber_bvstrcasecmp( &old[ j ].luh_uri, &cur[ i ].luh_uri ) == 0 ) {
+				cur[ i ].luh_rtt = old[ j ].luh_rtt;
+				break;
+			}
+		}
+
+		rc = ldap_back_uri_ping( urllist[ i ], sb, timeout, &rtt );
+		if ( rc == LDAP_SUCCESS ) {
+			cur[ i ].luh_up = 1;
+			/* exponentially weighted moving average, alpha = 1/4 */
+			if ( cur[ i ].luh_rtt == 0 ) {
+				cur[ i ].luh_rtt = rtt ? rtt : 1;
+			} else {
+				cur[ i ].luh_rtt -= cur[ i ].luh_rtt / 4;
+				cur[ i ].luh_rtt += rtt / 4;
+			}
+		}
+
+		Debug( LDAP_DEBUG_TRACE, "ldap_back_uri_probe: %s %s rtt=%lu (%d)\n",
+			urllist[ i ], cur[ i ].luh_up ? "up" : "down",
+			cur[ i ].luh_rtt, rc );
+
+		len += cur[ i ].luh_uri.bv_len + 1;
+	}
+	ldap_charray_free( urllist );
+
+	/* stable insertion sort: up before down, then by rtt */
+	for ( i = 1; i < n; i++ ) {
+		tmp = cur[ i ];
+		for ( j = i; j > 0; j-- ) {
+			ldap_uri_health_t	*prev = &cur[ j - 1 ];
+
+			if ( prev->luh_up > tmp.luh_up ||
+				( prev->luh_up == tmp.luh_up
+				  && ( !tmp.luh_up || prev->luh_rtt <= tmp.luh_rtt ) ) )
+			{
+				break;
+			}
+			cur[ j ] = *prev;
+		}
+		cur[ j ] = tmp;
+	}
+
+	p = *urisp = ch_malloc( len + 1 );
+	for ( i = 0; i < n; i++ ) {
+		if ( i ) {
+			*p++ = ' ';
+		}
+		p = lutil_strcopy( p, cur[ i ].luh_uri.bv_val );
+	}
+	*p = '\0';
+
+	ldap_back_uri_health_free( old );
+	*healthp = cur;
+
+	return LDAP_SUCCESS;
+}
+
+void
+ldap_back_uri_health_free( ldap_uri_health_t *health )
+{
+	int	i;
+
+	if ( health == NULL ) {
+		return;
+	}
+
+	for ( i = 0; !BER_BVISNULL( &health[ i ].luh_uri ); i++ ) {
+		ch_free( health[ i ].luh_uri.bv_val );
+	}
+	ch_free( health );
+}
@@ -41,7 +41,9 @@ static const ldap_extra_t ldap_extra = {
 	slap_retry_info_destroy,
 	slap_retry_info_parse,
 	slap_retry_info_unparse,
-	ldap_back_connid2str
+	ldap_back_connid2str,
+	ldap_back_uri_probe,
+	ldap_back_uri_health_free
 };
 
 int
@@ -179,6 +181,9 @@ ldap_back_db_init( Backend *be, ConfigReply *cr )
 		LDAP_TAILQ_INIT( &li->li_conn_priv[ i ].lic_priv );
 	}
 	li->li_conn_priv_max = LDAP_BACK_CONN_PRIV_DEFAULT;
+	li->li_conn_priv_share = 1;
+
+	ldap_pvt_thread_mutex_init( &li->li_warm_mutex );
 
 	ldap_pvt_thread_mutex_init( &li->li_counter_mutex );
 	for ( i = 0; i < SLAP_OP_LAST; i++ ) {
@@ -256,6 +261,9 @@ ldap_back_db_open( BackendDB *be, ConfigReply *cr )
 
 	li->li_flags |= LDAP_BACK_F_ISOPEN;
 
+	/* start filling the warm pool, if configured */
+	ldap_back_warm_schedule( be, 1 );
+
 	return rc;
 }
 
@@ -288,6 +296,9 @@ ldap_back_db_close( Backend *be, ConfigReply *cr )
 	int		rc = 0;
 
 	if ( be->be_private ) {
+		ldap_back_warm_schedule( be, 0 );
+		ldap_back_warm_flush( (ldapinfo_t *)be->be_private );
+
 		rc = ldap_back_monitor_db_close( be );
 	}
 
@@ -342,6 +353,9 @@ ldap_back_db_destroy( Backend *be, ConfigReply *cr )
 		ldap_pvt_thread_mutex_destroy( &li->li_conninfo.lai_mutex );
 		ldap_pvt_thread_mutex_destroy( &li->li_uri_mutex );
 
+		ldap_back_warm_flush( li );
+		ldap_pvt_thread_mutex_destroy( &li->li_warm_mutex );
+
 		for ( i = 0; i < SLAP_OP_LAST; i++ ) {
 			ldap_pvt_mp_clear( li->li_ops_completed[ i ] );
 		}
@@ -46,6 +46,8 @@ static AttributeDescription	*ad_olmDbBoundDN;
 static AttributeDescription	*ad_olmDbConnFlags;
 static AttributeDescription	*ad_olmDbConnURI;
 static AttributeDescription	*ad_olmDbPeerAddress;
+static AttributeDescription	*ad_olmDbWarmPoolHits;
+static AttributeDescription	*ad_olmDbWarmPoolMisses;
 
 /*
  * Stolen from back-monitor/operations.c
@@ -154,6 +156,20 @@ static struct {
 		"NO-USER-MODIFICATION "
 		"USAGE dSAOperation )",
 		&ad_olmDbPeerAddress },
+	{ "( olmLDAPAttributes:7 "
+		"NAME ( 'olmDbWarmPoolHits' ) "
+		"DESC 'monitor connections taken from the warm pool' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbWarmPoolHits },
+	{ "( olmLDAPAttributes:8 "
+		"NAME ( 'olmDbWarmPoolMisses' ) "
+		"DESC 'monitor connections opened while the warm pool was empty' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbWarmPoolMisses },
 
 	{ NULL }
 };
@@ -179,6 +195,8 @@ static struct {
 		"SUP top AUXILIARY "
 		"MAY ( "
 			"olmDbURIList "
+			"$ olmDbWarmPoolHits "
+			"$ olmDbWarmPoolMisses "
 			") )",
 		&oc_olmLDAPDatabase },
 	{ "( olmLDAPObjectClasses:2 "
@@ -195,6 +213,31 @@ static struct {
 	{ NULL }
 };
 
+static void
+ldap_back_monitor_counter(
+	Entry			*e,
+	AttributeDescription	*ad,
+	unsigned long		value )
+{
+	Attribute	*a;
+	char		buf[ SLAP_TEXT_BUFLEN ];
+	struct berval	bv;
+
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", value );
+
+	a = attr_find( e->e_attrs, ad );
+	if ( a == NULL ) {
+		attr_merge_normalize_one( e, ad, &bv, NULL );
+
+	} else if ( !bvmatch( &a->a_vals[ 0 ], &bv ) ) {
+		ber_bvreplace( &a->a_vals[ 0 ], &bv );
+		if ( a->a_nvals != a->a_vals ) {
+			ber_bvreplace( &a->a_nvals[ 0 ], &bv );
+		}
+	}
+}
+
 static int
 ldap_back_monitor_update(
 	Operation	*op,
@@ -225,6 +268,19 @@ ldap_back_monitor_update(
 		ldap_pvt_thread_mutex_unlock( &li->li_uri_mutex );
 	}
 
+	/* update the warm pool counters, if the pool is in use */
+	if ( li->li_warm_max > 0 || li->li_warm_hits || li->li_warm_misses ) {
+		unsigned long	hits, misses;
+
+		ldap_pvt_thread_mutex_lock( &li->li_warm_mutex );
+		hits = li->li_warm_hits;
+		misses = li->li_warm_misses;
+		ldap_pvt_thread_mutex_unlock( &li->li_warm_mutex );
+
+		ldap_back_monitor_counter( e, ad_olmDbWarmPoolHits, hits );
+		ldap_back_monitor_counter( e, ad_olmDbWarmPoolMisses, misses );
+	}
+
 	return SLAP_CB_CONTINUE;
 }
 
@@ -64,6 +64,9 @@ extern void ldap_back_conn_free( void *c );
 
 extern ldapconn_t * ldap_back_conn_delete( ldapinfo_t *li, ldapconn_t *lc );
 
+extern void ldap_back_warm_schedule( BackendDB *be, int on );
+extern void ldap_back_warm_flush( ldapinfo_t *li );
+
 extern int ldap_back_conn2str( const ldapconn_base_t *lc, char *buf, ber_len_t buflen );
 extern int ldap_back_connid2str( const ldapconn_base_t *lc, char *buf, ber_len_t buflen );
 
@@ -101,6 +104,10 @@ extern int slap_retry_info_parse( char *in, slap_retry_info_t *ri,
 	char *buf, ber_len_t buflen );
 extern int slap_retry_info_unparse( slap_retry_info_t *ri, struct berval *bvout );
 
+extern int ldap_back_uri_probe( const char *uris, slap_bindconf *sb,
+	time_t timeout, ldap_uri_health_t **healthp, char **urisp );
+extern void ldap_back_uri_health_free( ldap_uri_health_t *health );
+
 extern int slap_idassert_authzfrom_parse( struct config_args_s *ca, slap_idassert_t *si );
 extern int slap_idassert_passthru_parse_cf( const char *fname, int lineno, const char *arg, slap_idassert_t *si );
 extern int slap_idassert_parse( struct config_args_s *ca, slap_idassert_t *si );
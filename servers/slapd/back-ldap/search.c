@@ -327,6 +327,9 @@ retry:
 		}
 
 		if ( rc == 0 || rc == -2 ) {
+			/* the remote server is slow, send what we have */
+			if ( rc == 0 )
+				slap_write_coalesce_flush( op, 0 );
 			ldap_pvt_thread_yield();
 
 			/* check timeout */
@@ -56,9 +56,24 @@ struct ldif_info {
 	 */
 	ldap_pvt_thread_mutex_t	li_modop_mutex; /* serialize update requests */
 	ldap_pvt_thread_rdwr_t	li_rdwr;	/* no other I/O when writing */
+	/*
+	 * Optional cache of parsed entry files and directory listings,
+	 * keyed by pathname.  Readers fill it, so it has its own mutex.
+	 * Anything that changes a file or directory forgets it first.
+	 */
+	unsigned				li_cachesize;	/* max cached items, 0 = off */
+	unsigned				li_cachecount;
+	Avlnode					*li_cache;
+	ldap_pvt_thread_mutex_t	li_cache_mutex;
 };
 
 static int write_data( int fd, const char *spew, int len, int *save_errno );
+static int ldif_cache_entry( struct ldif_info *li, const char *path,
+	Entry **entryp );
+static void ldif_cache_entry_add( struct ldif_info *li, const char *path,
+	Entry *e );
+static void ldif_cache_forget( struct ldif_info *li, const char *path );
+static void ldif_cache_flush( struct ldif_info *li );
 
 #ifdef _WIN32
 #define mkdir(a,b)	mkdir(a)
@@ -170,6 +185,12 @@ static ConfigTable ldifcfg[] = {
 			"DESC 'Directory for database content' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "cachesize", "size", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct ldif_info, li_cachesize),
+		"( OLcfgDbAt:1.1 NAME 'olcDbCacheSize' "
+			"DESC 'Number of entries and directories to cache in memory' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED,
 		NULL, NULL, NULL, NULL }
 };
@@ -179,7 +200,8 @@ static ConfigOCs ldifocs[] = {
 		"NAME 'olcLdifConfig' "
 		"DESC 'LDIF backend configuration' "
 		"SUP olcDatabaseConfig "
-		"MUST ( olcDbDirectory ) )", Cft_Database, ldifcfg },
+		"MUST ( olcDbDirectory ) "
+		"MAY ( olcDbCacheSize ) )", Cft_Database, ldifcfg },
 	{ NULL, 0, NULL }
 };
 
@@ -547,6 +569,9 @@ ldif_write_entry(
 	if ( op->o_abandon )
 		return SLAPD_ABANDON;
 
+	ldif_cache_forget( (struct ldif_info *) op->o_bd->be_private,
+		path->bv_val );
+
 	if ( parentdir != NULL && mkdir( parentdir, 0750 ) < 0 ) {
 		save_errno = errno;
 		Debug( LDAP_DEBUG_ANY, "ldif_write_entry: %s \"%s\": %s\n",
@@ -635,6 +660,7 @@ ldif_read_entry(
 	Entry **entryp,
 	const char **text )
 {
+	struct ldif_info *li = (struct ldif_info *) op->o_bd->be_private;
 	int rc;
 	Entry *entry;
 	char *entry_as_string;
@@ -646,37 +672,47 @@ ldif_read_entry(
 	if ( op->o_abandon && op->o_tag != LDAP_REQ_BIND )
 		return SLAPD_ABANDON;
 
-	rc = ldif_read_file( path, entryp ? &entry_as_string : NULL );
+	if ( ldif_cache_entry( li, path, entryp ) ) {
+		rc = LDAP_SUCCESS;
+
+	} else {
+		rc = ldif_read_file( path, entryp ? &entry_as_string : NULL );
 
-	switch ( rc ) {
-	case LDAP_SUCCESS:
-		if ( entryp == NULL )
+		switch ( rc ) {
+		case LDAP_SUCCESS:
+			if ( entryp == NULL )
+				break;
+			*entryp = entry = str2entry( entry_as_string );
+			SLAP_FREE( entry_as_string );
+			if ( entry == NULL ) {
+				rc = LDAP_OTHER;
+				if ( text != NULL )
+					*text = "internal error (cannot parse some entry file)";
+				break;
+			}
+			ldif_cache_entry_add( li, path, entry );
 			break;
-		*entryp = entry = str2entry( entry_as_string );
-		SLAP_FREE( entry_as_string );
-		if ( entry == NULL ) {
-			rc = LDAP_OTHER;
+
+		case LDAP_OTHER:
 			if ( text != NULL )
-				*text = "internal error (cannot parse some entry file)";
+				*text = entryp
+					? "internal error (cannot read some entry file)"
+					: "internal error (cannot stat some entry file)";
 			break;
 		}
-		if ( pdn == NULL || BER_BVISEMPTY( pdn ) )
-			break;
+	}
+
+	if ( rc == LDAP_SUCCESS && entryp != NULL &&
+		pdn != NULL && !BER_BVISEMPTY( pdn ) )
+	{
 		/* Append parent DN to DN from LDIF file */
+		entry = *entryp;
 		rdn = entry->e_name;
 		build_new_dn( &entry->e_name, pdn, &rdn, NULL );
 		SLAP_FREE( rdn.bv_val );
 		rdn = entry->e_nname;
 		build_new_dn( &entry->e_nname, pndn, &rdn, NULL );
 		SLAP_FREE( rdn.bv_val );
-		break;
-
-	case LDAP_OTHER:
-		if ( text != NULL )
-			*text = entryp
-				? "internal error (cannot read some entry file)"
-				: "internal error (cannot stat some entry file)";
-		break;
 	}
 
 	return rc;
@@ -732,6 +768,253 @@ typedef struct bvlist {
 #	define BVL_SIZE(namelen) (sizeof(bvlist) + (namelen) + 1)
 } bvlist;
 
+
+/*
+ * Cache of entry files and directory listings.
+ *
+ * Entries are cached as parsed from the file, with the RDN as DN,
+ * and handed out as copies.  Directory listings are cached sorted,
+ * with the filenames truncated as ldif_readdir() leaves them; an
+ * absent directory (a leaf entry) is cached as an empty listing.
+ * When the cache is full, nothing more is added until something is
+ * forgotten.
+ */
+typedef struct ldif_cnode {
+	struct berval	lc_path;	/* allocated after the node */
+	Entry			*lc_entry;	/* entry file, or NULL for a directory */
+	bvlist			*lc_list;	/* directory listing */
+	ber_len_t		lc_fname_maxlen;
+} ldif_cnode;
+
+static int
+ldif_cnode_cmp( const void *v1, const void *v2 )
+{
+	const ldif_cnode *c1 = v1, *c2 = v2;
+	return strcmp( c1->lc_path.bv_val, c2->lc_path.bv_val );
+}
+
+static bvlist *
+bvlist_dup( bvlist *list )
+{
+	bvlist *res = NULL, **next = &res, *bvl;
+
+	for ( ; list != NULL; list = list->next ) {
+		char *name = BVL_NAME( list );
+		/* the name is truncated at ->trunc, the rest follows it */
+		size_t len = list->trunc - name + 1 + strlen( list->trunc + 1 );
+
+		bvl = SLAP_MALLOC( BVL_SIZE( len ) );
+		if ( bvl == NULL )
+			break;
+		AC_MEMCPY( bvl, list, BVL_SIZE( len ) );
+		bvl->trunc = BVL_NAME( bvl ) + (list->trunc - name);
+		*next = bvl;
+		next = &bvl->next;
+	}
+	*next = NULL;
+	return res;
+}
+
+static void
+bvlist_free( bvlist *list )
+{
+	bvlist *next;
+
+	for ( ; list != NULL; list = next ) {
+		next = list->next;
+		SLAP_FREE( list );
+	}
+}
+
+static void
+ldif_cnode_free( void *v )
+{
+	ldif_cnode *lc = v;
+
+	if ( lc->lc_entry != NULL )
+		entry_free( lc->lc_entry );
+	bvlist_free( lc->lc_list );
+	SLAP_FREE( lc );
+}
+
+static ldif_cnode *
+ldif_cnode_alloc( const char *path )
+{
+	size_t len = strlen( path );
+	ldif_cnode *lc = SLAP_CALLOC( 1, sizeof( ldif_cnode ) + len + 1 );
+
+	if ( lc != NULL ) {
+		lc->lc_path.bv_val = (char *) (lc + 1);
+		lc->lc_path.bv_len = len;
+		AC_MEMCPY( lc->lc_path.bv_val, path, len + 1 );
+	}
+	return lc;
+}
+
+/* Insert lc, or free it if the cache is full or already has path */
+static void
+ldif_cache_insert( struct ldif_info *li, ldif_cnode *lc )
+{
+	ldap_pvt_thread_mutex_lock( &li->li_cache_mutex );
+	if ( li->li_cachecount < li->li_cachesize &&
+		avl_insert( &li->li_cache, lc, ldif_cnode_cmp, avl_dup_error ) == 0 )
+	{
+		li->li_cachecount++;
+		lc = NULL;
+	}
+	ldap_pvt_thread_mutex_unlock( &li->li_cache_mutex );
+
+	if ( lc != NULL )
+		ldif_cnode_free( lc );
+}
+
+/* If the entry at path is cached, set *entryp to a copy (if entryp is
+ * not NULL) and return true.
+ */
+static int
+ldif_cache_entry( struct ldif_info *li, const char *path, Entry **entryp )
+{
+	ldif_cnode key, *lc;
+	int found = 0;
+
+	if ( li->li_cachesize == 0 ) {
+		/* cache turned off by reconfiguration, drop what it held */
+		if ( li->li_cache != NULL )
+			ldif_cache_flush( li );
+		return 0;
+	}
+
+	key.lc_path.bv_val = (char *) path;
+	ldap_pvt_thread_mutex_lock( &li->li_cache_mutex );
+	lc = avl_find( li->li_cache, &key, ldif_cnode_cmp );
+	if ( lc != NULL && lc->lc_entry != NULL ) {
+		found = 1;
+		if ( entryp != NULL )
+			*entryp = entry_dup( lc->lc_entry );
+	}
+	ldap_pvt_thread_mutex_unlock( &li->li_cache_mutex );
+
+	return found;
+}
+
+static void
+ldif_cache_entry_add( struct ldif_info *li, const char *path, Entry *e )
+{
+	ldif_cnode *lc;
+
+	if ( li->li_cachesize == 0 || li->li_cachecount >= li->li_cachesize )
+		return;
+
+	lc = ldif_cnode_alloc( path );
+	if ( lc == NULL )
+		return;
+	lc->lc_entry = entry_dup( e );
+	ldif_cache_insert( li, lc );
+}
+
+/* If the listing of directory path is cached, set *listp to a copy */
+static int
+ldif_cache_dir( struct ldif_info *li, const char *path,
+	bvlist **listp, ber_len_t *fname_maxlenp )
+{
+	ldif_cnode key, *lc;
+	int found = 0;
+
+	if ( li->li_cachesize == 0 )
+		return 0;
+
+	key.lc_path.bv_val = (char *) path;
+	ldap_pvt_thread_mutex_lock( &li->li_cache_mutex );
+	lc = avl_find( li->li_cache, &key, ldif_cnode_cmp );
+	if ( lc != NULL && lc->lc_entry == NULL ) {
+		*listp = bvlist_dup( lc->lc_list );
+		*fname_maxlenp = lc->lc_fname_maxlen;
+		/* fall back to reading the directory if out of memory */
+		found = lc->lc_list == NULL || *listp != NULL;
+	}
+	ldap_pvt_thread_mutex_unlock( &li->li_cache_mutex );
+
+	return found;
+}
+
+static void
+ldif_cache_dir_add( struct ldif_info *li, const char *path,
+	bvlist *list, ber_len_t fname_maxlen )
+{
+	ldif_cnode *lc;
+
+	if ( li->li_cachesize == 0 || li->li_cachecount >= li->li_cachesize )
+		return;
+
+	lc = ldif_cnode_alloc( path );
+	if ( lc == NULL )
+		return;
+	lc->lc_list = bvlist_dup( list );
+	if ( list != NULL && lc->lc_list == NULL ) {
+		ldif_cnode_free( lc );
+		return;
+	}
+	lc->lc_fname_maxlen = fname_maxlen;
+	ldif_cache_insert( li, lc );
+}
+
+static void
+ldif_cache_remove( struct ldif_info *li, char *path )
+{
+	ldif_cnode key, *lc;
+
+	key.lc_path.bv_val = path;
+	lc = avl_delete( &li->li_cache, &key, ldif_cnode_cmp );
+	if ( lc != NULL ) {
+		li->li_cachecount--;
+		ldif_cnode_free( lc );
+	}
+}
+
+/*
+ * Forget the entry file at path, and the listings of its own
+ * directory and of the directory it is in.
+ */
+static void
+ldif_cache_forget( struct ldif_info *li, const char *path )
+{
+	struct berval bv;
+	char *sep;
+
+	if ( li->li_cache == NULL )
+		return;
+
+	ber_str2bv( path, 0, 1, &bv );
+	ldap_pvt_thread_mutex_lock( &li->li_cache_mutex );
+
+	ldif_cache_remove( li, bv.bv_val );
+	if ( bv.bv_len > STRLENOF( LDIF ) &&
+		!strcmp( bv.bv_val + bv.bv_len - STRLENOF( LDIF ), LDIF ) )
+	{
+		ldif2dir_len( bv );
+		ldif2dir_name( bv );
+		ldif_cache_remove( li, bv.bv_val );
+	}
+	sep = strrchr( bv.bv_val, LDAP_DIRSEP[0] );
+	if ( sep != NULL ) {
+		*sep = '\0';
+		ldif_cache_remove( li, bv.bv_val );
+	}
+
+	ldap_pvt_thread_mutex_unlock( &li->li_cache_mutex );
+	ch_free( bv.bv_val );
+}
+
+static void
+ldif_cache_flush( struct ldif_info *li )
+{
+	ldap_pvt_thread_mutex_lock( &li->li_cache_mutex );
+	avl_free( li->li_cache, ldif_cnode_free );
+	li->li_cache = NULL;
+	li->li_cachecount = 0;
+	ldap_pvt_thread_mutex_unlock( &li->li_cache_mutex );
+}
+
 static int
 ldif_send_entry( Operation *op, SlapReply *rs, Entry *e, int scope )
 {
@@ -805,12 +1088,16 @@ ldif_readdir(
 	bvlist **listp,
 	ber_len_t *fname_maxlenp )
 {
+	struct ldif_info *li = (struct ldif_info *) op->o_bd->be_private;
 	int rc = LDAP_SUCCESS;
 	DIR *dir_of_path;
 
 	*listp = NULL;
 	*fname_maxlenp = 0;
 
+	if ( ldif_cache_dir( li, path->bv_val, listp, fname_maxlenp ) )
+		return rc;
+
 	dir_of_path = opendir( path->bv_val );
 	if ( dir_of_path == NULL ) {
 		int save_errno = errno;
@@ -898,6 +1185,9 @@ ldif_readdir(
 		}
 	}
 
+	if ( rc == LDAP_SUCCESS )
+		ldif_cache_dir_add( li, path->bv_val, *listp, *fname_maxlenp );
+
 	return rc;
 }
 
@@ -1495,6 +1785,7 @@ ldif_back_delete( Operation *op, SlapReply *rs )
 		goto done;
 	}
 
+	ldif_cache_forget( li, path.bv_val );
 	ldif2dir_len( path );
 	ldif2dir_name( path );
 	if ( rmdir( path.bv_val ) < 0 ) {
@@ -1609,6 +1900,9 @@ ldif_move_entry(
 				      *text, STRERROR(errno),
 				      op->o_req_dn.bv_val, entry->e_dn );
 			}
+
+			/* the whole subtree has moved */
+			ldif_cache_flush( li );
 		}
 
 		ldap_pvt_thread_rdwr_wunlock( &li->li_rdwr );
@@ -1891,7 +2185,7 @@ ldif_tool_entry_modify( BackendDB *be, Entry *e, struct berval *text )
 static int
 ldif_tool_entry_delete( BackendDB *be, struct berval *ndn, struct berval *text )
 {
-	struct ldif_tool *tl = &((struct ldif_info *) be->be_private)->li_tool;
+	struct ldif_info *li = (struct ldif_info *) be->be_private;
 	int rc = LDAP_SUCCESS;
 	const char *errmsg = NULL;
 	struct berval path;
@@ -1899,6 +2193,7 @@ ldif_tool_entry_delete( BackendDB *be, struct berval *ndn, struct berval *text )
 
 	op.o_bd = be;
 	ndn2path( &op, ndn, &path, 0 );
+	ldif_cache_forget( li, path.bv_val );
 
 	ldif2dir_len( path );
 	ldif2dir_name( path );
@@ -1950,6 +2245,7 @@ ldif_back_db_init( BackendDB *be, ConfigReply *cr )
 	be->be_cf_ocs = ldifocs;
 	ldap_pvt_thread_mutex_init( &li->li_modop_mutex );
 	ldap_pvt_thread_rdwr_init( &li->li_rdwr );
+	ldap_pvt_thread_mutex_init( &li->li_cache_mutex );
 	SLAP_DBFLAGS( be ) |= SLAP_DBFLAG_ONE_SUFFIX;
 	return 0;
 }
@@ -1960,6 +2256,8 @@ ldif_back_db_destroy( Backend *be, ConfigReply *cr )
 	struct ldif_info *li = be->be_private;
 
 	ch_free( li->li_base_path.bv_val );
+	ldif_cache_flush( li );
+	ldap_pvt_thread_mutex_destroy( &li->li_cache_mutex );
 	ldap_pvt_thread_rdwr_destroy( &li->li_rdwr );
 	ldap_pvt_thread_mutex_destroy( &li->li_modop_mutex );
 	free( be->be_private );
@@ -1974,6 +2272,8 @@ ldif_back_db_open( Backend *be, ConfigReply *cr )
 		Debug( LDAP_DEBUG_ANY, "missing base path for back-ldif\n" );
 		return 1;
 	}
+	/* the files may have been changed while the database was closed */
+	ldif_cache_flush( li );
 	return 0;
 }
 
@@ -70,8 +70,12 @@ mdb_add(Operation *op, SlapReply *rs )
 		Debug( LDAP_DEBUG_TRACE,
 			LDAP_XSTRING(mdb_add) ": txn_begin failed: %s (%d)\n",
 			mdb_strerror(rs->sr_err), rs->sr_err );
-		rs->sr_err = LDAP_OTHER;
-		rs->sr_text = "internal error";
+		if ( rs->sr_err == LDAP_BUSY ) {
+			rs->sr_text = "database is being compacted";
+		} else {
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "internal error";
+		}
 		goto return_results;
 	}
 	txn = moi->moi_txn;
@@ -366,7 +370,7 @@ mdb_add(Operation *op, SlapReply *rs )
 			goto return_results;
 		}
 
-		rs->sr_err = mdb_txn_commit( txn );
+		rs->sr_err = mdb_op_commit( op, moi );
 		txn = NULL;
 		if ( rs->sr_err != 0 ) {
 			mdb->mi_numads = numads;
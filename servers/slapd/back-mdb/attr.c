@@ -137,6 +137,10 @@ mdb_attr_dbs_open(
 				cr->msg );
 			break;
 		}
+		if ( mdb->mi_pinbranches && !( slapMode & SLAP_TOOL_MODE ) &&
+			(( mdb->mi_attrs[i]->ai_indexmask | mdb->mi_attrs[i]->ai_newmask ) &
+			SLAP_INDEX_EQUALITY ))
+			mdb_set_pinned( txn, mdb->mi_attrs[i]->ai_dbi, 1 );
 		/* Remember newly opened DBI handles */
 		if ( dbis )
 			dbis[i] = mdb->mi_attrs[i]->ai_dbi;
@@ -374,6 +378,38 @@ fail:
 			goto fail;
 		}
 
+		/* the keys are the normalized values, only in order for
+		 * rules comparing them bytewise
+		 */
+		if( IS_SLAP_INDEX( mask, SLAP_INDEX_SORT ) && (
+			!ad->ad_type->sat_equality || ( ad->ad_type->sat_ordering
+				&& ad->ad_type->sat_ordering->smr_match != octetStringOrderingMatch ) ) )
+		{
+			if (c_reply) {
+				snprintf(c_reply->msg, sizeof(c_reply->msg),
+					"sort index of attribute \"%s\" disallowed", attrs[i] );
+				fprintf( stderr, "%s: line %d: %s\n",
+					fname, lineno, c_reply->msg );
+			}
+			rc = LDAP_INAPPROPRIATE_MATCHING;
+			goto fail;
+		}
+
+		/* buckets of the equality keys, which must be in order */
+		if( IS_SLAP_INDEX( mask, SLAP_INDEX_RANGE ) && (
+			!IS_SLAP_INDEX( mask, SLAP_INDEX_EQUALITY ) ||
+			!( ad->ad_type->sat_equality->smr_usage & SLAP_MR_ORDERED_INDEX ) ) )
+		{
+			if (c_reply) {
+				snprintf(c_reply->msg, sizeof(c_reply->msg),
+					"range index of attribute \"%s\" disallowed", attrs[i] );
+				fprintf( stderr, "%s: line %d: %s\n",
+					fname, lineno, c_reply->msg );
+			}
+			rc = LDAP_INAPPROPRIATE_MATCHING;
+			goto fail;
+		}
+
 		Debug( LDAP_DEBUG_CONFIG, "index %s 0x%04lx\n",
 			ad->ad_cname.bv_val, mask );
 
@@ -388,6 +424,8 @@ fail:
 		a->ai_dbi = 0;
 		a->ai_multi_hi = UINT_MAX;
 		a->ai_multi_lo = UINT_MAX;
+		a->ai_dict = 0;
+		memset( a->ai_stats, 0, sizeof( a->ai_stats ));
 
 		if ( mdb->mi_flags & MDB_IS_OPEN ) {
 			a->ai_indexmask = 0;
@@ -428,8 +466,10 @@ fail:
 		rc = ainfo_insert( mdb, a );
 		if( rc ) {
 			AttrInfo *b = mdb_attr_mask( mdb, ad );
-			/* If this is just a multival record, reuse it for index info */
-			if ( !( b->ai_indexmask || b->ai_newmask ) && b->ai_multi_lo < UINT_MAX ) {
+			/* If this is just a multival or dictionary record, reuse it
+			 * for index info */
+			if ( !( b->ai_indexmask || b->ai_newmask ) &&
+				( b->ai_multi_lo < UINT_MAX || b->ai_dict )) {
 				b->ai_indexmask = a->ai_indexmask;
 				b->ai_newmask = a->ai_newmask;
 				ch_free( a );
@@ -671,6 +711,119 @@ mdb_attr_multi_thresh( struct mdb_info *mdb, AttributeDescription *ad, unsigned
 	}
 }
 
+int
+mdb_attr_dict_config(
+	struct mdb_info	*mdb,
+	const char		*fname,
+	int			lineno,
+	int			argc,
+	char		**argv,
+	struct		config_reply_s *c_reply)
+{
+	int rc = 0;
+	int	i;
+	unsigned max;
+	char **attrs;
+
+	attrs = ldap_str2charray( argv[0], "," );
+
+	if( attrs == NULL ) {
+		fprintf( stderr, "%s: line %d: "
+			"no attributes specified: %s\n",
+			fname, lineno, argv[0] );
+		return LDAP_PARAM_ERROR;
+	}
+
+	if ( lutil_atoux( &max, argv[1], 0 ) != 0 || max == 0 ) {
+		snprintf(c_reply->msg, sizeof(c_reply->msg),
+			"invalid number of values" );
+		fprintf( stderr, "%s: line %d: %s\n",
+			fname, lineno, c_reply->msg );
+		rc = LDAP_PARAM_ERROR;
+		goto done;
+	}
+
+	for ( i = 0; attrs[i] != NULL; i++ ) {
+		AttrInfo	*a;
+		AttributeDescription *ad;
+		const char *text;
+
+		ad = NULL;
+		rc = slap_str2ad( attrs[i], &ad, &text );
+
+		if( rc != LDAP_SUCCESS ) {
+			if ( c_reply )
+			{
+				snprintf(c_reply->msg, sizeof(c_reply->msg),
+					"dictionary attribute \"%s\" undefined",
+					attrs[i] );
+
+				fprintf( stderr, "%s: line %d: %s\n",
+					fname, lineno, c_reply->msg );
+			}
+			goto done;
+		}
+
+		a = (AttrInfo *) ch_calloc( 1, sizeof(AttrInfo) );
+
+		a->ai_desc = ad;
+		a->ai_multi_hi = UINT_MAX;
+		a->ai_multi_lo = UINT_MAX;
+		a->ai_dict = max;
+
+		rc = ainfo_insert( mdb, a );
+		if( rc ) {
+			AttrInfo *b = mdb_attr_mask( mdb, ad );
+			/* If this is an index or multival record, reuse it */
+			if ( !b->ai_dict ) {
+				b->ai_dict = max;
+				ch_free( a );
+				rc = 0;
+				continue;
+			}
+			if (c_reply) {
+				snprintf(c_reply->msg, sizeof(c_reply->msg),
+					"duplicate dictionary definition for attr \"%s\"",
+					attrs[i] );
+				fprintf( stderr, "%s: line %d: %s\n",
+					fname, lineno, c_reply->msg );
+			}
+
+			rc = LDAP_PARAM_ERROR;
+			goto done;
+		}
+	}
+
+done:
+	ldap_charray_free( attrs );
+
+	return rc;
+}
+
+void
+mdb_attr_dict_unparse( struct mdb_info *mdb, BerVarray *bva )
+{
+	char digbuf[sizeof("4294967296")];
+	struct berval bv;
+	AttrInfo *ai;
+	char *ptr;
+	int i;
+
+	for ( i=0; i<mdb->mi_nattrs; i++ ) {
+		ai = mdb->mi_attrs[i];
+		if ( !ai->ai_dict )
+			continue;
+		bv.bv_len = snprintf( digbuf, sizeof(digbuf), "%u", ai->ai_dict );
+		bv.bv_len += ai->ai_desc->ad_cname.bv_len + 1;
+		ptr = ch_malloc( bv.bv_len+1 );
+		bv.bv_val = lutil_strcopy( ptr, ai->ai_desc->ad_cname.bv_val );
+		*bv.bv_val++ = ' ';
+		strcpy( bv.bv_val, digbuf );
+		bv.bv_val = ptr;
+		ber_bvarray_add( bva, &bv );
+	}
+}
+
 void
 mdb_attr_info_free( AttrInfo *ai )
 {
@@ -710,8 +863,10 @@ void mdb_attr_flush( struct mdb_info *mdb )
 
 	for ( i=0; i<mdb->mi_nattrs; i++ ) {
 		if ( mdb->mi_attrs[i]->ai_indexmask & MDB_INDEX_DELETING ) {
-			/* if this is also a multival rec, just clear index */
-			if ( mdb->mi_attrs[i]->ai_multi_lo < UINT_MAX ) {
+			/* if this is also a multival or dictionary rec,
+			 * just clear index */
+			if ( mdb->mi_attrs[i]->ai_multi_lo < UINT_MAX ||
+				mdb->mi_attrs[i]->ai_dict ) {
 				mdb->mi_attrs[i]->ai_indexmask = 0;
 				mdb->mi_attrs[i]->ai_newmask = 0;
 			} else {
@@ -812,6 +967,69 @@ int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad )
 	return rc;
 }
 
+/* Record 0 of the ad2id DB, which mdb_ad_read never reaches, holds
+ * the generation of the hash the index keys were made with.
+ */
+int mdb_ixhash_put( struct mdb_info *mdb, MDB_txn *txn )
+{
+	int i = 0, gen = slap_hash_generation(), rc;
+	MDB_val key, val;
+
+	key.mv_size = sizeof(int);
+	key.mv_data = &i;
+	val.mv_size = sizeof(int);
+	val.mv_data = &gen;
+
+	rc = mdb_put( txn, mdb->mi_ad2id, &key, &val, 0 );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_ixhash_put: mdb_put failed %s(%d)\n",
+			mdb_strerror(rc), rc );
+	}
+	return rc;
+}
+
+int mdb_ixhash_check( BackendDB *be, MDB_txn *txn, ConfigReply *cr )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	int i = 0, gen = slap_hash_generation(), old = 0, rc;
+	MDB_val key, data;
+	MDB_stat st;
+
+	key.mv_size = sizeof(int);
+	key.mv_data = &i;
+
+	rc = mdb_get( txn, mdb->mi_ad2id, &key, &data );
+	if ( rc == MDB_NOTFOUND ) {
+		/* A new database takes the current generation. Keys of older
+		 * databases are whatever they were made with, until slapindex
+		 * rebuilds them all.
+		 */
+		rc = mdb_stat( txn, mdb->mi_id2entry, &st );
+		if ( rc == 0 && !st.ms_entries )
+			return mdb_ixhash_put( mdb, txn );
+		mdb->mi_flags |= MDB_IXHASH_STALE;
+		return rc;
+	}
+	if ( rc )
+		return rc;
+
+	if ( data.mv_size == sizeof(int) )
+		memcpy( &old, data.mv_data, sizeof(int) );
+	if ( old == gen )
+		return 0;
+
+	snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+		"index keys are of hash generation %d, index_hash and "
+		"index_hash64 give generation %d, run \"slapindex\".",
+		be->be_suffix[0].bv_val, old, gen );
+	Debug( LDAP_DEBUG_ANY, "mdb_ixhash_check: %s\n", cr->msg );
+	mdb->mi_flags |= MDB_IXHASH_STALE;
+	if ( !(slapMode & SLAP_TOOL_READMAIN ))
+		return LDAP_OTHER;
+	return 0;
+}
+
 void mdb_ad_unwind( struct mdb_info *mdb, int prev_ads )
 {
 	int i;
@@ -33,7 +33,9 @@ LDAP_BEGIN_DECL
 #define MDB_DN2ID		1
 #define MDB_ID2ENTRY	2
 #define MDB_ID2VAL		3
-#define MDB_NDB			4
+#define MDB_ALIAS		4	/* may be missing from older databases */
+#define MDB_DICT		5	/* likewise */
+#define MDB_NDB			6
 
 /* The default search IDL stack cache depth */
 #define DEFAULT_SEARCH_STACK_DEPTH	16
@@ -51,6 +53,15 @@ LDAP_BEGIN_DECL
 /* Most users will never see this */
 #define DEFAULT_RTXN_SIZE	10000
 
+/* Cached DN lookups per thread */
+#define DEFAULT_DNCACHE_SIZE	64
+
+/* Entries reindexed in one write txn by the online indexer */
+#define DEFAULT_INDEX_TXN_SIZE	1000
+
+/* Copies of the DB an online compaction makes before giving up */
+#define MDB_COMPACT_TRIES	3
+
 #ifdef LDAP_DEVEL
 #define MDB_MONITOR_IDX
 #endif
@@ -58,11 +69,41 @@ LDAP_BEGIN_DECL
 typedef struct mdb_monitor_t {
 	void		*mdm_cb;
 	struct berval	mdm_ndn;
+	BackendDB	*mdm_be;
 } mdb_monitor_t;
 
+/* Filter shapes of the searches that tested many more candidates
+ * than they returned, the most frequent ones kept.
+ */
+#define MDB_SHAPES		32	/* shapes kept */
+#define MDB_SHAPES_SHOWN	10	/* shapes shown in cn=Monitor */
+#define MDB_SHAPE_MINCAND	100	/* fewer candidates are cheap anyway */
+#define MDB_SHAPE_RATIO		10	/* candidates per entry returned */
+
+typedef struct mdb_shape {
+	char		*ms_shape;	/* NULL if the slot is free */
+	unsigned long	ms_count;	/* for ranking, may overestimate */
+	unsigned long	ms_searches;	/* counted in the sums below */
+	unsigned long	ms_cands;
+	unsigned long	ms_returned;
+} mdb_shape;
+
 /* From ldap_rq.h */
 struct re_s;
 
+/* A decoded entry kept by the entry cache, in one block with
+ * its attributes and values. Ops get their own copy of ec_e.
+ */
+typedef struct mdb_ecentry {
+	ID			ec_id;
+	size_t		ec_txnid;	/* readers of this txn or later may use it */
+	size_t		ec_size;
+	int			ec_refs;	/* ops using it, plus one while cached */
+	struct mdb_info	*ec_mdb;
+	LDAP_TAILQ_ENTRY(mdb_ecentry)	ec_lru;
+	Entry		ec_e;
+} mdb_ecentry;
+
 struct mdb_info {
 	MDB_env		*mi_dbenv;
 
@@ -74,24 +115,96 @@ struct mdb_info {
 	size_t		mi_mapsize;
 	ID			mi_nextid;
 	size_t		mi_maxentrysize;
+	size_t		mi_compress;	/* compress entries of this size or more */
 
 	slap_mask_t	mi_defaultmask;
 	int			mi_nattrs;
 	struct mdb_attrinfo		**mi_attrs;
 	void		*mi_search_stack;
 	int			mi_search_stack_depth;
+	int			mi_search_threads;
 	int			mi_readers;
 
 	unsigned	mi_rtxn_size;
+	unsigned	mi_rtxn_maxage;		/* seconds */
+	unsigned	mi_rtxn_maxpages;	/* growth of the DB */
+	unsigned	mi_prefetch;	/* candidates to read ahead */
+	unsigned	mi_search_quantum;	/* candidates between yields */
+	int			mi_warmup;
+	int			mi_warmup_threads;
+	int			mi_warmup_entries;	/* read the whole file */
+	int			mi_warmup_wait;	/* before accepting clients */
+	int			mi_pinbranches;	/* mlock the DN and equality index branches */
+	int			mi_idl_exact;
+	unsigned	mi_dncache_size;
+	size_t		mi_dncache_txnid;	/* last txn that deleted a DN */
+	ldap_pvt_thread_mutex_t	mi_dncache_mutex;
+
+	/* paged search candidates kept between pages */
+	struct mdb_pcache	*mi_pcache;
+	size_t		mi_pcache_bytes;
+	size_t		mi_pcache_max;
+	unsigned	mi_pcache_ttl;
+	ldap_pvt_thread_mutex_t	mi_pcache_mutex;
+
+	/* decoded copies of entries read often */
+	Avlnode		*mi_ecache_tree;
+	LDAP_TAILQ_HEAD(mdb_eclru, mdb_ecentry)	mi_ecache_lru;	/* most recent first */
+	size_t		mi_ecache_bytes;
+	size_t		mi_ecache_max;
+	size_t		mi_ecache_wtxnid;	/* last write txn to change an entry */
+	ldap_pvt_thread_mutex_t	mi_ecache_mutex;
+
+	/* identical searches sharing their responses */
+	int			mi_coalesce;
+	unsigned	mi_coalesce_ttl;	/* msec */
+	Avlnode		*mi_cq_tree;
+	struct mdb_coalesce	*mi_cq_done;	/* oldest first */
+	struct mdb_coalesce	**mi_cq_donetail;
+	int			mi_cq_ndone;
+	ldap_pvt_thread_mutex_t	mi_cq_mutex;
+	ldap_pvt_thread_cond_t	mi_cq_cond;
+
+	/* commits waiting for a shared sync */
+	int			mi_group_commit;
+	int			mi_gc_syncing;
+	int			mi_gc_rc;	/* result of the last sync */
+	unsigned long	mi_gc_committed;
+	unsigned long	mi_gc_synced;
+	unsigned long	mi_gc_syncs;
+	ldap_pvt_thread_mutex_t	mi_gc_mutex;
+	ldap_pvt_thread_cond_t	mi_gc_cond;
+
 	int			mi_txn_cp;
 	unsigned	mi_txn_cp_min;
 	unsigned	mi_txn_cp_kbyte;
 
 	struct re_s		*mi_txn_cp_task;
 	struct re_s		*mi_index_task;
+	int			mi_index_threads;
+	unsigned	mi_index_txn_size;
+	int			mi_index_restart;	/* index config changed while running */
+	unsigned long	mi_index_total;	/* entries to reindex */
+	unsigned long	mi_index_done;
+
+	struct re_s		*mi_warmup_task;
+	ldap_pvt_thread_mutex_t	mi_warmup_mutex;
+	int			mi_warmup_next;	/* next portion to read */
+	int			mi_warmup_total;
+	int			mi_warmup_done;
+	int			mi_warmup_busy;	/* workers still reading */
+	struct re_s		*mi_compact_task;
+	int			mi_compacting;	/* refuse new write txns */
+
+	/* index keys are sorted by quick mode tools */
+	size_t		mi_tool_sort_size;
+	char		*mi_tool_sort_dir;
 
 	mdb_monitor_t	mi_monitor;
 
+	ldap_pvt_thread_mutex_t	mi_shape_mutex;
+	mdb_shape	mi_shapes[MDB_SHAPES];
+
 #ifdef MDB_MONITOR_IDX
 	ldap_pvt_thread_mutex_t	mi_idx_mutex;
 	Avlnode		*mi_idx;
@@ -103,6 +216,7 @@ struct mdb_info {
 #define	MDB_DEL_INDEX	0x08
 #define	MDB_RE_OPEN		0x10
 #define	MDB_NEED_UPGRADE	0x20
+#define	MDB_IXHASH_STALE	0x40	/* index hash generation not current */
 
 	int mi_numads;
 
@@ -122,20 +236,40 @@ struct mdb_info {
 #define mi_dn2id	mi_dbis[MDB_DN2ID]
 #define mi_ad2id	mi_dbis[MDB_AD2ID]
 #define mi_id2val	mi_dbis[MDB_ID2VAL]
+#define mi_alias	mi_dbis[MDB_ALIAS]
+#define mi_dict		mi_dbis[MDB_DICT]
 
 typedef struct mdb_op_info {
 	OpExtra		moi_oe;
 	MDB_txn*	moi_txn;
+	MDB_txn*	moi_parent;	/* of moi_txn, in a bulk LDAP txn */
+	int			moi_numads;	/* mi_numads when moi_txn began */
 	int			moi_ref;
 	char		moi_flag;
 } mdb_op_info;
 #define MOI_READER	0x01
 #define MOI_FREEIT	0x02
 #define MOI_KEEPER	0x04
+#define MOI_GROUP	0x08	/* wait for a group commit sync */
 
 LDAP_END_DECL
 
 /* for the cache of attribute information (which are indexed, etc.) */
+/* slots of AttrInfo.ai_stats, by index type */
+#define MDB_IDXSTAT_PRES	0
+#define MDB_IDXSTAT_EQ		1
+#define MDB_IDXSTAT_APPROX	2
+#define MDB_IDXSTAT_SUB		3
+#define MDB_IDXSTAT_TYPES	4
+
+/* how searches used an index, kept while cn=Monitor is on */
+typedef struct mdb_idxstat {
+	unsigned long	is_lookups;
+	unsigned long	is_ids;		/* candidates found, summed */
+	unsigned long	is_ranges;	/* lookups that gave a range */
+	unsigned long	is_usec;
+} mdb_idxstat;
+
 typedef struct mdb_attrinfo {
 	AttributeDescription *ai_desc; /* attribute description cn;lang-en */
 	slap_mask_t ai_indexmask;	/* how the attr is indexed	*/
@@ -149,6 +283,8 @@ typedef struct mdb_attrinfo {
 	MDB_dbi ai_dbi;
 	unsigned ai_multi_hi;
 	unsigned ai_multi_lo;
+	unsigned ai_dict;	/* most values kept in the dictionary, or 0 */
+	mdb_idxstat ai_stats[MDB_IDXSTAT_TYPES];
 } AttrInfo;
 
 /* tool threaded indexer state */
@@ -159,10 +295,49 @@ typedef struct mdb_attrixinfo {
 	AttrInfo *ai_ai;
 } AttrIxInfo;
 
+/* online reindex, keys collected by indexer() to be
+ * written in key order by mdb_ixkeys_write()
+ */
+typedef struct mdb_ixkey {
+	AttrInfo *ik_ai;
+	ID ik_id;
+	struct berval ik_key;
+} mdb_ixkey;
+
+typedef struct mdb_ixkeys {
+	OpExtra ik_oe;
+	AttrInfo *ik_ai;
+	struct mdb_ixkey **ik_keys;
+	int ik_nkeys;
+	int ik_maxkeys;
+} mdb_ixkeys;
+
 /* These flags must not clash with SLAP_INDEX flags or ops in slap.h! */
 #define	MDB_INDEX_DELETING	0x8000U	/* index is being modified */
 #define	MDB_INDEX_UPDATE_OP	0x03	/* performing an index update */
 
+/* Keys of sort indices: the normalized value behind a prefix longer
+ * than any hashed key, padded with NULs to an aligned length. LMDB's
+ * key order is then the octetStringOrderingMatch order of the values,
+ * up to the length that fits in a key.
+ */
+#define MDB_SORT_PREFIX		"\377\377\377\377\377\377\377\377<"
+#define MDB_SORT_PREFIXLEN	(sizeof(MDB_SORT_PREFIX) - 1)
+#define MDB_SORT_KEYMAX		(511 & ~(sizeof(ID) - 1))	/* LMDB's default max key size */
+
+/* Keys of range indices: the ordered equality key of a value less its
+ * last MDB_RANGE_SHIFT bytes, behind a prefix of its own and padded
+ * like sort keys. Each one holds the IDs of every entry with a value
+ * in that bucket, so an inequality only walks the equality keys of
+ * the bucket its value falls in.
+ */
+#define MDB_RANGE_PREFIX	"\377\377\377\377\377\377\377\377#"
+#define MDB_RANGE_PREFIXLEN	(sizeof(MDB_RANGE_PREFIX) - 1)
+#define MDB_RANGE_SHIFT		2
+#define MDB_RANGE_KEYMAX	MDB_SORT_KEYMAX
+#define MDB_RANGE_KEYOK(k)	((k)->bv_len > MDB_RANGE_SHIFT && \
+	(k)->bv_len <= MDB_RANGE_KEYMAX - MDB_RANGE_PREFIXLEN + MDB_RANGE_SHIFT)
+
 /* For slapindex to record which attrs in an entry belong to which
  * index database 
  */
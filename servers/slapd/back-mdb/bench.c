@@ -0,0 +1,268 @@
+/* bench.c - mdb backend micro-benchmarks for slapbench */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+/* synthetic IDLs are drawn from a fixed seed, runs are comparable */
+#define MDB_BENCH_SEED	20200101U
+#define MDB_BENCH_PAIRS	8
+
+static unsigned int
+mdb_bench_rand( unsigned int *seed )
+{
+	*seed = *seed * 1103515245U + 12345U;
+	return *seed >> 8;
+}
+
+/* Fill ids with n distinct random IDs out of 1..max, in order */
+static void
+mdb_bench_idl( ID *ids, ID n, ID max, unsigned int *seed )
+{
+	ID i, k = 0;
+
+	for ( i = 1; i <= max && k < n; i++ ) {
+		if ( mdb_bench_rand( seed ) % ( max - i + 1 ) < n - k )
+			ids[++k] = i;
+	}
+	ids[0] = k;
+}
+
+static const struct mdb_bench_idlcase {
+	char *name;
+	int union_op;
+	ID na, maxa;	/* na 0: a is the range 1..maxa */
+	ID nb, maxb;
+} mdb_bench_idlcases[] = {
+	{ "idl-intersect-sparse",	0, 1000, 1000000, 1000, 1000000 },
+	{ "idl-intersect-skewed",	0, 100, 1000000, 60000, 1000000 },
+	{ "idl-intersect-dense",	0, 60000, 100000, 60000, 100000 },
+	{ "idl-intersect-range",	0, 0, 500000, 60000, 1000000 },
+	{ "idl-union-sparse",		1, 1000, 1000000, 1000, 1000000 },
+	{ "idl-union-dense",		1, 30000, 100000, 30000, 100000 },
+	{ NULL }
+};
+
+/* The primitives work in place, so each op includes copying a */
+static void
+mdb_bench_idls( slap_bench *sb )
+{
+	const struct mdb_bench_idlcase *ic;
+	unsigned int seed = MDB_BENCH_SEED;
+	ID *a[MDB_BENCH_PAIRS], *b[MDB_BENCH_PAIRS], *tmp;
+	int i;
+
+	for ( i = 0; i < MDB_BENCH_PAIRS; i++ ) {
+		a[i] = ch_malloc( MDB_idl_um_size * sizeof(ID) );
+		b[i] = ch_malloc( MDB_idl_um_size * sizeof(ID) );
+	}
+	tmp = ch_malloc( MDB_idl_um_size * sizeof(ID) );
+
+	for ( ic = mdb_bench_idlcases; ic->name; ic++ ) {
+		if ( !slap_bench_start( sb, ic->name ) )
+			continue;
+
+		/* generating the lists is not timed */
+		for ( i = 0; i < MDB_BENCH_PAIRS; i++ ) {
+			if ( ic->na ) {
+				mdb_bench_idl( a[i], ic->na, ic->maxa, &seed );
+			} else {
+				MDB_IDL_RANGE( a[i], 1, ic->maxa );
+			}
+			mdb_bench_idl( b[i], ic->nb, ic->maxb, &seed );
+		}
+		slap_bench_start( sb, ic->name );
+
+		do {
+			for ( i = 0; i < MDB_BENCH_PAIRS; i++ ) {
+				MDB_IDL_CPY( tmp, a[i] );
+				if ( ic->union_op )
+					mdb_idl_union( tmp, b[i] );
+				else
+					mdb_idl_intersection( tmp, b[i] );
+			}
+		} while ( slap_bench_more( sb, MDB_BENCH_PAIRS ));
+	}
+
+	for ( i = 0; i < MDB_BENCH_PAIRS; i++ ) {
+		ch_free( a[i] );
+		ch_free( b[i] );
+	}
+	ch_free( tmp );
+}
+
+static int
+mdb_bench_dn2id( slap_bench *sb, MDB_txn *txn )
+{
+	struct mdb_info *mdb = (struct mdb_info *) sb->sb_op->o_bd->be_private;
+	Operation *op = sb->sb_op;
+	MDB_cursor *mc;
+	unsigned long misses = 0;
+	ID id;
+	int i, rc, first = 1;
+
+	if ( !slap_bench_start( sb, "dn2id" ) )
+		return 0;
+
+	rc = mdb_cursor_open( txn, mdb->mi_dn2id, &mc );
+	if ( rc )
+		return rc;
+
+	do {
+		for ( i = 0; i < sb->sb_nentries; i++ ) {
+			rc = mdb_dn2id( op, txn, mc, &sb->sb_entries[i]->e_nname,
+				&id, NULL, NULL, NULL );
+			if ( rc && first )
+				misses++;
+		}
+		first = 0;
+	} while ( slap_bench_more( sb, sb->sb_nentries ));
+
+	mdb_cursor_close( mc );
+	if ( misses )
+		printf( "# dn2id: %lu of %d DNs not in the database\n",
+			misses, sb->sb_nentries );
+
+	return 0;
+}
+
+static int
+mdb_bench_entry( slap_bench *sb, MDB_txn *txn )
+{
+	Operation *op = sb->sb_op;
+	MDB_val *flat, data;
+	Entry *e;
+	int i, n = 0;
+
+	if ( !slap_bench_start( sb, "entry-encode" ) &&
+		!slap_bench_start( sb, "entry-decode" ) )
+		return 0;
+
+	/* keep the encoded entries for the decoder */
+	flat = ch_calloc( sb->sb_nentries ? sb->sb_nentries : 1,
+		sizeof(MDB_val) );
+	for ( i = 0; i < sb->sb_nentries; i++ ) {
+		if ( mdb_entry_flatten( op, txn, sb->sb_entries[i], &data ))
+			continue;
+		flat[i].mv_size = data.mv_size;
+		flat[i].mv_data = ch_malloc( data.mv_size );
+		AC_MEMCPY( flat[i].mv_data, data.mv_data, data.mv_size );
+		op->o_tmpfree( data.mv_data, op->o_tmpmemctx );
+		n++;
+	}
+	if ( n < sb->sb_nentries )
+		printf( "# entry: %d of %d entries can't be encoded here\n",
+			sb->sb_nentries - n, sb->sb_nentries );
+
+	if ( slap_bench_start( sb, "entry-encode" ) ) {
+		do {
+			for ( i = 0; i < sb->sb_nentries; i++ ) {
+				if ( !flat[i].mv_data )
+					continue;
+				mdb_entry_flatten( op, txn, sb->sb_entries[i], &data );
+				op->o_tmpfree( data.mv_data, op->o_tmpmemctx );
+			}
+		} while ( slap_bench_more( sb, n ));
+	}
+
+	if ( slap_bench_start( sb, "entry-decode" ) ) {
+		do {
+			for ( i = 0; i < sb->sb_nentries; i++ ) {
+				if ( !flat[i].mv_data )
+					continue;
+				if ( mdb_entry_decode( op, txn, &flat[i], i + 1, &e ))
+					continue;
+				/* as in mdb_id2entry, the DN is not stored */
+				e->e_name.bv_val = NULL;
+				e->e_nname.bv_val = NULL;
+				mdb_entry_return( op, e );
+			}
+		} while ( slap_bench_more( sb, n ));
+	}
+
+	for ( i = 0; i < sb->sb_nentries; i++ )
+		ch_free( flat[i].mv_data );
+	ch_free( flat );
+
+	return 0;
+}
+
+/* Keys are collected the way the online reindex does it */
+static int
+mdb_bench_index( slap_bench *sb )
+{
+	Operation *op = sb->sb_op;
+	mdb_ixkeys ik = { 0 };
+	unsigned long nkeys = 0;
+	int i, rc = 0, first = 1;
+
+	if ( !slap_bench_start( sb, "index-keys" ) )
+		return 0;
+
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &ik.ik_oe, oe_next );
+	do {
+		for ( i = 0; i < sb->sb_nentries && !rc; i++ ) {
+			rc = mdb_index_entry( op, NULL, SLAP_INDEX_ADD_OP,
+				sb->sb_entries[i] );
+			if ( first )
+				nkeys += ik.ik_nkeys;
+			mdb_ixkeys_free( &ik );
+		}
+		first = 0;
+	} while ( slap_bench_more( sb, rc ? 0 : sb->sb_nentries ));
+	LDAP_SLIST_REMOVE( &op->o_extra, &ik.ik_oe, OpExtra, oe_next );
+
+	if ( sb->sb_nentries )
+		printf( "# index-keys: %.1f keys per entry\n",
+			(double)nkeys / sb->sb_nentries );
+
+	return rc;
+}
+
+int
+mdb_tool_bench( BackendDB *be, slap_bench *sb )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_txn *txn;
+	int rc;
+
+	sb->sb_op->o_bd = be;
+
+	mdb_bench_idls( sb );
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_tool_bench: txn_begin failed: %s (%d)\n",
+			mdb_strerror(rc), rc );
+		return -1;
+	}
+
+	rc = mdb_bench_dn2id( sb, txn );
+	if ( !rc )
+		rc = mdb_bench_entry( sb, txn );
+	if ( !rc )
+		rc = mdb_bench_index( sb );
+
+	mdb_txn_abort( txn );
+
+	return rc;
+}
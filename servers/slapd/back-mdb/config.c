@@ -45,6 +45,10 @@ enum {
 	MDB_SSTACK,
 	MDB_MULTIVAL,
 	MDB_IDLEXP,
+	MDB_PCACHE,
+	MDB_TOOLSORT,
+	MDB_DICTIONARY,
+	MDB_ECACHE,
 };
 
 static ConfigTable mdbcfg[] = {
@@ -63,21 +67,80 @@ static ConfigTable mdbcfg[] = {
 			"DESC 'Database checkpoint interval in kbytes and minutes' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )",NULL, NULL },
+	{ "coalesce", "on|off", 2, 2, 0, ARG_ON_OFF|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_coalesce),
+		"( OLcfgDbAt:12.21 NAME 'olcDbCoalesce' "
+		"DESC 'Let identical concurrent searches share one execution' "
+		"EQUALITY booleanMatch "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "coalescettl", "msec", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_coalesce_ttl),
+		"( OLcfgDbAt:12.22 NAME 'olcDbCoalesceTTL' "
+		"DESC 'Milliseconds the responses of a coalesced search are kept' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "compress", "size", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_compress),
+		"( OLcfgDbAt:12.20 NAME 'olcDbCompress' "
+		"DESC 'Compress entries of at least this many bytes' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "dbnosync", NULL, 1, 2, 0, ARG_ON_OFF|ARG_MAGIC|MDB_DBNOSYNC,
 		mdb_cf_gen, "( OLcfgDbAt:1.4 NAME 'olcDbNoSync' "
 			"DESC 'Disable synchronous database writes' "
 			"EQUALITY booleanMatch "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "dictionary", "attr> <max", 3, 3, 0, ARG_MAGIC|MDB_DICTIONARY,
+		mdb_cf_gen,
+		"( OLcfgDbAt:12.23 NAME 'olcDbDictionary' "
+		"DESC 'Attributes whose values are stored once in a value dictionary' "
+		"EQUALITY caseIgnoreMatch "
+		"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "entrycache", "kbyte", 2, 2, 0, ARG_ULONG|ARG_MAGIC|MDB_ECACHE,
+		mdb_cf_gen, "( OLcfgDbAt:12.24 NAME 'olcDbEntryCache' "
+		"DESC 'Memory in kbytes for decoded copies of frequently read entries' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "dncachesize", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_dncache_size),
+		"( OLcfgDbAt:12.9 NAME 'olcDbDNcacheSize' "
+		"DESC 'Number of DN lookups cached per thread' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "envflags", "flags", 2, 0, 0, ARG_MAGIC|MDB_ENVFLAGS,
 		mdb_cf_gen, "( OLcfgDbAt:12.3 NAME 'olcDbEnvFlags' "
 			"DESC 'Database environment flags' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "groupcommit", "on|off", 2, 2, 0, ARG_ON_OFF|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_group_commit),
+		"( OLcfgDbAt:12.14 NAME 'olcDbGroupCommit' "
+		"DESC 'Let concurrent write transactions share one sync' "
+		"EQUALITY booleanMatch "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "idlexact", "on|off", 2, 2, 0, ARG_ON_OFF|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_idl_exact),
+		"( OLcfgDbAt:12.7 NAME 'olcDbIdlExact' "
+		"DESC 'Keep exact IDs for index keys that overflow to ranges' "
+		"EQUALITY booleanMatch "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "index", "attr> <[pres,eq,approx,sub]", 2, 3, 0, ARG_MAGIC|MDB_INDEX,
 		mdb_cf_gen, "( OLcfgDbAt:0.2 NAME 'olcDbIndex' "
 		"DESC 'Attribute index parameters' "
 		"EQUALITY caseIgnoreMatch "
 		"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "indexthreads", "num", 2, 2, 0, ARG_INT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_index_threads),
+		"( OLcfgDbAt:12.11 NAME 'olcDbIndexThreads' "
+		"DESC 'Number of threads used to reindex entries online' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "indextxnsize", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_index_txn_size),
+		"( OLcfgDbAt:12.12 NAME 'olcDbIndexTxnSize' "
+		"DESC 'Number of entries to reindex online in one write transaction' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "maxentrysize", "size", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_maxentrysize),
 		"( OLcfgDbAt:12.4 NAME 'olcDbMaxEntrySize' "
@@ -94,6 +157,11 @@ static ConfigTable mdbcfg[] = {
 		"DESC 'Maximum size of DB in bytes' "
 		"EQUALITY integerMatch "
 		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "pagedcache", "kbyte> <sec", 3, 3, 0, ARG_MAGIC|MDB_PCACHE,
+		mdb_cf_gen, "( OLcfgDbAt:12.10 NAME 'olcDbPagedCache' "
+		"DESC 'Memory in kbytes and time in seconds to keep paged search candidates' "
+		"EQUALITY caseIgnoreMatch "
+		"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "mode", "mode", 2, 2, 0, ARG_MAGIC|MDB_MODE,
 		mdb_cf_gen, "( OLcfgDbAt:0.3 NAME 'olcDbMode' "
 		"DESC 'Unix permissions of database files' "
@@ -105,17 +173,82 @@ static ConfigTable mdbcfg[] = {
 		"DESC 'Hi/Lo thresholds for splitting multivalued attr out of main blob' "
 		"EQUALITY caseIgnoreMatch "
 		"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "prefetch", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_prefetch),
+		"( OLcfgDbAt:12.17 NAME 'olcDbPrefetch' "
+		"DESC 'Number of upcoming search candidates to read ahead' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "rtxnmaxage", "seconds", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_rtxn_maxage),
+		"( OLcfgDbAt:12.15 NAME 'olcDbRtxnMaxAge' "
+		"DESC 'Seconds a search may keep its read transaction' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "rtxnmaxpages", "pages", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_rtxn_maxpages),
+		"( OLcfgDbAt:12.16 NAME 'olcDbRtxnMaxPages' "
+		"DESC 'Pages the DB may grow by while a search keeps its read transaction' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "rtxnsize", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_rtxn_size),
 		"( OLcfgDbAt:12.5 NAME 'olcDbRtxnSize' "
 		"DESC 'Number of entries to process in one read transaction' "
 		"EQUALITY integerMatch "
 		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "searchquantum", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_search_quantum),
+		"( OLcfgDbAt:12.25 NAME 'olcDbSearchQuantum' "
+		"DESC 'Number of candidates a search examines before letting waiting operations run' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "searchstack", "depth", 2, 2, 0, ARG_INT|ARG_MAGIC|MDB_SSTACK,
 		mdb_cf_gen, "( OLcfgDbAt:1.9 NAME 'olcDbSearchStack' "
 		"DESC 'Depth of search stack in IDLs' "
 		"EQUALITY integerMatch "
 		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "searchthreads", "num", 2, 2, 0, ARG_INT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_search_threads),
+		"( OLcfgDbAt:12.8 NAME 'olcDbSearchThreads' "
+		"DESC 'Number of threads verifying the candidates of a large search' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "toolsort", "mbyte> <[dir]", 2, 3, 0, ARG_MAGIC|MDB_TOOLSORT,
+		mdb_cf_gen, "( OLcfgDbAt:12.13 NAME 'olcDbToolSort' "
+		"DESC 'Memory in megabytes and temporary directory for sorting index keys in quick mode tools' "
+		"EQUALITY caseExactMatch "
+		"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "warmup", "on|off", 2, 2, 0, ARG_ON_OFF|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_warmup),
+		"( OLcfgDbAt:12.18 NAME 'olcDbWarmup' "
+		"DESC 'Read the DN and attribute indices into memory at startup' "
+		"EQUALITY booleanMatch "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "warmupentries", "on|off", 2, 2, 0, ARG_ON_OFF|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_warmup_entries),
+		"( OLcfgDbAt:12.27 NAME 'olcDbWarmupEntries' "
+		"DESC 'Warm up by reading the whole database file, entries included' "
+		"EQUALITY booleanMatch "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "warmupthreads", "num", 2, 2, 0, ARG_INT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_warmup_threads),
+		"( OLcfgDbAt:12.26 NAME 'olcDbWarmupThreads' "
+		"DESC 'Number of threads reading the database at warmup' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "warmupwait", "on|off", 2, 2, 0, ARG_ON_OFF|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_warmup_wait),
+		"( OLcfgDbAt:12.28 NAME 'olcDbWarmupWait' "
+		"DESC 'Finish the warmup before accepting clients at startup' "
+		"EQUALITY booleanMatch "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "pinbranches", "on|off", 2, 2, 0, ARG_ON_OFF|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_pinbranches),
+		"( OLcfgDbAt:12.19 NAME 'olcDbPinBranches' "
+		"DESC 'Lock the branch pages of the DN and equality indices in memory' "
+		"EQUALITY booleanMatch "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED,
 		NULL, NULL, NULL, NULL }
 };
@@ -137,7 +270,12 @@ static ConfigOCs mdbocs[] = {
 		"MAY ( olcDbCheckpoint $ olcDbEnvFlags $ "
 		"olcDbNoSync $ olcDbIndex $ olcDbMaxReaders $ olcDbMaxSize $ "
 		"olcDbMode $ olcDbSearchStack $ olcDbMaxEntrySize $ olcDbRtxnSize $ "
-		"olcDbMultival ) )",
+		"olcDbMultival $ olcDbDictionary $ olcDbIdlExact $ olcDbSearchThreads $ olcDbDNcacheSize $ "
+		"olcDbPagedCache $ olcDbIndexThreads $ olcDbIndexTxnSize $ "
+		"olcDbToolSort $ olcDbGroupCommit $ olcDbRtxnMaxAge $ "
+		"olcDbRtxnMaxPages $ olcDbPrefetch $ olcDbWarmup $ olcDbPinBranches $ olcDbCompress $ "
+		"olcDbCoalesce $ olcDbCoalesceTTL $ olcDbEntryCache $ olcDbSearchQuantum $ "
+		"olcDbWarmupThreads $ olcDbWarmupEntries $ olcDbWarmupWait ) )",
 			Cft_Database, mdbcfg+1 },
 	{ NULL, 0, NULL }
 };
@@ -148,6 +286,9 @@ static slap_verbmasks mdb_envflags[] = {
 	{ BER_BVC("writemap"),	MDB_WRITEMAP },
 	{ BER_BVC("mapasync"),	MDB_MAPASYNC },
 	{ BER_BVC("nordahead"),	MDB_NORDAHEAD },
+	{ BER_BVC("hugepages"),	MDB_HUGEPAGES },
+	{ BER_BVC("prefault"),	MDB_PREFAULT },
+	{ BER_BVC("interleave"),	MDB_INTERLEAVE },
 	{ BER_BVNULL, 0 }
 };
 
@@ -191,7 +332,198 @@ mdb_checkpoint( void *ctx, void *arg )
 	return NULL;
 }
 
-/* reindex entries on the fly */
+/* reindex entries on the fly
+ *
+ * Entries are reindexed in batches of indextxnsize, one write txn per
+ * batch so that other writers get their turn in between. The batch is
+ * cut into chunks which are decoded and turned into index keys by up
+ * to indexthreads threads, the extra ones reading in their own read
+ * txns, which see the same snapshot as the batch's write txn. All the
+ * keys of the batch are then written in key order.
+ */
+#define MDB_REINDEX_CHUNK	64
+
+typedef struct mdb_reindex {
+	ldap_pvt_thread_mutex_t ri_mutex;
+	ldap_pvt_thread_cond_t ri_cond;
+	BackendDB *ri_be;
+	int ri_refs;		/* the indexer, and each queued task */
+	int ri_tasks;		/* queued tasks */
+	int ri_busy;		/* chunks being reindexed */
+	int ri_claim;		/* next chunk of the batch */
+	int ri_nchunks;
+	int ri_maxchunks;
+	unsigned ri_gen;	/* batch number */
+	int ri_nids;
+	int ri_maxids;
+	ID *ri_ids;
+	mdb_ixkeys *ri_keys;	/* one per chunk */
+	int *ri_err;		/* one per chunk */
+} mdb_reindex;
+
+static void
+mdb_reindex_chunk( mdb_reindex *ri, Operation *op, MDB_txn *txn, int c )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_ixkeys *ik = &ri->ri_keys[c];
+	MDB_cursor *curs;
+	Entry *e;
+	int i, end, rc;
+
+	end = ( c + 1 ) * MDB_REINDEX_CHUNK;
+	if ( end > ri->ri_nids )
+		end = ri->ri_nids;
+
+	rc = mdb_cursor_open( txn, mdb->mi_id2entry, &curs );
+	if ( rc ) {
+		ri->ri_err[c] = rc;
+		return;
+	}
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &ik->ik_oe, oe_next );
+	for ( i = c * MDB_REINDEX_CHUNK; i < end; i++ ) {
+		rc = mdb_id2entry( op, curs, ri->ri_ids[i], &e );
+		if ( rc ) {
+			if ( rc == MDB_NOTFOUND )
+				continue;
+			break;
+		}
+		/* no txn, only collect the keys */
+		rc = mdb_index_entry( op, NULL, MDB_INDEX_UPDATE_OP, e );
+		mdb_entry_return( op, e );
+		if ( rc )
+			break;
+	}
+	LDAP_SLIST_REMOVE( &op->o_extra, &ik->ik_oe, OpExtra, oe_next );
+	mdb_cursor_close( curs );
+	ri->ri_err[c] = rc;
+}
+
+/* Reindex chunks of batch gen until none are left.
+ * Called and returns with ri_mutex held.
+ */
+static void
+mdb_reindex_work( mdb_reindex *ri, Operation *op, MDB_txn *txn, unsigned gen )
+{
+	int c;
+
+	while ( ri->ri_gen == gen && ri->ri_claim < ri->ri_nchunks ) {
+		c = ri->ri_claim++;
+		ri->ri_busy++;
+		ldap_pvt_thread_mutex_unlock( &ri->ri_mutex );
+
+		mdb_reindex_chunk( ri, op, txn, c );
+
+		ldap_pvt_thread_mutex_lock( &ri->ri_mutex );
+		if ( !--ri->ri_busy )
+			ldap_pvt_thread_cond_signal( &ri->ri_cond );
+	}
+}
+
+static void
+mdb_reindex_unref( mdb_reindex *ri )
+{
+	int i, refs = --ri->ri_refs;
+
+	ldap_pvt_thread_mutex_unlock( &ri->ri_mutex );
+	if ( !refs ) {
+		for ( i = 0; i < ri->ri_maxchunks; i++ )
+			mdb_ixkeys_free( &ri->ri_keys[i] );
+		ch_free( ri->ri_keys );
+		ch_free( ri->ri_err );
+		ch_free( ri->ri_ids );
+		ldap_pvt_thread_cond_destroy( &ri->ri_cond );
+		ldap_pvt_thread_mutex_destroy( &ri->ri_mutex );
+		ch_free( ri );
+	}
+}
+
+static void *
+mdb_reindex_task( void *ctx, void *arg )
+{
+	mdb_reindex *ri = arg;
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+	mdb_op_info opinfo = {{{0}}}, *moi = &opinfo;
+	struct mdb_info *mdb;
+
+	ldap_pvt_thread_mutex_lock( &ri->ri_mutex );
+	/* our read txn must see the snapshot of the batch being
+	 * reindexed, which stays uncommitted while chunks are left
+	 */
+	if ( ri->ri_claim < ri->ri_nchunks ) {
+		unsigned gen = ri->ri_gen;
+
+		connection_fake_init( &conn, &opbuf, ctx );
+		op = &opbuf.ob_op;
+		op->o_bd = ri->ri_be;
+		mdb = (struct mdb_info *) op->o_bd->be_private;
+
+		if ( mdb_opinfo_get( op, mdb, 1, &moi ) == 0 ) {
+			mdb_reindex_work( ri, op, moi->moi_txn, gen );
+			ldap_pvt_thread_mutex_unlock( &ri->ri_mutex );
+			mdb_txn_reset( moi->moi_txn );
+			LDAP_SLIST_REMOVE( &op->o_extra, &moi->moi_oe, OpExtra, oe_next );
+			ldap_pvt_thread_mutex_lock( &ri->ri_mutex );
+		}
+	}
+	ri->ri_tasks--;
+	mdb_reindex_unref( ri );
+	return NULL;
+}
+
+/* Reindex one batch of IDs in txn */
+static int
+mdb_reindex_batch( mdb_reindex *ri, Operation *op, MDB_txn *txn )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	int i, nchunks, rc = 0;
+
+	nchunks = ( ri->ri_nids + MDB_REINDEX_CHUNK - 1 ) / MDB_REINDEX_CHUNK;
+	if ( nchunks > ri->ri_maxchunks ) {
+		ri->ri_keys = ch_realloc( ri->ri_keys, nchunks * sizeof( mdb_ixkeys ));
+		memset( ri->ri_keys + ri->ri_maxchunks, 0,
+			( nchunks - ri->ri_maxchunks ) * sizeof( mdb_ixkeys ));
+		ri->ri_err = ch_realloc( ri->ri_err, nchunks * sizeof( int ));
+		ri->ri_maxchunks = nchunks;
+	}
+
+	ldap_pvt_thread_mutex_lock( &ri->ri_mutex );
+	ri->ri_gen++;
+	ri->ri_claim = 0;
+	ri->ri_nchunks = nchunks;
+	while ( ri->ri_tasks < mdb->mi_index_threads - 1 &&
+		ri->ri_tasks < nchunks - 1 ) {
+		ri->ri_refs++;
+		ri->ri_tasks++;
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+			mdb_reindex_task, ri )) {
+			ri->ri_refs--;
+			ri->ri_tasks--;
+			break;
+		}
+	}
+	/* work along with the tasks, whichever of them get to run */
+	mdb_reindex_work( ri, op, txn, ri->ri_gen );
+	while ( ri->ri_busy )
+		ldap_pvt_thread_cond_wait( &ri->ri_cond, &ri->ri_mutex );
+	ldap_pvt_thread_mutex_unlock( &ri->ri_mutex );
+
+	for ( i = 0; i < nchunks; i++ ) {
+		if ( ri->ri_err[i] ) {
+			rc = ri->ri_err[i];
+			break;
+		}
+	}
+	if ( rc == 0 ) {
+		rc = mdb_ixkeys_write( op, txn, ri->ri_keys, nchunks );
+	} else {
+		for ( i = 0; i < nchunks; i++ )
+			mdb_ixkeys_free( &ri->ri_keys[i] );
+	}
+	return rc;
+}
+
 static void *
 mdb_online_index( void *ctx, void *arg )
 {
@@ -206,9 +538,10 @@ mdb_online_index( void *ctx, void *arg )
 	MDB_cursor *curs;
 	MDB_val key, data;
 	MDB_txn *txn;
-	ID id;
-	Entry *e;
-	int rc, getnext = 1;
+	MDB_stat ms;
+	mdb_reindex *ri;
+	ID id = 1;
+	int rc, txnsize;
 	int i;
 
 	connection_fake_init( &conn, &opbuf, ctx );
@@ -216,7 +549,13 @@ mdb_online_index( void *ctx, void *arg )
 
 	op->o_bd = be;
 
-	id = 1;
+	ri = ch_calloc( 1, sizeof( mdb_reindex ));
+	ldap_pvt_thread_mutex_init( &ri->ri_mutex );
+	ldap_pvt_thread_cond_init( &ri->ri_cond );
+	ri->ri_be = be;
+	ri->ri_refs = 1;
+
+	mdb->mi_index_restart = 1;
 	key.mv_size = sizeof(ID);
 
 	while ( 1 ) {
@@ -231,39 +570,46 @@ mdb_online_index( void *ctx, void *arg )
 			mdb_txn_abort( txn );
 			break;
 		}
-		if ( getnext ) {
-			getnext = 0;
-			key.mv_data = &id;
-			rc = mdb_cursor_get( curs, &key, &data, MDB_SET_RANGE );
-			if ( rc ) {
-				mdb_txn_abort( txn );
-				if ( rc == MDB_NOTFOUND )
-					rc = 0;
+		if ( mdb->mi_index_restart ) {
+			/* new index settings, start over */
+			mdb->mi_index_restart = 0;
+			mdb_stat( txn, mdb->mi_id2entry, &ms );
+			mdb->mi_index_total = ms.ms_entries;
+			mdb->mi_index_done = 0;
+			id = 1;
+		}
+		txnsize = mdb->mi_index_txn_size ? mdb->mi_index_txn_size : 1;
+		if ( ri->ri_maxids < txnsize ) {
+			ri->ri_maxids = txnsize;
+			ri->ri_ids = ch_realloc( ri->ri_ids, txnsize * sizeof( ID ));
+		}
+		ri->ri_nids = 0;
+		key.mv_data = &id;
+		rc = mdb_cursor_get( curs, &key, &data, MDB_SET_RANGE );
+		while ( rc == 0 ) {
+			memcpy( &ri->ri_ids[ri->ri_nids], key.mv_data, sizeof( ID ));
+			if ( ++ri->ri_nids == txnsize )
 				break;
-			}
-			memcpy( &id, key.mv_data, sizeof( id ));
+			rc = mdb_cursor_get( curs, &key, &data, MDB_NEXT );
 		}
-
-		rc = mdb_id2entry( op, curs, id, &e );
 		mdb_cursor_close( curs );
-		if ( rc ) {
+		if ( rc && rc != MDB_NOTFOUND ) {
 			mdb_txn_abort( txn );
-			if ( rc == MDB_NOTFOUND ) {
-				id++;
-				getnext = 1;
-				continue;
-			}
 			break;
 		}
-		rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
-		mdb_entry_return( op, e );
+		if ( !ri->ri_nids ) {
+			mdb_txn_abort( txn );
+			rc = 0;
+			break;
+		}
+
+		rc = mdb_reindex_batch( ri, op, txn );
 		if ( rc == 0 ) {
 			rc = mdb_txn_commit( txn );
-			txn = NULL;
 		} else {
 			mdb_txn_abort( txn );
-			txn = NULL;
 		}
+		txn = NULL;
 		if ( rc ) {
 			Debug( LDAP_DEBUG_ANY,
 				LDAP_XSTRING(mdb_online_index) ": database %s: "
@@ -271,10 +617,18 @@ mdb_online_index( void *ctx, void *arg )
 				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
 			break;
 		}
-		id++;
-		getnext = 1;
+		mdb->mi_index_done += ri->ri_nids;
+		id = ri->ri_ids[ri->ri_nids - 1] + 1;
+
+		/* let config changes through */
+		ldap_pvt_thread_pool_pausecheck( &connection_pool );
 	}
 
+	ldap_pvt_thread_mutex_lock( &ri->ri_mutex );
+	ri->ri_nchunks = ri->ri_claim;
+	mdb_reindex_unref( ri );
+	mdb->mi_index_total = mdb->mi_index_done = 0;
+
 	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
 		if ( mdb->mi_attrs[ i ]->ai_indexmask & MDB_INDEX_DELETING
 			|| mdb->mi_attrs[ i ]->ai_newmask == 0 )
@@ -406,10 +760,59 @@ mdb_cf_gen( ConfigArgs *c )
 			c->value_ulong = mdb->mi_mapsize;
 			break;
 
+		case MDB_ECACHE:
+			c->value_ulong = mdb->mi_ecache_max / 1024;
+			break;
+
 		case MDB_MULTIVAL:
 			mdb_attr_multi_unparse( mdb, &c->rvalue_vals );
 			if ( !c->rvalue_vals ) rc = 1;
 			break;
+
+		case MDB_DICTIONARY:
+			mdb_attr_dict_unparse( mdb, &c->rvalue_vals );
+			if ( !c->rvalue_vals ) rc = 1;
+			break;
+
+		case MDB_PCACHE:
+			if ( mdb->mi_pcache_max ) {
+				char buf[64];
+				struct berval bv;
+				bv.bv_len = snprintf( buf, sizeof(buf), "%lu %u",
+					(unsigned long) mdb->mi_pcache_max / 1024,
+					mdb->mi_pcache_ttl );
+				if ( bv.bv_len > 0 && bv.bv_len < sizeof(buf) ) {
+					bv.bv_val = buf;
+					value_add_one( &c->rvalue_vals, &bv );
+				} else {
+					rc = 1;
+				}
+			} else {
+				rc = 1;
+			}
+			break;
+
+		case MDB_TOOLSORT:
+			if ( mdb->mi_tool_sort_size ) {
+				char buf[MAXPATHLEN + 64];
+				struct berval bv;
+				if ( mdb->mi_tool_sort_dir )
+					bv.bv_len = snprintf( buf, sizeof(buf), "%lu %s",
+						(unsigned long) mdb->mi_tool_sort_size / 1048576,
+						mdb->mi_tool_sort_dir );
+				else
+					bv.bv_len = snprintf( buf, sizeof(buf), "%lu",
+						(unsigned long) mdb->mi_tool_sort_size / 1048576 );
+				if ( bv.bv_len > 0 && bv.bv_len < sizeof(buf) ) {
+					bv.bv_val = buf;
+					value_add_one( &c->rvalue_vals, &bv );
+				} else {
+					rc = 1;
+				}
+			} else {
+				rc = 1;
+			}
+			break;
 		}
 		return rc;
 	} else if ( c->op == LDAP_MOD_DELETE ) {
@@ -441,6 +844,19 @@ mdb_cf_gen( ConfigArgs *c )
 			}
 			mdb->mi_txn_cp = 0;
 			break;
+		case MDB_PCACHE:
+			mdb->mi_pcache_max = 0;
+			mdb_pcache_flush( mdb );
+			break;
+		case MDB_ECACHE:
+			mdb->mi_ecache_max = 0;
+			mdb_ecache_flush( mdb );
+			break;
+		case MDB_TOOLSORT:
+			mdb->mi_tool_sort_size = 0;
+			ch_free( mdb->mi_tool_sort_dir );
+			mdb->mi_tool_sort_dir = NULL;
+			break;
 		case MDB_DIRECTORY:
 			mdb->mi_flags |= MDB_RE_OPEN;
 			ch_free( mdb->mi_dbenv_home );
@@ -598,6 +1014,47 @@ mdb_cf_gen( ConfigArgs *c )
 				}
 			}
 			break;
+		case MDB_DICTIONARY:
+			/* values already in the dictionary stay there, entries
+			 * are stored in full the next time they are written */
+			if ( c->valx == -1 ) {
+				int i;
+
+				for ( i = 0; i < mdb->mi_nattrs; i++ )
+					mdb->mi_attrs[i]->ai_dict = 0;
+			} else {
+				struct berval bv;
+				char **attrs;
+				char *ptr;
+				int i;
+
+				for (ptr = c->line; !isspace( (unsigned char) *ptr ); ptr++);
+				bv.bv_val = ch_malloc( ptr - c->line + 1 );
+				bv.bv_len = ptr - c->line;
+				AC_MEMCPY( bv.bv_val, c->line, bv.bv_len );
+				bv.bv_val[ bv.bv_len ] = '\0';
+				attrs = ldap_str2charray( bv.bv_val, "," );
+
+				for ( i = 0; attrs[ i ]; i++ ) {
+					AttributeDescription *ad = NULL;
+					const char *text;
+					AttrInfo *ai;
+
+					slap_str2ad( attrs[ i ], &ad, &text );
+					/* if we got here... */
+					assert( ad != NULL );
+
+					ai = mdb_attr_mask( mdb, ad );
+					/* if we got here... */
+					assert( ai != NULL );
+
+					ai->ai_dict = 0;
+				}
+
+				ldap_charray_free( attrs );
+				ch_free( bv.bv_val );
+			}
+			break;
 		}
 		return rc;
 	}
@@ -758,7 +1215,10 @@ mdb_cf_gen( ConfigArgs *c )
 		if ( mdb->mi_flags & MDB_IS_OPEN ) {
 			mdb->mi_flags |= MDB_OPEN_INDEX;
 			config_push_cleanup( c, mdb_cf_cleanup );
-			if ( !mdb->mi_index_task ) {
+			if ( mdb->mi_index_task ) {
+				/* a running reindex must cover the new settings */
+				mdb->mi_index_restart = 1;
+			} else {
 				/* Start the task as soon as we finish here. Set a long
 				 * interval (10 hours) so that it only gets scheduled once.
 				 */
@@ -803,12 +1263,72 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case MDB_ECACHE:
+		/* writes weren't tracked while it was off */
+		if ( !mdb->mi_ecache_max && ( mdb->mi_flags & MDB_IS_OPEN )) {
+			MDB_envinfo info;
+			mdb_env_info( mdb->mi_dbenv, &info );
+			ldap_pvt_thread_mutex_lock( &mdb->mi_ecache_mutex );
+			mdb->mi_ecache_wtxnid = info.me_last_txnid;
+			ldap_pvt_thread_mutex_unlock( &mdb->mi_ecache_mutex );
+		}
+		mdb->mi_ecache_max = c->value_ulong * 1024;
+		if ( !mdb->mi_ecache_max )
+			mdb_ecache_flush( mdb );
+		break;
+
 	case MDB_MULTIVAL:
 		rc = mdb_attr_multi_config( mdb, c->fname, c->lineno,
 			c->argc - 1, &c->argv[1], &c->reply);
 
 		if( rc != LDAP_SUCCESS ) return 1;
 		break;
+
+	case MDB_DICTIONARY:
+		rc = mdb_attr_dict_config( mdb, c->fname, c->lineno,
+			c->argc - 1, &c->argv[1], &c->reply);
+
+		if( rc != LDAP_SUCCESS ) return 1;
+		break;
+
+	case MDB_PCACHE: {
+		unsigned long kbyte;
+		unsigned sec;
+		if ( lutil_atoulx( &kbyte, c->argv[1], 0 ) != 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"invalid kbyte \"%s\" in \"pagedcache\"",
+				c->argv[1] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+			return 1;
+		}
+		if ( lutil_atoux( &sec, c->argv[2], 0 ) != 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"invalid seconds \"%s\" in \"pagedcache\"",
+				c->argv[2] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+			return 1;
+		}
+		mdb->mi_pcache_max = kbyte * 1024;
+		mdb->mi_pcache_ttl = sec;
+		if ( !mdb->mi_pcache_max )
+			mdb_pcache_flush( mdb );
+		} break;
+
+	case MDB_TOOLSORT: {
+		unsigned long mbyte;
+		if ( lutil_atoulx( &mbyte, c->argv[1], 0 ) != 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"invalid mbyte \"%s\" in \"toolsort\"",
+				c->argv[1] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+			return 1;
+		}
+		mdb->mi_tool_sort_size = mbyte * 1048576;
+		ch_free( mdb->mi_tool_sort_dir );
+		mdb->mi_tool_sort_dir = NULL;
+		if ( c->argc > 2 )
+			mdb->mi_tool_sort_dir = ch_strdup( c->argv[2] );
+		} break;
 	}
 	return 0;
 }
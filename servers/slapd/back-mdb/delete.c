@@ -58,8 +58,12 @@ mdb_delete( Operation *op, SlapReply *rs )
 		Debug( LDAP_DEBUG_TRACE,
 			LDAP_XSTRING(mdb_delete) ": txn_begin failed: "
 			"%s (%d)\n", mdb_strerror(rs->sr_err), rs->sr_err );
-		rs->sr_err = LDAP_OTHER;
-		rs->sr_text = "internal error";
+		if ( rs->sr_err == LDAP_BUSY ) {
+			rs->sr_text = "database is being compacted";
+		} else {
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "internal error";
+		}
 		goto return_results;
 	}
 	txn = moi->moi_txn;
@@ -358,6 +362,8 @@ mdb_delete( Operation *op, SlapReply *rs )
 			}
 			parent_is_leaf = 1;
 		}
+		/* not to be taken for a commit failure in a bulk txn */
+		rs->sr_err = 0;
 		mdb_entry_return( op, p );
 		p = NULL;
 	}
@@ -371,7 +377,7 @@ mdb_delete( Operation *op, SlapReply *rs )
 			txn = NULL;
 			goto return_results;
 		} else {
-			rs->sr_err = mdb_txn_commit( txn );
+			rs->sr_err = mdb_op_commit( op, moi );
 		}
 		txn = NULL;
 	}
@@ -75,6 +75,60 @@ mdb_dup_compare(
 	return strncmp( un->nrdn, cn->nrdn, nrlen );
 }
 
+/* Add NSUBS to the subtree counts of PID and all its superiors */
+int
+mdb_dn2id_upsub(
+	Operation	*op,
+	MDB_cursor	*mcp,
+	ID pid,
+	ID nsubs )
+{
+	MDB_val		key, data;
+	ID		nid, subs;
+	diskNode *d;
+	char *ptr;
+	int		rc, rlen;
+
+	key.mv_size = sizeof(ID);
+	key.mv_data = &nid;
+
+	nid = pid;
+	do {
+		/* Get parent's RDN */
+		rc = mdb_cursor_get( mcp, &key, &data, MDB_SET );
+		if ( !rc ) {
+			char *p2;
+			ptr = (char *)data.mv_data + data.mv_size - sizeof( ID );
+			memcpy( &nid, ptr, sizeof( ID ));
+			/* Get parent's node under grandparent */
+			d = data.mv_data;
+			rlen = ( d->nrdnlen[0] << 8 ) | d->nrdnlen[1];
+			p2 = op->o_tmpalloc( rlen + 2, op->o_tmpmemctx );
+			memcpy( p2, data.mv_data, rlen+2 );
+			*p2 ^= 0x80;
+			data.mv_data = p2;
+			rc = mdb_cursor_get( mcp, &key, &data, MDB_GET_BOTH );
+			op->o_tmpfree( p2, op->o_tmpmemctx );
+			if ( !rc ) {
+				/* Get parent's subtree count */
+				ptr = (char *)data.mv_data + data.mv_size - sizeof( ID );
+				memcpy( &subs, ptr, sizeof( ID ));
+				subs += nsubs;
+				p2 = op->o_tmpalloc( data.mv_size, op->o_tmpmemctx );
+				memcpy( p2, data.mv_data, data.mv_size - sizeof( ID ));
+				memcpy( p2+data.mv_size - sizeof( ID ), &subs, sizeof( ID ));
+				data.mv_data = p2;
+				rc = mdb_cursor_put( mcp, &key, &data, MDB_CURRENT );
+				op->o_tmpfree( p2, op->o_tmpmemctx );
+			}
+		}
+		if ( rc )
+			break;
+	} while ( nid );
+
+	return rc;
+}
+
 /* We add two elements to the DN2ID database - a data item under the parent's
  * entryID containing the child's RDN and entryID, and an item under the
  * child's entryID containing the parent's entryID.
@@ -157,42 +211,8 @@ mdb_dn2id_add(
 	op->o_tmpfree( d, op->o_tmpmemctx );
 
 	/* Add our subtree count to all superiors */
-	if ( rc == 0 && upsub && pid ) {
-		ID subs;
-		nid = pid;
-		do {
-			/* Get parent's RDN */
-			rc = mdb_cursor_get( mcp, &key, &data, MDB_SET );
-			if ( !rc ) {
-				char *p2;
-				ptr = (char *)data.mv_data + data.mv_size - sizeof( ID );
-				memcpy( &nid, ptr, sizeof( ID ));
-				/* Get parent's node under grandparent */
-				d = data.mv_data;
-				rlen = ( d->nrdnlen[0] << 8 ) | d->nrdnlen[1];
-				p2 = op->o_tmpalloc( rlen + 2, op->o_tmpmemctx );
-				memcpy( p2, data.mv_data, rlen+2 );
-				*p2 ^= 0x80;
-				data.mv_data = p2;
-				rc = mdb_cursor_get( mcp, &key, &data, MDB_GET_BOTH );
-				op->o_tmpfree( p2, op->o_tmpmemctx );
-				if ( !rc ) {
-					/* Get parent's subtree count */
-					ptr = (char *)data.mv_data + data.mv_size - sizeof( ID );
-					memcpy( &subs, ptr, sizeof( ID ));
-					subs += nsubs;
-					p2 = op->o_tmpalloc( data.mv_size, op->o_tmpmemctx );
-					memcpy( p2, data.mv_data, data.mv_size - sizeof( ID ));
-					memcpy( p2+data.mv_size - sizeof( ID ), &subs, sizeof( ID ));
-					data.mv_data = p2;
-					rc = mdb_cursor_put( mcp, &key, &data, MDB_CURRENT );
-					op->o_tmpfree( p2, op->o_tmpmemctx );
-				}
-			}
-			if ( rc )
-				break;
-		} while ( nid );
-	}
+	if ( rc == 0 && upsub && pid )
+		rc = mdb_dn2id_upsub( op, mcp, pid, nsubs );
 
 	Debug( LDAP_DEBUG_TRACE, "<= mdb_dn2id_add 0x%lx: %d\n", e->e_id, rc );
 
@@ -207,6 +227,7 @@ mdb_dn2id_delete(
 	ID id,
 	ID nsubs )
 {
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	ID nid;
 	char *ptr;
 	int rc;
@@ -214,6 +235,11 @@ mdb_dn2id_delete(
 	Debug( LDAP_DEBUG_TRACE, "=> mdb_dn2id_delete 0x%lx\n",
 		id );
 
+	/* cached lookups made before this txn commits are stale */
+	ldap_pvt_thread_mutex_lock( &mdb->mi_dncache_mutex );
+	mdb->mi_dncache_txnid = mdb_txn_id( mdb_cursor_txn( mc ));
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_dncache_mutex );
+
 	/* Delete our ID from the parent's list */
 	rc = mdb_cursor_del( mc, 0 );
 
@@ -280,6 +306,125 @@ mdb_dn2id_delete(
 	return rc;
 }
 
+/* Per-thread cache of DNs found by read-only lookups, so that the
+ * same few DNs, e.g. in a bind storm, don't walk dn2id every time.
+ * A slot remembers the txn it was filled in, and is only good for
+ * txns at least that new. It is also no good if a txn deleting or
+ * renaming an entry has committed since; such a txn records its
+ * txnid in mi_dncache_txnid before it commits.
+ */
+typedef struct dncache_slot {
+	struct berval ds_ndn;
+	struct berval ds_dn;	/* shares ds_ndn's buffer */
+	ber_len_t ds_size;	/* size of that buffer */
+	ID ds_id;
+	size_t ds_txnid;
+} dncache_slot;
+
+typedef struct dncache {
+	unsigned dc_size;
+	dncache_slot dc_slots[1];
+} dncache;
+
+#define DNCACHE_KEY(mdb)	((void *)&(mdb)->mi_dncache_txnid)
+
+static void
+mdb_dncache_free( void *key, void *data )
+{
+	dncache *dc = data;
+	unsigned i;
+
+	for ( i = 0; i < dc->dc_size; i++ )
+		ch_free( dc->dc_slots[i].ds_ndn.bv_val );
+	ch_free( dc );
+}
+
+/* free the caches of all threads, the pool must be paused */
+void
+mdb_dncache_purge( struct mdb_info *mdb )
+{
+	ldap_pvt_thread_pool_purgekey( DNCACHE_KEY( mdb ));
+}
+
+/* Find the slot for ndn in this thread's cache. Returns NULL if
+ * the cache can't be used for this lookup, otherwise *hit tells
+ * whether the slot holds a usable answer.
+ */
+static dncache_slot *
+mdb_dncache_get( Operation *op, struct mdb_info *mdb, MDB_txn *txn,
+	struct berval *ndn, size_t *txnid, int *hit )
+{
+	OpExtra *oex;
+	mdb_op_info *moi;
+	dncache *dc = NULL;
+	dncache_slot *ds;
+	size_t last;
+	unsigned h;
+	ber_len_t i;
+
+	if ( !op->o_threadctx )
+		return NULL;
+
+	/* only in our own read-only txn */
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == mdb ) break;
+	}
+	moi = (mdb_op_info *)oex;
+	if ( !moi || moi->moi_txn != txn || !( moi->moi_flag & MOI_READER ))
+		return NULL;
+
+	ldap_pvt_thread_pool_getkey( op->o_threadctx, DNCACHE_KEY( mdb ),
+		(void **)&dc, NULL );
+	if ( dc && dc->dc_size != mdb->mi_dncache_size ) {
+		ldap_pvt_thread_pool_setkey( op->o_threadctx, DNCACHE_KEY( mdb ),
+			NULL, 0, NULL, NULL );
+		mdb_dncache_free( NULL, dc );
+		dc = NULL;
+	}
+	if ( !dc ) {
+		dc = ch_calloc( 1, sizeof( dncache ) +
+			( mdb->mi_dncache_size - 1 ) * sizeof( dncache_slot ));
+		dc->dc_size = mdb->mi_dncache_size;
+		if ( ldap_pvt_thread_pool_setkey( op->o_threadctx, DNCACHE_KEY( mdb ),
+			dc, mdb_dncache_free, NULL, NULL )) {
+			ch_free( dc );
+			return NULL;
+		}
+	}
+
+	for ( i = 0, h = 0; i < ndn->bv_len; i++ )
+		h = h * 31 + (unsigned char)ndn->bv_val[i];
+	ds = &dc->dc_slots[h % dc->dc_size];
+
+	*txnid = mdb_txn_id( txn );
+	ldap_pvt_thread_mutex_lock( &mdb->mi_dncache_mutex );
+	last = mdb->mi_dncache_txnid;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_dncache_mutex );
+
+	*hit = ds->ds_ndn.bv_val && ds->ds_txnid >= last &&
+		ds->ds_txnid <= *txnid && bvmatch( &ds->ds_ndn, ndn );
+	return ds;
+}
+
+static void
+mdb_dncache_put( dncache_slot *ds, struct berval *ndn, struct berval *dn,
+	ID id, size_t txnid )
+{
+	ber_len_t len = ndn->bv_len + dn->bv_len + 2;
+
+	if ( ds->ds_size < len ) {
+		ds->ds_ndn.bv_val = ch_realloc( ds->ds_ndn.bv_val, len );
+		ds->ds_size = len;
+	}
+	ds->ds_ndn.bv_len = ndn->bv_len;
+	memcpy( ds->ds_ndn.bv_val, ndn->bv_val, ndn->bv_len + 1 );
+	ds->ds_dn.bv_len = dn->bv_len;
+	ds->ds_dn.bv_val = ds->ds_ndn.bv_val + ndn->bv_len + 1;
+	memcpy( ds->ds_dn.bv_val, dn->bv_val, dn->bv_len + 1 );
+	ds->ds_id = id;
+	ds->ds_txnid = txnid;
+}
+
 /* return last found ID in *id if no match
  * If mc is provided, it will be left pointing to the RDN's
  * record under the parent's ID. If nsubs is provided, return
@@ -306,9 +451,27 @@ mdb_dn2id(
 	char dn[SLAP_LDAPDN_MAXLEN];
 	ID pid, nid;
 	struct berval tmp;
+	dncache_slot *ds = NULL;
+	size_t txnid = 0;
+	int hit;
 
 	Debug( LDAP_DEBUG_TRACE, "=> mdb_dn2id(\"%s\")\n", in->bv_val ? in->bv_val : "" );
 
+	/* the cache knows nothing about cursors or subtree counts */
+	if ( mdb->mi_dncache_size && !mc && !nsubs && in->bv_len ) {
+		ds = mdb_dncache_get( op, mdb, txn, in, &txnid, &hit );
+		if ( ds && hit ) {
+			*id = ds->ds_id;
+			if ( matched )
+				ber_dupbv_x( matched, &ds->ds_dn, op->o_tmpmemctx );
+			if ( nmatched )
+				*nmatched = *in;
+			Debug( LDAP_DEBUG_TRACE, "<= mdb_dn2id: cached id=0x%lx\n",
+				ds->ds_id );
+			return 0;
+		}
+	}
+
 	if ( matched ) {
 		matched->bv_val = dn + sizeof(dn) - 1;
 		matched->bv_len = 0;
@@ -432,6 +595,8 @@ done:
 	} else {
 		Debug( LDAP_DEBUG_TRACE, "<= mdb_dn2id: got id=0x%lx\n",
 			nid );
+		if ( ds && matched && matched->bv_val )
+			mdb_dncache_put( ds, in, matched, nid, txnid );
 	}
 
 	return rc;
@@ -515,38 +680,55 @@ done:
 	return rc;
 }
 
+/* Return the number of immediate children of id. The parent's
+ * records are a dup set holding the parent itself and one record
+ * per child, and LMDB keeps the size of a dup set, so this does
+ * not depend on the number of children.
+ */
 int
-mdb_dn2id_children(
+mdb_dn2id_nkids(
 	Operation *op,
 	MDB_txn *txn,
-	Entry *e )
+	ID id,
+	size_t *nkids )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	MDB_dbi dbi = mdb->mi_dn2id;
 	MDB_val		key, data;
 	MDB_cursor	*cursor;
 	int		rc;
-	ID		id;
 
 	key.mv_size = sizeof(ID);
 	key.mv_data = &id;
-	id = e->e_id;
 
 	rc = mdb_cursor_open( txn, dbi, &cursor );
 	if ( rc ) return rc;
 
 	rc = mdb_cursor_get( cursor, &key, &data, MDB_SET );
 	if ( rc == 0 ) {
-		size_t dkids;
-		rc = mdb_cursor_count( cursor, &dkids );
-		if ( rc == 0 ) {
-			if ( dkids < 2 ) rc = MDB_NOTFOUND;
-		}
+		rc = mdb_cursor_count( cursor, nkids );
+		if ( rc == 0 && *nkids )
+			(*nkids)--;
 	}
 	mdb_cursor_close( cursor );
 	return rc;
 }
 
+int
+mdb_dn2id_children(
+	Operation *op,
+	MDB_txn *txn,
+	Entry *e )
+{
+	size_t		nkids;
+	int		rc;
+
+	rc = mdb_dn2id_nkids( op, txn, e->e_id, &nkids );
+	if ( rc == 0 && !nkids )
+		rc = MDB_NOTFOUND;
+	return rc;
+}
+
 int
 mdb_id2name(
 	Operation *op,
@@ -711,6 +893,29 @@ leave:
 
 /* See if base is a child of any of the scopes
  */
+/* The candidate and its parents in sctmp are outside every scope.
+ * Remember them, so that candidates below them stop right there.
+ */
+static void
+mdb_idscopes_miss( IdScopes *isc )
+{
+	ID2 id2;
+	int i;
+
+	if ( !isc->noscope )
+		return;
+	id2.mval.mv_data = NULL;
+	id2.mval.mv_size = 0;
+	id2.mid = isc->id;
+	if ( mdb_id2l_insert( isc->noscope, &id2 ) == -2 )
+		return;
+	for ( i = 1; i <= isc->sctmp[0].mid; i++ ) {
+		id2.mid = isc->sctmp[i].mid;
+		if ( mdb_id2l_insert( isc->noscope, &id2 ) == -2 )
+			break;
+	}
+}
+
 int
 mdb_idscopes(
 	Operation *op,
@@ -797,7 +1002,14 @@ mdb_idscopes(
 		}
 		if ( op->ors_scope == LDAP_SCOPE_ONELEVEL )
 			break;
+		if ( !rc && isc->noscope ) {
+			x = mdb_id2l_search( isc->noscope, id );
+			if ( x <= isc->noscope[0].mid && isc->noscope[x].mid == id )
+				break;
+		}
 	}
+	if ( !rc )
+		mdb_idscopes_miss( isc );
 	return MDB_SUCCESS;
 }
 
@@ -25,6 +25,16 @@
 #include <component.h>
 #endif
 
+/* An AND stops reading indexes once its candidates are down to
+ * this many; testing them is cheaper than further index reads.
+ */
+#define AND_CANDIDATE_CUTOFF	8
+
+/* A substring filter stops reading keys once the next one has this
+ * many times more IDs than the candidates left.
+ */
+#define SUBSTR_CANDIDATE_RATIO	64
+
 static int presence_candidates(
 	Operation *op,
 	MDB_txn *rtxn,
@@ -97,6 +107,163 @@ ava_comp_candidates (
 		ID *stack);
 #endif
 
+/* Record a leaf lookup and its yield in the op's slow-log profile */
+static void
+mdb_filter_profile(
+	Operation *op,
+	Filter	*f,
+	ID *ids )
+{
+	AttributeDescription *ad;
+	const char *type;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_PRESENT:
+		type = "pres";
+		ad = f->f_desc;
+		break;
+	case LDAP_FILTER_EQUALITY:
+		type = "eq";
+		ad = f->f_av_desc;
+		break;
+	case LDAP_FILTER_APPROX:
+		type = "approx";
+		ad = f->f_av_desc;
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		type = "sub";
+		ad = f->f_sub_desc;
+		break;
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		ad = f->f_av_desc;
+		if ( ad->ad_type->sat_ordering &&
+			( ad->ad_type->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX ) )
+			type = f->f_choice == LDAP_FILTER_GE ? "ge" : "le";
+		else
+			type = f->f_choice == LDAP_FILTER_GE ? "ge/pres" : "le/pres";
+		break;
+	case LDAP_FILTER_EXT:
+		type = "ext";
+		ad = f->f_mr_desc;
+		break;
+	default:
+		return;
+	}
+
+	if ( MDB_IDL_IS_RANGE( ids ) ) {
+		slap_op_profile_plan( op, "%s(%s)=range:%lu", type,
+			ad ? ad->ad_cname.bv_val : "",
+			(unsigned long) ( MDB_IDL_LAST( ids ) - MDB_IDL_FIRST( ids ) + 1 ) );
+	} else {
+		slap_op_profile_plan( op, "%s(%s)=%lu", type,
+			ad ? ad->ad_cname.bv_val : "", (unsigned long) ids[0] );
+	}
+}
+
+/*
+ * The index type a leaf filter looks up, as an AttrInfo.ai_stats slot,
+ * or -1 if it looks up none. *aip is set to the attribute's AttrInfo
+ * if it has that index, else to NULL.
+ */
+int
+mdb_filter_index(
+	Backend *be,
+	Filter *f,
+	AttrInfo **aip )
+{
+	AttributeDescription *ad;
+	AttrInfo *ai;
+	struct berval atname;
+	slap_mask_t type;
+	int slot;
+
+	*aip = NULL;
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED )
+		return -1;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		slot = MDB_IDXSTAT_PRES;
+		break;
+	case LDAP_FILTER_EQUALITY:
+		ad = f->f_av_desc;
+		slot = MDB_IDXSTAT_EQ;
+		break;
+	case LDAP_FILTER_APPROX:
+		ad = f->f_av_desc;
+		/* the equality index stands in, see mdb_index_param() */
+		slot = ad->ad_type->sat_approx ? MDB_IDXSTAT_APPROX : MDB_IDXSTAT_EQ;
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		slot = MDB_IDXSTAT_SUB;
+		break;
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		ad = f->f_av_desc;
+		if ( ad->ad_type->sat_ordering &&
+			( ad->ad_type->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX ) )
+			slot = MDB_IDXSTAT_EQ;
+		else
+			slot = MDB_IDXSTAT_PRES;
+		break;
+	default:
+		return -1;
+	}
+
+	switch ( slot ) {
+	case MDB_IDXSTAT_PRES:	type = SLAP_INDEX_PRESENT; break;
+	case MDB_IDXSTAT_EQ:	type = SLAP_INDEX_EQUALITY; break;
+	case MDB_IDXSTAT_APPROX:	type = SLAP_INDEX_APPROX; break;
+	default:		type = SLAP_INDEX_SUBSTR; break;
+	}
+
+	ai = mdb_index_mask( be, ad, &atname );
+	if ( ai && IS_SLAP_INDEX( ai->ai_indexmask, type ))
+		*aip = ai;
+	return slot;
+}
+
+static void
+mdb_idxstat_add( unsigned long *p, unsigned long n )
+{
+#ifdef __GNUC__
+	__atomic_fetch_add( p, n, __ATOMIC_RELAXED );
+#else
+	*p += n;
+#endif
+}
+
+/* Count a leaf's index lookup in its index's usage */
+static void
+mdb_filter_idxstat(
+	Operation *op,
+	Filter	*f,
+	ID *ids,
+	struct timeval *start )
+{
+	AttrInfo *ai;
+	mdb_idxstat *is;
+	int slot;
+
+	slot = mdb_filter_index( op->o_bd, f, &ai );
+	if ( slot < 0 || ai == NULL )
+		return;
+
+	is = &ai->ai_stats[ slot ];
+	mdb_idxstat_add( &is->is_lookups, 1 );
+	if ( MDB_IDL_IS_RANGE( ids ) ) {
+		mdb_idxstat_add( &is->is_ranges, 1 );
+		mdb_idxstat_add( &is->is_ids,
+			MDB_IDL_LAST( ids ) - MDB_IDL_FIRST( ids ) + 1 );
+	} else {
+		mdb_idxstat_add( &is->is_ids, ids[0] );
+	}
+	mdb_idxstat_add( &is->is_usec, slap_histo_since( start ));
+}
+
 int
 mdb_filter_candidates(
 	Operation *op,
@@ -106,12 +273,17 @@ mdb_filter_candidates(
 	ID *tmp,
 	ID *stack )
 {
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	int rc = 0;
+	struct timeval start = { 0, 0 };
 #ifdef LDAP_COMP_MATCH
 	AttributeAliasing *aa;
 #endif
 	Debug( LDAP_DEBUG_FILTER, "=> mdb_filter_candidates\n" );
 
+	if ( mdb->mi_monitor.mdm_cb )
+		gettimeofday( &start, NULL );
+
 	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
 		MDB_IDL_ZERO( ids );
 		goto out;
@@ -212,7 +384,6 @@ mdb_filter_candidates(
 		MDB_IDL_ALL( ids );
 	}
 	if ( ids[2] == NOID && MDB_IDL_IS_RANGE( ids )) {
-		struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 		ID last;
 
 		if ( mdb->mi_nextid ) {
@@ -243,6 +414,12 @@ out:
 		(long) ids[0],
 		(long) MDB_IDL_FIRST( ids ),
 		(long) MDB_IDL_LAST( ids ) );
+	if ( start.tv_sec )
+		mdb_filter_idxstat( op, f, ids, &start );
+	if ( op->o_profile )
+		mdb_filter_profile( op, f, ids );
+	SLAP_PROBE4( mdb__candidates, op->o_connid, op->o_opid,
+		f->f_choice, (long) ids[0] );
 
 	return rc;
 }
@@ -558,6 +735,163 @@ base:
 	return 0;
 }
 
+/* Estimate how many IDs a filter component will yield, from the
+ * index key counts. NOID if there's no cheap estimate.
+ */
+static ID
+estimate_candidates(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter *f )
+{
+	AttributeDescription *desc;
+	MDB_dbi dbi;
+	slap_mask_t mask;
+	struct berval prefix = {0, NULL};
+	struct berval *keys = NULL;
+	MatchingRule *mr;
+	ID n, est = NOID;
+	int i, rc;
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		return f->f_result == LDAP_SUCCESS ? NOID : 0;
+	case LDAP_FILTER_PRESENT:
+		desc = f->f_desc;
+		if ( desc == slap_schema.si_ad_objectClass )
+			return NOID;
+		break;
+	case LDAP_FILTER_EQUALITY:
+		desc = f->f_ava->aa_desc;
+		if ( desc == slap_schema.si_ad_entryDN )
+			return 1;
+#ifdef LDAP_COMP_MATCH
+		if ( is_aliased_attribute && is_aliased_attribute( desc ))
+			return NOID;
+#endif
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		desc = f->f_sub_desc;
+		break;
+	default:
+		return NOID;
+	}
+
+	rc = mdb_index_param( op->o_bd, desc, f->f_choice,
+		&dbi, &mask, &prefix );
+	if ( rc != LDAP_SUCCESS || prefix.bv_val == NULL )
+		return NOID;
+
+	if ( f->f_choice == LDAP_FILTER_PRESENT ) {
+		if ( mdb_key_count( op->o_bd, rtxn, dbi, &prefix, &n ) == 0 )
+			est = n;
+		return est;
+	}
+
+	if ( f->f_choice == LDAP_FILTER_SUBSTRINGS ) {
+		mr = desc->ad_type->sat_substr;
+		if ( !mr || !mr->smr_filter )
+			return NOID;
+		rc = (mr->smr_filter)( LDAP_FILTER_SUBSTRINGS, mask,
+			desc->ad_type->sat_syntax, mr, &prefix,
+			f->f_sub, &keys, op->o_tmpmemctx );
+	} else {
+		mr = desc->ad_type->sat_equality;
+		if ( !mr || !mr->smr_filter )
+			return NOID;
+		rc = (mr->smr_filter)( LDAP_FILTER_EQUALITY, mask,
+			desc->ad_type->sat_syntax, mr, &prefix,
+			&f->f_ava->aa_value, &keys, op->o_tmpmemctx );
+	}
+	if ( rc != LDAP_SUCCESS || keys == NULL )
+		return NOID;
+
+	/* the keys are intersected, the smallest one bounds them all */
+	for ( i = 0; keys[i].bv_val != NULL; i++ ) {
+		if ( mdb_key_count( op->o_bd, rtxn, dbi, &keys[i], &n ) == 0 &&
+			n < est )
+			est = n;
+	}
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	return est;
+}
+
+typedef struct exact_src {
+	MDB_dbi es_dbi;
+	size_t es_count;
+	struct berval es_key;
+} exact_src;
+
+/* An AND component came back as a range. If its one index key
+ * keeps exact IDs (idlexact), remember the key so the AND can be
+ * resolved against those instead.
+ */
+static int
+exact_source(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter *f,
+	exact_src *es )
+{
+	AttributeDescription *desc;
+	slap_mask_t mask;
+	struct berval prefix = {0, NULL};
+	struct berval *keys = NULL;
+	MatchingRule *mr;
+	int rc;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_PRESENT:
+		desc = f->f_desc;
+		if ( desc == slap_schema.si_ad_objectClass )
+			return -1;
+		break;
+	case LDAP_FILTER_EQUALITY:
+		desc = f->f_ava->aa_desc;
+		if ( desc == slap_schema.si_ad_entryDN )
+			return -1;
+#ifdef LDAP_COMP_MATCH
+		if ( is_aliased_attribute && is_aliased_attribute( desc ))
+			return -1;
+#endif
+		break;
+	default:
+		return -1;
+	}
+
+	rc = mdb_index_param( op->o_bd, desc, f->f_choice,
+		&es->es_dbi, &mask, &prefix );
+	if ( rc != LDAP_SUCCESS || prefix.bv_val == NULL )
+		return -1;
+
+	if ( f->f_choice == LDAP_FILTER_PRESENT ) {
+		ber_dupbv_x( &es->es_key, &prefix, op->o_tmpmemctx );
+	} else {
+		mr = desc->ad_type->sat_equality;
+		if ( !mr || !mr->smr_filter )
+			return -1;
+		rc = (mr->smr_filter)( LDAP_FILTER_EQUALITY, mask,
+			desc->ad_type->sat_syntax, mr, &prefix,
+			&f->f_ava->aa_value, &keys, op->o_tmpmemctx );
+		if ( rc != LDAP_SUCCESS || keys == NULL )
+			return -1;
+		/* multiple keys were intersected already */
+		if ( BER_BVISNULL( &keys[0] ) || !BER_BVISNULL( &keys[1] )) {
+			ber_bvarray_free_x( keys, op->o_tmpmemctx );
+			return -1;
+		}
+		es->es_key = keys[0];
+		op->o_tmpfree( keys, op->o_tmpmemctx );
+	}
+
+	rc = mdb_idl_exact_count( rtxn, es->es_dbi, &es->es_key, &es->es_count );
+	if ( rc ) {
+		op->o_tmpfree( es->es_key.bv_val, op->o_tmpmemctx );
+		return -1;
+	}
+	return 0;
+}
+
 static int
 list_candidates(
 	Operation *op,
@@ -569,10 +903,37 @@ list_candidates(
 	ID *save )
 {
 	int rc = 0;
-	Filter	*f;
+	Filter	*f, **plan = NULL;
+	ID *cost;
+	exact_src es[MDB_IDL_EXACT_MAX];
+	int i, j, nplan = 0, nes = 0, first = 1;
 
 	Debug( LDAP_DEBUG_FILTER, "=> mdb_list_candidates 0x%x\n", ftype );
-	for ( f = flist; f != NULL; f = f->f_next ) {
+
+	/* Evaluate the components of an AND in order of their
+	 * estimated size, so the cheap selective ones go first.
+	 */
+	if ( ftype == LDAP_FILTER_AND ) {
+		for ( f = flist; f != NULL; f = f->f_next )
+			nplan++;
+	}
+	if ( nplan > 1 ) {
+		cost = op->o_tmpalloc( nplan * ( sizeof(ID) + sizeof(Filter *) ),
+			op->o_tmpmemctx );
+		plan = (Filter **)( cost + nplan );
+		for ( j = 0, f = flist; f != NULL; f = f->f_next, j++ ) {
+			ID c = estimate_candidates( op, rtxn, f );
+			for ( i = j; i > 0 && cost[i-1] > c; i-- ) {
+				cost[i] = cost[i-1];
+				plan[i] = plan[i-1];
+			}
+			cost[i] = c;
+			plan[i] = f;
+		}
+	}
+
+	for ( j = 1, f = plan ? plan[0] : flist; f != NULL;
+		f = plan ? ( j < nplan ? plan[j++] : NULL ) : f->f_next ) {
 		/* ignore precomputed scopes */
 		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
 		     f->f_result == LDAP_SUCCESS ) {
@@ -592,13 +953,25 @@ list_candidates(
 
 		
 		if ( ftype == LDAP_FILTER_AND ) {
-			if ( f == flist ) {
+			if ( MDB_IDL_IS_RANGE( save ) && nes < MDB_IDL_EXACT_MAX &&
+				exact_source( op, rtxn, f, &es[nes] ) == 0 ) {
+				/* keep them sorted by size, smallest first */
+				exact_src e = es[nes];
+				for ( i = nes++; i > 0 && es[i-1].es_count > e.es_count; i-- )
+					es[i] = es[i-1];
+				es[i] = e;
+			}
+			if ( first ) {
 				MDB_IDL_CPY( ids, save );
+				first = 0;
 			} else {
 				mdb_idl_intersection( ids, save );
 			}
 			if( MDB_IDL_IS_ZERO( ids ) )
 				break;
+			if ( plan && !MDB_IDL_IS_RANGE( ids ) &&
+				ids[0] <= AND_CANDIDATE_CUTOFF )
+				break;
 		} else {
 			if ( f == flist ) {
 				MDB_IDL_CPY( ids, save );
@@ -608,6 +981,28 @@ list_candidates(
 		}
 	}
 
+	if ( nes ) {
+		if ( rc == LDAP_SUCCESS && !MDB_IDL_IS_ZERO( ids )) {
+			if ( MDB_IDL_IS_RANGE( ids )) {
+				MDB_dbi dbis[MDB_IDL_EXACT_MAX];
+				struct berval keys[MDB_IDL_EXACT_MAX];
+				for ( i = 0; i < nes; i++ ) {
+					dbis[i] = es[i].es_dbi;
+					keys[i] = es[i].es_key;
+				}
+				mdb_idl_exact_join( rtxn, dbis, keys, nes, ids, save );
+			} else {
+				for ( i = 0; i < nes && !MDB_IDL_IS_ZERO( ids ); i++ )
+					mdb_idl_exact_probe( rtxn, es[i].es_dbi,
+						&es[i].es_key, ids );
+			}
+		}
+		for ( i = 0; i < nes; i++ )
+			op->o_tmpfree( es[i].es_key.bv_val, op->o_tmpmemctx );
+	}
+	if ( plan )
+		op->o_tmpfree( cost, op->o_tmpmemctx );
+
 	if( rc == LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_FILTER,
 			"<= mdb_list_candidates: id=%ld first=%ld last=%ld\n",
@@ -953,12 +1348,14 @@ substring_candidates(
 	ID *tmp )
 {
 	MDB_dbi	dbi;
-	int i;
+	int i, j, nkeys;
 	int rc;
 	slap_mask_t mask;
 	struct berval prefix = {0, NULL};
 	struct berval *keys = NULL;
 	MatchingRule *mr;
+	ID *cost = NULL;
+	int *order = NULL;
 
 	Debug( LDAP_DEBUG_TRACE, "=> mdb_substring_candidates (%s)\n",
 			sub->sa_desc->ad_cname.bv_val );
@@ -1017,7 +1414,50 @@ substring_candidates(
 		return 0;
 	}
 
-	for ( i= 0; keys[i].bv_val != NULL; i++ ) {
+	for ( nkeys = 0; keys[nkeys].bv_val != NULL; nkeys++ )
+		;
+
+	/* Read the rarest keys first. Equal keys sort next to each
+	 * other, and only the first of them is read.
+	 */
+	if ( nkeys > 1 ) {
+		cost = op->o_tmpalloc( nkeys * ( sizeof(ID) + sizeof(int) ),
+			op->o_tmpmemctx );
+		order = (int *)( cost + nkeys );
+		for ( j = 0; j < nkeys; j++ ) {
+			ID c;
+			if ( mdb_key_count( op->o_bd, rtxn, dbi, &keys[j], &c ))
+				c = NOID;
+			if ( c == 0 ) {
+				MDB_IDL_ZERO( ids );
+				goto done;
+			}
+			for ( i = j; i > 0 && ( cost[i-1] > c || ( cost[i-1] == c &&
+				ber_bvcmp( &keys[order[i-1]], &keys[j] ) > 0 )); i-- ) {
+				cost[i] = cost[i-1];
+				order[i] = order[i-1];
+			}
+			cost[i] = c;
+			order[i] = j;
+		}
+	}
+
+	for ( j = 0; j < nkeys; j++ ) {
+		i = order ? order[j] : j;
+		if ( j > 0 && order ) {
+			if ( cost[j] == cost[j-1] &&
+				bvmatch( &keys[i], &keys[order[j-1]] ))
+				continue;
+			/* few enough candidates left that testing them is
+			 * cheaper than reading the remaining keys
+			 */
+			if ( !MDB_IDL_IS_RANGE( ids ) &&
+				( ids[0] <= AND_CANDIDATE_CUTOFF ||
+				( cost[j] != NOID &&
+				cost[j] / SUBSTR_CANDIDATE_RATIO > ids[0] )))
+				break;
+		}
+
 		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0 );
 
 		if( rc == MDB_NOTFOUND ) {
@@ -1040,7 +1480,7 @@ substring_candidates(
 			break;
 		}
 
-		if ( i == 0 ) {
+		if ( j == 0 ) {
 			MDB_IDL_CPY( ids, tmp );
 		} else {
 			mdb_idl_intersection( ids, tmp );
@@ -1050,6 +1490,9 @@ substring_candidates(
 			break;
 	}
 
+done:
+	if ( cost )
+		op->o_tmpfree( cost, op->o_tmpmemctx );
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
 
 	Debug( LDAP_DEBUG_TRACE, "<= mdb_substring_candidates: %ld, first=%ld, last=%ld\n",
@@ -1059,6 +1502,65 @@ substring_candidates(
 	return( rc );
 }
 
+/* With a range index, only the equality keys sharing the bucket of
+ * the asserted key are walked, the buckets beyond it are read whole.
+ */
+static int
+inequality_range_candidates(
+	Operation *op,
+	MDB_txn *rtxn,
+	MDB_dbi dbi,
+	struct berval *key,
+	ID *ids,
+	ID *tmp,
+	int gtorlt )
+{
+	char edge[MDB_RANGE_KEYMAX], lbuf[MDB_RANGE_KEYMAX], hbuf[MDB_RANGE_KEYMAX];
+	struct berval bv, lo, hi;
+	unsigned char *p;
+	ber_len_t blen = key->bv_len - MDB_RANGE_SHIFT;
+	ID limit = 0;
+	int i, rc;
+
+	if ( op->ors_limit && op->ors_limit->lms_s_unchecked != -1 )
+		limit = op->ors_limit->lms_s_unchecked;
+
+	/* the equality keys from the asserted one to the edge of its bucket */
+	memcpy( edge, key->bv_val, blen );
+	memset( edge + blen, gtorlt == LDAP_FILTER_GE ? 0xff : 0, MDB_RANGE_SHIFT );
+	bv.bv_val = edge;
+	bv.bv_len = key->bv_len;
+	if ( gtorlt == LDAP_FILTER_GE )
+		rc = mdb_key_range( op->o_bd, rtxn, dbi, key, &bv, ids, tmp, limit );
+	else
+		rc = mdb_key_range( op->o_bd, rtxn, dbi, &bv, key, ids, tmp, limit );
+	if ( rc || ( limit && MDB_IDL_N( ids ) >= limit ))
+		return rc;
+
+	/* the buckets from the next one to the first or last one there is */
+	mdb_range_key( key, lbuf, &lo );
+	memset( edge, gtorlt == LDAP_FILTER_GE ? 0xff : 0, key->bv_len );
+	mdb_range_key( &bv, hbuf, &hi );
+	/* step past the asserted bucket, there may be none beyond it */
+	p = (unsigned char *)lo.bv_val;
+	for ( i = MDB_RANGE_PREFIXLEN + blen - 1; i >= (int)MDB_RANGE_PREFIXLEN; i-- ) {
+		if ( gtorlt == LDAP_FILTER_GE ) {
+			if ( ++p[i] != 0 )
+				break;
+		} else {
+			if ( p[i]-- != 0 )
+				break;
+		}
+	}
+	if ( i < (int)MDB_RANGE_PREFIXLEN )
+		return 0;
+
+	if ( gtorlt == LDAP_FILTER_GE )
+		return mdb_key_range( op->o_bd, rtxn, dbi, &lo, &hi, ids, tmp, limit );
+	else
+		return mdb_key_range( op->o_bd, rtxn, dbi, &hi, &lo, ids, tmp, limit );
+}
+
 static int
 inequality_candidates(
 	Operation *op,
@@ -1133,6 +1635,18 @@ inequality_candidates(
 	}
 
 	MDB_IDL_ZERO( ids );
+	if ( IS_SLAP_INDEX( mask, SLAP_INDEX_RANGE ) &&
+		MDB_RANGE_KEYOK( &keys[0] ))
+	{
+		rc = inequality_range_candidates( op, rtxn, dbi, &keys[0],
+			ids, tmp, gtorlt );
+		if ( rc != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_TRACE,
+			       "<= mdb_inequality_candidates: (%s) "
+			       "range read failed (%d)\n",
+			       ava->aa_desc->ad_cname.bv_val, rc );
+		}
+	} else
 	while(1) {
 		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[0], tmp, &cursor, gtorlt );
 
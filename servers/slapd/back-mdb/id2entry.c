@@ -20,7 +20,12 @@
 #include <ac/string.h>
 #include <ac/errno.h>
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include "back-mdb.h"
+#include "idl.h"
 
 typedef struct Ecount {
 	ber_len_t len;	/* total entry size */
@@ -29,13 +34,18 @@ typedef struct Ecount {
 	int nvals;
 	int offset;
 	Attribute *multi;
+	unsigned *dict;	/* per attr, 0 or numvals and the dictionary codes */
 } Ecount;
 
-static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
-	Ecount *eh);
+static int mdb_entry_partsize(Operation *op, MDB_txn *txn, Entry *e,
+	Ecount *eh, int create);
 static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data,
 	Ecount *ec);
-static Entry *mdb_entry_alloc( Operation *op, int nattrs, int nvals );
+static int mdb_entry_deflate(Operation *op, Entry *e, MDB_val *data,
+	Ecount *ec);
+static Entry *mdb_entry_alloc( Operation *op, int nattrs, int nvals,
+	ber_len_t extra );
+static void mdb_ecache_drop( struct mdb_info *mdb, MDB_txn *txn, ID id );
 
 #define ID2VKSZ	(sizeof(ID)+2)
 
@@ -262,6 +272,34 @@ static int mdb_mval_get(Operation *op, MDB_cursor *mc, ID id, Attribute *a, int
 
 #define ADD_FLAGS	(MDB_NOOVERWRITE|MDB_APPEND)
 
+/* The alias database holds the ID of every alias entry, so that
+ * searches dereferencing aliases can find them without an index,
+ * and skip the whole thing when there are none.
+ */
+static int mdb_alias_set(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	Entry *e,
+	int adding )
+{
+	MDB_val key, data = { 0, NULL };
+	int rc = 0;
+
+	if ( !mdb->mi_alias )
+		return 0;
+
+	key.mv_data = &e->e_id;
+	key.mv_size = sizeof(ID);
+	if ( is_entry_alias( e )) {
+		rc = mdb_put( txn, mdb->mi_alias, &key, &data, 0 );
+	} else if ( !adding ) {
+		rc = mdb_del( txn, mdb->mi_alias, &key, NULL );
+		if ( rc == MDB_NOTFOUND )
+			rc = 0;
+	}
+	return rc;
+}
+
 static int mdb_id2entry_put(
 	Operation *op,
 	MDB_txn *txn,
@@ -271,22 +309,21 @@ static int mdb_id2entry_put(
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	Ecount ec;
-	MDB_val key, data;
+	MDB_val key, data, zdata = { 0, NULL };
 	int rc, adding = flag, prev_ads = mdb->mi_numads;
 
 	/* We only store rdns, and they go in the dn2id database. */
 
 	key.mv_data = &e->e_id;
 	key.mv_size = sizeof(ID);
+	mdb_ecache_drop( mdb, txn, e->e_id );
 
-	rc = mdb_entry_partsize( mdb, txn, e, &ec );
+	rc = mdb_entry_partsize( op, txn, e, &ec, 1 );
 	if (rc) {
 		rc = LDAP_OTHER;
 		goto fail;
 	}
 
-	flag |= MDB_RESERVE;
-
 	if (e->e_id < mdb->mi_nextid)
 		flag &= ~MDB_APPEND;
 
@@ -295,16 +332,34 @@ static int mdb_id2entry_put(
 		goto fail;
 	}
 
+	/* Big entries are encoded and compressed up front, small ones
+	 * are encoded straight into the reserved space.
+	 */
+	if (mdb->mi_compress && ec.dlen >= mdb->mi_compress) {
+		rc = mdb_entry_deflate( op, e, &zdata, &ec );
+		if( rc != LDAP_SUCCESS )
+			goto fail;
+	} else {
+		flag |= MDB_RESERVE;
+	}
+
 again:
-	data.mv_size = ec.dlen;
-	if ( mc )
-		rc = mdb_cursor_put( mc, &key, &data, flag );
+	if ( zdata.mv_data )
+		data = zdata;
 	else
+		data.mv_size = ec.dlen;
+	if ( mc ) {
+		/* slapadd's cursor is still on the previous entry */
+		size_t one = 1;
+		rc = mdb_cursor_put_multiple( mc, &key, &data, &one, flag );
+	} else
 		rc = mdb_put( txn, mdb->mi_id2entry, &key, &data, flag );
 	if (rc == MDB_SUCCESS) {
-		rc = mdb_entry_encode( op, e, &data, &ec );
-		if( rc != LDAP_SUCCESS )
-			goto fail;
+		if ( !zdata.mv_data ) {
+			rc = mdb_entry_encode( op, e, &data, &ec );
+			if( rc != LDAP_SUCCESS )
+				goto fail;
+		}
 		/* Handle adds of large multi-valued attrs here.
 		 * Modifies handle them directly.
 		 */
@@ -331,6 +386,15 @@ again:
 				goto fail;
 			}
 		}
+		rc = mdb_alias_set( mdb, txn, e, adding );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				"mdb_id2entry_put: mdb_alias_set failed: %s(%d) \"%s\"\n",
+				mdb_strerror(rc), rc,
+				e->e_nname.bv_val );
+			rc = LDAP_OTHER;
+			goto fail;
+		}
 	}
 	if (rc) {
 		/* Was there a hole from slapadd? */
@@ -346,6 +410,10 @@ again:
 			rc = LDAP_OTHER;
 	}
 fail:
+	if ( zdata.mv_data )
+		op->o_tmpfree( zdata.mv_data, op->o_tmpmemctx );
+	if ( ec.dict )
+		op->o_tmpfree( ec.dict, op->o_tmpmemctx );
 	if (rc) {
 		mdb_ad_unwind( mdb, prev_ads );
 	}
@@ -393,13 +461,235 @@ int mdb_id2edata(
 	return rc;
 }
 
+/* The entry cache keeps read-only copies of entries that readers
+ * fetch by ID, mostly the bind, compare and ACL lookups of a few
+ * hot entries. A copy made in a read txn is shared by the readers
+ * of mi_ecache_wtxnid or later, until a write txn changes the entry
+ * and drops it. A reader that can't see every write txn that has
+ * changed an entry so far doesn't store its copy, since it can't
+ * tell whether its copy is current.
+ */
+static int
+mdb_ecache_cmp( const void *v1, const void *v2 )
+{
+	const mdb_ecentry *e1 = v1, *e2 = v2;
+
+	return e1->ec_id < e2->ec_id ? -1 : e1->ec_id > e2->ec_id;
+}
+
+/* Only a reader's copies are good for other ops. */
+static int
+mdb_ecache_reader( Operation *op, struct mdb_info *mdb, MDB_txn *txn )
+{
+	OpExtra *oex;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == mdb ) {
+			mdb_op_info *moi = (mdb_op_info *)oex;
+			return moi->moi_txn == txn && ( moi->moi_flag & MOI_READER );
+		}
+	}
+	return 0;
+}
+
+static void
+mdb_ecache_free( mdb_ecentry *ec )
+{
+	attrs_valhash_free( ec->ec_e.e_attrs );
+	ch_free( ec );
+}
+
+/* Must hold mi_ecache_mutex */
+static void
+mdb_ecache_unlink( struct mdb_info *mdb, mdb_ecentry *ec )
+{
+	avl_delete( &mdb->mi_ecache_tree, ec, mdb_ecache_cmp );
+	LDAP_TAILQ_REMOVE( &mdb->mi_ecache_lru, ec, ec_lru );
+	mdb->mi_ecache_bytes -= ec->ec_size;
+	if ( !--ec->ec_refs )
+		mdb_ecache_free( ec );
+}
+
+static void
+mdb_ecache_release( mdb_ecentry *ec )
+{
+	struct mdb_info *mdb = ec->ec_mdb;
+	int refs;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_ecache_mutex );
+	refs = --ec->ec_refs;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_ecache_mutex );
+	if ( !refs )
+		mdb_ecache_free( ec );
+}
+
+/* Returns an op's own Entry for a cached copy usable in txnid */
+static Entry *
+mdb_ecache_get( Operation *op, struct mdb_info *mdb, ID id, size_t txnid )
+{
+	mdb_ecentry *ec, key;
+	Entry *e;
+
+	key.ec_id = id;
+	ldap_pvt_thread_mutex_lock( &mdb->mi_ecache_mutex );
+	ec = avl_find( mdb->mi_ecache_tree, &key, mdb_ecache_cmp );
+	if ( ec && ec->ec_txnid <= txnid ) {
+		ec->ec_refs++;
+		LDAP_TAILQ_REMOVE( &mdb->mi_ecache_lru, ec, ec_lru );
+		LDAP_TAILQ_INSERT_HEAD( &mdb->mi_ecache_lru, ec, ec_lru );
+	} else {
+		ec = NULL;
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_ecache_mutex );
+	if ( !ec )
+		return NULL;
+
+	e = op->o_tmpalloc( sizeof(Entry), op->o_tmpmemctx );
+	*e = ec->ec_e;
+	e->e_private = ec;
+	return e;
+}
+
+static char *
+mdb_ecache_vals( BerVarray src, unsigned n, BerVarray dst, char *ptr )
+{
+	unsigned i;
+
+	for ( i = 0; i < n; i++ ) {
+		dst[i].bv_len = src[i].bv_len;
+		dst[i].bv_val = ptr;
+		AC_MEMCPY( ptr, src[i].bv_val, src[i].bv_len );
+		ptr += src[i].bv_len;
+		*ptr++ = '\0';
+	}
+	BER_BVZERO( &dst[i] );
+	return ptr;
+}
+
+/* Keep a copy of e, read in a read txn txnid. Entries bigger than
+ * a quarter of the cache are left out.
+ */
+static void
+mdb_ecache_put( struct mdb_info *mdb, Entry *e, size_t txnid )
+{
+	mdb_ecentry *ec;
+	Attribute *a, *b;
+	BerVarray bv;
+	char *ptr;
+	size_t size = sizeof(mdb_ecentry);
+	int nattrs = 0, nvals = 0;
+	unsigned i;
+
+	for ( a = e->e_attrs; a; a = a->a_next ) {
+		nattrs++;
+		nvals += a->a_numvals + 1;
+		for ( i = 0; i < a->a_numvals; i++ )
+			size += a->a_vals[i].bv_len + 1;
+		if ( a->a_nvals != a->a_vals ) {
+			nvals += a->a_numvals + 1;
+			for ( i = 0; i < a->a_numvals; i++ )
+				size += a->a_nvals[i].bv_len + 1;
+		}
+	}
+	size += nattrs * sizeof(Attribute) + nvals * sizeof(struct berval);
+	if ( size > mdb->mi_ecache_max / 4 || txnid < mdb->mi_ecache_wtxnid )
+		return;
+
+	ec = ch_malloc( size );
+	ec->ec_id = e->e_id;
+	ec->ec_size = size;
+	ec->ec_refs = 1;
+	ec->ec_mdb = mdb;
+	ec->ec_e = *e;
+	BER_BVZERO( &ec->ec_e.e_name );
+	BER_BVZERO( &ec->ec_e.e_nname );
+	BER_BVZERO( &ec->ec_e.e_bv );
+	b = (Attribute *)(ec + 1);
+	bv = (BerVarray)(b + nattrs);
+	ptr = (char *)(bv + nvals);
+	ec->ec_e.e_attrs = nattrs ? b : NULL;
+	for ( a = e->e_attrs; a; a = a->a_next, b++ ) {
+		b->a_desc = a->a_desc;
+		b->a_numvals = a->a_numvals;
+		b->a_flags = ( a->a_flags & SLAP_ATTR_PERSISTENT_FLAGS ) |
+			SLAP_ATTR_DONT_FREE_DATA | SLAP_ATTR_DONT_FREE_VALS;
+		b->a_hash = NULL;
+#ifdef LDAP_COMP_MATCH
+		b->a_comp_data = NULL;
+#endif
+		b->a_vals = bv;
+		ptr = mdb_ecache_vals( a->a_vals, a->a_numvals, bv, ptr );
+		bv += a->a_numvals + 1;
+		if ( a->a_nvals != a->a_vals ) {
+			b->a_nvals = bv;
+			ptr = mdb_ecache_vals( a->a_nvals, a->a_numvals, bv, ptr );
+			bv += a->a_numvals + 1;
+		} else {
+			b->a_nvals = b->a_vals;
+		}
+		b->a_next = a->a_next ? b + 1 : NULL;
+	}
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_ecache_mutex );
+	/* a write txn may have changed it meanwhile */
+	if ( txnid < mdb->mi_ecache_wtxnid || !mdb->mi_ecache_max ||
+		avl_insert( &mdb->mi_ecache_tree, ec, mdb_ecache_cmp,
+			avl_dup_error )) {
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_ecache_mutex );
+		ch_free( ec );
+		return;
+	}
+	ec->ec_txnid = mdb->mi_ecache_wtxnid;
+	LDAP_TAILQ_INSERT_HEAD( &mdb->mi_ecache_lru, ec, ec_lru );
+	mdb->mi_ecache_bytes += size;
+	while ( mdb->mi_ecache_bytes > mdb->mi_ecache_max )
+		mdb_ecache_unlink( mdb, LDAP_TAILQ_LAST( &mdb->mi_ecache_lru, mdb_eclru ));
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_ecache_mutex );
+}
+
+/* Called by a write txn before it changes the entry id */
+static void
+mdb_ecache_drop( struct mdb_info *mdb, MDB_txn *txn, ID id )
+{
+	mdb_ecentry *ec, key;
+	size_t txnid;
+
+	if ( !mdb->mi_ecache_max || ( slapMode & SLAP_TOOL_MODE ))
+		return;
+
+	txnid = mdb_txn_id( txn );
+	key.ec_id = id;
+	ldap_pvt_thread_mutex_lock( &mdb->mi_ecache_mutex );
+	if ( txnid > mdb->mi_ecache_wtxnid )
+		mdb->mi_ecache_wtxnid = txnid;
+	ec = avl_find( mdb->mi_ecache_tree, &key, mdb_ecache_cmp );
+	if ( ec )
+		mdb_ecache_unlink( mdb, ec );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_ecache_mutex );
+}
+
+/* Drop all the copies. Those still in use go when they're released. */
+void
+mdb_ecache_flush( struct mdb_info *mdb )
+{
+	mdb_ecentry *ec;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_ecache_mutex );
+	while (( ec = LDAP_TAILQ_FIRST( &mdb->mi_ecache_lru )))
+		mdb_ecache_unlink( mdb, ec );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_ecache_mutex );
+}
+
 int mdb_id2entry(
 	Operation *op,
 	MDB_cursor *mc,
 	ID id,
 	Entry **e )
 {
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_txn *txn = mdb_cursor_txn( mc );
 	MDB_val key, data;
+	size_t txnid = 0;
 	int rc = 0;
 
 	*e = NULL;
@@ -407,13 +697,22 @@ int mdb_id2entry(
 	key.mv_data = &id;
 	key.mv_size = sizeof(ID);
 
+	SLAP_PROBE2( mdb__id2entry__start, op->o_connid, (long) id );
+
+	if ( mdb->mi_ecache_max && mdb_ecache_reader( op, mdb, txn )) {
+		txnid = mdb_txn_id( txn );
+		*e = mdb_ecache_get( op, mdb, id, txnid );
+		if ( *e )
+			goto done;
+	}
+
 	/* fetch it */
 	rc = mdb_cursor_get( mc, &key, &data, MDB_SET );
 	if ( rc == MDB_NOTFOUND ) {
 		/* Looking for root entry on an empty-dn suffix? */
 		if ( !id && BER_BVISEMPTY( &op->o_bd->be_nsuffix[0] )) {
 			struct berval gluebv = BER_BVC("glue");
-			Entry *r = mdb_entry_alloc(op, 2, 4);
+			Entry *r = mdb_entry_alloc(op, 2, 4, 0);
 			Attribute *a = r->e_attrs;
 			struct berval *bptr;
 
@@ -438,21 +737,26 @@ int mdb_id2entry(
 			BER_BVZERO(bptr);
 			a->a_next = NULL;
 			*e = r;
-			return MDB_SUCCESS;
+			rc = MDB_SUCCESS;
+			goto done;
 		}
 	}
 	/* stubs from missing parents - DB is actually invalid */
 	if ( rc == MDB_SUCCESS && !data.mv_size )
 		rc = MDB_NOTFOUND;
-	if ( rc ) return rc;
+	if ( rc ) goto done;
 
-	rc = mdb_entry_decode( op, mdb_cursor_txn( mc ), &data, id, e );
-	if ( rc ) return rc;
+	rc = mdb_entry_decode( op, txn, &data, id, e );
+	if ( rc ) goto done;
 
 	(*e)->e_id = id;
 	(*e)->e_name.bv_val = NULL;
 	(*e)->e_nname.bv_val = NULL;
+	if ( txnid )
+		mdb_ecache_put( mdb, *e, txnid );
 
+done:
+	SLAP_PROBE3( mdb__id2entry__done, op->o_connid, (long) id, rc );
 	return rc;
 }
 
@@ -469,11 +773,17 @@ int mdb_id2entry_delete(
 
 	key.mv_data = &e->e_id;
 	key.mv_size = sizeof(ID);
+	mdb_ecache_drop( mdb, tid, e->e_id );
 
 	/* delete from database */
 	rc = mdb_del( tid, dbi, &key, NULL );
 	if (rc)
 		return rc;
+	if ( mdb->mi_alias && is_entry_alias( e )) {
+		rc = mdb_del( tid, mdb->mi_alias, &key, NULL );
+		if ( rc && rc != MDB_NOTFOUND )
+			return rc;
+	}
 	rc = mdb_cursor_open( tid, mdb->mi_dbis[MDB_ID2VAL], &mvc );
 	if (rc)
 		return rc;
@@ -498,14 +808,18 @@ int mdb_id2entry_delete(
 	return rc;
 }
 
+/* The extra bytes follow the values array, for the inflated
+ * copy of a compressed entry.
+ */
 static Entry * mdb_entry_alloc(
 	Operation *op,
 	int nattrs,
-	int nvals )
+	int nvals,
+	ber_len_t extra )
 {
 	Entry *e = op->o_tmpalloc( sizeof(Entry) +
 		nattrs * sizeof(Attribute) +
-		nvals * sizeof(struct berval), op->o_tmpmemctx );
+		nvals * sizeof(struct berval) + extra, op->o_tmpmemctx );
 	BER_BVZERO(&e->e_bv);
 	e->e_private = e;
 	if (nattrs) {
@@ -526,6 +840,12 @@ int mdb_entry_return(
 	if ( !e )
 		return 0;
 	if ( e->e_private ) {
+		if ( e->e_private != e ) {
+			/* an op's header for a cached copy */
+			mdb_ecache_release( e->e_private );
+		} else {
+			attrs_valhash_free( e->e_attrs );
+		}
 		if ( op->o_hdr && op->o_tmpmfuncs ) {
 			op->o_tmpfree( e->e_nname.bv_val, op->o_tmpmemctx );
 			op->o_tmpfree( e->e_name.bv_val, op->o_tmpmemctx );
@@ -748,7 +1068,23 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 				if ( get_lazyCommit( op ))
 					flag |= MDB_NOMETASYNC;
 #endif
+				/* pointless if commits aren't synced anyway. A
+				 * deferred commit stays invisible until it is
+				 * synced, so lazy commits can't use it.
+				 */
+				if ( mdb->mi_group_commit &&
+#ifdef SLAP_CONTROL_X_LAZY_COMMIT
+					!get_lazyCommit( op ) &&
+#endif
+					!( mdb->mi_dbenv_flags & MDB_NOSYNC )) {
+					flag |= MDB_DEFERSYNC;
+					moi->moi_flag |= MOI_GROUP;
+				}
+				/* the end of an online compaction */
+				if ( mdb->mi_compacting )
+					return LDAP_BUSY;
 				rc = mdb_txn_begin( mdb->mi_dbenv, NULL, flag, &moi->moi_txn );
+				SLAP_PROBE3( mdb__txn__begin, op->o_connid, 0, rc );
 				if (rc) {
 					Debug( LDAP_DEBUG_ANY, "mdb_opinfo_get: err %s(%d)\n",
 						mdb_strerror(rc), rc );
@@ -768,6 +1104,7 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 		if ( !ctx ) {
 			/* Shouldn't happen unless we're single-threaded */
 			rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &moi->moi_txn );
+			SLAP_PROBE3( mdb__txn__begin, op->o_connid, 1, rc );
 			if (rc) {
 				Debug( LDAP_DEBUG_ANY, "mdb_opinfo_get: err %s(%d)\n",
 					mdb_strerror(rc), rc );
@@ -776,6 +1113,7 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 		}
 		if ( ldap_pvt_thread_pool_getkey( ctx, mdb->mi_dbenv, &data, NULL ) ) {
 			rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &moi->moi_txn );
+			SLAP_PROBE3( mdb__txn__begin, op->o_connid, 1, rc );
 			if (rc) {
 				Debug( LDAP_DEBUG_ANY, "mdb_opinfo_get: err %s(%d)\n",
 					mdb_strerror(rc), rc );
@@ -802,6 +1140,7 @@ ok:
 	}
 	if ( renew ) {
 		rc = mdb_txn_renew( moi->moi_txn );
+		SLAP_PROBE3( mdb__txn__begin, op->o_connid, 1, rc );
 		assert(!rc);
 	}
 	moi->moi_ref++;
@@ -811,10 +1150,59 @@ ok:
 	return 0;
 }
 
+/* Commit the write txn of an op. With groupcommit the txn was begun
+ * with MDB_DEFERSYNC, and the op waits for a sync covering its commit.
+ * Whichever writer finds no sync in progress does it on behalf of
+ * every txn committed so far, so one sync serves all writers that
+ * queued up behind the previous one.
+ */
+int mdb_op_commit( Operation *op, mdb_op_info *moi )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	unsigned long seq, upto;
+	int rc;
+
+	SLAP_PROBE1( mdb__txn__commit__start, op->o_connid );
+	rc = mdb_txn_commit( moi->moi_txn );
+	if ( rc || !( moi->moi_flag & MOI_GROUP )) {
+		SLAP_PROBE2( mdb__txn__commit__done, op->o_connid, rc );
+		return rc;
+	}
+	moi->moi_flag ^= MOI_GROUP;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_gc_mutex );
+	seq = ++mdb->mi_gc_committed;
+	while ( mdb->mi_gc_synced < seq ) {
+		if ( mdb->mi_gc_syncing ) {
+			ldap_pvt_thread_cond_wait( &mdb->mi_gc_cond, &mdb->mi_gc_mutex );
+			continue;
+		}
+		mdb->mi_gc_syncing = 1;
+		upto = mdb->mi_gc_committed;
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+		rc = mdb_env_sync( mdb->mi_dbenv, 1 );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY, "mdb_op_commit: sync failed: %s (%d)\n",
+				mdb_strerror( rc ), rc );
+		}
+		ldap_pvt_thread_mutex_lock( &mdb->mi_gc_mutex );
+		mdb->mi_gc_synced = upto;
+		mdb->mi_gc_rc = rc;
+		mdb->mi_gc_syncs++;
+		mdb->mi_gc_syncing = 0;
+		ldap_pvt_thread_cond_broadcast( &mdb->mi_gc_cond );
+	}
+	rc = mdb->mi_gc_rc;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+	SLAP_PROBE2( mdb__txn__commit__done, op->o_connid, rc );
+	return rc;
+}
+
 int mdb_txn( Operation *op, int txnop, OpExtra **ptr )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	mdb_op_info **moip = (mdb_op_info **)ptr, *moi = *moip;
+	MDB_txn *txn;
 	int rc;
 
 	switch( txnop ) {
@@ -823,10 +1211,36 @@ int mdb_txn( Operation *op, int txnop, OpExtra **ptr )
 		if ( !rc ) {
 			moi = *moip;
 			moi->moi_flag |= MOI_KEEPER;
+			moi->moi_parent = NULL;
 		}
 		return rc;
-	case SLAP_TXN_COMMIT:
+	case SLAP_TXN_SAVEPOINT:
+		/* Nested txns aren't supported with MDB_WRITEMAP */
+		rc = mdb_txn_begin( mdb->mi_dbenv, moi->moi_txn, 0, &txn );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY, "mdb_txn: nested txn begin failed: %s(%d)\n",
+				mdb_strerror(rc), rc );
+			return rc;
+		}
+		moi->moi_parent = moi->moi_txn;
+		moi->moi_txn = txn;
+		moi->moi_numads = mdb->mi_numads;
+		return 0;
+	case SLAP_TXN_RELEASE:
 		rc = mdb_txn_commit( moi->moi_txn );
+		if ( rc )
+			mdb_ad_unwind( mdb, moi->moi_numads );
+		moi->moi_txn = moi->moi_parent;
+		moi->moi_parent = NULL;
+		return rc;
+	case SLAP_TXN_ROLLBACK:
+		mdb_txn_abort( moi->moi_txn );
+		mdb_ad_unwind( mdb, moi->moi_numads );
+		moi->moi_txn = moi->moi_parent;
+		moi->moi_parent = NULL;
+		return 0;
+	case SLAP_TXN_COMMIT:
+		rc = mdb_op_commit( op, moi );
 		if ( rc )
 			mdb->mi_numads = 0;
 		op->o_tmpfree( moi, op->o_tmpmemctx );
@@ -840,16 +1254,192 @@ int mdb_txn( Operation *op, int txnop, OpExtra **ptr )
 	return LDAP_OTHER;
 }
 
-/* Count up the sizes of the components of an entry */
-static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
-	Ecount *eh)
+/* The value dictionary. Each value is kept once, under a code that
+ * entries store instead of the value; the normalized value is kept
+ * along with it. Records are told apart by the first byte of the key:
+ *	'c' code	-> length, normalized length, value, normalized value
+ *	'v' adx value	-> code
+ *	'a' adx		-> number of values of the attribute
+ *	'n'		-> next code
+ * Integers in keys are big-endian. A normalized length of UINT_MAX
+ * means the normalized value is the value itself. Codes are never
+ * reused, so nothing else needs to be updated as entries change.
+ */
+#define MDB_DICT_MAXVAL	256	/* longer values are never kept */
+
+static void
+mdb_dict_key( unsigned char *buf, int type, unsigned n )
+{
+	buf[0] = type;
+	buf[1] = n >> 24;
+	buf[2] = n >> 16;
+	buf[3] = n >> 8;
+	buf[4] = n;
+}
+
+static int
+mdb_dict_val( struct mdb_info *mdb, MDB_txn *txn, unsigned code,
+	struct berval *val, struct berval *nval )
 {
+	unsigned char kbuf[5];
+	MDB_val key, data;
+	unsigned len[2];
+	int rc = MDB_NOTFOUND;
+
+	mdb_dict_key( kbuf, 'c', code );
+	key.mv_size = sizeof(kbuf);
+	key.mv_data = kbuf;
+	if ( mdb->mi_dict )
+		rc = mdb_get( txn, mdb->mi_dict, &key, &data );
+	if ( rc || data.mv_size < sizeof(len) ) {
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_entry_decode: dictionary value %u not found\n", code );
+		return LDAP_OTHER;
+	}
+	memcpy( len, data.mv_data, sizeof(len) );
+	val->bv_len = len[0];
+	val->bv_val = (char *)data.mv_data + sizeof(len);
+	if ( nval ) {
+		if ( len[1] == UINT_MAX ) {
+			*nval = *val;
+		} else {
+			nval->bv_len = len[1];
+			nval->bv_val = val->bv_val + len[0] + 1;
+		}
+	}
+	return 0;
+}
+
+/* Give val a code, unless its attribute already has max values */
+static int
+mdb_dict_add( struct mdb_info *mdb, MDB_txn *txn, unsigned adx, unsigned max,
+	struct berval *val, struct berval *nval, MDB_val *vkey, unsigned *codep )
+{
+	unsigned char kbuf[5];
+	MDB_val key, data;
+	unsigned count = 0, code = 1, len[2];
+	char *ptr;
+	int rc;
+
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+	mdb_dict_key( kbuf, 'a', adx );
+	rc = mdb_get( txn, mdb->mi_dict, &key, &data );
+	if ( rc == 0 )
+		memcpy( &count, data.mv_data, sizeof(count) );
+	else if ( rc != MDB_NOTFOUND )
+		return rc;
+	if ( count >= max )
+		return MDB_NOTFOUND;
+	count++;
+	data.mv_size = sizeof(count);
+	data.mv_data = &count;
+	rc = mdb_put( txn, mdb->mi_dict, &key, &data, 0 );
+	if ( rc )
+		return rc;
+
+	key.mv_size = 1;
+	rc = mdb_get( txn, mdb->mi_dict, &key, &data );
+	if ( rc == 0 )
+		memcpy( &code, data.mv_data, sizeof(code) );
+	else if ( rc != MDB_NOTFOUND )
+		return rc;
+	code++;
+	data.mv_size = sizeof(code);
+	data.mv_data = &code;
+	rc = mdb_put( txn, mdb->mi_dict, &key, &data, 0 );
+	if ( rc )
+		return rc;
+	code--;
+
+	if ( nval && !bvmatch( val, nval ))
+		len[1] = nval->bv_len;
+	else
+		len[1] = UINT_MAX;
+	len[0] = val->bv_len;
+	mdb_dict_key( kbuf, 'c', code );
+	key.mv_size = sizeof(kbuf);
+	data.mv_size = sizeof(len) + val->bv_len + 1;
+	if ( len[1] != UINT_MAX )
+		data.mv_size += nval->bv_len + 1;
+	rc = mdb_put( txn, mdb->mi_dict, &key, &data, MDB_NOOVERWRITE|MDB_RESERVE );
+	if ( rc )
+		return rc;
+	memcpy( data.mv_data, len, sizeof(len) );
+	ptr = (char *)data.mv_data + sizeof(len);
+	memcpy( ptr, val->bv_val, val->bv_len );
+	ptr += val->bv_len;
+	*ptr++ = '\0';
+	if ( len[1] != UINT_MAX ) {
+		memcpy( ptr, nval->bv_val, nval->bv_len );
+		ptr[nval->bv_len] = '\0';
+	}
+
+	data.mv_size = sizeof(code);
+	data.mv_data = &code;
+	rc = mdb_put( txn, mdb->mi_dict, vkey, &data, MDB_NOOVERWRITE );
+	if ( rc == 0 )
+		*codep = code;
+	return rc;
+}
+
+/* Find the codes of all values of a, adding the missing ones if
+ * create is set. Returns MDB_NOTFOUND if some value has none.
+ */
+static int
+mdb_dict_codes( Operation *op, MDB_txn *txn, Attribute *a, unsigned max,
+	unsigned *codes, int create )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	unsigned char kbuf[5 + MDB_DICT_MAXVAL];
+	unsigned adx = mdb->mi_adxs[a->a_desc->ad_index];
+	MDB_val key, data;
+	int i, rc;
+
+	for ( i = 0; i < a->a_numvals; i++ ) {
+		if ( a->a_vals[i].bv_len > MDB_DICT_MAXVAL )
+			return MDB_NOTFOUND;
+	}
+
+	mdb_dict_key( kbuf, 'v', adx );
+	key.mv_data = kbuf;
+	for ( i = 0; i < a->a_numvals; i++ ) {
+		memcpy( kbuf + 5, a->a_vals[i].bv_val, a->a_vals[i].bv_len );
+		key.mv_size = 5 + a->a_vals[i].bv_len;
+		rc = mdb_get( txn, mdb->mi_dict, &key, &data );
+		if ( rc == 0 ) {
+			memcpy( &codes[i], data.mv_data, sizeof(unsigned) );
+			continue;
+		}
+		if ( rc != MDB_NOTFOUND || !create )
+			return rc;
+		rc = mdb_dict_add( mdb, txn, adx, max, &a->a_vals[i],
+			a->a_nvals != a->a_vals ? &a->a_nvals[i] : NULL,
+			&key, &codes[i] );
+		if ( rc )
+			return rc;
+	}
+	return 0;
+}
+
+/* Count up the sizes of the components of an entry. The values of
+ * attributes kept in the value dictionary are looked up, and added to
+ * it if create is set; if they all have a code, only the codes are
+ * stored.
+ */
+static int mdb_entry_partsize(Operation *op, MDB_txn *txn, Entry *e,
+	Ecount *eh, int create)
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	ber_len_t len, dlen;
 	int i, nat = 0, nval = 0, nnval = 0, doff = 0;
 	Attribute *a;
-	unsigned hi;
+	AttrInfo *ai;
+	unsigned hi, *dp = NULL;
+	int rc, dict;
 
 	eh->multi = NULL;
+	eh->dict = NULL;
 	len = 4*sizeof(int);	/* nattrs, nvals, ocflags, offset */
 	dlen = len;
 	for (a=e->e_attrs; a; a=a->a_next) {
@@ -860,7 +1450,7 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 			return LDAP_OTHER;
 		}
 		if (!mdb->mi_adxs[a->a_desc->ad_index]) {
-			int rc = mdb_ad_get(mdb, txn, a->a_desc);
+			rc = mdb_ad_get(mdb, txn, a->a_desc);
 			if (rc)
 				return rc;
 		}
@@ -872,12 +1462,40 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 			a->a_flags |= SLAP_ATTR_BIG_MULTI;
 		if (a->a_flags & SLAP_ATTR_BIG_MULTI)
 			doff += a->a_numvals;
+
+		dict = 0;
+		if (mdb->mi_dict && !(a->a_flags & SLAP_ATTR_BIG_MULTI) &&
+			(ai = mdb_attr_mask( mdb, a->a_desc )) && ai->ai_dict) {
+			if (!eh->dict) {
+				Attribute *b;
+				int n = 0;
+				for (b=e->e_attrs; b; b=b->a_next)
+					n += b->a_numvals + 1;
+				eh->dict = op->o_tmpcalloc( n, sizeof(unsigned), op->o_tmpmemctx );
+				dp = eh->dict + nat - 1;
+			}
+			rc = mdb_dict_codes( op, txn, a, ai->ai_dict, dp+1, create );
+			if (rc == 0) {
+				*dp = a->a_numvals;
+				dp += a->a_numvals + 1;
+				dict = 1;
+			} else if (rc == MDB_NOTFOUND) {
+				*dp++ = 0;
+			} else {
+				return rc;
+			}
+		} else if (eh->dict) {
+			*dp++ = 0;
+		}
+
 		for (i=0; i<a->a_numvals; i++) {
 			int alen = a->a_vals[i].bv_len + 1 + sizeof(int);	/* len */
 			len += alen;
 			if (a->a_flags & SLAP_ATTR_BIG_MULTI) {
 				if (!eh->multi)
 					eh->multi = a;
+			} else if (dict) {
+				dlen += sizeof(int);	/* code */
 			} else {
 				dlen += alen;
 			}
@@ -885,12 +1503,12 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 		if (a->a_nvals != a->a_vals) {
 			nval += a->a_numvals + 1;
 			nnval++;
-			if (a->a_flags & SLAP_ATTR_BIG_MULTI)
+			if (a->a_flags & SLAP_ATTR_BIG_MULTI || dict)
 				doff += a->a_numvals;
 			for (i=0; i<a->a_numvals; i++) {
 				int alen = a->a_nvals[i].bv_len + 1 + sizeof(int);
 				len += alen;
-				if (!(a->a_flags & SLAP_ATTR_BIG_MULTI))
+				if (!(a->a_flags & SLAP_ATTR_BIG_MULTI) && !dict)
 					dlen += alen;
 			}
 		}
@@ -910,10 +1528,16 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 	/* the values are in sorted order */
 #define MDB_AT_MULTI	(1<<(sizeof(unsigned int)*CHAR_BIT-2))
 	/* the values of this multi-valued attr are stored separately */
+#define MDB_AT_DICT	(1<<(sizeof(unsigned int)*CHAR_BIT-3))
+	/* the values are codes in the value dictionary */
 
 #define MDB_AT_NVALS	(1U<<(sizeof(unsigned int)*CHAR_BIT-1))
 	/* this attribute has normalized values */
 
+#define MDB_ENT_ZIP	(1U<<(sizeof(unsigned int)*CHAR_BIT-1))
+	/* the entry is compressed */
+#define MDB_ZIP_HDR	(4*sizeof(int))	/* nattrs, nvals, size, zsize */
+
 /* Flatten an Entry into a buffer. The buffer starts with the count of the
  * number of attributes in the entry, the total number of values in the
  * entry, and the e_ocflags. It then contains a list of integers for each
@@ -921,7 +1545,10 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
  * matching AttributeDescription, followed by the number of values in the
  * attribute. If the MDB_AT_SORTED bit of the attr index is set, the
  * attribute's values are already sorted. If the MDB_AT_MULTI bit of the
- * attr index is set, the values are stored separately.
+ * attr index is set, the values are stored separately. If the MDB_AT_DICT
+ * bit is set, the values and their normalized forms are in the value
+ * dictionary, and each value is only given by its code, in place of its
+ * length.
  *
  * If the MDB_AT_NVALS bit of numvals is set, the attribute also has
  * normalized values present. (Note - a_numvals is an unsigned int, so this
@@ -934,6 +1561,11 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
  * with a NUL terminator after each value.
  * The buffer is padded to the sizeof(ID). The entire buffer size is
  * precomputed so that a single malloc can be performed.
+ *
+ * If the MDB_ENT_ZIP bit of the attribute count is set, the count of
+ * values is followed by the size of the flattened entry and the size
+ * of its zlib compressed form, which comes next. The flattened entry
+ * starts with the same counts, without the flag.
  */
 static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
 {
@@ -941,7 +1573,8 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
 	ber_len_t i;
 	Attribute *a;
 	unsigned char *ptr;
-	unsigned int *lp, l;
+	unsigned int *lp, l, *dp = eh->dict;
+	int dict;
 
 	Debug( LDAP_DEBUG_TRACE, "=> mdb_entry_encode(0x%08lx): %s\n",
 		(long) e->e_id, e->e_dn );
@@ -960,11 +1593,14 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
 	for (a=e->e_attrs; a; a=a->a_next) {
 		if (!a->a_desc->ad_index)
 			return LDAP_UNDEFINED_TYPE;
+		dict = dp && *dp++;
 		l = mdb->mi_adxs[a->a_desc->ad_index];
 		if (a->a_flags & SLAP_ATTR_BIG_MULTI)
 			l |= MDB_AT_MULTI;
 		if (a->a_flags & SLAP_ATTR_SORTED_VALS)
 			l |= MDB_AT_SORTED;
+		if (dict)
+			l |= MDB_AT_DICT;
 		*lp++ = l;
 		l = a->a_numvals;
 		if (a->a_nvals != a->a_vals)
@@ -972,6 +1608,9 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
 		*lp++ = l;
 		if (a->a_flags & SLAP_ATTR_BIG_MULTI) {
 			continue;
+		} else if (dict) {
+			for (i=0; i<a->a_numvals; i++)
+				*lp++ = *dp++;
 		} else {
 			if (a->a_vals) {
 				for (i=0; a->a_vals[i].bv_val; i++);
@@ -1002,6 +1641,113 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
 	return 0;
 }
 
+/* Flatten an Entry into a temporary buffer, for slapbench. Entries
+ * with values stored apart in id2val are refused, and so are entries
+ * using attributes that can't be registered in a read-only txn.
+ * The caller frees data->mv_data.
+ */
+int mdb_entry_flatten(Operation *op, MDB_txn *txn, Entry *e, MDB_val *data)
+{
+	Ecount ec;
+	int rc;
+
+	rc = mdb_entry_partsize( op, txn, e, &ec, 0 );
+	if (rc) {
+		rc = LDAP_OTHER;
+		goto done;
+	}
+	if (ec.multi) {
+		rc = LDAP_UNWILLING_TO_PERFORM;
+		goto done;
+	}
+
+	data->mv_size = ec.dlen;
+	data->mv_data = op->o_tmpalloc( ec.dlen, op->o_tmpmemctx );
+	rc = mdb_entry_encode( op, e, data, &ec );
+	if (rc) {
+		op->o_tmpfree( data->mv_data, op->o_tmpmemctx );
+		data->mv_data = NULL;
+	}
+done:
+	if (ec.dict)
+		op->o_tmpfree( ec.dict, op->o_tmpmemctx );
+	return rc;
+}
+
+/* Flatten an Entry into a temporary buffer and compress it. If that
+ * doesn't save anything, the flattened entry is returned instead.
+ * The caller frees data->mv_data.
+ */
+static int mdb_entry_deflate(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
+{
+	MDB_val plain;
+	int rc;
+#ifdef HAVE_ZLIB
+	unsigned int *lp;
+	uLongf zlen;
+#endif
+
+	plain.mv_size = eh->dlen;
+	plain.mv_data = op->o_tmpalloc( eh->dlen, op->o_tmpmemctx );
+	rc = mdb_entry_encode( op, e, &plain, eh );
+	if ( rc ) {
+		op->o_tmpfree( plain.mv_data, op->o_tmpmemctx );
+		return rc;
+	}
+	*data = plain;
+
+#ifdef HAVE_ZLIB
+	if ( eh->dlen > UINT_MAX )
+		return 0;
+	zlen = compressBound( eh->dlen );
+	lp = op->o_tmpalloc( MDB_ZIP_HDR + zlen + sizeof(ID), op->o_tmpmemctx );
+	if ( compress2( (Bytef *)lp + MDB_ZIP_HDR, &zlen, plain.mv_data,
+		eh->dlen, Z_DEFAULT_COMPRESSION ) != Z_OK ||
+		MDB_ZIP_HDR + zlen >= eh->dlen ) {
+		op->o_tmpfree( lp, op->o_tmpmemctx );
+		return 0;
+	}
+	lp[0] = eh->nattrs | MDB_ENT_ZIP;
+	lp[1] = eh->nvals;
+	lp[2] = eh->dlen;
+	lp[3] = zlen;
+	op->o_tmpfree( plain.mv_data, op->o_tmpmemctx );
+	data->mv_data = lp;
+	/* padding */
+	data->mv_size = (MDB_ZIP_HDR + zlen + sizeof(ID)-1) & ~(sizeof(ID)-1);
+	memset( (char *)lp + MDB_ZIP_HDR + zlen, 0,
+		data->mv_size - MDB_ZIP_HDR - zlen );
+#endif
+	return 0;
+}
+
+/* Uncompress an entry stored by mdb_entry_deflate into the extra
+ * space of the Entry it is decoded into.
+ */
+static unsigned int *mdb_entry_inflate(Entry *x, int nattrs, int nvals,
+	MDB_val *data)
+{
+	unsigned int *lp = data->mv_data;
+	unsigned char *buf = (unsigned char *)(x+1) +
+		nattrs * sizeof(Attribute) + nvals * sizeof(struct berval);
+#ifdef HAVE_ZLIB
+	uLongf len = lp[2];
+
+	if ( data->mv_size < MDB_ZIP_HDR + lp[3] ||
+		uncompress( buf, &len, (Bytef *)lp + MDB_ZIP_HDR, lp[3] ) != Z_OK ||
+		len != lp[2] ) {
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_entry_decode: compressed entry is corrupt\n" );
+		return NULL;
+	}
+	return (unsigned int *)buf;
+#else
+	Debug( LDAP_DEBUG_ANY,
+		"mdb_entry_decode: compressed entry, but built without zlib\n" );
+	return NULL;
+#endif
+}
+
 /* Retrieve an Entry that was stored using entry_encode above.
  *
  * Note: everything is stored in a single contiguous block, so
@@ -1010,6 +1756,18 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
  */
 
 int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e)
+{
+	return mdb_entry_decode_ads( op, txn, data, id, NULL, e );
+}
+
+/* Decode only the attributes that are subtypes of one of the
+ * NULL-terminated list of descriptions in ads. The values of the
+ * other attributes are skipped without being looked at, and the
+ * values that are decoded are not sorted. The result is only good
+ * for a quick filter test; if ads is NULL everything is decoded.
+ */
+int mdb_entry_decode_ads(Operation *op, MDB_txn *txn, MDB_val *data, ID id,
+	AttributeDescription **ads, Entry **e)
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	int i, j, nattrs, nvals;
@@ -1021,13 +1779,27 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 	unsigned char *ptr;
 	BerVarray bptr;
 	MDB_cursor *mvc = NULL;
+	slap_prof_ctx_t pc;
 
 	Debug( LDAP_DEBUG_TRACE,
 		"=> mdb_entry_decode:\n" );
 
+	SLAP_PROF_BEGIN( pc, SLAP_PROF_DECODE );
 	nattrs = *lp++;
 	nvals = *lp++;
-	x = mdb_entry_alloc(op, nattrs, nvals);
+	if (nattrs & MDB_ENT_ZIP) {
+		nattrs ^= MDB_ENT_ZIP;
+		x = mdb_entry_alloc(op, nattrs, nvals, *lp);
+		lp = mdb_entry_inflate(x, nattrs, nvals, data);
+		if (!lp) {
+			op->o_tmpfree(x, op->o_tmpmemctx);
+			rc = LDAP_OTHER;
+			goto leave;
+		}
+		lp += 2;	/* nattrs, nvals */
+	} else {
+		x = mdb_entry_alloc(op, nattrs, nvals, 0);
+	}
 	x->e_ocflags = *lp++;
 	if (!nvals) {
 		goto done;
@@ -1038,7 +1810,7 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 	ptr = (unsigned char *)(lp + i);
 
 	for (;nattrs>0; nattrs--) {
-		int have_nval = 0, multi = 0;
+		int have_nval = 0, multi = 0, dict = 0;
 		a->a_flags = SLAP_ATTR_DONT_FREE_DATA | SLAP_ATTR_DONT_FREE_VALS;
 		i = *lp++;
 		if (i & MDB_AT_SORTED) {
@@ -1050,6 +1822,10 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 			a->a_flags |= SLAP_ATTR_BIG_MULTI;
 			multi = 1;
 		}
+		if (i & MDB_AT_DICT) {
+			i ^= MDB_AT_DICT;
+			dict = 1;
+		}
 		if (i > mdb->mi_numads) {
 			rc = mdb_ad_read(mdb, txn);
 			if (rc)
@@ -1068,6 +1844,25 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 			a->a_numvals ^= MDB_AT_NVALS;
 			have_nval = 1;
 		}
+		if (ads) {
+			for (j=0; ads[j]; j++)
+				if (is_ad_subtype(a->a_desc, ads[j]))
+					break;
+			if (!ads[j]) {
+				/* not wanted, step over its values */
+				if (dict) {
+					lp += a->a_numvals;
+				} else if (!multi) {
+					for (i=0; i<a->a_numvals; i++)
+						ptr += *lp++ + 1;
+					if (have_nval) {
+						for (i=0; i<a->a_numvals; i++)
+							ptr += *lp++ + 1;
+					}
+				}
+				continue;
+			}
+		}
 		a->a_vals = bptr;
 		if (multi) {
 			if (!mvc) {
@@ -1077,9 +1872,31 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 			}
 			i = a->a_numvals;
 			mdb_mval_get(op, mvc, id, a, have_nval);
+			/* id2val returns them in equality order, so lookups
+			 * in the value array can use binary search.
+			 */
+			if (!(a->a_desc->ad_type->sat_flags & SLAP_AT_ORDERED) &&
+				a->a_desc != slap_schema.si_ad_objectClass)
+				a->a_flags |= SLAP_ATTR_SORTED_VALS;
 			bptr += i + 1;
 			if (have_nval)
 				bptr += i + 1;
+		} else if (dict) {
+			a->a_nvals = have_nval ? bptr + a->a_numvals + 1 : a->a_vals;
+			for (i=0; i<a->a_numvals; i++) {
+				rc = mdb_dict_val( mdb, txn, *lp++, bptr,
+					have_nval ? &a->a_nvals[i] : NULL );
+				if (rc)
+					goto leave;
+				bptr++;
+			}
+			BER_BVZERO( bptr );
+			bptr++;
+			if (have_nval) {
+				bptr += a->a_numvals;
+				BER_BVZERO( bptr );
+				bptr++;
+			}
 		} else {
 			for (i=0; i<a->a_numvals; i++) {
 				bptr->bv_len = *lp++;
@@ -1108,7 +1925,7 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 		}
 
 		/* FIXME: This is redundant once a sorted entry is saved into the DB */
-		if (( a->a_desc->ad_type->sat_flags & SLAP_AT_SORTED_VAL )
+		if ( !ads && ( a->a_desc->ad_type->sat_flags & SLAP_AT_SORTED_VAL )
 			&& !(a->a_flags & SLAP_ATTR_SORTED_VALS)) {
 			rc = slap_sort_vals( (Modifications *)a, &text, &j, NULL );
 			if ( rc == LDAP_SUCCESS ) {
@@ -1124,7 +1941,10 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 		a->a_next = a+1;
 		a = a->a_next;
 	}
-	a[-1].a_next = NULL;
+	if (a == x->e_attrs)
+		x->e_attrs = NULL;
+	else
+		a[-1].a_next = NULL;
 done:
 	Debug(LDAP_DEBUG_TRACE, "<= mdb_entry_decode\n" );
 	*e = x;
@@ -1133,5 +1953,134 @@ done:
 leave:
 	if (mvc)
 		mdb_cursor_close(mvc);
+	SLAP_PROF_END( pc, SLAP_PROF_DECODE );
 	return rc;
 }
+
+/* Open the alias database. A database written before it existed
+ * gets one filled from its entries; if it cannot be written to,
+ * mi_alias stays 0 and searches fall back to the objectClass index.
+ */
+int mdb_alias_open(
+	BackendDB *be,
+	MDB_txn *txn )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	Operation op = {0};
+	Opheader ohdr = {0};
+	MDB_cursor *mc;
+	MDB_val key, data, zero = { 0, NULL };
+	MDB_dbi dbi;
+	Entry *e;
+	unsigned int *lp;
+	ID id;
+	int rc, alias, n = 0;
+
+	mdb->mi_alias = 0;
+	rc = mdb_dbi_open( txn, "alias", MDB_INTEGERKEY, &dbi );
+	if ( rc == 0 ) {
+		mdb->mi_alias = dbi;
+		return 0;
+	}
+	if ( rc != MDB_NOTFOUND || ( slapMode & SLAP_TOOL_READONLY ) ||
+		( mdb->mi_dbenv_flags & MDB_RDONLY ))
+		return rc == MDB_NOTFOUND ? 0 : rc;
+
+	rc = mdb_dbi_open( txn, "alias", MDB_INTEGERKEY|MDB_CREATE, &dbi );
+	if ( rc )
+		return rc;
+
+	op.o_hdr = &ohdr;
+	op.o_bd = be;
+	op.o_tmpmemctx = NULL;
+	op.o_tmpmfuncs = &ch_mfuncs;
+
+	rc = mdb_cursor_open( txn, mdb->mi_id2entry, &mc );
+	if ( rc )
+		return rc;
+	while (( rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT )) == 0 ) {
+		/* a hole left by slapadd */
+		if ( !data.mv_size )
+			continue;
+		lp = data.mv_data;
+		if ( lp[0] & MDB_ENT_ZIP ) {
+			/* the flags are inside the compressed part */
+			memcpy( &id, key.mv_data, sizeof(ID) );
+			rc = mdb_entry_decode( &op, txn, &data, id, &e );
+			if ( rc )
+				break;
+			alias = is_entry_alias( e );
+			BER_BVZERO( &e->e_name );
+			BER_BVZERO( &e->e_nname );
+			mdb_entry_return( &op, e );
+		} else {
+			alias = ( lp[2] & SLAP_OC_ALIAS ) != 0;
+		}
+		if ( alias ) {
+			rc = mdb_put( txn, dbi, &key, &zero, 0 );
+			if ( rc )
+				break;
+			n++;
+		}
+	}
+	mdb_cursor_close( mc );
+	if ( rc != MDB_NOTFOUND )
+		return rc;
+
+	if ( n )
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_alias_open)
+			": database \"%s\": indexed %d aliases.\n",
+			be->be_suffix[0].bv_val, n );
+	mdb->mi_alias = dbi;
+	return 0;
+}
+
+/* Open the value dictionary, creating it if it is missing and the
+ * database can be written to.
+ */
+int mdb_dict_open(
+	BackendDB *be,
+	MDB_txn *txn )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_dbi dbi;
+	int rc;
+
+	mdb->mi_dict = 0;
+	rc = mdb_dbi_open( txn, "dict", 0, &dbi );
+	if ( rc == MDB_NOTFOUND && !( slapMode & SLAP_TOOL_READONLY ) &&
+		!( mdb->mi_dbenv_flags & MDB_RDONLY ))
+		rc = mdb_dbi_open( txn, "dict", MDB_CREATE, &dbi );
+	if ( rc == 0 )
+		mdb->mi_dict = dbi;
+	return rc == MDB_NOTFOUND ? 0 : rc;
+}
+
+/* Collect the IDs of all aliases into ids */
+int mdb_alias_ids(
+	Operation *op,
+	MDB_txn *txn,
+	ID *ids )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	MDB_stat st;
+	ID id;
+	int rc;
+
+	MDB_IDL_ZERO( ids );
+	rc = mdb_stat( txn, mdb->mi_alias, &st );
+	if ( rc || !st.ms_entries )
+		return rc;
+
+	rc = mdb_cursor_open( txn, mdb->mi_alias, &mc );
+	if ( rc )
+		return rc;
+	while (( rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT )) == 0 ) {
+		memcpy( &id, key.mv_data, sizeof(ID) );
+		mdb_idl_insert( ids, id );
+	}
+	mdb_cursor_close( mc );
+	return rc == MDB_NOTFOUND ? 0 : rc;
+}
@@ -406,6 +406,230 @@ mdb_idl_fetch_key(
 	return rc;
 }
 
+/* Merge into IDS the IDLs of every key from LO to HI, both of the same
+ * size, stopping once LIMIT IDs have been collected.
+ */
+int
+mdb_idl_fetch_range(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*lo,
+	MDB_val		*hi,
+	ID			*ids,
+	ID			*tmp,
+	ID			limit )
+{
+	MDB_val key, data;
+	MDB_cursor *cursor;
+	ID *i;
+	int rc;
+
+	assert( lo->mv_size == hi->mv_size );
+
+	rc = mdb_cursor_open( txn, dbi, &cursor );
+	if( rc != 0 ) {
+		Debug( LDAP_DEBUG_ANY, "=> mdb_idl_fetch_range: "
+			"cursor failed: %s (%d)\n", mdb_strerror(rc), rc );
+		return rc;
+	}
+
+	key = *lo;
+	rc = mdb_cursor_get( cursor, &key, &data, MDB_SET_RANGE );
+	while ( rc == 0 ) {
+		/* keys of other sizes belong to other kinds of index */
+		if ( key.mv_size != hi->mv_size ) {
+			rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT_NODUP );
+			continue;
+		}
+		if ( memcmp( key.mv_data, hi->mv_data, hi->mv_size ) > 0 )
+			break;
+
+		i = tmp+1;
+		rc = mdb_cursor_get( cursor, &key, &data, MDB_GET_MULTIPLE );
+		while ( rc == 0 ) {
+			memcpy( i, data.mv_data, data.mv_size );
+			i += data.mv_size / sizeof(ID);
+			rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT_MULTIPLE );
+		}
+		if ( rc != MDB_NOTFOUND )
+			break;
+		tmp[0] = i - &tmp[1];
+		if ( tmp[1] == 0 ) {
+			if ( tmp[0] != MDB_IDL_RANGE_SIZE ) {
+				Debug( LDAP_DEBUG_ANY, "=> mdb_idl_fetch_range: "
+					"range size mismatch: expected %d, got %ld\n",
+					MDB_IDL_RANGE_SIZE, tmp[0] );
+				rc = -1;
+				break;
+			}
+			MDB_IDL_RANGE( tmp, tmp[2], tmp[3] );
+		}
+		mdb_idl_union( ids, tmp );
+
+		if ( limit && MDB_IDL_N( ids ) >= limit ) {
+			rc = MDB_NOTFOUND;
+			break;
+		}
+		rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT_NODUP );
+	}
+	mdb_cursor_close( cursor );
+
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	else if ( rc != 0 )
+		Debug( LDAP_DEBUG_ANY, "=> mdb_idl_fetch_range: "
+			"get failed: %s (%d)\n", mdb_strerror(rc), rc );
+	return rc;
+}
+
+/* Build the companion key holding the exact IDs of range key K */
+static int
+mdb_idl_exact_key( MDB_val *key, MDB_val *ekey, char *buf )
+{
+	if ( key->mv_size + MDB_IDL_EXACT_PAD > MDB_IDL_EXACT_KEYMAX )
+		return MDB_BAD_VALSIZE;
+	memcpy( buf, key->mv_data, key->mv_size );
+	memset( buf + key->mv_size, 0, MDB_IDL_EXACT_PAD );
+	ekey->mv_data = buf;
+	ekey->mv_size = key->mv_size + MDB_IDL_EXACT_PAD;
+	return 0;
+}
+
+/* Same, for a key as generated by the indexers */
+static int
+mdb_idl_exact_bvkey( struct berval *k, MDB_val *ekey, char *buf )
+{
+	MDB_val key;
+#ifndef MISALIGNED_OK
+	int kbuf[2];
+
+	if (k->bv_len & ALIGNER) {
+		key.mv_size = sizeof(kbuf);
+		key.mv_data = kbuf;
+		kbuf[1] = 0;
+		memcpy(kbuf, k->bv_val, k->bv_len);
+	} else
+#endif
+	{
+		key.mv_size = k->bv_len;
+		key.mv_data = k->bv_val;
+	}
+	return mdb_idl_exact_key( &key, ekey, buf );
+}
+
+/* Key is about to become a range: copy its IDs, plus the one
+ * being added, to its companion. The cursor is left positioned
+ * on the companion.
+ */
+static int
+mdb_idl_exact_create(
+	MDB_cursor	*cursor,
+	MDB_val		*key,
+	size_t		count,
+	ID			id )
+{
+	MDB_val key2, ekey, data[2];
+	char ebuf[MDB_IDL_EXACT_KEYMAX];
+	ID *ids, n, x;
+	int rc;
+
+	rc = mdb_idl_exact_key( key, &ekey, ebuf );
+	if ( rc )
+		return rc;
+
+	/* NEXT_MULTIPLE points the key at the page, use a copy */
+	key2 = *key;
+	ids = ch_malloc( ( count + 1 ) * sizeof(ID) );
+	n = 0;
+	rc = mdb_cursor_get( cursor, &key2, &data[0], MDB_GET_MULTIPLE );
+	while ( rc == 0 ) {
+		if ( n + data[0].mv_size / sizeof(ID) > count ) {
+			rc = MDB_CORRUPTED;
+			break;
+		}
+		memcpy( ids + n, data[0].mv_data, data[0].mv_size );
+		n += data[0].mv_size / sizeof(ID);
+		rc = mdb_cursor_get( cursor, &key2, &data[0], MDB_NEXT_MULTIPLE );
+	}
+	if ( rc != MDB_NOTFOUND )
+		goto done;
+
+	/* merge the new ID in order */
+	for ( x = n; x > 0 && ids[x-1] > id; x-- )
+		ids[x] = ids[x-1];
+	if ( x == 0 || ids[x-1] != id ) {
+		ids[x] = id;
+		n++;
+	} else {
+		memmove( ids + x, ids + x + 1, ( n - x ) * sizeof(ID) );
+	}
+
+	data[0].mv_size = sizeof(ID);
+	data[0].mv_data = ids;
+	data[1].mv_size = n;
+	rc = mdb_cursor_put( cursor, &ekey, data, MDB_MULTIPLE );
+
+done:
+	ch_free( ids );
+	return rc;
+}
+
+/* Add or delete one ID in a range key's companion, if it has one */
+static int
+mdb_idl_exact_update(
+	MDB_cursor	*cursor,
+	MDB_val		*key,
+	ID			id,
+	int			del )
+{
+	MDB_val ekey, data;
+	char ebuf[MDB_IDL_EXACT_KEYMAX];
+	int rc;
+
+	if ( mdb_idl_exact_key( key, &ekey, ebuf ))
+		return 0;
+
+	rc = mdb_cursor_get( cursor, &ekey, &data, MDB_SET );
+	if ( rc == 0 ) {
+		data.mv_size = sizeof(ID);
+		data.mv_data = &id;
+		if ( del ) {
+			rc = mdb_cursor_get( cursor, &ekey, &data, MDB_GET_BOTH );
+			if ( rc == 0 )
+				rc = mdb_cursor_del( cursor, 0 );
+		} else {
+			rc = mdb_cursor_put( cursor, &ekey, &data, MDB_NODUPDATA );
+			if ( rc == MDB_KEYEXIST )
+				rc = 0;
+		}
+	}
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	return rc;
+}
+
+/* The range collapsed, drop its companion */
+static int
+mdb_idl_exact_drop(
+	MDB_cursor	*cursor,
+	MDB_val		*key )
+{
+	MDB_val ekey, data;
+	char ebuf[MDB_IDL_EXACT_KEYMAX];
+	int rc;
+
+	if ( mdb_idl_exact_key( key, &ekey, ebuf ))
+		return 0;
+
+	rc = mdb_cursor_get( cursor, &ekey, &data, MDB_SET );
+	if ( rc == 0 )
+		rc = mdb_cursor_del( cursor, MDB_NODUPDATA );
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	return rc;
+}
+
 int
 mdb_idl_insert_keys(
 	BackendDB	*be,
@@ -466,6 +690,17 @@ mdb_idl_insert_keys(
 			}
 			if ( count >= MDB_idl_db_max ) {
 			/* No room, convert to a range */
+				if ( mdb->mi_idl_exact ) {
+					rc = mdb_idl_exact_create( cursor, &key, count, id );
+					if ( rc == 0 ) {
+						rc = mdb_cursor_get( cursor, &key, &data, MDB_SET );
+						i = data.mv_data;
+					}
+					if ( rc != 0 && rc != MDB_BAD_VALSIZE ) {
+						err = "c_put exact";
+						goto fail;
+					}
+				}
 				lo = *i;
 				rc = mdb_cursor_get( cursor, &key, &data, MDB_LAST_DUP );
 				if ( rc != 0 && rc != MDB_NOTFOUND ) {
@@ -543,6 +778,11 @@ mdb_idl_insert_keys(
 					goto fail;
 				}
 			}
+			rc = mdb_idl_exact_update( cursor, &key, id, 0 );
+			if ( rc != 0 ) {
+				err = "c_put exact id";
+				goto fail;
+			}
 		}
 	} else if ( rc == MDB_NOTFOUND ) {
 		flag &= ~MDB_APPENDDUP;
@@ -668,6 +908,12 @@ mdb_idl_delete_keys(
 						err = "c_del dup2";
 						goto fail;
 					}
+					rc = mdb_idl_exact_drop( cursor, &key );
+					if ( rc != 0 ) {
+						err = "c_del exact";
+						goto fail;
+					}
+					continue;
 				} else {
 					/* position on lo */
 					rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT_DUP );
@@ -687,6 +933,11 @@ mdb_idl_delete_keys(
 					}
 				}
 			}
+			rc = mdb_idl_exact_update( cursor, &key, id, 1 );
+			if ( rc != 0 ) {
+				err = "c_del exact id";
+				goto fail;
+			}
 		}
 	} else {
 		/* initial c_get failed, nothing was done */
@@ -703,12 +954,217 @@ fail:
 	return rc;
 }
 
+/* Number of exact IDs kept for range key k, MDB_NOTFOUND if none */
+int
+mdb_idl_exact_count(
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	struct berval *k,
+	size_t		*count )
+{
+	MDB_cursor *cursor;
+	MDB_val ekey, data;
+	char ebuf[MDB_IDL_EXACT_KEYMAX];
+	int rc;
+
+	rc = mdb_idl_exact_bvkey( k, &ekey, ebuf );
+	if ( rc )
+		return MDB_NOTFOUND;
+
+	rc = mdb_cursor_open( txn, dbi, &cursor );
+	if ( rc )
+		return rc;
+	rc = mdb_cursor_get( cursor, &ekey, &data, MDB_SET );
+	if ( rc == 0 )
+		rc = mdb_cursor_count( cursor, count );
+	mdb_cursor_close( cursor );
+	return rc;
+}
+
+/* Position cursor on the first exact ID >= *id */
+static int
+mdb_idl_exact_seek(
+	MDB_cursor	*cursor,
+	MDB_val		*ekey,
+	ID			*id )
+{
+	MDB_val data;
+	int rc;
+
+	data.mv_size = sizeof(ID);
+	data.mv_data = id;
+	rc = mdb_cursor_get( cursor, ekey, &data, MDB_GET_BOTH_RANGE );
+	if ( rc == 0 )
+		memcpy( id, data.mv_data, sizeof(ID) );
+	return rc;
+}
+
+/* Drop the IDs of list ids that are not among the exact IDs of k.
+ * ids is left untouched if k has no companion.
+ */
+int
+mdb_idl_exact_probe(
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	struct berval *k,
+	ID			*ids )
+{
+	MDB_cursor *cursor;
+	MDB_val ekey, data;
+	char ebuf[MDB_IDL_EXACT_KEYMAX];
+	ID i, j, x;
+	int rc;
+
+	assert( !MDB_IDL_IS_RANGE( ids ));
+
+	rc = mdb_idl_exact_bvkey( k, &ekey, ebuf );
+	if ( rc )
+		return MDB_NOTFOUND;
+
+	rc = mdb_cursor_open( txn, dbi, &cursor );
+	if ( rc )
+		return rc;
+	rc = mdb_cursor_get( cursor, &ekey, &data, MDB_SET );
+	if ( rc )
+		goto done;
+
+	for ( i = 1, j = 0; i <= ids[0]; ) {
+		x = ids[i];
+		rc = mdb_idl_exact_seek( cursor, &ekey, &x );
+		if ( rc )
+			break;
+		if ( x == ids[i] ) {
+			ids[++j] = x;
+			i++;
+		} else {
+			while ( i <= ids[0] && ids[i] < x )
+				i++;
+		}
+	}
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	if ( rc == 0 )
+		ids[0] = j;
+done:
+	mdb_cursor_close( cursor );
+	return rc;
+}
+
+/* Intersect the exact IDs of keys within range ids, into tmp.
+ * keys[0] should be the smallest; ids is only replaced if the
+ * result fits in an IDL.
+ */
+int
+mdb_idl_exact_join(
+	MDB_txn		*txn,
+	MDB_dbi		*dbis,
+	struct berval *keys,
+	int			nkeys,
+	ID			*ids,
+	ID			*tmp )
+{
+	MDB_cursor *cursors[MDB_IDL_EXACT_MAX];
+	MDB_val ekeys[MDB_IDL_EXACT_MAX], data;
+	char ebufs[MDB_IDL_EXACT_MAX][MDB_IDL_EXACT_KEYMAX];
+	ID x, y, hi;
+	int j, n, rc = 0;
+
+	assert( MDB_IDL_IS_RANGE( ids ));
+	assert( nkeys <= MDB_IDL_EXACT_MAX );
+
+	for ( n = 0; n < nkeys; n++ ) {
+		rc = mdb_idl_exact_bvkey( &keys[n], &ekeys[n], ebufs[n] );
+		if ( rc )
+			break;
+		rc = mdb_cursor_open( txn, dbis[n], &cursors[n] );
+		if ( rc )
+			break;
+		rc = mdb_cursor_get( cursors[n], &ekeys[n], &data, MDB_SET );
+		if ( rc ) {
+			n++;
+			break;
+		}
+	}
+	if ( rc )
+		goto done;
+
+	/* Leapfrog: each cursor in turn seeks to the largest ID seen
+	 * so far, until all of them agree on one.
+	 */
+	tmp[0] = 0;
+	x = MDB_IDL_RANGE_FIRST( ids );
+	hi = MDB_IDL_RANGE_LAST( ids );
+	for ( j = 0, n = 0; x <= hi; ) {
+		y = x;
+		rc = mdb_idl_exact_seek( cursors[j], &ekeys[j], &y );
+		if ( rc )
+			break;
+		if ( y != x ) {
+			x = y;
+			n = 0;
+		}
+		if ( ++n == nkeys ) {
+			if ( tmp[0] >= MDB_idl_um_max ) {
+				rc = -1;
+				break;
+			}
+			tmp[++tmp[0]] = x++;
+			n = 0;
+		}
+		if ( ++j == nkeys )
+			j = 0;
+	}
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	if ( rc == 0 )
+		MDB_IDL_CPY( ids, tmp );
+
+	n = nkeys;
+done:
+	while ( --n >= 0 )
+		mdb_cursor_close( cursors[n] );
+	return rc;
+}
+
+
+/* Lists whose sizes differ by more than this factor are intersected
+ * by galloping through the larger one instead of merging.
+ */
+#define IDL_GALLOP_RATIO	16
+
+/*
+ * return the first position >= pos in ids whose value is >= id,
+ * or ids[0]+1 if there is none
+ */
+static ID
+idl_gallop( ID *ids, ID pos, ID id )
+{
+	ID lo = pos, hi, step = 1, n = ids[0];
+
+	/* probe 1, 2, 4... elements ahead to bracket id */
+	while ( lo <= n && ids[lo] < id ) {
+		pos = lo + 1;
+		lo += step;
+		step <<= 1;
+	}
+	hi = lo <= n ? lo : n + 1;
+	lo = pos;
+
+	while ( lo < hi ) {
+		ID mid = lo + (( hi - lo ) >> 1 );
+		if ( ids[mid] < id )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
 
 /*
  * idl_intersection - return a = a intersection b
  */
-int
-mdb_idl_intersection(
+static int
+idl_intersection(
 	ID *a,
 	ID *b )
 {
@@ -757,23 +1213,51 @@ mdb_idl_intersection(
 		goto done;
 	}
 
-	/* Fine, do the intersection one element at a time.
-	 * First advance to idmin in both IDLs.
+	/* Advance to idmin in a; the result is written back into a,
+	 * never ahead of the element being read.
 	 */
-	cursora = cursorb = idmin;
-	ida = mdb_idl_first( a, &cursora );
-	idb = mdb_idl_first( b, &cursorb );
+	cursora = mdb_idl_search( a, idmin );
 	cursorc = 0;
 
-	while( ida <= idmax || idb <= idmax ) {
-		if( ida == idb ) {
-			a[++cursorc] = ida;
-			ida = mdb_idl_next( a, &cursora );
-			idb = mdb_idl_next( b, &cursorb );
-		} else if ( ida < idb ) {
-			ida = mdb_idl_next( a, &cursora );
-		} else {
-			idb = mdb_idl_next( b, &cursorb );
+	if ( MDB_IDL_IS_RANGE( b )) {
+		/* the part of a within idmin..idmax */
+		while ( cursora <= a[0] && a[cursora] <= idmax )
+			a[++cursorc] = a[cursora++];
+
+	} else if ( a[0] > b[0] * IDL_GALLOP_RATIO ) {
+		/* gallop through a for each of b's IDs */
+		for ( cursorb = mdb_idl_search( b, idmin );
+			cursorb <= b[0] && b[cursorb] <= idmax; cursorb++ ) {
+			cursora = idl_gallop( a, cursora, b[cursorb] );
+			if ( cursora > a[0] )
+				break;
+			if ( a[cursora] == b[cursorb] )
+				a[++cursorc] = a[cursora++];
+		}
+
+	} else if ( b[0] > a[0] * IDL_GALLOP_RATIO ) {
+		/* gallop through b for each of a's IDs */
+		cursorb = mdb_idl_search( b, idmin );
+		for ( ; cursora <= a[0] && a[cursora] <= idmax; cursora++ ) {
+			cursorb = idl_gallop( b, cursorb, a[cursora] );
+			if ( cursorb > b[0] )
+				break;
+			if ( b[cursorb] == a[cursora] )
+				a[++cursorc] = a[cursora];
+		}
+
+	} else {
+		/* Merge; both cursors step when the IDs are equal */
+		cursorb = mdb_idl_search( b, idmin );
+		while ( cursora <= a[0] && cursorb <= b[0] ) {
+			ida = a[cursora];
+			idb = b[cursorb];
+			if ( ida > idmax || idb > idmax )
+				break;
+			if ( ida == idb )
+				a[++cursorc] = ida;
+			cursora += ida <= idb;
+			cursorb += idb <= ida;
 		}
 	}
 	a[0] = cursorc;
@@ -785,11 +1269,26 @@ done:
 }
 
 
+int
+mdb_idl_intersection(
+	ID *a,
+	ID *b )
+{
+	slap_prof_ctx_t pc;
+	int rc;
+
+	SLAP_PROF_BEGIN( pc, SLAP_PROF_IDL );
+	rc = idl_intersection( a, b );
+	SLAP_PROF_END( pc, SLAP_PROF_IDL );
+	return rc;
+}
+
+
 /*
  * idl_union - return a = a union b
  */
-int
-mdb_idl_union(
+static int
+idl_union(
 	ID	*a,
 	ID	*b )
 {
@@ -814,48 +1313,72 @@ over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 		return 0;
 	}
 
-	ida = mdb_idl_first( a, &cursora );
-	idb = mdb_idl_first( b, &cursorb );
-
-	cursorc = b[0];
-
-	/* The distinct elements of a are cat'd to b */
-	while( ida != NOID || idb != NOID ) {
-		if ( ida < idb ) {
-			if( ++cursorc > MDB_idl_um_max ) {
-				goto over;
-			}
-			b[cursorc] = ida;
-			ida = mdb_idl_next( a, &cursora );
-
-		} else {
-			if ( ida == idb )
-				ida = mdb_idl_next( a, &cursora );
-			idb = mdb_idl_next( b, &cursorb );
-		}
+	/* Disjoint lists are just concatenated */
+	if ( MDB_IDL_LAST( a ) < MDB_IDL_FIRST( b )) {
+		if ( a[0] + b[0] > MDB_idl_um_max )
+			goto over;
+		AC_MEMCPY( a + a[0] + 1, b + 1, b[0] * sizeof(ID) );
+		a[0] += b[0];
+		return 0;
+	}
+	if ( MDB_IDL_LAST( b ) < MDB_IDL_FIRST( a )) {
+		if ( a[0] + b[0] > MDB_idl_um_max )
+			goto over;
+		AC_MEMCPY( a + b[0] + 1, a + 1, a[0] * sizeof(ID) );
+		AC_MEMCPY( a + 1, b + 1, b[0] * sizeof(ID) );
+		a[0] += b[0];
+		return 0;
 	}
 
-	/* b is copied back to a in sorted order */
+	/* Count the union first, so it can be merged in place from
+	 * the top down without overrunning a.
+	 */
+	cursora = cursorb = 1;
+	cursorc = 0;
+	while ( cursora <= a[0] && cursorb <= b[0] ) {
+		ida = a[cursora];
+		idb = b[cursorb];
+		cursora += ida <= idb;
+		cursorb += idb <= ida;
+		cursorc++;
+	}
+	cursorc += a[0] - cursora + 1;
+	cursorc += b[0] - cursorb + 1;
+	if ( cursorc > MDB_idl_um_max )
+		goto over;
+
+	cursora = a[0];
+	cursorb = b[0];
 	a[0] = cursorc;
-	cursora = 1;
-	cursorb = 1;
-	cursorc = b[0]+1;
-	while (cursorb <= b[0] || cursorc <= a[0]) {
-		if (cursorc > a[0])
-			idb = NOID;
-		else
-			idb = b[cursorc];
-		if (cursorb <= b[0] && b[cursorb] < idb)
-			a[cursora++] = b[cursorb++];
-		else {
-			a[cursora++] = idb;
-			cursorc++;
+	while ( cursorb > 0 ) {
+		idb = b[cursorb];
+		if ( cursora > 0 && a[cursora] >= idb ) {
+			ida = a[cursora--];
+			cursorb -= ida == idb;
+			a[cursorc--] = ida;
+		} else {
+			a[cursorc--] = idb;
+			cursorb--;
 		}
 	}
 
 	return 0;
 }
 
+int
+mdb_idl_union(
+	ID	*a,
+	ID	*b )
+{
+	slap_prof_ctx_t pc;
+	int rc;
+
+	SLAP_PROF_BEGIN( pc, SLAP_PROF_IDL );
+	rc = idl_union( a, b );
+	SLAP_PROF_END( pc, SLAP_PROF_IDL );
+	return rc;
+}
+
 
 #if 0
 /*
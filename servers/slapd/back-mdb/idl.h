@@ -27,6 +27,15 @@ extern unsigned int MDB_idl_um_size;
 extern unsigned int MDB_idl_db_max;
 extern unsigned int MDB_idl_um_max;
 
+/* Keys with more IDs than fit an IDL are stored as ranges.  With
+ * idlexact, their IDs are also kept under a companion key: the range
+ * key followed by MDB_IDL_EXACT_PAD zero bytes.  Being longer than
+ * any index key, companions are skipped by ordered index scans.
+ */
+#define MDB_IDL_EXACT_PAD	256
+#define MDB_IDL_EXACT_KEYMAX	511	/* LMDB's default max key size */
+#define MDB_IDL_EXACT_MAX	4	/* companions joined per AND filter */
+
 #define MDB_IDL_IS_RANGE(ids)	((ids)[0] == NOID)
 #define MDB_IDL_RANGE_SIZE		(3)
 #define MDB_IDL_RANGE_SIZEOF	(MDB_IDL_RANGE_SIZE * sizeof(ID))
@@ -87,6 +96,7 @@ typedef struct IdScopes {
 	ID id;
 	ID2L scopes;
 	ID2L sctmp;
+	ID2L noscope;	/* IDs known to be outside all scopes, or NULL */
 	int numrdns;
 	int nscope;
 	int oscope;
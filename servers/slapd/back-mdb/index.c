@@ -161,6 +161,37 @@ done:
 	return LDAP_SUCCESS;
 }
 
+/* Build the sort index key of VAL in BUF, of MDB_SORT_KEYMAX bytes */
+void
+mdb_sort_key( struct berval *val, char *buf, struct berval *key )
+{
+	ber_len_t len = val->bv_len;
+
+	if ( len > MDB_SORT_KEYMAX - MDB_SORT_PREFIXLEN )
+		len = MDB_SORT_KEYMAX - MDB_SORT_PREFIXLEN;
+	memcpy( buf, MDB_SORT_PREFIX, MDB_SORT_PREFIXLEN );
+	memcpy( buf + MDB_SORT_PREFIXLEN, val->bv_val, len );
+	len += MDB_SORT_PREFIXLEN;
+	key->bv_val = buf;
+	key->bv_len = ( len + sizeof( ID ) - 1 ) & ~( sizeof( ID ) - 1 );
+	memset( buf + len, 0, key->bv_len - len );
+}
+
+/* Build the range index key of the equality key KEY in BUF,
+ * of MDB_RANGE_KEYMAX bytes. KEY must satisfy MDB_RANGE_KEYOK() */
+void
+mdb_range_key( struct berval *key, char *buf, struct berval *rkey )
+{
+	ber_len_t len = key->bv_len - MDB_RANGE_SHIFT;
+
+	memcpy( buf, MDB_RANGE_PREFIX, MDB_RANGE_PREFIXLEN );
+	memcpy( buf + MDB_RANGE_PREFIXLEN, key->bv_val, len );
+	len += MDB_RANGE_PREFIXLEN;
+	rkey->bv_val = buf;
+	rkey->bv_len = ( len + sizeof( ID ) - 1 ) & ~( sizeof( ID ) - 1 );
+	memset( buf + len, 0, rkey->bv_len - len );
+}
+
 static int indexer(
 	Operation *op,
 	MDB_txn *txn,
@@ -180,6 +211,15 @@ static int indexer(
 
 	assert( mask != 0 );
 
+	if ( !txn ) {
+		/* online reindex, just collect the keys */
+		mdb_ixkeys *ik = (mdb_ixkeys *)LDAP_SLIST_FIRST(&op->o_extra);
+		ik->ik_ai = ai;
+		keyfunc = mdb_ixkeys_add;
+		mc = (MDB_cursor *)ik;
+		goto keys;
+	}
+
 	if ( !mc ) {
 		err = "c_open";
 		rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
@@ -197,10 +237,14 @@ static int indexer(
 			mc = (MDB_cursor *)ax;
 		} else
 #endif
+		if ( mdb_tool_sorting )
+			keyfunc = mdb_tool_sort_add;
+		else
 			keyfunc = mdb_idl_insert_keys;
 	} else
 		keyfunc = mdb_idl_delete_keys;
 
+keys:
 	if( IS_SLAP_INDEX( mask, SLAP_INDEX_PRESENT ) ) {
 		rc = keyfunc( op->o_bd, mc, presence_key, id );
 		if( rc ) {
@@ -219,6 +263,32 @@ static int indexer(
 
 		if( rc == LDAP_SUCCESS && keys != NULL ) {
 			rc = keyfunc( op->o_bd, mc, keys, id );
+			if ( rc == 0 && IS_SLAP_INDEX( mask, SLAP_INDEX_RANGE ) ) {
+				struct berval *rkeys;
+				char *kbuf;
+				int i, j;
+
+				for ( i = 0; !BER_BVISNULL( &keys[i] ); i++ ) ;
+				rkeys = op->o_tmpalloc( ( i + 1 ) * sizeof( struct berval ) +
+					i * MDB_RANGE_KEYMAX, op->o_tmpmemctx );
+				kbuf = (char *)( rkeys + i + 1 );
+				for ( i = j = 0; !BER_BVISNULL( &keys[i] ); i++ ) {
+					if ( !MDB_RANGE_KEYOK( &keys[i] ))
+						continue;
+					mdb_range_key( &keys[i], kbuf + j * MDB_RANGE_KEYMAX, &rkeys[j] );
+					j++;
+				}
+				BER_BVZERO( &rkeys[j] );
+
+				if ( j )
+					rc = keyfunc( op->o_bd, mc, rkeys, id );
+				op->o_tmpfree( rkeys, op->o_tmpmemctx );
+				if ( rc ) {
+					ber_bvarray_free_x( keys, op->o_tmpmemctx );
+					err = "range";
+					goto done;
+				}
+			}
 			ber_bvarray_free_x( keys, op->o_tmpmemctx );
 			if ( rc ) {
 				err = "equality";
@@ -268,8 +338,28 @@ static int indexer(
 		rc = LDAP_SUCCESS;
 	}
 
+	if( IS_SLAP_INDEX( mask, SLAP_INDEX_SORT ) ) {
+		char *kbuf;
+		int i;
+
+		for ( i = 0; !BER_BVISNULL( &vals[i] ); i++ ) ;
+		keys = op->o_tmpalloc( ( i + 1 ) * sizeof( struct berval ) +
+			i * MDB_SORT_KEYMAX, op->o_tmpmemctx );
+		kbuf = (char *)( keys + i + 1 );
+		for ( i = 0; !BER_BVISNULL( &vals[i] ); i++ )
+			mdb_sort_key( &vals[i], kbuf + i * MDB_SORT_KEYMAX, &keys[i] );
+		BER_BVZERO( &keys[i] );
+
+		rc = keyfunc( op->o_bd, mc, keys, id );
+		op->o_tmpfree( keys, op->o_tmpmemctx );
+		if( rc ) {
+			err = "sort";
+			goto done;
+		}
+	}
+
 done:
-	if ( !(slapMode & SLAP_TOOL_QUICK))
+	if ( txn && !(slapMode & SLAP_TOOL_QUICK))
 		mdb_cursor_close( mc );
 	switch( rc ) {
 	/* The callers all know how to deal with these results */
@@ -575,3 +665,199 @@ mdb_index_entry(
 
 	return LDAP_SUCCESS;
 }
+
+/* Collect keys for the online reindex. mc is really the
+ * mdb_ixkeys of the caller, set up by indexer().
+ */
+int
+mdb_ixkeys_add(
+	BackendDB *be,
+	MDB_cursor *mc,
+	struct berval *keys,
+	ID id )
+{
+	mdb_ixkeys *ik = (mdb_ixkeys *)mc;
+	mdb_ixkey *k;
+	int i;
+
+	for ( i = 0; keys[i].bv_val; i++ ) {
+		if ( ik->ik_nkeys == ik->ik_maxkeys ) {
+			ik->ik_maxkeys = ik->ik_maxkeys ? ik->ik_maxkeys * 2 : 256;
+			ik->ik_keys = ch_realloc( ik->ik_keys,
+				ik->ik_maxkeys * sizeof( mdb_ixkey * ));
+		}
+		k = ch_malloc( sizeof( mdb_ixkey ) + keys[i].bv_len );
+		k->ik_ai = ik->ik_ai;
+		k->ik_id = id;
+		k->ik_key.bv_len = keys[i].bv_len;
+		k->ik_key.bv_val = (char *)(k+1);
+		AC_MEMCPY( k->ik_key.bv_val, keys[i].bv_val, keys[i].bv_len );
+		ik->ik_keys[ik->ik_nkeys++] = k;
+	}
+	return 0;
+}
+
+/* Same order as the index DBs, so the writes walk each DB once */
+static int
+mdb_ixkey_cmp( const void *v1, const void *v2 )
+{
+	const mdb_ixkey *k1 = *(const mdb_ixkey **)v1;
+	const mdb_ixkey *k2 = *(const mdb_ixkey **)v2;
+	size_t len;
+	int rc;
+
+	if ( k1->ik_ai->ai_dbi != k2->ik_ai->ai_dbi )
+		return k1->ik_ai->ai_dbi < k2->ik_ai->ai_dbi ? -1 : 1;
+	len = k1->ik_key.bv_len < k2->ik_key.bv_len ?
+		k1->ik_key.bv_len : k2->ik_key.bv_len;
+	rc = memcmp( k1->ik_key.bv_val, k2->ik_key.bv_val, len );
+	if ( rc )
+		return rc;
+	if ( k1->ik_key.bv_len != k2->ik_key.bv_len )
+		return k1->ik_key.bv_len < k2->ik_key.bv_len ? -1 : 1;
+	if ( k1->ik_id != k2->ik_id )
+		return k1->ik_id < k2->ik_id ? -1 : 1;
+	return 0;
+}
+
+void
+mdb_ixkeys_free( mdb_ixkeys *ik )
+{
+	int i;
+
+	for ( i = 0; i < ik->ik_nkeys; i++ )
+		ch_free( ik->ik_keys[i] );
+	ch_free( ik->ik_keys );
+	ik->ik_keys = NULL;
+	ik->ik_nkeys = ik->ik_maxkeys = 0;
+}
+
+/* Write the keys collected in n mdb_ixkeys in key order, and
+ * free them.
+ */
+int
+mdb_ixkeys_write( Operation *op, MDB_txn *txn, mdb_ixkeys *ik, int n )
+{
+	mdb_ixkey **all, *k;
+	struct berval keys[2];
+	MDB_cursor *mc = NULL;
+	MDB_dbi dbi = 0;
+	int i, j, nkeys = 0, rc = 0;
+
+	for ( i = 0; i < n; i++ )
+		nkeys += ik[i].ik_nkeys;
+	if ( !nkeys )
+		return 0;
+
+	all = ch_malloc( nkeys * sizeof( mdb_ixkey * ));
+	for ( i = 0, j = 0; i < n; i++ ) {
+		AC_MEMCPY( all + j, ik[i].ik_keys, ik[i].ik_nkeys * sizeof( mdb_ixkey * ));
+		j += ik[i].ik_nkeys;
+		ik[i].ik_nkeys = 0;
+	}
+	qsort( all, nkeys, sizeof( mdb_ixkey * ), mdb_ixkey_cmp );
+
+	BER_BVZERO( &keys[1] );
+	for ( i = 0; i < nkeys && rc == 0; i++ ) {
+		k = all[i];
+		if ( !mc || dbi != k->ik_ai->ai_dbi ) {
+			if ( mc )
+				mdb_cursor_close( mc );
+			dbi = k->ik_ai->ai_dbi;
+			rc = mdb_cursor_open( txn, dbi, &mc );
+			if ( rc ) {
+				mc = NULL;
+				rc = LDAP_OTHER;
+				break;
+			}
+		}
+		/* the same key may come from several values */
+		if ( i && !mdb_ixkey_cmp( &all[i-1], &all[i] ))
+			continue;
+		keys[0] = k->ik_key;
+		rc = mdb_idl_insert_keys( op->o_bd, mc, keys, k->ik_id );
+	}
+	if ( mc )
+		mdb_cursor_close( mc );
+	for ( i = 0; i < nkeys; i++ )
+		ch_free( all[i] );
+	ch_free( all );
+	return rc;
+}
+
+#define MDB_READD_CHUNK	1024
+
+/* After the index keys of the deleted values dvals were removed,
+ * put back those of them that the remaining values vals also
+ * generate. Only the keys are compared, so the index itself is
+ * only written for the keys that really collided, instead of for
+ * every remaining value.
+ */
+int
+mdb_index_values_readd(
+	Operation *op,
+	MDB_txn *txn,
+	AttributeDescription *desc,
+	BerVarray dvals,
+	BerVarray vals,
+	ID id )
+{
+	mdb_ixkeys dk = { 0 }, vk = { 0 };
+	struct berval chunk[MDB_READD_CHUNK + 1];
+	char *need = NULL;
+	int i, j, left, rc;
+
+	if ( id == 0 || BER_BVISNULL( dvals ) || BER_BVISNULL( vals ))
+		return 0;
+
+	/* no txn, only collect the keys */
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &dk.ik_oe, oe_next );
+	rc = mdb_index_values( op, NULL, desc, dvals, id, SLAP_INDEX_ADD_OP );
+	LDAP_SLIST_REMOVE( &op->o_extra, &dk.ik_oe, OpExtra, oe_next );
+	if ( rc || !dk.ik_nkeys )
+		goto done;
+	qsort( dk.ik_keys, dk.ik_nkeys, sizeof( mdb_ixkey * ), mdb_ixkey_cmp );
+	need = ch_calloc( dk.ik_nkeys, 1 );
+	left = dk.ik_nkeys;
+
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &vk.ik_oe, oe_next );
+	while ( left && !BER_BVISNULL( vals )) {
+		for ( i = 0; i < MDB_READD_CHUNK && !BER_BVISNULL( vals ); i++ )
+			chunk[i] = *vals++;
+		BER_BVZERO( &chunk[i] );
+		rc = mdb_index_values( op, NULL, desc, chunk, id, SLAP_INDEX_ADD_OP );
+		for ( i = 0; !rc && left && i < vk.ik_nkeys; i++ ) {
+			mdb_ixkey **kp = bsearch( &vk.ik_keys[i], dk.ik_keys, dk.ik_nkeys,
+				sizeof( mdb_ixkey * ), mdb_ixkey_cmp );
+			if ( kp ) {
+				/* duplicates in dk were sorted next to each other */
+				for ( j = kp - dk.ik_keys; j && !mdb_ixkey_cmp( kp, &dk.ik_keys[j-1] ); j-- );
+				if ( !need[j] ) {
+					need[j] = 1;
+					left--;
+				}
+			}
+		}
+		mdb_ixkeys_free( &vk );
+		if ( rc )
+			break;
+	}
+	LDAP_SLIST_REMOVE( &op->o_extra, &vk.ik_oe, OpExtra, oe_next );
+
+	if ( !rc ) {
+		/* keep only the keys to write */
+		for ( i = 0, j = 0; i < dk.ik_nkeys; i++ ) {
+			if ( need[i] )
+				dk.ik_keys[j++] = dk.ik_keys[i];
+			else
+				ch_free( dk.ik_keys[i] );
+		}
+		dk.ik_nkeys = j;
+		rc = mdb_ixkeys_write( op, txn, &dk, 1 );
+	}
+
+done:
+	mdb_ixkeys_free( &dk );
+	ch_free( need );
+	return rc;
+}
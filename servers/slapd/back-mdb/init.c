@@ -22,6 +22,7 @@
 #include <ac/stdlib.h>
 #include <ac/errno.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include "back-mdb.h"
 #include <lutil.h>
 #include <ldap_rq.h>
@@ -63,6 +64,19 @@ mdb_db_init( BackendDB *be, ConfigReply *cr )
 
 	mdb->mi_mapsize = DEFAULT_MAPSIZE;
 	mdb->mi_rtxn_size = DEFAULT_RTXN_SIZE;
+	mdb->mi_dncache_size = DEFAULT_DNCACHE_SIZE;
+	mdb->mi_index_threads = 1;
+	mdb->mi_index_txn_size = DEFAULT_INDEX_TXN_SIZE;
+	ldap_pvt_thread_mutex_init( &mdb->mi_dncache_mutex );
+	ldap_pvt_thread_mutex_init( &mdb->mi_pcache_mutex );
+	ldap_pvt_thread_mutex_init( &mdb->mi_ecache_mutex );
+	LDAP_TAILQ_INIT( &mdb->mi_ecache_lru );
+	ldap_pvt_thread_mutex_init( &mdb->mi_cq_mutex );
+	ldap_pvt_thread_mutex_init( &mdb->mi_warmup_mutex );
+	ldap_pvt_thread_cond_init( &mdb->mi_cq_cond );
+	mdb->mi_cq_donetail = &mdb->mi_cq_done;
+	ldap_pvt_thread_mutex_init( &mdb->mi_gc_mutex );
+	ldap_pvt_thread_cond_init( &mdb->mi_gc_cond );
 	mdb->mi_multi_hi = UINT_MAX;
 	mdb->mi_multi_lo = UINT_MAX;
 
@@ -81,6 +95,229 @@ mdb_db_init( BackendDB *be, ConfigReply *cr )
 static int
 mdb_db_close( BackendDB *be, ConfigReply *cr );
 
+/* Read through the DN and attribute indices once, so the first
+ * searches after a restart don't fault them in a page at a time.
+ * With warmupentries the whole data file is read instead, in large
+ * sequential chunks. The work is split in portions, an index or a
+ * chunk each, claimed in turn by up to warmupthreads workers.
+ */
+#define MDB_WARMUP_CHUNK	(16 * 1048576)
+#define MDB_WARMUP_READ	1048576
+
+static int
+mdb_warmup_dbi( void *ctx, struct mdb_info *mdb, int i )
+{
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	struct berval last = BER_BVNULL;
+	MDB_cursor_op op = MDB_FIRST;
+	int n, rc;
+
+	do {
+		/* the config may have changed while we were paused */
+		if ( slapd_shutdown || i >= mdb->mi_nattrs ||
+			!( mdb->mi_flags & MDB_IS_OPEN )) {
+			rc = 0;
+			break;
+		}
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
+		if ( rc )
+			break;
+		rc = mdb_cursor_open( txn, i < 0 ? mdb->mi_dn2id :
+			mdb->mi_attrs[i]->ai_dbi, &mc );
+		if ( rc == 0 ) {
+			if ( op == MDB_GET_BOTH_RANGE ) {
+				/* continue where the last txn stopped */
+				key.mv_data = last.bv_val;
+				data.mv_data = last.bv_val + key.mv_size;
+			}
+			for ( n = 0; n < DEFAULT_RTXN_SIZE &&
+				( rc = mdb_cursor_get( mc, &key, &data, op )) == 0; n++ )
+				op = MDB_NEXT;
+			if ( rc == 0 ) {
+				last.bv_len = key.mv_size + data.mv_size;
+				last.bv_val = ch_realloc( last.bv_val, last.bv_len );
+				memcpy( last.bv_val, key.mv_data, key.mv_size );
+				memcpy( last.bv_val + key.mv_size, data.mv_data, data.mv_size );
+				op = MDB_GET_BOTH_RANGE;
+			}
+			mdb_cursor_close( mc );
+		}
+		mdb_txn_abort( txn );
+		/* let config changes through */
+		if ( ctx )
+			ldap_pvt_thread_pool_pausecheck( &connection_pool );
+	} while ( rc == 0 );
+
+	ch_free( last.bv_val );
+	return rc == MDB_NOTFOUND ? 0 : rc;
+}
+
+static int
+mdb_warmup_file( struct mdb_info *mdb, int i, char *buf, off_t size )
+{
+	off_t off = (off_t)i * MDB_WARMUP_CHUNK, end = off + MDB_WARMUP_CHUNK;
+	ssize_t len;
+	int fd;
+
+	if ( mdb_env_get_fd( mdb->mi_dbenv, &fd ))
+		return 0;
+	if ( end > size )
+		end = size;
+	for ( ; off < end && !slapd_shutdown; off += len ) {
+		len = end - off;
+		if ( len > MDB_WARMUP_READ )
+			len = MDB_WARMUP_READ;
+		len = pread( fd, buf, len, off );
+		if ( len <= 0 )
+			return len ? errno : 0;
+	}
+	return 0;
+}
+
+static void *
+mdb_warmup_worker( void *ctx, void *arg )
+{
+	BackendDB *be = arg;
+	struct mdb_info *mdb = be->be_private;
+	MDB_envinfo mei;
+	MDB_stat mst;
+	char *buf = NULL;
+	off_t size = 0;
+	int i, rc = 0;
+
+	if ( mdb->mi_warmup_entries ) {
+		mdb_env_info( mdb->mi_dbenv, &mei );
+		mdb_env_stat( mdb->mi_dbenv, &mst );
+		size = (off_t)( mei.me_last_pgno + 1 ) * mst.ms_psize;
+		buf = ch_malloc( MDB_WARMUP_READ );
+	}
+
+	for (;;) {
+		ldap_pvt_thread_mutex_lock( &mdb->mi_warmup_mutex );
+		i = mdb->mi_warmup_next++;
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_warmup_mutex );
+		if ( i >= mdb->mi_warmup_total || slapd_shutdown )
+			break;
+
+		if ( buf )
+			rc = mdb_warmup_file( mdb, i, buf, size );
+		else
+			rc = mdb_warmup_dbi( ctx, mdb, i - 1 );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_warmup) ": database %s: %s (%d)\n",
+				be->be_suffix[0].bv_val, buf ? STRERROR(rc) : mdb_strerror(rc), rc );
+			break;
+		}
+
+		ldap_pvt_thread_mutex_lock( &mdb->mi_warmup_mutex );
+		mdb->mi_warmup_done++;
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_warmup_mutex );
+	}
+	ch_free( buf );
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_warmup_mutex );
+	i = --mdb->mi_warmup_busy;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_warmup_mutex );
+	if ( i )
+		return NULL;
+
+	Debug( LDAP_DEBUG_STATS, LDAP_XSTRING(mdb_warmup)
+		": database %s: read %d of %d portions\n",
+		be->be_suffix[0].bv_val, mdb->mi_warmup_done, mdb->mi_warmup_total );
+
+	/* the last one out retires the task */
+	if ( ctx ) {
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+		if ( mdb->mi_warmup_task ) {
+			ldap_pvt_runqueue_stoptask( &slapd_rq, mdb->mi_warmup_task );
+			ldap_pvt_runqueue_remove( &slapd_rq, mdb->mi_warmup_task );
+			mdb->mi_warmup_task = NULL;
+		}
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	}
+
+	return NULL;
+}
+
+static void *
+mdb_warmup_thread( void *arg )
+{
+	return mdb_warmup_worker( NULL, arg );
+}
+
+/* Count the portions to read and get ready for THREADS workers */
+static void
+mdb_warmup_init( struct mdb_info *mdb, int threads )
+{
+	MDB_envinfo mei;
+	MDB_stat mst;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_warmup_mutex );
+	if ( mdb->mi_warmup_entries ) {
+		mdb_env_info( mdb->mi_dbenv, &mei );
+		mdb_env_stat( mdb->mi_dbenv, &mst );
+		mdb->mi_warmup_total = ( (off_t)( mei.me_last_pgno + 1 ) * mst.ms_psize +
+			MDB_WARMUP_CHUNK - 1 ) / MDB_WARMUP_CHUNK;
+	} else {
+		mdb->mi_warmup_total = 1 + mdb->mi_nattrs;
+	}
+	mdb->mi_warmup_next = 0;
+	mdb->mi_warmup_done = 0;
+	mdb->mi_warmup_busy = threads;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_warmup_mutex );
+}
+
+static void *
+mdb_warmup( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	BackendDB *be = rtask->arg;
+	struct mdb_info *mdb = be->be_private;
+	int i, threads = mdb->mi_warmup_threads > 1 ? mdb->mi_warmup_threads : 1;
+
+	mdb_warmup_init( mdb, threads );
+	for ( i = 1; i < threads; i++ ) {
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+			mdb_warmup_worker, be ) ) {
+			ldap_pvt_thread_mutex_lock( &mdb->mi_warmup_mutex );
+			mdb->mi_warmup_busy -= threads - i;
+			ldap_pvt_thread_mutex_unlock( &mdb->mi_warmup_mutex );
+			break;
+		}
+	}
+	return mdb_warmup_worker( ctx, be );
+}
+
+/* Warm up before the listeners are started: with native threads,
+ * since the pool doesn't run tasks yet.
+ */
+static void
+mdb_warmup_wait( BackendDB *be )
+{
+	struct mdb_info *mdb = be->be_private;
+	ldap_pvt_thread_t *tids;
+	int i, threads = mdb->mi_warmup_threads > 1 ? mdb->mi_warmup_threads : 1;
+
+	tids = ch_malloc( threads * sizeof( ldap_pvt_thread_t ));
+	mdb_warmup_init( mdb, threads );
+	for ( i = 1; i < threads; i++ ) {
+		if ( ldap_pvt_thread_create( &tids[i], 0, mdb_warmup_thread, be )) {
+			ldap_pvt_thread_mutex_lock( &mdb->mi_warmup_mutex );
+			mdb->mi_warmup_busy -= threads - i;
+			ldap_pvt_thread_mutex_unlock( &mdb->mi_warmup_mutex );
+			break;
+		}
+	}
+	threads = i;
+	mdb_warmup_thread( be );
+	for ( i = 1; i < threads; i++ )
+		ldap_pvt_thread_join( tids[i], NULL );
+	ch_free( tids );
+}
+
 static int
 mdb_db_open( BackendDB *be, ConfigReply *cr )
 {
@@ -111,6 +348,16 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		return -1;
 	}
 
+#ifndef HAVE_ZLIB
+	if ( mdb->mi_compress ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
+			"built without zlib, compress is ignored.\n",
+			be->be_suffix[0].bv_val );
+		mdb->mi_compress = 0;
+	}
+#endif
+
 	/* mdb is always clean */
 	be->be_flags |= SLAP_DBFLAG_CLEAN;
 
@@ -262,6 +509,9 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 			mdb_cursor_close( mc );
 			if ( rc == LDAP_OTHER )
 				goto fail;
+			/* locked in memory when txn commits */
+			if ( mdb->mi_pinbranches && !( slapMode & SLAP_TOOL_MODE ))
+				mdb_set_pinned( txn, mdb->mi_dbis[i], 1 );
 		}
 	}
 
@@ -271,10 +521,39 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
+	rc = mdb_alias_open( be, txn );
+	if ( rc ) {
+		snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+			"cannot open alias database: %s (%d).",
+			be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_db_open) ": %s\n",
+			cr->msg );
+		mdb_txn_abort( txn );
+		goto fail;
+	}
+
+	rc = mdb_dict_open( be, txn );
+	if ( rc ) {
+		snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+			"cannot open value dictionary: %s (%d).",
+			be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_db_open) ": %s\n",
+			cr->msg );
+		mdb_txn_abort( txn );
+		goto fail;
+	}
+
 	/* slapcat doesn't need indexes. avoid a failure if
 	 * a configured index wasn't created yet.
 	 */
 	if ( !(slapMode & SLAP_TOOL_READONLY) ) {
+		rc = mdb_ixhash_check( be, txn, cr );
+		if ( rc ) {
+			mdb_txn_abort( txn );
+			goto fail;
+		}
 		rc = mdb_attr_dbs_open( be, txn, cr );
 		if ( rc ) {
 			mdb_txn_abort( txn );
@@ -299,6 +578,21 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 
 	mdb->mi_flags |= MDB_IS_OPEN;
 
+	if ( mdb->mi_warmup && mdb->mi_warmup_wait &&
+		( slapMode & ( SLAP_SERVER_MODE|SLAP_SERVER_RUNNING )) == SLAP_SERVER_MODE ) {
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_db_open)
+			": database \"%s\": warming up\n",
+			be->be_suffix[0].bv_val );
+		mdb_warmup_wait( be );
+	} else if ( mdb->mi_warmup && !( slapMode & SLAP_TOOL_MODE )) {
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+		if ( !mdb->mi_warmup_task )
+			mdb->mi_warmup_task = ldap_pvt_runqueue_insert( &slapd_rq, 36000,
+				mdb_warmup, be, LDAP_XSTRING(mdb_warmup),
+				be->be_suffix[0].bv_val );
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	}
+
 	return 0;
 
 fail:
@@ -320,6 +614,10 @@ mdb_db_close( BackendDB *be, ConfigReply *cr )
 	if( mdb->mi_dbenv ) {
 		mdb_reader_flush( mdb->mi_dbenv );
 	}
+	mdb_dncache_purge( mdb );
+	mdb_pcache_flush( mdb );
+	mdb_coalesce_flush( mdb );
+	mdb_ecache_flush( mdb );
 
 	if ( mdb->mi_dbenv ) {
 		if ( mdb->mi_dbis[0] ) {
@@ -350,6 +648,154 @@ mdb_db_close( BackendDB *be, ConfigReply *cr )
 	return 0;
 }
 
+/* note readers of the environment in other processes */
+static int
+mdb_compact_reader( const char *msg, void *ctx )
+{
+	int *others = ctx;
+	int pid;
+
+	if ( sscanf( msg, "%d", &pid ) == 1 && pid != getpid() )
+		(*others)++;
+	return 0;
+}
+
+/* Write a compacted copy of the environment while it keeps serving
+ * requests. Writes are refused during the final pass, and the copy
+ * replaces the live data file only if no commit happened since the
+ * last copy started.
+ */
+static void *
+mdb_compact( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	BackendDB *be = rtask->arg;
+	struct mdb_info *mdb = be->be_private;
+	MDB_envinfo mei;
+	struct berval path, tmp;
+	ConfigReply cr = { 0 };
+	size_t txnid;
+	int fd, rc, others, tries;
+
+	path.bv_len = strlen( mdb->mi_dbenv_home ) + STRLENOF( "/data.mdb" );
+	path.bv_val = ch_malloc( 2 * path.bv_len + STRLENOF( ".compact" ) + 2 );
+	sprintf( path.bv_val, "%s/data.mdb", mdb->mi_dbenv_home );
+	tmp.bv_val = path.bv_val + path.bv_len + 1;
+	AC_MEMCPY( tmp.bv_val, path.bv_val, path.bv_len );
+	strcpy( tmp.bv_val + path.bv_len, ".compact" );
+	tmp.bv_len = path.bv_len + STRLENOF( ".compact" );
+
+	mdb_env_info( mdb->mi_dbenv, &mei );
+	txnid = mei.me_last_txnid;
+
+	for ( tries = 0; ; tries++ ) {
+		fd = open( tmp.bv_val, O_WRONLY|O_CREAT|O_TRUNC, mdb->mi_dbenv_mode );
+		if ( fd < 0 ) {
+			rc = errno;
+			break;
+		}
+		rc = mdb_env_copyfd2( mdb->mi_dbenv, fd, MDB_CP_COMPACT );
+		if ( rc == 0 && fsync( fd ))
+			rc = errno;
+		close( fd );
+		if ( rc || slapd_shutdown )
+			break;
+
+		/* the next copy, if any, must not race with new writers */
+		mdb->mi_compacting = 1;
+		slap_pause_server();
+
+		mdb_env_info( mdb->mi_dbenv, &mei );
+		if ( mei.me_last_txnid != txnid ) {
+			slap_unpause_server();
+			txnid = mei.me_last_txnid;
+			if ( tries + 1 < MDB_COMPACT_TRIES )
+				continue;
+			rc = MDB_BAD_TXN;
+			break;
+		}
+
+		others = 0;
+		mdb_reader_list( mdb->mi_dbenv, mdb_compact_reader, &others );
+		if ( others ) {
+			slap_unpause_server();
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_compact) ": database %s: "
+				"environment is in use by another process\n",
+				be->be_suffix[0].bv_val );
+			rc = EBUSY;
+			break;
+		}
+
+		ldap_pvt_thread_pool_purgekey( mdb->mi_dbenv );
+		mdb_db_close( be, NULL );
+		if ( rename( tmp.bv_val, path.bv_val ))
+			rc = errno;
+		/* txnids restart in the copy */
+		mdb->mi_dncache_txnid = 0;
+		if ( mdb_db_open( be, &cr )) {
+			/* same as a failed reopen after a config change */
+			slapd_shutdown = 2;
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_compact) ": database %s: "
+				"failed to reopen database: %s\n",
+				be->be_suffix[0].bv_val, cr.msg );
+		}
+		slap_unpause_server();
+		break;
+	}
+	mdb->mi_compacting = 0;
+
+	if ( rc ) {
+		unlink( tmp.bv_val );
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_compact) ": database %s: "
+			"compaction failed: %s (%d)\n",
+			be->be_suffix[0].bv_val, rc == MDB_BAD_TXN ?
+			"too many concurrent writes" : mdb_strerror(rc), rc );
+	} else {
+		Debug( LDAP_DEBUG_STATS,
+			LDAP_XSTRING(mdb_compact) ": database %s: compacted\n",
+			be->be_suffix[0].bv_val );
+	}
+	ch_free( path.bv_val );
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	mdb->mi_compact_task = NULL;
+	ldap_pvt_runqueue_remove( &slapd_rq, rtask );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	return NULL;
+}
+
+int
+mdb_compact_start( BackendDB *be, const char **text )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	int rc = LDAP_SUCCESS;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( !( mdb->mi_flags & MDB_IS_OPEN )) {
+		*text = "database is not open";
+		rc = LDAP_UNWILLING_TO_PERFORM;
+	} else if ( mdb->mi_compact_task ) {
+		*text = "database is already being compacted";
+		rc = LDAP_BUSY;
+	} else if ( mdb->mi_index_task ) {
+		*text = "database is being reindexed";
+		rc = LDAP_BUSY;
+	} else {
+		/* run once, as soon as possible */
+		mdb->mi_compact_task = ldap_pvt_runqueue_insert( &slapd_rq, 36000,
+			mdb_compact, be, LDAP_XSTRING(mdb_compact),
+			be->be_suffix[0].bv_val );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	return rc;
+}
+
 static int
 mdb_db_destroy( BackendDB *be, ConfigReply *cr )
 {
@@ -366,12 +812,31 @@ mdb_db_destroy( BackendDB *be, ConfigReply *cr )
 		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
 	}
 
+	/* and a warmup that never got to run */
+	if ( mdb->mi_warmup_task ) {
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+		if ( mdb->mi_warmup_task &&
+			!ldap_pvt_runqueue_isrunning( &slapd_rq, mdb->mi_warmup_task ))
+			ldap_pvt_runqueue_remove( &slapd_rq, mdb->mi_warmup_task );
+		mdb->mi_warmup_task = NULL;
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	}
+
 	/* monitor handling */
 	(void)mdb_monitor_db_destroy( be );
 
 	if( mdb->mi_dbenv_home ) ch_free( mdb->mi_dbenv_home );
+	if( mdb->mi_tool_sort_dir ) ch_free( mdb->mi_tool_sort_dir );
 
 	mdb_attr_index_destroy( mdb );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_dncache_mutex );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_pcache_mutex );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_ecache_mutex );
+	ldap_pvt_thread_cond_destroy( &mdb->mi_cq_cond );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_cq_mutex );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_warmup_mutex );
+	ldap_pvt_thread_cond_destroy( &mdb->mi_gc_cond );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_gc_mutex );
 
 	ch_free( mdb );
 	be->be_private = NULL;
@@ -458,6 +923,8 @@ mdb_back_initialize(
 	bi->bi_op_modify = mdb_modify;
 	bi->bi_op_modrdn = mdb_modrdn;
 	bi->bi_op_search = mdb_search;
+	bi->bi_op_abandon = mdb_coalesce_wake;
+	bi->bi_op_cancel = mdb_coalesce_wake;
 
 	bi->bi_op_unbind = 0;
 	bi->bi_op_txn = mdb_txn;
@@ -486,6 +953,7 @@ mdb_back_initialize(
 	bi->bi_tool_dn2id_get = mdb_tool_dn2id_get;
 	bi->bi_tool_entry_modify = mdb_tool_entry_modify;
 	bi->bi_tool_entry_delete = mdb_tool_entry_delete;
+	bi->bi_tool_bench = mdb_tool_bench;
 
 	bi->bi_connection_init = 0;
 	bi->bi_connection_destroy = 0;
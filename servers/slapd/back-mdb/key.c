@@ -39,12 +39,15 @@ mdb_key_read(
 {
 	int rc;
 	MDB_val key;
+	slap_prof_ctx_t pc;
 #ifndef MISALIGNED_OK
 	int kbuf[2];
 #endif
 
 	Debug( LDAP_DEBUG_TRACE, "=> key_read\n" );
 
+	SLAP_PROF_BEGIN( pc, SLAP_PROF_KEYREAD );
+
 #ifndef MISALIGNED_OK
 	if (k->bv_len & ALIGNER) {
 		key.mv_size = sizeof(kbuf);
@@ -60,6 +63,8 @@ mdb_key_read(
 
 	rc = mdb_idl_fetch_key( be, txn, dbi, &key, ids, saved_cursor, get_flag );
 
+	SLAP_PROF_END( pc, SLAP_PROF_KEYREAD );
+
 	if( rc != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_TRACE, "<= mdb_index_read: failed (%d)\n",
 			rc );
@@ -70,3 +75,114 @@ mdb_key_read(
 
 	return rc;
 }
+
+/* collect the IDs under all the keys from lo to hi */
+int
+mdb_key_range(
+	Backend	*be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *lo,
+	struct berval *hi,
+	ID *ids,
+	ID *tmp,
+	ID limit
+)
+{
+	int rc;
+	MDB_val lkey, hkey;
+#ifndef MISALIGNED_OK
+	int lbuf[2], hbuf[2];
+
+	if (lo->bv_len & ALIGNER) {
+		lkey.mv_size = hkey.mv_size = sizeof(lbuf);
+		lkey.mv_data = lbuf;
+		hkey.mv_data = hbuf;
+		lbuf[1] = hbuf[1] = 0;
+		memcpy(lbuf, lo->bv_val, lo->bv_len);
+		memcpy(hbuf, hi->bv_val, hi->bv_len);
+	} else
+#endif
+	{
+		lkey.mv_size = lo->bv_len;
+		lkey.mv_data = lo->bv_val;
+		hkey.mv_size = hi->bv_len;
+		hkey.mv_data = hi->bv_val;
+	}
+
+	Debug( LDAP_DEBUG_TRACE, "=> key_range\n" );
+
+	rc = mdb_idl_fetch_range( be, txn, dbi, &lkey, &hkey, ids, tmp, limit );
+
+	if( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_TRACE, "<= mdb_key_range: failed (%d)\n",
+			rc );
+	} else {
+		Debug( LDAP_DEBUG_TRACE, "<= mdb_key_range %ld candidates\n",
+			(long) MDB_IDL_N(ids) );
+	}
+
+	return rc;
+}
+
+/* estimate the number of IDs under a key, without reading them */
+int
+mdb_key_count(
+	Backend	*be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *k,
+	ID *count
+)
+{
+	int rc;
+	MDB_cursor *cursor;
+	MDB_val key, data;
+	size_t n;
+	ID lo, hi;
+#ifndef MISALIGNED_OK
+	int kbuf[2];
+
+	if (k->bv_len & ALIGNER) {
+		key.mv_size = sizeof(kbuf);
+		key.mv_data = kbuf;
+		kbuf[1] = 0;
+		memcpy(kbuf, k->bv_val, k->bv_len);
+	} else
+#endif
+	{
+		key.mv_size = k->bv_len;
+		key.mv_data = k->bv_val;
+	}
+
+	rc = mdb_cursor_open( txn, dbi, &cursor );
+	if ( rc )
+		return rc;
+
+	rc = mdb_cursor_get( cursor, &key, &data, MDB_SET );
+	if ( rc == MDB_NOTFOUND ) {
+		*count = 0;
+		rc = 0;
+	} else if ( rc == 0 ) {
+		memcpy( &lo, data.mv_data, sizeof(ID) );
+		if ( lo != 0 ) {
+			rc = mdb_cursor_count( cursor, &n );
+			*count = n;
+		} else if ( mdb_idl_exact_count( txn, dbi, k, &n ) == 0 ) {
+			*count = n;
+		} else {
+			/* a range: its span is the best we know */
+			rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT_DUP );
+			if ( rc == 0 ) {
+				memcpy( &lo, data.mv_data, sizeof(ID) );
+				rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT_DUP );
+			}
+			if ( rc == 0 ) {
+				memcpy( &hi, data.mv_data, sizeof(ID) );
+				*count = hi - lo + 1;
+			}
+		}
+	}
+	mdb_cursor_close( cursor );
+	return rc;
+}
@@ -56,7 +56,8 @@ mdb_modify_idxflags(
 			 *
 			 * In 2.5 use refcounts and avoid all of this mess.
 			 */
-			if (!slap_hash64(-1) || (ai->ai_indexmask & SLAP_INDEX_SUBSTR)) {
+			if (slap_hash_generation() == SLAP_IXHASH_GEN_FNV32 ||
+				(ai->ai_indexmask & SLAP_INDEX_SUBSTR)) {
 				/* Find all other attrs that index to same slot */
 				for ( ap = newattrs; ap; ap = ap->a_next ) {
 					ai = mdb_index_mask( op->o_bd, ap->a_desc, &ix2 );
@@ -74,6 +75,231 @@ mdb_modify_idxflags(
 	}
 }
 
+/* Big multi-valued attributes whose values are kept in equality
+ * order. Their values need not be copied to modify them.
+ */
+#define MDB_ATTR_LENDABLE(a) \
+	( ((a)->a_flags & (SLAP_ATTR_BIG_MULTI|SLAP_ATTR_SORTED_VALS)) == \
+		(SLAP_ATTR_BIG_MULTI|SLAP_ATTR_SORTED_VALS) && \
+	!((a)->a_desc->ad_type->sat_flags & SLAP_AT_ORDERED) && \
+	(a)->a_desc != slap_schema.si_ad_objectClass )
+
+/* The values of an entry read in a txn that this op began stay
+ * valid until the txn ends, since the pages they live on were
+ * clean and are copied before any write. A txn carried over from
+ * another op may already have dirtied them.
+ */
+static int
+mdb_modify_can_lend( Operation *op, struct mdb_info *mdb )
+{
+	OpExtra *oex;
+	mdb_op_info *moi;
+
+	if ( slapMode & SLAP_TOOL_MODE )
+		return 0;
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == mdb ) break;
+	}
+	moi = (mdb_op_info *)oex;
+	return moi && moi->moi_ref == 1 && !( moi->moi_flag & MOI_KEEPER );
+}
+
+/* Like attrs_dup(), but big multi-valued attributes only get their
+ * own value arrays; the values themselves are borrowed from the
+ * original entry, and those added by the modify are borrowed from
+ * the modlist. This saves copying every member of a large group to
+ * change one of them.
+ */
+static Attribute *
+mdb_attrs_dup( Attribute *a, int lend )
+{
+	Attribute *anew = NULL, **ap = &anew, *tmp;
+	size_t size;
+
+	for ( ; a; a = a->a_next ) {
+		if ( lend && MDB_ATTR_LENDABLE( a )) {
+			tmp = attr_alloc( a->a_desc );
+			tmp->a_flags = ( a->a_flags & SLAP_ATTR_PERSISTENT_FLAGS ) |
+				SLAP_ATTR_DONT_FREE_DATA;
+			tmp->a_numvals = a->a_numvals;
+			size = ( a->a_numvals + 1 ) * sizeof( struct berval );
+			tmp->a_vals = ch_malloc( size );
+			AC_MEMCPY( tmp->a_vals, a->a_vals, size );
+			if ( a->a_nvals != a->a_vals ) {
+				tmp->a_nvals = ch_malloc( size );
+				AC_MEMCPY( tmp->a_nvals, a->a_nvals, size );
+			} else {
+				tmp->a_nvals = tmp->a_vals;
+			}
+		} else {
+			tmp = attr_dup( a );
+		}
+		*ap = tmp;
+		ap = &tmp->a_next;
+	}
+	return anew;
+}
+
+/* Give a borrowing attribute its own copy of its values */
+static void
+mdb_attr_own( Attribute *a )
+{
+	struct berval bv;
+	unsigned i;
+
+	if ( !( a->a_flags & SLAP_ATTR_DONT_FREE_DATA ))
+		return;
+	for ( i = 0; i < a->a_numvals; i++ ) {
+		ber_dupbv( &bv, &a->a_vals[i] );
+		a->a_vals[i] = bv;
+		if ( a->a_nvals != a->a_vals ) {
+			ber_dupbv( &bv, &a->a_nvals[i] );
+			a->a_nvals[i] = bv;
+		}
+	}
+	a->a_flags ^= SLAP_ATTR_DONT_FREE_DATA;
+}
+
+/* Find where val goes among the first n sorted values of a */
+static unsigned
+mdb_vals_slot( Attribute *a, unsigned n, struct berval *val )
+{
+	MatchingRule *mr = a->a_desc->ad_type->sat_equality;
+	const char *text;
+	unsigned base = 0, pivot;
+	int match;
+
+	while ( n ) {
+		pivot = n >> 1;
+		value_match( &match, a->a_desc, mr, SLAP_MR_EQUALITY |
+			SLAP_MR_VALUE_OF_ASSERTION_SYNTAX |
+			SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH |
+			SLAP_MR_ATTRIBUTE_VALUE_NORMALIZED_MATCH,
+			&a->a_nvals[base + pivot], val, &text );
+		if ( match < 0 ) {
+			base += pivot + 1;
+			n -= pivot + 1;
+		} else {
+			n = pivot;
+		}
+	}
+	return base;
+}
+
+/* modify_add_values() for an attribute borrowing its values. The new
+ * values are sorted and merged into the old ones in a single pass,
+ * instead of being inserted one by one.
+ */
+static int
+mdb_modify_add_big(
+	Attribute *a,
+	Modification *mod,
+	int permissive,
+	const char **text,
+	char *textbuf,
+	size_t textlen )
+{
+	Modifications tmp = { { 0 } };
+	struct berval *cvals;
+	BerVarray v2;
+	unsigned i, j, n, end, w, flags;
+	int rc, dup;
+
+	flags = SLAP_MR_EQUALITY | SLAP_MR_VALUE_OF_ASSERTION_SYNTAX;
+	if ( mod->sm_nvalues ) {
+		flags |= SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH |
+			SLAP_MR_ATTRIBUTE_VALUE_NORMALIZED_MATCH;
+		cvals = mod->sm_nvalues;
+	} else {
+		cvals = mod->sm_values;
+	}
+
+	/* keep the values that are really new */
+	tmp.sml_desc = mod->sm_desc;
+	tmp.sml_values = ch_malloc( ( mod->sm_numvals + 1 ) * sizeof( struct berval ));
+	if ( a->a_nvals != a->a_vals )
+		tmp.sml_nvalues = ch_malloc( ( mod->sm_numvals + 1 ) * sizeof( struct berval ));
+	for ( i = 0, n = 0; i < mod->sm_numvals; i++ ) {
+		rc = attr_valfind( a, flags, &cvals[i], NULL, NULL );
+		if ( rc == LDAP_SUCCESS ) {
+			if ( !permissive ) {
+				/* value already exists */
+				*text = textbuf;
+				snprintf( textbuf, textlen,
+					"modify/add: %s: value #%u already exists",
+					mod->sm_desc->ad_cname.bv_val, i );
+				rc = LDAP_TYPE_OR_VALUE_EXISTS;
+				goto done;
+			}
+			continue;
+		} else if ( rc != LDAP_NO_SUCH_ATTRIBUTE ) {
+			goto done;
+		}
+		tmp.sml_values[n] = mod->sm_values[i];
+		if ( tmp.sml_nvalues )
+			tmp.sml_nvalues[n] = cvals[i];
+		n++;
+	}
+	rc = LDAP_SUCCESS;
+	if ( !n )
+		goto done;
+	BER_BVZERO( &tmp.sml_values[n] );
+	if ( tmp.sml_nvalues )
+		BER_BVZERO( &tmp.sml_nvalues[n] );
+	tmp.sml_numvals = n;
+	if ( n > 1 ) {
+		rc = slap_sort_vals( &tmp, text, &dup, NULL );
+		if ( rc ) {
+			*text = textbuf;
+			snprintf( textbuf, textlen,
+				"modify/add: %s: merge error (%d)",
+				mod->sm_desc->ad_cname.bv_val, rc );
+			rc = LDAP_OTHER;
+			goto done;
+		}
+	}
+
+	a->a_vals = ch_realloc( a->a_vals,
+		( a->a_numvals + n + 1 ) * sizeof( struct berval ));
+	if ( tmp.sml_nvalues ) {
+		a->a_nvals = ch_realloc( a->a_nvals,
+			( a->a_numvals + n + 1 ) * sizeof( struct berval ));
+		v2 = tmp.sml_nvalues;
+	} else {
+		a->a_nvals = a->a_vals;
+		v2 = tmp.sml_values;
+	}
+
+	/* merge from the top, moving each run of old values once */
+	end = a->a_numvals;
+	w = a->a_numvals + n;
+	for ( j = n; j-- > 0; ) {
+		i = mdb_vals_slot( a, end, &v2[j] );
+		if ( i < end ) {
+			w -= end - i;
+			AC_MEMCPY( &a->a_vals[w], &a->a_vals[i],
+				( end - i ) * sizeof( struct berval ));
+			if ( a->a_nvals != a->a_vals )
+				AC_MEMCPY( &a->a_nvals[w], &a->a_nvals[i],
+					( end - i ) * sizeof( struct berval ));
+			end = i;
+		}
+		w--;
+		a->a_vals[w] = tmp.sml_values[j];
+		if ( a->a_nvals != a->a_vals )
+			a->a_nvals[w] = v2[j];
+	}
+	a->a_numvals += n;
+	BER_BVZERO( &a->a_vals[a->a_numvals] );
+	if ( a->a_nvals != a->a_vals )
+		BER_BVZERO( &a->a_nvals[a->a_numvals] );
+
+done:
+	ch_free( tmp.sml_values );
+	ch_free( tmp.sml_nvalues );
+	return rc;
+}
+
 int mdb_modify_internal(
 	Operation *op,
 	MDB_txn *tid,
@@ -94,6 +320,7 @@ int mdb_modify_internal(
 	int			got_delete;
 	int			a_flags;
 	MDB_cursor	*mvc = NULL;
+	int			lend;
 
 	Debug( LDAP_DEBUG_TRACE, "mdb_modify_internal: 0x%08lx: %s\n",
 		e->e_id, e->e_dn );
@@ -104,7 +331,8 @@ int mdb_modify_internal(
 
 	/* save_attrs will be disposed of by caller */
 	save_attrs = e->e_attrs;
-	e->e_attrs = attrs_dup( e->e_attrs );
+	lend = mdb_modify_can_lend( op, mdb );
+	e->e_attrs = mdb_attrs_dup( e->e_attrs, lend );
 
 	for ( ml = modlist; ml != NULL; ml = ml->sml_next ) {
 		int match;
@@ -157,8 +385,12 @@ int mdb_modify_internal(
 				mod->sm_desc->ad_cname.bv_val );
 
 do_add:
-			err = modify_add_values( e, mod, get_permissiveModify(op),
-				text, textbuf, textlen );
+			if ( aold && ( a_flags & SLAP_ATTR_DONT_FREE_DATA ))
+				err = mdb_modify_add_big( aold, mod, get_permissiveModify(op),
+					text, textbuf, textlen );
+			else
+				err = modify_add_values( e, mod, get_permissiveModify(op),
+					text, textbuf, textlen );
 
 			if( softop ) {
 				mod->sm_op = SLAP_MOD_SOFTADD;
@@ -324,6 +556,8 @@ do_del:
 			Debug(LDAP_DEBUG_ARGS,
 				"mdb_modify_internal: increment %s\n",
 				mod->sm_desc->ad_cname.bv_val );
+			if ( aold )
+				mdb_attr_own( aold );
 			err = modify_increment_values( e, mod, get_permissiveModify(op),
 				text, textbuf, textlen );
 			if( err != LDAP_SUCCESS ) {
@@ -443,7 +677,7 @@ do_del:
 	/* start with deleting the old index entries */
 	for ( ap = save_attrs; ap != NULL; ap = ap->a_next ) {
 		if ( ap->a_flags & SLAP_ATTR_IXDEL ) {
-			struct berval *vals;
+			struct berval *vals, *avals = NULL;
 			Attribute *a2;
 			ap->a_flags &= ~SLAP_ATTR_IXDEL;
 			a2 = attr_find( e->e_attrs, ap->a_desc );
@@ -456,12 +690,56 @@ do_del:
 				vals = op->o_tmpalloc( (ap->a_numvals + 1) *
 					sizeof(struct berval), op->o_tmpmemctx );
 				j = 0;
-				for ( i=0; i < ap->a_numvals; i++ ) {
-					rc = attr_valfind( a2, SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH,
-						&ap->a_nvals[i], NULL, op->o_tmpmemctx );
-					/* Save deleted values */
-					if ( rc == LDAP_NO_SUCH_ATTRIBUTE )
-						vals[j++] = ap->a_nvals[i];
+				if ( ( ap->a_flags & a2->a_flags & SLAP_ATTR_SORTED_VALS ) &&
+					ap->a_desc->ad_type->sat_equality ) {
+					/* both in the same order, walk them together.
+					 * If the remaining values need their index
+					 * entries readded, also find the added ones.
+					 */
+					MatchingRule *mr = ap->a_desc->ad_type->sat_equality;
+					const char *mtext;
+					unsigned k = 0, n = 0;
+					int match;
+					if ( a2->a_flags & SLAP_ATTR_IXADD )
+						avals = op->o_tmpalloc( (a2->a_numvals + 1) *
+							sizeof(struct berval), op->o_tmpmemctx );
+					for ( i=0; i < ap->a_numvals; i++ ) {
+						match = 1;
+						while ( k < a2->a_numvals ) {
+							/* borrowed values are the same */
+							if ( a2->a_nvals[k].bv_val == ap->a_nvals[i].bv_val ) {
+								match = 0;
+							} else {
+								value_match( &match, ap->a_desc, mr,
+									SLAP_MR_EQUALITY | SLAP_MR_VALUE_OF_ASSERTION_SYNTAX |
+									SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH |
+									SLAP_MR_ATTRIBUTE_VALUE_NORMALIZED_MATCH,
+									&a2->a_nvals[k], &ap->a_nvals[i], &mtext );
+							}
+							if ( match >= 0 )
+								break;
+							if ( avals )
+								avals[n++] = a2->a_nvals[k];
+							k++;
+						}
+						if ( match == 0 )
+							k++;
+						else
+							vals[j++] = ap->a_nvals[i];
+					}
+					if ( avals ) {
+						while ( k < a2->a_numvals )
+							avals[n++] = a2->a_nvals[k++];
+						BER_BVZERO(avals+n);
+					}
+				} else {
+					for ( i=0; i < ap->a_numvals; i++ ) {
+						rc = attr_valfind( a2, SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH,
+							&ap->a_nvals[i], NULL, op->o_tmpmemctx );
+						/* Save deleted values */
+						if ( rc == LDAP_NO_SUCH_ATTRIBUTE )
+							vals[j++] = ap->a_nvals[i];
+					}
 				}
 				BER_BVZERO(vals+j);
 			} else {
@@ -480,6 +758,29 @@ do_del:
 					e->e_attrs = save_attrs;
 				}
 			}
+			if ( avals ) {
+				/* index the added values, and readd only the keys
+				 * that deleted and remaining values have in common
+				 */
+				if ( !rc && !BER_BVISNULL( avals ))
+					rc = mdb_index_values( op, tid, ap->a_desc,
+						avals, e->e_id, SLAP_INDEX_ADD_OP );
+				if ( !rc )
+					rc = mdb_index_values_readd( op, tid, ap->a_desc,
+						vals, a2->a_nvals, e->e_id );
+				if ( rc ) {
+					if ( e->e_attrs != save_attrs ) {
+						Debug( LDAP_DEBUG_ANY,
+							"%s: attribute \"%s\" index add failure\n",
+							op->o_log_prefix, ap->a_desc->ad_cname.bv_val );
+						attrs_free( e->e_attrs );
+						e->e_attrs = save_attrs;
+					}
+				} else {
+					a2->a_flags &= ~(SLAP_ATTR_IXADD|SLAP_ATTR_IXDEL);
+				}
+				op->o_tmpfree( avals, op->o_tmpmemctx );
+			}
 			if ( vals != ap->a_nvals )
 				op->o_tmpfree( vals, op->o_tmpmemctx );
 			if ( rc ) return rc;
@@ -585,8 +886,12 @@ mdb_modify( Operation *op, SlapReply *rs )
 		Debug( LDAP_DEBUG_TRACE,
 			LDAP_XSTRING(mdb_modify) ": txn_begin failed: "
 			"%s (%d)\n", mdb_strerror(rs->sr_err), rs->sr_err );
-		rs->sr_err = LDAP_OTHER;
-		rs->sr_text = "internal error";
+		if ( rs->sr_err == LDAP_BUSY ) {
+			rs->sr_text = "database is being compacted";
+		} else {
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "internal error";
+		}
 		goto return_results;
 	}
 	txn = moi->moi_txn;
@@ -749,7 +1054,7 @@ mdb_modify( Operation *op, SlapReply *rs )
 			txn = NULL;
 			goto return_results;
 		} else {
-			rs->sr_err = mdb_txn_commit( txn );
+			rs->sr_err = mdb_op_commit( op, moi );
 			if ( rs->sr_err )
 				mdb->mi_numads = numads;
 			txn = NULL;
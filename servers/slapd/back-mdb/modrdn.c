@@ -71,8 +71,12 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 		Debug( LDAP_DEBUG_TRACE,
 			LDAP_XSTRING(mdb_modrdn) ": txn_begin failed: "
 			"%s (%d)\n", mdb_strerror(rs->sr_err), rs->sr_err );
-		rs->sr_err = LDAP_OTHER;
-		rs->sr_text = "internal error";
+		if ( rs->sr_err == LDAP_BUSY ) {
+			rs->sr_text = "database is being compacted";
+		} else {
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "internal error";
+		}
 		goto return_results;
 	}
 	txn = moi->moi_txn;
@@ -539,7 +543,7 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 			goto return_results;
 
 		} else {
-			if(( rs->sr_err=mdb_txn_commit( txn )) != 0 ) {
+			if(( rs->sr_err=mdb_op_commit( op, moi )) != 0 ) {
 				rs->sr_text = "txn_commit failed";
 			} else {
 				rs->sr_err = LDAP_SUCCESS;
@@ -50,6 +50,19 @@ static AttributeDescription *ad_olmMDBReadersMax,
 
 static AttributeDescription *ad_olmMDBEntries;
 
+static AttributeDescription *ad_olmMDBIndexPending;
+
+static AttributeDescription *ad_olmMDBGroupSyncs;
+
+static AttributeDescription *ad_olmMDBReaderLag, *ad_olmMDBPagesPinned,
+	*ad_olmMDBReaderTxns;
+
+static AttributeDescription *ad_olmMDBCompact;
+
+static AttributeDescription *ad_olmMDBIndexStats, *ad_olmMDBFilterShapes;
+
+static AttributeDescription *ad_olmMDBWarmupDone;
+
 /*
  * NOTE: there's some confusion in monitor OID arc;
  * by now, let's consider:
@@ -143,6 +156,79 @@ static struct {
 		"NO-USER-MODIFICATION "
 		"USAGE dSAOperation )",
 		&ad_olmMDBEntries },
+
+	{ "( olmMDBAttributes:7 "
+		"NAME ( 'olmMDBIndexPending' ) "
+		"DESC 'Number of entries left to reindex online' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBIndexPending },
+
+	{ "( olmMDBAttributes:8 "
+		"NAME ( 'olmMDBGroupSyncs' ) "
+		"DESC 'Number of syncs done for group commits' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBGroupSyncs },
+
+	{ "( olmMDBAttributes:9 "
+		"NAME ( 'olmMDBReaderLag' ) "
+		"DESC 'Number of txns committed since the oldest reader began' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBReaderLag },
+
+	{ "( olmMDBAttributes:10 "
+		"NAME ( 'olmMDBPagesPinned' ) "
+		"DESC 'Number of free pages that readers keep from being reused' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBPagesPinned },
+
+	{ "( olmMDBAttributes:11 "
+		"NAME ( 'olmMDBReaderTxns' ) "
+		"DESC 'Process, thread, txnid and lag of each active reader' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBReaderTxns },
+
+	{ "( olmMDBAttributes:12 "
+		"NAME ( 'olmMDBCompact' ) "
+		"DESC 'Set to TRUE to compact the database; TRUE while it runs' "
+		"EQUALITY booleanMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.7 "
+		"SINGLE-VALUE "
+		"USAGE dSAOperation )",
+		&ad_olmMDBCompact },
+
+	{ "( olmMDBAttributes:13 "
+		"NAME ( 'olmMDBIndexStats' ) "
+		"DESC 'Lookups, mean IDs found, ranges and time of each index' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBIndexStats },
+
+	{ "( olmMDBAttributes:14 "
+		"NAME ( 'olmMDBFilterShapes' ) "
+		"DESC 'Most frequent filter shapes of poorly indexed searches' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBFilterShapes },
+
+	{ "( olmMDBAttributes:15 "
+		"NAME ( 'olmMDBWarmupDone' ) "
+		"DESC 'Percentage of the database read by the last warmup' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBWarmupDone },
 	{ NULL }
 };
 
@@ -162,12 +248,289 @@ static struct {
 #endif /* MDB_MONITOR_IDX */
 			"$ olmMDBPagesMax $ olmMDBPagesUsed $ olmMDBPagesFree "
 			"$ olmMDBReadersMax $ olmMDBReadersUsed $ olmMDBEntries "
+			"$ olmMDBIndexPending $ olmMDBGroupSyncs "
+			"$ olmMDBReaderLag $ olmMDBPagesPinned $ olmMDBReaderTxns "
+			"$ olmMDBCompact $ olmMDBIndexStats $ olmMDBFilterShapes "
+			"$ olmMDBWarmupDone "
 			") )",
 		&oc_olmMDBDatabase },
 
 	{ NULL }
 };
 
+typedef struct mdb_monitor_readers {
+	BerVarray	mr_txns;
+	size_t		mr_last;	/* last committed txnid */
+	size_t		mr_oldest;
+} mdb_monitor_readers;
+
+/* collect the active readers from the lines of mdb_reader_list() */
+static int
+mdb_monitor_reader( const char *msg, void *ctx )
+{
+	mdb_monitor_readers *mr = ctx;
+	char buf[ BUFSIZ ];
+	struct berval bv;
+	int pid;
+	char tid[ 32 ];
+	size_t txnid;
+
+	if ( sscanf( msg, "%d %31s %zu", &pid, tid, &txnid ) != 3 )
+		return 0;	/* header, or an idle reader slot */
+	if ( txnid < mr->mr_oldest )
+		mr->mr_oldest = txnid;
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "pid=%d thread=%s txnid=%zu lag=%zu",
+		pid, tid, txnid, mr->mr_last > txnid ? mr->mr_last - txnid : 0 );
+	value_add_one( &mr->mr_txns, &bv );
+	return 0;
+}
+
+static const char *mdb_idxstat_names[] = { "pres", "eq", "approx", "sub" };
+
+/* one value per index type in use */
+static BerVarray
+mdb_monitor_idxstats( struct mdb_info *mdb )
+{
+	BerVarray vals = NULL;
+	char buf[ SLAP_TEXT_BUFLEN ];
+	struct berval bv;
+	mdb_idxstat *is;
+	int i, j;
+
+	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+		for ( j = 0; j < MDB_IDXSTAT_TYPES; j++ ) {
+			is = &mdb->mi_attrs[i]->ai_stats[j];
+			if ( !is->is_lookups )
+				continue;
+			bv.bv_val = buf;
+			bv.bv_len = snprintf( buf, sizeof( buf ),
+				"%s#%s lookups=%lu avgids=%lu ranges=%lu usec=%lu",
+				mdb->mi_attrs[i]->ai_desc->ad_cname.bv_val,
+				mdb_idxstat_names[j], is->is_lookups,
+				is->is_ids / is->is_lookups, is->is_ranges, is->is_usec );
+			value_add_one( &vals, &bv );
+		}
+	}
+	return vals;
+}
+
+typedef struct mdb_shape_buf {
+	char	sb_shape[ SLAP_TEXT_BUFLEN ];
+	char	sb_unidx[ SLAP_TEXT_BUFLEN ];
+	int	sb_slen;
+	int	sb_ulen;
+} mdb_shape_buf;
+
+/* append, truncating at SLAP_TEXT_BUFLEN */
+static void
+mdb_shape_cat( char *buf, int *len, const char *s )
+{
+	int n = snprintf( buf + *len, SLAP_TEXT_BUFLEN - *len, "%s", s );
+
+	if ( n >= SLAP_TEXT_BUFLEN - *len )
+		n = SLAP_TEXT_BUFLEN - 1 - *len;
+	*len += n;
+}
+
+/*
+ * The filter with its values replaced by '?', and in sb_unidx the
+ * indexes its leaves would need but lack, as attr#type,...
+ */
+static void
+mdb_shape_walk( Backend *be, Filter *f, mdb_shape_buf *sb )
+{
+	AttributeDescription *ad = NULL;
+	AttrInfo *ai;
+	Filter *sf;
+	char need[ SLAP_TEXT_BUFLEN ], *p;
+	int slot;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen, "(?=undefined)" );
+		return;
+	}
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen,
+			f->f_choice == LDAP_FILTER_AND ? "(&" : "(|" );
+		for ( sf = f->f_list; sf; sf = sf->f_next )
+			mdb_shape_walk( be, sf, sb );
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen, ")" );
+		return;
+
+	case LDAP_FILTER_NOT:
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen, "(!" );
+		mdb_shape_walk( be, f->f_not, sb );
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen, ")" );
+		return;
+
+	case SLAPD_FILTER_COMPUTED:
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen,
+			f->f_result == LDAP_COMPARE_TRUE ? "(?=true)" :
+			f->f_result == LDAP_COMPARE_FALSE ? "(?=false)" :
+			"(?=undefined)" );
+		return;
+
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		break;
+	case LDAP_FILTER_EXT:
+		ad = f->f_mr_desc;
+		break;
+	default:
+		ad = f->f_av_desc;
+		break;
+	}
+
+	mdb_shape_cat( sb->sb_shape, &sb->sb_slen, "(" );
+	if ( ad )
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen, ad->ad_cname.bv_val );
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_PRESENT:
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen, "=*)" );
+		break;
+	case LDAP_FILTER_EQUALITY:
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen, "=?)" );
+		break;
+	case LDAP_FILTER_GE:
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen, ">=?)" );
+		break;
+	case LDAP_FILTER_LE:
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen, "<=?)" );
+		break;
+	case LDAP_FILTER_APPROX:
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen, "~=?)" );
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen,
+			BER_BVISNULL( &f->f_sub_initial ) ? "=*" : "=?*" );
+		if ( f->f_sub_any ) {
+			int i;
+			for ( i = 0; !BER_BVISNULL( &f->f_sub_any[i] ); i++ )
+				mdb_shape_cat( sb->sb_shape, &sb->sb_slen, "?*" );
+		}
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen,
+			BER_BVISNULL( &f->f_sub_final ) ? ")" : "?)" );
+		break;
+	case LDAP_FILTER_EXT:
+		if ( f->f_mr_dnattrs )
+			mdb_shape_cat( sb->sb_shape, &sb->sb_slen, ":dn" );
+		if ( !BER_BVISEMPTY( &f->f_mr_rule_text )) {
+			mdb_shape_cat( sb->sb_shape, &sb->sb_slen, ":" );
+			mdb_shape_cat( sb->sb_shape, &sb->sb_slen,
+				f->f_mr_rule_text.bv_val );
+		}
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen, ":=?)" );
+		break;
+	default:
+		mdb_shape_cat( sb->sb_shape, &sb->sb_slen, "=?)" );
+		break;
+	}
+
+	slot = mdb_filter_index( be, f, &ai );
+	if ( slot < 0 || ai != NULL )
+		return;
+
+	/* list each missing index once */
+	snprintf( need, sizeof( need ), "%s#%s",
+		ad->ad_cname.bv_val, mdb_idxstat_names[slot] );
+	for ( p = sb->sb_unidx; ( p = strstr( p, need )) != NULL; p++ ) {
+		if ( ( p == sb->sb_unidx || p[-1] == ',' ) &&
+			( p[strlen( need )] == ',' || p[strlen( need )] == '\0' ))
+			return;
+	}
+	if ( sb->sb_ulen )
+		mdb_shape_cat( sb->sb_unidx, &sb->sb_ulen, "," );
+	mdb_shape_cat( sb->sb_unidx, &sb->sb_ulen, need );
+}
+
+/*
+ * Called at the end of a search that went through ncand candidates
+ * to return nentries; keeps the filter's shape if the ratio is poor.
+ * The MDB_SHAPES most frequent shapes are kept with the Space-Saving
+ * scheme: a new shape takes the place of the least frequent one and
+ * inherits its count, so it stays long enough to prove itself.
+ */
+void
+mdb_monitor_search_add( Operation *op, ID ncand, int nentries )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_shape_buf sb;
+	mdb_shape *ms = NULL, *min = NULL;
+	int i;
+
+	if ( !mdb->mi_monitor.mdm_cb || ncand < MDB_SHAPE_MINCAND ||
+		(unsigned long)nentries * MDB_SHAPE_RATIO >= ncand )
+		return;
+
+	sb.sb_shape[0] = sb.sb_unidx[0] = '\0';
+	sb.sb_slen = sb.sb_ulen = 0;
+	mdb_shape_walk( op->o_bd, op->ors_filter, &sb );
+	if ( sb.sb_ulen ) {
+		mdb_shape_cat( sb.sb_shape, &sb.sb_slen, " unindexed=" );
+		mdb_shape_cat( sb.sb_shape, &sb.sb_slen, sb.sb_unidx );
+	}
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_shape_mutex );
+	for ( i = 0; i < MDB_SHAPES; i++ ) {
+		ms = &mdb->mi_shapes[i];
+		if ( !ms->ms_shape || !strcmp( ms->ms_shape, sb.sb_shape ))
+			break;
+		if ( !min || ms->ms_count < min->ms_count )
+			min = ms;
+	}
+	if ( i == MDB_SHAPES ) {
+		ms = min;
+		ch_free( ms->ms_shape );
+		ms->ms_shape = NULL;
+		ms->ms_searches = ms->ms_cands = ms->ms_returned = 0;
+	}
+	if ( !ms->ms_shape )
+		ms->ms_shape = ch_strdup( sb.sb_shape );
+	ms->ms_count++;
+	ms->ms_searches++;
+	ms->ms_cands += ncand;
+	ms->ms_returned += nentries;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_shape_mutex );
+}
+
+/* the most frequent shapes first */
+static BerVarray
+mdb_monitor_shapes( struct mdb_info *mdb )
+{
+	BerVarray vals = NULL;
+	mdb_shape *top[ MDB_SHAPES ], *ms;
+	char buf[ SLAP_TEXT_BUFLEN * 2 ];
+	struct berval bv;
+	int i, j, n = 0;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_shape_mutex );
+	for ( i = 0; i < MDB_SHAPES && mdb->mi_shapes[i].ms_shape; i++ ) {
+		ms = &mdb->mi_shapes[i];
+		for ( j = n++; j > 0 && top[j - 1]->ms_count < ms->ms_count; j-- )
+			top[j] = top[j - 1];
+		top[j] = ms;
+	}
+	for ( i = 0; i < n && i < MDB_SHAPES_SHOWN; i++ ) {
+		ms = top[i];
+		bv.bv_val = buf;
+		bv.bv_len = snprintf( buf, sizeof( buf ),
+			"count=%lu candidates=%lu returned=%lu filter=%s",
+			ms->ms_count, ms->ms_cands / ms->ms_searches,
+			ms->ms_returned / ms->ms_searches, ms->ms_shape );
+		value_add_one( &vals, &bv );
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_shape_mutex );
+	return vals;
+}
+
 static int
 mdb_monitor_update(
 	Operation	*op,
@@ -182,6 +545,8 @@ mdb_monitor_update(
 	MDB_stat mst;
 	MDB_envinfo mei;
 	MDB_txn *txn;
+	mdb_monitor_readers readers;
+	BerVarray vals;
 	int rc;
 
 #ifdef MDB_MONITOR_IDX
@@ -216,21 +581,95 @@ mdb_monitor_update(
 	bv.bv_len = snprintf( buf, sizeof( buf ), "%u", mei.me_numreaders );
 	ber_bvreplace( &a->a_vals[ 0 ], &bv );
 
+	a = attr_find( e->e_attrs, ad_olmMDBIndexPending );
+	assert( a != NULL );
+	{
+		unsigned long total = mdb->mi_index_total, done = mdb->mi_index_done;
+		bv.bv_val = buf;
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%lu",
+			total > done ? total - done : 0 );
+		ber_bvreplace( &a->a_vals[ 0 ], &bv );
+	}
+
+	a = attr_find( e->e_attrs, ad_olmMDBGroupSyncs );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", mdb->mi_gc_syncs );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	/* list the readers before ours is added */
+	readers.mr_txns = NULL;
+	readers.mr_last = mei.me_last_txnid;
+	readers.mr_oldest = mei.me_last_txnid + 1;
+	mdb_reader_list( mdb->mi_dbenv, mdb_monitor_reader, &readers );
+
+	a = attr_find( e->e_attrs, ad_olmMDBReaderLag );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%zu",
+		readers.mr_txns ? readers.mr_last - readers.mr_oldest : 0 );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmMDBWarmupDone );
+	assert( a != NULL );
+	{
+		int total = mdb->mi_warmup_total, done = mdb->mi_warmup_done;
+		bv.bv_val = buf;
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%d",
+			total ? done * 100 / total : 0 );
+		ber_bvreplace( &a->a_vals[ 0 ], &bv );
+	}
+
+	a = attr_find( e->e_attrs, ad_olmMDBCompact );
+	assert( a != NULL );
+	ber_bvreplace( &a->a_vals[ 0 ], mdb->mi_compact_task ?
+		(struct berval *)&slap_true_bv : (struct berval *)&slap_false_bv );
+
+	attr_delete( &e->e_attrs, ad_olmMDBReaderTxns );
+	if ( readers.mr_txns ) {
+		attr_merge( e, ad_olmMDBReaderTxns, readers.mr_txns, NULL );
+		ber_bvarray_free( readers.mr_txns );
+	}
+
+	attr_delete( &e->e_attrs, ad_olmMDBIndexStats );
+	vals = mdb_monitor_idxstats( mdb );
+	if ( vals ) {
+		attr_merge( e, ad_olmMDBIndexStats, vals, NULL );
+		ber_bvarray_free( vals );
+	}
+
+	attr_delete( &e->e_attrs, ad_olmMDBFilterShapes );
+	vals = mdb_monitor_shapes( mdb );
+	if ( vals ) {
+		attr_merge( e, ad_olmMDBFilterShapes, vals, NULL );
+		ber_bvarray_free( vals );
+	}
+
 	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
 	if ( !rc ) {
 		MDB_cursor *cursor;
 		MDB_val key, data;
-		size_t pages = 0, *iptr;
+		size_t pages = 0, pinned = 0, *iptr, freed;
 
+		/* pages freed by txns a reader doesn't predate can't be reused */
 		rc = mdb_cursor_open( txn, 0, &cursor );
 		if ( !rc ) {
 			while (( rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT )) == 0 ) {
 				iptr = data.mv_data;
 				pages += *iptr;
+				memcpy( &freed, key.mv_data, sizeof( freed ));
+				if ( freed >= readers.mr_oldest )
+					pinned += *iptr;
 			}
 			mdb_cursor_close( cursor );
 		}
 
+		a = attr_find( e->e_attrs, ad_olmMDBPagesPinned );
+		assert( a != NULL );
+		bv.bv_val = buf;
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%zu", pinned );
+		ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
 		mdb_stat( txn, mdb->mi_id2entry, &mst );
 		a = attr_find( e->e_attrs, ad_olmMDBEntries );
 		assert( a != NULL );
@@ -249,7 +688,6 @@ mdb_monitor_update(
 	return SLAP_CB_CONTINUE;
 }
 
-#if 0	/* uncomment if required */
 static int
 mdb_monitor_modify(
 	Operation	*op,
@@ -257,9 +695,31 @@ mdb_monitor_modify(
 	Entry		*e,
 	void		*priv )
 {
+	struct mdb_info		*mdb = (struct mdb_info *) priv;
+	Modifications		*ml;
+
+	for ( ml = op->orm_modlist; ml; ml = ml->sml_next ) {
+		Modification *mod = &ml->sml_mod;
+
+		if ( mod->sm_desc != ad_olmMDBCompact )
+			continue;
+
+		/* a compaction can be started, not stopped */
+		if ( mod->sm_op == LDAP_MOD_DELETE || !mod->sm_values ||
+			!bvmatch( &slap_true_bv, mod->sm_values ))
+		{
+			rs->sr_text = "olmMDBCompact can only be set to TRUE";
+			return ( rs->sr_err = LDAP_UNWILLING_TO_PERFORM );
+		}
+
+		rs->sr_err = mdb_compact_start( mdb->mi_monitor.mdm_be,
+			&rs->sr_text );
+		if ( rs->sr_err != LDAP_SUCCESS )
+			return rs->sr_err;
+	}
+
 	return SLAP_CB_CONTINUE;
 }
-#endif
 
 static int
 mdb_monitor_free(
@@ -381,15 +841,15 @@ mdb_monitor_initialize( void )
 int
 mdb_monitor_db_init( BackendDB *be )
 {
-#ifdef MDB_MONITOR_IDX
 	struct mdb_info		*mdb = (struct mdb_info *) be->be_private;
-#endif /* MDB_MONITOR_IDX */
 
 	if ( mdb_monitor_initialize() == LDAP_SUCCESS ) {
 		/* monitoring in back-mdb is on by default */
 		SLAP_DBFLAGS( be ) |= SLAP_DBFLAG_MONITORING;
 	}
 
+	ldap_pvt_thread_mutex_init( &mdb->mi_shape_mutex );
+
 #ifdef MDB_MONITOR_IDX
 	mdb->mi_idx = NULL;
 	ldap_pvt_thread_mutex_init( &mdb->mi_idx_mutex );
@@ -436,7 +896,7 @@ mdb_monitor_db_open( BackendDB *be )
 	}
 
 	/* alloc as many as required (plus 1 for objectClass) */
-	a = attrs_alloc( 1 + 7 );
+	a = attrs_alloc( 1 + 13 );
 	if ( a == NULL ) {
 		rc = 1;
 		goto cleanup;
@@ -472,6 +932,30 @@ mdb_monitor_db_open( BackendDB *be )
 		next->a_desc = ad_olmMDBEntries;
 		attr_valadd( next, &bv, NULL, 1 );
 		next = next->a_next;
+
+		next->a_desc = ad_olmMDBIndexPending;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBGroupSyncs;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBReaderLag;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBPagesPinned;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBCompact;
+		attr_valadd( next, (struct berval *)&slap_false_bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBWarmupDone;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
 	}
 
 	{
@@ -527,11 +1011,10 @@ mdb_monitor_db_open( BackendDB *be )
 
 	cb = ch_calloc( sizeof( monitor_callback_t ), 1 );
 	cb->mc_update = mdb_monitor_update;
-#if 0	/* uncomment if required */
 	cb->mc_modify = mdb_monitor_modify;
-#endif
 	cb->mc_free = mdb_monitor_free;
 	cb->mc_private = (void *)mdb;
+	mdb->mi_monitor.mdm_be = be;
 
 	/* make sure the database is registered; then add monitor attributes */
 	rc = mbe->register_database( be, &mdb->mi_monitor.mdm_ndn );
@@ -596,9 +1079,14 @@ mdb_monitor_db_close( BackendDB *be )
 int
 mdb_monitor_db_destroy( BackendDB *be )
 {
-#ifdef MDB_MONITOR_IDX
 	struct mdb_info		*mdb = (struct mdb_info *) be->be_private;
+	int			i;
 
+	for ( i = 0; i < MDB_SHAPES; i++ )
+		ch_free( mdb->mi_shapes[i].ms_shape );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_shape_mutex );
+
+#ifdef MDB_MONITOR_IDX
 	/* TODO: free tree */
 	ldap_pvt_thread_mutex_destroy( &mdb->mi_idx_mutex );
 	avl_free( mdb->mi_idx, ch_free );
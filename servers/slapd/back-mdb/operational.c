@@ -25,14 +25,13 @@
 #include "back-mdb.h"
 
 /*
- * sets *hasSubordinates to LDAP_COMPARE_TRUE/LDAP_COMPARE_FALSE
- * if the entry has children or not.
+ * returns in *nkids the number of immediate children of e
  */
-int
-mdb_hasSubordinates(
+static int
+mdb_numSubordinates(
 	Operation	*op,
 	Entry		*e,
-	int		*hasSubordinates )
+	size_t		*nkids )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	MDB_txn		*rtxn;
@@ -52,22 +51,21 @@ mdb_hasSubordinates(
 
 	rtxn = moi->moi_txn;
 
-	rc = mdb_dn2id_children( op, rtxn, e );
+	rc = mdb_dn2id_nkids( op, rtxn, e->e_id, nkids );
 
 	switch( rc ) {
 	case 0:
-		*hasSubordinates = LDAP_COMPARE_TRUE;
 		break;
 
 	case MDB_NOTFOUND:
-		*hasSubordinates = LDAP_COMPARE_FALSE;
+		*nkids = 0;
 		rc = LDAP_SUCCESS;
 		break;
 
 	default:
 		Debug(LDAP_DEBUG_ARGS, 
-			"<=- " LDAP_XSTRING(mdb_hasSubordinates)
-			": has_children failed: %s (%d)\n", 
+			"<=- " LDAP_XSTRING(mdb_numSubordinates)
+			": dn2id_nkids failed: %s (%d)\n", 
 			mdb_strerror(rc), rc );
 		rc = LDAP_OTHER;
 	}
@@ -82,6 +80,25 @@ done:;
 	return rc;
 }
 
+/*
+ * sets *hasSubordinates to LDAP_COMPARE_TRUE/LDAP_COMPARE_FALSE
+ * if the entry has children or not.
+ */
+int
+mdb_hasSubordinates(
+	Operation	*op,
+	Entry		*e,
+	int		*hasSubordinates )
+{
+	size_t		nkids;
+	int		rc;
+
+	rc = mdb_numSubordinates( op, e, &nkids );
+	if ( rc == LDAP_SUCCESS )
+		*hasSubordinates = nkids ? LDAP_COMPARE_TRUE : LDAP_COMPARE_FALSE;
+	return rc;
+}
+
 /*
  * sets the supported operational attributes (if required)
  */
@@ -90,32 +107,50 @@ mdb_operational(
 	Operation	*op,
 	SlapReply	*rs )
 {
-	Attribute	**ap;
+	Attribute	**ap, *a;
+	int		has = 1, num = 1;
+	size_t		nkids;
 
 	assert( rs->sr_entry != NULL );
 
 	for ( ap = &rs->sr_operational_attrs; *ap; ap = &(*ap)->a_next ) {
 		if ( (*ap)->a_desc == slap_schema.si_ad_hasSubordinates ) {
-			break;
+			has = 0;
+		} else if ( (*ap)->a_desc == slap_schema.si_ad_numSubordinates ) {
+			num = 0;
 		}
 	}
 
-	if ( *ap == NULL &&
-		attr_find( rs->sr_entry->e_attrs, slap_schema.si_ad_hasSubordinates ) == NULL &&
-		( SLAP_OPATTRS( rs->sr_attr_flags ) ||
-			ad_inlist( slap_schema.si_ad_hasSubordinates, rs->sr_attrs ) ) )
-	{
-		int	hasSubordinates, rc;
+	for ( a = rs->sr_entry->e_attrs; a; a = a->a_next ) {
+		if ( a->a_desc == slap_schema.si_ad_hasSubordinates ) {
+			has = 0;
+		} else if ( a->a_desc == slap_schema.si_ad_numSubordinates ) {
+			num = 0;
+		}
+	}
 
-		rc = mdb_hasSubordinates( op, rs->sr_entry, &hasSubordinates );
-		if ( rc == LDAP_SUCCESS ) {
-			*ap = slap_operational_hasSubordinate( hasSubordinates == LDAP_COMPARE_TRUE );
+	if ( has && !SLAP_OPATTRS( rs->sr_attr_flags ) &&
+		!ad_inlist( slap_schema.si_ad_hasSubordinates, rs->sr_attrs ) )
+		has = 0;
+	if ( num && !SLAP_OPATTRS( rs->sr_attr_flags ) &&
+		!ad_inlist( slap_schema.si_ad_numSubordinates, rs->sr_attrs ) )
+		num = 0;
+
+	/* both come from the same count of children */
+	if ( ( has || num ) &&
+		mdb_numSubordinates( op, rs->sr_entry, &nkids ) == LDAP_SUCCESS )
+	{
+		if ( has ) {
+			*ap = slap_operational_hasSubordinate( nkids != 0 );
 			assert( *ap != NULL );
 
 			ap = &(*ap)->a_next;
 		}
+		if ( num ) {
+			*ap = slap_operational_numSubordinates( nkids );
+			ap = &(*ap)->a_next;
+		}
 	}
 
 	return LDAP_SUCCESS;
 }
-
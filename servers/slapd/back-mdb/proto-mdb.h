@@ -53,11 +53,19 @@ void mdb_attr_multi_unparse LDAP_P(( struct mdb_info *mdb, BerVarray *bva ));
 void mdb_attr_multi_thresh LDAP_P(( struct mdb_info *mdb, AttributeDescription *ad,
 	unsigned *hi, unsigned *lo ));
 
+int mdb_attr_dict_config LDAP_P(( struct mdb_info *mdb,
+	const char *fname, int lineno,
+	int argc, char **argv, struct config_reply_s *cr ));
+
+void mdb_attr_dict_unparse LDAP_P(( struct mdb_info *mdb, BerVarray *bva ));
+
 void mdb_attr_info_free( AttrInfo *ai );
 
 int mdb_ad_read( struct mdb_info *mdb, MDB_txn *txn );
 int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad );
 void mdb_ad_unwind( struct mdb_info *mdb, int prev_ads );
+int mdb_ixhash_check( BackendDB *be, MDB_txn *txn, ConfigReply *cr );
+int mdb_ixhash_put( struct mdb_info *mdb, MDB_txn *txn );
 
 /*
  * config.c
@@ -95,6 +103,12 @@ int mdb_dn2id_add(
 	int upsub,
 	Entry *e );
 
+int mdb_dn2id_upsub(
+	Operation *op,
+	MDB_cursor *mcp,
+	ID pid,
+	ID nsubs );
+
 int mdb_dn2id_delete(
 	Operation *op,
 	MDB_cursor *mc,
@@ -106,6 +120,14 @@ int mdb_dn2id_children(
 	MDB_txn *tid,
 	Entry *e );
 
+int mdb_dn2id_nkids(
+	Operation *op,
+	MDB_txn *tid,
+	ID id,
+	size_t *nkids );
+
+void mdb_dncache_purge( struct mdb_info *mdb );
+
 int mdb_dn2sups (
 	Operation *op,
 	MDB_txn *tid,
@@ -174,6 +196,11 @@ int mdb_filter_candidates(
 	ID *tmp,
 	ID *stack );
 
+int mdb_filter_index(
+	Backend *be,
+	Filter *f,
+	AttrInfo **aip );
+
 /*
  * id2entry.c
  */
@@ -198,6 +225,19 @@ int mdb_id2entry_delete(
 	MDB_txn *tid,
 	Entry *e);
 
+int mdb_alias_open(
+	BackendDB *be,
+	MDB_txn *tid );
+
+int mdb_alias_ids(
+	Operation *op,
+	MDB_txn *tid,
+	ID *ids );
+
+int mdb_dict_open(
+	BackendDB *be,
+	MDB_txn *tid );
+
 int mdb_id2entry(
 	Operation *op,
 	MDB_cursor *mc,
@@ -211,14 +251,19 @@ int mdb_id2edata(
 	MDB_val *data);
 
 int mdb_entry_return( Operation *op, Entry *e );
+void mdb_ecache_flush( struct mdb_info *mdb );
 BI_entry_release_rw mdb_entry_release;
 BI_entry_get_rw mdb_entry_get;
 BI_op_txn mdb_txn;
 
 int mdb_entry_decode( Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e );
+int mdb_entry_decode_ads( Operation *op, MDB_txn *txn, MDB_val *data, ID id,
+	AttributeDescription **ads, Entry **e );
+int mdb_entry_flatten( Operation *op, MDB_txn *txn, Entry *e, MDB_val *data );
 
 void mdb_reader_flush( MDB_env *env );
 int mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **moi );
+int mdb_op_commit( Operation *op, mdb_op_info *moi );
 
 int mdb_mval_put(Operation *op, MDB_cursor *mc, ID id, Attribute *a);
 int mdb_mval_del(Operation *op, MDB_cursor *mc, ID id, Attribute *a);
@@ -238,6 +283,16 @@ int mdb_idl_fetch_key(
 	MDB_cursor	**saved_cursor,
 	int                     get_flag );
 
+int mdb_idl_fetch_range(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*lo,
+	MDB_val		*hi,
+	ID			*ids,
+	ID			*tmp,
+	ID			limit );
+
 int mdb_idl_insert( ID *ids, ID id );
 
 typedef int (mdb_idl_keyfunc)(
@@ -249,6 +304,26 @@ typedef int (mdb_idl_keyfunc)(
 mdb_idl_keyfunc mdb_idl_insert_keys;
 mdb_idl_keyfunc mdb_idl_delete_keys;
 
+int mdb_idl_exact_count(
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	struct berval *key,
+	size_t		*count );
+
+int mdb_idl_exact_probe(
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	struct berval *key,
+	ID			*ids );
+
+int mdb_idl_exact_join(
+	MDB_txn		*txn,
+	MDB_dbi		*dbis,
+	struct berval *keys,
+	int			nkeys,
+	ID			*ids,
+	ID			*tmp );
+
 int
 mdb_idl_intersection(
 	ID *a,
@@ -314,11 +389,30 @@ mdb_index_recrun LDAP_P((
 
 int mdb_index_entry LDAP_P(( Operation *op, MDB_txn *t, int r, Entry *e ));
 
+void mdb_range_key LDAP_P(( struct berval *key, char *buf,
+	struct berval *rkey ));
+void mdb_sort_key LDAP_P(( struct berval *val, char *buf,
+	struct berval *key ));
+
+extern mdb_idl_keyfunc mdb_ixkeys_add;
+
+int mdb_ixkeys_write LDAP_P(( Operation *op, MDB_txn *txn,
+	mdb_ixkeys *ik, int n ));
+void mdb_ixkeys_free LDAP_P(( mdb_ixkeys *ik ));
+int mdb_index_values_readd LDAP_P(( Operation *op, MDB_txn *txn,
+	AttributeDescription *desc, BerVarray dvals, BerVarray vals, ID id ));
+
 #define mdb_index_entry_add(op,t,e) \
 	mdb_index_entry((op),(t),SLAP_INDEX_ADD_OP,(e))
 #define mdb_index_entry_del(op,t,e) \
 	mdb_index_entry((op),(t),SLAP_INDEX_DELETE_OP,(e))
 
+/*
+ * init.c
+ */
+
+int mdb_compact_start( BackendDB *be, const char **text );
+
 /*
  * key.c
  */
@@ -333,6 +427,25 @@ mdb_key_read(
     MDB_cursor **saved_cursor,
         int get_flags );
 
+extern int
+mdb_key_range(
+	Backend	*be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *lo,
+	struct berval *hi,
+	ID *ids,
+	ID *tmp,
+	ID limit );
+
+extern int
+mdb_key_count(
+	Backend	*be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *k,
+	ID *count );
+
 /*
  * nextid.c
  */
@@ -361,6 +474,11 @@ int mdb_monitor_db_open( BackendDB *be );
 int mdb_monitor_db_close( BackendDB *be );
 int mdb_monitor_db_destroy( BackendDB *be );
 
+void mdb_monitor_search_add(
+	Operation *op,
+	ID ncand,
+	int nentries );
+
 #ifdef MDB_MONITOR_IDX
 int
 mdb_monitor_idx_add(
@@ -369,6 +487,13 @@ mdb_monitor_idx_add(
 	slap_mask_t		type );
 #endif /* MDB_MONITOR_IDX */
 
+/*
+ * search.c
+ */
+
+void mdb_pcache_flush( struct mdb_info *mdb );
+void mdb_coalesce_flush( struct mdb_info *mdb );
+
 /*
  * former external.h
  */
@@ -384,6 +509,7 @@ extern BI_op_delete			mdb_delete;
 extern BI_op_modify			mdb_modify;
 extern BI_op_modrdn			mdb_modrdn;
 extern BI_op_search			mdb_search;
+extern BI_op_abandon			mdb_coalesce_wake;
 extern BI_op_extended			mdb_extended;
 
 extern BI_chk_referrals			mdb_referrals;
@@ -404,7 +530,12 @@ extern BI_tool_dn2id_get		mdb_tool_dn2id_get;
 extern BI_tool_entry_modify		mdb_tool_entry_modify;
 extern BI_tool_entry_delete		mdb_tool_entry_delete;
 
+/* bench.c */
+extern BI_tool_bench			mdb_tool_bench;
+
 extern mdb_idl_keyfunc mdb_tool_idl_add;
+extern mdb_idl_keyfunc mdb_tool_sort_add;
+extern int mdb_tool_sorting;
 
 LDAP_END_DECL
 
@@ -18,9 +18,19 @@
 
 #include <stdio.h>
 #include <ac/string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 #include "back-mdb.h"
 #include "idl.h"
+#include "lutil.h"
+
+#if defined(MADV_WILLNEED)
+#define	mdb_willneed(p,n)	madvise(p, n, MADV_WILLNEED)
+#elif defined(POSIX_MADV_WILLNEED)
+#define	mdb_willneed(p,n)	posix_madvise(p, n, POSIX_MADV_WILLNEED)
+#endif
 
 static int base_candidate(
 	BackendDB	*be,
@@ -134,6 +144,7 @@ static int search_aliases(
 	MDB_cursor *mci,
 	ID *stack )
 {
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	ID *aliases, *curscop, *visited, *newsubs, *oldsubs, *tmp;
 	ID cursora, ida, cursoro, ido;
 	Entry *matched, *a;
@@ -156,8 +167,14 @@ static int search_aliases(
 
 	/* Find all aliases in database */
 	MDB_IDL_ZERO( aliases );
-	rs->sr_err = mdb_filter_candidates( op, isc->mt, &af, aliases,
-		curscop, visited );
+	if ( mdb->mi_alias ) {
+		rs->sr_err = mdb_alias_ids( op, isc->mt, aliases );
+		if ( rs->sr_err )
+			rs->sr_err = LDAP_OTHER;
+	} else {
+		rs->sr_err = mdb_filter_candidates( op, isc->mt, &af, aliases,
+			curscop, visited );
+	}
 	if (rs->sr_err != LDAP_SUCCESS || MDB_IDL_IS_ZERO( aliases )) {
 		return rs->sr_err;
 	}
@@ -287,6 +304,686 @@ mdb_get_nextid(MDB_cursor *mci, ID *cursor)
 	return 0;
 }
 
+/* Parallel filter verification: with searchthreads set, windows of
+ * candidate IDs are fetched, decoded and tested against the filter
+ * by pool threads, each in its own read txn, while the search loop
+ * sends the previous window. The loop then only visits IDs that
+ * passed. Candidates are only pruned, never added, so the loop's own
+ * checks still decide what is returned.
+ */
+#define SEARCH_PAR_WINDOW	2048
+#define SEARCH_PAR_CHUNK	128
+
+/* Test the search filter, compiled by mdb_search() if possible */
+#define search_filter( op, e, fp ) \
+	( (fp) ? test_filter_prog( op, e, fp ) : \
+		test_filter( op, e, (op)->oq_search.rs_filter ))
+
+typedef struct search_win {
+	ID sw_ids[SEARCH_PAR_WINDOW];
+	unsigned char sw_ok[SEARCH_PAR_WINDOW];
+	int sw_nids;
+} search_win;
+
+typedef struct search_par {
+	ldap_pvt_thread_mutex_t sp_mutex;
+	ldap_pvt_thread_cond_t sp_cond;
+	Operation *sp_op;
+	FilterProg *sp_fprog;
+	int sp_refs;		/* the search, and each queued task */
+	int sp_tasks;		/* queued tasks */
+	int sp_busy;		/* chunks being verified */
+	int sp_claim;		/* next chunk of the filling window */
+	int sp_nchunks;
+	int sp_size;		/* IDs in the next window */
+	int sp_fill;		/* window being verified */
+	int sp_pos;			/* next ID in the window being sent */
+	ID sp_id;			/* next candidate to put in a window */
+	ID sp_cursor;
+	search_win sp_win[2];
+} search_par;
+
+static void
+search_par_verify( Operation *op, MDB_txn *txn, FilterProg *fp,
+	search_win *sw, int start )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mci, *mcd = NULL;
+	MDB_val edata;
+	Entry *e;
+	int i, end, rc;
+
+	end = start + SEARCH_PAR_CHUNK;
+	if ( end > sw->sw_nids )
+		end = sw->sw_nids;
+
+	if ( mdb_cursor_open( txn, mdb->mi_id2entry, &mci )) {
+		/* can't tell, let the search loop decide */
+		memset( sw->sw_ok + start, 1, end - start );
+		return;
+	}
+
+	for ( i = start; i < end; i++ ) {
+		ID id = sw->sw_ids[i];
+
+		rc = mdb_id2edata( op, mci, id, &edata );
+		if ( rc ) {
+			sw->sw_ok[i] = rc != MDB_NOTFOUND;
+			continue;
+		}
+		if ( mdb_entry_decode( op, txn, &edata, id, &e )) {
+			sw->sw_ok[i] = 1;
+			continue;
+		}
+		e->e_id = id;
+		if ( mdb_id2name( op, txn, &mcd, id, &e->e_name, &e->e_nname )) {
+			BER_BVZERO( &e->e_name );
+			BER_BVZERO( &e->e_nname );
+			sw->sw_ok[i] = 1;
+		} else {
+			/* referrals are returned regardless of the filter */
+			sw->sw_ok[i] = ( !get_manageDSAit( op ) && is_entry_referral( e )) ||
+				search_filter( op, e, fp ) == LDAP_COMPARE_TRUE;
+		}
+		mdb_entry_return( op, e );
+	}
+	if ( mcd )
+		mdb_cursor_close( mcd );
+	mdb_cursor_close( mci );
+}
+
+/* Verify chunks of the filling window until none are left.
+ * Returns with sp_mutex held.
+ */
+static void
+search_par_work( search_par *sp, Operation *op, MDB_txn *txn )
+{
+	search_win *sw;
+	int c;
+
+	while ( sp->sp_claim < sp->sp_nchunks ) {
+		sw = &sp->sp_win[sp->sp_fill];
+		/* sp_op is still valid here. Once the search is abandoned
+		 * nothing more will be sent, don't decode the rest.
+		 */
+		if ( sp->sp_op->o_abandon ) {
+			c = sp->sp_claim * SEARCH_PAR_CHUNK;
+			memset( sw->sw_ok + c, 0, sw->sw_nids - c );
+			sp->sp_claim = sp->sp_nchunks;
+			break;
+		}
+		c = sp->sp_claim++;
+		sp->sp_busy++;
+		ldap_pvt_thread_mutex_unlock( &sp->sp_mutex );
+
+		search_par_verify( op, txn, sp->sp_fprog, sw, c * SEARCH_PAR_CHUNK );
+
+		ldap_pvt_thread_mutex_lock( &sp->sp_mutex );
+		if ( !--sp->sp_busy )
+			ldap_pvt_thread_cond_signal( &sp->sp_cond );
+	}
+}
+
+static void
+search_par_unref( search_par *sp )
+{
+	int refs = --sp->sp_refs;
+
+	ldap_pvt_thread_mutex_unlock( &sp->sp_mutex );
+	if ( !refs ) {
+		ldap_pvt_thread_cond_destroy( &sp->sp_cond );
+		ldap_pvt_thread_mutex_destroy( &sp->sp_mutex );
+		ch_free( sp );
+	}
+}
+
+static void *
+search_par_task( void *ctx, void *arg )
+{
+	search_par *sp = arg;
+	OperationBuffer opbuf;
+	Operation *op = NULL;
+	mdb_op_info opinfo = {{{0}}}, *moi = &opinfo;
+	struct mdb_info *mdb;
+
+	ldap_pvt_thread_mutex_lock( &sp->sp_mutex );
+	/* the search may be long gone, sp_op is only valid
+	 * while there are chunks to claim
+	 */
+	if ( sp->sp_claim < sp->sp_nchunks ) {
+		op = &opbuf.ob_op;
+		*op = *sp->sp_op;
+		op->o_hdr = &opbuf.ob_hdr;
+		*op->o_hdr = *sp->sp_op->o_hdr;
+		op->o_tmpmemctx = slap_sl_mem_create( SLAP_SLAB_SIZE,
+			SLAP_SLAB_STACK, ctx, 1 );
+		op->o_tmpmfuncs = &slap_sl_mfuncs;
+		op->o_threadctx = ctx;
+		LDAP_SLIST_FIRST( &op->o_extra ) = NULL;
+		op->o_callback = NULL;
+		mdb = (struct mdb_info *) op->o_bd->be_private;
+
+		if ( mdb_opinfo_get( op, mdb, 1, &moi ) == 0 ) {
+			search_par_work( sp, op, moi->moi_txn );
+			ldap_pvt_thread_mutex_unlock( &sp->sp_mutex );
+			mdb_txn_reset( moi->moi_txn );
+			LDAP_SLIST_REMOVE( &op->o_extra, &moi->moi_oe, OpExtra, oe_next );
+			ldap_pvt_thread_mutex_lock( &sp->sp_mutex );
+		}
+	}
+	sp->sp_tasks--;
+	search_par_unref( sp );
+	return NULL;
+}
+
+/* Fill the next window with candidates and queue it for verification */
+static void
+search_par_fill( search_par *sp, ID *candidates, MDB_cursor *mci, int nthreads )
+{
+	search_win *sw = &sp->sp_win[sp->sp_fill];
+	int n = 0;
+
+	while ( n < sp->sp_size && sp->sp_id != NOID ) {
+		sw->sw_ids[n++] = sp->sp_id;
+		if ( MDB_IDL_IS_RANGE( candidates )) {
+			/* skip the holes in the range */
+			if ( mdb_get_nextid( mci, &sp->sp_cursor ) ||
+				sp->sp_cursor > MDB_IDL_RANGE_LAST( candidates ))
+				sp->sp_id = NOID;
+			else
+				sp->sp_id = sp->sp_cursor;
+		} else {
+			sp->sp_id = mdb_idl_next( candidates, &sp->sp_cursor );
+		}
+	}
+	sw->sw_nids = n;
+	/* windows grow up to full size if the first ones weren't enough */
+	sp->sp_size <<= 1;
+	if ( sp->sp_size > SEARCH_PAR_WINDOW )
+		sp->sp_size = SEARCH_PAR_WINDOW;
+
+	ldap_pvt_thread_mutex_lock( &sp->sp_mutex );
+	sp->sp_claim = 0;
+	sp->sp_nchunks = ( n + SEARCH_PAR_CHUNK - 1 ) / SEARCH_PAR_CHUNK;
+	while ( sp->sp_tasks < nthreads && sp->sp_tasks < sp->sp_nchunks ) {
+		sp->sp_refs++;
+		sp->sp_tasks++;
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+			search_par_task, sp )) {
+			sp->sp_refs--;
+			sp->sp_tasks--;
+			break;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &sp->sp_mutex );
+}
+
+/* The first window holds no more than the wanted IDs, rounded up
+ * to a chunk, so a small size limit doesn't verify a full window.
+ */
+static search_par *
+search_par_begin( Operation *op, FilterProg *fp, ID *candidates, ID *cursor,
+	MDB_cursor *mci, int nthreads, unsigned wanted )
+{
+	search_par *sp;
+
+	sp = ch_malloc( sizeof( search_par ));
+	ldap_pvt_thread_mutex_init( &sp->sp_mutex );
+	ldap_pvt_thread_cond_init( &sp->sp_cond );
+	sp->sp_op = op;
+	sp->sp_fprog = fp;
+	sp->sp_refs = 1;
+	sp->sp_tasks = 0;
+	sp->sp_busy = 0;
+	sp->sp_claim = sp->sp_nchunks = 0;
+	sp->sp_size = SEARCH_PAR_WINDOW;
+	if ( wanted < SEARCH_PAR_WINDOW )
+		sp->sp_size = ( wanted + SEARCH_PAR_CHUNK - 1 ) & ~( SEARCH_PAR_CHUNK - 1 );
+	sp->sp_fill = 0;
+	sp->sp_pos = 0;
+	sp->sp_win[1].sw_nids = 0;
+	sp->sp_cursor = *cursor;
+	sp->sp_id = mdb_idl_first( candidates, &sp->sp_cursor );
+	search_par_fill( sp, candidates, mci, nthreads );
+	return sp;
+}
+
+/* Wait for the filling window; the search helps rather than idles */
+static void
+search_par_wait( search_par *sp, Operation *op, MDB_txn *txn )
+{
+	ldap_pvt_thread_mutex_lock( &sp->sp_mutex );
+	search_par_work( sp, op, txn );
+	while ( sp->sp_busy )
+		ldap_pvt_thread_cond_wait( &sp->sp_cond, &sp->sp_mutex );
+	ldap_pvt_thread_mutex_unlock( &sp->sp_mutex );
+}
+
+/* Next candidate that passed verification, or NOID */
+static ID
+search_par_next( search_par *sp, Operation *op, MDB_txn *txn,
+	ID *candidates, MDB_cursor *mci, int nthreads )
+{
+	search_win *sw = &sp->sp_win[sp->sp_fill ^ 1];
+
+	for (;;) {
+		while ( sp->sp_pos < sw->sw_nids ) {
+			int i = sp->sp_pos++;
+			if ( sw->sw_ok[i] )
+				return sw->sw_ids[i];
+		}
+		/* this window is sent, move on to the one being verified */
+		search_par_wait( sp, op, txn );
+		sw = &sp->sp_win[sp->sp_fill];
+		if ( !sw->sw_nids )
+			return NOID;
+		sp->sp_pos = 0;
+		sp->sp_fill ^= 1;
+		search_par_fill( sp, candidates, mci, nthreads );
+	}
+}
+
+static void
+search_par_end( search_par *sp )
+{
+	ldap_pvt_thread_mutex_lock( &sp->sp_mutex );
+	/* leave nothing for tasks that haven't started yet */
+	sp->sp_claim = sp->sp_nchunks;
+	while ( sp->sp_busy )
+		ldap_pvt_thread_cond_wait( &sp->sp_cond, &sp->sp_mutex );
+	search_par_unref( sp );
+}
+
+/* Filter pre-test: before decoding a candidate in full, decode only
+ * the attributes the filter refers to and test the filter against
+ * them with access control out of the way. Access control can only
+ * turn a filter component into Undefined, and without NOT that never
+ * makes a filter True, so a candidate failing the pre-test would fail
+ * the real test as well. Filters that need anything other than
+ * stored attributes are not pre-tested. When too few candidates get
+ * rejected, the pre-test is switched off for the rest of the search.
+ */
+#define SEARCH_PRE_MAXADS	16
+#define SEARCH_PRE_SAMPLE	256
+
+typedef struct search_pre {
+	Operation *sp_op;	/* NULL if not pre-testing */
+	FilterProg *sp_fprog;
+	int sp_tested;
+	int sp_rejected;
+	AttributeDescription *sp_ads[SEARCH_PRE_MAXADS + 1];
+	Operation sp_opbuf;
+} search_pre;
+
+static int
+search_pre_ads( Filter *f, AttributeDescription **ads, int *nads )
+{
+	AttributeDescription *ad;
+	int i;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED )
+		return 0;
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		return 0;
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		for ( f = f->f_list; f; f = f->f_next ) {
+			if ( search_pre_ads( f, ads, nads ))
+				return -1;
+		}
+		return 0;
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		ad = f->f_av_desc;
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		break;
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		break;
+	case LDAP_FILTER_EXT:
+		if ( f->f_mr_dnattrs )
+			return -1;
+		ad = f->f_mr_desc;
+		break;
+	default:
+		return -1;
+	}
+
+	if ( ad == NULL ||
+		ad == slap_schema.si_ad_entryDN ||
+		ad == slap_schema.si_ad_hasSubordinates ||
+		ad == slap_schema.si_ad_subschemaSubentry ||
+		( ad->ad_type->sat_flags & SLAP_AT_DYNAMIC ))
+		return -1;
+
+	for ( i = 0; i < *nads; i++ ) {
+		if ( ads[i] == ad )
+			return 0;
+	}
+	if ( *nads == SEARCH_PRE_MAXADS )
+		return -1;
+	ads[(*nads)++] = ad;
+	return 0;
+}
+
+static void
+search_pre_begin( search_pre *sp, Operation *op )
+{
+	int nads = 0;
+
+	sp->sp_op = NULL;
+	sp->sp_tested = 0;
+	sp->sp_rejected = 0;
+
+	/* needed to recognize referrals */
+	sp->sp_ads[nads++] = slap_schema.si_ad_objectClass;
+	if ( search_pre_ads( op->oq_search.rs_filter, sp->sp_ads, &nads ))
+		return;
+	sp->sp_ads[nads] = NULL;
+
+	if ( be_isroot( op )) {
+		sp->sp_op = op;
+	} else if ( !BER_BVISEMPTY( &op->o_bd->be_rootndn )) {
+		sp->sp_opbuf = *op;
+		sp->sp_opbuf.o_dn = op->o_bd->be_rootdn;
+		sp->sp_opbuf.o_ndn = op->o_bd->be_rootndn;
+		sp->sp_op = &sp->sp_opbuf;
+	}
+}
+
+/* Returns zero if the candidate certainly doesn't match */
+static int
+search_pre_test( search_pre *sp, MDB_txn *txn, MDB_val *edata, ID id )
+{
+	Operation *op = sp->sp_op;
+	Entry *e;
+	int rc;
+
+	if ( mdb_entry_decode_ads( op, txn, edata, id, sp->sp_ads, &e ))
+		return 1;
+	e->e_id = id;
+	e->e_name = slap_empty_bv;
+	e->e_nname = slap_empty_bv;
+	/* referrals are returned regardless of the filter */
+	rc = ( !get_manageDSAit( op ) && is_entry_referral( e )) ||
+		search_filter( op, e, sp->sp_fprog ) == LDAP_COMPARE_TRUE;
+	BER_BVZERO( &e->e_name );
+	BER_BVZERO( &e->e_nname );
+	mdb_entry_return( op, e );
+
+	if ( !rc )
+		sp->sp_rejected++;
+	if ( ++sp->sp_tested == SEARCH_PRE_SAMPLE ) {
+		if ( sp->sp_rejected < SEARCH_PRE_SAMPLE / 4 )
+			sp->sp_op = NULL;
+		sp->sp_tested = 0;
+		sp->sp_rejected = 0;
+	}
+	return rc;
+}
+
+/* Index-only results: when no attributes are requested and the
+ * candidate list is known to contain exactly the entries matching
+ * the filter, entries can be returned by DN alone, without reading
+ * id2entry. That holds for (objectClass=*) and for a presence filter
+ * whose index list didn't overflow into a range; equality keys are
+ * hashed and always need checking against the entry. Access control
+ * must not depend on the entry, and there must be no callbacks that
+ * could look at it. Candidates that might be referrals, aliases,
+ * glue or subentries are still fetched, as the search loop needs
+ * their objectClasses.
+ */
+static int
+search_covered( Operation *op, ID *candidates )
+{
+	AttributeName *an;
+	slap_mask_t flags;
+
+	if ( op->o_callback )
+		return 0;
+
+	if ( op->ors_filter->f_choice != LDAP_FILTER_PRESENT ||
+		( op->ors_filter->f_desc != slap_schema.si_ad_objectClass &&
+		MDB_IDL_IS_RANGE( candidates )))
+		return 0;
+
+	flags = slap_attr_flags( op->ors_attrs );
+	if ( SLAP_USERATTRS( flags ) || SLAP_OPATTRS( flags ))
+		return 0;
+	for ( an = op->ors_attrs; an && an->an_name.bv_val; an++ ) {
+		if ( an->an_oc || ( an->an_desc &&
+			an->an_desc->ad_type != slap_schema.si_at_undefined ))
+			return 0;
+	}
+
+	if ( !be_isroot( op ) && ( op->o_bd->be_acl || frontendDB->be_acl ||
+		op->o_bd->be_dfltaccess < ACL_READ ))
+		return 0;
+
+	return 1;
+}
+
+static int
+search_idl_has( ID *ids, ID id )
+{
+	unsigned i;
+
+	if ( MDB_IDL_IS_RANGE( ids ))
+		return id >= MDB_IDL_RANGE_FIRST( ids ) &&
+			id <= MDB_IDL_RANGE_LAST( ids );
+	i = mdb_idl_search( ids, id );
+	return i <= ids[0] && ids[i] == id;
+}
+
+/* Get the IDs of the entries whose objectClasses the search loop
+ * must look at. Returns NULL if there is no usable index for that.
+ */
+static ID *
+search_covered_special( Operation *op, MDB_txn *txn, ID *stack )
+{
+	ObjectClass *oc, *ocs[4];
+	AttributeAssertion *aa;
+	Filter *f, *fl = NULL, of;
+	ID *ids;
+	int i, rc;
+
+	ocs[0] = slap_schema.si_oc_referral;
+	ocs[1] = slap_schema.si_oc_alias;
+	ocs[2] = slap_schema.si_oc_glue;
+	ocs[3] = slap_schema.si_oc_subentry;
+
+	for ( oc_start( &oc ); oc; oc_next( &oc )) {
+		for ( i = 0; i < 4; i++ ) {
+			if ( is_object_subclass( ocs[i], oc ))
+				break;
+		}
+		if ( i == 4 )
+			continue;
+		f = op->o_tmpalloc( sizeof( Filter ) + sizeof( AttributeAssertion ),
+			op->o_tmpmemctx );
+		aa = (AttributeAssertion *)( f+1 );
+		*aa = (AttributeAssertion)ATTRIBUTEASSERTION_INIT;
+		f->f_choice = LDAP_FILTER_EQUALITY;
+		f->f_ava = aa;
+		f->f_av_desc = slap_schema.si_ad_objectClass;
+		f->f_av_value = oc->soc_cname;
+		f->f_next = fl;
+		fl = f;
+	}
+	of.f_choice = LDAP_FILTER_OR;
+	of.f_or = fl;
+	of.f_next = NULL;
+
+	ids = ch_malloc( MDB_idl_um_size * sizeof( ID ));
+	rc = mdb_filter_candidates( op, txn, &of, ids,
+		stack, stack+MDB_idl_um_size );
+
+	for ( f = fl; f; f = fl ) {
+		fl = f->f_next;
+		op->o_tmpfree( f, op->o_tmpmemctx );
+	}
+
+	/* a range would be of no use */
+	if ( rc || MDB_IDL_IS_RANGE( ids )) {
+		ch_free( ids );
+		ids = NULL;
+	}
+	return ids;
+}
+
+/* Candidates of paged searches, kept so that the following pages
+ * don't have to compute them again. An entry belongs to a connection
+ * and is only used for a search with the same base, scope, filter
+ * and controls, continuing from the cookie it was saved with. It is
+ * dropped if it isn't picked up within mi_pcache_ttl seconds, and the
+ * oldest ones are dropped to stay within mi_pcache_max bytes.
+ */
+typedef struct mdb_pcache {
+	struct mdb_pcache *pc_next;	/* newest first */
+	unsigned long pc_connid;
+	PagedResultsCookie pc_cookie;
+	time_t pc_time;
+	size_t pc_size;
+	int pc_scope;
+	int pc_flags;
+	struct berval pc_base;
+	struct berval pc_filter;
+	ID pc_ids[1];
+} mdb_pcache;
+
+#define PCACHE_FLAGS(op)	( (op)->ors_deref | \
+	( get_manageDSAit( op ) << 4 ) | \
+	( get_subentries_visibility( op ) << 5 ) | \
+	( get_domainScope( op ) << 6 ))
+
+void
+mdb_pcache_flush( struct mdb_info *mdb )
+{
+	mdb_pcache *pc;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_pcache_mutex );
+	while (( pc = mdb->mi_pcache )) {
+		mdb->mi_pcache = pc->pc_next;
+		ch_free( pc );
+	}
+	mdb->mi_pcache_bytes = 0;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_pcache_mutex );
+}
+
+/* Drop what's expired or left over from connid, and the oldest
+ * entries until size more bytes fit. Must hold mi_pcache_mutex.
+ */
+static void
+mdb_pcache_trim( struct mdb_info *mdb, unsigned long connid, size_t size )
+{
+	mdb_pcache **pp, *pc;
+	time_t now = slap_get_time();
+	size_t total = size;
+
+	for ( pp = &mdb->mi_pcache; ( pc = *pp ); ) {
+		if ( pc->pc_connid == connid ||
+			pc->pc_time + mdb->mi_pcache_ttl < now ||
+			total + pc->pc_size > mdb->mi_pcache_max ) {
+			*pp = pc->pc_next;
+			mdb->mi_pcache_bytes -= pc->pc_size;
+			ch_free( pc );
+		} else {
+			total += pc->pc_size;
+			pp = &pc->pc_next;
+		}
+	}
+}
+
+/* Take the saved candidates for this page, if there are any */
+static mdb_pcache *
+mdb_pcache_get( Operation *op, struct mdb_info *mdb )
+{
+	PagedResultsState *ps = op->o_pagedresults_state;
+	PagedResultsCookie cookie;
+	mdb_pcache **pp, *pc;
+
+	if ( !mdb->mi_pcache_max || ps->ps_cookieval.bv_len != sizeof( cookie ))
+		return NULL;
+	AC_MEMCPY( &cookie, ps->ps_cookieval.bv_val, sizeof( cookie ));
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_pcache_mutex );
+	for ( pp = &mdb->mi_pcache; ( pc = *pp ); pp = &pc->pc_next ) {
+		if ( pc->pc_connid == op->o_connid ) {
+			*pp = pc->pc_next;
+			mdb->mi_pcache_bytes -= pc->pc_size;
+			break;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_pcache_mutex );
+
+	if ( pc && ( pc->pc_cookie != cookie ||
+		pc->pc_time + mdb->mi_pcache_ttl < slap_get_time() ||
+		pc->pc_scope != op->ors_scope ||
+		pc->pc_flags != PCACHE_FLAGS( op ) ||
+		!bvmatch( &pc->pc_base, &op->o_req_ndn ) ||
+		!bvmatch( &pc->pc_filter, &op->ors_filterstr ))) {
+		ch_free( pc );
+		pc = NULL;
+	}
+	return pc;
+}
+
+/* Save the candidates for the next page. The entry taken by
+ * mdb_pcache_get(), if any, is reused or freed.
+ */
+static void
+mdb_pcache_put( Operation *op, struct mdb_info *mdb, mdb_pcache *pc,
+	ID *ids, ID lastid )
+{
+	if ( !mdb->mi_pcache_max ) {
+		ch_free( pc );
+		return;
+	}
+
+	if ( !pc ) {
+		size_t size, len = MDB_IDL_SIZEOF( ids );
+
+		size = sizeof( mdb_pcache ) + len +
+			op->o_req_ndn.bv_len + op->ors_filterstr.bv_len + 2;
+		if ( size > mdb->mi_pcache_max )
+			return;
+		pc = ch_malloc( size );
+		pc->pc_size = size;
+		pc->pc_connid = op->o_connid;
+		pc->pc_scope = op->ors_scope;
+		pc->pc_flags = PCACHE_FLAGS( op );
+		AC_MEMCPY( pc->pc_ids, ids, len );
+		pc->pc_base.bv_len = op->o_req_ndn.bv_len;
+		pc->pc_base.bv_val = (char *)pc->pc_ids + len;
+		AC_MEMCPY( pc->pc_base.bv_val, op->o_req_ndn.bv_val,
+			op->o_req_ndn.bv_len + 1 );
+		pc->pc_filter.bv_len = op->ors_filterstr.bv_len;
+		pc->pc_filter.bv_val = pc->pc_base.bv_val + pc->pc_base.bv_len + 1;
+		AC_MEMCPY( pc->pc_filter.bv_val, op->ors_filterstr.bv_val,
+			op->ors_filterstr.bv_len );
+		pc->pc_filter.bv_val[pc->pc_filter.bv_len] = '\0';
+	}
+	pc->pc_cookie = lastid;
+	pc->pc_time = slap_get_time();
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_pcache_mutex );
+	mdb_pcache_trim( mdb, pc->pc_connid, pc->pc_size );
+	if ( pc->pc_size > mdb->mi_pcache_max ) {
+		ch_free( pc );
+	} else {
+		pc->pc_next = mdb->mi_pcache;
+		mdb->mi_pcache = pc;
+		mdb->mi_pcache_bytes += pc->pc_size;
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_pcache_mutex );
+}
+
 static void scope_chunk_free( void *key, void *data )
 {
 	ID2 *p1, *p2;
@@ -332,8 +1029,20 @@ typedef struct ww_ctx {
 	MDB_val data;
 	int flag;
 	unsigned nentries;
+	time_t start;	/* when txn was last renewed */
+	size_t pgno;	/* last used page of the DB then */
 } ww_ctx;
 
+static void
+mdb_rtxn_mark( ww_ctx *ww )
+{
+	MDB_envinfo ei;
+
+	ww->start = slap_get_time();
+	mdb_env_info( mdb_txn_env( ww->txn ), &ei );
+	ww->pgno = ei.me_last_pgno;
+}
+
 /* ITS#7904 if we get blocked while writing results to client,
  * release the current reader txn and reacquire it after we
  * unblock.
@@ -376,6 +1085,7 @@ mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, IdSc
 	int rc = 0;
 	ww->flag = 0;
 	mdb_txn_renew( ww->txn );
+	mdb_rtxn_mark( ww );
 	mdb_cursor_renew( ww->txn, mci );
 	mdb_cursor_renew( ww->txn, mcd );
 
@@ -416,8 +1126,517 @@ mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, IdSc
 	return rc;
 }
 
-int
-mdb_search( Operation *op, SlapReply *rs )
+/* A search suspended after mi_search_quantum candidates while other
+ * operations were waiting for a thread. Only searches that go through
+ * their candidate list in ID order are suspended: the list is kept
+ * with the ID of the next candidate, and the search picks up from
+ * there when the frontend calls it again, in a new read txn.
+ */
+typedef struct mdb_yield {
+	OpExtra my_oe;
+	ID my_next;
+	int my_nentries;
+	BerVarray my_v2ref;
+	ID *my_ids;
+} mdb_yield;
+
+static mdb_yield *
+mdb_yield_get( Operation *op )
+{
+	OpExtra *oex;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == (void *)mdb_yield_get )
+			return (mdb_yield *)oex;
+	}
+	return NULL;
+}
+
+/* The most entries the search may still send, at most max. Nothing
+ * is read or verified ahead for entries past the size limit or the
+ * end of the page.
+ */
+static unsigned
+search_wanted( Operation *op, SlapReply *rs, unsigned max )
+{
+	unsigned n = max;
+
+	if ( op->ors_slimit > 0 ) {
+		if ( rs->sr_nentries >= op->ors_slimit )
+			return 1;
+		if ( (unsigned)( op->ors_slimit - rs->sr_nentries ) < n )
+			n = op->ors_slimit - rs->sr_nentries;
+	}
+	if ( get_pagedresults( op ) > SLAP_CONTROL_IGNORED ) {
+		PagedResultsState *ps = op->o_pagedresults_state;
+		if ( ps->ps_size > 0 && (unsigned) ps->ps_size < n )
+			n = ps->ps_size;
+	}
+	return n ? n : 1;
+}
+
+/* Advise the kernel to read in the next n candidates after *cursor.
+ * Only entries on overflow pages gain from it, looking them up
+ * already reads the leaf page of their ID.
+ */
+static void
+search_prefetch( MDB_cursor *mc, ID *ids, ID *cursor, unsigned n,
+	size_t psize )
+{
+#ifdef mdb_willneed
+	MDB_val key, data;
+	ID id;
+	char *start;
+
+	key.mv_size = sizeof(ID);
+	key.mv_data = &id;
+	while ( n-- && ( id = mdb_idl_next( ids, cursor )) != NOID ) {
+		if ( mdb_cursor_get( mc, &key, &data, MDB_SET ) ||
+			data.mv_size < psize / 2 )
+			continue;
+		start = (char *)((uintptr_t)data.mv_data & ~(uintptr_t)(psize - 1));
+		mdb_willneed( start, (char *)data.mv_data + data.mv_size - start );
+	}
+#endif
+}
+
+/* Server side sorting from a sort index, for the VLV windows the
+ * sssvlv overlay offers us. The IDs of the window's entries replace
+ * the candidates, in order, and the search loop sends them as usual.
+ * Only the entries in the window are read and tested; those before
+ * the target are counted from the index, checking just that they
+ * are candidates. Thus targetPosition and contentCount are estimates,
+ * as RFC 2891 allows.
+ */
+/* draft-ietf-ldapext-ldapv3-vlv-09.txt, as in the sssvlv overlay */
+#ifndef LDAP_VLV_RANGE_ERROR
+#define LDAP_VLV_RANGE_ERROR	0x4D
+#endif
+
+typedef struct sort_iter {
+	MDB_cursor *si_mc;
+	MDB_val si_key;
+	ID si_id;
+	ID si_lo, si_hi;	/* walking a range key */
+} sort_iter;
+
+/* Is KEY the idlexact companion of a sort key? */
+static int
+sort_key_companion( MDB_val *key )
+{
+	char *ptr;
+	int i;
+
+	if ( key->mv_size < MDB_SORT_PREFIXLEN + MDB_IDL_EXACT_PAD )
+		return 0;
+	ptr = (char *)key->mv_data + key->mv_size - MDB_IDL_EXACT_PAD;
+	for ( i = 0; i < MDB_IDL_EXACT_PAD; i++ ) {
+		if ( ptr[i] )
+			return 0;
+	}
+	return 1;
+}
+
+/* Start on the key under the cursor, at its first or last ID */
+static ID
+sort_iter_load( sort_iter *it, int dir )
+{
+	MDB_val data;
+	ID id;
+	int rc;
+
+	for ( rc = 0;; rc = mdb_cursor_get( it->si_mc, &it->si_key, &data,
+		dir > 0 ? MDB_NEXT_NODUP : MDB_PREV_NODUP ))
+	{
+		if ( rc || it->si_key.mv_size < MDB_SORT_PREFIXLEN ||
+			memcmp( it->si_key.mv_data, MDB_SORT_PREFIX, MDB_SORT_PREFIXLEN ))
+			return it->si_id = NOID;
+		if ( !sort_key_companion( &it->si_key ))
+			break;
+	}
+
+	if ( mdb_cursor_get( it->si_mc, &it->si_key, &data, MDB_FIRST_DUP ))
+		return it->si_id = NOID;
+	memcpy( &id, data.mv_data, sizeof(ID) );
+	if ( id ) {
+		it->si_lo = 0;
+		if ( dir < 0 ) {
+			if ( mdb_cursor_get( it->si_mc, &it->si_key, &data, MDB_LAST_DUP ))
+				return it->si_id = NOID;
+			memcpy( &id, data.mv_data, sizeof(ID) );
+		}
+		return it->si_id = id;
+	}
+
+	/* a range: 0, lo, hi */
+	if ( mdb_cursor_get( it->si_mc, &it->si_key, &data, MDB_NEXT_DUP ))
+		return it->si_id = NOID;
+	memcpy( &it->si_lo, data.mv_data, sizeof(ID) );
+	if ( mdb_cursor_get( it->si_mc, &it->si_key, &data, MDB_NEXT_DUP ))
+		return it->si_id = NOID;
+	memcpy( &it->si_hi, data.mv_data, sizeof(ID) );
+	return it->si_id = dir > 0 ? it->si_lo : it->si_hi;
+}
+
+static ID
+sort_iter_next( sort_iter *it, int dir )
+{
+	MDB_val data;
+
+	if ( it->si_lo ) {
+		if ( dir > 0 && it->si_id < it->si_hi )
+			return ++it->si_id;
+		if ( dir < 0 && it->si_id > it->si_lo )
+			return --it->si_id;
+	} else if ( !mdb_cursor_get( it->si_mc, &it->si_key, &data,
+		dir > 0 ? MDB_NEXT_DUP : MDB_PREV_DUP ))
+	{
+		memcpy( &it->si_id, data.mv_data, sizeof(ID) );
+		return it->si_id;
+	}
+	if ( mdb_cursor_get( it->si_mc, &it->si_key, &data,
+		dir > 0 ? MDB_NEXT_NODUP : MDB_PREV_NODUP ))
+		return it->si_id = NOID;
+	return sort_iter_load( it, dir );
+}
+
+/* Go to the first ID of the index, or the last one */
+static ID
+sort_iter_first( sort_iter *it, int dir )
+{
+	char buf[MDB_SORT_PREFIXLEN];
+	MDB_val data;
+	int rc;
+
+	memcpy( buf, MDB_SORT_PREFIX, MDB_SORT_PREFIXLEN );
+	if ( dir < 0 )
+		buf[MDB_SORT_PREFIXLEN - 1]++;
+	it->si_key.mv_data = buf;
+	it->si_key.mv_size = MDB_SORT_PREFIXLEN;
+	rc = mdb_cursor_get( it->si_mc, &it->si_key, &data, MDB_SET_RANGE );
+	if ( dir < 0 )
+		rc = mdb_cursor_get( it->si_mc, &it->si_key, &data,
+			rc == MDB_NOTFOUND ? MDB_LAST : MDB_PREV );
+	if ( rc )
+		return it->si_id = NOID;
+	return sort_iter_load( it, dir );
+}
+
+/* Go back to ID under KEY, where the iterator was before */
+static ID
+sort_iter_set( sort_iter *it, MDB_val *key, ID id )
+{
+	MDB_val data;
+
+	it->si_key = *key;
+	if ( mdb_cursor_get( it->si_mc, &it->si_key, &data, MDB_SET ) ||
+		sort_iter_load( it, 1 ) == NOID )
+		return it->si_id = NOID;
+	if ( !it->si_lo ) {
+		data.mv_size = sizeof(ID);
+		data.mv_data = &id;
+		if ( mdb_cursor_get( it->si_mc, &it->si_key, &data, MDB_GET_BOTH ))
+			return it->si_id = NOID;
+	}
+	return it->si_id = id;
+}
+
+/* Does every entry matching F have a value of AD? */
+static int
+oc_requires( ObjectClass *oc, AttributeType *at )
+{
+	int i;
+
+	for ( i = 0; oc->soc_required && oc->soc_required[i]; i++ ) {
+		if ( oc->soc_required[i] == at )
+			return 1;
+	}
+	for ( i = 0; oc->soc_sups && oc->soc_sups[i]; i++ ) {
+		if ( oc_requires( oc->soc_sups[i], at ))
+			return 1;
+	}
+	return 0;
+}
+
+static int
+search_sorted_has( Filter *f, AttributeDescription *ad )
+{
+	ObjectClass *oc;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+		for ( f = f->f_and; f; f = f->f_next ) {
+			if ( search_sorted_has( f, ad ))
+				return 1;
+		}
+		break;
+	case LDAP_FILTER_PRESENT:
+		return f->f_desc == ad;
+	case LDAP_FILTER_EQUALITY:
+		if ( f->f_av_desc == slap_schema.si_ad_objectClass ) {
+			oc = oc_bvfind( &f->f_av_value );
+			return oc && oc_requires( oc, ad->ad_type );
+		}
+		/* FALLTHRU */
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		return f->f_av_desc == ad;
+	case LDAP_FILTER_SUBSTRINGS:
+		return f->f_sub_desc == ad;
+	}
+	return 0;
+}
+
+/* Will the search loop send entry ID, and is KEY that of its least
+ * value?
+ */
+static int
+search_sorted_test(
+	Operation *op,
+	MDB_txn *txn,
+	MDB_cursor *mci,
+	MDB_cursor **mcd,
+	Entry *base,
+	ID *candidates,
+	SortedSearch *ss,
+	MDB_val *key,
+	ID id )
+{
+	MatchingRule *mr = ss->ss_ordering;
+	char buf[MDB_SORT_KEYMAX];
+	struct berval *bv, kbv;
+	MDB_val edata;
+	Attribute *a;
+	Entry *e;
+	unsigned i;
+	int cmp, rc = 0;
+
+	if ( !search_idl_has( candidates, id ) ||
+		mdb_id2edata( op, mci, id, &edata ) ||
+		mdb_entry_decode( op, txn, &edata, id, &e ))
+		return 0;
+	e->e_id = id;
+	BER_BVZERO( &e->e_name );
+	BER_BVZERO( &e->e_nname );
+
+	if ( id == base->e_id ) {
+		if ( op->ors_scope != LDAP_SCOPE_SUBTREE )
+			goto leave;
+		ber_dupbv_x( &e->e_name, &base->e_name, op->o_tmpmemctx );
+		ber_dupbv_x( &e->e_nname, &base->e_nname, op->o_tmpmemctx );
+	} else if ( mdb_id2name( op, txn, mcd, id, &e->e_name, &e->e_nname ) ||
+		!dnIsSuffixScope( &e->e_nname, &base->e_nname, op->ors_scope )) {
+		goto leave;
+	}
+
+	if ( test_filter( op, e, op->ors_filter ) != LDAP_COMPARE_TRUE )
+		goto leave;
+
+	a = attr_find( e->e_attrs, ss->ss_ad );
+	if ( a ) {
+		bv = a->a_nvals;
+		for ( i = 1; i < a->a_numvals; i++ ) {
+			mr->smr_match( &cmp, 0, mr->smr_syntax, mr, bv, &a->a_nvals[i] );
+			if ( cmp > 0 )
+				bv = &a->a_nvals[i];
+		}
+		mdb_sort_key( bv, buf, &kbv );
+		rc = kbv.bv_len == key->mv_size &&
+			!memcmp( kbv.bv_val, key->mv_data, kbv.bv_len );
+	}
+
+leave:
+	mdb_entry_return( op, e );
+	return rc;
+}
+
+/* Returns 1 if the window replaced the candidates, 0 if the overlay
+ * must sort them, or -1 if the result is a VLV error to send.
+ */
+static int
+search_sorted(
+	Operation *op,
+	SlapReply *rs,
+	MDB_txn *txn,
+	MDB_cursor *mci,
+	MDB_cursor **mcd,
+	Entry *base,
+	ID *candidates,
+	ID ncand,
+	ID *ids,
+	SortedSearch *ss )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MatchingRule *mr = ss->ss_ordering;
+	AttrInfo *ai;
+	sort_iter it;
+	char kbuf[MDB_SORT_KEYMAX];
+	struct berval bv = BER_BVNULL, tbv;
+	MDB_val tkey;
+	ID id, pos = 0, target = 0, n, nb, na, *seen = NULL;
+	int full, past = 0, rc = 0;
+
+	if ( SLAP_GLUE_INSTANCE( op->o_bd ) || SLAP_GLUE_SUBORDINATE( op->o_bd ) ||
+		( op->ors_deref & LDAP_DEREF_SEARCHING ) ||
+		mr->smr_match != octetStringOrderingMatch ||
+		ss->ss_before < 0 || ss->ss_after < 0 ||
+		(unsigned)ss->ss_before + ss->ss_after + 1 >= MDB_idl_db_size )
+		return 0;
+	ai = mdb_attr_mask( mdb, ss->ss_ad );
+	if ( !ai || !( ai->ai_indexmask & SLAP_INDEX_SORT ))
+		return 0;
+
+	/* entries without a value sort last, and have no key: we can't
+	 * serve windows reaching them
+	 */
+	full = search_sorted_has( op->ors_filter, ss->ss_ad );
+
+	if ( BER_BVISNULL( &ss->ss_value )) {
+		if ( ss->ss_count && ss->ss_count != ncand ) {
+			if ( ss->ss_offset > ss->ss_count )
+				goto range_err;
+			target = ncand * ss->ss_offset / ss->ss_count;
+		} else {
+			if ( ss->ss_offset > ncand ) {
+range_err:
+				ss->ss_sorted = 1;
+				ss->ss_vlv_rc = LDAP_VLV_RANGE_ERROR;
+				ss->ss_vlv_target = 0;
+				ss->ss_vlv_count = ncand;
+				rs->sr_err = LDAP_VLV_ERROR;
+				return -1;
+			}
+			target = ss->ss_offset;
+		}
+		if ( target < 1 )
+			target = 1;
+	} else if ( mr->smr_normalize ) {
+		if ( mr->smr_normalize( SLAP_MR_VALUE_OF_SYNTAX, mr->smr_syntax,
+			mr, &ss->ss_value, &bv, op->o_tmpmemctx ))
+		{
+			ss->ss_sorted = 1;
+			ss->ss_vlv_rc = LDAP_INAPPROPRIATE_MATCHING;
+			ss->ss_vlv_target = 0;
+			ss->ss_vlv_count = ncand;
+			rs->sr_err = LDAP_VLV_ERROR;
+			return -1;
+		}
+	} else {
+		ber_dupbv_x( &bv, &ss->ss_value, op->o_tmpmemctx );
+	}
+
+	it.si_mc = NULL;
+	if ( mdb_cursor_open( txn, ai->ai_dbi, &it.si_mc ))
+		goto leave;
+	it.si_lo = 0;
+	if ( !BER_BVISNULL( &bv )) {
+		mdb_sort_key( &bv, kbuf, &tbv );
+		tkey.mv_data = tbv.bv_val;
+		tkey.mv_size = tbv.bv_len;
+	}
+
+	/* find the target, counting the candidates before it. Entries
+	 * with several values are counted at their first one only, as
+	 * long as the set of those seen still fits in an IDL.
+	 */
+	seen = op->o_tmpalloc( MDB_idl_db_size * sizeof(ID), op->o_tmpmemctx );
+	MDB_IDL_ZERO( seen );
+	for ( id = sort_iter_first( &it, 1 ); id != NOID;
+		id = sort_iter_next( &it, 1 ))
+	{
+		if ( !search_idl_has( candidates, id ))
+			continue;
+		if ( !MDB_IDL_IS_RANGE( seen ) && mdb_idl_insert( seen, id ))
+			continue;
+		pos++;
+		if ( BER_BVISNULL( &bv ) ? pos == target :
+			mdb_cmp( txn, ai->ai_dbi, &it.si_key, &tkey ) >= 0 )
+			break;
+	}
+
+	nb = 0;
+	na = 0;
+	if ( id != NOID ) {
+		/* the target and the entries after it */
+		target = pos;
+		memcpy( kbuf, it.si_key.mv_data, it.si_key.mv_size );
+		tkey.mv_data = kbuf;
+		tkey.mv_size = it.si_key.mv_size;
+		n = id;
+		for ( ; id != NOID && na <= (ID)ss->ss_after;
+			id = sort_iter_next( &it, 1 ))
+		{
+			if ( search_sorted_test( op, txn, mci, mcd, base, candidates,
+				ss, &it.si_key, id ))
+				ids[ss->ss_before + 1 + na++] = id;
+		}
+		if ( id == NOID && !full )
+			goto leave;
+		id = sort_iter_set( &it, &tkey, n );
+		if ( id != NOID )
+			id = sort_iter_next( &it, -1 );
+	} else {
+		/* past the last value, or the index has fewer candidates
+		 * than estimated: the window ends with the last entry
+		 */
+		if ( !full )
+			goto leave;
+		id = sort_iter_first( &it, -1 );
+		if ( BER_BVISNULL( &bv )) {
+			target = pos;
+			for ( ; id != NOID; id = sort_iter_next( &it, -1 )) {
+				if ( search_sorted_test( op, txn, mci, mcd, base,
+					candidates, ss, &it.si_key, id ))
+				{
+					ids[ss->ss_before + 1 + na++] = id;
+					id = sort_iter_next( &it, -1 );
+					break;
+				}
+			}
+		} else {
+			target = pos + 1;
+			past = 1;
+		}
+	}
+
+	/* the entries before it, backwards */
+	for ( ; id != NOID && nb < (ID)ss->ss_before;
+		id = sort_iter_next( &it, -1 ))
+	{
+		if ( search_sorted_test( op, txn, mci, mcd, base, candidates,
+			ss, &it.si_key, id ))
+			ids[ss->ss_before - nb++] = id;
+	}
+
+	n = 0;
+	while ( nb )
+		candidates[++n] = ids[ss->ss_before + 1 - nb--];
+	for ( id = 0; id < na; id++ )
+		candidates[++n] = ids[ss->ss_before + 1 + id];
+	candidates[0] = n;
+
+	ss->ss_sorted = 1;
+	ss->ss_vlv_rc = LDAP_SUCCESS;
+	/* once seen overflowed, entries may be counted more than once */
+	if ( target > ncand )
+		target = ncand + past;
+	ss->ss_vlv_target = target;
+	ss->ss_vlv_count = ncand;
+	rc = 1;
+
+leave:
+	if ( it.si_mc )
+		mdb_cursor_close( it.si_mc );
+	if ( seen )
+		op->o_tmpfree( seen, op->o_tmpmemctx );
+	if ( !BER_BVISNULL( &bv ))
+		op->o_tmpfree( bv.bv_val, op->o_tmpmemctx );
+	return rc;
+}
+
+static int
+search_run( Operation *op, SlapReply *rs )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	ID		id, cursor, nsubs, ncand, cscope;
@@ -436,6 +1655,20 @@ mdb_search( Operation *op, SlapReply *rs )
 	MDB_cursor	*mci, *mcd;
 	ww_ctx wwctx;
 	slap_callback cb = { 0 };
+	search_par *par = NULL;
+	search_pre pre;
+	FilterProg	*fprog = NULL;
+	ID		*special = NULL;
+	mdb_pcache	*pc = NULL;
+	int		pcok = 0;
+	int		covered = 0;
+	ID		pfcursor = 0;
+	size_t		psize = 0;
+	SortedSearch	*ss;
+	int		sorted = 0;
+	mdb_yield	*resumed, *my;
+	int		canyield = 0;
+	unsigned	examined = 0;
 
 	mdb_op_info	opinfo = {{{0}}}, *moi = &opinfo;
 	MDB_txn			*ltid = NULL;
@@ -443,6 +1676,10 @@ mdb_search( Operation *op, SlapReply *rs )
 	Debug( LDAP_DEBUG_TRACE, "=> " LDAP_XSTRING(mdb_search) "\n" );
 	attrs = op->oq_search.rs_attrs;
 
+	resumed = mdb_yield_get( op );
+	if ( resumed )
+		LDAP_SLIST_REMOVE( &op->o_extra, &resumed->my_oe, OpExtra, oe_next );
+
 	manageDSAit = get_manageDSAit( op );
 
 	rs->sr_err = mdb_opinfo_get( op, mdb, 1, &moi );
@@ -469,6 +1706,12 @@ mdb_search( Operation *op, SlapReply *rs )
 		return rs->sr_err;
 	}
 
+	if ( mdb->mi_prefetch ) {
+		MDB_stat st;
+		mdb_env_stat( mdb->mi_dbenv, &st );
+		psize = st.ms_psize;
+	}
+
 	scopes = scope_chunk_get( op );
 	candidates = c0 = search_stack( op );
 	iscopes = candidates + MDB_idl_um_size;
@@ -483,6 +1726,7 @@ mdb_search( Operation *op, SlapReply *rs )
 	isc.scopes = scopes;
 	isc.oscope = op->ors_scope;
 	isc.sctmp = stack;
+	isc.noscope = NULL;
 
 	if ( op->ors_deref & LDAP_DEREF_FINDING ) {
 		MDB_IDL_ZERO(candidates);
@@ -674,8 +1918,19 @@ dn2entry_retry:
 		scopes[0].mid = 1;
 		scopes[1].mid = base->e_id;
 		scopes[1].mval.mv_data = NULL;
-		rs->sr_err = search_candidates( op, rs, base,
-			&isc, mci, candidates, stack );
+		if ( resumed ) {
+			MDB_IDL_CPY( candidates, resumed->my_ids );
+			rs->sr_err = LDAP_SUCCESS;
+		} else if ( get_pagedresults( op ) > SLAP_CONTROL_IGNORED &&
+			( pc = mdb_pcache_get( op, mdb ))) {
+			MDB_IDL_CPY( candidates, pc->pc_ids );
+			rs->sr_err = LDAP_SUCCESS;
+		} else {
+			rs->sr_err = search_candidates( op, rs, base,
+				&isc, mci, candidates, stack );
+		}
+		/* alias scopes aren't kept with the candidates */
+		pcok = scopes[0].mid == 1;
 
 		if ( rs->sr_err == LDAP_ADMINLIMIT_EXCEEDED )
 			goto adminlimit;
@@ -693,9 +1948,17 @@ dn2entry_retry:
 		}
 	}
 
-	/* start cursor at beginning of candidates.
+	/* start cursor at beginning of candidates,
+	 * or where a suspended search stopped.
 	 */
 	cursor = 0;
+	if ( resumed ) {
+		cursor = resumed->my_next;
+		rs->sr_nentries = resumed->my_nentries;
+		rs->sr_v2ref = resumed->my_v2ref;
+		resumed->my_v2ref = NULL;
+		nsubs = ncand;	/* always bypass scope'd search */
+	}
 
 	if ( candidates[0] == 0 ) {
 		Debug( LDAP_DEBUG_TRACE,
@@ -722,6 +1985,41 @@ adminlimit:
 		tentries = ncand;
 	}
 
+	ss = slap_sorted_search( op );
+	if ( ss && op->ors_scope != LDAP_SCOPE_BASE ) {
+		sorted = search_sorted( op, rs, ltid, mci, &mcd, base,
+			candidates, ncand, iscopes, ss );
+		if ( sorted < 0 ) {
+			send_ldap_result( op, rs );
+			rs->sr_err = LDAP_SUCCESS;
+			goto done;
+		}
+		if ( sorted ) {
+			Debug( LDAP_DEBUG_TRACE,
+				LDAP_XSTRING(mdb_search)
+				": %ld entries from the sort index of %s\n",
+				(long) candidates[0], ss->ss_ad->ad_cname.bv_val );
+			if ( !candidates[0] )
+				goto nochange;
+			nsubs = ncand;	/* always bypass scope'd search */
+		}
+	}
+
+	if ( search_covered( op, candidates )) {
+		special = search_covered_special( op, ltid, stack );
+		if ( special ) {
+			Debug( LDAP_DEBUG_TRACE,
+				LDAP_XSTRING(mdb_search)
+				": returning entries from the indexes\n" );
+			covered = 1;
+		}
+	}
+
+	/* Only searches straight from a client can be suspended */
+	if ( mdb->mi_search_quantum && moi == &opinfo && !op->o_callback &&
+		!ss && pcok && get_pagedresults( op ) <= SLAP_CONTROL_IGNORED )
+		canyield = 1;
+
 	wwctx.flag = 0;
 	wwctx.nentries = 0;
 	/* If we're running in our own read txn */
@@ -730,10 +2028,19 @@ adminlimit:
 		cb.sc_private = &wwctx;
 		wwctx.txn = ltid;
 		wwctx.mcd = NULL;
+		mdb_rtxn_mark( &wwctx );
 		cb.sc_next = op->o_callback;
 		op->o_callback = &cb;
 	}
 
+	/* compiled once for all the candidates */
+	fprog = filter_compile( op->oq_search.rs_filter, op->o_tmpmemctx );
+	pre.sp_fprog = fprog;
+	if ( covered )
+		pre.sp_op = NULL;
+	else
+		search_pre_begin( &pre, op );
+
 	if ( get_pagedresults( op ) > SLAP_CONTROL_IGNORED ) {
 		PagedResultsState *ps = op->o_pagedresults_state;
 		/* deferred cookie parsing */
@@ -763,6 +2070,11 @@ adminlimit:
 		if ( id == (ID)ps->ps_cookie )
 			id = mdb_idl_next( candidates, &cursor );
 		nsubs = ncand;	/* always bypass scope'd search */
+		if ( psize && !covered ) {
+			pfcursor = cursor;
+			search_prefetch( mci, candidates, &pfcursor,
+				search_wanted( op, rs, mdb->mi_prefetch ), psize );
+		}
 		goto loop_begin;
 	}
 	if ( nsubs < ncand ) {
@@ -792,16 +2104,33 @@ adminlimit:
 		else
 			id = isc.id;
 		cscope = 0;
+	} else if ( mdb->mi_search_threads > 1 && !sorted &&
+		ncand >= 2 * SEARCH_PAR_WINDOW ) {
+		par = search_par_begin( op, fprog, candidates, &cursor, mci,
+			mdb->mi_search_threads - 1,
+			search_wanted( op, rs, SEARCH_PAR_WINDOW ));
+		id = search_par_next( par, op, ltid, candidates, mci,
+			mdb->mi_search_threads - 1 );
 	} else {
 		id = mdb_idl_first( candidates, &cursor );
+		if ( psize && !covered ) {
+			pfcursor = cursor;
+			search_prefetch( mci, candidates, &pfcursor,
+				search_wanted( op, rs, mdb->mi_prefetch ), psize );
+		}
 	}
 
+	if ( par )
+		pre.sp_op = NULL;
+
 	while (id != NOID)
 	{
 		int scopeok;
 		MDB_val edata;
 
 loop_begin:
+		if ( op->o_profile )
+			op->o_profile->sp_scanned++;
 
 		/* check for abandon */
 		if ( op->o_abandon ) {
@@ -830,6 +2159,8 @@ loop_begin:
 			goto done;
 		}
 
+		/* don't hold back entries while scanning for more */
+		slap_write_coalesce_flush( op, 1 );
 
 		if ( nsubs < ncand ) {
 			unsigned i;
@@ -874,6 +2205,10 @@ loop_begin:
 			if ( id == base->e_id ) break;
 			isc.id = id;
 			isc.nscope = 0;
+			if ( !isc.noscope && op->ors_scope != LDAP_SCOPE_ONELEVEL ) {
+				isc.noscope = scope_chunk_get( op );
+				isc.noscope[0].mid = 0;
+			}
 			rs->sr_err = mdb_idscopes( op, &isc );
 			if ( rs->sr_err == MDB_SUCCESS ) {
 				if ( isc.nscope )
@@ -898,13 +2233,19 @@ loop_begin:
 scopeok:
 		if ( id == base->e_id ) {
 			e = base;
+		} else if ( covered && !search_idl_has( special, id )) {
+			/* DN only, freed by mdb_entry_return */
+			e = op->o_tmpcalloc( 1, sizeof( Entry ), op->o_tmpmemctx );
+			e->e_private = e;
+			e->e_id = id;
+			e->e_ocflags = SLAP_OC__END;
 		} else {
 
 			/* get the entry */
 			rs->sr_err = mdb_id2edata( op, mci, id, &edata );
 			if ( rs->sr_err == MDB_NOTFOUND ) {
 notfound:
-				if( nsubs < ncand )
+				if( nsubs < ncand || par )
 					goto loop_continue;
 
 				if( !MDB_IDL_IS_RANGE(candidates) ) {
@@ -936,6 +2277,9 @@ notfound:
 				goto done;
 			}
 
+			if ( pre.sp_op && !search_pre_test( &pre, ltid, &edata, id ))
+				goto loop_continue;
+
 			rs->sr_err = mdb_entry_decode( op, ltid, &edata, id, &e );
 			if ( rs->sr_err ) {
 				rs->sr_err = LDAP_OTHER;
@@ -1073,7 +2417,10 @@ notfound:
 		}
 
 		/* if it matches the filter and scope, send it */
-		rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
+		if ( covered && e != base && !e->e_attrs )	/* DN only */
+			rs->sr_err = LDAP_COMPARE_TRUE;
+		else
+			rs->sr_err = search_filter( op, e, fprog );
 
 		if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
 			/* check size limit */
@@ -1082,6 +2429,10 @@ notfound:
 					if (e != base)
 						mdb_entry_return( op, e );
 					e = NULL;
+					if ( pcok ) {
+						mdb_pcache_put( op, mdb, pc, candidates, lastid );
+						pc = NULL;
+					}
 					send_paged_response( op, rs, &lastid, tentries );
 					goto done;
 				}
@@ -1134,14 +2485,31 @@ notfound:
 		}
 
 loop_continue:
-		if ( moi == &opinfo && !wwctx.flag && mdb->mi_rtxn_size ) {
+		if ( moi == &opinfo && !wwctx.flag ) {
+			/* Release the txn to let writers reuse the pages it
+			 * pins, after rtxnsize entries, or sooner if it is
+			 * too old or the DB had to grow while it was held.
+			 */
+			int renew = 0;
 			wwctx.nentries++;
-			if ( wwctx.nentries >= mdb->mi_rtxn_size ) {
+			if ( mdb->mi_rtxn_size && wwctx.nentries >= mdb->mi_rtxn_size )
+				renew = 1;
+			else if ( mdb->mi_rtxn_maxage &&
+				slap_get_time() - wwctx.start >= mdb->mi_rtxn_maxage )
+				renew = 1;
+			if ( renew || mdb->mi_rtxn_maxpages ) {
 				MDB_envinfo ei;
-				wwctx.nentries = 0;
 				mdb_env_info(mdb->mi_dbenv, &ei);
-				if ( ei.me_last_txnid > mdb_txn_id( ltid ))
-					mdb_rtxn_snap( op, &wwctx );
+				if ( mdb->mi_rtxn_maxpages &&
+					ei.me_last_pgno - wwctx.pgno >= mdb->mi_rtxn_maxpages )
+					renew = 1;
+				if ( renew ) {
+					wwctx.nentries = 0;
+					if ( ei.me_last_txnid > mdb_txn_id( ltid ))
+						mdb_rtxn_snap( op, &wwctx );
+					else
+						mdb_rtxn_mark( &wwctx );
+				}
 			}
 		}
 		if ( wwctx.flag ) {
@@ -1187,12 +2555,30 @@ loop_continue:
 				}
 			} else
 				id = isc.id;
+		} else if ( par ) {
+			id = search_par_next( par, op, ltid, candidates, mci,
+				mdb->mi_search_threads - 1 );
 		} else {
 			id = mdb_idl_next( candidates, &cursor );
+			/* keep the window of hinted candidates ahead of us */
+			if ( pfcursor && id != NOID )
+				search_prefetch( mci, candidates, &pfcursor, 1, psize );
+			if ( canyield && id != NOID &&
+				++examined >= mdb->mi_search_quantum ) {
+				examined = 0;
+				if ( slap_search_yieldable( op ))
+					goto yield;
+			}
 		}
 	}
 
 nochange:
+	/* the candidates were all gone through */
+	if ( op->ors_scope != LDAP_SCOPE_BASE &&
+		get_pagedresults( op ) <= SLAP_CONTROL_IGNORED )
+		mdb_monitor_search_add( op, nsubs < ncand ? nsubs : ncand,
+			rs->sr_nentries );
+
 	rs->sr_ctrls = NULL;
 	rs->sr_ref = rs->sr_v2ref;
 	rs->sr_err = (rs->sr_v2ref == NULL) ? LDAP_SUCCESS : LDAP_REFERRAL;
@@ -1204,8 +2590,29 @@ nochange:
 	}
 
 	rs->sr_err = LDAP_SUCCESS;
+	goto done;
+
+yield:
+	/* let the operations waiting for a thread go first */
+	my = ch_malloc( sizeof( mdb_yield ) + MDB_IDL_SIZEOF( candidates ));
+	my->my_oe.oe_key = (void *)mdb_yield_get;
+	my->my_next = id;
+	my->my_nentries = rs->sr_nentries;
+	my->my_v2ref = rs->sr_v2ref;
+	rs->sr_v2ref = NULL;
+	my->my_ids = (ID *)(my+1);
+	MDB_IDL_CPY( my->my_ids, candidates );
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &my->my_oe, oe_next );
+	slap_search_yield( op );
+	Debug( LDAP_DEBUG_TRACE, LDAP_XSTRING(mdb_search)
+		": suspended before candidate %ld\n", (long) id );
+	rs->sr_err = SLAPD_ASYNCOP;
 
 done:
+	if ( par )
+		search_par_end( par );
+	if ( fprog )
+		filter_prog_free( fprog, op->o_tmpmemctx );
 	if ( cb.sc_private ) {
 		/* remove our writewait callback */
 		slap_callback **scp = &op->o_callback;
@@ -1232,15 +2639,445 @@ done:
 	if (base)
 		mdb_entry_return( op, base );
 	scope_chunk_ret( op, scopes );
+	if ( isc.noscope )
+		scope_chunk_ret( op, isc.noscope );
 	if ( candidates != c0 ) {
 		ch_free( candidates );
 	} else {
 		MDB_IDL_ZERO( candidates );
 	}
+	if ( special )
+		ch_free( special );
+	if ( pc )
+		ch_free( pc );
+	if ( resumed ) {
+		if ( resumed->my_v2ref )
+			ber_bvarray_free( resumed->my_v2ref );
+		ch_free( resumed );
+	}
 
 	return rs->sr_err;
 }
 
+/* Coalesced searches. A search identical to one in progress, from
+ * the same identity, waits for it and sends the same responses
+ * instead of running itself: the entries are shared before access
+ * control, which each search then applies as usual when sending
+ * them. Once complete, the responses stay usable for mi_coalesce_ttl
+ * milliseconds, as long as no write transaction has committed since
+ * the search began. Only searches without controls are coalesced,
+ * while access depends on nothing but the identity, and a search is
+ * no longer shared when its responses grow beyond CQ_MAXRES or include
+ * controls or intermediate responses.
+ */
+#define CQ_MAXRES	64
+#define CQ_MAXDONE	1024
+
+enum { CQ_RUNNING, CQ_DONE, CQ_BAD };
+
+typedef struct mdb_cqres {
+	struct mdb_cqres *cr_next;
+	slap_reply_t cr_type;
+	Entry *cr_entry;
+	BerVarray cr_ref;
+} mdb_cqres;
+
+typedef struct mdb_coalesce {
+	struct mdb_coalesce *cq_next;	/* on mi_cq_done */
+	struct berval cq_key;
+	int cq_refs;
+	int cq_state;
+	int cq_intree;
+	size_t cq_txnid;
+	unsigned long cq_expire;	/* msec */
+	mdb_cqres *cq_res, **cq_tail;
+	int cq_nres;
+	int cq_err;
+	char *cq_matched;
+	char *cq_text;
+	BerVarray cq_ref;
+} mdb_coalesce;
+
+static unsigned long
+cq_now( void )
+{
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec * 1000UL + tv.tv_usec / 1000;
+}
+
+static int
+cq_cmp( const void *v1, const void *v2 )
+{
+	const mdb_coalesce *c1 = v1, *c2 = v2;
+
+	if ( c1->cq_key.bv_len != c2->cq_key.bv_len )
+		return c1->cq_key.bv_len < c2->cq_key.bv_len ? -1 : 1;
+	return memcmp( c1->cq_key.bv_val, c2->cq_key.bv_val, c1->cq_key.bv_len );
+}
+
+static void
+cq_free_res( mdb_coalesce *cq )
+{
+	mdb_cqres *cr;
+
+	while (( cr = cq->cq_res )) {
+		cq->cq_res = cr->cr_next;
+		if ( cr->cr_entry )
+			entry_free( cr->cr_entry );
+		if ( cr->cr_ref )
+			ber_bvarray_free( cr->cr_ref );
+		ch_free( cr );
+	}
+	cq->cq_tail = &cq->cq_res;
+	cq->cq_nres = 0;
+}
+
+/* Must hold mi_cq_mutex */
+static void
+cq_release( mdb_coalesce *cq )
+{
+	if ( --cq->cq_refs )
+		return;
+	cq_free_res( cq );
+	ch_free( cq->cq_matched );
+	ch_free( cq->cq_text );
+	if ( cq->cq_ref )
+		ber_bvarray_free( cq->cq_ref );
+	ch_free( cq );
+}
+
+/* Must hold mi_cq_mutex */
+static void
+cq_unlink( struct mdb_info *mdb, mdb_coalesce *cq )
+{
+	if ( cq->cq_intree ) {
+		avl_delete( &mdb->mi_cq_tree, cq, cq_cmp );
+		cq->cq_intree = 0;
+		cq_release( cq );
+	}
+}
+
+/* Drop the completed searches that expired. Must hold mi_cq_mutex */
+static void
+cq_expire( struct mdb_info *mdb, unsigned long now )
+{
+	mdb_coalesce *cq;
+
+	while (( cq = mdb->mi_cq_done ) &&
+		( cq->cq_expire <= now || mdb->mi_cq_ndone > CQ_MAXDONE ))
+	{
+		if ( !( mdb->mi_cq_done = cq->cq_next ))
+			mdb->mi_cq_donetail = &mdb->mi_cq_done;
+		mdb->mi_cq_ndone--;
+		cq_unlink( mdb, cq );
+		cq_release( cq );
+	}
+}
+
+void
+mdb_coalesce_flush( struct mdb_info *mdb )
+{
+	ldap_pvt_thread_mutex_lock( &mdb->mi_cq_mutex );
+	cq_expire( mdb, ~0UL );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_cq_mutex );
+}
+
+static size_t
+cq_txnid( struct mdb_info *mdb )
+{
+	MDB_envinfo ei;
+
+	mdb_env_info( mdb->mi_dbenv, &ei );
+	return ei.me_last_txnid;
+}
+
+/* Whatever the search may depend on, besides the database */
+static void
+cq_key( Operation *op, struct berval *key )
+{
+	struct berval fstr;
+	AttributeName *an;
+	char buf[128], *ptr;
+	int len;
+
+	filter2bv_x( op, op->ors_filter, &fstr );
+	len = snprintf( buf, sizeof( buf ), "%d %d %d %d %d %d %u",
+		op->o_protocol, op->ors_scope, op->ors_deref, op->ors_slimit,
+		op->ors_tlimit, op->ors_attrsonly, op->o_ssf );
+
+	key->bv_len = len + op->o_ndn.bv_len + op->o_req_ndn.bv_len +
+		fstr.bv_len + 3;
+	for ( an = op->ors_attrs; an && an->an_name.bv_val; an++ )
+		key->bv_len += an->an_name.bv_len + 1;
+	key->bv_val = op->o_tmpalloc( key->bv_len + 1, op->o_tmpmemctx );
+
+	ptr = lutil_strncopy( key->bv_val, buf, len );
+	*ptr++ = '\0';
+	ptr = lutil_strncopy( ptr, op->o_ndn.bv_val, op->o_ndn.bv_len );
+	*ptr++ = '\0';
+	ptr = lutil_strncopy( ptr, op->o_req_ndn.bv_val, op->o_req_ndn.bv_len );
+	*ptr++ = '\0';
+	ptr = lutil_strncopy( ptr, fstr.bv_val, fstr.bv_len );
+	for ( an = op->ors_attrs; an && an->an_name.bv_val; an++ ) {
+		*ptr++ = '\0';
+		ptr = lutil_strncopy( ptr, an->an_name.bv_val, an->an_name.bv_len );
+	}
+	*ptr = '\0';
+	op->o_tmpfree( fstr.bv_val, op->o_tmpmemctx );
+}
+
+/* Keeps the responses of the search that runs for the others */
+static int
+cq_response( Operation *op, SlapReply *rs )
+{
+	mdb_coalesce *cq = op->o_callback->sc_private;
+	mdb_cqres *cr;
+
+	if ( cq->cq_state != CQ_RUNNING )
+		return SLAP_CB_CONTINUE;
+
+	switch ( rs->sr_type ) {
+	case REP_SEARCH:
+	case REP_SEARCHREF:
+		if ( cq->cq_nres == CQ_MAXRES ) {
+			cq->cq_state = CQ_BAD;
+			break;
+		}
+		cr = ch_calloc( 1, sizeof( mdb_cqres ));
+		cr->cr_type = rs->sr_type;
+		if ( rs->sr_entry )
+			cr->cr_entry = entry_dup( rs->sr_entry );
+		if ( rs->sr_type == REP_SEARCHREF && rs->sr_ref )
+			ber_bvarray_dup_x( &cr->cr_ref, rs->sr_ref, NULL );
+		*cq->cq_tail = cr;
+		cq->cq_tail = &cr->cr_next;
+		cq->cq_nres++;
+		break;
+
+	case REP_RESULT:
+		if ( rs->sr_ctrls || rs->sr_err == SLAPD_ABANDON ||
+			rs->sr_err == LDAP_TIMELIMIT_EXCEEDED ||
+			rs->sr_err == LDAP_BUSY || rs->sr_err == LDAP_OTHER ) {
+			cq->cq_state = CQ_BAD;
+			break;
+		}
+		cq->cq_err = rs->sr_err;
+		if ( rs->sr_matched )
+			cq->cq_matched = ch_strdup( rs->sr_matched );
+		if ( rs->sr_text )
+			cq->cq_text = ch_strdup( rs->sr_text );
+		if ( rs->sr_ref )
+			ber_bvarray_dup_x( &cq->cq_ref, rs->sr_ref, NULL );
+		cq->cq_state = CQ_DONE;
+		break;
+
+	default:
+		cq->cq_state = CQ_BAD;
+		break;
+	}
+	return SLAP_CB_CONTINUE;
+}
+
+/* Send the responses of the search that ran */
+static int
+cq_replay( Operation *op, SlapReply *rs, mdb_coalesce *cq )
+{
+	mdb_cqres *cr;
+
+	for ( cr = cq->cq_res; cr; cr = cr->cr_next ) {
+		if ( op->o_abandon ) {
+			rs->sr_err = SLAPD_ABANDON;
+			send_ldap_result( op, rs );
+			return rs->sr_err;
+		}
+		rs->sr_entry = cr->cr_entry;
+		rs->sr_flags = 0;
+		if ( cr->cr_type == REP_SEARCHREF ) {
+			rs->sr_ref = cr->cr_ref;
+			send_search_reference( op, rs );
+			rs->sr_ref = NULL;
+			rs->sr_entry = NULL;
+			continue;
+		}
+		rs->sr_attrs = op->ors_attrs;
+		rs->sr_err = send_search_entry( op, rs );
+		rs->sr_attrs = NULL;
+		rs->sr_entry = NULL;
+		switch ( rs->sr_err ) {
+		case LDAP_SIZELIMIT_EXCEEDED:
+		case LDAP_BUSY:
+			send_ldap_result( op, rs );
+			return LDAP_SUCCESS;
+		case LDAP_UNAVAILABLE:
+			return LDAP_OTHER;
+		}
+	}
+
+	rs->sr_err = cq->cq_err;
+	rs->sr_matched = cq->cq_matched;
+	rs->sr_text = cq->cq_text;
+	rs->sr_ref = cq->cq_ref;
+	send_ldap_result( op, rs );
+	rs->sr_matched = NULL;
+	rs->sr_text = NULL;
+	rs->sr_ref = NULL;
+	return LDAP_SUCCESS;
+}
+
+static int
+search_coalesce( Operation *op, SlapReply *rs )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	slap_callback cb = { 0 };
+	mdb_coalesce *cq, key;
+	unsigned long now = cq_now();
+	size_t txnid = cq_txnid( mdb );
+	int rc, state;
+
+	cq_key( op, &key.cq_key );
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_cq_mutex );
+	cq_expire( mdb, now );
+	cq = avl_find( mdb->mi_cq_tree, &key, cq_cmp );
+	if ( cq && cq->cq_state == CQ_DONE && cq->cq_txnid != txnid ) {
+		/* written to since */
+		cq_unlink( mdb, cq );
+		cq = NULL;
+	}
+	if ( cq ) {
+		cq->cq_refs++;
+		/* mdb_coalesce_wake() gets us out on abandon and shutdown */
+		while ( cq->cq_state == CQ_RUNNING && !op->o_abandon &&
+			!slapd_shutdown )
+			ldap_pvt_thread_cond_wait( &mdb->mi_cq_cond, &mdb->mi_cq_mutex );
+		state = cq->cq_state;
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_cq_mutex );
+		op->o_tmpfree( key.cq_key.bv_val, op->o_tmpmemctx );
+
+		if ( state == CQ_RUNNING ) {
+			if ( op->o_abandon ) {
+				rs->sr_err = SLAPD_ABANDON;
+				send_ldap_result( op, rs );
+			} else {
+				rs->sr_err = LDAP_UNAVAILABLE;
+				send_ldap_disconnect( op, rs );
+			}
+			rc = rs->sr_err;
+		} else if ( state == CQ_DONE ) {
+			/* the responses don't change once it's done */
+			Debug( LDAP_DEBUG_TRACE, LDAP_XSTRING(mdb_search)
+				": answered by a coalesced search\n" );
+			rc = cq_replay( op, rs, cq );
+		} else {
+			rc = search_run( op, rs );
+		}
+		ldap_pvt_thread_mutex_lock( &mdb->mi_cq_mutex );
+		cq_release( cq );
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_cq_mutex );
+		return rc;
+	}
+
+	/* run it for whoever comes along meanwhile */
+	cq = ch_calloc( 1, sizeof( mdb_coalesce ) + key.cq_key.bv_len + 1 );
+	cq->cq_key.bv_len = key.cq_key.bv_len;
+	cq->cq_key.bv_val = (char *)( cq + 1 );
+	AC_MEMCPY( cq->cq_key.bv_val, key.cq_key.bv_val, key.cq_key.bv_len );
+	op->o_tmpfree( key.cq_key.bv_val, op->o_tmpmemctx );
+	cq->cq_tail = &cq->cq_res;
+	cq->cq_txnid = txnid;
+	cq->cq_state = CQ_RUNNING;
+	cq->cq_refs = 2;	/* the tree and us */
+	cq->cq_intree = 1;
+	avl_insert( &mdb->mi_cq_tree, cq, cq_cmp, avl_dup_error );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_cq_mutex );
+
+	cb.sc_response = cq_response;
+	cb.sc_private = cq;
+	cb.sc_next = op->o_callback;
+	op->o_callback = &cb;
+
+	rc = search_run( op, rs );
+
+	/* remove our callback, whatever was pushed above it */
+	{
+		slap_callback **scp;
+		for ( scp = &op->o_callback; *scp; scp = &(*scp)->sc_next ) {
+			if ( *scp == &cb ) {
+				*scp = cb.sc_next;
+				break;
+			}
+		}
+	}
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_cq_mutex );
+	if ( cq->cq_state == CQ_RUNNING )
+		cq->cq_state = CQ_BAD;
+	if ( cq->cq_state == CQ_BAD )
+		cq_free_res( cq );
+	if ( cq->cq_state == CQ_DONE && mdb->mi_coalesce_ttl ) {
+		/* keep it for the next ones */
+		cq->cq_expire = cq_now() + mdb->mi_coalesce_ttl;
+		cq->cq_refs++;
+		*mdb->mi_cq_donetail = cq;
+		mdb->mi_cq_donetail = &cq->cq_next;
+		mdb->mi_cq_ndone++;
+	} else {
+		cq_unlink( mdb, cq );
+	}
+	cq_release( cq );
+	ldap_pvt_thread_cond_broadcast( &mdb->mi_cq_cond );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_cq_mutex );
+	return rc;
+}
+
+/* Searches that depend on nothing but their parameters, the bound
+ * identity and the database, read from their own read txn
+ */
+static int
+search_coalescable( Operation *op, struct mdb_info *mdb )
+{
+	OpExtra *oex;
+
+	if ( op->o_ctrls || !op->o_conn )
+		return 0;
+	/* only the bound identity and the ssf are compared */
+	if ( !acl_by_identity( op->o_bd->bd_self ))
+		return 0;
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == mdb || oex->oe_key == (void *)mdb_yield_get )
+			return 0;
+	}
+	return 1;
+}
+
+/* Abandon and Cancel, also sent for the operations of connections
+ * closed at shutdown: let waiting searches see it
+ */
+int
+mdb_coalesce_wake( Operation *op, SlapReply *rs )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+
+	if ( mdb->mi_coalesce ) {
+		ldap_pvt_thread_mutex_lock( &mdb->mi_cq_mutex );
+		ldap_pvt_thread_cond_broadcast( &mdb->mi_cq_cond );
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_cq_mutex );
+	}
+	return LDAP_OTHER;
+}
+
+int
+mdb_search( Operation *op, SlapReply *rs )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+
+	if ( mdb->mi_coalesce && search_coalescable( op, mdb ))
+		return search_coalesce( op, rs );
+	return search_run( op, rs );
+}
+
 
 static int base_candidate(
 	BackendDB	*be,
@@ -19,10 +19,12 @@
 #include <stdio.h>
 #include <ac/string.h>
 #include <ac/errno.h>
+#include <ac/unistd.h>
 
 #define AVL_INTERNAL
 #include "back-mdb.h"
 #include "idl.h"
+#include "lutil.h"
 
 #ifdef MDB_TOOL_IDL_CACHING
 static int mdb_tool_idl_flush( BackendDB *be, MDB_txn *txn );
@@ -68,6 +70,40 @@ static dn_id hbuf[HOLE_SIZE], *holes = hbuf;
 static unsigned nhmax = HOLE_SIZE;
 static unsigned nholes;
 
+/* Nobody else writes while a tool runs: IDs are handed out from
+ * memory once the last one in id2entry is known, and the subtree
+ * counts of the superiors of added entries are only updated when
+ * the parent changes, once for a run of siblings, or before the
+ * txn is committed.
+ */
+static ID mdb_tool_nextid;	/* 0 until read from id2entry */
+static ID mdb_tool_subs_pid, mdb_tool_nsubs;
+
+static int
+mdb_tool_subs_flush( BackendDB *be )
+{
+	Operation op = {0};
+	Opheader ohdr = {0};
+	int rc;
+
+	if ( !mdb_tool_nsubs )
+		return 0;
+
+	op.o_hdr = &ohdr;
+	op.o_bd = be;
+	op.o_tmpmemctx = NULL;
+	op.o_tmpmfuncs = &ch_mfuncs;
+
+	rc = mdb_dn2id_upsub( &op, mcp, mdb_tool_subs_pid, mdb_tool_nsubs );
+	mdb_tool_nsubs = 0;
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			"=> mdb_tool_subs_flush: subtree count update failed: %s (%d)\n",
+			mdb_strerror(rc), rc );
+	}
+	return rc;
+}
+
 static struct berval	*tool_base;
 static int		tool_scope;
 static Filter		*tool_filter;
@@ -87,6 +123,44 @@ static void * mdb_tool_index_task( void *ctx, void *ptr );
 
 static int	mdb_writes, mdb_writes_per_commit;
 
+/* 1 while slapindex has rebuilt every index of every entry so far */
+static int	mdb_tool_ixhash;
+
+int mdb_tool_sorting;
+static int mdb_tool_sort_open( struct mdb_info *mdb );
+static int mdb_tool_sort_flush( BackendDB *be );
+
+static int mdb_tool_rx_start( BackendDB *be );
+static int mdb_tool_rx_add( ID id );
+static int mdb_tool_rx_stop( void );
+
+/* Parallel readers for slapindex -q with toolsort. The main thread
+ * walks id2entry as usual and queues the IDs in batches; reader
+ * threads decode the entries of a batch in their own read txns and
+ * collect their keys, which go to the sort buffer. Nothing is written
+ * to the index DBs before the sorted keys are merged at close.
+ */
+#define MDB_TOOL_RX_BATCH	256
+
+typedef struct mdb_tool_rx_batch {
+	struct mdb_tool_rx_batch *rb_next;
+	int rb_nids;
+	ID rb_ids[MDB_TOOL_RX_BATCH];
+} mdb_tool_rx_batch;
+
+static struct {
+	ldap_pvt_thread_mutex_t rx_mutex;
+	ldap_pvt_thread_cond_t rx_work;	/* a batch is queued, or done */
+	ldap_pvt_thread_cond_t rx_room;	/* a batch was taken */
+	mdb_tool_rx_batch *rx_head, **rx_tail;
+	mdb_tool_rx_batch *rx_cur;		/* being filled */
+	int rx_queued;
+	int rx_done;
+	int rx_err;
+	int rx_nthreads;
+	ldap_pvt_thread_t *rx_threads;
+} mdb_tool_rx;
+
 /* Number of ops per commit in Quick mode.
  * Batching speeds writes overall, but too large a
  * batch will fail with MDB_TXN_FULL.
@@ -103,11 +177,22 @@ int mdb_tool_entry_open(
 {
 	/* In Quick mode, commit once per 500 entries */
 	mdb_writes = 0;
+	mdb_tool_ixhash = 0;
+	mdb_tool_nextid = 0;
+	mdb_tool_nsubs = 0;
 	if ( slapMode & SLAP_TOOL_QUICK )
 		mdb_writes_per_commit = MDB_WRITES_PER_COMMIT;
 	else
 		mdb_writes_per_commit = 1;
 
+	if (( slapMode & (SLAP_TOOL_QUICK|SLAP_TOOL_READONLY)) == SLAP_TOOL_QUICK ) {
+		struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+		if ( mdb->mi_tool_sort_size && mdb->mi_nattrs && !mdb_tool_sorting ) {
+			if ( mdb_tool_sort_open( mdb ))
+				return -1;
+		}
+	}
+
 #ifdef MDB_TOOL_IDL_CACHING			/* threaded indexing has no performance advantage */
 	/* Set up for threaded slapindex */
 	if (( slapMode & (SLAP_TOOL_QUICK|SLAP_TOOL_READONLY)) == SLAP_TOOL_QUICK ) {
@@ -147,6 +232,13 @@ int mdb_tool_entry_open(
 int mdb_tool_entry_close(
 	BackendDB *be )
 {
+	if ( mdb_tool_rx.rx_nthreads > 0 ) {
+		/* leave the index DBs alone if any reader failed */
+		if ( mdb_tool_rx_stop())
+			return -1;
+	}
+	mdb_tool_rx.rx_nthreads = 0;
+
 #ifdef MDB_TOOL_IDL_CACHING
 	if ( mdb_tool_info ) {
 		int i;
@@ -208,7 +300,8 @@ int mdb_tool_entry_close(
 	}
 	if( mdb_tool_txn ) {
 		int rc;
-		if (( rc = mdb_txn_commit( mdb_tool_txn ))) {
+		if (( rc = mdb_tool_subs_flush( be )) ||
+			( rc = mdb_txn_commit( mdb_tool_txn ))) {
 			Debug( LDAP_DEBUG_ANY,
 				LDAP_XSTRING(mdb_tool_entry_close) ": database %s: "
 				"txn_commit failed: %s (%d)\n",
@@ -229,6 +322,11 @@ int mdb_tool_entry_close(
 		txi = NULL;
 	}
 
+	if( mdb_tool_sorting ) {
+		if ( mdb_tool_sort_flush( be ))
+			return -1;
+	}
+
 	if( nholes ) {
 		unsigned i;
 		fprintf( stderr, "Error, entries missing!\n");
@@ -240,6 +338,33 @@ int mdb_tool_entry_close(
 		return -1;
 	}
 
+	/* All keys are now made with the current hash */
+	if ( mdb_tool_ixhash > 0 ) {
+		struct mdb_info *mdb = be->be_private;
+		MDB_txn *txn;
+		int rc;
+
+		mdb_tool_ixhash = 0;
+		if ( mdb->mi_flags & MDB_IXHASH_STALE ) {
+			rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+			if ( rc == 0 ) {
+				rc = mdb_ixhash_put( mdb, txn );
+				if ( rc == 0 )
+					rc = mdb_txn_commit( txn );
+				else
+					mdb_txn_abort( txn );
+			}
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_tool_entry_close) ": database %s: "
+					"recording index hash failed: %s (%d)\n",
+					be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+				return -1;
+			}
+			mdb->mi_flags ^= MDB_IXHASH_STALE;
+		}
+	}
+
 	return 0;
 }
 
@@ -464,6 +589,7 @@ static int mdb_tool_next_id(
 	struct berval *text,
 	int hole )
 {
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	struct berval dn = e->e_name;
 	struct berval ndn = e->e_nname;
 	struct berval pdn, npdn, nmatched;
@@ -501,16 +627,26 @@ static int mdb_tool_next_id(
 				pid = id;
 			}
 		}
-		rc = mdb_next_id( op->o_bd, idcursor, &e->e_id );
-		if ( rc ) {
-			snprintf( text->bv_val, text->bv_len,
-				"next_id failed: %s (%d)",
-				mdb_strerror(rc), rc );
-		Debug( LDAP_DEBUG_ANY,
-			"=> mdb_tool_next_id: %s\n", text->bv_val );
-			return rc;
+		if ( !mdb_tool_nextid ) {
+			rc = mdb_next_id( op->o_bd, idcursor, &mdb_tool_nextid );
+			if ( rc ) {
+				snprintf( text->bv_val, text->bv_len,
+					"next_id failed: %s (%d)",
+					mdb_strerror(rc), rc );
+			Debug( LDAP_DEBUG_ANY,
+				"=> mdb_tool_next_id: %s\n", text->bv_val );
+				return rc;
+			}
+		}
+		e->e_id = mdb_tool_nextid++;
+		mdb->mi_nextid = e->e_id;
+		rc = mdb_dn2id_add( op, mcp, mcd, pid, 1, 0, e );
+		if ( rc == 0 && pid ) {
+			if ( pid != mdb_tool_subs_pid )
+				rc = mdb_tool_subs_flush( op->o_bd );
+			mdb_tool_subs_pid = pid;
+			mdb_tool_nsubs++;
 		}
-		rc = mdb_dn2id_add( op, mcp, mcd, pid, 1, 1, e );
 		if ( rc ) {
 			snprintf( text->bv_val, text->bv_len,
 				"dn2id_add failed: %s (%d)",
@@ -756,7 +892,11 @@ done:
 		if ( mdb_writes >= mdb_writes_per_commit ) {
 			unsigned i;
 			MDB_TOOL_IDL_FLUSH( be, mdb_tool_txn );
-			rc = mdb_txn_commit( mdb_tool_txn );
+			rc = mdb_tool_subs_flush( be );
+			if ( rc == 0 )
+				rc = mdb_txn_commit( mdb_tool_txn );
+			else
+				mdb_txn_abort( mdb_tool_txn );
 			for ( i=0; i<mdb->mi_nattrs; i++ )
 				mdb->mi_attrs[i]->ai_cursor = NULL;
 			mdb_writes = 0;
@@ -764,6 +904,7 @@ done:
 			idcursor = NULL;
 			if( rc != 0 ) {
 				mdb->mi_numads = 0;
+				mdb_tool_nextid = 0;
 				snprintf( text->bv_val, text->bv_len,
 						"txn_commit failed: %s (%d)",
 						mdb_strerror(rc), rc );
@@ -779,6 +920,8 @@ done:
 		mdb_txn_abort( mdb_tool_txn );
 		mdb_tool_txn = NULL;
 		idcursor = NULL;
+		mdb_tool_nextid = 0;
+		mdb_tool_nsubs = 0;
 		for ( i=0; i<mdb->mi_nattrs; i++ )
 			mdb->mi_attrs[i]->ai_cursor = NULL;
 		mdb_writes = 0;
@@ -797,10 +940,27 @@ done:
 
 static int mdb_dn2id_upgrade( BackendDB *be );
 
+static int mdb_tool_entry_reindex_int(
+	BackendDB *be, ID id, AttributeDescription **adv );
+
 int mdb_tool_entry_reindex(
 	BackendDB *be,
 	ID id,
 	AttributeDescription **adv )
+{
+	int rc = mdb_tool_entry_reindex_int( be, id, adv );
+
+	if ( rc || adv )
+		mdb_tool_ixhash = -1;
+	else if ( !mdb_tool_ixhash )
+		mdb_tool_ixhash = 1;
+	return rc;
+}
+
+static int mdb_tool_entry_reindex_int(
+	BackendDB *be,
+	ID id,
+	AttributeDescription **adv )
 {
 	struct mdb_info *mi = (struct mdb_info *) be->be_private;
 	int rc;
@@ -869,16 +1029,6 @@ int mdb_tool_entry_reindex(
 		mi->mi_nattrs = i;
 	}
 
-	e = mdb_tool_entry_get( be, id );
-
-	if( e == NULL ) {
-		Debug( LDAP_DEBUG_ANY,
-			LDAP_XSTRING(mdb_tool_entry_reindex)
-			": could not locate id=%ld\n",
-			(long) id );
-		return -1;
-	}
-
 	if ( !txi ) {
 		rc = mdb_txn_begin( mi->mi_dbenv, NULL, 0, &txi );
 		if( rc != 0 ) {
@@ -886,7 +1036,7 @@ int mdb_tool_entry_reindex(
 				"=> " LDAP_XSTRING(mdb_tool_entry_reindex) ": "
 				"txn_begin failed: %s (%d)\n",
 				mdb_strerror(rc), rc );
-			goto done;
+			return -1;
 		}
 	}
 
@@ -906,6 +1056,27 @@ int mdb_tool_entry_reindex(
 		slapMode ^= SLAP_TRUNCATE_MODE;
 	}
 
+	/* With keys going to the sort buffer, hand the entry to the
+	 * reader threads.
+	 */
+	if ( mdb_tool_sorting && slap_tool_thread_max > 1 &&
+		mdb_tool_rx.rx_nthreads >= 0 )
+	{
+		if ( mdb_tool_rx.rx_nthreads || mdb_tool_rx_start( be ) == 0 )
+			return mdb_tool_rx_add( id ) ? -1 : 0;
+		mdb_tool_rx.rx_nthreads = -1;
+	}
+
+	e = mdb_tool_entry_get( be, id );
+
+	if( e == NULL ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_tool_entry_reindex)
+			": could not locate id=%ld\n",
+			(long) id );
+		return -1;
+	}
+
 	/*
 	 * just (re)add them for now
 	 * Use truncate mode to empty/reset index databases
@@ -922,7 +1093,6 @@ int mdb_tool_entry_reindex(
 
 	rc = mdb_tool_index_add( &op, txi, e );
 
-done:
 	if( rc == 0 ) {
 		mdb_writes++;
 		if ( mdb_writes >= mdb_writes_per_commit ) {
@@ -1019,6 +1189,11 @@ ID mdb_tool_entry_modify(
 	op.o_tmpmemctx = NULL;
 	op.o_tmpmfuncs = &ch_mfuncs;
 
+	rc = mdb_tool_subs_flush( be );
+	if( rc != 0 ) {
+		goto done;
+	}
+
 	/* id2entry index */
 	rc = mdb_id2entry_update( &op, mdb_tool_txn, NULL, e );
 	if( rc != 0 ) {
@@ -1046,6 +1221,7 @@ done:
 
 	} else {
 		mdb_txn_abort( mdb_tool_txn );
+		mdb_tool_nextid = 0;
 		snprintf( text->bv_val, text->bv_len,
 			"txn_aborted! %s (%d)",
 			mdb_strerror(rc), rc );
@@ -1120,6 +1296,13 @@ int mdb_tool_entry_delete(
 	op.o_tmpmemctx = NULL;
 	op.o_tmpmfuncs = &ch_mfuncs;
 
+	/* the counts it takes off must all be in place */
+	e = NULL;
+	rc = mdb_tool_subs_flush( be );
+	if( rc != 0 ) {
+		goto done;
+	}
+
 	rc = mdb_dn2entry( &op, mdb_tool_txn, cursor, ndn, &e, NULL, 0 );
 	if( rc != 0 ) {
 		snprintf( text->bv_val, text->bv_len,
@@ -1205,6 +1388,7 @@ done:
 
 	} else {
 		mdb_txn_abort( mdb_tool_txn );
+		mdb_tool_nextid = 0;
 		snprintf( text->bv_val, text->bv_len,
 			"txn_aborted! %s (%d)",
 			mdb_strerror(rc), rc );
@@ -1259,6 +1443,640 @@ mdb_tool_index_task( void *ctx, void *ptr )
 	return NULL;
 }
 
+/* External sort of index keys. With toolsort set, indexer() hands
+ * the keys of slapadd -q and slapindex -q to mdb_tool_sort_add()
+ * instead of writing them. They're sorted in a buffer of the given
+ * size, which is spilled to a temporary run file whenever it fills
+ * up. When the tool is done, the runs are merged and written to the
+ * index DBs in key order, with MDB_APPEND for DBs that were empty.
+ */
+typedef struct mdb_tool_skey {
+	ID sk_id;
+	MDB_dbi sk_dbi;
+	unsigned sk_len;
+	/* key follows */
+} mdb_tool_skey;
+
+#define SKEY_SIZE(len)	(( sizeof( mdb_tool_skey ) + (len) + sizeof( ID ) - 1 ) & \
+	~( sizeof( ID ) - 1 ))
+
+/* a sorted run being merged */
+typedef struct mdb_tool_srun {
+	FILE *sr_fp;
+	mdb_tool_skey **sr_keys;	/* the last run, still in memory */
+	int sr_nkeys;
+	mdb_tool_skey *sr_key;		/* current key */
+	mdb_tool_skey *sr_buf;		/* current key of a run file */
+	size_t sr_size;
+} mdb_tool_srun;
+
+static struct {
+	ldap_pvt_thread_mutex_t ts_mutex;
+	char *ts_buf;
+	size_t ts_size;
+	size_t ts_used;			/* keys, from the start of ts_buf */
+	mdb_tool_skey **ts_top;	/* pointers to keys, down from the end */
+	int ts_nkeys;
+	const char *ts_dir;
+	FILE **ts_runs;
+	int ts_nruns;
+} mdb_tool_ts;
+
+static int
+mdb_tool_skey_cmp( const mdb_tool_skey *k1, const mdb_tool_skey *k2 )
+{
+	unsigned len;
+	int rc;
+
+	if ( k1->sk_dbi != k2->sk_dbi )
+		return k1->sk_dbi < k2->sk_dbi ? -1 : 1;
+	/* the default MDB key order */
+	len = k1->sk_len < k2->sk_len ? k1->sk_len : k2->sk_len;
+	rc = memcmp( k1+1, k2+1, len );
+	if ( rc )
+		return rc;
+	if ( k1->sk_len != k2->sk_len )
+		return k1->sk_len < k2->sk_len ? -1 : 1;
+	if ( k1->sk_id != k2->sk_id )
+		return k1->sk_id < k2->sk_id ? -1 : 1;
+	return 0;
+}
+
+static int
+mdb_tool_skey_qcmp( const void *v1, const void *v2 )
+{
+	return mdb_tool_skey_cmp( *(mdb_tool_skey * const *)v1,
+		*(mdb_tool_skey * const *)v2 );
+}
+
+static int
+mdb_tool_sort_open( struct mdb_info *mdb )
+{
+	size_t size = mdb->mi_tool_sort_size & ~( sizeof( ID ) - 1 );
+
+	mdb_tool_ts.ts_buf = ch_malloc( size );
+	mdb_tool_ts.ts_size = size;
+	mdb_tool_ts.ts_used = 0;
+	mdb_tool_ts.ts_top = (mdb_tool_skey **)( mdb_tool_ts.ts_buf + size );
+	mdb_tool_ts.ts_nkeys = 0;
+	mdb_tool_ts.ts_dir = mdb->mi_tool_sort_dir ?
+		mdb->mi_tool_sort_dir : mdb->mi_dbenv_home;
+	mdb_tool_ts.ts_runs = NULL;
+	mdb_tool_ts.ts_nruns = 0;
+	ldap_pvt_thread_mutex_init( &mdb_tool_ts.ts_mutex );
+	mdb_tool_sorting = 1;
+	return 0;
+}
+
+/* Sort the buffer and write it out as a new run */
+static int
+mdb_tool_sort_spill( void )
+{
+	mdb_tool_skey **keys = mdb_tool_ts.ts_top - mdb_tool_ts.ts_nkeys;
+	char path[MAXPATHLEN];
+	FILE *fp = NULL;
+	int i, fd;
+
+	qsort( keys, mdb_tool_ts.ts_nkeys, sizeof( mdb_tool_skey * ),
+		mdb_tool_skey_qcmp );
+
+	snprintf( path, sizeof( path ), "%s" LDAP_DIRSEP "mdbsortXXXXXX",
+		mdb_tool_ts.ts_dir );
+	fd = mkstemp( path );
+	if ( fd >= 0 ) {
+		/* only needed as long as we hold it open */
+		unlink( path );
+		fp = fdopen( fd, "w+b" );
+		if ( !fp )
+			close( fd );
+	}
+	if ( !fp ) {
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_tool_sort_spill)
+			": cannot create run file in %s: %s\n",
+			mdb_tool_ts.ts_dir, AC_STRERROR_R( errno, path, sizeof( path )));
+		return -1;
+	}
+	for ( i = 0; i < mdb_tool_ts.ts_nkeys; i++ ) {
+		if ( fwrite( keys[i], sizeof( mdb_tool_skey ) + keys[i]->sk_len,
+			1, fp ) != 1 )
+			break;
+	}
+	if ( i < mdb_tool_ts.ts_nkeys || fflush( fp )) {
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_tool_sort_spill)
+			": cannot write run file in %s: %s\n",
+			mdb_tool_ts.ts_dir, AC_STRERROR_R( errno, path, sizeof( path )));
+		fclose( fp );
+		return -1;
+	}
+
+	mdb_tool_ts.ts_runs = ch_realloc( mdb_tool_ts.ts_runs,
+		( mdb_tool_ts.ts_nruns + 1 ) * sizeof( FILE * ));
+	mdb_tool_ts.ts_runs[mdb_tool_ts.ts_nruns++] = fp;
+	mdb_tool_ts.ts_used = 0;
+	mdb_tool_ts.ts_nkeys = 0;
+	return 0;
+}
+
+#define SKEY_FITS(size)	( mdb_tool_ts.ts_used + (size) + \
+	( mdb_tool_ts.ts_nkeys + 1 ) * sizeof( mdb_tool_skey * ) <= \
+	mdb_tool_ts.ts_size )
+
+/* Add one key to the buffer, called with ts_mutex held.
+ * Returns 1 if the key doesn't fit even in an empty buffer.
+ */
+static int
+mdb_tool_sort_key( MDB_dbi dbi, struct berval *kv, ID id )
+{
+	mdb_tool_skey *k;
+	size_t size = SKEY_SIZE( kv->bv_len );
+	int rc;
+
+	if ( !SKEY_FITS( size )) {
+		if ( !mdb_tool_ts.ts_nkeys )
+			return 1;
+		rc = mdb_tool_sort_spill();
+		if ( rc )
+			return rc;
+		if ( !SKEY_FITS( size ))
+			return 1;
+	}
+	k = (mdb_tool_skey *)( mdb_tool_ts.ts_buf + mdb_tool_ts.ts_used );
+	k->sk_id = id;
+	k->sk_dbi = dbi;
+	k->sk_len = kv->bv_len;
+	AC_MEMCPY( k+1, kv->bv_val, kv->bv_len );
+	mdb_tool_ts.ts_used += size;
+	mdb_tool_ts.ts_nkeys++;
+	mdb_tool_ts.ts_top[-mdb_tool_ts.ts_nkeys] = k;
+	return 0;
+}
+
+int
+mdb_tool_sort_add(
+	BackendDB *be,
+	MDB_cursor *mc,
+	struct berval *keys,
+	ID id )
+{
+	MDB_dbi dbi = mdb_cursor_dbi( mc );
+	int i, rc = 0;
+
+	ldap_pvt_thread_mutex_lock( &mdb_tool_ts.ts_mutex );
+	for ( i = 0; keys[i].bv_val; i++ ) {
+		rc = mdb_tool_sort_key( dbi, &keys[i], id );
+		if ( rc == 1 ) {
+			/* a single key doesn't fit, write it now */
+			ldap_pvt_thread_mutex_unlock( &mdb_tool_ts.ts_mutex );
+			return mdb_idl_insert_keys( be, mc, keys + i, id );
+		}
+		if ( rc )
+			break;
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb_tool_ts.ts_mutex );
+	return rc;
+}
+
+/* Add the keys collected by a reader thread */
+static int
+mdb_tool_sort_ixkeys( mdb_ixkeys *ik )
+{
+	mdb_ixkey *k;
+	int i, rc = 0;
+
+	ldap_pvt_thread_mutex_lock( &mdb_tool_ts.ts_mutex );
+	for ( i = 0; i < ik->ik_nkeys; i++ ) {
+		k = ik->ik_keys[i];
+		rc = mdb_tool_sort_key( k->ik_ai->ai_dbi, &k->ik_key, k->ik_id );
+		if ( rc ) {
+			/* there's no write txn to put it in */
+			if ( rc == 1 )
+				Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_tool_sort_ixkeys)
+					": index key of %lu bytes doesn't fit in toolsort buffer\n",
+					(unsigned long) k->ik_key.bv_len );
+			break;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb_tool_ts.ts_mutex );
+	return rc;
+}
+
+/* Advance a run to its next key, sr_key is NULL at the end */
+static int
+mdb_tool_srun_next( mdb_tool_srun *sr )
+{
+	mdb_tool_skey hdr;
+
+	if ( !sr->sr_fp ) {
+		sr->sr_key = sr->sr_nkeys ? *sr->sr_keys++ : NULL;
+		if ( sr->sr_nkeys )
+			sr->sr_nkeys--;
+		return 0;
+	}
+	sr->sr_key = NULL;
+	if ( fread( &hdr, sizeof( hdr ), 1, sr->sr_fp ) != 1 )
+		return ferror( sr->sr_fp ) ? -1 : 0;
+	if ( sizeof( hdr ) + hdr.sk_len > sr->sr_size ) {
+		sr->sr_size = sizeof( hdr ) + hdr.sk_len;
+		sr->sr_buf = ch_realloc( sr->sr_buf, sr->sr_size );
+	}
+	sr->sr_key = sr->sr_buf;
+	*sr->sr_key = hdr;
+	if ( hdr.sk_len && fread( sr->sr_key+1, hdr.sk_len, 1, sr->sr_fp ) != 1 )
+		return -1;
+	return 0;
+}
+
+/* Write the IDs of one key. Empty DBs get an append. */
+static int
+mdb_tool_sort_put( BackendDB *be, MDB_cursor *mc, int append,
+	MDB_val *key, ID *ids, int n )
+{
+	MDB_val data[2];
+	ID range[3];
+	size_t one;
+	int rc = 0, i;
+
+	if ( !append ) {
+		struct berval keys[2];
+		keys[0].bv_val = key->mv_data;
+		keys[0].bv_len = key->mv_size;
+		BER_BVZERO( &keys[1] );
+		for ( i = 0; i < n && rc == 0; i++ )
+			rc = mdb_idl_insert_keys( be, mc, keys, ids[i] );
+		return rc;
+	}
+
+	if ( n > MDB_idl_db_size ) {
+		range[0] = 0;
+		range[1] = ids[0];
+		range[2] = ids[n-1];
+		ids = range;
+		n = 3;
+	}
+	data[0].mv_size = sizeof( ID );
+	data[0].mv_data = ids;
+	/* the cursor is still on the previous key */
+	one = 1;
+	rc = mdb_cursor_put_multiple( mc, key, data, &one, MDB_APPEND );
+	if ( rc == 0 && n > 1 ) {
+		data[0].mv_data = ids + 1;
+		data[1].mv_size = n - 1;
+		rc = mdb_cursor_put( mc, key, data, MDB_APPENDDUP|MDB_MULTIPLE );
+	}
+	return rc;
+}
+
+/* Merge the runs into the index DBs */
+static int
+mdb_tool_sort_flush( BackendDB *be )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	mdb_tool_srun *runs, *sr;
+	int i, nruns, n = 0, max = 0, append = 0, rc = 0;
+	unsigned long writes = 0;
+	mdb_tool_skey *k, *last = NULL;
+	MDB_txn *txn = NULL;
+	MDB_cursor *mc = NULL;
+	MDB_dbi dbi = 0;
+	MDB_val key;
+	ID *ids = NULL;
+
+	mdb_tool_sorting = 0;
+	if ( mdb_tool_ts.ts_nruns && mdb_tool_ts.ts_nkeys ) {
+		/* unless everything fit in memory */
+		rc = mdb_tool_sort_spill();
+		if ( rc )
+			goto done;
+	}
+	nruns = mdb_tool_ts.ts_nruns ? mdb_tool_ts.ts_nruns : 1;
+	runs = ch_calloc( nruns, sizeof( mdb_tool_srun ));
+	if ( mdb_tool_ts.ts_nruns ) {
+		for ( i = 0; i < nruns; i++ ) {
+			runs[i].sr_fp = mdb_tool_ts.ts_runs[i];
+			rewind( runs[i].sr_fp );
+			if ( mdb_tool_srun_next( &runs[i] ))
+				rc = -1;
+		}
+	} else {
+		runs[0].sr_keys = mdb_tool_ts.ts_top - mdb_tool_ts.ts_nkeys;
+		runs[0].sr_nkeys = mdb_tool_ts.ts_nkeys;
+		qsort( runs[0].sr_keys, runs[0].sr_nkeys, sizeof( mdb_tool_skey * ),
+			mdb_tool_skey_qcmp );
+		mdb_tool_srun_next( &runs[0] );
+	}
+
+	while ( rc == 0 ) {
+		/* k-way merge, runs are few */
+		sr = NULL;
+		for ( i = 0; i < nruns; i++ ) {
+			if ( runs[i].sr_key && ( !sr ||
+				mdb_tool_skey_cmp( runs[i].sr_key, sr->sr_key ) < 0 ))
+				sr = &runs[i];
+		}
+		k = sr ? sr->sr_key : NULL;
+
+		/* a new key, write out the IDs of the previous one */
+		if ( n && ( !k || k->sk_dbi != last->sk_dbi || k->sk_len != last->sk_len ||
+			memcmp( k+1, last+1, k->sk_len ))) {
+			if ( !txn ) {
+				rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+				if ( rc )
+					break;
+			}
+			if ( !mc || dbi != last->sk_dbi ) {
+				MDB_stat ms;
+				if ( mc )
+					mdb_cursor_close( mc );
+				if ( dbi != last->sk_dbi ) {
+					dbi = last->sk_dbi;
+					rc = mdb_stat( txn, dbi, &ms );
+					/* the exact counts of idlexact aren't kept in order */
+					append = rc == 0 && !ms.ms_entries && !mdb->mi_idl_exact;
+				}
+				if ( rc == 0 )
+					rc = mdb_cursor_open( txn, dbi, &mc );
+				if ( rc ) {
+					mc = NULL;
+					break;
+				}
+			}
+			key.mv_data = last+1;
+			key.mv_size = last->sk_len;
+			rc = mdb_tool_sort_put( be, mc, append, &key, ids, n );
+			if ( rc )
+				break;
+			writes += n;
+			n = 0;
+			if ( writes >= MDB_WRITES_PER_COMMIT * 1024 ) {
+				mdb_cursor_close( mc );
+				mc = NULL;
+				rc = mdb_txn_commit( txn );
+				txn = NULL;
+				if ( rc )
+					break;
+				writes = 0;
+			}
+		}
+		if ( !k )
+			break;
+
+		/* collect the IDs of this key */
+		if ( !n || ids[n-1] != k->sk_id ) {
+			if ( n == max ) {
+				max = max ? max * 2 : 1024;
+				ids = ch_realloc( ids, max * sizeof( ID ));
+			}
+			ids[n++] = k->sk_id;
+		}
+		if ( sr->sr_fp ) {
+			/* keep the key, the run reuses its buffer */
+			if ( n == 1 ) {
+				ch_free( last );
+				last = ch_malloc( sizeof( mdb_tool_skey ) + k->sk_len );
+				AC_MEMCPY( last, k, sizeof( mdb_tool_skey ) + k->sk_len );
+			}
+		} else {
+			last = k;
+		}
+		if ( mdb_tool_srun_next( sr ))
+			rc = -1;
+	}
+
+	if ( mc )
+		mdb_cursor_close( mc );
+	if ( txn ) {
+		if ( rc == 0 )
+			rc = mdb_txn_commit( txn );
+		else
+			mdb_txn_abort( txn );
+	}
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_tool_sort_flush)
+			": writing index keys failed: %s (%d)\n",
+			rc > 0 ? mdb_strerror( rc ) : "cannot read run file", rc );
+	}
+	if ( mdb_tool_ts.ts_nruns ) {
+		for ( i = 0; i < nruns; i++ )
+			ch_free( runs[i].sr_buf );
+		ch_free( last );
+	}
+	ch_free( runs );
+	ch_free( ids );
+
+done:
+	for ( i = 0; i < mdb_tool_ts.ts_nruns; i++ )
+		fclose( mdb_tool_ts.ts_runs[i] );
+	ch_free( mdb_tool_ts.ts_runs );
+	ch_free( mdb_tool_ts.ts_buf );
+	ldap_pvt_thread_mutex_destroy( &mdb_tool_ts.ts_mutex );
+	memset( &mdb_tool_ts, 0, sizeof( mdb_tool_ts ));
+	return rc;
+}
+
+static int
+mdb_tool_rx_batch_index( Operation *op, MDB_txn *txn, mdb_tool_rx_batch *rb )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	MDB_val kv, dv;
+	Entry *e;
+	int i, rc;
+
+	rc = mdb_cursor_open( txn, mdb->mi_id2entry, &mc );
+	if ( rc )
+		return rc;
+	kv.mv_size = sizeof( ID );
+	for ( i = 0; i < rb->rb_nids; i++ ) {
+		kv.mv_data = &rb->rb_ids[i];
+		rc = mdb_cursor_get( mc, &kv, &dv, MDB_SET );
+		if ( rc )
+			break;
+		e = NULL;
+		rc = mdb_entry_decode( op, txn, &dv, rb->rb_ids[i], &e );
+		if ( rc )
+			break;
+		e->e_id = rb->rb_ids[i];
+		BER_BVZERO( &e->e_name );
+		BER_BVZERO( &e->e_nname );
+		/* no txn, only collect the keys */
+		rc = mdb_index_entry_add( op, NULL, e );
+		mdb_entry_return( op, e );
+		if ( rc )
+			break;
+	}
+	mdb_cursor_close( mc );
+	return rc;
+}
+
+static void *
+mdb_tool_rx_task( void *arg )
+{
+	BackendDB *be = arg;
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	Operation op = {0};
+	Opheader ohdr = {0};
+	mdb_ixkeys ik;
+	mdb_tool_rx_batch *rb;
+	MDB_txn *txn = NULL;
+	int rc;
+
+	op.o_hdr = &ohdr;
+	op.o_bd = be;
+	op.o_tmpmemctx = NULL;
+	op.o_tmpmfuncs = &ch_mfuncs;
+	memset( &ik, 0, sizeof( ik ));
+	LDAP_SLIST_INSERT_HEAD( &op.o_extra, &ik.ik_oe, oe_next );
+
+	ldap_pvt_thread_mutex_lock( &mdb_tool_rx.rx_mutex );
+	for (;;) {
+		while ( !mdb_tool_rx.rx_head && !mdb_tool_rx.rx_done )
+			ldap_pvt_thread_cond_wait( &mdb_tool_rx.rx_work,
+				&mdb_tool_rx.rx_mutex );
+		rb = mdb_tool_rx.rx_head;
+		if ( !rb )
+			break;
+		mdb_tool_rx.rx_head = rb->rb_next;
+		if ( !mdb_tool_rx.rx_head )
+			mdb_tool_rx.rx_tail = &mdb_tool_rx.rx_head;
+		mdb_tool_rx.rx_queued--;
+		ldap_pvt_thread_cond_signal( &mdb_tool_rx.rx_room );
+		if ( mdb_tool_rx.rx_err ) {
+			/* just drain the queue */
+			ch_free( rb );
+			continue;
+		}
+		ldap_pvt_thread_mutex_unlock( &mdb_tool_rx.rx_mutex );
+
+		if ( txn )
+			rc = mdb_txn_renew( txn );
+		else
+			rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
+		if ( rc == 0 ) {
+			rc = mdb_tool_rx_batch_index( &op, txn, rb );
+			mdb_txn_reset( txn );
+		}
+		if ( rc == 0 )
+			rc = mdb_tool_sort_ixkeys( &ik );
+		mdb_ixkeys_free( &ik );
+
+		ldap_pvt_thread_mutex_lock( &mdb_tool_rx.rx_mutex );
+		if ( rc && !mdb_tool_rx.rx_err ) {
+			Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_tool_rx_task)
+				": reindexing ids %ld-%ld failed: %s (%d)\n",
+				(long) rb->rb_ids[0], (long) rb->rb_ids[rb->rb_nids-1],
+				mdb_strerror( rc ), rc );
+			mdb_tool_rx.rx_err = rc;
+		}
+		ch_free( rb );
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb_tool_rx.rx_mutex );
+
+	if ( txn )
+		mdb_txn_abort( txn );
+	return NULL;
+}
+
+static int
+mdb_tool_rx_start( BackendDB *be )
+{
+	int i;
+
+	ldap_pvt_thread_mutex_init( &mdb_tool_rx.rx_mutex );
+	ldap_pvt_thread_cond_init( &mdb_tool_rx.rx_work );
+	ldap_pvt_thread_cond_init( &mdb_tool_rx.rx_room );
+	mdb_tool_rx.rx_head = NULL;
+	mdb_tool_rx.rx_tail = &mdb_tool_rx.rx_head;
+	mdb_tool_rx.rx_cur = NULL;
+	mdb_tool_rx.rx_queued = 0;
+	mdb_tool_rx.rx_done = 0;
+	mdb_tool_rx.rx_err = 0;
+	mdb_tool_rx.rx_threads = ch_malloc( ( slap_tool_thread_max - 1 ) *
+		sizeof( ldap_pvt_thread_t ));
+	for ( i = 0; i < slap_tool_thread_max - 1; i++ ) {
+		if ( ldap_pvt_thread_create( &mdb_tool_rx.rx_threads[i], 0,
+			mdb_tool_rx_task, be ))
+			break;
+	}
+	mdb_tool_rx.rx_nthreads = i;
+	if ( !i ) {
+		ch_free( mdb_tool_rx.rx_threads );
+		ldap_pvt_thread_cond_destroy( &mdb_tool_rx.rx_room );
+		ldap_pvt_thread_cond_destroy( &mdb_tool_rx.rx_work );
+		ldap_pvt_thread_mutex_destroy( &mdb_tool_rx.rx_mutex );
+		return -1;
+	}
+	return 0;
+}
+
+/* Queue the current batch, waiting for room */
+static int
+mdb_tool_rx_queue( void )
+{
+	int rc;
+
+	ldap_pvt_thread_mutex_lock( &mdb_tool_rx.rx_mutex );
+	while ( mdb_tool_rx.rx_queued >= 2 * mdb_tool_rx.rx_nthreads &&
+		!mdb_tool_rx.rx_err )
+		ldap_pvt_thread_cond_wait( &mdb_tool_rx.rx_room,
+			&mdb_tool_rx.rx_mutex );
+	rc = mdb_tool_rx.rx_err;
+	if ( rc ) {
+		ch_free( mdb_tool_rx.rx_cur );
+	} else {
+		mdb_tool_rx.rx_cur->rb_next = NULL;
+		*mdb_tool_rx.rx_tail = mdb_tool_rx.rx_cur;
+		mdb_tool_rx.rx_tail = &mdb_tool_rx.rx_cur->rb_next;
+		mdb_tool_rx.rx_queued++;
+		ldap_pvt_thread_cond_signal( &mdb_tool_rx.rx_work );
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb_tool_rx.rx_mutex );
+	mdb_tool_rx.rx_cur = NULL;
+	return rc;
+}
+
+static int
+mdb_tool_rx_add( ID id )
+{
+	mdb_tool_rx_batch *rb = mdb_tool_rx.rx_cur;
+
+	if ( !rb ) {
+		rb = ch_malloc( sizeof( mdb_tool_rx_batch ));
+		rb->rb_nids = 0;
+		mdb_tool_rx.rx_cur = rb;
+	}
+	rb->rb_ids[rb->rb_nids++] = id;
+	if ( rb->rb_nids == MDB_TOOL_RX_BATCH )
+		return mdb_tool_rx_queue();
+	return 0;
+}
+
+/* Queue the last batch and wait for the readers to finish */
+static int
+mdb_tool_rx_stop( void )
+{
+	int i, rc = 0;
+
+	if ( mdb_tool_rx.rx_cur )
+		rc = mdb_tool_rx_queue();
+
+	ldap_pvt_thread_mutex_lock( &mdb_tool_rx.rx_mutex );
+	mdb_tool_rx.rx_done = 1;
+	ldap_pvt_thread_cond_broadcast( &mdb_tool_rx.rx_work );
+	ldap_pvt_thread_mutex_unlock( &mdb_tool_rx.rx_mutex );
+	for ( i = 0; i < mdb_tool_rx.rx_nthreads; i++ )
+		ldap_pvt_thread_join( mdb_tool_rx.rx_threads[i], NULL );
+	if ( !rc )
+		rc = mdb_tool_rx.rx_err;
+
+	ch_free( mdb_tool_rx.rx_threads );
+	mdb_tool_rx.rx_threads = NULL;
+	mdb_tool_rx.rx_nthreads = 0;
+	ldap_pvt_thread_cond_destroy( &mdb_tool_rx.rx_room );
+	ldap_pvt_thread_cond_destroy( &mdb_tool_rx.rx_work );
+	ldap_pvt_thread_mutex_destroy( &mdb_tool_rx.rx_mutex );
+	return rc;
+}
+
 #ifdef MDB_TOOL_IDL_CACHING
 static int
 mdb_tool_idl_cmp( const void *v1, const void *v2 )
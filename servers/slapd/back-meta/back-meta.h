@@ -308,6 +308,8 @@ typedef struct metacommon_t {
 typedef struct metatarget_t {
 	char			*mt_uri;
 	ldap_pvt_thread_mutex_t	mt_uri_mutex;
+	/* per-URI probe results; only touched by the health check task */
+	ldap_uri_health_t	*mt_health;
 
 	/* TODO: we might want to enable different strategies
 	 * for different targets */
@@ -469,6 +471,9 @@ typedef struct metainfo_t {
 
 	time_t			mi_conn_ttl;
 	time_t			mi_idle_timeout;
+	time_t			mi_health_interval;
+	struct re_s		*mi_health_task;
+#define META_BACK_HEALTH_TIMEOUT	(5)
 
 	metacommon_t	mi_mc;
 	ldap_extra_t	*mi_ldap_extra;
@@ -510,6 +515,11 @@ extern void
 meta_back_conn_free(
 	void			*v_mc );
 
+extern void
+meta_back_health_schedule(
+	Backend			*be,
+	time_t			interval );
+
 #if META_BACK_PRINT_CONNTREE > 0
 extern void
 meta_back_print_conntree(
@@ -64,6 +64,7 @@ enum {
 	LDAP_BACK_CFG_SINGLECONN,
 	LDAP_BACK_CFG_USETEMP,
 	LDAP_BACK_CFG_CONNPOOLMAX,
+	LDAP_BACK_CFG_HEALTH_INTERVAL,
 	LDAP_BACK_CFG_LAST_BASE
 };
 
@@ -259,6 +260,15 @@ static ConfigTable metacfg[] = {
 			"SYNTAX OMsInteger "
 			"SINGLE-VALUE )",
 		NULL, NULL },
+	{ "health-check-interval", "interval", 2, 2, 0,
+		ARG_MAGIC|LDAP_BACK_CFG_HEALTH_INTERVAL,
+		meta_back_cf_gen, "( OLcfgDbAt:3.119 "
+			"NAME 'olcDbHealthCheckInterval' "
+			"DESC 'Interval between probes of the target URIs' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString "
+			"SINGLE-VALUE )",
+		NULL, NULL },
 #ifdef SLAP_CONTROL_X_SESSION_TRACKING
 	{ "session-tracking-request", "true|FALSE", 2, 2, 0,
 		ARG_MAGIC|ARG_ON_OFF|LDAP_BACK_CFG_ST_REQUEST,
@@ -467,6 +477,7 @@ static ConfigOCs metaocs[] = {
 			"$ olcDbSingleConn "
 			"$ olcDbUseTemporaryConn "
 			"$ olcDbConnectionPoolMax "
+			"$ olcDbHealthCheckInterval "
 
 			/* defaults, may be overridden per-target */
 			COMMON_ATTRS
@@ -1174,6 +1185,18 @@ meta_back_cf_gen( ConfigArgs *c )
 			c->value_int = mi->mi_conn_priv_max;
 			break;
 
+		case LDAP_BACK_CFG_HEALTH_INTERVAL:
+			if ( mi->mi_health_interval == 0 ) {
+				return 1;
+			} else {
+				char	buf[ SLAP_TEXT_BUFLEN ];
+
+				lutil_unparse_time( buf, sizeof( buf ), mi->mi_health_interval );
+				ber_str2bv( buf, 0, 0, &bv );
+				value_add_one( &c->rvalue_vals, &bv );
+			}
+			break;
+
 		/* common attrs */
 		case LDAP_BACK_CFG_BIND_TIMEOUT:
 			if ( mc->mc_bind_timeout.tv_sec == 0 &&
@@ -1644,6 +1667,13 @@ meta_back_cf_gen( ConfigArgs *c )
 			mi->mi_conn_priv_max = LDAP_BACK_CONN_PRIV_MIN;
 			break;
 
+		case LDAP_BACK_CFG_HEALTH_INTERVAL:
+			mi->mi_health_interval = 0;
+			if ( slapMode & SLAP_SERVER_RUNNING ) {
+				meta_back_health_schedule( c->be, 0 );
+			}
+			break;
+
 		/* common attrs */
 		case LDAP_BACK_CFG_BIND_TIMEOUT:
 			mc->mc_bind_timeout.tv_sec = 0;
@@ -2247,6 +2277,24 @@ meta_back_cf_gen( ConfigArgs *c )
 		mi->mi_idle_timeout = (time_t)t;
 		} break;
 
+	case LDAP_BACK_CFG_HEALTH_INTERVAL: {
+	/* interval between active probes of the target URIs */
+		unsigned long	t;
+
+		if ( lutil_parse_time( c->argv[ 1 ], &t ) ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"unable to parse health check interval \"%s\"",
+				c->argv[ 1 ] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+			return 1;
+
+		}
+		mi->mi_health_interval = (time_t)t;
+		if ( slapMode & SLAP_SERVER_RUNNING ) {
+			meta_back_health_schedule( c->be, mi->mi_health_interval );
+		}
+		} break;
+
 	case LDAP_BACK_CFG_CONN_TTL: {
 	/* conn ttl */
 		unsigned long	t;
@@ -24,6 +24,7 @@
 
 #include "slap.h"
 #include "config.h"
+#include "ldap_rq.h"
 #include "../back-ldap/back-ldap.h"
 #include "back-meta.h"
 
@@ -66,7 +67,7 @@ meta_back_initialize(
 	bi->bi_db_init = meta_back_db_init;
 	bi->bi_db_config = config_generic_wrapper;
 	bi->bi_db_open = meta_back_db_open;
-	bi->bi_db_close = 0;
+	bi->bi_db_close = meta_back_db_close;
 	bi->bi_db_destroy = meta_back_db_destroy;
 
 	bi->bi_op_bind = meta_back_bind;
@@ -232,6 +233,94 @@ meta_target_finish(
 	return 0;
 }
 
+/*
+ * Probes the URIs of every target with more than one, and puts the
+ * reachable ones first, fastest first, so that new connections
+ * (which try the URIs in order) go to the best available server.
+ */
+static void *
+meta_back_health_check( void *ctx, void *arg )
+{
+	struct re_s	*rtask = arg;
+	metainfo_t	*mi = rtask->arg;
+	int		i;
+
+	for ( i = 0; i < mi->mi_ntargets; i++ ) {
+		metatarget_t	*mt = mi->mi_targets[ i ];
+		char		*uris, *newuris = NULL;
+		time_t		timeout;
+
+		ldap_pvt_thread_mutex_lock( &mt->mt_uri_mutex );
+		uris = ch_strdup( mt->mt_uri );
+		ldap_pvt_thread_mutex_unlock( &mt->mt_uri_mutex );
+
+		/* nothing to choose from */
+		if ( strchr( uris, ' ' ) == NULL ) {
+			ch_free( uris );
+			continue;
+		}
+
+		timeout = mt->mt_network_timeout ?
+			mt->mt_network_timeout : META_BACK_HEALTH_TIMEOUT;
+		if ( mi->mi_ldap_extra->uri_probe( uris, &mt->mt_tls, timeout,
+			&mt->mt_health, &newuris ) == LDAP_SUCCESS )
+		{
+			ldap_pvt_thread_mutex_lock( &mt->mt_uri_mutex );
+			if ( strcmp( mt->mt_uri, newuris ) != 0 ) {
+				Debug( LDAP_DEBUG_TRACE,
+					"meta_back_health_check: target #%d uri=\"%s\"\n",
+					i, newuris );
+				ch_free( mt->mt_uri );
+				mt->mt_uri = newuris;
+				newuris = NULL;
+			}
+			ldap_pvt_thread_mutex_unlock( &mt->mt_uri_mutex );
+		}
+
+		ch_free( uris );
+		if ( newuris ) {
+			ch_free( newuris );
+		}
+	}
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	ldap_pvt_runqueue_resched( &slapd_rq, rtask, 0 );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	return NULL;
+}
+
+/*
+ * (Re)schedules the health check task with the given interval,
+ * or removes it if interval is 0
+ */
+void
+meta_back_health_schedule( Backend *be, time_t interval )
+{
+	metainfo_t	*mi = (metainfo_t *)be->be_private;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( interval == 0 ) {
+		if ( mi->mi_health_task != NULL ) {
+			if ( ldap_pvt_runqueue_isrunning( &slapd_rq, mi->mi_health_task ) ) {
+				ldap_pvt_runqueue_stoptask( &slapd_rq, mi->mi_health_task );
+			}
+			ldap_pvt_runqueue_remove( &slapd_rq, mi->mi_health_task );
+			mi->mi_health_task = NULL;
+		}
+
+	} else if ( mi->mi_health_task == NULL ) {
+		mi->mi_health_task = ldap_pvt_runqueue_insert( &slapd_rq,
+			interval, meta_back_health_check, mi,
+			"meta_back_health_check", be->be_suffix[0].bv_val );
+
+	} else {
+		mi->mi_health_task->interval.tv_sec = interval;
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
 int
 meta_back_db_open(
 	Backend		*be,
@@ -262,6 +351,20 @@ meta_back_db_open(
 			return 1;
 	}
 
+	meta_back_health_schedule( be, mi->mi_health_interval );
+
+	return 0;
+}
+
+int
+meta_back_db_close(
+	Backend		*be,
+	ConfigReply	*cr )
+{
+	if ( be->be_private ) {
+		meta_back_health_schedule( be, 0 );
+	}
+
 	return 0;
 }
 
@@ -433,6 +536,10 @@ meta_back_db_destroy(
 					ldap_pvt_thread_mutex_destroy( &mt->mt_quarantine_mutex );
 				}
 
+				if ( mt->mt_health != NULL ) {
+					mi->mi_ldap_extra->uri_health_free( mt->mt_health );
+				}
+
 				target_free( mt );
 			}
 
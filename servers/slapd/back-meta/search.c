@@ -1765,6 +1765,9 @@ free_message:;
 		/* if no entry was found during this loop,
 		 * set a minimal timeout */
 		if ( ncandidates > 0 && gotit == 0 ) {
+			/* send what we have before waiting */
+			slap_write_coalesce_flush( op, 0 );
+
 			if ( save_tv.tv_sec == 0 && save_tv.tv_usec == 0 ) {
 				save_tv.tv_usec = LDAP_BACK_RESULT_UTIMEOUT/initial_candidates;
 
@@ -69,6 +69,8 @@ typedef struct monitor_entry_t {
 #define MONITOR_F_VOLATILE_CH	0x0080U		/* subsystem generates 
 						   volatile entries */
 #define MONITOR_F_EXTERNAL	0x0100U		/* externally added - don't free */
+#define MONITOR_F_SNAPSHOT	0x0200U		/* private copy of a cached
+						   entry being sent */
 /* NOTE: flags with 0xF0000000U mask are reserved for subsystem internals */
 
 	struct monitor_callback_t	*mp_cb;		/* callback sequence */
@@ -90,6 +92,8 @@ typedef struct monitor_info_t {
 	struct berval		mi_startTime;		/* don't free it! */
 	struct berval		mi_creatorsName;	/* don't free it! */
 	struct berval		mi_ncreatorsName;	/* don't free it! */
+	struct berval		mi_metrics_listener;
+	unsigned		mi_metrics_interval;
 
 	/*
 	 * Specific schema entities
@@ -131,6 +135,9 @@ typedef struct monitor_info_t {
 	AttributeDescription	*mi_ad_monitorUpdateRef;
 	AttributeDescription	*mi_ad_monitorRuntimeConfig;
 	AttributeDescription	*mi_ad_monitorSuperiorDN;
+	AttributeDescription	*mi_ad_monitorOpLatency;
+	AttributeDescription	*mi_ad_monitorLogDropped;
+	AttributeDescription	*mi_ad_monitorProfileTime;
 
 	/*
 	 * Generic description attribute
@@ -159,6 +166,7 @@ enum {
 	SLAPD_MONITOR_TIME,
 	SLAPD_MONITOR_TLS,
 	SLAPD_MONITOR_RWW,
+	SLAPD_MONITOR_PROFILE,
 
 	SLAPD_MONITOR_LAST
 };
@@ -243,6 +251,12 @@ enum {
 #define SLAPD_MONITOR_RWW_DN	\
 	SLAPD_MONITOR_RWW_RDN "," SLAPD_MONITOR_DN
 
+#define SLAPD_MONITOR_PROFILE_NAME	"Profile"
+#define SLAPD_MONITOR_PROFILE_RDN	\
+	SLAPD_MONITOR_AT "=" SLAPD_MONITOR_PROFILE_NAME
+#define SLAPD_MONITOR_PROFILE_DN	\
+	SLAPD_MONITOR_PROFILE_RDN "," SLAPD_MONITOR_DN
+
 typedef struct monitor_subsys_t {
 	char		*mss_name;
 	struct berval	mss_rdn;
@@ -270,6 +284,11 @@ typedef struct monitor_subsys_t {
 	int		( *mss_modify )( Operation *, SlapReply *, Entry * );
 
 	void		*mss_private;
+
+	/* objectClass of the volatile children, if they are all of one
+	 * class and have no children of their own; searches whose filter
+	 * cannot match that class skip creating them */
+	ObjectClass	*mss_volatile_oc;
 } monitor_subsys_t;
 
 extern BackendDB *be_monitor;
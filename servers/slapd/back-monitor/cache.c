@@ -348,8 +348,8 @@ monitor_cache_dn2entry(
 }
 
 /*
- * releases the lock of the entry; if it is marked as volatile, it is
- * destroyed.
+ * releases the lock of the entry; if it is marked as volatile or is
+ * a snapshot, it is destroyed.
  */
 int
 monitor_cache_release(
@@ -364,17 +364,20 @@ monitor_cache_release(
 	
 	mp = ( monitor_entry_t * )e->e_private;
 
-	if ( mp->mp_flags & MONITOR_F_VOLATILE ) {
-		monitor_cache_t	*mc, tmp_mc;
-
-		/* volatile entries do not return to cache */
-		ldap_pvt_thread_mutex_lock( &mi->mi_cache_mutex );
-		tmp_mc.mc_ndn = e->e_nname;
-		mc = avl_delete( &mi->mi_cache,
-				( caddr_t )&tmp_mc, monitor_cache_cmp );
-		ldap_pvt_thread_mutex_unlock( &mi->mi_cache_mutex );
-		if ( mc != NULL ) {
-			ch_free( mc );
+	if ( mp->mp_flags & ( MONITOR_F_VOLATILE | MONITOR_F_SNAPSHOT ) ) {
+		/* volatile entries do not return to cache;
+		 * snapshots never were in it */
+		if ( !( mp->mp_flags & MONITOR_F_SNAPSHOT ) ) {
+			monitor_cache_t	*mc, tmp_mc;
+
+			ldap_pvt_thread_mutex_lock( &mi->mi_cache_mutex );
+			tmp_mc.mc_ndn = e->e_nname;
+			mc = avl_delete( &mi->mi_cache,
+					( caddr_t )&tmp_mc, monitor_cache_cmp );
+			ldap_pvt_thread_mutex_unlock( &mi->mi_cache_mutex );
+			if ( mc != NULL ) {
+				ch_free( mc );
+			}
 		}
 		
 		ldap_pvt_thread_mutex_unlock( &mp->mp_mutex );
@@ -391,6 +394,48 @@ monitor_cache_release(
 	return( 0 );
 }
 
+/*
+ * takes a private copy of a locked, up to date cached entry and
+ * releases the entry, so that it is not kept locked, and other
+ * searches and updates of it do not wait, while the copy is sent;
+ * the copy is returned locked, and destroyed by
+ * monitor_cache_release() like a volatile entry
+ */
+Entry *
+monitor_cache_snapshot(
+	monitor_info_t	*mi,
+	Entry		*e )
+{
+	monitor_entry_t *mp, *smp;
+	Entry		*se;
+
+	assert( mi != NULL );
+	assert( e != NULL );
+	assert( e->e_private != NULL );
+
+	mp = ( monitor_entry_t * )e->e_private;
+
+	/* volatile entries are private already */
+	if ( mp->mp_flags & ( MONITOR_F_VOLATILE | MONITOR_F_SNAPSHOT ) ) {
+		return e;
+	}
+
+	se = entry_dup( e );
+
+	/* enough for monitor_back_operational() */
+	smp = monitor_entrypriv_create();
+	smp->mp_info = mp->mp_info;
+	smp->mp_children = mp->mp_children;
+	smp->mp_flags = ( mp->mp_flags & MONITOR_F_VOLATILE_CH )
+		| MONITOR_F_SNAPSHOT;
+	se->e_private = ( void * )smp;
+
+	monitor_cache_lock( se );
+	monitor_cache_release( mi, e );
+
+	return se;
+}
+
 static void
 monitor_entry_destroy( void *v_mc )
 {
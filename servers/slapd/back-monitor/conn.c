@@ -60,6 +60,8 @@ monitor_subsys_conn_init(
 
 	mi = ( monitor_info_t * )be->be_private;
 
+	ms->mss_volatile_oc = mi->mi_oc_monitorConnection;
+
 	if ( monitor_cache_get( mi, &ms->mss_ndn, &e_conn ) ) {
 		Debug( LDAP_DEBUG_ANY,
 			"monitor_subsys_conn_init: "
@@ -222,18 +224,8 @@ monitor_subsys_conn_update(
 		n = connections_nextid() - SLAPD_SYNC_SYNCCONN_OFFSET;
 
 	} else if ( dn_match( &rdn, &current_bv ) ) {
-		Connection	*c;
-		ber_socket_t	connindex;
-
-		for ( n = 0, c = connection_first( &connindex );
-				c != NULL;
-				n++, c = connection_next( c, &connindex ) )
-		{
-			/* Ignore outbound connections */
-			if ( c->c_conn_state == SLAP_C_CLIENT )
-				n--;
-		}
-		connection_done( c );
+		/* outbound connections are not counted */
+		n = connections_current();
 	}
 
 	if ( n != -1 ) {
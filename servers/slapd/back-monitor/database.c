@@ -39,6 +39,12 @@ monitor_subsys_database_modify(
 	SlapReply	*rs,
 	Entry		*e );
 
+static int
+monitor_subsys_database_update(
+	Operation	*op,
+	SlapReply	*rs,
+	Entry		*e );
+
 static struct restricted_ops_t {
 	struct berval	op;
 	unsigned int	tag;
@@ -107,7 +113,7 @@ monitor_subsys_overlay_init_one(
 	monitor_subsys_t	*ms_overlay,
 	slap_overinst		*on,
 	Entry			*e_database,
-	Entry			**ep_overlay )
+	Entry			***ep_overlay )
 {
 	char			buf[ BACKMONITOR_BUFSIZE ];
 	int			j, o;
@@ -188,8 +194,8 @@ monitor_subsys_overlay_init_one(
 		return -1;
 	}
 
-	*ep_overlay = e_overlay;
-	ep_overlay = &mp_overlay->mp_next;
+	**ep_overlay = e_overlay;
+	*ep_overlay = &mp_overlay->mp_next;
 
 	return 0;
 }
@@ -338,6 +344,11 @@ monitor_subsys_database_init_one(
 	/* we must find it! */
 	assert( j >= 0 );
 
+	/* the frontend accounts ops to this from now on */
+	if ( be->be_histo == NULL ) {
+		be->be_histo = ch_calloc( SLAP_HISTO_NUM, sizeof( slap_histo_t ) );
+	}
+
 	mp = monitor_entrypriv_create();
 	if ( mp == NULL ) {
 		return -1;
@@ -365,7 +376,7 @@ monitor_subsys_database_init_one(
 
 		for ( ; on; on = on->on_next ) {
 			monitor_subsys_overlay_init_one( mi, be,
-				ms, ms_overlay, on, e, ep_overlay );
+				ms, ms_overlay, on, e, &ep_overlay );
 		}
 	}
 
@@ -552,6 +563,7 @@ monitor_subsys_database_init(
 	assert( be != NULL );
 
 	ms->mss_modify = monitor_subsys_database_modify;
+	ms->mss_update = monitor_subsys_database_update;
 
 	mi = ( monitor_info_t * )be->be_private;
 
@@ -665,6 +677,40 @@ value_mask( BerVarray v, slap_mask_t cur, slap_mask_t *delta )
 	return LDAP_SUCCESS;
 }
 
+static int
+monitor_subsys_database_update(
+	Operation	*op,
+	SlapReply	*rs,
+	Entry		*e )
+{
+	monitor_info_t	*mi = (monitor_info_t *)op->o_bd->be_private;
+	Backend		*be;
+	int		n;
+
+	if ( strncmp( e->e_nname.bv_val, "cn=frontend,",
+			STRLENOF( "cn=frontend," ) ) == 0 )
+	{
+		be = frontendDB;
+
+	} else if ( sscanf( e->e_nname.bv_val, "cn=database %d,", &n ) == 1 ) {
+		LDAP_STAILQ_FOREACH( be, &backendDB, be_next ) {
+			if ( n == 0 ) {
+				break;
+			}
+			n--;
+		}
+
+	} else {
+		return SLAP_CB_CONTINUE;
+	}
+
+	if ( be != NULL && be->be_histo != NULL ) {
+		monitor_ops_db_latency( mi, e, be->be_histo );
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
 static int
 monitor_subsys_database_modify(
 	Operation	*op,
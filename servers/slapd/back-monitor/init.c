@@ -227,6 +227,17 @@ static struct monitor_subsys_t known_monitor_subsys[] = {
 		NULL,   /* update */
 		NULL, 	/* create */
 		NULL	/* modify */
+       	}, { 
+		SLAPD_MONITOR_PROFILE_NAME,
+		BER_BVNULL, BER_BVNULL, BER_BVNULL,
+		{ BER_BVC( "This subsystem contains hot path profiling counters." ),
+			BER_BVNULL },
+		MONITOR_F_PERSISTENT_CH,
+		monitor_subsys_profile_init,
+		NULL,	/* destroy */
+		NULL,   /* update */
+		NULL, 	/* create */
+		NULL	/* modify */
        	}, { NULL }
 };
 
@@ -1658,6 +1669,18 @@ monitor_back_initialize(
 	};
 
 	static ConfigTable monitorcfg[] = {
+		{ "metrics-listener", "url", 2, 2, 0, ARG_BERVAL|ARG_OFFSET,
+			(void *)offsetof(monitor_info_t, mi_metrics_listener),
+			"( OLcfgDbAt:4.1 NAME 'olcMonitorMetricsListener' "
+				"DESC 'Address to serve OpenMetrics text on' "
+				"EQUALITY caseIgnoreMatch "
+				"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+		{ "metrics-interval", "seconds", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+			(void *)offsetof(monitor_info_t, mi_metrics_interval),
+			"( OLcfgDbAt:4.2 NAME 'olcMonitorMetricsInterval' "
+				"DESC 'Seconds the OpenMetrics text is cached for' "
+				"EQUALITY integerMatch "
+				"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 		{ NULL, NULL, 0, 0, 0, ARG_IGNORED,
 			NULL, NULL, NULL, NULL }
 	};
@@ -1667,7 +1690,7 @@ monitor_back_initialize(
 			"NAME 'olcMonitorConfig' "
 			"DESC 'Monitor backend configuration' "
 			"SUP olcDatabaseConfig "
-			")",
+			"MAY ( olcMonitorMetricsListener $ olcMonitorMetricsInterval ) )",
 			 	Cft_Database, monitorcfg },
 		{ NULL, 0, NULL }
 	};
@@ -1951,6 +1974,33 @@ monitor_back_initialize(
 			"NO-USER-MODIFICATION "
 			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
 			offsetof(monitor_info_t, mi_ad_monitorSuperiorDN) },
+		{ "( 1.3.6.1.4.1.4203.666.1.55.31 "
+			"NAME 'monitorOpLatency' "
+			"DESC 'monitor operation latency percentiles, in microseconds' "
+			"SUP monitoredInfo "
+			"NO-USER-MODIFICATION "
+			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
+			offsetof(monitor_info_t, mi_ad_monitorOpLatency) },
+		{ "( 1.3.6.1.4.1.4203.666.1.55.32 "
+			"NAME 'monitorLogDropped' "
+			"DESC 'number of log messages dropped because a log buffer was full' "
+			"EQUALITY integerMatch "
+			"ORDERING integerOrderingMatch "
+			"SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+			"SINGLE-VALUE "
+			"NO-USER-MODIFICATION "
+			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
+			offsetof(monitor_info_t, mi_ad_monitorLogDropped) },
+		{ "( 1.3.6.1.4.1.4203.666.1.55.33 "
+			"NAME 'monitorProfileTime' "
+			"DESC 'CPU time spent in a profiled code path, in microseconds' "
+			"EQUALITY integerMatch "
+			"ORDERING integerOrderingMatch "
+			"SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+			"SINGLE-VALUE "
+			"NO-USER-MODIFICATION "
+			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
+			offsetof(monitor_info_t, mi_ad_monitorProfileTime) },
 		{ NULL, 0, -1 }
 	};
 
@@ -2052,7 +2102,7 @@ monitor_back_initialize(
 	bi->bi_db_config = monitor_back_db_config;
 #endif
 	bi->bi_db_open = monitor_back_db_open;
-	bi->bi_db_close = 0;
+	bi->bi_db_close = monitor_back_db_close;
 	bi->bi_db_destroy = monitor_back_db_destroy;
 
 	bi->bi_op_bind = monitor_back_bind;
@@ -2156,6 +2206,8 @@ monitor_back_db_init(
 	ldap_pvt_thread_mutex_init( &monitor_info.mi_cache_mutex );
 
 	be->be_private = &monitor_info;
+	be->be_cf_ocs = be->bd_info->bi_cf_ocs;
+	monitor_info.mi_metrics_interval = 5;
 
 	be2 = select_backend( &ndn, 0 );
 	if ( be2 != be ) {
@@ -2477,9 +2529,23 @@ monitor_back_db_open(
 		mi->mi_entry_limbo = NULL;
 	}
 
+	if ( monitor_metrics_open( be ) ) {
+		retcode = 1;
+	}
+
 	return retcode;
 }
 
+int
+monitor_back_db_close(
+	BackendDB	*be,
+	ConfigReply	*cr)
+{
+	monitor_metrics_close( be );
+
+	return 0;
+}
+
 int
 monitor_back_config(
 	BackendInfo	*bi,
@@ -42,6 +42,12 @@ monitor_subsys_log_modify(
 	SlapReply		*rs,
 	Entry 			*e );
 
+static int 
+monitor_subsys_log_update( 
+	Operation		*op,
+	SlapReply		*rs,
+	Entry 			*e );
+
 /*
  * log mutex
  */
@@ -61,6 +67,7 @@ monitor_subsys_log_init(
 {
 	ms->mss_open = monitor_subsys_log_open;
 	ms->mss_modify = monitor_subsys_log_modify;
+	ms->mss_update = monitor_subsys_log_update;
 
 	ldap_pvt_thread_mutex_init( &monitor_log_mutex );
 
@@ -101,6 +108,33 @@ monitor_subsys_log_open(
 	return( 0 );
 }
 
+/*
+ * refreshes the count of dropped log messages
+ */
+static int 
+monitor_subsys_log_update( 
+	Operation		*op,
+	SlapReply		*rs,
+	Entry 			*e )
+{
+	monitor_info_t	*mi = ( monitor_info_t * )op->o_bd->be_private;
+	Attribute	*a;
+	char		buf[ LDAP_PVT_INTTYPE_CHARS( unsigned long ) ];
+	struct berval	bv;
+
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", slap_log_dropped );
+
+	a = attr_find( e->e_attrs, mi->mi_ad_monitorLogDropped );
+	if ( a == NULL ) {
+		attr_merge_one( e, mi->mi_ad_monitorLogDropped, &bv, NULL );
+	} else {
+		ber_bvreplace( &a->a_vals[ 0 ], &bv );
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
 static int 
 monitor_subsys_log_modify( 
 	Operation		*op,
@@ -0,0 +1,678 @@
+/* metrics.c - serve monitor data in OpenMetrics text format */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2001-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/ctype.h>
+#include <ac/errno.h>
+#include <ac/socket.h>
+#include <ac/stdarg.h>
+#include <ac/string.h>
+#include <ac/time.h>
+#include <ac/unistd.h>
+
+#include "slap.h"
+#include "lutil.h"
+#include "back-monitor.h"
+#include "proto-back-monitor.h"
+
+/*
+ * The listener is served by a thread of its own rather than by the
+ * connection pool, so that scrapes keep working when all the workers
+ * are busy and never delay LDAP operations.  The exposition text is
+ * rebuilt at most once per metrics-interval; scrapes in between are
+ * served from the cached copy.
+ */
+
+#define METRICS_CONTENT_TYPE \
+	"application/openmetrics-text; version=1.0.0; charset=utf-8"
+#define METRICS_PREFIX		"openldap_"
+#define METRICS_PATH		"/metrics"
+#define METRICS_REQ_MAX		4096
+#define METRICS_IO_TIMEOUT	5
+
+typedef struct metrics_buf_t {
+	char		*mb_buf;
+	ber_len_t	mb_len;
+	ber_len_t	mb_size;
+} metrics_buf_t;
+
+/* samples must be grouped by family, so they are collected here first */
+typedef struct metrics_family_t {
+	char		*mf_name;
+	const char	*mf_type;
+	const char	*mf_unit;
+	metrics_buf_t	mf_samples;
+} metrics_family_t;
+
+static ber_socket_t		metrics_sd = AC_SOCKET_INVALID;
+static ldap_pvt_thread_t	metrics_tid;
+static volatile int		metrics_running;
+static metrics_buf_t		metrics_text;
+static time_t			metrics_built;
+
+static void
+metrics_printf( metrics_buf_t *mb, const char *fmt, ... )
+{
+	va_list		ap;
+	int		len;
+
+	for ( ;; ) {
+		va_start( ap, fmt );
+		len = vsnprintf( mb->mb_buf ? mb->mb_buf + mb->mb_len : NULL,
+			mb->mb_size - mb->mb_len, fmt, ap );
+		va_end( ap );
+
+		if ( len < 0 ) {
+			return;
+		}
+		if ( mb->mb_len + len < mb->mb_size ) {
+			mb->mb_len += len;
+			return;
+		}
+
+		mb->mb_size = mb->mb_size ? mb->mb_size * 2 : 1024;
+		while ( mb->mb_size <= mb->mb_len + len ) {
+			mb->mb_size *= 2;
+		}
+		mb->mb_buf = ch_realloc( mb->mb_buf, mb->mb_size );
+	}
+}
+
+/* label values are escaped as per the OpenMetrics ABNF */
+static void
+metrics_label( metrics_buf_t *mb, const char *name, struct berval *val )
+{
+	ber_len_t	i;
+
+	metrics_printf( mb, "%s=\"", name );
+	for ( i = 0; i < val->bv_len; i++ ) {
+		switch ( val->bv_val[ i ] ) {
+		case '\\':
+			metrics_printf( mb, "\\\\" );
+			break;
+		case '"':
+			metrics_printf( mb, "\\\"" );
+			break;
+		case '\n':
+			metrics_printf( mb, "\\n" );
+			break;
+		default:
+			metrics_printf( mb, "%c", val->bv_val[ i ] );
+			break;
+		}
+	}
+	metrics_printf( mb, "\"" );
+}
+
+static int
+metrics_family_cmp( const void *v1, const void *v2 )
+{
+	const metrics_family_t *mf1 = v1, *mf2 = v2;
+
+	return strcmp( mf1->mf_name, mf2->mf_name );
+}
+
+static metrics_family_t *
+metrics_family( Avlnode **root, AttributeDescription *ad, const char *type,
+	const char *unit )
+{
+	metrics_family_t	tmp, *mf;
+	char			name[ 256 ];
+	int			i, len;
+
+	len = snprintf( name, sizeof( name ), METRICS_PREFIX "%s%s%s",
+		ad->ad_cname.bv_val, unit ? "_" : "", unit ? unit : "" );
+	if ( len < 0 || len >= sizeof( name ) ) {
+		return NULL;
+	}
+	for ( i = 0; i < len; i++ ) {
+		if ( !isalnum( (unsigned char)name[ i ] ) ) {
+			name[ i ] = '_';
+		}
+	}
+
+	tmp.mf_name = name;
+	mf = avl_find( *root, &tmp, metrics_family_cmp );
+	if ( mf == NULL ) {
+		mf = ch_calloc( 1, sizeof( metrics_family_t ) );
+		mf->mf_name = ch_strdup( name );
+		mf->mf_type = type;
+		mf->mf_unit = unit;
+		avl_insert( root, mf, metrics_family_cmp, avl_dup_error );
+	}
+
+	return mf;
+}
+
+static int
+metrics_numeric( struct berval *bv )
+{
+	ber_len_t	i = 0;
+	int		dot = 0;
+
+	if ( bv->bv_len && bv->bv_val[ 0 ] == '-' ) {
+		i++;
+	}
+	if ( i == bv->bv_len ) {
+		return 0;
+	}
+	for ( ; i < bv->bv_len; i++ ) {
+		if ( bv->bv_val[ i ] == '.' && !dot ) {
+			dot = 1;
+		} else if ( !isdigit( (unsigned char)bv->bv_val[ i ] ) ) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * monitorOpLatency values look like
+ * "[<name> ]<phase> count=<n> p50=<us> p99=<us> p999=<us> max=<us>"
+ */
+static void
+metrics_latency( Avlnode **root, monitor_info_t *mi, Entry *e, Attribute *a )
+{
+	static const struct {
+		const char	*key;
+		const char	*quantile;
+	} q[] = {
+		{ "p50=", "0.5" },
+		{ "p99=", "0.99" },
+		{ "p999=", "0.999" },
+		{ "max=", "1" },
+		{ NULL, NULL }
+	};
+	metrics_family_t	*mf;
+	int			i, j;
+
+	mf = metrics_family( root, a->a_desc, "summary", "seconds" );
+	if ( mf == NULL ) {
+		return;
+	}
+
+	for ( i = 0; i < a->a_numvals; i++ ) {
+		struct berval	name = BER_BVNULL, phase;
+		char		*count, *p, *next;
+		unsigned long	us;
+
+		phase = a->a_vals[ i ];
+		count = strstr( phase.bv_val, " count=" );
+		if ( count == NULL ) {
+			continue;
+		}
+		phase.bv_len = count - phase.bv_val;
+		p = memchr( phase.bv_val, ' ', phase.bv_len );
+		if ( p != NULL ) {
+			name.bv_val = phase.bv_val;
+			name.bv_len = p - phase.bv_val;
+			phase.bv_val = p + 1;
+			phase.bv_len = count - phase.bv_val;
+		}
+
+		for ( j = 0; q[ j ].key; j++ ) {
+			p = strstr( count, q[ j ].key );
+			if ( p == NULL ) {
+				continue;
+			}
+			us = strtoul( p + strlen( q[ j ].key ), &next, 10 );
+			metrics_printf( &mf->mf_samples, "%s{", mf->mf_name );
+			metrics_label( &mf->mf_samples, "dn", &e->e_name );
+			if ( !BER_BVISNULL( &name ) ) {
+				metrics_printf( &mf->mf_samples, "," );
+				metrics_label( &mf->mf_samples, "name", &name );
+			}
+			metrics_printf( &mf->mf_samples, "," );
+			metrics_label( &mf->mf_samples, "phase", &phase );
+			metrics_printf( &mf->mf_samples, ",quantile=\"%s\"} %lu.%06lu\n",
+				q[ j ].quantile, us / 1000000, us % 1000000 );
+		}
+
+		us = strtoul( count + STRLENOF( " count=" ), &next, 10 );
+		metrics_printf( &mf->mf_samples, "%s_count{", mf->mf_name );
+		metrics_label( &mf->mf_samples, "dn", &e->e_name );
+		if ( !BER_BVISNULL( &name ) ) {
+			metrics_printf( &mf->mf_samples, "," );
+			metrics_label( &mf->mf_samples, "name", &name );
+		}
+		metrics_printf( &mf->mf_samples, "," );
+		metrics_label( &mf->mf_samples, "phase", &phase );
+		metrics_printf( &mf->mf_samples, "} %lu\n", us );
+	}
+}
+
+/*
+ * Integer valued attributes, monitorTimestamp subtypes (as seconds
+ * since the epoch) and single valued monitoredInfo subtypes holding
+ * a number are exposed, with the entry DN as label
+ */
+static void
+metrics_entry( Avlnode **root, monitor_info_t *mi, Entry *e )
+{
+	Attribute	*a;
+
+	for ( a = e->e_attrs; a != NULL; a = a->a_next ) {
+		AttributeType		*at = a->a_desc->ad_type;
+		metrics_family_t	*mf;
+		char			buf[ 32 ];
+		struct berval		val;
+
+		if ( a->a_desc == mi->mi_ad_monitorOpLatency ) {
+			metrics_latency( root, mi, e, a );
+			continue;
+		}
+
+		if ( a->a_numvals != 1 ) {
+			continue;
+		}
+		val = a->a_vals[ 0 ];
+
+		if ( is_at_subtype( at, mi->mi_ad_monitorTimestamp->ad_type ) ) {
+			struct lutil_tm		tm;
+			struct lutil_timet	tt;
+
+			if ( lutil_parsetime( val.bv_val, &tm ) != 0 ||
+				lutil_tm2time( &tm, &tt ) != 0 )
+			{
+				continue;
+			}
+			val.bv_val = buf;
+			val.bv_len = snprintf( buf, sizeof( buf ), "%u", tt.tt_sec );
+
+		} else if ( at->sat_syntax != slap_schema.si_syn_integer &&
+			!( is_at_subtype( at, mi->mi_ad_monitoredInfo->ad_type ) &&
+				metrics_numeric( &val ) ) )
+		{
+			continue;
+		}
+
+		mf = metrics_family( root, a->a_desc, "unknown", NULL );
+		if ( mf == NULL ) {
+			continue;
+		}
+		metrics_printf( &mf->mf_samples, "%s{", mf->mf_name );
+		metrics_label( &mf->mf_samples, "dn", &e->e_name );
+		metrics_printf( &mf->mf_samples, "} %s\n", val.bv_val );
+	}
+}
+
+/*
+ * Walk the persistent entries below and including e, the same way
+ * monitor_send_children() does; volatile entries, e.g. the individual
+ * connections, are not worth the cost of a scrape
+ */
+static void
+metrics_walk( Operation *op, SlapReply *rs, Avlnode **root, Entry *e )
+{
+	monitor_info_t	*mi = ( monitor_info_t * )op->o_bd->be_private;
+	monitor_entry_t	*mp;
+	Entry		*next, *children;
+
+	for ( ; e != NULL; e = next ) {
+		monitor_cache_lock( e );
+		monitor_entry_update( op, rs, e );
+		mp = ( monitor_entry_t * )e->e_private;
+		next = mp->mp_next;
+		children = mp->mp_children;
+		metrics_entry( root, mi, e );
+		monitor_cache_release( mi, e );
+
+		if ( children ) {
+			metrics_walk( op, rs, root, children );
+		}
+	}
+}
+
+static int
+metrics_family_print( void *v, void *arg )
+{
+	metrics_family_t	*mf = v;
+	metrics_buf_t		*mb = arg;
+
+	metrics_printf( mb, "# TYPE %s %s\n", mf->mf_name, mf->mf_type );
+	if ( mf->mf_unit ) {
+		metrics_printf( mb, "# UNIT %s %s\n", mf->mf_name, mf->mf_unit );
+	}
+	if ( mf->mf_samples.mb_len ) {
+		metrics_printf( mb, "%s", mf->mf_samples.mb_buf );
+	}
+
+	return 0;
+}
+
+static void
+metrics_family_free( void *v )
+{
+	metrics_family_t	*mf = v;
+
+	ch_free( mf->mf_samples.mb_buf );
+	ch_free( mf->mf_name );
+	ch_free( mf );
+}
+
+static void
+metrics_build( BackendDB *be )
+{
+	monitor_info_t	*mi = ( monitor_info_t * )be->be_private;
+	OperationBuffer	opbuf;
+	Operation	*op;
+	SlapReply	rs = { REP_RESULT };
+	Avlnode		*root = NULL;
+	Entry		*e;
+
+	memset( &opbuf, 0, sizeof( opbuf ) );
+	op = &opbuf.ob_op;
+	op->o_hdr = &opbuf.ob_hdr;
+	op->o_controls = opbuf.ob_controls;
+	op->o_tag = LDAP_REQ_SEARCH;
+	op->o_bd = be;
+	op->o_tmpmemctx = NULL;
+	op->o_tmpmfuncs = &ch_mfuncs;
+	op->o_time = slap_get_time();
+	op->o_req_dn = be->be_suffix[ 0 ];
+	op->o_req_ndn = be->be_nsuffix[ 0 ];
+
+	if ( monitor_cache_get( mi, &be->be_nsuffix[ 0 ], &e ) == 0 ) {
+		monitor_entry_t	*mp = ( monitor_entry_t * )e->e_private;
+		Entry		*children = mp->mp_children;
+
+		monitor_entry_update( op, &rs, e );
+		metrics_entry( &root, mi, e );
+		monitor_cache_release( mi, e );
+		metrics_walk( op, &rs, &root, children );
+	}
+
+	metrics_text.mb_len = 0;
+	avl_apply( root, metrics_family_print, &metrics_text,
+		-1, AVL_INORDER );
+	metrics_printf( &metrics_text, "# EOF\n" );
+	avl_free( root, metrics_family_free );
+
+	metrics_built = op->o_time;
+}
+
+static int
+metrics_write( ber_socket_t sd, const char *buf, ber_len_t len )
+{
+	while ( len > 0 ) {
+		ber_slen_t	n = tcp_write( sd, buf, len );
+
+		if ( n < 0 ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static void
+metrics_serve( BackendDB *be, ber_socket_t sd )
+{
+	monitor_info_t	*mi = ( monitor_info_t * )be->be_private;
+	char		req[ METRICS_REQ_MAX ], hdr[ 256 ];
+	const char	*status = NULL;
+	ber_len_t	len = 0;
+	int		hlen;
+	struct timeval	tv;
+
+	tv.tv_sec = METRICS_IO_TIMEOUT;
+	tv.tv_usec = 0;
+	(void)setsockopt( sd, SOL_SOCKET, SO_RCVTIMEO, (void *)&tv, sizeof( tv ) );
+	(void)setsockopt( sd, SOL_SOCKET, SO_SNDTIMEO, (void *)&tv, sizeof( tv ) );
+
+	/* only the request line matters, but let the client finish sending */
+	while ( len < sizeof( req ) - 1 ) {
+		ber_slen_t	n = tcp_read( sd, req + len, sizeof( req ) - 1 - len );
+
+		if ( n < 0 && errno == EINTR ) {
+			continue;
+		}
+		if ( n <= 0 ) {
+			break;
+		}
+		len += n;
+		req[ len ] = '\0';
+		if ( strstr( req, "\r\n\r\n" ) || strstr( req, "\n\n" ) ) {
+			break;
+		}
+	}
+	req[ len ] = '\0';
+
+	if ( strncmp( req, "GET ", STRLENOF( "GET " ) ) != 0 ) {
+		status = "405 Method Not Allowed";
+
+	} else {
+		char	*path = req + STRLENOF( "GET " );
+		size_t	plen = strcspn( path, " ?\r\n" );
+
+		if ( plen != STRLENOF( METRICS_PATH ) ||
+			strncmp( path, METRICS_PATH, plen ) != 0 )
+		{
+			status = "404 Not Found";
+		}
+	}
+
+	if ( status ) {
+		hlen = snprintf( hdr, sizeof( hdr ),
+			"HTTP/1.1 %s\r\n"
+			"Content-Length: 0\r\n"
+			"Connection: close\r\n\r\n", status );
+		(void)metrics_write( sd, hdr, hlen );
+		return;
+	}
+
+	if ( metrics_text.mb_len == 0 ||
+		slap_get_time() - metrics_built >= mi->mi_metrics_interval )
+	{
+		metrics_build( be );
+	}
+
+	hlen = snprintf( hdr, sizeof( hdr ),
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type: " METRICS_CONTENT_TYPE "\r\n"
+		"Content-Length: %lu\r\n"
+		"Connection: close\r\n\r\n",
+		(unsigned long)metrics_text.mb_len );
+	if ( metrics_write( sd, hdr, hlen ) == 0 ) {
+		(void)metrics_write( sd, metrics_text.mb_buf, metrics_text.mb_len );
+	}
+}
+
+static void *
+metrics_thread( void *ctx )
+{
+	BackendDB	*be = ctx;
+
+	while ( metrics_running && !slapd_shutdown ) {
+		struct timeval	tv;
+		fd_set		rfds;
+		ber_socket_t	sd;
+		int		rc;
+
+		FD_ZERO( &rfds );
+		FD_SET( metrics_sd, &rfds );
+		tv.tv_sec = 1;
+		tv.tv_usec = 0;
+
+		rc = select( metrics_sd + 1, &rfds, NULL, NULL, &tv );
+		if ( rc <= 0 ) {
+			continue;
+		}
+
+		sd = accept( metrics_sd, NULL, NULL );
+		if ( sd == AC_SOCKET_INVALID ) {
+			continue;
+		}
+		metrics_serve( be, sd );
+		tcp_close( sd );
+	}
+
+	return NULL;
+}
+
+/*
+ * Parse "[http://]<host>:<port>", where host may be a bracketed IPv6
+ * address or empty to listen on all interfaces
+ */
+static int
+metrics_parse_listener( char *url, char **host, char **port )
+{
+	char	*p;
+
+	if ( strncasecmp( url, "http://", STRLENOF( "http://" ) ) == 0 ) {
+		url += STRLENOF( "http://" );
+	}
+	p = url + strlen( url );
+	if ( p > url && p[ -1 ] == '/' ) {
+		*--p = '\0';
+	}
+
+	p = strrchr( url, ':' );
+	if ( p == NULL || p[ 1 ] == '\0' ) {
+		return -1;
+	}
+	*p++ = '\0';
+	*port = p;
+
+	if ( url[ 0 ] == '[' ) {
+		p = strchr( url, ']' );
+		if ( p == NULL || p[ 1 ] != '\0' ) {
+			return -1;
+		}
+		*p = '\0';
+		url++;
+	}
+	*host = url[ 0 ] ? url : NULL;
+
+	return 0;
+}
+
+int
+monitor_metrics_open( BackendDB *be )
+{
+	monitor_info_t	*mi = ( monitor_info_t * )be->be_private;
+#ifdef HAVE_GETADDRINFO
+	struct addrinfo	hints, *res, *ai;
+	char		*url, *host, *port, ebuf[ 128 ];
+	int		rc;
+
+	if ( BER_BVISNULL( &mi->mi_metrics_listener ) ||
+		( slapMode & SLAP_TOOL_MODE ) )
+	{
+		return 0;
+	}
+
+	url = ch_strdup( mi->mi_metrics_listener.bv_val );
+	if ( metrics_parse_listener( url, &host, &port ) ) {
+		Debug( LDAP_DEBUG_ANY, "monitor_metrics_open: "
+			"unable to parse metrics-listener \"%s\"\n",
+			mi->mi_metrics_listener.bv_val );
+		ch_free( url );
+		return -1;
+	}
+
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_flags = AI_PASSIVE;
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	rc = getaddrinfo( host, port, &hints, &res );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "monitor_metrics_open: "
+			"getaddrinfo(%s) failed: %s\n",
+			mi->mi_metrics_listener.bv_val, AC_GAI_STRERROR( rc ) );
+		ch_free( url );
+		return -1;
+	}
+	ch_free( url );
+
+	for ( ai = res; ai != NULL; ai = ai->ai_next ) {
+		int	tmp = 1;
+
+		metrics_sd = socket( ai->ai_family, ai->ai_socktype,
+			ai->ai_protocol );
+		if ( metrics_sd == AC_SOCKET_INVALID ) {
+			continue;
+		}
+#ifdef SO_REUSEADDR
+		(void)setsockopt( metrics_sd, SOL_SOCKET, SO_REUSEADDR,
+			(char *)&tmp, sizeof( tmp ) );
+#endif /* SO_REUSEADDR */
+		if ( bind( metrics_sd, ai->ai_addr, ai->ai_addrlen ) == 0 &&
+			listen( metrics_sd, SOMAXCONN ) == 0 )
+		{
+			break;
+		}
+		tcp_close( metrics_sd );
+		metrics_sd = AC_SOCKET_INVALID;
+	}
+	freeaddrinfo( res );
+
+	if ( metrics_sd == AC_SOCKET_INVALID ) {
+		rc = errno;
+		Debug( LDAP_DEBUG_ANY, "monitor_metrics_open: "
+			"unable to listen on \"%s\": %s\n",
+			mi->mi_metrics_listener.bv_val, AC_STRERROR_R( rc, ebuf, sizeof( ebuf ) ) );
+		return -1;
+	}
+
+	metrics_running = 1;
+	rc = ldap_pvt_thread_create( &metrics_tid, 0, metrics_thread, be );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "monitor_metrics_open: "
+			"ldap_pvt_thread_create failed (%d)\n", rc );
+		metrics_running = 0;
+		tcp_close( metrics_sd );
+		metrics_sd = AC_SOCKET_INVALID;
+		return -1;
+	}
+
+	return 0;
+#else /* ! HAVE_GETADDRINFO */
+	if ( BER_BVISNULL( &mi->mi_metrics_listener ) ) {
+		return 0;
+	}
+
+	Debug( LDAP_DEBUG_ANY, "monitor_metrics_open: "
+		"metrics-listener requires getaddrinfo(3)\n" );
+	return -1;
+#endif /* ! HAVE_GETADDRINFO */
+}
+
+void
+monitor_metrics_close( BackendDB *be )
+{
+	if ( !metrics_running ) {
+		return;
+	}
+
+	metrics_running = 0;
+	ldap_pvt_thread_join( metrics_tid, NULL );
+	tcp_close( metrics_sd );
+	metrics_sd = AC_SOCKET_INVALID;
+
+	ch_free( metrics_text.mb_buf );
+	memset( &metrics_text, 0, sizeof( metrics_text ) );
+	metrics_built = 0;
+}
@@ -45,6 +45,14 @@ struct monitor_ops_t {
 	{ BER_BVNULL,			BER_BVNULL }
 };
 
+static char *monitor_phase[] = {
+	"queue",
+	"backend",
+	"acl",
+	"send",
+	NULL
+};
+
 static int
 monitor_subsys_ops_destroy(
 	BackendDB		*be,
@@ -75,6 +83,9 @@ monitor_subsys_ops_init(
 
 	mi = ( monitor_info_t * )be->be_private;
 
+	/* have the frontend keep latency histograms from now on */
+	slap_histo_on = 1;
+
 	if ( monitor_cache_get( mi,
 			&ms->mss_ndn, &e_op ) )
 	{
@@ -163,6 +174,94 @@ monitor_subsys_ops_destroy(
 	return 0;
 }
 
+/*
+ * Add to e one monitorOpLatency value per phase of the histograms
+ * in h, each led by name if given
+ */
+static void
+monitor_ops_latency(
+	monitor_info_t		*mi,
+	Entry			*e,
+	const char		*name,
+	slap_histo_t		*h )
+{
+	char		buf[ BACKMONITOR_BUFSIZE ];
+	struct berval	bv;
+	unsigned long	n;
+	int		i;
+
+	for ( i = 0; i < SLAP_PHASE_LAST; i++ ) {
+		n = slap_histo_count( &h[ i ] );
+		bv.bv_val = buf;
+		bv.bv_len = snprintf( buf, sizeof( buf ),
+			"%s%s%s count=%lu p50=%lu p99=%lu p999=%lu max=%lu",
+			name ? name : "", name ? " " : "", monitor_phase[ i ], n,
+			slap_histo_quantile( &h[ i ], n, 500 ),
+			slap_histo_quantile( &h[ i ], n, 990 ),
+			slap_histo_quantile( &h[ i ], n, 999 ),
+			h[ i ].sh_max );
+		attr_merge_one( e, mi->mi_ad_monitorOpLatency, &bv, NULL );
+	}
+}
+
+/*
+ * Add to a database entry the latencies of each op type the
+ * database has replied to, from its be_histo
+ */
+void
+monitor_ops_db_latency(
+	monitor_info_t		*mi,
+	Entry			*e,
+	slap_histo_t		*h )
+{
+	int		i;
+
+	attr_delete( &e->e_attrs, mi->mi_ad_monitorOpLatency );
+
+	for ( i = 0; i < SLAP_OP_LAST; i++ ) {
+		slap_histo_t	*oh = &h[ SLAP_HISTO_IDX( i, 0 ) ];
+
+		if ( slap_histo_count( &oh[ SLAP_PHASE_QUEUE ] ) == 0 )
+			continue;
+		monitor_ops_latency( mi, e,
+			monitor_op[ i ].rdn.bv_val + STRLENOF( "cn=" ), oh );
+	}
+}
+
+/*
+ * Sum the per-thread histograms of op type opidx, or of all types
+ * if opidx is SLAP_OP_LAST, into h[ SLAP_PHASE_LAST ]
+ */
+static void
+monitor_ops_histo_collect( slap_histo_t *h, int opidx )
+{
+	slap_counters_t	*sc;
+	int		i, j;
+
+	memset( h, 0, SLAP_PHASE_LAST * sizeof( slap_histo_t ) );
+
+	ldap_pvt_thread_mutex_lock( &slap_counters.sc_mutex );
+	for ( sc = &slap_counters; sc; sc = sc->sc_next ) {
+		slap_histo_t	*sh;
+
+		if ( sc != &slap_counters )
+			ldap_pvt_thread_mutex_lock( &sc->sc_mutex );
+		sh = sc->sc_histo;
+		if ( sc != &slap_counters )
+			ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
+		if ( sh == NULL )
+			continue;
+
+		for ( i = 0; i < SLAP_OP_LAST; i++ ) {
+			if ( opidx != SLAP_OP_LAST && i != opidx )
+				continue;
+			for ( j = 0; j < SLAP_PHASE_LAST; j++ )
+				slap_histo_merge( &h[ j ], &sh[ SLAP_HISTO_IDX( i, j ) ] );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_counters.sc_mutex );
+}
+
 static int
 monitor_subsys_ops_update(
 	Operation		*op,
@@ -170,6 +269,7 @@ monitor_subsys_ops_update(
 	Entry                   *e )
 {
 	monitor_info_t		*mi = ( monitor_info_t * )op->o_bd->be_private;
+	slap_histo_t		h[ SLAP_PHASE_LAST ];
 
 	ldap_pvt_mp_t		nInitiated = LDAP_PVT_MP_INIT,
 				nCompleted = LDAP_PVT_MP_INIT;
@@ -198,6 +298,8 @@ monitor_subsys_ops_update(
 			ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
 		}
 		ldap_pvt_thread_mutex_unlock( &slap_counters.sc_mutex );
+
+		monitor_ops_histo_collect( h, SLAP_OP_LAST );
 		
 	} else {
 		for ( i = 0; i < SLAP_OP_LAST; i++ ) {
@@ -213,6 +315,8 @@ monitor_subsys_ops_update(
 					ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
 				}
 				ldap_pvt_thread_mutex_unlock( &slap_counters.sc_mutex );
+
+				monitor_ops_histo_collect( h, i );
 				break;
 			}
 		}
@@ -237,6 +341,9 @@ monitor_subsys_ops_update(
 	UI2BV( &a->a_vals[ 0 ], nCompleted );
 	ldap_pvt_mp_clear( nCompleted );
 
+	attr_delete( &e->e_attrs, mi->mi_ad_monitorOpLatency );
+	monitor_ops_latency( mi, e, NULL, h );
+
 	/* FIXME: touch modifyTimestamp? */
 
 	return SLAP_CB_CONTINUE;
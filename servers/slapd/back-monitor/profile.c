@@ -0,0 +1,208 @@
+/* profile.c - deal with hot path profiling subsystem */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2001-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "slap.h"
+#include "lutil.h"
+#include "back-monitor.h"
+
+static int
+monitor_subsys_profile_destroy(
+	BackendDB		*be,
+	monitor_subsys_t	*ms );
+
+static int
+monitor_subsys_profile_update(
+	Operation		*op,
+	SlapReply		*rs,
+	Entry                   *e );
+
+/* in slap_prof_t order */
+static struct monitor_profile_t {
+	struct berval	rdn;
+	struct berval	nrdn;
+} monitor_profile[] = {
+	{ BER_BVC("cn=Index Reads"),	BER_BVNULL },
+	{ BER_BVC("cn=IDL"),		BER_BVNULL },
+	{ BER_BVC("cn=Entry Decode"),	BER_BVNULL },
+	{ BER_BVC("cn=Filter"),		BER_BVNULL },
+	{ BER_BVC("cn=Normalize"),	BER_BVNULL },
+	{ BER_BVC("cn=BER Encode"),	BER_BVNULL },
+	{ BER_BVNULL,			BER_BVNULL }
+};
+
+int
+monitor_subsys_profile_init(
+	BackendDB		*be,
+	monitor_subsys_t	*ms )
+{
+	monitor_info_t	*mi;
+
+	Entry		**ep, *e_prof;
+	monitor_entry_t	*mp;
+	int			i;
+
+	assert( be != NULL );
+
+	ms->mss_destroy = monitor_subsys_profile_destroy;
+	ms->mss_update = monitor_subsys_profile_update;
+
+	mi = ( monitor_info_t * )be->be_private;
+
+	if ( monitor_cache_get( mi, &ms->mss_ndn, &e_prof ) ) {
+		Debug( LDAP_DEBUG_ANY,
+			"monitor_subsys_profile_init: "
+			"unable to get entry \"%s\"\n",
+			ms->mss_ndn.bv_val );
+		return( -1 );
+	}
+
+	mp = ( monitor_entry_t * )e_prof->e_private;
+	mp->mp_children = NULL;
+	ep = &mp->mp_children;
+
+	for ( i = 0; i < SLAP_PROF_LAST; i++ ) {
+		struct berval		nrdn, bv;
+		Entry			*e;
+
+		e = monitor_entry_stub( &ms->mss_dn, &ms->mss_ndn,
+			&monitor_profile[i].rdn,
+			mi->mi_oc_monitorCounterObject, NULL, NULL );
+		if ( e == NULL ) {
+			Debug( LDAP_DEBUG_ANY,
+				"monitor_subsys_profile_init: "
+				"unable to create entry \"%s,%s\"\n",
+				monitor_profile[ i ].rdn.bv_val,
+				ms->mss_ndn.bv_val );
+			return( -1 );
+		}
+
+		/* steal normalized RDN */
+		dnRdn( &e->e_nname, &nrdn );
+		ber_dupbv( &monitor_profile[ i ].nrdn, &nrdn );
+
+		BER_BVSTR( &bv, "0" );
+		attr_merge_one( e, mi->mi_ad_monitorCounter, &bv, NULL );
+		attr_merge_one( e, mi->mi_ad_monitorProfileTime, &bv, NULL );
+
+		mp = monitor_entrypriv_create();
+		if ( mp == NULL ) {
+			return -1;
+		}
+		e->e_private = ( void * )mp;
+		mp->mp_info = ms;
+		mp->mp_flags = ms->mss_flags \
+			| MONITOR_F_SUB | MONITOR_F_PERSISTENT;
+
+		if ( monitor_cache_add( mi, e ) ) {
+			Debug( LDAP_DEBUG_ANY,
+				"monitor_subsys_profile_init: "
+				"unable to add entry \"%s,%s\"\n",
+				monitor_profile[ i ].rdn.bv_val,
+				ms->mss_ndn.bv_val );
+			return( -1 );
+		}
+
+		*ep = e;
+		ep = &mp->mp_next;
+	}
+
+	monitor_cache_release( mi, e_prof );
+
+	return( 0 );
+}
+
+static int
+monitor_subsys_profile_destroy(
+	BackendDB		*be,
+	monitor_subsys_t	*ms )
+{
+	int		i;
+
+	for ( i = 0; i < SLAP_PROF_LAST; i++ ) {
+		ber_memfree_x( monitor_profile[ i ].nrdn.bv_val, NULL );
+	}
+
+	return 0;
+}
+
+static void
+monitor_profile_set(
+	Entry			*e,
+	AttributeDescription	*ad,
+	char			*buf )
+{
+	Attribute	*a;
+	ber_len_t	len;
+
+	a = attr_find( e->e_attrs, ad );
+	assert( a != NULL );
+	len = strlen( buf );
+	if ( len > a->a_vals[ 0 ].bv_len ) {
+		a->a_vals[ 0 ].bv_val = ber_memrealloc( a->a_vals[ 0 ].bv_val, len + 1 );
+		if ( BER_BVISNULL( &a->a_vals[ 0 ] ) ) {
+			BER_BVZERO( &a->a_vals[ 0 ] );
+			return;
+		}
+	}
+	AC_MEMCPY( a->a_vals[ 0 ].bv_val, buf, len + 1 );
+	a->a_vals[ 0 ].bv_len = len;
+}
+
+static int
+monitor_subsys_profile_update(
+	Operation		*op,
+	SlapReply		*rs,
+	Entry                   *e )
+{
+	monitor_info_t *mi = (monitor_info_t *)op->o_bd->be_private;
+	slap_prof_counter_t	counters[ SLAP_PROF_LAST ];
+
+	int		i;
+	struct berval	nrdn;
+
+	char 		buf[ 32 ];
+
+	assert( mi != NULL );
+	assert( e != NULL );
+
+	dnRdn( &e->e_nname, &nrdn );
+
+	for ( i = 0; !BER_BVISNULL( &monitor_profile[ i ].nrdn ); i++ ) {
+		if ( dn_match( &nrdn, &monitor_profile[ i ].nrdn ) ) {
+			break;
+		}
+	}
+
+	if ( i == SLAP_PROF_LAST ) {
+		return SLAP_CB_CONTINUE;
+	}
+
+	slap_prof_collect( counters );
+
+	snprintf( buf, sizeof( buf ), "%lu", counters[ i ].spc_calls );
+	monitor_profile_set( e, mi->mi_ad_monitorCounter, buf );
+
+	snprintf( buf, sizeof( buf ), "%.0f",
+		slap_prof_usec( counters[ i ].spc_ticks ));
+	monitor_profile_set( e, mi->mi_ad_monitorProfileTime, buf );
+
+	return SLAP_CB_CONTINUE;
+}
@@ -72,6 +72,10 @@ extern int
 monitor_cache_release LDAP_P((
 	monitor_info_t		*mi,
 	Entry			*e ));
+extern Entry *
+monitor_cache_snapshot LDAP_P((
+	monitor_info_t		*mi,
+	Entry			*e ));
 
 extern int
 monitor_cache_destroy LDAP_P((
@@ -271,6 +275,16 @@ monitor_subsys_log_init LDAP_P((
 	BackendDB		*be,
 	monitor_subsys_t	*ms ));
 
+/*
+ * metrics
+ */
+extern int
+monitor_metrics_open LDAP_P((
+	BackendDB		*be ));
+extern void
+monitor_metrics_close LDAP_P((
+	BackendDB		*be ));
+
 /*
  * operations
  */
@@ -278,6 +292,11 @@ extern int
 monitor_subsys_ops_init LDAP_P((
 	BackendDB		*be,
 	monitor_subsys_t	*ms ));
+extern void
+monitor_ops_db_latency LDAP_P((
+	monitor_info_t		*mi,
+	Entry			*e,
+	slap_histo_t		*h ));
 
 /*
  * overlay
@@ -318,6 +337,14 @@ monitor_subsys_rww_init LDAP_P((
 	BackendDB		*be,
 	monitor_subsys_t	*ms ));
 
+/*
+ * profile
+ */
+extern int
+monitor_subsys_profile_init LDAP_P((
+	BackendDB		*be,
+	monitor_subsys_t	*ms ));
+
 /*
  * former external.h
  */
@@ -326,6 +353,7 @@ extern BI_init			monitor_back_initialize;
 
 extern BI_db_init		monitor_back_db_init;
 extern BI_db_open		monitor_back_db_open;
+extern BI_db_close		monitor_back_db_close;
 extern BI_config		monitor_back_config;
 extern BI_db_destroy		monitor_back_db_destroy;
 extern BI_db_config		monitor_back_db_config;
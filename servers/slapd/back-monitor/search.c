@@ -30,6 +30,96 @@
 #include "back-monitor.h"
 #include "proto-back-monitor.h"
 
+static int
+monitor_oc_allows(
+	ObjectClass *oc,
+	AttributeType *at
+)
+{
+	int i;
+
+	for ( i = 0; oc->soc_required && oc->soc_required[ i ]; i++ ) {
+		if ( is_at_subtype( oc->soc_required[ i ], at ) )
+			return 1;
+	}
+	for ( i = 0; oc->soc_allowed && oc->soc_allowed[ i ]; i++ ) {
+		if ( is_at_subtype( oc->soc_allowed[ i ], at ) )
+			return 1;
+	}
+	for ( i = 0; oc->soc_sups && oc->soc_sups[ i ]; i++ ) {
+		if ( monitor_oc_allows( oc->soc_sups[ i ], at ) )
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * tells whether an entry of class oc may be able to match f; only
+ * objectClass assertions and assertions on attributes that oc does
+ * not allow are known to fail, everything else may match
+ */
+static int
+monitor_filter_oc_match(
+	Filter *f,
+	ObjectClass *oc
+)
+{
+	AttributeDescription *ad = NULL;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+		for ( f = f->f_and; f != NULL; f = f->f_next ) {
+			if ( !monitor_filter_oc_match( f, oc ) )
+				return 0;
+		}
+		return 1;
+
+	case LDAP_FILTER_OR:
+		for ( f = f->f_or; f != NULL; f = f->f_next ) {
+			if ( monitor_filter_oc_match( f, oc ) )
+				return 1;
+		}
+		return 0;
+
+	case SLAPD_FILTER_COMPUTED:
+		return f->f_result == LDAP_COMPARE_TRUE;
+
+	case LDAP_FILTER_EQUALITY:
+		if ( f->f_av_desc == slap_schema.si_ad_objectClass ) {
+			ObjectClass *foc = oc_bvfind( &f->f_av_value );
+
+			return foc == NULL || is_object_subclass( foc, oc );
+		}
+		/* fallthru */
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		ad = f->f_av_desc;
+		break;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		break;
+
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		break;
+
+	default:
+		/* NOT, extensible */
+		return 1;
+	}
+
+	if ( ad == slap_schema.si_ad_objectClass
+		|| is_at_operational( ad->ad_type ) )
+	{
+		return 1;
+	}
+
+	return monitor_oc_allows( oc, ad->ad_type );
+}
+
 static void
 monitor_find_children(
 	Operation *op,
@@ -45,6 +135,13 @@ monitor_find_children(
 	*nonv = mp->mp_children;
 
 	if ( MONITOR_HAS_VOLATILE_CH( mp ) ) {
+		/* e.g. counter scrapes need not walk all connections */
+		if ( mp->mp_info && mp->mp_info->mss_volatile_oc &&
+			!monitor_filter_oc_match( op->ors_filter,
+				mp->mp_info->mss_volatile_oc ) )
+		{
+			return;
+		}
 		monitor_entry_create( op, rs, NULL, e_parent, vol );
 	}
 }
@@ -119,7 +216,7 @@ monitor_send_children(
 
 		rc = test_filter( op, e, op->oq_search.rs_filter );
 		if ( rc == LDAP_COMPARE_TRUE ) {
-			rs->sr_entry = e;
+			rs->sr_entry = monitor_cache_snapshot( mi, e );
 			rs->sr_flags = REP_ENTRY_MUSTRELEASE;
 			rc = send_search_entry( op, rs );
 			if ( rc ) {
@@ -221,7 +318,7 @@ monitor_back_search( Operation *op, SlapReply *rs )
 		monitor_entry_update( op, rs, e );
 		rc = test_filter( op, e, op->oq_search.rs_filter );
  		if ( rc == LDAP_COMPARE_TRUE ) {
-			rs->sr_entry = e;
+			rs->sr_entry = monitor_cache_snapshot( mi, e );
 			rs->sr_flags = REP_ENTRY_MUSTRELEASE;
 			send_search_entry( op, rs );
 			rs->sr_entry = NULL;
@@ -244,7 +341,7 @@ monitor_back_search( Operation *op, SlapReply *rs )
 		monitor_find_children( op, rs, e, &e_nv, &e_ch );
 		rc = test_filter( op, e, op->oq_search.rs_filter );
 		if ( rc == LDAP_COMPARE_TRUE ) {
-			rs->sr_entry = e;
+			rs->sr_entry = monitor_cache_snapshot( mi, e );
 			rs->sr_flags = REP_ENTRY_MUSTRELEASE;
 			send_search_entry( op, rs );
 			rs->sr_entry = NULL;
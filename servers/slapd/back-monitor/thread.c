@@ -33,6 +33,12 @@ typedef enum {
 	MT_UNKNOWN,
 	MT_RUNQUEUE,
 	MT_TASKLIST,
+	MT_ENTRY_HITS,
+	MT_ENTRY_MISSES,
+	MT_ATTR_HITS,
+	MT_ATTR_MISSES,
+	MT_SLAB_CHUNKS,
+	MT_SLAB_FALLBACKS,
 
 	MT_LAST
 } monitor_thread_t;
@@ -65,6 +71,12 @@ static struct {
 	{ BER_BVC( "cn=Backload" ),	
 		BER_BVC("Number of active plus pending threads"),
 		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_BACKLOAD,	MT_UNKNOWN },
+	{ BER_BVC( "cn=Limit" ),
+		BER_BVC("Number of threads the pool may currently open"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_LIMIT,	MT_UNKNOWN },
+	{ BER_BVC( "cn=Wait" ),
+		BER_BVC("Average queue wait of recent tasks in microseconds"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_WAIT,	MT_UNKNOWN },
 #if 0	/* not meaningful right now */
 	{ BER_BVC( "cn=Active Max" ),
 		BER_BVNULL,
@@ -87,6 +99,25 @@ static struct {
 		BER_BVC("List of running plus standby threads - besides those handling operations"),
 		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_TASKLIST },
 
+	{ BER_BVC( "cn=Entry Local Hits" ),
+		BER_BVC("Entries allocated from per-thread free lists"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_ENTRY_HITS },
+	{ BER_BVC( "cn=Entry Local Misses" ),
+		BER_BVC("Refills of per-thread Entry free lists from the shared list"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_ENTRY_MISSES },
+	{ BER_BVC( "cn=Attribute Local Hits" ),
+		BER_BVC("Attributes allocated from per-thread free lists"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_ATTR_HITS },
+	{ BER_BVC( "cn=Attribute Local Misses" ),
+		BER_BVC("Refills of per-thread Attribute free lists from the shared list"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_ATTR_MISSES },
+	{ BER_BVC( "cn=Slab Chunks" ),
+		BER_BVC("Chunks chained to full per-thread slabs"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_SLAB_CHUNKS },
+	{ BER_BVC( "cn=Slab Fallbacks" ),
+		BER_BVC("Temporary allocations not served from per-thread slabs"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_SLAB_FALLBACKS },
+
 	{ BER_BVNULL }
 };
 
@@ -96,6 +127,23 @@ monitor_subsys_thread_update(
 	SlapReply		*rs,
 	Entry 			*e );
 
+static unsigned long
+monitor_thread_local( monitor_thread_t which )
+{
+	unsigned long	hits, misses;
+
+	if ( which == MT_SLAB_CHUNKS || which == MT_SLAB_FALLBACKS ) {
+		slap_sl_stats( &hits, &misses );
+		return which == MT_SLAB_CHUNKS ? hits : misses;
+	}
+	if ( which == MT_ENTRY_HITS || which == MT_ENTRY_MISSES ) {
+		entry_local_stats( &hits, &misses );
+	} else {
+		attr_local_stats( &hits, &misses );
+	}
+	return ( which == MT_ENTRY_HITS || which == MT_ATTR_HITS ) ? hits : misses;
+}
+
 /*
  * initializes log subentry
  */
@@ -151,6 +199,11 @@ monitor_subsys_thread_init(
 
 		switch ( mt[ i ].param ) {
 		case LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN:
+			if ( mt[ i ].mt >= MT_ENTRY_HITS ) {
+				bv.bv_val = buf;
+				bv.bv_len = snprintf( buf, sizeof( buf ), "%lu",
+					monitor_thread_local( mt[ i ].mt ) );
+			}
 			break;
 
 		case LDAP_PVT_THREAD_POOL_PARAM_STATE:
@@ -293,7 +346,7 @@ monitor_subsys_thread_update(
 			i = 0;
 			bv.bv_val = buf;
 			ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
-			LDAP_STAILQ_FOREACH( re, &slapd_rq.task_list, tnext ) {
+			LDAP_TAILQ_FOREACH( re, &slapd_rq.task_list, tnext ) {
 				bv.bv_len = snprintf( buf, sizeof( buf ), "{%d}%s(%s)",
 					i, re->tname, re->tspec );
 				if ( bv.bv_len < sizeof( buf ) ) {
@@ -312,6 +365,23 @@ monitor_subsys_thread_update(
 			}
 			break;
 
+		case MT_ENTRY_HITS:
+		case MT_ENTRY_MISSES:
+		case MT_ATTR_HITS:
+		case MT_ATTR_MISSES:
+		case MT_SLAB_CHUNKS:
+		case MT_SLAB_FALLBACKS:
+			if ( a == NULL ) {
+				return rs->sr_err = LDAP_OTHER;
+			}
+			bv.bv_val = buf;
+			bv.bv_len = snprintf( buf, sizeof( buf ), "%lu",
+				monitor_thread_local( mt[ which ].mt ) );
+			if ( bv.bv_len < sizeof( buf ) ) {
+				ber_bvreplace( &a->a_vals[ 0 ], &bv );
+			}
+			break;
+
 		default:
 			assert( 0 );
 		}
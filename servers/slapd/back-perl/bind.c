@@ -31,6 +31,7 @@ perl_back_bind(
 	int count;
 
 	PerlBackend *perl_back = (PerlBackend *) op->o_bd->be_private;
+	PerlInterp *pi;
 
 	/* allow rootdn as a means to auth without the need to actually
  	 * contact the proxied DSA */
@@ -42,14 +43,14 @@ perl_back_bind(
 		return rs->sr_err;
 	}
 
-	PERL_SET_CONTEXT( PERL_INTERPRETER );
-	ldap_pvt_thread_mutex_lock( &perl_interpreter_mutex );	
+	pi = perl_back_interp_get( perl_back );
 
 	{
+		dTHXa( pi->pi_perl );
 		dSP; ENTER; SAVETMPS;
 
 		PUSHMARK(SP);
-		XPUSHs( perl_back->pb_obj_ref );
+		XPUSHs( pi->pi_obj_ref );
 		XPUSHs(sv_2mortal(newSVpv( op->o_req_dn.bv_val , op->o_req_dn.bv_len)));
 		XPUSHs(sv_2mortal(newSVpv( op->orb_cred.bv_val , op->orb_cred.bv_len)));
 		PUTBACK;
@@ -68,7 +69,7 @@ perl_back_bind(
 		PUTBACK; FREETMPS; LEAVE;
 	}
 
-	ldap_pvt_thread_mutex_unlock( &perl_interpreter_mutex );	
+	perl_back_interp_release( perl_back, pi );
 
 	Debug( LDAP_DEBUG_ANY, "Perl BIND returned 0x%04x\n", rs->sr_err );
 
@@ -40,6 +40,34 @@ perl_back_close(
 	return 0;
 }
 
+int
+perl_back_db_close(
+	BackendDB *be,
+	ConfigReply *cr
+)
+{
+	PerlBackend *pb = be->be_private;
+	PerlInterp *pi;
+
+	if ( pb->pb_pool == NULL )
+		return 0;
+
+	ldap_pvt_thread_mutex_lock( &perl_interpreter_mutex );
+	for ( pi = pb->pb_pool; pi->pi_perl; pi++ ) {
+		PERL_SET_CONTEXT( pi->pi_perl );
+		perl_destruct( pi->pi_perl );
+		perl_free( pi->pi_perl );
+	}
+	PERL_SET_CONTEXT( PERL_INTERPRETER );
+	ldap_pvt_thread_mutex_unlock( &perl_interpreter_mutex );
+
+	ch_free( pb->pb_pool );
+	pb->pb_pool = NULL;
+	pb->pb_free = NULL;
+
+	return 0;
+}
+
 int
 perl_back_db_destroy(
 	BackendDB *be,
@@ -51,6 +79,8 @@ perl_back_db_destroy(
 	ch_free( pb->pb_module_name );
 	ber_bvarray_free( pb->pb_module_path );
 	ber_bvarray_free( pb->pb_module_config );
+	ldap_pvt_thread_cond_destroy( &pb->pb_pool_cond );
+	ldap_pvt_thread_mutex_destroy( &pb->pb_pool_mutex );
 
 	free( be->be_private );
 	be->be_private = NULL;
@@ -33,6 +33,7 @@ perl_back_compare(
 	char *avastr;
 
 	PerlBackend *perl_back = (PerlBackend *)op->o_bd->be_private;
+	PerlInterp *pi;
 
 	avalen = op->orc_ava->aa_desc->ad_cname.bv_len + 1 +
 		op->orc_ava->aa_value.bv_len;
@@ -42,14 +43,14 @@ perl_back_compare(
 		op->orc_ava->aa_desc->ad_cname.bv_val ), "=" ),
 		op->orc_ava->aa_value.bv_val );
 
-	PERL_SET_CONTEXT( PERL_INTERPRETER );
-	ldap_pvt_thread_mutex_lock( &perl_interpreter_mutex );	
+	pi = perl_back_interp_get( perl_back );
 
 	{
+		dTHXa( pi->pi_perl );
 		dSP; ENTER; SAVETMPS;
 
 		PUSHMARK(sp);
-		XPUSHs( perl_back->pb_obj_ref );
+		XPUSHs( pi->pi_obj_ref );
 		XPUSHs(sv_2mortal(newSVpv( op->o_req_dn.bv_val , op->o_req_dn.bv_len)));
 		XPUSHs(sv_2mortal(newSVpv( avastr , avalen)));
 		PUTBACK;
@@ -67,7 +68,7 @@ perl_back_compare(
 		PUTBACK; FREETMPS; LEAVE;
 	}
 
-	ldap_pvt_thread_mutex_unlock( &perl_interpreter_mutex );	
+	perl_back_interp_release( perl_back, pi );
 
 	ch_free( avastr );
 
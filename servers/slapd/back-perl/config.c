@@ -51,6 +51,12 @@ static ConfigTable perlcfg[] = {
 			"DESC 'Perl module config directives' "
 			"EQUALITY caseExactMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "perlInterpreters", "num", 2, 2, 0, ARG_INT|ARG_OFFSET,
+		(void *)offsetof(PerlBackend, pb_interpreters),
+		"( OLcfgDbAt:11.5 NAME 'olcPerlInterpreters' "
+			"DESC 'Number of interpreters to run operations in concurrently' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL }
 };
 
@@ -60,7 +66,8 @@ static ConfigOCs perlocs[] = {
 		"DESC 'Perl DB configuration' "
 		"SUP olcDatabaseConfig "
 		"MUST ( olcPerlModulePath $ olcPerlModule ) "
-		"MAY ( olcPerlFilterSearchResults $ olcPerlModuleConfig ) )",
+		"MAY ( olcPerlFilterSearchResults $ olcPerlModuleConfig "
+			"$ olcPerlInterpreters ) )",
 			Cft_Database, perlcfg, NULL, NULL },
 	{ NULL }
 };
@@ -71,7 +78,8 @@ static ConfigOCs ovperlocs[] = {
 		"DESC 'Perl overlay configuration' "
 		"SUP olcOverlayConfig "
 		"MUST ( olcPerlModulePath $ olcPerlModule ) "
-		"MAY ( olcPerlFilterSearchResults $ olcPerlModuleConfig ) )",
+		"MAY ( olcPerlFilterSearchResults $ olcPerlModuleConfig "
+			"$ olcPerlInterpreters ) )",
 			Cft_Overlay, perlcfg, NULL, NULL },
 	{ NULL }
 };
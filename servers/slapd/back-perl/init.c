@@ -57,7 +57,7 @@ perl_back_initialize(
 	bi->bi_db_init = perl_back_db_init;
 	bi->bi_db_config = perl_back_db_config;
 	bi->bi_db_open = perl_back_db_open;
-	bi->bi_db_close = 0;
+	bi->bi_db_close = perl_back_db_close;
 	bi->bi_db_destroy = perl_back_db_destroy;
 
 	bi->bi_op_bind = perl_back_bind;
@@ -110,6 +110,9 @@ perl_back_db_init(
 	memset( be->be_private, '\0', sizeof(PerlBackend));
 
 	((PerlBackend *)be->be_private)->pb_filter_search_results = 0;
+	((PerlBackend *)be->be_private)->pb_interpreters = 1;
+	ldap_pvt_thread_mutex_init( &((PerlBackend *)be->be_private)->pb_pool_mutex );
+	ldap_pvt_thread_cond_init( &((PerlBackend *)be->be_private)->pb_pool_cond );
 
 	Debug( LDAP_DEBUG_TRACE, "perl backend db init\n" );
 
@@ -152,11 +155,90 @@ perl_back_db_open(
 		PUTBACK; FREETMPS; LEAVE;
 	}
 
+#ifdef USE_ITHREADS
+	/* Clone the configured and initialized interpreter, so that
+	 * operations can run concurrently, each in its own interpreter.
+	 * Only what Perl can reach gets cloned, so hang the module object
+	 * off an array first; the pointer table then maps it to its copy.
+	 */
+	if ( return_code == 0 && perl_back->pb_interpreters > 1 ) {
+		int i;
+
+		av_push( get_av( "OpenLDAP::Backend::objects", GV_ADD ),
+			SvREFCNT_inc( perl_back->pb_obj_ref ) );
+
+		perl_back->pb_pool = ch_calloc( perl_back->pb_interpreters + 1,
+			sizeof(PerlInterp) );
+		for ( i = 0; i < perl_back->pb_interpreters; i++ ) {
+			PerlInterp *pi = &perl_back->pb_pool[i];
+
+			pi->pi_perl = perl_clone( PERL_INTERPRETER, CLONEf_KEEP_PTR_TABLE );
+			{
+				dTHXa( pi->pi_perl );
+
+				pi->pi_obj_ref = (SV *)ptr_table_fetch( PL_ptr_table,
+					perl_back->pb_obj_ref );
+				ptr_table_free( PL_ptr_table );
+				PL_ptr_table = NULL;
+			}
+			pi->pi_next = perl_back->pb_free;
+			perl_back->pb_free = pi;
+		}
+		PERL_SET_CONTEXT( PERL_INTERPRETER );
+	}
+#endif /* USE_ITHREADS */
+
 	ldap_pvt_thread_mutex_unlock( &perl_interpreter_mutex );
 
 	return return_code;
 }
 
+/* Check out an interpreter for the duration of an operation.
+ * Without a pool, all operations share the main interpreter.
+ */
+PerlInterp *
+perl_back_interp_get(
+	PerlBackend *pb
+)
+{
+	PerlInterp *pi;
+
+	if ( pb->pb_pool == NULL ) {
+		ldap_pvt_thread_mutex_lock( &perl_interpreter_mutex );
+		pi = &pb->pb_main;
+		pi->pi_perl = PERL_INTERPRETER;
+		pi->pi_obj_ref = pb->pb_obj_ref;
+	} else {
+		ldap_pvt_thread_mutex_lock( &pb->pb_pool_mutex );
+		while ( pb->pb_free == NULL ) {
+			ldap_pvt_thread_cond_wait( &pb->pb_pool_cond, &pb->pb_pool_mutex );
+		}
+		pi = pb->pb_free;
+		pb->pb_free = pi->pi_next;
+		ldap_pvt_thread_mutex_unlock( &pb->pb_pool_mutex );
+	}
+	PERL_SET_CONTEXT( pi->pi_perl );
+
+	return pi;
+}
+
+void
+perl_back_interp_release(
+	PerlBackend *pb,
+	PerlInterp *pi
+)
+{
+	if ( pi == &pb->pb_main ) {
+		ldap_pvt_thread_mutex_unlock( &perl_interpreter_mutex );
+	} else {
+		ldap_pvt_thread_mutex_lock( &pb->pb_pool_mutex );
+		pi->pi_next = pb->pb_free;
+		pb->pb_free = pi;
+		ldap_pvt_thread_cond_signal( &pb->pb_pool_cond );
+		ldap_pvt_thread_mutex_unlock( &pb->pb_pool_mutex );
+	}
+}
+
 
 static void
 perl_back_xs_init(PERL_BACK_XS_INIT_PARAMS)
@@ -23,16 +23,17 @@ perl_back_modrdn(
 	SlapReply	*rs )
 {
 	PerlBackend *perl_back = (PerlBackend *) op->o_bd->be_private;
+	PerlInterp *pi;
 	int count;
 
-	PERL_SET_CONTEXT( PERL_INTERPRETER );
-	ldap_pvt_thread_mutex_lock( &perl_interpreter_mutex );	
+	pi = perl_back_interp_get( perl_back );
 
 	{
+		dTHXa( pi->pi_perl );
 		dSP; ENTER; SAVETMPS;
 		
 		PUSHMARK(sp) ;
-		XPUSHs( perl_back->pb_obj_ref );
+		XPUSHs( pi->pi_obj_ref );
 		XPUSHs(sv_2mortal(newSVpv( op->o_req_dn.bv_val , op->o_req_dn.bv_len )));
 		XPUSHs(sv_2mortal(newSVpv( op->orr_newrdn.bv_val , op->orr_newrdn.bv_len )));
 		XPUSHs(sv_2mortal(newSViv( op->orr_deleteoldrdn )));
@@ -54,7 +55,7 @@ perl_back_modrdn(
 		PUTBACK; FREETMPS; LEAVE ;
 	}
 
-	ldap_pvt_thread_mutex_unlock( &perl_interpreter_mutex );
+	perl_back_interp_release( perl_back, pi );
 	
 	send_ldap_result( op, rs );
 
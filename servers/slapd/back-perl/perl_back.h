@@ -67,12 +67,27 @@ extern ldap_pvt_thread_mutex_t  perl_interpreter_mutex;
 extern PerlInterpreter *PERL_INTERPRETER;
 
 
+/* An interpreter and the module object living in it */
+typedef struct perl_interp {
+	PerlInterpreter	*pi_perl;
+	SV	*pi_obj_ref;
+	struct perl_interp *pi_next;
+} PerlInterp;
+
 typedef struct perl_backend_instance {
 	char *pb_module_name;
 	BerVarray pb_module_path;
 	BerVarray pb_module_config;
 	SV	*pb_obj_ref;
 	int	pb_filter_search_results;
+
+	/* pool of interpreters cloned from the main one at db_open */
+	int	pb_interpreters;
+	PerlInterp	pb_main;
+	PerlInterp	*pb_pool;
+	PerlInterp	*pb_free;
+	ldap_pvt_thread_mutex_t	pb_pool_mutex;
+	ldap_pvt_thread_cond_t	pb_pool_cond;
 } PerlBackend;
 
 LDAP_END_DECL
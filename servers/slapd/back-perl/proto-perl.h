@@ -26,6 +26,7 @@ extern BI_close		perl_back_close;
 
 extern BI_db_init	perl_back_db_init;
 extern BI_db_open	perl_back_db_open;
+extern BI_db_close	perl_back_db_close;
 extern BI_db_destroy	perl_back_db_destroy;
 extern BI_db_config	perl_back_db_config;
 
@@ -38,6 +39,9 @@ extern BI_op_add	perl_back_add;
 extern BI_op_delete	perl_back_delete;
 
 extern int perl_back_init_cf( BackendInfo *bi );
+
+extern PerlInterp *perl_back_interp_get( PerlBackend *pb );
+extern void perl_back_interp_release( PerlBackend *pb, PerlInterp *pi );
 LDAP_END_DECL
 
 #endif /* PROTO_PERL_H */
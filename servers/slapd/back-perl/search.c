@@ -28,20 +28,21 @@ perl_back_search(
 	SlapReply *rs )
 {
 	PerlBackend *perl_back = (PerlBackend *)op->o_bd->be_private;
+	PerlInterp *pi;
 	int count ;
 	AttributeName *an;
 	Entry	*e;
 	char *buf;
 	int i;
 
-	PERL_SET_CONTEXT( PERL_INTERPRETER );
-	ldap_pvt_thread_mutex_lock( &perl_interpreter_mutex );	
+	pi = perl_back_interp_get( perl_back );
 
 	{
+		dTHXa( pi->pi_perl );
 		dSP; ENTER; SAVETMPS;
 
 		PUSHMARK(sp) ;
-		XPUSHs( perl_back->pb_obj_ref );
+		XPUSHs( pi->pi_obj_ref );
 		XPUSHs(sv_2mortal(newSVpv( op->o_req_ndn.bv_val , op->o_req_ndn.bv_len)));
 		XPUSHs(sv_2mortal(newSViv( op->ors_scope )));
 		XPUSHs(sv_2mortal(newSViv( op->ors_deref )));
@@ -114,7 +115,7 @@ done:;
 		PUTBACK; FREETMPS; LEAVE;
 	}
 
-	ldap_pvt_thread_mutex_unlock( &perl_interpreter_mutex );	
+	perl_back_interp_release( perl_back, pi );
 
 	send_ldap_result( op, rs );
 
@@ -45,7 +45,7 @@ sock_back_add(
 		return -1;
 	}
 
-	if ( (fp = opensock( si->si_sockpath )) == NULL ) {
+	if ( (fp = sock_open( si )) == NULL ) {
 		send_ldap_error( op, rs, LDAP_OTHER,
 		    "could not open socket" );
 		return( -1 );
@@ -64,6 +64,6 @@ sock_back_add(
 	/* read in the result and send it along */
 	sock_read_and_send_results( op, rs, fp );
 
-	fclose( fp );
+	sock_close( si, fp );
 	return( 0 );
 }
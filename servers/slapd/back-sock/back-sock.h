@@ -32,6 +32,11 @@ struct sockinfo {
 	slap_mask_t	si_resps;	/* overlay: responses to forward */
 	regex_t	si_dnpat;		/* overlay: DN pattern to match */
 	struct berval 	si_dnpatstr;
+	int		si_poolmax;	/* max idle persistent connections */
+	int		si_npool;
+	int		si_poolsize;
+	int		*si_pool;	/* idle connected sockets */
+	ldap_pvt_thread_mutex_t	si_mutex;
 };
 
 #define	SOCK_EXT_BINDDN	1
@@ -42,6 +47,16 @@ struct sockinfo {
 extern FILE *opensock LDAP_P((
 	const char *sockpath));
 
+extern FILE *sock_open LDAP_P((
+	struct sockinfo *si));
+
+extern void sock_close LDAP_P((
+	struct sockinfo *si,
+	FILE *fp));
+
+extern void sock_pool_free LDAP_P((
+	struct sockinfo *si));
+
 extern void sock_print_suffixes LDAP_P((
 	FILE *fp,
 	BackendDB *bd));
@@ -55,7 +55,7 @@ sock_back_bind(
 		return -1;
 	}
 
-	if ( (fp = opensock( si->si_sockpath )) == NULL ) {
+	if ( (fp = sock_open( si )) == NULL ) {
 		send_ldap_error( op, rs, LDAP_OTHER,
 		    "could not open socket" );
 		return( -1 );
@@ -74,7 +74,7 @@ sock_back_bind(
 
 	/* read in the results and send them along */
 	rc = sock_read_and_send_results( op, rs, fp );
-	fclose( fp );
+	sock_close( si, fp );
 
 	return( rc );
 }
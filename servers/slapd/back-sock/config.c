@@ -71,6 +71,12 @@ static ConfigTable bscfg[] = {
 			"DESC 'binddn, peername, or ssf' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "socketpool", "num", 2, 2, 0, ARG_INT|ARG_OFFSET,
+		(void *)offsetof(struct sockinfo, si_poolmax),
+		"( OLcfgDbAt:7.6 NAME 'olcDbSocketPool' "
+			"DESC 'Max number of idle connections kept open' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL }
 };
 
@@ -80,7 +86,7 @@ static ConfigOCs bsocs[] = {
 		"DESC 'Socket backend configuration' "
 		"SUP olcDatabaseConfig "
 		"MUST olcDbSocketPath "
-		"MAY olcDbSocketExtensions )",
+		"MAY ( olcDbSocketExtensions $ olcDbSocketPool ) )",
 			Cft_Database, bscfg+NUM_OV_ATTRS },
 	{ NULL, 0, NULL }
 };
@@ -91,7 +97,7 @@ static ConfigOCs osocs[] = {
 		"DESC 'Socket overlay configuration' "
 		"SUP olcOverlayConfig "
 		"MUST olcDbSocketPath "
-		"MAY ( olcDbSocketExtensions $ "
+		"MAY ( olcDbSocketExtensions $ olcDbSocketPool $ "
 			" olcOvSocketOps $ olcOvSocketResps $ "
 			" olcOvSocketDNpat ) )",
 			Cft_Overlay, bscfg },
@@ -326,7 +332,7 @@ sock_over_response( Operation *op, SlapReply *rs )
 	} else
 		return SLAP_CB_CONTINUE;
 
-	if (( fp = opensock( si->si_sockpath )) == NULL )
+	if (( fp = sock_open( si )) == NULL )
 		return SLAP_CB_CONTINUE;
 
 	if ( rs->sr_type == REP_RESULT ) {
@@ -350,7 +356,7 @@ sock_over_response( Operation *op, SlapReply *rs )
 		ldap_pvt_thread_mutex_unlock( &entry2str_mutex );
 	}
 	fprintf( fp, "\n" );
-	fclose( fp );
+	sock_close( si, fp );
 
 	return SLAP_CB_CONTINUE;
 }
@@ -54,7 +54,7 @@ sock_back_delete(
 		return -1;
 	}
 
-	if ( (fp = opensock( si->si_sockpath )) == NULL ) {
+	if ( (fp = sock_open( si )) == NULL ) {
 		send_ldap_error( op, rs, LDAP_OTHER,
 		    "could not open socket" );
 		return( -1 );
@@ -70,6 +70,6 @@ sock_back_delete(
 
 	/* read in the results and send them along */
 	sock_read_and_send_results( op, rs, fp );
-	fclose( fp );
+	sock_close( si, fp );
 	return( 0 );
 }
@@ -35,7 +35,7 @@ sock_back_extended( Operation *op, SlapReply *rs )
 	Debug( LDAP_DEBUG_ARGS, "==> sock_back_extended(%s, %s)\n",
 		op->ore_reqoid.bv_val, op->o_req_dn.bv_val );
 
-	if ( (fp = opensock( si->si_sockpath )) == NULL ) {
+	if ( (fp = sock_open( si )) == NULL ) {
 		send_ldap_error( op, rs, LDAP_OTHER,
 			"could not open socket" );
 		return( -1 );
@@ -70,7 +70,7 @@ sock_back_extended( Operation *op, SlapReply *rs )
 
 	/* read in the results and send them along */
 	rc = sock_read_and_send_results( op, rs, fp );
-	fclose( fp );
+	sock_close( si, fp );
 
 	return( rc );
 }
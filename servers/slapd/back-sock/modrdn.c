@@ -55,7 +55,7 @@ sock_back_modrdn(
 		return -1;
 	}
 
-	if ( (fp = opensock( si->si_sockpath )) == NULL ) {
+	if ( (fp = sock_open( si )) == NULL ) {
 		send_ldap_error( op, rs, LDAP_OTHER,
 		    "could not open socket" );
 		return( -1 );
@@ -76,6 +76,6 @@ sock_back_modrdn(
 
 	/* read in the results and send them along */
 	sock_read_and_send_results( op, rs, fp );
-	fclose( fp );
+	sock_close( si, fp );
 	return( 0 );
 }
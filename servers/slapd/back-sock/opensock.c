@@ -69,3 +69,100 @@ opensock(
 
 	return( fp );
 }
+
+/*
+ * With socketpool set, connections are kept open once a request has
+ * been answered, and reused by the following requests, so that the
+ * listener is not connected to (and does not fork or spawn a thread)
+ * for each operation.  Each connection carries one request at a time;
+ * concurrent operations use different connections.
+ */
+
+/* a pooled connection is unusable if the peer closed it, or if
+ * it sent something while no request was pending */
+static int
+sock_idle_ok( int fd )
+{
+#ifdef MSG_DONTWAIT
+	char	c;
+
+	if ( recv( fd, &c, 1, MSG_PEEK|MSG_DONTWAIT ) >= 0 )
+		return 0;
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#else
+	return 1;
+#endif
+}
+
+FILE *
+sock_open(
+    struct sockinfo	*si
+)
+{
+	FILE	*fp;
+	int	fd;
+
+	while ( si->si_poolmax > 0 ) {
+		ldap_pvt_thread_mutex_lock( &si->si_mutex );
+		fd = si->si_npool > 0 ? si->si_pool[--si->si_npool] : -1;
+		ldap_pvt_thread_mutex_unlock( &si->si_mutex );
+		if ( fd < 0 )
+			break;
+
+		if ( sock_idle_ok( fd ) && ( fp = fdopen( fd, "r+" ) ) != NULL )
+			return( fp );
+		close( fd );
+	}
+
+	return( opensock( si->si_sockpath ) );
+}
+
+/*
+ * The response has been read completely unless the stream hit EOF
+ * or an error; only then can the connection carry another request.
+ */
+void
+sock_close(
+    struct sockinfo	*si,
+    FILE		*fp
+)
+{
+	int	fd = -1;
+
+	if ( si->si_poolmax > 0 && fflush( fp ) == 0 &&
+		!feof( fp ) && !ferror( fp ) )
+	{
+		fd = dup( fileno( fp ) );
+	}
+	fclose( fp );
+
+	if ( fd < 0 )
+		return;
+
+	ldap_pvt_thread_mutex_lock( &si->si_mutex );
+	if ( si->si_npool < si->si_poolmax ) {
+		if ( si->si_npool == si->si_poolsize ) {
+			si->si_poolsize = si->si_poolmax;
+			si->si_pool = ch_realloc( si->si_pool,
+				si->si_poolsize * sizeof( int ) );
+		}
+		si->si_pool[si->si_npool++] = fd;
+		fd = -1;
+	}
+	ldap_pvt_thread_mutex_unlock( &si->si_mutex );
+
+	if ( fd >= 0 )
+		close( fd );
+}
+
+void
+sock_pool_free(
+    struct sockinfo	*si
+)
+{
+	while ( si->si_npool > 0 )
+		close( si->si_pool[--si->si_npool] );
+	ch_free( si->si_pool );
+	si->si_pool = NULL;
+	si->si_poolsize = 0;
+}
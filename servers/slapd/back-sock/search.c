@@ -41,7 +41,7 @@ sock_back_search(
 	FILE			*fp;
 	AttributeName		*an;
 
-	if ( (fp = opensock( si->si_sockpath )) == NULL ) {
+	if ( (fp = sock_open( si )) == NULL ) {
 		send_ldap_error( op, rs, LDAP_OTHER,
 		    "could not open socket" );
 		return( -1 );
@@ -69,6 +69,6 @@ sock_back_search(
 	rs->sr_attrs = op->oq_search.rs_attrs;
 	sock_read_and_send_results( op, rs, fp );
 
-	fclose( fp );
+	sock_close( si, fp );
 	return( 0 );
 }
@@ -52,6 +52,54 @@ slap_bi_head backendInfo = LDAP_STAILQ_HEAD_INITIALIZER(backendInfo);
 int			nBackendDB = 0; 
 slap_be_head backendDB = LDAP_STAILQ_HEAD_INITIALIZER(backendDB);
 
+/* Server-wide cache of fe_acl_group() results, shared by all
+ * operations. Entries expire after group_cache_ttl seconds, and
+ * every committed write anywhere in the server bumps a generation
+ * number that invalidates all of them. The per-operation o_groups
+ * list is still consulted first.
+ */
+int group_cache_size = 0;
+int group_cache_ttl = 60;
+
+typedef struct GroupCacheEntry {
+	struct GroupCacheEntry *gc_next;
+	BackendDB *gc_be;
+	ObjectClass *gc_oc;
+	AttributeDescription *gc_at;
+	unsigned long gc_gen;
+	time_t gc_time;
+	unsigned gc_hash;
+	int gc_res;
+	ber_len_t gc_glen;
+	ber_len_t gc_mlen;
+	char gc_ndn[1];		/* group ndn, NUL, member ndn, NUL */
+} GroupCacheEntry;
+
+static ldap_pvt_thread_mutex_t group_cache_mutex;
+static GroupCacheEntry **group_cache_hash;
+static GroupCacheEntry **group_cache_ring;
+static unsigned group_cache_mask;
+static int group_cache_slots, group_cache_next;
+static unsigned long group_cache_gen;
+
+static void
+group_cache_free( void )
+{
+	int i;
+
+	if ( group_cache_ring ) {
+		for ( i = 0; i < group_cache_slots; i++ ) {
+			ch_free( group_cache_ring[i] );
+		}
+		ch_free( group_cache_ring );
+		ch_free( group_cache_hash );
+	}
+	group_cache_ring = NULL;
+	group_cache_hash = NULL;
+	group_cache_slots = 0;
+	group_cache_next = 0;
+}
+
 static int
 backend_init_controls( BackendInfo *bi )
 {
@@ -119,6 +167,8 @@ int backend_init(void)
 	/* HACK: need schema defined in deterministic order */
 	syncrepl_monitor_init();
 
+	ldap_pvt_thread_mutex_init( &group_cache_mutex );
+
 
 	if ( nBackendInfo > 0) {
 		return 0;
@@ -196,14 +246,22 @@ backend_set_controls( BackendDB *be )
 /* startup a specific backend database */
 int backend_startup_one(Backend *be, ConfigReply *cr)
 {
-	int		rc = 0;
+	int		rc = 0, i;
+	struct timeval	start;
 
 	assert( be != NULL );
 
-	be->be_pending_csn_list = (struct be_pcl *)
-		ch_calloc( 1, sizeof( struct be_pcl ) );
+	if ( !be->be_pending_csn_list ) {
+		be->be_pending_csn_list = (struct be_pcl *)
+			ch_calloc( 1, sizeof( struct be_pcl ) );
 
-	LDAP_TAILQ_INIT( be->be_pending_csn_list );
+		for ( i = 0; i < SLAP_PCL_PARTS; i++ ) {
+			struct be_pcl_part *pp = &be->be_pending_csn_list->pcl_parts[i];
+
+			LDAP_TAILQ_INIT( &pp->pp_list );
+			ldap_pvt_thread_mutex_init( &pp->pp_mutex );
+		}
+	}
 
 	Debug( LDAP_DEBUG_TRACE,
 		"backend_startup_one: starting \"%s\"\n",
@@ -224,9 +282,14 @@ int backend_startup_one(Backend *be, ConfigReply *cr)
 #endif
 
 	if ( be->bd_info->bi_db_open ) {
+		gettimeofday( &start, NULL );
 		rc = be->bd_info->bi_db_open( be, cr );
 		if ( rc == 0 ) {
 			(void)backend_set_controls( be );
+			Debug( LDAP_DEBUG_STATS,
+				"backend_startup_one: opened \"%s\" in %lu ms\n",
+				be->be_suffix ? be->be_suffix[0].bv_val : "(unknown)",
+				slap_histo_since( &start ) / 1000 );
 
 		} else {
 			char *type = be->bd_info->bi_type;
@@ -431,16 +494,20 @@ backend_stopdown_one( BackendDB *bd )
 {
 	if ( bd->be_pending_csn_list ) {
 		struct slap_csn_entry *csne;
-		csne = LDAP_TAILQ_FIRST( bd->be_pending_csn_list );
-		while ( csne ) {
-			struct slap_csn_entry *tmp_csne = csne;
+		int i;
+
+		for ( i = 0; i < SLAP_PCL_PARTS; i++ ) {
+			struct be_pcl_part *pp = &bd->be_pending_csn_list->pcl_parts[i];
 
-			LDAP_TAILQ_REMOVE( bd->be_pending_csn_list, csne, ce_csn_link );
-			ch_free( csne->ce_csn.bv_val );
-			csne = LDAP_TAILQ_NEXT( csne, ce_csn_link );
-			ch_free( tmp_csne );
+			while (( csne = LDAP_TAILQ_FIRST( &pp->pp_list ))) {
+				LDAP_TAILQ_REMOVE( &pp->pp_list, csne, ce_csn_link );
+				ch_free( csne->ce_csn.bv_val );
+				ch_free( csne );
+			}
+			ldap_pvt_thread_mutex_destroy( &pp->pp_mutex );
 		}
 		ch_free( bd->be_pending_csn_list );
+		bd->be_pending_csn_list = NULL;
 	}
 
 	if ( bd->bd_info->bi_db_destroy ) {
@@ -450,6 +517,10 @@ backend_stopdown_one( BackendDB *bd )
 
 void backend_destroy_one( BackendDB *bd, int dynamic )
 {
+	/* cached group and authz results refer to the database */
+	group_cache_bump();
+	authz_cache_bump();
+
 	if ( dynamic ) {
 		LDAP_STAILQ_REMOVE(&backendDB, bd, BackendDB, be_next );
 	}
@@ -482,8 +553,10 @@ void backend_destroy_one( BackendDB *bd, int dynamic )
 	if ( bd->be_update_refs ) {
 		ber_bvarray_free( bd->be_update_refs );
 	}
-
-	ldap_pvt_thread_mutex_destroy( &bd->be_pcl_mutex );
+	if ( bd->be_histo ) {
+		ch_free( bd->be_histo );
+		bd->be_histo = NULL;
+	}
 
 	if ( dynamic ) {
 		free( bd );
@@ -510,6 +583,9 @@ int backend_destroy(void)
 	nBackendInfo = 0;
 	LDAP_STAILQ_INIT(&backendInfo);
 
+	group_cache_free();
+	ldap_pvt_thread_mutex_destroy( &group_cache_mutex );
+
 	/* destroy frontend database */
 	bd = frontendDB;
 	if ( bd ) {
@@ -528,6 +604,9 @@ int backend_destroy(void)
 			free( bd->be_rootpw.bv_val );
 		}
 		acl_destroy( bd->be_acl );
+		if ( bd->be_histo ) {
+			ch_free( bd->be_histo );
+		}
 		frontendDB = NULL;
 	}
 
@@ -620,8 +699,6 @@ backend_db_init(
 	be->be_requires = frontendDB->be_requires;
 	be->be_ssf_set = frontendDB->be_ssf_set;
 
-	ldap_pvt_thread_mutex_init( &be->be_pcl_mutex );
-
  	/* assign a default depth limit for alias deref */
 	be->be_max_deref_depth = SLAPD_DEFAULT_MAXDEREFDEPTH; 
 
@@ -634,7 +711,6 @@ backend_db_init(
 		/* If we created and linked this be, remove it and free it */
 		if ( !b0 ) {
 			LDAP_STAILQ_REMOVE(&backendDB, be, BackendDB, be_next);
-			ldap_pvt_thread_mutex_destroy( &be->be_pcl_mutex );
 			ch_free( be );
 			be = NULL;
 			nbackends--;
@@ -856,7 +932,9 @@ be_rootdn_bind( Operation *op, SlapReply *rs )
 		op->o_conn->c_sasl_authctx, 0, &old_authctx, NULL );
 #endif
 
-	rc = lutil_passwd( &op->o_bd->be_rootpw, &op->orb_cred, NULL, NULL );
+	rc = slap_passwd_offloaded( op, &op->o_bd->be_rootpw, &op->orb_cred );
+	if ( rc < 0 )
+		rc = lutil_passwd( &op->o_bd->be_rootpw, &op->orb_cred, NULL, NULL );
 
 #ifdef SLAPD_SPASSWD
 	ldap_pvt_thread_pool_setkey( op->o_threadctx, (void *)slap_sasl_bind,
@@ -1441,6 +1519,168 @@ be_entry_get_rw(
 	return LDAP_UNWILLING_TO_PERFORM;
 }
 
+/* (Re)size the cache; called by the config code */
+void
+group_cache_resize( int size )
+{
+	unsigned n;
+
+	ldap_pvt_thread_mutex_lock( &group_cache_mutex );
+	group_cache_free();
+	group_cache_size = size;
+	if ( size > 0 ) {
+		for ( n = 16; n < (unsigned)size; n <<= 1 )
+			;
+		group_cache_mask = n - 1;
+		group_cache_hash = ch_calloc( n, sizeof( GroupCacheEntry * ) );
+		group_cache_ring = ch_calloc( size, sizeof( GroupCacheEntry * ) );
+		group_cache_slots = size;
+	}
+	/* writes made while the cache was off did not bump */
+	group_cache_gen++;
+	ldap_pvt_thread_mutex_unlock( &group_cache_mutex );
+}
+
+/* Invalidate all cached results; called whenever a write commits,
+ * and only once it is visible to readers.
+ */
+void
+group_cache_bump( void )
+{
+	if ( !group_cache_size )
+		return;
+	ldap_pvt_thread_mutex_lock( &group_cache_mutex );
+	group_cache_gen++;
+	ldap_pvt_thread_mutex_unlock( &group_cache_mutex );
+}
+
+/* The generation an operation starts under. Its reads may come from
+ * a snapshot taken before a write that commits later, so its results
+ * are only cached if no write was committed since the operation began.
+ */
+unsigned long
+group_cache_generation( void )
+{
+	unsigned long gen;
+
+	if ( !group_cache_size )
+		return 0;
+	ldap_pvt_thread_mutex_lock( &group_cache_mutex );
+	gen = group_cache_gen;
+	ldap_pvt_thread_mutex_unlock( &group_cache_mutex );
+	return gen;
+}
+
+static unsigned
+group_cache_hashof( BackendDB *be, struct berval *gr, struct berval *mem,
+	AttributeDescription *at )
+{
+	unsigned h = (unsigned)( (unsigned long)be >> 4 ) ^
+		(unsigned)( (unsigned long)at >> 4 );
+	ber_len_t i;
+
+	for ( i = 0; i < gr->bv_len; i++ )
+		h = h * 31 + (unsigned char)gr->bv_val[i];
+	for ( i = 0; i < mem->bv_len; i++ )
+		h = h * 31 + (unsigned char)mem->bv_val[i];
+	return h;
+}
+
+static GroupCacheEntry *
+group_cache_find( unsigned h, BackendDB *be, struct berval *gr,
+	struct berval *mem, ObjectClass *oc, AttributeDescription *at )
+{
+	GroupCacheEntry *gc;
+
+	for ( gc = group_cache_hash[h & group_cache_mask]; gc; gc = gc->gc_next ) {
+		if ( gc->gc_hash == h && gc->gc_be == be && gc->gc_oc == oc &&
+			gc->gc_at == at && gc->gc_glen == gr->bv_len &&
+			gc->gc_mlen == mem->bv_len &&
+			!memcmp( gc->gc_ndn, gr->bv_val, gr->bv_len ) &&
+			!memcmp( gc->gc_ndn + gr->bv_len + 1, mem->bv_val, mem->bv_len ))
+			break;
+	}
+	return gc;
+}
+
+static int
+group_cache_get( BackendDB *be, struct berval *gr, struct berval *mem,
+	ObjectClass *oc, AttributeDescription *at, int *res )
+{
+	GroupCacheEntry *gc;
+	unsigned h;
+	int rc = 0;
+
+	if ( !group_cache_size )
+		return 0;
+
+	h = group_cache_hashof( be, gr, mem, at );
+	ldap_pvt_thread_mutex_lock( &group_cache_mutex );
+	if ( group_cache_hash ) {
+		gc = group_cache_find( h, be, gr, mem, oc, at );
+		if ( gc && gc->gc_gen == group_cache_gen &&
+			slap_get_time() - gc->gc_time < group_cache_ttl )
+		{
+			*res = gc->gc_res;
+			rc = 1;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &group_cache_mutex );
+	return rc;
+}
+
+static void
+group_cache_put( BackendDB *be, struct berval *gr, struct berval *mem,
+	ObjectClass *oc, AttributeDescription *at, int res, unsigned long gen )
+{
+	GroupCacheEntry *gc, **gp;
+	unsigned h;
+
+	if ( !group_cache_size )
+		return;
+
+	h = group_cache_hashof( be, gr, mem, at );
+	ldap_pvt_thread_mutex_lock( &group_cache_mutex );
+	/* a write committed since the operation began */
+	if ( !group_cache_hash || gen != group_cache_gen )
+		goto done;
+
+	gc = group_cache_find( h, be, gr, mem, oc, at );
+	if ( !gc ) {
+		/* evict the oldest entry and reuse its ring slot */
+		gc = group_cache_ring[group_cache_next];
+		if ( gc ) {
+			for ( gp = &group_cache_hash[gc->gc_hash & group_cache_mask];
+				*gp != gc; gp = &(*gp)->gc_next )
+				;
+			*gp = gc->gc_next;
+			ch_free( gc );
+		}
+		gc = ch_malloc( sizeof( GroupCacheEntry ) + gr->bv_len + mem->bv_len + 1 );
+		gc->gc_hash = h;
+		gc->gc_be = be;
+		gc->gc_oc = oc;
+		gc->gc_at = at;
+		gc->gc_glen = gr->bv_len;
+		gc->gc_mlen = mem->bv_len;
+		AC_MEMCPY( gc->gc_ndn, gr->bv_val, gr->bv_len );
+		gc->gc_ndn[gr->bv_len] = '\0';
+		AC_MEMCPY( gc->gc_ndn + gr->bv_len + 1, mem->bv_val, mem->bv_len );
+		gc->gc_ndn[gr->bv_len + 1 + mem->bv_len] = '\0';
+		gp = &group_cache_hash[h & group_cache_mask];
+		gc->gc_next = *gp;
+		*gp = gc;
+		group_cache_ring[group_cache_next++] = gc;
+		if ( group_cache_next == group_cache_slots )
+			group_cache_next = 0;
+	}
+	gc->gc_res = res;
+	gc->gc_gen = gen;
+	gc->gc_time = slap_get_time();
+done:
+	ldap_pvt_thread_mutex_unlock( &group_cache_mutex );
+}
+
 int 
 fe_acl_group(
 	Operation *op,
@@ -1453,7 +1693,7 @@ fe_acl_group(
 	Entry *e;
 	void *o_priv = op->o_private, *e_priv = NULL;
 	Attribute *a;
-	int rc;
+	int rc, shared;
 	GroupAssertion *g;
 	Backend *be = op->o_bd;
 	OpExtra		*oex;
@@ -1485,15 +1725,26 @@ fe_acl_group(
 		goto done;
 	}
 
+	shared = op->o_tag != LDAP_REQ_BIND && !op->o_do_not_cache;
+	if ( shared && group_cache_get( op->o_bd, gr_ndn, op_ndn,
+		group_oc, group_at, &rc ) )
+	{
+		goto cached;
+	}
+
 	if ( target && dn_match( &target->e_nname, gr_ndn ) ) {
+		/* may not be what is committed, don't share the result */
 		e = target;
 		rc = 0;
+		shared = 0;
 
 	} else {
 		op->o_private = NULL;
 		rc = be_entry_get_rw( op, gr_ndn, group_oc, group_at, 0, &e );
 		e_priv = op->o_private;
 		op->o_private = o_priv;
+		if ( rc != LDAP_SUCCESS && rc != LDAP_NO_SUCH_OBJECT )
+			shared = 0;
 	}
 
 	if ( e ) {
@@ -1515,6 +1766,7 @@ fe_acl_group(
 
 				if ( target && dn_match( &target->e_nname, op_ndn ) ) {
 					user = target;
+					shared = 0;
 				}
 				
 				rc = LDAP_COMPARE_FALSE;
@@ -1645,6 +1897,12 @@ loopit:
 		rc = LDAP_NO_SUCH_OBJECT;
 	}
 
+	if ( shared && rc != LDAP_OTHER ) {
+		group_cache_put( op->o_bd, gr_ndn, op_ndn, group_oc, group_at,
+			rc, op->o_groupgen );
+	}
+
+cached:
 	if ( op->o_tag != LDAP_REQ_BIND && !op->o_do_not_cache ) {
 		g = op->o_tmpalloc( sizeof( GroupAssertion ) + gr_ndn->bv_len,
 			op->o_tmpmemctx );
@@ -377,6 +377,533 @@ glue_sub_search( Operation *op, SlapReply *rs, BackendDB *b0,
 	return op->o_bd->be_search( op, rs );
 }
 
+/* Whether a search of ndn with the given scope needs the glued
+ * database be, pdn being the DN of its parent in the glued tree.
+ */
+static int
+glue_sub_wanted( BackendDB *be, BackendDB *b1, struct berval *pdn,
+	int scope, struct berval *ndn )
+{
+	if ( !be || !be->be_search )
+		return 0;
+	if ( !dnIsSuffix( &be->be_nsuffix[0], &b1->be_nsuffix[0] ))
+		return 0;
+	if ( scope == LDAP_SCOPE_ONELEVEL && dn_match( pdn, ndn ))
+		return 1;
+	if ( scope == LDAP_SCOPE_SUBTREE && dnIsSuffix( &be->be_nsuffix[0], ndn ))
+		return 1;
+	return dnIsSuffix( ndn, &be->be_nsuffix[0] );
+}
+
+/* Search op->o_bd, rebasing the search at its suffix when the base
+ * is above it. Sets *nsok if noSuchObject from it is not an error.
+ */
+static int
+glue_sub_dispatch( Operation *op, SlapReply *rs, BackendDB *b0,
+	slap_overinst *on, struct berval *pdn, int scope0,
+	struct berval *dn, struct berval *ndn, int *nsok )
+{
+	struct berval mdn, mndn;
+	int rc = 0;
+
+	*nsok = 0;
+	if ( scope0 == LDAP_SCOPE_ONELEVEL && dn_match( pdn, ndn )) {
+		op->ors_scope = LDAP_SCOPE_BASE;
+		mdn = op->o_req_dn = op->o_bd->be_suffix[0];
+		mndn = op->o_req_ndn = op->o_bd->be_nsuffix[0];
+		rc = op->o_bd->be_search( op, rs );
+		*nsok = 1;
+		op->ors_scope = LDAP_SCOPE_ONELEVEL;
+		if ( op->o_req_dn.bv_val == mdn.bv_val )
+			op->o_req_dn = *dn;
+		if ( op->o_req_ndn.bv_val == mndn.bv_val )
+			op->o_req_ndn = *ndn;
+
+	} else if ( scope0 == LDAP_SCOPE_SUBTREE &&
+		dn_match( &op->o_bd->be_nsuffix[0], ndn ))
+	{
+		rc = glue_sub_search( op, rs, b0, on );
+
+	} else if ( scope0 == LDAP_SCOPE_SUBTREE &&
+		dnIsSuffix( &op->o_bd->be_nsuffix[0], ndn ))
+	{
+		mdn = op->o_req_dn = op->o_bd->be_suffix[0];
+		mndn = op->o_req_ndn = op->o_bd->be_nsuffix[0];
+		rc = glue_sub_search( op, rs, b0, on );
+		*nsok = 1;
+		if ( op->o_req_dn.bv_val == mdn.bv_val )
+			op->o_req_dn = *dn;
+		if ( op->o_req_ndn.bv_val == mndn.bv_val )
+			op->o_req_ndn = *ndn;
+
+	} else if ( dnIsSuffix( ndn, &op->o_bd->be_nsuffix[0] )) {
+		rc = glue_sub_search( op, rs, b0, on );
+	}
+	return rc;
+}
+
+/* Parallel search of the subordinates. Each one is searched by a
+ * pool thread with its own copy of the operation, and whatever it
+ * returns is copied and queued. The thread of the operation sends
+ * all of it, so the overlays above glue, the size limit and the
+ * result merging see the same stream of responses as when the
+ * databases are searched one after the other, only interleaved.
+ * Meanwhile it searches the primary database itself, and any
+ * subordinate that no pool thread got around to.
+ *
+ * Paged results keep the sequential search, their cookie says
+ * which database to carry on from.
+ */
+
+#define GLUE_PAR_TASKS	8	/* pool threads per search */
+#define GLUE_PAR_QUEUE	128	/* responses queued for sending */
+
+typedef struct glue_item {
+	struct glue_item *gm_next;
+	slap_reply_t gm_type;
+	int gm_node;
+	Entry *gm_entry;
+	BerVarray gm_ref;
+
+	/* REP_RESULT: the database is done */
+	int gm_rc;
+	int gm_nsok;
+	int gm_gotres;
+	int gm_err;
+	char *gm_matched;
+	LDAPControl **gm_ctrls;
+} glue_item;
+
+typedef struct glue_par {
+	ldap_pvt_thread_mutex_t gp_mutex;
+	ldap_pvt_thread_cond_t gp_cond;	/* for the sender */
+	ldap_pvt_thread_cond_t gp_room;	/* for the searchers */
+	glue_item *gp_head, **gp_tail;
+	int gp_nitems;
+	int gp_running;
+	int gp_abort;
+	int gp_refs;
+
+	Operation *gp_orig;
+	OperationBuffer gp_opbuf;	/* template for the searchers */
+	glueinfo *gp_gi;
+	slap_overinst *gp_on;
+	BackendDB *gp_b0;
+	struct berval gp_dn, gp_ndn;
+	int gp_scope;
+	int gp_tlimit;
+	long gp_stoptime;
+
+	int gp_next;
+	int gp_ntodo;
+	int gp_todo[1];
+} glue_par;
+
+typedef struct glue_worker {
+	glue_par *gw_par;
+	glue_item *gw_res;
+} glue_worker;
+
+static void
+glue_item_free( glue_item *gm )
+{
+	if ( gm->gm_entry )
+		entry_free( gm->gm_entry );
+	if ( gm->gm_ref )
+		ber_bvarray_free( gm->gm_ref );
+	if ( gm->gm_matched )
+		ch_free( gm->gm_matched );
+	if ( gm->gm_ctrls )
+		ldap_controls_free( gm->gm_ctrls );
+	ch_free( gm );
+}
+
+/* called with gp_mutex held, releases it */
+static void
+glue_par_release( glue_par *gp )
+{
+	int refs = --gp->gp_refs;
+
+	ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+	if ( !refs ) {
+		ldap_pvt_thread_cond_destroy( &gp->gp_room );
+		ldap_pvt_thread_cond_destroy( &gp->gp_cond );
+		ldap_pvt_thread_mutex_destroy( &gp->gp_mutex );
+		ch_free( gp );
+	}
+}
+
+/* called with gp_mutex held */
+static void
+glue_par_stop( glue_par *gp )
+{
+	gp->gp_abort = 1;
+	ldap_pvt_thread_cond_broadcast( &gp->gp_room );
+}
+
+/* Stands in for the client on a searcher's operation */
+static int
+glue_par_response( Operation *op, SlapReply *rs )
+{
+	glue_worker *gw = op->o_callback->sc_private;
+	glue_par *gp = gw->gw_par;
+	glue_item *gm;
+
+	switch ( rs->sr_type ) {
+	case REP_SEARCH:
+	case REP_SEARCHREF:
+		if ( gp->gp_orig->o_abandon ) {
+			op->o_abandon = 1;
+			return 0;
+		}
+		gm = ch_calloc( 1, sizeof(glue_item) );
+		gm->gm_type = rs->sr_type;
+		gm->gm_node = gw->gw_res->gm_node;
+		if ( rs->sr_entry )
+			gm->gm_entry = entry_dup( rs->sr_entry );
+		if ( rs->sr_type == REP_SEARCHREF && rs->sr_ref )
+			ber_bvarray_dup_x( &gm->gm_ref, rs->sr_ref, NULL );
+
+		ldap_pvt_thread_mutex_lock( &gp->gp_mutex );
+		while ( gp->gp_nitems >= GLUE_PAR_QUEUE && !gp->gp_abort )
+			ldap_pvt_thread_cond_wait( &gp->gp_room, &gp->gp_mutex );
+		if ( gp->gp_abort ) {
+			ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+			glue_item_free( gm );
+			op->o_abandon = 1;
+			return 0;
+		}
+		*gp->gp_tail = gm;
+		gp->gp_tail = &gm->gm_next;
+		gp->gp_nitems++;
+		ldap_pvt_thread_cond_signal( &gp->gp_cond );
+		ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+		return 0;
+
+	case REP_RESULT:
+		gm = gw->gw_res;
+		gm->gm_gotres = 1;
+		gm->gm_err = rs->sr_err;
+		if ( rs->sr_matched )
+			gm->gm_matched = ch_strdup( rs->sr_matched );
+		if ( rs->sr_ref )
+			ber_bvarray_dup_x( &gm->gm_ref, rs->sr_ref, NULL );
+		if ( rs->sr_ctrls )
+			gm->gm_ctrls = ldap_controls_dup( rs->sr_ctrls );
+		return 0;
+
+	default:
+		return 0;
+	}
+}
+
+/* Search the i-th subordinate on behalf of gp->gp_orig */
+static glue_item *
+glue_par_run( void *ctx, glue_par *gp, int i )
+{
+	OperationBuffer opbuf;
+	Operation *op = &opbuf.ob_op;
+	SlapReply rs = { REP_RESULT };
+	slap_callback cb = { NULL, glue_par_response, NULL, NULL };
+	glue_worker gw;
+	glue_item *res;
+
+	res = ch_calloc( 1, sizeof(glue_item) );
+	res->gm_type = REP_RESULT;
+	res->gm_node = i;
+	gw.gw_par = gp;
+	gw.gw_res = res;
+
+	*op = gp->gp_opbuf.ob_op;
+	op->o_hdr = &opbuf.ob_hdr;
+	*op->o_hdr = gp->gp_opbuf.ob_hdr;
+	op->o_controls = opbuf.ob_controls;
+	AC_MEMCPY( op->o_controls, gp->gp_opbuf.ob_controls,
+		sizeof(opbuf.ob_controls) );
+	op->o_threadctx = ctx;
+	op->o_tmpmemctx = slap_sl_mem_create( SLAP_SLAB_SIZE, SLAP_SLAB_STACK,
+		ctx, 1 );
+	op->o_tmpmfuncs = &slap_sl_mfuncs;
+	LDAP_SLIST_INIT( &op->o_extra );
+	cb.sc_private = &gw;
+	op->o_callback = &cb;
+	op->o_bd = gp->gp_gi->gi_n[i].gn_be;
+
+	if ( gp->gp_tlimit != SLAP_NO_LIMIT ) {
+		op->o_time = slap_get_time();
+		op->ors_tlimit = gp->gp_stoptime - op->o_time;
+		if ( op->ors_tlimit <= 0 ) {
+			res->gm_gotres = 1;
+			res->gm_err = LDAP_TIMELIMIT_EXCEEDED;
+			return res;
+		}
+	}
+
+	res->gm_rc = glue_sub_dispatch( op, &rs, gp->gp_b0, gp->gp_on,
+		&gp->gp_gi->gi_n[i].gn_pdn, gp->gp_scope, &gp->gp_dn, &gp->gp_ndn,
+		&res->gm_nsok );
+	return res;
+}
+
+static void *
+glue_par_task( void *ctx, void *arg )
+{
+	glue_par *gp = arg;
+	glue_item *res;
+	int i;
+
+	ldap_pvt_thread_mutex_lock( &gp->gp_mutex );
+	while ( !gp->gp_abort && gp->gp_next < gp->gp_ntodo ) {
+		i = gp->gp_todo[gp->gp_next++];
+		gp->gp_running++;
+		ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+
+		res = glue_par_run( ctx, gp, i );
+
+		ldap_pvt_thread_mutex_lock( &gp->gp_mutex );
+		if ( gp->gp_abort ) {
+			glue_item_free( res );
+		} else {
+			*gp->gp_tail = res;
+			gp->gp_tail = &res->gm_next;
+			gp->gp_nitems++;
+		}
+		gp->gp_running--;
+		ldap_pvt_thread_cond_signal( &gp->gp_cond );
+	}
+	glue_par_release( gp );
+	return NULL;
+}
+
+static int
+glue_par_stop_err( int err )
+{
+	switch ( err ) {
+	case LDAP_SIZELIMIT_EXCEEDED:
+	case LDAP_TIMELIMIT_EXCEEDED:
+	case LDAP_ADMINLIMIT_EXCEEDED:
+	case LDAP_NO_SUCH_OBJECT:
+	case LDAP_BUSY:
+	case LDAP_OTHER:
+#ifdef LDAP_CONTROL_X_CHAINING_BEHAVIOR
+	case LDAP_X_CANNOT_CHAIN:
+#endif /* LDAP_CONTROL_X_CHAINING_BEHAVIOR */
+		return 1;
+	}
+	return 0;
+}
+
+/* Search a database in the thread of the operation, returns nonzero
+ * if the search must stop.
+ */
+static int
+glue_par_local( Operation *op, SlapReply *rs, glue_par *gp,
+	BackendDB *be, struct berval *pdn )
+{
+	glue_state *gs = op->o_callback->sc_private;
+	int nsok;
+
+	if ( gp->gp_tlimit != SLAP_NO_LIMIT ) {
+		op->o_time = slap_get_time();
+		op->ors_tlimit = gp->gp_stoptime - op->o_time;
+		if ( op->ors_tlimit <= 0 ) {
+			rs->sr_err = gs->err = LDAP_TIMELIMIT_EXCEEDED;
+			return 1;
+		}
+	}
+	rs->sr_err = 0;
+	op->o_bd = be;
+	rs->sr_err = glue_sub_dispatch( op, rs, gp->gp_b0, gp->gp_on, pdn,
+		gp->gp_scope, &gp->gp_dn, &gp->gp_ndn, &nsok );
+	if ( nsok && rs->sr_err == LDAP_NO_SUCH_OBJECT )
+		gs->err = LDAP_SUCCESS;
+
+	return op->o_abandon || glue_par_stop_err( gs->err );
+}
+
+/* Send what a searcher queued, returns nonzero if the search must stop */
+static int
+glue_par_play( Operation *op, SlapReply *rs, glue_par *gp, glue_item *gm )
+{
+	glue_state *gs = op->o_callback->sc_private;
+	BackendDB *be = gp->gp_gi->gi_n[gm->gm_node].gn_be;
+	int rc = 0;
+
+	/* look as if the database itself was sending */
+	op->o_bd = be;
+	if ( !dnIsSuffix( &gp->gp_ndn, &be->be_nsuffix[0] )) {
+		op->o_req_dn = be->be_suffix[0];
+		op->o_req_ndn = be->be_nsuffix[0];
+	}
+
+	switch ( gm->gm_type ) {
+	case REP_SEARCH:
+		rs->sr_entry = gm->gm_entry;
+		gm->gm_entry = NULL;
+		rs->sr_flags = REP_ENTRY_MODIFIABLE | REP_ENTRY_MUSTBEFREED;
+		rs->sr_attrs = op->ors_attrs;
+		rs->sr_operational_attrs = NULL;
+		rs->sr_err = send_search_entry( op, rs );
+		rs_flush_entry( op, rs, NULL );
+		rs->sr_attrs = NULL;
+		switch ( rs->sr_err ) {
+		case LDAP_SIZELIMIT_EXCEEDED:
+		case LDAP_BUSY:
+			gs->err = rs->sr_err;
+			rc = 1;
+			break;
+		case LDAP_UNAVAILABLE:
+			gs->err = LDAP_OTHER;
+			rc = 1;
+			break;
+		}
+		break;
+
+	case REP_SEARCHREF:
+		rs->sr_entry = gm->gm_entry;
+		gm->gm_entry = NULL;
+		rs->sr_flags = rs->sr_entry ? REP_ENTRY_MUSTBEFREED : 0;
+		rs->sr_ref = gm->gm_ref;
+		send_search_reference( op, rs );
+		rs_flush_entry( op, rs, NULL );
+		rs->sr_ref = NULL;
+		break;
+
+	default:
+		if ( gm->gm_gotres ) {
+			SlapReply r = { REP_RESULT };
+
+			r.sr_err = gm->gm_err;
+			r.sr_matched = gm->gm_matched;
+			r.sr_ref = gm->gm_ref;
+			r.sr_ctrls = gm->gm_ctrls;
+			glue_op_response( op, &r );
+		}
+		if ( gm->gm_nsok && gm->gm_rc == LDAP_NO_SUCH_OBJECT )
+			gs->err = LDAP_SUCCESS;
+		rc = glue_par_stop_err( gs->err );
+		break;
+	}
+
+	op->o_req_dn = gp->gp_dn;
+	op->o_req_ndn = gp->gp_ndn;
+	glue_item_free( gm );
+	return rc || op->o_abandon;
+}
+
+/* Returns -1 if the subordinates must be searched one at a time */
+static int
+glue_par_search( Operation *op, SlapReply *rs, glueinfo *gi,
+	slap_overinst *on, BackendDB *b0, BackendDB *b1, long stoptime )
+{
+	glue_par *gp;
+	glue_item *gm;
+	int i, n = 0, stop = 0;
+
+	if ( get_pagedresults( op ) > SLAP_CONTROL_IGNORED ||
+		op->o_sync > SLAP_CONTROL_IGNORED ||
+		get_no_subordinate_glue( op ))
+		return -1;
+
+	for ( i = gi->gi_nodes - 1; i >= 0; i-- ) {
+		BackendDB *be = gi->gi_n[i].gn_be;
+
+		if ( !glue_sub_wanted( be, b1, &gi->gi_n[i].gn_pdn,
+			op->ors_scope, &op->o_req_ndn ))
+			continue;
+		/* nested glue switches bd_info around while it searches */
+		if ( SLAP_GLUE_INSTANCE( be ))
+			return -1;
+		n++;
+	}
+	if ( !n || ( n == 1 && !glue_sub_wanted( b0, b1, &gi->gi_pdn,
+		op->ors_scope, &op->o_req_ndn )))
+		return -1;
+
+	gp = ch_calloc( 1, sizeof(glue_par) + ( n - 1 ) * sizeof(int) );
+	for ( i = gi->gi_nodes - 1; i >= 0; i-- ) {
+		if ( glue_sub_wanted( gi->gi_n[i].gn_be, b1, &gi->gi_n[i].gn_pdn,
+			op->ors_scope, &op->o_req_ndn ))
+			gp->gp_todo[gp->gp_ntodo++] = i;
+	}
+	ldap_pvt_thread_mutex_init( &gp->gp_mutex );
+	ldap_pvt_thread_cond_init( &gp->gp_cond );
+	ldap_pvt_thread_cond_init( &gp->gp_room );
+	gp->gp_tail = &gp->gp_head;
+	gp->gp_refs = 1;
+	gp->gp_orig = op;
+	gp->gp_opbuf.ob_op = *op;
+	gp->gp_opbuf.ob_hdr = *op->o_hdr;
+	gp->gp_opbuf.ob_op.o_hdr = &gp->gp_opbuf.ob_hdr;
+	AC_MEMCPY( gp->gp_opbuf.ob_controls, op->o_controls,
+		sizeof(gp->gp_opbuf.ob_controls) );
+	gp->gp_opbuf.ob_op.o_controls = gp->gp_opbuf.ob_controls;
+	gp->gp_gi = gi;
+	gp->gp_on = on;
+	gp->gp_b0 = b0;
+	gp->gp_dn = op->o_req_dn;
+	gp->gp_ndn = op->o_req_ndn;
+	gp->gp_scope = op->ors_scope;
+	gp->gp_tlimit = op->ors_tlimit;
+	gp->gp_stoptime = stoptime;
+
+	ldap_pvt_thread_mutex_lock( &gp->gp_mutex );
+	for ( i = 0; i < n && i < GLUE_PAR_TASKS; i++ ) {
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+			glue_par_task, gp ))
+			break;
+		gp->gp_refs++;
+	}
+	ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+
+	if ( glue_sub_wanted( b0, b1, &gi->gi_pdn, gp->gp_scope, &gp->gp_ndn ))
+		stop = glue_par_local( op, rs, gp, b0, &gi->gi_pdn );
+
+	ldap_pvt_thread_mutex_lock( &gp->gp_mutex );
+	if ( stop )
+		glue_par_stop( gp );
+	for (;;) {
+		if (( gm = gp->gp_head )) {
+			if ( !( gp->gp_head = gm->gm_next ))
+				gp->gp_tail = &gp->gp_head;
+			gp->gp_nitems--;
+			if ( gp->gp_abort ) {
+				glue_item_free( gm );
+				continue;
+			}
+			ldap_pvt_thread_cond_signal( &gp->gp_room );
+			ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+			stop = glue_par_play( op, rs, gp, gm );
+			ldap_pvt_thread_mutex_lock( &gp->gp_mutex );
+			if ( stop )
+				glue_par_stop( gp );
+			continue;
+		}
+		if ( !gp->gp_abort && gp->gp_next < gp->gp_ntodo &&
+			!gp->gp_running )
+		{
+			/* no pool thread to be had, do it here */
+			i = gp->gp_todo[gp->gp_next++];
+			ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+			stop = glue_par_local( op, rs, gp, gi->gi_n[i].gn_be,
+				&gi->gi_n[i].gn_pdn );
+			ldap_pvt_thread_mutex_lock( &gp->gp_mutex );
+			if ( stop )
+				glue_par_stop( gp );
+			continue;
+		}
+		if ( !gp->gp_running &&
+			( gp->gp_abort || gp->gp_next == gp->gp_ntodo ))
+			break;
+		ldap_pvt_thread_cond_wait( &gp->gp_cond, &gp->gp_mutex );
+	}
+	/* tasks that start from now on find nothing to do */
+	gp->gp_abort = 1;
+	glue_par_release( gp );
+
+	return 0;
+}
+
 static const ID glueID = NOID;
 static const struct berval gluecookie = { sizeof( glueID ), (char *)&glueID };
 
@@ -392,7 +919,7 @@ glue_op_search ( Operation *op, SlapReply *rs )
 	long stoptime = 0, starttime;
 	glue_state gs = {NULL, NULL, NULL, 0, 0, 0, 0};
 	slap_callback cb = { NULL, glue_op_response, glue_op_cleanup, NULL };
-	int scope0, tlimit0;
+	int scope0, tlimit0, nsok;
 	struct berval dn, ndn, *pdn;
 
 	cb.sc_private = &gs;
@@ -458,6 +985,9 @@ glue_op_search ( Operation *op, SlapReply *rs )
 		ndn = op->o_req_ndn;
 		b1 = op->o_bd;
 
+		if ( !glue_par_search( op, rs, gi, on, b0, b1, stoptime ))
+			goto end_of_loop;
+
 		/*
 		 * Execute in reverse order, most specific first 
 		 */
@@ -503,45 +1033,10 @@ glue_op_search ( Operation *op, SlapReply *rs )
 			assert( op->o_bd->be_suffix != NULL );
 			assert( op->o_bd->be_nsuffix != NULL );
 			
-			if (scope0 == LDAP_SCOPE_ONELEVEL && 
-				dn_match(pdn, &ndn))
-			{
-				struct berval mdn, mndn;
-				op->ors_scope = LDAP_SCOPE_BASE;
-				mdn = op->o_req_dn = op->o_bd->be_suffix[0];
-				mndn = op->o_req_ndn = op->o_bd->be_nsuffix[0];
-				rs->sr_err = op->o_bd->be_search(op, rs);
-				if ( rs->sr_err == LDAP_NO_SUCH_OBJECT ) {
-					gs.err = LDAP_SUCCESS;
-				}
-				op->ors_scope = LDAP_SCOPE_ONELEVEL;
-				if ( op->o_req_dn.bv_val == mdn.bv_val )
-					op->o_req_dn = dn;
-				if ( op->o_req_ndn.bv_val == mndn.bv_val )
-					op->o_req_ndn = ndn;
-
-			} else if (scope0 == LDAP_SCOPE_SUBTREE &&
-				dn_match(&op->o_bd->be_nsuffix[0], &ndn))
-			{
-				rs->sr_err = glue_sub_search( op, rs, b0, on );
-
-			} else if (scope0 == LDAP_SCOPE_SUBTREE &&
-				dnIsSuffix(&op->o_bd->be_nsuffix[0], &ndn))
-			{
-				struct berval mdn, mndn;
-				mdn = op->o_req_dn = op->o_bd->be_suffix[0];
-				mndn = op->o_req_ndn = op->o_bd->be_nsuffix[0];
-				rs->sr_err = glue_sub_search( op, rs, b0, on );
-				if ( rs->sr_err == LDAP_NO_SUCH_OBJECT ) {
-					gs.err = LDAP_SUCCESS;
-				}
-				if ( op->o_req_dn.bv_val == mdn.bv_val )
-					op->o_req_dn = dn;
-				if ( op->o_req_ndn.bv_val == mndn.bv_val )
-					op->o_req_ndn = ndn;
-
-			} else if (dnIsSuffix(&ndn, &op->o_bd->be_nsuffix[0])) {
-				rs->sr_err = glue_sub_search( op, rs, b0, on );
+			rs->sr_err = glue_sub_dispatch( op, rs, b0, on, pdn, scope0,
+				&dn, &ndn, &nsok );
+			if ( nsok && rs->sr_err == LDAP_NO_SUCH_OBJECT ) {
+				gs.err = LDAP_SUCCESS;
 			}
 
 			switch ( gs.err ) {
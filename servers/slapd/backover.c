@@ -1208,16 +1208,22 @@ overlay_remove_cb( Operation *op, SlapReply *rs )
 {
 	slap_callback *sc = op->o_callback;
 	ov_remove_ctx *rm_ctx = (ov_remove_ctx*) op->o_callback->sc_private;
+	int dopause = 1;
 
 	op->o_callback = sc->sc_next;
 	rm_ctx->be.bd_info = (BackendInfo*) rm_ctx->on;
 
+	/* close the overlay paused, as when deleting a database */
+	if ( slap_pause_server() < 0 )
+		dopause = 0;
 	if ( rm_ctx->on->on_bi.bi_db_close ) {
 		rm_ctx->on->on_bi.bi_db_close( &rm_ctx->be, NULL );
 	}
 	if ( rm_ctx->on->on_bi.bi_db_destroy ) {
 		rm_ctx->on->on_bi.bi_db_destroy( &rm_ctx->be, NULL );
 	}
+	if ( dopause )
+		slap_unpause_server();
 
 	/* clean up after removing last overlay */
 	if ( ! rm_ctx->on->on_info->oi_list ) {
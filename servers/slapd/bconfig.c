@@ -65,6 +65,9 @@ typedef struct ConfigFile {
 	ObjectClass *c_oc_head, *c_oc_tail;
 	OidMacro *c_om_head, *c_om_tail;
 	Syntax *c_syn_head, *c_syn_tail;
+	/* number of items in the lists above, so that
+	 * appending by index needn't walk them */
+	int c_at_count, c_oc_count, c_syn_count;
 	BerVarray c_dseFiles;
 } ConfigFile;
 
@@ -81,6 +84,17 @@ static CfBackInfo cfBackInfo;
 static char	*passwd_salt;
 static FILE *logfile;
 static char	*logfileName;
+
+static slap_verbmasks logbuffer_policies[] = {
+	{ BER_BVC("block"),	SLAP_LOG_BLOCK },
+	{ BER_BVC("drop"),	SLAP_LOG_DROP },
+	{ BER_BVNULL,	0 }
+};
+static slap_verbmasks index_hashes[] = {
+	{ BER_BVC("fnv"),	SLAP_IXHASH_FNV },
+	{ BER_BVC("wyhash"),	SLAP_IXHASH_WYHASH },
+	{ BER_BVNULL,	0 }
+};
 static AccessControl *defacl_parsed = NULL;
 
 static struct berval cfdir;
@@ -127,6 +141,8 @@ static ConfigDriver config_rootpw;
 static ConfigDriver config_restrict;
 static ConfigDriver config_allows;
 static ConfigDriver config_disallows;
+static ConfigDriver config_threadpriority;
+static ConfigDriver config_threadaffinity;
 static ConfigDriver config_requires;
 static ConfigDriver config_security;
 static ConfigDriver config_referral;
@@ -197,10 +213,29 @@ enum {
 	CFG_IX_HASH64,
 	CFG_DISABLED,
 	CFG_THREADQS,
+	CFG_THREADSTEAL,
+	CFG_THREADRESERVE,
+	CFG_THREADMIN,
+	CFG_THREADWAIT,
+	CFG_TLSTHREADS,
+	CFG_GROUPCACHE,
+	CFG_GROUPCACHETTL,
+	CFG_AZCACHE,
+	CFG_AZCACHETTL,
+	CFG_PASSWDCACHE,
+	CFG_PASSWDCACHETTL,
+	CFG_PASSWDOFFLOAD,
+	CFG_PASSWDOFFLOADQ,
 	CFG_TLS_ECNAME,
 	CFG_TLS_CACERT,
 	CFG_TLS_CERT,
 	CFG_TLS_KEY,
+	CFG_TLS_SESS_CACHE,
+	CFG_TLS_TICKET_LIFETIME,
+	CFG_TLS_KTLS,
+	CFG_LOGBUFSIZE,
+	CFG_LOGBUFPOLICY,
+	CFG_IX_HASH,
 
 	CFG_LAST
 };
@@ -335,6 +370,18 @@ static ConfigTable config_back_cf_table[] = {
 		 "( OLcfgGlAt:6 NAME 'olcAuthIDRewrite' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString X-ORDERED 'VALUES' )", NULL, NULL },
+	{ "authz-cache", "entries", 2, 2, 0,
+		ARG_INT|ARG_MAGIC|CFG_AZCACHE, &config_generic,
+		"( OLcfgGlAt:123 NAME 'olcAuthzCache' "
+			"DESC 'Number of SASL name mappings and authz decisions cached server-wide' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "authz-cache-ttl", "seconds", 2, 2, 0,
+		ARG_INT|ARG_MAGIC|CFG_AZCACHETTL, &config_generic,
+		"( OLcfgGlAt:124 NAME 'olcAuthzCacheTTL' "
+			"DESC 'Lifetime of cached SASL name mappings and authz decisions' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "authz-policy", "policy", 2, 2, 0, ARG_STRING|ARG_MAGIC|CFG_AZPOLICY,
 		&config_generic, "( OLcfgGlAt:7 NAME 'olcAuthzPolicy' "
 			"EQUALITY caseIgnoreMatch "
@@ -397,6 +444,18 @@ static ConfigTable config_back_cf_table[] = {
 		"( OLcfgGlAt:17 NAME 'olcGentleHUP' "
 			"EQUALITY booleanMatch "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "groupcache", "entries", 2, 2, 0,
+		ARG_INT|ARG_MAGIC|CFG_GROUPCACHE, &config_generic,
+		"( OLcfgGlAt:108 NAME 'olcGroupCache' "
+			"DESC 'Number of group membership results cached server-wide' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "groupcachettl", "seconds", 2, 2, 0,
+		ARG_INT|ARG_MAGIC|CFG_GROUPCACHETTL, &config_generic,
+		"( OLcfgGlAt:109 NAME 'olcGroupCacheTTL' "
+			"DESC 'Lifetime of cached group membership results' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "hidden", "on|off", 2, 2, 0, ARG_DB|ARG_ON_OFF|ARG_MAGIC|CFG_HIDDEN,
 		&config_generic, "( OLcfgDbAt:0.17 NAME 'olcHidden' "
 			"EQUALITY booleanMatch "
@@ -408,6 +467,12 @@ static ConfigTable config_back_cf_table[] = {
 	{ "include", "file", 2, 2, 0, ARG_MAGIC,
 		&config_include, "( OLcfgGlAt:19 NAME 'olcInclude' "
 			"SUP labeledURI )", NULL, NULL },
+	{ "index_hash", "fnv|wyhash", 2, 2, 0,
+		ARG_STRING|ARG_MAGIC|CFG_IX_HASH, &config_generic,
+		"( OLcfgGlAt:120 NAME 'olcIndexHash' "
+			"DESC 'Hash function for index keys' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "index_hash64", "on|off", 2, 2, 0, ARG_ON_OFF|ARG_MAGIC|CFG_IX_HASH64,
 		&config_generic, "( OLcfgGlAt:94 NAME 'olcIndexHash64' "
 			"EQUALITY booleanMatch "
@@ -461,6 +526,18 @@ static ConfigTable config_back_cf_table[] = {
 		&local_ssf, "( OLcfgGlAt:26 NAME 'olcLocalSSF' "
 			"EQUALITY integerMatch "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "logbuffer-policy", "block|drop", 2, 2, 0,
+		ARG_STRING|ARG_MAGIC|CFG_LOGBUFPOLICY, &config_generic,
+		"( OLcfgGlAt:118 NAME 'olcLogBufferPolicy' "
+			"DESC 'Wait for room or drop the message when a log buffer is full' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "logbuffer-size", "kbytes", 2, 2, 0,
+		ARG_UINT|ARG_MAGIC|CFG_LOGBUFSIZE, &config_generic,
+		"( OLcfgGlAt:117 NAME 'olcLogBufferSize' "
+			"DESC 'Per-thread log buffer size in kbytes, 0 to log synchronously' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "logfile", "file", 2, 2, 0, ARG_STRING|ARG_MAGIC|CFG_LOGFILE,
 		&config_generic, "( OLcfgGlAt:27 NAME 'olcLogFile' "
 			"EQUALITY caseExactMatch "
@@ -515,6 +592,18 @@ static ConfigTable config_back_cf_table[] = {
 	{ "overlay", "overlay", 2, 2, 0, ARG_MAGIC,
 		&config_overlay, "( OLcfgGlAt:34 NAME 'olcOverlay' "
 			"SUP olcDatabase SINGLE-VALUE X-ORDERED 'SIBLINGS' )", NULL, NULL },
+	{ "password-cache", "entries", 2, 2, 0,
+		ARG_INT|ARG_MAGIC|CFG_PASSWDCACHE, &config_generic,
+		"( OLcfgGlAt:110 NAME 'olcPasswordCache' "
+			"DESC 'Number of successful password checks cached server-wide' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "password-cache-ttl", "seconds", 2, 2, 0,
+		ARG_INT|ARG_MAGIC|CFG_PASSWDCACHETTL, &config_generic,
+		"( OLcfgGlAt:111 NAME 'olcPasswordCacheTTL' "
+			"DESC 'Lifetime of cached password checks' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "password-crypt-salt-format", "salt", 2, 2, 0, ARG_STRING|ARG_MAGIC|CFG_SALT,
 		&config_generic, "( OLcfgGlAt:35 NAME 'olcPasswordCryptSaltFormat' "
 			"EQUALITY caseIgnoreMatch "
@@ -523,6 +612,18 @@ static ConfigTable config_back_cf_table[] = {
 		&config_passwd_hash, "( OLcfgGlAt:36 NAME 'olcPasswordHash' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "password-offload-queue", "count", 2, 2, 0,
+		ARG_INT|ARG_MAGIC|CFG_PASSWDOFFLOADQ, &config_generic,
+		"( OLcfgGlAt:122 NAME 'olcPasswordOffloadQueue' "
+			"DESC 'Password checks queued or running before Binds are refused, 0 for no limit' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "password-offload-threads", "count", 2, 2, 0,
+		ARG_INT|ARG_MAGIC|CFG_PASSWDOFFLOAD, &config_generic,
+		"( OLcfgGlAt:121 NAME 'olcPasswordOffloadThreads' "
+			"DESC 'Threads for slow password checks, 0 to run them on the worker threads' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "pidfile", "file", 2, 2, 0, ARG_STRING,
 		&slapd_pid_file, "( OLcfgGlAt:37 NAME 'olcPidFile' "
 			"EQUALITY caseExactMatch "
@@ -545,6 +646,11 @@ static ConfigTable config_back_cf_table[] = {
 		"( OLcfgGlAt:39 NAME 'olcPluginLogFile' "
 			"EQUALITY caseExactMatch "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "profiling", "on|off", 2, 2, 0, ARG_ON_OFF,
+		&slap_profiling, "( OLcfgGlAt:119 NAME 'olcProfiling' "
+			"DESC 'Count calls to and CPU time spent in hot paths' "
+			"EQUALITY booleanMatch "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "readonly", "on|off", 2, 2, 0, ARG_MAY_DB|ARG_ON_OFF|ARG_MAGIC|CFG_RO,
 		&config_generic, "( OLcfgGlAt:40 NAME 'olcReadOnly' "
 			"EQUALITY booleanMatch "
@@ -670,6 +776,10 @@ static ConfigTable config_back_cf_table[] = {
 		&config_schema_dn, "( OLcfgGlAt:58 NAME 'olcSchemaDN' "
 			"EQUALITY distinguishedNameMatch "
 			"SYNTAX OMsDN SINGLE-VALUE )", NULL, NULL },
+	{ "search-templates", "max", 2, 2, 0, ARG_INT,
+		&slap_search_templates, "( OLcfgGlAt:128 NAME 'olcSearchTemplates' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "security", "factors", 2, 0, 0, ARG_MAY_DB|ARG_MAGIC,
 		&config_security, "( OLcfgGlAt:59 NAME 'olcSecurity' "
 			"EQUALITY caseIgnoreMatch "
@@ -682,6 +792,11 @@ static ConfigTable config_back_cf_table[] = {
 		&config_sizelimit, "( OLcfgGlAt:60 NAME 'olcSizeLimit' "
 			"EQUALITY caseExactMatch "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "slowop-threshold", "milliseconds", 2, 2, 0, ARG_INT,
+		&slap_slowop_threshold, "( OLcfgGlAt:116 NAME 'olcSlowOpThreshold' "
+			"DESC 'Log a profile of operations taking longer, 0 to disable' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "sockbuf_max_incoming", "max", 2, 2, 0, ARG_BER_LEN_T,
 		&sockbuf_max_incoming, "( OLcfgGlAt:61 NAME 'olcSockbufMaxIncoming' "
 			"EQUALITY integerMatch "
@@ -690,6 +805,10 @@ static ConfigTable config_back_cf_table[] = {
 		&sockbuf_max_incoming_auth, "( OLcfgGlAt:62 NAME 'olcSockbufMaxIncomingAuth' "
 			"EQUALITY integerMatch "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "sockbuf_readahead", "bytes", 2, 2, 0, ARG_BER_LEN_T,
+		&sockbuf_readahead, "( OLcfgGlAt:105 NAME 'olcSockbufReadahead' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "sortvals", "attr", 2, 0, 0, ARG_MAGIC|CFG_SORTVALS,
 		&config_generic, "( OLcfgGlAt:83 NAME 'olcSortVals' "
 			"DESC 'Attributes whose values will always be sorted' "
@@ -732,6 +851,38 @@ static ConfigTable config_back_cf_table[] = {
 		"( OLcfgGlAt:95 NAME 'olcThreadQueues' "
 			"EQUALITY integerMatch "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "threadsteal", "on|off", 2, 2, 0,
+		ARG_ON_OFF|ARG_MAGIC|CFG_THREADSTEAL, &config_generic,
+		"( OLcfgGlAt:102 NAME 'olcThreadSteal' "
+			"EQUALITY booleanMatch "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "threadreserve", "count", 2, 2, 0,
+		ARG_INT|ARG_MAGIC|CFG_THREADRESERVE, &config_generic,
+		"( OLcfgGlAt:103 NAME 'olcThreadReserve' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "threadmin", "count", 2, 2, 0,
+		ARG_INT|ARG_MAGIC|CFG_THREADMIN, &config_generic,
+		"( OLcfgGlAt:106 NAME 'olcThreadMin' "
+			"DESC 'Minimum number of threads when threadwait is set' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "threadwait", "usec", 2, 2, 0,
+		ARG_INT|ARG_MAGIC|CFG_THREADWAIT, &config_generic,
+		"( OLcfgGlAt:107 NAME 'olcThreadWait' "
+			"DESC 'Target queue wait in microseconds for adapting the thread count' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "threadaffinity", "cpulist", 2, 0, 0, ARG_MAGIC,
+		&config_threadaffinity, "( OLcfgGlAt:126 NAME 'olcThreadAffinity' "
+			"DESC 'CPU lists to bind listener and worker threads to, one group per value' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "threadpriority", "ops", 2, 0, 0, ARG_MAGIC,
+		&config_threadpriority, "( OLcfgGlAt:104 NAME 'olcThreadPriority' "
+			"DESC 'Operations that may use the reserved thread queues' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString )", NULL, NULL },
 	{ "timelimit", "limit", 2, 0, 0, ARG_MAY_DB|ARG_MAGIC,
 		&config_timelimit, "( OLcfgGlAt:67 NAME 'olcTimeLimit' "
 			"EQUALITY caseExactMatch "
@@ -838,6 +989,33 @@ static ConfigTable config_back_cf_table[] = {
 		"( OLcfgGlAt:74 NAME 'olcTLSRandFile' "
 			"EQUALITY caseExactMatch "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "TLSSessionCache", "sessions", 2, 2, 0,
+#if defined(HAVE_TLS) && defined(HAVE_OPENSSL)
+		CFG_TLS_SESS_CACHE|ARG_STRING|ARG_MAGIC, &config_tls_config,
+#else
+		ARG_IGNORED, NULL,
+#endif
+		"( OLcfgGlAt:112 NAME 'olcTLSSessionCache' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "TLSTicketLifetime", "seconds", 2, 2, 0,
+#if defined(HAVE_TLS) && defined(HAVE_OPENSSL)
+		CFG_TLS_TICKET_LIFETIME|ARG_STRING|ARG_MAGIC, &config_tls_config,
+#else
+		ARG_IGNORED, NULL,
+#endif
+		"( OLcfgGlAt:113 NAME 'olcTLSTicketLifetime' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "TLSKTLS", "on|off", 2, 2, 0,
+#if defined(HAVE_TLS) && defined(HAVE_OPENSSL)
+		CFG_TLS_KTLS|ARG_STRING|ARG_MAGIC, &config_tls_config,
+#else
+		ARG_IGNORED, NULL,
+#endif
+		"( OLcfgGlAt:115 NAME 'olcTLSKTLS' "
+			"EQUALITY booleanMatch "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "TLSVerifyClient", NULL, 2, 2, 0,
 #ifdef HAVE_TLS
 		CFG_TLS_VERIFY|ARG_STRING|ARG_MAGIC, &config_tls_config,
@@ -874,6 +1052,16 @@ static ConfigTable config_back_cf_table[] = {
 		"( OLcfgGlAt:87 NAME 'olcTLSProtocolMin' "
 			"EQUALITY caseExactMatch "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "tls-threads", "count", 2, 2, 0,
+#ifdef HAVE_TLS
+		ARG_INT|ARG_MAGIC|CFG_TLSTHREADS, &config_generic,
+#else
+		ARG_IGNORED, NULL,
+#endif
+		"( OLcfgGlAt:114 NAME 'olcTLSThreads' "
+			"DESC 'Threads for TLS handshakes, 0 to run them on the worker threads' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "tool-threads", "count", 2, 2, 0, ARG_INT|ARG_MAGIC|CFG_TTHREADS,
 		&config_generic, "( OLcfgGlAt:80 NAME 'olcToolThreads' "
 			"EQUALITY integerMatch "
@@ -888,6 +1076,18 @@ static ConfigTable config_back_cf_table[] = {
 		&config_updateref, "( OLcfgDbAt:0.13 NAME 'olcUpdateRef' "
 			"EQUALITY caseIgnoreMatch "
 			"SUP labeledURI )", NULL, NULL },
+	{ "write-behind", "entries", 2, 2, 0, ARG_INT,
+		&slap_write_behind, "( OLcfgGlAt:125 NAME 'olcWriteBehind' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "write-buffer", "bytes", 2, 2, 0, ARG_BER_LEN_T,
+		&slap_write_buffer, "( OLcfgGlAt:127 NAME 'olcWriteBuffer' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "write-coalesce", "bytes", 2, 2, 0, ARG_BER_LEN_T,
+		&slap_write_coalesce, "( OLcfgGlAt:101 NAME 'olcWriteCoalesce' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "writetimeout", "timeout", 2, 2, 0, ARG_INT,
 		&global_writetimeout, "( OLcfgGlAt:88 NAME 'olcWriteTimeout' "
 			"EQUALITY integerMatch "
@@ -936,29 +1136,38 @@ static ConfigOCs cf_ocs[] = {
 		"SUP olcConfig STRUCTURAL "
 		"MAY ( cn $ olcConfigFile $ olcConfigDir $ olcAllows $ olcArgsFile $ "
 		 "olcAttributeOptions $ olcAuthIDRewrite $ "
-		 "olcAuthzPolicy $ olcAuthzRegexp $ olcConcurrency $ "
+		 "olcAuthzCache $ olcAuthzCacheTTL $ olcAuthzPolicy $ olcAuthzRegexp $ olcConcurrency $ "
 		 "olcConnMaxPending $ olcConnMaxPendingAuth $ "
-		 "olcDisallows $ olcGentleHUP $ olcIdleTimeout $ "
+		 "olcDisallows $ olcGentleHUP $ olcGroupCache $ olcGroupCacheTTL $ "
+		 "olcIdleTimeout $ "
 		 "olcIndexSubstrIfMaxLen $ olcIndexSubstrIfMinLen $ "
-		 "olcIndexSubstrAnyLen $ olcIndexSubstrAnyStep $ olcIndexHash64 $ "
+		 "olcIndexSubstrAnyLen $ olcIndexSubstrAnyStep $ olcIndexHash $ "
+		 "olcIndexHash64 $ "
 		 "olcIndexIntLen $ "
-		 "olcListenerThreads $ olcLocalSSF $ olcLogFile $ olcLogLevel $ "
+		 "olcListenerThreads $ olcLocalSSF $ olcLogBufferPolicy $ "
+		 "olcLogBufferSize $ olcLogFile $ olcLogLevel $ "
+		 "olcPasswordCache $ olcPasswordCacheTTL $ "
+		 "olcPasswordOffloadQueue $ olcPasswordOffloadThreads $ "
 		 "olcPasswordCryptSaltFormat $ olcPasswordHash $ olcPidFile $ "
-		 "olcPluginLogFile $ olcReadOnly $ olcReferral $ "
+		 "olcPluginLogFile $ olcProfiling $ olcReadOnly $ olcReferral $ "
 		 "olcReplogFile $ olcRequires $ olcRestrict $ olcReverseLookup $ "
 		 "olcRootDSE $ "
 		 "olcSaslAuxprops $ olcSaslAuxpropsDontUseCopy $ olcSaslAuxpropsDontUseCopyIgnore $ "
 		 "olcSaslCBinding $ olcSaslHost $ olcSaslRealm $ olcSaslSecProps $ "
-		 "olcSecurity $ olcServerID $ olcSizeLimit $ "
+		 "olcSearchTemplates $ olcSecurity $ olcServerID $ olcSizeLimit $ olcSlowOpThreshold $ "
 		 "olcSockbufMaxIncoming $ olcSockbufMaxIncomingAuth $ "
+		 "olcSockbufReadahead $ "
 		 "olcTCPBuffer $ "
-		 "olcThreads $ olcThreadQueues $ "
+		 "olcThreads $ olcThreadQueues $ olcThreadSteal $ "
+		 "olcThreadReserve $ olcThreadPriority $ "
+		 "olcThreadMin $ olcThreadWait $ olcThreadAffinity $ "
 		 "olcTimeLimit $ olcTLSCACertificateFile $ "
 		 "olcTLSCACertificatePath $ olcTLSCertificateFile $ "
 		 "olcTLSCertificateKeyFile $ olcTLSCipherSuite $ olcTLSCRLCheck $ "
 		 "olcTLSCACertificate $ olcTLSCertificate $ olcTLSCertificateKey $ "
 		 "olcTLSRandFile $ olcTLSVerifyClient $ olcTLSDHParamFile $ olcTLSECName $ "
-		 "olcTLSCRLFile $ olcTLSProtocolMin $ olcToolThreads $ olcWriteTimeout $ "
+		 "olcTLSCRLFile $ olcTLSProtocolMin $ olcTLSSessionCache $ "
+		 "olcTLSTicketLifetime $ olcTLSKTLS $ olcTLSThreads $ olcToolThreads $ olcWriteBehind $ olcWriteBuffer $ olcWriteCoalesce $ olcWriteTimeout $ "
 		 "olcObjectIdentifier $ olcAttributeTypes $ olcObjectClasses $ "
 		 "olcDitContentRules $ olcLdapSyntaxes ) )", Cft_Global },
 	{ "( OLcfgGlOc:2 "
@@ -1067,6 +1276,47 @@ config_generic(ConfigArgs *c) {
 		case CFG_THREADQS:
 			c->value_int = connection_pool_queues;
 			break;
+		case CFG_THREADSTEAL:
+			c->value_int = connection_pool_steal;
+			break;
+		case CFG_THREADRESERVE:
+			c->value_int = connection_pool_reserve;
+			break;
+		case CFG_THREADMIN:
+			c->value_int = connection_pool_min;
+			break;
+		case CFG_THREADWAIT:
+			c->value_int = connection_pool_wait;
+			break;
+#ifdef HAVE_TLS
+		case CFG_TLSTHREADS:
+			c->value_int = slap_tls_thread_max;
+			break;
+#endif
+		case CFG_GROUPCACHE:
+			c->value_int = group_cache_size;
+			break;
+		case CFG_GROUPCACHETTL:
+			c->value_int = group_cache_ttl;
+			break;
+		case CFG_AZCACHE:
+			c->value_int = authz_cache_size;
+			break;
+		case CFG_AZCACHETTL:
+			c->value_int = authz_cache_ttl;
+			break;
+		case CFG_PASSWDCACHE:
+			c->value_int = passwd_cache_size;
+			break;
+		case CFG_PASSWDCACHETTL:
+			c->value_int = passwd_cache_ttl;
+			break;
+		case CFG_PASSWDOFFLOAD:
+			c->value_int = passwd_offload_threads;
+			break;
+		case CFG_PASSWDOFFLOADQ:
+			c->value_int = passwd_offload_queue;
+			break;
 		case CFG_TTHREADS:
 			c->value_int = slap_tool_thread_max;
 			break;
@@ -1324,6 +1574,15 @@ config_generic(ConfigArgs *c) {
 			else
 				rc = 1;
 			break;
+		case CFG_LOGBUFSIZE:
+			c->value_uint = slap_log_bufsize / 1024;
+			break;
+		case CFG_LOGBUFPOLICY: {
+			struct berval bv;
+
+			enum_to_verb( logbuffer_policies, slap_log_policy, &bv );
+			c->value_string = ch_strdup( bv.bv_val );
+			} break;
 		case CFG_LASTMOD:
 			c->value_int = (SLAP_NOLASTMOD(c->be) == 0);
 			break;
@@ -1351,6 +1610,12 @@ config_generic(ConfigArgs *c) {
 		case CFG_IX_HASH64:
 			c->value_int = slap_hash64( -1 );
 			break;
+		case CFG_IX_HASH: {
+			struct berval bv;
+
+			enum_to_verb( index_hashes, slap_hash_alg( -1 ), &bv );
+			c->value_string = ch_strdup( bv.bv_val );
+			} break;
 		case CFG_IX_INTLEN:
 			c->value_int = index_intlen;
 			break;
@@ -1493,11 +1758,20 @@ config_generic(ConfigArgs *c) {
 			ch_free( logfileName );
 			logfileName = NULL;
 			if ( logfile ) {
+				slap_log_set_file( NULL );
 				fclose( logfile );
 				logfile = NULL;
 			}
 			break;
 
+		case CFG_LOGBUFSIZE:
+			slap_log_buffer( 0 );
+			break;
+
+		case CFG_LOGBUFPOLICY:
+			slap_log_policy = SLAP_LOG_BLOCK;
+			break;
+
 		case CFG_SERVERID: {
 			ServerID *si, **sip;
 
@@ -1539,6 +1813,76 @@ config_generic(ConfigArgs *c) {
 			slap_hash64( 0 );
 			break;
 
+		case CFG_IX_HASH:
+			slap_hash_alg( SLAP_IXHASH_FNV );
+			break;
+
+		case CFG_THREADSTEAL:
+			if ( slapMode & SLAP_SERVER_MODE )
+				ldap_pvt_thread_pool_steal(&connection_pool, 0);
+			connection_pool_steal = 0;
+			break;
+
+		case CFG_THREADRESERVE:
+			if ( slapMode & SLAP_SERVER_MODE )
+				ldap_pvt_thread_pool_reserve(&connection_pool, 0);
+			connection_pool_reserve = 0;
+			break;
+
+		case CFG_THREADMIN:
+			if ( slapMode & SLAP_SERVER_MODE )
+				ldap_pvt_thread_pool_adapt(&connection_pool, 0,
+					connection_pool_wait);
+			connection_pool_min = 0;
+			break;
+
+		case CFG_THREADWAIT:
+			if ( slapMode & SLAP_SERVER_MODE )
+				ldap_pvt_thread_pool_adapt(&connection_pool,
+					connection_pool_min, 0);
+			connection_pool_wait = 0;
+			break;
+
+#ifdef HAVE_TLS
+		case CFG_TLSTHREADS:
+			if ( slapMode & SLAP_SERVER_MODE )
+				connections_tls_threads( 0 );
+			slap_tls_thread_max = 0;
+			break;
+#endif
+
+		case CFG_GROUPCACHE:
+			group_cache_resize( 0 );
+			break;
+
+		case CFG_GROUPCACHETTL:
+			group_cache_ttl = 60;
+			break;
+
+		case CFG_AZCACHE:
+			authz_cache_resize( 0 );
+			break;
+
+		case CFG_AZCACHETTL:
+			authz_cache_ttl = 60;
+			break;
+
+		case CFG_PASSWDCACHE:
+			passwd_cache_resize( 0 );
+			break;
+
+		case CFG_PASSWDCACHETTL:
+			passwd_cache_ttl = 60;
+			break;
+
+		case CFG_PASSWDOFFLOAD:
+			slap_passwd_offload_threads( 0 );
+			break;
+
+		case CFG_PASSWDOFFLOADQ:
+			passwd_offload_queue = 64;
+			break;
+
 		case CFG_IX_INTLEN:
 			index_intlen = SLAP_INDEX_INTLEN_DEFAULT;
 			index_intlen_strlen = SLAP_INDEX_INTLEN_STRLEN(
@@ -1590,6 +1934,7 @@ config_generic(ConfigArgs *c) {
 						break;
 				}
 				cfn->c_oc_head = cfn->c_oc_tail = NULL;
+				cfn->c_oc_count = 0;
 			} else {
 				ObjectClass *oc, *prev = NULL;
 
@@ -1598,6 +1943,7 @@ config_generic(ConfigArgs *c) {
 					oc_next( &oc );
 				}
 				oc_delete( oc );
+				cfn->c_oc_count--;
 				if ( cfn->c_oc_tail == oc ) {
 					cfn->c_oc_tail = prev;
 				}
@@ -1628,6 +1974,7 @@ config_generic(ConfigArgs *c) {
 						break;
 				}
 				cfn->c_at_head = cfn->c_at_tail = NULL;
+				cfn->c_at_count = 0;
 			} else {
 				AttributeType *at, *prev = NULL;
 
@@ -1636,6 +1983,7 @@ config_generic(ConfigArgs *c) {
 					at_next( &at );
 				}
 				at_delete( at );
+				cfn->c_at_count--;
 				if ( cfn->c_at_tail == at ) {
 					cfn->c_at_tail = prev;
 				}
@@ -1666,6 +2014,7 @@ config_generic(ConfigArgs *c) {
 						break;
 				}
 				cfn->c_syn_head = cfn->c_syn_tail = NULL;
+				cfn->c_syn_count = 0;
 			} else {
 				Syntax *syn, *prev = NULL;
 
@@ -1674,6 +2023,7 @@ config_generic(ConfigArgs *c) {
 					syn_next( &syn );
 				}
 				syn_delete( syn );
+				cfn->c_syn_count--;
 				if ( cfn->c_syn_tail == syn ) {
 					cfn->c_syn_tail = prev;
 				}
@@ -1825,6 +2175,131 @@ config_generic(ConfigArgs *c) {
 			connection_pool_queues = c->value_int;	/* save for reference */
 			break;
 
+		case CFG_THREADSTEAL:
+			if ( slapMode & SLAP_SERVER_MODE )
+				ldap_pvt_thread_pool_steal(&connection_pool, c->value_int);
+			connection_pool_steal = c->value_int;	/* save for reference */
+			break;
+
+		case CFG_THREADRESERVE:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"threadreserve=%d smaller than minimum value 0",
+					c->value_int );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg );
+				return 1;
+			}
+			if ( slapMode & SLAP_SERVER_MODE )
+				ldap_pvt_thread_pool_reserve(&connection_pool, c->value_int);
+			connection_pool_reserve = c->value_int;	/* save for reference */
+			break;
+
+		case CFG_THREADMIN:
+		case CFG_THREADWAIT:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s=%d smaller than minimum value 0",
+					c->argv[0], c->value_int );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg );
+				return 1;
+			}
+			if ( c->type == CFG_THREADMIN )
+				connection_pool_min = c->value_int;
+			else
+				connection_pool_wait = c->value_int;
+			if ( slapMode & SLAP_SERVER_MODE )
+				ldap_pvt_thread_pool_adapt(&connection_pool,
+					connection_pool_min, connection_pool_wait);
+			break;
+
+#ifdef HAVE_TLS
+		case CFG_TLSTHREADS:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"tls-threads=%d smaller than minimum value 0",
+					c->value_int );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg );
+				return 1;
+			}
+			if ( slapMode & SLAP_SERVER_MODE )
+				connections_tls_threads( c->value_int );
+			slap_tls_thread_max = c->value_int;	/* save for reference */
+			break;
+#endif
+
+		case CFG_GROUPCACHE:
+		case CFG_GROUPCACHETTL:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s=%d smaller than minimum value 0",
+					c->argv[0], c->value_int );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg );
+				return 1;
+			}
+			if ( c->type == CFG_GROUPCACHE )
+				group_cache_resize( c->value_int );
+			else
+				group_cache_ttl = c->value_int;
+			break;
+
+		case CFG_AZCACHE:
+		case CFG_AZCACHETTL:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s=%d smaller than minimum value 0",
+					c->argv[0], c->value_int );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg );
+				return 1;
+			}
+			if ( c->type == CFG_AZCACHE )
+				authz_cache_resize( c->value_int );
+			else
+				authz_cache_ttl = c->value_int;
+			break;
+
+		case CFG_PASSWDCACHE:
+		case CFG_PASSWDCACHETTL:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s=%d smaller than minimum value 0",
+					c->argv[0], c->value_int );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg );
+				return 1;
+			}
+			if ( c->type == CFG_PASSWDCACHETTL ) {
+				passwd_cache_ttl = c->value_int;
+			} else if ( passwd_cache_resize( c->value_int ) ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s: no entropy available for the cache key",
+					c->argv[0] );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg );
+				return 1;
+			}
+			break;
+
+		case CFG_PASSWDOFFLOAD:
+		case CFG_PASSWDOFFLOADQ:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s=%d smaller than minimum value 0",
+					c->argv[0], c->value_int );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg );
+				return 1;
+			}
+			if ( c->type == CFG_PASSWDOFFLOADQ )
+				passwd_offload_queue = c->value_int;
+			else
+				slap_passwd_offload_threads( c->value_int );
+			break;
+
 		case CFG_TTHREADS:
 			if ( slapMode & SLAP_TOOL_MODE )
 				ldap_pvt_thread_pool_maxthreads(&connection_pool, c->value_int);
@@ -1961,7 +2436,7 @@ config_generic(ConfigArgs *c) {
 
 			if ( c->op == LDAP_MOD_ADD && c->ca_private && cfn != c->ca_private )
 				cfn = c->ca_private;
-			if ( c->valx < 0 ) {
+			if ( c->valx < 0 || c->valx >= cfn->c_oc_count ) {
 				prev = cfn->c_oc_tail;
 			} else {
 				prev = NULL;
@@ -1986,6 +2461,7 @@ config_generic(ConfigArgs *c) {
 			if(parse_oc(c, &oc, prev)) return(1);
 			if (!cfn->c_oc_head || !c->valx) cfn->c_oc_head = oc;
 			if (cfn->c_oc_tail == prev) cfn->c_oc_tail = oc;
+			cfn->c_oc_count++;
 			}
 			break;
 
@@ -1994,7 +2470,7 @@ config_generic(ConfigArgs *c) {
 
 			if ( c->op == LDAP_MOD_ADD && c->ca_private && cfn != c->ca_private )
 				cfn = c->ca_private;
-			if ( c->valx < 0 ) {
+			if ( c->valx < 0 || c->valx >= cfn->c_at_count ) {
 				prev = cfn->c_at_tail;
 			} else {
 				prev = NULL;
@@ -2019,6 +2495,7 @@ config_generic(ConfigArgs *c) {
 			if(parse_at(c, &at, prev)) return(1);
 			if (!cfn->c_at_head || !c->valx) cfn->c_at_head = at;
 			if (cfn->c_at_tail == prev) cfn->c_at_tail = at;
+			cfn->c_at_count++;
 			}
 			break;
 
@@ -2027,7 +2504,7 @@ config_generic(ConfigArgs *c) {
 
 			if ( c->op == LDAP_MOD_ADD && c->ca_private && cfn != c->ca_private )
 				cfn = c->ca_private;
-			if ( c->valx < 0 ) {
+			if ( c->valx < 0 || c->valx >= cfn->c_syn_count ) {
 				prev = cfn->c_syn_tail;
 			} else {
 				prev = NULL;
@@ -2052,6 +2529,7 @@ config_generic(ConfigArgs *c) {
 			if ( parse_syn( c, &syn, prev ) ) return(1);
 			if ( !cfn->c_syn_head || !c->valx ) cfn->c_syn_head = syn;
 			if ( cfn->c_syn_tail == prev ) cfn->c_syn_tail = syn;
+			cfn->c_syn_count++;
 			}
 			break;
 
@@ -2078,6 +2556,22 @@ config_generic(ConfigArgs *c) {
 				return 1;
 			break;
 
+		case CFG_IX_HASH: {
+			int i = verb_to_mask( c->value_string, index_hashes );
+
+			if ( BER_BVISNULL( &index_hashes[i].word ) ||
+				slap_hash_alg( index_hashes[i].mask ) ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> unsupported hash \"%s\"",
+					c->argv[0], c->value_string );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg );
+				ch_free( c->value_string );
+				return 1;
+			}
+			ch_free( c->value_string );
+			} break;
+
 		case CFG_IX_INTLEN:
 			if ( c->value_int < SLAP_INDEX_INTLEN_DEFAULT )
 				c->value_int = SLAP_INDEX_INTLEN_DEFAULT;
@@ -2265,7 +2759,34 @@ sortval_reject:
 				if ( logfileName ) ch_free( logfileName );
 				logfileName = c->value_string;
 				logfile = fopen(logfileName, "w");
-				if(logfile) lutil_debug_file(logfile);
+				if(logfile) slap_log_set_file(logfile);
+			} break;
+
+		case CFG_LOGBUFSIZE:
+			if ( slap_log_buffer( c->value_uint ) ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> invalid size %u",
+					c->argv[0], c->value_uint );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg );
+				return 1;
+			}
+			break;
+
+		case CFG_LOGBUFPOLICY: {
+			int i = verb_to_mask( c->value_string, logbuffer_policies );
+
+			if ( BER_BVISNULL( &logbuffer_policies[i].word ) ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> unknown policy \"%s\"",
+					c->argv[0], c->value_string );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg );
+				ch_free( c->value_string );
+				return 1;
+			}
+			slap_log_policy = logbuffer_policies[i].mask;
+			ch_free( c->value_string );
 			} break;
 
 		case CFG_LASTMOD:
@@ -3500,6 +4021,94 @@ config_disallows(ConfigArgs *c) {
 	return(0);
 }
 
+static int
+config_threadpriority(ConfigArgs *c) {
+	slap_mask_t ops = 0;
+	int i;
+	slap_verbmasks priority_ops[] = {
+		{ BER_BVC("bind"),		SLAP_RESTRICT_OP_BIND },
+		{ BER_BVC("add"),		SLAP_RESTRICT_OP_ADD },
+		{ BER_BVC("modify"),		SLAP_RESTRICT_OP_MODIFY },
+		{ BER_BVC("rename"),		SLAP_RESTRICT_OP_RENAME },
+		{ BER_BVC("delete"),		SLAP_RESTRICT_OP_DELETE },
+		{ BER_BVC("search"),		SLAP_RESTRICT_OP_SEARCH },
+		{ BER_BVC("base"),		SLAP_PRIORITY_OP_BASE },
+		{ BER_BVC("compare"),		SLAP_RESTRICT_OP_COMPARE },
+		{ BER_BVC("extended"),		SLAP_RESTRICT_OP_EXTENDED },
+		{ BER_BVNULL,	0 }
+	};
+
+	if (c->op == SLAP_CONFIG_EMIT) {
+		return mask_to_verbs( priority_ops, connection_pool_priority,
+			&c->rvalue_vals );
+	} else if ( c->op == LDAP_MOD_DELETE ) {
+		if ( !c->line ) {
+			connection_pool_priority = 0;
+		} else {
+			i = verb_to_mask( c->line, priority_ops );
+			connection_pool_priority &= ~priority_ops[i].mask;
+		}
+		return 0;
+	}
+	i = verbs_to_mask( c->argc, c->argv, priority_ops, &ops );
+	if ( i ) {
+		snprintf( c->cr_msg, sizeof( c->cr_msg ), "<%s> unknown operation", c->argv[0] );
+		Debug(LDAP_DEBUG_ANY, "%s: %s %s\n",
+			c->log, c->cr_msg, c->argv[i]);
+		return(1);
+	}
+	connection_pool_priority |= ops;
+	return(0);
+}
+
+static int
+config_threadaffinity(ConfigArgs *c) {
+	char **groups = NULL;
+	int i, rc;
+
+	if (c->op == SLAP_CONFIG_EMIT) {
+		for ( i = 0; i < slapd_cpu_ngroups; i++ ) {
+			struct berval bv;
+			ber_str2bv( slapd_cpu_groups[i], 0, 0, &bv );
+			value_add_one( &c->rvalue_vals, &bv );
+		}
+		return slapd_cpu_ngroups ? 0 : 1;
+	} else if ( c->op == LDAP_MOD_DELETE ) {
+		if ( c->valx >= 0 && c->valx < slapd_cpu_ngroups ) {
+			for ( i = 0; i < slapd_cpu_ngroups; i++ ) {
+				if ( i != c->valx )
+					ldap_charray_add( &groups, slapd_cpu_groups[i] );
+			}
+		}
+		rc = slapd_thread_affinity( groups );
+		ldap_charray_free( groups );
+		return rc;
+	}
+
+	for ( i = 1; i < c->argc; i++ ) {
+		if ( ldap_pvt_thread_check_affinity( c->argv[i] ) ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"<%s> invalid or unsupported CPU list", c->argv[0] );
+			Debug(LDAP_DEBUG_ANY, "%s: %s \"%s\"\n",
+				c->log, c->cr_msg, c->argv[i]);
+			return(1);
+		}
+	}
+	for ( i = 0; i < slapd_cpu_ngroups; i++ )
+		ldap_charray_add( &groups, slapd_cpu_groups[i] );
+	for ( i = 1; i < c->argc; i++ )
+		ldap_charray_add( &groups, c->argv[i] );
+	rc = slapd_thread_affinity( groups );
+	ldap_charray_free( groups );
+	if ( rc ) {
+		snprintf( c->cr_msg, sizeof( c->cr_msg ),
+			"<%s> unable to set thread affinity", c->argv[0] );
+		Debug(LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+		return(1);
+	}
+	return(0);
+}
+
 static int
 config_requires(ConfigArgs *c) {
 	slap_mask_t requires = frontendDB->be_requires;
@@ -4229,6 +4838,11 @@ config_tls_config(ConfigArgs *c) {
 	case CFG_TLS_CRLCHECK:	flag = LDAP_OPT_X_TLS_CRLCHECK; break;
 	case CFG_TLS_VERIFY:	flag = LDAP_OPT_X_TLS_REQUIRE_CERT; break;
 	case CFG_TLS_PROTOCOL_MIN: flag = LDAP_OPT_X_TLS_PROTOCOL_MIN; break;
+#ifdef HAVE_OPENSSL
+	case CFG_TLS_SESS_CACHE: flag = LDAP_OPT_X_TLS_SESSION_CACHE; break;
+	case CFG_TLS_TICKET_LIFETIME: flag = LDAP_OPT_X_TLS_TICKET_LIFETIME; break;
+	case CFG_TLS_KTLS: flag = LDAP_OPT_X_TLS_KTLS; break;
+#endif
 	default:
 		Debug(LDAP_DEBUG_ANY, "%s: "
 				"unknown tls_option <0x%x>\n",
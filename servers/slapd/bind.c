@@ -34,6 +34,8 @@
 #include "lutil.h"
 #include "slap.h"
 
+static int do_bind_cleanup( Operation *op, SlapReply *rs, struct berval *mech );
+
 int
 do_bind(
     Operation	*op,
@@ -204,11 +206,21 @@ do_bind(
 
 	op->o_bd = frontendDB;
 	rs->sr_err = frontendDB->be_bind( op, rs );
+	if ( rs->sr_err == SLAPD_ASYNCOP ) {
+		/* skip cleanup */
+		return rs->sr_err;
+	}
 
 cleanup:
+	return do_bind_cleanup( op, rs, &mech );
+}
+
+static int
+do_bind_cleanup( Operation *op, SlapReply *rs, struct berval *mech )
+{
 	if ( rs->sr_err == LDAP_SUCCESS ) {
 		if ( op->orb_method != LDAP_AUTH_SASL ) {
-			ber_dupbv( &op->o_conn->c_authmech, &mech );
+			ber_dupbv( &op->o_conn->c_authmech, mech );
 		}
 		op->o_conn->c_authtype = op->orb_method;
 	}
@@ -225,6 +237,21 @@ cleanup:
 	return rs->sr_err;
 }
 
+/*
+ * Run a simple Bind again once slap_passwd_offload() has checked
+ * its credentials, and finish it as do_bind() would have.
+ */
+int
+do_bind_resume( Operation *op, SlapReply *rs )
+{
+	struct berval mech = BER_BVNULL;
+
+	op->o_bd = frontendDB;
+	rs->sr_err = frontendDB->be_bind( op, rs );
+
+	return do_bind_cleanup( op, rs, &mech );
+}
+
 int
 fe_op_bind( Operation *op, SlapReply *rs )
 {
@@ -378,6 +405,16 @@ fe_op_bind( Operation *op, SlapReply *rs )
 	}
 
 	if( op->o_bd->be_bind ) {
+		/* slow password schemes may be checked off the worker thread */
+		rs->sr_err = slap_passwd_offload( op, rs );
+		if ( rs->sr_err == SLAPD_ASYNCOP ) {
+			/* the op belongs to the offload thread now */
+			return rs->sr_err;
+		}
+		if ( rs->sr_err != LDAP_SUCCESS ) {
+			goto cleanup;
+		}
+
 		op->o_conn->c_authz_cookie = NULL;
 
 		rs->sr_err = (op->o_bd->be_bind)( op, rs );
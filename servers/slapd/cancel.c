@@ -76,23 +76,17 @@ int cancel_extop( Operation *op, SlapReply *rs )
 		goto out;
 	}
 
-	LDAP_STAILQ_FOREACH( o, &op->o_conn->c_pending_ops, o_next ) {
-		if ( o->o_msgid == opid ) {
-			/* TODO: We could instead remove the cancelled operation
-			 * from c_pending_ops like Abandon does, and send its
-			 * response here.  Not if it is pending because of a
-			 * congested connection though.
-			 */
-			rc = LDAP_CANNOT_CANCEL;
-			rs->sr_text = "too busy for Cancel, try Abandon instead";
-			goto out;
-		}
-	}
+	o = connection_op_find( op->o_conn, opid );
 
-	LDAP_STAILQ_FOREACH( o, &op->o_conn->c_ops, o_next ) {
-		if ( o->o_msgid == opid ) {
-			break;
-		}
+	if ( o && o->o_pending ) {
+		/* TODO: We could instead remove the cancelled operation
+		 * from c_pending_ops like Abandon does, and send its
+		 * response here.  Not if it is pending because of a
+		 * congested connection though.
+		 */
+		rc = LDAP_CANNOT_CANCEL;
+		rs->sr_text = "too busy for Cancel, try Abandon instead";
+		goto out;
 	}
 
 	if ( o == NULL ) {
@@ -69,6 +69,10 @@ slap_mask_t		global_disallows = 0;
 int		global_gentlehup = 0;
 int		global_idletimeout = 0;
 int		global_writetimeout = 0;
+ber_len_t	slap_write_coalesce = 0;
+int		slap_write_behind = 0;
+ber_len_t	slap_write_buffer = 0;
+int		slap_search_templates = 16;
 char	*global_host = NULL;
 struct berval global_host_bv = BER_BVNULL;
 char	*global_realm = NULL;
@@ -79,6 +83,7 @@ struct berval default_search_base = BER_BVNULL;
 struct berval default_search_nbase = BER_BVNULL;
 
 ber_len_t sockbuf_max_incoming = SLAP_SB_MAX_INCOMING_DEFAULT;
+ber_len_t sockbuf_readahead = 0;
 ber_len_t sockbuf_max_incoming_auth= SLAP_SB_MAX_INCOMING_AUTH;
 
 int	slap_conn_max_pending = SLAP_CONN_MAX_PENDING_DEFAULT;
@@ -1750,6 +1755,20 @@ slap_tls_get_config( LDAP *ld, int opt, char **val )
 		*val = ch_strdup( buf );
 		return 0;
 		}
+	case LDAP_OPT_X_TLS_SESSION_CACHE:
+	case LDAP_OPT_X_TLS_TICKET_LIFETIME: {
+		char buf[16];
+		if ( ldap_pvt_tls_get_option( ld, opt, &ival ) || ival == 0 )
+			return -1;
+		snprintf( buf, sizeof( buf ), "%d", ival );
+		*val = ch_strdup( buf );
+		return 0;
+		}
+	case LDAP_OPT_X_TLS_KTLS:
+		if ( ldap_pvt_tls_get_option( ld, opt, &ival ) || ival == 0 )
+			return -1;
+		*val = ch_strdup( "TRUE" );
+		return 0;
 	default:
 		return -1;
 	}
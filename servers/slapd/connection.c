@@ -50,6 +50,7 @@
 /* protected by connections_mutex */
 static ldap_pvt_thread_mutex_t connections_mutex;
 static Connection *connections = NULL;
+static unsigned long conn_current;	/* inbound connections in use */
 
 static ldap_pvt_thread_mutex_t conn_nextid_mutex;
 static unsigned long conn_nextid = SLAPD_SYNC_SYNCCONN_OFFSET;
@@ -71,7 +72,7 @@ connection_state2str( int state )
 	return "?";
 }
 
-static Connection* connection_get( ber_socket_t s );
+static Connection* connection_get( ber_socket_t s, int *busy );
 
 typedef struct conn_readinfo {
 	Operation *op;
@@ -79,16 +80,30 @@ typedef struct conn_readinfo {
 	void *arg;
 	void *ctx;
 	int nullop;
+	int handshake;
 } conn_readinfo;
 
 static int connection_input( Connection *c, conn_readinfo *cri );
+
+#ifdef HAVE_TLS
+/* TLS handshake threads, see connection_tls_thread() */
+static ldap_pvt_thread_mutex_t	conn_tls_mutex;
+static ldap_pvt_thread_cond_t	conn_tls_cond;
+static ber_socket_t	*conn_tls_ring;
+static int		conn_tls_head, conn_tls_count;
+static ldap_pvt_thread_t	*conn_tls_tids;
+static int		conn_tls_started, conn_tls_active, conn_tls_stop;
+#endif
 static void connection_close( Connection *c );
 
 static int connection_op_activate( Operation *op );
+static int connection_op_priority( Operation *op );
+static int connection_op_submit( Operation *op );
 static void connection_op_queue( Operation *op );
 static int connection_resched( Connection *conn );
 static void connection_abandon( Connection *conn );
 static void connection_destroy( Connection *c );
+static int connection_write_wait( ber_socket_t s, int wait );
 
 static ldap_pvt_thread_start_t connection_operation;
 
@@ -129,6 +144,12 @@ int connections_init(void)
 		ldap_pvt_thread_cond_init( &connections[i].c_write1_cv );
 	}
 
+#ifdef HAVE_TLS
+	ldap_pvt_thread_mutex_init( &conn_tls_mutex );
+	ldap_pvt_thread_cond_init( &conn_tls_cond );
+	conn_tls_ring = ch_malloc( dtblsize * sizeof( ber_socket_t ));
+	connections_tls_threads( slap_tls_thread_max );
+#endif
 
 	/*
 	 * per entry initialization of the Connection array initialization
@@ -153,12 +174,18 @@ int connections_destroy(void)
 		return -1;
 	}
 
+#ifdef HAVE_TLS
+	/* normally done when the daemon stops */
+	connections_tls_threads_stop();
+#endif
+
 	for ( i = 0; i < dtblsize; i++ ) {
 		if( connections[i].c_struct_state != SLAP_C_UNINITIALIZED ) {
 			ber_sockbuf_free( connections[i].c_sb );
 			ldap_pvt_thread_mutex_destroy( &connections[i].c_mutex );
 			ldap_pvt_thread_mutex_destroy( &connections[i].c_write1_mutex );
 			ldap_pvt_thread_cond_destroy( &connections[i].c_write1_cv );
+			ch_free( connections[i].c_ophash );
 #ifdef LDAP_SLAPI
 			if ( slapi_plugins_used ) {
 				slapi_int_free_object_extensions( SLAPI_X_EXT_CONNECTION,
@@ -171,6 +198,15 @@ int connections_destroy(void)
 	free( connections );
 	connections = NULL;
 
+#ifdef HAVE_TLS
+	ch_free( conn_tls_tids );
+	conn_tls_tids = NULL;
+	ch_free( conn_tls_ring );
+	conn_tls_ring = NULL;
+	ldap_pvt_thread_cond_destroy( &conn_tls_cond );
+	ldap_pvt_thread_mutex_destroy( &conn_tls_mutex );
+#endif
+
 	ldap_pvt_thread_mutex_destroy( &connections_mutex );
 	ldap_pvt_thread_mutex_destroy( &conn_nextid_mutex );
 	return 0;
@@ -210,32 +246,44 @@ int connections_shutdown(void)
  */
 int connections_timeout_idle(time_t now)
 {
-	int i = 0, writers = 0;
+	int i = 0;
 	ber_socket_t connindex;
 	Connection* c;
 
-	for( c = connection_first( &connindex );
-		c != NULL;
-		c = connection_next( c, &connindex ) )
-	{
+	if ( !global_idletimeout )
+		return 0;
+
+	/* This runs in the listener thread, so don't use connection_first()
+	 * and connection_next(): they lock every connection in turn and
+	 * wait for the ones a worker is busy with.  Peek at each slot
+	 * without locking instead, and lock only the connections that look
+	 * idle.  A connection whose lock is held is in use, not idle.
+	 */
+	for ( connindex = 0; connindex < dtblsize; connindex++ ) {
+		c = &connections[connindex];
+
+		if ( c->c_struct_state != SLAP_C_USED ||
+			difftime( c->c_activitytime+global_idletimeout, now ) >= 0 )
+			continue;
+
+		if ( ldap_pvt_thread_mutex_trylock( &c->c_mutex ))
+			continue;
+
 		/* Don't timeout a slow-running request or a persistent
 		 * outbound connection.
 		 */
-		if(( c->c_n_ops_executing && !c->c_writewaiter)
-			|| c->c_conn_state == SLAP_C_CLIENT ) {
-			continue;
-		}
-
-		if( global_idletimeout && 
-			difftime( c->c_activitytime+global_idletimeout, now) < 0 ) {
+		if ( c->c_struct_state == SLAP_C_USED &&
+			!( c->c_n_ops_executing && !c->c_writewaiter ) &&
+			c->c_conn_state != SLAP_C_CLIENT &&
+			difftime( c->c_activitytime+global_idletimeout, now ) < 0 )
+		{
 			/* close it */
 			connection_closing( c, "idletimeout" );
 			connection_close( c );
 			i++;
-			continue;
 		}
+		ldap_pvt_thread_mutex_unlock( &c->c_mutex );
 	}
-	connection_done( c );
 
 	return i;
 }
@@ -263,7 +311,12 @@ void connections_drop()
 	connection_done( c );
 }
 
-static Connection* connection_get( ber_socket_t s )
+/*
+ * Get the (locked) connection on socket s.  If busy is not NULL and
+ * another thread holds the connection, don't wait for it: set *busy
+ * and return NULL.
+ */
+static Connection* connection_get( ber_socket_t s, int *busy )
 {
 	Connection *c;
 
@@ -279,7 +332,12 @@ static Connection* connection_get( ber_socket_t s )
 	c = &connections[s];
 
 	if( c != NULL ) {
-		ldap_pvt_thread_mutex_lock( &c->c_mutex );
+		if ( busy == NULL ) {
+			ldap_pvt_thread_mutex_lock( &c->c_mutex );
+		} else if ( ldap_pvt_thread_mutex_trylock( &c->c_mutex )) {
+			*busy = 1;
+			return NULL;
+		}
 
 		assert( c->c_struct_state != SLAP_C_UNINITIALIZED );
 
@@ -383,9 +441,14 @@ Connection * connection_init(
 		LDAP_STAILQ_INIT(&c->c_pending_ops);
 
 		c->c_txn = CONN_TXN_INACTIVE;
+		c->c_txn_bulk = 0;
+		c->c_txn_busy = 0;
 		c->c_txn_backend = NULL;
 		LDAP_STAILQ_INIT(&c->c_txn_ops);
 
+		c->c_templates = NULL;
+		c->c_ntemplates = 0;
+
 		BER_BVZERO( &c->c_sasl_bind_mech );
 		c->c_sasl_done = 0;
 		c->c_sasl_authctx = NULL;
@@ -507,6 +570,16 @@ Connection * connection_init(
 			LBER_SBIOD_LEVEL_PROVIDER, (void *)&sfd );
 	}
 
+#ifdef LDAP_CONNECTIONLESS
+	if ( !c->c_is_udp )
+#endif /* LDAP_CONNECTIONLESS */
+	if ( sockbuf_readahead ) {
+		/* let pipelined requests be decoded from one read */
+		int size = sockbuf_readahead;
+		ber_sockbuf_add_io( c->c_sb, &ber_sockbuf_io_readahead,
+			LBER_SBIOD_LEVEL_PROVIDER, (void *)&size );
+	}
+
 #ifdef LDAP_DEBUG
 	ber_sockbuf_add_io( c->c_sb, &ber_sockbuf_io_debug,
 		INT_MAX, (void*)"ldap_" );
@@ -544,6 +617,7 @@ Connection * connection_init(
 	ldap_pvt_thread_mutex_lock( &connections_mutex );
 	c->c_conn_state = SLAP_C_INACTIVE;
 	c->c_struct_state = SLAP_C_USED;
+	conn_current++;
 	ldap_pvt_thread_mutex_unlock( &connections_mutex );
 	c->c_close_reason = "?";			/* should never be needed */
 
@@ -559,6 +633,7 @@ Connection * connection_init(
 		c->c_needs_tls_accept = 0;
 	}
 #endif
+	c->c_compress = 0;
 
 	slap_sasl_open( c, 0 );
 	slap_sasl_external( c, ssf, authid );
@@ -635,6 +710,7 @@ connection_destroy( Connection *c )
 
 	ldap_pvt_thread_mutex_lock( &connections_mutex );
 	c->c_struct_state = SLAP_C_PENDING;
+	conn_current--;
 	ldap_pvt_thread_mutex_unlock( &connections_mutex );
 
 	backend_connection_destroy(c);
@@ -664,11 +740,25 @@ connection_destroy( Connection *c )
 
 	slap_sasl_close( c );
 
+	search_templates_free( c );
+
 	if ( c->c_currentber != NULL ) {
 		ber_free( c->c_currentber, 1 );
 		c->c_currentber = NULL;
 	}
 
+	if ( c->c_wber != NULL ) {
+		ber_free( c->c_wber, 1 );
+		c->c_wber = NULL;
+	}
+	c->c_wlen = 0;
+	c->c_wctx = NULL;
+
+	if ( c->c_bber != NULL ) {
+		ber_free( c->c_bber, 1 );
+		c->c_bber = NULL;
+	}
+	c->c_bcount = 0;
 
 #ifdef LDAP_SLAPI
 	/* call destructors, then constructors; avoids unnecessary allocation */
@@ -728,6 +818,84 @@ int connection_valid( Connection *c )
 		c->c_conn_state <= SLAP_C_CLIENT;
 }
 
+#define CONN_OPHASH(msgid)	((unsigned)(msgid) & (SLAP_CONN_OPHASH-1))
+
+/*
+ * Append op to c_ops, or to c_pending_ops if o_pending is set, and
+ * index it by msgid so Abandon and Cancel don't have to walk the lists.
+ * Duplicate msgids are chained in arrival order.
+ * c_mutex must be locked by caller.
+ */
+void
+connection_op_add( Connection *c, Operation *op )
+{
+	Operation **opp;
+
+	if ( op->o_pending )
+		LDAP_STAILQ_INSERT_TAIL( &c->c_pending_ops, op, o_next );
+	else
+		LDAP_STAILQ_INSERT_TAIL( &c->c_ops, op, o_next );
+
+	if ( c->c_ophash == NULL )
+		c->c_ophash = ch_calloc( SLAP_CONN_OPHASH, sizeof( Operation * ));
+	for ( opp = &c->c_ophash[CONN_OPHASH( op->o_msgid )]; *opp;
+		opp = &(*opp)->o_hnext )
+		;
+	*opp = op;
+	op->o_hnext = NULL;
+}
+
+/*
+ * Take op off whichever list connection_op_add put it on.
+ * c_mutex must be locked by caller.
+ */
+void
+connection_op_remove( Connection *c, Operation *op )
+{
+	Operation **opp;
+
+	if ( op->o_pending ) {
+		LDAP_STAILQ_REMOVE( &c->c_pending_ops, op, Operation, o_next );
+		op->o_pending = 0;
+	} else {
+		LDAP_STAILQ_REMOVE( &c->c_ops, op, Operation, o_next );
+	}
+	LDAP_STAILQ_NEXT( op, o_next ) = NULL;
+
+	if ( c->c_ophash == NULL )
+		return;
+	for ( opp = &c->c_ophash[CONN_OPHASH( op->o_msgid )]; *opp;
+		opp = &(*opp)->o_hnext ) {
+		if ( *opp == op ) {
+			*opp = op->o_hnext;
+			break;
+		}
+	}
+	op->o_hnext = NULL;
+}
+
+/*
+ * Find the operation with the given msgid, preferring one that is
+ * executing over one that is pending. c_mutex must be locked by caller.
+ */
+Operation *
+connection_op_find( Connection *c, ber_int_t msgid )
+{
+	Operation *op, *pending = NULL;
+
+	if ( c->c_ophash == NULL )
+		return NULL;
+	for ( op = c->c_ophash[CONN_OPHASH( msgid )]; op; op = op->o_hnext ) {
+		if ( op->o_msgid != msgid )
+			continue;
+		if ( !op->o_pending )
+			return op;
+		if ( pending == NULL )
+			pending = op;
+	}
+	return pending;
+}
+
 static void connection_abandon( Connection *c )
 {
 	/* c_mutex must be locked by caller */
@@ -763,11 +931,11 @@ static void connection_abandon( Connection *c )
 	/* clear transaction */
 	c->c_txn_backend = NULL;
 	c->c_txn = CONN_TXN_INACTIVE;
+	c->c_txn_bulk = 0;
 
 	/* remove pending operations */
 	while ( (o = LDAP_STAILQ_FIRST( &c->c_pending_ops )) != NULL) {
-		LDAP_STAILQ_REMOVE_HEAD( &c->c_pending_ops, o_next );
-		LDAP_STAILQ_NEXT(o, o_next) = NULL;
+		connection_op_remove( c, o );
 		slap_op_free( o, NULL );
 	}
 }
@@ -870,6 +1038,18 @@ unsigned long connections_nextid(void)
 	return id;
 }
 
+/* Number of inbound connections, without walking the table */
+unsigned long connections_current(void)
+{
+	unsigned long n;
+
+	ldap_pvt_thread_mutex_lock( &connections_mutex );
+	n = conn_current;
+	ldap_pvt_thread_mutex_unlock( &connections_mutex );
+
+	return n;
+}
+
 /*
  * Loop through the connections:
  *
@@ -1026,7 +1206,15 @@ conn_counter_destroy( void *key, void *data )
 #ifdef SLAPD_MONITOR
 			for ( i = 0; i < SLAP_OP_LAST; i++ ) {
 				ldap_pvt_mp_add( slap_counters.sc_ops_initiated_[ i ], sc->sc_ops_initiated_[ i ] );
-				ldap_pvt_mp_add( slap_counters.sc_ops_initiated_[ i ], sc->sc_ops_completed_[ i ] );
+				ldap_pvt_mp_add( slap_counters.sc_ops_completed_[ i ], sc->sc_ops_completed_[ i ] );
+			}
+			if ( sc->sc_histo ) {
+				if ( slap_counters.sc_histo == NULL )
+					slap_counters.sc_histo = ch_calloc( SLAP_HISTO_NUM,
+						sizeof( slap_histo_t ));
+				for ( i = 0; i < SLAP_HISTO_NUM; i++ )
+					slap_histo_merge( &slap_counters.sc_histo[ i ],
+						&sc->sc_histo[ i ] );
 			}
 #endif /* SLAPD_MONITOR */
 			slap_counters_destroy( sc );
@@ -1059,6 +1247,48 @@ conn_counter_init( Operation *op, void *ctx )
 	op->o_counters = vsc;
 }
 
+#ifdef SLAPD_MONITOR
+/* Account the op's latency to this thread's histograms and to those
+ * of the database that answered it, if back-monitor keeps them.
+ */
+static void
+connection_op_histo( Operation *op, slap_op_t opidx )
+{
+	slap_counters_t *sc = op->o_counters;
+	slap_histo_t *h, *bh = op->o_histo;
+	unsigned long usec[ SLAP_PHASE_LAST ], total;
+	int i;
+
+	if ( !slap_histo_on )
+		return;
+
+	total = slap_histo_since( &op->o_xtime );
+	usec[ SLAP_PHASE_QUEUE ] = op->o_qtime.tv_sec * 1000000UL +
+		op->o_qtime.tv_usec;
+	usec[ SLAP_PHASE_ACL ] = op->o_acl_usec;
+	usec[ SLAP_PHASE_SEND ] = op->o_send_usec;
+	usec[ SLAP_PHASE_EXEC ] = total > op->o_acl_usec + op->o_send_usec
+		? total - op->o_acl_usec - op->o_send_usec : 0;
+
+	h = sc->sc_histo;
+	if ( h == NULL ) {
+		ldap_pvt_thread_mutex_lock( &sc->sc_mutex );
+		if ( sc->sc_histo == NULL )
+			sc->sc_histo = ch_calloc( SLAP_HISTO_NUM, sizeof( slap_histo_t ));
+		h = sc->sc_histo;
+		ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
+	}
+
+	for ( i = 0; i < SLAP_PHASE_LAST; i++ ) {
+		slap_histo_add( &h[ SLAP_HISTO_IDX( opidx, i ) ], usec[ i ] );
+		if ( bh )
+			slap_histo_add( &bh[ SLAP_HISTO_IDX( opidx, i ) ], usec[ i ] );
+	}
+}
+#else /* !SLAPD_MONITOR */
+#define connection_op_histo( op, opidx ) do { } while (0)
+#endif /* !SLAPD_MONITOR */
+
 void
 connection_op_finish( Operation *op )
 {
@@ -1068,6 +1298,9 @@ connection_op_finish( Operation *op )
 	assert( opidx != SLAP_OP_LAST );
 
 	INCR_OP_COMPLETED( opidx );
+	connection_op_histo( op, opidx );
+	slap_op_slowlog( op, NULL );
+	SLAP_PROBE4( op__done, op->o_connid, op->o_opid, op->o_tag, 0 );
 
 	ldap_pvt_thread_mutex_lock( &conn->c_mutex );
 
@@ -1076,8 +1309,7 @@ connection_op_finish( Operation *op )
 
 	ber_set_option( op->o_ber, LBER_OPT_BER_MEMCTX, &memctx_null );
 
-	LDAP_STAILQ_REMOVE( &conn->c_ops, op, Operation, o_next);
-	LDAP_STAILQ_NEXT(op, o_next) = NULL;
+	connection_op_remove( conn, op );
 	conn->c_n_ops_executing--;
 	conn->c_n_ops_completed++;
 	connection_resched( conn );
@@ -1098,6 +1330,7 @@ connection_operation( void *ctx, void *arg_v )
 	ber_len_t memsiz;
 
 	gettimeofday( &op->o_qtime, NULL );
+	op->o_xtime = op->o_qtime;
 	op->o_qtime.tv_usec -= op->o_tusec;
 	if ( op->o_qtime.tv_usec < 0 ) {
 		op->o_qtime.tv_usec += 1000000;
@@ -1182,9 +1415,15 @@ connection_operation( void *ctx, void *arg_v )
 	opidx = slap_req2op( tag );
 	assert( opidx != SLAP_OP_LAST );
 	INCR_OP_INITIATED( opidx );
+	SLAP_PROBE3( op__start, op->o_connid, op->o_opid, tag );
+	if ( slap_slowop_threshold > 0 )
+		op->o_profile = ch_calloc( 1, sizeof( slap_op_profile_t ) );
 	rc = (*(opfun[opidx]))( op, &rs );
 
 operations_error:
+	if ( rc != SLAPD_ASYNCOP )
+		SLAP_PROBE4( op__done, op->o_connid, op->o_opid, tag, rc );
+
 	if ( rc == SLAPD_DISCONNECT ) {
 		tag = LBER_ERROR;
 
@@ -1204,6 +1443,9 @@ operations_error:
 		 * only if operation was initiated
 		 * and rc != SLAPD_DISCONNECT */
 		INCR_OP_COMPLETED( opidx );
+		connection_op_histo( op, opidx );
+		/* searches were already logged by do_search() */
+		slap_op_slowlog( op, NULL );
 	}
 
 	ldap_pvt_thread_mutex_lock( &conn->c_mutex );
@@ -1234,9 +1476,16 @@ operations_error:
 
 	ber_set_option( op->o_ber, LBER_OPT_BER_MEMCTX, &memctx_null );
 
-	if ( rc != LDAP_TXN_SPECIFY_OKAY ) {
-		LDAP_STAILQ_REMOVE( &conn->c_ops, op, Operation, o_next);
-		LDAP_STAILQ_NEXT(op, o_next) = NULL;
+	connection_op_remove( conn, op );
+	if ( rc == LDAP_TXN_SPECIFY_OKAY ) {
+		/* nothing uses the update anymore, hand it to the txn */
+		conn->c_txn_busy--;
+		if ( conn->c_txn != CONN_TXN_INACTIVE ) {
+			LDAP_STAILQ_INSERT_TAIL( &conn->c_txn_ops, op, o_next );
+		} else {
+			/* the connection was closed, the txn is gone */
+			rc = LDAP_OTHER;
+		}
 	}
 	conn->c_n_ops_executing--;
 	conn->c_n_ops_completed++;
@@ -1293,7 +1542,7 @@ void connection_client_stop(
 	ber_socket_t s = c->c_sd;
 
 	/* get (locked) connection */
-	c = connection_get( s );
+	c = connection_get( s, NULL );
 
 	assert( c->c_conn_state == SLAP_C_CLIENT );
 
@@ -1313,12 +1562,75 @@ void connection_client_stop(
 	connection_return( c );
 }
 
+/* Per-thread cache of inbound BerElements. Their receive buffers are
+ * kept across PDUs, up to SLAP_RBUF_MAX bytes, so that a steady stream
+ * of small requests is read without going through malloc.
+ */
+#define SLAP_RBUF_CACHE	10
+#define SLAP_RBUF_MAX	4096
+
+typedef struct conn_bercache {
+	int bc_num;
+	BerElement *bc_bers[SLAP_RBUF_CACHE];
+} conn_bercache;
+
+static void
+connection_bercache_free( void *key, void *data )
+{
+	conn_bercache *bc = data;
+
+	while ( bc->bc_num > 0 )
+		ber_free( bc->bc_bers[--bc->bc_num], 1 );
+	ch_free( bc );
+}
+
+static BerElement *
+connection_ber_alloc( void *ctx )
+{
+	conn_bercache *bc = NULL;
+
+	if ( ctx ) {
+		ldap_pvt_thread_pool_getkey( ctx, (void *)connection_ber_alloc,
+			(void **)&bc, NULL );
+		if ( bc && bc->bc_num > 0 )
+			return bc->bc_bers[--bc->bc_num];
+	}
+	return ber_alloc();
+}
+
+void
+connection_ber_free( BerElement *ber, void *ctx )
+{
+	conn_bercache *bc = NULL;
+	void *memctx_null = NULL;
+
+	if ( ctx ) {
+		ldap_pvt_thread_pool_getkey( ctx, (void *)connection_ber_alloc,
+			(void **)&bc, NULL );
+		if ( !bc ) {
+			bc = ch_calloc( 1, sizeof( conn_bercache ));
+			if ( ldap_pvt_thread_pool_setkey( ctx, (void *)connection_ber_alloc,
+				bc, connection_bercache_free, NULL, NULL )) {
+				ch_free( bc );
+				bc = NULL;
+			}
+		}
+	}
+	if ( !bc || bc->bc_num >= SLAP_RBUF_CACHE ) {
+		ber_free( ber, 1 );
+		return;
+	}
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &memctx_null );
+	ber_pvt_ber_recycle( ber, SLAP_RBUF_MAX );
+	bc->bc_bers[bc->bc_num++] = ber;
+}
+
 static int connection_read( ber_socket_t s, conn_readinfo *cri );
 
 static void* connection_read_thread( void* ctx, void* argv )
 {
 	int rc ;
-	conn_readinfo cri = { NULL, NULL, NULL, NULL, 0 };
+	conn_readinfo cri = { NULL, NULL, NULL, NULL, 0, 0 };
 	ber_socket_t s = (long)argv;
 
 	/*
@@ -1341,6 +1653,115 @@ static void* connection_read_thread( void* ctx, void* argv )
 	return (void*)(long)rc;
 }
 
+#ifdef HAVE_TLS
+/*
+ * TLS handshakes may run on their own threads, so that a burst of new
+ * ldaps:// connections does not tie up the connection pool.  These are
+ * plain threads: the pool supports only one instance per process.
+ * Sockets wait in a ring; each is queued once while its reading is
+ * suspended, the ring falls back to the connection pool if it fills up.
+ */
+static void* connection_tls_thread( void *arg )
+{
+	int id = (long)arg;
+	ber_socket_t s;
+	conn_readinfo cri;
+
+	ldap_pvt_thread_mutex_lock( &conn_tls_mutex );
+	for (;;) {
+		/* threads beyond the configured count stay idle */
+		while ( !conn_tls_stop &&
+			( !conn_tls_count || id >= conn_tls_active ))
+			ldap_pvt_thread_cond_wait( &conn_tls_cond, &conn_tls_mutex );
+		if ( conn_tls_stop )
+			break;
+		s = conn_tls_ring[conn_tls_head];
+		conn_tls_head = ( conn_tls_head + 1 ) % dtblsize;
+		conn_tls_count--;
+		ldap_pvt_thread_mutex_unlock( &conn_tls_mutex );
+
+		memset( &cri, 0, sizeof( cri ));
+		cri.handshake = 1;
+		ldap_pvt_thread_rdwr_rlock( &slap_tls_thread_rwlock );
+		connection_read( s, &cri );
+		ldap_pvt_thread_rdwr_runlock( &slap_tls_thread_rwlock );
+
+		/* handshake done and a request already arrived, reading stays
+		 * suspended until the connection pool picks it up */
+		if ( cri.handshake > 1 )
+			ldap_pvt_thread_pool_submit( &connection_pool,
+				connection_read_thread, (void *)(long)s );
+
+		ldap_pvt_thread_mutex_lock( &conn_tls_mutex );
+	}
+	ldap_pvt_thread_mutex_unlock( &conn_tls_mutex );
+	return NULL;
+}
+
+static int connection_tls_submit( ber_socket_t s )
+{
+	int rc = -1;
+
+	ldap_pvt_thread_mutex_lock( &conn_tls_mutex );
+	if ( conn_tls_active > 0 && !conn_tls_stop && conn_tls_count < dtblsize ) {
+		conn_tls_ring[( conn_tls_head + conn_tls_count ) % dtblsize] = s;
+		conn_tls_count++;
+		ldap_pvt_thread_cond_broadcast( &conn_tls_cond );
+		rc = 0;
+	}
+	ldap_pvt_thread_mutex_unlock( &conn_tls_mutex );
+	return rc;
+}
+
+/* Set the number of handshake threads, 0 to run handshakes
+ * on the connection pool.  Surplus threads idle until shutdown.
+ */
+int connections_tls_threads( int num )
+{
+	int rc = 0;
+
+	if ( !conn_tls_ring )
+		return 0;
+
+	ldap_pvt_thread_mutex_lock( &conn_tls_mutex );
+	if ( num > conn_tls_started ) {
+		conn_tls_tids = ch_realloc( conn_tls_tids,
+			num * sizeof( ldap_pvt_thread_t ));
+		while ( conn_tls_started < num ) {
+			rc = ldap_pvt_thread_create( &conn_tls_tids[conn_tls_started],
+				0, connection_tls_thread, (void *)(long)conn_tls_started );
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY, "connections_tls_threads: "
+					"ldap_pvt_thread_create failed (%d)\n", rc );
+				break;
+			}
+			conn_tls_started++;
+		}
+	}
+	conn_tls_active = num < conn_tls_started ? num : conn_tls_started;
+	ldap_pvt_thread_cond_broadcast( &conn_tls_cond );
+	ldap_pvt_thread_mutex_unlock( &conn_tls_mutex );
+	return rc;
+}
+
+void connections_tls_threads_stop( void )
+{
+	int i;
+
+	if ( !conn_tls_ring )
+		return;
+
+	ldap_pvt_thread_mutex_lock( &conn_tls_mutex );
+	conn_tls_stop = 1;
+	ldap_pvt_thread_cond_broadcast( &conn_tls_cond );
+	ldap_pvt_thread_mutex_unlock( &conn_tls_mutex );
+
+	for ( i = 0; i < conn_tls_started; i++ )
+		ldap_pvt_thread_join( conn_tls_tids[i], NULL );
+	conn_tls_started = conn_tls_active = 0;
+}
+#endif
+
 int connection_read_activate( ber_socket_t s )
 {
 	int rc;
@@ -1354,8 +1775,17 @@ int connection_read_activate( ber_socket_t s )
 	if ( rc )
 		return rc;
 
-	rc = ldap_pvt_thread_pool_submit( &connection_pool,
-		connection_read_thread, (void *)(long)s );
+#ifdef HAVE_TLS
+	/* Unlocked peek: the flags only change while the connection is
+	 * being processed, and reading is suspended until it is done.
+	 */
+	if ( connections[s].c_is_tls && connections[s].c_needs_tls_accept &&
+		connection_tls_submit( s ) == 0 )
+		return 0;
+#endif
+
+	rc = ldap_pvt_thread_pool_submit_group( &connection_pool,
+		connection_read_thread, (void *)(long)s, 0, slapd_daemon_group( s ) );
 
 	if( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -1375,7 +1805,7 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 	assert( connections != NULL );
 
 	/* get (locked) connection */
-	c = connection_get( s );
+	c = connection_get( s, NULL );
 
 	if( c == NULL ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -1468,6 +1898,14 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 			connection_return( c );
 			return 0;
 		}
+
+		/* the handshake pool does not process operations, hand
+		 * the buffered input over to the connection pool */
+		if ( cri->handshake ) {
+			connection_return( c );
+			cri->handshake = 2;
+			return 0;
+		}
 	}
 #endif
 
@@ -1498,6 +1936,34 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 	}
 #endif
 
+#ifdef HAVE_ZLIB
+	if ( c->c_compress ) {
+		c->c_compress = 0;
+
+		/* The Start Compression response has been sent, the
+		 * client only compresses what it sends after it.
+		 */
+		ldap_pvt_thread_mutex_lock( &c->c_write1_mutex );
+		rc = ber_sockbuf_add_io( c->c_sb, &ber_sockbuf_io_zlib,
+			LBER_SBIOD_LEVEL_APPLICATION, NULL );
+		ldap_pvt_thread_mutex_unlock( &c->c_write1_mutex );
+		if ( rc < 0 ) {
+			Debug( LDAP_DEBUG_TRACE,
+				"connection_read(%d): compression install error "
+				"id=%lu, closing\n",
+				s, c->c_connid );
+
+			/* c_mutex is locked */
+			connection_closing( c, "compression layer install failure" );
+			connection_close( c );
+			connection_return( c );
+			return 0;
+		}
+		Debug( LDAP_DEBUG_STATS, "conn=%lu fd=%d compression started\n",
+			c->c_connid, (int) s );
+	}
+#endif
+
 #define CONNECTION_INPUT_LOOP 1
 /* #define	DATA_READY_LOOP 1 */
 
@@ -1552,7 +2018,7 @@ connection_input( Connection *conn , conn_readinfo *cri )
 	void *ctx;
 
 	if ( conn->c_currentber == NULL &&
-		( conn->c_currentber = ber_alloc()) == NULL )
+		( conn->c_currentber = connection_ber_alloc( cri->ctx )) == NULL )
 	{
 		Debug( LDAP_DEBUG_ANY, "ber_alloc failed\n" );
 		return -1;
@@ -1757,7 +2223,8 @@ connection_input( Connection *conn , conn_readinfo *cri )
 			"connection_input: conn=%lu deferring operation: %s\n",
 			conn->c_connid, defer );
 		conn->c_n_ops_pending++;
-		LDAP_STAILQ_INSERT_TAIL( &conn->c_pending_ops, op, o_next );
+		op->o_pending = 1;
+		connection_op_add( conn, op );
 		rc = ( conn->c_n_ops_pending > max ) ? -1 : 0;
 
 	} else {
@@ -1769,15 +2236,16 @@ connection_input( Connection *conn , conn_readinfo *cri )
 		 * Subsequent ops will be submitted to the pool by
 		 * calling connection_op_activate()
 		 */
-		if ( cri->op == NULL ) {
+		if ( cri->op == NULL && ( !connection_pool_reserve ||
+			connection_op_priority( op )))
+		{
 			/* the first incoming request */
 			connection_op_queue( op );
 			cri->op = op;
 		} else {
-			if ( !cri->nullop ) {
+			if ( cri->op && !cri->nullop ) {
 				cri->nullop = 1;
-				rc = ldap_pvt_thread_pool_submit( &connection_pool,
-					connection_operation, (void *) cri->op );
+				rc = connection_op_submit( cri->op );
 			}
 			connection_op_activate( op );
 		}
@@ -1811,8 +2279,7 @@ connection_resched( Connection *conn )
 	while ((op = LDAP_STAILQ_FIRST( &conn->c_pending_ops )) != NULL) {
 		if ( conn->c_n_ops_executing > connection_pool_max/2 ) break;
 
-		LDAP_STAILQ_REMOVE_HEAD( &conn->c_pending_ops, o_next );
-		LDAP_STAILQ_NEXT(op, o_next) = NULL;
+		connection_op_remove( conn, op );
 
 		/* pending operations should not be marked for abandonment */
 		assert(!op->o_abandon);
@@ -1951,7 +2418,82 @@ static void connection_op_queue( Operation *op )
 	op->o_connid = op->o_conn->c_connid;
 	connection_init_log_prefix( op );
 
-	LDAP_STAILQ_INSERT_TAIL( &op->o_conn->c_ops, op, o_next );
+	connection_op_add( op->o_conn, op );
+}
+
+/*
+ * Tell whether op may run on the thread queues kept free by
+ * threadreserve.  Called before the request is decoded, so only
+ * the operation type and, for searches, the scope are looked at.
+ */
+static int connection_op_priority( Operation *op )
+{
+	slap_mask_t ops = connection_pool_priority ?
+		connection_pool_priority : SLAP_PRIORITY_OP_DEFAULT;
+	slap_mask_t mask;
+
+	switch ( op->o_tag ) {
+	case LDAP_REQ_BIND:
+		mask = SLAP_RESTRICT_OP_BIND;
+		break;
+	case LDAP_REQ_ADD:
+		mask = SLAP_RESTRICT_OP_ADD;
+		break;
+	case LDAP_REQ_MODIFY:
+		mask = SLAP_RESTRICT_OP_MODIFY;
+		break;
+	case LDAP_REQ_MODRDN:
+		mask = SLAP_RESTRICT_OP_RENAME;
+		break;
+	case LDAP_REQ_DELETE:
+		mask = SLAP_RESTRICT_OP_DELETE;
+		break;
+	case LDAP_REQ_COMPARE:
+		mask = SLAP_RESTRICT_OP_COMPARE;
+		break;
+	case LDAP_REQ_EXTENDED:
+		mask = SLAP_RESTRICT_OP_EXTENDED;
+		break;
+	case LDAP_REQ_SEARCH:
+		mask = SLAP_RESTRICT_OP_SEARCH;
+		if ( ops & SLAP_PRIORITY_OP_BASE ) {
+			BerElementBuffer berbuf;
+			BerElement *ber = (BerElement *)&berbuf;
+			struct berval bv;
+			ber_int_t scope;
+
+			/* peek at the scope, leaving o_ber untouched */
+			if ( ber_peek_element( op->o_ber, &bv ) != LBER_ERROR ) {
+				ber_init2( ber, &bv, 0 );
+				if ( ber_scanf( ber, "{xi" /*}*/, &scope ) != LBER_ERROR &&
+					scope == LDAP_SCOPE_BASE )
+					mask |= SLAP_PRIORITY_OP_BASE;
+			}
+		}
+		break;
+	default:
+		/* abandon, unbind */
+		return 1;
+	}
+
+	return ( ops & mask ) != 0;
+}
+
+static int connection_op_submit( Operation *op )
+{
+	int bulk = connection_pool_reserve && !connection_op_priority( op );
+	int group = slapd_daemon_group( op->o_conn->c_sd );
+
+	if ( group >= 0 )
+		return ldap_pvt_thread_pool_submit_group( &connection_pool,
+			connection_operation, (void *) op, bulk, group );
+
+	if ( bulk )
+		return ldap_pvt_thread_pool_submit_bulk( &connection_pool,
+			connection_operation, (void *) op );
+
+	return ldap_pvt_thread_pool_submit( &connection_pool,
+		connection_operation, (void *) op );
 }
 
 static int connection_op_activate( Operation *op )
@@ -1960,8 +2502,7 @@ static int connection_op_activate( Operation *op )
 
 	connection_op_queue( op );
 
-	rc = ldap_pvt_thread_pool_submit( &connection_pool,
-		connection_operation, (void *) op );
+	rc = connection_op_submit( op );
 
 	if ( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -1973,15 +2514,37 @@ static int connection_op_activate( Operation *op )
 	return rc;
 }
 
+static void* connection_write_thread( void* ctx, void* argv )
+{
+	return (void*)(long)connection_write_wait( (long)argv, 1 );
+}
+
+/*
+ * Called from the listener thread to handle a write event.  If a worker
+ * holds the connection, the event is handed to the pool rather than
+ * stalling the listener until the worker is done.
+ */
 int connection_write(ber_socket_t s)
+{
+	return connection_write_wait( s, 0 );
+}
+
+static int connection_write_wait(ber_socket_t s, int wait)
 {
 	Connection *c;
 	Operation *op;
-	int wantwrite;
+	int wantwrite, drain, busy = 0;
 
 	assert( connections != NULL );
 
-	c = connection_get( s );
+	c = connection_get( s, wait ? NULL : &busy );
+	if ( busy ) {
+		slapd_clr_write( s, 0 );
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+			connection_write_thread, (void *)(long)s ) == 0 )
+			return 0;
+		c = connection_get( s, NULL );
+	}
 	if( c == NULL ) {
 		Debug( LDAP_DEBUG_ANY,
 			"connection_write(%ld): no connection!\n",
@@ -2005,7 +2568,16 @@ int connection_write(ber_socket_t s)
 		"connection_write(%d): waking output for id=%lu\n",
 		s, c->c_connid );
 
-	wantwrite = ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_NEEDS_WRITE, NULL );
+	/* write out what was left for the client */
+	drain = slap_write_drain( c );
+	if ( drain < 0 ) {
+		connection_closing( c, "connection lost on write" );
+		connection_close( c );
+		connection_return( c );
+		return 0;
+	}
+
+	wantwrite = drain || ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_NEEDS_WRITE, NULL );
 	if ( ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_NEEDS_READ, NULL )) {
 		/* don't wakeup twice */
 		slapd_set_read( s, !wantwrite );
@@ -2021,8 +2593,7 @@ int connection_write(ber_socket_t s)
 		if ( !c->c_writewaiter ) break;
 		if ( c->c_n_ops_executing > connection_pool_max/2 ) break;
 
-		LDAP_STAILQ_REMOVE_HEAD( &c->c_pending_ops, o_next );
-		LDAP_STAILQ_NEXT(op, o_next) = NULL;
+		connection_op_remove( c, op );
 
 		/* pending operations should not be marked for abandonment */
 		assert(!op->o_abandon);
@@ -2050,8 +2621,7 @@ int connection_write_resume( Connection *c )
 	while ((op = LDAP_STAILQ_FIRST( &c->c_pending_ops )) != NULL) {
 		if ( c->c_n_ops_executing > connection_pool_max/2 ) break;
 
-		LDAP_STAILQ_REMOVE_HEAD( &c->c_pending_ops, o_next );
-		LDAP_STAILQ_NEXT(op, o_next) = NULL;
+		connection_op_remove( c, op );
 
 		/* pending operations should not be marked for abandonment */
 		assert(!op->o_abandon);
@@ -114,6 +114,11 @@ static char *manageDSAit_extops[] = {
 	NULL
 };
 
+static char *txn_bulk_extops[] = {
+	LDAP_EXOP_TXN_START,
+	NULL
+};
+
 #ifdef SLAP_CONTROL_X_SESSION_TRACKING
 static char *session_tracking_extops[] = {
 	LDAP_EXOP_MODIFY_PASSWD,
@@ -183,6 +188,11 @@ static struct slap_control control_defs[] = {
 		SLAP_CTRL_GLOBAL|SLAP_CTRL_SEARCH|SLAP_CTRL_HIDE,
 		NULL, NULL,
 		parseSearchOptions, LDAP_SLIST_ENTRY_INITIALIZER(next) },
+	{ LDAP_CONTROL_X_SEARCH_TEMPLATE,
+ 		(int)offsetof(struct slap_control_ids, sc_searchTemplate),
+		SLAP_CTRL_GLOBAL|SLAP_CTRL_SEARCH,
+		NULL, NULL,
+		search_template_ctrl, LDAP_SLIST_ENTRY_INITIALIZER(next) },
 	{ LDAP_CONTROL_SUBENTRIES,
  		(int)offsetof(struct slap_control_ids, sc_subentries),
 		SLAP_CTRL_SEARCH,
@@ -203,6 +213,11 @@ static struct slap_control control_defs[] = {
 		SLAP_CTRL_UPDATE|SLAP_CTRL_HIDE,
 		NULL, NULL,
 		txn_spec_ctrl, LDAP_SLIST_ENTRY_INITIALIZER(next) },
+	{ LDAP_CONTROL_X_TXN_BULK,
+ 		(int)offsetof(struct slap_control_ids, sc_txnBulk),
+		SLAP_CTRL_GLOBAL,
+		txn_bulk_extops, NULL,
+		txn_bulk_ctrl, LDAP_SLIST_ENTRY_INITIALIZER(next) },
 	{ LDAP_CONTROL_MANAGEDSAIT,
  		(int)offsetof(struct slap_control_ids, sc_manageDSAit),
 		SLAP_CTRL_ACCESS,
@@ -1086,6 +1101,19 @@ slap_remove_control(
 	return rs->sr_err;
 }
 
+/* The sorted VLV window offered to the backend of this search, if any */
+SortedSearch *
+slap_sorted_search( Operation *op )
+{
+	OpExtra *oex;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == (void *)slap_sorted_search )
+			break;
+	}
+	return (SortedSearch *)oex;
+}
+
 static int parseDontUseCopy (
 	Operation *op,
 	SlapReply *rs,
@@ -30,6 +30,47 @@ const struct berval slap_ldapsync_bv = BER_BVC("ldapsync");
 const struct berval slap_ldapsync_cn_bv = BER_BVC("cn=ldapsync");
 int slap_serverID;
 
+/* Find the pending CSN queued by op. Look in the list of the SID of
+ * op's CSN first, it is only missing from there if o_csn changed after
+ * the CSN was queued. Returns with the list's mutex held if found.
+ */
+static struct slap_csn_entry *
+slap_find_pending_csn( BackendDB *be, Operation *op, int sid,
+	struct be_pcl_part **ppp )
+{
+	struct slap_csn_entry *csne;
+	struct be_pcl_part *pp, *first = NULL;
+	int i;
+
+	if ( sid != -1 ) {
+		first = SLAP_PCL_PART( be->be_pending_csn_list, sid );
+		ldap_pvt_thread_mutex_lock( &first->pp_mutex );
+		LDAP_TAILQ_FOREACH( csne, &first->pp_list, ce_csn_link ) {
+			if ( csne->ce_op == op ) {
+				*ppp = first;
+				return csne;
+			}
+		}
+		ldap_pvt_thread_mutex_unlock( &first->pp_mutex );
+	}
+
+	for ( i = 0; i < SLAP_PCL_PARTS; i++ ) {
+		pp = &be->be_pending_csn_list->pcl_parts[i];
+		if ( pp == first )
+			continue;
+		ldap_pvt_thread_mutex_lock( &pp->pp_mutex );
+		LDAP_TAILQ_FOREACH( csne, &pp->pp_list, ce_csn_link ) {
+			if ( csne->ce_op == op ) {
+				*ppp = pp;
+				return csne;
+			}
+		}
+		ldap_pvt_thread_mutex_unlock( &pp->pp_mutex );
+	}
+
+	return NULL;
+}
+
 /* maxcsn->bv_val must point to a char buf[LDAP_PVT_CSNSTR_BUFSIZE] */
 void
 slap_get_commit_csn(
@@ -39,6 +80,7 @@ slap_get_commit_csn(
 )
 {
 	struct slap_csn_entry *csne, *committed_csne = NULL;
+	struct be_pcl_part *pp = NULL;
 	BackendDB *be = op->o_bd->bd_self;
 	int sid = -1;
 
@@ -54,20 +96,26 @@ slap_get_commit_csn(
 		sid = slap_parse_csn_sid( &op->o_csn );
 	}
 
-	ldap_pvt_thread_mutex_lock( &be->be_pcl_mutex );
-
-	LDAP_TAILQ_FOREACH( csne, be->be_pending_csn_list, ce_csn_link ) {
-		if ( csne->ce_op == op ) {
-			csne->ce_state = SLAP_CSN_COMMIT;
-			if ( foundit ) *foundit = 1;
-			break;
+	csne = slap_find_pending_csn( be, op, sid, &pp );
+	if ( csne ) {
+		csne->ce_state = SLAP_CSN_COMMIT;
+		if ( foundit ) *foundit = 1;
+		if ( pp != SLAP_PCL_PART( be->be_pending_csn_list, sid )) {
+			ldap_pvt_thread_mutex_unlock( &pp->pp_mutex );
+			pp = NULL;
 		}
 	}
 
-	LDAP_TAILQ_FOREACH( csne, be->be_pending_csn_list, ce_csn_link ) {
-		if ( sid != -1 && sid == csne->ce_sid ) {
-			if ( csne->ce_state == SLAP_CSN_COMMIT ) committed_csne = csne;
-			if ( csne->ce_state == SLAP_CSN_PENDING ) break;
+	if ( sid != -1 ) {
+		if ( !pp ) {
+			pp = SLAP_PCL_PART( be->be_pending_csn_list, sid );
+			ldap_pvt_thread_mutex_lock( &pp->pp_mutex );
+		}
+		LDAP_TAILQ_FOREACH( csne, &pp->pp_list, ce_csn_link ) {
+			if ( sid == csne->ce_sid ) {
+				if ( csne->ce_state == SLAP_CSN_COMMIT ) committed_csne = csne;
+				if ( csne->ce_state == SLAP_CSN_PENDING ) break;
+			}
 		}
 	}
 
@@ -82,43 +130,50 @@ slap_get_commit_csn(
 			maxcsn->bv_val[0] = 0;
 		}
 	}
-	ldap_pvt_thread_mutex_unlock( &be->be_pcl_mutex );
+	if ( pp )
+		ldap_pvt_thread_mutex_unlock( &pp->pp_mutex );
 }
 
 void
 slap_rewind_commit_csn( Operation *op )
 {
 	struct slap_csn_entry *csne;
+	struct be_pcl_part *pp;
 	BackendDB *be = op->o_bd->bd_self;
+	int sid = -1;
 
-	ldap_pvt_thread_mutex_lock( &be->be_pcl_mutex );
-
-	LDAP_TAILQ_FOREACH( csne, be->be_pending_csn_list, ce_csn_link ) {
-		if ( csne->ce_op == op ) {
-			csne->ce_state = SLAP_CSN_PENDING;
-			break;
-		}
+	if ( !BER_BVISEMPTY( &op->o_csn )) {
+		sid = slap_parse_csn_sid( &op->o_csn );
 	}
 
-	ldap_pvt_thread_mutex_unlock( &be->be_pcl_mutex );
+	csne = slap_find_pending_csn( be, op, sid, &pp );
+	if ( csne ) {
+		csne->ce_state = SLAP_CSN_PENDING;
+		ldap_pvt_thread_mutex_unlock( &pp->pp_mutex );
+	}
 }
 
 void
 slap_graduate_commit_csn( Operation *op )
 {
 	struct slap_csn_entry *csne;
+	struct be_pcl_part *pp;
 	BackendDB *be;
+	int sid = -1;
 
 	if ( op == NULL ) return;
 	if ( op->o_bd == NULL ) return;
 	be = op->o_bd->bd_self;
 
-	ldap_pvt_thread_mutex_lock( &be->be_pcl_mutex );
+	if ( be->be_pending_csn_list ) {
+		if ( !BER_BVISEMPTY( &op->o_csn )) {
+			sid = slap_parse_csn_sid( &op->o_csn );
+		}
 
-	LDAP_TAILQ_FOREACH( csne, be->be_pending_csn_list, ce_csn_link ) {
-		if ( csne->ce_op == op ) {
-			LDAP_TAILQ_REMOVE( be->be_pending_csn_list,
-				csne, ce_csn_link );
+		csne = slap_find_pending_csn( be, op, sid, &pp );
+		if ( csne ) {
+			LDAP_TAILQ_REMOVE( &pp->pp_list, csne, ce_csn_link );
+			ldap_pvt_thread_mutex_unlock( &pp->pp_mutex );
 			Debug( LDAP_DEBUG_SYNC, "slap_graduate_commit_csn: removing %p %s\n",
 				csne, csne->ce_csn.bv_val );
 			if ( op->o_csn.bv_val == csne->ce_csn.bv_val ) {
@@ -126,12 +181,9 @@ slap_graduate_commit_csn( Operation *op )
 			}
 			ch_free( csne->ce_csn.bv_val );
 			ch_free( csne );
-			break;
 		}
 	}
 
-	ldap_pvt_thread_mutex_unlock( &be->be_pcl_mutex );
-
 	return;
 }
 
@@ -181,6 +233,7 @@ slap_queue_csn(
 	struct berval *csn )
 {
 	struct slap_csn_entry *pending;
+	struct be_pcl_part *pp;
 	BackendDB *be = op->o_bd->bd_self;
 
 	pending = (struct slap_csn_entry *) ch_calloc( 1,
@@ -194,10 +247,10 @@ slap_queue_csn(
 	pending->ce_op = op;
 	pending->ce_state = SLAP_CSN_PENDING;
 
-	ldap_pvt_thread_mutex_lock( &be->be_pcl_mutex );
-	LDAP_TAILQ_INSERT_TAIL( be->be_pending_csn_list,
-		pending, ce_csn_link );
-	ldap_pvt_thread_mutex_unlock( &be->be_pcl_mutex );
+	pp = SLAP_PCL_PART( be->be_pending_csn_list, pending->ce_sid );
+	ldap_pvt_thread_mutex_lock( &pp->pp_mutex );
+	LDAP_TAILQ_INSERT_TAIL( &pp->pp_list, pending, ce_csn_link );
+	ldap_pvt_thread_mutex_unlock( &pp->pp_mutex );
 }
 
 int
@@ -206,9 +259,14 @@ slap_get_csn(
 	struct berval *csn,
 	int manage_ctxcsn )
 {
+	lutil_csn cs;
+
 	if ( csn == NULL ) return LDAP_OTHER;
 
-	csn->bv_len = ldap_pvt_csnstr( csn->bv_val, csn->bv_len, slap_serverID, 0 );
+	ldap_pvt_gettime( &cs.cs_time );
+	cs.cs_sid = slap_serverID;
+	cs.cs_mod = 0;
+	csn->bv_len = lutil_csnstr( &cs, csn->bv_val, csn->bv_len );
 	Debug( LDAP_DEBUG_SYNC, "slap_get_csn: %s generated new csn=%s manage=%d\n",
 		op->o_log_prefix, csn->bv_val, manage_ctxcsn );
 	if ( manage_ctxcsn )
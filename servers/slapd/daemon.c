@@ -49,6 +49,13 @@
 # include <sys/types.h>
 # include <sys/event.h>
 # include <sys/time.h>
+#elif defined(SLAP_X_IOURING) && defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_IO_URING)
+# define SLAP_IOURING 1
+# include <sys/types.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <poll.h>
+# include <linux/io_uring.h>
 #elif defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL)
 # include <sys/epoll.h>
 #elif defined(SLAP_X_DEVPOLL) && defined(HAVE_SYS_DEVPOLL_H) && defined(HAVE_DEVPOLL)
@@ -56,7 +63,7 @@
 # include <sys/stat.h>
 # include <fcntl.h>
 # include <sys/devpoll.h>
-#endif /* ! kqueue && ! epoll && ! /dev/poll */
+#endif /* ! kqueue && ! io_uring && ! epoll && ! /dev/poll */
 
 #ifdef HAVE_TCPD
 int allow_severity = LOG_INFO;
@@ -82,8 +89,13 @@ slap_ssf_t local_ssf = LDAP_PVT_SASL_LOCAL_SSF;
 struct runqueue_s slapd_rq;
 
 int slapd_daemon_threads = 1;
+int slapd_listener_reuseport = 0;
 int slapd_daemon_mask;
 
+/* CPU groups the listener and worker threads are bound to */
+char **slapd_cpu_groups;
+int slapd_cpu_ngroups;
+
 #ifdef LDAP_TCP_BUFFER
 int slapd_tcp_rmem;
 int slapd_tcp_wmem;
@@ -128,6 +140,36 @@ SOCKET *slapd_ws_sockets;
 static ldap_pvt_thread_mutex_t	sd_tcpd_mutex;
 #endif /* TCP Wrappers */
 
+#ifdef SLAP_IOURING
+/* per-descriptor state of the io_uring backend */
+typedef struct slap_uring_fd {
+	unsigned	uf_gen;		/* generation of the armed poll */
+	short		uf_armed;	/* events the armed poll waits for */
+	char		uf_stall;	/* hangup seen, wait for a mask change */
+	char		uf_dirty;	/* queued in sd_dirty */
+} slap_uring_fd;
+
+/* the submission and completion rings of one listener thread */
+typedef struct slap_uring {
+	int			ur_fd;
+	unsigned		*ur_sqhead;
+	unsigned		*ur_sqtail;
+	unsigned		*ur_sqarray;
+	unsigned		ur_sqmask;
+	unsigned		ur_sqentries;
+	struct io_uring_sqe	*ur_sqes;
+	unsigned		*ur_cqhead;
+	unsigned		*ur_cqtail;
+	unsigned		ur_cqmask;
+	struct io_uring_cqe	*ur_cqes;
+	void			*ur_sqmap;
+	size_t			ur_sqmaplen;
+	void			*ur_cqmap;
+	size_t			ur_cqmaplen;
+	size_t			ur_sqeslen;
+} slap_uring;
+#endif /* SLAP_IOURING */
+
 typedef struct slap_daemon_st {
 	ldap_pvt_thread_mutex_t	sd_mutex;
 
@@ -149,6 +191,18 @@ typedef struct slap_daemon_st {
 	}               sd_kqc[2];
 	int             sd_changeidx; /* index to current change buffer */
 	int             sd_kq;
+#elif defined(SLAP_IOURING)
+	/* eXperimental */
+	struct pollfd		*sd_pollfd;	/* registered descriptors */
+	struct pollfd		*sd_revents;	/* results of the last wait */
+	int			*sd_index;
+	Listener		**sd_l;
+	slap_uring_fd		*sd_ufd;	/* indexed by fd */
+	int			*sd_dirty;	/* descriptors to (re)arm */
+	int			sd_ndirty;
+	__u64			*sd_cancel;	/* armed polls of removed fds */
+	int			sd_ncancel;
+	slap_uring		sd_ring;
 #elif defined(HAVE_EPOLL)
 
 	struct epoll_event	*sd_epolls;
@@ -169,7 +223,7 @@ typedef struct slap_daemon_st {
 	fd_set			sd_readers;
 	fd_set			sd_writers;
 #endif /* ! HAVE_WINSOCK */
-#endif /* ! kqueue && ! epoll && ! /dev/poll */
+#endif /* ! kqueue && ! io_uring && ! epoll && ! /dev/poll */
 } slap_daemon_st;
 
 static slap_daemon_st *slap_daemon;
@@ -181,7 +235,7 @@ static slap_daemon_st *slap_daemon;
  *   with file descriptors and events respectively
  *
  * - SLAP_<type>_* for private interface; type by now is one of
- *   EPOLL, DEVPOLL, SELECT, KQUEUE
+ *   EPOLL, DEVPOLL, SELECT, KQUEUE, IOURING
  *
  * private interface should not be used in the code.
  */
@@ -402,6 +456,479 @@ static slap_daemon_st *slap_daemon;
 
 /*-------------------------------------------------------------------------------*/
 
+#elif defined(SLAP_IOURING)
+
+/*************************************************************
+ * Use Linux io_uring infrastructure - io_uring(7)           *
+ *************************************************************/
+# define SLAP_EVENT_FNAME		"io_uring"
+# define SLAP_EVENTS_ARE_INDEXED	0
+/*
+ * Descriptors are watched with one-shot IORING_OP_POLL_ADD requests.
+ * All the requests needed by a wakeup are queued while building the
+ * event set and handed to the kernel by the same io_uring_enter(2)
+ * that waits for completions, so changing the interest of many sockets
+ * costs a single system call.
+ *
+ * - sd_pollfd	is the list of registered descriptors and the events
+ *		they are interested in; sd_index maps a fd to its slot
+ * - sd_l	is indexed by fd and holds the listener, if any
+ * - sd_ufd	tracks the poll request currently armed for each fd;
+ *		its generation is part of the request's user_data, so
+ *		completions for a closed and reused fd are recognized
+ *		and dropped
+ * - sd_dirty	lists the descriptors whose request must be re-armed
+ *
+ * Only the listener thread touches the rings; other threads merely
+ * update the interest masks under sd_mutex, as with select().
+ */
+# ifndef SLAP_IOURING_ENTRIES
+#  define SLAP_IOURING_ENTRIES	1024
+# endif
+
+# define SLAP_IOURING_UD(fd,gen)	(((__u64)((gen) & 0x7fffffffU) << 32) | (unsigned)(fd))
+# define SLAP_IOURING_UD_FD(ud)		((ber_socket_t)((ud) & 0xffffffffU))
+# define SLAP_IOURING_UD_GEN(ud)	((unsigned)((ud) >> 32) & 0x7fffffffU)
+/* completions of POLL_REMOVE requests carry this bit and are ignored */
+# define SLAP_IOURING_UD_IGNORE		((__u64)1 << 63)
+
+# define SLAP_IOURING_SOCK_IX(t,s)	(slap_daemon[t].sd_index[(s)])
+# define SLAP_IOURING_SOCK_LX(t,s)	(slap_daemon[t].sd_l[(s)])
+# define SLAP_IOURING_SOCK_UF(t,s)	(slap_daemon[t].sd_ufd[(s)])
+# define SLAP_IOURING_SOCK_EP(t,s)	(slap_daemon[t].sd_pollfd[SLAP_IOURING_SOCK_IX(t,(s))])
+# define SLAP_IOURING_SOCK_EV(t,s)	(SLAP_IOURING_SOCK_EP(t,(s)).events)
+# define SLAP_SOCK_IS_ACTIVE(t,s)		(SLAP_IOURING_SOCK_IX(t,(s)) != -1)
+# define SLAP_SOCK_NOT_ACTIVE(t,s)	(SLAP_IOURING_SOCK_IX(t,(s)) == -1)
+# define SLAP_IOURING_SOCK_IS_SET(t,s, mode)	(SLAP_IOURING_SOCK_EV(t,(s)) & (mode))
+
+# define SLAP_SOCK_IS_READ(t,s)		SLAP_IOURING_SOCK_IS_SET(t,(s), POLLIN)
+# define SLAP_SOCK_IS_WRITE(t,s)		SLAP_IOURING_SOCK_IS_SET(t,(s), POLLOUT)
+
+# define SLAP_IOURING_SOCK_DIRTY(t,s)	do { \
+	SLAP_IOURING_SOCK_UF(t,(s)).uf_stall = 0; \
+	if ( !SLAP_IOURING_SOCK_UF(t,(s)).uf_dirty ) { \
+		SLAP_IOURING_SOCK_UF(t,(s)).uf_dirty = 1; \
+		slap_daemon[t].sd_dirty[slap_daemon[t].sd_ndirty++] = (s); \
+	} \
+} while (0)
+
+# define SLAP_IOURING_SOCK_SET(t,s, mode)	do { \
+	if ( (SLAP_IOURING_SOCK_EV(t,(s)) & (mode)) != (mode) ) { \
+		SLAP_IOURING_SOCK_EV(t,(s)) |= (mode); \
+		SLAP_IOURING_SOCK_DIRTY(t,(s)); \
+	} \
+} while (0)
+
+# define SLAP_IOURING_SOCK_CLR(t,s, mode)	do { \
+	if ( (SLAP_IOURING_SOCK_EV(t,(s)) & (mode)) ) { \
+		SLAP_IOURING_SOCK_EV(t,(s)) &= ~(mode); \
+		SLAP_IOURING_SOCK_DIRTY(t,(s)); \
+	} \
+} while (0)
+
+# define SLAP_SOCK_SET_READ(t,s)		SLAP_IOURING_SOCK_SET(t,s, POLLIN)
+# define SLAP_SOCK_SET_WRITE(t,s)		SLAP_IOURING_SOCK_SET(t,s, POLLOUT)
+
+# define SLAP_SOCK_CLR_READ(t,s)		SLAP_IOURING_SOCK_CLR(t,(s), POLLIN)
+# define SLAP_SOCK_CLR_WRITE(t,s)		SLAP_IOURING_SOCK_CLR(t,(s), POLLOUT)
+
+# define SLAP_IOURING_EVENT_CLR(i, mode)	(revents[(i)].events &= ~(mode))
+
+# define SLAP_EVENT_MAX(t)			slap_daemon[t].sd_nfds
+
+# define SLAP_SOCK_ADD(t, s, l)		do { \
+	SLAP_IOURING_SOCK_IX(t,(s)) = slap_daemon[t].sd_nfds; \
+	SLAP_IOURING_SOCK_LX(t,(s)) = (l); \
+	SLAP_IOURING_SOCK_EP(t,(s)).fd = (s); \
+	SLAP_IOURING_SOCK_EV(t,(s)) = POLLIN; \
+	SLAP_IOURING_SOCK_UF(t,(s)).uf_gen++; \
+	SLAP_IOURING_SOCK_UF(t,(s)).uf_armed = 0; \
+	SLAP_IOURING_SOCK_DIRTY(t,(s)); \
+	slap_daemon[t].sd_nfds++; \
+} while (0)
+
+/* The armed poll keeps a reference to the socket, which would stay
+ * open after close(2) until the poll completes; have the listener
+ * thread cancel it right away.
+ */
+# define SLAP_SOCK_DEL(t,s)		do { \
+	int fd, index = SLAP_IOURING_SOCK_IX(t,(s)); \
+	if ( index < 0 ) break; \
+	if ( SLAP_IOURING_SOCK_UF(t,(s)).uf_armed ) { \
+		if ( slap_daemon[t].sd_ncancel < dtblsize ) { \
+			slap_daemon[t].sd_cancel[slap_daemon[t].sd_ncancel++] = \
+				SLAP_IOURING_UD((s), SLAP_IOURING_SOCK_UF(t,(s)).uf_gen); \
+		} \
+		SLAP_IOURING_SOCK_UF(t,(s)).uf_armed = 0; \
+		WAKE_LISTENER(t,1); \
+	} \
+	SLAP_IOURING_SOCK_UF(t,(s)).uf_gen++; \
+	if ( index < slap_daemon[t].sd_nfds - 1 ) { \
+		fd = slap_daemon[t].sd_pollfd[slap_daemon[t].sd_nfds - 1].fd; \
+		slap_daemon[t].sd_pollfd[index] = slap_daemon[t].sd_pollfd[slap_daemon[t].sd_nfds - 1]; \
+		slap_daemon[t].sd_index[fd] = index; \
+	} \
+	slap_daemon[t].sd_index[(s)] = -1; \
+	SLAP_IOURING_SOCK_LX(t,(s)) = NULL; \
+	slap_daemon[t].sd_nfds--; \
+} while (0)
+
+# define SLAP_EVENT_CLR_READ(i)		SLAP_IOURING_EVENT_CLR((i), POLLIN)
+# define SLAP_EVENT_CLR_WRITE(i)	SLAP_IOURING_EVENT_CLR((i), POLLOUT)
+
+# define SLAP_IOURING_EVENT_CHK(i, mode)	(revents[(i)].events & (mode))
+
+# define SLAP_EVENT_FD(t,i)		(revents[(i)].fd)
+
+# define SLAP_EVENT_IS_READ(i)		SLAP_IOURING_EVENT_CHK((i), POLLIN)
+# define SLAP_EVENT_IS_WRITE(i)		SLAP_IOURING_EVENT_CHK((i), POLLOUT)
+# define SLAP_EVENT_IS_LISTENER(t,i)	(SLAP_IOURING_SOCK_LX(t, SLAP_EVENT_FD(t,(i))) != NULL)
+# define SLAP_EVENT_LISTENER(t,i)		SLAP_IOURING_SOCK_LX(t, SLAP_EVENT_FD(t,(i)))
+
+static int
+slap_uring_setup( slap_uring *ur, unsigned entries )
+{
+	struct io_uring_params p;
+	int err;
+
+	memset( &p, 0, sizeof( p ) );
+	ur->ur_sqmap = ur->ur_cqmap = MAP_FAILED;
+	ur->ur_sqes = MAP_FAILED;
+
+	ur->ur_fd = syscall( __NR_io_uring_setup, entries, &p );
+	if ( ur->ur_fd < 0 ) {
+		return -1;
+	}
+
+	/* timed waits need IORING_ENTER_EXT_ARG (Linux 5.11) */
+	if ( !( p.features & IORING_FEAT_EXT_ARG ) ) {
+		err = ENOSYS;
+		goto fail;
+	}
+
+	ur->ur_sqmaplen = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+	ur->ur_cqmaplen = p.cq_off.cqes + p.cq_entries * sizeof( struct io_uring_cqe );
+	if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+		if ( ur->ur_cqmaplen > ur->ur_sqmaplen )
+			ur->ur_sqmaplen = ur->ur_cqmaplen;
+		ur->ur_cqmaplen = ur->ur_sqmaplen;
+	}
+
+	ur->ur_sqmap = mmap( NULL, ur->ur_sqmaplen, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ur->ur_fd, IORING_OFF_SQ_RING );
+	if ( ur->ur_sqmap == MAP_FAILED ) {
+		err = errno;
+		goto fail;
+	}
+
+	if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+		ur->ur_cqmap = ur->ur_sqmap;
+	} else {
+		ur->ur_cqmap = mmap( NULL, ur->ur_cqmaplen, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ur->ur_fd, IORING_OFF_CQ_RING );
+		if ( ur->ur_cqmap == MAP_FAILED ) {
+			err = errno;
+			goto fail;
+		}
+	}
+
+	ur->ur_sqeslen = p.sq_entries * sizeof( struct io_uring_sqe );
+	ur->ur_sqes = mmap( NULL, ur->ur_sqeslen, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ur->ur_fd, IORING_OFF_SQES );
+	if ( ur->ur_sqes == MAP_FAILED ) {
+		err = errno;
+		goto fail;
+	}
+
+	ur->ur_sqhead = (unsigned *)((char *)ur->ur_sqmap + p.sq_off.head);
+	ur->ur_sqtail = (unsigned *)((char *)ur->ur_sqmap + p.sq_off.tail);
+	ur->ur_sqarray = (unsigned *)((char *)ur->ur_sqmap + p.sq_off.array);
+	ur->ur_sqmask = *(unsigned *)((char *)ur->ur_sqmap + p.sq_off.ring_mask);
+	ur->ur_sqentries = p.sq_entries;
+
+	ur->ur_cqhead = (unsigned *)((char *)ur->ur_cqmap + p.cq_off.head);
+	ur->ur_cqtail = (unsigned *)((char *)ur->ur_cqmap + p.cq_off.tail);
+	ur->ur_cqmask = *(unsigned *)((char *)ur->ur_cqmap + p.cq_off.ring_mask);
+	ur->ur_cqes = (struct io_uring_cqe *)((char *)ur->ur_cqmap + p.cq_off.cqes);
+
+	return 0;
+
+fail:;
+	if ( ur->ur_sqes != MAP_FAILED )
+		munmap( ur->ur_sqes, ur->ur_sqeslen );
+	if ( ur->ur_cqmap != MAP_FAILED && ur->ur_cqmap != ur->ur_sqmap )
+		munmap( ur->ur_cqmap, ur->ur_cqmaplen );
+	if ( ur->ur_sqmap != MAP_FAILED )
+		munmap( ur->ur_sqmap, ur->ur_sqmaplen );
+	close( ur->ur_fd );
+	ur->ur_fd = -1;
+	errno = err;
+	return -1;
+}
+
+static void
+slap_uring_teardown( slap_uring *ur )
+{
+	if ( ur->ur_fd < 0 )
+		return;
+
+	munmap( ur->ur_sqes, ur->ur_sqeslen );
+	if ( ur->ur_cqmap != ur->ur_sqmap )
+		munmap( ur->ur_cqmap, ur->ur_cqmaplen );
+	munmap( ur->ur_sqmap, ur->ur_sqmaplen );
+	close( ur->ur_fd );
+	ur->ur_fd = -1;
+}
+
+static int
+slap_uring_enter( slap_uring *ur, int wait, struct timeval *tvp )
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned submit, flags = 0;
+	void *argp = NULL;
+	size_t argsz = 0;
+
+	submit = *ur->ur_sqtail - __atomic_load_n( ur->ur_sqhead, __ATOMIC_ACQUIRE );
+
+	if ( wait ) {
+		flags |= IORING_ENTER_GETEVENTS;
+		if ( tvp != NULL ) {
+			ts.tv_sec = tvp->tv_sec;
+			ts.tv_nsec = tvp->tv_usec * 1000;
+			memset( &arg, 0, sizeof( arg ) );
+			arg.ts = (__u64)(uintptr_t)&ts;
+			flags |= IORING_ENTER_EXT_ARG;
+			argp = &arg;
+			argsz = sizeof( arg );
+		}
+	}
+
+	return syscall( __NR_io_uring_enter, ur->ur_fd, submit,
+		wait ? 1 : 0, flags, argp, argsz );
+}
+
+/* queue a request; flush the ring to the kernel when it is full */
+static int
+slap_uring_queue( slap_uring *ur, int op, int fd, unsigned events,
+	__u64 addr, __u64 ud )
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail, idx;
+
+	tail = *ur->ur_sqtail;
+	if ( tail - __atomic_load_n( ur->ur_sqhead, __ATOMIC_ACQUIRE )
+		>= ur->ur_sqentries )
+	{
+		if ( slap_uring_enter( ur, 0, NULL ) < 0 ||
+			tail - __atomic_load_n( ur->ur_sqhead, __ATOMIC_ACQUIRE )
+				>= ur->ur_sqentries )
+		{
+			return -1;
+		}
+	}
+
+	idx = tail & ur->ur_sqmask;
+	sqe = &ur->ur_sqes[idx];
+	memset( sqe, 0, sizeof( *sqe ) );
+	sqe->opcode = op;
+	sqe->fd = fd;
+#if __BYTE_ORDER == __BIG_ENDIAN
+	events = ( events << 16 ) | ( events >> 16 );
+#endif
+	sqe->poll32_events = events;
+	sqe->addr = addr;
+	sqe->user_data = ud;
+	ur->ur_sqarray[idx] = idx;
+
+	__atomic_store_n( ur->ur_sqtail, tail + 1, __ATOMIC_RELEASE );
+
+	return 0;
+}
+
+/* called with sd_mutex held, while building the event set */
+static void
+slap_uring_arm( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	slap_uring *ur = &sd->sd_ring;
+	int i;
+
+	for ( i = 0; i < sd->sd_ncancel; i++ ) {
+		if ( slap_uring_queue( ur, IORING_OP_POLL_REMOVE, -1, 0,
+			sd->sd_cancel[i], SLAP_IOURING_UD_IGNORE ) )
+		{
+			break;
+		}
+	}
+	if ( i < sd->sd_ncancel ) {
+		memmove( sd->sd_cancel, &sd->sd_cancel[i],
+			( sd->sd_ncancel - i ) * sizeof( __u64 ) );
+	}
+	sd->sd_ncancel -= i;
+
+	for ( i = 0; i < sd->sd_ndirty; i++ ) {
+		ber_socket_t fd = sd->sd_dirty[i];
+		slap_uring_fd *uf = &sd->sd_ufd[fd];
+		short want;
+
+		if ( SLAP_SOCK_NOT_ACTIVE( t, fd ) ) {
+			uf->uf_dirty = 0;
+			continue;
+		}
+
+		want = SLAP_IOURING_SOCK_EV( t, fd );
+		if ( uf->uf_armed && uf->uf_armed != want ) {
+			if ( slap_uring_queue( ur, IORING_OP_POLL_REMOVE, -1, 0,
+				SLAP_IOURING_UD( fd, uf->uf_gen ), SLAP_IOURING_UD_IGNORE ) )
+			{
+				break;
+			}
+			uf->uf_armed = 0;
+			uf->uf_gen++;
+		}
+
+		if ( !uf->uf_armed && want && !uf->uf_stall ) {
+			if ( slap_uring_queue( ur, IORING_OP_POLL_ADD, fd, want,
+				0, SLAP_IOURING_UD( fd, uf->uf_gen ) ) )
+			{
+				break;
+			}
+			uf->uf_armed = want;
+		}
+		uf->uf_dirty = 0;
+	}
+
+	/* whatever could not be queued is retried on the next wait */
+	if ( i < sd->sd_ndirty ) {
+		memmove( sd->sd_dirty, &sd->sd_dirty[i],
+			( sd->sd_ndirty - i ) * sizeof( int ) );
+	}
+	sd->sd_ndirty -= i;
+}
+
+static int
+slap_uring_wait( int t, struct timeval *tvp )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	slap_uring *ur = &sd->sd_ring;
+	unsigned head, tail;
+	int rc, ns = 0;
+
+	rc = slap_uring_enter( ur,
+		tvp == NULL || tvp->tv_sec || tvp->tv_usec, tvp );
+	if ( rc < 0 && errno != ETIME && errno != EBUSY ) {
+		return -1;
+	}
+
+	ldap_pvt_thread_mutex_lock( &sd->sd_mutex );
+	head = *ur->ur_cqhead;
+	tail = __atomic_load_n( ur->ur_cqtail, __ATOMIC_ACQUIRE );
+	for ( ; head != tail && ns < dtblsize; head++ ) {
+		struct io_uring_cqe *cqe = &ur->ur_cqes[head & ur->ur_cqmask];
+		ber_socket_t fd;
+		slap_uring_fd *uf;
+		short revents, want;
+
+		if ( cqe->user_data & SLAP_IOURING_UD_IGNORE )
+			continue;
+
+		fd = SLAP_IOURING_UD_FD( cqe->user_data );
+		if ( fd < 0 || fd >= dtblsize || SLAP_SOCK_NOT_ACTIVE( t, fd ) )
+			continue;
+
+		uf = &sd->sd_ufd[fd];
+		if ( !uf->uf_armed ||
+			( uf->uf_gen & 0x7fffffffU ) != SLAP_IOURING_UD_GEN( cqe->user_data ) )
+		{
+			/* stale: cancelled, or the fd was closed and reused */
+			continue;
+		}
+
+		uf->uf_armed = 0;
+		uf->uf_gen++;
+		SLAP_IOURING_SOCK_DIRTY( t, fd );
+
+		if ( cqe->res == -ECANCELED )
+			continue;
+
+		revents = cqe->res < 0 ? POLLERR : cqe->res;
+		want = SLAP_IOURING_SOCK_EV( t, fd );
+
+		/* let the reader or writer notice the failure */
+		if ( revents & ( POLLHUP | POLLERR | POLLNVAL ) )
+			revents |= want;
+		revents &= want;
+
+		if ( !revents ) {
+			/* don't keep reporting the hangup */
+			uf->uf_stall = 1;
+			continue;
+		}
+
+		sd->sd_revents[ns].fd = fd;
+		sd->sd_revents[ns].events = revents;
+		ns++;
+	}
+	__atomic_store_n( ur->ur_cqhead, head, __ATOMIC_RELEASE );
+	ldap_pvt_thread_mutex_unlock( &sd->sd_mutex );
+
+	return ns;
+}
+
+# define SLAP_SOCK_DESTROY(t)		do { \
+	if ( slap_daemon[t].sd_pollfd != NULL ) { \
+		slap_uring_teardown( &slap_daemon[t].sd_ring ); \
+		ch_free( slap_daemon[t].sd_pollfd ); \
+		slap_daemon[t].sd_pollfd = NULL; \
+		slap_daemon[t].sd_revents = NULL; \
+		slap_daemon[t].sd_index = NULL; \
+		slap_daemon[t].sd_l = NULL; \
+		slap_daemon[t].sd_ufd = NULL; \
+		slap_daemon[t].sd_dirty = NULL; \
+		slap_daemon[t].sd_cancel = NULL; \
+	} \
+} while ( 0 )
+
+# define SLAP_SOCK_INIT(t)		do { \
+	int j; \
+	slap_daemon[t].sd_pollfd = ch_calloc( 1, \
+		( sizeof(struct pollfd) * 2 \
+			+ sizeof( __u64 ) \
+			+ sizeof( slap_uring_fd ) \
+			+ sizeof( Listener * ) \
+			+ sizeof( int ) * 2 ) * dtblsize ); \
+	slap_daemon[t].sd_revents = &slap_daemon[t].sd_pollfd[ dtblsize ]; \
+	slap_daemon[t].sd_cancel = (__u64 *)&slap_daemon[t].sd_revents[ dtblsize ]; \
+	slap_daemon[t].sd_ufd = (slap_uring_fd *)&slap_daemon[t].sd_cancel[ dtblsize ]; \
+	slap_daemon[t].sd_l = (Listener **)&slap_daemon[t].sd_ufd[ dtblsize ]; \
+	slap_daemon[t].sd_index = (int *)&slap_daemon[t].sd_l[ dtblsize ]; \
+	slap_daemon[t].sd_dirty = &slap_daemon[t].sd_index[ dtblsize ]; \
+	for ( j = 0; j < dtblsize; j++ ) slap_daemon[t].sd_index[j] = -1; \
+	if ( slap_uring_setup( &slap_daemon[t].sd_ring, \
+		SLAP_IOURING_ENTRIES ) ) \
+	{ \
+		Debug( LDAP_DEBUG_ANY, "daemon: " SLAP_EVENT_FNAME ": " \
+			"io_uring_setup() failed errno=%d\n", \
+			errno ); \
+		SLAP_SOCK_DESTROY(t); \
+		return -1; \
+	} \
+} while (0)
+
+# define SLAP_SOCK_INIT2()
+
+# define SLAP_EVENT_DECL		struct pollfd *revents
+
+# define SLAP_EVENT_INIT(t)		do { \
+	slap_uring_arm( t ); \
+	revents = slap_daemon[t].sd_revents; \
+} while (0)
+
+# define SLAP_EVENT_WAIT(t, tvp, nsp)	do { \
+	*(nsp) = slap_uring_wait( (t), (tvp) ); \
+} while (0)
+
 #elif defined(HAVE_EPOLL)
 /***************************************
  * Use epoll infrastructure - epoll(4) *
@@ -1559,6 +2086,7 @@ slap_open_listener(
 	int err, addrlen = 0;
 	struct sockaddr **sal = NULL, **psal;
 	int socktype = SOCK_STREAM;	/* default to COTS */
+	int nsock = 1, nclone = 0;
 	ber_socket_t s;
 
 #if defined(LDAP_PF_LOCAL) || defined(SLAP_X_LISTENER_MOD)
@@ -1653,8 +2181,25 @@ slap_open_listener(
 	 * for it in the slap_listeners array.
 	 */
 	for ( num=0; sal[num]; num++ ) /* empty */;
-	if ( num > 1 ) {
-		*listeners += num-1;
+
+#ifdef SO_REUSEPORT
+	/* With SO_REUSEPORT, open several sockets on each TCP address
+	 * so that the kernel spreads incoming connections over them.
+	 * The sockets are opened back to back, so their descriptors
+	 * are normally polled by different listener threads.
+	 */
+	if ( slapd_listener_reuseport > 1
+#ifdef LDAP_CONNECTIONLESS
+		&& !l.sl_is_udp
+#endif /* LDAP_CONNECTIONLESS */
+		)
+	{
+		nsock = slapd_listener_reuseport;
+	}
+#endif /* SO_REUSEPORT */
+
+	if ( num * nsock > 1 ) {
+		*listeners += num * nsock - 1;
 		slap_listeners = ch_realloc( slap_listeners,
 			(*listeners + 1) * sizeof(Listener *) );
 	}
@@ -1691,6 +2236,7 @@ slap_open_listener(
 			Debug( LDAP_DEBUG_ANY,
 				"daemon: %s socket() failed errno=%d (%s)\n",
 				af, err, sock_errstr(err) );
+			nclone = 0;
 			sal++;
 			continue;
 		}
@@ -1701,6 +2247,7 @@ slap_open_listener(
 				"daemon: listener descriptor %ld is too great %ld\n",
 				(long) l.sl_sd, (long) dtblsize );
 			tcp_close( s );
+			nclone = 0;
 			sal++;
 			continue;
 		}
@@ -1723,6 +2270,20 @@ slap_open_listener(
 					(long) l.sl_sd, err, sock_errstr(err) );
 			}
 #endif /* SO_REUSEADDR */
+#ifdef SO_REUSEPORT
+			/* share the address among the listener threads */
+			if ( nsock > 1 ) {
+				tmp = 1;
+				rc = setsockopt( s, SOL_SOCKET, SO_REUSEPORT,
+					(char *) &tmp, sizeof(tmp) );
+				if ( rc == AC_SOCKET_ERROR ) {
+					int err = sock_errno();
+					Debug( LDAP_DEBUG_ANY, "slapd(%ld): "
+						"setsockopt(SO_REUSEPORT) failed errno=%d (%s)\n",
+						(long) l.sl_sd, err, sock_errstr(err) );
+				}
+			}
+#endif /* SO_REUSEPORT */
 		}
 
 		switch( (*sal)->sa_family ) {
@@ -1789,6 +2350,7 @@ slap_open_listener(
 				"daemon: bind(%ld) failed errno=%d (%s)\n",
 				(long)l.sl_sd, err, sock_errstr( err ) );
 			tcp_close( s );
+			nclone = 0;
 			sal++;
 			continue;
 		}
@@ -1850,6 +2412,15 @@ slap_open_listener(
 		*li = l;
 		slap_listeners[*cur] = li;
 		(*cur)++;
+
+#ifdef LDAP_PF_LOCAL
+		if ( (*sal)->sa_family != AF_LOCAL )
+#endif /* LDAP_PF_LOCAL */
+		if ( ++nclone < nsock ) {
+			/* open another socket on the same address */
+			continue;
+		}
+		nclone = 0;
 		sal++;
 	}
 
@@ -1919,6 +2490,9 @@ slapd_daemon_init( const char *urls )
 	}
 	ber_pvt_socket_set_nonblock( wake_sds[0][1], 1 );
 
+	/* thread 0 runs the runqueue, wake it for tasks due sooner */
+	slapd_rq.rq_wake = slap_wake_listener;
+
 	SLAP_SOCK_INIT(0);
 
 	if( urls == NULL ) urls = "ldap:///";
@@ -2036,6 +2610,8 @@ slapd_daemon_destroy( void )
 	if ( daemon_inited ) {
 		int i;
 
+		slapd_rq.rq_wake = NULL;
+
 		for ( i=0; i<slapd_daemon_threads; i++ ) {
 #ifdef HAVE_WINSOCK
 			if ( wake_sds[i][1] != INVALID_SOCKET &&
@@ -2506,6 +3082,9 @@ slapd_daemon_task(
 
 #define SLAPD_IDLE_CHECK_LIMIT 4
 
+	if ( slapd_cpu_ngroups )
+		ldap_pvt_thread_set_affinity( slapd_cpu_groups[tid % slapd_cpu_ngroups] );
+
 	slapd_add( wake_sds[tid][0], 0, NULL, tid );
 	if ( tid )
 		goto loop;
@@ -3172,7 +3751,7 @@ loop:
 					SLAP_EVENT_CLR_READ( i );
 					connection_read_activate( fd );
 				} else if ( !w ) {
-#ifdef HAVE_EPOLL
+#if defined(HAVE_EPOLL) && !defined(SLAP_IOURING)
 					/* Don't keep reporting the hangup
 					 */
 					if ( SLAP_SOCK_IS_ACTIVE( tid, fd )) {
@@ -3234,6 +3813,10 @@ loop:
 			"slapd shutdown: waiting for %d operations/tasks to finish\n",
 			t );
 	}
+#ifdef HAVE_TLS
+	connections_tls_threads_stop();
+#endif
+	slap_passwd_offload_stop();
 	ldap_pvt_thread_pool_close( &connection_pool, 1 );
 
 	return NULL;
@@ -3258,6 +3841,46 @@ slapd_daemon_tid_cleanup(
 	return NULL;
 }
 
+/* Set the CPU groups, NULL to unbind. Listener threads pick them up
+ * when they start, worker threads as they are opened.
+ */
+int
+slapd_thread_affinity( char **groups )
+{
+	char **old = slapd_cpu_groups;
+	int rc, n;
+
+	rc = ldap_pvt_thread_pool_affinity( &connection_pool, groups );
+	if ( rc )
+		return rc;
+
+	slapd_cpu_ngroups = 0;
+	slapd_cpu_groups = groups ? ldap_charray_dup( groups ) : NULL;
+	for ( n = 0; groups && groups[n]; n++ )
+		;
+	slapd_cpu_ngroups = n;
+	if ( old )
+		ldap_charray_free( old );
+	return 0;
+}
+
+/* The CPU group whose worker threads should process requests
+ * from connection s: that of the listener thread reading it,
+ * or a spread of the connections if there are fewer listener
+ * threads than groups. -1 when threads are not bound.
+ */
+int
+slapd_daemon_group( ber_socket_t s )
+{
+	int n = slapd_cpu_ngroups;
+
+	if ( n < 2 )
+		return -1;
+	if ( slapd_daemon_threads >= n )
+		return DAEMON_ID(s) % n;
+	return s % n;
+}
+
 int
 slapd_daemon_resize( int newnum )
 {
@@ -3531,6 +4154,12 @@ slap_pause_server( void )
 	int rc = LDAP_SUCCESS;
 
 	rc = ldap_pvt_thread_pool_pause( &connection_pool );
+#ifdef HAVE_TLS
+	/* the TLS handshake threads are not pool threads, keep them
+	 * off slap_tls_ctx while paused */
+	ldap_pvt_thread_rdwr_wlock( &slap_tls_thread_rwlock );
+#endif
+	slap_passwd_offload_pause( 1 );
 
 	LDAP_STAILQ_FOREACH(bi, &backendInfo, bi_next) {
 		if ( bi->bi_pause ) {
@@ -3565,6 +4194,10 @@ slap_unpause_server( void )
 		}
 	}
 
+	slap_passwd_offload_pause( 0 );
+#ifdef HAVE_TLS
+	ldap_pvt_thread_rdwr_wunlock( &slap_tls_thread_rwlock );
+#endif
 	rc = ldap_pvt_thread_pool_resume( &connection_pool );
 	return rc;
 }
@@ -3647,3 +4280,49 @@ slapd_wait_writer( ber_socket_t sd )
 	return poll( &fds, 1, timeout );
 #endif
 }
+
+/*
+ * Wait up to msec milliseconds for any of the n sockets in sds to
+ * become writable. Sockets that can be written to, or that failed,
+ * get a nonzero ready flag. Returns how many did, 0 on timeout or -1.
+ */
+int
+slapd_wait_writers( ber_socket_t *sds, int n, char *ready, int msec )
+{
+	int i, rc;
+#ifdef HAVE_WINSOCK
+	fd_set writefds, exceptfds;
+	struct timeval tv;
+
+	FD_ZERO( &writefds );
+	FD_ZERO( &exceptfds );
+	for ( i = 0; i < n; i++ ) {
+		FD_SET( slapd_ws_sockets[sds[i]], &writefds );
+		FD_SET( slapd_ws_sockets[sds[i]], &exceptfds );
+	}
+	tv.tv_sec = msec / 1000;
+	tv.tv_usec = ( msec % 1000 ) * 1000;
+	rc = select( 0, NULL, &writefds, &exceptfds, &tv );
+	for ( i = 0; i < n; i++ ) {
+		ready[i] = rc > 0 &&
+			( FD_ISSET( slapd_ws_sockets[sds[i]], &writefds ) ||
+			FD_ISSET( slapd_ws_sockets[sds[i]], &exceptfds ));
+	}
+#else
+	struct pollfd one, *fds = &one;
+
+	if ( n > 1 )
+		fds = ch_malloc( n * sizeof( struct pollfd ));
+	for ( i = 0; i < n; i++ ) {
+		fds[i].fd = sds[i];
+		fds[i].events = POLLOUT;
+		fds[i].revents = 0;
+	}
+	rc = poll( fds, n, msec );
+	for ( i = 0; i < n; i++ )
+		ready[i] = rc > 0 && fds[i].revents != 0;
+	if ( fds != &one )
+		ch_free( fds );
+#endif
+	return rc;
+}
@@ -412,11 +412,8 @@ LDAPDN_rewrite( LDAPDN dn, unsigned flags, void *ctx )
 	return LDAP_SUCCESS;
 }
 
-int
-dnNormalize(
-    slap_mask_t use,
-    Syntax *syntax,
-    MatchingRule *mr,
+static int
+dn_normalize(
     struct berval *val,
     struct berval *out,
     void *ctx)
@@ -468,6 +465,24 @@ dnNormalize(
 	return LDAP_SUCCESS;
 }
 
+int
+dnNormalize(
+    slap_mask_t use,
+    Syntax *syntax,
+    MatchingRule *mr,
+    struct berval *val,
+    struct berval *out,
+    void *ctx)
+{
+	slap_prof_ctx_t pc;
+	int rc;
+
+	SLAP_PROF_BEGIN( pc, SLAP_PROF_NORMALIZE );
+	rc = dn_normalize( val, out, ctx );
+	SLAP_PROF_END( pc, SLAP_PROF_NORMALIZE );
+	return rc;
+}
+
 int
 rdnNormalize(
     slap_mask_t use,
@@ -694,8 +709,8 @@ dnPrettyNormalDN(
 /*
  * Combination of both dnPretty and dnNormalize
  */
-int
-dnPrettyNormal(
+static int
+dn_pretty_normal(
 	Syntax *syntax,
 	struct berval *val,
 	struct berval *pretty,
@@ -775,6 +790,23 @@ dnPrettyNormal(
 	return LDAP_SUCCESS;
 }
 
+int
+dnPrettyNormal(
+	Syntax *syntax,
+	struct berval *val,
+	struct berval *pretty,
+	struct berval *normal,
+	void *ctx)
+{
+	slap_prof_ctx_t pc;
+	int rc;
+
+	SLAP_PROF_BEGIN( pc, SLAP_PROF_NORMALIZE );
+	rc = dn_pretty_normal( syntax, val, pretty, normal, ctx );
+	SLAP_PROF_END( pc, SLAP_PROF_NORMALIZE );
+	return rc;
+}
+
 /*
  * dnMatch routine
  */
@@ -1264,14 +1296,8 @@ dnIsSuffixScope( struct berval *ndn, struct berval *nbase, int scope )
 int
 dnIsOneLevelRDN( struct berval *rdn )
 {
-	ber_len_t	len = rdn->bv_len;
-	for ( ; len--; ) {
-		if ( DN_SEPARATOR( rdn->bv_val[ len ] ) ) {
-			return 0;
-		}
-	}
-
-	return 1;
+	/* same cheat as dnRdn(): input is pretty or normalized */
+	return ber_bvchr( rdn, ',' ) == NULL;
 }
 
 #ifdef HAVE_TLS
@@ -37,8 +37,7 @@
 #include "ldif.h"
 
 static char		*ebuf;	/* buf returned by entry2str		 */
-static char		*ecur;	/* pointer to end of currently used ebuf */
-static int		emaxsize;/* max size of ebuf			 */
+static ber_len_t	emaxsize;/* max size of ebuf			 */
 
 /*
  * Empty root entry
@@ -68,12 +67,26 @@ static slap_list *entry_chunks;
 static Entry *entry_list;
 static ldap_pvt_thread_mutex_t entry_mutex;
 
+/*
+ * Per-thread free lists in front of entry_list, as for Attributes
+ * in attr.c; entries are linked through e_private.
+ */
+#define	ENTRY_LOCAL_BATCH	32
+#define	ENTRY_LOCAL_MAX	(4*ENTRY_LOCAL_BATCH)
+typedef struct entry_local {
+	Entry *el_list;
+	int el_num;
+	unsigned long el_hits;	/* not yet added to entry_local_hits */
+} entry_local;
+static ldap_pvt_thread_key_t entry_local_key;
+static void *entry_main_ctx;
+static unsigned long entry_local_hits, entry_local_misses;
+
 int entry_destroy(void)
 {
 	slap_list *e;
 	if ( ebuf ) free( ebuf );
 	ebuf = NULL;
-	ecur = NULL;
 	emaxsize = 0;
 
 	for ( e=entry_chunks; e; e=entry_chunks ) {
@@ -83,6 +96,7 @@ int entry_destroy(void)
 
 	ldap_pvt_thread_mutex_destroy( &entry_mutex );
 	ldap_pvt_thread_mutex_destroy( &entry2str_mutex );
+	ldap_pvt_thread_key_destroy( entry_local_key );
 	return attr_destroy();
 }
 
@@ -91,6 +105,8 @@ entry_init(void)
 {
 	ldap_pvt_thread_mutex_init( &entry2str_mutex );
 	ldap_pvt_thread_mutex_init( &entry_mutex );
+	ldap_pvt_thread_key_create( &entry_local_key );
+	entry_main_ctx = ldap_pvt_thread_pool_context();
 	return attr_init();
 }
 
@@ -372,52 +388,50 @@ fail:
 
 #define GRABSIZE	BUFSIZ
 
-#define MAKE_SPACE( n )	{ \
-		while ( ecur + (n) > ebuf + emaxsize ) { \
-			ptrdiff_t	offset; \
-			offset = (int) (ecur - ebuf); \
-			ebuf = ch_realloc( ebuf, \
-				emaxsize + GRABSIZE ); \
-			emaxsize += GRABSIZE; \
-			ecur = ebuf + offset; \
-		} \
-	}
-
-/* NOTE: only preserved for binary compatibility */
-char *
-entry2str(
-	Entry	*e,
-	int		*len )
-{
-	return entry2str_wrap( e, len, LDIF_LINE_WIDTH );
-}
-
-char *
-entry2str_wrap(
+static char *
+entry2str_buf(
 	Entry		*e,
 	int			*len,
-	ber_len_t	wrap )
+	ber_len_t	wrap,
+	char		**bufp,
+	ber_len_t	*sizep )
 {
 	Attribute	*a;
 	struct berval	*bv;
 	int		i;
-	ber_len_t tmplen;
+	ber_len_t tmplen, size = 1;
+	char		*ecur;
 
 	assert( e != NULL );
 
+	/* LDIF_SIZE_NEEDED_WRAP is an upper bound, so the buffer
+	 * can be sized once up front.
+	 */
+	if ( e->e_dn != NULL )
+		size += LDIF_SIZE_NEEDED_WRAP( 2, e->e_name.bv_len, wrap );
+	for ( a = e->e_attrs; a != NULL; a = a->a_next ) {
+		tmplen = a->a_desc->ad_cname.bv_len;
+		for ( i = 0; a->a_vals[i].bv_val != NULL; i++ )
+			size += LDIF_SIZE_NEEDED_WRAP( tmplen, a->a_vals[i].bv_len, wrap );
+	}
+	if ( size > *sizep ) {
+		size = ( size + GRABSIZE - 1 ) / GRABSIZE * GRABSIZE;
+		*bufp = ch_realloc( *bufp, size );
+		*sizep = size;
+	}
+
 	/*
 	 * In string format, an entry looks like this:
 	 *	dn: <dn>\n
 	 *	[<attr>: <value>\n]*
 	 */
 
-	ecur = ebuf;
+	ecur = *bufp;
 
 	/* put the dn */
 	if ( e->e_dn != NULL ) {
 		/* put "dn: <dn>" */
 		tmplen = e->e_name.bv_len;
-		MAKE_SPACE( LDIF_SIZE_NEEDED( 2, tmplen ));
 		ldif_sput_wrap( &ecur, LDIF_PUT_VALUE, "dn", e->e_dn, tmplen, wrap );
 	}
 
@@ -426,18 +440,47 @@ entry2str_wrap(
 		/* put "<type>:[:] <value>" line for each value */
 		for ( i = 0; a->a_vals[i].bv_val != NULL; i++ ) {
 			bv = &a->a_vals[i];
-			tmplen = a->a_desc->ad_cname.bv_len;
-			MAKE_SPACE( LDIF_SIZE_NEEDED( tmplen, bv->bv_len ));
 			ldif_sput_wrap( &ecur, LDIF_PUT_VALUE,
 				a->a_desc->ad_cname.bv_val,
 				bv->bv_val, bv->bv_len, wrap );
 		}
 	}
-	MAKE_SPACE( 1 );
 	*ecur = '\0';
-	*len = ecur - ebuf;
+	*len = ecur - *bufp;
+
+	return( *bufp );
+}
+
+/* NOTE: only preserved for binary compatibility */
+char *
+entry2str(
+	Entry	*e,
+	int		*len )
+{
+	return entry2str_wrap( e, len, LDIF_LINE_WIDTH );
+}
+
+char *
+entry2str_wrap(
+	Entry		*e,
+	int			*len,
+	ber_len_t	wrap )
+{
+	return entry2str_buf( e, len, wrap, &ebuf, &emaxsize );
+}
 
-	return( ebuf );
+/* Reentrant version, formats into the caller's buffer.
+ * buf->bv_len is the allocated size of buf->bv_val, the
+ * buffer is grown as needed and must be freed by the caller.
+ */
+char *
+entry2str_wrap_r(
+	Entry		*e,
+	int			*len,
+	ber_len_t	wrap,
+	struct berval	*buf )
+{
+	return entry2str_buf( e, len, wrap, &buf->bv_val, &buf->bv_len );
 }
 
 void
@@ -475,15 +518,76 @@ entry_clean( Entry *e )
 	e->e_ocflags = 0;
 }
 
+/* Return all but keep of the thread's free Entries to entry_list */
+static void
+entry_local_spill( entry_local *el, int keep )
+{
+	Entry *head, *tail;
+
+	if ( el->el_num <= keep )
+		return;
+
+	head = el->el_list;
+	for ( tail = head; --el->el_num > keep; tail = tail->e_private )
+		;
+	el->el_list = tail->e_private;
+	el->el_num = keep;
+
+	ldap_pvt_thread_mutex_lock( &entry_mutex );
+	tail->e_private = entry_list;
+	entry_list = head;
+	entry_local_hits += el->el_hits;
+	el->el_hits = 0;
+	ldap_pvt_thread_mutex_unlock( &entry_mutex );
+}
+
+static void
+entry_local_free( void *key, void *data )
+{
+	entry_local *el = data;
+
+	entry_local_spill( el, 0 );
+	if ( el->el_hits ) {
+		ldap_pvt_thread_mutex_lock( &entry_mutex );
+		entry_local_hits += el->el_hits;
+		ldap_pvt_thread_mutex_unlock( &entry_mutex );
+	}
+	ldap_pvt_thread_key_setdata( entry_local_key, NULL );
+	ch_free( el );
+}
+
+static entry_local *
+entry_local_get( void )
+{
+	entry_local *el = NULL;
+	void *ctx;
+
+	ldap_pvt_thread_key_getdata( entry_local_key, (void **)&el );
+	if ( el )
+		return el;
+
+	el = ch_calloc( 1, sizeof( entry_local ));
+	ldap_pvt_thread_key_setdata( entry_local_key, el );
+
+	/* see attr_local_get() */
+	ctx = ldap_pvt_thread_pool_context();
+	if ( ctx != entry_main_ctx )
+		ldap_pvt_thread_pool_setkey( ctx, &entry_local_key, el,
+			entry_local_free, NULL, NULL );
+	return el;
+}
+
 void
 entry_free( Entry *e )
 {
+	entry_local *el = entry_local_get();
+
 	entry_clean( e );
 
-	ldap_pvt_thread_mutex_lock( &entry_mutex );
-	e->e_private = entry_list;
-	entry_list = e;
-	ldap_pvt_thread_mutex_unlock( &entry_mutex );
+	e->e_private = el->el_list;
+	el->el_list = e;
+	if ( ++el->el_num > ENTRY_LOCAL_MAX )
+		entry_local_spill( el, ENTRY_LOCAL_BATCH );
 }
 
 /* These parameters work well on AMD64 */
@@ -535,19 +639,44 @@ entry_prealloc( int num )
 Entry *
 entry_alloc( void )
 {
-	Entry *e;
-
-	ldap_pvt_thread_mutex_lock( &entry_mutex );
-	if ( !entry_list )
-		entry_prealloc( CHUNK_SIZE );
-	e = entry_list;
-	entry_list = e->e_private;
+	Entry *e, **ep;
+	entry_local *el = entry_local_get();
+
+	if ( !el->el_list ) {
+		ldap_pvt_thread_mutex_lock( &entry_mutex );
+		if ( !entry_list )
+			entry_prealloc( CHUNK_SIZE );
+		el->el_list = entry_list;
+		for ( ep = &entry_list; *ep && el->el_num < ENTRY_LOCAL_BATCH;
+			ep = (Entry **)&(*ep)->e_private )
+			el->el_num++;
+		entry_list = *ep;
+		*ep = NULL;
+		entry_local_hits += el->el_hits;
+		el->el_hits = 0;
+		entry_local_misses++;
+		ldap_pvt_thread_mutex_unlock( &entry_mutex );
+	} else {
+		el->el_hits++;
+	}
+	e = el->el_list;
+	el->el_list = e->e_private;
+	el->el_num--;
 	e->e_private = NULL;
-	ldap_pvt_thread_mutex_unlock( &entry_mutex );
 
 	return e;
 }
 
+/* Same as attr_local_stats(), for Entries */
+void
+entry_local_stats( unsigned long *hits, unsigned long *misses )
+{
+	ldap_pvt_thread_mutex_lock( &entry_mutex );
+	*hits = entry_local_hits;
+	*misses = entry_local_misses;
+	ldap_pvt_thread_mutex_unlock( &entry_mutex );
+}
+
 
 /*
  * These routines are used only by Backend.
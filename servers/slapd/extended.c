@@ -47,6 +47,9 @@ static struct extop_list {
 } *supp_ext_list = NULL;
 
 static SLAP_EXTOP_MAIN_FN whoami_extop;
+#ifdef HAVE_ZLIB
+static SLAP_EXTOP_MAIN_FN compress_extop;
+#endif
 
 /* This list of built-in extops is for extops that are not part
  * of backends or in external modules.	Essentially, this is
@@ -63,6 +66,10 @@ static struct {
 	{ &slap_EXOP_CANCEL, 0, cancel_extop },
 	{ &slap_EXOP_WHOAMI, 0, whoami_extop },
 	{ &slap_EXOP_MODIFY_PASSWD, SLAP_EXOP_WRITES, passwd_extop },
+	{ &slap_EXOP_SEARCH_TEMPLATE, 0, search_template_extop },
+#ifdef HAVE_ZLIB
+	{ &slap_EXOP_START_COMPRESS, 0, compress_extop },
+#endif
 	{ NULL, 0, NULL }
 };
 
@@ -459,3 +466,51 @@ whoami_extop (
 	rs->sr_rspdata = bv;
 	return LDAP_SUCCESS;
 }
+
+#ifdef HAVE_ZLIB
+const struct berval slap_EXOP_START_COMPRESS = BER_BVC(LDAP_EXOP_X_START_COMPRESS);
+
+static int
+compress_extop (
+	Operation *op,
+	SlapReply *rs )
+{
+	Connection *c = op->o_conn;
+	int rc = LDAP_SUCCESS;
+
+	if ( op->ore_reqdata != NULL ) {
+		/* no request data should be provided */
+		rs->sr_text = "no request data expected";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	Debug( LDAP_DEBUG_STATS, "%s STARTCOMPRESS\n",
+	    op->o_log_prefix );
+
+	ldap_pvt_thread_mutex_lock( &c->c_mutex );
+
+	if ( c->c_compress ||
+		ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_HAS_IO, &ber_sockbuf_io_zlib ) )
+	{
+		rs->sr_text = "compression already started";
+		rc = LDAP_OPERATIONS_ERROR;
+
+	} else if (( !LDAP_STAILQ_EMPTY(&c->c_ops) &&
+			(LDAP_STAILQ_FIRST(&c->c_ops) != op ||
+			LDAP_STAILQ_NEXT(op, o_next) != NULL)) ||
+		( !LDAP_STAILQ_EMPTY(&c->c_pending_ops) ))
+	{
+		/* like StartTLS, other results must not cross the switch */
+		rs->sr_text = "cannot start compression when operations are outstanding";
+		rc = LDAP_OPERATIONS_ERROR;
+
+	} else {
+		/* installed by connection_read() once the response is out */
+		c->c_compress = 1;
+	}
+
+	ldap_pvt_thread_mutex_unlock( &c->c_mutex );
+
+	return rc;
+}
+#endif /* HAVE_ZLIB */
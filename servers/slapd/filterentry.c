@@ -64,8 +64,11 @@ test_filter(
     Filter	*f )
 {
 	int	rc;
+	slap_prof_ctx_t pc;
 	Debug( LDAP_DEBUG_FILTER, "=> test_filter\n" );
 
+	SLAP_PROF_BEGIN( pc, SLAP_PROF_FILTER );
+
 	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
 		Debug( LDAP_DEBUG_FILTER, "    UNDEFINED\n" );
 		rc = SLAPD_COMPARE_UNDEFINED;
@@ -151,6 +154,7 @@ test_filter(
 		rc = LDAP_PROTOCOL_ERROR;
 	}
 out:
+	SLAP_PROF_END( pc, SLAP_PROF_FILTER );
 	Debug( LDAP_DEBUG_FILTER, "<= test_filter %d\n", rc );
 	return( rc );
 }
@@ -864,6 +868,278 @@ test_presence_filter(
 }
 
 
+/*
+ * A search filter compiled by filter_compile() for testing many
+ * entries: the filter tree flattened into an array in preorder, with
+ * the filters whose result is known folded away. test_filter_prog()
+ * evaluates it with an explicit stack instead of recursion.
+ */
+#define FILTER_PROG_DEPTH	32
+
+typedef struct filter_insn {
+	ber_tag_t	fi_choice;	/* filter type, or SLAPD_FILTER_COMPUTED */
+	int		fi_size;	/* number of insns in this subtree */
+	ber_int_t	fi_result;	/* if SLAPD_FILTER_COMPUTED */
+	Filter		*fi_f;		/* the filter, for a leaf */
+} filter_insn;
+
+struct FilterProg {
+	int		fp_len;
+	int		fp_depth;	/* deepest nesting of AND, OR and NOT */
+	filter_insn	fp_insns[1];
+};
+
+static int
+filter_count( Filter *f )
+{
+	int n = 1;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		for ( f = f->f_list; f != NULL; f = f->f_next )
+			n += filter_count( f );
+		break;
+	case LDAP_FILTER_NOT:
+		n += filter_count( f->f_not );
+		break;
+	}
+	return n;
+}
+
+static void
+filter_emit( FilterProg *fp, Filter *f, int depth )
+{
+	int start = fp->fp_len++, pos;
+	filter_insn *fi = &fp->fp_insns[start], *ci;
+	ber_int_t decides, neutral;
+	Filter *f2;
+
+	fi->fi_choice = f->f_choice;
+	fi->fi_f = f;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
+		fi->fi_choice = SLAPD_FILTER_COMPUTED;
+		fi->fi_result = SLAPD_COMPARE_UNDEFINED;
+		goto done;
+	}
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		fi->fi_result = f->f_result;
+		break;
+
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_SUBSTRINGS:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_PRESENT:
+	case LDAP_FILTER_APPROX:
+	case LDAP_FILTER_EXT:
+		break;
+
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		if ( depth > fp->fp_depth )
+			fp->fp_depth = depth;
+		if ( f->f_choice == LDAP_FILTER_AND ) {
+			decides = LDAP_COMPARE_FALSE;
+			neutral = LDAP_COMPARE_TRUE;
+		} else {
+			decides = LDAP_COMPARE_TRUE;
+			neutral = LDAP_COMPARE_FALSE;
+		}
+		for ( f2 = f->f_list; f2 != NULL; f2 = f2->f_next ) {
+			pos = fp->fp_len;
+			filter_emit( fp, f2, depth + 1 );
+			ci = &fp->fp_insns[pos];
+			if ( ci->fi_choice != SLAPD_FILTER_COMPUTED )
+				continue;
+			if ( ci->fi_result == decides ) {
+				fp->fp_len = start + 1;
+				fi->fi_choice = SLAPD_FILTER_COMPUTED;
+				fi->fi_result = decides;
+				goto done;
+			}
+			if ( ci->fi_result == neutral )
+				fp->fp_len = pos;
+		}
+		if ( fp->fp_len == start + 1 ) {
+			/* empty, or only neutral elements */
+			fi->fi_choice = SLAPD_FILTER_COMPUTED;
+			fi->fi_result = neutral;
+		} else if ( fi[1].fi_size == fp->fp_len - start - 1 ) {
+			/* a single element decides on its own */
+			AC_MEMCPY( fi, fi + 1, ( fp->fp_len - start - 1 ) * sizeof( *fi ));
+			fp->fp_len--;
+			return;
+		}
+		break;
+
+	case LDAP_FILTER_NOT:
+		if ( depth > fp->fp_depth )
+			fp->fp_depth = depth;
+		filter_emit( fp, f->f_not, depth + 1 );
+		ci = &fp->fp_insns[start + 1];
+		if ( ci->fi_choice == SLAPD_FILTER_COMPUTED ) {
+			fp->fp_len = start + 1;
+			fi->fi_choice = SLAPD_FILTER_COMPUTED;
+			switch ( ci->fi_result ) {
+			case LDAP_COMPARE_TRUE:
+				fi->fi_result = LDAP_COMPARE_FALSE;
+				break;
+			case LDAP_COMPARE_FALSE:
+				fi->fi_result = LDAP_COMPARE_TRUE;
+				break;
+			default:
+				fi->fi_result = ci->fi_result;
+			}
+		}
+		break;
+
+	default:
+		fi->fi_choice = SLAPD_FILTER_COMPUTED;
+		fi->fi_result = LDAP_PROTOCOL_ERROR;
+	}
+done:
+	fi->fi_size = fp->fp_len - start;
+}
+
+/*
+ * filter_compile - compile a filter for test_filter_prog().
+ * Returns NULL if the filter is nested too deeply, then test_filter()
+ * must be used instead. The filter must outlive the program.
+ */
+FilterProg *
+filter_compile( Filter *f, void *memctx )
+{
+	FilterProg *fp;
+	int n;
+
+	if ( f == NULL )
+		return NULL;
+
+	n = filter_count( f );
+	fp = ber_memalloc_x( sizeof( FilterProg ) +
+		( n - 1 ) * sizeof( filter_insn ), memctx );
+	if ( fp == NULL )
+		return NULL;
+	fp->fp_len = 0;
+	fp->fp_depth = 0;
+	filter_emit( fp, f, 1 );
+	if ( fp->fp_depth > FILTER_PROG_DEPTH ) {
+		ber_memfree_x( fp, memctx );
+		return NULL;
+	}
+	return fp;
+}
+
+void
+filter_prog_free( FilterProg *fp, void *memctx )
+{
+	ber_memfree_x( fp, memctx );
+}
+
+/*
+ * test_filter_prog - test a compiled filter against a single entry.
+ * Returns the same as test_filter() does for the filter.
+ */
+int
+test_filter_prog(
+	Operation	*op,
+	Entry		*e,
+	FilterProg	*fp )
+{
+	struct {
+		ber_tag_t	choice;
+		int		rc;
+		int		end;
+	} stack[FILTER_PROG_DEPTH], *fr;
+	filter_insn *fi;
+	int pc = 0, sp = 0, rc;
+	slap_prof_ctx_t prof;
+
+	SLAP_PROF_BEGIN( prof, SLAP_PROF_FILTER );
+	for (;;) {
+		fi = &fp->fp_insns[pc];
+		switch ( fi->fi_choice ) {
+		case LDAP_FILTER_AND:
+		case LDAP_FILTER_OR:
+		case LDAP_FILTER_NOT:
+			/* never empty once compiled */
+			stack[sp].choice = fi->fi_choice;
+			stack[sp].rc = fi->fi_choice == LDAP_FILTER_AND ?
+				LDAP_COMPARE_TRUE : LDAP_COMPARE_FALSE;
+			stack[sp].end = pc + fi->fi_size;
+			sp++;
+			pc++;
+			continue;
+
+		case SLAPD_FILTER_COMPUTED:
+			rc = fi->fi_result;
+			break;
+
+		case LDAP_FILTER_EQUALITY:
+		case LDAP_FILTER_GE:
+		case LDAP_FILTER_LE:
+		case LDAP_FILTER_APPROX:
+			rc = test_ava_filter( op, e, fi->fi_f->f_ava, fi->fi_choice );
+			break;
+
+		case LDAP_FILTER_SUBSTRINGS:
+			rc = test_substrings_filter( op, e, fi->fi_f );
+			break;
+
+		case LDAP_FILTER_PRESENT:
+			rc = test_presence_filter( op, e, fi->fi_f->f_desc );
+			break;
+
+		case LDAP_FILTER_EXT:
+			rc = test_mra_filter( op, e, fi->fi_f->f_mra );
+			break;
+
+		default:
+			rc = LDAP_PROTOCOL_ERROR;
+		}
+		pc++;
+
+		/* Hand the result up until an AND or OR has more to test */
+		for ( ; sp > 0; sp-- ) {
+			fr = &stack[sp - 1];
+			if ( fr->choice == LDAP_FILTER_NOT ) {
+				if ( rc == LDAP_COMPARE_TRUE )
+					rc = LDAP_COMPARE_FALSE;
+				else if ( rc == LDAP_COMPARE_FALSE )
+					rc = LDAP_COMPARE_TRUE;
+				continue;
+			}
+			if ( fr->choice == LDAP_FILTER_AND ) {
+				if ( rc == LDAP_COMPARE_FALSE ) {
+					pc = fr->end;
+					continue;
+				}
+				if ( rc != LDAP_COMPARE_TRUE )
+					fr->rc = rc;
+			} else {
+				if ( rc == LDAP_COMPARE_TRUE ) {
+					pc = fr->end;
+					continue;
+				}
+				if ( rc != LDAP_COMPARE_FALSE )
+					fr->rc = rc;
+			}
+			if ( pc < fr->end )
+				break;
+			rc = fr->rc;
+		}
+		if ( sp == 0 ) {
+			SLAP_PROF_END( prof, SLAP_PROF_FILTER );
+			Debug( LDAP_DEBUG_FILTER, "<= test_filter_prog %d\n", rc );
+			return rc;
+		}
+	}
+}
+
 static int
 test_filter_and(
 	Operation	*op,
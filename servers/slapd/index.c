@@ -31,6 +31,8 @@ static slap_verbmasks idxstr[] = {
 	{ BER_BVC("subfinal"), SLAP_INDEX_SUBSTR_FINAL },
 	{ BER_BVC("sub"), SLAP_INDEX_SUBSTR_DEFAULT },
 	{ BER_BVC("substr"), 0 },
+	{ BER_BVC("sort"), SLAP_INDEX_SORT },
+	{ BER_BVC("range"), SLAP_INDEX_RANGE },
 	{ BER_BVC("notags"), SLAP_INDEX_NOTAGS },
 	{ BER_BVC("nolang"), 0 },	/* backwards compat */
 	{ BER_BVC("nosubtypes"), SLAP_INDEX_NOSUBTYPES },
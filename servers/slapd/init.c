@@ -61,10 +61,26 @@ BerVarray default_referral = NULL;
 ldap_pvt_thread_pool_t	connection_pool;
 int		connection_pool_max = SLAP_MAX_WORKER_THREADS;
 int		connection_pool_queues = 1;
+int		connection_pool_steal = 0;
+int		connection_pool_reserve = 0;
+int		connection_pool_min = 0;
+int		connection_pool_wait = 0;
+slap_mask_t	connection_pool_priority = 0;
 int		slap_tool_thread_max = 1;
+#ifdef HAVE_TLS
+int		slap_tls_thread_max = 0;
+ldap_pvt_thread_rdwr_t	slap_tls_thread_rwlock;
+#endif
 
 slap_counters_t			slap_counters, *slap_counters_list;
 
+/* set by back-monitor to keep latency histograms */
+int		slap_histo_on = 0;
+/* milliseconds after which an op's profile is logged */
+int		slap_slowop_threshold = 0;
+/* whether hot paths count their calls and CPU time */
+int		slap_profiling = 0;
+
 static const char* slap_name = NULL;
 int slapMode = SLAP_UNDEFINED_MODE;
 
@@ -87,6 +103,8 @@ slap_init( int mode, const char *name )
 
 	slapMode = mode;
 
+	slap_log_init();
+
 	slap_op_init();
 
 #ifdef SLAPD_MODULES
@@ -137,11 +155,14 @@ slap_init( int mode, const char *name )
 
 		ldap_pvt_thread_pool_init_q( &connection_pool,
 				connection_pool_max, 0, connection_pool_queues);
+#ifdef HAVE_TLS
+		ldap_pvt_thread_rdwr_init( &slap_tls_thread_rwlock );
+#endif
 
 		slap_counters_init( &slap_counters );
 
 		ldap_pvt_thread_mutex_init( &slapd_rq.rq_mutex );
-		LDAP_STAILQ_INIT( &slapd_rq.task_list );
+		LDAP_TAILQ_INIT( &slapd_rq.task_list );
 		LDAP_STAILQ_INIT( &slapd_rq.run_list );
 
 		slap_passwd_init();
@@ -217,8 +238,10 @@ int slap_startup( Backend *be )
 		slap_name );
 
 	rc = backend_startup( be );
-	if ( !rc && ( slapMode & SLAP_SERVER_MODE ))
+	if ( !rc && ( slapMode & SLAP_SERVER_MODE )) {
 		slapMode |= SLAP_SERVER_RUNNING;
+		rc = slap_log_start();
+	}
 	return rc;
 }
 
@@ -248,6 +271,9 @@ int slap_destroy(void)
 	}
 
 	ldap_pvt_thread_pool_free( &connection_pool );
+#ifdef HAVE_TLS
+	ldap_pvt_thread_rdwr_destroy( &slap_tls_thread_rwlock );
+#endif
 
 	/* clear out any thread-keys for the main thread */
 	ldap_pvt_thread_pool_context_reset( ldap_pvt_thread_pool_context());
@@ -256,6 +282,8 @@ int slap_destroy(void)
 
 	slap_sasl_destroy();
 
+	slap_passwd_destroy();
+
 	/* rootdse destroy goes before entry_destroy()
 	 * because it may use entry_free() */
 	root_dse_destroy();
@@ -278,6 +306,8 @@ int slap_destroy(void)
 
 	slap_op_destroy();
 
+	slap_log_destroy();
+
 	ldap_pvt_thread_destroy();
 
 	/* should destroy the above mutex */
@@ -302,6 +332,7 @@ void slap_counters_init( slap_counters_t *sc )
 		ldap_pvt_mp_init( sc->sc_ops_initiated_[ i ] );
 		ldap_pvt_mp_init( sc->sc_ops_completed_[ i ] );
 	}
+	sc->sc_histo = NULL;
 #endif /* SLAPD_MONITOR */
 }
 
@@ -323,6 +354,10 @@ void slap_counters_destroy( slap_counters_t *sc )
 		ldap_pvt_mp_clear( sc->sc_ops_initiated_[ i ] );
 		ldap_pvt_mp_clear( sc->sc_ops_completed_[ i ] );
 	}
+	if ( sc->sc_histo ) {
+		ch_free( sc->sc_histo );
+		sc->sc_histo = NULL;
+	}
 #endif /* SLAPD_MONITOR */
 }
 
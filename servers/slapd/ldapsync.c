@@ -138,6 +138,11 @@ slap_parse_csn_sid( struct berval *csnp )
 	struct berval csn = *csnp;
 	int i;
 
+	i = lutil_csnsid( csn.bv_val, csn.bv_len );
+	if ( i >= 0 )
+		return i;
+
+	/* older forms */
 	p = ber_bvchr( &csn, '#' );
 	if ( !p )
 		return -1;
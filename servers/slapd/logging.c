@@ -0,0 +1,493 @@
+/* logging.c - buffered log output */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include <ac/stdarg.h>
+#include <ac/string.h>
+#include <ac/syslog.h>
+#include <ac/time.h>
+
+#include "slap.h"
+
+/*
+ * All of slapd's Debug() and Log() calls end up in slap_log_print().
+ * Without a logbuffer-size it writes the message out right away, as
+ * lutil_debug() and syslog() always did.  With one, the message is
+ * copied into a ring buffer owned by the calling pool thread and a
+ * writer thread drains the rings, writing each batch to the log file,
+ * stderr and syslog.  Every ring has a single producer and a single
+ * consumer, so queueing takes no lock; threads outside the pool
+ * (listeners, the main thread) share one ring under a mutex.
+ *
+ * When a ring is full the thread waits for the writer, or with
+ * logbuffer-policy drop the message is discarded and counted.
+ */
+
+#define SLAP_LOG_LINE	4096
+#define SLAP_LOG_MINBUF	( 4 * SLAP_LOG_LINE )
+
+unsigned long slap_log_bufsize;
+int slap_log_policy = SLAP_LOG_BLOCK;
+unsigned long slap_log_dropped;
+
+#ifdef __GNUC__
+#define SLAP_LOG_ASYNC
+#define LOG_GET(p)	__atomic_load_n( (p), __ATOMIC_SEQ_CST )
+#define LOG_SET(p, v)	__atomic_store_n( (p), (v), __ATOMIC_SEQ_CST )
+#define LOG_INC(p)	__atomic_fetch_add( (p), 1, __ATOMIC_RELAXED )
+#endif
+
+static ldap_pvt_thread_mutex_t slap_log_file_mutex;
+static FILE *slap_log_fp;
+
+#ifdef SLAP_LOG_ASYNC
+typedef struct slap_logrec {
+	int lr_level;
+	int lr_pri;
+	time_t lr_time;
+	int lr_len;
+} slap_logrec;
+
+typedef struct slap_logbuf {
+	struct slap_logbuf *lb_next;
+	char *lb_buf;
+	unsigned long lb_size;		/* a power of two */
+	unsigned long lb_head;		/* advanced by the owner */
+	unsigned long lb_tail;		/* advanced by the writer */
+	int lb_dead;			/* owner is gone, free once drained */
+} slap_logbuf;
+
+static ldap_pvt_thread_mutex_t slap_log_mutex;
+static ldap_pvt_thread_cond_t slap_log_wake;	/* writer waits for messages */
+static ldap_pvt_thread_cond_t slap_log_space;	/* owners wait for room */
+static ldap_pvt_thread_mutex_t slap_log_shared_mutex;
+static ldap_pvt_thread_t slap_log_tid;
+static slap_logbuf *slap_log_bufs;
+static slap_logbuf *slap_log_shared;
+static void *slap_log_mainctx;
+static int slap_log_running, slap_log_stop;
+static int slap_log_sleeping, slap_log_waiters;
+static int slap_log_lastc = '\n';
+
+static slap_logbuf *
+slap_logbuf_new( unsigned long size )
+{
+	slap_logbuf *lb;
+
+	/* no ch_malloc, its failures get logged */
+	lb = SLAP_CALLOC( 1, sizeof( slap_logbuf ) );
+	if ( lb == NULL )
+		return NULL;
+	lb->lb_buf = SLAP_MALLOC( size );
+	if ( lb->lb_buf == NULL ) {
+		SLAP_FREE( lb );
+		return NULL;
+	}
+	lb->lb_size = size;
+
+	ldap_pvt_thread_mutex_lock( &slap_log_mutex );
+	lb->lb_next = slap_log_bufs;
+	LOG_SET( &slap_log_bufs, lb );
+	ldap_pvt_thread_mutex_unlock( &slap_log_mutex );
+
+	return lb;
+}
+
+/* the owning pool thread exited */
+static void
+slap_logbuf_release( void *key, void *data )
+{
+	slap_logbuf *lb = data;
+
+	LOG_SET( &lb->lb_dead, 1 );
+}
+
+static void
+slap_logbuf_write( slap_logbuf *lb, unsigned long pos, const void *src, int len )
+{
+	unsigned long off = pos & ( lb->lb_size - 1 );
+	unsigned long n = lb->lb_size - off;
+
+	if ( n > len )
+		n = len;
+	memcpy( lb->lb_buf + off, src, n );
+	memcpy( lb->lb_buf, (const char *)src + n, len - n );
+}
+
+static void
+slap_logbuf_read( slap_logbuf *lb, unsigned long pos, void *dst, int len )
+{
+	unsigned long off = pos & ( lb->lb_size - 1 );
+	unsigned long n = lb->lb_size - off;
+
+	if ( n > len )
+		n = len;
+	memcpy( dst, lb->lb_buf + off, n );
+	memcpy( (char *)dst + n, lb->lb_buf, len - n );
+}
+
+#define slap_logbuf_room( lb, head ) \
+	( (lb)->lb_size - ( (head) - LOG_GET( &(lb)->lb_tail )))
+
+/* Returns 0 when queued, -1 when dropped */
+static int
+slap_logbuf_put( slap_logbuf *lb, slap_logrec *lr, const char *text )
+{
+	unsigned long head = lb->lb_head;
+	unsigned long need = sizeof( slap_logrec ) + lr->lr_len;
+
+	if ( slap_logbuf_room( lb, head ) < need ) {
+		if ( slap_log_policy == SLAP_LOG_DROP ) {
+			LOG_INC( &slap_log_dropped );
+			return -1;
+		}
+		ldap_pvt_thread_mutex_lock( &slap_log_mutex );
+		slap_log_waiters++;
+		while ( slap_logbuf_room( lb, head ) < need && !slap_log_stop ) {
+			ldap_pvt_thread_cond_signal( &slap_log_wake );
+			ldap_pvt_thread_cond_wait( &slap_log_space, &slap_log_mutex );
+		}
+		slap_log_waiters--;
+		ldap_pvt_thread_mutex_unlock( &slap_log_mutex );
+		if ( slap_logbuf_room( lb, head ) < need ) {
+			LOG_INC( &slap_log_dropped );
+			return -1;
+		}
+	}
+
+	slap_logbuf_write( lb, head, lr, sizeof( slap_logrec ) );
+	slap_logbuf_write( lb, head + sizeof( slap_logrec ), text, lr->lr_len );
+	LOG_SET( &lb->lb_head, head + need );
+
+	if ( LOG_GET( &slap_log_sleeping ) ) {
+		ldap_pvt_thread_mutex_lock( &slap_log_mutex );
+		ldap_pvt_thread_cond_signal( &slap_log_wake );
+		ldap_pvt_thread_mutex_unlock( &slap_log_mutex );
+	}
+	return 0;
+}
+
+/* Returns -1 if the message could not be buffered and must
+ * be written directly
+ */
+static int
+slap_log_queue( int level, int pri, const char *text, int len )
+{
+	unsigned long size = slap_log_bufsize;
+	void *ctx = ldap_pvt_thread_pool_context();
+	slap_logbuf *lb = NULL;
+	slap_logrec lr;
+
+	lr.lr_level = level;
+	lr.lr_pri = pri;
+	lr.lr_time = time( NULL );
+	lr.lr_len = len;
+
+	if ( ctx == slap_log_mainctx ) {
+		ldap_pvt_thread_mutex_lock( &slap_log_shared_mutex );
+		lb = slap_log_shared;
+		if ( lb == NULL || lb->lb_size != size ) {
+			if ( lb )
+				LOG_SET( &lb->lb_dead, 1 );
+			lb = slap_log_shared = slap_logbuf_new( size );
+		}
+		if ( lb )
+			slap_logbuf_put( lb, &lr, text );
+		ldap_pvt_thread_mutex_unlock( &slap_log_shared_mutex );
+		return lb ? 0 : -1;
+	}
+
+	ldap_pvt_thread_pool_getkey( ctx, (void *)slap_log_print, (void **)&lb, NULL );
+	if ( lb == NULL || lb->lb_size != size ) {
+		/* first message from this thread, or logbuffer-size changed */
+		if ( lb )
+			LOG_SET( &lb->lb_dead, 1 );
+		lb = slap_logbuf_new( size );
+		ldap_pvt_thread_pool_setkey( ctx, (void *)slap_log_print, lb,
+			lb ? slap_logbuf_release : NULL, NULL, NULL );
+		if ( lb == NULL )
+			return -1;
+	}
+	slap_logbuf_put( lb, &lr, text );
+	return 0;
+}
+
+static void
+slap_log_output( slap_logrec *lr, const char *text )
+{
+	if ( ldap_debug & lr->lr_level ) {
+		if ( slap_log_lastc == '\n' ) {
+			char stamp[ 16 ];
+
+			snprintf( stamp, sizeof( stamp ), "%08x ", (unsigned) lr->lr_time );
+			if ( slap_log_fp )
+				fputs( stamp, slap_log_fp );
+			fputs( stamp, stderr );
+		}
+		if ( slap_log_fp )
+			fputs( text, slap_log_fp );
+		fputs( text, stderr );
+		if ( lr->lr_len )
+			slap_log_lastc = text[ lr->lr_len - 1 ];
+	}
+#ifdef LDAP_SYSLOG
+	if ( ldap_syslog & lr->lr_level )
+		syslog( lr->lr_pri, "%s", text );
+#endif
+}
+
+/* Write out everything queued so far, returns the number of messages */
+static int
+slap_log_drain( void )
+{
+	static unsigned long dropped;
+	slap_logbuf *lb;
+	slap_logrec lr;
+	char text[ SLAP_LOG_LINE ];
+	unsigned long head, tail;
+	int n = 0;
+
+	ldap_pvt_thread_mutex_lock( &slap_log_file_mutex );
+	for ( lb = LOG_GET( &slap_log_bufs ); lb; lb = lb->lb_next ) {
+		tail = lb->lb_tail;
+		head = LOG_GET( &lb->lb_head );
+		while ( tail != head ) {
+			slap_logbuf_read( lb, tail, &lr, sizeof( lr ) );
+			slap_logbuf_read( lb, tail + sizeof( lr ), text, lr.lr_len );
+			text[ lr.lr_len ] = '\0';
+			tail += sizeof( lr ) + lr.lr_len;
+			slap_log_output( &lr, text );
+			n++;
+		}
+		LOG_SET( &lb->lb_tail, tail );
+	}
+
+	if ( dropped != slap_log_dropped ) {
+		lr.lr_level = LDAP_DEBUG_ANY;
+		lr.lr_pri = LDAP_LEVEL_MASK( ldap_syslog_level );
+		lr.lr_time = time( NULL );
+		lr.lr_len = snprintf( text, sizeof( text ),
+			"slap_log: %lu messages dropped, log buffers full\n",
+			slap_log_dropped - dropped );
+		dropped = slap_log_dropped;
+		slap_log_output( &lr, text );
+		n++;
+	}
+
+	if ( n ) {
+		if ( slap_log_fp )
+			fflush( slap_log_fp );
+		fflush( stderr );
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_log_file_mutex );
+
+	return n;
+}
+
+static int
+slap_log_pending( void )
+{
+	slap_logbuf *lb;
+
+	for ( lb = slap_log_bufs; lb; lb = lb->lb_next ) {
+		if ( LOG_GET( &lb->lb_head ) != lb->lb_tail )
+			return 1;
+	}
+	return 0;
+}
+
+/* slap_log_mutex must be held */
+static void
+slap_log_reap( void )
+{
+	slap_logbuf *lb, **prev;
+
+	for ( prev = &slap_log_bufs; ( lb = *prev ) != NULL; ) {
+		if ( LOG_GET( &lb->lb_dead ) &&
+			LOG_GET( &lb->lb_head ) == lb->lb_tail )
+		{
+			*prev = lb->lb_next;
+			SLAP_FREE( lb->lb_buf );
+			SLAP_FREE( lb );
+		} else {
+			prev = &lb->lb_next;
+		}
+	}
+}
+
+static void *
+slap_log_writer( void *arg )
+{
+	int n;
+
+	for (;;) {
+		n = slap_log_drain();
+
+		ldap_pvt_thread_mutex_lock( &slap_log_mutex );
+		if ( slap_log_waiters )
+			ldap_pvt_thread_cond_broadcast( &slap_log_space );
+		slap_log_reap();
+		if ( !n ) {
+			if ( slap_log_stop ) {
+				ldap_pvt_thread_mutex_unlock( &slap_log_mutex );
+				break;
+			}
+			LOG_SET( &slap_log_sleeping, 1 );
+			if ( !slap_log_pending() )
+				ldap_pvt_thread_cond_wait( &slap_log_wake, &slap_log_mutex );
+			LOG_SET( &slap_log_sleeping, 0 );
+		}
+		ldap_pvt_thread_mutex_unlock( &slap_log_mutex );
+	}
+	return NULL;
+}
+#endif /* SLAP_LOG_ASYNC */
+
+void
+slap_log_print( int level, int pri, const char *fmt, ... )
+{
+	char text[ SLAP_LOG_LINE ];
+	va_list ap;
+	int len;
+
+	va_start( ap, fmt );
+	len = vsnprintf( text, sizeof( text ), fmt, ap );
+	va_end( ap );
+	if ( len < 0 )
+		return;
+	if ( len >= sizeof( text ) )
+		len = sizeof( text ) - 1;
+
+#ifdef SLAP_LOG_ASYNC
+	if ( slap_log_bufsize && LOG_GET( &slap_log_running ) &&
+		slap_log_queue( level, pri, text, len ) == 0 )
+		return;
+#endif
+
+	if ( ldap_debug & level )
+		lutil_debug( ldap_debug, level, "%s", text );
+#ifdef LDAP_SYSLOG
+	if ( ldap_syslog & level )
+		syslog( pri, "%s", text );
+#endif
+}
+
+/* Set the buffer size from logbuffer-size, in kbytes */
+int
+slap_log_buffer( unsigned long kbytes )
+{
+	unsigned long size;
+
+	if ( kbytes == 0 ) {
+		slap_log_bufsize = 0;
+		return 0;
+	}
+	if ( kbytes > 65536 )
+		return -1;
+	for ( size = SLAP_LOG_MINBUF; size < kbytes * 1024; size <<= 1 )
+		;
+	slap_log_bufsize = size;
+
+	if ( slapMode & SLAP_SERVER_RUNNING )
+		return slap_log_start();
+	return 0;
+}
+
+void
+slap_log_set_file( FILE *fp )
+{
+	ldap_pvt_thread_mutex_lock( &slap_log_file_mutex );
+	slap_log_fp = fp;
+	lutil_debug_file( fp );
+	ldap_pvt_thread_mutex_unlock( &slap_log_file_mutex );
+}
+
+void
+slap_log_init( void )
+{
+	ldap_pvt_thread_mutex_init( &slap_log_file_mutex );
+#ifdef SLAP_LOG_ASYNC
+	ldap_pvt_thread_mutex_init( &slap_log_mutex );
+	ldap_pvt_thread_mutex_init( &slap_log_shared_mutex );
+	ldap_pvt_thread_cond_init( &slap_log_wake );
+	ldap_pvt_thread_cond_init( &slap_log_space );
+	slap_log_mainctx = ldap_pvt_thread_pool_context();
+#endif
+}
+
+/* Start the writer thread, if buffering is configured */
+int
+slap_log_start( void )
+{
+#ifdef SLAP_LOG_ASYNC
+	int rc;
+
+	if ( !slap_log_bufsize || !( slapMode & SLAP_SERVER_MODE ) ||
+		slap_log_running )
+		return 0;
+
+	slap_log_stop = 0;
+	rc = ldap_pvt_thread_create( &slap_log_tid, 0, slap_log_writer, NULL );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "slap_log_start: "
+			"ldap_pvt_thread_create failed (%d)\n", rc );
+		return rc;
+	}
+	LOG_SET( &slap_log_running, 1 );
+#else
+	if ( slap_log_bufsize )
+		Debug( LDAP_DEBUG_ANY, "slap_log_start: "
+			"log buffering is not supported on this platform\n" );
+#endif
+	return 0;
+}
+
+/* Stop the writer once everything queued is written, and free
+ * the buffers.  Only the calling thread may still be logging.
+ */
+void
+slap_log_destroy( void )
+{
+#ifdef SLAP_LOG_ASYNC
+	if ( slap_log_running ) {
+		LOG_SET( &slap_log_running, 0 );
+		ldap_pvt_thread_mutex_lock( &slap_log_mutex );
+		slap_log_stop = 1;
+		ldap_pvt_thread_cond_signal( &slap_log_wake );
+		ldap_pvt_thread_cond_broadcast( &slap_log_space );
+		ldap_pvt_thread_mutex_unlock( &slap_log_mutex );
+		ldap_pvt_thread_join( slap_log_tid, NULL );
+	}
+
+	while ( slap_log_bufs ) {
+		slap_logbuf *lb = slap_log_bufs;
+
+		slap_log_bufs = lb->lb_next;
+		SLAP_FREE( lb->lb_buf );
+		SLAP_FREE( lb );
+	}
+	slap_log_shared = NULL;
+
+	ldap_pvt_thread_cond_destroy( &slap_log_space );
+	ldap_pvt_thread_cond_destroy( &slap_log_wake );
+	ldap_pvt_thread_mutex_destroy( &slap_log_shared_mutex );
+	ldap_pvt_thread_mutex_destroy( &slap_log_mutex );
+#endif
+	ldap_pvt_thread_mutex_destroy( &slap_log_file_mutex );
+}
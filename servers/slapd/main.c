@@ -65,7 +65,7 @@ static struct sockaddr_in	bind_addr;
 
 typedef int (MainFunc) LDAP_P(( int argc, char *argv[] ));
 extern MainFunc slapadd, slapcat, slapdn, slapindex, slappasswd,
-	slaptest, slapauth, slapacl, slapschema, slapmodify;
+	slaptest, slapauth, slapacl, slapschema, slapmodify, slapbench;
 
 static struct {
 	char *name;
@@ -81,6 +81,7 @@ static struct {
 	{"slaptest", slaptest},
 	{"slapauth", slapauth},
 	{"slapacl", slapacl},
+	{"slapbench", slapbench},
 	/* NOTE: new tools must be added in chronological order,
 	 * not in alphabetical order, because for backwards
 	 * compatibility name[4] is used to identify the
@@ -139,6 +140,31 @@ slapd_opt_slp( const char *val, void *arg )
 #endif
 }
 
+static int
+slapd_opt_reuseport( const char *val, void *arg )
+{
+#ifdef SO_REUSEPORT
+	int n;
+
+	if ( val == NULL || strcasecmp( val, "off" ) == 0 ) {
+		slapd_listener_reuseport = 0;
+
+	} else if ( lutil_atoi( &n, val ) != 0 || n < 1 ) {
+		fprintf( stderr, "unrecognized value \"%s\" for reuseport option\n", val );
+		return -1;
+
+	} else {
+		slapd_listener_reuseport = n;
+	}
+
+	return 0;
+
+#else
+	fputs( "slapd: SO_REUSEPORT is not available\n", stderr );
+	return 0;
+#endif
+}
+
 /*
  * Option helper structure:
  * 
@@ -159,6 +185,7 @@ struct option_helper {
 	const char	*oh_usage;
 } option_helpers[] = {
 	{ BER_BVC("slp"),	slapd_opt_slp,	NULL, "slp[={on|off|(attrs)}] enable/disable SLP using (attrs)" },
+	{ BER_BVC("reuseport"),	slapd_opt_reuseport,	NULL, "reuseport={<n>|off} open <n> SO_REUSEPORT sockets per TCP listener" },
 	{ BER_BVNULL, 0, NULL, NULL }
 };
 
@@ -311,7 +338,7 @@ usage( char *name )
 	fprintf( stderr,
 		"\t-4\t\tIPv4 only\n"
 		"\t-6\t\tIPv6 only\n"
-		"\t-T {acl|add|auth|cat|dn|index|modify|passwd|test}\n"
+		"\t-T {acl|add|auth|bench|cat|dn|index|modify|passwd|test}\n"
 		"\t\t\tRun in Tool mode\n"
 		"\t-c cookie\tSync cookie of consumer\n"
 		"\t-d level\tDebug level" "\n"
@@ -358,6 +385,8 @@ int main( int argc, char **argv )
 	int		i, no_detach = 0;
 	int		rc = 1;
 	char *urls = NULL;
+	struct timeval	phase_start;
+	unsigned long	config_usec, schema_usec, startup_usec;
 #if defined(HAVE_SETUID) && defined(HAVE_SETGID)
 	char *username = NULL;
 	char *groupname = NULL;
@@ -800,6 +829,7 @@ unhandled_option:;
 		goto destroy;
 	}
 
+	gettimeofday( &phase_start, NULL );
 	if ( read_config( configfile, configdir ) != 0 ) {
 		rc = 1;
 		SERVICE_EXIT( ERROR_SERVICE_SPECIFIC_ERROR, 19 );
@@ -811,6 +841,8 @@ unhandled_option:;
 		goto destroy;
 	}
 
+	config_usec = slap_histo_since( &phase_start );
+
 	if ( debug_unknowns ) {
 		rc = parse_debug_unknowns( debug_unknowns, &slap_debug );
 		ldap_charray_free( debug_unknowns );
@@ -848,12 +880,14 @@ unhandled_option:;
 		goto destroy;
 	}
 
+	gettimeofday( &phase_start, NULL );
 	if ( slap_schema_check( ) != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
 		    "schema prep error\n" );
 
 		goto destroy;
 	}
+	schema_usec = slap_histo_since( &phase_start );
 
 #ifdef HAVE_TLS
 	rc = ldap_pvt_tls_init();
@@ -996,13 +1030,19 @@ unhandled_option:;
 	time( &starttime );
 
 	connections_init();
+	slap_passwd_offload_start();
 
+	gettimeofday( &phase_start, NULL );
 	if ( slap_startup( NULL ) != 0 ) {
 		rc = 1;
 		SERVICE_EXIT( ERROR_SERVICE_SPECIFIC_ERROR, 21 );
 		goto shutdown;
 	}
+	startup_usec = slap_histo_since( &phase_start );
 
+	Debug( LDAP_DEBUG_STATS, "slapd startup: config %lu ms, "
+		"schema %lu ms, databases %lu ms\n",
+		config_usec / 1000, schema_usec / 1000, startup_usec / 1000 );
 	Debug( LDAP_DEBUG_ANY, "slapd starting\n" );
 
 #ifndef HAVE_WINSOCK
@@ -1102,6 +1142,11 @@ stop:
 
 	/* kludge, get symbols referenced */
 	tavl_free( NULL, NULL );
+	{
+		IAvltree it;
+		iavl_init( &it, NULL, 0 );
+		iavl_free( &it, NULL );
+	}
 
 #ifdef CSRIMALLOC
 	mal_dumpleaktrace( leakfile );
@@ -312,10 +312,12 @@ modify_delete_vindex(
 		if ( a->a_vals[idx[i]].bv_val == &dummy )
 			continue;
 		/* delete value and mark it as gone */
-		free( a->a_vals[idx[i]].bv_val );
+		if ( !( a->a_flags & SLAP_ATTR_DONT_FREE_DATA ))
+			free( a->a_vals[idx[i]].bv_val );
 		a->a_vals[idx[i]].bv_val = &dummy;
 		if( a->a_nvals != a->a_vals ) {
-			free( a->a_nvals[idx[i]].bv_val );
+			if ( !( a->a_flags & SLAP_ATTR_DONT_FREE_DATA ))
+				free( a->a_nvals[idx[i]].bv_val );
 			a->a_nvals[idx[i]].bv_val = &dummy;
 		}
 		a->a_numvals--;
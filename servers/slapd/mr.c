@@ -381,6 +381,7 @@ matching_rule_use_init( void )
 				*mru = &mru_storage;
 
 		char		**applies_oids = NULL;
+		int		napplies = 0, maxapplies = 0;
 
 		mr->smr_mru = NULL;
 
@@ -424,7 +425,15 @@ matching_rule_use_init( void )
 			if( at->sat_flags & SLAP_AT_HIDE ) continue;
 
 			if( mr_usable_with_at( mr, at )) {
-				ldap_charray_add( &applies_oids, at->sat_cname.bv_val );
+				/* ldap_charray_add() would count the array
+				 * each time, quadratic with large schemas */
+				if ( napplies + 1 >= maxapplies ) {
+					maxapplies = maxapplies ? 2 * maxapplies : 16;
+					applies_oids = ch_realloc( applies_oids,
+						maxapplies * sizeof( char * ) );
+				}
+				applies_oids[ napplies++ ] = ch_strdup( at->sat_cname.bv_val );
+				applies_oids[ napplies ] = NULL;
 			}
 		}
 
@@ -134,7 +134,7 @@ struct oindexrec {
 };
 
 static Avlnode	*oc_index = NULL;
-static Avlnode	*oc_cache = NULL;
+static SlapNameHash	oc_hash;
 static LDAP_STAILQ_HEAD(OCList, ObjectClass) oc_list
 	= LDAP_STAILQ_HEAD_INITIALIZER(oc_list);
 
@@ -151,18 +151,6 @@ oc_index_cmp(
 	return strcasecmp( oir1->oir_name.bv_val, oir2->oir_name.bv_val );
 }
 
-static int
-oc_index_name_cmp(
-	const void *v_name,
-	const void *v_oir )
-{
-	const struct berval    *name = v_name;
-	const struct oindexrec *oir  = v_oir;
-	int i = name->bv_len - oir->oir_name.bv_len;
-	if (i) return i;
-	return strncasecmp( name->bv_val, oir->oir_name.bv_val, name->bv_len );
-}
-
 ObjectClass *
 oc_find( const char *ocname )
 {
@@ -179,17 +167,9 @@ oc_bvfind( struct berval *ocname )
 {
 	struct oindexrec	*oir;
 
-	if ( oc_cache ) {
-		oir = avl_find( oc_cache, ocname, oc_index_name_cmp );
-		if ( oir ) return oir->oir_oc;
-	}
-	oir = avl_find( oc_index, ocname, oc_index_name_cmp );
+	oir = (struct oindexrec *)slap_name_hash_find( &oc_hash, ocname );
 
 	if ( oir != NULL ) {
-		if ( at_oc_cache ) {
-			avl_insert( &oc_cache, (caddr_t) oir,
-				oc_index_cmp, avl_dup_error );
-		}
 		return( oir->oir_oc );
 	}
 
@@ -410,6 +390,7 @@ oc_delete_names( ObjectClass *oc )
 		oir = (struct oindexrec *)avl_delete( &oc_index,
 			(caddr_t)&tmpoir, oc_index_cmp );
 		assert( oir != NULL );
+		slap_name_hash_delete( &oc_hash, &oir->oir_name );
 		ldap_memfree( oir );
 		names++;
 	}
@@ -473,6 +454,7 @@ oc_destroy( void )
 	}
 	
 	avl_free( oc_index, oc_destroy_one );
+	slap_name_hash_destroy( &oc_hash );
 
 	while( !LDAP_STAILQ_EMPTY(&oc_undef_list) ) {
 		o = LDAP_STAILQ_FIRST(&oc_undef_list);
@@ -633,6 +615,8 @@ oc_insert(
 				ldap_memfree( oir );
 				return rc;
 			}
+		} else {
+			slap_name_hash_insert( &oc_hash, &oir->oir_name );
 		}
 
 		/* FIX: temporal consistency check */
@@ -672,6 +656,7 @@ oc_insert(
 					oir = (struct oindexrec *)avl_delete( &oc_index,
 						(caddr_t)&tmpoir, oc_index_cmp );
 					assert( oir != NULL );
+					slap_name_hash_delete( &oc_hash, &oir->oir_name );
 					ldap_memfree( oir );
 				}
 
@@ -683,11 +668,13 @@ oc_insert(
 					oir = (struct oindexrec *)avl_delete( &oc_index,
 						(caddr_t)&tmpoir, oc_index_cmp );
 					assert( oir != NULL );
+					slap_name_hash_delete( &oc_hash, &oir->oir_name );
 					ldap_memfree( oir );
 				}
 
 				return rc;
 			}
+			slap_name_hash_insert( &oc_hash, &oir->oir_name );
 
 			/* FIX: temporal consistency check */
 			assert( oc_bvfind(&oir->oir_name) != NULL );
@@ -28,6 +28,7 @@
 
 #include <stdio.h>
 
+#include <ac/stdarg.h>
 #include <ac/string.h>
 #include <ac/socket.h>
 
@@ -41,13 +42,55 @@ static ldap_pvt_thread_mutex_t	slap_op_mutex;
 static time_t last_time;
 static int last_incr;
 
+/* Freed ops are kept on a per-thread list. Ops are mostly allocated
+ * on the thread reading the connection and freed on the pool thread
+ * that ran them, so a full list is handed to a shared depot as a
+ * whole, and a thread whose list is empty takes a whole list back.
+ * The depot mutex is taken once per batch rather than once per op.
+ */
+#define SLAP_OP_BATCH	16	/* ops on a per-thread list */
+#define SLAP_OP_DEPOT	64	/* lists in the depot */
+
+static ldap_pvt_thread_mutex_t	slap_op_depot_mutex;
+static Operation	*slap_op_depot[SLAP_OP_DEPOT];
+static int		slap_op_ndepot;
+
+/* Per thread hot-path counters, see slap_prof_begin() */
+typedef struct slap_prof_thread_t {
+	struct slap_prof_thread_t	*pt_next;
+	slap_prof_counter_t		pt_counters[SLAP_PROF_LAST];
+	int				pt_depth[SLAP_PROF_LAST];
+} slap_prof_thread_t;
+
+static ldap_pvt_thread_mutex_t	slap_prof_mutex;
+static slap_prof_thread_t	*slap_prof_threads;
+/* counts of the threads that have exited */
+static slap_prof_counter_t	slap_prof_total[SLAP_PROF_LAST];
+static void			*slap_prof_mainctx;
+/* for turning ticks into microseconds */
+static slap_prof_tick_t		slap_prof_tick0;
+static struct timeval		slap_prof_tv0;
+
+static slap_prof_tick_t slap_prof_ticks( void );
+
 void slap_op_init(void)
 {
 	ldap_pvt_thread_mutex_init( &slap_op_mutex );
+	ldap_pvt_thread_mutex_init( &slap_op_depot_mutex );
+	ldap_pvt_thread_mutex_init( &slap_prof_mutex );
+	slap_prof_mainctx = ldap_pvt_thread_pool_context();
+	gettimeofday( &slap_prof_tv0, NULL );
+	slap_prof_tick0 = slap_prof_ticks();
 }
 
+static void slap_op_q_destroy( void *key, void *data );
+
 void slap_op_destroy(void)
 {
+	while ( slap_op_ndepot > 0 )
+		slap_op_q_destroy( NULL, slap_op_depot[--slap_op_ndepot] );
+	ldap_pvt_thread_mutex_destroy( &slap_op_depot_mutex );
+	ldap_pvt_thread_mutex_destroy( &slap_prof_mutex );
 	ldap_pvt_thread_mutex_destroy( &slap_op_mutex );
 }
 
@@ -83,7 +126,7 @@ slap_op_free( Operation *op, void *ctx )
 	op->o_abandon = 1;
 
 	if ( op->o_ber != NULL ) {
-		ber_free( op->o_ber, 1 );
+		connection_ber_free( op->o_ber, ctx );
 	}
 	if ( !BER_BVISNULL( &op->o_dn ) ) {
 		ch_free( op->o_dn.bv_val );
@@ -122,6 +165,10 @@ slap_op_free( Operation *op, void *ctx )
 		op->o_tmpfree( op->o_pagedresults_state, op->o_tmpmemctx );
 	}
 
+	if ( op->o_profile != NULL ) {
+		ch_free( op->o_profile );
+	}
+
 	/* Selectively zero out the struct. Ignore fields that will
 	 * get explicitly initialized later anyway. Keep o_abandon intact.
 	 */
@@ -137,20 +184,26 @@ slap_op_free( Operation *op, void *ctx )
 
 	if ( ctx ) {
 		Operation *op2 = NULL;
-		ldap_pvt_thread_pool_setkey( ctx, (void *)slap_op_free,
-			op, slap_op_q_destroy, (void **)&op2, NULL );
-		LDAP_STAILQ_NEXT( op, o_next ) = op2;
-		if ( op2 ) {
-			op->o_tincr = op2->o_tincr + 1;
-			/* No more than 10 ops on per-thread free list */
-			if ( op->o_tincr > 10 ) {
-				ldap_pvt_thread_pool_setkey( ctx, (void *)slap_op_free,
-					op2, slap_op_q_destroy, NULL, NULL );
+		ldap_pvt_thread_pool_getkey( ctx, (void *)slap_op_free,
+			(void **)&op2, NULL );
+		/* o_tincr of the list head is the length of the list */
+		if ( op2 && op2->o_tincr >= SLAP_OP_BATCH ) {
+			ldap_pvt_thread_mutex_lock( &slap_op_depot_mutex );
+			if ( slap_op_ndepot < SLAP_OP_DEPOT ) {
+				slap_op_depot[slap_op_ndepot++] = op2;
+				op2 = NULL;
+			}
+			ldap_pvt_thread_mutex_unlock( &slap_op_depot_mutex );
+			if ( op2 ) {
+				/* depot is full too */
 				ber_memfree_x( op, NULL );
+				return;
 			}
-		} else {
-			op->o_tincr = 1;
 		}
+		LDAP_STAILQ_NEXT( op, o_next ) = op2;
+		op->o_tincr = op2 ? op2->o_tincr + 1 : 1;
+		ldap_pvt_thread_pool_setkey( ctx, (void *)slap_op_free,
+			op, slap_op_q_destroy, NULL, NULL );
 	} else {
 		ber_memfree_x( op, NULL );
 	}
@@ -187,6 +240,12 @@ slap_op_alloc(
 	if ( ctx ) {
 		void *otmp = NULL;
 		ldap_pvt_thread_pool_getkey( ctx, (void *)slap_op_free, &otmp, NULL );
+		if ( !otmp && slap_op_ndepot ) {
+			ldap_pvt_thread_mutex_lock( &slap_op_depot_mutex );
+			if ( slap_op_ndepot )
+				otmp = slap_op_depot[--slap_op_ndepot];
+			ldap_pvt_thread_mutex_unlock( &slap_op_depot_mutex );
+		}
 		if ( otmp ) {
 			op = otmp;
 			otmp = LDAP_STAILQ_NEXT( op, o_next );
@@ -208,6 +267,8 @@ slap_op_alloc(
 
 	slap_op_time( &op->o_time, &op->o_tincr );
 	op->o_opid = id;
+	op->o_groupgen = group_cache_generation();
+	op->o_authzgen = authz_cache_generation();
 
 #if defined( LDAP_SLAPI )
 	if ( slapi_plugins_used ) {
@@ -246,3 +307,315 @@ slap_req2op( ber_tag_t tag )
 
 	return SLAP_OP_LAST;
 }
+
+/* Microseconds elapsed since tv */
+unsigned long
+slap_histo_since( struct timeval *tv )
+{
+	struct timeval now;
+	long sec;
+
+	gettimeofday( &now, NULL );
+	sec = now.tv_sec - tv->tv_sec;
+	if ( sec < 0 )
+		return 0;
+	/* well past the last bucket, and no overflow with 32 bit longs */
+	if ( sec > 2000 )
+		sec = 2000;
+	sec = sec * 1000000L + now.tv_usec - tv->tv_usec;
+	return sec > 0 ? sec : 0;
+}
+
+static int
+slap_histo_bucket( unsigned long usec )
+{
+	int e, i;
+
+	if ( usec < SLAP_HISTO_SUB )
+		return usec;
+
+	for ( e = SLAP_HISTO_SUBBITS; usec >> ( e + 1 ); e++ )
+		;
+	i = ( e - SLAP_HISTO_SUBBITS + 1 ) * SLAP_HISTO_SUB +
+		(( usec >> ( e - SLAP_HISTO_SUBBITS )) & ( SLAP_HISTO_SUB - 1 ));
+	return i < SLAP_HISTO_BUCKETS ? i : SLAP_HISTO_BUCKETS - 1;
+}
+
+/* Lowest value counted in bucket i */
+static unsigned long
+slap_histo_value( int i )
+{
+	if ( i < SLAP_HISTO_SUB )
+		return i;
+	return (unsigned long)( SLAP_HISTO_SUB + i % SLAP_HISTO_SUB )
+		<< ( i / SLAP_HISTO_SUB - 1 );
+}
+
+/* Buckets are bumped without locks; a monitor reader may see
+ * a sample in the count but not yet in the max, which is harmless.
+ */
+void
+slap_histo_add( slap_histo_t *h, unsigned long usec )
+{
+#ifdef __GNUC__
+	__atomic_fetch_add( &h->sh_bucket[ slap_histo_bucket( usec ) ], 1,
+		__ATOMIC_RELAXED );
+#else
+	h->sh_bucket[ slap_histo_bucket( usec ) ]++;
+#endif
+	if ( usec > h->sh_max )
+		h->sh_max = usec;
+}
+
+void
+slap_histo_merge( slap_histo_t *dst, slap_histo_t *src )
+{
+	int i;
+
+	for ( i = 0; i < SLAP_HISTO_BUCKETS; i++ )
+		dst->sh_bucket[ i ] += src->sh_bucket[ i ];
+	if ( src->sh_max > dst->sh_max )
+		dst->sh_max = src->sh_max;
+}
+
+unsigned long
+slap_histo_count( slap_histo_t *h )
+{
+	unsigned long n = 0;
+	int i;
+
+	for ( i = 0; i < SLAP_HISTO_BUCKETS; i++ )
+		n += h->sh_bucket[ i ];
+	return n;
+}
+
+/* Value below which permille/1000 of the n samples fall, reported
+ * as the top of its bucket like HdrHistogram does.
+ */
+unsigned long
+slap_histo_quantile( slap_histo_t *h, unsigned long n, int permille )
+{
+	unsigned long want, seen = 0, v;
+	int i;
+
+	if ( n == 0 )
+		return 0;
+
+	want = n / 1000 * permille + ( n % 1000 ) * permille / 1000;
+	if ( want == 0 )
+		want = 1;
+
+	for ( i = 0; i < SLAP_HISTO_BUCKETS - 1; i++ ) {
+		seen += h->sh_bucket[ i ];
+		if ( seen >= want )
+			break;
+	}
+	if ( i == SLAP_HISTO_BUCKETS - 1 )
+		return h->sh_max;
+
+	v = slap_histo_value( i + 1 ) - 1;
+	return v < h->sh_max ? v : h->sh_max;
+}
+
+/* Note an index lookup in the op's profile, if it keeps one */
+void
+slap_op_profile_plan( Operation *op, const char *fmt, ... )
+{
+	slap_op_profile_t *sp = op->o_profile;
+	va_list ap;
+	char *p;
+	int len, room;
+
+	if ( sp == NULL || sp->sp_planlen >= sizeof( sp->sp_plan ) - 1 )
+		return;
+
+	p = sp->sp_plan + sp->sp_planlen;
+	room = sizeof( sp->sp_plan ) - sp->sp_planlen;
+	if ( sp->sp_planlen ) {
+		*p++ = ' ';
+		room--;
+	}
+
+	va_start( ap, fmt );
+	len = vsnprintf( p, room, fmt, ap );
+	va_end( ap );
+
+	if ( len < 0 ) {
+		sp->sp_plan[ sp->sp_planlen ] = '\0';
+	} else if ( len >= room ) {
+		/* full, mark the truncation */
+		strcpy( sp->sp_plan + sizeof( sp->sp_plan ) - 4, "..." );
+		sp->sp_planlen = sizeof( sp->sp_plan ) - 1;
+	} else {
+		sp->sp_planlen = p - sp->sp_plan + len;
+	}
+}
+
+static const char *slap_op_names[] = {
+	"BIND", "UNBIND", "SRCH", "CMP", "MOD",
+	"MODRDN", "ADD", "DEL", "ABANDON", "EXT", NULL
+};
+
+/* Log what op did if it took longer than slowop-threshold. Searches
+ * pass rs, while their request is still around, to add its details.
+ */
+void
+slap_op_slowlog( Operation *op, SlapReply *rs )
+{
+	slap_op_profile_t *sp = op->o_profile;
+	unsigned long queue, total, exec;
+	slap_op_t opidx;
+	char buf[ SLAP_TEXT_BUFLEN * 4 ];
+
+	if ( slap_slowop_threshold <= 0 || sp == NULL )
+		return;
+
+	queue = op->o_qtime.tv_sec * 1000000UL + op->o_qtime.tv_usec;
+	total = queue + slap_histo_since( &op->o_xtime );
+	if ( total < slap_slowop_threshold * 1000UL )
+		return;
+
+	exec = total - queue;
+	exec = exec > op->o_acl_usec + op->o_send_usec
+		? exec - op->o_acl_usec - op->o_send_usec : 0;
+
+	buf[ 0 ] = '\0';
+	if ( rs != NULL && op->o_tag == LDAP_REQ_SEARCH ) {
+		snprintf( buf, sizeof( buf ), " base=\"%s\" scope=%d"
+			" filter=\"%s\" scanned=%lu nentries=%d plan=\"%s\"",
+			BER_BVISNULL( &op->o_req_dn ) ? "" : op->o_req_dn.bv_val,
+			op->ors_scope,
+			BER_BVISNULL( &op->ors_filterstr ) ? "" : op->ors_filterstr.bv_val,
+			sp->sp_scanned, rs->sr_nentries, sp->sp_plan );
+	}
+
+	opidx = slap_req2op( op->o_tag );
+	Debug( LDAP_DEBUG_ANY, "%s SLOW %s etime=%lu.%06lu queue=%lu"
+		" backend=%lu acl=%lu send=%lu bytes=%lu%s\n",
+		op->o_log_prefix,
+		opidx == SLAP_OP_LAST ? "UNKNOWN" : slap_op_names[ opidx ],
+		total / 1000000, total % 1000000, queue, exec,
+		op->o_acl_usec, op->o_send_usec, sp->sp_bytes, buf );
+
+	/* only once, even if the op completes in more places */
+	op->o_profile = NULL;
+	ch_free( sp );
+}
+
+static slap_prof_tick_t
+slap_prof_ticks( void )
+{
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+	return __builtin_ia32_rdtsc();
+#else
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return (slap_prof_tick_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+/* Fold a pool thread's counters into the totals when it exits */
+static void
+slap_prof_release( void *key, void *data )
+{
+	slap_prof_thread_t *pt = data, **prev;
+	int i;
+
+	ldap_pvt_thread_mutex_lock( &slap_prof_mutex );
+	for ( prev = &slap_prof_threads; *prev; prev = &(*prev)->pt_next ) {
+		if ( *prev == pt ) {
+			*prev = pt->pt_next;
+			break;
+		}
+	}
+	for ( i = 0; i < SLAP_PROF_LAST; i++ ) {
+		slap_prof_total[i].spc_calls += pt->pt_counters[i].spc_calls;
+		slap_prof_total[i].spc_ticks += pt->pt_counters[i].spc_ticks;
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_prof_mutex );
+	ch_free( pt );
+}
+
+/*
+ * Start timing a call of kind which. Only pool threads are counted,
+ * each in its own slap_prof_thread_t, so the hot path takes no locks.
+ * Returns the thread's counters, to be passed to slap_prof_end(), or
+ * NULL if this thread isn't counted.
+ */
+slap_prof_thread_t *
+slap_prof_begin( slap_prof_t which, slap_prof_tick_t *start )
+{
+	void *ctx = ldap_pvt_thread_pool_context();
+	slap_prof_thread_t *pt = NULL;
+
+	if ( ctx == slap_prof_mainctx )
+		return NULL;
+
+	ldap_pvt_thread_pool_getkey( ctx, (void *)slap_prof_begin,
+		(void **)&pt, NULL );
+	if ( pt == NULL ) {
+		pt = ch_calloc( 1, sizeof( slap_prof_thread_t ));
+		if ( ldap_pvt_thread_pool_setkey( ctx, (void *)slap_prof_begin,
+				pt, slap_prof_release, NULL, NULL )) {
+			ch_free( pt );
+			return NULL;
+		}
+		ldap_pvt_thread_mutex_lock( &slap_prof_mutex );
+		pt->pt_next = slap_prof_threads;
+		slap_prof_threads = pt;
+		ldap_pvt_thread_mutex_unlock( &slap_prof_mutex );
+	}
+
+	*start = pt->pt_depth[which]++ ? 0 : slap_prof_ticks();
+	return pt;
+}
+
+void
+slap_prof_end( slap_prof_thread_t *pt, slap_prof_t which,
+	slap_prof_tick_t start )
+{
+	pt->pt_depth[which]--;
+	if ( start ) {
+		pt->pt_counters[which].spc_calls++;
+		pt->pt_counters[which].spc_ticks += slap_prof_ticks() - start;
+	}
+}
+
+/* Sum the counters of all threads into out[SLAP_PROF_LAST].
+ * Live threads are read without stopping them, so a total may
+ * miss the calls in progress.
+ */
+void
+slap_prof_collect( slap_prof_counter_t *out )
+{
+	slap_prof_thread_t *pt;
+	int i;
+
+	ldap_pvt_thread_mutex_lock( &slap_prof_mutex );
+	for ( i = 0; i < SLAP_PROF_LAST; i++ )
+		out[i] = slap_prof_total[i];
+	for ( pt = slap_prof_threads; pt; pt = pt->pt_next ) {
+		for ( i = 0; i < SLAP_PROF_LAST; i++ ) {
+			out[i].spc_calls += pt->pt_counters[i].spc_calls;
+			out[i].spc_ticks += pt->pt_counters[i].spc_ticks;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_prof_mutex );
+}
+
+/* Ticks to microseconds, at the tick rate seen since startup */
+double
+slap_prof_usec( slap_prof_tick_t ticks )
+{
+	struct timeval now;
+	slap_prof_tick_t elapsed = slap_prof_ticks() - slap_prof_tick0;
+	double usec;
+
+	gettimeofday( &now, NULL );
+	usec = ( now.tv_sec - slap_prof_tv0.tv_sec ) * 1000000.0 +
+		( now.tv_usec - slap_prof_tv0.tv_usec );
+	if ( elapsed == 0 || usec <= 0 )
+		return 0;
+	return (double)ticks * usec / (double)elapsed;
+}
@@ -33,6 +33,13 @@
 #include "lutil.h"
 #include "ldap_rq.h"
 
+#include "../back-monitor/back-monitor.h"
+
+/*
+ * Monitoring
+ */
+#define ACCESSLOG_MONITOR
+
 #define LOG_OP_ADD	0x001
 #define LOG_OP_DELETE	0x002
 #define	LOG_OP_MODIFY	0x004
@@ -63,6 +70,18 @@ typedef struct log_base {
 	struct berval lb_line;
 } log_base;
 
+/* A log entry waiting to be written by the async writer */
+typedef struct log_rec {
+	struct log_rec *lr_next;
+	Entry *lr_e;
+	struct berval lr_csn;	/* op CSN, if any */
+	int lr_queuecsn;	/* propagate lr_csn as the log DB's commit CSN */
+	int lr_mincsn;		/* lr_csn is from a new SID, add it to minCSN */
+	int lr_dont_replicate;
+	time_t lr_time;
+	int lr_tincr;
+} log_rec;
+
 typedef struct log_info {
 	BackendDB *li_db;
 	struct berval li_db_suffix;
@@ -80,8 +99,28 @@ typedef struct log_info {
 	int *li_sids, li_numcsns;
 	ldap_pvt_thread_mutex_t li_op_rmutex;
 	ldap_pvt_thread_mutex_t li_log_mutex;
+	int li_async;		/* max queued log entries, 0 = write inline */
+	int li_nqueued;
+	int li_writing;		/* writer task is submitted or running */
+	log_rec *li_queue, **li_qtail;
+	ldap_pvt_thread_mutex_t li_q_mutex;
+	ldap_pvt_thread_cond_t li_q_cond;
+	int li_purge_batch;	/* max entries per purge batch, 0 = all */
+	int li_purge_msec;	/* min time per purge batch */
+	ldap_pvt_thread_mutex_t li_purge_mutex;
+	int li_purge_active;
+	unsigned long li_purged;	/* since startup */
+	unsigned long li_purge_current;	/* by the current or last run */
+	struct berval li_purge_last;	/* reqStart of the last purged entry */
+	char li_purge_lastbuf[LDAP_LUTIL_GENTIME_BUFSIZE+8];
+#ifdef ACCESSLOG_MONITOR
+	void *li_monitor_cb;
+	struct berval li_monitor_ndn;
+#endif /* ACCESSLOG_MONITOR */
 } log_info;
 
+#define PURGE_BATCH	1000
+
 static ConfigDriver log_cf_gen;
 
 enum {
@@ -91,7 +130,9 @@ enum {
 	LOG_SUCCESS,
 	LOG_OLD,
 	LOG_OLDATTR,
-	LOG_BASE
+	LOG_BASE,
+	LOG_ASYNC,
+	LOG_PURGEBATCH
 };
 
 static ConfigTable log_cfats[] = {
@@ -132,6 +173,16 @@ static ConfigTable log_cfats[] = {
 			"DESC 'Operation types to log under a specific branch' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "logasync", "limit", 2, 2, 0, ARG_INT|ARG_MAGIC|LOG_ASYNC,
+		log_cf_gen, "( OLcfgOvAt:4.8 NAME 'olcAccessLogAsync' "
+			"DESC 'Max number of log entries queued for the log writer' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "logpurgebatch", "entries> <msec", 2, 3, 0, ARG_MAGIC|LOG_PURGEBATCH,
+		log_cf_gen, "( OLcfgOvAt:4.9 NAME 'olcAccessLogPurgeBatch' "
+			"DESC 'Max number of log entries purged per batch, and min time per batch' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ NULL }
 };
 
@@ -142,7 +193,8 @@ static ConfigOCs log_cfocs[] = {
 		"SUP olcOverlayConfig "
 		"MUST olcAccessLogDB "
 		"MAY ( olcAccessLogOps $ olcAccessLogPurge $ olcAccessLogSuccess $ "
-			"olcAccessLogOld $ olcAccessLogOldAttr $ olcAccessLogBase ) )",
+			"olcAccessLogOld $ olcAccessLogOldAttr $ olcAccessLogBase $ "
+			"olcAccessLogAsync $ olcAccessLogPurgeBatch ) )",
 			Cft_Overlay, log_cfats },
 	{ NULL }
 };
@@ -203,6 +255,14 @@ static AttributeDescription *ad_reqDN, *ad_reqStart, *ad_reqEnd, *ad_reqType,
 	*ad_reqReferral, *ad_reqOld, *ad_auditContext, *ad_reqEntryUUID,
 	*ad_minCSN;
 
+#ifdef ACCESSLOG_MONITOR
+static AttributeDescription *ad_olmAccessLogPurged,
+	*ad_olmAccessLogPurgeCurrent, *ad_olmAccessLogPurgeLast,
+	*ad_olmAccessLogPurgeActive;
+
+static ObjectClass *oc_olmAccessLog;
+#endif /* ACCESSLOG_MONITOR */
+
 static int
 logSchemaControlValidate(
 	Syntax		*syntax,
@@ -425,6 +485,37 @@ static struct {
 		"SYNTAX 1.3.6.1.4.1.4203.666.11.2.1{64} "
 		"NO-USER-MODIFICATION "
 		"USAGE dSAOperation )", &ad_minCSN },
+#ifdef ACCESSLOG_MONITOR
+	{ "( " LOG_SCHEMA_AT ".33 NAME 'olmAccessLogPurged' "
+		"DESC 'Number of log entries purged since startup' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE directoryOperation )", &ad_olmAccessLogPurged },
+	{ "( " LOG_SCHEMA_AT ".34 NAME 'olmAccessLogPurgeCurrent' "
+		"DESC 'Number of log entries purged by the current or last purge' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE directoryOperation )", &ad_olmAccessLogPurgeCurrent },
+	{ "( " LOG_SCHEMA_AT ".35 NAME 'olmAccessLogPurgeLast' "
+		"DESC 'reqStart of the last log entry purged' "
+		"EQUALITY generalizedTimeMatch "
+		"ORDERING generalizedTimeOrderingMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.24 "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE directoryOperation )", &ad_olmAccessLogPurgeLast },
+	{ "( " LOG_SCHEMA_AT ".36 NAME 'olmAccessLogPurgeActive' "
+		"DESC 'A purge is in progress' "
+		"EQUALITY booleanMatch "
+		"SYNTAX OMsBoolean "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE directoryOperation )", &ad_olmAccessLogPurgeActive },
+#endif /* ACCESSLOG_MONITOR */
 	{ NULL, NULL }
 };
 
@@ -488,6 +579,15 @@ static struct {
 		"DESC 'Extended operation' "
 		"SUP auditObject STRUCTURAL "
 		"MAY reqData )", &log_ocs[LOG_EN_EXTENDED] },
+#ifdef ACCESSLOG_MONITOR
+	/* augments an existing object, so it must be AUXILIARY */
+	{ "( " LOG_SCHEMA_OC ".13 NAME 'olmAccessLog' "
+		"DESC 'Access log purge statistics' "
+		"SUP top AUXILIARY "
+		"MAY ( olmAccessLogPurged $ olmAccessLogPurgeCurrent $ "
+			"olmAccessLogPurgeLast $ olmAccessLogPurgeActive ) )",
+		&oc_olmAccessLog },
+#endif /* ACCESSLOG_MONITOR */
 	{ NULL, NULL }
 };
 
@@ -657,7 +757,10 @@ log_old_lookup( Operation *op, SlapReply *rs )
 	return 0;
 }
 
-/* Periodically search for old entries in the log database and delete them */
+/* Periodically search for old entries in the log database and delete them.
+ * They are collected and deleted in batches, oldest first, so neither
+ * the list of DNs nor the search's read txn grow with the size of the log.
+ */
 static void *
 accesslog_purge( void *ctx, void *arg )
 {
@@ -675,6 +778,9 @@ accesslog_purge( void *ctx, void *arg )
 	char timebuf[LDAP_LUTIL_GENTIME_BUFSIZE];
 	char csnbuf[LDAP_PVT_CSNSTR_BUFSIZE];
 	time_t old = slap_get_time();
+	struct berval filterstr;
+	struct timeval start, now;
+	int i, batch = li->li_purge_batch, deleted;
 
 	connection_fake_init( &conn, &opbuf, ctx );
 	op = &opbuf.ob_op;
@@ -690,29 +796,41 @@ accesslog_purge( void *ctx, void *arg )
 	old -= li->li_age;
 	slap_timestamp( &old, &ava.aa_value );
 
-	op->o_tag = LDAP_REQ_SEARCH;
-	op->o_bd = li->li_db;
-	op->o_dn = li->li_db->be_rootdn;
-	op->o_ndn = li->li_db->be_rootndn;
-	op->o_req_dn = li->li_db->be_suffix[0];
-	op->o_req_ndn = li->li_db->be_nsuffix[0];
-	op->o_callback = &cb;
-	op->ors_scope = LDAP_SCOPE_ONELEVEL;
-	op->ors_deref = LDAP_DEREF_NEVER;
-	op->ors_tlimit = SLAP_NO_LIMIT;
-	op->ors_slimit = SLAP_NO_LIMIT;
-	op->ors_filter = &f;
-	filter2bv_x( op, &f, &op->ors_filterstr );
-	op->ors_attrs = slap_anlist_no_attrs;
-	op->ors_attrsonly = 1;
-	
+	filter2bv_x( op, &f, &filterstr );
 	cb.sc_private = &pd;
 
-	op->o_bd->be_search( op, &rs );
-	op->o_tmpfree( op->ors_filterstr.bv_val, op->o_tmpmemctx );
-
-	if ( pd.used ) {
-		int i;
+	ldap_pvt_thread_mutex_lock( &li->li_purge_mutex );
+	li->li_purge_active = 1;
+	li->li_purge_current = 0;
+	ldap_pvt_thread_mutex_unlock( &li->li_purge_mutex );
+
+	do {
+		gettimeofday( &start, NULL );
+		pd.used = 0;
+		pd.mincsn_updated = 0;
+
+		op->o_tag = LDAP_REQ_SEARCH;
+		op->o_bd = li->li_db;
+		op->o_dn = li->li_db->be_rootdn;
+		op->o_ndn = li->li_db->be_rootndn;
+		op->o_req_dn = li->li_db->be_suffix[0];
+		op->o_req_ndn = li->li_db->be_nsuffix[0];
+		op->o_callback = &cb;
+		op->o_dont_replicate = 0;
+		op->ors_scope = LDAP_SCOPE_ONELEVEL;
+		op->ors_deref = LDAP_DEREF_NEVER;
+		op->ors_tlimit = SLAP_NO_LIMIT;
+		op->ors_slimit = batch ? batch : SLAP_NO_LIMIT;
+		op->ors_filter = &f;
+		op->ors_filterstr = filterstr;
+		op->ors_attrs = slap_anlist_no_attrs;
+		op->ors_attrsonly = 1;
+
+		rs_reinit( &rs, REP_RESULT );
+		op->o_bd->be_search( op, &rs );
+
+		if ( !pd.used )
+			break;
 
 		op->o_callback = &nullsc;
 		op->o_dont_replicate = 1;
@@ -739,26 +857,89 @@ accesslog_purge( void *ctx, void *arg )
 				Debug( LDAP_DEBUG_SYNC, "accesslog_purge: "
 						"updating minCSN with %d values\n",
 						li->li_numcsns );
+				rs_reinit( &rs, REP_RESULT );
 				op->o_bd->be_modify( op, &rs );
 			}
 		}
 
 		/* delete the expired entries */
 		op->o_tag = LDAP_REQ_DELETE;
+		deleted = 0;
 		for (i=0; i<pd.used; i++) {
 			op->o_req_dn = pd.dn[i];
 			op->o_req_ndn = pd.ndn[i];
 			if ( !slapd_shutdown ) {
 				rs_reinit( &rs, REP_RESULT );
 				op->o_bd->be_delete( op, &rs );
+				if ( rs.sr_err == LDAP_SUCCESS )
+					deleted++;
+			}
+			ldap_pvt_thread_pool_pausecheck( &connection_pool );
+		}
+
+		ldap_pvt_thread_mutex_lock( &li->li_purge_mutex );
+		if ( deleted ) {
+			struct berval rdn;
+			char *ptr;
+
+			/* the RDN value is the entry's reqStart */
+			dnRdn( &pd.dn[pd.used-1], &rdn );
+			ptr = ber_bvchr( &rdn, '=' );
+			if ( ptr ) {
+				rdn.bv_len -= ptr - rdn.bv_val + 1;
+				rdn.bv_val = ptr + 1;
+				if ( rdn.bv_len >= sizeof( li->li_purge_lastbuf ))
+					rdn.bv_len = sizeof( li->li_purge_lastbuf ) - 1;
+				AC_MEMCPY( li->li_purge_lastbuf, rdn.bv_val, rdn.bv_len );
+				li->li_purge_lastbuf[rdn.bv_len] = '\0';
+				li->li_purge_last.bv_val = li->li_purge_lastbuf;
+				li->li_purge_last.bv_len = rdn.bv_len;
 			}
+			li->li_purged += deleted;
+			li->li_purge_current += deleted;
+		}
+		ldap_pvt_thread_mutex_unlock( &li->li_purge_mutex );
+
+		for (i=0; i<pd.used; i++) {
 			ch_free( pd.ndn[i].bv_val );
 			ch_free( pd.dn[i].bv_val );
+		}
+
+		/* A short batch was the last one. Stop too if nothing could
+		 * be deleted, the next search would find the same entries.
+		 */
+		if ( !batch || pd.used < batch || !deleted || slapd_shutdown )
+			break;
+
+		if ( li->li_purge_msec ) {
+			long msec;
+
+			gettimeofday( &now, NULL );
+			msec = ( now.tv_sec - start.tv_sec ) * 1000 +
+				( now.tv_usec - start.tv_usec ) / 1000;
+			if ( msec < li->li_purge_msec ) {
+				struct timeval tv;
+
+				msec = li->li_purge_msec - msec;
+				tv.tv_sec = msec / 1000;
+				tv.tv_usec = ( msec % 1000 ) * 1000;
+				(void)select( 0, NULL, NULL, NULL, &tv );
+			}
 			ldap_pvt_thread_pool_pausecheck( &connection_pool );
 		}
-		ch_free( pd.ndn );
-		ch_free( pd.dn );
-	}
+	} while ( !slapd_shutdown );
+
+	op->o_tmpfree( filterstr.bv_val, op->o_tmpmemctx );
+	ch_free( pd.ndn );
+	ch_free( pd.dn );
+
+	ldap_pvt_thread_mutex_lock( &li->li_purge_mutex );
+	li->li_purge_active = 0;
+	ldap_pvt_thread_mutex_unlock( &li->li_purge_mutex );
+
+	Debug( LDAP_DEBUG_STATS, "accesslog_purge: "
+		"purged %lu entries older than %s\n",
+		li->li_purge_current, timebuf );
 
 	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
 	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
@@ -847,6 +1028,26 @@ log_cf_gen(ConfigArgs *c)
 			else
 				rc = 1;
 			break;
+		case LOG_ASYNC:
+			if ( li->li_async )
+				c->value_int = li->li_async;
+			else
+				rc = 1;
+			break;
+		case LOG_PURGEBATCH:
+			if ( li->li_purge_batch != PURGE_BATCH || li->li_purge_msec ) {
+				agebv.bv_val = agebuf;
+				if ( li->li_purge_msec )
+					agebv.bv_len = snprintf( agebuf, sizeof( agebuf ), "%d %d",
+						li->li_purge_batch, li->li_purge_msec );
+				else
+					agebv.bv_len = snprintf( agebuf, sizeof( agebuf ), "%d",
+						li->li_purge_batch );
+				value_add_one( &c->rvalue_vals, &agebv );
+			}
+			else
+				rc = 1;
+			break;
 		}
 		break;
 	case LDAP_MOD_DELETE:
@@ -879,6 +1080,13 @@ log_cf_gen(ConfigArgs *c)
 		case LOG_SUCCESS:
 			li->li_success = 0;
 			break;
+		case LOG_ASYNC:
+			li->li_async = 0;
+			break;
+		case LOG_PURGEBATCH:
+			li->li_purge_batch = PURGE_BATCH;
+			li->li_purge_msec = 0;
+			break;
 		case LOG_OLD:
 			if ( li->li_oldf ) {
 				filter_free( li->li_oldf );
@@ -978,6 +1186,32 @@ log_cf_gen(ConfigArgs *c)
 		case LOG_SUCCESS:
 			li->li_success = c->value_int;
 			break;
+		case LOG_ASYNC:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s: limit must not be negative", c->argv[0] );
+				Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+				rc = ARG_BAD_CONF;
+				break;
+			}
+			li->li_async = c->value_int;
+			break;
+		case LOG_PURGEBATCH: {
+			int batch, msec = 0;
+
+			if ( lutil_atoi( &batch, c->argv[1] ) || batch < 0 ||
+				( c->argc > 2 && ( lutil_atoi( &msec, c->argv[2] ) || msec < 0 )))
+			{
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s: invalid entries or msec", c->argv[0] );
+				Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+				rc = ARG_BAD_CONF;
+				break;
+			}
+			li->li_purge_batch = batch;
+			li->li_purge_msec = msec;
+			}
+			break;
 		case LOG_OLD:
 			li->li_oldf = str2filter( c->argv[1] );
 			if ( !li->li_oldf ) {
@@ -1474,6 +1708,218 @@ accesslog_op2logop( Operation *op )
 	return LOG_EN_UNKNOWN;
 }
 
+/* Add a log entry to the log DB, and its CSN to the minCSN set if
+ * it's from a SID not seen before. The op must already be set up
+ * on the log DB. The entry is consumed.
+ */
+static int
+accesslog_log_write( Operation *op, log_info *li, log_rec *lr )
+{
+	SlapReply rs = {REP_RESULT};
+	Entry *e = lr->lr_e;
+	int rc;
+
+	op->o_tag = LDAP_REQ_ADD;
+	op->o_req_dn = e->e_name;
+	op->o_req_ndn = e->e_nname;
+	op->ora_e = e;
+	op->o_callback = &nullsc;
+	op->o_csn = lr->lr_csn;
+	op->o_time = lr->lr_time;
+	op->o_tincr = lr->lr_tincr;
+	/* contextCSN updates may still reach here */
+	op->o_dont_replicate = lr->lr_dont_replicate;
+
+	if ( lr->lr_queuecsn )
+		slap_queue_csn( op, &lr->lr_csn );
+
+	op->o_bd->be_add( op, &rs );
+	rc = rs.sr_err;
+	if ( rs.sr_err != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_SYNC,
+			"accesslog_response: got result 0x%x adding log entry %s\n",
+			rs.sr_err, op->o_req_dn.bv_val );
+	}
+	if ( e == op->ora_e ) entry_free( e );
+	lr->lr_e = NULL;
+
+	if ( lr->lr_mincsn ) {
+		Modifications mod;
+		struct berval bv[2];
+
+		op->o_tag = LDAP_REQ_MODIFY;
+		op->o_req_dn = li->li_db->be_suffix[0];
+		op->o_req_ndn = li->li_db->be_nsuffix[0];
+
+		bv[0] = lr->lr_csn;
+		BER_BVZERO( &bv[1] );
+
+		mod.sml_numvals = 1;
+		mod.sml_values = bv;
+		mod.sml_nvalues = bv;
+		mod.sml_desc = ad_minCSN;
+		mod.sml_op = LDAP_MOD_ADD;
+		mod.sml_flags = SLAP_MOD_INTERNAL;
+		mod.sml_next = NULL;
+
+		op->orm_modlist = &mod;
+		op->orm_no_opattrs = 1;
+
+		Debug( LDAP_DEBUG_SYNC, "accesslog_response: "
+				"adding a new csn=%s into minCSN\n",
+				bv[0].bv_val );
+		rs_reinit( &rs, REP_RESULT );
+		op->o_bd->be_modify( op, &rs );
+		if ( rs.sr_err != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_SYNC, "accesslog_response: "
+					"got result 0x%x adding minCSN %s\n",
+					rs.sr_err, lr->lr_csn.bv_val );
+			rc = rs.sr_err;
+		}
+	}
+	BER_BVZERO( &op->o_csn );
+	return rc;
+}
+
+/* Commit the log entries written so far in the writer's txn */
+static void
+accesslog_log_commit( Operation *op, OpExtra **txn, int n )
+{
+	int rc;
+
+	LDAP_SLIST_REMOVE( &op->o_extra, *txn, OpExtra, oe_next );
+	rc = op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_COMMIT, txn );
+	Debug( LDAP_DEBUG_SYNC, "accesslog_log_commit: "
+		"committed %d log entries (%d)\n", n, rc );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "accesslog_log_commit: "
+			"commit of %d log entries failed (%d)\n", n, rc );
+	}
+	*txn = NULL;
+}
+
+/* Write the queued log entries in the order they were queued. The
+ * entries taken off the queue at once are written in a single txn,
+ * unless the log DB has syncprov: its psearch responses go out
+ * before the txn commits, and consumers must not see entries that
+ * may still get lost.
+ */
+static void *
+accesslog_writer( void *ctx, void *arg )
+{
+	slap_overinst *on = arg;
+	log_info *li = on->on_bi.bi_private;
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+	log_rec *lr, *next;
+	OpExtra *txn;
+	int batch, n, rc;
+
+	connection_fake_init( &conn, &opbuf, ctx );
+	op = &opbuf.ob_op;
+	op->o_bd = li->li_db;
+	op->o_dn = li->li_db->be_rootdn;
+	op->o_ndn = li->li_db->be_rootndn;
+
+	batch = li->li_db->bd_info->bi_op_txn &&
+		!overlay_is_inst( li->li_db, "syncprov" );
+
+	ldap_pvt_thread_mutex_lock( &li->li_q_mutex );
+	li->li_writing = 2;
+	while (( lr = li->li_queue )) {
+		li->li_queue = NULL;
+		li->li_qtail = &li->li_queue;
+		n = li->li_nqueued;
+		li->li_nqueued = 0;
+		ldap_pvt_thread_cond_broadcast( &li->li_q_cond );
+		ldap_pvt_thread_mutex_unlock( &li->li_q_mutex );
+
+		txn = NULL;
+		if ( batch && n > 1 &&
+			op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_BEGIN, &txn ))
+		{
+			if ( txn ) {
+				LDAP_SLIST_REMOVE( &op->o_extra, txn, OpExtra, oe_next );
+				op->o_tmpfree( txn, op->o_tmpmemctx );
+				txn = NULL;
+			}
+		}
+		for ( ; lr; lr = next ) {
+			next = lr->lr_next;
+			/* Each entry gets a savepoint, so a failed one doesn't
+			 * leave partial writes behind in the txn */
+			if ( txn &&
+				op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_SAVEPOINT, &txn ))
+			{
+				Debug( LDAP_DEBUG_ANY, "accesslog_writer: "
+					"log DB can't nest txns, writing log entries one by one\n" );
+				accesslog_log_commit( op, &txn, n );
+				batch = 0;
+			}
+			rc = accesslog_log_write( op, li, lr );
+			if ( txn ) {
+				op->o_bd->bd_info->bi_op_txn( op, rc == LDAP_SUCCESS ?
+					SLAP_TXN_RELEASE : SLAP_TXN_ROLLBACK, &txn );
+			}
+			ch_free( lr->lr_csn.bv_val );
+			ch_free( lr );
+		}
+		if ( txn )
+			accesslog_log_commit( op, &txn, n );
+		ldap_pvt_thread_mutex_lock( &li->li_q_mutex );
+	}
+	li->li_writing = 0;
+	ldap_pvt_thread_cond_broadcast( &li->li_q_cond );
+	ldap_pvt_thread_mutex_unlock( &li->li_q_mutex );
+
+	return NULL;
+}
+
+/* Hand a log entry over to the writer task. Waits for room if the
+ * queue is full. Returns zero if the entry must be written inline.
+ */
+static int
+accesslog_log_queue( slap_overinst *on, log_rec *lr )
+{
+	log_info *li = on->on_bi.bi_private;
+	log_rec *q;
+
+	ldap_pvt_thread_mutex_lock( &li->li_q_mutex );
+	/* Entries still queued from before async got turned off
+	 * must be written first */
+	if ( !li->li_async && !li->li_queue ) {
+		ldap_pvt_thread_mutex_unlock( &li->li_q_mutex );
+		return 0;
+	}
+	if ( !li->li_writing ) {
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+				accesslog_writer, on )) {
+			ldap_pvt_thread_mutex_unlock( &li->li_q_mutex );
+			return 0;
+		}
+		li->li_writing = 1;
+	}
+	/* Only wait on a running writer, a pending one may need
+	 * this very thread to get started */
+	while ( li->li_writing == 2 && li->li_async &&
+		li->li_nqueued >= li->li_async )
+		ldap_pvt_thread_cond_wait( &li->li_q_cond, &li->li_q_mutex );
+
+	q = ch_malloc( sizeof( log_rec ));
+	*q = *lr;
+	q->lr_next = NULL;
+	if ( !BER_BVISEMPTY( &lr->lr_csn ))
+		ber_dupbv( &q->lr_csn, &lr->lr_csn );
+	else
+		BER_BVZERO( &q->lr_csn );
+	*li->li_qtail = q;
+	li->li_qtail = &q->lr_next;
+	li->li_nqueued++;
+	ldap_pvt_thread_mutex_unlock( &li->li_q_mutex );
+	return 1;
+}
+
 static int accesslog_response(Operation *op, SlapReply *rs) {
 	slap_overinst *on = (slap_overinst *)op->o_callback->sc_private;
 	log_info *li = on->on_bi.bi_private;
@@ -1489,7 +1935,11 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 	char *ptr;
 	BerVarray vals;
 	Operation op2 = {0};
-	SlapReply rs2 = {REP_RESULT};
+	log_rec lr = {0};
+
+	/* search entries come first; keep the callback for the result */
+	if ( rs->sr_type != REP_RESULT && rs->sr_type != REP_EXTENDED )
+		return SLAP_CB_CONTINUE;
 
 	{
 		slap_callback *sc = op->o_callback;
@@ -1497,9 +1947,6 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 		op->o_tmpfree(sc, op->o_tmpmemctx );
 	}
 
-	if ( rs->sr_type != REP_RESULT && rs->sr_type != REP_EXTENDED )
-		return SLAP_CB_CONTINUE;
-
 	logop = accesslog_op2logop( op );
 	lo = logops+logop+EN_OFFSET;
 	if ( !( li->li_ops & lo->mask )) {
@@ -1865,18 +2312,11 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 		}
 	}
 
-	op2.o_hdr = op->o_hdr;
-	op2.o_tag = LDAP_REQ_ADD;
-	op2.o_bd = li->li_db;
-	op2.o_dn = li->li_db->be_rootdn;
-	op2.o_ndn = li->li_db->be_rootndn;
-	op2.o_req_dn = e->e_name;
-	op2.o_req_ndn = e->e_nname;
-	op2.ora_e = e;
-	op2.o_callback = &nullsc;
-	op2.o_csn = op->o_csn;
-	/* contextCSN updates may still reach here */
-	op2.o_dont_replicate = op->o_dont_replicate;
+	lr.lr_e = e;
+	lr.lr_csn = op->o_csn;
+	lr.lr_dont_replicate = op->o_dont_replicate;
+	lr.lr_time = op2.o_time;
+	lr.lr_tincr = op2.o_tincr;
 
 	if (( lo->mask & LOG_OP_WRITES ) && !BER_BVISEMPTY( &op->o_csn )) {
 		struct berval maxcsn;
@@ -1891,25 +2331,15 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 		 */
 		slap_get_commit_csn( op, &maxcsn, &foundit );
 		if ( !BER_BVISEMPTY( &maxcsn ) ) {
-			slap_queue_csn( &op2, &op->o_csn );
+			lr.lr_queuecsn = 1;
 		} else {
 			attr_merge_normalize_one( e, slap_schema.si_ad_entryCSN,
 				&op->o_csn, op->o_tmpmemctx );
 		}
 	}
 
-	op2.o_bd->be_add( &op2, &rs2 );
-	if ( rs2.sr_err != LDAP_SUCCESS ) {
-		Debug( LDAP_DEBUG_SYNC,
-			"accesslog_response: got result 0x%x adding log entry %s\n",
-			rs2.sr_err, op2.o_req_dn.bv_val );
-	}
-	if ( e == op2.ora_e ) entry_free( e );
-	e = NULL;
-
 	/* TODO: What to do about minCSN when we have an op without a CSN? */
 	if ( !BER_BVISEMPTY( &op->o_csn ) ) {
-		Modifications mod;
 		int i, sid = slap_parse_csn_sid( &op->o_csn );
 
 		for ( i=0; i < li->li_numcsns; i++ ) {
@@ -1917,42 +2347,12 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 		}
 		if ( i >= li->li_numcsns || sid != li->li_sids[i] ) {
 			/* SID not in minCSN set, add */
-			struct berval bv[2];
-
 			Debug( LDAP_DEBUG_TRACE, "accesslog_response: "
 					"adding minCSN %s\n",
 					op->o_csn.bv_val );
 			slap_insert_csn_sids( (struct sync_cookie *)&li->li_mincsn, i,
 					sid, &op->o_csn );
-
-			op2.o_tag = LDAP_REQ_MODIFY;
-			op2.o_req_dn = li->li_db->be_suffix[0];
-			op2.o_req_ndn = li->li_db->be_nsuffix[0];
-
-			bv[0] = op->o_csn;
-			BER_BVZERO( &bv[1] );
-
-			mod.sml_numvals = 1;
-			mod.sml_values = bv;
-			mod.sml_nvalues = bv;
-			mod.sml_desc = ad_minCSN;
-			mod.sml_op = LDAP_MOD_ADD;
-			mod.sml_flags = SLAP_MOD_INTERNAL;
-			mod.sml_next = NULL;
-
-			op2.orm_modlist = &mod;
-			op2.orm_no_opattrs = 1;
-
-			Debug( LDAP_DEBUG_SYNC, "accesslog_response: "
-					"adding a new csn=%s into minCSN\n",
-					bv[0].bv_val );
-			rs_reinit( &rs2, REP_RESULT );
-			op2.o_bd->be_modify( &op2, &rs2 );
-			if ( rs2.sr_err != LDAP_SUCCESS ) {
-				Debug( LDAP_DEBUG_SYNC, "accesslog_response: "
-						"got result 0x%x adding minCSN %s\n",
-						rs2.sr_err, op->o_csn.bv_val );
-			}
+			lr.lr_mincsn = 1;
 		} else if ( ber_bvcmp( &op->o_csn, &li->li_mincsn[i] ) < 0 ) {
 			Debug( LDAP_DEBUG_ANY, "accesslog_response: "
 					"csn=%s older than existing minCSN csn=%s for this sid\n",
@@ -1960,6 +2360,15 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 		}
 	}
 
+	if ( !accesslog_log_queue( on, &lr )) {
+		op2.o_hdr = op->o_hdr;
+		op2.o_bd = li->li_db;
+		op2.o_dn = li->li_db->be_rootdn;
+		op2.o_ndn = li->li_db->be_rootndn;
+		accesslog_log_write( &op2, li, &lr );
+	}
+	e = NULL;
+
 done:
 	if ( lo->mask & LOG_OP_WRITES )
 		ldap_pvt_thread_mutex_unlock( &li->li_log_mutex );
@@ -2077,8 +2486,7 @@ accesslog_unbind( Operation *op, SlapReply *rs )
 		log_info *li = on->on_bi.bi_private;
 		Operation op2 = {0};
 		void *cids[SLAP_MAX_CIDS];
-		SlapReply rs2 = {REP_RESULT};
-		Entry *e;
+		log_rec lr = {0};
 
 		if ( !( li->li_ops & LOG_OP_UNBIND )) {
 			log_base *lb;
@@ -2093,22 +2501,19 @@ accesslog_unbind( Operation *op, SlapReply *rs )
 				return SLAP_CB_CONTINUE;
 		}
 
-		e = accesslog_entry( op, rs, li, LOG_EN_UNBIND, &op2 );
-		op2.o_hdr = op->o_hdr;
-		op2.o_tag = LDAP_REQ_ADD;
-		op2.o_bd = li->li_db;
-		op2.o_dn = li->li_db->be_rootdn;
-		op2.o_ndn = li->li_db->be_rootndn;
-		op2.o_req_dn = e->e_name;
-		op2.o_req_ndn = e->e_nname;
-		op2.ora_e = e;
-		op2.o_callback = &nullsc;
-		op2.o_controls = cids;
-		memset(cids, 0, sizeof( cids ));
+		lr.lr_e = accesslog_entry( op, rs, li, LOG_EN_UNBIND, &op2 );
+		lr.lr_time = op2.o_time;
+		lr.lr_tincr = op2.o_tincr;
+		if ( !accesslog_log_queue( on, &lr )) {
+			op2.o_hdr = op->o_hdr;
+			op2.o_bd = li->li_db;
+			op2.o_dn = li->li_db->be_rootdn;
+			op2.o_ndn = li->li_db->be_rootndn;
+			op2.o_controls = cids;
+			memset(cids, 0, sizeof( cids ));
 
-		op2.o_bd->be_add( &op2, &rs2 );
-		if ( e == op2.ora_e )
-			entry_free( e );
+			accesslog_log_write( &op2, li, &lr );
+		}
 	}
 	return SLAP_CB_CONTINUE;
 }
@@ -2120,7 +2525,7 @@ accesslog_abandon( Operation *op, SlapReply *rs )
 	log_info *li = on->on_bi.bi_private;
 	Operation op2 = {0};
 	void *cids[SLAP_MAX_CIDS];
-	SlapReply rs2 = {REP_RESULT};
+	log_rec lr = {0};
 	Entry *e;
 	char buf[64];
 	struct berval bv;
@@ -2148,21 +2553,19 @@ accesslog_abandon( Operation *op, SlapReply *rs )
 		attr_merge_one( e, ad_reqId, &bv, NULL );
 	} /* else? */
 
-	op2.o_hdr = op->o_hdr;
-	op2.o_tag = LDAP_REQ_ADD;
-	op2.o_bd = li->li_db;
-	op2.o_dn = li->li_db->be_rootdn;
-	op2.o_ndn = li->li_db->be_rootndn;
-	op2.o_req_dn = e->e_name;
-	op2.o_req_ndn = e->e_nname;
-	op2.ora_e = e;
-	op2.o_callback = &nullsc;
-	op2.o_controls = cids;
-	memset(cids, 0, sizeof( cids ));
-
-	op2.o_bd->be_add( &op2, &rs2 );
-	if ( e == op2.ora_e )
-		entry_free( e );
+	lr.lr_e = e;
+	lr.lr_time = op2.o_time;
+	lr.lr_tincr = op2.o_tincr;
+	if ( !accesslog_log_queue( on, &lr )) {
+		op2.o_hdr = op->o_hdr;
+		op2.o_bd = li->li_db;
+		op2.o_dn = li->li_db->be_rootdn;
+		op2.o_ndn = li->li_db->be_rootndn;
+		op2.o_controls = cids;
+		memset(cids, 0, sizeof( cids ));
+
+		accesslog_log_write( &op2, li, &lr );
+	}
 
 	return SLAP_CB_CONTINUE;
 }
@@ -2197,6 +2600,226 @@ accesslog_operational( Operation *op, SlapReply *rs )
 	return SLAP_CB_CONTINUE;
 }
 
+#ifdef ACCESSLOG_MONITOR
+
+static int
+accesslog_monitor_update(
+	Operation	*op,
+	SlapReply	*rs,
+	Entry		*e,
+	void		*priv )
+{
+	log_info	*li = (log_info *) priv;
+	Attribute	*a;
+	char		buf[ SLAP_TEXT_BUFLEN ];
+	struct berval	bv;
+
+	ldap_pvt_thread_mutex_lock( &li->li_purge_mutex );
+
+	a = attr_find( e->e_attrs, ad_olmAccessLogPurged );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", li->li_purged );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmAccessLogPurgeCurrent );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", li->li_purge_current );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmAccessLogPurgeActive );
+	assert( a != NULL );
+	if ( li->li_purge_active )
+		ber_bvreplace( &a->a_vals[ 0 ], (struct berval *)&slap_true_bv );
+	else
+		ber_bvreplace( &a->a_vals[ 0 ], (struct berval *)&slap_false_bv );
+
+	attr_delete( &e->e_attrs, ad_olmAccessLogPurgeLast );
+	if ( !BER_BVISEMPTY( &li->li_purge_last ))
+		attr_merge_normalize_one( e, ad_olmAccessLogPurgeLast,
+			&li->li_purge_last, NULL );
+
+	ldap_pvt_thread_mutex_unlock( &li->li_purge_mutex );
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+accesslog_monitor_free(
+	Entry		*e,
+	void		**priv )
+{
+	struct berval	values[ 2 ];
+	Modification	mod = { 0 };
+	AttributeDescription **ads[] = { &ad_olmAccessLogPurged,
+		&ad_olmAccessLogPurgeCurrent, &ad_olmAccessLogPurgeLast,
+		&ad_olmAccessLogPurgeActive, NULL };
+	int i;
+
+	const char	*text;
+	char		textbuf[ SLAP_TEXT_BUFLEN ];
+
+	/* NOTE: if slap_shutdown != 0, priv might have already been freed */
+	*priv = NULL;
+
+	/* Remove objectClass */
+	mod.sm_op = LDAP_MOD_DELETE;
+	mod.sm_desc = slap_schema.si_ad_objectClass;
+	mod.sm_values = values;
+	mod.sm_numvals = 1;
+	values[ 0 ] = oc_olmAccessLog->soc_cname;
+	BER_BVZERO( &values[ 1 ] );
+
+	modify_delete_values( e, &mod, 1, &text,
+		textbuf, sizeof( textbuf ) );
+	/* don't care too much about return code... */
+
+	/* remove attrs */
+	mod.sm_values = NULL;
+	mod.sm_numvals = 0;
+	for ( i = 0; ads[i]; i++ ) {
+		mod.sm_desc = *ads[i];
+		modify_delete_values( e, &mod, 1, &text,
+			textbuf, sizeof( textbuf ) );
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+accesslog_monitor_db_init( BackendDB *be )
+{
+	if ( backend_info( "monitor" ) != NULL ) {
+		SLAP_DBFLAGS( be ) |= SLAP_DBFLAG_MONITORING;
+	}
+
+	return 0;
+}
+
+static int
+accesslog_monitor_db_open( BackendDB *be )
+{
+	slap_overinst		*on = (slap_overinst *)be->bd_info;
+	log_info		*li = on->on_bi.bi_private;
+	Attribute		*a, *next;
+	monitor_callback_t	*cb = NULL;
+	int			rc = 0;
+	BackendInfo		*mi;
+	monitor_extra_t		*mbe;
+
+	if ( !SLAP_DBMONITORING( be ) ) {
+		return 0;
+	}
+
+	mi = backend_info( "monitor" );
+	if ( !mi || !mi->bi_extra ) {
+		SLAP_DBFLAGS( be ) ^= SLAP_DBFLAG_MONITORING;
+		return 0;
+	}
+	mbe = mi->bi_extra;
+
+	/* don't bother if monitor is not configured */
+	if ( !mbe->is_configured() ) {
+		static int warning = 0;
+
+		if ( warning++ == 0 ) {
+			Debug( LDAP_DEBUG_ANY, "accesslog_monitor_db_open: "
+				"monitoring disabled; "
+				"configure monitor database to enable\n" );
+		}
+
+		return 0;
+	}
+
+	/* alloc as many as required (plus 1 for objectClass) */
+	a = attrs_alloc( 1 + 3 );
+	if ( a == NULL ) {
+		rc = 1;
+		goto cleanup;
+	}
+
+	a->a_desc = slap_schema.si_ad_objectClass;
+	attr_valadd( a, &oc_olmAccessLog->soc_cname, NULL, 1 );
+	next = a->a_next;
+
+	{
+		struct berval	bv = BER_BVC( "0" );
+
+		next->a_desc = ad_olmAccessLogPurged;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmAccessLogPurgeCurrent;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmAccessLogPurgeActive;
+		attr_valadd( next, (struct berval *)&slap_false_bv, NULL, 1 );
+		next = next->a_next;
+	}
+
+	cb = ch_calloc( sizeof( monitor_callback_t ), 1 );
+	cb->mc_update = accesslog_monitor_update;
+	cb->mc_free = accesslog_monitor_free;
+	cb->mc_private = (void *)li;
+
+	/* make sure the database is registered; then add monitor attributes */
+	BER_BVZERO( &li->li_monitor_ndn );
+	rc = mbe->register_overlay( be, on, &li->li_monitor_ndn );
+	if ( rc == 0 ) {
+		rc = mbe->register_entry_attrs( &li->li_monitor_ndn, a, cb,
+			NULL, -1, NULL );
+	}
+
+cleanup:;
+	if ( rc != 0 ) {
+		if ( cb != NULL ) {
+			ch_free( cb );
+			cb = NULL;
+		}
+
+		if ( a != NULL ) {
+			attrs_free( a );
+			a = NULL;
+		}
+	}
+
+	/* store for cleanup */
+	li->li_monitor_cb = (void *)cb;
+
+	/* we don't need to keep track of the attributes, because
+	 * accesslog_monitor_free() takes care of everything */
+	if ( a != NULL ) {
+		attrs_free( a );
+	}
+
+	return rc;
+}
+
+static int
+accesslog_monitor_db_close( BackendDB *be )
+{
+	slap_overinst *on = (slap_overinst *)be->bd_info;
+	log_info *li = on->on_bi.bi_private;
+
+	if ( li->li_monitor_cb != NULL ) {
+		BackendInfo		*mi = backend_info( "monitor" );
+		monitor_extra_t		*mbe;
+
+		if ( mi && mi->bi_extra ) {
+			mbe = mi->bi_extra;
+			mbe->unregister_entry_callback( &li->li_monitor_ndn,
+				(monitor_callback_t *)li->li_monitor_cb,
+				NULL, 0, NULL );
+		}
+		li->li_monitor_cb = NULL;
+	}
+
+	return 0;
+}
+
+#endif /* ACCESSLOG_MONITOR */
+
 static slap_overinst accesslog;
 
 static int
@@ -2211,7 +2834,16 @@ accesslog_db_init(
 	on->on_bi.bi_private = li;
 	ldap_pvt_thread_mutex_recursive_init( &li->li_op_rmutex );
 	ldap_pvt_thread_mutex_init( &li->li_log_mutex );
+	ldap_pvt_thread_mutex_init( &li->li_q_mutex );
+	ldap_pvt_thread_cond_init( &li->li_q_cond );
+	li->li_qtail = &li->li_queue;
+	ldap_pvt_thread_mutex_init( &li->li_purge_mutex );
+	li->li_purge_batch = PURGE_BATCH;
+#ifndef ACCESSLOG_MONITOR
 	return 0;
+#else /* ACCESSLOG_MONITOR */
+	return accesslog_monitor_db_init( be );
+#endif /* ACCESSLOG_MONITOR */
 }
 
 static int
@@ -2230,6 +2862,9 @@ accesslog_db_destroy(
 		li->li_oldattrs = la->next;
 		ch_free( la );
 	}
+	ldap_pvt_thread_mutex_destroy( &li->li_purge_mutex );
+	ldap_pvt_thread_cond_destroy( &li->li_q_cond );
+	ldap_pvt_thread_mutex_destroy( &li->li_q_mutex );
 	ldap_pvt_thread_mutex_destroy( &li->li_log_mutex );
 	ldap_pvt_thread_mutex_destroy( &li->li_op_rmutex );
 	free( li );
@@ -2410,6 +3045,31 @@ accesslog_db_open(
 		"accesslog_db_root", li->li_db->be_suffix[0].bv_val );
 	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
 
+#ifdef ACCESSLOG_MONITOR
+	return accesslog_monitor_db_open( be );
+#else /* ! ACCESSLOG_MONITOR */
+	return 0;
+#endif /* ! ACCESSLOG_MONITOR */
+}
+
+/* Let the writer finish with the queue */
+static int
+accesslog_db_close(
+	BackendDB *be,
+	ConfigReply *cr
+)
+{
+	slap_overinst *on = (slap_overinst *)be->bd_info;
+	log_info *li = on->on_bi.bi_private;
+
+	ldap_pvt_thread_mutex_lock( &li->li_q_mutex );
+	while ( li->li_writing )
+		ldap_pvt_thread_cond_wait( &li->li_q_cond, &li->li_q_mutex );
+	ldap_pvt_thread_mutex_unlock( &li->li_q_mutex );
+
+#ifdef ACCESSLOG_MONITOR
+	accesslog_monitor_db_close( be );
+#endif /* ACCESSLOG_MONITOR */
 	return 0;
 }
 
@@ -2421,6 +3081,7 @@ int accesslog_initialize()
 	accesslog.on_bi.bi_db_init = accesslog_db_init;
 	accesslog.on_bi.bi_db_destroy = accesslog_db_destroy;
 	accesslog.on_bi.bi_db_open = accesslog_db_open;
+	accesslog.on_bi.bi_db_close = accesslog_db_close;
 
 	accesslog.on_bi.bi_op_add = accesslog_op_mod;
 	accesslog.on_bi.bi_op_bind = accesslog_op_misc;
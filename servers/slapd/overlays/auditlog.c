@@ -25,26 +25,77 @@
 
 #include <stdio.h>
 
+#include <ac/stdarg.h>
 #include <ac/string.h>
 #include <ac/ctype.h>
+#include <ac/errno.h>
+#include <ac/unistd.h>
+#include <sys/stat.h>
 
 #include "slap.h"
 #include "config.h"
 #include "ldif.h"
 
+/* A change formatted as LDIF, waiting to be written by the writer */
+typedef struct auditlog_rec {
+	struct auditlog_rec *ar_next;
+	char *ar_buf;
+	ber_len_t ar_len;
+	ber_len_t ar_size;
+} auditlog_rec;
+
 typedef struct auditlog_data {
-	ldap_pvt_thread_mutex_t ad_mutex;
+	ldap_pvt_thread_mutex_t ad_mutex;	/* protects the file */
 	char *ad_logfile;
+	FILE *ad_file;		/* kept open across changes */
+	dev_t ad_dev;
+	ino_t ad_ino;
+	off_t ad_size;
+	int ad_unsynced;	/* changes written since the last fsync */
+	int ad_fsync;		/* fsync every that many changes, 0 = never */
+	int ad_rotate;		/* rotate at that many kbytes, 0 = never */
+	int ad_async;		/* max queued changes, 0 = write inline */
+	int ad_nqueued;
+	int ad_writing;		/* writer task is submitted or running */
+	auditlog_rec *ad_queue, **ad_qtail;
+	ldap_pvt_thread_mutex_t ad_q_mutex;
+	ldap_pvt_thread_cond_t ad_q_cond;
 } auditlog_data;
 
+enum {
+	AUDIT_FILE = 1,
+	AUDIT_QUEUE,
+	AUDIT_FSYNC,
+	AUDIT_ROTATE
+};
+
+static ConfigDriver auditlog_cf_gen;
+
 static ConfigTable auditlogcfg[] = {
 	{ "auditlog", "filename", 2, 2, 0,
-	  ARG_STRING|ARG_OFFSET,
-	  (void *)offsetof(auditlog_data, ad_logfile),
+	  ARG_STRING|ARG_MAGIC|AUDIT_FILE, auditlog_cf_gen,
 	  "( OLcfgOvAt:15.1 NAME 'olcAuditlogFile' "
 	  "DESC 'Filename for auditlogging' "
 	  "EQUALITY caseExactMatch "
 	  "SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "auditlog-queue", "num", 2, 2, 0,
+	  ARG_INT|ARG_MAGIC|AUDIT_QUEUE, auditlog_cf_gen,
+	  "( OLcfgOvAt:15.2 NAME 'olcAuditlogQueue' "
+	  "DESC 'Max number of changes queued for the writer thread' "
+	  "EQUALITY integerMatch "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "auditlog-fsync", "num", 2, 2, 0,
+	  ARG_INT|ARG_MAGIC|AUDIT_FSYNC, auditlog_cf_gen,
+	  "( OLcfgOvAt:15.3 NAME 'olcAuditlogFsync' "
+	  "DESC 'Number of changes after which the file is synced to disk' "
+	  "EQUALITY integerMatch "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "auditlog-rotate", "kbytes", 2, 2, 0,
+	  ARG_INT|ARG_MAGIC|AUDIT_ROTATE, auditlog_cf_gen,
+	  "( OLcfgOvAt:15.4 NAME 'olcAuditlogRotate' "
+	  "DESC 'Size in kbytes at which the file is rotated' "
+	  "EQUALITY integerMatch "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -53,24 +104,314 @@ static ConfigOCs auditlogocs[] = {
 	  "NAME 'olcAuditlogConfig' "
 	  "DESC 'Auditlog configuration' "
 	  "SUP olcOverlayConfig "
-	  "MAY ( olcAuditlogFile ) )",
+	  "MAY ( olcAuditlogFile $ olcAuditlogQueue $ olcAuditlogFsync $ "
+	  "olcAuditlogRotate ) )",
 	  Cft_Overlay, auditlogcfg },
 	{ NULL, 0, NULL }
 };
 
-static int fprint_ldif(FILE *f, char *name, char *val, ber_len_t len) {
+static int
+auditlog_cf_gen( ConfigArgs *c )
+{
+	slap_overinst *on = (slap_overinst *)c->bi;
+	auditlog_data *ad = on->on_bi.bi_private;
+	int rc = 0;
+
+	switch ( c->op ) {
+	case SLAP_CONFIG_EMIT:
+		switch ( c->type ) {
+		case AUDIT_FILE:
+			if ( ad->ad_logfile )
+				c->value_string = ch_strdup( ad->ad_logfile );
+			else
+				rc = 1;
+			break;
+		case AUDIT_QUEUE:
+			c->value_int = ad->ad_async;
+			break;
+		case AUDIT_FSYNC:
+			c->value_int = ad->ad_fsync;
+			break;
+		case AUDIT_ROTATE:
+			c->value_int = ad->ad_rotate;
+			break;
+		}
+		break;
+	case LDAP_MOD_DELETE:
+		switch ( c->type ) {
+		case AUDIT_FILE:
+			ldap_pvt_thread_mutex_lock( &ad->ad_mutex );
+			if ( ad->ad_file ) {
+				fclose( ad->ad_file );
+				ad->ad_file = NULL;
+			}
+			ch_free( ad->ad_logfile );
+			ad->ad_logfile = NULL;
+			ldap_pvt_thread_mutex_unlock( &ad->ad_mutex );
+			break;
+		case AUDIT_QUEUE:
+			ldap_pvt_thread_mutex_lock( &ad->ad_q_mutex );
+			ad->ad_async = 0;
+			ldap_pvt_thread_mutex_unlock( &ad->ad_q_mutex );
+			break;
+		case AUDIT_FSYNC:
+			ad->ad_fsync = 0;
+			break;
+		case AUDIT_ROTATE:
+			ad->ad_rotate = 0;
+			break;
+		}
+		break;
+	case SLAP_CONFIG_ADD:
+	case LDAP_MOD_ADD:
+		switch ( c->type ) {
+		case AUDIT_FILE:
+			ldap_pvt_thread_mutex_lock( &ad->ad_mutex );
+			if ( ad->ad_file ) {
+				fclose( ad->ad_file );
+				ad->ad_file = NULL;
+			}
+			ch_free( ad->ad_logfile );
+			ad->ad_logfile = c->value_string;
+			ldap_pvt_thread_mutex_unlock( &ad->ad_mutex );
+			break;
+		default:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> invalid value %d", c->argv[0], c->value_int );
+				Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+				return 1;
+			}
+			if ( c->type == AUDIT_QUEUE ) {
+				ldap_pvt_thread_mutex_lock( &ad->ad_q_mutex );
+				ad->ad_async = c->value_int;
+				ldap_pvt_thread_mutex_unlock( &ad->ad_q_mutex );
+			} else if ( c->type == AUDIT_FSYNC ) {
+				ad->ad_fsync = c->value_int;
+			} else {
+				ad->ad_rotate = c->value_int;
+			}
+			break;
+		}
+		break;
+	}
+	return rc;
+}
+
+static void
+auditlog_put( auditlog_rec *ar, const char *s, ber_len_t len )
+{
+	if ( ar->ar_len + len >= ar->ar_size ) {
+		while ( ar->ar_len + len >= ar->ar_size )
+			ar->ar_size *= 2;
+		ar->ar_buf = ch_realloc( ar->ar_buf, ar->ar_size );
+	}
+	AC_MEMCPY( ar->ar_buf + ar->ar_len, s, len );
+	ar->ar_len += len;
+}
+
+static void
+auditlog_printf( auditlog_rec *ar, const char *fmt, ... )
+{
+	va_list ap;
+	int len;
+
+	for (;;) {
+		va_start( ap, fmt );
+		len = vsnprintf( ar->ar_buf + ar->ar_len, ar->ar_size - ar->ar_len,
+			fmt, ap );
+		va_end( ap );
+		if ( len < 0 )
+			return;
+		if ( ar->ar_len + len < ar->ar_size )
+			break;
+		while ( ar->ar_len + len >= ar->ar_size )
+			ar->ar_size *= 2;
+		ar->ar_buf = ch_realloc( ar->ar_buf, ar->ar_size );
+	}
+	ar->ar_len += len;
+}
+
+static int auditlog_put_ldif(auditlog_rec *ar, char *name, char *val, ber_len_t len) {
 	char *s;
 	if((s = ldif_put(LDIF_PUT_VALUE, name, val, len)) == NULL)
 		return(-1);
-	fputs(s, f);
+	auditlog_put(ar, s, strlen(s));
 	ber_memfree(s);
 	return(0);
 }
 
+/* The file functions are called with ad_mutex locked */
+
+/* Opens the log file if it isn't yet, or again if it has been moved
+ * or removed since, e.g. by an external log rotation.
+ */
+static FILE *
+auditlog_open( auditlog_data *ad )
+{
+	struct stat st;
+
+	if ( ad->ad_file ) {
+		if ( stat( ad->ad_logfile, &st ) == 0 &&
+			st.st_dev == ad->ad_dev && st.st_ino == ad->ad_ino )
+			return ad->ad_file;
+		fclose( ad->ad_file );
+		ad->ad_file = NULL;
+	}
+
+	if (( ad->ad_file = fopen( ad->ad_logfile, "a" )) == NULL ) {
+		Debug( LDAP_DEBUG_ANY, "auditlog_open: "
+			"cannot open \"%s\": %s\n", ad->ad_logfile,
+			strerror( errno ));
+		return NULL;
+	}
+	if ( fstat( fileno( ad->ad_file ), &st ) == 0 ) {
+		ad->ad_dev = st.st_dev;
+		ad->ad_ino = st.st_ino;
+		ad->ad_size = st.st_size;
+	}
+	return ad->ad_file;
+}
+
+/* Renames the file to <file>.<YYYYmmddHHMMSS>, the next change
+ * goes to a new file */
+static void
+auditlog_rotate( auditlog_data *ad )
+{
+	struct tm tm;
+	time_t now = slap_get_time();
+	char *name;
+	size_t len;
+	int i, n;
+
+	fclose( ad->ad_file );
+	ad->ad_file = NULL;
+
+	len = strlen( ad->ad_logfile ) + STRLENOF( ".YYYYmmddHHMMSS.nnn" ) + 1;
+	name = ch_malloc( len );
+	ldap_pvt_gmtime( &now, &tm );
+	n = snprintf( name, len, "%s.", ad->ad_logfile );
+	n += strftime( name + n, len - n, "%Y%m%d%H%M%S", &tm );
+	for ( i = 1; access( name, F_OK ) == 0 && i < 1000; i++ )
+		snprintf( name + n, len - n, ".%d", i );
+	if ( rename( ad->ad_logfile, name ) < 0 ) {
+		Debug( LDAP_DEBUG_ANY, "auditlog_rotate: "
+			"cannot rename \"%s\" to \"%s\": %s\n",
+			ad->ad_logfile, name, strerror( errno ));
+	}
+	ch_free( name );
+}
+
+static void
+auditlog_write( auditlog_data *ad, auditlog_rec *ar )
+{
+	FILE *f;
+
+	if ( !ad->ad_logfile || ( f = auditlog_open( ad )) == NULL )
+		return;
+	fwrite( ar->ar_buf, 1, ar->ar_len, f );
+	ad->ad_size += ar->ar_len;
+	ad->ad_unsynced++;
+}
+
+/* Called after each change written inline, or batch of changes
+ * written by the writer */
+static void
+auditlog_flush( auditlog_data *ad )
+{
+	if ( !ad->ad_file )
+		return;
+	fflush( ad->ad_file );
+	if ( ad->ad_fsync && ad->ad_unsynced >= ad->ad_fsync ) {
+		fsync( fileno( ad->ad_file ));
+		ad->ad_unsynced = 0;
+	}
+	if ( ad->ad_rotate && ad->ad_size >= (off_t)ad->ad_rotate * 1024 )
+		auditlog_rotate( ad );
+}
+
+static void
+auditlog_rec_free( auditlog_rec *ar )
+{
+	ch_free( ar->ar_buf );
+	ch_free( ar );
+}
+
+/* Write the queued changes in the order they were queued, with a
+ * single flush per batch taken off the queue.
+ */
+static void *
+auditlog_writer( void *ctx, void *arg )
+{
+	auditlog_data *ad = arg;
+	auditlog_rec *ar, *next;
+
+	ldap_pvt_thread_mutex_lock( &ad->ad_q_mutex );
+	ad->ad_writing = 2;
+	while (( ar = ad->ad_queue )) {
+		ad->ad_queue = NULL;
+		ad->ad_qtail = &ad->ad_queue;
+		ad->ad_nqueued = 0;
+		ldap_pvt_thread_cond_broadcast( &ad->ad_q_cond );
+		ldap_pvt_thread_mutex_unlock( &ad->ad_q_mutex );
+
+		ldap_pvt_thread_mutex_lock( &ad->ad_mutex );
+		for ( ; ar; ar = next ) {
+			next = ar->ar_next;
+			auditlog_write( ad, ar );
+			auditlog_rec_free( ar );
+		}
+		auditlog_flush( ad );
+		ldap_pvt_thread_mutex_unlock( &ad->ad_mutex );
+
+		ldap_pvt_thread_mutex_lock( &ad->ad_q_mutex );
+	}
+	ad->ad_writing = 0;
+	ldap_pvt_thread_cond_broadcast( &ad->ad_q_cond );
+	ldap_pvt_thread_mutex_unlock( &ad->ad_q_mutex );
+
+	return NULL;
+}
+
+/* Hand a change over to the writer task. Waits for room if the
+ * queue is full. Returns zero if the change must be written inline.
+ */
+static int
+auditlog_queue( auditlog_data *ad, auditlog_rec *ar )
+{
+	ldap_pvt_thread_mutex_lock( &ad->ad_q_mutex );
+	/* Changes still queued from before the queue got turned off
+	 * must be written first */
+	if ( !ad->ad_async && !ad->ad_queue ) {
+		ldap_pvt_thread_mutex_unlock( &ad->ad_q_mutex );
+		return 0;
+	}
+	if ( !ad->ad_writing ) {
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+				auditlog_writer, ad )) {
+			ldap_pvt_thread_mutex_unlock( &ad->ad_q_mutex );
+			return 0;
+		}
+		ad->ad_writing = 1;
+	}
+	/* Only wait on a running writer, a pending one may need
+	 * this very thread to get started */
+	while ( ad->ad_writing == 2 && ad->ad_async &&
+		ad->ad_nqueued >= ad->ad_async )
+		ldap_pvt_thread_cond_wait( &ad->ad_q_cond, &ad->ad_q_mutex );
+
+	ar->ar_next = NULL;
+	*ad->ad_qtail = ar;
+	ad->ad_qtail = &ar->ar_next;
+	ad->ad_nqueued++;
+	ldap_pvt_thread_mutex_unlock( &ad->ad_q_mutex );
+	return 1;
+}
+
 static int auditlog_response(Operation *op, SlapReply *rs) {
 	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
 	auditlog_data *ad = on->on_bi.bi_private;
-	FILE *f;
+	auditlog_rec *ar;
 	Attribute *a;
 	Modifications *m;
 	struct berval *b, *who = NULL, peername;
@@ -121,22 +462,24 @@ static int auditlog_response(Operation *op, SlapReply *rs) {
 		who = &op->o_dn;
 
 	peername = op->o_conn->c_peer_name;
-	ldap_pvt_thread_mutex_lock(&ad->ad_mutex);
-	if((f = fopen(ad->ad_logfile, "a")) == NULL) {
-		ldap_pvt_thread_mutex_unlock(&ad->ad_mutex);
-		return SLAP_CB_CONTINUE;
-	}
+
+	/* format the change here, the file is only written
+	 * by whoever holds ad_mutex */
+	ar = ch_malloc( sizeof( auditlog_rec ));
+	ar->ar_size = 1024;
+	ar->ar_buf = ch_malloc( ar->ar_size );
+	ar->ar_len = 0;
 
 	stamp = slap_get_time();
-	fprintf(f, "# %s %ld %s%s%s %s conn=%ld\n",
+	auditlog_printf(ar, "# %s %ld %s%s%s %s conn=%ld\n",
 		what, (long)stamp, suffix, who ? " " : "", who ? who->bv_val : "",
 		peername.bv_val ? peername.bv_val: "", op->o_conn->c_connid);
 
 	if ( !BER_BVISEMPTY( &op->o_conn->c_dn ) &&
 		(!who || !dn_match( who, &op->o_conn->c_dn )))
-		fprintf(f, "# realdn: %s\n", op->o_conn->c_dn.bv_val );
+		auditlog_printf(ar, "# realdn: %s\n", op->o_conn->c_dn.bv_val );
 
-	fprintf(f, "dn: %s\nchangetype: %s\n",
+	auditlog_printf(ar, "dn: %s\nchangetype: %s\n",
 		op->o_req_dn.bv_val, what);
 
 	switch(op->o_tag) {
@@ -144,7 +487,7 @@ static int auditlog_response(Operation *op, SlapReply *rs) {
 		for(a = op->ora_e->e_attrs; a; a = a->a_next)
 		  if((b = a->a_vals) != NULL)
 			for(i = 0; b[i].bv_val; i++)
-				fprint_ldif(f, a->a_desc->ad_cname.bv_val, b[i].bv_val, b[i].bv_len);
+				auditlog_put_ldif(ar, a->a_desc->ad_cname.bv_val, b[i].bv_val, b[i].bv_len);
 		break;
 
 	  case LDAP_REQ_MODIFY:
@@ -155,21 +498,21 @@ static int auditlog_response(Operation *op, SlapReply *rs) {
 				case LDAP_MOD_DELETE:	 whatm = "delete";	break;
 				case LDAP_MOD_INCREMENT: whatm = "increment";	break;
 				default:
-					fprintf(f, "# MOD_TYPE_UNKNOWN:%02x\n", m->sml_op & LDAP_MOD_OP);
+					auditlog_printf(ar, "# MOD_TYPE_UNKNOWN:%02x\n", m->sml_op & LDAP_MOD_OP);
 					continue;
 			}
-			fprintf(f, "%s: %s\n", whatm, m->sml_desc->ad_cname.bv_val);
+			auditlog_printf(ar, "%s: %s\n", whatm, m->sml_desc->ad_cname.bv_val);
 			if((b = m->sml_values) != NULL)
 			  for(i = 0; b[i].bv_val; i++)
-				fprint_ldif(f, m->sml_desc->ad_cname.bv_val, b[i].bv_val, b[i].bv_len);
-			fprintf(f, "-\n");
+				auditlog_put_ldif(ar, m->sml_desc->ad_cname.bv_val, b[i].bv_val, b[i].bv_len);
+			auditlog_printf(ar, "-\n");
 		}
 		break;
 
 	  case LDAP_REQ_MODRDN:
-		fprintf(f, "newrdn: %s\ndeleteoldrdn: %s\n",
+		auditlog_printf(ar, "newrdn: %s\ndeleteoldrdn: %s\n",
 			op->orr_newrdn.bv_val, op->orr_deleteoldrdn ? "1" : "0");
-		if(op->orr_newSup) fprintf(f, "newsuperior: %s\n", op->orr_newSup->bv_val);
+		if(op->orr_newSup) auditlog_printf(ar, "newsuperior: %s\n", op->orr_newSup->bv_val);
 		break;
 
 	  case LDAP_REQ_DELETE:
@@ -177,10 +520,15 @@ static int auditlog_response(Operation *op, SlapReply *rs) {
 		break;
 	}
 
-	fprintf(f, "# end %s %ld\n\n", what, (long)stamp);
+	auditlog_printf(ar, "# end %s %ld\n\n", what, (long)stamp);
 
-	fclose(f);
-	ldap_pvt_thread_mutex_unlock(&ad->ad_mutex);
+	if ( !auditlog_queue( ad, ar )) {
+		ldap_pvt_thread_mutex_lock(&ad->ad_mutex);
+		auditlog_write( ad, ar );
+		auditlog_flush( ad );
+		ldap_pvt_thread_mutex_unlock(&ad->ad_mutex);
+		auditlog_rec_free( ar );
+	}
 	return SLAP_CB_CONTINUE;
 }
 
@@ -197,6 +545,37 @@ auditlog_db_init(
 
 	on->on_bi.bi_private = ad;
 	ldap_pvt_thread_mutex_init( &ad->ad_mutex );
+	ldap_pvt_thread_mutex_init( &ad->ad_q_mutex );
+	ldap_pvt_thread_cond_init( &ad->ad_q_cond );
+	ad->ad_qtail = &ad->ad_queue;
+	return 0;
+}
+
+/* Let the writer finish with the queue, and close the file */
+static int
+auditlog_db_close(
+	BackendDB *be,
+	ConfigReply *cr
+)
+{
+	slap_overinst *on = (slap_overinst *)be->bd_info;
+	auditlog_data *ad = on->on_bi.bi_private;
+
+	ldap_pvt_thread_mutex_lock( &ad->ad_q_mutex );
+	while ( ad->ad_writing )
+		ldap_pvt_thread_cond_wait( &ad->ad_q_cond, &ad->ad_q_mutex );
+	ldap_pvt_thread_mutex_unlock( &ad->ad_q_mutex );
+
+	ldap_pvt_thread_mutex_lock( &ad->ad_mutex );
+	if ( ad->ad_file ) {
+		fflush( ad->ad_file );
+		if ( ad->ad_fsync && ad->ad_unsynced )
+			fsync( fileno( ad->ad_file ));
+		fclose( ad->ad_file );
+		ad->ad_file = NULL;
+		ad->ad_unsynced = 0;
+	}
+	ldap_pvt_thread_mutex_unlock( &ad->ad_mutex );
 	return 0;
 }
 
@@ -209,6 +588,8 @@ auditlog_db_destroy(
 	slap_overinst *on = (slap_overinst *)be->bd_info;
 	auditlog_data *ad = on->on_bi.bi_private;
 
+	ldap_pvt_thread_cond_destroy( &ad->ad_q_cond );
+	ldap_pvt_thread_mutex_destroy( &ad->ad_q_mutex );
 	ldap_pvt_thread_mutex_destroy( &ad->ad_mutex );
 	free( ad->ad_logfile );
 	free( ad );
@@ -221,6 +602,7 @@ int auditlog_initialize() {
 	auditlog.on_bi.bi_type = "auditlog";
 	auditlog.on_bi.bi_flags = SLAPO_BFLAG_SINGLE;
 	auditlog.on_bi.bi_db_init = auditlog_db_init;
+	auditlog.on_bi.bi_db_close = auditlog_db_close;
 	auditlog.on_bi.bi_db_destroy = auditlog_db_destroy;
 	auditlog.on_response = auditlog_response;
 
@@ -302,7 +302,7 @@ constraint_cf_gen( ConfigArgs *c )
 				ap.type = CONSTRAINT_REGEX;
 				ap.re = ch_malloc( sizeof(regex_t) );
 				if ((err = regcomp( ap.re,
-					c->argv[3], REG_EXTENDED )) != 0) {
+					c->argv[3], REG_EXTENDED|REG_NOSUB )) != 0) {
 					char errmsg[1024];
 							
 					regerror( err, ap.re, errmsg, sizeof(errmsg) );
@@ -570,20 +570,201 @@ done:;
 	return rc;
 }
 
+typedef struct constraint_uri_ctx {
+	Filter *values;		/* one OR per asserted value, in value order */
+	char *found;
+	int nfound;
+	int nvals;
+} constraint_uri_ctx;
+
 static int
 constraint_uri_cb( Operation *op, SlapReply *rs ) 
 {
 	if(rs->sr_type == REP_SEARCH) {
-		int *foundp = op->o_callback->sc_private;
-
-		*foundp = 1;
+		constraint_uri_ctx *uc = op->o_callback->sc_private;
+		Filter *f;
+		int i;
 
 		Debug(LDAP_DEBUG_TRACE, "==> constraint_uri_cb <%s>\n",
 			rs->sr_entry ? rs->sr_entry->e_name.bv_val : "UNKNOWN_DN" );
+
+		if ( uc->nvals == 1 ) {
+			/* the filter alone already proves it */
+			uc->found[0] = 1;
+			uc->nfound = 1;
+
+		} else {
+			/* figure out which of the values this entry satisfies */
+			for ( i = 0, f = uc->values; f && i < uc->nvals; i++, f = f->f_next ) {
+				if ( !uc->found[i] &&
+					test_filter( op, rs->sr_entry, f ) == LDAP_COMPARE_TRUE )
+				{
+					uc->found[i] = 1;
+					uc->nfound++;
+				}
+			}
+		}
+
+		/* nothing left to prove, stop the search */
+		if ( uc->nfound == uc->nvals )
+			return LDAP_SIZELIMIT_EXCEEDED;
 	}
 	return 0;
 }
 
+/*
+ * Check all values of one attribute against a uri constraint with a
+ * single internal search:
+ *
+ *	(&(<uri filter>)(|(|(a1=v1)(a2=v1)...)(|(a1=v2)(a2=v2)...)...))
+ *
+ * instead of one search per value. The search is cut short as soon as
+ * every value has been matched.
+ */
+static int
+constraint_uri_violation( constraint *c, BerVarray b, Operation *op )
+{
+	Operation nop = *op;
+	slap_overinst *on = (slap_overinst *) op->o_bd->bd_info;
+	slap_callback cb = { 0 };
+	constraint_uri_ctx uc = { 0 };
+	SlapReply nrs = { REP_RESULT };
+	struct berval filterstr, *esc;
+	int i, j, nvals;
+	int rc;
+	size_t len;
+	char *ptr;
+
+	if ( !c->attrs ) return LDAP_SUCCESS;
+
+	for ( nvals = 0; b[nvals].bv_val; nvals++ )
+		/* count */ ;
+	if ( !nvals ) return LDAP_SUCCESS;
+
+	nop.o_protocol = LDAP_VERSION3;
+	nop.o_tag = LDAP_REQ_SEARCH;
+	nop.o_time = slap_get_time();
+	if (c->lud->lud_dn) {
+		struct berval dn;
+
+		ber_str2bv(c->lud->lud_dn, 0, 0, &dn);
+		nop.o_req_dn = dn;
+		nop.o_req_ndn = dn;
+		nop.o_bd = select_backend(&nop.o_req_ndn, 1 );
+		if (!nop.o_bd) {
+			return LDAP_NO_SUCH_OBJECT; /* unexpected error */
+		}
+		if (!nop.o_bd->be_search) {
+			return LDAP_OTHER; /* unexpected error */
+		}
+	} else {
+		nop.o_req_dn = nop.o_bd->be_nsuffix[0];
+		nop.o_req_ndn = nop.o_bd->be_nsuffix[0];
+		nop.o_bd = on->on_info->oi_origdb;
+	}
+
+	esc = op->o_tmpalloc( nvals * sizeof(struct berval), op->o_tmpmemctx );
+	len = STRLENOF("(&(") + c->filter.bv_len + STRLENOF(")(|");
+	for ( i = 0; i < nvals; i++ ) {
+		filter_escape_value_x( &b[i], &esc[i], op->o_tmpmemctx );
+		len += STRLENOF("(|") + STRLENOF(")");
+		for ( j = 0; c->attrs[j]; j++ ) {
+			len += STRLENOF("(") +
+				   c->attrs[j]->ad_cname.bv_len +
+				   STRLENOF("=") +
+				   esc[i].bv_len +
+				   STRLENOF(")");
+		}
+	}
+	len += STRLENOF("))");
+
+	filterstr.bv_len = len;
+	filterstr.bv_val = op->o_tmpalloc( len + 1, op->o_tmpmemctx );
+
+	ptr = lutil_strcopy( filterstr.bv_val, "(&(" );
+	ptr = lutil_strncopy( ptr, c->filter.bv_val, c->filter.bv_len );
+	ptr = lutil_strcopy( ptr, ")(|" );
+	for ( i = 0; i < nvals; i++ ) {
+		ptr = lutil_strcopy( ptr, "(|" );
+		for ( j = 0; c->attrs[j]; j++ ) {
+			*ptr++ = '(';
+			ptr = lutil_strcopy( ptr, c->attrs[j]->ad_cname.bv_val );
+			*ptr++ = '=';
+			ptr = lutil_strncopy( ptr, esc[i].bv_val, esc[i].bv_len );
+			*ptr++ = ')';
+		}
+		*ptr++ = ')';
+		op->o_tmpfree( esc[i].bv_val, op->o_tmpmemctx );
+	}
+	*ptr++ = ')';
+	*ptr++ = ')';
+	*ptr = '\0';
+	op->o_tmpfree( esc, op->o_tmpmemctx );
+
+	uc.nvals = nvals;
+	uc.found = op->o_tmpcalloc( nvals, 1, op->o_tmpmemctx );
+
+	cb.sc_response = constraint_uri_cb;
+	cb.sc_private = &uc;
+
+	nop.o_do_not_cache = 1;
+	nop.o_callback = &cb;
+
+	nop.ors_scope = c->lud->lud_scope;
+	nop.ors_deref = LDAP_DEREF_NEVER;
+	nop.ors_slimit = SLAP_NO_LIMIT;
+	nop.ors_tlimit = SLAP_NO_LIMIT;
+	nop.ors_limit = NULL;
+
+	nop.ors_attrsonly = 0;
+	nop.ors_attrs = slap_anlist_no_attrs;
+
+	nop.ors_filterstr = filterstr;
+	nop.ors_filter = str2filter_x(&nop, filterstr.bv_val);
+	if ( nop.ors_filter == NULL ) {
+		Debug( LDAP_DEBUG_ANY,
+			"%s constraint_uri_violation filter=\"%s\" invalid\n",
+			op->o_log_prefix, filterstr.bv_val );
+		rc = LDAP_OTHER;
+
+	} else {
+		Filter *f = nop.ors_filter;
+
+		if ( f->f_choice == LDAP_FILTER_AND && f->f_and &&
+			f->f_and->f_next &&
+			f->f_and->f_next->f_choice == LDAP_FILTER_OR )
+		{
+			uc.values = f->f_and->f_next->f_or;
+		}
+
+		Debug(LDAP_DEBUG_TRACE,
+			"==> constraint_uri_violation filter = %s\n",
+			filterstr.bv_val );
+
+		rc = nop.o_bd->be_search( &nop, &nrs );
+		if ( rc == LDAP_SIZELIMIT_EXCEEDED && uc.nfound == nvals ) {
+			rc = LDAP_SUCCESS;
+		}
+
+		Debug(LDAP_DEBUG_TRACE,
+			"==> constraint_uri_violation rc = %d, found = %d/%d\n",
+			rc, uc.nfound, nvals );
+
+		filter_free_x( &nop, nop.ors_filter, 1 );
+	}
+	op->o_tmpfree( filterstr.bv_val, op->o_tmpmemctx );
+	op->o_tmpfree( uc.found, op->o_tmpmemctx );
+
+	if ((rc != LDAP_SUCCESS) && (rc != LDAP_NO_SUCH_OBJECT)) {
+		return rc; /* unexpected error */
+	}
+
+	if ( uc.nfound < nvals )
+		return LDAP_CONSTRAINT_VIOLATION; /* constraint violation */
+
+	return LDAP_SUCCESS;
+}
+
 static int
 constraint_violation( constraint *c, struct berval *bv, Operation *op )
 {
@@ -598,115 +779,28 @@ constraint_violation( constraint *c, struct berval *bv, Operation *op )
 			if (regexec(c->re, bv->bv_val, 0, NULL, 0) == REG_NOMATCH)
 				return LDAP_CONSTRAINT_VIOLATION; /* regular expression violation */
 			break;
-		case CONSTRAINT_URI: {
-			Operation nop = *op;
-			slap_overinst *on = (slap_overinst *) op->o_bd->bd_info;
-			slap_callback cb = { 0 };
-			int i;
-			int found = 0;
-			int rc;
-			size_t len;
-			struct berval filterstr;
-			char *ptr;
-
-			cb.sc_response = constraint_uri_cb;
-			cb.sc_private = &found;
-
-			nop.o_protocol = LDAP_VERSION3;
-			nop.o_tag = LDAP_REQ_SEARCH;
-			nop.o_time = slap_get_time();
-			if (c->lud->lud_dn) {
-				struct berval dn;
-
-				ber_str2bv(c->lud->lud_dn, 0, 0, &dn);
-				nop.o_req_dn = dn;
-				nop.o_req_ndn = dn;
-				nop.o_bd = select_backend(&nop.o_req_ndn, 1 );
-				if (!nop.o_bd) {
-					return LDAP_NO_SUCH_OBJECT; /* unexpected error */
-				}
-				if (!nop.o_bd->be_search) {
-					return LDAP_OTHER; /* unexpected error */
-				}
-			} else {
-				nop.o_req_dn = nop.o_bd->be_nsuffix[0];
-				nop.o_req_ndn = nop.o_bd->be_nsuffix[0];
-				nop.o_bd = on->on_info->oi_origdb;
-			}
-			nop.o_do_not_cache = 1;
-			nop.o_callback = &cb;
-
-			nop.ors_scope = c->lud->lud_scope;
-			nop.ors_deref = LDAP_DEREF_NEVER;
-			nop.ors_slimit = SLAP_NO_LIMIT;
-			nop.ors_tlimit = SLAP_NO_LIMIT;
-			nop.ors_limit = NULL;
-
-			nop.ors_attrsonly = 0;
-			nop.ors_attrs = slap_anlist_no_attrs;
-
-			len = STRLENOF("(&(") +
-				  c->filter.bv_len +
-				  STRLENOF(")(|");
-
-			for (i = 0; c->attrs[i]; i++) {
-				len += STRLENOF("(") +
-					   c->attrs[i]->ad_cname.bv_len +
-					   STRLENOF("=") +
-					   bv->bv_len +
-					   STRLENOF(")");
-			}
-
-			len += STRLENOF("))");
-			filterstr.bv_len = len;
-			filterstr.bv_val = op->o_tmpalloc(len + 1, op->o_tmpmemctx);
-
-			ptr = filterstr.bv_val +
-				snprintf(filterstr.bv_val, len, "(&(%s)(|", c->lud->lud_filter);
-			for (i = 0; c->attrs[i]; i++) {
-				*ptr++ = '(';
-				ptr = lutil_strcopy( ptr, c->attrs[i]->ad_cname.bv_val );
-				*ptr++ = '=';
-				ptr = lutil_strcopy( ptr, bv->bv_val );
-				*ptr++ = ')';
-			}
-			*ptr++ = ')';
-			*ptr++ = ')';
-			*ptr++ = '\0';
-
-			nop.ors_filterstr = filterstr;
-			nop.ors_filter = str2filter_x(&nop, filterstr.bv_val);
-			if ( nop.ors_filter == NULL ) {
-				Debug( LDAP_DEBUG_ANY,
-					"%s constraint_violation uri filter=\"%s\" invalid\n",
-					op->o_log_prefix, filterstr.bv_val );
-				rc = LDAP_OTHER;
-
-			} else {
-				SlapReply nrs = { REP_RESULT };
-
-				Debug(LDAP_DEBUG_TRACE,
-					"==> constraint_violation uri filter = %s\n",
-					filterstr.bv_val );
+		default:
+			/* uri is checked per attribute, see constraint_values_violation */
+			break;
+	}
 
-				rc = nop.o_bd->be_search( &nop, &nrs );
+	return LDAP_SUCCESS;
+}
 
-				Debug(LDAP_DEBUG_TRACE,
-					"==> constraint_violation uri rc = %d, found = %d\n",
-					rc, found );
-			}
-			op->o_tmpfree(filterstr.bv_val, op->o_tmpmemctx);
+/* check all values of an attribute against one constraint */
+static int
+constraint_values_violation( constraint *c, BerVarray b, Operation *op )
+{
+	int i, rc;
 
-			if ((rc != LDAP_SUCCESS) && (rc != LDAP_NO_SUCH_OBJECT)) {
-				return rc; /* unexpected error */
-			}
+	if ( c->type == CONSTRAINT_URI )
+		return constraint_uri_violation( c, b, op );
 
-			if (!found)
-				return LDAP_CONSTRAINT_VIOLATION; /* constraint violation */
-			break;
-		}
+	for ( i = 0; b[i].bv_val; i++ ) {
+		rc = constraint_violation( c, &b[i], op );
+		if ( rc )
+			return rc;
 	}
-
 	return LDAP_SUCCESS;
 }
 
@@ -722,6 +816,18 @@ print_message( struct berval *errtext, AttributeDescription *a )
 	return ret;
 }
 
+static int
+constraint_has_ad( constraint *cp, AttributeDescription *ad )
+{
+	int j;
+
+	for ( j = 0; cp->ap[j]; j++ ) {
+		if ( cp->ap[j] == ad )
+			return 1;
+	}
+	return 0;
+}
+
 static unsigned
 constraint_count_attr(Entry *e, AttributeDescription *ad)
 {
@@ -794,7 +900,6 @@ constraint_add( Operation *op, SlapReply *rs )
 	Attribute *a;
 	constraint *c = on->on_bi.bi_private, *cp;
 	BerVarray b = NULL;
-	int i;
 	struct berval rsv = BER_BVC("add breaks constraint");
 	int rc = 0;
 	char *msg = NULL;
@@ -815,11 +920,7 @@ constraint_add( Operation *op, SlapReply *rs )
 		if (is_at_operational(a->a_desc->ad_type)) continue;
 
 		for(cp = c; cp; cp = cp->ap_next) {
-			int j;
-			for (j = 0; cp->ap[j]; j++) {
-				if (cp->ap[j] == a->a_desc) break;
-			}
-			if (cp->ap[j] == NULL) continue;
+			if (!constraint_has_ad(cp, a->a_desc)) continue;
 			if ((b = a->a_vals) == NULL) continue;
 
 			if (cp->restrict_lud != NULL && constraint_check_restrict(op, cp, op->ora_e) == 0) {
@@ -841,12 +942,7 @@ constraint_add( Operation *op, SlapReply *rs )
 						rc = LDAP_CONSTRAINT_VIOLATION;
 					break;
 				default:
-					for ( i = 0; b[i].bv_val; i++ ) {
-						rc = constraint_violation( cp, &b[i], op );
-						if ( rc ) {
-							goto add_violation;
-						}
-					}
+					rc = constraint_values_violation( cp, b, op );
 				}
 			if ( rc )
 				goto add_violation;
@@ -868,62 +964,72 @@ add_violation:
 }
 
 
+/*
+ * Work out the resulting number of values of each constrained attribute
+ * touched by the modifications; attributes the modifications leave alone
+ * are not checked.
+ */
 static int
-constraint_check_count_violation( Modifications *m, Entry *target_entry, constraint *cp )
+constraint_check_count_violation( Modifications *modlist, Entry *target_entry, constraint *cp )
 {
-	BerVarray b = NULL;
-	unsigned ce = 0;
+	Modifications *m;
+	unsigned ce;
 	unsigned ca;
-	int j;
+	int j, touched;
 
 	for ( j = 0; cp->ap[j]; j++ ) {
 		/* Get this attribute count */
-		if ( target_entry )
-			ce = constraint_count_attr( target_entry, cp->ap[j] );
-
-		for( ; m; m = m->sml_next ) {
-			if ( cp->ap[j] == m->sml_desc ) {
-				ca = m->sml_numvals;
-				switch ( m->sml_op ) {
-				case LDAP_MOD_DELETE:
-				case SLAP_MOD_SOFTDEL:
-					if ( !ca || ca > ce ) {
-						ce = 0;
-					} else {
-						/* No need to check for values' validity. Invalid values
-						 * cause the whole transaction to die anyway. */
-						ce -= ca;
-					}
-					break;
+		ce = target_entry ? constraint_count_attr( target_entry, cp->ap[j] ) : 0;
+		touched = 0;
 
-				case LDAP_MOD_ADD:
-				case SLAP_MOD_SOFTADD:
-					ce += ca;
-					break;
+		for( m = modlist; m; m = m->sml_next ) {
+			if ( cp->ap[j] != m->sml_desc )
+				continue;
 
-				case LDAP_MOD_REPLACE:
-					ce = ca;
-					break;
+			touched = 1;
+			ca = m->sml_numvals;
+			switch ( m->sml_op ) {
+			case LDAP_MOD_DELETE:
+			case SLAP_MOD_SOFTDEL:
+				if ( !ca || ca > ce ) {
+					ce = 0;
+				} else {
+					/* No need to check for values' validity. Invalid values
+					 * cause the whole transaction to die anyway. */
+					ce -= ca;
+				}
+				break;
+
+			case LDAP_MOD_ADD:
+			case SLAP_MOD_SOFTADD:
+				ce += ca;
+				break;
+
+			case LDAP_MOD_REPLACE:
+				ce = ca;
+				break;
 
 #if 0
-				/* TODO */
-				case handle SLAP_MOD_ADD_IF_NOT_PRESENT:
+			/* TODO */
+			case handle SLAP_MOD_ADD_IF_NOT_PRESENT:
 #endif
 
-				default:
-					/* impossible! assert? */
-					return 1;
-				}
-
-				Debug(LDAP_DEBUG_TRACE,
-					"==> constraint_check_count_violation ce = %u, "
-					"ca = %u, cp->count = %lu\n",
-					ce, ca, (unsigned long) cp->count);
+			default:
+				/* impossible! assert? */
+				return 1;
 			}
+
+			Debug(LDAP_DEBUG_TRACE,
+				"==> constraint_check_count_violation ce = %u, "
+				"ca = %u, cp->count = %lu\n",
+				ce, ca, (unsigned long) cp->count);
 		}
+
+		if ( touched && ce > cp->count )
+			return 1;
 	}
 
-	return ( ce > cp->count );
+	return 0;
 }
 
 static int
@@ -935,7 +1041,6 @@ constraint_update( Operation *op, SlapReply *rs )
 	Entry *target_entry = NULL, *target_entry_copy = NULL;
 	Modifications *modlist, *m;
 	BerVarray b = NULL;
-	int i;
 	struct berval rsv = BER_BVC("modify breaks constraint");
 	int rc;
 	char *msg = NULL;
@@ -967,6 +1072,20 @@ constraint_update( Operation *op, SlapReply *rs )
 		return(rs->sr_err);
 	}
 
+	/* Skip fetching the entry when no constraint covers
+	 * any of the modified attributes */
+	for ( ; m; m = m->sml_next ) {
+		if ( is_at_operational( m->sml_desc->ad_type ) ) continue;
+		for ( cp = c; cp; cp = cp->ap_next ) {
+			if ( constraint_has_ad( cp, m->sml_desc ) )
+				break;
+		}
+		if ( cp ) break;
+	}
+	if ( m == NULL )
+		return SLAP_CB_CONTINUE;
+	m = modlist;
+
 	op->o_bd = on->on_info->oi_origdb;
 	rc = be_entry_get_rw( op, &op->o_req_ndn, NULL, NULL, 0, &target_entry );
 	op->o_bd = be;
@@ -1010,13 +1129,7 @@ constraint_update( Operation *op, SlapReply *rs )
 			continue;
 
 		for(cp = c; cp; cp = cp->ap_next) {
-			int j;
-			for (j = 0; cp->ap[j]; j++) {
-				if (cp->ap[j] == m->sml_desc) {
-					break;
-				}
-			}
-			if (cp->ap[j] == NULL) continue;
+			if (!constraint_has_ad(cp, m->sml_desc)) continue;
 
 			if (cp->restrict_lud != NULL && constraint_check_restrict(op, cp, target_entry) == 0) {
 				continue;
@@ -1026,11 +1139,9 @@ constraint_update( Operation *op, SlapReply *rs )
 			if (( m->sml_op & LDAP_MOD_OP ) == LDAP_MOD_DELETE)
 				continue;
 
-			for ( i = 0; b[i].bv_val; i++ ) {
-				rc = constraint_violation( cp, &b[i], op );
-				if ( rc ) {
-					goto mod_violation;
-				}
+			rc = constraint_values_violation( cp, b, op );
+			if ( rc ) {
+				goto mod_violation;
 			}
 
 			if (cp->type == CONSTRAINT_SET && target_entry) {
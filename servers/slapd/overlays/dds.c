@@ -36,6 +36,7 @@
 #define	DDS_RF2589_MAX_TTL		(31557600)	/* 1 year + 6 hours */
 #define	DDS_RF2589_DEFAULT_TTL		(86400)		/* 1 day */
 #define	DDS_DEFAULT_INTERVAL		(3600)		/* 1 hour */
+#define	DDS_DEFAULT_EXPIRE_BATCH	(64)		/* deletes per txn */
 
 typedef struct dds_info_t {
 	unsigned		di_flags;
@@ -63,6 +64,17 @@ typedef struct dds_info_t {
 	int			di_num_dynamicObjects;
 	int			di_max_dynamicObjects;
 
+	/* expiry index of the dynamic objects, by entryExpireTimestamp
+	 * and DN; also protected by di_mutex */
+	IAvltree		di_expiry;
+	int			di_rebuild;
+
+	/* deletes per txn and per run of the expiration task */
+	int			di_expire_batch;
+#define	DDS_EXPIRE_BATCH(di)	\
+	( (di)->di_expire_batch ? (di)->di_expire_batch : DDS_DEFAULT_EXPIRE_BATCH )
+	int			di_expire_max;
+
 	/* used to advertize the dynamicSubtrees in the root DSE,
 	 * and to select the database in the expiration task */
 	BerVarray		di_suffix;
@@ -72,51 +84,111 @@ typedef struct dds_info_t {
 static struct berval slap_EXOP_REFRESH = BER_BVC( LDAP_EXOP_REFRESH );
 static AttributeDescription	*ad_entryExpireTimestamp;
 
-/* list of expired DNs */
+/* expiry index node, also used to list the DNs being expired */
 typedef struct dds_expire_t {
+	IAvlnode		de_avl;
+	time_t			de_expire;
 	struct berval		de_ndn;
 	struct dds_expire_t	*de_next;
 } dds_expire_t;
 
-typedef struct dds_cb_t {
-	dds_expire_t	*dc_ndnlist;
-} dds_cb_t;
-
 static int
-dds_expire_cb( Operation *op, SlapReply *rs )
+dds_expire_cmp( const void *v1, const void *v2 )
+{
+	const dds_expire_t	*de1 = v1, *de2 = v2;
+
+	if ( de1->de_expire != de2->de_expire ) {
+		return de1->de_expire < de2->de_expire ? -1 : 1;
+	}
+
+	return ber_bvcmp( &de1->de_ndn, &de2->de_ndn );
+}
+
+/* returns the time of an entryExpireTimestamp value, or 0 */
+static time_t
+dds_timestamp( struct berval *bv )
+{
+	struct lutil_tm		tm;
+	struct lutil_timet	tt;
+
+	assert( bv->bv_val[ bv->bv_len ] == '\0' );
+	if ( lutil_parsetime( bv->bv_val, &tm ) ) {
+		return 0;
+	}
+
+	lutil_tm2time( &tm, &tt );
+	return tt.tt_sec;
+}
+
+static time_t
+dds_entry_expire( Entry *e )
+{
+	Attribute	*a = attr_find( e->e_attrs, ad_entryExpireTimestamp );
+
+	return a ? dds_timestamp( &a->a_nvals[ 0 ] ) : 0;
+}
+
+/* the index functions must be called with di_mutex locked */
+static void
+dds_index_add( dds_info_t *di, struct berval *ndn, time_t expire )
 {
-	dds_cb_t	*dc = (dds_cb_t *)op->o_callback->sc_private;
 	dds_expire_t	*de;
-	int		rc;
 
-	switch ( rs->sr_type ) {
-	case REP_SEARCH:
-		/* alloc list and buffer for berval all in one */
-		de = op->o_tmpalloc( sizeof( dds_expire_t ) + rs->sr_entry->e_nname.bv_len + 1,
-			op->o_tmpmemctx );
-
-		de->de_next = dc->dc_ndnlist;
-		dc->dc_ndnlist = de;
-
-		de->de_ndn.bv_len = rs->sr_entry->e_nname.bv_len;
-		de->de_ndn.bv_val = (char *)&de[ 1 ];
-		AC_MEMCPY( de->de_ndn.bv_val, rs->sr_entry->e_nname.bv_val,
-			rs->sr_entry->e_nname.bv_len + 1 );
-		rc = 0;
-		break;
+	/* alloc node and buffer for berval all in one */
+	de = ch_malloc( sizeof( dds_expire_t ) + ndn->bv_len + 1 );
+	de->de_expire = expire;
+	de->de_ndn.bv_len = ndn->bv_len;
+	de->de_ndn.bv_val = (char *)&de[ 1 ];
+	AC_MEMCPY( de->de_ndn.bv_val, ndn->bv_val, ndn->bv_len );
+	de->de_ndn.bv_val[ ndn->bv_len ] = '\0';
 
-	case REP_SEARCHREF:
-	case REP_RESULT:
-		rc = rs->sr_err;
-		break;
+	if ( iavl_insert( &di->di_expiry, de, avl_dup_error ) ) {
+		ch_free( de );
+	}
+}
 
-	default:
-		assert( 0 );
+static void
+dds_index_del( dds_info_t *di, struct berval *ndn, time_t expire )
+{
+	dds_expire_t	key, *de;
+
+	key.de_expire = expire;
+	key.de_ndn = *ndn;
+	de = iavl_delete( &di->di_expiry, &key );
+	if ( de != NULL ) {
+		ch_free( de );
 	}
+}
 
-	return rc;
+static int dds_count( void *ctx, BackendDB *be, dds_info_t *di );
+
+static void
+dds_txn_commit( Operation *op, OpExtra **txn, dds_info_t *di, int n )
+{
+	int	rc;
+
+	LDAP_SLIST_REMOVE( &op->o_extra, *txn, OpExtra, oe_next );
+	rc = op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_COMMIT, txn );
+	if ( rc ) {
+		Log( LDAP_DEBUG_ANY, LDAP_LEVEL_ERR,
+			"DDS commit of %d expired objects failed err=%d\n",
+			n, rc );
+
+		/* the index no longer matches the database */
+		ldap_pvt_thread_mutex_lock( &di->di_mutex );
+		di->di_rebuild = 1;
+		ldap_pvt_thread_mutex_unlock( &di->di_mutex );
+	}
+	*txn = NULL;
 }
 
+/* Deletes the dynamic objects that are due in the expiry index.
+ * Each delete asserts that the entryExpireTimestamp of the entry
+ * is still due, in case it has been refreshed in the meantime;
+ * the deletes are grouped in txns of up to dds-expire-batch, each
+ * in a savepoint, if the backend supports them and no syncprov or
+ * accesslog would send or log the changes before they get committed.
+ */
 static int
 dds_expire( void *ctx, dds_info_t *di )
 {
@@ -124,107 +196,136 @@ dds_expire( void *ctx, dds_info_t *di )
 	OperationBuffer opbuf;
 	Operation	*op;
 	slap_callback	sc = { 0 };
-	dds_cb_t	dc = { 0 };
-	dds_expire_t	*de = NULL, **dep;
+	dds_expire_t	*de, *list = NULL, **dep;
 	SlapReply	rs = { REP_RESULT };
+	OpExtra		*txn = NULL;
 
 	time_t		expire;
 	char		tsbuf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
-	struct berval	ts;
+	struct berval	ts, fstr;
+	Filter		*f;
 
+	int		batch, ntxn = 0, n, rebuild;
 	int		ndeletes, ntotdeletes;
 
-	int		rc;
-	char		*extra = "";
-
 	connection_fake_init2( &conn, &opbuf, ctx, 0 );
 	op = &opbuf.ob_op;
 
-	op->o_tag = LDAP_REQ_SEARCH;
-	memset( &op->oq_search, 0, sizeof( op->oq_search ) );
-
 	op->o_bd = select_backend( &di->di_nsuffix[ 0 ], 0 );
 
-	op->o_req_dn = op->o_bd->be_suffix[ 0 ];
-	op->o_req_ndn = op->o_bd->be_nsuffix[ 0 ];
-
 	op->o_dn = op->o_bd->be_rootdn;
 	op->o_ndn = op->o_bd->be_rootndn;
 
-	op->ors_scope = LDAP_SCOPE_SUBTREE;
-	op->ors_tlimit = DDS_INTERVAL( di )/2 + 1;
-	op->ors_slimit = SLAP_NO_LIMIT;
-	op->ors_attrs = slap_anlist_no_attrs;
+	ldap_pvt_thread_mutex_lock( &di->di_mutex );
+	rebuild = di->di_rebuild;
+	di->di_rebuild = 0;
+	ldap_pvt_thread_mutex_unlock( &di->di_mutex );
+
+	if ( rebuild && dds_count( ctx, op->o_bd, di ) != LDAP_SUCCESS ) {
+		ldap_pvt_thread_mutex_lock( &di->di_mutex );
+		di->di_rebuild = 1;
+		ldap_pvt_thread_mutex_unlock( &di->di_mutex );
+		return LDAP_OTHER;
+	}
 
 	expire = slap_get_time() - di->di_tolerance;
+
+	/* take the due objects off the index */
+	dep = &list;
+	ldap_pvt_thread_mutex_lock( &di->di_mutex );
+	for ( n = 0; di->di_expire_max == 0 || n < di->di_expire_max; n++ ) {
+		de = iavl_end( &di->di_expiry, TAVL_DIR_LEFT );
+		if ( de == NULL || de->de_expire > expire ) {
+			break;
+		}
+		iavl_remove( &di->di_expiry, de );
+		*dep = de;
+		dep = &de->de_next;
+	}
+	*dep = NULL;
+	ldap_pvt_thread_mutex_unlock( &di->di_mutex );
+
+	if ( list == NULL ) {
+		return LDAP_SUCCESS;
+	}
+
 	ts.bv_val = tsbuf;
 	ts.bv_len = sizeof( tsbuf );
 	slap_timestamp( &expire, &ts );
 
-	op->ors_filterstr.bv_len = STRLENOF( "(&(objectClass=" ")(" "<=" "))" )
-		+ slap_schema.si_oc_dynamicObject->soc_cname.bv_len
+	fstr.bv_len = STRLENOF( "(" "<=" ")" )
 		+ ad_entryExpireTimestamp->ad_cname.bv_len
 		+ ts.bv_len;
-	op->ors_filterstr.bv_val = op->o_tmpalloc( op->ors_filterstr.bv_len + 1, op->o_tmpmemctx );
-	snprintf( op->ors_filterstr.bv_val, op->ors_filterstr.bv_len + 1,
-		"(&(objectClass=%s)(%s<=%s))",
-		slap_schema.si_oc_dynamicObject->soc_cname.bv_val,
+	fstr.bv_val = op->o_tmpalloc( fstr.bv_len + 1, op->o_tmpmemctx );
+	snprintf( fstr.bv_val, fstr.bv_len + 1, "(%s<=%s)",
 		ad_entryExpireTimestamp->ad_cname.bv_val, ts.bv_val );
-
-	op->ors_filter = str2filter_x( op, op->ors_filterstr.bv_val );
-	if ( op->ors_filter == NULL ) {
+	f = str2filter_x( op, fstr.bv_val );
+	op->o_tmpfree( fstr.bv_val, op->o_tmpmemctx );
+	if ( f == NULL ) {
 		rs.sr_err = LDAP_OTHER;
-		goto done_search;
-	}
-	
-	op->o_callback = &sc;
-	sc.sc_response = dds_expire_cb;
-	sc.sc_private = &dc;
-
-	(void)op->o_bd->bd_info->bi_op_search( op, &rs );
-
-done_search:;
-	op->o_tmpfree( op->ors_filterstr.bv_val, op->o_tmpmemctx );
-	filter_free_x( op, op->ors_filter, 1 );
-
-	rc = rs.sr_err;
-	switch ( rs.sr_err ) {
-	case LDAP_SUCCESS:
-		break;
-
-	case LDAP_NO_SUCH_OBJECT:
-		/* (ITS#5267) database not created yet? */
-		rs.sr_err = LDAP_SUCCESS;
-		extra = " (ignored)";
-		/* fallthru */
-
-	default:
-		Log( LDAP_DEBUG_ANY, LDAP_LEVEL_ERR,
-			"DDS expired objects lookup failed err=%d%s\n",
-			rc, extra );
 		goto done;
 	}
 
 	op->o_tag = LDAP_REQ_DELETE;
 	op->o_callback = &sc;
 	sc.sc_response = slap_null_cb;
-	sc.sc_private = NULL;
+	op->o_assert = SLAP_CONTROL_CRITICAL;
+	op->o_assertion = f;
 
-	for ( ntotdeletes = 0, ndeletes = 1; dc.dc_ndnlist != NULL  && ndeletes > 0; ) {
+	batch = DDS_EXPIRE_BATCH( di );
+	if ( !op->o_bd->bd_info->bi_op_txn ||
+		overlay_is_inst( op->o_bd, "syncprov" ) ||
+		overlay_is_inst( op->o_bd, "accesslog" ) )
+	{
+		batch = 1;
+	}
+
+	for ( ntotdeletes = 0, ndeletes = 1; list != NULL && ndeletes > 0; ) {
 		ndeletes = 0;
 
-		for ( dep = &dc.dc_ndnlist; *dep != NULL; ) {
+		for ( dep = &list; *dep != NULL; ) {
 			de = *dep;
 
+			if ( batch > 1 && txn == NULL &&
+				op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_BEGIN, &txn ) )
+			{
+				if ( txn ) {
+					LDAP_SLIST_REMOVE( &op->o_extra, txn, OpExtra, oe_next );
+					op->o_tmpfree( txn, op->o_tmpmemctx );
+					txn = NULL;
+				}
+				batch = 1;
+			}
+			if ( txn &&
+				op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_SAVEPOINT, &txn ) )
+			{
+				dds_txn_commit( op, &txn, di, ntxn );
+				ntxn = 0;
+				batch = 1;
+			}
+
 			op->o_req_dn = de->de_ndn;
 			op->o_req_ndn = de->de_ndn;
+			rs_reinit( &rs, REP_RESULT );
 			(void)op->o_bd->bd_info->bi_op_delete( op, &rs );
+
+			if ( txn ) {
+				op->o_bd->bd_info->bi_op_txn( op, rs.sr_err == LDAP_SUCCESS ?
+					SLAP_TXN_RELEASE : SLAP_TXN_ROLLBACK, &txn );
+				if ( ++ntxn >= batch ) {
+					dds_txn_commit( op, &txn, di, ntxn );
+					ntxn = 0;
+				}
+			}
+
 			switch ( rs.sr_err ) {
 			case LDAP_SUCCESS:
 				Log( LDAP_DEBUG_STATS, LDAP_LEVEL_INFO,
 					"DDS dn=\"%s\" expired.\n",
 					de->de_ndn.bv_val );
 				ndeletes++;
+				*dep = de->de_next;
+				ch_free( de );
 				break;
 
 			case LDAP_NOT_ALLOWED_ON_NONLEAF:
@@ -233,32 +334,78 @@ done_search:;
 					"deferring.\n",
 					de->de_ndn.bv_val );
 				dep = &de->de_next;
-				de = NULL;
 				break;
-	
+
+			case LDAP_NO_SUCH_OBJECT:
+				*dep = de->de_next;
+				ch_free( de );
+				break;
+
+			case LDAP_ASSERTION_FAILED: {
+				/* refreshed; index it again by its current
+				 * expire time, unless that is done already */
+				Entry		*e = NULL;
+				time_t		t = 0;
+
+				if ( be_entry_get_rw( op, &de->de_ndn,
+					slap_schema.si_oc_dynamicObject, NULL, 0, &e ) == LDAP_SUCCESS
+					&& e != NULL )
+				{
+					t = dds_entry_expire( e );
+					be_entry_release_r( op, e );
+				}
+
+				*dep = de->de_next;
+				ldap_pvt_thread_mutex_lock( &di->di_mutex );
+				if ( t ) {
+					dds_index_add( di, &de->de_ndn, t );
+				}
+				ldap_pvt_thread_mutex_unlock( &di->di_mutex );
+				ch_free( de );
+				} break;
+
 			default:
 				Log( LDAP_DEBUG_ANY, LDAP_LEVEL_NOTICE,
 					"DDS dn=\"%s\" err=%d; "
 					"deferring.\n",
 					de->de_ndn.bv_val, rs.sr_err );
-				break;
-			}
-
-			if ( de != NULL ) {
 				*dep = de->de_next;
-				op->o_tmpfree( de, op->o_tmpmemctx );
+				ldap_pvt_thread_mutex_lock( &di->di_mutex );
+				if ( iavl_insert( &di->di_expiry, de, avl_dup_error ) ) {
+					ch_free( de );
+				}
+				ldap_pvt_thread_mutex_unlock( &di->di_mutex );
+				break;
 			}
 		}
 
 		ntotdeletes += ndeletes;
 	}
 
+	if ( txn ) {
+		dds_txn_commit( op, &txn, di, ntxn );
+	}
+
+	op->o_assert = SLAP_CONTROL_NONE;
+	op->o_assertion = NULL;
+	filter_free_x( op, f, 1 );
+
 	rs.sr_err = LDAP_SUCCESS;
 
 	Log( LDAP_DEBUG_STATS, LDAP_LEVEL_INFO,
 		"DDS expired=%d\n", ntotdeletes );
 
 done:;
+	/* put back the non-leaf objects for the next run */
+	ldap_pvt_thread_mutex_lock( &di->di_mutex );
+	while ( ( de = list ) != NULL ) {
+		list = de->de_next;
+		if ( iavl_insert( &di->di_expiry, de, avl_dup_error ) ) {
+			ch_free( de );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &di->di_mutex );
+
 	return rs.sr_err;
 }
 
@@ -292,29 +439,59 @@ dds_freeit_cb( Operation *op, SlapReply *rs )
 	return SLAP_CB_CONTINUE;
 }
 
-/* updates counter - installed on add/delete only if required */
+/* updates the counter and the expiry index once the operation
+ * succeeds - installed on add, delete and modify */
+typedef struct dds_update_t {
+	slap_callback	du_cb;		/* must be first, for dds_freeit_cb */
+	dds_info_t	*du_di;
+	time_t		du_old;		/* index key before... */
+	time_t		du_new;		/* ...and after, 0 if none */
+	int		du_count;	/* counter update */
+} dds_update_t;
+
+static dds_update_t *
+dds_update_install( Operation *op, dds_info_t *di, slap_response *func )
+{
+	dds_update_t	*du;
+
+	du = op->o_tmpcalloc( 1, sizeof( dds_update_t ), op->o_tmpmemctx );
+	du->du_cb.sc_cleanup = dds_freeit_cb;
+	du->du_cb.sc_response = func;
+	du->du_cb.sc_private = du;
+	du->du_cb.sc_next = op->o_callback;
+	du->du_di = di;
+
+	op->o_callback = &du->du_cb;
+
+	return du;
+}
+
 static int
-dds_counter_cb( Operation *op, SlapReply *rs )
+dds_update_cb( Operation *op, SlapReply *rs )
 {
 	assert( rs->sr_type == REP_RESULT );
 
 	if ( rs->sr_err == LDAP_SUCCESS ) {
-		dds_info_t	*di = op->o_callback->sc_private;
+		dds_update_t	*du = op->o_callback->sc_private;
+		dds_info_t	*di = du->du_di;
 
 		ldap_pvt_thread_mutex_lock( &di->di_mutex );
-		switch ( op->o_tag ) {
-		case LDAP_REQ_DELETE:
+		if ( du->du_count < 0 ) {
 			assert( di->di_num_dynamicObjects > 0 );
 			di->di_num_dynamicObjects--;
-			break;
 
-		case LDAP_REQ_ADD:
+		} else if ( du->du_count > 0 ) {
 			assert( di->di_num_dynamicObjects < di->di_max_dynamicObjects );
 			di->di_num_dynamicObjects++;
-			break;
+		}
 
-		default:
-			assert( 0 );
+		if ( du->du_old != du->du_new ) {
+			if ( du->du_old ) {
+				dds_index_del( di, &op->o_req_ndn, du->du_old );
+			}
+			if ( du->du_new ) {
+				dds_index_add( di, &op->o_req_ndn, du->du_new );
+			}
 		}
 		ldap_pvt_thread_mutex_unlock( &di->di_mutex );
 	}
@@ -322,6 +499,58 @@ dds_counter_cb( Operation *op, SlapReply *rs )
 	return dds_freeit_cb( op, rs );
 }
 
+/* moves the indexed objects in the renamed subtree to their new DN */
+static int
+dds_rename_cb( Operation *op, SlapReply *rs )
+{
+	assert( rs->sr_type == REP_RESULT );
+
+	if ( rs->sr_err == LDAP_SUCCESS ) {
+		dds_update_t	*du = op->o_callback->sc_private;
+		dds_info_t	*di = du->du_di;
+		dds_expire_t	*de, *next, *list = NULL;
+		struct berval	pndn, nndn, ndn;
+		ber_len_t	len;
+
+		if ( op->orr_nnewSup != NULL ) {
+			pndn = *op->orr_nnewSup;
+
+		} else {
+			dnParent( &op->o_req_ndn, &pndn );
+		}
+		build_new_dn( &nndn, &pndn, &op->orr_nnewrdn, op->o_tmpmemctx );
+
+		ldap_pvt_thread_mutex_lock( &di->di_mutex );
+		for ( de = iavl_end( &di->di_expiry, TAVL_DIR_LEFT ); de; de = next ) {
+			next = iavl_next( &di->di_expiry, de, TAVL_DIR_RIGHT );
+			if ( dnIsSuffix( &de->de_ndn, &op->o_req_ndn ) ) {
+				iavl_remove( &di->di_expiry, de );
+				de->de_next = list;
+				list = de;
+			}
+		}
+
+		while ( ( de = list ) != NULL ) {
+			list = de->de_next;
+
+			len = de->de_ndn.bv_len - op->o_req_ndn.bv_len;
+			ndn.bv_len = len + nndn.bv_len;
+			ndn.bv_val = op->o_tmpalloc( ndn.bv_len + 1, op->o_tmpmemctx );
+			AC_MEMCPY( ndn.bv_val, de->de_ndn.bv_val, len );
+			AC_MEMCPY( &ndn.bv_val[ len ], nndn.bv_val, nndn.bv_len + 1 );
+
+			dds_index_add( di, &ndn, de->de_expire );
+			op->o_tmpfree( ndn.bv_val, op->o_tmpmemctx );
+			ch_free( de );
+		}
+		ldap_pvt_thread_mutex_unlock( &di->di_mutex );
+
+		op->o_tmpfree( nndn.bv_val, op->o_tmpmemctx );
+	}
+
+	return dds_freeit_cb( op, rs );
+}
+
 static int
 dds_op_add( Operation *op, SlapReply *rs )
 {
@@ -397,6 +626,7 @@ dds_op_add( Operation *op, SlapReply *rs )
 		char		ttlbuf[STRLENOF("31557600") + 1];
 		char		tsbuf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
 		struct berval	bv;
+		dds_update_t	*du;
 
 		if ( !be_isroot_dn( op->o_bd, &op->o_req_ndn ) ) {
 			ldap_pvt_thread_mutex_lock( &di->di_mutex );
@@ -433,19 +663,10 @@ dds_op_add( Operation *op, SlapReply *rs )
 		assert( attr_find( op->ora_e->e_attrs, ad_entryExpireTimestamp ) == NULL );
 		attr_merge_one( op->ora_e, ad_entryExpireTimestamp, &bv, &bv );
 
-		/* if required, install counter callback */
-		if ( di->di_max_dynamicObjects > 0) {
-			slap_callback	*sc;
-
-			sc = op->o_tmpalloc( sizeof( slap_callback ), op->o_tmpmemctx );
-			sc->sc_cleanup = dds_freeit_cb;
-			sc->sc_response = dds_counter_cb;
-			sc->sc_private = di;
-			sc->sc_next = op->o_callback;
-			sc->sc_writewait = 0;
-
-			op->o_callback = sc;
-		}
+		/* index the object, and count it if required */
+		du = dds_update_install( op, di, dds_update_cb );
+		du->du_new = expire;
+		du->du_count = di->di_max_dynamicObjects > 0;
 	}
 
 	return SLAP_CB_CONTINUE;
@@ -457,8 +678,9 @@ dds_op_delete( Operation *op, SlapReply *rs )
 	slap_overinst	*on = (slap_overinst *)op->o_bd->bd_info;
 	dds_info_t	*di = on->on_bi.bi_private;
 
-	/* if required, install counter callback */
-	if ( !DDS_OFF( di ) && di->di_max_dynamicObjects > 0 ) {
+	/* install the callback that unindexes the object,
+	 * and uncounts it if required */
+	if ( !DDS_OFF( di ) ) {
 		Entry		*e = NULL;
 		BackendInfo	*bi = op->o_bd->bd_info;
 
@@ -468,19 +690,15 @@ dds_op_delete( Operation *op, SlapReply *rs )
 
 		/* FIXME: couldn't the entry be added before deletion? */
 		if ( rs->sr_err == LDAP_SUCCESS && e != NULL ) {
-			slap_callback	*sc;
-	
+			dds_update_t	*du;
+			time_t		expire = dds_entry_expire( e );
+
 			be_entry_release_r( op, e );
 			e = NULL;
-	
-			sc = op->o_tmpalloc( sizeof( slap_callback ), op->o_tmpmemctx );
-			sc->sc_cleanup = dds_freeit_cb;
-			sc->sc_response = dds_counter_cb;
-			sc->sc_private = di;
-			sc->sc_writewait = 0;
-			sc->sc_next = op->o_callback;
-	
-			op->o_callback = sc;
+
+			du = dds_update_install( op, di, dds_update_cb );
+			du->du_old = expire;
+			du->du_count = -( di->di_max_dynamicObjects > 0 );
 		}
 		op->o_bd->bd_info = bi;
 	}
@@ -499,7 +717,8 @@ dds_op_modify( Operation *op, SlapReply *rs )
 	int		was_dynamicObject = 0,
 			is_dynamicObject = 0;
 	struct berval	bv_entryTtl = BER_BVNULL;
-	time_t		entryTtl = 0;
+	time_t		entryTtl = 0,
+			old_expire = 0;
 	char		textbuf[ SLAP_TEXT_BUFLEN ];
 
 	if ( DDS_OFF( di ) ) {
@@ -535,6 +754,7 @@ dds_op_modify( Operation *op, SlapReply *rs )
 			entryTtl = (time_t)ttl;
 		}
 
+		old_expire = dds_entry_expire( e );
 		be_entry_release_r( op, e );
 		e = NULL;
 		was_dynamicObject = is_dynamicObject = 1;
@@ -779,6 +999,7 @@ done:;
 
 	if ( rs->sr_err == LDAP_SUCCESS && entryTtl != 0 ) {
 		Modifications	*tmpmod = NULL, **modp;
+		dds_update_t	*du;
 
 		for ( modp = &op->orm_modlist; *modp; modp = &(*modp)->sml_next )
 			;
@@ -790,6 +1011,10 @@ done:;
 
 		*modp = tmpmod;
 
+		/* reindex the object by its new expire time */
+		du = dds_update_install( op, di, dds_update_cb );
+		du->du_old = old_expire;
+
 		if ( entryTtl == -1 ) {
 			/* delete entryExpireTimestamp */
 			tmpmod->sml_op = LDAP_MOD_DELETE;
@@ -810,6 +1035,7 @@ done:;
 			value_add_one( &tmpmod->sml_values, &bv );
 			value_add_one( &tmpmod->sml_nvalues, &bv );
 			tmpmod->sml_numvals = 1;
+			du->du_new = expire;
 		}
 	}
 
@@ -876,6 +1102,9 @@ dds_op_rename( Operation *op, SlapReply *rs )
 		}
 	}
 
+	/* the renamed subtree may contain indexed objects */
+	(void)dds_update_install( op, di, dds_rename_cb );
+
 	return SLAP_CB_CONTINUE;
 }
 
@@ -1226,6 +1455,8 @@ enum {
 	DDS_INTERVAL,
 	DDS_TOLERANCE,
 	DDS_MAXDYNAMICOBJS,
+	DDS_EXPIREBATCH,
+	DDS_EXPIREMAX,
 
 	DDS_LAST
 };
@@ -1288,6 +1519,22 @@ static ConfigTable dds_cfg[] = {
 			"EQUALITY integerMatch "
 			"SYNTAX OMsInteger "
 			"SINGLE-VALUE )", NULL, NULL },
+	{ "dds-expire-batch", "num",
+		2, 2, 0, ARG_MAGIC|ARG_INT|DDS_EXPIREBATCH, dds_cfgen,
+		"( OLcfgOvAt:9.8 NAME 'olcDDSexpireBatch' "
+			"DESC 'RFC2589 Dynamic directory services max number of expired objects "
+				"deleted per transaction' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger "
+			"SINGLE-VALUE )", NULL, NULL },
+	{ "dds-expire-max", "num",
+		2, 2, 0, ARG_MAGIC|ARG_INT|DDS_EXPIREMAX, dds_cfgen,
+		"( OLcfgOvAt:9.9 NAME 'olcDDSexpireMax' "
+			"DESC 'RFC2589 Dynamic directory services max number of expired objects "
+				"deleted per expiration task run' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger "
+			"SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -1304,6 +1551,8 @@ static ConfigOCs dds_ocs[] = {
 			"$ olcDDSinterval "
 			"$ olcDDStolerance "
 			"$ olcDDSmaxDynamicObjects "
+			"$ olcDDSexpireBatch "
+			"$ olcDDSexpireMax "
 		" ) "
 		")", Cft_Overlay, dds_cfg, NULL, NULL /* dds_cfadd */ },
 	{ NULL, 0, NULL }
@@ -1400,6 +1649,24 @@ dds_cfgen( ConfigArgs *c )
 			}
 			break;
 
+		case DDS_EXPIREBATCH:
+			if ( di->di_expire_batch > 0 ) {
+				c->value_int = di->di_expire_batch;
+
+			} else {
+				rc = 1;
+			}
+			break;
+
+		case DDS_EXPIREMAX:
+			if ( di->di_expire_max > 0 ) {
+				c->value_int = di->di_expire_max;
+
+			} else {
+				rc = 1;
+			}
+			break;
+
 		default:
 			rc = 1;
 			break;
@@ -1437,6 +1704,14 @@ dds_cfgen( ConfigArgs *c )
 			di->di_max_dynamicObjects = 0;
 			break;
 
+		case DDS_EXPIREBATCH:
+			di->di_expire_batch = 0;
+			break;
+
+		case DDS_EXPIREMAX:
+			di->di_expire_max = 0;
+			break;
+
 		default:
 			rc = 1;
 			break;
@@ -1601,6 +1876,28 @@ dds_cfgen( ConfigArgs *c )
 		di->di_max_dynamicObjects = c->value_int;
 		break;
 
+	case DDS_EXPIREBATCH:
+		if ( c->value_int < 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"DDS invalid dds-expire-batch=%d", c->value_int );
+			Log( LDAP_DEBUG_ANY, LDAP_LEVEL_ERR,
+				"%s: %s.\n", c->log, c->cr_msg );
+			return 1;
+		}
+		di->di_expire_batch = c->value_int;
+		break;
+
+	case DDS_EXPIREMAX:
+		if ( c->value_int < 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"DDS invalid dds-expire-max=%d", c->value_int );
+			Log( LDAP_DEBUG_ANY, LDAP_LEVEL_ERR,
+				"%s: %s.\n", c->log, c->cr_msg );
+			return 1;
+		}
+		di->di_expire_max = c->value_int;
+		break;
+
 	default:
 		rc = 1;
 		break;
@@ -1646,6 +1943,7 @@ dds_db_init(
 	di->di_max_ttl = DDS_RF2589_DEFAULT_TTL;
 
 	ldap_pvt_thread_mutex_init( &di->di_mutex );
+	iavl_init( &di->di_expiry, dds_expire_cmp, offsetof( dds_expire_t, de_avl ) );
 
 	SLAP_DBFLAGS( be ) |= SLAP_DBFLAG_DYNAMIC;
 
@@ -1664,17 +1962,29 @@ dds_entry_info( void *arg, Entry *e )
 	return 0;
 }
 
-/* callback that counts the returned entries, since the search
- * does not get to the point in slap_send_search_entries where
+typedef struct dds_count_t {
+	dds_info_t	*dc_di;
+	int		dc_num;
+} dds_count_t;
+
+/* callback that counts and indexes the returned entries, since the
+ * search does not get to the point in slap_send_search_entries where
  * the actual count occurs */
 static int
 dds_count_cb( Operation *op, SlapReply *rs )
 {
-	int	*nump = (int *)op->o_callback->sc_private;
+	dds_count_t	*dc = (dds_count_t *)op->o_callback->sc_private;
+	time_t		expire;
 
 	switch ( rs->sr_type ) {
 	case REP_SEARCH:
-		(*nump)++;
+		dc->dc_num++;
+		expire = dds_entry_expire( rs->sr_entry );
+		if ( expire ) {
+			ldap_pvt_thread_mutex_lock( &dc->dc_di->di_mutex );
+			dds_index_add( dc->dc_di, &rs->sr_entry->e_nname, expire );
+			ldap_pvt_thread_mutex_unlock( &dc->dc_di->di_mutex );
+		}
 		break;
 
 	case REP_SEARCHREF:
@@ -1688,17 +1998,16 @@ dds_count_cb( Operation *op, SlapReply *rs )
 	return 0;
 }
 
-/* count dynamic objects existing in the database at startup */
+/* count and index the dynamic objects existing in the database,
+ * at startup or when the index needs to be rebuilt */
 static int
-dds_count( void *ctx, BackendDB *be )
+dds_count( void *ctx, BackendDB *be, dds_info_t *di )
 {
-	slap_overinst	*on = (slap_overinst *)be->bd_info;
-	dds_info_t	*di = (dds_info_t *)on->on_bi.bi_private;
-	
 	Connection	conn = { 0 };
 	OperationBuffer opbuf;
 	Operation	*op;
 	slap_callback	sc = { 0 };
+	dds_count_t	dc = { 0 };
 	SlapReply	rs = { REP_RESULT };
 
 	int		rc;
@@ -1738,12 +2047,14 @@ dds_count( void *ctx, BackendDB *be )
 	
 	op->o_callback = &sc;
 	sc.sc_response = dds_count_cb;
-	sc.sc_private = &di->di_num_dynamicObjects;
-	di->di_num_dynamicObjects = 0;
+	sc.sc_private = &dc;
+	dc.dc_di = di;
+
+	ldap_pvt_thread_mutex_lock( &di->di_mutex );
+	iavl_free( &di->di_expiry, ch_free );
+	ldap_pvt_thread_mutex_unlock( &di->di_mutex );
 
-	op->o_bd->bd_info = (BackendInfo *)on->on_info;
 	(void)op->o_bd->bd_info->bi_op_search( op, &rs );
-	op->o_bd->bd_info = (BackendInfo *)on;
 
 done_search:;
 	op->o_tmpfree( op->ors_filterstr.bv_val, op->o_tmpmemctx );
@@ -1752,9 +2063,12 @@ done_search:;
 	rc = rs.sr_err;
 	switch ( rs.sr_err ) {
 	case LDAP_SUCCESS:
+		ldap_pvt_thread_mutex_lock( &di->di_mutex );
+		di->di_num_dynamicObjects = dc.dc_num;
+		ldap_pvt_thread_mutex_unlock( &di->di_mutex );
 		Log( LDAP_DEBUG_STATS, LDAP_LEVEL_INFO,
 			"DDS non-expired=%d\n",
-			di->di_num_dynamicObjects );
+			dc.dc_num );
 		break;
 
 	case LDAP_NO_SUCH_OBJECT:
@@ -1808,8 +2122,10 @@ dds_db_open(
 	di->di_suffix = be->be_suffix;
 	di->di_nsuffix = be->be_nsuffix;
 
-	/* count the dynamic objects first */
-	rc = dds_count( thrctx, be );
+	/* count and index the dynamic objects first */
+	be->bd_info = (BackendInfo *)on->on_info;
+	rc = dds_count( thrctx, be, di );
+	be->bd_info = (BackendInfo *)on;
 	if ( rc != LDAP_SUCCESS ) {
 		rc = 1;
 		goto done;
@@ -1852,6 +2168,10 @@ dds_db_close(
 
 	(void)entry_info_unregister( dds_entry_info, (void *)di );
 
+	if ( di ) {
+		iavl_free( &di->di_expiry, ch_free );
+	}
+
 	return 0;
 }
 
@@ -132,9 +132,24 @@ typedef struct DerefRes {
 	struct DerefRes		*dr_next;
 } DerefRes;
 
+/* per-op cache of dereferenced entries, so that a target shared
+ * by many results (e.g. a member of many groups) is fetched once */
+#ifndef DEREF_CACHE_MAX
+#define DEREF_CACHE_MAX	1024
+#endif
+
+typedef struct deref_cache_t {
+	struct berval		dt_ndn;
+	Entry			*dt_e;		/* NULL if no such entry */
+	struct deref_cache_t	*dt_next;
+} deref_cache_t;
+
 typedef struct deref_cb_t {
 	slap_overinst *dc_on;
 	DerefSpec *dc_ds;
+	Avlnode *dc_cache;
+	deref_cache_t *dc_list;
+	int dc_ncache;
 } deref_cb_t;
 
 static int			deref_cid;
@@ -264,10 +279,75 @@ justcleanup:;
 	return rs->sr_err;
 }
 
+static int
+deref_cache_cmp( const void *c1, const void *c2 )
+{
+	const deref_cache_t *t1 = c1, *t2 = c2;
+
+	return ber_bvcmp( &t1->dt_ndn, &t2->dt_ndn );
+}
+
+/* returns the target entry, from the cache if possible;
+ * *release is set if the caller must release it */
+static Entry *
+deref_entry_get( Operation *op, deref_cb_t *dc, struct berval *ndn,
+	int *release )
+{
+	deref_cache_t dt, *dtp;
+	Entry *e = NULL;
+	int rc;
+
+	*release = 0;
+	dt.dt_ndn = *ndn;
+	dtp = avl_find( dc->dc_cache, &dt, deref_cache_cmp );
+	if ( dtp != NULL ) {
+		return dtp->dt_e;
+	}
+
+	rc = overlay_entry_get_ov( op, ndn, NULL, NULL, 0, &e, dc->dc_on );
+	if ( rc != LDAP_SUCCESS ) {
+		e = NULL;
+	}
+
+	if ( dc->dc_ncache >= DEREF_CACHE_MAX ) {
+		*release = ( e != NULL );
+		return e;
+	}
+
+	dtp = op->o_tmpalloc( sizeof( deref_cache_t ) + ndn->bv_len + 1,
+		op->o_tmpmemctx );
+	dtp->dt_ndn.bv_len = ndn->bv_len;
+	dtp->dt_ndn.bv_val = (char *)&dtp[ 1 ];
+	AC_MEMCPY( dtp->dt_ndn.bv_val, ndn->bv_val, ndn->bv_len + 1 );
+	dtp->dt_e = NULL;
+	if ( e != NULL ) {
+		dtp->dt_e = entry_dup( e );
+		overlay_entry_release_ov( op, e, 0, dc->dc_on );
+	}
+	avl_insert( &dc->dc_cache, dtp, deref_cache_cmp, avl_dup_error );
+	dtp->dt_next = dc->dc_list;
+	dc->dc_list = dtp;
+	dc->dc_ncache++;
+
+	return dtp->dt_e;
+}
+
 static int
 deref_cleanup( Operation *op, SlapReply *rs )
 {
 	if ( rs->sr_type == REP_RESULT || rs->sr_err == SLAPD_ABANDON ) {
+		deref_cb_t *dc = (deref_cb_t *)op->o_callback->sc_private;
+		deref_cache_t *dtp;
+
+		avl_free( dc->dc_cache, NULL );
+		while ( ( dtp = dc->dc_list ) != NULL ) {
+			dc->dc_list = dtp->dt_next;
+			if ( dtp->dt_e != NULL ) {
+				entry_free( dtp->dt_e );
+			}
+			op->o_tmpfree( dtp, op->o_tmpmemctx );
+		}
+
 		op->o_tmpfree( op->o_callback, op->o_tmpmemctx );
 		op->o_callback = NULL;
 
@@ -295,12 +375,21 @@ deref_response( Operation *op, SlapReply *rs )
 		LDAPControl *ctrl, *ctrlsp[2];
 		AccessControlState acl_state = ACL_STATE_INIT;
 		static char dummy = '\0';
-		Entry *ebase;
-		int i;
+		Entry *ebase = rs->sr_entry;
+		int i, release;
 
-		rc = overlay_entry_get_ov( op, &rs->sr_entry->e_nname, NULL, NULL, 0, &ebase, dc->dc_on );
-		if ( rc != LDAP_SUCCESS || ebase == NULL ) {
-			return SLAP_CB_CONTINUE;
+		/* the entry being returned usually carries all the
+		 * attributes to dereference; fetch it only if not */
+		for ( ds = dc->dc_ds; ds; ds = ds->ds_next ) {
+			if ( attr_find( ebase->e_attrs, ds->ds_derefAttr ) == NULL ) {
+				break;
+			}
+		}
+		if ( ds != NULL ) {
+			rc = overlay_entry_get_ov( op, &rs->sr_entry->e_nname, NULL, NULL, 0, &ebase, dc->dc_on );
+			if ( rc != LDAP_SUCCESS || ebase == NULL ) {
+				return SLAP_CB_CONTINUE;
+			}
 		}
 
 		for ( ds = dc->dc_ds; ds; ds = ds->ds_next ) {
@@ -346,8 +435,8 @@ deref_response( Operation *op, SlapReply *rs )
 					nVals++;
 					nDerefVals++;
 
-					rc = overlay_entry_get_ov( op, &a->a_nvals[ i ], NULL, NULL, 0, &e, dc->dc_on );
-					if ( rc == LDAP_SUCCESS && e != NULL ) {
+					e = deref_entry_get( op, dc, &a->a_nvals[ i ], &release );
+					if ( e != NULL ) {
 						int j;
 
 						if ( access_allowed( op, e, slap_schema.si_ad_entry,
@@ -392,7 +481,9 @@ deref_response( Operation *op, SlapReply *rs )
 							}
 						}
 
-						overlay_entry_release_ov( op, e, 0, dc->dc_on );
+						if ( release ) {
+							overlay_entry_release_ov( op, e, 0, dc->dc_on );
+						}
 					}
 				}
 
@@ -400,7 +491,9 @@ deref_response( Operation *op, SlapReply *rs )
 				drp = &dr->dr_next;
 			}
 		}
-		overlay_entry_release_ov( op, ebase, 0, dc->dc_on );
+		if ( ebase != rs->sr_entry ) {
+			overlay_entry_release_ov( op, ebase, 0, dc->dc_on );
+		}
 
 		if ( drhead == NULL ) {
 			return SLAP_CB_CONTINUE;
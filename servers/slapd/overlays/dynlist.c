@@ -47,6 +47,10 @@ typedef struct dynlist_map_t {
 	int						 dlm_memberOf_nested;
 	int						 dlm_member_oper;
 	int						 dlm_memberOf_oper;
+	struct dynlist_gen_t	*dlm_dlg;
+	int						 dlm_nc_loaded;
+	TAvlnode				*dlm_nc_groups;		/* static groups, by DN */
+	TAvlnode				*dlm_nc_members;	/* member DN -> groups */
 	struct dynlist_map_t	*dlm_next;
 } dynlist_map_t;
 
@@ -65,6 +69,8 @@ typedef struct dynlist_info_t {
 typedef struct dynlist_gen_t {
 	dynlist_info_t	*dlg_dli;
 	int				 dlg_memberOf;
+	int				 dlg_nestcache;
+	ldap_pvt_thread_rdwr_t	 dlg_nc_rwlock;
 } dynlist_gen_t;
 
 #define DYNLIST_USAGE \
@@ -330,6 +336,7 @@ done:;
 typedef struct dynlist_name_t {
 	struct berval dy_name;
 	dynlist_info_t *dy_dli;
+	dynlist_map_t *dy_dlm;
 	AttributeDescription *dy_staticmember;
 	int dy_seen;
 	int dy_numuris;
@@ -417,6 +424,412 @@ dynlist_ptr_cmp( const void *c1, const void *c2 )
 	return ( c1 < c2 ) ? -1 : c1 > c2;
 }
 
+/* Nested group cache
+ *
+ * With dynlist-nestcache enabled, the members of every static group
+ * (<static-oc> of a member-ad+memberOf-ad@static-oc map) are kept in
+ * memory, together with the reverse index from each member DN to the
+ * groups listing it. For nested maps the reverse index also holds the
+ * transitive closure: every ancestor group of the member, sorted by DN.
+ * The cache is loaded by the first search that needs it and is then
+ * kept current by the write operations going through this overlay.
+ * Dynamic (URL) groups are not cached.
+ */
+typedef struct dynlist_cgroup_t {
+	struct berval dc_ndn;	/* must be first, see dynlist_nc_cmp() */
+	BerVarray dc_vals;
+	BerVarray dc_nvals;
+	int dc_numvals;
+} dynlist_cgroup_t;
+
+typedef struct dynlist_cmember_t {
+	struct berval dcm_ndn;	/* must be first, see dynlist_nc_cmp() */
+	dynlist_cgroup_t **dcm_parents;
+	int dcm_nparents;
+	dynlist_cgroup_t **dcm_ancestors;	/* sorted by DN */
+	int dcm_nancestors;
+} dynlist_cmember_t;
+
+static int
+dynlist_nc_cmp( const void *c1, const void *c2 )
+{
+	const struct berval *b1 = c1, *b2 = c2;
+
+	return ber_bvcmp( b1, b2 );
+}
+
+static int
+dynlist_nc_anccmp( const void *key, const void *elem )
+{
+	return dynlist_nc_cmp( key, *(dynlist_cgroup_t * const *)elem );
+}
+
+static int
+dynlist_nc_sortcmp( const void *c1, const void *c2 )
+{
+	return dynlist_nc_cmp( *(dynlist_cgroup_t * const *)c1,
+		*(dynlist_cgroup_t * const *)c2 );
+}
+
+static void
+dynlist_nc_group_free( void *ptr )
+{
+	dynlist_cgroup_t *dc = ptr;
+
+	ber_bvarray_free( dc->dc_vals );
+	ber_bvarray_free( dc->dc_nvals );
+	ch_free( dc );
+}
+
+static void
+dynlist_nc_member_free( void *ptr )
+{
+	dynlist_cmember_t *dcm = ptr;
+
+	ch_free( dcm->dcm_parents );
+	ch_free( dcm->dcm_ancestors );
+	ch_free( dcm );
+}
+
+/* drop the cache of a map; the write lock must be held, or the
+ * server paused */
+static void
+dynlist_nc_flush( dynlist_map_t *dlm )
+{
+	if ( dlm->dlm_nc_members ) {
+		tavl_free( dlm->dlm_nc_members, dynlist_nc_member_free );
+		dlm->dlm_nc_members = NULL;
+	}
+	if ( dlm->dlm_nc_groups ) {
+		tavl_free( dlm->dlm_nc_groups, dynlist_nc_group_free );
+		dlm->dlm_nc_groups = NULL;
+	}
+	dlm->dlm_nc_loaded = 0;
+}
+
+static void
+dynlist_nc_flush_all( dynlist_gen_t *dlg )
+{
+	dynlist_info_t *dli;
+	dynlist_map_t *dlm;
+
+	for ( dli = dlg->dlg_dli; dli; dli = dli->dli_next )
+		for ( dlm = dli->dli_dlm; dlm; dlm = dlm->dlm_next )
+			dynlist_nc_flush( dlm );
+}
+
+static dynlist_cgroup_t *
+dynlist_nc_group_new( struct berval *ndn, Attribute *a )
+{
+	dynlist_cgroup_t *dc;
+
+	dc = ch_calloc( 1, sizeof( dynlist_cgroup_t ) + ndn->bv_len + 1 );
+	dc->dc_ndn.bv_val = (char *)(dc+1);
+	dc->dc_ndn.bv_len = ndn->bv_len;
+	memcpy( dc->dc_ndn.bv_val, ndn->bv_val, ndn->bv_len );
+	if ( a && a->a_numvals ) {
+		ber_bvarray_dup_x( &dc->dc_vals, a->a_vals, NULL );
+		ber_bvarray_dup_x( &dc->dc_nvals, a->a_nvals, NULL );
+		dc->dc_numvals = a->a_numvals;
+	}
+	return dc;
+}
+
+/* add the group to the reverse index of each of its members */
+static void
+dynlist_nc_link( dynlist_map_t *dlm, dynlist_cgroup_t *dc )
+{
+	dynlist_cmember_t *dcm;
+	int i;
+
+	for ( i = 0; i < dc->dc_numvals; i++ ) {
+		dcm = tavl_find( dlm->dlm_nc_members, &dc->dc_nvals[i], dynlist_nc_cmp );
+		if ( !dcm ) {
+			dcm = ch_calloc( 1, sizeof( dynlist_cmember_t ) + dc->dc_nvals[i].bv_len + 1 );
+			dcm->dcm_ndn.bv_val = (char *)(dcm+1);
+			dcm->dcm_ndn.bv_len = dc->dc_nvals[i].bv_len;
+			memcpy( dcm->dcm_ndn.bv_val, dc->dc_nvals[i].bv_val, dc->dc_nvals[i].bv_len );
+			tavl_insert( &dlm->dlm_nc_members, dcm, dynlist_nc_cmp, avl_dup_error );
+		}
+		dcm->dcm_parents = ch_realloc( dcm->dcm_parents,
+			( dcm->dcm_nparents + 1 ) * sizeof( dynlist_cgroup_t * ));
+		dcm->dcm_parents[dcm->dcm_nparents++] = dc;
+	}
+}
+
+static void
+dynlist_nc_unlink( dynlist_map_t *dlm, dynlist_cgroup_t *dc )
+{
+	dynlist_cmember_t *dcm;
+	int i, j;
+
+	for ( i = 0; i < dc->dc_numvals; i++ ) {
+		dcm = tavl_find( dlm->dlm_nc_members, &dc->dc_nvals[i], dynlist_nc_cmp );
+		if ( !dcm )
+			continue;
+		for ( j = 0; j < dcm->dcm_nparents; j++ ) {
+			if ( dcm->dcm_parents[j] == dc ) {
+				dcm->dcm_parents[j] = dcm->dcm_parents[--dcm->dcm_nparents];
+				break;
+			}
+		}
+	}
+}
+
+static void
+dynlist_nc_walk( dynlist_map_t *dlm, dynlist_cmember_t *dcm, TAvlnode **seen, int *n )
+{
+	dynlist_cmember_t *up;
+	int i;
+
+	for ( i = 0; i < dcm->dcm_nparents; i++ ) {
+		if ( tavl_insert( seen, dcm->dcm_parents[i], dynlist_ptr_cmp, avl_dup_error ))
+			continue;
+		(*n)++;
+		up = tavl_find( dlm->dlm_nc_members, &dcm->dcm_parents[i]->dc_ndn, dynlist_nc_cmp );
+		if ( up )
+			dynlist_nc_walk( dlm, up, seen, n );
+	}
+}
+
+/* recompute the ancestor groups of a member */
+static void
+dynlist_nc_closure( dynlist_map_t *dlm, dynlist_cmember_t *dcm )
+{
+	TAvlnode *seen = NULL, *ptr;
+	int n = 0;
+
+	ch_free( dcm->dcm_ancestors );
+	dcm->dcm_ancestors = NULL;
+	dcm->dcm_nancestors = 0;
+
+	dynlist_nc_walk( dlm, dcm, &seen, &n );
+	if ( !n )
+		return;
+
+	dcm->dcm_ancestors = ch_malloc( n * sizeof( dynlist_cgroup_t * ));
+	for ( ptr = tavl_end( seen, TAVL_DIR_LEFT ); ptr;
+		ptr = tavl_next( ptr, TAVL_DIR_RIGHT ))
+		dcm->dcm_ancestors[dcm->dcm_nancestors++] = ptr->avl_data;
+	tavl_free( seen, NULL );
+	qsort( dcm->dcm_ancestors, n, sizeof( dynlist_cgroup_t * ), dynlist_nc_sortcmp );
+}
+
+/* collect the members, direct or nested, of a group */
+static void
+dynlist_nc_descendants( dynlist_map_t *dlm, dynlist_cgroup_t *dc, TAvlnode **found )
+{
+	dynlist_cmember_t *dcm;
+	dynlist_cgroup_t *sub;
+	int i;
+
+	for ( i = 0; i < dc->dc_numvals; i++ ) {
+		dcm = tavl_find( dlm->dlm_nc_members, &dc->dc_nvals[i], dynlist_nc_cmp );
+		if ( !dcm || tavl_insert( found, dcm, dynlist_ptr_cmp, avl_dup_error ))
+			continue;
+		sub = tavl_find( dlm->dlm_nc_groups, &dcm->dcm_ndn, dynlist_nc_cmp );
+		if ( sub )
+			dynlist_nc_descendants( dlm, sub, found );
+	}
+}
+
+/* replace the cached copy of group ndn with the current entry e;
+ * a NULL entry drops the group. The write lock must be held.
+ */
+static void
+dynlist_nc_update( dynlist_map_t *dlm, struct berval *ndn, Entry *e )
+{
+	dynlist_cgroup_t *old, *dc = NULL;
+	TAvlnode *found = NULL, *ptr;
+	dynlist_cmember_t *dcm;
+
+	old = tavl_delete( &dlm->dlm_nc_groups, ndn, dynlist_nc_cmp );
+	if ( old ) {
+		dynlist_nc_descendants( dlm, old, &found );
+		dynlist_nc_unlink( dlm, old );
+	}
+	if ( e && is_entry_objectclass( e, dlm->dlm_static_oc, 0 )) {
+		dc = dynlist_nc_group_new( ndn,
+			attr_find( e->e_attrs, dlm->dlm_member_ad ));
+		tavl_insert( &dlm->dlm_nc_groups, dc, dynlist_nc_cmp, avl_dup_error );
+		dynlist_nc_link( dlm, dc );
+		dynlist_nc_descendants( dlm, dc, &found );
+	}
+
+	for ( ptr = tavl_end( found, TAVL_DIR_LEFT ); ptr;
+		ptr = tavl_next( ptr, TAVL_DIR_RIGHT )) {
+		dcm = ptr->avl_data;
+		if ( !dcm->dcm_nparents ) {
+			tavl_delete( &dlm->dlm_nc_members, dcm, dynlist_nc_cmp );
+			dynlist_nc_member_free( dcm );
+		} else if ( dlm->dlm_memberOf_nested ) {
+			dynlist_nc_closure( dlm, dcm );
+		}
+	}
+	if ( found )
+		tavl_free( found, NULL );
+	if ( old )
+		dynlist_nc_group_free( old );
+}
+
+static int
+dynlist_nc_load_cb( Operation *op, SlapReply *rs )
+{
+	dynlist_map_t *dlm = op->o_callback->sc_private;
+	dynlist_cgroup_t *dc;
+
+	if ( rs->sr_type != REP_SEARCH )
+		return 0;
+
+	dc = dynlist_nc_group_new( &rs->sr_entry->e_nname,
+		attr_find( rs->sr_entry->e_attrs, dlm->dlm_member_ad ));
+	if ( tavl_insert( &dlm->dlm_nc_groups, dc, dynlist_nc_cmp, avl_dup_error )) {
+		dynlist_nc_group_free( dc );
+		return 0;
+	}
+	dynlist_nc_link( dlm, dc );
+	return 0;
+}
+
+/* read all static groups of a map. Runs with the write lock held,
+ * as the rootdn so that the cache doesn't depend on who asked first.
+ */
+static int
+dynlist_nc_load( Operation *op, dynlist_map_t *dlm )
+{
+	Operation o = *op;
+	SlapReply r = { REP_SEARCH };
+	slap_callback cb = { 0 };
+	Filter f = { 0 };
+	AttributeAssertion ava = ATTRIBUTEASSERTION_INIT;
+	AttributeName an[2] = {0};
+
+	f.f_choice = LDAP_FILTER_EQUALITY;
+	f.f_ava = &ava;
+	f.f_av_desc = slap_schema.si_ad_objectClass;
+	f.f_av_value = dlm->dlm_static_oc->soc_cname;
+
+	an[0].an_desc = dlm->dlm_member_ad;
+	an[0].an_name = dlm->dlm_member_ad->ad_cname;
+
+	cb.sc_response = dynlist_nc_load_cb;
+	cb.sc_private = dlm;
+
+	o.o_tag = LDAP_REQ_SEARCH;
+	o.o_callback = &cb;
+	o.o_managedsait = SLAP_CONTROL_CRITICAL;
+	o.o_dn = op->o_bd->be_rootdn;
+	o.o_ndn = op->o_bd->be_rootndn;
+	o.o_req_dn = op->o_bd->be_suffix[0];
+	o.o_req_ndn = op->o_bd->be_nsuffix[0];
+	o.ors_scope = LDAP_SCOPE_SUBTREE;
+	o.ors_deref = LDAP_DEREF_NEVER;
+	o.ors_limit = NULL;
+	o.ors_slimit = SLAP_NO_LIMIT;
+	o.ors_tlimit = SLAP_NO_LIMIT;
+	o.ors_attrsonly = 0;
+	o.ors_attrs = an;
+	o.ors_filter = &f;
+	filter2bv_x( &o, &f, &o.ors_filterstr );
+	o.o_bd = select_backend( op->o_bd->be_nsuffix, 1 );
+
+	dynlist_nc_flush( dlm );
+	(void)o.o_bd->be_search( &o, &r );
+	o.o_tmpfree( o.ors_filterstr.bv_val, o.o_tmpmemctx );
+
+	if ( r.sr_err != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY, "%s: dynlist: unable to load static groups "
+			"(objectClass=%s): err=%d\n",
+			op->o_log_prefix, dlm->dlm_static_oc->soc_cname.bv_val, r.sr_err );
+		dynlist_nc_flush( dlm );
+		return -1;
+	}
+
+	if ( dlm->dlm_memberOf_nested ) {
+		TAvlnode *ptr;
+		for ( ptr = tavl_end( dlm->dlm_nc_members, TAVL_DIR_LEFT ); ptr;
+			ptr = tavl_next( ptr, TAVL_DIR_RIGHT ))
+			dynlist_nc_closure( dlm, ptr->avl_data );
+	}
+	dlm->dlm_nc_loaded = 1;
+	return 0;
+}
+
+/* Read-lock the cache of a map, loading it first if needed.
+ * Returns 0 if the cache can't be used, and 1 with the read lock
+ * held otherwise; release it with dynlist_nc_unlock().
+ */
+static int
+dynlist_nc_lock( Operation *op, dynlist_map_t *dlm )
+{
+	dynlist_gen_t *dlg;
+	int rc = 0;
+
+	if ( !dlm || !dlm->dlm_static_oc || SLAP_GLUE_INSTANCE( op->o_bd ))
+		return 0;
+	dlg = dlm->dlm_dlg;
+	if ( !dlg->dlg_nestcache )
+		return 0;
+
+	ldap_pvt_thread_rdwr_rlock( &dlg->dlg_nc_rwlock );
+	while ( !dlm->dlm_nc_loaded ) {
+		ldap_pvt_thread_rdwr_runlock( &dlg->dlg_nc_rwlock );
+		ldap_pvt_thread_rdwr_wlock( &dlg->dlg_nc_rwlock );
+		if ( !dlm->dlm_nc_loaded )
+			rc = dynlist_nc_load( op, dlm );
+		ldap_pvt_thread_rdwr_wunlock( &dlg->dlg_nc_rwlock );
+		if ( rc )
+			return 0;
+		ldap_pvt_thread_rdwr_rlock( &dlg->dlg_nc_rwlock );
+	}
+	return 1;
+}
+
+static void
+dynlist_nc_unlock( dynlist_map_t *dlm )
+{
+	ldap_pvt_thread_rdwr_runlock( &dlm->dlm_dlg->dlg_nc_rwlock );
+}
+
+/* Is ndn a member of the static group? For nested maps this
+ * includes membership through other static groups.
+ * Read lock held.
+ */
+static int
+dynlist_nc_ismember( dynlist_map_t *dlm, struct berval *group, struct berval *ndn )
+{
+	dynlist_cmember_t *dcm;
+	int i;
+
+	dcm = tavl_find( dlm->dlm_nc_members, ndn, dynlist_nc_cmp );
+	if ( !dcm )
+		return 0;
+	if ( dlm->dlm_memberOf_nested )
+		return bsearch( group, dcm->dcm_ancestors, dcm->dcm_nancestors,
+			sizeof( dynlist_cgroup_t * ), dynlist_nc_anccmp ) != NULL;
+	for ( i = 0; i < dcm->dcm_nparents; i++ )
+		if ( dn_match( &dcm->dcm_parents[i]->dc_ndn, group ))
+			return 1;
+	return 0;
+}
+
+/* Fill a with the cached members of a static group. Read lock held. */
+static int
+dynlist_nc_members( dynlist_map_t *dlm, struct berval *group, Attribute *a )
+{
+	dynlist_cgroup_t *dc;
+
+	dc = tavl_find( dlm->dlm_nc_groups, group, dynlist_nc_cmp );
+	if ( !dc )
+		return 0;
+	memset( a, 0, sizeof( Attribute ));
+	a->a_desc = dlm->dlm_member_ad;
+	a->a_vals = dc->dc_vals;
+	a->a_nvals = dc->dc_nvals;
+	a->a_numvals = dc->dc_numvals;
+	return 1;
+}
+
 static int
 dynlist_nested_member_dg( Operation *op, SlapReply *rs )
 {
@@ -451,17 +864,30 @@ dynlist_nested_member( Operation *op, dynlist_member_t *dm, TAvlnode *subs )
 		dyn = ptr->avl_data;
 		if ( tavl_insert( &dm->dm_groups, dyn, dynlist_ptr_cmp, avl_dup_error ))
 			continue;
-		if ( overlay_entry_get_ov( op, &dyn->dy_name, NULL, NULL, 0, &ne, on ) != LDAP_SUCCESS || ne == NULL )
-			continue;
-		b = attr_find( ne->e_attrs, dm->dm_ad );
-		if ( b ) {
-			dm->dm_mod.sm_values = b->a_vals;
-			dm->dm_mod.sm_nvalues = b->a_nvals;
-			dm->dm_mod.sm_numvals = b->a_numvals;
-			modify_add_values( dm->dm_e, &dm->dm_mod, /* permissive */ 1,
-				&dm->dm_text, dm->dm_textbuf, sizeof( dm->dm_textbuf ));
-		}
-		overlay_entry_release_ov( op, ne, 0, on );
+		if ( dyn->dy_dlm && dyn->dy_dlm->dlm_member_ad == dm->dm_ad &&
+			dynlist_nc_lock( op, dyn->dy_dlm )) {
+			Attribute ca;
+			if ( dynlist_nc_members( dyn->dy_dlm, &dyn->dy_name, &ca ) && ca.a_numvals ) {
+				dm->dm_mod.sm_values = ca.a_vals;
+				dm->dm_mod.sm_nvalues = ca.a_nvals;
+				dm->dm_mod.sm_numvals = ca.a_numvals;
+				modify_add_values( dm->dm_e, &dm->dm_mod, /* permissive */ 1,
+					&dm->dm_text, dm->dm_textbuf, sizeof( dm->dm_textbuf ));
+			}
+			dynlist_nc_unlock( dyn->dy_dlm );
+		} else {
+			if ( overlay_entry_get_ov( op, &dyn->dy_name, NULL, NULL, 0, &ne, on ) != LDAP_SUCCESS || ne == NULL )
+				continue;
+			b = attr_find( ne->e_attrs, dm->dm_ad );
+			if ( b ) {
+				dm->dm_mod.sm_values = b->a_vals;
+				dm->dm_mod.sm_nvalues = b->a_nvals;
+				dm->dm_mod.sm_numvals = b->a_numvals;
+				modify_add_values( dm->dm_e, &dm->dm_mod, /* permissive */ 1,
+					&dm->dm_text, dm->dm_textbuf, sizeof( dm->dm_textbuf ));
+			}
+			overlay_entry_release_ov( op, ne, 0, on );
+		}
 		if ( dyn->dy_numuris ) {
 			slap_callback cb = { 0 };
 			cb.sc_private = dm;
@@ -1084,8 +1510,10 @@ dynlist_search1resp( Operation *op, SlapReply *rs )
 			}
 			dyn->dy_numuris = j;
 			memcpy(dyn->dy_name.bv_val, rs->sr_entry->e_nname.bv_val, rs->sr_entry->e_nname.bv_len );
-			if ( b )
+			if ( b ) {
+				dyn->dy_dlm = ds->ds_dlm;
 				dyn->dy_staticmember = ds->ds_dlm->dlm_member_ad;
+			}
 
 			if ( tavl_insert( &ds->ds_names, dyn, dynlist_avl_cmp, avl_dup_error )) {
 				for (i=dyn->dy_numuris-1; i>=0; i--) {
@@ -1244,6 +1672,16 @@ dynlist_filter_group( Operation *op, dynlist_name_t *dyn, Filter *n, dynlist_sea
 	if ( tavl_insert( &ds->ds_fnodes, dyn, dynlist_ptr_cmp, avl_dup_error ))
 		return 0;
 
+	if ( dynlist_nc_lock( op, ds->ds_dlm )) {
+		Attribute ca;
+		int cached = dynlist_nc_members( ds->ds_dlm, &dyn->dy_name, &ca );
+		if ( cached && ca.a_numvals )
+			rc = dynlist_filter_stgroup( op, n, &ca );
+		dynlist_nc_unlock( ds->ds_dlm );
+		if ( cached )
+			goto subs;
+	}
+
 	if ( overlay_entry_get_ov( op, &dyn->dy_name, NULL, NULL, 0, &e, on ) !=
 		LDAP_SUCCESS || e == NULL ) {
 		return -1;
@@ -1260,6 +1698,7 @@ dynlist_filter_group( Operation *op, dynlist_name_t *dyn, Filter *n, dynlist_sea
 		}
 	}
 	overlay_entry_release_ov( op, e, 0, on );
+subs:
 	if ( dyn->dy_subs && !rc ) {
 		TAvlnode *ptr;
 		for ( ptr = tavl_end( dyn->dy_subs, TAVL_DIR_LEFT ); ptr;
@@ -1417,6 +1856,11 @@ dynlist_test_membership(Operation *op, dynlist_name_t *dyn, Entry *e)
 	int i, rc = LDAP_COMPARE_FALSE;
 	if ( dyn->dy_staticmember ) {
 		Entry *grp;
+		if ( dynlist_nc_lock( op, dyn->dy_dlm )) {
+			rc = dynlist_nc_ismember( dyn->dy_dlm, &dyn->dy_name, &e->e_nname );
+			dynlist_nc_unlock( dyn->dy_dlm );
+			return rc ? LDAP_COMPARE_TRUE : LDAP_COMPARE_FALSE;
+		}
 		if ( overlay_entry_get_ov( op, &dyn->dy_name, NULL, NULL, 0, &grp, (slap_overinst *)op->o_bd->bd_info ) == LDAP_SUCCESS && grp ) {
 			Attribute *a = attr_find( grp->e_attrs, dyn->dy_staticmember );
 			if ( a ) {
@@ -1623,9 +2067,22 @@ dynlist_nestlink( Operation *op, dynlist_search_t *ds )
 		ptr = tavl_next( ptr, TAVL_DIR_RIGHT )) {
 		di = ptr->avl_data;
 		if ( ds->ds_dlm ) {
-			if ( overlay_entry_get_ov( op, &di->dy_name, NULL, NULL, 0, &e, on ) != LDAP_SUCCESS || e == NULL )
-				continue;
-			a = attr_find( e->e_attrs, ds->ds_dlm->dlm_member_ad );
+			Attribute ca;
+			int cached = 0;
+
+			/* dynamic groups aren't cached, read them as usual */
+			if ( dynlist_nc_lock( op, ds->ds_dlm )) {
+				cached = dynlist_nc_members( ds->ds_dlm, &di->dy_name, &ca );
+				if ( !cached )
+					dynlist_nc_unlock( ds->ds_dlm );
+			}
+			if ( cached ) {
+				a = &ca;
+			} else {
+				if ( overlay_entry_get_ov( op, &di->dy_name, NULL, NULL, 0, &e, on ) != LDAP_SUCCESS || e == NULL )
+					continue;
+				a = attr_find( e->e_attrs, ds->ds_dlm->dlm_member_ad );
+			}
 			if ( a ) {
 				for ( i=0; i < a->a_numvals; i++ ) {
 					dj = tavl_find( ds->ds_names, &a->a_nvals[i], dynlist_avl_cmp );
@@ -1639,7 +2096,10 @@ dynlist_nestlink( Operation *op, dynlist_search_t *ds )
 					}
 				}
 			}
-			overlay_entry_release_ov( op, e, 0, on );
+			if ( cached )
+				dynlist_nc_unlock( ds->ds_dlm );
+			else
+				overlay_entry_release_ov( op, e, 0, on );
 		}
 
 		if ( di->dy_numuris ) {
@@ -1836,6 +2296,121 @@ dynlist_search( Operation *op, SlapReply *rs )
 	return SLAP_CB_CONTINUE;
 }
 
+static int
+dynlist_nc_write_cleanup( Operation *op, SlapReply *rs )
+{
+	if ( rs->sr_type == REP_RESULT || op->o_abandon ||
+		rs->sr_err == SLAPD_ABANDON ) {
+		slap_callback *sc = op->o_callback;
+		op->o_callback = sc->sc_next;
+		op->o_tmpfree( sc, op->o_tmpmemctx );
+	}
+	return 0;
+}
+
+/* bring the nested group cache up to date after a successful write.
+ * The entry is read back under the write lock, so that concurrent
+ * updates of the same group are applied in commit order.
+ */
+static int
+dynlist_nc_write_resp( Operation *op, SlapReply *rs )
+{
+	slap_overinst *on = op->o_callback->sc_private;
+	dynlist_gen_t *dlg = (dynlist_gen_t *)on->on_bi.bi_private;
+	dynlist_info_t *dli;
+	dynlist_map_t *dlm;
+	Entry *e = NULL;
+	int got = 0;
+
+	if ( rs->sr_type != REP_RESULT || rs->sr_err != LDAP_SUCCESS )
+		return SLAP_CB_CONTINUE;
+
+	ldap_pvt_thread_rdwr_wlock( &dlg->dlg_nc_rwlock );
+	for ( dli = dlg->dlg_dli; dli; dli = dli->dli_next ) {
+		for ( dlm = dli->dli_dlm; dlm; dlm = dlm->dlm_next ) {
+			if ( !dlm->dlm_nc_loaded )
+				continue;
+			switch ( op->o_tag ) {
+			case LDAP_REQ_DELETE:
+				dynlist_nc_update( dlm, &op->o_req_ndn, NULL );
+				break;
+			case LDAP_REQ_ADD:
+			case LDAP_REQ_MODIFY:
+				if ( !got ) {
+					got = 1;
+					if ( overlay_entry_get_ov( op, &op->o_req_ndn, NULL, NULL,
+						0, &e, on ) != LDAP_SUCCESS )
+						e = NULL;
+				}
+				if ( e )
+					dynlist_nc_update( dlm, &op->o_req_ndn, e );
+				else
+					dynlist_nc_flush( dlm );
+				break;
+			default:
+				/* renames may move whole subtrees of groups */
+				dynlist_nc_flush( dlm );
+				break;
+			}
+		}
+	}
+	ldap_pvt_thread_rdwr_wunlock( &dlg->dlg_nc_rwlock );
+	if ( e )
+		overlay_entry_release_ov( op, e, 0, on );
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+dynlist_nc_write( Operation *op, SlapReply *rs )
+{
+	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
+	dynlist_gen_t *dlg = (dynlist_gen_t *)on->on_bi.bi_private;
+	dynlist_info_t *dli;
+	dynlist_map_t *dlm;
+	slap_callback *sc;
+	Modifications *ml;
+	int relevant = 0;
+
+	if ( !dlg->dlg_nestcache )
+		return SLAP_CB_CONTINUE;
+
+	for ( dli = dlg->dlg_dli; dli && !relevant; dli = dli->dli_next ) {
+		for ( dlm = dli->dli_dlm; dlm && !relevant; dlm = dlm->dlm_next ) {
+			if ( !dlm->dlm_static_oc )
+				continue;
+			switch ( op->o_tag ) {
+			case LDAP_REQ_ADD:
+				relevant = is_entry_objectclass( op->ora_e, dlm->dlm_static_oc, 0 );
+				break;
+			case LDAP_REQ_MODIFY:
+				for ( ml = op->orm_modlist; ml; ml = ml->sml_next ) {
+					if ( ml->sml_desc == dlm->dlm_member_ad ||
+						ml->sml_desc == slap_schema.si_ad_objectClass ) {
+						relevant = 1;
+						break;
+					}
+				}
+				break;
+			default:
+				relevant = 1;
+				break;
+			}
+		}
+	}
+	if ( !relevant )
+		return SLAP_CB_CONTINUE;
+
+	sc = op->o_tmpcalloc( 1, sizeof( slap_callback ), op->o_tmpmemctx );
+	sc->sc_response = dynlist_nc_write_resp;
+	sc->sc_cleanup = dynlist_nc_write_cleanup;
+	sc->sc_private = on;
+	sc->sc_next = op->o_callback;
+	op->o_callback = sc;
+
+	return SLAP_CB_CONTINUE;
+}
+
 static int
 dynlist_build_def_filter( dynlist_info_t *dli )
 {
@@ -1862,6 +2437,7 @@ enum {
 	DL_ATTRSET = 1,
 	DL_ATTRPAIR,
 	DL_ATTRPAIR_COMPAT,
+	DL_NESTCACHE,
 	DL_LAST
 };
 
@@ -1885,6 +2461,13 @@ static ConfigTable dlcfg[] = {
 		3, 3, 0, ARG_MAGIC|DL_ATTRPAIR_COMPAT, dl_cfgen,
 			NULL, NULL, NULL },
 #endif
+	{ "dynlist-nestcache", "on|off",
+		2, 2, 0, ARG_ON_OFF|ARG_MAGIC|DL_NESTCACHE, dl_cfgen,
+		"( OLcfgOvAt:8.2 NAME 'olcDynListNestCache' "
+			"DESC 'Dynamic list: cache static group members and their nesting' "
+			"EQUALITY booleanMatch "
+			"SYNTAX OMsBoolean SINGLE-VALUE )",
+			NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -1893,7 +2476,7 @@ static ConfigOCs dlocs[] = {
 		"NAME ( 'olcDynListConfig' 'olcDynamicList' ) "
 		"DESC 'Dynamic list configuration' "
 		"SUP olcOverlayConfig "
-		"MAY olcDynListAttrSet )",
+		"MAY ( olcDynListAttrSet $ olcDynListNestCache ) )",
 		Cft_Overlay, dlcfg, NULL, NULL },
 	{ NULL, 0, NULL }
 };
@@ -1970,6 +2553,10 @@ dl_cfgen( ConfigArgs *c )
 			rc = 1;
 			break;
 
+		case DL_NESTCACHE:
+			c->value_int = dlg->dlg_nestcache;
+			break;
+
 		default:
 			rc = 1;
 			break;
@@ -2009,6 +2596,7 @@ dl_cfgen( ConfigArgs *c )
 
 					while ( dlm != NULL ) {
 						dlm_next = dlm->dlm_next;
+						dynlist_nc_flush( dlm );
 						ch_free( dlm );
 						dlm = dlm_next;
 					}
@@ -2058,6 +2646,7 @@ dl_cfgen( ConfigArgs *c )
 					dlm_next = dlm->dlm_next;
 					if ( dlm->dlm_memberOf_ad )
 						dlg->dlg_memberOf--;
+					dynlist_nc_flush( dlm );
 					ch_free( dlm );
 					dlm = dlm_next;
 				}
@@ -2072,6 +2661,11 @@ dl_cfgen( ConfigArgs *c )
 			rc = 1;
 			break;
 
+		case DL_NESTCACHE:
+			dlg->dlg_nestcache = 0;
+			dynlist_nc_flush_all( dlg );
+			break;
+
 		default:
 			rc = 1;
 			break;
@@ -2308,6 +2902,7 @@ done_uri:;
 			if ( dlm == NULL ) {
 				dlm = dlmp;
 			}
+			dlmp->dlm_dlg = dlg;
 			dlmp->dlm_member_ad = member_ad;
 			dlmp->dlm_mapped_ad = mapped_ad;
 			dlmp->dlm_memberOf_ad = memberOf_ad;
@@ -2457,6 +3052,7 @@ done_uri:;
 		(*dlip)->dli_oc = oc;
 		(*dlip)->dli_ad = ad;
 		(*dlip)->dli_dlm = (dynlist_map_t *)ch_calloc( 1, sizeof( dynlist_map_t ) );
+		(*dlip)->dli_dlm->dlm_dlg = dlg;
 		(*dlip)->dli_dlm->dlm_member_ad = member_ad;
 		(*dlip)->dli_dlm->dlm_mapped_ad = NULL;
 
@@ -2464,6 +3060,12 @@ done_uri:;
 
 		} break;
 
+	case DL_NESTCACHE:
+		dlg->dlg_nestcache = c->value_int;
+		if ( !dlg->dlg_nestcache )
+			dynlist_nc_flush_all( dlg );
+		break;
+
 	default:
 		rc = 1;
 		break;
@@ -2484,6 +3086,8 @@ dynlist_db_init(
 	on->on_bi.bi_private = dlg;
 	dlg->dlg_dli = NULL;
 	dlg->dlg_memberOf = 0;
+	dlg->dlg_nestcache = 0;
+	ldap_pvt_thread_rdwr_init( &dlg->dlg_nc_rwlock );
 
 	return 0;
 }
@@ -2608,11 +3212,13 @@ dynlist_db_destroy(
 			dlm = dli->dli_dlm;
 			while ( dlm != NULL ) {
 				dlm_next = dlm->dlm_next;
+				dynlist_nc_flush( dlm );
 				ch_free( dlm );
 				dlm = dlm_next;
 			}
 			ch_free( dli );
 		}
+		ldap_pvt_thread_rdwr_destroy( &dlg->dlg_nc_rwlock );
 		ch_free( dlg );
 	}
 
@@ -2671,6 +3277,10 @@ dynlist_initialize(void)
 
 	dynlist.on_bi.bi_op_search = dynlist_search;
 	dynlist.on_bi.bi_op_compare = dynlist_compare;
+	dynlist.on_bi.bi_op_add = dynlist_nc_write;
+	dynlist.on_bi.bi_op_modify = dynlist_nc_write;
+	dynlist.on_bi.bi_op_modrdn = dynlist_nc_write;
+	dynlist.on_bi.bi_op_delete = dynlist_nc_write;
 
 	dynlist.on_bi.bi_cf_ocs = dlocs;
 
@@ -126,6 +126,15 @@
  *		- if the entry being deleted has the MEMBER_OF attribute,
  *		  the corresponding value of the MEMBER_AT must be deleted
  *		  from the respective GROUP entries.
+ *
+ *	- async:
+ *		- if configured to do so, the updates of the MEMBER_OF
+ *		  (and, with refint, MEMBER_AT) values of other entries
+ *		  are queued instead of being applied before the result
+ *		  is returned; a pool task applies them in batches, one
+ *		  modify per target entry.  Deletes and renames, and
+ *		  searches and compares carrying the memberOf barrier
+ *		  control, first wait for the queued updates to be applied.
  */
 
 #define	SLAPD_MEMBEROF_ATTR	"memberOf"
@@ -137,6 +146,21 @@ static ObjectClass			*oc_group;
 
 static slap_overinst		memberof;
 
+static int memberof_barrier_cid;
+static int memberof_barrier_registered;
+#define o_memberof_barrier	o_ctrlflag[memberof_barrier_cid]
+
+/* A back-link update waiting for the async writer */
+typedef struct memberof_rec {
+	struct memberof_rec	*mr_next;
+	unsigned long		mr_seq;
+	AttributeDescription	*mr_ad;
+	struct berval		mr_ndn;		/* entry to modify */
+	struct berval		mr_old_dn, mr_old_ndn;	/* value to delete */
+	struct berval		mr_new_dn, mr_new_ndn;	/* value to add */
+	int			mr_relax;
+} memberof_rec;
+
 typedef struct memberof_t {
 	struct berval		mo_dn;
 	struct berval		mo_ndn;
@@ -162,6 +186,17 @@ typedef struct memberof_t {
 
 	ber_int_t		mo_dangling_err;
 
+	int			mo_async;	/* max queued updates, 0 = apply inline */
+	int			mo_nqueued;
+	int			mo_wpending;	/* writer task submitted */
+	int			mo_wrunning;	/* queue is being applied */
+	unsigned long		mo_seq;		/* last update queued */
+	unsigned long		mo_done;	/* last update applied */
+	memberof_rec		*mo_queue, **mo_qtail;
+	BackendDB		*mo_db;
+	ldap_pvt_thread_mutex_t	mo_q_mutex;
+	ldap_pvt_thread_cond_t	mo_q_cond;
+
 #define MEMBEROF_CHK(mo,f) \
 	(((mo)->mo_flags & (f)) == (f))
 #define MEMBEROF_DANGLING_CHECK(mo) \
@@ -339,6 +374,369 @@ memberof_isGroupOrMember( Operation *op, memberof_cbinfo_t *mci )
 	return LDAP_SUCCESS;
 }
 
+static int
+memberof_rec_cmp( const void *v1, const void *v2 )
+{
+	const memberof_rec *r1 = *(const memberof_rec **)v1;
+	const memberof_rec *r2 = *(const memberof_rec **)v2;
+	int rc;
+
+	rc = ber_bvcmp( &r1->mr_ndn, &r2->mr_ndn );
+	if ( rc == 0 )
+		rc = ( r1->mr_seq > r2->mr_seq ) - ( r1->mr_seq < r2->mr_seq );
+	return rc;
+}
+
+static void
+memberof_rec_free( memberof_rec *mr )
+{
+	ch_free( mr->mr_ndn.bv_val );
+	ch_free( mr->mr_old_dn.bv_val );
+	ch_free( mr->mr_old_ndn.bv_val );
+	ch_free( mr->mr_new_dn.bv_val );
+	ch_free( mr->mr_new_ndn.bv_val );
+	ch_free( mr );
+}
+
+/* Apply the queued updates of a single entry with one modify. The
+ * values are soft-added and soft-deleted, in the order they were
+ * queued, so one stale value doesn't fail the others.
+ */
+static int
+memberof_apply( Operation *op, memberof_t *mo, memberof_rec **mrs, int n )
+{
+	SlapReply	rs = { REP_RESULT };
+	slap_callback	cb = { NULL, slap_null_cb, NULL, NULL };
+	Modifications	*mods, *ml, *last = NULL;
+	struct berval	*vals;
+	OpExtra		oex;
+	int		i, nmods = 0;
+
+	mods = ch_calloc( 2 * n + 1, sizeof( Modifications ) +
+		4 * sizeof( struct berval ));
+	vals = (struct berval *)( mods + 2 * n + 1 );
+
+	op->o_tag = LDAP_REQ_MODIFY;
+	op->o_req_dn = mrs[0]->mr_ndn;
+	op->o_req_ndn = mrs[0]->mr_ndn;
+	op->o_callback = &cb;
+	op->o_dn = mo->mo_db->be_rootdn;
+	op->o_ndn = mo->mo_db->be_rootndn;
+	op->o_relax = SLAP_CONTROL_NONE;
+	op->orm_modlist = NULL;
+	op->orm_no_opattrs = 1;
+	op->o_dont_replicate = 1;
+
+#define MO_ADDMOD( mop, desc, dn, ndn ) \
+	ml = &mods[ nmods ]; \
+	ml->sml_values = &vals[ 4 * nmods ]; \
+	ml->sml_nvalues = &vals[ 4 * nmods + 2 ]; \
+	ml->sml_values[ 0 ] = dn; \
+	ml->sml_nvalues[ 0 ] = ndn; \
+	ml->sml_numvals = 1; \
+	ml->sml_desc = desc; \
+	ml->sml_type = desc->ad_cname; \
+	ml->sml_op = mop; \
+	ml->sml_flags = SLAP_MOD_INTERNAL; \
+	if ( last ) last->sml_next = ml; else op->orm_modlist = ml; \
+	last = ml; \
+	nmods++
+
+	if ( !BER_BVISNULL( &mo->mo_ndn ) ) {
+		MO_ADDMOD( LDAP_MOD_REPLACE, slap_schema.si_ad_modifiersName,
+			mo->mo_dn, mo->mo_ndn );
+	}
+	for ( i = 0; i < n; i++ ) {
+		if ( !BER_BVISNULL( &mrs[i]->mr_new_ndn ) ) {
+			MO_ADDMOD( SLAP_MOD_SOFTADD, mrs[i]->mr_ad,
+				mrs[i]->mr_new_dn, mrs[i]->mr_new_ndn );
+		}
+		if ( !BER_BVISNULL( &mrs[i]->mr_old_ndn ) ) {
+			MO_ADDMOD( SLAP_MOD_SOFTDEL, mrs[i]->mr_ad,
+				mrs[i]->mr_old_dn, mrs[i]->mr_old_ndn );
+		}
+		if ( mrs[i]->mr_relax )
+			op->o_relax = mrs[i]->mr_relax;
+	}
+#undef MO_ADDMOD
+
+	oex.oe_key = (void *)&memberof;
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &oex, oe_next );
+	(void)op->o_bd->be_modify( op, &rs );
+	LDAP_SLIST_REMOVE( &op->o_extra, &oex, OpExtra, oe_next );
+	if ( rs.sr_err != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY,
+			"%s: memberof_apply DN=\"%s\" %d queued updates failed err=%d\n",
+			op->o_log_prefix, op->o_req_dn.bv_val, n, rs.sr_err );
+	}
+
+	/* free any mods the backend appended */
+	if ( last->sml_next != NULL ) {
+		slap_mods_free( last->sml_next, 1 );
+	}
+	ch_free( mods );
+
+	return rs.sr_err;
+}
+
+/* Apply the queued updates until the queue is empty. Must be called
+ * with mo_q_mutex locked and mo_wrunning set, returns with the mutex
+ * still locked. The updates are applied in target DN order, all the
+ * updates of an entry taken off the queue at once with one modify;
+ * with batch set, they are applied in a single txn as well.
+ */
+static void
+memberof_drain( Operation *op, memberof_t *mo, int batch )
+{
+	memberof_rec *mr, **mrs = NULL;
+	unsigned long last_seq;
+	OpExtra *txn;
+	int i, j, n, nmrs = 0, rc;
+
+	while (( mr = mo->mo_queue )) {
+		mo->mo_queue = NULL;
+		mo->mo_qtail = &mo->mo_queue;
+		n = mo->mo_nqueued;
+		mo->mo_nqueued = 0;
+		last_seq = mo->mo_seq;
+		ldap_pvt_thread_cond_broadcast( &mo->mo_q_cond );
+		ldap_pvt_thread_mutex_unlock( &mo->mo_q_mutex );
+
+		if ( n > nmrs ) {
+			nmrs = n;
+			mrs = ch_realloc( mrs, nmrs * sizeof( memberof_rec * ));
+		}
+		for ( i = 0; mr; mr = mr->mr_next )
+			mrs[i++] = mr;
+		assert( i == n );
+		qsort( mrs, n, sizeof( memberof_rec * ), memberof_rec_cmp );
+
+		txn = NULL;
+		if ( batch && n > 1 &&
+			op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_BEGIN, &txn ))
+		{
+			if ( txn ) {
+				LDAP_SLIST_REMOVE( &op->o_extra, txn, OpExtra, oe_next );
+				op->o_tmpfree( txn, op->o_tmpmemctx );
+				txn = NULL;
+			}
+		}
+		for ( i = 0; i < n; i = j ) {
+			for ( j = i + 1; j < n &&
+				ber_bvcmp( &mrs[i]->mr_ndn, &mrs[j]->mr_ndn ) == 0; j++ )
+				;
+			if ( txn &&
+				op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_SAVEPOINT, &txn ))
+			{
+				LDAP_SLIST_REMOVE( &op->o_extra, txn, OpExtra, oe_next );
+				op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_COMMIT, &txn );
+				txn = NULL;
+				batch = 0;
+			}
+			rc = memberof_apply( op, mo, &mrs[i], j - i );
+			if ( txn ) {
+				op->o_bd->bd_info->bi_op_txn( op, rc == LDAP_SUCCESS ?
+					SLAP_TXN_RELEASE : SLAP_TXN_ROLLBACK, &txn );
+			}
+		}
+		if ( txn ) {
+			LDAP_SLIST_REMOVE( &op->o_extra, txn, OpExtra, oe_next );
+			rc = op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_COMMIT, &txn );
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY, "memberof_drain: "
+					"commit of %d queued updates failed (%d)\n", n, rc );
+			}
+		}
+		for ( i = 0; i < n; i++ )
+			memberof_rec_free( mrs[i] );
+
+		ldap_pvt_thread_mutex_lock( &mo->mo_q_mutex );
+		mo->mo_done = last_seq;
+	}
+	ch_free( mrs );
+	mo->mo_wrunning = 0;
+	ldap_pvt_thread_cond_broadcast( &mo->mo_q_cond );
+}
+
+/* Apply the queued updates from the caller's thread, when there is
+ * no writer running to wait for. Locking as for memberof_drain().
+ */
+static void
+memberof_drain_inline( Operation *op, slap_overinst *on )
+{
+	memberof_t	*mo = (memberof_t *)on->on_bi.bi_private;
+	Operation	op2 = *op;
+	unsigned long	opid = op->o_opid;
+
+	op2.o_bd = mo->mo_db;
+	mo->mo_wrunning = 1;
+	memberof_drain( &op2, mo, 0 );
+	/* shared with op */
+	op->o_opid = opid;
+}
+
+/* Apply the queued updates in the background. The updates of the
+ * entries taken off the queue at once are applied in a single txn,
+ * unless the DB has syncprov or accesslog: they would send or log
+ * the changes before the txn commits.
+ */
+static void *
+memberof_writer( void *ctx, void *arg )
+{
+	slap_overinst	*on = arg;
+	memberof_t	*mo = (memberof_t *)on->on_bi.bi_private;
+	Connection	conn = { 0 };
+	OperationBuffer	opbuf;
+	Operation	*op;
+	int		batch;
+
+	connection_fake_init( &conn, &opbuf, ctx );
+	op = &opbuf.ob_op;
+	op->o_bd = mo->mo_db;
+
+	batch = mo->mo_db->bd_info->bi_op_txn &&
+		!overlay_is_inst( mo->mo_db, "syncprov" ) &&
+		!overlay_is_inst( mo->mo_db, "accesslog" );
+
+	ldap_pvt_thread_mutex_lock( &mo->mo_q_mutex );
+	mo->mo_wpending = 0;
+	/* the queue may have been drained inline in the meantime */
+	if ( !mo->mo_wrunning ) {
+		mo->mo_wrunning = 1;
+		memberof_drain( op, mo, batch );
+	}
+	ldap_pvt_thread_cond_broadcast( &mo->mo_q_cond );
+	ldap_pvt_thread_mutex_unlock( &mo->mo_q_mutex );
+
+	return NULL;
+}
+
+/* Queue an update of the values of ad in the entry ndn for the
+ * writer. Waits for room if the queue is full. Returns zero if the
+ * update must be applied inline.
+ */
+static int
+memberof_queue(
+	Operation		*op,
+	slap_overinst		*on,
+	struct berval		*ndn,
+	AttributeDescription	*ad,
+	struct berval		*old_dn,
+	struct berval		*old_ndn,
+	struct berval		*new_dn,
+	struct berval		*new_ndn )
+{
+	memberof_t	*mo = (memberof_t *)on->on_bi.bi_private;
+	memberof_rec	*mr;
+	/* An outer txn may hold the write lock the writer needs,
+	 * don't wait for it then */
+	int		nowait = !LDAP_SLIST_EMPTY( &op->o_extra );
+
+	ldap_pvt_thread_mutex_lock( &mo->mo_q_mutex );
+	/* Updates still queued from before async got turned off
+	 * must be applied first */
+	if ( !mo->mo_async && !mo->mo_queue ) {
+		ldap_pvt_thread_mutex_unlock( &mo->mo_q_mutex );
+		return 0;
+	}
+	if ( !mo->mo_wpending && !mo->mo_wrunning ) {
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+				memberof_writer, on )) {
+			/* keep the order of the updates still queued */
+			if ( mo->mo_queue && !nowait ) {
+				memberof_drain_inline( op, on );
+			}
+			ldap_pvt_thread_mutex_unlock( &mo->mo_q_mutex );
+			return 0;
+		}
+		mo->mo_wpending = 1;
+	}
+	while ( !nowait && mo->mo_nqueued && mo->mo_nqueued >= mo->mo_async ) {
+		if ( mo->mo_wrunning ) {
+			ldap_pvt_thread_cond_wait( &mo->mo_q_cond, &mo->mo_q_mutex );
+		} else {
+			/* a pending writer may need this very thread to get
+			 * started, make room ourselves */
+			memberof_drain_inline( op, on );
+		}
+	}
+
+	mr = ch_calloc( 1, sizeof( memberof_rec ));
+	mr->mr_seq = ++mo->mo_seq;
+	mr->mr_ad = ad;
+	ber_dupbv( &mr->mr_ndn, ndn );
+	if ( old_ndn != NULL ) {
+		ber_dupbv( &mr->mr_old_dn, old_dn );
+		ber_dupbv( &mr->mr_old_ndn, old_ndn );
+	}
+	if ( new_ndn != NULL ) {
+		ber_dupbv( &mr->mr_new_dn, new_dn );
+		ber_dupbv( &mr->mr_new_ndn, new_ndn );
+	}
+	mr->mr_relax = op->o_relax;
+	*mo->mo_qtail = mr;
+	mo->mo_qtail = &mr->mr_next;
+	mo->mo_nqueued++;
+	ldap_pvt_thread_mutex_unlock( &mo->mo_q_mutex );
+	return 1;
+}
+
+/* Wait until the updates queued so far have been applied */
+static void
+memberof_barrier( Operation *op, slap_overinst *on )
+{
+	memberof_t	*mo = (memberof_t *)on->on_bi.bi_private;
+	unsigned long	seq;
+
+	ldap_pvt_thread_mutex_lock( &mo->mo_q_mutex );
+	seq = mo->mo_seq;
+	while ( mo->mo_done < seq ) {
+		if ( mo->mo_wrunning ) {
+			/* see memberof_queue() */
+			if ( !LDAP_SLIST_EMPTY( &op->o_extra ) )
+				break;
+			ldap_pvt_thread_cond_wait( &mo->mo_q_cond, &mo->mo_q_mutex );
+		} else {
+			memberof_drain_inline( op, on );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &mo->mo_q_mutex );
+}
+
+static int
+memberof_op_barrier( Operation *op, SlapReply *rs )
+{
+	slap_overinst	*on = (slap_overinst *)op->o_bd->bd_info;
+
+	if ( op->o_memberof_barrier ) {
+		memberof_barrier( op, on );
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+memberof_barrier_parseCtrl(
+	Operation *op,
+	SlapReply *rs,
+	LDAPControl *ctrl )
+{
+	if ( op->o_memberof_barrier != SLAP_CONTROL_NONE ) {
+		rs->sr_text = "memberOf barrier control specified multiple times";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	if ( !BER_BVISNULL( &ctrl->ldctl_value ) ) {
+		rs->sr_text = "memberOf barrier control value not absent";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	op->o_memberof_barrier = ctrl->ldctl_iscritical ?
+		SLAP_CONTROL_CRITICAL : SLAP_CONTROL_NONCRITICAL;
+
+	return LDAP_SUCCESS;
+}
+
 /*
  * response callback that adds memberof values when a group is modified.
  */
@@ -370,6 +768,11 @@ memberof_value_modify(
 	    return;
 	}
 
+	if ( ( mo->mo_async || mo->mo_queue ) && memberof_queue( op, on, ndn, ad,
+			old_dn, old_ndn, new_dn, new_ndn ) ) {
+		return;
+	}
+
 	op2.o_tag = LDAP_REQ_MODIFY;
 
 	op2.o_req_dn = *ndn;
@@ -775,6 +1178,11 @@ memberof_op_delete( Operation *op, SlapReply *rs )
 			return SLAP_CB_CONTINUE;
 	}
 
+	/* the memberOf values read below must be current */
+	if ( mo->mo_async || mo->mo_queue ) {
+		memberof_barrier( op, on );
+	}
+
 	sc = op->o_tmpalloc( sizeof(slap_callback)+sizeof(*mci), op->o_tmpmemctx );
 	sc->sc_private = sc+1;
 	sc->sc_response = memberof_res_delete;
@@ -1231,6 +1639,7 @@ static int
 memberof_op_modrdn( Operation *op, SlapReply *rs )
 {
 	slap_overinst	*on = (slap_overinst *)op->o_bd->bd_info;
+	memberof_t	*mo = (memberof_t *)on->on_bi.bi_private;
 	slap_callback *sc;
 	memberof_cbinfo_t *mci;
 	OpExtra		*oex;
@@ -1240,6 +1649,11 @@ memberof_op_modrdn( Operation *op, SlapReply *rs )
 			return SLAP_CB_CONTINUE;
 	}
 
+	/* queued updates of the entry would be lost once it's renamed */
+	if ( mo->mo_async || mo->mo_queue ) {
+		memberof_barrier( op, on );
+	}
+
 	sc = op->o_tmpalloc( sizeof(slap_callback)+sizeof(*mci), op->o_tmpmemctx );
 	sc->sc_private = sc+1;
 	sc->sc_response = memberof_res_modrdn;
@@ -1625,6 +2039,10 @@ memberof_db_init(
 	/* safe default */
 	mo->mo_dangling_err = LDAP_CONSTRAINT_VIOLATION;
 
+	mo->mo_qtail = &mo->mo_queue;
+	ldap_pvt_thread_mutex_init( &mo->mo_q_mutex );
+	ldap_pvt_thread_cond_init( &mo->mo_q_cond );
+
 	if ( !ad_memberOf ) {
 		rc = slap_str2ad( SLAPD_MEMBEROF_ATTR, &ad_memberOf, &text );
 		if ( rc != LDAP_SUCCESS ) {
@@ -1656,6 +2074,19 @@ memberof_db_init(
 		}
 	}
 
+	/* only take a control slot when the overlay is actually used */
+	if ( !memberof_barrier_registered ) {
+		rc = register_supported_control( LDAP_CONTROL_X_MEMBEROF_BARRIER,
+			SLAP_CTRL_SEARCH | SLAP_CTRL_COMPARE, NULL,
+			memberof_barrier_parseCtrl, &memberof_barrier_cid );
+		if ( rc != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY, "memberof_db_init: "
+					"failed to register control (%d)\n", rc );
+			return rc;
+		}
+		memberof_barrier_registered = 1;
+	}
+
 	on->on_bi.bi_private = (void *)mo;
 
 	return 0;
@@ -1673,6 +2104,7 @@ enum {
 #endif
 
 	MO_DANGLING_ERROR,
+	MO_ASYNC,
 
 	MO_LAST
 };
@@ -1754,6 +2186,15 @@ static ConfigTable mo_cfg[] = {
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )",
 		NULL, NULL },
 
+	{ "memberof-async", "limit",
+		2, 2, 0, ARG_MAGIC|ARG_INT|MO_ASYNC, mo_cf_gen,
+		"( OLcfgOvAt:18.8 NAME 'olcMemberOfAsync' "
+			"DESC 'Max number of queued back-link updates, "
+				"0 to apply them synchronously' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )",
+		NULL, NULL },
+
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -1770,6 +2211,7 @@ static ConfigOCs mo_ocs[] = {
 			"$ olcMemberOfGroupOC "
 			"$ olcMemberOfMemberAD "
 			"$ olcMemberOfMemberOfAD "
+			"$ olcMemberOfAsync "
 #if 0
 			"$ olcMemberOfReverse "
 #endif
@@ -1911,6 +2353,12 @@ mo_cf_gen( ConfigArgs *c )
 			c->value_ad = mo->mo_ad_memberof;
 			break;
 
+		case MO_ASYNC:
+			if ( mo->mo_async == 0 )
+				return 1;
+			c->value_int = mo->mo_async;
+			break;
+
 		default:
 			assert( 0 );
 			return 1;
@@ -1961,6 +2409,10 @@ mo_cf_gen( ConfigArgs *c )
 			memberof_make_member_filter( mo );
 			break;
 
+		case MO_ASYNC:
+			mo->mo_async = 0;
+			break;
+
 		default:
 			assert( 0 );
 			return 1;
@@ -2070,6 +2522,17 @@ mo_cf_gen( ConfigArgs *c )
 			memberof_make_member_filter( mo );
 			} break;
 
+		case MO_ASYNC:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"memberof-async limit must not be negative" );
+				Debug( LDAP_DEBUG_CONFIG, "%s: %s.\n",
+					c->log, c->cr_msg );
+				return 1;
+			}
+			mo->mo_async = c->value_int;
+			break;
+
 		default:
 			assert( 0 );
 			return 1;
@@ -2114,6 +2577,24 @@ memberof_db_open(
 		memberof_make_member_filter( mo );
 	}
 
+	mo->mo_db = be->bd_self;
+
+	return overlay_register_control( be, LDAP_CONTROL_X_MEMBEROF_BARRIER );
+}
+
+static int
+memberof_db_close(
+	BackendDB	*be,
+	ConfigReply	*cr )
+{
+	slap_overinst	*on = (slap_overinst *)be->bd_info;
+	memberof_t	*mo = (memberof_t *)on->on_bi.bi_private;
+
+	ldap_pvt_thread_mutex_lock( &mo->mo_q_mutex );
+	while ( mo->mo_wpending || mo->mo_wrunning )
+		ldap_pvt_thread_cond_wait( &mo->mo_q_cond, &mo->mo_q_mutex );
+	ldap_pvt_thread_mutex_unlock( &mo->mo_q_mutex );
+
 	return 0;
 }
 
@@ -2126,6 +2607,15 @@ memberof_db_destroy(
 	memberof_t	*mo = (memberof_t *)on->on_bi.bi_private;
 
 	if ( mo ) {
+		memberof_rec *mr;
+
+		while (( mr = mo->mo_queue )) {
+			mo->mo_queue = mr->mr_next;
+			memberof_rec_free( mr );
+		}
+		ldap_pvt_thread_cond_destroy( &mo->mo_q_cond );
+		ldap_pvt_thread_mutex_destroy( &mo->mo_q_mutex );
+
 		if ( !BER_BVISNULL( &mo->mo_dn ) ) {
 			ber_memfree( mo->mo_dn.bv_val );
 			ber_memfree( mo->mo_ndn.bv_val );
@@ -2183,8 +2673,12 @@ memberof_initialize( void )
 
 	memberof.on_bi.bi_db_init = memberof_db_init;
 	memberof.on_bi.bi_db_open = memberof_db_open;
+	memberof.on_bi.bi_db_close = memberof_db_close;
 	memberof.on_bi.bi_db_destroy = memberof_db_destroy;
 
+	memberof.on_bi.bi_op_search = memberof_op_barrier;
+	memberof.on_bi.bi_op_compare = memberof_op_barrier;
+
 	memberof.on_bi.bi_op_add = memberof_op_add;
 	memberof.on_bi.bi_op_delete = memberof_op_delete;
 	memberof.on_bi.bi_op_modify = memberof_op_modify;
@@ -219,6 +219,9 @@ typedef struct cache_manager_s {
 	char	cache_binds;			/* cache binds or just passthru */
 
 	time_t	cc_period;		/* interval between successive consistency checks (sec) */
+	time_t	refresh_ahead;		/* refresh hot queries this long before expiry */
+	time_t	refresh_stale;		/* keep serving hot expired queries this long */
+	int	refresh_hits;		/* answers that make a query hot */
 #define PCACHE_CC_PAUSED	1
 #define PCACHE_CC_OFFLINE	2
 	int 	cc_paused;
@@ -1271,163 +1274,260 @@ typedef struct fstack {
 	Filter *fs_fi;
 } fstack;
 
+/* Check whether the cached filter fs contains the incoming filter fi.
+ * Returns 1 if it does, 0 if it doesn't, 2 if the equality first
+ * components differ, so no cached query further along the tree with
+ * an equality first component can contain fi either, and -1 if the
+ * values could not be compared.
+ */
+static int
+filter_contained( Operation *op, Filter *fs, Filter *fi, Filter *first )
+{
+	MatchingRule* mrule = NULL;
+	int res=0;
+	int ret = 0, rc;
+	fstack *stack = NULL, *fsp;
+
+	do {
+		res=0;
+		switch (fs->f_choice) {
+		case LDAP_FILTER_EQUALITY:
+			if (fi->f_choice == LDAP_FILTER_EQUALITY)
+				mrule = fs->f_ava->aa_desc->ad_type->sat_equality;
+			else
+				ret = 1;
+			break;
+		case LDAP_FILTER_GE:
+		case LDAP_FILTER_LE:
+			mrule = fs->f_ava->aa_desc->ad_type->sat_ordering;
+			break;
+		default:
+			mrule = NULL; 
+		}
+		if (mrule) {
+			const char *text;
+			rc = value_match(&ret, fs->f_ava->aa_desc, mrule,
+				SLAP_MR_VALUE_OF_ASSERTION_SYNTAX,
+				&(fi->f_ava->aa_value),
+				&(fs->f_ava->aa_value), &text);
+			if (rc != LDAP_SUCCESS) {
+				res = -1;
+				break;
+			}
+			if ( fi==first && fi->f_choice==LDAP_FILTER_EQUALITY && ret ) {
+				res = 2;
+				break;
+			}
+		}
+		switch (fs->f_choice) {
+		case LDAP_FILTER_OR:
+		case LDAP_FILTER_AND:
+			if ( fs->f_next ) {
+				/* save our stack position */
+				fsp = op->o_tmpalloc(sizeof(fstack), op->o_tmpmemctx);
+				fsp->fs_next = stack;
+				fsp->fs_fs = fs->f_next;
+				fsp->fs_fi = fi->f_next;
+				stack = fsp;
+			}
+			fs = fs->f_and;
+			fi = fi->f_and;
+			res=1;
+			break;
+		case LDAP_FILTER_SUBSTRINGS:
+			/* check if the equality query can be
+			* answered with cached substring query */
+			if ((fi->f_choice == LDAP_FILTER_EQUALITY)
+				&& substr_containment_equality( op,
+				fs, fi))
+				res=1;
+			/* check if the substring query can be
+			* answered with cached substring query */
+			if ((fi->f_choice ==LDAP_FILTER_SUBSTRINGS
+				) && substr_containment_substr( op,
+				fs, fi))
+				res= 1;
+			fs=fs->f_next;
+			fi=fi->f_next;
+			break;
+		case LDAP_FILTER_PRESENT:
+			res=1;
+			fs=fs->f_next;
+			fi=fi->f_next;
+			break;
+		case LDAP_FILTER_EQUALITY:
+			if (ret == 0)
+				res = 1;
+			fs=fs->f_next;
+			fi=fi->f_next;
+			break;
+		case LDAP_FILTER_GE:
+			if (mrule && ret >= 0)
+				res = 1;
+			fs=fs->f_next;
+			fi=fi->f_next;
+			break;
+		case LDAP_FILTER_LE:
+			if (mrule && ret <= 0)
+				res = 1;
+			fs=fs->f_next;
+			fi=fi->f_next;
+			break;
+		case LDAP_FILTER_NOT:
+			res=0;
+			break;
+		default:
+			break;
+		}
+		if (!fs && !fi && stack) {
+			/* pop the stack */
+			fsp = stack;
+			stack = fsp->fs_next;
+			fs = fsp->fs_fs;
+			fi = fsp->fs_fi;
+			op->o_tmpfree(fsp, op->o_tmpmemctx);
+		}
+	} while((res == 1) && (fi != NULL) && (fs != NULL));
+
+	while ( stack ) {
+		fsp = stack;
+		stack = fsp->fs_next;
+		op->o_tmpfree(fsp, op->o_tmpmemctx);
+	}
+	return res;
+}
+
+/* Find a cached substring query containing the incoming query, whose
+ * first component is an equality or substring assertion with the
+ * value or initial string val. Cached substring queries sort by their
+ * initial strings, those without one first; a cached query can only
+ * contain the incoming one if its initial string is absent or a
+ * prefix of val. Each of these runs of queries is found by a lookup
+ * of its own, instead of walking all the cached substring queries.
+ * The runs are visited from the end of the tree backwards, so the
+ * first containing query found is the same as with a full walk.
+ */
+static CachedQuery *
+find_substr_filter( Operation *op, TAvlnode *root, Filter *inputf,
+	Filter *first, struct berval *val )
+{
+	Filter *keyf, *f, *kf;
+	SubstringsAssertion ssa = { 0 };
+	CachedQuery cq, *qc = NULL;
+	TAvlnode *ptr, *start, *end;
+	ber_len_t len;
+	int depth = 0, ret, rc = 0;
+
+	/* A key shaped like the incoming filter, down to the first
+	 * component; it sorts before all the cached queries whose first
+	 * component has the same initial string */
+	for ( f = inputf; f != first; f = f->f_and )
+		depth++;
+	keyf = op->o_tmpcalloc( depth + 1, sizeof(Filter), op->o_tmpmemctx );
+	for ( f = inputf, kf = keyf; f != first; f = f->f_and, kf++ ) {
+		kf->f_choice = f->f_choice;
+		kf->f_and = kf+1;
+	}
+	kf->f_choice = LDAP_FILTER_SUBSTRINGS;
+	kf->f_sub = &ssa;
+	ssa.sa_desc = first->f_choice == LDAP_FILTER_SUBSTRINGS ?
+		first->f_sub_desc : first->f_av_desc;
+	cq.filter = keyf;
+	cq.first = kf;
+
+	/* len 0 stands for no initial string */
+	len = val->bv_val ? val->bv_len : 0;
+	for ( ;; len-- ) {
+		if ( len ) {
+			ssa.sa_initial.bv_val = val->bv_val;
+			ssa.sa_initial.bv_len = len;
+		} else {
+			BER_BVZERO( &ssa.sa_initial );
+		}
+		start = tavl_find3( root, &cq, pcache_query_cmp, &ret );
+		if ( start && ret > 0 )
+			start = tavl_next( start, TAVL_DIR_RIGHT );
+
+		/* find the end of the run */
+		end = NULL;
+		for ( ptr = start; ptr; ptr = tavl_next( ptr, TAVL_DIR_RIGHT )) {
+			Filter *qf;
+
+			qc = ptr->avl_data;
+			qf = qc->first;
+			if ( qf->f_choice != LDAP_FILTER_SUBSTRINGS )
+				break;
+			if ( len ? ( qf->f_sub_initial.bv_len != len ||
+					memcmp( qf->f_sub_initial.bv_val, val->bv_val, len )) :
+				!BER_BVISNULL( &qf->f_sub_initial ))
+				break;
+			end = ptr;
+		}
+
+		for ( ptr = end; ptr; ptr = tavl_next( ptr, TAVL_DIR_LEFT )) {
+			qc = ptr->avl_data;
+			rc = filter_contained( op, qc->filter, inputf, first );
+			if ( rc < 0 )
+				break;
+			if ( rc == 1 )
+				goto done;
+			if ( ptr == start )
+				break;
+		}
+		if ( rc < 0 || !len )
+			break;
+	}
+	qc = NULL;
+done:
+	op->o_tmpfree( keyf, op->o_tmpmemctx );
+	return qc;
+}
+
 static CachedQuery *
 find_filter( Operation *op, TAvlnode *root, Filter *inputf, Filter *first )
 {
-	Filter* fs;
-	Filter* fi;
-	MatchingRule* mrule = NULL;
-	int res=0, eqpass= 0;
 	int ret, rc, dir;
 	TAvlnode *ptr;
 	CachedQuery cq, *qc;
-	fstack *stack = NULL, *fsp;
 
 	cq.filter = inputf;
 	cq.first = first;
 
-	/* substring matches sort to the end, and we just have to
-	 * walk the entire list.
+	/* an incoming substr query can only be satisfied by a cached
+	 * substr query.
 	 */
-	if ( first->f_choice == LDAP_FILTER_SUBSTRINGS ) {
-		ptr = tavl_end( root, 1 );
-		dir = TAVL_DIR_LEFT;
-	} else {
-		ptr = tavl_find3( root, &cq, pcache_query_cmp, &ret );
-		dir = (first->f_choice == LDAP_FILTER_GE) ? TAVL_DIR_LEFT :
-			TAVL_DIR_RIGHT;
-	}
+	if ( first->f_choice == LDAP_FILTER_SUBSTRINGS )
+		return find_substr_filter( op, root, inputf, first,
+			&first->f_sub_initial );
+
+	ptr = tavl_find3( root, &cq, pcache_query_cmp, &ret );
+	dir = (first->f_choice == LDAP_FILTER_GE) ? TAVL_DIR_LEFT :
+		TAVL_DIR_RIGHT;
 
 	while (ptr) {
 		qc = ptr->avl_data;
-		fi = inputf;
-		fs = qc->filter;
-
-		/* an incoming substr query can only be satisfied by a cached
-		 * substr query.
-		 */
-		if ( first->f_choice == LDAP_FILTER_SUBSTRINGS &&
-			qc->first->f_choice != LDAP_FILTER_SUBSTRINGS )
-			break;
 
 		/* an incoming eq query can be satisfied by a cached eq or substr
 		 * query
 		 */
-		if ( first->f_choice == LDAP_FILTER_EQUALITY ) {
-			if ( eqpass == 0 ) {
-				if ( qc->first->f_choice != LDAP_FILTER_EQUALITY ) {
-nextpass:			eqpass = 1;
-					ptr = tavl_end( root, 1 );
-					dir = TAVL_DIR_LEFT;
-					continue;
-				}
-			} else {
-				if ( qc->first->f_choice != LDAP_FILTER_SUBSTRINGS )
-					break;
-			}
-		}
-		do {
-			res=0;
-			switch (fs->f_choice) {
-			case LDAP_FILTER_EQUALITY:
-				if (fi->f_choice == LDAP_FILTER_EQUALITY)
-					mrule = fs->f_ava->aa_desc->ad_type->sat_equality;
-				else
-					ret = 1;
-				break;
-			case LDAP_FILTER_GE:
-			case LDAP_FILTER_LE:
-				mrule = fs->f_ava->aa_desc->ad_type->sat_ordering;
-				break;
-			default:
-				mrule = NULL; 
-			}
-			if (mrule) {
-				const char *text;
-				rc = value_match(&ret, fs->f_ava->aa_desc, mrule,
-					SLAP_MR_VALUE_OF_ASSERTION_SYNTAX,
-					&(fi->f_ava->aa_value),
-					&(fs->f_ava->aa_value), &text);
-				if (rc != LDAP_SUCCESS) {
-					return NULL;
-				}
-				if ( fi==first && fi->f_choice==LDAP_FILTER_EQUALITY && ret )
-					goto nextpass;
-			}
-			switch (fs->f_choice) {
-			case LDAP_FILTER_OR:
-			case LDAP_FILTER_AND:
-				if ( fs->f_next ) {
-					/* save our stack position */
-					fsp = op->o_tmpalloc(sizeof(fstack), op->o_tmpmemctx);
-					fsp->fs_next = stack;
-					fsp->fs_fs = fs->f_next;
-					fsp->fs_fi = fi->f_next;
-					stack = fsp;
-				}
-				fs = fs->f_and;
-				fi = fi->f_and;
-				res=1;
-				break;
-			case LDAP_FILTER_SUBSTRINGS:
-				/* check if the equality query can be
-				* answered with cached substring query */
-				if ((fi->f_choice == LDAP_FILTER_EQUALITY)
-					&& substr_containment_equality( op,
-					fs, fi))
-					res=1;
-				/* check if the substring query can be
-				* answered with cached substring query */
-				if ((fi->f_choice ==LDAP_FILTER_SUBSTRINGS
-					) && substr_containment_substr( op,
-					fs, fi))
-					res= 1;
-				fs=fs->f_next;
-				fi=fi->f_next;
-				break;
-			case LDAP_FILTER_PRESENT:
-				res=1;
-				fs=fs->f_next;
-				fi=fi->f_next;
-				break;
-			case LDAP_FILTER_EQUALITY:
-				if (ret == 0)
-					res = 1;
-				fs=fs->f_next;
-				fi=fi->f_next;
-				break;
-			case LDAP_FILTER_GE:
-				if (mrule && ret >= 0)
-					res = 1;
-				fs=fs->f_next;
-				fi=fi->f_next;
-				break;
-			case LDAP_FILTER_LE:
-				if (mrule && ret <= 0)
-					res = 1;
-				fs=fs->f_next;
-				fi=fi->f_next;
-				break;
-			case LDAP_FILTER_NOT:
-				res=0;
-				break;
-			default:
-				break;
-			}
-			if (!fs && !fi && stack) {
-				/* pop the stack */
-				fsp = stack;
-				stack = fsp->fs_next;
-				fs = fsp->fs_fs;
-				fi = fsp->fs_fi;
-				op->o_tmpfree(fsp, op->o_tmpmemctx);
-			}
-		} while((res) && (fi != NULL) && (fs != NULL));
+		if ( first->f_choice == LDAP_FILTER_EQUALITY &&
+			qc->first->f_choice != LDAP_FILTER_EQUALITY )
+			break;
 
-		if ( res )
+		rc = filter_contained( op, qc->filter, inputf, first );
+		if ( rc < 0 )
+			return NULL;
+		if ( rc == 1 )
 			return qc;
+		if ( rc == 2 )
+			break;
 		ptr = tavl_next( ptr, dir );
 	}
+
+	if ( first->f_choice == LDAP_FILTER_EQUALITY )
+		return find_substr_filter( op, root, inputf, first,
+			&first->f_av_value );
+
 	return NULL;
 }
 
@@ -1691,6 +1791,24 @@ remove_from_template (CachedQuery* qc, QueryTemplate* template)
 	template->no_of_queries--;
 }
 
+/* move a refreshed query to the top of the template's list,
+ * where its new expiry belongs */
+static void
+query_to_template_top( CachedQuery *qc, QueryTemplate *template )
+{
+	if ( !qc->prev )
+		return;
+	qc->prev->next = qc->next;
+	if ( qc->next )
+		qc->next->prev = qc->prev;
+	else
+		template->query_last = qc->prev;
+	qc->prev = NULL;
+	qc->next = template->query;
+	template->query->prev = qc;
+	template->query = qc;
+}
+
 /* remove bottom query of LRU list from the query cache */
 /*
  * NOTE: slight change in functionality.
@@ -3058,7 +3176,7 @@ pcache_op_search(
 		ldap_pvt_thread_mutex_lock( &answerable->answerable_cnt_mutex );
 		answerable->answerable_cnt++;
 		/* we only care about refcnts if we're refreshing */
-		if ( answerable->refresh_time )
+		if ( answerable->refresh_time || cm->refresh_ahead )
 			answerable->refcnt++;
 		Debug( pcache_debug, "QUERY ANSWERABLE (answered %lu times)\n",
 			answerable->answerable_cnt );
@@ -3530,11 +3648,11 @@ consistency_check(
 	cm->cc_arg = arg;
 
 	for (templ = qm->templates; templ; templ=templ->qmnext) {
-		time_t ttl;
+		time_t ttl = 0, ahead = cm->refresh_ahead;
 		if ( !templ->query_last ) continue;
 		pause = 0;
 		op->o_time = slap_get_time();
-		if ( !templ->ttr ) {
+		if ( !templ->ttr && !ahead ) {
 			ttl = templ->ttl;
 			if ( templ->negttl && templ->negttl < ttl )
 				ttl = templ->negttl;
@@ -3560,6 +3678,28 @@ consistency_check(
 				}
 			}
 
+			/* Refresh a query that has been answered often enough
+			 * since it was cached or last refreshed, shortly before
+			 * it expires or, within the stale bound, after, so the
+			 * next clients don't have to wait for the remote server.
+			 * refresh_query() resets the count, so a query that
+			 * stops being used, or whose refresh fails, expires.
+			 */
+			if ( ahead && query->refcnt >= cm->refresh_hits &&
+				query->expiry_time <= op->o_time + ahead &&
+				query->expiry_time + cm->refresh_stale >= op->o_time )
+			{
+				Debug( pcache_debug, "REFRESHING HOT QUERY (%d answers)\n",
+					query->refcnt );
+				if ( refresh_query( op, query, on ) == LDAP_SUCCESS ) {
+					query->expiry_time = op->o_time + templ->ttl;
+					ldap_pvt_thread_rdwr_wlock(&templ->t_rwlock);
+					query_to_template_top( query, templ );
+					ldap_pvt_thread_rdwr_wunlock(&templ->t_rwlock);
+					continue;
+				}
+			}
+
 			if (query->expiry_time < op->o_time) {
 				int rem = 0;
 				Debug( pcache_debug, "Lock CR index = %p\n",
@@ -3605,7 +3745,8 @@ consistency_check(
 				ldap_pvt_thread_rdwr_wunlock( &query->rwlock );
 				if ( rem ) free_query(query);
 				ldap_pvt_thread_rdwr_wunlock(&templ->t_rwlock);
-			} else if ( !templ->ttr && query->expiry_time > ttl ) {
+			} else if ( !templ->ttr && !ahead &&
+				query->expiry_time > ttl ) {
 				/* We don't need to check for refreshes, and this
 				 * query's expiry is too new, and all subsequent queries
 				 * will be newer yet. So stop looking.
@@ -3643,7 +3784,8 @@ enum {
 	PC_QUERIES,
 	PC_OFFLINE,
 	PC_BIND,
-	PC_PRIVATE_DB
+	PC_PRIVATE_DB,
+	PC_REFRESH_AHEAD
 };
 
 static ConfigDriver pc_cf_gen;
@@ -3709,6 +3851,13 @@ static ConfigTable pccfg[] = {
 			"DESC 'Parameters for caching Binds' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "pcacheRefreshAhead", "time> <hits> <stale",
+		2, 4, 0, ARG_MAGIC|PC_REFRESH_AHEAD, pc_cf_gen,
+		"( OLcfgOvAt:2.10 NAME 'olcPcacheRefreshAhead' "
+			"DESC 'Refresh queries answered at least <hits> times <time> "
+				"before they expire, serving them up to <stale> after' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "pcache-", "private database args",
 		1, 0, STRLENOF("pcache-"), ARG_MAGIC|PC_PRIVATE_DB, pc_cf_gen,
 		NULL, NULL, NULL },
@@ -3747,7 +3896,8 @@ static ConfigOCs pcocs[] = {
 		"SUP olcOverlayConfig "
 		"MUST ( olcPcache $ olcPcacheAttrset $ olcPcacheTemplate ) "
 		"MAY ( olcPcachePosition $ olcPcacheMaxQueries $ olcPcachePersist $ "
-			"olcPcacheValidate $ olcPcacheOffline $ olcPcacheBind ) )",
+			"olcPcacheValidate $ olcPcacheOffline $ olcPcacheBind $ "
+			"olcPcacheRefreshAhead ) )",
 		Cft_Overlay, pccfg, NULL, pc_cfadd },
 	{ "( OLcfgOvOc:2.2 "
 		"NAME 'olcPcacheDatabase' "
@@ -3934,6 +4084,17 @@ pc_cf_gen( ConfigArgs *c )
 		case PC_OFFLINE:
 			c->value_int = (cm->cc_paused & PCACHE_CC_OFFLINE) != 0;
 			break;
+		case PC_REFRESH_AHEAD:
+			if ( !cm->refresh_ahead ) {
+				rc = 1;
+				break;
+			}
+			bv.bv_len = snprintf( c->cr_msg, sizeof( c->cr_msg ), "%ld %d %ld",
+				(long)cm->refresh_ahead, cm->refresh_hits,
+				(long)cm->refresh_stale );
+			bv.bv_val = c->cr_msg;
+			value_add_one( &c->rvalue_vals, &bv );
+			break;
 		}
 		return rc;
 	} else if ( c->op == LDAP_MOD_DELETE ) {
@@ -3956,6 +4117,12 @@ pc_cf_gen( ConfigArgs *c )
 			}
 			rc = 0;
 			break;
+		case PC_REFRESH_AHEAD:
+			cm->refresh_ahead = 0;
+			cm->refresh_stale = 0;
+			cm->refresh_hits = 0;
+			rc = 0;
+			break;
 		}
 		return rc;
 	}
@@ -4412,6 +4579,33 @@ pc_bind_fail:
 		else
 			cm->cc_paused &= ~PCACHE_CC_OFFLINE;
 		break;
+	case PC_REFRESH_AHEAD: {
+		unsigned long stale = 0;
+
+		num = 1;
+		if ( lutil_parse_time( c->argv[1], &t ) != 0 || t == 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"unable to parse refresh time=\"%s\"", c->argv[1] );
+			Debug( LDAP_DEBUG_CONFIG, "%s: %s.\n", c->log, c->cr_msg );
+			return( 1 );
+		}
+		if ( c->argc > 2 && ( lutil_atoi( &num, c->argv[2] ) != 0 || num <= 0 )) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"hits=\"%s\" must be a positive number", c->argv[2] );
+			Debug( LDAP_DEBUG_CONFIG, "%s: %s.\n", c->log, c->cr_msg );
+			return( 1 );
+		}
+		if ( c->argc > 3 && lutil_parse_time( c->argv[3], &stale ) != 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"unable to parse stale time=\"%s\"", c->argv[3] );
+			Debug( LDAP_DEBUG_CONFIG, "%s: %s.\n", c->log, c->cr_msg );
+			return( 1 );
+		}
+		cm->refresh_ahead = (time_t)t;
+		cm->refresh_hits = num;
+		cm->refresh_stale = (time_t)stale;
+		break;
+		}
 	case PC_PRIVATE_DB:
 		if ( cm->db.be_private == NULL ) {
 			snprintf( c->cr_msg, sizeof( c->cr_msg ),
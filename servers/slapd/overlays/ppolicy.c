@@ -40,6 +40,7 @@
 #include <ac/string.h>
 #include <ac/ctype.h>
 #include "config.h"
+#include "ldap_rq.h"
 
 #ifndef MODULE_NAME_SZ
 #define MODULE_NAME_SZ 256
@@ -57,9 +58,24 @@ typedef struct pp_info {
 	int forward_updates;	/* use frontend for policy state updates */
 	int disable_write;
 	int send_netscape_controls;	/* send netscape password controls */
+	int failure_cache;	/* seconds between writes of cached bind state */
+	Avlnode *fstates;	/* cached bind state, by DN */
+	BackendDB *db;
+	struct re_s *fstate_task;
 	ldap_pvt_thread_mutex_t pwdFailureTime_mutex;
 } pp_info;
 
+/* Bind failure state not written to the entry yet */
+typedef struct pp_fstate {
+	struct berval pf_ndn;
+	BerVarray pf_failures;	/* new pwdFailureTime values */
+	int pf_nfailures;
+	int pf_maxrecorded;	/* pwdMaxRecordedFailure of the entry's policy */
+	time_t pf_cleared;	/* last successful bind, older failures are void */
+	time_t pf_locked;	/* new pwdAccountLockedTime */
+	time_t pf_tmplock;	/* new pwdAccountTmpLockoutEnd */
+} pp_fstate;
+
 /* Our per-connection info - note, it is not per-instance, it is 
  * used by all instances
  */
@@ -421,9 +437,11 @@ enum {
 	PPOLICY_HASH_CLEARTEXT,
 	PPOLICY_USE_LOCKOUT,
 	PPOLICY_DISABLE_WRITE,
+	PPOLICY_FAILURE_CACHE,
 };
 
 static ConfigDriver ppolicy_cf_default;
+static ConfigDriver ppolicy_cf_fcache;
 
 static ConfigTable ppolicycfg[] = {
 	{ "ppolicy_default", "policyDN", 2, 2, 0,
@@ -467,6 +485,12 @@ static ConfigTable ppolicycfg[] = {
 	  "DESC 'Send Netscape policy controls' "
 	  "EQUALITY booleanMatch "
 	  "SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "ppolicy_failure_cache", "seconds", 2, 2, 0,
+	  ARG_INT|ARG_MAGIC|PPOLICY_FAILURE_CACHE, ppolicy_cf_fcache,
+	  "( OLcfgOvAt:12.7 NAME 'olcPPolicyFailureCache' "
+	  "DESC 'Keep Bind failure state in memory, write it at this interval' "
+	  "EQUALITY integerMatch "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -477,7 +501,8 @@ static ConfigOCs ppolicyocs[] = {
 	  "SUP olcOverlayConfig "
 	  "MAY ( olcPPolicyDefault $ olcPPolicyHashCleartext $ "
 	  "olcPPolicyUseLockout $ olcPPolicyForwardUpdates $ "
-	  "olcPPolicyDisableWrite $ olcPPolicySendNetscapeControls ) )",
+	  "olcPPolicyDisableWrite $ olcPPolicySendNetscapeControls $ "
+	  "olcPPolicyFailureCache ) )",
 	  Cft_Overlay, ppolicycfg },
 	{ NULL, 0, NULL }
 };
@@ -1394,6 +1419,378 @@ ppolicy_ctrls_cleanup( Operation *op, SlapReply *rs )
 	return SLAP_CB_CONTINUE;
 }
 
+/* Write the policy state changes resulting from a Bind to the entry */
+static void
+ppolicy_state_update( Operation *op, slap_overinst *on, Modifications *mod )
+{
+	pp_info *pi = on->on_bi.bi_private;
+	Operation op2 = *op;
+	SlapReply r2 = { REP_RESULT };
+	slap_callback cb = { NULL, slap_null_cb, NULL, NULL };
+	LDAPControl c, *ca[2];
+	BackendInfo *bi = op->o_bd->bd_info;
+
+	op2.o_tag = LDAP_REQ_MODIFY;
+	op2.o_callback = &cb;
+	op2.orm_modlist = mod;
+	op2.orm_no_opattrs = 0;
+	op2.o_dn = op->o_bd->be_rootdn;
+	op2.o_ndn = op->o_bd->be_rootndn;
+
+	/* If this server is a shadow and forward_updates is true,
+	 * use the frontend to perform this modify. That will trigger
+	 * the update referral, which can then be forwarded by the
+	 * chain overlay. Obviously the updateref and chain overlay
+	 * must be configured appropriately for this to be useful.
+	 */
+	if ( SLAP_SHADOW( op->o_bd ) && pi->forward_updates ) {
+		op2.o_bd = frontendDB;
+
+		/* Must use Relax control since these are no-user-mod */
+		op2.o_relax = SLAP_CONTROL_CRITICAL;
+		op2.o_ctrls = ca;
+		ca[0] = &c;
+		ca[1] = NULL;
+		BER_BVZERO( &c.ldctl_value );
+		c.ldctl_iscritical = 1;
+		c.ldctl_oid = LDAP_CONTROL_RELAX;
+	} else {
+		/* If not forwarding, don't update opattrs and don't replicate */
+		if ( SLAP_SINGLE_SHADOW( op->o_bd )) {
+			op2.orm_no_opattrs = 1;
+			op2.o_dont_replicate = 1;
+		}
+		op2.o_bd->bd_info = (BackendInfo *)on->on_info;
+	}
+	op2.o_bd->be_modify( &op2, &r2 );
+	op->o_bd->bd_info = bi;
+}
+
+static Modifications *
+ppolicy_mod_replace( Modifications *next, AttributeDescription *ad, time_t t )
+{
+	Modifications *m;
+	char buf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
+	struct berval bv;
+
+	bv.bv_val = buf;
+	bv.bv_len = sizeof(buf);
+	slap_timestamp( &t, &bv );
+
+	m = ch_calloc( sizeof(Modifications), 1 );
+	m->sml_op = LDAP_MOD_REPLACE;
+	m->sml_flags = 0;
+	m->sml_type = ad->ad_cname;
+	m->sml_desc = ad;
+	m->sml_numvals = 1;
+	m->sml_values = ch_calloc( sizeof(struct berval), 2 );
+	m->sml_nvalues = ch_calloc( sizeof(struct berval), 2 );
+	ber_dupbv( &m->sml_values[0], &bv );
+	ber_dupbv( &m->sml_nvalues[0], &bv );
+	m->sml_next = next;
+	return m;
+}
+
+/*
+ * With ppolicy_failure_cache, the pwdFailureTime values and the lockouts
+ * resulting from failed Binds, and the removal of the failures after a
+ * successful Bind, are kept in memory and written to the entries
+ * periodically, all the changes to an entry in a single modification.
+ * The changes are merged with the values found in the entry at that
+ * time, which may have been replicated from other servers meanwhile,
+ * rather than replacing them.
+ */
+static int
+ppolicy_fstate_cmp( const void *v1, const void *v2 )
+{
+	const pp_fstate *pf1 = v1, *pf2 = v2;
+
+	return ber_bvcmp( &pf1->pf_ndn, &pf2->pf_ndn );
+}
+
+static void
+ppolicy_fstate_free( void *v )
+{
+	pp_fstate *pf = v;
+
+	ber_bvarray_free( pf->pf_failures );
+	ch_free( pf );
+}
+
+static pp_fstate *
+ppolicy_fstate_get( pp_info *pi, struct berval *ndn, int create )
+{
+	pp_fstate *pf, key;
+
+	key.pf_ndn = *ndn;
+	pf = avl_find( pi->fstates, &key, ppolicy_fstate_cmp );
+	if ( !pf && create ) {
+		pf = ch_calloc( 1, sizeof(pp_fstate) + ndn->bv_len + 1 );
+		pf->pf_ndn.bv_val = (char *)(pf+1);
+		pf->pf_ndn.bv_len = ndn->bv_len;
+		AC_MEMCPY( pf->pf_ndn.bv_val, ndn->bv_val, ndn->bv_len );
+		avl_insert( &pi->fstates, pf, ppolicy_fstate_cmp, avl_dup_error );
+	}
+	return pf;
+}
+
+/*
+ * A shadow forwarding the state to its provider keeps doing so for each
+ * Bind: the chained writes need the connection of the originating client.
+ */
+#define PPOLICY_FCACHE(op, pi) ( (pi)->failure_cache && \
+	!( SLAP_SHADOW( (op)->o_bd ) && (pi)->forward_updates ) )
+
+/* Failure stored in the entry, but reset by a later successful Bind */
+static int
+ppolicy_fstate_void( pp_fstate *pf, struct berval *bv )
+{
+	return pf && pf->pf_cleared && parse_time( bv->bv_val ) <= pf->pf_cleared;
+}
+
+/* Is the account locked by a cached lockout? */
+static int
+ppolicy_fstate_locked( pp_info *pi, struct berval *ndn, PassPolicy *pp,
+	time_t now )
+{
+	pp_fstate *pf;
+	int rc = 0;
+
+	if ( !pp->pwdLockout )
+		return 0;
+
+	ldap_pvt_thread_mutex_lock( &pi->pwdFailureTime_mutex );
+	pf = ppolicy_fstate_get( pi, ndn, 0 );
+	if ( pf ) {
+		if ( now < pf->pf_tmplock )
+			rc = 1;
+		if ( pf->pf_locked ) {
+			if ( !pp->pwdLockoutDuration ||
+					now < pf->pf_locked + pp->pwdLockoutDuration )
+				rc = 1;
+			else
+				pf->pf_locked = 0;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &pi->pwdFailureTime_mutex );
+	return rc;
+}
+
+/* Record a failed Bind, lock the account if needed */
+static void
+ppolicy_fstate_failure( pp_info *pi, PassPolicy *pp, Entry *e, time_t now,
+	struct berval *timestamp_usec )
+{
+	pp_fstate *pf = ppolicy_fstate_get( pi, &e->e_nname, 1 );
+	Attribute *a;
+	int i, fc = 0;
+
+	if ( (a = attr_find( e->e_attrs, ad_pwdFailureTime )) != NULL ) {
+		for ( i=0; a->a_nvals[i].bv_val; i++ ) {
+			if ( ppolicy_fstate_void( pf, &a->a_nvals[i] ))
+				continue;
+			if ( pp->pwdFailureCountInterval == 0 ||
+					now <= parse_time( a->a_nvals[i].bv_val ) +
+						pp->pwdFailureCountInterval )
+				fc++;
+		}
+	}
+	for ( i=0; i < pf->pf_nfailures; i++ ) {
+		if ( pp->pwdFailureCountInterval == 0 ||
+				now <= parse_time( pf->pf_failures[i].bv_val ) +
+					pp->pwdFailureCountInterval )
+			fc++;
+	}
+
+	value_add_one( &pf->pf_failures, timestamp_usec );
+	pf->pf_nfailures++;
+	pf->pf_maxrecorded = pp->pwdMaxRecordedFailure;
+
+	if ( pp->pwdMaxFailure > 0 && fc >= pp->pwdMaxFailure - 1 ) {
+		pf->pf_locked = now;
+	} else if ( pp->pwdMinDelay ) {
+		int waittime = pp->pwdMinDelay << fc;
+
+		if ( waittime > pp->pwdMaxDelay ) {
+			waittime = pp->pwdMaxDelay;
+		}
+		pf->pf_tmplock = now + waittime;
+	}
+}
+
+static int
+ppolicy_time_cmp( const void *v1, const void *v2 )
+{
+	const struct berval *bv1 = v1, *bv2 = v2;
+
+	return strcmp( bv1->bv_val, bv2->bv_val );
+}
+
+/* Write the cached state of one entry */
+static int
+ppolicy_fstate_write( void *data, void *arg )
+{
+	pp_fstate *pf = data;
+	Operation *op = arg;
+	slap_overinst *on = op->o_callback->sc_private;
+	pp_info *pi = on->on_bi.bi_private;
+	Modifications *mod = NULL, *m;
+	Attribute *a;
+	struct berval *vals;
+	Entry *e;
+	int i, j, n, changed = 0;
+
+	op->o_bd->bd_info = (BackendInfo *)on->on_info;
+	if ( be_entry_get_rw( op, &pf->pf_ndn, NULL, NULL, 0, &e ) != LDAP_SUCCESS )
+		return 0;
+
+	a = attr_find( e->e_attrs, ad_pwdFailureTime );
+	n = ( a ? a->a_numvals : 0 ) + pf->pf_nfailures;
+	vals = op->o_tmpalloc( ( n + 1 ) * sizeof(struct berval), op->o_tmpmemctx );
+	n = 0;
+	if ( a ) {
+		for ( i=0; i < a->a_numvals; i++ ) {
+			if ( ppolicy_fstate_void( pf, &a->a_nvals[i] ))
+				changed = 1;
+			else
+				vals[n++] = a->a_nvals[i];
+		}
+	}
+	for ( i=0; i < pf->pf_nfailures; i++ ) {
+		for ( j=0; j < n && !bvmatch( &vals[j], &pf->pf_failures[i] ); j++ )
+			;
+		if ( j == n ) {
+			vals[n++] = pf->pf_failures[i];
+			changed = 1;
+		}
+	}
+	qsort( vals, n, sizeof(struct berval), ppolicy_time_cmp );
+	/* keep the most recent ones */
+	j = 0;
+	if ( pf->pf_maxrecorded && n > pf->pf_maxrecorded ) {
+		j = n - pf->pf_maxrecorded;
+		changed = 1;
+	}
+
+	if ( changed && ( a || n > j )) {
+		m = ch_calloc( sizeof(Modifications), 1 );
+		m->sml_flags = 0;
+		m->sml_type = ad_pwdFailureTime->ad_cname;
+		m->sml_desc = ad_pwdFailureTime;
+		if ( n > j ) {
+			m->sml_op = LDAP_MOD_REPLACE;
+			m->sml_numvals = n - j;
+			m->sml_values = ch_calloc( sizeof(struct berval), n - j + 1 );
+			m->sml_nvalues = ch_calloc( sizeof(struct berval), n - j + 1 );
+			for ( i=0; j < n; i++, j++ ) {
+				ber_dupbv( &m->sml_values[i], &vals[j] );
+				ber_dupbv( &m->sml_nvalues[i], &vals[j] );
+			}
+		} else {
+			m->sml_op = LDAP_MOD_DELETE;
+		}
+		m->sml_next = mod;
+		mod = m;
+	}
+	op->o_tmpfree( vals, op->o_tmpmemctx );
+
+	if ( pf->pf_locked )
+		mod = ppolicy_mod_replace( mod, ad_pwdAccountLockedTime, pf->pf_locked );
+	if ( pf->pf_tmplock > op->o_time )
+		mod = ppolicy_mod_replace( mod, ad_pwdAccountTmpLockoutEnd, pf->pf_tmplock );
+
+	be_entry_release_r( op, e );
+
+	if ( mod ) {
+		if ( !pi->disable_write ) {
+			op->o_req_dn = pf->pf_ndn;
+			op->o_req_ndn = pf->pf_ndn;
+			ppolicy_state_update( op, on, mod );
+		}
+		slap_mods_free( mod, 1 );
+	}
+	return 0;
+}
+
+static void
+ppolicy_fstate_flush( Operation *op, slap_overinst *on )
+{
+	pp_info *pi = on->on_bi.bi_private;
+	slap_callback cb = { 0 };
+
+	cb.sc_private = on;
+	op->o_callback = &cb;
+	op->o_bd = pi->db;
+	op->o_dn = pi->db->be_rootdn;
+	op->o_ndn = pi->db->be_rootndn;
+	op->o_time = slap_get_time();
+
+	ldap_pvt_thread_mutex_lock( &pi->pwdFailureTime_mutex );
+	if ( pi->fstates ) {
+		avl_apply( pi->fstates, ppolicy_fstate_write, op, -1, AVL_INORDER );
+		avl_free( pi->fstates, ppolicy_fstate_free );
+		pi->fstates = NULL;
+	}
+	ldap_pvt_thread_mutex_unlock( &pi->pwdFailureTime_mutex );
+}
+
+static void *
+ppolicy_fstate_task( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	slap_overinst *on = rtask->arg;
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+
+	connection_fake_init( &conn, &opbuf, ctx );
+	op = &opbuf.ob_op;
+	ppolicy_fstate_flush( op, on );
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	return NULL;
+}
+
+static void
+ppolicy_fstate_start( slap_overinst *on )
+{
+	pp_info *pi = on->on_bi.bi_private;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( pi->fstate_task ) {
+		pi->fstate_task->interval.tv_sec = pi->failure_cache;
+	} else {
+		pi->fstate_task = ldap_pvt_runqueue_insert( &slapd_rq,
+			pi->failure_cache, ppolicy_fstate_task, on,
+			"ppolicy_fstate_task", pi->db->be_suffix[0].bv_val );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
+/* Stop the periodic writes and write out what is left */
+static void
+ppolicy_fstate_stop( slap_overinst *on )
+{
+	pp_info *pi = on->on_bi.bi_private;
+	Connection conn = {0};
+	OperationBuffer opbuf;
+
+	if ( pi->fstate_task ) {
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+		if ( ldap_pvt_runqueue_isrunning( &slapd_rq, pi->fstate_task ))
+			ldap_pvt_runqueue_stoptask( &slapd_rq, pi->fstate_task );
+		ldap_pvt_runqueue_remove( &slapd_rq, pi->fstate_task );
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+		pi->fstate_task = NULL;
+	}
+	if ( pi->fstates ) {
+		connection_fake_init2( &conn, &opbuf, ldap_pvt_thread_pool_context(), 0 );
+		ppolicy_fstate_flush( &opbuf.ob_op, on );
+	}
+}
+
 static int
 ppolicy_bind_response( Operation *op, SlapReply *rs )
 {
@@ -1448,7 +1845,11 @@ ppolicy_bind_response( Operation *op, SlapReply *rs )
 	snprintf( timestamp_usec.bv_val + timestamp_usec.bv_len-1, sizeof(".123456Z"), ".%06dZ", now_usec.tt_usec );
 	timestamp_usec.bv_len += STRLENOF(".123456");
 
-	if ( rs->sr_err == LDAP_INVALID_CREDENTIALS && ppb->pp.pwdMaxRecordedFailure ) {
+	if ( rs->sr_err == LDAP_INVALID_CREDENTIALS && ppb->pp.pwdMaxRecordedFailure &&
+			PPOLICY_FCACHE( op, pi ) ) {
+		ppolicy_fstate_failure( pi, &ppb->pp, e, now, &timestamp_usec );
+
+	} else if ( rs->sr_err == LDAP_INVALID_CREDENTIALS && ppb->pp.pwdMaxRecordedFailure ) {
 		int i = 0;
 
 		m = ch_calloc( sizeof(Modifications), 1 );
@@ -1587,7 +1988,17 @@ ppolicy_bind_response( Operation *op, SlapReply *rs )
 			pwtime = parse_time( a->a_nvals[0].bv_val );
 
 		/* delete all pwdFailureTimes */
-		if ( attr_find( e->e_attrs, ad_pwdFailureTime )) {
+		if ( PPOLICY_FCACHE( op, pi ) ) {
+			pp_fstate *pf = ppolicy_fstate_get( pi, &e->e_nname,
+				attr_find( e->e_attrs, ad_pwdFailureTime ) != NULL );
+
+			if ( pf ) {
+				ber_bvarray_free( pf->pf_failures );
+				pf->pf_failures = NULL;
+				pf->pf_nfailures = 0;
+				pf->pf_cleared = now;
+			}
+		} else if ( attr_find( e->e_attrs, ad_pwdFailureTime )) {
 			m = ch_calloc( sizeof(Modifications), 1 );
 			m->sml_op = LDAP_MOD_DELETE;
 			m->sml_flags = 0;
@@ -1722,44 +2133,7 @@ done:
 
 locked:
 	if ( mod && !pi->disable_write ) {
-		Operation op2 = *op;
-		SlapReply r2 = { REP_RESULT };
-		slap_callback cb = { NULL, slap_null_cb, NULL, NULL };
-		LDAPControl c, *ca[2];
-
-		op2.o_tag = LDAP_REQ_MODIFY;
-		op2.o_callback = &cb;
-		op2.orm_modlist = mod;
-		op2.orm_no_opattrs = 0;
-		op2.o_dn = op->o_bd->be_rootdn;
-		op2.o_ndn = op->o_bd->be_rootndn;
-
-		/* If this server is a shadow and forward_updates is true,
-		 * use the frontend to perform this modify. That will trigger
-		 * the update referral, which can then be forwarded by the
-		 * chain overlay. Obviously the updateref and chain overlay
-		 * must be configured appropriately for this to be useful.
-		 */
-		if ( SLAP_SHADOW( op->o_bd ) && pi->forward_updates ) {
-			op2.o_bd = frontendDB;
-
-			/* Must use Relax control since these are no-user-mod */
-			op2.o_relax = SLAP_CONTROL_CRITICAL;
-			op2.o_ctrls = ca;
-			ca[0] = &c;
-			ca[1] = NULL;
-			BER_BVZERO( &c.ldctl_value );
-			c.ldctl_iscritical = 1;
-			c.ldctl_oid = LDAP_CONTROL_RELAX;
-		} else {
-			/* If not forwarding, don't update opattrs and don't replicate */
-			if ( SLAP_SINGLE_SHADOW( op->o_bd )) {
-				op2.orm_no_opattrs = 1;
-				op2.o_dont_replicate = 1;
-			}
-			op2.o_bd->bd_info = (BackendInfo *)on->on_info;
-		}
-		rc = op2.o_bd->be_modify( &op2, &r2 );
+		ppolicy_state_update( op, on, mod );
 	}
 	if ( mod ) {
 		slap_mods_free( mod, 1 );
@@ -1792,6 +2166,7 @@ static int
 ppolicy_bind( Operation *op, SlapReply *rs )
 {
 	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
+	pp_info *pi = on->on_bi.bi_private;
 
 	/* Reset lockout status on all Bind requests */
 	if ( !BER_BVISEMPTY( &pwcons[op->o_conn->c_conn_idx].dn )) {
@@ -1835,6 +2210,9 @@ ppolicy_bind( Operation *op, SlapReply *rs )
 
 		if ( ppolicy_get( op, e, &ppb->pp ) == LDAP_SUCCESS ) {
 			rc = account_locked( op, e, &ppb->pp, &ppb->mod );
+			if ( !rc && PPOLICY_FCACHE( op, pi ) )
+				rc = ppolicy_fstate_locked( pi, &e->e_nname, &ppb->pp,
+					op->o_time );
 		}
 
 		op->o_bd->bd_info = (BackendInfo *)on->on_info;
@@ -2083,6 +2461,7 @@ ppolicy_compare(
 	SlapReply *rs )
 {
 	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
+	pp_info *pi = on->on_bi.bi_private;
 
 	if ( ppolicy_restrict( op, rs ) != SLAP_CB_CONTINUE )
 		return rs->sr_err;
@@ -2123,6 +2502,9 @@ ppolicy_compare(
 
 		if ( ppolicy_get( op, e, &ppb->pp ) == LDAP_SUCCESS ) {
 			rc = account_locked( op, e, &ppb->pp, &ppb->mod );
+			if ( !rc && PPOLICY_FCACHE( op, pi ) )
+				rc = ppolicy_fstate_locked( pi, &e->e_nname, &ppb->pp,
+					op->o_time );
 		}
 
 		op->o_bd->bd_info = (BackendInfo *)on->on_info;
@@ -3112,6 +3494,49 @@ attrNormalize(
 	return code;
 }
 
+static int
+ppolicy_cf_fcache( ConfigArgs *c )
+{
+	slap_overinst *on = (slap_overinst *)c->bi;
+	pp_info *pi = (pp_info *)on->on_bi.bi_private;
+	int rc = 0;
+
+	assert ( c->type == PPOLICY_FAILURE_CACHE );
+
+	switch ( c->op ) {
+	case SLAP_CONFIG_EMIT:
+		c->value_int = pi->failure_cache;
+		break;
+	case LDAP_MOD_DELETE:
+		pi->failure_cache = 0;
+		if ( pi->db )
+			ppolicy_fstate_stop( on );
+		break;
+	case SLAP_CONFIG_ADD:
+		/* fallthru to LDAP_MOD_ADD */
+	case LDAP_MOD_ADD:
+		if ( c->value_int < 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"<%s> invalid interval %d",
+				c->argv[0], c->value_int );
+			Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+			return ARG_BAD_CONF;
+		}
+		pi->failure_cache = c->value_int;
+		if ( pi->db ) {
+			if ( pi->failure_cache )
+				ppolicy_fstate_start( on );
+			else
+				ppolicy_fstate_stop( on );
+		}
+		break;
+	default:
+		abort ();
+	}
+
+	return rc;
+}
+
 static int
 ppolicy_db_init(
 	BackendDB *be,
@@ -3152,12 +3577,24 @@ ppolicy_db_open(
 	ConfigReply *cr
 )
 {
+	slap_overinst *on = (slap_overinst *) be->bd_info;
+	pp_info *pi = on->on_bi.bi_private;
 	int rc;
 
 	if ( (rc = overlay_register_control( be, LDAP_CONTROL_X_ACCOUNT_USABILITY )) != LDAP_SUCCESS ) {
 		return rc;
 	}
-	return overlay_register_control( be, LDAP_CONTROL_PASSWORDPOLICYREQUEST );
+	if ( (rc = overlay_register_control( be, LDAP_CONTROL_PASSWORDPOLICYREQUEST )) != LDAP_SUCCESS ) {
+		return rc;
+	}
+
+	if ( slapMode & SLAP_TOOL_MODE )
+		return 0;
+
+	pi->db = be->bd_self;
+	if ( pi->failure_cache )
+		ppolicy_fstate_start( on );
+	return 0;
 }
 
 static int
@@ -3166,6 +3603,14 @@ ppolicy_db_close(
 	ConfigReply *cr
 )
 {
+	slap_overinst *on = (slap_overinst *) be->bd_info;
+	pp_info *pi = on->on_bi.bi_private;
+
+	if ( pi->db ) {
+		ppolicy_fstate_stop( on );
+		pi->db = NULL;
+	}
+
 #ifdef SLAP_CONFIG_DELETE
 	overlay_unregister_control( be, LDAP_CONTROL_PASSWORDPOLICYREQUEST );
 	overlay_unregister_control( be, LDAP_CONTROL_X_ACCOUNT_USABILITY );
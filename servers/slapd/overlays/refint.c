@@ -84,6 +84,7 @@ typedef struct refint_data_s {
 	BerValue nnothing;			/* normalized nothingness */
 	BerValue refint_dn;			/* modifier's name */
 	BerValue refint_ndn;			/* normalized modifier's name */
+	int subtree_max;			/* max renamed entries looked up by DN */
 	struct re_s *qtask;
 	refint_q *qhead;
 	refint_q *qtail;
@@ -98,12 +99,21 @@ typedef struct refint_pre_s {
 
 #define	RUNQ_INTERVAL	36000	/* a long time */
 
+#define	REFINT_TXN_MAX		256	/* repairs per backend txn */
+
+typedef struct refint_sub_s {
+	BerValue *ndns;
+	int n;
+	int max;
+} refint_sub;
+
 static MatchingRule	*mr_dnSubtreeMatch;
 
 enum {
 	REFINT_ATTRS = 1,
 	REFINT_NOTHING,
-	REFINT_MODIFIERSNAME
+	REFINT_MODIFIERSNAME,
+	REFINT_SUBTREE_LOOKUP
 };
 
 static ConfigDriver refint_cf_gen;
@@ -127,6 +137,12 @@ static ConfigTable refintcfg[] = {
 	  "DESC 'The DN to use as modifiersName' "
 	  "EQUALITY distinguishedNameMatch "
 	  "SYNTAX OMsDN SINGLE-VALUE )", NULL, NULL },
+	{ "refint_subtree_lookup", "max", 2, 2, 0,
+	  ARG_INT|ARG_MAGIC|REFINT_SUBTREE_LOOKUP, refint_cf_gen,
+	  "( OLcfgOvAt:11.4 NAME 'olcRefintSubtreeLookup' "
+	  "DESC 'Max number of renamed entries to look up by their old DN' "
+	  "EQUALITY integerMatch "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -138,6 +154,7 @@ static ConfigOCs refintocs[] = {
 	  "MAY ( olcRefintAttribute "
 		"$ olcRefintNothing "
 		"$ olcRefintModifiersName "
+		"$ olcRefintSubtreeLookup "
 	  ") )",
 	  Cft_Overlay, refintcfg },
 	{ NULL, 0, NULL }
@@ -188,6 +205,10 @@ refint_cf_gen(ConfigArgs *c)
 			}
 			rc = 0;
 			break;
+		case REFINT_SUBTREE_LOOKUP:
+			c->value_int = dd->subtree_max;
+			rc = dd->subtree_max ? 0 : 1;
+			break;
 		default:
 			abort ();
 		}
@@ -232,6 +253,10 @@ refint_cf_gen(ConfigArgs *c)
 			BER_BVZERO( &dd->refint_ndn );
 			rc = 0;
 			break;
+		case REFINT_SUBTREE_LOOKUP:
+			dd->subtree_max = 0;
+			rc = 0;
+			break;
 		default:
 			abort ();
 		}
@@ -282,6 +307,18 @@ refint_cf_gen(ConfigArgs *c)
 				rc = ARG_BAD_CONF;
 			}
 			break;
+		case REFINT_SUBTREE_LOOKUP:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s: must not be negative", c->argv[0] );
+				Debug ( LDAP_DEBUG_CONFIG|LDAP_DEBUG_NONE,
+					"%s: %s\n", c->log, c->cr_msg );
+				rc = ARG_BAD_CONF;
+			} else {
+				dd->subtree_max = c->value_int;
+				rc = 0;
+			}
+			break;
 		default:
 			abort ();
 		}
@@ -572,6 +609,144 @@ refint_search_cb(
 	return(0);
 }
 
+/* Commit the repairs written so far in the txn */
+static void
+refint_txn_commit( Operation *op, OpExtra **txn, int n )
+{
+	int rc;
+
+	LDAP_SLIST_REMOVE( &op->o_extra, *txn, OpExtra, oe_next );
+	rc = op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_COMMIT, txn );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "refint_repair: "
+			"commit of %d repaired entries failed (%d)\n", n, rc );
+	}
+	*txn = NULL;
+}
+
+static int
+refint_subtree_cb(
+	Operation *op,
+	SlapReply *rs
+)
+{
+	refint_sub *sub = op->o_callback->sc_private;
+
+	if ( rs->sr_type == REP_SEARCH && rs->sr_entry ) {
+		if ( sub->n < sub->max )
+			ber_dupbv_x( &sub->ndns[ sub->n ], &rs->sr_entry->e_nname,
+				op->o_tmpmemctx );
+		sub->n++;
+	}
+	return 0;
+}
+
+/*
+** if a renamed subtree is small enough,
+** list the DNs its entries had before the rename, and
+** build (|(attr=olddn)...) for all configured attributes,
+** which can be answered from the attributes' equality indices
+** unlike (attr:dnSubtreeMatch:=olddn);
+** returns NULL if the subtree is too big or can't be listed
+**
+*/
+
+static Filter *
+refint_subtree_filter(
+	Operation *op,
+	refint_data *id,
+	refint_q *rq
+)
+{
+	slap_callback cb = { NULL, refint_subtree_cb, NULL, NULL };
+	SlapReply rs = {REP_RESULT};
+	refint_sub sub;
+	refint_attrs *ip;
+	Filter *f = NULL, *fptr;
+	AttributeAssertion *ava;
+	BerValue rdn, oldndn;
+	int i, rc;
+
+	op->o_bd = select_backend( &rq->newndn, 1 );
+	if ( !op->o_bd || !op->o_bd->be_search )
+		return NULL;
+
+	sub.ndns = op->o_tmpalloc( id->subtree_max * sizeof(BerValue),
+		op->o_tmpmemctx );
+	sub.n = 0;
+	sub.max = id->subtree_max;
+	cb.sc_private	= &sub;
+	op->o_callback	= &cb;
+	op->o_tag	= LDAP_REQ_SEARCH;
+	op->o_req_dn	= rq->newdn;
+	op->o_req_ndn	= rq->newndn;
+	op->o_dn	= op->o_bd->be_rootdn;
+	op->o_ndn	= op->o_bd->be_rootndn;
+	op->ors_scope	= LDAP_SCOPE_SUBTREE;
+	op->ors_deref	= LDAP_DEREF_NEVER;
+	op->ors_limit	= NULL;
+	op->ors_slimit	= id->subtree_max + 1;
+	op->ors_tlimit	= SLAP_NO_LIMIT;
+	op->ors_attrs	= slap_anlist_no_attrs;
+	op->ors_filter	= (Filter *)slap_filter_objectClass_pres;
+	op->ors_filterstr = *slap_filterstr_objectClass_pres;
+
+	rc = op->o_bd->be_search( op, &rs );
+	if ( rc == LDAP_SUCCESS && sub.n > 0 && sub.n <= id->subtree_max ) {
+		f = op->o_tmpcalloc( 1, sizeof(Filter), op->o_tmpmemctx );
+		f->f_choice = LDAP_FILTER_OR;
+		for ( i = 0; i < sub.n; i++ ) {
+			/* the DN below the new one, moved below the old one */
+			rdn = sub.ndns[i];
+			if ( rdn.bv_len > rq->newndn.bv_len ) {
+				rdn.bv_len -= rq->newndn.bv_len + 1;
+				build_new_dn( &oldndn, &rq->oldndn, &rdn, op->o_tmpmemctx );
+			} else {
+				ber_dupbv_x( &oldndn, &rq->oldndn, op->o_tmpmemctx );
+			}
+			for ( ip = id->attrs; ip; ip = ip->next ) {
+				fptr = op->o_tmpcalloc( 1, sizeof(Filter) +
+					sizeof(AttributeAssertion), op->o_tmpmemctx );
+				ava = (AttributeAssertion *)(fptr+1);
+				ava->aa_desc = ip->attr;
+				ava->aa_value = oldndn;
+				fptr->f_choice = LDAP_FILTER_EQUALITY;
+				fptr->f_ava = ava;
+				fptr->f_next = f->f_or;
+				f->f_or = fptr;
+			}
+			op->o_tmpfree( sub.ndns[i].bv_val, op->o_tmpmemctx );
+		}
+	} else {
+		Debug( LDAP_DEBUG_TRACE, "refint_subtree_filter: "
+			"%s: %d entries, using dnSubtreeMatch\n",
+			rq->newdn.bv_val, sub.n );
+		for ( i = 0; i < sub.n && i < id->subtree_max; i++ )
+			op->o_tmpfree( sub.ndns[i].bv_val, op->o_tmpmemctx );
+	}
+	op->o_tmpfree( sub.ndns, op->o_tmpmemctx );
+
+	return f;
+}
+
+static void
+refint_subtree_filter_free(
+	Operation *op,
+	Filter *f
+)
+{
+	Filter *fptr, *f_next;
+
+	/* each value is shared by all the attributes that follow it */
+	for ( fptr = f->f_or; fptr; fptr = f_next ) {
+		f_next = fptr->f_next;
+		if ( !f_next || f_next->f_av_value.bv_val != fptr->f_av_value.bv_val )
+			op->o_tmpfree( fptr->f_av_value.bv_val, op->o_tmpmemctx );
+		op->o_tmpfree( fptr, op->o_tmpmemctx );
+	}
+	op->o_tmpfree( f, op->o_tmpmemctx );
+}
+
 static int
 refint_repair(
 	Operation	*op,
@@ -582,8 +757,9 @@ refint_repair(
 	SlapReply		rs = {REP_RESULT};
 	Operation		op2;
 	unsigned long	opid;
+	OpExtra		*txn = NULL;
 	int		rc;
-	int	cache;
+	int	cache, batch, ntxn = 0;
 
 	op->o_callback->sc_response = refint_search_cb;
 	op->o_req_dn = op->o_bd->be_suffix[ 0 ];
@@ -621,8 +797,16 @@ refint_repair(
 	 *	build Modification* chain;
 	 *	call the backend modify function;
 	 *
+	 * The repairs of the entries of the searched backend are grouped
+	 * in txns of up to REFINT_TXN_MAX modifies, each in a savepoint,
+	 * if the backend supports them and no syncprov or accesslog
+	 * would send or log changes before they get committed.
 	 */
 
+	batch = op->o_bd->bd_info->bi_op_txn &&
+		!overlay_is_inst( op->o_bd, "syncprov" ) &&
+		!overlay_is_inst( op->o_bd, "accesslog" );
+
 	opid = op->o_opid;
 	op2 = *op;
 	for ( dp = rq->attrs; dp; dp = dp->next ) {
@@ -734,18 +918,50 @@ refint_repair(
 
 		op2.o_dn = op2.o_bd->be_rootdn;
 		op2.o_ndn = op2.o_bd->be_rootndn;
+		if ( batch && op2.o_bd == op->o_bd ) {
+			if ( !txn && rq->attrs->next &&
+				op2.o_bd->bd_info->bi_op_txn( &op2, SLAP_TXN_BEGIN, &txn ))
+			{
+				if ( txn ) {
+					LDAP_SLIST_REMOVE( &op2.o_extra, txn, OpExtra, oe_next );
+					op2.o_tmpfree( txn, op2.o_tmpmemctx );
+					txn = NULL;
+				}
+				batch = 0;
+			}
+			if ( txn &&
+				op2.o_bd->bd_info->bi_op_txn( &op2, SLAP_TXN_SAVEPOINT, &txn ))
+			{
+				Debug( LDAP_DEBUG_TRACE, "refint_repair: "
+					"backend can't nest txns, repairing entries one by one\n" );
+				refint_txn_commit( &op2, &txn, ntxn );
+				batch = 0;
+			}
+		}
 		rc = op2.o_bd->be_modify( &op2, &rs2 );
 		if ( rc != LDAP_SUCCESS ) {
 			Debug( LDAP_DEBUG_TRACE,
 				"refint_repair: dependent modify failed: %d\n",
 				rs2.sr_err );
 		}
+		if ( txn && op2.o_bd == op->o_bd ) {
+			op2.o_bd->bd_info->bi_op_txn( &op2, rs2.sr_err == LDAP_SUCCESS ?
+				SLAP_TXN_RELEASE : SLAP_TXN_ROLLBACK, &txn );
+			if ( ++ntxn >= REFINT_TXN_MAX ) {
+				refint_txn_commit( &op2, &txn, ntxn );
+				ntxn = 0;
+			}
+		}
 
 		while ( ( m = op2.orm_modlist ) ) {
 			op2.orm_modlist = m->sml_next;
 			op2.o_tmpfree( m, op2.o_tmpmemctx );
 		}
 	}
+	if ( txn ) {
+		op2.o_bd = op->o_bd;
+		refint_txn_commit( &op2, &txn, ntxn );
+	}
 	op2.o_opid = opid;
 
 	return 0;
@@ -760,7 +976,7 @@ refint_qtask( void *ctx, void *arg )
 	OperationBuffer opbuf;
 	Operation *op;
 	slap_callback cb = { NULL, NULL, NULL, NULL };
-	Filter ftop, *fptr;
+	Filter ftop, *fptr, *fsub;
 	refint_q *rq;
 	refint_attrs *ip;
 	int pausing = 0, rc = 0;
@@ -816,6 +1032,12 @@ refint_qtask( void *ctx, void *arg )
 		if ( !rq )
 			break;
 
+		/* A subtree rename can be looked up by the old DNs
+		 * of all its entries, if there aren't too many */
+		fsub = NULL;
+		if ( rq->do_sub && id->subtree_max && !BER_BVISEMPTY( &rq->newndn ))
+			fsub = refint_subtree_filter( op, id, rq );
+
 		for (fptr = ftop.f_or; fptr; fptr = fptr->f_next ) {
 			fptr->f_mr_value = rq->oldndn;
 			/* Use (attr:dnSubtreeMatch:=value) to catch subtree rename
@@ -826,6 +1048,7 @@ refint_qtask( void *ctx, void *arg )
 				fptr->f_choice = LDAP_FILTER_EQUALITY;
 		}
 
+		op->ors_filter = fsub ? fsub : &ftop;
 		filter2bv_x( op, op->ors_filter, &op->ors_filterstr );
 
 		/* callback gets the searched dn instead */
@@ -879,6 +1102,8 @@ refint_qtask( void *ctx, void *arg )
 			op->o_tmpfree( dp, op->o_tmpmemctx );
 		}
 		op->o_tmpfree( op->ors_filterstr.bv_val, op->o_tmpmemctx );
+		if ( fsub )
+			refint_subtree_filter_free( op, fsub );
 		if ( rc == LDAP_BUSY ) {
 			pausing = 1;
 			/* re-queue this op */
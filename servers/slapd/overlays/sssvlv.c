@@ -95,12 +95,43 @@ typedef struct sort_node
 	struct berval *sn_vals;
 } sort_node;
 
+typedef struct view_node
+{
+	struct berval vn_dn;
+	struct berval vn_val;	/* value of the first sort key */
+} view_node;
+
+/* A sorted result set shared by all the connections, for answering
+ * VLV requests by the same identity with the same search parameters
+ * and sort keys without searching and sorting again. Any write at or
+ * below its base, or above it, discards it.
+ */
+typedef struct sort_view
+{
+	struct sort_view *sv_next;
+	struct berval sv_ndn;
+	struct berval sv_base;
+	int sv_scope;
+	int sv_deref;
+	struct berval sv_filter;
+	sort_ctrl *sv_ctrl;
+	int sv_nentries;
+	view_node *sv_nodes;	/* in sort order */
+	unsigned long sv_id;
+} sort_view;
+
 typedef struct sssvlv_info
 {
 	int svi_max;	/* max concurrent sorts */
 	int svi_num;	/* current # sorts */
 	int svi_max_keys;	/* max sort keys per request */
 	int svi_max_percon; /* max concurrent sorts per con */
+	int svi_max_views;	/* max cached sorted views */
+	int svi_num_views;	/* current # cached views */
+	sort_view *svi_views;	/* most recently used first */
+	unsigned long svi_view_gen;	/* bumped by every write */
+	unsigned long svi_view_id;
+	ldap_pvt_thread_mutex_t svi_views_mutex;
 } sssvlv_info;
 
 typedef struct sort_op
@@ -117,6 +148,8 @@ typedef struct sort_op
 	int so_session;
 	unsigned long so_vcontext;
 	int so_running;
+	SortedSearch *so_sorted;	/* offered to the backend */
+	unsigned long so_view_gen;	/* writes seen when the search began */
 } sort_op;
 
 /* There is only one conn table for all overlay instances */
@@ -441,6 +474,157 @@ static void free_sort_ops( Connection *conn, sort_op **sos, int svi_max_percon )
 	}
 }
 	
+static void free_sort_view( sort_view *sv )
+{
+	int i;
+
+	for ( i=0; i<sv->sv_nentries; i++ )
+		ch_free( sv->sv_nodes[i].vn_dn.bv_val );
+	ch_free( sv->sv_nodes );
+	ch_free( sv->sv_ndn.bv_val );
+	ch_free( sv->sv_base.bv_val );
+	ch_free( sv->sv_filter.bv_val );
+	ch_free( sv->sv_ctrl );
+	ch_free( sv );
+}
+
+static void free_sort_views( sssvlv_info *si, int keep )
+{
+	sort_view *sv, **svp;
+	int i;
+
+	for ( i=0, svp = &si->svi_views; (sv = *svp); i++ ) {
+		if ( i < keep ) {
+			svp = &sv->sv_next;
+		} else {
+			*svp = sv->sv_next;
+			free_sort_view( sv );
+			si->svi_num_views--;
+		}
+	}
+}
+
+static int sort_view_match(
+	sort_view		*sv,
+	Operation		*op,
+	sort_ctrl		*sc )
+{
+	int i;
+
+	if ( sv->sv_scope != op->ors_scope || sv->sv_deref != op->ors_deref ||
+		sv->sv_ctrl->sc_nkeys != sc->sc_nkeys ||
+		!bvmatch( &sv->sv_filter, &op->ors_filterstr ) ||
+		!dn_match( &sv->sv_base, &op->o_req_ndn ) ||
+		!dn_match( &sv->sv_ndn, &op->o_ndn ))
+		return 0;
+
+	for ( i=0; i<sc->sc_nkeys; i++ ) {
+		if ( sv->sv_ctrl->sc_keys[i].sk_ad != sc->sc_keys[i].sk_ad ||
+			sv->sv_ctrl->sc_keys[i].sk_ordering != sc->sc_keys[i].sk_ordering ||
+			sv->sv_ctrl->sc_keys[i].sk_direction != sc->sc_keys[i].sk_direction )
+			return 0;
+	}
+	return 1;
+}
+
+/* Keep the sorted result of a VLV search for later requests */
+static void cache_sort_view(
+	Operation		*op,
+	sort_op			*so )
+{
+	sssvlv_info *si = so->so_info;
+	sort_ctrl *sc = so->so_ctrl;
+	sort_view *sv, **svp;
+	TAvlnode *cur_node;
+	size_t len;
+	int i;
+
+	if ( !si->svi_max_views || !so->so_tree || !so->so_nentries )
+		return;
+	if ( !acl_by_identity( op->o_bd->bd_self ))
+		return;
+
+	sv = ch_calloc( 1, sizeof(sort_view) );
+	ber_dupbv( &sv->sv_ndn, &op->o_ndn );
+	ber_dupbv( &sv->sv_base, &op->o_req_ndn );
+	ber_dupbv( &sv->sv_filter, &op->ors_filterstr );
+	sv->sv_scope = op->ors_scope;
+	sv->sv_deref = op->ors_deref;
+	len = sizeof(sort_ctrl) + (sc->sc_nkeys-1) * sizeof(sort_key);
+	sv->sv_ctrl = ch_malloc( len );
+	AC_MEMCPY( sv->sv_ctrl, sc, len );
+
+	sv->sv_nodes = ch_malloc( so->so_nentries * sizeof(view_node) );
+	for ( i=0, cur_node = tavl_end( so->so_tree, TAVL_DIR_LEFT );
+		cur_node && i<so->so_nentries;
+		cur_node = tavl_next( cur_node, TAVL_DIR_RIGHT ), i++ ) {
+		sort_node *sn = cur_node->avl_data;
+		view_node *vn = &sv->sv_nodes[i];
+		char *ptr;
+
+		ptr = ch_malloc( sn->sn_dn.bv_len + sn->sn_vals[0].bv_len + 2 );
+		vn->vn_dn.bv_val = ptr;
+		vn->vn_dn.bv_len = sn->sn_dn.bv_len;
+		AC_MEMCPY( ptr, sn->sn_dn.bv_val, sn->sn_dn.bv_len );
+		ptr += sn->sn_dn.bv_len;
+		*ptr++ = '\0';
+		if ( BER_BVISNULL( &sn->sn_vals[0] )) {
+			BER_BVZERO( &vn->vn_val );
+		} else {
+			vn->vn_val.bv_val = ptr;
+			vn->vn_val.bv_len = sn->sn_vals[0].bv_len;
+			AC_MEMCPY( ptr, sn->sn_vals[0].bv_val, sn->sn_vals[0].bv_len );
+			ptr[sn->sn_vals[0].bv_len] = '\0';
+		}
+	}
+	sv->sv_nentries = i;
+
+	ldap_pvt_thread_mutex_lock( &si->svi_views_mutex );
+	/* entries may have changed while we were searching */
+	if ( so->so_view_gen != si->svi_view_gen || !si->svi_max_views ) {
+		ldap_pvt_thread_mutex_unlock( &si->svi_views_mutex );
+		free_sort_view( sv );
+		return;
+	}
+	for ( svp = &si->svi_views; *svp; svp = &(*svp)->sv_next ) {
+		if ( sort_view_match( *svp, op, sc )) {
+			sort_view *old = *svp;
+			*svp = old->sv_next;
+			free_sort_view( old );
+			si->svi_num_views--;
+			break;
+		}
+	}
+	sv->sv_id = ++si->svi_view_id;
+	sv->sv_next = si->svi_views;
+	si->svi_views = sv;
+	si->svi_num_views++;
+	free_sort_views( si, si->svi_max_views );
+	ldap_pvt_thread_mutex_unlock( &si->svi_views_mutex );
+}
+
+/* Discard the views that a write to ndn may affect */
+static void expire_sort_views(
+	sssvlv_info		*si,
+	struct berval	*ndn )
+{
+	sort_view *sv, **svp;
+
+	ldap_pvt_thread_mutex_lock( &si->svi_views_mutex );
+	si->svi_view_gen++;
+	for ( svp = &si->svi_views; (sv = *svp); ) {
+		if ( dnIsSuffix( ndn, &sv->sv_base ) ||
+			dnIsSuffix( &sv->sv_base, ndn )) {
+			*svp = sv->sv_next;
+			free_sort_view( sv );
+			si->svi_num_views--;
+		} else {
+			svp = &sv->sv_next;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &si->svi_views_mutex );
+}
+
 static void send_list(
 	Operation		*op,
 	SlapReply		*rs,
@@ -714,6 +898,161 @@ static void send_result(
 	}
 }
 
+/* Answer a VLV request from a cached view, if there is one.
+ * Returns LDAP_SUCCESS if the request was answered.
+ */
+static int send_view_list(
+	Operation		*op,
+	SlapReply		*rs,
+	sssvlv_info		*si,
+	sort_ctrl		*sc,
+	vlv_ctrl		*vc )
+{
+	sort_view *sv, **svp;
+	sort_op so;
+	struct berval *dns, bv;
+	BackendDB *be;
+	Entry *e;
+	int i, j, n, target, rc;
+
+	/* the set was built with another operation's access */
+	if ( !si->svi_max_views || !acl_by_identity( op->o_bd->bd_self ))
+		return -1;
+
+	BER_BVZERO( &bv );
+	if ( !BER_BVISNULL( &vc->vc_value )) {
+		MatchingRule *mr = sc->sc_keys[0].sk_ordering;
+
+		if ( mr->smr_normalize ) {
+			/* let the regular path report the error */
+			if ( mr->smr_normalize( SLAP_MR_VALUE_OF_SYNTAX,
+				mr->smr_syntax, mr, &vc->vc_value, &bv, op->o_tmpmemctx ))
+				return -1;
+		} else {
+			bv = vc->vc_value;
+		}
+	}
+
+	dns = NULL;
+	ldap_pvt_thread_mutex_lock( &si->svi_views_mutex );
+	for ( svp = &si->svi_views; (sv = *svp); svp = &sv->sv_next ) {
+		if ( sort_view_match( sv, op, sc ))
+			break;
+	}
+	if ( !sv )
+		goto done;
+	n = sv->sv_nentries;
+
+	/* Find the target, as send_list() does on the sorted tree */
+	if ( BER_BVISNULL( &vc->vc_value )) {
+		if ( vc->vc_offset == vc->vc_count ) {
+			target = n;
+		} else if ( vc->vc_offset == 1 ) {
+			target = 1;
+		} else if ( vc->vc_count && vc->vc_count != n ) {
+			if ( vc->vc_offset > vc->vc_count )
+				goto done;
+			target = n * vc->vc_offset / vc->vc_count;
+		} else {
+			if ( vc->vc_offset > n )
+				goto done;
+			target = vc->vc_offset;
+		}
+		i = target > 1 ? target - 1 : 0;
+	} else {
+		MatchingRule *mr = sc->sc_keys[0].sk_ordering;
+		int dir = sc->sc_keys[0].sk_direction, lo = 0, hi = n, cmp;
+
+		/* first entry at or after the value; entries without
+		 * a value for the key come last */
+		while ( lo < hi ) {
+			j = ( lo + hi ) / 2;
+			if ( BER_BVISNULL( &sv->sv_nodes[j].vn_val )) {
+				cmp = 1;
+			} else {
+				mr->smr_match( &cmp, 0, mr->smr_syntax, mr,
+					&sv->sv_nodes[j].vn_val, &bv );
+				cmp *= dir;
+			}
+			if ( cmp >= 0 )
+				hi = j;
+			else
+				lo = j + 1;
+		}
+		target = lo + 1;
+		i = lo;
+	}
+
+	/* past the end, the window ends at the last entry */
+	j = 0;
+	if ( i >= n ) {
+		i = n - 1;
+		j = 1;
+	}
+	for ( ; j<vc->vc_before && i > 0; j++ )
+		i--;
+	j += vc->vc_after + 1;
+	if ( j > n - i )
+		j = n - i;
+
+	dns = op->o_tmpalloc( ( j + 1 ) * sizeof(struct berval), op->o_tmpmemctx );
+	for ( rc=0; rc<j; rc++ )
+		ber_dupbv_x( &dns[rc], &sv->sv_nodes[i + rc].vn_dn, op->o_tmpmemctx );
+	BER_BVZERO( &dns[j] );
+
+	memset( &so, 0, sizeof(so) );
+	so.so_info = si;
+	so.so_ctrl = sc;
+	so.so_vlv = op->o_ctrlflag[vlv_cid];
+	so.so_vlv_rc = LDAP_SUCCESS;
+	so.so_vlv_target = target;
+	so.so_nentries = n;
+	so.so_vcontext = sv->sv_id;
+	so.so_session = -1;
+
+	/* most recently used first */
+	*svp = sv->sv_next;
+	sv->sv_next = si->svi_views;
+	si->svi_views = sv;
+done:
+	ldap_pvt_thread_mutex_unlock( &si->svi_views_mutex );
+
+	if ( !BER_BVISNULL( &vc->vc_value ) && bv.bv_val != vc->vc_value.bv_val )
+		op->o_tmpfree( bv.bv_val, op->o_tmpmemctx );
+
+	if ( !dns )
+		return -1;
+
+	Debug(LDAP_DEBUG_TRACE, "%s: VLV request answered from view %lu\n",
+		debug_header, so.so_vcontext );
+
+	rs->sr_attrs = op->ors_attrs;
+	rs->sr_err = LDAP_SUCCESS;
+	be = op->o_bd;
+	for ( i=0; !BER_BVISNULL( &dns[i] ); i++ ) {
+		if ( slapd_shutdown ) break;
+
+		op->o_bd = select_backend( &dns[i], 0 );
+		e = NULL;
+		rc = be_entry_get_rw( op, &dns[i], NULL, NULL, 0, &e );
+
+		if ( e && rc == LDAP_SUCCESS ) {
+			rs->sr_entry = e;
+			rs->sr_flags = REP_ENTRY_MUSTRELEASE;
+			rs->sr_err = send_search_entry( op, rs );
+			if ( rs->sr_err == LDAP_UNAVAILABLE )
+				break;
+		}
+	}
+	op->o_bd = be;
+	for ( i=0; !BER_BVISNULL( &dns[i] ); i++ )
+		op->o_tmpfree( dns[i].bv_val, op->o_tmpmemctx );
+	op->o_tmpfree( dns, op->o_tmpmemctx );
+
+	send_result( op, rs, &so );
+	return LDAP_SUCCESS;
+}
+
 static int sssvlv_op_response(
 	Operation	*op,
 	SlapReply	*rs )
@@ -721,6 +1060,12 @@ static int sssvlv_op_response(
 	sort_ctrl *sc = op->o_controls[sss_cid];
 	sort_op *so = op->o_callback->sc_private;
 
+	if ( so->so_sorted && so->so_sorted->ss_sorted &&
+		rs->sr_type != REP_RESULT ) {
+		/* the backend sends the window in order itself */
+		return SLAP_CB_CONTINUE;
+	}
+
 	if ( rs->sr_type == REP_SEARCH ) {
 		int i;
 		size_t len;
@@ -787,6 +1132,9 @@ static int sssvlv_op_response(
 		rs->sr_err = LDAP_SUCCESS;
 	}
 	else if ( rs->sr_type == REP_RESULT ) {
+		SortedSearch *ss = so->so_sorted;
+		int sorted = 0;
+
 		/* Remove serversort response callback.
 		 * We don't want the entries that we are about to send to be
 		 * processed by serversort response again.
@@ -795,7 +1143,31 @@ static int sssvlv_op_response(
 			op->o_callback = op->o_callback->sc_next;
 		}
 
-		send_entry( op, rs, so );
+		if ( ss ) {
+			LDAP_SLIST_REMOVE( &op->o_extra, &ss->ss_oe, OpExtra, oe_next );
+			so->so_sorted = NULL;
+			sorted = ss->ss_sorted;
+			if ( sorted ) {
+				/* nothing is kept for continuing the search */
+				so->so_vlv_rc = ss->ss_vlv_rc;
+				so->so_vlv_target = ss->ss_vlv_target;
+				so->so_nentries = ss->ss_vlv_count;
+				so->so_vcontext = 0;
+			}
+			op->o_tmpfree( ss, op->o_tmpmemctx );
+		}
+
+		if ( !sorted ) {
+			if ( so->so_vlv > SLAP_CONTROL_IGNORED &&
+				rs->sr_err == LDAP_SUCCESS )
+				cache_sort_view( op, so );
+			send_entry( op, rs, so );
+		} else if ( so->so_vlv_rc != LDAP_SUCCESS ) {
+			LDAPControl *ctrls[2];
+			pack_vlv_response_control( op, rs, so, ctrls );
+			ctrls[1] = NULL;
+			slap_add_ctrls( op, rs, ctrls );
+		}
 		send_result( op, rs, so );
 	}
 
@@ -860,6 +1232,14 @@ static int sssvlv_op_search(
 		goto leave;
 	}
 
+	/* A cached view may answer without searching at all */
+	if ( vc && si->svi_max_views ) {
+		if ( !op->ors_limit && limits_check( op, rs ))
+			return rs->sr_err;
+		if ( send_view_list( op, rs, si, sc, vc ) == LDAP_SUCCESS )
+			return LDAP_SUCCESS;
+	}
+
 	ok = 1;
 	ldap_pvt_thread_mutex_lock( &sort_conns_mutex );
 	/* Is there already a sort running on this conn? */
@@ -969,6 +1349,30 @@ static int sssvlv_op_search(
 			so->so_vcontext = (unsigned long)so;
 			so->so_nentries = 0;
 			so->so_running = 1;
+			if ( vc && si->svi_max_views ) {
+				ldap_pvt_thread_mutex_lock( &si->svi_views_mutex );
+				so->so_view_gen = si->svi_view_gen;
+				ldap_pvt_thread_mutex_unlock( &si->svi_views_mutex );
+			}
+
+			/* The backend may be able to return the window from an
+			 * ordered index, instead of us sorting all the entries
+			 */
+			if ( vc && sc->sc_nkeys == 1 &&
+				sc->sc_keys[0].sk_direction == 1 ) {
+				SortedSearch *ss = op->o_tmpcalloc( 1,
+					sizeof(SortedSearch), op->o_tmpmemctx );
+				ss->ss_oe.oe_key = (void *)slap_sorted_search;
+				ss->ss_ad = sc->sc_keys[0].sk_ad;
+				ss->ss_ordering = sc->sc_keys[0].sk_ordering;
+				ss->ss_before = vc->vc_before;
+				ss->ss_after = vc->vc_after;
+				ss->ss_offset = vc->vc_offset;
+				ss->ss_count = vc->vc_count;
+				ss->ss_value = vc->vc_value;
+				LDAP_SLIST_INSERT_HEAD( &op->o_extra, &ss->ss_oe, oe_next );
+				so->so_sorted = ss;
+			}
 
 			op->o_callback		= cb;
 		}
@@ -987,6 +1391,53 @@ leave:
 	return rc;
 }
 
+static int sssvlv_write_response(
+	Operation	*op,
+	SlapReply	*rs )
+{
+	sssvlv_info *si = op->o_callback->sc_private;
+
+	if ( rs->sr_type == REP_RESULT && rs->sr_err == LDAP_SUCCESS ) {
+		expire_sort_views( si, &op->o_req_ndn );
+		if ( op->o_tag == LDAP_REQ_MODRDN && op->orr_nnewSup )
+			expire_sort_views( si, op->orr_nnewSup );
+	}
+	return SLAP_CB_CONTINUE;
+}
+
+static int sssvlv_write_cleanup(
+	Operation	*op,
+	SlapReply	*rs )
+{
+	slap_callback *sc = op->o_callback;
+
+	op->o_callback = sc->sc_next;
+	op->o_tmpfree( sc, op->o_tmpmemctx );
+	return 0;
+}
+
+/* Writes discard the cached views they may affect */
+static int sssvlv_op_write(
+	Operation	*op,
+	SlapReply	*rs )
+{
+	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
+	sssvlv_info *si = on->on_bi.bi_private;
+	slap_callback *cb;
+
+	if ( !si->svi_max_views )
+		return SLAP_CB_CONTINUE;
+
+	cb = op->o_tmpcalloc( 1, sizeof(slap_callback), op->o_tmpmemctx );
+	cb->sc_response = sssvlv_write_response;
+	cb->sc_cleanup = sssvlv_write_cleanup;
+	cb->sc_private = si;
+	cb->sc_next = op->o_callback;
+	op->o_callback = cb;
+
+	return SLAP_CB_CONTINUE;
+}
+
 static int get_ordering_rule(
 	AttributeDescription	*ad,
 	struct berval			*matchrule,
@@ -1278,6 +1729,35 @@ static int sssvlv_db_open(
 	return rc;
 }
 
+static int sssvlv_cf_maxviews( ConfigArgs *c )
+{
+	slap_overinst *on = (slap_overinst *)c->bi;
+	sssvlv_info *si = on->on_bi.bi_private;
+
+	switch ( c->op ) {
+	case SLAP_CONFIG_EMIT:
+		c->value_int = si->svi_max_views;
+		return 0;
+	case LDAP_MOD_DELETE:
+		c->value_int = 0;
+		break;
+	default:
+		if ( c->value_int < 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"<%s> invalid value %d", c->argv[0], c->value_int );
+			Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+			return 1;
+		}
+		break;
+	}
+
+	ldap_pvt_thread_mutex_lock( &si->svi_views_mutex );
+	si->svi_max_views = c->value_int;
+	free_sort_views( si, si->svi_max_views );
+	ldap_pvt_thread_mutex_unlock( &si->svi_views_mutex );
+	return 0;
+}
+
 static ConfigTable sssvlv_cfg[] = {
 	{ "sssvlv-max", "num",
 		2, 2, 0, ARG_INT|ARG_OFFSET,
@@ -1300,6 +1780,13 @@ static ConfigTable sssvlv_cfg[] = {
 			"DESC 'Maximum number of concurrent paged search requests per connection' "
 			"EQUALITY integerMatch "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "sssvlv-maxviews", "num",
+		2, 2, 0, ARG_INT|ARG_MAGIC,
+			sssvlv_cf_maxviews,
+		"( OLcfgOvAt:21.4 NAME 'olcSssVlvMaxViews' "
+			"DESC 'Maximum number of sorted views kept for VLV requests' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -1308,7 +1795,8 @@ static ConfigOCs sssvlv_ocs[] = {
 		"NAME 'olcSssVlvConfig' "
 		"DESC 'SSS VLV configuration' "
 		"SUP olcOverlayConfig "
-		"MAY ( olcSssVlvMax $ olcSssVlvMaxKeys $ olcSssVlvMaxPerConn ) )",
+		"MAY ( olcSssVlvMax $ olcSssVlvMaxKeys $ olcSssVlvMaxPerConn $ "
+			"olcSssVlvMaxViews ) )",
 		Cft_Overlay, sssvlv_cfg, NULL, NULL },
 	{ NULL, 0, NULL }
 };
@@ -1359,6 +1847,12 @@ static int sssvlv_db_init(
 	si->svi_num = 0;
 	si->svi_max_keys = SSSVLV_DEFAULT_MAX_KEYS;
 	si->svi_max_percon = SSSVLV_DEFAULT_MAX_REQUEST_PER_CONN;
+	si->svi_max_views = 0;
+	si->svi_num_views = 0;
+	si->svi_views = NULL;
+	si->svi_view_gen = 0;
+	si->svi_view_id = 0;
+	ldap_pvt_thread_mutex_init( &si->svi_views_mutex );
 
 	ov_count++;
 
@@ -1393,6 +1887,8 @@ static int sssvlv_db_destroy(
 #endif /* SLAP_CONFIG_DELETE */
 
 	if ( si ) {
+		free_sort_views( si, 0 );
+		ldap_pvt_thread_mutex_destroy( &si->svi_views_mutex );
 		ch_free( si );
 		on->on_bi.bi_private = NULL;
 	}
@@ -1412,6 +1908,10 @@ int sssvlv_initialize()
 	sssvlv.on_bi.bi_db_open				= sssvlv_db_open;
 	sssvlv.on_bi.bi_connection_destroy	= sssvlv_connection_destroy;
 	sssvlv.on_bi.bi_op_search			= sssvlv_op_search;
+	sssvlv.on_bi.bi_op_add				= sssvlv_op_write;
+	sssvlv.on_bi.bi_op_delete			= sssvlv_op_write;
+	sssvlv.on_bi.bi_op_modify			= sssvlv_op_write;
+	sssvlv.on_bi.bi_op_modrdn			= sssvlv_op_write;
 
 	sssvlv.on_bi.bi_cf_ocs = sssvlv_ocs;
 
@@ -28,10 +28,17 @@
 #include "config.h"
 #include "ldap_rq.h"
 
+#include "../back-monitor/back-monitor.h"
+
 #ifdef LDAP_DEVEL
 #define	CHECK_CSN	1
 #endif
 
+/*
+ * Monitoring
+ */
+#define SYNCPROV_MONITOR
+
 /* A modify request on a particular entry */
 typedef struct modinst {
 	struct modinst *mi_next;
@@ -43,6 +50,7 @@ typedef struct modtarget {
 	struct modinst *mt_tail;
 	struct berval mt_dn;
 	ldap_pvt_thread_mutex_t mt_mutex;
+	IAvlnode mt_node;
 } modtarget;
 
 /* All the info of a psearch result that's shared between
@@ -63,9 +71,12 @@ typedef struct resinfo {
 /* A queued result of a persistent search */
 typedef struct syncres {
 	struct syncres *s_next;	/* list of results on this psearch queue */
+	struct syncres *s_prev;
 	struct syncres *s_rilist;	/* list of psearches using this result */
 	resinfo *s_info;
+	IAvlnode s_node;	/* in s_pending, by entryUUID */
 	char s_mode;
+	char s_pending;		/* linked into s_pending */
 } syncres;
 
 /* Record of a persistent search */
@@ -84,12 +95,17 @@ typedef struct syncops {
 #define	PS_WROTE_BASE		0x04
 #define	PS_FIND_BASE		0x08
 #define	PS_FIX_FILTER		0x10
-#define	PS_TASK_QUEUED		0x20
+#define	PS_TASK_QUEUED		0x20	/* handed to the senders */
+#define	PS_OVERFLOW		0x40	/* queue limit hit, refresh required */
 
 	int		s_inuse;	/* reference count */
 	struct syncres *s_res;
 	struct syncres *s_restail;
-	void *s_pool_cookie;
+	IAvltree	s_pending;	/* queued entry changes, by entryUUID */
+	int		s_qlen;		/* responses queued on s_res */
+	int		s_qmax;		/* largest s_qlen seen */
+	unsigned long	s_coalesced;	/* queued responses superseded */
+	struct syncops *s_qnext;	/* on si_ready or si_parked */
 	ldap_pvt_thread_mutex_t	s_mutex;
 } syncops;
 
@@ -118,22 +134,25 @@ typedef struct syncmatches {
 
 /* Session log data */
 typedef struct slog_entry {
-	struct slog_entry *se_next;
 	struct berval se_uuid;
 	struct berval se_csn;
 	int	se_sid;
 	ber_tag_t	se_tag;
 } slog_entry;
 
+/* The first three fields must match struct sync_cookie,
+ * see slap_insert_csn_sids().
+ */
 typedef struct sessionlog {
 	BerVarray	sl_mincsn;
 	int		*sl_sids;
 	int		sl_numcsns;
 	int		sl_num;
 	int		sl_size;
-	int		sl_playing;
-	slog_entry *sl_head;
-	slog_entry *sl_tail;
+	TAvlnode	*sl_entries;	/* slog_entries in csn order */
+	int		*sl_esids;	/* SIDs of the logged entries */
+	int		*sl_ecounts;	/* and how many each has */
+	int		sl_numesids;
 	ldap_pvt_thread_mutex_t sl_mutex;
 } sessionlog;
 
@@ -167,12 +186,29 @@ typedef struct syncprov_info_t {
 	int		si_dirty;	/* True if the context is dirty, i.e changes
 						 * have been made without updating the csn. */
 	time_t	si_chklast;	/* time of last checkpoint */
-	Avlnode	*si_mods;	/* entries being modified */
+	IAvltree	si_mods;	/* entries being modified */
 	sessionlog	*si_logs;
 	ldap_pvt_thread_rdwr_t	si_csn_rwlock;
 	ldap_pvt_thread_mutex_t	si_ops_mutex;
 	ldap_pvt_thread_mutex_t	si_mods_mutex;
 	ldap_pvt_thread_mutex_t	si_resp_mutex;
+
+	/* Queued responses are written by at most si_senders pool tasks
+	 * shared by all psearches, see syncprov_sender().
+	 */
+	int		si_senders;
+	int		si_qlimit;	/* max responses queued per psearch */
+	int		si_nocoalesce;	/* queue every change, superseded or not */
+	int		si_nsenders;	/* sender tasks submitted */
+	int		si_polling;	/* a sender waits on si_parked */
+	int		si_nparked;
+	syncops		*si_ready, *si_readytail;	/* psearches to serve */
+	syncops		*si_parked, *si_parkedtail;	/* waiting for their socket */
+	ldap_pvt_thread_mutex_t	si_send_mutex;
+#ifdef SYNCPROV_MONITOR
+	void		*si_monitor_cb;
+	struct berval	si_monitor_ndn;
+#endif /* SYNCPROV_MONITOR */
 } syncprov_info_t;
 
 typedef struct opcookie {
@@ -976,25 +1012,49 @@ syncprov_sendresp( Operation *op, resinfo *ri, syncops *so, int mode )
 	return rs.sr_err;
 }
 
-static void
-syncprov_qstart( syncops *so );
+static int
+syncprov_drop_psearch( syncops *so, int lock );
+
+static int
+sp_sres_cmp( const void *c1, const void *c2 )
+{
+	const syncres *r1 = c1, *r2 = c2;
+
+	return ber_bvcmp( &r1->s_info->ri_uuid, &r2->s_info->ri_uuid );
+}
+
+/* Default number of sender tasks */
+#define SP_SENDERS	4
 
-/* Play back queued responses */
+/* Responses written for one psearch before moving on to the next */
+#define SP_SEND_BATCH	8
+
+/* How long a sender waits for parked psearches at a time */
+#define SP_POLL_MSEC	10
+
+/* Play back up to SP_SEND_BATCH queued responses, or all of them if
+ * the psearch was abandoned. Returns with so->s_mutex held.
+ */
 static int
 syncprov_qplay( Operation *op, syncops *so )
 {
 	syncres *sr;
-	int rc = 0;
+	int rc = 0, n = 0;
 
-	do {
+	for (;;) {
 		ldap_pvt_thread_mutex_lock( &so->s_mutex );
 		sr = so->s_res;
 		/* Exit loop with mutex held */
-		if ( !sr )
+		if ( !sr || rc || n == SP_SEND_BATCH )
 			break;
 		so->s_res = sr->s_next;
-		if ( !so->s_res )
+		if ( so->s_res )
+			so->s_res->s_prev = NULL;
+		else
 			so->s_restail = NULL;
+		if ( sr->s_pending )
+			iavl_remove( &so->s_pending, sr );
+		so->s_qlen--;
 		ldap_pvt_thread_mutex_unlock( &so->s_mutex );
 
 		if ( !so->s_op->o_abandon ) {
@@ -1007,94 +1067,261 @@ syncprov_qplay( Operation *op, syncops *so )
 			} else {
 				rc = syncprov_sendresp( op, sr->s_info, so, sr->s_mode );
 			}
+			n++;
 		}
 
 		free_resinfo( sr );
 		ch_free( sr );
+	}
 
-		if ( so->s_op->o_abandon )
-			continue;
-
-		/* Exit loop with mutex held */
-		ldap_pvt_thread_mutex_lock( &so->s_mutex );
-		break;
+	return rc;
+}
 
-	} while (1);
+/* Append to the senders' work list; si_send_mutex is held */
+static void
+syncprov_qready( syncprov_info_t *si, syncops *so )
+{
+	so->s_qnext = NULL;
+	if ( si->si_readytail )
+		si->si_readytail->s_qnext = so;
+	else
+		si->si_ready = so;
+	si->si_readytail = so;
+}
 
-	/* We now only send one change at a time, to prevent one
-	 * psearch from hogging all the CPU. Resubmit this task if
-	 * there are more responses queued and no errors occurred.
-	 */
+/* Give up on a psearch whose queue outgrew syncprov-queue-limit,
+ * the consumer has to refresh.
+ */
+static void
+syncprov_qoverflow( syncprov_info_t *si, syncops *so )
+{
+	SlapReply rs = { REP_RESULT };
+	syncops **sop;
+	int found = 0;
 
-	if ( rc == 0 && so->s_res ) {
-		syncprov_qstart( so );
+	ldap_pvt_thread_mutex_lock( &si->si_ops_mutex );
+	for ( sop = &si->si_ops; *sop; sop = &(*sop)->s_next ) {
+		if ( *sop == so ) {
+			*sop = so->s_next;
+			found = 1;
+			break;
+		}
 	}
+	ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
+	/* abandoned meanwhile */
+	if ( !found )
+		return;
+
+	Debug( LDAP_DEBUG_SYNC, "%s syncprov_qoverflow: "
+		"more than %d responses queued, refresh required\n",
+		so->s_op->o_log_prefix, si->si_qlimit );
+	send_ldap_error( so->s_op, &rs, LDAP_SYNC_REFRESH_REQUIRED,
+		"too many changes queued" );
+	so->s_op->o_abandon = 1;
+	syncprov_drop_psearch( so, 1 );
+}
 
-	return rc;
+/* Wait a little for any parked psearch to become writable, and put
+ * those that did back on si_ready. Called and returns with
+ * si_send_mutex held.
+ */
+static void
+syncprov_qpoll( syncprov_info_t *si )
+{
+	ber_socket_t *sds;
+	char *ready;
+	syncops *so, **sop, *prev;
+	int i, n = si->si_nparked;
+
+	si->si_polling = 1;
+	sds = ch_malloc( n * ( sizeof( ber_socket_t ) + 1 ));
+	ready = (char *)( sds + n );
+	for ( i = 0, so = si->si_parked; i < n; i++, so = so->s_qnext )
+		sds[i] = so->s_op->o_conn->c_sd;
+	ldap_pvt_thread_mutex_unlock( &si->si_send_mutex );
+
+	if ( slapd_wait_writers( sds, n, ready, SP_POLL_MSEC ) < 0 ) {
+		/* let the writes find out what is wrong */
+		for ( i = 0; i < n; i++ )
+			ready[i] = 1;
+	}
+
+	ldap_pvt_thread_mutex_lock( &si->si_send_mutex );
+	/* only the poller takes psearches off si_parked, so the first n
+	 * are still the ones we waited for
+	 */
+	for ( i = 0, prev = NULL, sop = &si->si_parked; i < n; i++ ) {
+		so = *sop;
+		if ( ready[i] || so->s_op->o_abandon ) {
+			*sop = so->s_qnext;
+			if ( si->si_parkedtail == so )
+				si->si_parkedtail = prev;
+			si->si_nparked--;
+			syncprov_qready( si, so );
+		} else {
+			prev = so;
+			sop = &so->s_qnext;
+		}
+	}
+	si->si_polling = 0;
+	ch_free( sds );
 }
 
-/* task for playing back queued responses */
+/* Task playing back queued responses. Psearches with responses to
+ * send wait on si_ready, and at most si_senders of these tasks serve
+ * all of them: a sender writes a few responses for the first one and
+ * puts it back at the tail, so one busy consumer cannot hold up the
+ * others and a burst of writes doesn't start a task per consumer.
+ * A psearch whose socket is full is parked instead of blocking a
+ * sender, and one sender at a time waits for any of the parked
+ * sockets to drain.
+ */
 static void *
-syncprov_qtask( void *ctx, void *arg )
+syncprov_sender( void *ctx, void *arg )
 {
-	syncops *so = arg;
+	syncprov_info_t *si = arg;
 	OperationBuffer opbuf;
 	Operation *op;
 	BackendDB be;
+	syncops *so;
+	void *memctx;
+	char ready;
 	int rc;
 
-	op = &opbuf.ob_op;
-	*op = *so->s_op;
-	op->o_hdr = &opbuf.ob_hdr;
-	op->o_controls = opbuf.ob_controls;
-	memset( op->o_controls, 0, sizeof(opbuf.ob_controls) );
-	op->o_sync = SLAP_CONTROL_IGNORED;
-
-	*op->o_hdr = *so->s_op->o_hdr;
+	memctx = slap_sl_mem_create( SLAP_SLAB_SIZE, SLAP_SLAB_STACK, ctx, 1 );
+
+	ldap_pvt_thread_mutex_lock( &si->si_send_mutex );
+	for (;;) {
+		if ( ldap_pvt_thread_pool_pausing( &connection_pool ) > 0 ) {
+			/* step aside for the pause, and carry on afterwards */
+			if ( ( si->si_ready || si->si_parked ) &&
+				!ldap_pvt_thread_pool_submit( &connection_pool,
+					syncprov_sender, si ))
+			{
+				ldap_pvt_thread_mutex_unlock( &si->si_send_mutex );
+				return NULL;
+			}
+			break;
+		}
 
-	op->o_tmpmemctx = slap_sl_mem_create(SLAP_SLAB_SIZE, SLAP_SLAB_STACK, ctx, 1);
-	op->o_tmpmfuncs = &slap_sl_mfuncs;
-	op->o_threadctx = ctx;
+		so = si->si_ready;
+		if ( !so ) {
+			if ( si->si_parked && !si->si_polling ) {
+				syncprov_qpoll( si );
+				continue;
+			}
+			break;
+		}
+		si->si_ready = so->s_qnext;
+		if ( !si->si_ready )
+			si->si_readytail = NULL;
+		ldap_pvt_thread_mutex_unlock( &si->si_send_mutex );
 
-	/* syncprov_qplay expects a fake db */
-	be = *so->s_op->o_bd;
-	be.be_flags |= SLAP_DBFLAG_OVERLAY;
-	op->o_bd = &be;
-	LDAP_SLIST_FIRST(&op->o_extra) = NULL;
-	op->o_callback = NULL;
+		if ( so->s_flags & PS_OVERFLOW )
+			syncprov_qoverflow( si, so );
 
-	rc = syncprov_qplay( op, so );
+		if ( !so->s_op->o_abandon &&
+			slapd_wait_writers( &so->s_op->o_conn->c_sd, 1, &ready, 0 ) == 0 )
+		{
+			/* socket full, wait for it along with the others */
+			ldap_pvt_thread_mutex_lock( &si->si_send_mutex );
+			so->s_qnext = NULL;
+			if ( si->si_parkedtail )
+				si->si_parkedtail->s_qnext = so;
+			else
+				si->si_parked = so;
+			si->si_parkedtail = so;
+			si->si_nparked++;
+			continue;
+		}
 
-	/* if an error occurred, or no responses left, task is no longer queued */
-	if ( !rc && !so->s_res )
-		rc = 1;
+		op = &opbuf.ob_op;
+		*op = *so->s_op;
+		op->o_hdr = &opbuf.ob_hdr;
+		op->o_controls = opbuf.ob_controls;
+		memset( op->o_controls, 0, sizeof(opbuf.ob_controls) );
+		op->o_sync = SLAP_CONTROL_IGNORED;
+
+		*op->o_hdr = *so->s_op->o_hdr;
+
+		op->o_tmpmemctx = memctx;
+		op->o_tmpmfuncs = &slap_sl_mfuncs;
+		op->o_threadctx = ctx;
+
+		/* syncprov_qplay expects a fake db */
+		be = *so->s_op->o_bd;
+		be.be_flags |= SLAP_DBFLAG_OVERLAY;
+		op->o_bd = &be;
+		LDAP_SLIST_FIRST(&op->o_extra) = NULL;
+		op->o_callback = NULL;
+
+		rc = syncprov_qplay( op, so );
+
+		/* the overlay was removed while we were writing */
+		if ( !so->s_si ) {
+			if ( !syncprov_free_syncop( so, 0 ))
+				ldap_pvt_thread_mutex_unlock( &so->s_mutex );
+			return NULL;
+		}
+
+		ldap_pvt_thread_mutex_lock( &si->si_send_mutex );
+		if ( !rc && so->s_res && !so->s_op->o_abandon ) {
+			/* more to send, back of the line */
+			syncprov_qready( si, so );
+			ldap_pvt_thread_mutex_unlock( &so->s_mutex );
+			continue;
+		}
+		ldap_pvt_thread_mutex_unlock( &si->si_send_mutex );
 
-	/* decrement use count... */
-	if ( !syncprov_free_syncop( so, FS_UNLINK )) {
-		if ( rc )
-			/* if we didn't unlink, and task is no longer queued, clear flag */
+		/* if an error occurred, or no responses left, we're done
+		 * with this psearch until more responses get queued
+		 */
+		if ( !syncprov_free_syncop( so, FS_UNLINK )) {
 			so->s_flags ^= PS_TASK_QUEUED;
-		ldap_pvt_thread_mutex_unlock( &so->s_mutex );
+			ldap_pvt_thread_mutex_unlock( &so->s_mutex );
+		}
+		ldap_pvt_thread_mutex_lock( &si->si_send_mutex );
 	}
+	si->si_nsenders--;
+	ldap_pvt_thread_mutex_unlock( &si->si_send_mutex );
 
 	return NULL;
 }
 
-/* Start the task to play back queued psearch responses */
+/* Pool walk callback, picks the pending senders of a closing db */
+static int
+syncprov_sender_retract( ldap_pvt_thread_start_t *start, void *arg, void *si )
+{
+	return arg == si;
+}
+
+/* Hand a psearch with responses to send to the senders; so->s_mutex
+ * is held.
+ */
 static void
 syncprov_qstart( syncops *so )
 {
+	syncprov_info_t *si = so->s_si;
+
+	if ( !si )
+		return;
 	so->s_flags |= PS_TASK_QUEUED;
 	so->s_inuse++;
-	ldap_pvt_thread_pool_submit2( &connection_pool,
-		syncprov_qtask, so, &so->s_pool_cookie );
+	ldap_pvt_thread_mutex_lock( &si->si_send_mutex );
+	syncprov_qready( si, so );
+	if ( si->si_nsenders < si->si_senders &&
+		!ldap_pvt_thread_pool_submit( &connection_pool,
+			syncprov_sender, si ))
+		si->si_nsenders++;
+	ldap_pvt_thread_mutex_unlock( &si->si_send_mutex );
 }
 
 /* Queue a persistent search response */
 static int
 syncprov_qresp( opcookie *opc, syncops *so, int mode )
 {
-	syncres *sr;
+	syncprov_info_t	*si = opc->son->on_bi.bi_private;
+	syncres *sr, *old = NULL, *drop = NULL;
 	resinfo *ri;
 	int srsize;
 	struct berval csn = opc->sctxcsn;
@@ -1173,12 +1400,77 @@ syncprov_qresp( opcookie *opc, syncops *so, int mode )
 	ldap_pvt_thread_mutex_unlock( &ri->ri_mutex );
 
 	ldap_pvt_thread_mutex_lock( &so->s_mutex );
+	if ( so->s_flags & PS_OVERFLOW ) {
+		/* the consumer will have to refresh anyway */
+		ldap_pvt_thread_mutex_unlock( &so->s_mutex );
+		free_resinfo( sr );
+		ch_free( sr );
+		return LDAP_SUCCESS;
+	}
+
+	/* A change to an entry supersedes an earlier one still queued,
+	 * except that an entry coming back must not cancel its delete.
+	 * Likewise a new cookie supersedes one queued right before it.
+	 */
+	sr->s_pending = 0;
+	if ( si->si_nocoalesce ) {
+		/* every change is sent */
+	} else if ( mode == LDAP_SYNC_NEW_COOKIE ) {
+		old = so->s_restail;
+		if ( old && old->s_mode == LDAP_SYNC_NEW_COOKIE ) {
+			if ( old->s_prev )
+				old->s_prev->s_next = NULL;
+			else
+				so->s_res = NULL;
+			so->s_restail = old->s_prev;
+			so->s_qlen--;
+			so->s_coalesced++;
+		} else {
+			old = NULL;
+		}
+	} else if ( ri->ri_uuid.bv_len ) {
+		old = iavl_find( &so->s_pending, sr );
+		if ( old ) {
+			iavl_remove( &so->s_pending, old );
+			old->s_pending = 0;
+			if ( old->s_mode == LDAP_SYNC_DELETE ) {
+				old = NULL;
+			} else {
+				if ( old->s_mode == LDAP_SYNC_ADD && mode == LDAP_SYNC_MODIFY )
+					sr->s_mode = LDAP_SYNC_ADD;
+				if ( old->s_prev )
+					old->s_prev->s_next = old->s_next;
+				else
+					so->s_res = old->s_next;
+				if ( old->s_next )
+					old->s_next->s_prev = old->s_prev;
+				else
+					so->s_restail = old->s_prev;
+				so->s_qlen--;
+				so->s_coalesced++;
+			}
+		}
+		iavl_insert( &so->s_pending, sr, avl_dup_error );
+		sr->s_pending = 1;
+	}
+
+	sr->s_prev = so->s_restail;
 	if ( !so->s_res ) {
 		so->s_res = sr;
 	} else {
 		so->s_restail->s_next = sr;
 	}
 	so->s_restail = sr;
+	if ( ++so->s_qlen > so->s_qmax )
+		so->s_qmax = so->s_qlen;
+
+	if ( si->si_qlimit && so->s_qlen > si->si_qlimit ) {
+		so->s_flags |= PS_OVERFLOW;
+		drop = so->s_res;
+		so->s_res = so->s_restail = NULL;
+		so->s_pending.avl_root = NULL;
+		so->s_qlen = 0;
+	}
 
 	/* If the base of the psearch was modified, check it next time round */
 	if ( so->s_flags & PS_WROTE_BASE ) {
@@ -1189,6 +1481,16 @@ syncprov_qresp( opcookie *opc, syncops *so, int mode )
 		syncprov_qstart( so );
 	}
 	ldap_pvt_thread_mutex_unlock( &so->s_mutex );
+
+	if ( old ) {
+		free_resinfo( old );
+		ch_free( old );
+	}
+	for ( ; drop; drop = sr ) {
+		sr = drop->s_next;
+		free_resinfo( drop );
+		ch_free( drop );
+	}
 	return LDAP_SUCCESS;
 }
 
@@ -1200,8 +1502,7 @@ syncprov_drop_psearch( syncops *so, int lock )
 			ldap_pvt_thread_mutex_lock( &so->s_op->o_conn->c_mutex );
 		so->s_op->o_conn->c_n_ops_executing--;
 		so->s_op->o_conn->c_n_ops_completed++;
-		LDAP_STAILQ_REMOVE( &so->s_op->o_conn->c_ops, so->s_op, Operation,
-			o_next );
+		connection_op_remove( so->s_op->o_conn, so->s_op );
 		if ( lock )
 			ldap_pvt_thread_mutex_unlock( &so->s_op->o_conn->c_mutex );
 	}
@@ -1256,6 +1557,29 @@ syncprov_op_abandon( Operation *op, SlapReply *rs )
 	return SLAP_CB_CONTINUE;
 }
 
+/* Filter results already computed in this syncprov_matchops().
+ * The psearch itself may go away meanwhile, so keep copies of
+ * what identifies it.
+ */
+typedef struct syncfmemo {
+	struct syncfmemo *sf_next;
+	struct berval sf_base;
+	struct berval sf_filterstr;
+	struct berval sf_ndn;
+	int sf_scope;
+	int sf_rc;
+} syncfmemo;
+
+/* Whether test_filter() gives the same answer for this psearch */
+static int
+syncprov_same_search( syncfmemo *sf, syncops *ss )
+{
+	return sf->sf_scope == ss->s_op->ors_scope &&
+		bvmatch( &sf->sf_base, &ss->s_base ) &&
+		bvmatch( &sf->sf_filterstr, &ss->s_filterstr ) &&
+		bvmatch( &sf->sf_ndn, &ss->s_op->o_ndn );
+}
+
 /* Find which persistent searches are affected by this operation */
 static void
 syncprov_matchops( Operation *op, opcookie *opc, int saveit )
@@ -1271,6 +1595,8 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 	struct berval newdn;
 	int freefdn = 0;
 	BackendDB *b0 = op->o_bd, db;
+	syncfmemo *memo = NULL, *sf;
+	int share = -1;
 
 	fc.fdn = &op->o_req_ndn;
 	/* compute new DN */
@@ -1397,7 +1723,20 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 			}
 		}
 
+		/* Consumers with the same search see the same result */
+		sf = NULL;
 		if ( fc.fscope ) {
+			if ( share < 0 )
+				share = acl_by_identity( op->o_bd->bd_self );
+			for ( sf = share ? memo : NULL; sf; sf = sf->sf_next ) {
+				if ( syncprov_same_search( sf, ss ))
+					break;
+			}
+			if ( sf )
+				rc = sf->sf_rc;
+		}
+
+		if ( fc.fscope && !sf ) {
 			ldap_pvt_thread_mutex_lock( &ss->s_mutex );
 			op2 = *ss->s_op;
 			oh = *op->o_hdr;
@@ -1415,6 +1754,16 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 			}
 			rc = test_filter( &op2, e, op2.ors_filter );
 			ldap_pvt_thread_mutex_unlock( &ss->s_mutex );
+			if ( share ) {
+				sf = op->o_tmpalloc( sizeof(syncfmemo), op->o_tmpmemctx );
+				ber_dupbv_x( &sf->sf_base, &ss->s_base, op->o_tmpmemctx );
+				ber_dupbv_x( &sf->sf_filterstr, &ss->s_filterstr, op->o_tmpmemctx );
+				ber_dupbv_x( &sf->sf_ndn, &ss->s_op->o_ndn, op->o_tmpmemctx );
+				sf->sf_scope = ss->s_op->ors_scope;
+				sf->sf_rc = rc;
+				sf->sf_next = memo;
+				memo = sf;
+			}
 		}
 
 		Debug( LDAP_DEBUG_TRACE, "%s syncprov_matchops: "
@@ -1455,6 +1804,15 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 	}
 	ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
 
+	while ( memo ) {
+		sf = memo->sf_next;
+		op->o_tmpfree( memo->sf_base.bv_val, op->o_tmpmemctx );
+		op->o_tmpfree( memo->sf_filterstr.bv_val, op->o_tmpmemctx );
+		op->o_tmpfree( memo->sf_ndn.bv_val, op->o_tmpmemctx );
+		op->o_tmpfree( memo, op->o_tmpmemctx );
+		memo = sf;
+	}
+
 	if ( op->o_tag != LDAP_REQ_ADD && e ) {
 		if ( !SLAP_ISOVERLAY( op->o_bd )) {
 			op->o_bd = &db;
@@ -1515,10 +1873,9 @@ syncprov_op_cleanup( Operation *op, SlapReply *rs )
 		} else {
 			ldap_pvt_thread_mutex_unlock( &mt->mt_mutex );
 			ldap_pvt_thread_mutex_lock( &si->si_mods_mutex );
-			avl_delete( &si->si_mods, mt, sp_avl_cmp );
+			iavl_remove( &si->si_mods, mt );
 			ldap_pvt_thread_mutex_unlock( &si->si_mods_mutex );
 			ldap_pvt_thread_mutex_destroy( &mt->mt_mutex );
-			ch_free( mt->mt_dn.bv_val );
 			ch_free( mt );
 		}
 	}
@@ -1610,6 +1967,57 @@ syncprov_checkpoint( Operation *op, slap_overinst *on )
 #endif
 }
 
+/* Order by CSN; equal CSNs are kept apart by address. A search
+ * key (no UUID) sorts before all entries with its CSN.
+ */
+static int
+syncprov_slog_cmp( const void *v1, const void *v2 )
+{
+	const slog_entry *se1 = v1, *se2 = v2;
+	int rc = ber_bvcmp( &se1->se_csn, &se2->se_csn );
+
+	if ( rc == 0 && se1 != se2 ) {
+		if ( !se1->se_uuid.bv_val )
+			rc = -1;
+		else
+			rc = se1 < se2 ? -1 : 1;
+	}
+	return rc;
+}
+
+/* Track how many entries of each SID are in the log */
+static void
+syncprov_slog_count( sessionlog *sl, int sid, int delta )
+{
+	int i;
+
+	for ( i=0; i<sl->sl_numesids; i++ ) {
+		if ( sl->sl_esids[i] == sid ) {
+			sl->sl_ecounts[i] += delta;
+			return;
+		}
+	}
+	assert( delta > 0 );
+	sl->sl_esids = ch_realloc( sl->sl_esids, (i+1) * sizeof(int) );
+	sl->sl_ecounts = ch_realloc( sl->sl_ecounts, (i+1) * sizeof(int) );
+	sl->sl_esids[i] = sid;
+	sl->sl_ecounts[i] = delta;
+	sl->sl_numesids++;
+}
+
+static void
+syncprov_slog_clear( sessionlog *sl )
+{
+	tavl_free( sl->sl_entries, ch_free );
+	sl->sl_entries = NULL;
+	sl->sl_num = 0;
+	ch_free( sl->sl_esids );
+	ch_free( sl->sl_ecounts );
+	sl->sl_esids = NULL;
+	sl->sl_ecounts = NULL;
+	sl->sl_numesids = 0;
+}
+
 static void
 syncprov_add_slog( Operation *op )
 {
@@ -1628,15 +2036,7 @@ syncprov_add_slog( Operation *op )
 			 * wipe out anything in the log if we see them.
 			 */
 			ldap_pvt_thread_mutex_lock( &sl->sl_mutex );
-			/* can only do this if no one else is reading the log at the moment */
-			if (!sl->sl_playing) {
-			while ( (se = sl->sl_head) ) {
-				sl->sl_head = se->se_next;
-				ch_free( se );
-			}
-			sl->sl_tail = NULL;
-			sl->sl_num = 0;
-			}
+			syncprov_slog_clear( sl );
 			ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
 			return;
 		}
@@ -1644,7 +2044,6 @@ syncprov_add_slog( Operation *op )
 		/* Allocate a record. UUIDs are not NUL-terminated. */
 		se = ch_malloc( sizeof( slog_entry ) + opc->suuid.bv_len +
 			op->o_csn.bv_len + 1 );
-		se->se_next = NULL;
 		se->se_tag = op->o_tag;
 
 		se->se_uuid.bv_val = (char *)(&se[1]);
@@ -1669,40 +2068,22 @@ syncprov_add_slog( Operation *op )
 				"adding csn=%s to sessionlog, uuid=%s\n",
 				op->o_log_prefix, se->se_csn.bv_val, uuidstr );
 		}
-		if ( sl->sl_head ) {
-			/* Keep the list in csn order. */
-			if ( ber_bvcmp( &sl->sl_tail->se_csn, &se->se_csn ) <= 0 ) {
-				sl->sl_tail->se_next = se;
-				sl->sl_tail = se;
-			} else {
-				slog_entry **sep;
-
-				for ( sep = &sl->sl_head; *sep; sep = &(*sep)->se_next ) {
-					if ( ber_bvcmp( &se->se_csn, &(*sep)->se_csn ) < 0 ) {
-						se->se_next = *sep;
-						*sep = se;
-						break;
-					}
-				}
-			}
-		} else {
-			sl->sl_head = se;
-			sl->sl_tail = se;
-			if ( !sl->sl_mincsn ) {
-				sl->sl_numcsns = 1;
-				sl->sl_mincsn = ch_malloc( 2*sizeof( struct berval ));
-				sl->sl_sids = ch_malloc( sizeof( int ));
-				sl->sl_sids[0] = se->se_sid;
-				ber_dupbv( sl->sl_mincsn, &se->se_csn );
-				BER_BVZERO( &sl->sl_mincsn[1] );
-			}
+		if ( !sl->sl_entries && !sl->sl_mincsn ) {
+			sl->sl_numcsns = 1;
+			sl->sl_mincsn = ch_malloc( 2*sizeof( struct berval ));
+			sl->sl_sids = ch_malloc( sizeof( int ));
+			sl->sl_sids[0] = se->se_sid;
+			ber_dupbv( sl->sl_mincsn, &se->se_csn );
+			BER_BVZERO( &sl->sl_mincsn[1] );
 		}
+		tavl_insert( &sl->sl_entries, se, syncprov_slog_cmp, avl_dup_error );
+		syncprov_slog_count( sl, se->se_sid, 1 );
 		sl->sl_num++;
-		if (!sl->sl_playing) {
 		while ( sl->sl_num > sl->sl_size ) {
 			int i;
-			se = sl->sl_head;
-			sl->sl_head = se->se_next;
+			se = tavl_end( sl->sl_entries, TAVL_DIR_LEFT )->avl_data;
+			tavl_delete( &sl->sl_entries, se, syncprov_slog_cmp );
+			syncprov_slog_count( sl, se->se_sid, -1 );
 			Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
 				"expiring csn=%s from sessionlog (sessionlog size=%d)\n",
 				op->o_log_prefix, se->se_csn.bv_val, sl->sl_num );
@@ -1724,7 +2105,6 @@ syncprov_add_slog( Operation *op )
 			ch_free( se );
 			sl->sl_num--;
 		}
-		}
 		ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
 	}
 }
@@ -1939,6 +2319,7 @@ syncprov_accesslog_uuid_cb( Operation *op, SlapReply *rs )
 		assert( uuid_progress->ndel == uuid_progress->list_len );
 		ndel = avl_free( uuid_progress->uuids, NULL );
 		assert( ndel == uuid_progress->ndel );
+		uuid_progress->uuids = NULL;
 		uuid_progress->ndel = 0;
 	}
 
@@ -1956,7 +2337,8 @@ syncprov_play_sessionlog( Operation *op, SlapReply *rs, sync_control *srs,
 	int i, j, ndel, num, nmods, mmods, do_play = 0, rc = -1;
 	BerVarray uuids, csns;
 	struct berval uuid[2] = {}, csn[2] = {};
-	slog_entry *se;
+	slog_entry *se, key;
+	struct berval *start = NULL;
 	TAvlnode *entry;
 
 	ldap_pvt_thread_mutex_lock( &sl->sl_mutex );
@@ -1995,8 +2377,6 @@ syncprov_play_sessionlog( Operation *op, SlapReply *rs, sync_control *srs,
 	num = sl->sl_num;
 	i = 0;
 	nmods = 0;
-	sl->sl_playing++;
-	ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
 
 	uuids = op->o_tmpalloc( (num) * sizeof( struct berval ) +
 			num * UUID_LEN, op->o_tmpmemctx );
@@ -2005,14 +2385,48 @@ syncprov_play_sessionlog( Operation *op, SlapReply *rs, sync_control *srs,
 			num * LDAP_PVT_CSNSTR_BUFSIZE, op->o_tmpmemctx );
 	csns[0].bv_val = (char *)(csns + num);
 
+	/* Entries older than the consumer's cookie are skipped below,
+	 * so start from the oldest cookie CSN among the SIDs present in
+	 * the log. A SID the consumer has never seen forces a full walk.
+	 */
+	for ( j=0; j<sl->sl_numesids; j++ ) {
+		int k;
+
+		if ( !sl->sl_ecounts[j] )
+			continue;
+		for ( k=0; k<srs->sr_state.numcsns; k++ ) {
+			if ( sl->sl_esids[j] == srs->sr_state.sids[k] )
+				break;
+		}
+		if ( k == srs->sr_state.numcsns ) {
+			start = NULL;
+			break;
+		}
+		if ( !start || ber_bvcmp( &srs->sr_state.ctxcsn[k], start ) < 0 )
+			start = &srs->sr_state.ctxcsn[k];
+	}
+	if ( start ) {
+		int ret;
+
+		key.se_csn = *start;
+		key.se_uuid.bv_val = NULL;
+		entry = tavl_find3( sl->sl_entries, &key, syncprov_slog_cmp, &ret );
+		if ( entry && ret > 0 )
+			entry = tavl_next( entry, TAVL_DIR_RIGHT );
+	} else {
+		entry = tavl_end( sl->sl_entries, TAVL_DIR_LEFT );
+	}
+
 	/* Make a copy of the relevant UUIDs. Put the Deletes up front
 	 * and everything else at the end. Do this first so we can
-	 * unlock the list mutex.
+	 * unlock the log mutex.
 	 */
-	for ( se=sl->sl_head; se; se=se->se_next ) {
+	for ( ; entry; entry = tavl_next( entry, TAVL_DIR_RIGHT ) ) {
 		char uuidstr[40] = {};
 		int k;
 
+		se = entry->avl_data;
+
 
 		ndel = 1;
 		for ( k=0; k<srs->sr_state.numcsns; k++ ) {
@@ -2063,8 +2477,6 @@ syncprov_play_sessionlog( Operation *op, SlapReply *rs, sync_control *srs,
 				uuidstr, csns[j].bv_val );
 		}
 	}
-	ldap_pvt_thread_mutex_lock( &sl->sl_mutex );
-	sl->sl_playing--;
 	ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
 
 	ndel = i;
@@ -2169,7 +2581,7 @@ syncprov_play_accesslog( Operation *op, SlapReply *rs, sync_control *srs,
 		.sids = sids,
 	};
 	struct berval oldestcsn = BER_BVNULL, newestcsn = ctxcsn[0],
-	basedn, filterpattern = BER_BVC(
+	cookiecsn = BER_BVNULL, basedn, filterpattern = BER_BVC(
 			"(&"
 				"(entryCSN>=%s)"
 				"(entryCSN<=%s)"
@@ -2182,7 +2594,7 @@ syncprov_play_accesslog( Operation *op, SlapReply *rs, sync_control *srs,
 	BackendDB *db;
 	Entry *e;
 	Attribute *a;
-	int i, rc = -1;
+	int i, j, rc = -1;
 
 	assert( !BER_BVISNULL( &si->si_logbase ) );
 
@@ -2192,6 +2604,25 @@ syncprov_play_accesslog( Operation *op, SlapReply *rs, sync_control *srs,
 		}
 	}
 
+	/* Log records at or below the consumer's CSN for their SID are of
+	 * no use, so unless the cookie is missing one of our SIDs, the
+	 * oldest CSN in the cookie bounds the records to look at. That
+	 * lets the entryCSN index pick just the tail of the log instead
+	 * of all of it.
+	 */
+	for ( i=0, j=0; i < numcsns; i++ ) {
+		while ( j < srs->sr_state.numcsns && srs->sr_state.sids[j] < sids[i] )
+			j++;
+		if ( j == srs->sr_state.numcsns || srs->sr_state.sids[j] != sids[i] ) {
+			BER_BVZERO( &cookiecsn );
+			break;
+		}
+		if ( BER_BVISNULL( &cookiecsn ) ||
+				ber_bvcmp( &cookiecsn, &srs->sr_state.ctxcsn[j] ) > 0 ) {
+			cookiecsn = srs->sr_state.ctxcsn[j];
+		}
+	}
+
 	db = select_backend( &si->si_logbase, 0 );
 	if ( !db ) {
 		Debug( LDAP_DEBUG_ANY, "%s syncprov_play_accesslog: "
@@ -2219,6 +2650,10 @@ syncprov_play_accesslog( Operation *op, SlapReply *rs, sync_control *srs,
 			oldestcsn = a->a_nvals[i];
 		}
 	}
+	if ( !BER_BVISEMPTY( &cookiecsn ) &&
+			ber_bvcmp( &oldestcsn, &cookiecsn ) < 0 ) {
+		oldestcsn = cookiecsn;
+	}
 
 	filter_escape_value_x( &op->o_req_ndn, &basedn, fop.o_tmpmemctx );
 	fop.o_req_ndn = fop.o_req_dn = si->si_logbase;
@@ -2262,6 +2697,7 @@ syncprov_play_accesslog( Operation *op, SlapReply *rs, sync_control *srs,
 
 	rc = fop.o_bd->be_search( &fop, &frs );
 
+	avl_free( uuid_progress.uuids, NULL );
 	fop.o_tmpfree( uuid_progress.uuid_buf, fop.o_tmpmemctx );
 	fop.o_tmpfree( uuid_progress.uuid_list, fop.o_tmpmemctx );
 	fop.o_tmpfree( fop.ors_filterstr.bv_val, fop.o_tmpmemctx );
@@ -2614,7 +3050,7 @@ syncprov_op_mod( Operation *op, SlapReply *rs )
 		mtdummy.mt_dn = op->o_req_ndn;
 retry:
 		ldap_pvt_thread_mutex_lock( &si->si_mods_mutex );
-		mt = avl_find( si->si_mods, &mtdummy, sp_avl_cmp );
+		mt = iavl_find( &si->si_mods, &mtdummy );
 		if ( mt ) {
 			ldap_pvt_thread_mutex_lock( &mt->mt_mutex );
 			if ( mt->mt_mods == NULL ) {
@@ -2683,12 +3119,15 @@ retry:
 			ldap_pvt_thread_mutex_unlock( &mt->mt_mutex );
 		} else {
 			/* Record that we're modifying this entry now */
-			mt = ch_malloc( sizeof(modtarget) );
+			mt = ch_malloc( sizeof(modtarget) + op->o_req_ndn.bv_len + 1 );
 			mt->mt_mods = mi;
 			mt->mt_tail = mi;
-			ber_dupbv( &mt->mt_dn, &mi->mi_op->o_req_ndn );
+			mt->mt_dn.bv_val = (char *)(mt+1);
+			mt->mt_dn.bv_len = op->o_req_ndn.bv_len;
+			AC_MEMCPY( mt->mt_dn.bv_val, op->o_req_ndn.bv_val,
+				op->o_req_ndn.bv_len + 1 );
 			ldap_pvt_thread_mutex_init( &mt->mt_mutex );
-			avl_insert( &si->si_mods, mt, sp_avl_cmp, avl_dup_error );
+			iavl_insert( &si->si_mods, mt, avl_dup_error );
 			ldap_pvt_thread_mutex_unlock( &si->si_mods_mutex );
 		}
 		opc->smt = mt;
@@ -2815,7 +3254,7 @@ syncprov_detach_op( Operation *op, syncops *so, slap_overinst *on )
 	/* Add op2 to conn so abandon will find us */
 	op->o_conn->c_n_ops_executing++;
 	op->o_conn->c_n_ops_completed--;
-	LDAP_STAILQ_INSERT_TAIL( &op->o_conn->c_ops, op2, o_next );
+	connection_op_add( op->o_conn, op2 );
 	so->s_flags |= PS_IS_DETACHED;
 
 	/* Prevent anyone else from trying to send a result for this op */
@@ -2956,7 +3395,8 @@ syncprov_search_response( Operation *op, SlapReply *rs )
 				ldap_pvt_thread_mutex_unlock( &op->o_conn->c_mutex );
 
 				/* If there are queued responses, fire them off */
-				if ( ss->ss_so->s_res )
+				if ( ss->ss_so->s_res ||
+					( ss->ss_so->s_flags & PS_OVERFLOW ))
 					syncprov_qstart( ss->ss_so );
 				ldap_pvt_thread_mutex_unlock( &ss->ss_so->s_mutex );
 			}
@@ -3026,6 +3466,7 @@ syncprov_op_search( Operation *op, SlapReply *rs )
 		}
 		sop = ch_malloc( sizeof( syncops ));
 		*sop = so;
+		iavl_init( &sop->s_pending, sp_sres_cmp, offsetof( syncres, s_node ));
 		sop->s_rid = srs->sr_state.rid;
 		sop->s_sid = srs->sr_state.sid;
 		/* set refcount=2 to prevent being freed out from under us
@@ -3463,7 +3904,10 @@ enum {
 	SP_SESSL,
 	SP_NOPRES,
 	SP_USEHINT,
-	SP_LOGDB
+	SP_LOGDB,
+	SP_SENDERS_CF,
+	SP_QLIMIT,
+	SP_COALESCE
 };
 
 static ConfigDriver sp_cf_gen;
@@ -3493,6 +3937,21 @@ static ConfigTable spcfg[] = {
 		sp_cf_gen, "( OLcfgOvAt:1.5 NAME 'olcSpSessionlogSource' "
 			"DESC 'On startup, try loading sessionlog from this subtree' "
 			"SYNTAX OMsDN SINGLE-VALUE )", NULL, NULL },
+	{ "syncprov-senders", "tasks", 2, 2, 0, ARG_INT|ARG_MAGIC|SP_SENDERS_CF,
+		sp_cf_gen, "( OLcfgOvAt:1.6 NAME 'olcSpSenders' "
+			"DESC 'Number of tasks writing persistent search responses' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "syncprov-queue-limit", "responses", 2, 2, 0, ARG_INT|ARG_MAGIC|SP_QLIMIT,
+		sp_cf_gen, "( OLcfgOvAt:1.7 NAME 'olcSpQueueLimit' "
+			"DESC 'Max responses queued per persistent search' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "syncprov-coalesce", NULL, 2, 2, 0, ARG_ON_OFF|ARG_MAGIC|SP_COALESCE,
+		sp_cf_gen, "( OLcfgOvAt:1.8 NAME 'olcSpCoalesce' "
+			"DESC 'Queued changes to an entry are superseded by later ones' "
+			"EQUALITY booleanMatch "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -3506,6 +3965,9 @@ static ConfigOCs spocs[] = {
 			"$ olcSpNoPresent "
 			"$ olcSpReloadHint "
 			"$ olcSpSessionlogSource "
+			"$ olcSpSenders "
+			"$ olcSpQueueLimit "
+			"$ olcSpCoalesce "
 		") )",
 			Cft_Overlay, spcfg },
 	{ NULL, 0, NULL }
@@ -3567,6 +4029,23 @@ sp_cf_gen(ConfigArgs *c)
 				value_add_one( &c->rvalue_nvals, &si->si_logbase );
 			}
 			break;
+		case SP_SENDERS_CF:
+			c->value_int = si->si_senders;
+			break;
+		case SP_QLIMIT:
+			if ( si->si_qlimit ) {
+				c->value_int = si->si_qlimit;
+			} else {
+				rc = 1;
+			}
+			break;
+		case SP_COALESCE:
+			if ( si->si_nocoalesce ) {
+				c->value_int = 0;
+			} else {
+				rc = 1;
+			}
+			break;
 		}
 		return rc;
 	} else if ( c->op == LDAP_MOD_DELETE ) {
@@ -3590,6 +4069,15 @@ sp_cf_gen(ConfigArgs *c)
 				BER_BVZERO( &si->si_logbase );
 			}
 			break;
+		case SP_SENDERS_CF:
+			si->si_senders = SP_SENDERS;
+			break;
+		case SP_QLIMIT:
+			si->si_qlimit = 0;
+			break;
+		case SP_COALESCE:
+			si->si_nocoalesce = 0;
+			break;
 		}
 		return rc;
 	}
@@ -3679,6 +4167,29 @@ sp_cf_gen(ConfigArgs *c)
 		rc = syncprov_setup_accesslog();
 		ch_free( c->value_dn.bv_val );
 		break;
+	case SP_SENDERS_CF:
+		if ( c->value_int <= 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ), "%s must be positive",
+				c->argv[0] );
+			Debug( LDAP_DEBUG_CONFIG|LDAP_DEBUG_NONE,
+				"%s: %s\n", c->log, c->cr_msg );
+			return ARG_BAD_CONF;
+		}
+		si->si_senders = c->value_int;
+		break;
+	case SP_QLIMIT:
+		if ( c->value_int < 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ), "%s limit %d is negative",
+				c->argv[0], c->value_int );
+			Debug( LDAP_DEBUG_CONFIG|LDAP_DEBUG_NONE,
+				"%s: %s\n", c->log, c->cr_msg );
+			return ARG_BAD_CONF;
+		}
+		si->si_qlimit = c->value_int;
+		break;
+	case SP_COALESCE:
+		si->si_nocoalesce = !c->value_int;
+		break;
 	}
 	return rc;
 }
@@ -3696,6 +4207,329 @@ syncprov_db_otask(
 }
 
 
+#ifdef SYNCPROV_MONITOR
+
+static AttributeDescription *ad_olmSPPersistentSearches, *ad_olmSPQueue;
+static ObjectClass *oc_olmSyncProv;
+
+static struct {
+	char *name;
+	char *oid;
+} sp_oid[] = {
+	{ "olmSyncProvAttributes",	"olmOverlayAttributes:2" },
+	{ "olmSyncProvObjectClasses", "olmOverlayObjectClasses:2" },
+	{ NULL }
+};
+
+static struct {
+	char *desc;
+	AttributeDescription **ad;
+} sp_at[] = {
+	{ "( olmSyncProvAttributes:1 "
+		"NAME ( 'olmSPPersistentSearches' ) "
+		"DESC 'Number of persistent searches being served' "
+		"SUP monitorCounter "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmSPPersistentSearches },
+	{ "( olmSyncProvAttributes:2 "
+		"NAME ( 'olmSPQueue' ) "
+		"DESC 'Responses queued for each persistent search' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmSPQueue },
+	{ NULL }
+};
+
+static struct {
+	char *desc;
+	ObjectClass **oc;
+} sp_oc[] = {
+	/* augments an existing object, so it must be AUXILIARY */
+	{ "( olmSyncProvObjectClasses:1 "
+		"NAME ( 'olmSyncProv' ) "
+		"SUP top AUXILIARY "
+		"MAY ( "
+			"olmSPPersistentSearches "
+			"$ olmSPQueue "
+			") )",
+		&oc_olmSyncProv },
+	{ NULL }
+};
+
+static int
+syncprov_monitor_initialized;
+
+/* The OID macros come from back-monitor, so the schema can only be
+ * defined once we know it is there */
+static int
+syncprov_monitor_schema_init( void )
+{
+	ConfigArgs c;
+	char *argv[3];
+	int i, code;
+
+	if ( syncprov_monitor_initialized )
+		return 0;
+
+	argv[ 0 ] = "syncprov monitor";
+	c.argv = argv;
+	c.argc = 2;
+	c.fname = argv[0];
+	for ( i=0; sp_oid[i].name; i++ ) {
+		argv[1] = sp_oid[i].name;
+		argv[2] = sp_oid[i].oid;
+		if ( parse_oidm( &c, 0, NULL )) {
+			Debug( LDAP_DEBUG_ANY,
+				"syncprov_monitor_schema_init: unable to add "
+				"objectIdentifier \"%s=%s\"\n",
+				sp_oid[i].name, sp_oid[i].oid );
+			return 2;
+		}
+	}
+
+	for ( i=0; sp_at[i].desc != NULL; i++ ) {
+		code = register_at( sp_at[i].desc, sp_at[i].ad, 1 );
+		if ( code != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY,
+				"syncprov_monitor_schema_init: register_at failed for attributeType (%s)\n",
+				sp_at[i].desc );
+			return 3;
+		}
+		(*sp_at[i].ad)->ad_type->sat_flags |= SLAP_AT_HIDE;
+	}
+
+	for ( i=0; sp_oc[i].desc != NULL; i++ ) {
+		code = register_oc( sp_oc[i].desc, sp_oc[i].oc, 1 );
+		if ( code != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY,
+				"syncprov_monitor_schema_init: register_oc failed for objectClass (%s)\n",
+				sp_oc[i].desc );
+			return 4;
+		}
+		(*sp_oc[i].oc)->soc_flags |= SLAP_OC_HIDE;
+	}
+	syncprov_monitor_initialized = 1;
+
+	return 0;
+}
+
+static int
+syncprov_monitor_update(
+	Operation	*op,
+	SlapReply	*rs,
+	Entry		*e,
+	void		*priv )
+{
+	syncprov_info_t	*si = (syncprov_info_t *) priv;
+	syncops		*so;
+	Attribute	*a;
+	char		buf[ SLAP_TEXT_BUFLEN ];
+	struct berval	bv;
+	int		n = 0;
+
+	bv.bv_val = buf;
+	attr_delete( &e->e_attrs, ad_olmSPQueue );
+
+	ldap_pvt_thread_mutex_lock( &si->si_ops_mutex );
+	for ( so = si->si_ops; so; so = so->s_next ) {
+		char sid[ sizeof(" sid=ffffffff") ] = "";
+
+		n++;
+		if ( so->s_sid >= 0 )
+			snprintf( sid, sizeof( sid ), " sid=%03x", so->s_sid );
+		ldap_pvt_thread_mutex_lock( &so->s_mutex );
+		bv.bv_len = snprintf( buf, sizeof( buf ),
+			"conn=%lu rid=%03d%s queued=%d max=%d coalesced=%lu%s",
+			so->s_op->o_connid, so->s_rid, sid,
+			so->s_qlen, so->s_qmax, so->s_coalesced,
+			( so->s_flags & PS_IS_REFRESHING ) ? " refreshing" : "" );
+		ldap_pvt_thread_mutex_unlock( &so->s_mutex );
+		attr_merge_normalize_one( e, ad_olmSPQueue, &bv, NULL );
+	}
+	ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
+
+	a = attr_find( e->e_attrs, ad_olmSPPersistentSearches );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%d", n );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+syncprov_monitor_free(
+	Entry		*e,
+	void		**priv )
+{
+	struct berval	values[ 2 ];
+	Modification	mod = { 0 };
+	AttributeDescription **ads[] = { &ad_olmSPPersistentSearches,
+		&ad_olmSPQueue, NULL };
+	int i;
+
+	const char	*text;
+	char		textbuf[ SLAP_TEXT_BUFLEN ];
+
+	/* NOTE: if slap_shutdown != 0, priv might have already been freed */
+	*priv = NULL;
+
+	/* Remove objectClass */
+	mod.sm_op = LDAP_MOD_DELETE;
+	mod.sm_desc = slap_schema.si_ad_objectClass;
+	mod.sm_values = values;
+	mod.sm_numvals = 1;
+	values[ 0 ] = oc_olmSyncProv->soc_cname;
+	BER_BVZERO( &values[ 1 ] );
+
+	modify_delete_values( e, &mod, 1, &text,
+		textbuf, sizeof( textbuf ) );
+	/* don't care too much about return code... */
+
+	/* remove attrs */
+	mod.sm_values = NULL;
+	mod.sm_numvals = 0;
+	for ( i = 0; ads[i]; i++ ) {
+		mod.sm_desc = *ads[i];
+		modify_delete_values( e, &mod, 1, &text,
+			textbuf, sizeof( textbuf ) );
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+syncprov_monitor_db_init( BackendDB *be )
+{
+	if ( backend_info( "monitor" ) != NULL ) {
+		SLAP_DBFLAGS( be ) |= SLAP_DBFLAG_MONITORING;
+	}
+
+	return 0;
+}
+
+static int
+syncprov_monitor_db_open( BackendDB *be )
+{
+	slap_overinst		*on = (slap_overinst *)be->bd_info;
+	syncprov_info_t		*si = on->on_bi.bi_private;
+	Attribute		*a, *next;
+	monitor_callback_t	*cb = NULL;
+	int			rc = 0;
+	BackendInfo		*mi;
+	monitor_extra_t		*mbe;
+
+	if ( !SLAP_DBMONITORING( be ) ) {
+		return 0;
+	}
+
+	mi = backend_info( "monitor" );
+	if ( !mi || !mi->bi_extra ) {
+		SLAP_DBFLAGS( be ) ^= SLAP_DBFLAG_MONITORING;
+		return 0;
+	}
+	mbe = mi->bi_extra;
+
+	/* don't bother if monitor is not configured */
+	if ( !mbe->is_configured() ) {
+		static int warning = 0;
+
+		if ( warning++ == 0 ) {
+			Debug( LDAP_DEBUG_ANY, "syncprov_monitor_db_open: "
+				"monitoring disabled; "
+				"configure monitor database to enable\n" );
+		}
+
+		return 0;
+	}
+
+	if ( syncprov_monitor_schema_init() ) {
+		return 0;
+	}
+
+	/* alloc as many as required (plus 1 for objectClass) */
+	a = attrs_alloc( 1 + 1 );
+	if ( a == NULL ) {
+		rc = 1;
+		goto cleanup;
+	}
+
+	a->a_desc = slap_schema.si_ad_objectClass;
+	attr_valadd( a, &oc_olmSyncProv->soc_cname, NULL, 1 );
+	next = a->a_next;
+
+	{
+		struct berval	bv = BER_BVC( "0" );
+
+		next->a_desc = ad_olmSPPersistentSearches;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+	}
+
+	cb = ch_calloc( sizeof( monitor_callback_t ), 1 );
+	cb->mc_update = syncprov_monitor_update;
+	cb->mc_free = syncprov_monitor_free;
+	cb->mc_private = (void *)si;
+
+	/* make sure the database is registered; then add monitor attributes */
+	BER_BVZERO( &si->si_monitor_ndn );
+	rc = mbe->register_overlay( be, on, &si->si_monitor_ndn );
+	if ( rc == 0 ) {
+		rc = mbe->register_entry_attrs( &si->si_monitor_ndn, a, cb,
+			NULL, -1, NULL );
+	}
+
+cleanup:;
+	if ( rc != 0 ) {
+		if ( cb != NULL ) {
+			ch_free( cb );
+			cb = NULL;
+		}
+
+		if ( a != NULL ) {
+			attrs_free( a );
+			a = NULL;
+		}
+	}
+
+	/* store for cleanup */
+	si->si_monitor_cb = (void *)cb;
+
+	/* we don't need to keep track of the attributes, because
+	 * syncprov_monitor_free() takes care of everything */
+	if ( a != NULL ) {
+		attrs_free( a );
+	}
+
+	return rc;
+}
+
+static int
+syncprov_monitor_db_close( BackendDB *be )
+{
+	slap_overinst *on = (slap_overinst *)be->bd_info;
+	syncprov_info_t *si = on->on_bi.bi_private;
+
+	if ( si->si_monitor_cb != NULL ) {
+		BackendInfo		*mi = backend_info( "monitor" );
+		monitor_extra_t		*mbe;
+
+		if ( mi && mi->bi_extra ) {
+			mbe = mi->bi_extra;
+			mbe->unregister_entry_callback( &si->si_monitor_ndn,
+				(monitor_callback_t *)si->si_monitor_cb,
+				NULL, 0, NULL );
+		}
+		si->si_monitor_cb = NULL;
+	}
+
+	return 0;
+}
+
+#endif /* SYNCPROV_MONITOR */
+
 /* Read any existing contextCSN from the underlying db.
  * Then search for any entries newer than that. If no value exists,
  * just generate it. Cache whatever result.
@@ -3825,6 +4659,9 @@ syncprov_db_open(
 
 out:
 	op->o_bd->bd_info = (BackendInfo *)on;
+#ifdef SYNCPROV_MONITOR
+	syncprov_monitor_db_open( be );
+#endif /* SYNCPROV_MONITOR */
 	return 0;
 }
 
@@ -3845,6 +4682,9 @@ syncprov_db_close(
 	if ( slapMode & SLAP_TOOL_MODE ) {
 		return 0;
 	}
+#ifdef SYNCPROV_MONITOR
+	syncprov_monitor_db_close( be );
+#endif /* SYNCPROV_MONITOR */
 	if ( si->si_numops ) {
 		Connection conn = {0};
 		OperationBuffer opbuf;
@@ -3868,13 +4708,31 @@ syncprov_db_close(
 			rs.sr_err = LDAP_UNAVAILABLE;
 			send_ldap_result( so->s_op, &rs );
 			sonext=so->s_next;
-			if ( so->s_flags & PS_TASK_QUEUED )
-				ldap_pvt_thread_pool_retract( so->s_pool_cookie );
 			if ( !syncprov_drop_psearch( so, 0 ))
 				so->s_si = NULL;
 		}
 		si->si_ops=NULL;
 		ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
+
+		/* the pool is paused, no sender is running */
+		ldap_pvt_thread_pool_walk( &connection_pool, syncprov_sender,
+			syncprov_sender_retract, si );
+		ldap_pvt_thread_mutex_lock( &si->si_send_mutex );
+		si->si_nsenders = 0;
+		for ( so = si->si_ready; so; so = sonext ) {
+			sonext = so->s_qnext;
+			so->s_si = NULL;
+			syncprov_free_syncop( so, FS_LOCK );
+		}
+		for ( so = si->si_parked; so; so = sonext ) {
+			sonext = so->s_qnext;
+			so->s_si = NULL;
+			syncprov_free_syncop( so, FS_LOCK );
+		}
+		si->si_ready = si->si_readytail = NULL;
+		si->si_parked = si->si_parkedtail = NULL;
+		si->si_nparked = 0;
+		ldap_pvt_thread_mutex_unlock( &si->si_send_mutex );
 	}
 	overlay_unregister_control( be, LDAP_CONTROL_SYNC );
 #endif /* SLAP_CONFIG_DELETE */
@@ -3903,6 +4761,9 @@ syncprov_db_init(
 	ldap_pvt_thread_mutex_init( &si->si_ops_mutex );
 	ldap_pvt_thread_mutex_init( &si->si_mods_mutex );
 	ldap_pvt_thread_mutex_init( &si->si_resp_mutex );
+	ldap_pvt_thread_mutex_init( &si->si_send_mutex );
+	si->si_senders = SP_SENDERS;
+	iavl_init( &si->si_mods, sp_avl_cmp, offsetof( modtarget, mt_node ));
 
 	csn_anlist[0].an_desc = slap_schema.si_ad_entryCSN;
 	csn_anlist[0].an_name = slap_schema.si_ad_entryCSN->ad_cname;
@@ -3912,6 +4773,10 @@ syncprov_db_init(
 	uuid_anlist[0].an_desc = slap_schema.si_ad_entryUUID;
 	uuid_anlist[0].an_name = slap_schema.si_ad_entryUUID->ad_cname;
 
+#ifdef SYNCPROV_MONITOR
+	syncprov_monitor_db_init( be );
+#endif /* SYNCPROV_MONITOR */
+
 	return 0;
 }
 
@@ -3927,13 +4792,8 @@ syncprov_db_destroy(
 	if ( si ) {
 		if ( si->si_logs ) {
 			sessionlog *sl = si->si_logs;
-			slog_entry *se = sl->sl_head;
 
-			while ( se ) {
-				slog_entry *se_next = se->se_next;
-				ch_free( se );
-				se = se_next;
-			}
+			syncprov_slog_clear( sl );
 			if ( sl->sl_mincsn )
 				ber_bvarray_free( sl->sl_mincsn );
 			if ( sl->sl_sids )
@@ -3946,6 +4806,7 @@ syncprov_db_destroy(
 			ber_bvarray_free( si->si_ctxcsn );
 		if ( si->si_sids )
 			ch_free( si->si_sids );
+		ldap_pvt_thread_mutex_destroy( &si->si_send_mutex );
 		ldap_pvt_thread_mutex_destroy( &si->si_resp_mutex );
 		ldap_pvt_thread_mutex_destroy( &si->si_mods_mutex );
 		ldap_pvt_thread_mutex_destroy( &si->si_ops_mutex );
@@ -4113,6 +4974,12 @@ syncprov_initialize()
 	rc = config_register_schema( spcfg, spocs );
 	if ( rc ) return rc;
 
+#ifdef SYNCPROV_MONITOR
+	/* define the monitor schema now if we can, so its order is fixed */
+	if ( backend_info( "monitor" ) != NULL )
+		syncprov_monitor_schema_init();
+#endif /* SYNCPROV_MONITOR */
+
 	return overlay_register( &syncprov );
 }
 
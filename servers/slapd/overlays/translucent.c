@@ -43,6 +43,12 @@ typedef struct translucent_info {
 	int defer_db_open;
 	int bind_local;
 	int pwmod_local;
+	unsigned bulk;			/* max local entries fetched at once */
+	unsigned negcache;		/* max DNs known to have no local entry */
+	ldap_pvt_thread_mutex_t nc_mutex;
+	Avlnode *nc_tree;
+	unsigned nc_count;
+	unsigned long nc_gen;	/* bumped whenever local entries appear */
 } translucent_info;
 
 static ConfigLDAPadd translucent_ldadd;
@@ -98,6 +104,20 @@ static ConfigTable translucentcfg[] = {
 	  "DESC 'Enable local RFC 3062 Password Modify extended operation' "
 	  "EQUALITY booleanMatch "
 	  "SYNTAX OMsBoolean SINGLE-VALUE)", NULL, NULL },
+	{ "translucent_bulk", "num", 2, 2, 0,
+	  ARG_UINT|ARG_OFFSET,
+	  (void *)offsetof(translucent_info, bulk),
+	  "( OLcfgOvAt:14.7 NAME 'olcTranslucentBulk' "
+	  "DESC 'Max number of local entries fetched at once to merge a search' "
+	  "EQUALITY integerMatch "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "translucent_negcache", "num", 2, 2, 0,
+	  ARG_UINT|ARG_OFFSET,
+	  (void *)offsetof(translucent_info, negcache),
+	  "( OLcfgOvAt:14.8 NAME 'olcTranslucentNegCache' "
+	  "DESC 'Max number of DNs remembered as having no local entry' "
+	  "EQUALITY integerMatch "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -108,7 +128,8 @@ static ConfigOCs translucentocs[] = {
 	  "SUP olcOverlayConfig "
 	  "MAY ( olcTranslucentStrict $ olcTranslucentNoGlue $"
 	  " olcTranslucentLocal $ olcTranslucentRemote $"
-	  " olcTranslucentBindLocal $ olcTranslucentPwModLocal ) )",
+	  " olcTranslucentBindLocal $ olcTranslucentPwModLocal $"
+	  " olcTranslucentBulk $ olcTranslucentNegCache ) )",
 	  Cft_Overlay, translucentcfg, NULL, translucent_cfadd },
 	{ "( OLcfgOvOc:14.2 "
 	  "NAME 'olcTranslucentDatabase' "
@@ -305,6 +326,109 @@ void free_attr_chain(Attribute *b) {
 	return;
 }
 
+/*
+** negative cache of DNs that have no local entry;
+**	consulted by searches that merge remote entries one by one;
+**	flushed after any write that may create local entries,
+**	the generation keeps lookups that raced with it from
+**	repopulating the cache with stale data;
+**
+*/
+
+static int
+trans_ndn_cmp( const void *v1, const void *v2 )
+{
+	const struct berval *b1 = v1, *b2 = v2;
+
+	return ber_bvcmp( b1, b2 );
+}
+
+static int
+trans_negcache_find( translucent_info *ov, struct berval *ndn,
+	unsigned long *gen )
+{
+	int rc;
+
+	ldap_pvt_thread_mutex_lock( &ov->nc_mutex );
+	rc = avl_find( ov->nc_tree, ndn, trans_ndn_cmp ) != NULL;
+	*gen = ov->nc_gen;
+	ldap_pvt_thread_mutex_unlock( &ov->nc_mutex );
+
+	return rc;
+}
+
+static void
+trans_negcache_add( translucent_info *ov, struct berval *ndn,
+	unsigned long gen )
+{
+	struct berval *bv;
+
+	ldap_pvt_thread_mutex_lock( &ov->nc_mutex );
+	if ( gen == ov->nc_gen && ov->negcache ) {
+		/* full: start over rather than tracking usage */
+		if ( ov->nc_count >= ov->negcache ) {
+			avl_free( ov->nc_tree, ch_free );
+			ov->nc_tree = NULL;
+			ov->nc_count = 0;
+		}
+		bv = ch_malloc( sizeof( struct berval ) + ndn->bv_len + 1 );
+		bv->bv_len = ndn->bv_len;
+		bv->bv_val = (char *)( bv + 1 );
+		AC_MEMCPY( bv->bv_val, ndn->bv_val, ndn->bv_len + 1 );
+		if ( avl_insert( &ov->nc_tree, bv, trans_ndn_cmp, avl_dup_error ))
+			ch_free( bv );
+		else
+			ov->nc_count++;
+	}
+	ldap_pvt_thread_mutex_unlock( &ov->nc_mutex );
+}
+
+static void
+trans_negcache_flush( translucent_info *ov )
+{
+	ldap_pvt_thread_mutex_lock( &ov->nc_mutex );
+	avl_free( ov->nc_tree, ch_free );
+	ov->nc_tree = NULL;
+	ov->nc_count = 0;
+	ov->nc_gen++;
+	ldap_pvt_thread_mutex_unlock( &ov->nc_mutex );
+}
+
+static int
+trans_negcache_cb( Operation *op, SlapReply *rs )
+{
+	translucent_info *ov = op->o_callback->sc_private;
+
+	if ( rs->sr_type == REP_RESULT && rs->sr_err == LDAP_SUCCESS )
+		trans_negcache_flush( ov );
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+trans_negcache_free( Operation *op, SlapReply *rs )
+{
+	op->o_tmpfree( op->o_callback, op->o_tmpmemctx );
+	op->o_callback = NULL;
+	return SLAP_CB_CONTINUE;
+}
+
+/* flush the cache once the local write has completed */
+static void
+trans_negcache_install( Operation *op, translucent_info *ov )
+{
+	slap_callback *sc;
+
+	if ( !ov->negcache && !ov->nc_tree )
+		return;
+
+	sc = op->o_tmpcalloc( 1, sizeof( slap_callback ), op->o_tmpmemctx );
+	sc->sc_response = trans_negcache_cb;
+	sc->sc_cleanup = trans_negcache_free;
+	sc->sc_private = ov;
+	sc->sc_next = op->o_callback;
+	op->o_callback = sc;
+}
+
 /*
 ** translucent_add()
 **	if not bound as root, send ACCESS error;
@@ -326,6 +450,7 @@ static int translucent_add(Operation *op, SlapReply *rs) {
 		return(rs->sr_err);
 	}
 	if(!ov->no_glue) glue_parent(op);
+	trans_negcache_install(op, ov);
 	return(SLAP_CB_CONTINUE);
 }
 
@@ -354,6 +479,7 @@ static int translucent_modrdn(Operation *op, SlapReply *rs) {
 		glue_parent(op);
 		op->o_tag = LDAP_REQ_MODRDN;
 	}
+	trans_negcache_install(op, ov);
 	return(SLAP_CB_CONTINUE);
 }
 
@@ -579,6 +705,7 @@ release:
 
 	glue_parent(op);
 
+	trans_negcache_install(op, ov);
 	cb.sc_next = op->o_callback;
 	op->o_callback = &cb;
 	rc = on->on_info->oi_orig->bi_op_add(op, &nrs);
@@ -774,6 +901,8 @@ typedef struct trans_ctx {
 	slap_overinst *on;
 	Filter *orig;
 	TAvlnode *list;
+	Avlnode *local;		/* prefetched local entries */
+	int bulk;			/* local is complete */
 	int step;
 	int slimit;
 	AttributeName *attrs;
@@ -847,11 +976,27 @@ static int translucent_search_cb(Operation *op, SlapReply *rs) {
 			re = tmp;
 			test_f = 1;
 		}
+	} else if ( tc->bulk ) {
+	/* Else we have remote, local was prefetched */
+		le = avl_find( tc->local, rs->sr_entry, entry_dn_cmp );
+		if ( le ) {
+			re = entry_dup( rs->sr_entry );
+			rs_flush_entry( op, rs, on );
+		}
 	} else {
 	/* Else we have remote, get local */
+		unsigned long gen = 0;
+
 		op->o_bd = tc->db;
 		le = NULL;
-		rc = overlay_entry_get_ov(op, &rs->sr_entry->e_nname, NULL, NULL, 0, &le, on);
+		if ( ov->negcache && trans_negcache_find( ov,
+				&rs->sr_entry->e_nname, &gen )) {
+			rc = LDAP_NO_SUCH_OBJECT;
+		} else {
+			rc = overlay_entry_get_ov(op, &rs->sr_entry->e_nname, NULL, NULL, 0, &le, on);
+			if ( rc == LDAP_NO_SUCH_OBJECT && ov->negcache )
+				trans_negcache_add( ov, &rs->sr_entry->e_nname, gen );
+		}
 		if ( rc == LDAP_SUCCESS && le ) {
 			re = entry_dup( rs->sr_entry );
 			rs_flush_entry( op, rs, on );
@@ -895,7 +1040,7 @@ static int translucent_search_cb(Operation *op, SlapReply *rs) {
 		/* Dispose of local entry */
 		if ( tc->step & LCL_SIDE ) {
 			rs_flush_entry(op, rs, on);
-		} else {
+		} else if ( !tc->bulk ) {
 			overlay_entry_release_ov(op, le, 0, on);
 		}
 
@@ -1061,6 +1206,92 @@ trans_filter_free( Operation *op, Filter *f )
 	op->o_tmpfree( f, op->o_tmpmemctx );
 }
 
+/*
+** trans_bulk_fetch()
+**	collect all local entries in the scope of the search
+**	with a single internal search, so that remote results
+**	can be merged without looking up each of them;
+**	give up if there are more than the configured max;
+**
+*/
+
+typedef struct trans_bulk {
+	Avlnode *tree;
+	unsigned count;
+	unsigned max;
+	int rc;
+} trans_bulk;
+
+static int
+trans_bulk_cb( Operation *op, SlapReply *rs )
+{
+	trans_bulk *tb = op->o_callback->sc_private;
+
+	if ( rs->sr_type == REP_SEARCH ) {
+		Entry *e;
+
+		if ( ++tb->count > tb->max )
+			return LDAP_SIZELIMIT_EXCEEDED;
+		e = entry_dup( rs->sr_entry );
+		if ( avl_insert( &tb->tree, e, entry_dn_cmp, avl_dup_error ))
+			entry_free( e );
+	} else if ( rs->sr_type == REP_RESULT ) {
+		tb->rc = rs->sr_err;
+	}
+	return 0;
+}
+
+static int
+trans_bulk_fetch( Operation *op, trans_ctx *tc )
+{
+	translucent_info *ov = tc->on->on_bi.bi_private;
+	Operation op2 = *op;
+	SlapReply rs2 = { REP_RESULT };
+	slap_callback cb = { NULL, trans_bulk_cb, NULL, NULL };
+	BackendInfo *bi = op->o_bd->bd_info;
+	trans_bulk tb = { NULL, 0 };
+	Filter ftrue = { 0 };
+	struct berval fstr = BER_BVC( "(?=true)" );
+
+	tb.max = ov->bulk;
+	tb.rc = LDAP_OTHER;
+	cb.sc_private = &tb;
+
+	op2.o_callback = &cb;
+	op2.o_dn = tc->db->be_rootdn;
+	op2.o_ndn = tc->db->be_rootndn;
+	/* glue entries are local entries too */
+	op2.o_managedsait = SLAP_CONTROL_CRITICAL;
+	op2.o_pagedresults = SLAP_CONTROL_NONE;
+	op2.o_sync = SLAP_CONTROL_NONE;
+	/* local entries need not have an objectClass */
+	ftrue.f_choice = SLAPD_FILTER_COMPUTED;
+	ftrue.f_result = LDAP_COMPARE_TRUE;
+	op2.ors_filter = &ftrue;
+	op2.ors_filterstr = fstr;
+	op2.ors_attrs = NULL;
+	op2.ors_attrsonly = 0;
+	op2.ors_limit = NULL;
+	op2.ors_slimit = SLAP_NO_LIMIT;
+	op2.ors_tlimit = SLAP_NO_LIMIT;
+
+	overlay_op_walk( &op2, &rs2, op_search, tc->on->on_info,
+		tc->on->on_next );
+	op->o_bd->bd_info = bi;
+
+	/* glue_parent() ensures a local entry has local ancestors */
+	if ( tb.count <= tb.max && ( tb.rc == LDAP_SUCCESS ||
+		( tb.rc == LDAP_NO_SUCH_OBJECT && !ov->no_glue ))) {
+		tc->local = tb.tree;
+		tc->bulk = 1;
+	} else {
+		Debug( LDAP_DEBUG_TRACE, "translucent_search: "
+			"bulk fetch of local entries gave up (%d)\n", tb.rc );
+		avl_free( tb.tree, (AVL_FREE)entry_free );
+	}
+	return tc->bulk;
+}
+
 /*
 ** translucent_search()
 **	search via captive backend;
@@ -1100,6 +1331,8 @@ static int translucent_search(Operation *op, SlapReply *rs) {
 	tc.on = on;
 	tc.orig = op->ors_filter;
 	tc.list = NULL;
+	tc.local = NULL;
+	tc.bulk = 0;
 	tc.step = 0;
 	tc.slimit = op->ors_slimit;
 	tc.attrs = NULL;
@@ -1108,6 +1341,8 @@ static int translucent_search(Operation *op, SlapReply *rs) {
 	op->o_callback = &cb;
 
 	if ( fr || !fl ) {
+		if ( ov->bulk )
+			trans_bulk_fetch( op, &tc );
 		tc.attrs = op->ors_attrs;
 		op->ors_slimit = SLAP_NO_LIMIT;
 		op->ors_attrs = slap_anlist_all_attributes;
@@ -1125,6 +1360,11 @@ static int translucent_search(Operation *op, SlapReply *rs) {
 		if ( fl ) {
 			op->o_tmpfree( op->ors_filterstr.bv_val, op->o_tmpmemctx );
 		}
+		if ( tc.bulk ) {
+			avl_free( tc.local, (AVL_FREE)entry_free );
+			tc.local = NULL;
+			tc.bulk = 0;
+		}
 	}
 	if ( fl && !rc ) {
 		tc.step |= LCL_SIDE;
@@ -1283,6 +1523,7 @@ static int translucent_db_init(BackendDB *be, ConfigReply *cr) {
 	ov->db = *be;
 	ov->db.be_private = NULL;
 	ov->defer_db_open = 1;
+	ldap_pvt_thread_mutex_init( &ov->nc_mutex );
 
 	if ( !backend_db_init( "ldap", &ov->db, -1, NULL )) {
 		Debug( LDAP_DEBUG_CONFIG, "translucent: unable to open captive back-ldap\n" );
@@ -1370,8 +1611,9 @@ translucent_db_destroy( BackendDB *be, ConfigReply *cr )
 		if ( ov->db.be_private != NULL ) {
 			backend_stopdown_one( &ov->db );
 		}
+		avl_free( ov->nc_tree, ch_free );
+		ldap_pvt_thread_mutex_destroy( &ov->nc_mutex );
 
-		ldap_pvt_thread_mutex_destroy( &ov->db.be_pcl_mutex );
 		ch_free(ov);
 		on->on_bi.bi_private = NULL;
 	}
@@ -73,6 +73,14 @@ typedef struct unique_counter_s {
 	int count;
 } unique_counter;
 
+typedef struct unique_batch_s {
+	struct unique_batch_s *next;
+	struct berval *ndn;
+	int scope;
+	int nkeys;
+	struct berval key;	/* filters, after room for a leading "(|" */
+} unique_batch;
+
 enum {
 	UNIQUE_BASE = 1,
 	UNIQUE_IGNORE,
@@ -832,6 +840,7 @@ unique_db_destroy(
 /*
 ** search callback
 **	if this is a REP_SEARCH, count++;
+**	the first conflict ends the search
 **
 */
 
@@ -858,7 +867,8 @@ static int count_attr_cb(
 
 	uc->count++;
 
-	return(0);
+	/* one conflict is enough, stop the search */
+	return(LDAP_SIZELIMIT_EXCEEDED);
 }
 
 /* count the length of one attribute ad
@@ -1006,7 +1016,8 @@ unique_search(
 	rc = nop->o_bd->be_search(nop, &nrs);
 	filter_free_x(nop, nop->ors_filter, 1);
 
-	if(rc != LDAP_SUCCESS && rc != LDAP_NO_SUCH_OBJECT) {
+	if(rc != LDAP_SUCCESS && rc != LDAP_NO_SUCH_OBJECT &&
+		rc != LDAP_SIZELIMIT_EXCEEDED) {
 		op->o_bd->bd_info = (BackendInfo *) on->on_info;
 		send_ldap_error(op, rs, rc, "unique_search failed");
 		rc = rs->sr_err;
@@ -1025,9 +1036,90 @@ unique_search(
 		rc = SLAP_CB_CONTINUE;
 	}
 
+	return(rc);
+}
+
+/*
+** queue the filter of a domain-uri, merging it with those of the
+** domain-uris already queued with the same base and scope, so that
+** they are all checked by a single search
+*/
+
+static void
+unique_batch_add(
+	Operation *op,
+	unique_batch **batches,
+	struct berval *ndn,
+	int scope,
+	struct berval *key
+)
+{
+	unique_batch *ub;
+
+	for ( ; (ub = *batches); batches = &ub->next ) {
+		if ( ub->scope == scope && dn_match( ub->ndn, ndn ))
+			break;
+	}
+	if ( !ub ) {
+		ub = op->o_tmpcalloc( 1, sizeof(unique_batch), op->o_tmpmemctx );
+		ub->ndn = ndn;
+		ub->scope = scope;
+		*batches = ub;
+	}
+
+	ub->key.bv_val = op->o_tmprealloc( ub->key.bv_val,
+		STRLENOF("(|") + ub->key.bv_len + key->bv_len + STRLENOF(")") + 1,
+		op->o_tmpmemctx );
+	AC_MEMCPY( ub->key.bv_val + STRLENOF("(|") + ub->key.bv_len,
+		key->bv_val, key->bv_len );
+	ub->key.bv_len += key->bv_len;
+	ub->nkeys++;
+
 	op->o_tmpfree( key->bv_val, op->o_tmpmemctx );
+}
 
-	return(rc);
+/*
+** run the queued searches, unless rc already tells the operation
+** failed, and free the queue
+*/
+
+static int
+unique_batch_search(
+	Operation *op,
+	Operation *nop,
+	SlapReply *rs,
+	unique_batch *batches,
+	int rc
+)
+{
+	unique_batch *ub;
+	struct berval bvkey;
+
+	while ( (ub = batches) ) {
+		batches = ub->next;
+
+		if ( rc == SLAP_CB_CONTINUE ) {
+			if ( ub->nkeys > 1 ) {
+				ub->key.bv_val[0] = '(';
+				ub->key.bv_val[1] = '|';
+				bvkey.bv_val = ub->key.bv_val;
+				bvkey.bv_len = STRLENOF("(|") + ub->key.bv_len;
+				bvkey.bv_val[bvkey.bv_len++] = ')';
+			} else {
+				bvkey.bv_val = ub->key.bv_val + STRLENOF("(|");
+				bvkey.bv_len = ub->key.bv_len;
+			}
+			bvkey.bv_val[bvkey.bv_len] = '\0';
+
+			rc = unique_search ( op, nop, ub->ndn, ub->scope,
+					     rs, &bvkey );
+		}
+
+		op->o_tmpfree( ub->key.bv_val, op->o_tmpmemctx );
+		op->o_tmpfree( ub, op->o_tmpmemctx );
+	}
+
+	return rc;
 }
 
 static int
@@ -1060,6 +1152,7 @@ unique_add(
 	Attribute *a;
 	char *key, *kp;
 	struct berval bvkey;
+	unique_batch *batches = NULL;
 	int rc = SLAP_CB_CONTINUE;
 	int locked = 0;
 
@@ -1162,20 +1255,19 @@ unique_add(
 			bvkey.bv_val = key;
 			bvkey.bv_len = kp - key;
 
-			rc = unique_search ( op,
-					     &nop,
-					     uri->ndn.bv_val ?
-					     &uri->ndn :
-					     &op->o_bd->be_nsuffix[0],
-					     uri->scope,
-					     rs,
-					     &bvkey);
-
-			if ( rc != SLAP_CB_CONTINUE ) break;
+			unique_batch_add ( op,
+					   &batches,
+					   uri->ndn.bv_val ?
+					   &uri->ndn :
+					   &op->o_bd->be_nsuffix[0],
+					   uri->scope,
+					   &bvkey);
 		}
 		if ( rc != SLAP_CB_CONTINUE ) break;
 	}
 
+	rc = unique_batch_search ( op, &nop, rs, batches, rc );
+
 	if ( locked ) {
 		if ( rc != SLAP_CB_CONTINUE ) {
 			ldap_pvt_thread_mutex_unlock( &private->serial_mutex );
@@ -1207,6 +1299,7 @@ unique_modify(
 	Entry *e = NULL;
 	char *key, *kp;
 	struct berval bvkey;
+	unique_batch *batches = NULL;
 	int rc = SLAP_CB_CONTINUE;
 	int locked = 0;
 
@@ -1304,20 +1397,19 @@ unique_modify(
 			bvkey.bv_val = key;
 			bvkey.bv_len = kp - key;
 
-			rc = unique_search ( op,
-					     &nop,
-					     uri->ndn.bv_val ?
-					     &uri->ndn :
-					     &op->o_bd->be_nsuffix[0],
-					     uri->scope,
-					     rs,
-					     &bvkey);
-
-			if ( rc != SLAP_CB_CONTINUE ) break;
+			unique_batch_add ( op,
+					   &batches,
+					   uri->ndn.bv_val ?
+					   &uri->ndn :
+					   &op->o_bd->be_nsuffix[0],
+					   uri->scope,
+					   &bvkey);
 		}
 		if ( rc != SLAP_CB_CONTINUE ) break;
 	}
 
+	rc = unique_batch_search ( op, &nop, rs, batches, rc );
+
 	if ( locked ) {
 		if ( rc != SLAP_CB_CONTINUE ) {
 			ldap_pvt_thread_mutex_unlock( &private->serial_mutex );
@@ -1350,6 +1442,7 @@ unique_modrdn(
 	struct berval bvkey;
 	LDAPRDN	newrdn;
 	struct berval bv[2];
+	unique_batch *batches = NULL;
 	int rc = SLAP_CB_CONTINUE;
 	int locked = 0;
 
@@ -1472,20 +1565,19 @@ unique_modrdn(
 			bvkey.bv_val = key;
 			bvkey.bv_len = kp - key;
 
-			rc = unique_search ( op,
-					     &nop,
-					     uri->ndn.bv_val ?
-					     &uri->ndn :
-					     &op->o_bd->be_nsuffix[0],
-					     uri->scope,
-					     rs,
-					     &bvkey);
-
-			if ( rc != SLAP_CB_CONTINUE ) break;
+			unique_batch_add ( op,
+					   &batches,
+					   uri->ndn.bv_val ?
+					   &uri->ndn :
+					   &op->o_bd->be_nsuffix[0],
+					   uri->scope,
+					   &bvkey);
 		}
 		if ( rc != SLAP_CB_CONTINUE ) break;
 	}
 
+	rc = unique_batch_search ( op, &nop, rs, batches, rc );
+
 	if ( locked ) {
 		if ( rc != SLAP_CB_CONTINUE ) {
 			ldap_pvt_thread_mutex_unlock( &private->serial_mutex );
@@ -488,6 +488,526 @@ struct berval * slap_passwd_return(
 	return bv;
 }
 
+/* Cache of successful password checks, so that repeated simple Binds
+ * with the same credentials skip the (possibly deliberately slow)
+ * scheme verification. Each entry is the HMAC-SHA1, under a key drawn
+ * when the cache is (re)sized, of the stored value and the presented
+ * credentials, so a changed password value simply no longer matches.
+ * Only the scheme check is skipped: access control and password policy
+ * are still evaluated on every Bind. Entries expire after
+ * passwd_cache_ttl seconds, which also bounds how long schemes that
+ * consult an external store may be answered from the cache.
+ */
+int passwd_cache_size = 0;
+int passwd_cache_ttl = 60;
+
+typedef struct PasswdCacheEntry {
+	struct PasswdCacheEntry *pc_next;
+	time_t pc_time;
+	unsigned char pc_digest[LUTIL_SHA1_BYTES];
+} PasswdCacheEntry;
+
+static ldap_pvt_thread_mutex_t passwd_cache_mutex;
+static PasswdCacheEntry **passwd_cache_hash;
+static PasswdCacheEntry *passwd_cache_ring;
+static unsigned passwd_cache_mask;
+static int passwd_cache_slots, passwd_cache_next;
+static unsigned char passwd_cache_key[64];
+
+static void
+passwd_cache_free( void )
+{
+	ch_free( passwd_cache_ring );
+	ch_free( passwd_cache_hash );
+	passwd_cache_ring = NULL;
+	passwd_cache_hash = NULL;
+	passwd_cache_slots = 0;
+	passwd_cache_next = 0;
+}
+
+/* (Re)size the cache; called by the config code */
+int
+passwd_cache_resize( int size )
+{
+	unsigned n;
+	int rc = 0;
+
+	ldap_pvt_thread_mutex_lock( &passwd_cache_mutex );
+	passwd_cache_free();
+	if ( size > 0 && lutil_entropy( passwd_cache_key,
+			sizeof( passwd_cache_key )) < 0 ) {
+		size = 0;
+		rc = -1;
+	}
+	passwd_cache_size = size;
+	if ( size > 0 ) {
+		for ( n = 16; n < (unsigned)size; n <<= 1 )
+			;
+		passwd_cache_mask = n - 1;
+		passwd_cache_hash = ch_calloc( n, sizeof( PasswdCacheEntry * ) );
+		passwd_cache_ring = ch_calloc( size, sizeof( PasswdCacheEntry ) );
+		passwd_cache_slots = size;
+	}
+	ldap_pvt_thread_mutex_unlock( &passwd_cache_mutex );
+	return rc;
+}
+
+static void
+passwd_cache_digest( struct berval *passwd, struct berval *cred,
+	unsigned char *digest )
+{
+	lutil_SHA1_CTX ctx;
+	unsigned char pad[sizeof( passwd_cache_key )], len[4];
+	int i;
+
+	/* the stored value is length-prefixed, so that the split
+	 * between it and the credentials is unambiguous */
+	len[0] = passwd->bv_len >> 24;
+	len[1] = passwd->bv_len >> 16;
+	len[2] = passwd->bv_len >> 8;
+	len[3] = passwd->bv_len;
+
+	for ( i = 0; i < sizeof( pad ); i++ )
+		pad[i] = passwd_cache_key[i] ^ 0x36;
+	lutil_SHA1Init( &ctx );
+	lutil_SHA1Update( &ctx, pad, sizeof( pad ) );
+	lutil_SHA1Update( &ctx, len, sizeof( len ) );
+	lutil_SHA1Update( &ctx, (unsigned char *)passwd->bv_val, passwd->bv_len );
+	lutil_SHA1Update( &ctx, (unsigned char *)cred->bv_val, cred->bv_len );
+	lutil_SHA1Final( digest, &ctx );
+
+	for ( i = 0; i < sizeof( pad ); i++ )
+		pad[i] = passwd_cache_key[i] ^ 0x5c;
+	lutil_SHA1Init( &ctx );
+	lutil_SHA1Update( &ctx, pad, sizeof( pad ) );
+	lutil_SHA1Update( &ctx, digest, LUTIL_SHA1_BYTES );
+	lutil_SHA1Final( digest, &ctx );
+}
+
+static unsigned
+passwd_cache_hashof( unsigned char *digest )
+{
+	return digest[0] | digest[1] << 8 | digest[2] << 16 |
+		(unsigned)digest[3] << 24;
+}
+
+static PasswdCacheEntry *
+passwd_cache_find( unsigned char *digest )
+{
+	PasswdCacheEntry *pc;
+
+	for ( pc = passwd_cache_hash[passwd_cache_hashof( digest ) &
+			passwd_cache_mask]; pc; pc = pc->pc_next ) {
+		if ( !memcmp( pc->pc_digest, digest, LUTIL_SHA1_BYTES ))
+			break;
+	}
+	return pc;
+}
+
+static int
+passwd_cache_get( unsigned char *digest )
+{
+	PasswdCacheEntry *pc;
+	int rc = 0;
+
+	ldap_pvt_thread_mutex_lock( &passwd_cache_mutex );
+	if ( passwd_cache_hash ) {
+		pc = passwd_cache_find( digest );
+		if ( pc && slap_get_time() - pc->pc_time < passwd_cache_ttl )
+			rc = 1;
+	}
+	ldap_pvt_thread_mutex_unlock( &passwd_cache_mutex );
+	return rc;
+}
+
+static void
+passwd_cache_put( unsigned char *digest )
+{
+	PasswdCacheEntry *pc, **pp;
+
+	ldap_pvt_thread_mutex_lock( &passwd_cache_mutex );
+	if ( !passwd_cache_hash )
+		goto done;
+
+	pc = passwd_cache_find( digest );
+	if ( !pc ) {
+		/* evict the oldest entry and reuse its ring slot */
+		pc = &passwd_cache_ring[passwd_cache_next++];
+		if ( passwd_cache_next == passwd_cache_slots )
+			passwd_cache_next = 0;
+		if ( pc->pc_time ) {
+			for ( pp = &passwd_cache_hash[passwd_cache_hashof(
+					pc->pc_digest ) & passwd_cache_mask];
+				*pp != pc; pp = &(*pp)->pc_next )
+				;
+			*pp = pc->pc_next;
+		}
+		AC_MEMCPY( pc->pc_digest, digest, LUTIL_SHA1_BYTES );
+		pp = &passwd_cache_hash[passwd_cache_hashof( digest ) &
+			passwd_cache_mask];
+		pc->pc_next = *pp;
+		*pp = pc;
+	}
+	pc->pc_time = slap_get_time();
+done:
+	ldap_pvt_thread_mutex_unlock( &passwd_cache_mutex );
+}
+
+/* Offloading of expensive password checks. With password-offload-threads
+ * set, a simple Bind whose stored values include one of a slow scheme is
+ * stopped before it reaches the backend: the values and the credentials
+ * are queued to dedicated threads and the worker thread returns
+ * SLAPD_ASYNCOP. Once they are checked, the Bind is run again on the
+ * connection pool and slap_passwd_check() takes the outcome from the op
+ * instead of hashing again. These are plain threads, as for the TLS
+ * handshakes, since there is only one thread pool per process. At most
+ * passwd_offload_queue checks are queued or running at a time, further
+ * Binds that need one are refused with busy.
+ */
+int passwd_offload_threads = 0;
+int passwd_offload_queue = 64;
+
+typedef struct PasswdOffload {
+	OpExtra po_oe;
+	struct PasswdOffload *po_next;
+	Operation *po_op;
+	BerVarray po_vals;
+	struct berval po_cred;
+	int po_match;		/* index of the matching value, or -1 */
+} PasswdOffload;
+
+static ldap_pvt_thread_mutex_t passwd_offload_mutex;
+static ldap_pvt_thread_cond_t passwd_offload_cond;
+static ldap_pvt_thread_rdwr_t passwd_offload_rwlock;
+static PasswdOffload *passwd_offload_head, **passwd_offload_tail;
+static int passwd_offload_pending;	/* queued or running */
+static ldap_pvt_thread_t *passwd_offload_tids;
+static int passwd_offload_live, passwd_offload_started,
+	passwd_offload_active, passwd_offload_stop;
+
+/* Schemes cheap enough to check on the worker thread. {SASL}
+ * also needs the SASL context of the connection.
+ */
+static const struct berval passwd_offload_cheap[] = {
+	BER_BVC("{SSHA}"),
+	BER_BVC("{SHA}"),
+	BER_BVC("{SMD5}"),
+	BER_BVC("{MD5}"),
+	BER_BVC("{CLEARTEXT}"),
+	BER_BVC("{SASL}"),
+	BER_BVNULL
+};
+
+static int
+passwd_offload_wanted( struct berval *bv )
+{
+	int i;
+
+	/* no scheme is cleartext */
+	if ( bv->bv_len == 0 || bv->bv_val[0] != '{' )
+		return 0;
+
+	for ( i = 0; !BER_BVISNULL( &passwd_offload_cheap[i] ); i++ ) {
+		if ( bv->bv_len >= passwd_offload_cheap[i].bv_len &&
+			!strncasecmp( bv->bv_val, passwd_offload_cheap[i].bv_val,
+				passwd_offload_cheap[i].bv_len ))
+			return 0;
+	}
+	return 1;
+}
+
+static PasswdOffload *
+passwd_offload_get( Operation *op )
+{
+	OpExtra *oex;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == (void *)passwd_offload_get )
+			return (PasswdOffload *)oex;
+	}
+	return NULL;
+}
+
+static void
+passwd_offload_free( PasswdOffload *po )
+{
+	ber_bvarray_free( po->po_vals );
+	memset( po->po_cred.bv_val, 0, po->po_cred.bv_len );
+	ch_free( po->po_cred.bv_val );
+	ch_free( po );
+}
+
+/* Run on the connection pool once the check is done */
+static void *
+passwd_offload_resume( void *ctx, void *arg )
+{
+	Operation *op = arg;
+	PasswdOffload *po = passwd_offload_get( op );
+	SlapReply rs = { REP_RESULT };
+	void *memctx = op->o_tmpmemctx, *thrmemctx;
+
+	/* the op kept the memory context it had on its first thread */
+	thrmemctx = slap_sl_mem_create( SLAP_SLAB_SIZE, SLAP_SLAB_STACK, ctx, 0 );
+	slap_sl_mem_setctx( ctx, memctx );
+	op->o_threadctx = ctx;
+	op->o_tid = ldap_pvt_thread_pool_tid( ctx );
+
+	do_bind_resume( op, &rs );
+
+	LDAP_SLIST_REMOVE( &op->o_extra, &po->po_oe, OpExtra, oe_next );
+	passwd_offload_free( po );
+
+	connection_op_finish( op );
+	slap_op_free( op, ctx );
+	slap_sl_mem_setctx( ctx, thrmemctx );
+	slap_sl_mem_destroy( (void *)1, memctx );
+	return NULL;
+}
+
+static void *
+passwd_offload_thread( void *arg )
+{
+	int id = (long)arg;
+	PasswdOffload *po;
+	const char *text;
+	int i;
+
+	ldap_pvt_thread_mutex_lock( &passwd_offload_mutex );
+	for (;;) {
+		/* threads beyond the configured count stay idle,
+		 * all of them help draining the queue on shutdown */
+		while ( !passwd_offload_stop &&
+			( !passwd_offload_head || id >= passwd_offload_active ))
+			ldap_pvt_thread_cond_wait( &passwd_offload_cond,
+				&passwd_offload_mutex );
+		po = passwd_offload_head;
+		if ( po == NULL )
+			break;
+		passwd_offload_head = po->po_next;
+		if ( passwd_offload_head == NULL )
+			passwd_offload_tail = &passwd_offload_head;
+		ldap_pvt_thread_mutex_unlock( &passwd_offload_mutex );
+
+		ldap_pvt_thread_rdwr_rlock( &passwd_offload_rwlock );
+		po->po_match = -1;
+		for ( i = 0; !BER_BVISNULL( &po->po_vals[i] ); i++ ) {
+			if ( !lutil_passwd( &po->po_vals[i], &po->po_cred,
+					NULL, &text )) {
+				po->po_match = i;
+				break;
+			}
+		}
+		ldap_pvt_thread_rdwr_runlock( &passwd_offload_rwlock );
+
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+				passwd_offload_resume, po->po_op )) {
+			/* only when the pool is going away */
+			Debug( LDAP_DEBUG_ANY, "passwd_offload_thread: "
+				"%s could not resume bind\n",
+				po->po_op->o_log_prefix );
+		}
+
+		ldap_pvt_thread_mutex_lock( &passwd_offload_mutex );
+		passwd_offload_pending--;
+	}
+	ldap_pvt_thread_mutex_unlock( &passwd_offload_mutex );
+	return NULL;
+}
+
+/* Set the number of offload threads, 0 to check all passwords
+ * on the worker threads. Surplus threads idle until shutdown.
+ */
+int
+slap_passwd_offload_threads( int num )
+{
+	int rc = 0;
+
+	passwd_offload_threads = num;
+	if ( !passwd_offload_live )
+		return 0;
+
+	ldap_pvt_thread_mutex_lock( &passwd_offload_mutex );
+	if ( num > passwd_offload_started ) {
+		passwd_offload_tids = ch_realloc( passwd_offload_tids,
+			num * sizeof( ldap_pvt_thread_t ));
+		while ( passwd_offload_started < num ) {
+			rc = ldap_pvt_thread_create(
+				&passwd_offload_tids[passwd_offload_started], 0,
+				passwd_offload_thread, (void *)(long)passwd_offload_started );
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY, "slap_passwd_offload_threads: "
+					"ldap_pvt_thread_create failed (%d)\n", rc );
+				break;
+			}
+			passwd_offload_started++;
+		}
+	}
+	passwd_offload_active = num < passwd_offload_started ?
+		num : passwd_offload_started;
+	ldap_pvt_thread_cond_broadcast( &passwd_offload_cond );
+	ldap_pvt_thread_mutex_unlock( &passwd_offload_mutex );
+	return rc;
+}
+
+/* Called by slapd once it serves requests, not by the tools */
+void
+slap_passwd_offload_start( void )
+{
+	passwd_offload_live = 1;
+	slap_passwd_offload_threads( passwd_offload_threads );
+}
+
+/* The queue is drained before the threads exit, the resumed
+ * Binds then finish as the connection pool shuts down.
+ */
+void
+slap_passwd_offload_stop( void )
+{
+	int i;
+
+	if ( !passwd_offload_live )
+		return;
+
+	ldap_pvt_thread_mutex_lock( &passwd_offload_mutex );
+	passwd_offload_stop = 1;
+	ldap_pvt_thread_cond_broadcast( &passwd_offload_cond );
+	ldap_pvt_thread_mutex_unlock( &passwd_offload_mutex );
+
+	for ( i = 0; i < passwd_offload_started; i++ )
+		ldap_pvt_thread_join( passwd_offload_tids[i], NULL );
+	ch_free( passwd_offload_tids );
+	passwd_offload_tids = NULL;
+	passwd_offload_started = passwd_offload_active = 0;
+	passwd_offload_live = 0;
+}
+
+/* Keep the offload threads off the password schemes while the
+ * server is paused, modules may be adding some.
+ */
+void
+slap_passwd_offload_pause( int pause )
+{
+	if ( pause )
+		ldap_pvt_thread_rdwr_wlock( &passwd_offload_rwlock );
+	else
+		ldap_pvt_thread_rdwr_wunlock( &passwd_offload_rwlock );
+}
+
+/*
+ * Called by fe_op_bind() for a simple Bind once the backend is chosen.
+ * Returns LDAP_SUCCESS to carry on with the Bind, SLAPD_ASYNCOP if it
+ * has been queued, or the error that was sent.
+ */
+int
+slap_passwd_offload( Operation *op, SlapReply *rs )
+{
+	PasswdOffload *po;
+	Entry *e = NULL;
+	Attribute *a;
+	BerVarray vals;
+	struct berval rootpw[2];
+	unsigned char digest[LUTIL_SHA1_BYTES];
+	int i, wanted = 0;
+
+	/* a resumed Bind, or nothing to offload to */
+	if ( !passwd_offload_active || passwd_offload_get( op ))
+		return LDAP_SUCCESS;
+
+	if ( be_isroot_dn( op->o_bd, &op->o_req_ndn ) &&
+		!BER_BVISEMPTY( &op->o_bd->be_rootpw )) {
+		rootpw[0] = op->o_bd->be_rootpw;
+		BER_BVZERO( &rootpw[1] );
+		vals = rootpw;
+
+	} else {
+		if ( be_entry_get_rw( op, &op->o_req_ndn, NULL, NULL, 0, &e ) ||
+			e == NULL )
+			return LDAP_SUCCESS;
+		a = attr_find( e->e_attrs, slap_schema.si_ad_userPassword );
+		if ( a == NULL ) {
+			be_entry_release_r( op, e );
+			return LDAP_SUCCESS;
+		}
+		vals = a->a_vals;
+	}
+
+	for ( i = 0; !BER_BVISNULL( &vals[i] ); i++ ) {
+		if ( !passwd_offload_wanted( &vals[i] ))
+			continue;
+		if ( passwd_cache_size ) {
+			passwd_cache_digest( &vals[i], &op->orb_cred, digest );
+			if ( passwd_cache_get( digest )) {
+				/* it will be found again inline */
+				wanted = 0;
+				break;
+			}
+		}
+		wanted = 1;
+	}
+
+	if ( !wanted ) {
+		if ( e )
+			be_entry_release_r( op, e );
+		return LDAP_SUCCESS;
+	}
+
+	po = ch_calloc( 1, sizeof( PasswdOffload ));
+	po->po_oe.oe_key = (void *)passwd_offload_get;
+	po->po_op = op;
+	ber_bvarray_dup_x( &po->po_vals, vals, NULL );
+	ber_dupbv( &po->po_cred, &op->orb_cred );
+	if ( e )
+		be_entry_release_r( op, e );
+
+	ldap_pvt_thread_mutex_lock( &passwd_offload_mutex );
+	if ( !passwd_offload_active || passwd_offload_stop ||
+		( passwd_offload_queue &&
+			passwd_offload_pending >= passwd_offload_queue )) {
+		ldap_pvt_thread_mutex_unlock( &passwd_offload_mutex );
+		passwd_offload_free( po );
+		Debug( LDAP_DEBUG_STATS, "%s BIND password check queue full\n",
+			op->o_log_prefix );
+		send_ldap_error( op, rs, LDAP_BUSY,
+			"too many password checks pending" );
+		return LDAP_BUSY;
+	}
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &po->po_oe, oe_next );
+	*passwd_offload_tail = po;
+	passwd_offload_tail = &po->po_next;
+	passwd_offload_pending++;
+	ldap_pvt_thread_cond_signal( &passwd_offload_cond );
+	ldap_pvt_thread_mutex_unlock( &passwd_offload_mutex );
+
+	return SLAPD_ASYNCOP;
+}
+
+/*
+ * The outcome of an offloaded check of cred against passwd: 0 if they
+ * matched, 1 if not, -1 if the op carries no such check. The values
+ * after the first match were not checked.
+ */
+int
+slap_passwd_offloaded( Operation *op, struct berval *passwd,
+	struct berval *cred )
+{
+	PasswdOffload *po;
+	int i;
+
+	if ( LDAP_SLIST_EMPTY( &op->o_extra ) ||
+		( po = passwd_offload_get( op )) == NULL ||
+		!bvmatch( cred, &po->po_cred ))
+		return -1;
+
+	for ( i = 0; !BER_BVISNULL( &po->po_vals[i] ); i++ ) {
+		if ( bvmatch( passwd, &po->po_vals[i] )) {
+			if ( po->po_match >= 0 && i > po->po_match )
+				return -1;
+			return i != po->po_match;
+		}
+	}
+	return -1;
+}
+
 /*
  * if "e" is provided, access to each value of the password is checked first
  */
@@ -503,6 +1023,8 @@ slap_passwd_check(
 	struct berval		*bv;
 	AccessControlState	acl_state = ACL_STATE_INIT;
 	char		credNul = cred->bv_val[cred->bv_len];
+	unsigned char	digest[LUTIL_SHA1_BYTES];
+	int		cached, offloaded;
 
 #ifdef SLAPD_SPASSWD
 	void		*old_authctx = NULL;
@@ -521,7 +1043,32 @@ slap_passwd_check(
 			continue;
 		}
 		
+		offloaded = slap_passwd_offloaded( op, bv, cred );
+		if ( offloaded == 0 ) {
+			/* so that the next Bind is not offloaded again */
+			if ( passwd_cache_size ) {
+				passwd_cache_digest( bv, cred, digest );
+				passwd_cache_put( digest );
+			}
+			result = 0;
+			break;
+		} else if ( offloaded > 0 ) {
+			continue;
+		}
+
+		cached = 0;
+		if ( passwd_cache_size ) {
+			passwd_cache_digest( bv, cred, digest );
+			if ( passwd_cache_get( digest ) ) {
+				result = 0;
+				break;
+			}
+			cached = 1;
+		}
+
 		if ( !lutil_passwd( bv, cred, NULL, text ) ) {
+			if ( cached )
+				passwd_cache_put( digest );
 			result = 0;
 			break;
 		}
@@ -639,9 +1186,23 @@ static int slapd_crypt( const char *key, const char *salt, char **hash )
 
 void slap_passwd_init()
 {
+	ldap_pvt_thread_mutex_init( &passwd_cache_mutex );
+	ldap_pvt_thread_mutex_init( &passwd_offload_mutex );
+	ldap_pvt_thread_cond_init( &passwd_offload_cond );
+	ldap_pvt_thread_rdwr_init( &passwd_offload_rwlock );
+	passwd_offload_tail = &passwd_offload_head;
 #ifdef SLAPD_CRYPT
 	ldap_pvt_thread_mutex_init( &passwd_mutex );
 	lutil_cryptptr = slapd_crypt;
 #endif
 }
 
+void slap_passwd_destroy()
+{
+	passwd_cache_free();
+	ldap_pvt_thread_mutex_destroy( &passwd_cache_mutex );
+	ldap_pvt_thread_rdwr_destroy( &passwd_offload_rwlock );
+	ldap_pvt_thread_cond_destroy( &passwd_offload_cond );
+	ldap_pvt_thread_mutex_destroy( &passwd_offload_mutex );
+}
+
@@ -75,6 +75,8 @@ LDAP_SLAPD_F (int) acl_check_modlist LDAP_P((
 
 LDAP_SLAPD_F (void) acl_append( AccessControl **l, AccessControl *a, int pos );
 
+LDAP_SLAPD_F (int) acl_by_identity LDAP_P(( BackendDB *be ));
+
 #ifdef SLAP_DYNACL
 LDAP_SLAPD_F (int) slap_dynacl_register LDAP_P(( slap_dynacl_t *da ));
 LDAP_SLAPD_F (slap_dynacl_t *) slap_dynacl_get LDAP_P(( const char *name ));
@@ -220,7 +222,14 @@ LDAP_SLAPD_F( int ) slap_add_opattrs(
 /*
  * at.c
  */
-LDAP_SLAPD_V(int) at_oc_cache;
+LDAP_SLAPD_F (int) slap_name_hash_insert LDAP_P((
+	SlapNameHash *nh, struct berval *name ));
+LDAP_SLAPD_F (struct berval *) slap_name_hash_find LDAP_P((
+	SlapNameHash *nh, struct berval *name ));
+LDAP_SLAPD_F (void) slap_name_hash_delete LDAP_P((
+	SlapNameHash *nh, struct berval *name ));
+LDAP_SLAPD_F (void) slap_name_hash_destroy LDAP_P((
+	SlapNameHash *nh ));
 LDAP_SLAPD_F (void) at_config LDAP_P((
 	const char *fname, int lineno,
 	int argc, char **argv ));
@@ -278,11 +287,14 @@ LDAP_SLAPD_F (void) comp_tree_free LDAP_P(( Attribute *a ));
 LDAP_SLAPD_F (Attribute *) attr_alloc LDAP_P(( AttributeDescription *ad ));
 LDAP_SLAPD_F (Attribute *) attrs_alloc LDAP_P(( int num ));
 LDAP_SLAPD_F (int) attr_prealloc LDAP_P(( int num ));
+LDAP_SLAPD_F (void) attr_local_stats LDAP_P(( unsigned long *hits,
+	unsigned long *misses ));
 LDAP_SLAPD_F (int) attr_valfind LDAP_P(( Attribute *a,
 	unsigned flags,
 	struct berval *val,
 	unsigned *slot,
 	void *ctx ));
+LDAP_SLAPD_F (void) attrs_valhash_free LDAP_P(( Attribute *a ));
 LDAP_SLAPD_F (int) attr_valadd LDAP_P(( Attribute *a,
 	BerVarray vals,
 	BerVarray nvals,
@@ -416,6 +428,12 @@ LDAP_SLAPD_F (int) backend_group LDAP_P((
 	AttributeDescription *group_at
 ));
 
+LDAP_SLAPD_V (int) group_cache_size;
+LDAP_SLAPD_V (int) group_cache_ttl;
+LDAP_SLAPD_F (void) group_cache_resize LDAP_P(( int size ));
+LDAP_SLAPD_F (void) group_cache_bump LDAP_P(( void ));
+LDAP_SLAPD_F (unsigned long) group_cache_generation LDAP_P(( void ));
+
 LDAP_SLAPD_F (int) backend_attribute LDAP_P((
 	Operation *op,
 	Entry *target,
@@ -694,6 +712,8 @@ LDAP_SLAPD_F (int) slap_remove_control LDAP_P((
 	SlapReply	*rs,
 	int		ctrl,
 	BI_chk_controls	fnc ));
+LDAP_SLAPD_F (SortedSearch *) slap_sorted_search LDAP_P((
+	Operation	*op ));
 
 #ifdef SLAP_CONTROL_X_SESSION_TRACKING
 LDAP_SLAPD_F (int)
@@ -776,6 +796,10 @@ LDAP_SLAPD_F (int) connections_shutdown LDAP_P((void));
 LDAP_SLAPD_F (int) connections_destroy LDAP_P((void));
 LDAP_SLAPD_F (int) connections_timeout_idle LDAP_P((time_t));
 LDAP_SLAPD_F (void) connections_drop LDAP_P((void));
+#ifdef HAVE_TLS
+LDAP_SLAPD_F (int) connections_tls_threads LDAP_P((int));
+LDAP_SLAPD_F (void) connections_tls_threads_stop LDAP_P((void));
+#endif
 
 LDAP_SLAPD_F (Connection *) connection_client_setup LDAP_P((
 	ber_socket_t s,
@@ -813,8 +837,17 @@ LDAP_SLAPD_F (int) connection_write_resume LDAP_P((Connection *c));
 
 LDAP_SLAPD_F (void) connection_op_finish LDAP_P((
 	Operation *op ));
+LDAP_SLAPD_F (void) connection_op_add LDAP_P((
+	Connection *c, Operation *op ));
+LDAP_SLAPD_F (void) connection_op_remove LDAP_P((
+	Connection *c, Operation *op ));
+LDAP_SLAPD_F (Operation *) connection_op_find LDAP_P((
+	Connection *c, ber_int_t msgid ));
+LDAP_SLAPD_F (void) connection_ber_free LDAP_P((
+	BerElement *ber, void *ctx ));
 
 LDAP_SLAPD_F (unsigned long) connections_nextid(void);
+LDAP_SLAPD_F (unsigned long) connections_current(void);
 
 LDAP_SLAPD_F (Connection *) connection_first LDAP_P(( ber_socket_t * ));
 LDAP_SLAPD_F (Connection *) connection_next LDAP_P((
@@ -879,6 +912,8 @@ LDAP_SLAPD_F (void) slap_queue_csn LDAP_P(( Operation *, struct berval * ));
 LDAP_SLAPD_F (void) slapd_add_internal(ber_socket_t s, int isactive);
 LDAP_SLAPD_F (int) slapd_daemon_init( const char *urls );
 LDAP_SLAPD_F (int) slapd_daemon_resize( int newnum );
+LDAP_SLAPD_F (int) slapd_thread_affinity( char **groups );
+LDAP_SLAPD_F (int) slapd_daemon_group( ber_socket_t s );
 LDAP_SLAPD_F (int) slapd_daemon_destroy(void);
 LDAP_SLAPD_F (int) slapd_daemon(void);
 LDAP_SLAPD_F (Listener **)	slapd_get_listeners LDAP_P((void));
@@ -901,6 +936,8 @@ LDAP_SLAPD_F (void) slapd_clr_write LDAP_P((ber_socket_t s, int wake));
 LDAP_SLAPD_F (void) slapd_set_read LDAP_P((ber_socket_t s, int wake));
 LDAP_SLAPD_F (int) slapd_clr_read LDAP_P((ber_socket_t s, int wake));
 LDAP_SLAPD_F (int) slapd_wait_writer( ber_socket_t sd );
+LDAP_SLAPD_F (int) slapd_wait_writers( ber_socket_t *sds, int n,
+	char *ready, int msec );
 LDAP_SLAPD_F (void) slapd_shutsock( ber_socket_t sd );
 
 LDAP_SLAPD_V (volatile sig_atomic_t) slapd_abrupt_shutdown;
@@ -911,6 +948,9 @@ LDAP_SLAPD_V (slap_ssf_t) local_ssf;
 LDAP_SLAPD_V (struct runqueue_s) slapd_rq;
 LDAP_SLAPD_V (int) slapd_daemon_threads;
 LDAP_SLAPD_V (int) slapd_daemon_mask;
+LDAP_SLAPD_V (int) slapd_listener_reuseport;
+LDAP_SLAPD_V (char **) slapd_cpu_groups;
+LDAP_SLAPD_V (int) slapd_cpu_ngroups;
 #ifdef LDAP_TCP_BUFFER
 LDAP_SLAPD_V (int) slapd_tcp_rmem;
 LDAP_SLAPD_V (int) slapd_tcp_wmem;
@@ -1035,6 +1075,8 @@ LDAP_SLAPD_F (Entry *) str2entry LDAP_P(( char	*s ));
 LDAP_SLAPD_F (Entry *) str2entry2 LDAP_P(( char	*s, int checkvals ));
 LDAP_SLAPD_F (char *) entry2str LDAP_P(( Entry *e, int *len ));
 LDAP_SLAPD_F (char *) entry2str_wrap LDAP_P(( Entry *e, int *len, ber_len_t wrap ));
+LDAP_SLAPD_F (char *) entry2str_wrap_r LDAP_P(( Entry *e, int *len, ber_len_t wrap,
+	struct berval *buf ));
 
 LDAP_SLAPD_F (ber_len_t) entry_flatsize LDAP_P(( Entry *e, int norm ));
 LDAP_SLAPD_F (void) entry_partsize LDAP_P(( Entry *e, ber_len_t *len,
@@ -1062,6 +1104,8 @@ LDAP_SLAPD_F (Entry *) entry_dup2 LDAP_P(( Entry *dest, Entry *src ));
 LDAP_SLAPD_F (Entry *) entry_dup_bv LDAP_P(( Entry *e ));
 LDAP_SLAPD_F (Entry *) entry_alloc LDAP_P((void));
 LDAP_SLAPD_F (int) entry_prealloc LDAP_P((int num));
+LDAP_SLAPD_F (void) entry_local_stats LDAP_P(( unsigned long *hits,
+	unsigned long *misses ));
 
 /*
  * extended.c
@@ -1076,6 +1120,9 @@ LDAP_SLAPD_V( const struct berval ) slap_EXOP_MODIFY_PASSWD;
 LDAP_SLAPD_V( const struct berval ) slap_EXOP_START_TLS;
 LDAP_SLAPD_V( const struct berval ) slap_EXOP_TXN_START;
 LDAP_SLAPD_V( const struct berval ) slap_EXOP_TXN_END;
+#ifdef HAVE_ZLIB
+LDAP_SLAPD_V( const struct berval ) slap_EXOP_START_COMPRESS;
+#endif
 
 typedef int (SLAP_EXTOP_MAIN_FN) LDAP_P(( Operation *op, SlapReply *rs ));
 
@@ -1104,6 +1151,7 @@ LDAP_SLAPD_F (struct berval *) get_supported_extop LDAP_P((int index));
  * txn.c
  */
 LDAP_SLAPD_F ( SLAP_CTRL_PARSE_FN ) txn_spec_ctrl;
+LDAP_SLAPD_F ( SLAP_CTRL_PARSE_FN ) txn_bulk_ctrl;
 LDAP_SLAPD_F ( SLAP_EXTOP_MAIN_FN ) txn_start_extop;
 LDAP_SLAPD_F ( SLAP_EXTOP_MAIN_FN ) txn_end_extop;
 LDAP_SLAPD_F ( int ) txn_preop LDAP_P(( Operation *op, SlapReply *rs ));
@@ -1151,6 +1199,10 @@ LDAP_SLAPD_F (void) filter_destroy LDAP_P(( void ));
  */
 
 LDAP_SLAPD_F (int) test_filter LDAP_P(( Operation *op, Entry *e, Filter *f ));
+LDAP_SLAPD_F (FilterProg *) filter_compile LDAP_P(( Filter *f, void *memctx ));
+LDAP_SLAPD_F (void) filter_prog_free LDAP_P(( FilterProg *fp, void *memctx ));
+LDAP_SLAPD_F (int) test_filter_prog LDAP_P((
+	Operation *op, Entry *e, FilterProg *fp ));
 
 /*
  * frontend.c
@@ -1239,6 +1291,20 @@ LDAP_SLAPD_F (FILE *) lock_fopen LDAP_P(( const char *fname,
 	const char *type, FILE **lfp ));
 LDAP_SLAPD_F (int) lock_fclose LDAP_P(( FILE *fp, FILE *lfp ));
 
+/*
+ * logging.c
+ */
+LDAP_SLAPD_V (unsigned long) slap_log_bufsize;
+LDAP_SLAPD_V (int) slap_log_policy;
+LDAP_SLAPD_V (unsigned long) slap_log_dropped;
+LDAP_SLAPD_F (void) slap_log_print LDAP_P(( int level, int pri,
+	const char *fmt, ... )) LDAP_GCCATTR((format(printf, 3, 4)));
+LDAP_SLAPD_F (int) slap_log_buffer LDAP_P(( unsigned long kbytes ));
+LDAP_SLAPD_F (void) slap_log_set_file LDAP_P(( FILE *fp ));
+LDAP_SLAPD_F (void) slap_log_init LDAP_P(( void ));
+LDAP_SLAPD_F (int) slap_log_start LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_log_destroy LDAP_P(( void ));
+
 /*
  * main.c
  */
@@ -1502,6 +1568,21 @@ LDAP_SLAPD_F (Operation *) slap_op_alloc LDAP_P((
 	ber_tag_t tag, ber_int_t id, void *ctx ));
 
 LDAP_SLAPD_F (slap_op_t) slap_req2op LDAP_P(( ber_tag_t tag ));
+LDAP_SLAPD_F (unsigned long) slap_histo_since LDAP_P(( struct timeval *tv ));
+LDAP_SLAPD_F (void) slap_histo_add LDAP_P(( slap_histo_t *h, unsigned long usec ));
+LDAP_SLAPD_F (void) slap_histo_merge LDAP_P(( slap_histo_t *dst, slap_histo_t *src ));
+LDAP_SLAPD_F (unsigned long) slap_histo_count LDAP_P(( slap_histo_t *h ));
+LDAP_SLAPD_F (unsigned long) slap_histo_quantile LDAP_P((
+	slap_histo_t *h, unsigned long n, int permille ));
+LDAP_SLAPD_F (void) slap_op_profile_plan LDAP_P((
+	Operation *op, const char *fmt, ... )) LDAP_GCCATTR((format(printf, 2, 3)));
+LDAP_SLAPD_F (void) slap_op_slowlog LDAP_P(( Operation *op, SlapReply *rs ));
+LDAP_SLAPD_F (struct slap_prof_thread_t *) slap_prof_begin LDAP_P((
+	slap_prof_t which, slap_prof_tick_t *start ));
+LDAP_SLAPD_F (void) slap_prof_end LDAP_P(( struct slap_prof_thread_t *pt,
+	slap_prof_t which, slap_prof_tick_t start ));
+LDAP_SLAPD_F (void) slap_prof_collect LDAP_P(( slap_prof_counter_t *out ));
+LDAP_SLAPD_F (double) slap_prof_usec LDAP_P(( slap_prof_tick_t ticks ));
 
 /*
  * operational.c
@@ -1509,6 +1590,7 @@ LDAP_SLAPD_F (slap_op_t) slap_req2op LDAP_P(( ber_tag_t tag ));
 LDAP_SLAPD_F (Attribute *) slap_operational_subschemaSubentry( Backend *be );
 LDAP_SLAPD_F (Attribute *) slap_operational_entryDN( Entry *e );
 LDAP_SLAPD_F (Attribute *) slap_operational_hasSubordinate( int has );
+LDAP_SLAPD_F (Attribute *) slap_operational_numSubordinates( unsigned long n );
 
 /*
  * overlays.c
@@ -1551,6 +1633,22 @@ LDAP_SLAPD_F (int) slap_passwd_parse(
 	const char		**text );
 
 LDAP_SLAPD_F (void) slap_passwd_init (void);
+LDAP_SLAPD_F (void) slap_passwd_destroy (void);
+
+LDAP_SLAPD_V (int) passwd_cache_size;
+LDAP_SLAPD_V (int) passwd_cache_ttl;
+LDAP_SLAPD_F (int) passwd_cache_resize LDAP_P(( int size ));
+
+LDAP_SLAPD_V (int) passwd_offload_threads;
+LDAP_SLAPD_V (int) passwd_offload_queue;
+LDAP_SLAPD_F (int) slap_passwd_offload_threads LDAP_P(( int num ));
+LDAP_SLAPD_F (void) slap_passwd_offload_start LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_passwd_offload_stop LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_passwd_offload_pause LDAP_P(( int pause ));
+LDAP_SLAPD_F (int) slap_passwd_offload LDAP_P((
+	Operation *op, SlapReply *rs ));
+LDAP_SLAPD_F (int) slap_passwd_offloaded LDAP_P((
+	Operation *op, struct berval *passwd, struct berval *cred ));
 
 /*
  * phonetic.c
@@ -1627,6 +1725,11 @@ LDAP_SLAPD_F (void) slap_send_ldap_extended LDAP_P(( Operation *op, SlapReply *r
 LDAP_SLAPD_F (void) slap_send_ldap_intermediate LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (void) slap_send_search_result LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_send_search_reference LDAP_P(( Operation *op, SlapReply *rs ));
+LDAP_SLAPD_F (int) slap_write_coalesce_start LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_write_coalesce_end LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_write_coalesce_flush LDAP_P(( Operation *op,
+	int expired ));
+LDAP_SLAPD_F (int) slap_write_drain LDAP_P(( Connection *conn ));
 LDAP_SLAPD_F (int) slap_send_search_entry LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_null_cb LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_freeself_cb LDAP_P(( Operation *op, SlapReply *rs ));
@@ -1732,6 +1835,13 @@ LDAP_SLAPD_F (int) slap_sasl_rewrite_delete LDAP_P(( int valx ));
 LDAP_SLAPD_F (int) slap_sasl_rewrite_unparse LDAP_P(( BerVarray *bva ));
 LDAP_SLAPD_F (void) slap_sasl_regexp_destroy LDAP_P(( void ));
 LDAP_SLAPD_F (int) slap_sasl_regexp_delete LDAP_P(( int valx ));
+LDAP_SLAPD_V (int) authz_cache_size;
+LDAP_SLAPD_V (int) authz_cache_ttl;
+LDAP_SLAPD_F (void) authz_cache_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) authz_cache_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (void) authz_cache_resize LDAP_P(( int size ));
+LDAP_SLAPD_F (void) authz_cache_bump LDAP_P(( void ));
+LDAP_SLAPD_F (unsigned long) authz_cache_generation LDAP_P(( void ));
 LDAP_SLAPD_F (int) authzValidate LDAP_P((
 	Syntax *syn, struct berval *in ));
 #if 0
@@ -1800,6 +1910,8 @@ LDAP_SLAPD_F (int) slap_schema_init LDAP_P((void));
 LDAP_SLAPD_F (void) schema_destroy LDAP_P(( void ));
 
 LDAP_SLAPD_F (int) slap_hash64 LDAP_P((int));
+LDAP_SLAPD_F (int) slap_hash_alg LDAP_P((int));
+LDAP_SLAPD_F (int) slap_hash_generation LDAP_P((void));
 
 LDAP_SLAPD_F( slap_mr_indexer_func ) octetStringIndexer;
 LDAP_SLAPD_F( slap_mr_filter_func ) octetStringFilter;
@@ -1857,6 +1969,14 @@ LDAP_SLAPD_F (int) slap_send_session_log LDAP_P((
 LDAP_SLAPD_F (int) slap_add_session_log LDAP_P((
 					Operation *, Operation *, Entry * ));
 
+/*
+ * slapbench.c
+ */
+LDAP_SLAPD_F (int) slap_bench_start LDAP_P((
+	slap_bench *sb, const char *name ));
+LDAP_SLAPD_F (int) slap_bench_more LDAP_P((
+	slap_bench *sb, unsigned long ops ));
+
 /*
  * sl_malloc.c
  */
@@ -1882,6 +2002,8 @@ LDAP_SLAPD_F (void *) slap_sl_mem_create LDAP_P((
 LDAP_SLAPD_F (void) slap_sl_mem_setctx LDAP_P(( void *ctx, void *memctx ));
 LDAP_SLAPD_F (void) slap_sl_mem_destroy LDAP_P(( void *key, void *data ));
 LDAP_SLAPD_F (void *) slap_sl_context LDAP_P(( void *ptr ));
+LDAP_SLAPD_F (void) slap_sl_stats LDAP_P(( unsigned long *chunks,
+	unsigned long *fallbacks ));
 
 /*
  * starttls.c
@@ -2058,6 +2180,7 @@ LDAP_SLAPD_V (unsigned int) index_intlen_strlen;
 #define SLAP_INDEX_INTLEN_STRLEN(intlen) ((8*(intlen)-1) * 146/485 + 3)
 
 LDAP_SLAPD_V (ber_len_t) sockbuf_max_incoming;
+LDAP_SLAPD_V (ber_len_t) sockbuf_readahead;
 LDAP_SLAPD_V (ber_len_t) sockbuf_max_incoming_auth;
 LDAP_SLAPD_V (int)		slap_conn_max_pending;
 LDAP_SLAPD_V (int)		slap_conn_max_pending_auth;
@@ -2071,6 +2194,10 @@ LDAP_SLAPD_V (const char) 	Versionstr[];
 LDAP_SLAPD_V (int)		global_gentlehup;
 LDAP_SLAPD_V (int)		global_idletimeout;
 LDAP_SLAPD_V (int)		global_writetimeout;
+LDAP_SLAPD_V (ber_len_t)	slap_write_coalesce;
+LDAP_SLAPD_V (int)		slap_write_behind;
+LDAP_SLAPD_V (ber_len_t)	slap_write_buffer;
+LDAP_SLAPD_V (int)		slap_search_templates;
 LDAP_SLAPD_V (char *)	global_host;
 LDAP_SLAPD_V (struct berval)	global_host_bv;
 LDAP_SLAPD_V (char *)	global_realm;
@@ -2099,7 +2226,21 @@ LDAP_SLAPD_V (time_t)		starttime;
 LDAP_SLAPD_V (ldap_pvt_thread_pool_t)	connection_pool;
 LDAP_SLAPD_V (int)			connection_pool_max;
 LDAP_SLAPD_V (int)			connection_pool_queues;
+#ifdef HAVE_TLS
+LDAP_SLAPD_V (int)			slap_tls_thread_max;
+LDAP_SLAPD_V (ldap_pvt_thread_rdwr_t)	slap_tls_thread_rwlock;
+#endif
+LDAP_SLAPD_V (int)			connection_pool_steal;
+LDAP_SLAPD_V (int)			connection_pool_reserve;
+LDAP_SLAPD_V (int)			connection_pool_min;
+LDAP_SLAPD_V (int)			connection_pool_wait;
+LDAP_SLAPD_V (slap_mask_t)		connection_pool_priority;
 LDAP_SLAPD_V (int)			slap_tool_thread_max;
+LDAP_SLAPD_V (int)			slap_histo_on;
+LDAP_SLAPD_V (int)			slap_slowop_threshold;
+LDAP_SLAPD_V (int)			slap_profiling;
+/* whether ops time their phases */
+#define slap_op_timed()	( slap_histo_on || slap_slowop_threshold > 0 )
 
 LDAP_SLAPD_V (ldap_pvt_thread_mutex_t)	entry2str_mutex;
 
@@ -2117,11 +2258,18 @@ LDAP_SLAPD_V (int)		use_reverse_lookup;
 LDAP_SLAPD_F (int) do_abandon LDAP_P((Operation *op, SlapReply *rs));
 LDAP_SLAPD_F (int) do_add LDAP_P((Operation *op, SlapReply *rs));
 LDAP_SLAPD_F (int) do_bind LDAP_P((Operation *op, SlapReply *rs));
+LDAP_SLAPD_F (int) do_bind_resume LDAP_P((Operation *op, SlapReply *rs));
 LDAP_SLAPD_F (int) do_compare LDAP_P((Operation *op, SlapReply *rs));
 LDAP_SLAPD_F (int) do_delete LDAP_P((Operation *op, SlapReply *rs));
 LDAP_SLAPD_F (int) do_modify LDAP_P((Operation *op, SlapReply *rs));
 LDAP_SLAPD_F (int) do_modrdn LDAP_P((Operation *op, SlapReply *rs));
 LDAP_SLAPD_F (int) do_search LDAP_P((Operation *op, SlapReply *rs));
+LDAP_SLAPD_F (int) slap_search_yieldable LDAP_P((Operation *op));
+LDAP_SLAPD_F (void) slap_search_yield LDAP_P((Operation *op));
+LDAP_SLAPD_V( const struct berval ) slap_EXOP_SEARCH_TEMPLATE;
+LDAP_SLAPD_F (SLAP_EXTOP_MAIN_FN) search_template_extop;
+LDAP_SLAPD_F (SLAP_CTRL_PARSE_FN) search_template_ctrl;
+LDAP_SLAPD_F (void) search_templates_free LDAP_P((Connection *c));
 LDAP_SLAPD_F (int) do_unbind LDAP_P((Operation *op, SlapReply *rs));
 LDAP_SLAPD_F (int) do_extended LDAP_P((Operation *op, SlapReply *rs));
 
@@ -331,26 +331,102 @@ slap_writewait_play(
 	}
 }
 
+/*
+ * Send a PDU to the client.  While the calling thread owns the
+ * connection's write coalescing window (see slap_write_coalesce_start())
+ * the PDU is appended to c_wber instead, and a deferrable PDU (a search
+ * entry or reference) is only written once write-coalesce bytes have
+ * accumulated or the window has been open for a second.  A PDU that
+ * would be written on its own anyway is sent straight from its own
+ * buffer.  With ber set to NULL, anything buffered is written and,
+ * unless defer is set, the window is closed.
+ *
+ * When a deferrable PDU of the window's owner would block, up to
+ * write-behind PDUs are left in c_bber instead of waiting, so that the
+ * search goes on and the writewait callbacks only run once that many
+ * are pending.  Any later PDU is queued behind them, and one that may
+ * not be left behind waits until all of them are written.
+ */
 static long send_ldap_ber(
 	Operation *op,
-	BerElement *ber )
+	BerElement *ber,
+	int defer )
 {
 	Connection *conn = op->o_conn;
-	ber_len_t bytes;
+	ber_len_t bytes = 0;
 	long ret = 0;
 	char *close_reason;
 	int do_resume = 0;
+	int coalesce, owner, behind = 0;
+	BerElement *wber = ber;
+	int timed = slap_op_timed();
+	struct timeval start;
 
-	ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
+	if ( ber != NULL )
+		ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
 
 	/* write only one pdu at a time - wait til it's our turn */
 	ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
-	if (( op->o_abandon && !op->o_cancel ) || !connection_valid( conn ) ||
-		conn->c_writers < 0 ) {
+	if (( op->o_abandon && !op->o_cancel && ( ber || !conn->c_bcount )) ||
+		!connection_valid( conn ) || conn->c_writers < 0 ) {
+		ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
+		return 0;
+	}
+
+	coalesce = owner = conn->c_wctx != NULL &&
+		conn->c_wctx == ldap_pvt_thread_pool_context();
+	if ( coalesce && ber != NULL && conn->c_wlen == 0 &&
+		( !defer || bytes >= slap_write_coalesce ) )
+	{
+		/* nothing to gather this PDU with, write it from where
+		 * it was encoded instead of copying it first */
+		coalesce = 0;
+	}
+	if ( coalesce ) {
+		if ( ber != NULL ) {
+			struct berval bv;
+			time_t now = slap_get_time();
+
+			if ( conn->c_wber == NULL )
+				conn->c_wber = ber_alloc_t( LBER_USE_DER );
+			if ( conn->c_wlen == 0 )
+				conn->c_wtime = now;
+
+			ber_flatten2( ber, &bv, 0 );
+			if ( conn->c_wber == NULL ||
+				ber_write( conn->c_wber, bv.bv_val, bv.bv_len, 0 ) < 0 )
+			{
+				ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
+				return -1;
+			}
+			conn->c_wlen += bv.bv_len;
+
+			if ( defer && conn->c_wlen < slap_write_coalesce &&
+				conn->c_wtime == now )
+			{
+				ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
+				return bytes;
+			}
+		} else if ( !defer ) {
+			conn->c_wctx = NULL;
+		}
+
+		if ( conn->c_wlen ) {
+			wber = conn->c_wber;
+			conn->c_wlen = 0;
+		} else if ( !conn->c_bcount ) {
+			ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
+			return bytes;
+		}
+
+	} else if ( ber == NULL && !conn->c_bcount ) {
 		ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
 		return 0;
 	}
 
+	if ( timed )
+		gettimeofday( &start, NULL );
+	SLAP_PROBE2( send__start, conn->c_connid, bytes );
 	conn->c_writers++;
 
 	while ( conn->c_writers > 0 && conn->c_writing ) {
@@ -366,17 +442,36 @@ static long send_ldap_ber(
 			ldap_pvt_thread_cond_signal( &conn->c_write1_cv );
 		conn->c_writers++;
 		ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
+		SLAP_PROBE2( send__done, conn->c_connid, 0 );
 		return 0;
 	}
 
 	/* Our turn */
 	conn->c_writing = 1;
 
+	if ( conn->c_bcount ) {
+		/* after the PDUs left behind */
+		if ( wber != NULL ) {
+			struct berval bv;
+
+			ber_flatten2( wber, &bv, 0 );
+			if ( ber_write( conn->c_bber, bv.bv_val, bv.bv_len, 0 ) < 0 ) {
+				close_reason = "out of memory";
+				goto fail;
+			}
+			if ( wber != ber )
+				ber_reset( wber, 1 );
+			conn->c_bcount++;
+		}
+		wber = conn->c_bber;
+	}
+
 	/* write the pdu */
 	while( 1 ) {
+		ber_len_t left;
 		int err;
 
-		if ( ber_flush2( conn->c_sb, ber, LBER_FLUSH_FREE_NEVER ) == 0 ) {
+		if ( ber_flush2( conn->c_sb, wber, LBER_FLUSH_FREE_NEVER ) == 0 ) {
 			ret = bytes;
 			break;
 		}
@@ -395,6 +490,11 @@ static long send_ldap_ber(
 		if ( err != EWOULDBLOCK && err != EAGAIN ) {
 			close_reason = "connection lost on write";
 fail:
+			SLAP_PROBE2( send__done, conn->c_connid, -1 );
+			if ( wber == conn->c_bber )
+				conn->c_bcount = 0;
+			if ( wber != ber && wber != NULL )
+				ber_reset( wber, 1 );
 			conn->c_writers--;
 			conn->c_writing = 0;
 			ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
@@ -404,6 +504,35 @@ fail:
 			return -1;
 		}
 
+		ber_get_option( wber, LBER_OPT_BER_BYTES_UNFLUSHED, &left );
+		if (( owner && defer && slap_write_behind > 0 &&
+			( wber == conn->c_bber ? conn->c_bcount : 1 ) <= slap_write_behind ) ||
+			( slap_write_buffer > 0 && left <= slap_write_buffer ))
+		{
+			/* leave the rest for later rather than wait */
+			if ( wber != conn->c_bber ) {
+				struct berval bv;
+
+				ber_flatten2( wber, &bv, 0 );
+				if ( conn->c_bber == NULL )
+					conn->c_bber = ber_alloc_t( LBER_USE_DER );
+				if ( conn->c_bber != NULL && ber_write( conn->c_bber,
+					bv.bv_val + bv.bv_len - left, left, 0 ) == left )
+				{
+					conn->c_bcount = 1;
+					behind = 1;
+				}
+			} else {
+				behind = 1;
+			}
+			if ( behind ) {
+				/* the listener writes it out as the client catches up */
+				slapd_set_write( conn->c_sd, 1 );
+				ret = bytes;
+				break;
+			}
+		}
+
 		/* wait for socket to be write-ready */
 		do_resume = 1;
 		conn->c_writewaiter = 1;
@@ -431,6 +560,16 @@ fail:
 		}
 	}
 
+	if ( wber == conn->c_bber ) {
+		if ( !behind ) {
+			ber_reset( wber, 1 );
+			conn->c_bcount = 0;
+		}
+	} else if ( wber != ber ) {
+		/* the coalescing buffer is reused */
+		ber_reset( wber, 1 );
+	}
+
 	conn->c_writing = 0;
 	if ( conn->c_writers < 0 ) {
 		/* shutting down, don't resume any ops */
@@ -451,9 +590,124 @@ fail:
 	if ( do_resume )
 		connection_write_resume( conn );
 
+	if ( timed )
+		op->o_send_usec += slap_histo_since( &start );
+	if ( op->o_profile && ret > 0 )
+		op->o_profile->sp_bytes += ret;
+	SLAP_PROBE2( send__done, conn->c_connid, ret );
+
 	return ret;
 }
 
+/*
+ * Called from the listener with conn's c_mutex held when the socket
+ * is writable, to write out PDUs left behind by send_ldap_ber()
+ * without tying up a thread for the client.  Nothing is done while
+ * a writer is active, it takes care of them.  Returns 1 if some are
+ * still waiting for the client, 0 when done, -1 on error.
+ */
+int
+slap_write_drain( Connection *conn )
+{
+	int rc = 0;
+
+	ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
+	if ( conn->c_bcount && !conn->c_writing && conn->c_writers >= 0 ) {
+		if ( ber_flush2( conn->c_sb, conn->c_bber,
+			LBER_FLUSH_FREE_NEVER ) == 0 )
+		{
+			ber_reset( conn->c_bber, 1 );
+			conn->c_bcount = 0;
+		} else {
+			int err = sock_errno();
+
+			Debug( LDAP_DEBUG_CONNS, "slap_write_drain: conn=%lu "
+				"ber_flush2 failed errno=%d reason=\"%s\"\n",
+				conn->c_connid, err, sock_errstr(err) );
+			rc = ( err == EWOULDBLOCK || err == EAGAIN ) ? 1 : -1;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
+
+	return rc;
+}
+
+/*
+ * Let the calling thread coalesce the search entries it sends on
+ * op's connection, and leave them behind when the client is slow to
+ * read, until slap_write_coalesce_end() is called.  Only
+ * one thread per connection coalesces at a time; entries sent later
+ * from other threads (e.g. persistent searches) are written directly.
+ */
+int
+slap_write_coalesce_start( Operation *op )
+{
+	Connection *conn = op->o_conn;
+	int rc = 0;
+
+	if (( !slap_write_coalesce && slap_write_behind <= 0 ) ||
+		conn == NULL || conn->c_sb == NULL
+#ifdef LDAP_CONNECTIONLESS
+		|| conn->c_is_udp
+#endif /* LDAP_CONNECTIONLESS */
+		)
+	{
+		return 0;
+	}
+
+	ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
+	if ( conn->c_wctx == NULL && connection_valid( conn ) ) {
+		conn->c_wctx = ldap_pvt_thread_pool_context();
+		conn->c_wlen = 0;
+		rc = 1;
+	}
+	ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
+
+	return rc;
+}
+
+void
+slap_write_coalesce_end( Operation *op )
+{
+	Connection *conn = op->o_conn;
+	void *ctx = ldap_pvt_thread_pool_context();
+
+	send_ldap_ber( op, NULL, 0 );
+
+	/* nothing could be written, drop what is left */
+	ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
+	if ( conn->c_wctx == ctx ) {
+		conn->c_wctx = NULL;
+		if ( conn->c_wlen ) {
+			ber_reset( conn->c_wber, 1 );
+			conn->c_wlen = 0;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
+}
+
+/*
+ * Write out the entries the calling thread holds in its coalescing
+ * window, keeping the window open.  Since the one second limit is
+ * otherwise only checked when the next entry is sent, backends call
+ * this before waiting on something else, or with expired set while
+ * they scan, to only write what was held since an earlier second.
+ */
+void
+slap_write_coalesce_flush( Operation *op, int expired )
+{
+	Connection *conn = op->o_conn;
+
+	/* only the window's owner fills c_wber */
+	if ( conn == NULL || !conn->c_wlen ||
+		conn->c_wctx != ldap_pvt_thread_pool_context() )
+		return;
+	if ( expired && conn->c_wtime == slap_get_time() )
+		return;
+
+	send_ldap_ber( op, NULL, 1 );
+}
+
 static int
 send_ldap_control( BerElement *ber, LDAPControl *c )
 {
@@ -650,6 +904,10 @@ send_ldap_response(
 		goto clean2;
 	}
 
+	/* account the op's latency to the database that replied */
+	if ( op->o_bd )
+		op->o_histo = op->o_bd->be_histo;
+
 #ifdef LDAP_CONNECTIONLESS
 	if (op->o_conn && op->o_conn->c_is_udp)
 		ber = op->o_res_ber;
@@ -759,7 +1017,7 @@ send_ldap_response(
 	}
 
 	/* send BER */
-	bytes = send_ldap_ber( op, ber );
+	bytes = send_ldap_ber( op, ber, 0 );
 #ifdef LDAP_CONNECTIONLESS
 	if (!op->o_conn || op->o_conn->c_is_udp == 0)
 #endif
@@ -867,6 +1125,22 @@ slap_send_ldap_result( Operation *op, SlapReply *rs )
 
 	rs->sr_type = REP_RESULT;
 
+	/* A write is committed by the time its result is sent, so the
+	 * cached group and authz results are stale now. Writes inside a transaction
+	 * are seen only once it commits; its commit bumps again then.
+	 */
+	if ( rs->sr_err == LDAP_SUCCESS ) {
+		switch ( op->o_tag ) {
+		case LDAP_REQ_ADD:
+		case LDAP_REQ_MODIFY:
+		case LDAP_REQ_MODRDN:
+		case LDAP_REQ_DELETE:
+			group_cache_bump();
+			authz_cache_bump();
+			break;
+		}
+	}
+
 	/* Propagate Abandons so that cleanup callbacks can be processed */
 	if ( rs->sr_err == SLAPD_ABANDON || op->o_abandon )
 		goto abandon;
@@ -1008,6 +1282,56 @@ slap_send_ldap_intermediate( Operation *op, SlapReply *rs )
 #define set_ldap_error( rs, err, text ) do { \
 		(rs)->sr_err = err; (rs)->sr_text = text; } while(0)
 
+/* value set length of an attribute slap_send_search_entry() leaves out */
+#define SLAP_ENC_SKIP	((ber_len_t) -1)
+
+/* length of the contents of an attribute's encoding */
+static ber_len_t
+send_entry_attrlen( AttributeDescription *desc, ber_len_t vlen )
+{
+	return ber_sizeof_header( LBER_OCTETSTRING, desc->ad_cname.bv_len ) +
+		desc->ad_cname.bv_len + ber_sizeof_header( LBER_SET, vlen ) + vlen;
+}
+
+/* Write the attributes of list picked by the first pass of
+ * slap_send_search_entry(), advancing *alp and *vsp past them
+ */
+static int
+send_entry_attrs(
+	BerElement *ber,
+	Attribute *list,
+	ber_len_t **alp,
+	char **vsp )
+{
+	Attribute	*a;
+	ber_len_t	*al = *alp;
+	char		*vs = *vsp;
+	int		i;
+
+	for ( a = list; a != NULL; a = a->a_next, al++ ) {
+		if ( *al != SLAP_ENC_SKIP && (
+			ber_put_header( ber, LBER_SEQUENCE,
+				send_entry_attrlen( a->a_desc, *al ) ) == -1 ||
+			ber_put_berval( ber, &a->a_desc->ad_cname,
+				LBER_OCTETSTRING ) == -1 ||
+			ber_put_header( ber, LBER_SET, *al ) == -1 ) )
+		{
+			return -1;
+		}
+		for ( i = 0; a->a_vals[i].bv_val != NULL; i++, vs++ ) {
+			if ( *vs && ber_put_berval( ber, &a->a_vals[i],
+				LBER_OCTETSTRING ) == -1 )
+			{
+				return -1;
+			}
+		}
+	}
+
+	*alp = al;
+	*vsp = vs;
+	return 0;
+}
+
 /*
  * returns:
  *
@@ -1021,14 +1345,21 @@ slap_send_ldap_intermediate( Operation *op, SlapReply *rs )
 int
 slap_send_search_entry( Operation *op, SlapReply *rs )
 {
-	BerElementBuffer berbuf;
+	BerElementBuffer berbuf, cberbuf;
 	BerElement	*ber = (BerElement *) &berbuf;
+	BerElement	*cber = (BerElement *) &cberbuf;
+	struct berval	cbv = BER_BVNULL;
 	Attribute	*a;
 	int		i, j, rc = LDAP_UNAVAILABLE, bytes;
+	int		nattrs = 0, nvals = 0, nv, wrap;
+	ber_len_t	*alens = NULL, *al;
+	char		*vsel, *vs;
+	ber_len_t	attrslen = 0, entrylen, msglen;
 	int		userattrs;
 	AccessControlState acl_state = ACL_STATE_INIT;
 	int			 attrsonly;
 	AttributeDescription *ad_entry = slap_schema.si_ad_entry;
+	slap_prof_ctx_t	pc = { NULL };
 
 	/* a_flags: array of flags telling if the i-th element will be
 	 *          returned or filtered out
@@ -1080,7 +1411,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 
 	attrsonly = op->ors_attrsonly;
 
-	if ( !access_allowed( op, rs->sr_entry, ad_entry, NULL, ACL_READ, NULL )) {
+	if ( !access_allowed( op, rs->sr_entry, ad_entry, NULL, ACL_READ, &acl_state )) {
 		Debug( LDAP_DEBUG_ACL,
 			"send_search_entry: conn %lu access to entry (%s) not allowed\n", 
 			op->o_connid, rs->sr_entry->e_name.bv_val );
@@ -1089,53 +1420,30 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		goto error_return;
 	}
 
-	if ( op->o_res_ber ) {
-		/* read back control or LDAP_CONNECTIONLESS */
-	    ber = op->o_res_ber;
-	} else {
-		struct berval	bv;
-
-		bv.bv_len = entry_flatsize( rs->sr_entry, 0 );
-		bv.bv_val = op->o_tmpalloc( bv.bv_len, op->o_tmpmemctx );
+	/* includes the access checks on the attributes */
+	SLAP_PROF_BEGIN( pc, SLAP_PROF_ENCODE );
 
-		ber_init2( ber, &bv, LBER_USE_DER );
-		ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
-	}
+	/* check for special all user attributes ("*") type */
+	userattrs = SLAP_USERATTRS( rs->sr_attr_flags );
 
-#ifdef LDAP_CONNECTIONLESS
-	if ( op->o_conn && op->o_conn->c_is_udp ) {
-		/* CONNECTIONLESS */
-		if ( op->o_protocol == LDAP_VERSION2 ) {
-	    	rc = ber_printf(ber, "t{O{" /*}}*/,
-				LDAP_RES_SEARCH_ENTRY, &rs->sr_entry->e_name );
-		} else {
-	    	rc = ber_printf( ber, "{it{O{" /*}}}*/, op->o_msgid,
-				LDAP_RES_SEARCH_ENTRY, &rs->sr_entry->e_name );
-		}
-	} else
-#endif
-	if ( op->o_res_ber ) {
-		/* read back control */
-	    rc = ber_printf( ber, "t{O{" /*}}*/,
-			LDAP_RES_SEARCH_ENTRY, &rs->sr_entry->e_name );
-	} else {
-	    rc = ber_printf( ber, "{it{O{" /*}}}*/, op->o_msgid,
-			LDAP_RES_SEARCH_ENTRY, &rs->sr_entry->e_name );
+	/* The entry is encoded in two passes. The first one makes all the
+	 * access decisions, recording in alens the length of the value set
+	 * of each attribute sent and in vsel which of its values are sent,
+	 * and adds up the length of the encoding. The second one writes it
+	 * into a buffer of exactly that size.
+	 */
+	for ( a = rs->sr_entry->e_attrs; a != NULL; a = a->a_next ) {
+		nattrs++;
+		for ( i = 0; a->a_vals[i].bv_val != NULL; i++ ) nvals++;
 	}
-
-	if ( rc == -1 ) {
-		Debug( LDAP_DEBUG_ANY, 
-			"send_search_entry: conn %lu  ber_printf failed\n", 
-			op->o_connid );
-
-		if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-		set_ldap_error( rs, LDAP_OTHER, "encoding DN error" );
-		rc = rs->sr_err;
-		goto error_return;
+	for ( a = rs->sr_operational_attrs; a != NULL; a = a->a_next ) {
+		nattrs++;
+		for ( i = 0; a->a_vals[i].bv_val != NULL; i++ ) nvals++;
 	}
-
-	/* check for special all user attributes ("*") type */
-	userattrs = SLAP_USERATTRS( rs->sr_attr_flags );
+	alens = op->o_tmpalloc( nattrs * sizeof(ber_len_t) + nvals + 1,
+		op->o_tmpmemctx );
+	vsel = (char *)( alens + nattrs );
+	memset( vsel, 0, nvals );
 
 	/* create an array of arrays of flags. Each flag corresponds
 	 * to particular value of attribute and equals 1 if value matches
@@ -1157,7 +1465,6 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		    	Debug( LDAP_DEBUG_ANY, 
 					"send_search_entry: conn %lu slap_sl_calloc failed\n",
 					op->o_connid );
-				ber_free( ber, 1 );
 	
 				set_ldap_error( rs, LDAP_OTHER, "out of memory" );
 				goto error_return;
@@ -1175,7 +1482,6 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 			    	Debug( LDAP_DEBUG_ANY, "send_search_entry: "
 					"conn %lu matched values filtering failed\n",
 					op->o_connid );
-				if ( op->o_res_ber == NULL ) ber_free_buf( ber );
 				set_ldap_error( rs, LDAP_OTHER,
 					"matched values filtering error" );
 				rc = rs->sr_err;
@@ -1184,9 +1490,17 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		}
 	}
 
-	for ( a = rs->sr_entry->e_attrs, j = 0; a != NULL; a = a->a_next, j++ ) {
+	al = alens;
+	vs = vsel;
+	for ( a = rs->sr_entry->e_attrs, j = 0; a != NULL;
+		a = a->a_next, j++, al++, vs += nv )
+	{
 		AttributeDescription *desc = a->a_desc;
-		int finish = 0;
+		ber_len_t len = 0;
+
+		for ( nv = 0; a->a_vals[nv].bv_val != NULL; nv++ )
+			;
+		*al = SLAP_ENC_SKIP;
 
 		if ( rs->sr_attrs == NULL ) {
 			/* all user attrs request, skip operational attributes */
@@ -1224,19 +1538,6 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 				continue;
 			}
 
-			if (( rc = ber_printf( ber, "{O[" /*]}*/ , &desc->ad_cname )) == -1 ) {
-				Debug( LDAP_DEBUG_ANY, 
-					"send_search_entry: conn %lu  ber_printf failed\n", 
-					op->o_connid );
-
-				if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-				set_ldap_error( rs, LDAP_OTHER,
-					"encoding description error");
-				rc = rs->sr_err;
-				goto error_return;
-			}
-			finish = 1;
-
 		} else {
 			int first = 1;
 			for ( i = 0; a->a_nvals[i].bv_val != NULL; i++ ) {
@@ -1255,45 +1556,19 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 					continue;
 				}
 
-				if ( first ) {
-					first = 0;
-					finish = 1;
-					if (( rc = ber_printf( ber, "{O[" /*]}*/ , &desc->ad_cname )) == -1 ) {
-						Debug( LDAP_DEBUG_ANY,
-							"send_search_entry: conn %lu  ber_printf failed\n", 
-							op->o_connid );
-
-						if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-						set_ldap_error( rs, LDAP_OTHER,
-							"encoding description error");
-						rc = rs->sr_err;
-						goto error_return;
-					}
-				}
-				if (( rc = ber_printf( ber, "O", &a->a_vals[i] )) == -1 ) {
-					Debug( LDAP_DEBUG_ANY,
-						"send_search_entry: conn %lu  "
-						"ber_printf failed.\n", op->o_connid );
-
-					if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-					set_ldap_error( rs, LDAP_OTHER,
-						"encoding values error" );
-					rc = rs->sr_err;
-					goto error_return;
-				}
+				first = 0;
+				vs[i] = 1;
+				len += ber_sizeof_header( LBER_OCTETSTRING,
+					a->a_vals[i].bv_len ) + a->a_vals[i].bv_len;
+			}
+			if ( first ) {
+				continue;
 			}
 		}
 
-		if ( finish && ( rc = ber_printf( ber, /*{[*/ "]N}" )) == -1 ) {
-			Debug( LDAP_DEBUG_ANY,
-				"send_search_entry: conn %lu ber_printf failed\n", 
-				op->o_connid );
-
-			if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-			set_ldap_error( rs, LDAP_OTHER, "encode end error" );
-			rc = rs->sr_err;
-			goto error_return;
-		}
+		*al = len;
+		len = send_entry_attrlen( desc, len );
+		attrslen += ber_sizeof_header( LBER_SEQUENCE, len ) + len;
 	}
 
 	/* NOTE: moved before overlays callback circling because
@@ -1322,7 +1597,6 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 					"not enough memory "
 					"for matched values filtering\n",
 					op->o_connid );
-				if ( op->o_res_ber == NULL ) ber_free_buf( ber );
 				set_ldap_error( rs, LDAP_OTHER,
 					"not enough memory for matched values filtering" );
 				goto error_return;
@@ -1342,7 +1616,6 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 					"send_search_entry: conn %lu "
 					"matched values filtering failed\n", 
 					op->o_connid );
-				if ( op->o_res_ber == NULL ) ber_free_buf( ber );
 				set_ldap_error( rs, LDAP_OTHER,
 					"matched values filtering error" );
 				rc = rs->sr_err;
@@ -1351,8 +1624,15 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		}
 	}
 
-	for (a = rs->sr_operational_attrs, j=0; a != NULL; a = a->a_next, j++ ) {
+	for ( a = rs->sr_operational_attrs, j = 0; a != NULL;
+		a = a->a_next, j++, al++, vs += nv )
+	{
 		AttributeDescription *desc = a->a_desc;
+		ber_len_t len = 0;
+
+		for ( nv = 0; a->a_vals[nv].bv_val != NULL; nv++ )
+			;
+		*al = SLAP_ENC_SKIP;
 
 		if ( rs->sr_attrs == NULL ) {
 			/* all user attrs request, skip operational attributes */
@@ -1390,19 +1670,6 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 			continue;
 		}
 
-		rc = ber_printf( ber, "{O[" /*]}*/ , &desc->ad_cname );
-		if ( rc == -1 ) {
-			Debug( LDAP_DEBUG_ANY,
-				"send_search_entry: conn %lu  "
-				"ber_printf failed\n", op->o_connid );
-
-			if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-			set_ldap_error( rs, LDAP_OTHER,
-				"encoding description error" );
-			rc = rs->sr_err;
-			goto error_return;
-		}
-
 		if ( ! attrsonly ) {
 			for ( i = 0; a->a_vals[i].bv_val != NULL; i++ ) {
 				if ( ! access_allowed( op, rs->sr_entry,
@@ -1420,55 +1687,96 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 					continue;
 				}
 
-				if (( rc = ber_printf( ber, "O", &a->a_vals[i] )) == -1 ) {
-					Debug( LDAP_DEBUG_ANY,
-						"send_search_entry: conn %lu  ber_printf failed\n", 
-						op->o_connid );
-
-					if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-					set_ldap_error( rs, LDAP_OTHER,
-						"encoding values error" );
-					rc = rs->sr_err;
-					goto error_return;
-				}
+				vs[i] = 1;
+				len += ber_sizeof_header( LBER_OCTETSTRING,
+					a->a_vals[i].bv_len ) + a->a_vals[i].bv_len;
 			}
 		}
 
-		if (( rc = ber_printf( ber, /*{[*/ "]N}" )) == -1 ) {
+		*al = len;
+		len = send_entry_attrlen( desc, len );
+		attrslen += ber_sizeof_header( LBER_SEQUENCE, len ) + len;
+	}
+
+	/* free e_flags */
+	if ( e_flags ) {
+		slap_sl_free( e_flags, op->o_tmpmemctx );
+		e_flags = NULL;
+	}
+
+	/* controls are rare, encode them aside to learn their length */
+	if ( rs->sr_ctrls != NULL ) {
+		ber_init2( cber, NULL, LBER_USE_DER );
+		ber_set_option( cber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+		rc = send_ldap_controls( op, cber, rs->sr_ctrls );
+		if ( rc == -1 || ber_flatten2( cber, &cbv, 0 ) == -1 ) {
 			Debug( LDAP_DEBUG_ANY,
 				"send_search_entry: conn %lu  ber_printf failed\n",
 				op->o_connid );
 
-			if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-			set_ldap_error( rs, LDAP_OTHER, "encode end error" );
+			ber_free_buf( cber );
+			set_ldap_error( rs, LDAP_OTHER, "encoding controls error" );
 			rc = rs->sr_err;
 			goto error_return;
 		}
 	}
 
-	/* free e_flags */
-	if ( e_flags ) {
-		slap_sl_free( e_flags, op->o_tmpmemctx );
-		e_flags = NULL;
+	entrylen = ber_sizeof_header( LBER_OCTETSTRING, rs->sr_entry->e_name.bv_len ) +
+		rs->sr_entry->e_name.bv_len +
+		ber_sizeof_header( LBER_SEQUENCE, attrslen ) + attrslen;
+	msglen = ber_sizeof_header( LDAP_RES_SEARCH_ENTRY, entrylen ) + entrylen +
+		cbv.bv_len;
+
+	/* LDAP_CONNECTIONLESS v2 results carry no message envelope */
+	wrap = op->o_res_ber == NULL;
+#ifdef LDAP_CONNECTIONLESS
+	if ( op->o_conn && op->o_conn->c_is_udp ) {
+		wrap = op->o_protocol != LDAP_VERSION2;
+	}
+#endif
+	if ( wrap ) {
+		msglen += ber_sizeof_header( LBER_INTEGER,
+			ber_sizeof_int( op->o_msgid ) ) + ber_sizeof_int( op->o_msgid );
 	}
 
-	rc = ber_printf( ber, /*{{*/ "}N}" );
+	if ( op->o_res_ber ) {
+		/* LDAP_CONNECTIONLESS */
+		ber = op->o_res_ber;
+	} else {
+		struct berval	bv;
+
+		bv.bv_len = msglen;
+		if ( wrap )
+			bv.bv_len += ber_sizeof_header( LBER_SEQUENCE, msglen );
+		/* ber_flatten2() terminates the buffer */
+		bv.bv_val = op->o_tmpalloc( bv.bv_len + 1, op->o_tmpmemctx );
 
-	if( rc != -1 ) {
-		rc = send_ldap_controls( op, ber, rs->sr_ctrls );
+		ber_init2( ber, &bv, LBER_USE_DER );
+		ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
 	}
 
-	if( rc != -1 ) {
-#ifdef LDAP_CONNECTIONLESS
-		if( op->o_conn && op->o_conn->c_is_udp ) {
-			if ( op->o_protocol != LDAP_VERSION2 ) {
-				rc = ber_printf( ber, /*{*/ "N}" );
-			}
-		} else
-#endif
-		if ( op->o_res_ber == NULL ) {
-			rc = ber_printf( ber, /*{*/ "N}" );
-		}
+	rc = 0;
+	if ( wrap ) {
+		rc = ber_put_header( ber, LBER_SEQUENCE, msglen );
+		if ( rc != -1 )
+			rc = ber_put_int( ber, op->o_msgid, LBER_INTEGER );
+	}
+	if ( rc != -1 )
+		rc = ber_put_header( ber, LDAP_RES_SEARCH_ENTRY, entrylen );
+	if ( rc != -1 )
+		rc = ber_put_berval( ber, &rs->sr_entry->e_name, LBER_OCTETSTRING );
+	if ( rc != -1 )
+		rc = ber_put_header( ber, LBER_SEQUENCE, attrslen );
+	al = alens;
+	vs = vsel;
+	if ( rc != -1 )
+		rc = send_entry_attrs( ber, rs->sr_entry->e_attrs, &al, &vs );
+	if ( rc != -1 )
+		rc = send_entry_attrs( ber, rs->sr_operational_attrs, &al, &vs );
+	if ( rs->sr_ctrls != NULL ) {
+		if ( rc != -1 )
+			rc = ber_write( ber, cbv.bv_val, cbv.bv_len, 0 );
+		ber_free_buf( cber );
 	}
 
 	if ( rc == -1 ) {
@@ -1479,6 +1787,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		rc = rs->sr_err;
 		goto error_return;
 	}
+	SLAP_PROF_END( pc, SLAP_PROF_ENCODE );
 
 	Debug( LDAP_DEBUG_STATS2, "%s ENTRY dn=\"%s\"\n",
 	    op->o_log_prefix, rs->sr_entry->e_nname.bv_val );
@@ -1486,7 +1795,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	rs_flush_entry( op, rs, NULL );
 
 	if ( op->o_res_ber == NULL ) {
-		bytes = send_ldap_ber( op, ber );
+		bytes = send_ldap_ber( op, ber, 1 );
 		ber_free_buf( ber );
 
 		if ( bytes < 0 ) {
@@ -1512,6 +1821,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	rc = LDAP_SUCCESS;
 
 error_return:;
+	SLAP_PROF_END( pc, SLAP_PROF_ENCODE );
 	if ( op->o_callback ) {
 		(void)slap_cleanup_play( op, rs );
 	}
@@ -1519,6 +1829,9 @@ error_return:;
 	if ( e_flags ) {
 		slap_sl_free( e_flags, op->o_tmpmemctx );
 	}
+	if ( alens ) {
+		op->o_tmpfree( alens, op->o_tmpmemctx );
+	}
 
 	/* FIXME: Can break if rs now contains an extended response */
 	if ( rs->sr_operational_attrs ) {
@@ -1652,7 +1965,7 @@ slap_send_search_reference( Operation *op, SlapReply *rs )
 #ifdef LDAP_CONNECTIONLESS
 	if (!op->o_conn || op->o_conn->c_is_udp == 0) {
 #endif
-	bytes = send_ldap_ber( op, ber );
+	bytes = send_ldap_ber( op, ber, 1 );
 	ber_free_buf( ber );
 
 	if ( bytes < 0 ) {
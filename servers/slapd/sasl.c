@@ -1243,6 +1243,7 @@ int slap_sasl_init( void )
 #endif
 
 	rewrite_mapper_register( &slapd_mapper );
+	authz_cache_init();
 
 #ifdef HAVE_CYRUS_SASL
 #ifdef HAVE_SASL_VERSION
@@ -1322,6 +1323,7 @@ int slap_sasl_destroy( void )
 	sasl_host = NULL;
 	free( sasl_cbinding );
 	sasl_cbinding = NULL;
+	authz_cache_destroy();
 
 	return 0;
 }
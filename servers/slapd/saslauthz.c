@@ -92,6 +92,263 @@ static const char *policy_txt[] = {
 
 static int authz_policy = SASL_AUTHZ_NONE;
 
+/* Server-wide cache of slap_sasl2dn() mappings and of successful
+ * slap_sasl_authorized() decisions, so that identities asserted over
+ * and over, e.g. by proxies sending the proxied authorization control
+ * with every request, are not mapped and checked from scratch each
+ * time. Entries expire after authz_cache_ttl seconds; every committed
+ * write and every change to the authz configuration bumps a generation
+ * number that invalidates all of them. Failures are never cached.
+ */
+int authz_cache_size = 0;
+int authz_cache_ttl = 60;
+
+#define AUTHZ_CACHE_SASL2DN	0
+#define AUTHZ_CACHE_AUTHORIZED	1
+
+typedef struct AuthzCacheEntry {
+	struct AuthzCacheEntry *ac_next;
+	BackendDB *ac_be;	/* sasl2dn: the authz backend */
+	unsigned long ac_gen;
+	time_t ac_time;
+	unsigned ac_hash;
+	int ac_slot;		/* index in authz_cache_ring */
+	int ac_type;
+	int ac_flags;
+	ber_len_t ac_len[4];	/* three key strings, then the result DN */
+	char ac_data[1];	/* each of them followed by a NUL */
+} AuthzCacheEntry;
+
+static ldap_pvt_thread_mutex_t authz_cache_mutex;
+static AuthzCacheEntry **authz_cache_hash;
+static AuthzCacheEntry **authz_cache_ring;
+static unsigned authz_cache_mask;
+static int authz_cache_slots, authz_cache_next;
+static unsigned long authz_cache_gen;
+
+static void
+authz_cache_free( void )
+{
+	int i;
+
+	if ( authz_cache_ring ) {
+		for ( i = 0; i < authz_cache_slots; i++ ) {
+			ch_free( authz_cache_ring[i] );
+		}
+		ch_free( authz_cache_ring );
+		ch_free( authz_cache_hash );
+	}
+	authz_cache_ring = NULL;
+	authz_cache_hash = NULL;
+	authz_cache_slots = 0;
+	authz_cache_next = 0;
+}
+
+void
+authz_cache_init( void )
+{
+	ldap_pvt_thread_mutex_init( &authz_cache_mutex );
+}
+
+void
+authz_cache_destroy( void )
+{
+	authz_cache_free();
+	ldap_pvt_thread_mutex_destroy( &authz_cache_mutex );
+}
+
+/* (Re)size the cache; called by the config code */
+void
+authz_cache_resize( int size )
+{
+	unsigned n;
+
+	ldap_pvt_thread_mutex_lock( &authz_cache_mutex );
+	authz_cache_free();
+	authz_cache_size = size;
+	if ( size > 0 ) {
+		for ( n = 16; n < (unsigned)size; n <<= 1 )
+			;
+		authz_cache_mask = n - 1;
+		authz_cache_hash = ch_calloc( n, sizeof( AuthzCacheEntry * ) );
+		authz_cache_ring = ch_calloc( size, sizeof( AuthzCacheEntry * ) );
+		authz_cache_slots = size;
+	}
+	/* writes made while the cache was off did not bump */
+	authz_cache_gen++;
+	ldap_pvt_thread_mutex_unlock( &authz_cache_mutex );
+}
+
+/* Invalidate all cached results; called whenever a write commits,
+ * once it is visible to readers, and when the rules change.
+ */
+void
+authz_cache_bump( void )
+{
+	if ( !authz_cache_size )
+		return;
+	ldap_pvt_thread_mutex_lock( &authz_cache_mutex );
+	authz_cache_gen++;
+	ldap_pvt_thread_mutex_unlock( &authz_cache_mutex );
+}
+
+/* The generation an operation starts under; as for the group cache,
+ * its results are only cached if nothing was committed since.
+ */
+unsigned long
+authz_cache_generation( void )
+{
+	unsigned long gen;
+
+	if ( !authz_cache_size )
+		return 0;
+	ldap_pvt_thread_mutex_lock( &authz_cache_mutex );
+	gen = authz_cache_gen;
+	ldap_pvt_thread_mutex_unlock( &authz_cache_mutex );
+	return gen;
+}
+
+static unsigned
+authz_cache_hashof( int type, int flags, struct berval *key )
+{
+	unsigned h = type * 2 + flags;
+	ber_len_t i;
+	int k;
+
+	for ( k = 0; k < 3; k++ ) {
+		for ( i = 0; i < key[k].bv_len; i++ )
+			h = h * 31 + (unsigned char)key[k].bv_val[i];
+		h = h * 31 + k;
+	}
+	return h;
+}
+
+static AuthzCacheEntry *
+authz_cache_find( unsigned h, int type, int flags, struct berval *key )
+{
+	AuthzCacheEntry *ac;
+	char *p;
+	int k;
+
+	for ( ac = authz_cache_hash[h & authz_cache_mask]; ac; ac = ac->ac_next ) {
+		if ( ac->ac_hash != h || ac->ac_type != type || ac->ac_flags != flags )
+			continue;
+		for ( k = 0, p = ac->ac_data; k < 3; p += ac->ac_len[k++] + 1 ) {
+			if ( ac->ac_len[k] != key[k].bv_len ||
+				memcmp( p, key[k].bv_val, key[k].bv_len ))
+				break;
+		}
+		if ( k == 3 )
+			break;
+	}
+	return ac;
+}
+
+/* Look up key; on a hit, the result DN is copied into res using
+ * memctx, and the authz backend is returned in *bep.
+ */
+static int
+authz_cache_get( int type, int flags, struct berval *key,
+	struct berval *res, BackendDB **bep, void *memctx )
+{
+	AuthzCacheEntry *ac;
+	unsigned h;
+	int rc = 0;
+
+	if ( !authz_cache_size )
+		return 0;
+
+	h = authz_cache_hashof( type, flags, key );
+	ldap_pvt_thread_mutex_lock( &authz_cache_mutex );
+	if ( authz_cache_hash ) {
+		ac = authz_cache_find( h, type, flags, key );
+		if ( ac && ac->ac_gen == authz_cache_gen &&
+			slap_get_time() - ac->ac_time < authz_cache_ttl )
+		{
+			if ( res ) {
+				res->bv_len = ac->ac_len[3];
+				res->bv_val = slap_sl_malloc( res->bv_len + 1, memctx );
+				AC_MEMCPY( res->bv_val, ac->ac_data + ac->ac_len[0] +
+					ac->ac_len[1] + ac->ac_len[2] + 3, res->bv_len + 1 );
+			}
+			if ( bep )
+				*bep = ac->ac_be;
+			rc = 1;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &authz_cache_mutex );
+	return rc;
+}
+
+static void
+authz_cache_put( int type, int flags, struct berval *key,
+	struct berval *res, BackendDB *be, unsigned long gen )
+{
+	AuthzCacheEntry *ac, **ap;
+	ber_len_t len;
+	unsigned h;
+	char *p;
+	int k;
+
+	if ( !authz_cache_size )
+		return;
+
+	h = authz_cache_hashof( type, flags, key );
+	ldap_pvt_thread_mutex_lock( &authz_cache_mutex );
+	/* a write committed since the operation began */
+	if ( !authz_cache_hash || gen != authz_cache_gen )
+		goto done;
+
+	ac = authz_cache_find( h, type, flags, key );
+	if ( ac ) {
+		/* unlink it, the result may not fit */
+		for ( ap = &authz_cache_hash[h & authz_cache_mask];
+			*ap != ac; ap = &(*ap)->ac_next )
+			;
+		*ap = ac->ac_next;
+		k = ac->ac_slot;
+	} else {
+		/* evict the oldest entry and reuse its ring slot */
+		k = authz_cache_next++;
+		if ( authz_cache_next == authz_cache_slots )
+			authz_cache_next = 0;
+		ac = authz_cache_ring[k];
+		if ( ac ) {
+			for ( ap = &authz_cache_hash[ac->ac_hash & authz_cache_mask];
+				*ap != ac; ap = &(*ap)->ac_next )
+				;
+			*ap = ac->ac_next;
+		}
+	}
+	ch_free( ac );
+
+	len = key[0].bv_len + key[1].bv_len + key[2].bv_len +
+		( res ? res->bv_len : 0 ) + 3;
+	ac = ch_malloc( sizeof( AuthzCacheEntry ) + len );
+	authz_cache_ring[k] = ac;
+	ac->ac_slot = k;
+	ac->ac_hash = h;
+	ac->ac_type = type;
+	ac->ac_flags = flags;
+	ac->ac_be = be;
+	for ( k = 0, p = ac->ac_data; k < 4; k++ ) {
+		struct berval *bv = k < 3 ? &key[k] : res;
+
+		ac->ac_len[k] = bv ? bv->bv_len : 0;
+		if ( bv )
+			AC_MEMCPY( p, bv->bv_val, bv->bv_len );
+		p += ac->ac_len[k];
+		*p++ = '\0';
+	}
+	ap = &authz_cache_hash[h & authz_cache_mask];
+	ac->ac_next = *ap;
+	*ap = ac;
+	ac->ac_gen = gen;
+	ac->ac_time = slap_get_time();
+done:
+	ldap_pvt_thread_mutex_unlock( &authz_cache_mutex );
+}
+
 static int
 slap_sasl_match( Operation *opx, struct berval *rule,
 	struct berval *assertDN, struct berval *authc );
@@ -113,6 +370,7 @@ int slap_sasl_setpolicy( const char *arg )
 	} else {
 		rc = LDAP_OTHER;
 	}
+	authz_cache_bump();
 	return rc;
 }
 
@@ -1346,6 +1604,8 @@ int slap_sasl_rewrite_config(
 	struct berval bv;
 	struct rewrite_info *rw = sasl_rwinfo;
 
+	authz_cache_bump();
+
 	for ( last = 0; authz_rewrites && !BER_BVISNULL( &authz_rewrites[ last ] ); last++ )
 		/* count'em */ ;
 
@@ -1399,6 +1659,8 @@ int slap_sasl_rewrite_config(
 int slap_sasl_rewrite_delete( int valx ) {
 	int rc, i;
 
+	authz_cache_bump();
+
 	if ( valx == -1 ) {
 		slap_sasl_rewrite_destroy();
 		if ( authz_rewrites ) {
@@ -1494,6 +1756,8 @@ int slap_sasl_regexp_config( const char *match, const char *replace, int valx )
 	SaslRegexp_t sr;
 	struct rewrite_info *rw = NULL;
 
+	authz_cache_bump();
+
 	if ( valx < 0 || valx > nSaslRegexp )
 		valx = nSaslRegexp;
 
@@ -1568,6 +1832,8 @@ int slap_sasl_regexp_delete( int valx )
 {
 	int rc = 0;
 
+	authz_cache_bump();
+
 	if ( valx >= nSaslRegexp ) {
 		rc = 1;
 	} else if ( valx < 0 || nSaslRegexp == 1 ) {
@@ -2002,6 +2268,8 @@ slap_sasl2dn(
 	SlapReply rs = {REP_RESULT};
 	struct berval regout = BER_BVNULL;
 	struct berval base = BER_BVNULL;
+	struct berval key[3];
+	BackendDB *be;
 
 	Debug( LDAP_DEBUG_TRACE, "==>slap_sasl2dn: "
 		"converting SASL name %s to a DN\n",
@@ -2010,6 +2278,22 @@ slap_sasl2dn(
 	BER_BVZERO( sasldn );
 	cb.sc_private = sasldn;
 
+	/* the search below runs as the connection's current identity */
+	key[0] = *saslname;
+	key[1] = BER_BVISNULL( &opx->o_conn->c_ndn ) ?
+		slap_empty_bv : opx->o_conn->c_ndn;
+	key[2] = slap_empty_bv;
+	if ( authz_cache_get( AUTHZ_CACHE_SASL2DN, flags, key, sasldn, &be,
+		opx->o_tmpmemctx ))
+	{
+		if ( opx == opx->o_conn->c_sasl_bindop ) {
+			opx->o_conn->c_authz_backend = be;
+		}
+		Debug( LDAP_DEBUG_TRACE, "<==slap_sasl2dn: Converted SASL name to %s "
+			"(cached)\n", sasldn->bv_val );
+		return;
+	}
+
 	/* Convert the SASL name into a minimal URI */
 	if( !slap_authz_regexp( saslname, &regout, flags, opx->o_tmpmemctx ) ) {
 		goto FINISHED;
@@ -2091,8 +2375,12 @@ slap_sasl2dn(
 	op.o_bd->be_search( &op, &rs );
 	
 FINISHED:
-	if( opx == opx->o_conn->c_sasl_bindop && !BER_BVISEMPTY( sasldn ) ) {
-		opx->o_conn->c_authz_backend = op.o_bd;
+	if( !BER_BVISEMPTY( sasldn ) ) {
+		if( opx == opx->o_conn->c_sasl_bindop ) {
+			opx->o_conn->c_authz_backend = op.o_bd;
+		}
+		authz_cache_put( AUTHZ_CACHE_SASL2DN, flags, key, sasldn,
+			op.o_bd, opx->o_authzgen );
 	}
 	if( !BER_BVISNULL( &op.o_req_dn ) ) {
 		slap_sl_free( op.o_req_dn.bv_val, opx->o_tmpmemctx );
@@ -2122,6 +2410,7 @@ int slap_sasl_authorized( Operation *op,
 	struct berval *authcDN, struct berval *authzDN )
 {
 	int rc = LDAP_INAPPROPRIATE_AUTH;
+	struct berval key[3];
 
 	/* User binding as anonymous */
 	if ( !authzDN || !authzDN->bv_len || !authzDN->bv_val ) {
@@ -2154,13 +2443,25 @@ int slap_sasl_authorized( Operation *op,
 		}
 	}
 
+	/* the rules are read with the access rights of op->o_ndn */
+	key[0] = *authcDN;
+	key[1] = *authzDN;
+	key[2] = BER_BVISNULL( &op->o_ndn ) ? slap_empty_bv : op->o_ndn;
+	if ( authz_cache_get( AUTHZ_CACHE_AUTHORIZED, 0, key, NULL, NULL,
+		NULL ))
+	{
+		rc = LDAP_SUCCESS;
+		goto DONE;
+	}
+
 	/* Check source rules */
 	if( authz_policy & SASL_AUTHZ_TO ) {
 		rc = slap_sasl_check_authz( op, authcDN, authzDN,
 			slap_schema.si_ad_saslAuthzTo, authcDN );
 		if(( rc == LDAP_SUCCESS ) ^ (( authz_policy & SASL_AUTHZ_AND) != 0)) {
-			if( rc != LDAP_SUCCESS )
-				rc = LDAP_INAPPROPRIATE_AUTH;
+			if( rc == LDAP_SUCCESS )
+				goto AUTHORIZED;
+			rc = LDAP_INAPPROPRIATE_AUTH;
 			goto DONE;
 		}
 	}
@@ -2170,11 +2471,16 @@ int slap_sasl_authorized( Operation *op,
 		rc = slap_sasl_check_authz( op, authzDN, authcDN,
 			slap_schema.si_ad_saslAuthzFrom, authcDN );
 		if( rc == LDAP_SUCCESS ) {
-			goto DONE;
+			goto AUTHORIZED;
 		}
 	}
 
 	rc = LDAP_INAPPROPRIATE_AUTH;
+	goto DONE;
+
+AUTHORIZED:
+	authz_cache_put( AUTHZ_CACHE_AUTHORIZED, 0, key, NULL, NULL,
+		op->o_authzgen );
 
 DONE:
 
@@ -117,14 +117,18 @@ static int hashlen = LUTIL_HASH_BYTES;
 #define HASH_Update(c,buf,len)	hashupdate(c,buf,len)
 #define HASH_Final(d,c)			hashfinal(d,c)
 
-/* Toggle between 32 and 64 bit hashing, default to 32 for compatibility
-   -1 to query, returns 1 if 64 bit, 0 if 32.
-   0/1 to set 32/64, returns 0 on success, -1 on failure */
-int slap_hash64( int onoff )
+static int hashalg = SLAP_IXHASH_FNV;
+static int hashwide;
+
+static void
+hash_select( void )
 {
-	if ( onoff < 0 ) {
-		return hashlen == LUTIL_HASH64_BYTES;
-	} else if ( onoff ) {
+	if ( hashalg == SLAP_IXHASH_WYHASH ) {
+		hashinit = lutil_WYHASH64Init;
+		hashupdate = lutil_WYHASH64Update;
+		hashfinal = lutil_WYHASH64Final;
+		hashlen = LUTIL_HASH64_BYTES;
+	} else if ( hashwide ) {
 		hashinit = lutil_HASH64Init;
 		hashupdate = lutil_HASH64Update;
 		hashfinal = lutil_HASH64Final;
@@ -135,9 +139,43 @@ int slap_hash64( int onoff )
 		hashfinal = lutil_HASHFinal;
 		hashlen = LUTIL_HASH_BYTES;
 	}
+}
+
+/* Toggle between 32 and 64 bit FNV hashing, default to 32 for compatibility
+   -1 to query, returns 1 if 64 bit, 0 if 32.
+   0/1 to set 32/64, returns 0 on success, -1 on failure */
+int slap_hash64( int onoff )
+{
+	if ( onoff < 0 )
+		return hashwide;
+	hashwide = onoff != 0;
+	hash_select();
+	return 0;
+}
+
+/* Select the index hash function, SLAP_IXHASH_FNV or SLAP_IXHASH_WYHASH.
+   wyhash keys are always 64 bits wide.
+   -1 to query, returns 0 on success, -1 on failure */
+int slap_hash_alg( int alg )
+{
+	if ( alg < 0 )
+		return hashalg;
+	if ( alg != SLAP_IXHASH_FNV && alg != SLAP_IXHASH_WYHASH )
+		return -1;
+	hashalg = alg;
+	hash_select();
 	return 0;
 }
 
+/* The generation of the index keys currently produced. Backends that
+   record it can tell when their indices need rebuilding. */
+int slap_hash_generation( void )
+{
+	if ( hashalg == SLAP_IXHASH_WYHASH )
+		return SLAP_IXHASH_GEN_WYHASH64;
+	return hashwide ? SLAP_IXHASH_GEN_FNV64 : SLAP_IXHASH_GEN_FNV32;
+}
+
 #else
 #define HASH_BYTES				LUTIL_HASH_BYTES
 #define HASH_LEN				HASH_BYTES
@@ -145,7 +183,7 @@ int slap_hash64( int onoff )
 #define HASH_Update(c,buf,len)	lutil_HASHUpdate(c,buf,len)
 #define HASH_Final(d,c)			lutil_HASHFinal(d,c)
 
-int slap_has64( int onoff )
+int slap_hash64( int onoff )
 {
 	if ( onoff < 0 )
 		return 0;
@@ -153,6 +191,19 @@ int slap_has64( int onoff )
 		return onoff ? -1 : 0;
 }
 
+int slap_hash_alg( int alg )
+{
+	if ( alg < 0 )
+		return SLAP_IXHASH_FNV;
+	else
+		return alg == SLAP_IXHASH_FNV ? 0 : -1;
+}
+
+int slap_hash_generation( void )
+{
+	return SLAP_IXHASH_GEN_FNV32;
+}
+
 #endif
 #define HASH_CONTEXT			lutil_HASH_CTX
 
@@ -1873,7 +1924,9 @@ UTF8StringNormalize(
 	void *ctx )
 {
 	struct berval tmp, nvalue;
-	int flags, wasspace;
+	int flags, wasspace, fold = 0;
+	unsigned char any;
+	char *src;
 	ber_len_t i;
 
 	assert( SLAP_MR_IS_VALUE_OF_SYNTAX( use ) != 0 );
@@ -1891,10 +1944,26 @@ UTF8StringNormalize(
 	flags |= ( ( use & SLAP_MR_EQUALITY_APPROX ) == SLAP_MR_EQUALITY_APPROX )
 		? LDAP_UTF8_APPROX : 0;
 
-	val = UTF8bvnormalize( val, &tmp, flags, ctx );
-	/* out of memory or syntax error, the former is unlikely */
-	if( val == NULL ) {
-		return LDAP_INVALID_SYNTAX;
+	/* A pure ASCII value needs no Unicode normalization, only case
+	 * folding, which is done while collapsing spaces below.
+	 */
+	for ( i = 0, any = 0; i < val->bv_len; i++ ) {
+		any |= val->bv_val[i];
+	}
+	if ( !( any & 0x80 ) ) {
+		tmp.bv_len = val->bv_len;
+		tmp.bv_val = slap_sl_malloc( tmp.bv_len + 1, ctx );
+		tmp.bv_val[tmp.bv_len] = '\0';
+		src = val->bv_val;
+		fold = ( flags & LDAP_UTF8_CASEFOLD );
+
+	} else {
+		val = UTF8bvnormalize( val, &tmp, flags, ctx );
+		/* out of memory or syntax error, the former is unlikely */
+		if( val == NULL ) {
+			return LDAP_INVALID_SYNTAX;
+		}
+		src = tmp.bv_val;
 	}
 	
 	/* collapse spaces (in place) */
@@ -1906,14 +1975,14 @@ UTF8StringNormalize(
 		(( use & SLAP_MR_SUBSTR_FINAL ) == SLAP_MR_SUBSTR_FINAL ));
 
 	for( i = 0; i < tmp.bv_len; i++) {
-		if ( ASCII_SPACE( tmp.bv_val[i] )) {
+		if ( ASCII_SPACE( src[i] )) {
 			if( wasspace++ == 0 ) {
 				/* trim repeated spaces */
-				nvalue.bv_val[nvalue.bv_len++] = tmp.bv_val[i];
+				nvalue.bv_val[nvalue.bv_len++] = src[i];
 			}
 		} else {
 			wasspace = 0;
-			nvalue.bv_val[nvalue.bv_len++] = tmp.bv_val[i];
+			nvalue.bv_val[nvalue.bv_len++] = fold ? TOLOWER( src[i] ) : src[i];
 		}
 	}
 
@@ -5138,6 +5207,7 @@ csnValidate(
 	struct berval	bv;
 	char		*ptr;
 	int		rc;
+	lutil_csn	cs;
 
 	assert( in != NULL );
 	assert( !BER_BVISNULL( in ) );
@@ -5146,6 +5216,11 @@ csnValidate(
 		return LDAP_INVALID_SYNTAX;
 	}
 
+	/* the current form, checked in one go */
+	if ( lutil_csnparse( in->bv_val, in->bv_len, &cs ) == 0 ) {
+		return LDAP_SUCCESS;
+	}
+
 	bv = *in;
 
 	ptr = ber_bvchr( &bv, '#' );
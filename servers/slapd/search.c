@@ -33,6 +33,18 @@
 #include "lutil.h"
 #include "slap.h"
 
+/* what the search template control asked for */
+typedef struct SearchTemplateState {
+	SearchTemplate *sts_template;
+	BerVarray sts_values;
+} SearchTemplateState;
+
+static void search_attrs_resolve( AttributeName *an, ber_len_t siz );
+static void search_template_apply( Operation *op, ber_len_t *nattrs );
+static void search_template_free( SearchTemplate *st );
+static void search_cleanup( Operation *op, SlapReply *rs );
+static int search_requeue( Operation *op, SlapReply *rs );
+
 int
 do_search(
     Operation	*op,	/* info about the op to which we're responding */
@@ -148,49 +160,7 @@ do_search(
 		rs->sr_err = SLAPD_DISCONNECT;
 		goto return_results;
 	}
-	for ( i=0; i<siz; i++ ) {
-		const char *dummy;	/* ignore msgs from bv2ad */
-		op->ors_attrs[i].an_desc = NULL;
-		op->ors_attrs[i].an_oc = NULL;
-		op->ors_attrs[i].an_flags = 0;
-		if ( slap_bv2ad( &op->ors_attrs[i].an_name,
-			&op->ors_attrs[i].an_desc, &dummy ) != LDAP_SUCCESS )
-		{
-			if ( slap_bv2undef_ad( &op->ors_attrs[i].an_name,
-				&op->ors_attrs[i].an_desc, &dummy,
-				SLAP_AD_PROXIED|SLAP_AD_NOINSERT ) )
-			{
-				struct berval *bv = &op->ors_attrs[i].an_name;
-
-				/* RFC 4511 LDAPv3: All User Attributes */
-				if ( bvmatch( bv, slap_bv_all_user_attrs ) ) {
-					continue;
-				}
-
-				/* RFC 3673 LDAPv3: All Operational Attributes */
-				if ( bvmatch( bv, slap_bv_all_operational_attrs ) ) {
-					continue;
-				}
-
-				/* RFC 4529 LDAP: Requesting Attributes by Object Class */
-				if ( bv->bv_len > 1 && bv->bv_val[0] == '@' ) {
-					/* FIXME: check if remaining is valid oc name? */
-					continue;
-				}
-
-				/* add more "exceptions" to RFC 4511 4.5.1.8. */
-
-				/* invalid attribute description? remove */
-				if ( ad_keystring( bv ) ) {
-					/* NOTE: parsed in-place, don't modify;
-					 * rather add "1.1", which must be ignored */
-					BER_BVSTR( &op->ors_attrs[i].an_name, LDAP_NO_ATTRS );
-				}
-
-				/* otherwise leave in place... */
-			}
-		}
-	}
+	search_attrs_resolve( op->ors_attrs, siz );
 
 	if( get_ctrls( op, rs, 1 ) != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_ANY, "%s do_search: get_ctrls failed\n",
@@ -198,6 +168,11 @@ do_search(
 		goto return_results;
 	}
 
+	if ( op->o_searchTemplate ) {
+		/* the request only names the template */
+		search_template_apply( op, &siz );
+	}
+
 	Debug( LDAP_DEBUG_ARGS, "    attrs:" );
 
 	if ( siz != 0 ) {
@@ -251,6 +226,16 @@ do_search(
 	}
 
 return_results:;
+	search_cleanup( op, rs );
+
+	return rs->sr_err;
+}
+
+static void
+search_cleanup( Operation *op, SlapReply *rs )
+{
+	slap_op_slowlog( op, rs );
+
 	if ( !BER_BVISNULL( &op->o_req_dn ) ) {
 		slap_sl_free( op->o_req_dn.bv_val, op->o_tmpmemctx );
 	}
@@ -266,7 +251,130 @@ return_results:;
 	if ( op->ors_attrs != NULL ) {
 		op->o_tmpfree( op->ors_attrs, op->o_tmpmemctx );
 	}
+	if ( op->o_searchTemplate_state != NULL ) {
+		SearchTemplateState *sts = op->o_searchTemplate_state;
+
+		if ( sts->sts_values != NULL )
+			op->o_tmpfree( sts->sts_values, op->o_tmpmemctx );
+		op->o_tmpfree( sts, op->o_tmpmemctx );
+		op->o_searchTemplate_state = NULL;
+	}
+}
 
+/*
+ * Suspension of long searches. A backend may stop a search that has
+ * examined enough candidates while other tasks wait for a thread: it
+ * saves its position in op->o_extra, calls slap_search_yield() and
+ * returns SLAPD_ASYNCOP. The search is then queued again behind the
+ * waiting tasks and its backend called anew, on whichever thread
+ * picks it up, to carry on from there. Only searches that reach the
+ * backend straight from a client, with no callbacks on them, qualify.
+ */
+typedef struct SearchYield {
+	OpExtra sy_oe;
+	BackendDB *sy_be;
+} SearchYield;
+
+static SearchYield *
+search_yield_get( Operation *op )
+{
+	OpExtra *oex;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == (void *)search_yield_get )
+			return (SearchYield *)oex;
+	}
+	return NULL;
+}
+
+/* Whether the backend may suspend op now, i.e. other work is waiting
+ * for a thread. The backend must only ask for searches that had no
+ * callbacks of their own when they reached it. */
+int
+slap_search_yieldable( Operation *op )
+{
+	int pending = 0;
+
+	if ( !op->o_conn || op->o_abandon || slapd_shutdown )
+		return 0;
+	ldap_pvt_thread_pool_query( &connection_pool,
+		LDAP_PVT_THREAD_POOL_PARAM_PENDING, &pending );
+	return pending > 0;
+}
+
+void
+slap_search_yield( Operation *op )
+{
+	SearchYield *sy = ch_malloc( sizeof( SearchYield ));
+
+	sy->sy_oe.oe_key = (void *)search_yield_get;
+	sy->sy_be = op->o_bd;
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &sy->sy_oe, oe_next );
+}
+
+static void *
+search_resume( void *ctx, void *arg )
+{
+	Operation *op = arg;
+	SearchYield *sy = search_yield_get( op );
+	SlapReply rs = { REP_RESULT };
+	void *memctx = op->o_tmpmemctx, *thrmemctx;
+	int coalesce;
+
+	/* the op kept the memory context it had on its first thread */
+	thrmemctx = slap_sl_mem_create( SLAP_SLAB_SIZE, SLAP_SLAB_STACK, ctx, 0 );
+	slap_sl_mem_setctx( ctx, memctx );
+	op->o_threadctx = ctx;
+	op->o_tid = ldap_pvt_thread_pool_tid( ctx );
+
+	op->o_bd = sy->sy_be;
+	LDAP_SLIST_REMOVE( &op->o_extra, &sy->sy_oe, OpExtra, oe_next );
+	ch_free( sy );
+
+	coalesce = slap_write_coalesce_start( op );
+	op->o_bd->be_search( op, &rs );
+	if ( coalesce )
+		slap_write_coalesce_end( op );
+	op->o_bd = frontendDB;
+
+	if ( search_requeue( op, &rs ) == SLAPD_ASYNCOP ) {
+		slap_sl_mem_setctx( ctx, thrmemctx );
+		return NULL;
+	}
+
+	SLAP_PROBE4( search__done, op->o_connid, op->o_opid,
+		rs.sr_err, rs.sr_nentries );
+	search_cleanup( op, &rs );
+	connection_op_finish( op );
+	slap_op_free( op, ctx );
+	slap_sl_mem_setctx( ctx, thrmemctx );
+	slap_sl_mem_destroy( (void *)1, memctx );
+	return NULL;
+}
+
+/*
+ * Queue a suspended search again, once the current thread is done
+ * with it. Returns SLAPD_ASYNCOP if it was queued. Otherwise, which
+ * only happens while the pool is going away, the search is carried on
+ * here: slapd_shutdown is set then and the backend finishes it at once.
+ */
+static int
+search_requeue( Operation *op, SlapReply *rs )
+{
+	SearchYield *sy;
+
+	while (( sy = search_yield_get( op )) != NULL ) {
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+				search_resume, op ) == 0 )
+			return SLAPD_ASYNCOP;
+
+		op->o_bd = sy->sy_be;
+		LDAP_SLIST_REMOVE( &op->o_extra, &sy->sy_oe, OpExtra, oe_next );
+		ch_free( sy );
+		rs_reinit( rs, REP_RESULT );
+		op->o_bd->be_search( op, rs );
+		op->o_bd = frontendDB;
+	}
 	return rs->sr_err;
 }
 
@@ -402,8 +510,18 @@ fail1:
 
 	} else if ( op->o_bd->be_search ) {
 		if ( limits_check( op, rs ) == 0 ) {
+			int coalesce = slap_write_coalesce_start( op );
+
 			/* actually do the search and send the result(s) */
+			SLAP_PROBE3( search__start, op->o_connid, op->o_opid,
+				op->o_req_ndn.bv_val );
 			(op->o_bd->be_search)( op, rs );
+			if ( rs->sr_err != SLAPD_ASYNCOP )
+				SLAP_PROBE4( search__done, op->o_connid, op->o_opid,
+					rs->sr_err, rs->sr_nentries );
+
+			if ( coalesce )
+				slap_write_coalesce_end( op );
 		}
 		/* else limits_check() sends error */
 
@@ -414,6 +532,431 @@ fail1:
 
 return_results:;
 	op->o_bd = bd;
+	if ( rs->sr_err == SLAPD_ASYNCOP ) {
+		/* the op is no longer ours once queued */
+		return search_requeue( op, rs );
+	}
 	return rs->sr_err;
 }
 
+
+/* Resolve the descriptions of the requested attributes, in place */
+static void
+search_attrs_resolve( AttributeName *an, ber_len_t siz )
+{
+	ber_len_t i;
+
+	for ( i=0; i<siz; i++ ) {
+		const char *dummy;	/* ignore msgs from bv2ad */
+		an[i].an_desc = NULL;
+		an[i].an_oc = NULL;
+		an[i].an_flags = 0;
+		if ( slap_bv2ad( &an[i].an_name,
+			&an[i].an_desc, &dummy ) != LDAP_SUCCESS )
+		{
+			if ( slap_bv2undef_ad( &an[i].an_name,
+				&an[i].an_desc, &dummy,
+				SLAP_AD_PROXIED|SLAP_AD_NOINSERT ) )
+			{
+				struct berval *bv = &an[i].an_name;
+
+				/* RFC 4511 LDAPv3: All User Attributes */
+				if ( bvmatch( bv, slap_bv_all_user_attrs ) ) {
+					continue;
+				}
+
+				/* RFC 3673 LDAPv3: All Operational Attributes */
+				if ( bvmatch( bv, slap_bv_all_operational_attrs ) ) {
+					continue;
+				}
+
+				/* RFC 4529 LDAP: Requesting Attributes by Object Class */
+				if ( bv->bv_len > 1 && bv->bv_val[0] == '@' ) {
+					/* FIXME: check if remaining is valid oc name? */
+					continue;
+				}
+
+				/* add more "exceptions" to RFC 4511 4.5.1.8. */
+
+				/* invalid attribute description? remove */
+				if ( ad_keystring( bv ) ) {
+					/* NOTE: parsed in-place, don't modify;
+					 * rather add "1.1", which must be ignored */
+					BER_BVSTR( &an[i].an_name, LDAP_NO_ATTRS );
+				}
+
+				/* otherwise leave in place... */
+			}
+		}
+	}
+}
+
+/*
+ * Search templates: a client registers the fixed parts of a search it
+ * sends over and over once per connection, with the Search Template
+ * extended operation
+ *
+ *	SearchTemplateRequest ::= SEQUENCE {
+ *		baseObject	LDAPDN,
+ *		scope		ENUMERATED,
+ *		derefAliases	ENUMERATED,
+ *		typesOnly	BOOLEAN,
+ *		filter		LDAPString,
+ *		attributes	AttributeSelection
+ *	}
+ *
+ * whose response value is the templateID, an INTEGER. The filter is in
+ * string form; each equality, ordering or approx assertion whose value
+ * is a lone "?" is a parameter, numbered in the order they appear.
+ * Searches then carry the Search Template control
+ *
+ *	SearchTemplateControl ::= SEQUENCE {
+ *		templateID	INTEGER,
+ *		values		SEQUENCE OF AssertionValue
+ *	}
+ *
+ * and only their size and time limits are taken from the request; the
+ * rest comes from the template, with the values put in the parameters.
+ * The DN, the filter and the attributes are thus only parsed, resolved
+ * and normalized once, the values only need to be normalized. Templates
+ * last as long as the connection.
+ */
+const struct berval slap_EXOP_SEARCH_TEMPLATE = BER_BVC(LDAP_EXOP_X_SEARCH_TEMPLATE);
+
+/* Turn the assertions of "?" into parameters by dropping their value */
+static int
+search_template_params( Filter *f, int *n )
+{
+	switch ( f->f_choice & SLAPD_FILTER_MASK ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+	case LDAP_FILTER_NOT:
+		for ( f = f->f_list; f; f = f->f_next ) {
+			if ( search_template_params( f, n ) )
+				return -1;
+		}
+		break;
+
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		if ( f->f_av_value.bv_len != 1 || f->f_av_value.bv_val[0] != '?' )
+			break;
+		/* nothing to normalize the values with */
+		if ( ( f->f_av_desc->ad_flags & SLAP_DESC_TEMPORARY ) ||
+			f->f_av_desc->ad_type == slap_schema.si_at_undefined ||
+			f->f_av_desc->ad_type == slap_schema.si_at_proxied )
+			return -1;
+		ch_free( f->f_av_value.bv_val );
+		BER_BVZERO( &f->f_av_value );
+		/* "?" itself may have been an invalid value */
+		f->f_choice &= SLAPD_FILTER_MASK;
+		(*n)++;
+		break;
+	}
+	return 0;
+}
+
+/* Copy the template filter for op, with the n-th value and onwards
+ * in its parameters */
+static Filter *
+search_template_filter( Operation *op, Filter *f, BerVarray vals, int *n )
+{
+	Filter *nf, **p;
+	unsigned usage;
+	const char *text;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+	case LDAP_FILTER_NOT:
+		nf = op->o_tmpalloc( sizeof( Filter ), op->o_tmpmemctx );
+		nf->f_choice = f->f_choice;
+		nf->f_next = NULL;
+		for ( p = &nf->f_list, f = f->f_list; f; f = f->f_next ) {
+			*p = search_template_filter( op, f, vals, n );
+			p = &(*p)->f_next;
+		}
+		return nf;
+
+	case LDAP_FILTER_EQUALITY:
+		usage = SLAP_MR_EQUALITY;
+		break;
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		usage = SLAP_MR_ORDERING;
+		break;
+	case LDAP_FILTER_APPROX:
+		usage = SLAP_MR_EQUALITY_APPROX;
+		break;
+	default:
+		return filter_dup( f, op->o_tmpmemctx );
+	}
+
+	if ( !BER_BVISNULL( &f->f_av_value ) )
+		return filter_dup( f, op->o_tmpmemctx );
+
+	nf = op->o_tmpalloc( sizeof( Filter ), op->o_tmpmemctx );
+	nf->f_choice = f->f_choice;
+	nf->f_next = NULL;
+	nf->f_ava = op->o_tmpcalloc( 1, sizeof( AttributeAssertion ),
+		op->o_tmpmemctx );
+	nf->f_av_desc = f->f_av_desc;
+	/* as get_ava() does */
+	if ( asserted_value_validate_normalize( nf->f_av_desc,
+		ad_mr( nf->f_av_desc, usage ), usage, &vals[*n],
+		&nf->f_av_value, &text, op->o_tmpmemctx ) != LDAP_SUCCESS )
+	{
+		nf->f_choice |= SLAPD_FILTER_UNDEFINED;
+		ber_dupbv_x( &nf->f_av_value, &vals[*n], op->o_tmpmemctx );
+	}
+	(*n)++;
+	return nf;
+}
+
+int
+search_template_extop( Operation *op, SlapReply *rs )
+{
+	Connection *c = op->o_conn;
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	SearchTemplate *st;
+	struct berval base, fstr;
+	AttributeName *an = NULL;
+	ber_len_t siz = sizeof( AttributeName ), i, len;
+	ber_int_t scope, deref, attrsonly;
+	char *str = NULL, *ptr;
+	int id, rc;
+
+	if ( op->ore_reqdata == NULL ) {
+		rs->sr_text = "no request data provided";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	if ( slap_search_templates <= 0 ) {
+		rs->sr_text = "search templates are disabled";
+		return LDAP_UNWILLING_TO_PERFORM;
+	}
+
+	ber_init2( ber, op->ore_reqdata, 0 );
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+	if ( ber_scanf( ber, "{miibm{M}}", &base, &scope, &deref, &attrsonly,
+		&fstr, &an, &siz, (ber_len_t)offsetof( AttributeName, an_name ) )
+		== LBER_ERROR )
+	{
+		rs->sr_text = "search template request could not be decoded";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	st = ch_calloc( 1, sizeof( SearchTemplate ) );
+	rc = LDAP_PROTOCOL_ERROR;
+
+	switch ( scope ) {
+	case LDAP_SCOPE_BASE:
+	case LDAP_SCOPE_ONELEVEL:
+	case LDAP_SCOPE_SUBTREE:
+	case LDAP_SCOPE_SUBORDINATE:
+		break;
+	default:
+		rs->sr_text = "invalid scope";
+		goto fail;
+	}
+
+	switch ( deref ) {
+	case LDAP_DEREF_NEVER:
+	case LDAP_DEREF_FINDING:
+	case LDAP_DEREF_SEARCHING:
+	case LDAP_DEREF_ALWAYS:
+		break;
+	default:
+		rs->sr_text = "invalid deref";
+		goto fail;
+	}
+
+	st->st_scope = scope;
+	st->st_deref = deref;
+	st->st_attrsonly = attrsonly;
+
+	if ( dnPrettyNormal( NULL, &base, &st->st_dn, &st->st_ndn, NULL )
+		!= LDAP_SUCCESS )
+	{
+		rs->sr_text = "invalid DN";
+		rc = LDAP_INVALID_DN_SYNTAX;
+		goto fail;
+	}
+
+	str = ch_malloc( fstr.bv_len + 1 );
+	AC_MEMCPY( str, fstr.bv_val, fstr.bv_len );
+	str[fstr.bv_len] = '\0';
+	st->st_filter = str2filter( str );
+	if ( st->st_filter == NULL ) {
+		rs->sr_text = "invalid filter";
+		goto fail;
+	}
+	if ( search_template_params( st->st_filter, &st->st_nparams ) ) {
+		rs->sr_text = "filter parameter of an undefined attribute type";
+		rc = LDAP_UNDEFINED_TYPE;
+		goto fail;
+	}
+
+	/* the attributes are kept in one block with their names */
+	for ( i = 0, len = 0; i < siz; i++ )
+		len += an[i].an_name.bv_len + 1;
+	st->st_attrs = ch_calloc( 1, ( siz + 1 ) * sizeof( AttributeName ) + len );
+	ptr = (char *)&st->st_attrs[siz + 1];
+	for ( i = 0; i < siz; i++ ) {
+		st->st_attrs[i].an_name.bv_val = ptr;
+		st->st_attrs[i].an_name.bv_len = an[i].an_name.bv_len;
+		ptr = lutil_strncopy( ptr, an[i].an_name.bv_val,
+			an[i].an_name.bv_len ) + 1;
+	}
+	search_attrs_resolve( st->st_attrs, siz );
+	st->st_nattrs = siz;
+
+	ldap_pvt_thread_mutex_lock( &c->c_mutex );
+	if ( c->c_ntemplates >= slap_search_templates ) {
+		ldap_pvt_thread_mutex_unlock( &c->c_mutex );
+		rs->sr_text = "too many search templates";
+		rc = LDAP_ADMINLIMIT_EXCEEDED;
+		goto fail;
+	}
+	c->c_templates = ch_realloc( c->c_templates,
+		( c->c_ntemplates + 1 ) * sizeof( SearchTemplate * ) );
+	c->c_templates[c->c_ntemplates++] = st;
+	id = c->c_ntemplates;
+	ldap_pvt_thread_mutex_unlock( &c->c_mutex );
+
+	Debug( LDAP_DEBUG_STATS, "%s SEARCHTEMPLATE id=%d base=\"%s\" "
+		"scope=%d filter=\"%s\"\n",
+		op->o_log_prefix, id, st->st_dn.bv_val, st->st_scope, str );
+	ch_free( str );
+	if ( an )
+		op->o_tmpfree( an, op->o_tmpmemctx );
+
+	ber_init2( ber, NULL, LBER_USE_DER );
+	ber_printf( ber, "i", id );
+	rc = ber_flatten( ber, &rs->sr_rspdata );
+	ber_free_buf( ber );
+	return rc < 0 ? LDAP_OTHER : LDAP_SUCCESS;
+
+fail:
+	ch_free( str );
+	if ( an )
+		op->o_tmpfree( an, op->o_tmpmemctx );
+	search_template_free( st );
+	return rc;
+}
+
+int
+search_template_ctrl( Operation *op, SlapReply *rs, LDAPControl *ctrl )
+{
+	Connection *c = op->o_conn;
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	SearchTemplate *st = NULL;
+	SearchTemplateState *sts;
+	BerVarray vals = NULL;
+	ber_len_t siz = sizeof( struct berval );
+	ber_int_t id;
+
+	if ( op->o_searchTemplate != SLAP_CONTROL_NONE ) {
+		rs->sr_text = "search template control specified multiple times";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	if ( BER_BVISNULL( &ctrl->ldctl_value ) ) {
+		rs->sr_text = "search template control value is absent";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	ber_init2( ber, &ctrl->ldctl_value, 0 );
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+	if ( ber_scanf( ber, "{i{M}}", &id, &vals, &siz, (ber_len_t)0 )
+		== LBER_ERROR )
+	{
+		rs->sr_text = "search template control could not be decoded";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	ldap_pvt_thread_mutex_lock( &c->c_mutex );
+	if ( id > 0 && id <= c->c_ntemplates )
+		st = c->c_templates[id - 1];
+	ldap_pvt_thread_mutex_unlock( &c->c_mutex );
+
+	if ( st == NULL || siz != (ber_len_t)st->st_nparams ) {
+		if ( vals )
+			op->o_tmpfree( vals, op->o_tmpmemctx );
+		rs->sr_text = st ? "wrong number of search template values" :
+			"unknown search template";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	sts = op->o_tmpalloc( sizeof( SearchTemplateState ), op->o_tmpmemctx );
+	sts->sts_template = st;
+	sts->sts_values = vals;
+	op->o_searchTemplate_state = sts;
+	op->o_searchTemplate = ctrl->ldctl_iscritical
+		? SLAP_CONTROL_CRITICAL
+		: SLAP_CONTROL_NONCRITICAL;
+
+	return LDAP_SUCCESS;
+}
+
+/* Replace what the request of op asked for with its template */
+static void
+search_template_apply( Operation *op, ber_len_t *nattrs )
+{
+	SearchTemplateState *sts = op->o_searchTemplate_state;
+	SearchTemplate *st = sts->sts_template;
+	int n = 0;
+
+	op->o_tmpfree( op->o_req_dn.bv_val, op->o_tmpmemctx );
+	op->o_tmpfree( op->o_req_ndn.bv_val, op->o_tmpmemctx );
+	ber_dupbv_x( &op->o_req_dn, &st->st_dn, op->o_tmpmemctx );
+	ber_dupbv_x( &op->o_req_ndn, &st->st_ndn, op->o_tmpmemctx );
+	op->ors_scope = st->st_scope;
+	op->ors_deref = st->st_deref;
+	op->ors_attrsonly = st->st_attrsonly;
+
+	filter_free_x( op, op->ors_filter, 1 );
+	op->ors_filter = search_template_filter( op, st->st_filter,
+		sts->sts_values, &n );
+	op->o_tmpfree( op->ors_filterstr.bv_val, op->o_tmpmemctx );
+	filter2bv_x( op, op->ors_filter, &op->ors_filterstr );
+
+	if ( op->ors_attrs != NULL )
+		op->o_tmpfree( op->ors_attrs, op->o_tmpmemctx );
+	op->ors_attrs = NULL;
+	if ( st->st_nattrs ) {
+		/* the names stay with the template */
+		op->ors_attrs = op->o_tmpalloc( ( st->st_nattrs + 1 ) *
+			sizeof( AttributeName ), op->o_tmpmemctx );
+		AC_MEMCPY( op->ors_attrs, st->st_attrs,
+			( st->st_nattrs + 1 ) * sizeof( AttributeName ) );
+	}
+	*nattrs = st->st_nattrs;
+}
+
+static void
+search_template_free( SearchTemplate *st )
+{
+	ch_free( st->st_dn.bv_val );
+	ch_free( st->st_ndn.bv_val );
+	if ( st->st_filter )
+		filter_free( st->st_filter );
+	ch_free( st->st_attrs );
+	ch_free( st );
+}
+
+void
+search_templates_free( Connection *c )
+{
+	int i;
+
+	for ( i = 0; i < c->c_ntemplates; i++ )
+		search_template_free( c->c_templates[i] );
+	ch_free( c->c_templates );
+	c->c_templates = NULL;
+	c->c_ntemplates = 0;
+}
@@ -52,8 +52,13 @@
  * The allocator helps memory fragmentation, speed and memory leaks.
  * It is not (yet) reliable as a garbage collector:
  *
- * It falls back to context NULL - plain ber_memalloc() - when the
- * context's slab is full.  A reset does not reclaim such memory.
+ * When a stack context's slab is full, it chains another chunk of
+ * memory to it, as big as the segment it fills up or the request.
+ * Chunks are released by the next reset, which also grows the slab
+ * towards the task's total use (up to SLAP_SLAB_MAXBASE), so that
+ * the thread's next tasks fit in one slab.  Past SLAP_SLAB_MAXSIZE,
+ * and always for pool contexts, it falls back to context NULL - plain
+ * ber_memalloc() - and a reset does not reclaim such memory.
  * Conversely, free/realloc of data not from the given context assumes
  * context NULL.  The data must not belong to another memory context.
  *
@@ -70,6 +75,9 @@
  * by ORing *next* block's head with 1.  Freed blocks are only reclaimed
  * from the last block forward.  This is fast, but when a block is never
  * freed, older blocks will not be reclaimed until the slab is reset...
+ *
+ * Each chunk starts with a struct slab_chunk recording the segment it
+ * displaced.  Frees in displaced segments are ignored until the reset.
  */
 
 #ifdef SLAP_NO_SL_MALLOC /* Useful with memory debuggers like Valgrind */
@@ -86,6 +94,13 @@ struct slab_object {
     LDAP_LIST_ENTRY(slab_object) so_link;
 };
 
+struct slab_chunk {
+	struct slab_chunk *sc_next;	/* older chunk */
+	void *sc_base;	/* the segment this chunk displaced */
+	void *sc_last;
+	void *sc_end;
+};
+
 struct slab_heap {
     void *sh_base;
     void *sh_last;
@@ -95,6 +110,9 @@ struct slab_heap {
     unsigned char **sh_map;
     LDAP_LIST_HEAD(sh_freelist, slab_object) *sh_free;
 	LDAP_LIST_HEAD(sh_so, slab_object) sh_sopool;
+	struct slab_chunk *sh_chunks;
+	ber_len_t sh_total;	/* size of slab plus chunks */
+	ber_len_t sh_hiwat;	/* use of the last task that chained */
 };
 
 enum {
@@ -106,6 +124,7 @@ enum {
 };
 
 static struct slab_object * slap_replenish_sopool(struct slab_heap* sh);
+static int slap_sl_chunked(struct slab_heap *sh, void *ptr);
 #ifdef SLAPD_UNUSED
 static void print_slheap(int level, void *ctx);
 #endif
@@ -119,6 +138,27 @@ static void print_slheap(int level, void *ctx);
 	 (void) ldap_pvt_thread_pool_getkey(thrctx,memctx_key, memctxp,NULL), \
 	 *(memctxp))
 
+static ldap_pvt_thread_mutex_t slab_mutex;
+static unsigned long slab_chunks, slab_fallbacks;
+
+/* Only counted on the slow paths, which call ch_malloc anyway */
+#define SLAB_COUNT(n) ( \
+	ldap_pvt_thread_mutex_lock( &slab_mutex ), (n)++, \
+	ldap_pvt_thread_mutex_unlock( &slab_mutex ) )
+
+/*
+ * Chunks chained to stack contexts, and allocations which fell back
+ * to context NULL, since slapd started.
+ */
+void
+slap_sl_stats( unsigned long *chunks, unsigned long *fallbacks )
+{
+	ldap_pvt_thread_mutex_lock( &slab_mutex );
+	*chunks = slab_chunks;
+	*fallbacks = slab_fallbacks;
+	ldap_pvt_thread_mutex_unlock( &slab_mutex );
+}
+
 /* Destroy the context, or if key==NULL clean it up for reuse. */
 void
 slap_sl_mem_destroy(
@@ -133,6 +173,24 @@ slap_sl_mem_destroy(
 	if (!sh)
 		return;
 
+	if (sh->sh_stack && sh->sh_chunks) {
+		struct slab_chunk *sc;
+		ber_len_t used = (char *) sh->sh_last - (char *) sh->sh_base;
+
+		/* Pop the chunks, back to the original slab */
+		while ((sc = sh->sh_chunks) != NULL) {
+			used += (char *) sc->sc_last - (char *) sc->sc_base;
+			sh->sh_base = sc->sc_base;
+			sh->sh_last = sc->sc_last;
+			sh->sh_end = sc->sc_end;
+			sh->sh_chunks = sc->sc_next;
+			ber_memfree_x(sc, NULL);
+		}
+		if (used > SLAP_SLAB_MAXBASE)
+			used = SLAP_SLAB_MAXBASE;
+		sh->sh_hiwat = used;
+	}
+
 	if (!sh->sh_stack) {
 		for (i = 0; i <= sh->sh_maxorder - order_start; i++) {
 			so = LDAP_LIST_FIRST(&sh->sh_free[i]);
@@ -176,6 +234,8 @@ slap_sl_mem_init()
 {
 	assert( Align == 1 << Align_log2 );
 
+	ldap_pvt_thread_mutex_init( &slab_mutex );
+
 	ber_set_option( NULL, LBER_OPT_MEMORY_FNS, &slap_sl_mfuncs );
 }
 
@@ -199,12 +259,15 @@ slap_sl_mem_create(
 	if ( sh && !new )
 		return sh;
 
+	if ( sh && stack && size < sh->sh_hiwat )
+		size = sh->sh_hiwat;
+
 	/* Round up to doubleword boundary, then make room for initial
 	 * padding, preserving expected available size for pool version */
 	size = ((size + Align-1) & -Align) + Base_offset;
 
 	if (!sh) {
-		sh = ch_malloc(sizeof(struct slab_heap));
+		sh = ch_calloc(1, sizeof(struct slab_heap));
 		base = ch_malloc(size);
 		SET_MEMCTX(thrctx, sh, slap_sl_mem_destroy);
 		VGMEMP_MARK(base, size);
@@ -213,7 +276,8 @@ slap_sl_mem_create(
 		slap_sl_mem_destroy(NULL, sh);
 		base = sh->sh_base;
 		if (size > (ber_len_t) ((char *) sh->sh_end - base)) {
-			newptr = ch_realloc(base, size);
+			/* Not ch_realloc(), which would find base in our slab */
+			newptr = ber_memrealloc_x(base, size, NULL);
 			if ( newptr == NULL ) return NULL;
 			VGMEMP_CHANGE(sh, base, newptr, size);
 			base = newptr;
@@ -222,6 +286,7 @@ slap_sl_mem_create(
 	}
 	sh->sh_base = base;
 	sh->sh_end = base + size;
+	sh->sh_total = size;
 
 	/* Align (base + head of first block) == first returned block */
 	base += Base_offset;
@@ -320,6 +385,40 @@ slap_sl_malloc(
 			return( (void *)newptr );
 		}
 
+		/* Chain a new chunk, at least as big as the full segment */
+		if (sh->sh_total + size < SLAP_SLAB_MAXSIZE) {
+			enum {
+				Chunk_head = (sizeof(struct slab_chunk) + Align-1) & -Align,
+				Base_offset = (unsigned) -sizeof(ber_len_t) % Align
+			};
+			struct slab_chunk *sc;
+			ber_len_t len = (char *) sh->sh_end - (char *) sh->sh_base;
+
+			if (len <= size)
+				len = size + Align;
+			if (len > SLAP_SLAB_MAXSIZE - sh->sh_total)
+				len = SLAP_SLAB_MAXSIZE - sh->sh_total;
+			len += Base_offset;
+
+			sc = ch_malloc(Chunk_head + len);
+			sc->sc_next = sh->sh_chunks;
+			sc->sc_base = sh->sh_base;
+			sc->sc_last = sh->sh_last;
+			sc->sc_end = sh->sh_end;
+			sh->sh_chunks = sc;
+			sh->sh_base = (char *) sc + Chunk_head;
+			sh->sh_end = (char *) sh->sh_base + len;
+			sh->sh_total += len;
+			SLAB_COUNT(slab_chunks);
+			VGMEMP_MARK(sh->sh_base, len);
+
+			newptr = (ber_len_t *) ((char *) sh->sh_base + Base_offset);
+			sh->sh_last = (char *) newptr + size;
+			VGMEMP_ALLOC(sh, newptr, size);
+			*newptr++ = size;
+			return( (void *)newptr );
+		}
+
 		size -= sizeof(ber_len_t);
 
 	} else {
@@ -383,6 +482,7 @@ slap_sl_malloc(
 	Debug(LDAP_DEBUG_TRACE,
 		"sl_malloc %lu: ch_malloc\n",
 		(unsigned long) size );
+	SLAB_COUNT(slab_fallbacks);
 	return ch_malloc(size);
 }
 
@@ -420,7 +520,8 @@ slap_sl_realloc(void *ptr, ber_len_t size, void *ctx)
 		return slap_sl_malloc(size, ctx);
 
 	/* Not our memory? */
-	if (No_sl_malloc || !sh || ptr < sh->sh_base || ptr >= sh->sh_end) {
+	if (No_sl_malloc || !sh || ((ptr < sh->sh_base || ptr >= sh->sh_end) &&
+			!slap_sl_chunked(sh, ptr))) {
 		/* Like ch_realloc(), except not trying a new context */
 		newptr = ber_memrealloc_x(ptr, size, NULL);
 		if (newptr) {
@@ -453,8 +554,14 @@ slap_sl_realloc(void *ptr, ber_len_t size, void *ctx)
 		oldsize &= -2;
 		nextp = (ber_len_t *) ((char *) p + oldsize);
 
+		/* In a displaced segment, just copy */
+		if (ptr < sh->sh_base || ptr >= sh->sh_end) {
+			newptr = slap_sl_malloc(size-sizeof(ber_len_t), ctx);
+			AC_MEMCPY(newptr, ptr, oldsize-sizeof(ber_len_t));
+			return newptr;
+
 		/* If reallocing the last block, try to grow it */
-		if (nextp == sh->sh_last) {
+		} else if (nextp == sh->sh_last) {
 			if (size < (ber_len_t) ((char *) sh->sh_end - (char *) p)) {
 				sh->sh_last = (char *) p + size;
 				p[0] = (p[0] & 1) | size;
@@ -496,7 +603,9 @@ slap_sl_free(void *ptr, void *ctx)
 		return;
 
 	if (No_sl_malloc || !sh || ptr < sh->sh_base || ptr >= sh->sh_end) {
-		ber_memfree_x(ptr, NULL);
+		/* Displaced segments are reclaimed by the reset */
+		if (!sh || !slap_sl_chunked(sh, ptr))
+			ber_memfree_x(ptr, NULL);
 		return;
 	}
 
@@ -647,7 +756,22 @@ void
 slap_sl_release( void *ptr, void *ctx )
 {
 	struct slab_heap *sh = ctx;
-	if ( sh && ptr >= sh->sh_base && ptr <= sh->sh_end )
+	struct slab_chunk *sc;
+
+	if ( !sh )
+		return;
+
+	/* Drop the chunks chained since the mark */
+	while ( ( ptr < sh->sh_base || ptr > sh->sh_end ) &&
+			slap_sl_chunked( sh, ptr ) ) {
+		sc = sh->sh_chunks;
+		sh->sh_total -= (char *) sh->sh_end - (char *) sh->sh_base;
+		sh->sh_base = sc->sc_base;
+		sh->sh_end = sc->sc_end;
+		sh->sh_chunks = sc->sc_next;
+		ber_memfree_x( sc, NULL );
+	}
+	if ( ptr >= sh->sh_base && ptr <= sh->sh_end )
 		sh->sh_last = ptr;
 }
 
@@ -671,12 +795,26 @@ slap_sl_context( void *ptr )
 	if ( slapMode & SLAP_TOOL_MODE ) return NULL;
 
 	sh = GET_MEMCTX(ldap_pvt_thread_pool_context(), &memctx);
-	if (sh && ptr >= sh->sh_base && ptr <= sh->sh_end) {
+	if (sh && ((ptr >= sh->sh_base && ptr <= sh->sh_end) ||
+			slap_sl_chunked(sh, ptr))) {
 		return sh;
 	}
 	return NULL;
 }
 
+/* Does ptr point into a segment displaced by a chunk? */
+static int
+slap_sl_chunked( struct slab_heap *sh, void *ptr )
+{
+	struct slab_chunk *sc;
+
+	for ( sc = sh->sh_chunks; sc; sc = sc->sc_next ) {
+		if ( ptr >= sc->sc_base && ptr < sc->sc_end )
+			return 1;
+	}
+	return 0;
+}
+
 static struct slab_object *
 slap_replenish_sopool(
     struct slab_heap* sh
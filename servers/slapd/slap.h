@@ -48,6 +48,26 @@
 
 #include "ldap_log.h"
 
+#if defined(LDAP_DEBUG) && !defined(LDAP_INT_DEBUG)
+/* slapd routes its messages through slap_log_print(), which may
+ * hand them to the log writer thread instead of writing them out */
+#undef Log
+#ifdef LDAP_SYSLOG
+#define Log(level, severity, ...) \
+	do { \
+		if ( ( ldap_debug | ldap_syslog ) & (level) ) \
+			slap_log_print( (level), LDAP_LEVEL_MASK((severity)), \
+				__VA_ARGS__ ); \
+	} while ( 0 )
+#else /* ! LDAP_SYSLOG */
+#define Log(level, severity, ...) \
+	do { \
+		if ( ldap_debug & (level) ) \
+			slap_log_print( (level), 0, __VA_ARGS__ ); \
+	} while ( 0 )
+#endif /* ! LDAP_SYSLOG */
+#endif /* LDAP_DEBUG && ! LDAP_INT_DEBUG */
+
 #include <ldap.h>
 #include <ldap_schema.h>
 
@@ -80,6 +100,25 @@ LDAP_BEGIN_DECL
 #define SLAP_STATS_ETIME	1 /* microsecond op timing */
 #endif
 
+/*
+ * USDT static probes in the "slapd" provider, for perf, bpftrace or
+ * SystemTap.  They compile to nothing unless configured with
+ * --enable-probes, and to a single nop until a tracer attaches
+ * otherwise, so their arguments must be cheap to evaluate.
+ */
+#ifdef SLAPD_PROBES
+#include <sys/sdt.h>
+#define SLAP_PROBE1(name,a)		DTRACE_PROBE1(slapd,name,a)
+#define SLAP_PROBE2(name,a,b)		DTRACE_PROBE2(slapd,name,a,b)
+#define SLAP_PROBE3(name,a,b,c)		DTRACE_PROBE3(slapd,name,a,b,c)
+#define SLAP_PROBE4(name,a,b,c,d)	DTRACE_PROBE4(slapd,name,a,b,c,d)
+#else
+#define SLAP_PROBE1(name,a)		((void)0)
+#define SLAP_PROBE2(name,a,b)		((void)0)
+#define SLAP_PROBE3(name,a,b,c)		((void)0)
+#define SLAP_PROBE4(name,a,b,c,d)	((void)0)
+#endif
+
 /*
  * SLAPD Memory allocation macros
  *
@@ -141,6 +180,7 @@ LDAP_BEGIN_DECL
 
 #define SLAP_CONN_MAX_PENDING_DEFAULT	100
 #define SLAP_CONN_MAX_PENDING_AUTH	1000
+#define SLAP_CONN_OPHASH	32	/* msgid hash buckets per connection, power of 2 */
 
 #define SLAP_TEXT_BUFLEN (256)
 
@@ -250,6 +290,8 @@ typedef struct slap_ssf_set {
 #define SLAP_INDEX_APPROX         0x0008UL
 #define SLAP_INDEX_SUBSTR         0x0010UL
 #define SLAP_INDEX_EXTENDED		  0x0020UL
+#define SLAP_INDEX_SORT           0x0040UL	/* values kept in order */
+#define SLAP_INDEX_RANGE          0x0080UL	/* ordered keys in buckets */
 
 #define SLAP_INDEX_DEFAULT        SLAP_INDEX_EQUALITY
 
@@ -277,6 +319,15 @@ typedef struct slap_ssf_set {
 /* default for ordered integer index keys */
 #define SLAP_INDEX_INTLEN_DEFAULT	4
 
+/* index key hash functions, see slap_hash_alg() */
+#define SLAP_IXHASH_FNV		0
+#define SLAP_IXHASH_WYHASH	1
+
+/* generations of index keys, as recorded by backends */
+#define SLAP_IXHASH_GEN_FNV32	1
+#define SLAP_IXHASH_GEN_FNV64	2
+#define SLAP_IXHASH_GEN_WYHASH64	3
+
 #define SLAP_INDEX_FLAGS         0xF000UL
 #define SLAP_INDEX_NOSUBTYPES    0x1000UL /* don't use index w/ subtypes */
 #define SLAP_INDEX_NOTAGS        0x2000UL /* don't use index w/ tags */
@@ -350,6 +401,7 @@ typedef struct ContentRule ContentRule;
 typedef struct AttributeAssertion AttributeAssertion;
 typedef struct SubstringsAssertion SubstringsAssertion;
 typedef struct Filter Filter;
+typedef struct FilterProg FilterProg;
 typedef struct ValuesReturnFilter ValuesReturnFilter;
 typedef struct Attribute Attribute;
 #ifdef LDAP_COMP_MATCH
@@ -687,6 +739,23 @@ typedef struct slap_mrule_defs_rec {
 	char *						mrd_associated;
 } slap_mrule_defs_rec;
 
+/*
+ * Case-insensitive hash of schema names, kept next to the attributeType
+ * and objectClass AVL indices for fast lookups. Each slot points to the
+ * name at the start of an index record.
+ */
+typedef struct SlapNameSlot {
+	unsigned		ns_hash;
+	struct berval	*ns_name;
+} SlapNameSlot;
+
+typedef struct SlapNameHash {
+	SlapNameSlot	*nh_slots;
+	unsigned		nh_size;	/* power of 2 */
+	unsigned		nh_used;	/* live and deleted slots */
+	unsigned		nh_live;
+} SlapNameHash;
+
 typedef int (AttributeTypeSchemaCheckFN)(
 	BackendDB *be,
 	Entry *e,
@@ -910,6 +979,7 @@ struct slap_internal_schema {
 	AttributeDescription *si_ad_modifiersName;
 	AttributeDescription *si_ad_modifyTimestamp;
 	AttributeDescription *si_ad_hasSubordinates;
+	AttributeDescription *si_ad_numSubordinates;
 	AttributeDescription *si_ad_subschemaSubentry;
 	AttributeDescription *si_ad_collectiveSubentries;
 	AttributeDescription *si_ad_collectiveExclusions;
@@ -1175,12 +1245,15 @@ struct Attribute {
 #define SLAP_ATTR_DONT_FREE_VALS	0x8U
 #define	SLAP_ATTR_SORTED_VALS		0x10U	/* values are sorted */
 #define	SLAP_ATTR_BIG_MULTI		0x20U	/* for backends */
+#define	SLAP_ATTR_HASH_WANT		0x40U	/* looked up once, hash next time */
+#define	SLAP_ATTR_HASHED		0x80U	/* a_hash is set */
 
 /* These flags persist across an attr_dup() */
 #define	SLAP_ATTR_PERSISTENT_FLAGS \
 	(SLAP_ATTR_SORTED_VALS|SLAP_ATTR_BIG_MULTI)
 
 	Attribute		*a_next;
+	struct AttrValHash	*a_hash;	/* attr_valfind() index, if HASHED */
 #ifdef LDAP_COMP_MATCH
 	ComponentData		*a_comp_data;	/* component values */
 #endif
@@ -1547,6 +1620,7 @@ typedef struct AccessControl {
 	slap_style_t acl_dn_style;
 	regex_t		acl_dn_re;
 	struct berval	acl_dn_pat;
+	struct berval	acl_dn_tail;	/* literal suffix of a regex, in acl_dn_pat */
 	AttributeName	*acl_attrs;
 	MatchingRule	*acl_attrval_mr;
 	slap_style_t	acl_attrval_style;
@@ -1579,8 +1653,25 @@ typedef struct AccessControlState {
 
 	/* True if started to process frontend ACLs */
 	int as_fe_done;
+
+	/* Outcome of the <what> DN and filter tests of ACLs,
+	 * hashed by ACL; only valid for am_e, and kept across
+	 * attributes */
+#define	ACL_MEMO_SLOTS	32
+	struct AclEntryMemo {
+		Entry *am_e;
+		struct berval am_ndn;
+		struct {
+			AccessControl *ae_acl;
+			int ae_flags;
+#define	ACL_MEMO_SKIP	0x1	/* DN or filter did not match */
+#define	ACL_MEMO_DN	0x2	/* non-regex DN matched */
+#define	ACL_MEMO_FILTER	0x4	/* filter matched */
+		} am_ent[ACL_MEMO_SLOTS];
+	} as_memo;
 } AccessControlState;
-#define ACL_STATE_INIT { NULL, ACL_NONE, NULL, 0, 0, ACL_PRIV_NONE, -1, 0 }
+#define ACL_STATE_INIT { NULL, ACL_NONE, NULL, 0, 0, ACL_PRIV_NONE, -1, 0, \
+	{ NULL, BER_BVNULL } }
 
 typedef struct AclRegexMatches {        
 	int dn_count;
@@ -1780,10 +1871,26 @@ struct sync_cookie {
 
 LDAP_STAILQ_HEAD( slap_sync_cookie_s, sync_cookie );
 
-LDAP_TAILQ_HEAD( be_pcl, slap_csn_entry );
+/* Pending CSNs of a database, spread over lists by SID. A CSN can
+ * only be committed once the pending CSNs of its SID queued before it
+ * are, so only writers whose SIDs share a list wait on each other.
+ */
+#define SLAP_PCL_PARTS	16	/* must be a power of 2 */
+
+struct be_pcl_part {
+	LDAP_TAILQ_HEAD( be_pcl_list, slap_csn_entry ) pp_list;
+	ldap_pvt_thread_mutex_t	pp_mutex;
+};
+
+struct be_pcl {
+	struct be_pcl_part pcl_parts[SLAP_PCL_PARTS];
+};
+
+#define SLAP_PCL_PART( pcl, sid ) \
+	( &(pcl)->pcl_parts[ (sid) & (SLAP_PCL_PARTS-1) ] )
 
 #ifndef SLAP_MAX_CIDS
-#define	SLAP_MAX_CIDS	32	/* Maximum number of supported controls */
+#define	SLAP_MAX_CIDS	40	/* Maximum number of supported controls */
 #endif
 
 struct ConfigOCs;	/* config.h */
@@ -1935,6 +2042,14 @@ struct BackendDB {
 	| SLAP_RESTRICT_OP_BIND \
 	| SLAP_RESTRICT_OP_EXTENDED )
 
+/* connection_pool_priority uses the SLAP_RESTRICT_OP_* bits, plus: */
+#define SLAP_PRIORITY_OP_BASE		0x00010000U	/* base scope search */
+#define SLAP_PRIORITY_OP_DEFAULT \
+	( SLAP_RESTRICT_OP_BIND \
+	| SLAP_RESTRICT_OP_COMPARE \
+	| SLAP_RESTRICT_OP_EXTENDED \
+	| SLAP_PRIORITY_OP_BASE )
+
 #define SLAP_ALLOW_BIND_V2		0x0001U	/* LDAPv2 bind */
 #define SLAP_ALLOW_BIND_ANON_CRED	0x0002U /* cred should be empty */
 #define SLAP_ALLOW_BIND_ANON_DN		0x0004U /* dn should be empty */
@@ -1983,12 +2098,15 @@ struct BackendDB {
 	struct berval be_update_ndn;	/* allowed to make changes (in replicas) */
 	BerVarray	be_update_refs;	/* where to refer modifying clients to */
 	struct		be_pcl	*be_pending_csn_list;
-	ldap_pvt_thread_mutex_t					be_pcl_mutex;
 	struct syncinfo_s						*be_syncinfo; /* For syncrepl */
 
 	void    *be_pb;         /* Netscape plugin */
+	void    *be_pb_types;   /* bitmap of registered plugin functions */
 	struct ConfigOCs *be_cf_ocs;
 
+	/* latency histograms, SLAP_HISTO_NUM of them, kept by back-monitor */
+	struct slap_histo_t	*be_histo;
+
 	void	*be_private;	/* anything the backend database needs 	   */
 	LDAP_STAILQ_ENTRY(BackendDB) be_next;
 };
@@ -2209,6 +2327,9 @@ typedef int (BI_op_txn) LDAP_P(( Operation *op, int txnop, struct OpExtra **ptr
 #define SLAP_TXN_BEGIN	1
 #define SLAP_TXN_COMMIT	2
 #define SLAP_TXN_ABORT	3
+#define SLAP_TXN_SAVEPOINT	4	/* nest the next update of a bulk txn */
+#define SLAP_TXN_RELEASE	5	/* keep its changes */
+#define SLAP_TXN_ROLLBACK	6	/* discard them */
 
 typedef int (BI_conn_func) LDAP_P(( BackendDB *bd, Connection *c ));
 typedef BI_conn_func BI_connection_init;
@@ -2230,6 +2351,23 @@ typedef ID (BI_tool_entry_modify) LDAP_P(( BackendDB *be, Entry *e,
 typedef int (BI_tool_entry_delete) LDAP_P(( BackendDB *be, struct berval *ndn,
 	struct berval *text ));
 
+/* State of a slapbench run, handed to the backend's bench hook */
+typedef struct slap_bench {
+	Operation	*sb_op;
+	Entry		**sb_entries;	/* the dataset, from LDIF or the database */
+	int		sb_nentries;
+	char		**sb_names;	/* benchmarks to run, NULL for all */
+
+	/* private to slap_bench_start/slap_bench_more */
+	const char	*sb_name;
+	struct timeval	sb_start;
+	unsigned long	sb_ops;
+	unsigned long	sb_allocs;
+	unsigned long	sb_bytes;
+} slap_bench;
+
+typedef int (BI_tool_bench) LDAP_P(( BackendDB *be, slap_bench *sb ));
+
 struct BackendInfo {
 	char	*bi_type; /* type of backend */
 
@@ -2332,6 +2470,7 @@ struct BackendInfo {
 	BI_tool_dn2id_get	*bi_tool_dn2id_get;
 	BI_tool_entry_modify	*bi_tool_entry_modify;
 	BI_tool_entry_delete	*bi_tool_entry_delete;
+	BI_tool_bench		*bi_tool_bench;
 
 #define SLAP_INDEX_ADD_OP		0x0001
 #define SLAP_INDEX_DELETE_OP	0x0002
@@ -2466,6 +2605,21 @@ typedef struct PagedResultsState {
 	struct berval ps_cookieval;
 } PagedResultsState;
 
+/*
+ * Search template registered on a connection, see search.c
+ */
+typedef struct SearchTemplate {
+	struct berval st_dn;
+	struct berval st_ndn;
+	int st_scope;
+	int st_deref;
+	int st_attrsonly;
+	Filter *st_filter;	/* parameters have no assertion value */
+	int st_nparams;
+	AttributeName *st_attrs;
+	int st_nattrs;
+} SearchTemplate;
+
 struct slap_csn_entry {
 	Operation *ce_op;
 	struct berval ce_csn;
@@ -2512,6 +2666,8 @@ struct slap_control_ids {
 	int sc_treeDelete;
 #endif
 	int sc_txnSpec;
+	int sc_txnBulk;
+	int sc_searchTemplate;
 #ifdef SLAP_CONTROL_X_SESSION_TRACKING
 	int sc_sessionTracking;
 #endif
@@ -2541,6 +2697,87 @@ typedef enum {
 	SLAP_OP_LAST
 } slap_op_t;
 
+/*
+ * Latency histograms: microseconds in log-linear buckets, exact below
+ * SLAP_HISTO_SUB and then SLAP_HISTO_SUB buckets per power of two
+ * (about 12% resolution); the last bucket also counts anything slower.
+ */
+typedef enum {
+	SLAP_PHASE_QUEUE = 0,	/* waiting for a thread */
+	SLAP_PHASE_EXEC,	/* backend, net of ACL and send time */
+	SLAP_PHASE_ACL,		/* access control checks */
+	SLAP_PHASE_SEND,	/* writing responses */
+	SLAP_PHASE_LAST
+} slap_phase_t;
+
+#define SLAP_HISTO_SUBBITS	3
+#define SLAP_HISTO_SUB		(1 << SLAP_HISTO_SUBBITS)
+#define SLAP_HISTO_BUCKETS	(SLAP_HISTO_SUB * 28)
+
+typedef struct slap_histo_t {
+	unsigned long	sh_bucket[SLAP_HISTO_BUCKETS];
+	unsigned long	sh_max;
+} slap_histo_t;
+
+/* one histogram per operation type and phase */
+#define SLAP_HISTO_NUM		(SLAP_OP_LAST * SLAP_PHASE_LAST)
+#define SLAP_HISTO_IDX(opidx, phase)	((opidx) * SLAP_PHASE_LAST + (phase))
+
+/* logbuffer-policy, when a thread's log buffer is full */
+#define SLAP_LOG_BLOCK	0	/* wait for the writer thread */
+#define SLAP_LOG_DROP	1	/* discard the message */
+
+/*
+ * What an op did, for the slow-op log
+ */
+typedef struct slap_op_profile_t {
+	unsigned long	sp_scanned;	/* candidates examined by the backend */
+	unsigned long	sp_bytes;	/* bytes sent */
+	int		sp_planlen;
+	char		sp_plan[ SLAP_TEXT_BUFLEN ];	/* index lookups */
+} slap_op_profile_t;
+
+/*
+ * Hot-path profiling: calls to and CPU ticks spent in a few inner
+ * routines, counted per thread while "profiling" is on. Nested calls
+ * of the same kind are folded into the outermost one.
+ */
+typedef enum {
+	SLAP_PROF_KEYREAD = 0,	/* index key reads */
+	SLAP_PROF_IDL,		/* ID list intersections and unions */
+	SLAP_PROF_DECODE,	/* entry decoding */
+	SLAP_PROF_FILTER,	/* filter evaluation */
+	SLAP_PROF_NORMALIZE,	/* DN and attribute value normalization */
+	SLAP_PROF_ENCODE,	/* BER encoding of search entries */
+	SLAP_PROF_LAST
+} slap_prof_t;
+
+#ifdef HAVE_LONG_LONG
+typedef unsigned long long slap_prof_tick_t;
+#else
+typedef unsigned long slap_prof_tick_t;
+#endif
+
+typedef struct slap_prof_counter_t {
+	unsigned long		spc_calls;
+	slap_prof_tick_t	spc_ticks;
+} slap_prof_counter_t;
+
+typedef struct slap_prof_ctx_t {
+	struct slap_prof_thread_t	*pc_thread;	/* NULL if not counting */
+	slap_prof_tick_t		pc_start;	/* 0 if nested */
+} slap_prof_ctx_t;
+
+#define SLAP_PROF_BEGIN(pc, which) \
+	((pc).pc_thread = slap_profiling ? \
+		slap_prof_begin( (which), &(pc).pc_start ) : NULL)
+#define SLAP_PROF_END(pc, which) do { \
+		if ( (pc).pc_thread ) { \
+			slap_prof_end( (pc).pc_thread, (which), (pc).pc_start ); \
+			(pc).pc_thread = NULL; \
+		} \
+	} while ( 0 )
+
 typedef struct slap_counters_t {
 	struct slap_counters_t	*sc_next;
 	ldap_pvt_thread_mutex_t	sc_mutex;
@@ -2554,6 +2791,7 @@ typedef struct slap_counters_t {
 #ifdef SLAPD_MONITOR
 	ldap_pvt_mp_t		sc_ops_completed_[SLAP_OP_LAST];
 	ldap_pvt_mp_t		sc_ops_initiated_[SLAP_OP_LAST];
+	slap_histo_t		*sc_histo;	/* SLAP_HISTO_NUM, or NULL */
 #endif /* SLAPD_MONITOR */
 } slap_counters_t;
 
@@ -2576,6 +2814,14 @@ typedef struct Opheader {
 
 	slap_counters_t	*oh_counters;
 
+	/* latency accounting, shared by copies of the op */
+	struct timeval	oh_xtime;	/* start of execution */
+	unsigned long	oh_acl_usec;
+	unsigned long	oh_send_usec;
+	int		oh_acl_depth;
+	struct slap_histo_t	*oh_histo;	/* of the database that replied */
+	slap_op_profile_t	*oh_profile;	/* if slowop-threshold is set */
+
 	char		oh_log_prefix[ /* sizeof("conn= op=") + 2*LDAP_PVT_INTTYPE_CHARS(unsigned long) */ SLAP_TEXT_BUFLEN ];
 
 #ifdef LDAP_SLAPI
@@ -2610,6 +2856,29 @@ typedef struct OpExtraDB {
 	BackendDB *oe_db;
 } OpExtraDB;
 
+/* A VLV request on a single ascending sort key, offered by the
+ * sssvlv overlay to a backend that can return the window itself
+ * from an ordered index. The backend sets ss_sorted if it did; the
+ * overlay then passes its entries through and builds the response
+ * controls from the ss_vlv_* results. Looked up with
+ * slap_sorted_search().
+ */
+typedef struct SortedSearch {
+	OpExtra ss_oe;
+	AttributeDescription *ss_ad;
+	MatchingRule *ss_ordering;
+	int ss_before;
+	int ss_after;
+	int ss_offset;
+	int ss_count;
+	struct berval ss_value;		/* target by value if not NULL */
+
+	int ss_sorted;
+	int ss_vlv_rc;
+	int ss_vlv_target;
+	int ss_vlv_count;
+} SortedSearch;
+
 struct Operation {
 	Opheader *o_hdr;
 
@@ -2623,6 +2892,12 @@ struct Operation {
 #define o_tmpmemctx o_hdr->oh_tmpmemctx
 #define o_tmpmfuncs o_hdr->oh_tmpmfuncs
 #define o_counters o_hdr->oh_counters
+#define o_xtime o_hdr->oh_xtime
+#define o_acl_usec o_hdr->oh_acl_usec
+#define o_send_usec o_hdr->oh_send_usec
+#define o_acl_depth o_hdr->oh_acl_depth
+#define o_histo o_hdr->oh_histo
+#define o_profile o_hdr->oh_profile
 
 #define	o_tmpalloc	o_tmpmfuncs->bmf_malloc
 #define o_tmpcalloc	o_tmpmfuncs->bmf_calloc
@@ -2702,15 +2977,20 @@ struct Operation {
 #define SLAP_CANCEL_DONE				0x03
 
 	GroupAssertion *o_groups;
+	unsigned long o_groupgen;	/* group cache generation at op start */
+	unsigned long o_authzgen;	/* authz cache generation at op start */
 	char o_do_not_cache;	/* don't cache groups from this op */
 	char o_is_auth_check;	/* authorization in progress */
 	char o_dont_replicate;
+	char o_pending;		/* on c_pending_ops rather than c_ops */
 	slap_access_t o_acl_priv;
 
 	char o_nocaching;
 	char o_delete_glue_parent;
 	char o_no_schema_check;
 #define get_no_schema_check(op)			((op)->o_no_schema_check)
+#define SLAP_NO_SCHEMA_CHECK_TRUSTED	2	/* values need no syntax validation */
+#define get_no_syntax_check(op)			((op)->o_no_schema_check == SLAP_NO_SCHEMA_CHECK_TRUSTED)
 	char o_no_subordinate_glue;
 #define get_no_subordinate_glue(op)		((op)->o_no_subordinate_glue)
 
@@ -2785,6 +3065,10 @@ struct Operation {
 #endif
 
 #define o_txnSpec		o_ctrlflag[slap_cids.sc_txnSpec]
+#define o_txnBulk		o_ctrlflag[slap_cids.sc_txnBulk]
+
+#define o_searchTemplate	o_ctrlflag[slap_cids.sc_searchTemplate]
+#define o_searchTemplate_state	o_controls[slap_cids.sc_searchTemplate]
 
 #ifdef SLAP_CONTROL_X_SESSION_TRACKING
 #define o_session_tracking	o_ctrlflag[slap_cids.sc_sessionTracking]
@@ -2817,6 +3101,7 @@ struct Operation {
 	LDAP_SLIST_HEAD(o_e, OpExtra) o_extra;	/* anything the backend needs */
 
 	LDAP_STAILQ_ENTRY(Operation)	o_next;	/* next operation in list */
+	struct Operation	*o_hnext;	/* next in connection's msgid hash */
 };
 
 typedef struct OperationBuffer {
@@ -2929,6 +3214,7 @@ struct Connection {
 
 	LDAP_STAILQ_HEAD(c_o, Operation) c_ops;	/* list of operations being processed */
 	LDAP_STAILQ_HEAD(c_po, Operation) c_pending_ops;	/* list of pending operations */
+	struct Operation	**c_ophash;	/* ops of both lists by msgid */
 
 	ldap_pvt_thread_mutex_t	c_write1_mutex;	/* only one pdu written at a time */
 	ldap_pvt_thread_cond_t	c_write1_cv;	/* only one pdu written at a time */
@@ -2937,6 +3223,14 @@ struct Connection {
 	int			c_writers;		/* number of writers waiting */
 	char		c_writing;		/* someone is writing */
 
+	/* output coalescing, protected by c_write1_mutex */
+	BerElement	*c_wber;	/* PDUs not written yet */
+	ber_len_t	c_wlen;		/* bytes in c_wber */
+	time_t		c_wtime;	/* when c_wber got its first PDU */
+	void		*c_wctx;	/* thread allowed to coalesce */
+	BerElement	*c_bber;	/* PDUs left behind by a blocked write */
+	int		c_bcount;	/* PDUs in c_bber */
+
 	char		c_sasl_bind_in_progress;	/* multi-op bind in progress */
 	char		c_writewaiter;	/* true if blocked on write */
 
@@ -2954,6 +3248,7 @@ struct Connection {
 	char	c_needs_tls_accept;	/* true if SSL_accept should be called */
 #endif
 	char	c_sasl_layers;	 /* true if we need to install SASL i/o handlers */
+	char	c_compress;	 /* true if we need to install the zlib i/o handler */
 	char	c_sasl_done;		/* SASL completed once */
 	void	*c_sasl_authctx;	/* SASL authentication context */
 	void	*c_sasl_sockctx;	/* SASL security layer context */
@@ -2965,12 +3260,17 @@ struct Connection {
 #define CONN_TXN_SPECIFY 1
 #define CONN_TXN_SETTLE -1
 	int c_txn;
+	int c_txn_bulk;		/* failed updates don't abort the txn */
+	int c_txn_busy;		/* updates accepted but not yet queued */
 
 	Backend *c_txn_backend;
 	LDAP_STAILQ_HEAD(c_to, Operation) c_txn_ops; /* list of operations in txn */
 
 	PagedResultsState c_pagedresults_state; /* paged result state */
 
+	SearchTemplate **c_templates;	/* registered search templates */
+	int c_ntemplates;
+
 	long	c_n_ops_received;	/* num of ops received (next op_id) */
 	long	c_n_ops_executing;	/* num of ops currently executing */
 	long	c_n_ops_pending;	/* num of ops pending execution */
@@ -3077,6 +3377,8 @@ typedef int (SLAP_CTRL_PARSE_FN) LDAP_P((
 typedef int (*SLAP_ENTRY_INFO_FN) LDAP_P(( void *arg, Entry *e ));
 
 #define SLAP_SLAB_SIZE	(1024*1024)
+#define SLAP_SLAB_MAXBASE	(8*SLAP_SLAB_SIZE)	/* grown from high-water mark */
+#define SLAP_SLAB_MAXSIZE	(64*SLAP_SLAB_SIZE)	/* slab plus chained chunks */
 #define SLAP_SLAB_STACK 1
 
 #define SLAP_ZONE_ALLOC 1
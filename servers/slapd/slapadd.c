@@ -64,6 +64,7 @@ typedef struct Erec {
 	unsigned long nextline;
 } Erec;
 
+/* A slot in the queue between the LDIF workers and the writer */
 typedef struct Trec {
 	Entry *e;
 	unsigned long lineno;
@@ -72,7 +73,18 @@ typedef struct Trec {
 	int ready;
 } Trec;
 
-static Trec trec;
+/* Queued records per LDIF worker */
+#define ADD_QUEUE_PER_THREAD	16
+
+static Trec *trecs;
+static int trec_max;
+static unsigned long trec_read;	/* next record to read */
+static unsigned long trec_done;	/* next record for the writer */
+static unsigned long trec_line;	/* last line read */
+static int trec_eof;
+static int add_nthreads;
+static ldap_pvt_thread_t *add_threads;
+
 static unsigned long sid = SLAP_SYNC_SID_MAX + 1;
 static int checkvals;
 static int enable_meter;
@@ -86,240 +98,332 @@ static ldap_pvt_thread_mutex_t add_mutex;
 static ldap_pvt_thread_cond_t add_cond;
 static int add_stop;
 
+/* serializes reading from ldiffp and the meter */
+static ldap_pvt_thread_mutex_t read_mutex;
+/* signals a free slot to the reading worker */
+static ldap_pvt_thread_cond_t free_cond;
+
 /* returns:
  *	1: got a record
  *	0: EOF
  * -1: read failure
+ */
+static int
+getrec_read( unsigned long *lineno, unsigned long *nextline,
+	char **bufp, int *lmaxp )
+{
+	int ldifrc;
+
+	do {
+		*lineno = *nextline+1;
+		/* nextline is the line number of the end of the current entry */
+		ldifrc = ldif_read_record( ldiffp, nextline, bufp, lmaxp );
+		if (ldifrc < 1)
+			return ldifrc < 0 ? -1 : 0;
+	} while ( *lineno < jumpline );
+
+	if ( enable_meter )
+		lutil_meter_update( &meter,
+				 ftello( ldiffp->fp ),
+				 0);
+	return 1;
+}
+
+/* Parse and check one record. Safe to run concurrently,
+ * nothing here touches shared state.
+ *
+ * returns:
+ *	1: got an entry
  * -2: parse failure
  */
 static int
-getrec0(Erec *erec)
+getrec_parse( char *rec, unsigned long lineno, Operation *op, Entry **ep )
 {
 	const char *text;
-	int ldifrc;
 	char textbuf[SLAP_TEXT_BUFLEN] = { '\0' };
 	size_t textlen = sizeof textbuf;
-	struct berval csn;
-	Operation *op = &opbuf.ob_op;
-	op->o_hdr = &opbuf.ob_hdr;
+	BackendDB *bd;
+	Entry *e;
+
+	e = str2entry2( rec, checkvals );
 
-again:
-	erec->lineno = erec->nextline+1;
-	/* nextline is the line number of the end of the current entry */
-	ldifrc = ldif_read_record( ldiffp, &erec->nextline, &buf, &lmax );
-	if (ldifrc < 1)
-		return ldifrc < 0 ? -1 : 0;
+	if( e == NULL ) {
+		fprintf( stderr, "%s: could not parse entry (line=%lu)\n",
+			progname, lineno );
+		return -2;
+	}
+
+	/* make sure the DN is not empty */
+	if( BER_BVISEMPTY( &e->e_nname ) &&
+		!BER_BVISEMPTY( be->be_nsuffix ))
 	{
-		BackendDB *bd;
-		Entry *e;
-		int prev_DN_strict;
+		fprintf( stderr, "%s: line %lu: "
+			"cannot add entry with empty dn=\"%s\"",
+			progname, lineno, e->e_dn );
+		bd = select_backend( &e->e_nname, nosubordinates );
+		if ( bd ) {
+			BackendDB *bdtmp;
+			int dbidx = 0;
+			LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
+				if ( bdtmp == bd ) break;
+				dbidx++;
+			}
 
-		if ( erec->lineno < jumpline )
-			goto again;
+			assert( bdtmp != NULL );
+			
+			fprintf( stderr, "; did you mean to use database #%d (%s)?",
+				dbidx,
+				bd->be_suffix[0].bv_val );
 
-		if ( !dbnum ) {
-			prev_DN_strict = slap_DN_strict;
-			slap_DN_strict = 0;
-		}
-		e = str2entry2( buf, checkvals );
-		if ( !dbnum ) {
-			slap_DN_strict = prev_DN_strict;
 		}
+		fprintf( stderr, "\n" );
+		entry_free( e );
+		return -2;
+	}
+
+	/* check backend */
+	bd = select_backend( &e->e_nname, nosubordinates );
+	if ( bd != be ) {
+		fprintf( stderr, "%s: line %lu: "
+			"database #%d (%s) not configured to hold \"%s\"",
+			progname, lineno,
+			dbnum,
+			be->be_suffix[0].bv_val,
+			e->e_dn );
+		if ( bd ) {
+			BackendDB *bdtmp;
+			int dbidx = 0;
+			LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
+				if ( bdtmp == bd ) break;
+				dbidx++;
+			}
 
-		if ( enable_meter )
-			lutil_meter_update( &meter,
-					 ftello( ldiffp->fp ),
-					 0);
+			assert( bdtmp != NULL );
+			
+			fprintf( stderr, "; did you mean to use database #%d (%s)?",
+				dbidx,
+				bd->be_suffix[0].bv_val );
 
-		if( e == NULL ) {
-			fprintf( stderr, "%s: could not parse entry (line=%lu)\n",
-				progname, erec->lineno );
-			return -2;
+		} else {
+			fprintf( stderr, "; no database configured for that naming context" );
 		}
+		fprintf( stderr, "\n" );
+		entry_free( e );
+		return -2;
+	}
 
-		/* make sure the DN is not empty */
-		if( BER_BVISEMPTY( &e->e_nname ) &&
-			!BER_BVISEMPTY( be->be_nsuffix ))
-		{
-			fprintf( stderr, "%s: line %lu: "
-				"cannot add entry with empty dn=\"%s\"",
-				progname, erec->lineno, e->e_dn );
-			bd = select_backend( &e->e_nname, nosubordinates );
-			if ( bd ) {
-				BackendDB *bdtmp;
-				int dbidx = 0;
-				LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
-					if ( bdtmp == bd ) break;
-					dbidx++;
-				}
+	if ( slap_tool_entry_check( progname, op, e, lineno, &text, textbuf, textlen ) !=
+		LDAP_SUCCESS ) {
+		entry_free( e );
+		return -2;
+	}
 
-				assert( bdtmp != NULL );
-				
-				fprintf( stderr, "; did you mean to use database #%d (%s)?",
-					dbidx,
-					bd->be_suffix[0].bv_val );
+	*ep = e;
+	return 1;
+}
 
-			}
-			fprintf( stderr, "\n" );
-			entry_free( e );
-			return -2;
-		}
+/* Add the operational attributes and track the contextCSN.
+ * The UUID and CSN generators are not reentrant, and CSNs
+ * should follow the order of the input, so this is always
+ * done by the writer.
+ */
+static void
+getrec_finish( Entry *e )
+{
+	struct berval csn;
 
-		/* check backend */
-		bd = select_backend( &e->e_nname, nosubordinates );
-		if ( bd != be ) {
-			fprintf( stderr, "%s: line %lu: "
-				"database #%d (%s) not configured to hold \"%s\"",
-				progname, erec->lineno,
-				dbnum,
-				be->be_suffix[0].bv_val,
-				e->e_dn );
-			if ( bd ) {
-				BackendDB *bdtmp;
-				int dbidx = 0;
-				LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
-					if ( bdtmp == bd ) break;
-					dbidx++;
-				}
+	if ( SLAP_LASTMOD(be) ) {
+		time_t now = slap_get_time();
+		char uuidbuf[ LDAP_LUTIL_UUIDSTR_BUFSIZE ];
+		struct berval vals[ 2 ];
 
-				assert( bdtmp != NULL );
-				
-				fprintf( stderr, "; did you mean to use database #%d (%s)?",
-					dbidx,
-					bd->be_suffix[0].bv_val );
+		struct berval name, timestamp;
 
-			} else {
-				fprintf( stderr, "; no database configured for that naming context" );
-			}
-			fprintf( stderr, "\n" );
-			entry_free( e );
-			return -2;
-		}
+		struct berval nvals[ 2 ];
+		struct berval nname;
+		char timebuf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
 
-		if ( slap_tool_entry_check( progname, op, e, erec->lineno, &text, textbuf, textlen ) !=
-			LDAP_SUCCESS ) {
-			entry_free( e );
-			return -2;
-		}
+		enum {
+			GOT_NONE = 0x0,
+			GOT_CSN = 0x1,
+			GOT_UUID = 0x2,
+			GOT_ALL = (GOT_CSN|GOT_UUID)
+		} got = GOT_ALL;
 
-		if ( SLAP_LASTMOD(be) ) {
-			time_t now = slap_get_time();
-			char uuidbuf[ LDAP_LUTIL_UUIDSTR_BUFSIZE ];
-			struct berval vals[ 2 ];
+		vals[1].bv_len = 0;
+		vals[1].bv_val = NULL;
 
-			struct berval name, timestamp;
+		nvals[1].bv_len = 0;
+		nvals[1].bv_val = NULL;
 
-			struct berval nvals[ 2 ];
-			struct berval nname;
-			char timebuf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
+		csn.bv_len = ldap_pvt_csnstr( csnbuf, sizeof( csnbuf ), csnsid, 0 );
+		csn.bv_val = csnbuf;
 
-			enum {
-				GOT_NONE = 0x0,
-				GOT_CSN = 0x1,
-				GOT_UUID = 0x2,
-				GOT_ALL = (GOT_CSN|GOT_UUID)
-			} got = GOT_ALL;
+		timestamp.bv_val = timebuf;
+		timestamp.bv_len = sizeof(timebuf);
 
-			vals[1].bv_len = 0;
-			vals[1].bv_val = NULL;
+		slap_timestamp( &now, &timestamp );
 
-			nvals[1].bv_len = 0;
-			nvals[1].bv_val = NULL;
+		if ( BER_BVISEMPTY( &be->be_rootndn ) ) {
+			BER_BVSTR( &name, SLAPD_ANONYMOUS );
+			nname = name;
+		} else {
+			name = be->be_rootdn;
+			nname = be->be_rootndn;
+		}
 
-			csn.bv_len = ldap_pvt_csnstr( csnbuf, sizeof( csnbuf ), csnsid, 0 );
-			csn.bv_val = csnbuf;
+		if( attr_find( e->e_attrs, slap_schema.si_ad_entryUUID )
+			== NULL )
+		{
+			got &= ~GOT_UUID;
+			vals[0].bv_len = lutil_uuidstr( uuidbuf, sizeof( uuidbuf ) );
+			vals[0].bv_val = uuidbuf;
+			attr_merge_normalize_one( e, slap_schema.si_ad_entryUUID, vals, NULL );
+		}
 
-			timestamp.bv_val = timebuf;
-			timestamp.bv_len = sizeof(timebuf);
+		if( attr_find( e->e_attrs, slap_schema.si_ad_creatorsName )
+			== NULL )
+		{
+			vals[0] = name;
+			nvals[0] = nname;
+			attr_merge( e, slap_schema.si_ad_creatorsName, vals, nvals );
+		}
 
-			slap_timestamp( &now, &timestamp );
+		if( attr_find( e->e_attrs, slap_schema.si_ad_createTimestamp )
+			== NULL )
+		{
+			vals[0] = timestamp;
+			attr_merge( e, slap_schema.si_ad_createTimestamp, vals, NULL );
+		}
 
-			if ( BER_BVISEMPTY( &be->be_rootndn ) ) {
-				BER_BVSTR( &name, SLAPD_ANONYMOUS );
-				nname = name;
-			} else {
-				name = be->be_rootdn;
-				nname = be->be_rootndn;
-			}
+		if( attr_find( e->e_attrs, slap_schema.si_ad_entryCSN )
+			== NULL )
+		{
+			got &= ~GOT_CSN;
+			vals[0] = csn;
+			attr_merge( e, slap_schema.si_ad_entryCSN, vals, NULL );
+		}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_entryUUID )
-				== NULL )
-			{
-				got &= ~GOT_UUID;
-				vals[0].bv_len = lutil_uuidstr( uuidbuf, sizeof( uuidbuf ) );
-				vals[0].bv_val = uuidbuf;
-				attr_merge_normalize_one( e, slap_schema.si_ad_entryUUID, vals, NULL );
-			}
+		if( attr_find( e->e_attrs, slap_schema.si_ad_modifiersName )
+			== NULL )
+		{
+			vals[0] = name;
+			nvals[0] = nname;
+			attr_merge( e, slap_schema.si_ad_modifiersName, vals, nvals );
+		}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_creatorsName )
-				== NULL )
-			{
-				vals[0] = name;
-				nvals[0] = nname;
-				attr_merge( e, slap_schema.si_ad_creatorsName, vals, nvals );
-			}
+		if( attr_find( e->e_attrs, slap_schema.si_ad_modifyTimestamp )
+			== NULL )
+		{
+			vals[0] = timestamp;
+			attr_merge( e, slap_schema.si_ad_modifyTimestamp, vals, NULL );
+		}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_createTimestamp )
-				== NULL )
-			{
-				vals[0] = timestamp;
-				attr_merge( e, slap_schema.si_ad_createTimestamp, vals, NULL );
-			}
+		if ( SLAP_SINGLE_SHADOW(be) && got != GOT_ALL ) {
+			Debug(LDAP_DEBUG_ANY,
+			      "%s: warning, missing attrs %s%s%s from entry dn=\"%s\"\n",
+			      progname,
+			      (!(got & GOT_UUID) ? slap_schema.si_ad_entryUUID->ad_cname.bv_val : ""),
+			      (!(got & GOT_CSN) ? "," : ""),
+			      (!(got & GOT_CSN) ? slap_schema.si_ad_entryCSN->ad_cname.bv_val : ""),
+			      e->e_name.bv_val );
+		}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_entryCSN )
-				== NULL )
-			{
-				got &= ~GOT_CSN;
-				vals[0] = csn;
-				attr_merge( e, slap_schema.si_ad_entryCSN, vals, NULL );
-			}
+		sid = slap_tool_update_ctxcsn_check( progname, e );
+	}
+}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_modifiersName )
-				== NULL )
-			{
-				vals[0] = name;
-				nvals[0] = nname;
-				attr_merge( e, slap_schema.si_ad_modifiersName, vals, nvals );
-			}
+/* returns:
+ *	1: got a record
+ *	0: EOF
+ * -1: read failure
+ * -2: parse failure
+ */
+static int
+getrec0(Erec *erec)
+{
+	Operation *op = &opbuf.ob_op;
+	int prev_DN_strict;
+	int rc;
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_modifyTimestamp )
-				== NULL )
-			{
-				vals[0] = timestamp;
-				attr_merge( e, slap_schema.si_ad_modifyTimestamp, vals, NULL );
-			}
+	op->o_hdr = &opbuf.ob_hdr;
 
-			if ( SLAP_SINGLE_SHADOW(be) && got != GOT_ALL ) {
-				Debug(LDAP_DEBUG_ANY,
-				      "%s: warning, missing attrs %s%s%s from entry dn=\"%s\"\n",
-				      progname,
-				      (!(got & GOT_UUID) ? slap_schema.si_ad_entryUUID->ad_cname.bv_val : ""),
-				      (!(got & GOT_CSN) ? "," : ""),
-				      (!(got & GOT_CSN) ? slap_schema.si_ad_entryCSN->ad_cname.bv_val : ""),
-				      e->e_name.bv_val );
-			}
+	rc = getrec_read( &erec->lineno, &erec->nextline, &buf, &lmax );
+	if ( rc < 1 )
+		return rc;
 
-			sid = slap_tool_update_ctxcsn_check( progname, e );
-		}
-		erec->e = e;
+	if ( !dbnum ) {
+		prev_DN_strict = slap_DN_strict;
+		slap_DN_strict = 0;
 	}
-	return 1;
+	rc = getrec_parse( buf, erec->lineno, op, &erec->e );
+	if ( !dbnum ) {
+		slap_DN_strict = prev_DN_strict;
+	}
+	if ( rc == 1 )
+		getrec_finish( erec->e );
+	return rc;
 }
 
+/* LDIF worker. Records are read one at a time in file order,
+ * then parsed and checked concurrently by all the workers,
+ * and handed to the writer in their original order.
+ */
 static void *
 getrec_thr(void *ctx)
 {
-	ldap_pvt_thread_mutex_lock( &add_mutex );
-	while (!add_stop) {
-		trec.rc = getrec0((Erec *)&trec);
-		trec.ready = 1;
-		while (trec.ready)
-			ldap_pvt_thread_cond_wait( &add_cond, &add_mutex );
-		/* eof or read failure */
-		if ( trec.rc == 0 || trec.rc == -1 )
+	OperationBuffer opb;
+	Operation *op = &opb.ob_op;
+	char *rbuf = NULL;
+	int rmax = 0;
+
+	memset( &opb, 0, sizeof( opb ));
+	op->o_hdr = &opb.ob_hdr;
+
+	for (;;) {
+		unsigned long seq, lineno, nextline;
+		Entry *e = NULL;
+		Trec *tr;
+		int rc;
+
+		ldap_pvt_thread_mutex_lock( &read_mutex );
+		ldap_pvt_thread_mutex_lock( &add_mutex );
+		while ( !add_stop && trec_read - trec_done >= trec_max )
+			ldap_pvt_thread_cond_wait( &free_cond, &add_mutex );
+		ldap_pvt_thread_mutex_unlock( &add_mutex );
+		if ( add_stop || trec_eof ) {
+			ldap_pvt_thread_mutex_unlock( &read_mutex );
 			break;
+		}
+		seq = trec_read++;
+		nextline = trec_line;
+		rc = getrec_read( &lineno, &nextline, &rbuf, &rmax );
+		trec_line = nextline;
+		/* eof or read failure ends the input */
+		if ( rc < 1 )
+			trec_eof = 1;
+		ldap_pvt_thread_mutex_unlock( &read_mutex );
+
+		if ( rc == 1 )
+			rc = getrec_parse( rbuf, lineno, op, &e );
+
+		ldap_pvt_thread_mutex_lock( &add_mutex );
+		if ( add_stop ) {
+			ldap_pvt_thread_mutex_unlock( &add_mutex );
+			if ( e ) entry_free( e );
+			break;
+		}
+		tr = &trecs[ seq % trec_max ];
+		tr->e = e;
+		tr->lineno = lineno;
+		tr->nextline = nextline;
+		tr->rc = rc;
+		tr->ready = 1;
+		if ( seq == trec_done )
+			ldap_pvt_thread_cond_signal( &add_cond );
+		ldap_pvt_thread_mutex_unlock( &add_mutex );
 	}
-	ldap_pvt_thread_mutex_unlock( &add_mutex );
+	ch_free( rbuf );
 	return NULL;
 }
 
@@ -328,20 +432,28 @@ static int ldif_threaded;
 static int
 getrec(Erec *erec)
 {
+	Trec *tr;
 	int rc;
 	if ( !ldif_threaded )
 		return getrec0(erec);
 
-	while (!trec.ready)
-		ldap_pvt_thread_yield();
-	erec->e = trec.e;
-	erec->lineno = trec.lineno;
-	erec->nextline = trec.nextline;
-	trec.ready = 0;
-	rc = trec.rc;
 	ldap_pvt_thread_mutex_lock( &add_mutex );
+	tr = &trecs[ trec_done % trec_max ];
+	while ( !tr->ready )
+		ldap_pvt_thread_cond_wait( &add_cond, &add_mutex );
+	rc = tr->rc;
+	if ( rc == 1 )
+		erec->e = tr->e;
+	erec->lineno = tr->lineno;
+	erec->nextline = tr->nextline;
+	tr->e = NULL;
+	tr->ready = 0;
+	trec_done++;
+	ldap_pvt_thread_cond_signal( &free_cond );
 	ldap_pvt_thread_mutex_unlock( &add_mutex );
-	ldap_pvt_thread_cond_signal( &add_cond );
+
+	if ( rc == 1 )
+		getrec_finish( erec->e );
 	return rc;
 }
 
@@ -352,9 +464,9 @@ slapadd( int argc, char **argv )
 	size_t textlen = sizeof textbuf;
 	Erec erec;
 	struct berval bvtext;
-	ldap_pvt_thread_t thr;
 	ID id;
 	Entry *prev = NULL;
+	int prev_DN_strict = 0;
 
 	int ldifrc;
 	int rc = EXIT_SUCCESS;
@@ -425,9 +537,23 @@ slapadd( int argc, char **argv )
 	}
 
 	if ( slap_tool_thread_max > 1 ) {
+		int i;
+
 		ldap_pvt_thread_mutex_init( &add_mutex );
 		ldap_pvt_thread_cond_init( &add_cond );
-		ldap_pvt_thread_create( &thr, 0, getrec_thr, NULL );
+		ldap_pvt_thread_mutex_init( &read_mutex );
+		ldap_pvt_thread_cond_init( &free_cond );
+		add_nthreads = slap_tool_thread_max - 1;
+		trec_max = add_nthreads * ADD_QUEUE_PER_THREAD;
+		trecs = ch_calloc( trec_max, sizeof( Trec ));
+		add_threads = ch_malloc( add_nthreads * sizeof( ldap_pvt_thread_t ));
+		/* the workers can't toggle it around each entry */
+		if ( !dbnum ) {
+			prev_DN_strict = slap_DN_strict;
+			slap_DN_strict = 0;
+		}
+		for ( i = 0; i < add_nthreads; i++ )
+			ldap_pvt_thread_create( &add_threads[i], 0, getrec_thr, NULL );
 		ldif_threaded = 1;
 	}
 
@@ -477,12 +603,23 @@ slapadd( int argc, char **argv )
 	}
 
 	if ( ldif_threaded ) {
+		int i;
+
 		ldap_pvt_thread_mutex_lock( &add_mutex );
 		add_stop = 1;
-		trec.ready = 0;
-		ldap_pvt_thread_cond_signal( &add_cond );
+		ldap_pvt_thread_cond_broadcast( &free_cond );
 		ldap_pvt_thread_mutex_unlock( &add_mutex );
-		ldap_pvt_thread_join( thr, NULL );
+		for ( i = 0; i < add_nthreads; i++ )
+			ldap_pvt_thread_join( add_threads[i], NULL );
+		/* records read ahead of an error */
+		for ( i = 0; i < trec_max; i++ ) {
+			if ( trecs[i].ready && trecs[i].e )
+				entry_free( trecs[i].e );
+		}
+		ch_free( trecs );
+		ch_free( add_threads );
+		if ( !dbnum )
+			slap_DN_strict = prev_DN_strict;
 	}
 	if ( erec.e ) entry_free( erec.e );
 
@@ -0,0 +1,259 @@
+/* slapbench.c - backend micro-benchmarks */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include "ac/stdlib.h"
+#include "ac/ctype.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/time.h"
+
+#include "slapcommon.h"
+#include "ldif.h"
+
+/* entries taken from the database when no LDIF is given */
+#define SLAPBENCH_MAXENTRIES	10000
+
+/* each benchmark repeats its passes for at least this long (usec) */
+#define SLAPBENCH_MINTIME	1000000
+
+/*
+ * Allocations from memory contexts are counted by wrapping the
+ * slab allocator; the wrappers are installed before slap_init()
+ * gets to install the slab allocator itself.
+ */
+static unsigned long bench_allocs, bench_bytes;
+
+static void *
+bench_malloc( ber_len_t size, void *ctx )
+{
+	bench_allocs++;
+	bench_bytes += size;
+	return slap_sl_mfuncs.bmf_malloc( size, ctx );
+}
+
+static void *
+bench_calloc( ber_len_t n, ber_len_t size, void *ctx )
+{
+	bench_allocs++;
+	bench_bytes += n * size;
+	return slap_sl_mfuncs.bmf_calloc( n, size, ctx );
+}
+
+static void *
+bench_realloc( void *ptr, ber_len_t size, void *ctx )
+{
+	bench_allocs++;
+	bench_bytes += size;
+	return slap_sl_mfuncs.bmf_realloc( ptr, size, ctx );
+}
+
+static void
+bench_free( void *ptr, void *ctx )
+{
+	slap_sl_mfuncs.bmf_free( ptr, ctx );
+}
+
+static BerMemoryFunctions bench_mfuncs =
+	{ bench_malloc, bench_calloc, bench_realloc, bench_free };
+
+static void *bench_mark;
+
+/*
+ * Start the named benchmark. Returns 0 if it was not selected
+ * on the command line, and should be skipped.
+ */
+int
+slap_bench_start( slap_bench *sb, const char *name )
+{
+	if ( sb->sb_names ) {
+		int i;
+
+		for ( i = 0; sb->sb_names[i]; i++ ) {
+			if ( !strncasecmp( name, sb->sb_names[i],
+				strlen( sb->sb_names[i] ) ) )
+				break;
+		}
+		if ( !sb->sb_names[i] )
+			return 0;
+	}
+
+	sb->sb_name = name;
+	sb->sb_ops = 0;
+	sb->sb_allocs = bench_allocs;
+	sb->sb_bytes = bench_bytes;
+	if ( sb->sb_op->o_tmpmemctx )
+		bench_mark = slap_sl_mark( sb->sb_op->o_tmpmemctx );
+	gettimeofday( &sb->sb_start, NULL );
+
+	return 1;
+}
+
+/*
+ * Account for a pass of ops operations. Returns nonzero while the
+ * benchmark should run another pass; once it has run long enough,
+ * prints its results and returns 0.
+ */
+int
+slap_bench_more( slap_bench *sb, unsigned long ops )
+{
+	double usec;
+
+	if ( sb->sb_op->o_tmpmemctx )
+		slap_sl_release( bench_mark, sb->sb_op->o_tmpmemctx );
+
+	sb->sb_ops += ops;
+	usec = slap_histo_since( &sb->sb_start );
+	if ( ops && usec < SLAPBENCH_MINTIME )
+		return 1;
+
+	if ( sb->sb_ops ) {
+		printf( "%-24s %12lu %12.1f %10.2f %10.1f\n", sb->sb_name,
+			sb->sb_ops, usec * 1000.0 / sb->sb_ops,
+			(double)( bench_allocs - sb->sb_allocs ) / sb->sb_ops,
+			(double)( bench_bytes - sb->sb_bytes ) / sb->sb_ops );
+	} else {
+		printf( "%-24s %12s\n", sb->sb_name, "(no data)" );
+	}
+	fflush( stdout );
+
+	return 0;
+}
+
+int
+slapbench( int argc, char **argv )
+{
+	int rc = EXIT_SUCCESS;
+	const char *progname = "slapbench";
+	Connection conn = { 0 };
+	OperationBuffer	opbuf;
+	Operation *op;
+	void *thrctx, *memctx;
+	slap_bench sb = { 0 };
+	int i, maxentries = 0;
+
+	ber_set_option( NULL, LBER_OPT_MEMORY_FNS, &bench_mfuncs );
+
+	slap_tool_init( progname, SLAPBENCH, argc, argv );
+
+	if ( !be->bd_info->bi_tool_bench ||
+		!be->be_entry_open ||
+		!be->be_entry_close )
+	{
+		fprintf( stderr, "%s: database doesn't support benchmarks.\n",
+			progname );
+		exit( EXIT_FAILURE );
+	}
+
+	if ( !ldiffp && ( !( be->be_entry_first || be->be_entry_first_x ) ||
+		!be->be_entry_next || !be->be_entry_get ) )
+	{
+		fprintf( stderr, "%s: database doesn't support necessary operations.\n",
+			progname );
+		exit( EXIT_FAILURE );
+	}
+
+	if( be->be_entry_open( be, 0 ) != 0 ) {
+		fprintf( stderr, "%s: could not open database.\n",
+			progname );
+		exit( EXIT_FAILURE );
+	}
+
+	thrctx = ldap_pvt_thread_pool_context();
+	connection_fake_init( &conn, &opbuf, thrctx );
+	op = &opbuf.ob_op;
+	memctx = op->o_tmpmemctx;
+	op->o_tmpmemctx = NULL;
+	op->o_bd = be;
+
+	/* load the dataset */
+	if ( ldiffp ) {
+		unsigned long lineno = 0;
+		char *buf = NULL;
+		int lmax = 0;
+
+		while ( ldif_read_record( ldiffp, &lineno, &buf, &lmax ) > 0 ) {
+			Entry *e = str2entry( buf );
+
+			if ( e == NULL ) {
+				fprintf( stderr, "%s: could not parse entry (line=%lu)\n",
+					progname, lineno );
+				rc = EXIT_FAILURE;
+				break;
+			}
+			if ( sb.sb_nentries == maxentries ) {
+				maxentries = maxentries ? maxentries * 2 : 256;
+				sb.sb_entries = ch_realloc( sb.sb_entries,
+					maxentries * sizeof( Entry * ) );
+			}
+			sb.sb_entries[ sb.sb_nentries++ ] = e;
+		}
+		ch_free( buf );
+
+	} else {
+		ID id;
+
+		sb.sb_entries = ch_malloc( SLAPBENCH_MAXENTRIES * sizeof( Entry * ) );
+		if ( be->be_entry_first ) {
+			id = be->be_entry_first( be );
+		} else {
+			id = be->be_entry_first_x( be, NULL, LDAP_SCOPE_DEFAULT, NULL );
+		}
+		for ( ; id != NOID && sb.sb_nentries < SLAPBENCH_MAXENTRIES;
+			id = be->be_entry_next( be ) )
+		{
+			Entry *e = be->be_entry_get( be, id );
+
+			if ( e == NULL )
+				continue;
+			sb.sb_entries[ sb.sb_nentries ] = entry_dup( e );
+			sb.sb_entries[ sb.sb_nentries++ ]->e_id = id;
+			be_entry_release_r( op, e );
+		}
+	}
+
+	be->be_entry_close( be );
+
+	if ( rc == EXIT_SUCCESS ) {
+		if ( verbose ) {
+			fprintf( stderr, "%s: %d entries from %s\n", progname,
+				sb.sb_nentries, ldiffp ? "LDIF" : "the database" );
+		}
+
+		op->o_tmpmemctx = memctx;
+		op->o_tmpmfuncs = &bench_mfuncs;
+		sb.sb_op = op;
+		if ( argv[ optind ] )
+			sb.sb_names = &argv[ optind ];
+
+		printf( "%-24s %12s %12s %10s %10s\n",
+			"benchmark", "ops", "ns/op", "allocs/op", "bytes/op" );
+		if ( be->bd_info->bi_tool_bench( be, &sb ) )
+			rc = EXIT_FAILURE;
+	}
+
+	for ( i = 0; i < sb.sb_nentries; i++ )
+		entry_free( sb.sb_entries[i] );
+	ch_free( sb.sb_entries );
+
+	if ( slap_tool_destroy() )
+		rc = EXIT_FAILURE;
+
+	return rc;
+}
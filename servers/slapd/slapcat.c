@@ -40,11 +40,166 @@ slapcat_sig( int sig )
 	gotsig=1;
 }
 
+/* With more than one tool thread, entries are fetched from the
+ * backend by the main thread, formatted as LDIF by the workers,
+ * and written out by the main thread in their original order.
+ */
+typedef struct cat_rec {
+	ID cr_id;
+	Entry *cr_e;
+	char *cr_data;
+	int cr_len;
+	int cr_done;
+	struct berval cr_buf;	/* bv_len is the allocated size */
+} cat_rec;
+
+/* Queued entries per worker */
+#define CAT_QUEUE_PER_THREAD	32
+/* Entries formatted per wakeup */
+#define CAT_BATCH	8
+
+static cat_rec *cat_recs;
+static int cat_max;
+static unsigned long cat_head;	/* next entry to write */
+static unsigned long cat_next;	/* next entry to format */
+static unsigned long cat_tail;	/* next free slot */
+static int cat_stop;
+static int cat_waiting;
+static int cat_nthreads;
+static ldap_pvt_thread_t *cat_threads;
+static ldap_pvt_thread_mutex_t cat_mutex;
+static ldap_pvt_thread_cond_t cat_work_cond;
+static ldap_pvt_thread_cond_t cat_done_cond;
+
+static void *
+slapcat_thr( void *ctx )
+{
+	ldap_pvt_thread_mutex_lock( &cat_mutex );
+	for (;;) {
+		unsigned long seq, n, i;
+
+		/* take entries in batches, unless the writer is waiting */
+		while ( !cat_stop && ( cat_next == cat_tail ||
+			( cat_tail - cat_next < CAT_BATCH && !cat_waiting )))
+			ldap_pvt_thread_cond_wait( &cat_work_cond, &cat_mutex );
+		if ( cat_stop )
+			break;
+		seq = cat_next;
+		n = cat_tail - cat_next;
+		if ( n > CAT_BATCH )
+			n = CAT_BATCH;
+		cat_next += n;
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+		for ( i = 0; i < n; i++ ) {
+			cat_rec *cr = &cat_recs[ ( seq + i ) % cat_max ];
+			cr->cr_data = entry2str_wrap_r( cr->cr_e, &cr->cr_len,
+				ldif_wrap, &cr->cr_buf );
+		}
+
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		for ( i = 0; i < n; i++ )
+			cat_recs[ ( seq + i ) % cat_max ].cr_done = 1;
+		if ( seq == cat_head )
+			ldap_pvt_thread_cond_signal( &cat_done_cond );
+	}
+	ldap_pvt_thread_mutex_unlock( &cat_mutex );
+	return NULL;
+}
+
+/* returns:
+ *	0: entry written
+ *	1: bad data
+ * -1: write failure
+ */
+static int
+slapcat_put( const char *progname, ID id, char *data, int len )
+{
+	if ( verbose ) {
+		printf( "# id=%08lx\n", (long) id );
+	}
+
+	if ( data == NULL ) {
+		printf("# bad data for entry id=%08lx\n\n", (long) id );
+		return 1;
+	}
+
+	if ( fputs( data, ldiffp->fp ) == EOF ||
+		fputs( "\n", ldiffp->fp ) == EOF ) {
+		fprintf(stderr, "%s: error writing output.\n",
+			progname);
+		return -1;
+	}
+	return 0;
+}
+
+/* Write out the formatted entries at the head of the queue.
+ * With wait, first wait until at most want entries are queued.
+ * Returns 0, or 1 if output should stop.
+ */
+static int
+slapcat_flush( const char *progname, Operation *op, unsigned long want,
+	int *rc )
+{
+	int ret = 0;
+
+	ldap_pvt_thread_mutex_lock( &cat_mutex );
+	while ( cat_head < cat_tail ) {
+		cat_rec *cr = &cat_recs[ cat_head % cat_max ];
+		int wrc;
+
+		if ( !cr->cr_done ) {
+			if ( cat_tail - cat_head <= want )
+				break;
+			/* let the workers take a partial batch */
+			cat_waiting = 1;
+			ldap_pvt_thread_cond_broadcast( &cat_work_cond );
+			ldap_pvt_thread_cond_wait( &cat_done_cond, &cat_mutex );
+			cat_waiting = 0;
+			continue;
+		}
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+		wrc = slapcat_put( progname, cr->cr_id, cr->cr_data, cr->cr_len );
+		be_entry_release_r( op, cr->cr_e );
+		cr->cr_e = NULL;
+
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		cr->cr_done = 0;
+		cat_head++;
+		if ( wrc ) {
+			*rc = EXIT_FAILURE;
+			if ( wrc < 0 || !continuemode ) {
+				ret = 1;
+				break;
+			}
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &cat_mutex );
+	return ret;
+}
+
+static void
+slapcat_queue( ID id, Entry *e )
+{
+	cat_rec *cr;
+
+	ldap_pvt_thread_mutex_lock( &cat_mutex );
+	cr = &cat_recs[ cat_tail % cat_max ];
+	cr->cr_id = id;
+	cr->cr_e = e;
+	cat_tail++;
+	if ( cat_tail - cat_next == CAT_BATCH )
+		ldap_pvt_thread_cond_signal( &cat_work_cond );
+	ldap_pvt_thread_mutex_unlock( &cat_mutex );
+}
+
 int
 slapcat( int argc, char **argv )
 {
 	ID id;
 	int rc = EXIT_SUCCESS;
+	int ldifrc;
 	Operation op = {0};
 	const char *progname = "slapcat";
 	int requestBSF;
@@ -81,6 +236,21 @@ slapcat( int argc, char **argv )
 	}
 
 	op.o_bd = be;
+
+	if ( slap_tool_thread_max > 1 ) {
+		int i;
+
+		ldap_pvt_thread_mutex_init( &cat_mutex );
+		ldap_pvt_thread_cond_init( &cat_work_cond );
+		ldap_pvt_thread_cond_init( &cat_done_cond );
+		cat_nthreads = slap_tool_thread_max - 1;
+		cat_max = cat_nthreads * CAT_QUEUE_PER_THREAD;
+		cat_recs = ch_calloc( cat_max, sizeof( cat_rec ));
+		cat_threads = ch_malloc( cat_nthreads * sizeof( ldap_pvt_thread_t ));
+		for ( i = 0; i < cat_nthreads; i++ )
+			ldap_pvt_thread_create( &cat_threads[i], 0, slapcat_thr, NULL );
+	}
+
 	if ( !requestBSF && be->be_entry_first ) {
 		id = be->be_entry_first( be );
 
@@ -107,6 +277,9 @@ slapcat( int argc, char **argv )
 
 		e = be->be_entry_get( be, id );
 		if ( e == NULL ) {
+			/* keep the comments in order */
+			if ( cat_nthreads && slapcat_flush( progname, &op, 0, &rc ))
+				break;
 			printf("# no data for entry id=%08lx\n\n", (long) id );
 			rc = EXIT_FAILURE;
 			if ( continuemode == 0 ) {
@@ -144,27 +317,47 @@ slapcat( int argc, char **argv )
 			}
 		}
 
-		if ( verbose ) {
-			printf( "# id=%08lx\n", (long) id );
+		if ( cat_nthreads ) {
+			if ( slapcat_flush( progname, &op, cat_max - 1, &rc )) {
+				be_entry_release_r( &op, e );
+				break;
+			}
+			slapcat_queue( id, e );
+			continue;
 		}
 
 		data = entry2str_wrap( e, &len, ldif_wrap );
 		be_entry_release_r( &op, e );
 
-		if ( data == NULL ) {
-			printf("# bad data for entry id=%08lx\n\n", (long) id );
+		ldifrc = slapcat_put( progname, id, data, len );
+		if ( ldifrc ) {
 			rc = EXIT_FAILURE;
-			if( continuemode ) continue;
+			if( ldifrc > 0 && continuemode ) continue;
 			break;
 		}
+	}
 
-		if ( fputs( data, ldiffp->fp ) == EOF ||
-			fputs( "\n", ldiffp->fp ) == EOF ) {
-			fprintf(stderr, "%s: error writing output.\n",
-				progname);
-			rc = EXIT_FAILURE;
-			break;
+	if ( cat_nthreads ) {
+		int i;
+
+		if ( !gotsig )
+			slapcat_flush( progname, &op, 0, &rc );
+
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		cat_stop = 1;
+		ldap_pvt_thread_cond_broadcast( &cat_work_cond );
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+		for ( i = 0; i < cat_nthreads; i++ )
+			ldap_pvt_thread_join( cat_threads[i], NULL );
+
+		/* entries left after an error */
+		for ( i = 0; i < cat_max; i++ ) {
+			if ( cat_recs[i].cr_e )
+				be_entry_release_r( &op, cat_recs[i].cr_e );
+			ch_free( cat_recs[i].cr_buf.bv_val );
 		}
+		ch_free( cat_recs );
+		ch_free( cat_threads );
 	}
 
 	be->be_entry_close( be );
@@ -78,6 +78,11 @@ usage( int tool, const char *progname )
 		options = "\n\t[-U authcID] [-X authzID] [-R realm] [-M mech] ID [...]\n";
 		break;
 
+	case SLAPBENCH:
+		options = "\n\t[-n databasenumber | -b suffix] [-l ldiffile]"
+			" [benchmark ...]\n";
+		break;
+
 	case SLAPCAT:
 		options = " [-c]\n\t[-g] [-n databasenumber | -b suffix]"
 			" [-l ldiffile] [-a filter] [-s subtree] [-H url]\n";
@@ -355,6 +360,11 @@ slap_tool_init(
 		mode |= SLAP_TOOL_READMAIN | SLAP_TOOL_READONLY;
 		break;
 
+	case SLAPBENCH:
+		options = "b:d:f:F:l:n:o:v";
+		mode |= SLAP_TOOL_READMAIN | SLAP_TOOL_READONLY;
+		break;
+
 	default:
 		fprintf( stderr, "%s: unknown tool mode (%d)\n", progname, tool );
 		exit( EXIT_FAILURE );
@@ -613,6 +623,7 @@ slap_tool_init(
 		break;
 
 	case SLAPINDEX:
+	case SLAPBENCH:
 		if ( dbnum >= 0 && base.bv_val != NULL ) {
 			usage( tool, progname );
 		}
@@ -652,8 +663,9 @@ slap_tool_init(
 	}
 
 	if ( ldiffile == NULL ) {
+		/* slapbench reads LDIF only when asked to */
 		dummy.fp = writer ? stdout : stdin;
-		ldiffp = &dummy;
+		ldiffp = tool == SLAPBENCH ? NULL : &dummy;
 
 	} else if ((ldiffp = ldif_open( ldiffile, writer ? "w" : "r" ))
 		== NULL )
@@ -698,14 +710,13 @@ slap_tool_init(
 	}
 #endif
 
-	at_oc_cache = 1;
-
 	switch ( tool ) {
 	case SLAPADD:
 	case SLAPCAT:
 	case SLAPINDEX:
 	case SLAPMODIFY:
 	case SLAPSCHEMA:
+	case SLAPBENCH:
 		if ( !nbackends ) {
 			fprintf( stderr, "No databases found "
 					"in config file\n" );
@@ -31,6 +31,7 @@ enum slaptool {
 	SLAPTEST,	/* slapd.conf test tool */
 	SLAPAUTH,	/* test authz-regexp and authc/authz stuff */
 	SLAPACL,	/* test acl */
+	SLAPBENCH,	/* backend micro-benchmarks */
 	SLAPLAST
 };
 
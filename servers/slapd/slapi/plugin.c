@@ -126,6 +126,65 @@ done:
 	return pPlugin;
 } 
 
+/*
+ * Recompute the bitmap of the function types provided by the plugins
+ * registered with be, so that callers can tell cheaply whether any
+ * plugin needs to be called (and a pblock built) for a given type.
+ */
+static void
+slapi_int_update_plugin_types( Backend *be )
+{
+	Slapi_PBlock	*pCurrentPB;
+	unsigned char	*types = SLAPI_BACKEND_PLUGIN_TYPES( be );
+
+	pCurrentPB = SLAPI_BACKEND_PBLOCK( be );
+	if ( pCurrentPB == NULL ) {
+		ch_free( types );
+		SLAPI_BACKEND_PLUGIN_TYPES( be ) = NULL;
+		return;
+	}
+
+	if ( types == NULL ) {
+		types = ch_calloc( 1, SLAPI_PLUGIN_TYPES_MAX / 8 );
+		SLAPI_BACKEND_PLUGIN_TYPES( be ) = types;
+	} else {
+		memset( types, 0, SLAPI_PLUGIN_TYPES_MAX / 8 );
+	}
+
+	for ( ; pCurrentPB != NULL;
+		slapi_pblock_get( pCurrentPB, SLAPI_IBM_PBLOCK, &pCurrentPB ) )
+	{
+		slapi_int_pblock_get_types( pCurrentPB, types );
+	}
+}
+
+/*
+ * Returns nonzero if a plugin registered with be may provide
+ * a function of type functype.
+ */
+int
+slapi_int_has_plugins(
+	Backend *be,
+	int functype )
+{
+	unsigned char	*types;
+
+	if ( be == NULL ) {
+		return 0;
+	}
+
+	types = SLAPI_BACKEND_PLUGIN_TYPES( be );
+	if ( types == NULL ) {
+		return 0;
+	}
+
+	if ( functype < 0 || functype >= SLAPI_PLUGIN_TYPES_MAX ) {
+		return 1;
+	}
+
+	return ( types[functype >> 3] & ( 1 << ( functype & 7 ) ) ) != 0;
+}
+
 /*********************************************************************
  * Function Name:      slapi_int_register_plugin
  *
@@ -172,6 +231,8 @@ slapi_int_register_plugin_index(
 	if ( index >= 0 && rc == LDAP_SUCCESS ) {
 		rc = slapi_pblock_set( pPB, SLAPI_IBM_PBLOCK, (void *)pTmpPB );
 	}
+
+	slapi_int_update_plugin_types( be );
      
 	return ( rc != LDAP_SUCCESS ) ? LDAP_OTHER : LDAP_SUCCESS;
 }
@@ -215,7 +276,8 @@ slapi_int_get_plugins(
 
 	assert( ppFuncPtrs != NULL );
 
-	if ( be == NULL ) {
+	if ( !slapi_int_has_plugins( be, functype ) ) {
+		*ppFuncPtrs = NULL;
 		goto done;
 	}
 
@@ -769,6 +831,7 @@ slapi_int_unregister_plugins(
 				slapi_int_unregister_plugin( be, pSavePB, NULL );
 			}
 		}
+		SLAPI_BACKEND_PBLOCK( be ) = NULL;
 	} else if ( index == 0 ) {
 		slapi_pblock_get( pTmpPB, SLAPI_IBM_PBLOCK, &pSavePB );
 		SLAPI_BACKEND_PBLOCK( be ) = pSavePB;
@@ -783,6 +846,9 @@ slapi_int_unregister_plugins(
 			slapi_int_unregister_plugin( be, pTmpPB, pSavePB );
 		}
 	}
+
+	slapi_int_update_plugin_types( be );
+
 	return rc;
 }
 
@@ -46,6 +46,10 @@ LDAP_BEGIN_DECL
 
 #define SLAPI_OPERATION_PBLOCK(_op)		((_op)->o_callback->sc_private)
 #define SLAPI_BACKEND_PBLOCK(_be)		((_be)->be_pb)
+#define SLAPI_BACKEND_PLUGIN_TYPES(_be)		((_be)->be_pb_types)
+
+/* function types tracked in SLAPI_BACKEND_PLUGIN_TYPES */
+#define SLAPI_PLUGIN_TYPES_MAX			1536
 
 #define SLAPI_OPERATION_EXTENSIONS(_op)		((_op)->o_hdr->oh_extensions)
 #define SLAPI_CONNECTION_EXTENSIONS(_conn)	((_conn)->c_extensions)
@@ -117,6 +121,12 @@ typedef enum slapi_pblock_class_e {
 #define PBLOCK_ERROR			(-1)
 #define PBLOCK_MAX_PARAMS		100
 
+/* parameters from SLAPI_IBM_PBLOCK up to PBLOCK_PARAM_RANGE get a
+ * dense id, used to index the parameter slots without a search */
+#define PBLOCK_PARAM_MIN		SLAPI_IBM_PBLOCK
+#define PBLOCK_PARAM_RANGE		1536
+#define PBLOCK_MAX_PARAM_IDS		256
+
 union slapi_pblock_value {
 	int pv_integer;
 	long pv_long_integer;
@@ -129,6 +139,7 @@ struct slapi_pblock {
 	int			pb_nParams;
 	int			pb_params[PBLOCK_MAX_PARAMS];
 	union slapi_pblock_value pb_values[PBLOCK_MAX_PARAMS];
+	unsigned char		pb_slots[PBLOCK_MAX_PARAM_IDS];	/* id -> index + 1 */
 	/* native types */
 	Connection		*pb_conn;
 	Operation		*pb_op;
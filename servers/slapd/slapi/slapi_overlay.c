@@ -147,6 +147,10 @@ slapi_over_aux_operational( Operation *op, SlapReply *rs )
 	computed_attr_context    ctx;
 	AttributeName		*anp;
 
+	if ( !slapi_int_has_plugins( frontendDB, SLAPI_PLUGIN_COMPUTE_EVALUATOR_FN ) ) {
+		return SLAP_CB_CONTINUE;
+	}
+
 	if ( slapi_op_internal_p( op, rs, NULL ) ) {
 		return SLAP_CB_CONTINUE;
 	}
@@ -204,6 +208,13 @@ slapi_over_call_plugins( Slapi_PBlock *pb, int type )
 	return rc;
 }
 
+static int
+slapi_over_has_plugins( Operation *op, int type )
+{
+	return slapi_int_has_plugins( frontendDB, type ) ||
+		slapi_int_has_plugins( op->o_bd, type );
+}
+
 static int
 slapi_over_search( Operation *op, SlapReply *rs, int type )
 {
@@ -212,6 +223,11 @@ slapi_over_search( Operation *op, SlapReply *rs, int type )
 
 	assert( rs->sr_type == REP_SEARCH || rs->sr_type == REP_SEARCHREF );
 
+	if ( !slapi_over_has_plugins( op, type ) ) {
+		/* same as calling no plugins */
+		return SLAP_CB_CONTINUE;
+	}
+
 	/* create a new pblock to not trample on result controls */
 	pb = slapi_over_pblock_new( op, rs );
 
@@ -556,6 +572,40 @@ slapi_over_cleanup( Operation *op, SlapReply *rs )
 	return rc;
 }
 
+/*
+ * Check whether any plugin may be called for an operation: its
+ * pre and postoperation plugins, and those called on its responses.
+ */
+static int
+slapi_op_plugins_p( Operation *op, struct slapi_op_info *opinfo )
+{
+	static const int response_types[] = {
+		SLAPI_PLUGIN_PRE_RESULT_FN,
+		SLAPI_PLUGIN_POST_RESULT_FN,
+		SLAPI_PLUGIN_PRE_ENTRY_FN,
+		SLAPI_PLUGIN_POST_ENTRY_FN,
+		SLAPI_PLUGIN_PRE_REFERRAL_FN,
+		SLAPI_PLUGIN_POST_REFERRAL_FN,
+		SLAPI_PLUGIN_COMPUTE_SEARCH_REWRITER_FN,
+		0
+	};
+	int i;
+
+	if ( slapi_over_has_plugins( op, opinfo->soi_preop ) ||
+		slapi_over_has_plugins( op, opinfo->soi_postop ) )
+	{
+		return 1;
+	}
+
+	for ( i = 0; response_types[i] != 0; i++ ) {
+		if ( slapi_over_has_plugins( op, response_types[i] ) ) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 static int
 slapi_op_func( Operation *op, SlapReply *rs )
 {
@@ -591,6 +641,16 @@ slapi_op_func( Operation *op, SlapReply *rs )
 		return SLAP_CB_CONTINUE;
 	}
 
+	/*
+	 * Unless this is a SLAPI internal operation, which already
+	 * has its pblock, don't build one if no plugin would see it.
+	 */
+	if ( !slapi_op_plugins_p( op, opinfo ) &&
+		!slapi_op_internal_p( op, rs, NULL ) )
+	{
+		return SLAP_CB_CONTINUE;
+	}
+
 	internal_op = slapi_op_internal_p( op, rs, &cb );
 
 	if ( internal_op ) {
@@ -731,6 +791,10 @@ slapi_over_access_allowed(
 	int			internal_op;
 	SlapReply		rs = { REP_RESULT };
 
+	if ( !slapi_int_has_plugins( frontendDB, SLAPI_PLUGIN_ACL_ALLOW_ACCESS ) ) {
+		return SLAP_CB_CONTINUE;
+	}
+
 	internal_op = slapi_op_internal_p( op, &rs, &cb );
 
 	cb.sc_response = NULL;
@@ -792,7 +856,13 @@ slapi_over_acl_group(
 	} else {
 		rc = be_entry_get_rw( op, gr_ndn, group_oc, group_at, 0, &e );
 	}
-	if ( e != NULL ) {
+	if ( e != NULL && !slapi_over_has_plugins( op, SLAPI_X_PLUGIN_PRE_GROUP_FN ) ) {
+		/* same as calling no plugins */
+		if ( e != target ) {
+			be_entry_release_r( op, e );
+		}
+		rc = SLAP_CB_CONTINUE;
+	} else if ( e != NULL ) {
 		int			internal_op;
 		slap_callback		cb;
 
@@ -939,6 +1009,8 @@ int slapi_over_config( BackendDB *be, ConfigReply *cr )
 		if ( rc != 0 )
 			return rc;
 
+		slapi_int_pblock_init();
+
 		rc = slapi_over_init();
 		if ( rc != 0 )
 			return rc;
@@ -302,6 +302,84 @@ pblock_get_param_class( int param )
 	return PBLOCK_CLASS_INVALID;
 }
 
+/* dense id of each parameter, 0 if it has none */
+static unsigned char pblock_param_ids[PBLOCK_PARAM_RANGE - PBLOCK_PARAM_MIN];
+
+void
+slapi_int_pblock_init( void )
+{
+	int param, id = 0;
+
+	for ( param = PBLOCK_PARAM_MIN; param < PBLOCK_PARAM_RANGE; param++ ) {
+		if ( pblock_get_param_class( param ) == PBLOCK_CLASS_INVALID ) {
+			continue;
+		}
+		if ( ++id >= PBLOCK_MAX_PARAM_IDS ) {
+			/* the remaining ones are searched for */
+			break;
+		}
+		pblock_param_ids[param - PBLOCK_PARAM_MIN] = id;
+	}
+}
+
+static int
+pblock_param_id( int param )
+{
+	if ( param < PBLOCK_PARAM_MIN || param >= PBLOCK_PARAM_RANGE ) {
+		return 0;
+	}
+	return pblock_param_ids[param - PBLOCK_PARAM_MIN];
+}
+
+/* index of param in pb_params, -1 if not set */
+static int
+pblock_find( Slapi_PBlock *pb, int param )
+{
+	int i, id;
+
+	id = pblock_param_id( param );
+	if ( id != 0 ) {
+		return (int)pb->pb_slots[id] - 1;
+	}
+
+	for ( i = 0; i < pb->pb_nParams; i++ ) {
+		if ( pb->pb_params[i] == param ) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static void
+pblock_index( Slapi_PBlock *pb, int param, int i )
+{
+	int id;
+
+	id = pblock_param_id( param );
+	if ( id != 0 ) {
+		pb->pb_slots[id] = i + 1;
+	}
+}
+
+/* mark the function types set in pb in the types bitmap */
+void
+slapi_int_pblock_get_types( Slapi_PBlock *pb, unsigned char *types )
+{
+	int i, param;
+
+	for ( i = 0; i < pb->pb_nParams; i++ ) {
+		param = pb->pb_params[i];
+		if ( param < 0 || param >= SLAPI_PLUGIN_TYPES_MAX ||
+			pb->pb_values[i].pv_function_pointer == NULL ||
+			pblock_get_param_class( param ) != PBLOCK_CLASS_FUNCTION_POINTER )
+		{
+			continue;
+		}
+		types[param >> 3] |= 1 << (param & 7);
+	}
+}
+
 static void
 pblock_lock( Slapi_PBlock *pb )
 {
@@ -340,26 +418,24 @@ pblock_get_default( Slapi_PBlock *pb, int param, void **value )
 		return PBLOCK_ERROR;
 	}
 
-	for ( i = 0; i < pb->pb_nParams; i++ ) {
-		if ( pb->pb_params[i] == param ) {
-			switch ( pbClass ) {
-			case PBLOCK_CLASS_INTEGER:
-				*((int *)value) = pb->pb_values[i].pv_integer;
-				break;
-			case PBLOCK_CLASS_LONG_INTEGER:
-				*((long *)value) = pb->pb_values[i].pv_long_integer;
-				break;
-			case PBLOCK_CLASS_POINTER:
-				*value = pb->pb_values[i].pv_pointer;
-				break;
-			case PBLOCK_CLASS_FUNCTION_POINTER:
-				*value = pb->pb_values[i].pv_function_pointer;
-				break;
-			default:
-				break;
-			}
+	i = pblock_find( pb, param );
+	if ( i >= 0 ) {
+		switch ( pbClass ) {
+		case PBLOCK_CLASS_INTEGER:
+			*((int *)value) = pb->pb_values[i].pv_integer;
 			break;
-	  	}
+		case PBLOCK_CLASS_LONG_INTEGER:
+			*((long *)value) = pb->pb_values[i].pv_long_integer;
+			break;
+		case PBLOCK_CLASS_POINTER:
+			*value = pb->pb_values[i].pv_pointer;
+			break;
+		case PBLOCK_CLASS_FUNCTION_POINTER:
+			*value = pb->pb_values[i].pv_function_pointer;
+			break;
+		default:
+			break;
+		}
 	}
 
 	return PBLOCK_SUCCESS;
@@ -403,17 +479,14 @@ pblock_set_default( Slapi_PBlock *pb, int param, void *value )
 		return PBLOCK_ERROR;
 	}
 
-	if ( pb->pb_nParams == PBLOCK_MAX_PARAMS ) {
-		return PBLOCK_ERROR;
-	}
-
-	for ( i = 0; i < pb->pb_nParams; i++ ) {
-		if ( pb->pb_params[i] == param )
-			break;
-	}
-	if ( i >= pb->pb_nParams ) {
+	i = pblock_find( pb, param );
+	if ( i < 0 ) {
+		if ( pb->pb_nParams == PBLOCK_MAX_PARAMS ) {
+			return PBLOCK_ERROR;
+		}
+		i = pb->pb_nParams++;
 		pb->pb_params[i] = param;
-	  	pb->pb_nParams++;
+		pblock_index( pb, param, i );
 	}
 
 	switch ( pbClass ) {
@@ -1289,6 +1362,8 @@ static void
 pblock_clear( Slapi_PBlock *pb ) 
 {
 	pb->pb_nParams = 1;
+	memset( pb->pb_slots, 0, sizeof( pb->pb_slots ) );
+	pblock_index( pb, pb->pb_params[0], 0 );
 }
 
 static int
@@ -1298,21 +1373,19 @@ pblock_delete_param( Slapi_PBlock *p, int param )
 
 	pblock_lock(p);
 
-	for ( i = 0; i < p->pb_nParams; i++ ) { 
-		if ( p->pb_params[i] == param ) {
-			break;
-		}
-	}
-    
-	if (i >= p->pb_nParams ) {
+	i = pblock_find( p, param );
+	if ( i < 0 ) {
 		pblock_unlock( p );
 		return PBLOCK_ERROR;
 	}
 
+	pblock_index( p, param, -1 );
+
 	/* move last parameter to index of deleted parameter */
-	if ( p->pb_nParams > 1 ) {
+	if ( p->pb_nParams > 1 && i < p->pb_nParams - 1 ) {
 		p->pb_params[i] = p->pb_params[p->pb_nParams - 1];
 		p->pb_values[i] = p->pb_values[p->pb_nParams - 1];
+		pblock_index( p, p->pb_params[i], i );
 	}
 	p->pb_nParams--;
 
@@ -1333,6 +1406,7 @@ slapi_pblock_new(void)
 		pb->pb_params[0] = SLAPI_IBM_PBLOCK;
 		pb->pb_values[0].pv_pointer = NULL;
 		pb->pb_nParams = 1;
+		pblock_index( pb, SLAPI_IBM_PBLOCK, 0 );
 		pb->pb_conn = NULL;
 		pb->pb_op = NULL;
 		pb->pb_rs = NULL;
@@ -99,6 +99,9 @@ typedef struct cookie_state {
 #define RETRYNUM_VALID(n)	((n) >= RETRYNUM_FOREVER)	/* valid retrynum */
 #define RETRYNUM_FINITE(n)	((n) > RETRYNUM_FOREVER)	/* not forever */
 
+/* apply time histogram buckets, each 10 times the previous one */
+#define SR_APPLY_BUCKETS	6	/* 0-100us ... 100ms-1s, 1s+ */
+
 typedef struct syncinfo_s {
 	struct syncinfo_s	*si_next;
 	BackendDB		*si_be;
@@ -124,6 +127,7 @@ typedef struct syncinfo_s {
 	int			si_allattrs;
 	int			si_allopattrs;
 	int			si_schemachecking;
+#define	SYNC_SCHEMA_TRUSTED	2	/* no schema check, no syntax validation */
 	int			si_type;	/* the active type */
 	int			si_ctype;	/* the configured type */
 	time_t			si_interval;
@@ -142,11 +146,19 @@ typedef struct syncinfo_s {
 	int			si_syncdata;
 	int			si_logstate;
 	int			si_lazyCommit;
+	int			si_compress;	/* ask for a compressed stream */
+	int			si_applyBatch;	/* max changes per backend txn */
+	int			si_applyBatchTime;	/* max msec per backend txn */
+	int			si_batched;	/* changes in the open batch */
+	int			si_nobatch;	/* the backend can't nest txns */
+	OpExtra			*si_batch;	/* the open backend txn */
+	struct timeval		si_batchStart;
+	struct sync_cookie	si_batchCookie;	/* CSNs of the open batch */
 	int			si_got;
 	int			si_strict_refresh;	/* stop listening during fallback refresh */
 	int			si_too_old;
 	ber_int_t	si_msgid;
-	Avlnode			*si_presentlist;
+	struct presentlist	*si_presentlist;
 	LDAP			*si_ld;
 	Connection		*si_conn;
 	LDAP_LIST_HEAD(np, nonpresent_entry)	si_nonpresentlist;
@@ -167,16 +179,21 @@ typedef struct syncinfo_s {
 	struct berval	si_lastCookieSent;
 	struct berval	si_monitor_ndn;
 	char	si_connaddrbuf[SLAP_ADDRLEN];
+	unsigned long	si_changes;	/* changes applied */
+	unsigned long	si_bytesRcvd;	/* bytes read from the provider */
+	time_t	si_rateSec;	/* second si_rateCur is counting */
+	unsigned long	si_rateCur;
+	unsigned long	si_rateLast;	/* changes in the previous second */
+	unsigned long	si_applyTimes[SR_APPLY_BUCKETS];
+	struct sync_cookie	si_provCSN;	/* newest CSN received per SID */
 
 	ldap_pvt_thread_mutex_t	si_monitor_mutex;
 	ldap_pvt_thread_mutex_t	si_mutex;
 } syncinfo_t;
 
-static int syncuuid_cmp( const void *, const void * );
+struct presentlist;
 static int presentlist_insert( syncinfo_t* si, struct berval *syncUUID );
-static void presentlist_delete( Avlnode **av, struct berval *syncUUID );
-static char *presentlist_find( Avlnode *av, struct berval *syncUUID );
-static int presentlist_free( Avlnode *av );
+static int presentlist_free( struct presentlist *pl );
 static void syncrepl_del_nonpresent( Operation *, syncinfo_t *, BerVarray, struct sync_cookie *, int );
 static int syncrepl_message_to_op(
 					syncinfo_t *, Operation *, LDAPMessage *, int );
@@ -914,6 +931,115 @@ check_syncprov(
 	return changed;
 }
 
+/* Count the bytes read from the provider, below any SASL, TLS or
+ * compression layer */
+static int
+sb_count_setup( Sockbuf_IO_Desc *sbiod, void *arg )
+{
+	sbiod->sbiod_pvt = arg;
+	return 0;
+}
+
+static int
+sb_count_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg )
+{
+	return LBER_SBIOD_CTRL_NEXT( sbiod, opt, arg );
+}
+
+static ber_slen_t
+sb_count_read( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	ber_slen_t ret = LBER_SBIOD_READ_NEXT( sbiod, buf, len );
+
+	if ( ret > 0 )
+		*(unsigned long *)sbiod->sbiod_pvt += ret;
+	return ret;
+}
+
+static ber_slen_t
+sb_count_write( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	return LBER_SBIOD_WRITE_NEXT( sbiod, buf, len );
+}
+
+static Sockbuf_IO sb_count_io = {
+	sb_count_setup,		/* sbi_setup */
+	NULL,			/* sbi_remove */
+	sb_count_ctrl,		/* sbi_ctrl */
+	sb_count_read,		/* sbi_read */
+	sb_count_write,		/* sbi_write */
+	NULL			/* sbi_close */
+};
+
+/* Remember a cookie received from the provider, and the newest CSN
+ * seen for each of its SIDs */
+static void
+syncrepl_monitor_cookie( syncinfo_t *si, struct berval *cookie )
+{
+	struct sync_cookie sc = { NULL };
+	int i, j;
+
+	if ( BER_BVISEMPTY( &si->si_monitor_ndn )) {
+		ldap_pvt_thread_mutex_lock( &si->si_monitor_mutex );
+		ber_bvreplace( &si->si_lastCookieRcvd, cookie );
+		ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
+		return;
+	}
+
+	ber_dupbv( &sc.octet_str, cookie );
+	slap_parse_sync_cookie( &sc, NULL );
+
+	ldap_pvt_thread_mutex_lock( &si->si_monitor_mutex );
+	ber_bvreplace( &si->si_lastCookieRcvd, cookie );
+	for ( i = 0; i < sc.numcsns; i++ ) {
+		for ( j = 0; j < si->si_provCSN.numcsns; j++ ) {
+			if ( si->si_provCSN.sids[j] >= sc.sids[i] )
+				break;
+		}
+		if ( j < si->si_provCSN.numcsns &&
+			si->si_provCSN.sids[j] == sc.sids[i] )
+		{
+			if ( ber_bvcmp( &sc.ctxcsn[i], &si->si_provCSN.ctxcsn[j] ) > 0 )
+				ber_bvreplace( &si->si_provCSN.ctxcsn[j], &sc.ctxcsn[i] );
+		} else {
+			slap_insert_csn_sids( &si->si_provCSN, j, sc.sids[i],
+				&sc.ctxcsn[i] );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
+
+	slap_sync_cookie_free( &sc, 0 );
+}
+
+/* Account for one change applied, started at *start */
+static void
+syncrepl_monitor_applied( syncinfo_t *si, struct timeval *start )
+{
+	struct timeval now;
+	unsigned long usec, limit;
+	int i;
+
+	gettimeofday( &now, NULL );
+	usec = ( now.tv_sec - start->tv_sec ) * 1000000 +
+		now.tv_usec - start->tv_usec;
+	for ( i = 0, limit = 100; i < SR_APPLY_BUCKETS - 1; i++, limit *= 10 ) {
+		if ( usec < limit )
+			break;
+	}
+
+	ldap_pvt_thread_mutex_lock( &si->si_monitor_mutex );
+	si->si_changes++;
+	si->si_applyTimes[i]++;
+	if ( now.tv_sec != si->si_rateSec ) {
+		si->si_rateLast = now.tv_sec == si->si_rateSec + 1 ?
+			si->si_rateCur : 0;
+		si->si_rateCur = 0;
+		si->si_rateSec = now.tv_sec;
+	}
+	si->si_rateCur++;
+	ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
+}
+
 static int
 do_syncrep1(
 	Operation *op,
@@ -935,6 +1061,46 @@ do_syncrep1(
 	}
 	op->o_protocol = LDAP_VERSION3;
 
+	{
+		Sockbuf *sb;
+
+		ldap_get_option( si->si_ld, LDAP_OPT_SOCKBUF, &sb );
+		ber_sockbuf_add_io( sb, &sb_count_io, LBER_SBIOD_LEVEL_PROVIDER,
+			&si->si_bytesRcvd );
+	}
+
+#ifdef HAVE_ZLIB
+	if ( si->si_compress ) {
+		char *retoid = NULL;
+		struct berval *retdata = NULL;
+		Sockbuf *sb;
+
+		rc = ldap_extended_operation_s( si->si_ld, LDAP_EXOP_X_START_COMPRESS,
+			NULL, NULL, NULL, &retoid, &retdata );
+		if ( retoid ) ldap_memfree( retoid );
+		if ( retdata ) ber_bvfree( retdata );
+
+		if ( rc == LDAP_SUCCESS ) {
+			/* the provider compresses everything after its response */
+			ldap_get_option( si->si_ld, LDAP_OPT_SOCKBUF, &sb );
+			if ( ber_sockbuf_add_io( sb, &ber_sockbuf_io_zlib,
+				LBER_SBIOD_LEVEL_APPLICATION, NULL ) < 0 )
+			{
+				Debug( LDAP_DEBUG_ANY, "do_syncrep1: %s "
+					"unable to install the compression layer\n",
+					si->si_ridtxt );
+				rc = LDAP_LOCAL_ERROR;
+				goto done;
+			}
+		} else {
+			Debug( LDAP_DEBUG_ANY, "do_syncrep1: %s "
+				"provider refused compression: %s (%d), continuing without\n",
+				si->si_ridtxt, ldap_err2string( rc ), rc );
+			rc = LDAP_SUCCESS;
+		}
+	}
+#endif
+
 	/* Set SSF to strongest of TLS, SASL SSFs */
 	op->o_sasl_ssf = 0;
 	op->o_tls_ssf = 0;
@@ -1201,6 +1367,208 @@ get_pmutex(
 	return 0;
 }
 
+/* Whether received changes may be applied in batches. Unless this
+ * consumer is the only writer that coordinates with others, holding
+ * the backend's write txn across changes could deadlock: other
+ * consumers of this DB wait on it under the shared cookie state, and
+ * syncprov and accesslog make writers wait for each other.
+ */
+static int
+syncrepl_batch_ok( syncinfo_t *si )
+{
+	return si->si_applyBatch > 0 && !si->si_nobatch &&
+		si->si_cookieState->cs_ref == 1 &&
+		si->si_wbe->bd_info->bi_op_txn &&
+		!overlay_is_inst( si->si_wbe, "syncprov" ) &&
+		!overlay_is_inst( si->si_wbe, "accesslog" );
+}
+
+/* The batch never got into the DB, but the cookie state already
+ * counts it. Forget it all, so it gets read again from the DB.
+ */
+static void
+syncrepl_batch_lost( syncinfo_t *si )
+{
+	cookie_state *cs = si->si_cookieState;
+
+	ldap_pvt_thread_mutex_lock( &cs->cs_pmutex );
+	ber_bvarray_free( cs->cs_pvals );
+	ch_free( cs->cs_psids );
+	cs->cs_pvals = NULL;
+	cs->cs_psids = NULL;
+	cs->cs_pnum = 0;
+	ldap_pvt_thread_mutex_unlock( &cs->cs_pmutex );
+
+	ldap_pvt_thread_mutex_lock( &cs->cs_mutex );
+	ber_bvarray_free( cs->cs_vals );
+	ch_free( cs->cs_sids );
+	cs->cs_vals = NULL;
+	cs->cs_sids = NULL;
+	cs->cs_num = 0;
+	ldap_pvt_thread_mutex_unlock( &cs->cs_mutex );
+
+	ber_bvarray_free( si->si_syncCookie.ctxcsn );
+	si->si_syncCookie.ctxcsn = NULL;
+}
+
+/* Commit the changes batched so far, along with the contextCSN
+ * they bring the DB to.
+ */
+static int
+syncrepl_batch_commit( syncinfo_t *si, Operation *op )
+{
+	BackendDB *be = op->o_bd;
+	int rc = LDAP_SUCCESS;
+
+	if ( !si->si_batch )
+		return LDAP_SUCCESS;
+
+	if ( si->si_batchCookie.numcsns ) {
+		rc = syncrepl_updateCookie( si, op, &si->si_batchCookie, 0 );
+		slap_sync_cookie_free( &si->si_batchCookie, 0 );
+	}
+
+	op->o_bd = si->si_wbe;
+	LDAP_SLIST_REMOVE( &op->o_extra, si->si_batch, OpExtra, oe_next );
+	if ( rc == LDAP_SUCCESS ) {
+		rc = op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_COMMIT, &si->si_batch );
+		if ( rc == LDAP_SUCCESS ) {
+			/* the batched changes are visible only now */
+			group_cache_bump();
+			authz_cache_bump();
+		}
+	} else {
+		op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_ABORT, &si->si_batch );
+	}
+	op->o_bd = be;
+	Debug( LDAP_DEBUG_SYNC, "syncrepl_batch_commit: %s "
+		"committed %d changes (%d)\n",
+		si->si_ridtxt, si->si_batched, rc );
+	si->si_batch = NULL;
+	si->si_batched = 0;
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "syncrepl_batch_commit: %s "
+			"commit failed (%d)\n", si->si_ridtxt, rc );
+		syncrepl_batch_lost( si );
+		rc = LDAP_OTHER;
+	}
+	return rc;
+}
+
+/* Start applying a change inside the batch. Each change gets a
+ * savepoint of its own, so a failed one can be undone without
+ * losing those before it. Returns zero if the change has to be
+ * applied on its own.
+ */
+static int
+syncrepl_batch_begin( syncinfo_t *si, Operation *op )
+{
+	BackendDB *be = op->o_bd;
+	int rc;
+
+	if ( !syncrepl_batch_ok( si ))
+		return 0;
+
+	op->o_bd = si->si_wbe;
+	if ( !si->si_batch ) {
+		rc = op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_BEGIN, &si->si_batch );
+		if ( rc ) {
+			if ( si->si_batch ) {
+				LDAP_SLIST_REMOVE( &op->o_extra, si->si_batch, OpExtra, oe_next );
+				op->o_tmpfree( si->si_batch, op->o_tmpmemctx );
+				si->si_batch = NULL;
+			}
+			op->o_bd = be;
+			return 0;
+		}
+		gettimeofday( &si->si_batchStart, NULL );
+	}
+	rc = op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_SAVEPOINT, &si->si_batch );
+	op->o_bd = be;
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "syncrepl_batch_begin: %s "
+			"backend can't nest txns, applying changes one by one\n",
+			si->si_ridtxt );
+		si->si_nobatch = 1;
+		syncrepl_batch_commit( si, op );
+		return 0;
+	}
+	return 1;
+}
+
+/* Keep or undo the change just applied, commit when the batch is full */
+static int
+syncrepl_batch_end( syncinfo_t *si, Operation *op, int rc )
+{
+	BackendDB *be = op->o_bd;
+
+	op->o_bd = si->si_wbe;
+	if ( rc == LDAP_SUCCESS ) {
+		rc = op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_RELEASE, &si->si_batch );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY, "syncrepl_batch_end: %s "
+				"commit of savepoint failed (%d)\n", si->si_ridtxt, rc );
+			LDAP_SLIST_REMOVE( &op->o_extra, si->si_batch, OpExtra, oe_next );
+			op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_ABORT, &si->si_batch );
+			op->o_bd = be;
+			si->si_batch = NULL;
+			si->si_batched = 0;
+			slap_sync_cookie_free( &si->si_batchCookie, 0 );
+			syncrepl_batch_lost( si );
+			return LDAP_OTHER;
+		}
+		si->si_batched++;
+	} else {
+		op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_ROLLBACK, &si->si_batch );
+	}
+	op->o_bd = be;
+	if ( si->si_applyBatchTime ) {
+		struct timeval now;
+		long msec;
+
+		gettimeofday( &now, NULL );
+		msec = ( now.tv_sec - si->si_batchStart.tv_sec ) * 1000 +
+			( now.tv_usec - si->si_batchStart.tv_usec ) / 1000;
+		if ( msec >= si->si_applyBatchTime )
+			si->si_batched = si->si_applyBatch;
+	}
+	if ( si->si_batched >= si->si_applyBatch ) {
+		int rc2 = syncrepl_batch_commit( si, op );
+		if ( rc == LDAP_SUCCESS )
+			rc = rc2;
+	}
+	return rc;
+}
+
+/* Record the CSNs a change brings. A batched change leaves the
+ * contextCSN to be updated once, when the batch is committed.
+ */
+static int
+syncrepl_batch_cookie( syncinfo_t *si, Operation *op,
+	struct sync_cookie *syncCookie, int batched )
+{
+	struct sync_cookie *bc = &si->si_batchCookie;
+	int i, j;
+
+	if ( !batched )
+		return syncrepl_updateCookie( si, op, syncCookie, 0 );
+
+	for ( i = 0; i < syncCookie->numcsns; i++ ) {
+		for ( j = 0; j < bc->numcsns; j++ ) {
+			if ( syncCookie->sids[i] <= bc->sids[j] )
+				break;
+		}
+		if ( j < bc->numcsns && syncCookie->sids[i] == bc->sids[j] ) {
+			if ( ber_bvcmp( &syncCookie->ctxcsn[i], &bc->ctxcsn[j] ) > 0 )
+				ber_bvreplace( &bc->ctxcsn[j], &syncCookie->ctxcsn[i] );
+		} else {
+			slap_insert_csn_sids( bc, j, syncCookie->sids[i],
+				&syncCookie->ctxcsn[i] );
+		}
+	}
+	return LDAP_SUCCESS;
+}
+
 static int
 do_syncrep2(
 	Operation *op,
@@ -1246,16 +1614,34 @@ do_syncrep2(
 		char			*retoid;
 		LDAPControl		**rctrls = NULL, *rctrlp = NULL;
 		BerVarray		syncUUIDs;
+		ber_len_t		nuuids;
 		ber_len_t		len;
 		ber_tag_t		si_tag;
 		Entry			*entry;
 		struct berval	bdn;
+		int				batched = 0;
+		struct timeval	start;
 
 		if ( slapd_shutdown ) {
 			rc = SYNC_SHUTDOWN;
 			goto done;
 		}
 		si->si_lastcontact = slap_get_time();
+		gettimeofday( &start, NULL );
+
+		/* Only entries and log records are batched, anything else
+		 * needs the changes so far to be in the DB first.
+		 */
+		if ( si->si_batch && ( ldap_msgtype( msg ) != LDAP_RES_SEARCH_ENTRY ||
+#ifdef LDAP_CONTROL_X_DIRSYNC
+			si->si_ctype == MSAD_DIRSYNC ||
+#endif
+			si->si_syncdata == SYNCDATA_CHANGELOG ))
+		{
+			if (( rc = syncrepl_batch_commit( si, op )))
+				goto done;
+		}
+
 		switch( ldap_msgtype( msg ) ) {
 		case LDAP_RES_SEARCH_ENTRY:
 #ifdef LDAP_CONTROL_X_DIRSYNC
@@ -1373,9 +1759,7 @@ do_syncrep2(
 					ch_free( syncCookie.octet_str.bv_val );
 					ber_dupbv( &syncCookie.octet_str, &cookie );
 
-					ldap_pvt_thread_mutex_lock( &si->si_monitor_mutex );
-					ber_bvreplace( &si->si_lastCookieRcvd, &cookie );
-					ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
+					syncrepl_monitor_cookie( si, &cookie );
 				}
 				if ( !BER_BVISNULL( &syncCookie.octet_str ) )
 				{
@@ -1430,10 +1814,11 @@ do_syncrep2(
 			rc = 0;
 			if ( si->si_syncdata && si->si_logstate == SYNCLOG_LOGGING ) {
 				modlist = NULL;
+				batched = syncrepl_batch_begin( si, op );
 				if ( ( rc = syncrepl_message_to_op( si, op, msg, punlock < 0 ) ) == LDAP_SUCCESS &&
 					syncCookie.ctxcsn )
 				{
-					rc = syncrepl_updateCookie( si, op, &syncCookie, 0 );
+					rc = syncrepl_batch_cookie( si, op, &syncCookie, batched );
 				} else
 logerr:
 					switch ( rc ) {
@@ -1463,11 +1848,12 @@ logerr:
 					if (( rc = get_pmutex( si )))
 						goto done;
 				}
+				batched = syncrepl_batch_begin( si, op );
 				if ( ( rc = syncrepl_entry( si, op, entry, &modlist,
 					syncstate, syncUUID, syncCookie.ctxcsn ) ) == LDAP_SUCCESS &&
 					syncCookie.ctxcsn )
 				{
-					rc = syncrepl_updateCookie( si, op, &syncCookie, 0 );
+					rc = syncrepl_batch_cookie( si, op, &syncCookie, batched );
 				}
 				if ( punlock < 0 )
 					ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
@@ -1490,6 +1876,11 @@ logerr:
 				}
 				ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
 			}
+			if ( batched ) {
+				int rc2 = syncrepl_batch_end( si, op, rc );
+				if ( rc == LDAP_SUCCESS )
+					rc = rc2;
+			}
 			ldap_controls_free( rctrls );
 			if ( modlist ) {
 				slap_mods_free( modlist, 1 );
@@ -1591,9 +1982,7 @@ logerr:
 						ch_free( syncCookie.octet_str.bv_val );
 						ber_dupbv( &syncCookie.octet_str, &cookie);
 
-						ldap_pvt_thread_mutex_lock( &si->si_monitor_mutex );
-						ber_bvreplace( &si->si_lastCookieRcvd, &cookie );
-						ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
+						syncrepl_monitor_cookie( si, &cookie );
 					}
 					if ( !BER_BVISNULL( &syncCookie.octet_str ) )
 					{
@@ -1680,9 +2069,7 @@ logerr:
 						ch_free( syncCookie.octet_str.bv_val );
 						ber_dupbv( &syncCookie.octet_str, &cookie );
 
-						ldap_pvt_thread_mutex_lock( &si->si_monitor_mutex );
-						ber_bvreplace( &si->si_lastCookieRcvd, &cookie );
-						ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
+						syncrepl_monitor_cookie( si, &cookie );
 					}
 					if (!BER_BVISNULL( &syncCookie.octet_str ) ) {
 						slap_parse_sync_cookie( &syncCookie, NULL );
@@ -1715,9 +2102,7 @@ logerr:
 							ch_free( syncCookie.octet_str.bv_val );
 							ber_dupbv( &syncCookie.octet_str, &cookie );
 
-							ldap_pvt_thread_mutex_lock( &si->si_monitor_mutex );
-							ber_bvreplace( &si->si_lastCookieRcvd, &cookie );
-							ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
+							syncrepl_monitor_cookie( si, &cookie );
 						}
 						if ( !BER_BVISNULL( &syncCookie.octet_str ) )
 						{
@@ -1760,9 +2145,7 @@ logerr:
 							ch_free( syncCookie.octet_str.bv_val );
 							ber_dupbv( &syncCookie.octet_str, &cookie );
 
-							ldap_pvt_thread_mutex_lock( &si->si_monitor_mutex );
-							ber_bvreplace( &si->si_lastCookieRcvd, &cookie );
-							ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
+							syncrepl_monitor_cookie( si, &cookie );
 						}
 						if ( !BER_BVISNULL( &syncCookie.octet_str ) )
 						{
@@ -1776,22 +2159,24 @@ logerr:
 					{
 						ber_scanf( ber, "b", &refreshDeletes );
 					}
+					/* the UUIDs are only looked at while retdata
+					 * is around, decode them in place */
 					syncUUIDs = NULL;
-					rc = ber_scanf( ber, "[W]", &syncUUIDs );
+					nuuids = sizeof( struct berval );
+					rc = ber_scanf( ber, "[M]", &syncUUIDs, &nuuids,
+						(ber_len_t) 0 );
 					ber_scanf( ber, /*"{"*/ "}" );
 					if ( rc != LBER_ERROR ) {
 						if ( refreshDeletes ) {
 							syncrepl_del_nonpresent( op, si, syncUUIDs,
 								&syncCookie, m );
-							ber_bvarray_free_x( syncUUIDs, op->o_tmpmemctx );
-						} else {
+						} else if ( syncUUIDs ) {
 							int i;
 							for ( i = 0; !BER_BVISNULL( &syncUUIDs[i] ); i++ ) {
 								(void)presentlist_insert( si, &syncUUIDs[i] );
-								slap_sl_free( syncUUIDs[i].bv_val, op->o_tmpmemctx );
 							}
-							slap_sl_free( syncUUIDs, op->o_tmpmemctx );
 						}
+						slap_sl_free( syncUUIDs, op->o_tmpmemctx );
 					}
 					rc = 0;
 					slap_sync_cookie_free( &syncCookie, 0 );
@@ -1858,6 +2243,8 @@ logerr:
 			break;
 
 		}
+		if ( ldap_msgtype( msg ) == LDAP_RES_SEARCH_ENTRY )
+			syncrepl_monitor_applied( si, &start );
 		if ( !BER_BVISNULL( &syncCookie.octet_str ) ) {
 			slap_sync_cookie_free( &syncCookie_req, 0 );
 			syncCookie_req = syncCookie;
@@ -1866,6 +2253,8 @@ logerr:
 		ldap_msgfree( msg );
 		msg = NULL;
 		if ( ldap_pvt_thread_pool_pausing( &connection_pool )) {
+			if (( rc = syncrepl_batch_commit( si, op )))
+				goto done;
 			slap_sync_cookie_free( &syncCookie, 0 );
 			slap_sync_cookie_free( &syncCookie_req, 0 );
 			return SYNC_PAUSED;
@@ -1879,6 +2268,12 @@ logerr:
 	}
 
 done:
+	if ( si->si_batch ) {
+		int rc2 = syncrepl_batch_commit( si, op );
+		if ( rc == LDAP_SUCCESS )
+			rc = rc2;
+	}
+
 	if ( err != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_ANY,
 			"do_syncrep2: %s (%d) %s\n",
@@ -2015,7 +2410,9 @@ do_syncrepl(
 			si->si_contextdn = si->si_wbe->be_nsuffix[0];
 		}
 	}
-	if ( !si->si_schemachecking )
+	if ( si->si_schemachecking == SYNC_SCHEMA_TRUSTED )
+		op->o_no_schema_check = SLAP_NO_SCHEMA_CHECK_TRUSTED;
+	else if ( !si->si_schemachecking )
 		op->o_no_schema_check = 1;
 
 reload:
@@ -3757,7 +4154,40 @@ typedef struct dninfo {
 	AttributeDescription *newDesc;	/* for renames */
 } dninfo;
 
-#define HASHUUID	1
+/* UUIDs received during the present phase. They are spread over
+ * buckets by their first two bytes, each bucket holding the remaining
+ * bytes in one array. A bucket is only sorted when it's searched,
+ * so collecting millions of UUIDs costs little more than their size.
+ */
+#define PRESENT_KEYLEN	(UUIDLEN-2)
+
+typedef struct presentbucket {
+	unsigned char *pb_keys;
+	int pb_num;		/* keys in use */
+	int pb_max;		/* keys allocated */
+	int pb_sorted;	/* the first pb_sorted keys are in order */
+} presentbucket;
+
+typedef struct presentlist {
+	presentbucket pl_buckets[65536];
+	int pl_count;	/* keys inserted */
+	int pl_found;	/* keys looked up successfully */
+} presentlist;
+
+static int
+presentlist_cmp( const void *k1, const void *k2 )
+{
+	return memcmp( k1, k2, PRESENT_KEYLEN );
+}
+
+static presentbucket *
+presentlist_bucket( presentlist *pl, struct berval *uuid )
+{
+	unsigned short s;
+
+	memcpy( &s, uuid->bv_val, 2 );
+	return &pl->pl_buckets[s];
+}
 
 /* return 1 if inserted, 0 otherwise */
 static int
@@ -3765,96 +4195,76 @@ presentlist_insert(
 	syncinfo_t* si,
 	struct berval *syncUUID )
 {
-	char *val;
-
-#ifdef HASHUUID
-	Avlnode **av;
-	unsigned short s;
+	presentbucket *pb;
 
 	if ( !si->si_presentlist )
-		si->si_presentlist = ch_calloc(65536, sizeof( Avlnode * ));
-
-	av = (Avlnode **)si->si_presentlist;
-
-	val = ch_malloc(UUIDLEN-2);
-	memcpy(&s, syncUUID->bv_val, 2);
-	memcpy(val, syncUUID->bv_val+2, UUIDLEN-2);
-
-	if ( avl_insert( &av[s], val,
-		syncuuid_cmp, avl_dup_error ) )
-	{
-		ch_free( val );
-		return 0;
-	}
-#else
-	val = ch_malloc(UUIDLEN);
-
-	AC_MEMCPY( val, syncUUID->bv_val, UUIDLEN );
+		si->si_presentlist = ch_calloc( 1, sizeof( presentlist ));
+	pb = presentlist_bucket( si->si_presentlist, syncUUID );
 
-	if ( avl_insert( &si->si_presentlist, val,
-		syncuuid_cmp, avl_dup_error ) )
-	{
-		ch_free( val );
-		return 0;
+	if ( pb->pb_num == pb->pb_max ) {
+		pb->pb_max = pb->pb_max ? pb->pb_max * 2 : 4;
+		pb->pb_keys = ch_realloc( pb->pb_keys, pb->pb_max * PRESENT_KEYLEN );
 	}
-#endif
+	memcpy( pb->pb_keys + pb->pb_num * PRESENT_KEYLEN,
+		syncUUID->bv_val + 2, PRESENT_KEYLEN );
+	pb->pb_num++;
+	si->si_presentlist->pl_count++;
 
 	return 1;
 }
 
-static char *
+static int
 presentlist_find(
-	Avlnode *av,
+	presentlist *pl,
 	struct berval *val )
 {
-#ifdef HASHUUID
-	Avlnode **a2 = (Avlnode **)av;
-	unsigned short s;
+	presentbucket *pb;
+	int i, j;
 
-	if (!av)
-		return NULL;
+	if ( !pl )
+		return 0;
 
-	memcpy(&s, val->bv_val, 2);
-	return avl_find( a2[s], val->bv_val+2, syncuuid_cmp );
-#else
-	return avl_find( av, val->bv_val, syncuuid_cmp );
-#endif
+	pb = presentlist_bucket( pl, val );
+	if ( pb->pb_sorted < pb->pb_num ) {
+		qsort( pb->pb_keys, pb->pb_num, PRESENT_KEYLEN, presentlist_cmp );
+		/* a UUID may have been sent more than once */
+		for ( i = j = 1; i < pb->pb_num; i++ ) {
+			if ( presentlist_cmp( pb->pb_keys + (j-1) * PRESENT_KEYLEN,
+					pb->pb_keys + i * PRESENT_KEYLEN )) {
+				if ( i != j )
+					memcpy( pb->pb_keys + j * PRESENT_KEYLEN,
+						pb->pb_keys + i * PRESENT_KEYLEN, PRESENT_KEYLEN );
+				j++;
+			}
+		}
+		pl->pl_count -= pb->pb_num - j;
+		pb->pb_num = pb->pb_sorted = j;
+	}
+
+	if ( bsearch( val->bv_val + 2, pb->pb_keys, pb->pb_num, PRESENT_KEYLEN,
+			presentlist_cmp )) {
+		pl->pl_found++;
+		return 1;
+	}
+	return 0;
 }
 
+/* return the number of UUIDs that were never looked up */
 static int
-presentlist_free( Avlnode *av )
+presentlist_free( presentlist *pl )
 {
-#ifdef HASHUUID
-	Avlnode **a2 = (Avlnode **)av;
-	int i, count = 0;
+	int i, count;
 
-	if ( av ) {
-		for (i=0; i<65536; i++) {
-			if (a2[i])
-				count += avl_free( a2[i], ch_free );
-		}
-		ch_free( av );
+	if ( !pl )
+		return 0;
+
+	for ( i = 0; i < 65536; i++ ) {
+		if ( pl->pl_buckets[i].pb_keys )
+			ch_free( pl->pl_buckets[i].pb_keys );
 	}
+	count = pl->pl_count - pl->pl_found;
+	ch_free( pl );
 	return count;
-#else
-	return avl_free( av, ch_free );
-#endif
-}
-
-static void
-presentlist_delete(
-	Avlnode **av,
-	struct berval *val )
-{
-#ifdef HASHUUID
-	Avlnode **a2 = *(Avlnode ***)av;
-	unsigned short s;
-
-	memcpy(&s, val->bv_val, 2);
-	avl_delete( &a2[s], val->bv_val+2, syncuuid_cmp );
-#else
-	avl_delete( av, val->bv_val, syncuuid_cmp );
-#endif
 }
 
 static int
@@ -5098,6 +5508,26 @@ syncrepl_updateCookie(
 	return rc;
 }
 
+/* Order values by length, then contents. Only used to line up
+ * identical values, so it need not agree with any matching rule.
+ */
+static int
+attr_cmp_bvp( const void *v1, const void *v2 )
+{
+	const struct berval *b1 = *(const struct berval **)v1;
+	const struct berval *b2 = *(const struct berval **)v2;
+
+	if ( b1->bv_len != b2->bv_len )
+		return b1->bv_len < b2->bv_len ? -1 : 1;
+	return memcmp( b1->bv_val, b2->bv_val, b1->bv_len );
+}
+
+/* Beyond this many value pairs, sort both sides and merge them
+ * instead of comparing every old value with every new one.
+ * Either way only the values that differ become Add or Delete mods.
+ */
+#define ATTR_CMP_MERGE	256
+
 /* Compare the attribute from the old entry to the one in the new
  * entry. The Modifications from the new entry will either be left
  * in place, or changed to an Add or Delete as needed.
@@ -5113,6 +5543,7 @@ attr_cmp( Operation *op, Attribute *old, Attribute *new,
 
 	if ( old ) {
 		int n, o, nn, no;
+		int lo, ohi, nhi;
 		struct berval **adds, **dels;
 		/* count old and new */
 		for ( o=0; old->a_vals[o].bv_val; o++ ) ;
@@ -5131,16 +5562,62 @@ attr_cmp( Operation *op, Attribute *old, Attribute *new,
 
 		nn = n; no = o;
 
-		for ( i=0; i<o; i++ ) {
-			for ( j=0; j<n; j++ ) {
-				if ( !adds[j] )
-					continue;
-				if ( bvmatch( dels[i], adds[j] ) ) {
+		/* Both sides usually list their values in the same order,
+		 * with only a few of them changed. Pair off the common
+		 * leading and trailing values first, leaving [lo,ohi) and
+		 * [lo,nhi) to be compared.
+		 */
+		for ( lo=0; lo<o && lo<n && bvmatch( dels[lo], adds[lo] ); lo++ ) {
+			dels[lo] = adds[lo] = NULL;
+		}
+		for ( ohi=o, nhi=n; ohi>lo && nhi>lo &&
+			bvmatch( dels[ohi-1], adds[nhi-1] ); ohi--, nhi-- )
+		{
+			dels[ohi-1] = adds[nhi-1] = NULL;
+		}
+		no -= o - ( ohi - lo );
+		nn -= n - ( nhi - lo );
+
+		j = 0;
+		if ( (unsigned long)( ohi - lo ) * ( nhi - lo ) > ATTR_CMP_MERGE ) {
+			struct berval **so, **sn;
+			int so_n = ohi - lo, sn_n = nhi - lo;
+
+			so = op->o_tmpalloc( sizeof(struct berval *) * ( so_n + sn_n ), op->o_tmpmemctx );
+			sn = so + so_n;
+			AC_MEMCPY( so, dels + lo, sizeof(struct berval *) * so_n );
+			AC_MEMCPY( sn, adds + lo, sizeof(struct berval *) * sn_n );
+			qsort( so, so_n, sizeof(struct berval *), attr_cmp_bvp );
+			qsort( sn, sn_n, sizeof(struct berval *), attr_cmp_bvp );
+
+			for ( i=0, j=0; i<so_n && j<sn_n; ) {
+				int c = attr_cmp_bvp( &so[i], &sn[j] );
+				if ( c == 0 ) {
 					no--;
 					nn--;
-					adds[j] = NULL;
-					dels[i] = NULL;
-					break;
+					dels[so[i] - old->a_vals] = NULL;
+					adds[sn[j] - new->a_vals] = NULL;
+					i++;
+					j++;
+				} else if ( c < 0 ) {
+					i++;
+				} else {
+					j++;
+				}
+			}
+			op->o_tmpfree( so, op->o_tmpmemctx );
+		} else {
+			for ( i=lo; i<ohi; i++ ) {
+				for ( j=lo; j<nhi; j++ ) {
+					if ( !adds[j] )
+						continue;
+					if ( bvmatch( dels[i], adds[j] ) ) {
+						no--;
+						nn--;
+						adds[j] = NULL;
+						dels[i] = NULL;
+						break;
+					}
 				}
 			}
 		}
@@ -5531,7 +6008,7 @@ nonpresent_callback(
 	syncinfo_t *si = op->o_callback->sc_private;
 	Attribute *a;
 	int count = 0;
-	char *present_uuid = NULL;
+	int present_uuid = 0;
 	struct nonpresent_entry *np_entry;
 	struct sync_cookie *syncCookie = op->o_controls[slap_cids.sc_LDAPsync];
 
@@ -5559,7 +6036,7 @@ nonpresent_callback(
 			if ( a == NULL ) return 0;
 		}
 
-		if ( present_uuid == NULL ) {
+		if ( !present_uuid ) {
 			int covered = 1; /* covered by our new contextCSN? */
 
 			if ( !syncCookie )
@@ -5591,10 +6068,6 @@ nonpresent_callback(
 					"adding entry %s to non-present list\n",
 					si->si_ridtxt, np_entry->npe_name->bv_val );
 			}
-
-		} else {
-			presentlist_delete( &si->si_presentlist, &a->a_nvals[0] );
-			ch_free( present_uuid );
 		}
 	}
 	return LDAP_SUCCESS;
@@ -5703,16 +6176,6 @@ done:;
 	return new;
 }
 
-static int
-syncuuid_cmp( const void* v_uuid1, const void* v_uuid2 )
-{
-#ifdef HASHUUID
-	return ( memcmp( v_uuid1, v_uuid2, UUIDLEN-2 ));
-#else
-	return ( memcmp( v_uuid1, v_uuid2, UUIDLEN ));
-#endif
-}
-
 void
 syncinfo_free( syncinfo_t *sie, int free_all )
 {
@@ -5749,6 +6212,7 @@ syncinfo_free( syncinfo_t *sie, int free_all )
 
 		ldap_pvt_thread_mutex_destroy( &sie->si_mutex );
 		ldap_pvt_thread_mutex_destroy( &sie->si_monitor_mutex );
+		slap_sync_cookie_free( &sie->si_provCSN, 0 );
 
 		bindconf_free( &sie->si_bindconf );
 
@@ -5920,6 +6384,9 @@ config_suffixm( ConfigArgs *c, syncinfo_t *si )
 #define SUFFIXMSTR		"suffixmassage"
 #define	STRICT_REFRESH	"strictrefresh"
 #define LAZY_COMMIT		"lazycommit"
+#define COMPRESSSTR		"compress"
+#define APPLYBATCHSTR		"applybatch"
+#define APPLYBATCHTIMESTR	"applybatchtime"
 
 /* FIXME: undocumented */
 #define EXATTRSSTR		"exattrs"
@@ -6103,6 +6570,8 @@ parse_syncrepl_line(
 			val = c->argv[ i ] + STRLENOF( SCHEMASTR "=" );
 			if ( !strncasecmp( val, "on", STRLENOF( "on" ) ) ) {
 				si->si_schemachecking = 1;
+			} else if ( !strcasecmp( val, "trusted" ) ) {
+				si->si_schemachecking = SYNC_SCHEMA_TRUSTED;
 			} else if ( !strncasecmp( val, "off", STRLENOF( "off" ) ) ) {
 				si->si_schemachecking = 0;
 			} else {
@@ -6447,6 +6916,35 @@ parse_syncrepl_line(
 					STRLENOF( LAZY_COMMIT ) ) )
 		{
 			si->si_lazyCommit = 1;
+		} else if ( !strcasecmp( c->argv[ i ], COMPRESSSTR ) ) {
+#ifdef HAVE_ZLIB
+			si->si_compress = 1;
+#else
+			Debug( LDAP_DEBUG_ANY, "%s: " COMPRESSSTR
+				" ignored, not built with zlib.\n", c->log );
+#endif
+		} else if ( !strncasecmp( c->argv[ i ], APPLYBATCHTIMESTR "=",
+					STRLENOF( APPLYBATCHTIMESTR "=" ) ) )
+		{
+			val = c->argv[ i ] + STRLENOF( APPLYBATCHTIMESTR "=" );
+			if ( lutil_atoi( &si->si_applyBatchTime, val ) != 0 || si->si_applyBatchTime < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"invalid apply batch time \"%s\".\n",
+					val );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+				return 1;
+			}
+		} else if ( !strncasecmp( c->argv[ i ], APPLYBATCHSTR "=",
+					STRLENOF( APPLYBATCHSTR "=" ) ) )
+		{
+			val = c->argv[ i ] + STRLENOF( APPLYBATCHSTR "=" );
+			if ( lutil_atoi( &si->si_applyBatch, val ) != 0 || si->si_applyBatch < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"invalid apply batch size \"%s\".\n",
+					val );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+				return 1;
+			}
 		} else if ( !bindconf_parse( c->argv[i], &si->si_bindconf ) ) {
 			si->si_got |= GOT_BINDCONF;
 		} else {
@@ -6522,13 +7020,16 @@ parse_syncrepl_line(
 	provider URLs
 	timestamp of last contact
 	cookievals
+	replication throughput and lag
 	*/
 
 static ObjectClass	*oc_olmSyncRepl;
 static AttributeDescription	*ad_olmProviderURIList,
 	*ad_olmConnection, *ad_olmSyncPhase,
 	*ad_olmNextConnect, *ad_olmLastConnect, *ad_olmLastContact,
-	*ad_olmLastCookieRcvd, *ad_olmLastCookieSent;
+	*ad_olmLastCookieRcvd, *ad_olmLastCookieSent,
+	*ad_olmChangesApplied, *ad_olmChangeRate, *ad_olmBytesReceived,
+	*ad_olmApplyTime, *ad_olmPendingChanges, *ad_olmCSNLag;
 
 static struct {
 	char *name;
@@ -6604,6 +7105,52 @@ static struct {
 		"NO-USER-MODIFICATION "
 		"USAGE dSAOperation )",
 		&ad_olmLastCookieSent },
+	{ "( olmSyncReplAttributes:9 "
+		"NAME ( 'olmSRChangesApplied' ) "
+		"DESC 'Number of changes received and applied' "
+		"SUP monitorCounter "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmChangesApplied },
+	{ "( olmSyncReplAttributes:10 "
+		"NAME ( 'olmSRChangeRate' ) "
+		"DESC 'Number of changes applied during the last full second' "
+		"SUP monitorCounter "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmChangeRate },
+	{ "( olmSyncReplAttributes:11 "
+		"NAME ( 'olmSRBytesReceived' ) "
+		"DESC 'Number of bytes read from the provider' "
+		"SUP monitorCounter "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmBytesReceived },
+	{ "( olmSyncReplAttributes:12 "
+		"NAME ( 'olmSRApplyTime' ) "
+		"DESC 'Histogram of the time taken to apply each change' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmApplyTime },
+	{ "( olmSyncReplAttributes:13 "
+		"NAME ( 'olmSRPendingChanges' ) "
+		"DESC 'Number of changes applied but not yet committed' "
+		"SUP monitorCounter "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmPendingChanges },
+	{ "( olmSyncReplAttributes:14 "
+		"NAME ( 'olmSRCSNLag' ) "
+		"DESC 'Per SID, how far the local contextCSN trails the provider' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmCSNLag },
 	{ NULL }
 };
 
@@ -6623,6 +7170,12 @@ static struct {
 			"$ olmSRLastContact "
 			"$ olmSRLastCookieRcvd "
 			"$ olmSRLastCookieSent "
+			"$ olmSRChangesApplied "
+			"$ olmSRChangeRate "
+			"$ olmSRBytesReceived "
+			"$ olmSRApplyTime "
+			"$ olmSRPendingChanges "
+			"$ olmSRCSNLag "
 			") )",
 		&oc_olmSyncRepl },
 	{ NULL }
@@ -6693,6 +7246,86 @@ syncrepl_monitor_init( void )
 
 static const struct berval zerotime = BER_BVC("00000101000000Z");
 
+static const char *apply_buckets[SR_APPLY_BUCKETS] = {
+	"0-100us", "100us-1ms", "1-10ms", "10-100ms", "100ms-1s", "1s+"
+};
+
+static int
+csn2timeval( struct berval *csn, struct timeval *tv )
+{
+	struct lutil_tm tm;
+	struct lutil_timet tt;
+
+	if ( lutil_parsetime( csn->bv_val, &tm ))
+		return -1;
+	lutil_tm2time( &tm, &tt );
+	tv->tv_sec = tt.tt_sec;
+	tv->tv_usec = tt.tt_usec;
+	return 0;
+}
+
+/* One value per SID the provider sent us a CSN for: the newest such
+ * CSN and how much older the CSN committed locally for that SID is */
+static void
+syncrepl_monitor_csnlag( syncinfo_t *si, Entry *e )
+{
+	struct sync_cookie prov = { NULL };
+	cookie_state *cs = si->si_cookieState;
+	char buf[ SLAP_TEXT_BUFLEN ];
+	struct berval bv;
+	int i, j;
+
+	ldap_pvt_thread_mutex_lock( &si->si_monitor_mutex );
+	if ( si->si_provCSN.numcsns ) {
+		ber_bvarray_dup_x( &prov.ctxcsn, si->si_provCSN.ctxcsn, NULL );
+		prov.sids = ch_malloc( si->si_provCSN.numcsns * sizeof(int) );
+		AC_MEMCPY( prov.sids, si->si_provCSN.sids,
+			si->si_provCSN.numcsns * sizeof(int) );
+		prov.numcsns = si->si_provCSN.numcsns;
+	}
+	ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
+
+	attr_delete( &e->e_attrs, ad_olmCSNLag );
+	bv.bv_val = buf;
+	if ( cs )
+		ldap_pvt_thread_mutex_lock( &cs->cs_mutex );
+	for ( i = 0; i < prov.numcsns; i++ ) {
+		struct timeval ptv, ltv;
+		char lag[ sizeof("-9223372036854775808.000000") ];
+
+		strcpy( lag, "-" );
+		for ( j = 0; cs && j < cs->cs_num; j++ ) {
+			if ( cs->cs_sids[j] == prov.sids[i] )
+				break;
+		}
+		if ( cs && j < cs->cs_num &&
+			!csn2timeval( &prov.ctxcsn[i], &ptv ) &&
+			!csn2timeval( &cs->cs_vals[j], &ltv ))
+		{
+			long usec = 0;
+
+			if ( ber_bvcmp( &prov.ctxcsn[i], &cs->cs_vals[j] ) > 0 ) {
+				usec = ( ptv.tv_sec - ltv.tv_sec ) * 1000000L +
+					ptv.tv_usec - ltv.tv_usec;
+				if ( usec < 0 )
+					usec = 0;
+			}
+			snprintf( lag, sizeof( lag ), "%ld.%06ld",
+				usec / 1000000L, usec % 1000000L );
+		}
+		bv.bv_len = snprintf( buf, sizeof( buf ), "sid=%03x lag=%s csn=%s",
+			prov.sids[i], lag, prov.ctxcsn[i].bv_val );
+		attr_merge_normalize_one( e, ad_olmCSNLag, &bv, NULL );
+	}
+	if ( cs )
+		ldap_pvt_thread_mutex_unlock( &cs->cs_mutex );
+	if ( !prov.numcsns ) {
+		BER_BVSTR( &bv, "" );
+		attr_merge_normalize_one( e, ad_olmCSNLag, &bv, NULL );
+	}
+	slap_sync_cookie_free( &prov, 0 );
+}
+
 static int
 syncrepl_monitor_update(
 	Operation *op,
@@ -6798,8 +7431,69 @@ syncrepl_monitor_update(
 	if ( !BER_BVISEMPTY( &si->si_lastCookieSent ) &&
 		!bvmatch( &a->a_vals[0], &si->si_lastCookieSent ))
 		ber_bvreplace( &a->a_vals[0], &si->si_lastCookieSent );
+
+	{
+		char buf[ SLAP_TEXT_BUFLEN ];
+		struct berval bv;
+		unsigned long rate;
+		time_t now = slap_get_time();
+		int i;
+
+		bv.bv_val = buf;
+
+		a = a->a_next;
+		if ( a->a_desc != ad_olmChangesApplied ) {
+			ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
+			return SLAP_CB_CONTINUE;
+		}
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", si->si_changes );
+		ber_bvreplace( &a->a_vals[0], &bv );
+
+		a = a->a_next;
+		if ( a->a_desc != ad_olmChangeRate ) {
+			ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
+			return SLAP_CB_CONTINUE;
+		}
+		if ( now == si->si_rateSec )
+			rate = si->si_rateLast;
+		else if ( now == si->si_rateSec + 1 )
+			rate = si->si_rateCur;
+		else
+			rate = 0;
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", rate );
+		ber_bvreplace( &a->a_vals[0], &bv );
+
+		a = a->a_next;
+		if ( a->a_desc != ad_olmBytesReceived ) {
+			ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
+			return SLAP_CB_CONTINUE;
+		}
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", si->si_bytesRcvd );
+		ber_bvreplace( &a->a_vals[0], &bv );
+
+		a = a->a_next;
+		if ( a->a_desc != ad_olmApplyTime ) {
+			ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
+			return SLAP_CB_CONTINUE;
+		}
+		for ( i = 0; i < SR_APPLY_BUCKETS; i++ ) {
+			bv.bv_len = snprintf( buf, sizeof( buf ), "%s %lu",
+				apply_buckets[i], si->si_applyTimes[i] );
+			ber_bvreplace( &a->a_vals[i], &bv );
+		}
+
+		a = a->a_next;
+		if ( a->a_desc != ad_olmPendingChanges ) {
+			ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
+			return SLAP_CB_CONTINUE;
+		}
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%d", si->si_batched );
+		ber_bvreplace( &a->a_vals[0], &bv );
+	}
 	ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
 
+	syncrepl_monitor_csnlag( si, e );
+
 	return SLAP_CB_CONTINUE;
 }
 
@@ -6877,6 +7571,26 @@ syncrepl_monitor_add(
 		attr_merge_normalize_one( e, ad_olmLastCookieRcvd, &bv, NULL );
 		attr_merge_normalize_one( e, ad_olmLastCookieSent, &bv, NULL );
 	}
+	{
+		struct berval bv = BER_BVC("0");
+		int i;
+
+		attr_merge_normalize_one( e, ad_olmChangesApplied, &bv, NULL );
+		attr_merge_normalize_one( e, ad_olmChangeRate, &bv, NULL );
+		attr_merge_normalize_one( e, ad_olmBytesReceived, &bv, NULL );
+		for ( i = 0; i < SR_APPLY_BUCKETS; i++ ) {
+			char buf[ SLAP_TEXT_BUFLEN ];
+
+			bv.bv_val = buf;
+			bv.bv_len = snprintf( buf, sizeof( buf ), "%s 0",
+				apply_buckets[i] );
+			attr_merge_normalize_one( e, ad_olmApplyTime, &bv, NULL );
+		}
+		BER_BVSTR( &bv, "0" );
+		attr_merge_normalize_one( e, ad_olmPendingChanges, &bv, NULL );
+		BER_BVSTR( &bv, "" );
+		attr_merge_normalize_one( e, ad_olmCSNLag, &bv, NULL );
+	}
 	{
 		monitor_callback_t *cb = ch_calloc( sizeof( monitor_callback_t ), 1 );
 		cb->mc_update = syncrepl_monitor_update;
@@ -7177,9 +7891,10 @@ syncrepl_unparse( syncinfo_t *si, struct berval *bv )
 		ptr = anlist_unparse( si->si_exanlist, ptr, WHATSLEFT );
 		if ( ptr == NULL ) return;
 	}
-	if ( WHATSLEFT <= STRLENOF( " " SCHEMASTR "=" ) + STRLENOF( "off" ) ) return;
+	if ( WHATSLEFT <= STRLENOF( " " SCHEMASTR "=" ) + STRLENOF( "trusted" ) ) return;
 	ptr = lutil_strcopy( ptr, " " SCHEMASTR "=" );
-	ptr = lutil_strcopy( ptr, si->si_schemachecking ? "on" : "off" );
+	ptr = lutil_strcopy( ptr, si->si_schemachecking == SYNC_SCHEMA_TRUSTED ?
+		"trusted" : si->si_schemachecking ? "on" : "off" );
 	
 	if ( WHATSLEFT <= STRLENOF( " " TYPESTR "=" ) + STRLENOF( "refreshAndPersist" ) ) return;
 	ptr = lutil_strcopy( ptr, " " TYPESTR "=" );
@@ -7259,6 +7974,23 @@ syncrepl_unparse( syncinfo_t *si, struct berval *bv )
 		ptr = lutil_strcopy( ptr, " " LAZY_COMMIT );
 	}
 
+	if ( si->si_compress ) {
+		if ( WHATSLEFT <= STRLENOF( " " COMPRESSSTR ) ) return;
+		ptr = lutil_strcopy( ptr, " " COMPRESSSTR );
+	}
+
+	if ( si->si_applyBatch ) {
+		len = snprintf( ptr, WHATSLEFT, " " APPLYBATCHSTR "=%d", si->si_applyBatch );
+		if ( WHATSLEFT <= len ) return;
+		ptr += len;
+	}
+
+	if ( si->si_applyBatchTime ) {
+		len = snprintf( ptr, WHATSLEFT, " " APPLYBATCHTIMESTR "=%d", si->si_applyBatchTime );
+		if ( WHATSLEFT <= len ) return;
+		ptr += len;
+	}
+
 	bc.bv_len = ptr - buf;
 	bc.bv_val = buf;
 	ber_dupbv( bv, &bc );
@@ -62,6 +62,7 @@ int txn_start_extop(
 
 	assert( op->o_conn->c_txn_backend == NULL );
 	op->o_conn->c_txn = CONN_TXN_SPECIFY;
+	op->o_conn->c_txn_bulk = op->o_txnBulk != SLAP_CONTROL_NONE;
 
 	bv = (struct berval *) ch_malloc( sizeof (struct berval) );
 	bv->bv_len = 0;
@@ -110,6 +111,32 @@ int txn_spec_ctrl(
 	return LDAP_SUCCESS;
 }
 
+/* The bulk update control on a Start Transaction request asks that
+ * updates which fail at commit time be rolled back on their own,
+ * instead of aborting the whole transaction. Each failed update is
+ * reported in the updatesControls of the End Transaction response,
+ * by a control of the same OID whose value is
+ *	SEQUENCE { resultCode ENUMERATED, diagnosticMessage LDAPString }
+ */
+int txn_bulk_ctrl(
+	Operation *op, SlapReply *rs, LDAPControl *ctrl )
+{
+	if( op->o_txnBulk ) {
+		rs->sr_text = "bulk update control provided multiple times";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	if ( !BER_BVISNULL( &ctrl->ldctl_value ) ) {
+		rs->sr_text = "bulk update control value not absent";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	op->o_txnBulk = ctrl->ldctl_iscritical
+		? SLAP_CONTROL_CRITICAL
+		: SLAP_CONTROL_NONCRITICAL;
+	return LDAP_SUCCESS;
+}
+
 typedef struct txn_rctrls {
 	struct txn_rctrls *tr_next;
 	ber_int_t	tr_msgid;
@@ -118,7 +145,23 @@ typedef struct txn_rctrls {
 
 static int txn_result( Operation *op, SlapReply *rs )
 {
-	if ( rs->sr_ctrls ) {
+	LDAPControl **ctrls = rs->sr_ctrls, *bulk[2] = { NULL, NULL }, c;
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+
+	if ( op->o_conn->c_txn_bulk && rs->sr_err != LDAP_SUCCESS ) {
+		/* the update is rolled back, its own controls don't apply */
+		ber_init_w_nullc( ber, LBER_USE_DER );
+		ber_printf( ber, "{es}", rs->sr_err,
+			rs->sr_text ? rs->sr_text : "" );
+		c.ldctl_oid = LDAP_CONTROL_X_TXN_BULK;
+		c.ldctl_iscritical = 0;
+		ber_flatten2( ber, &c.ldctl_value, 0 );
+		bulk[0] = &c;
+		ctrls = bulk;
+	}
+
+	if ( ctrls ) {
 		txn_rctrls **t0, *tr;
 		for ( t0 = (txn_rctrls **) &op->o_callback->sc_private; *t0;
 			t0 = &(*t0)->tr_next )
@@ -127,8 +170,10 @@ static int txn_result( Operation *op, SlapReply *rs )
 		tr->tr_next = NULL;
 		*t0 = tr;
 		tr->tr_msgid = op->o_msgid;
-		tr->tr_ctrls = ldap_controls_dup( rs->sr_ctrls );
+		tr->tr_ctrls = ldap_controls_dup( ctrls );
 	}
+	if ( bulk[0] )
+		ber_free_buf( ber );
 	return rs->sr_err;
 }
 
@@ -150,6 +195,16 @@ static int txn_put_ctrls( Operation *op, BerElement *ber, txn_rctrls *tr )
 	return 0;
 }
 
+static void txn_free_ctrls( Operation *op, txn_rctrls *tr )
+{
+	txn_rctrls *next;
+	for ( ; tr; tr = next ) {
+		next = tr->tr_next;
+		ldap_controls_free( tr->tr_ctrls );
+		op->o_tmpfree( tr, op->o_tmpmemctx );
+	}
+}
+
 int txn_end_extop(
 	Operation *op, SlapReply *rs )
 {
@@ -220,6 +275,19 @@ int txn_end_extop(
 	}
 	c->c_txn = CONN_TXN_SETTLE;
 
+	/* wait for the updates still returning from txn_preop() */
+	while ( c->c_txn_busy ) {
+		ldap_pvt_thread_mutex_unlock( &c->c_mutex );
+		ldap_pvt_thread_yield();
+		ldap_pvt_thread_mutex_lock( &c->c_mutex );
+	}
+	if ( c->c_txn != CONN_TXN_SETTLE ) {
+		/* the connection was closed meanwhile */
+		rs->sr_text = "transaction aborted";
+		rc = LDAP_OTHER;
+		goto done;
+	}
+
 	if( commit ) {
 		slap_callback cb = {0};
 		OpExtra *txn = NULL;
@@ -248,6 +316,16 @@ int txn_end_extop(
 			} else {
 				LDAP_SLIST_INSERT_HEAD( &o->o_extra, txn, oe_next );
 			}
+			if ( c->c_txn_bulk ) {
+				rc = o->o_bd->bd_info->bi_op_txn(o, SLAP_TXN_SAVEPOINT, &txn );
+				if ( rc ) {
+					rs->sr_text = "couldn't start nested DB transaction";
+					rc = LDAP_OTHER;
+					o->o_bd->bd_info->bi_op_txn(o, SLAP_TXN_ABORT, &txn );
+					txn_free_ctrls( op, cb.sc_private );
+					goto drain;
+				}
+			}
 			cb.sc_next = o->o_callback;
 			o->o_callback = &cb;
 			{
@@ -260,7 +338,20 @@ int txn_end_extop(
 				rc = (&o->o_bd->bd_info->bi_op_bind)[opidx]( o, &rs );
 				ldap_pvt_thread_mutex_lock( &c->c_mutex );
 			}
-			if ( rc ) {
+			if ( c->c_txn_bulk ) {
+				if ( rc ) {
+					o->o_bd->bd_info->bi_op_txn(o, SLAP_TXN_ROLLBACK, &txn );
+					continue;
+				}
+				rc = o->o_bd->bd_info->bi_op_txn(o, SLAP_TXN_RELEASE, &txn );
+				if ( rc ) {
+					rs->sr_text = "nested DB transaction commit failed";
+					rc = LDAP_OTHER;
+					o->o_bd->bd_info->bi_op_txn(o, SLAP_TXN_ABORT, &txn );
+					txn_free_ctrls( op, cb.sc_private );
+					goto drain;
+				}
+			} else if ( rc ) {
 				struct berval *bv = NULL;
 				BerElementBuffer berbuf;
 				BerElement *ber = (BerElement *)&berbuf;
@@ -295,6 +386,10 @@ int txn_end_extop(
 		if ( rc ) {
 			rs->sr_text = "transaction commit failed";
 			rc = LDAP_OTHER;
+		} else {
+			/* the writes are visible only now */
+			group_cache_bump();
+			authz_cache_bump();
 		}
 	} else {
 		rs->sr_text = "transaction aborted";
@@ -313,6 +408,7 @@ settled:
 	assert( LDAP_STAILQ_EMPTY(&c->c_txn_ops) );
 	assert( c->c_txn == CONN_TXN_SETTLE );
 	c->c_txn = CONN_TXN_INACTIVE;
+	c->c_txn_bulk = 0;
 	c->c_txn_backend = NULL;
 
 done:
@@ -346,9 +442,10 @@ int txn_preop( Operation *op, SlapReply *rs )
 		goto txnReturn;
 	}
 
-	/* insert operation into transaction */
-	LDAP_STAILQ_REMOVE( &op->o_conn->c_ops, op, Operation, o_next );
-	LDAP_STAILQ_INSERT_TAIL( &op->o_conn->c_txn_ops, op, o_next );
+	/* connection_operation() queues it once the operation is done
+	 * with it, the client may end the txn as soon as it has our result
+	 */
+	op->o_conn->c_txn_busy++;
 
 txnReturn:
 	/* release connection lock */
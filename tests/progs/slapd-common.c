@@ -444,6 +444,10 @@ tester_config_opt( struct tester_conn_args *config, char opt, char *optarg )
 			config->authmethod = LDAP_AUTH_SIMPLE;
 			break;
 
+		case 'Z':
+			config->tls++;
+			break;
+
 		default:
 			return -1;
 	}
@@ -509,6 +513,17 @@ retry:;
 	(void) ldap_set_option( ld, LDAP_OPT_REFERRALS,
 		config->chaserefs ? LDAP_OPT_ON: LDAP_OPT_OFF );
 
+	if ( config->tls ) {
+		rc = ldap_start_tls_s( ld, NULL, NULL );
+		if ( rc != LDAP_SUCCESS ) {
+			tester_ldap_error( ld, "ldap_start_tls_s", NULL );
+			if ( config->tls > 1 ) {
+				ldap_unbind_ext( ld, NULL, NULL );
+				exit( EXIT_FAILURE );
+			}
+		}
+	}
+
 	if ( !( flags & TESTER_INIT_ONLY ) ) {
 		if ( config->authmethod == LDAP_AUTH_SASL ) {
 #ifdef HAVE_CYRUS_SASL
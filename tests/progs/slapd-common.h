@@ -28,6 +28,9 @@ typedef enum {
 	TESTER_MODRDN,
 	TESTER_READ,
 	TESTER_SEARCH,
+	TESTER_LOAD,
+	TESTER_REPLAY,
+	TESTER_TEMPLATE,
 	TESTER_LAST
 } tester_t;
 
@@ -49,6 +52,7 @@ struct tester_conn_args {
 	int delay;
 
 	int chaserefs;
+	int tls;
 
 	int authmethod;
 
@@ -66,7 +70,7 @@ struct tester_conn_args {
 };
 
 #define TESTER_INIT_ONLY (1 << 0)
-#define TESTER_COMMON_OPTS "CD:d:H:h:L:l:i:O:p:R:U:X:Y:r:t:w:x"
+#define TESTER_COMMON_OPTS "CD:d:H:h:L:l:i:O:p:R:U:X:Y:r:t:w:xZ"
 #define TESTER_COMMON_HELP \
 	"[-C] " \
 	"[-D <dn> [-w <passwd>]] " \
@@ -80,7 +84,8 @@ struct tester_conn_args {
 	"[-O <SASL secprops>] " \
 	"[-R <SASL realm>] " \
 	"[-U <SASL authcid> [-X <SASL authzid>]] " \
-	"[-x | -Y <SASL mech>] "
+	"[-x | -Y <SASL mech>] " \
+	"[-Z[Z]] "
 
 extern int tester_config_opt( struct tester_conn_args *config, char opt, char *optarg );
 extern void tester_config_finish( struct tester_conn_args *config );
@@ -0,0 +1,915 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * This tool is an open-loop load generator.  Unlike slapd-tester,
+ * which forks closed-loop clients that each wait for one response
+ * before sending the next request, it issues a configurable mix of
+ * operations at a fixed target rate from a few threads, each driving
+ * several asynchronous connections with up to -P requests outstanding
+ * on each.  Latency is measured from the time a request was due to be
+ * sent rather than from the time it actually went out, so that a
+ * server which falls behind is charged for the queueing it causes
+ * (no "coordinated omission").  Throughput and latency percentiles are
+ * reported every -I seconds and for the whole run.
+ *
+ * With a rate of 0 it runs closed-loop, keeping every connection
+ * -P requests deep.
+ */
+
+#include "portable.h"
+
+/* Requires libldap with threads */
+#ifndef NO_THREADS
+
+#include <stdio.h>
+#include "ldap_pvt_thread.h"
+
+#include "ac/stdlib.h"
+
+#include "ac/ctype.h"
+#include "ac/param.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/time.h"
+#include "ac/unistd.h"
+
+#include "ldap.h"
+#include "lutil.h"
+
+#include "ldap_pvt.h"
+
+#include "slapd-common.h"
+
+#define MAXCONN		512
+#define MAXTHREAD	64
+#define MAXDEPTH	256
+#define DEFAULT_BASE	"ou=people,dc=example,dc=com"
+#define DEFAULT_FILTER	"(objectClass=*)"
+#define DEFAULT_MODATTR	"description"
+
+/* a request sent more than this late (usec) counts as late */
+#define LATE_USEC	1000.0
+
+/* how long (sec) to wait for outstanding responses at the end */
+#define DRAIN_SECS	10
+
+enum {
+	LOAD_SEARCH,
+	LOAD_READ,
+	LOAD_COMPARE,
+	LOAD_MODIFY,
+	LOAD_BIND,
+	LOAD_LAST
+};
+
+static char *load_opname[] = {
+	"search", "read", "compare", "modify", "bind", NULL
+};
+
+/*
+ * Log-linear latency histogram, in microseconds: values below
+ * HISTO_SUB are exact, above that every power of two is split in
+ * HISTO_SUB buckets, so any value is known within about 6%.
+ */
+#define HISTO_SUBBITS	4
+#define HISTO_SUB	(1 << HISTO_SUBBITS)
+#define HISTO_BUCKETS	(HISTO_SUB * 40)
+
+typedef struct load_histo {
+	unsigned long	h_count[ HISTO_BUCKETS ];
+	unsigned long	h_n;
+	unsigned long	h_errors;
+	double		h_max;
+} load_histo;
+
+typedef struct load_req {
+	int		lr_msgid;
+	int		lr_op;
+	double		lr_due;
+} load_req;
+
+typedef struct load_conn {
+	LDAP		*lc_ld;
+	ber_socket_t	lc_fd;
+	int		lc_outstanding;
+	int		lc_binding;
+	load_req	lc_reqs[ MAXDEPTH ];
+} load_conn;
+
+typedef struct load_thread {
+	ldap_pvt_thread_t	lt_tid;
+	int		lt_idx;
+	unsigned int	lt_seed;
+
+	load_conn	*lt_conns;
+	int		lt_nconns;
+	int		lt_next;
+
+	unsigned long	lt_late;
+
+	/* protected by lt_mutex, read by the reporting thread */
+	ldap_pvt_thread_mutex_t	lt_mutex;
+	load_histo	lt_ival;
+	load_histo	lt_total[ LOAD_LAST ];
+} load_thread;
+
+static struct tester_conn_args *config;
+
+static char	*base = DEFAULT_BASE;
+static char	*filter = DEFAULT_FILTER;
+static char	*entry = NULL;
+static char	*cmpattr = NULL;
+static struct berval cmpval = BER_BVNULL;
+static char	*modattr = DEFAULT_MODATTR;
+static char	**attrs = NULL;
+
+static int	mix[ LOAD_LAST ] = { 100, 0, 0, 0, 0 };
+static int	mixtotal = 100;
+static int	range = 1;
+static double	rate = 0;
+static int	nconns = 1;
+static int	nthreads = 1;
+static int	depth = 1;
+static int	duration = 10;
+static int	interval = 1;
+
+static double	load_start, load_end;
+static volatile int load_done;
+
+static void
+usage( char *name, char opt )
+{
+	if ( opt ) {
+		fprintf( stderr, "%s: unable to handle option \'%c\'\n\n",
+			name, opt );
+	}
+
+	fprintf( stderr, "usage: %s " TESTER_COMMON_HELP
+		"[-a <attr>:<value>] "
+		"[-A <attr>] "
+		"[-b <base>] "
+		"[-c <connections>] "
+		"[-e <entry>] "
+		"[-f <filter>] "
+		"[-I <interval>] "
+		"[-k <range>] "
+		"[-m <threads>] "
+		"[-o <op>=<weight>[,...]] "
+		"[-P <depth>] "
+		"[-q <rate>] "
+		"[-s <seed>] "
+		"[-T <duration>] "
+		"[<attrs>] "
+		"\n",
+		name );
+	exit( EXIT_FAILURE );
+}
+
+static double
+load_now( void )
+{
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return (double)tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+static unsigned int
+load_rand( unsigned int *seed )
+{
+	/* xorshift32; rand() is neither reentrant nor per-thread */
+	unsigned int x = *seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*seed = x;
+	return x;
+}
+
+/*
+ * copy pattern into buf, replacing the first "%d" with n; a width
+ * may be given as in printf(3), e.g. "%06d"
+ */
+static void
+load_expand( char *buf, size_t len, const char *pattern, int n )
+{
+	const char *p, *q;
+
+	for ( p = strchr( pattern, '%' ); p != NULL; p = strchr( p + 1, '%' ) ) {
+		for ( q = p + 1; isdigit( (unsigned char) *q ); q++ )
+			;
+		if ( *q == 'd' ) {
+			break;
+		}
+	}
+
+	if ( p == NULL ) {
+		snprintf( buf, len, "%s", pattern );
+	} else if ( p[1] == '0' ) {
+		snprintf( buf, len, "%.*s%0*d%s",
+			(int)( p - pattern ), pattern, atoi( p + 1 ), n, q + 1 );
+	} else {
+		snprintf( buf, len, "%.*s%*d%s",
+			(int)( p - pattern ), pattern, atoi( p + 1 ), n, q + 1 );
+	}
+}
+
+static int
+load_histo_bucket( double usec )
+{
+	unsigned long v = usec < 0 ? 0 : (unsigned long)usec;
+	int e, b;
+
+	if ( v < HISTO_SUB ) {
+		return v;
+	}
+
+	for ( e = HISTO_SUBBITS; ( v >> ( e + 1 ) ) != 0; e++ )
+		;
+	b = ( e - HISTO_SUBBITS + 1 ) * HISTO_SUB
+		+ ( ( v >> ( e - HISTO_SUBBITS ) ) & ( HISTO_SUB - 1 ) );
+
+	return b < HISTO_BUCKETS ? b : HISTO_BUCKETS - 1;
+}
+
+static double
+load_histo_value( int b )
+{
+	int e;
+
+	if ( b < HISTO_SUB ) {
+		return b;
+	}
+
+	e = b / HISTO_SUB + HISTO_SUBBITS - 1;
+	return (double)( ( HISTO_SUB + b % HISTO_SUB ) ) * ( 1UL << ( e - HISTO_SUBBITS ) );
+}
+
+static void
+load_histo_add( load_histo *h, double usec )
+{
+	h->h_count[ load_histo_bucket( usec ) ]++;
+	h->h_n++;
+	if ( usec > h->h_max ) {
+		h->h_max = usec;
+	}
+}
+
+static void
+load_histo_merge( load_histo *dst, load_histo *src )
+{
+	int i;
+
+	for ( i = 0; i < HISTO_BUCKETS; i++ ) {
+		dst->h_count[ i ] += src->h_count[ i ];
+	}
+	dst->h_n += src->h_n;
+	dst->h_errors += src->h_errors;
+	if ( src->h_max > dst->h_max ) {
+		dst->h_max = src->h_max;
+	}
+}
+
+/* latency in msec below which the fraction q of the samples lie */
+static double
+load_histo_quantile( load_histo *h, double q )
+{
+	unsigned long want, seen = 0;
+	int i;
+
+	if ( h->h_n == 0 ) {
+		return 0;
+	}
+
+	want = (unsigned long)( q * h->h_n );
+	if ( want >= h->h_n ) {
+		return h->h_max / 1000.0;
+	}
+
+	for ( i = 0; i < HISTO_BUCKETS; i++ ) {
+		seen += h->h_count[ i ];
+		if ( seen > want ) {
+			break;
+		}
+	}
+
+	return load_histo_value( i ) / 1000.0;
+}
+
+static void
+load_histo_print( const char *name, load_histo *h, double secs )
+{
+	printf( "%-8s %10lu %10.1f %8lu %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+		name, h->h_n, secs > 0 ? h->h_n / secs : 0.0, h->h_errors,
+		load_histo_quantile( h, 0.50 ),
+		load_histo_quantile( h, 0.90 ),
+		load_histo_quantile( h, 0.99 ),
+		load_histo_quantile( h, 0.999 ),
+		h->h_max / 1000.0 );
+}
+
+static int
+load_pick_op( load_thread *lt )
+{
+	int i, r;
+
+	r = load_rand( &lt->lt_seed ) % mixtotal;
+	for ( i = 0; i < LOAD_LAST - 1; i++ ) {
+		if ( r < mix[ i ] ) {
+			break;
+		}
+		r -= mix[ i ];
+	}
+
+	return i;
+}
+
+/*
+ * Find a connection that can take op: one with room in its pipeline,
+ * or, for a bind, one with nothing outstanding.  Round-robin so the
+ * load spreads over all the connections.
+ */
+static load_conn *
+load_pick_conn( load_thread *lt, int op )
+{
+	int i;
+
+	for ( i = 0; i < lt->lt_nconns; i++ ) {
+		load_conn *lc = &lt->lt_conns[ ( lt->lt_next + i ) % lt->lt_nconns ];
+
+		if ( lc->lc_binding ) {
+			continue;
+		}
+		if ( op == LOAD_BIND ? lc->lc_outstanding == 0
+				: lc->lc_outstanding < depth )
+		{
+			lt->lt_next = ( lt->lt_next + i + 1 ) % lt->lt_nconns;
+			return lc;
+		}
+	}
+
+	return NULL;
+}
+
+static int
+load_send( load_thread *lt, load_conn *lc, int op, double due )
+{
+	char		buf[ BUFSIZ ];
+	int		rc, msgid = -1;
+	int		n = range > 1 ? load_rand( &lt->lt_seed ) % range : 0;
+
+	switch ( op ) {
+	case LOAD_SEARCH:
+		load_expand( buf, sizeof( buf ), filter, n );
+		rc = ldap_search_ext( lc->lc_ld, base, LDAP_SCOPE_SUBTREE,
+			buf, attrs, 0, NULL, NULL, NULL, LDAP_NO_LIMIT, &msgid );
+		break;
+
+	case LOAD_READ:
+		load_expand( buf, sizeof( buf ), entry, n );
+		rc = ldap_search_ext( lc->lc_ld, buf, LDAP_SCOPE_BASE,
+			NULL, attrs, 0, NULL, NULL, NULL, LDAP_NO_LIMIT, &msgid );
+		break;
+
+	case LOAD_COMPARE:
+		load_expand( buf, sizeof( buf ), entry, n );
+		rc = ldap_compare_ext( lc->lc_ld, buf, cmpattr, &cmpval,
+			NULL, NULL, &msgid );
+		break;
+
+	case LOAD_MODIFY: {
+		LDAPMod		mod, *mods[ 2 ];
+		struct berval	bv, *bvs[ 2 ];
+		char		val[ 64 ];
+
+		bv.bv_val = val;
+		bv.bv_len = snprintf( val, sizeof( val ), "slapd-load %u",
+			load_rand( &lt->lt_seed ) );
+		bvs[ 0 ] = &bv;
+		bvs[ 1 ] = NULL;
+		mod.mod_op = LDAP_MOD_REPLACE | LDAP_MOD_BVALUES;
+		mod.mod_type = modattr;
+		mod.mod_bvalues = bvs;
+		mods[ 0 ] = &mod;
+		mods[ 1 ] = NULL;
+
+		load_expand( buf, sizeof( buf ), entry, n );
+		rc = ldap_modify_ext( lc->lc_ld, buf, mods, NULL, NULL, &msgid );
+		} break;
+
+	case LOAD_BIND:
+		rc = ldap_sasl_bind( lc->lc_ld, config->binddn, LDAP_SASL_SIMPLE,
+			&config->pass, NULL, NULL, &msgid );
+		break;
+
+	default:
+		assert( 0 );
+		return -1;
+	}
+
+	if ( rc != LDAP_SUCCESS ) {
+		snprintf( buf, sizeof( buf ), "%s thread %d", load_opname[ op ],
+			lt->lt_idx );
+		tester_ldap_error( lc->lc_ld, "send", buf );
+		return -1;
+	}
+
+	lc->lc_reqs[ lc->lc_outstanding ].lr_msgid = msgid;
+	lc->lc_reqs[ lc->lc_outstanding ].lr_op = op;
+	lc->lc_reqs[ lc->lc_outstanding ].lr_due = due;
+	lc->lc_outstanding++;
+	if ( op == LOAD_BIND ) {
+		lc->lc_binding = 1;
+	}
+
+	if ( lc->lc_fd == AC_SOCKET_INVALID ) {
+		ldap_get_option( lc->lc_ld, LDAP_OPT_DESC, &lc->lc_fd );
+	}
+
+	return 0;
+}
+
+/* read whatever responses are available on lc without blocking */
+static int
+load_receive( load_thread *lt, load_conn *lc )
+{
+	struct timeval	zero = { 0, 0 };
+	LDAPMessage	*msg;
+	int		rc, i;
+
+	while ( lc->lc_outstanding > 0 ) {
+		rc = ldap_result( lc->lc_ld, LDAP_RES_ANY, LDAP_MSG_ONE, &zero, &msg );
+		if ( rc == 0 ) {
+			break;
+		}
+		if ( rc < 0 ) {
+			tester_ldap_error( lc->lc_ld, "ldap_result", NULL );
+			return -1;
+		}
+
+		if ( rc == LDAP_RES_SEARCH_ENTRY ||
+			rc == LDAP_RES_SEARCH_REFERENCE ||
+			rc == LDAP_RES_INTERMEDIATE )
+		{
+			ldap_msgfree( msg );
+			continue;
+		}
+
+		for ( i = 0; i < lc->lc_outstanding; i++ ) {
+			if ( lc->lc_reqs[ i ].lr_msgid == ldap_msgid( msg ) ) {
+				break;
+			}
+		}
+		if ( i == lc->lc_outstanding ) {
+			/* unsolicited, or not ours */
+			ldap_msgfree( msg );
+			continue;
+		}
+
+		if ( ldap_parse_result( lc->lc_ld, msg, &rc,
+			NULL, NULL, NULL, NULL, 1 ) != LDAP_SUCCESS )
+		{
+			rc = LDAP_OTHER;
+		}
+
+		ldap_pvt_thread_mutex_lock( &lt->lt_mutex );
+		{
+			load_req *lr = &lc->lc_reqs[ i ];
+			double lat = load_now() - lr->lr_due;
+			int err = !( rc == LDAP_SUCCESS ||
+				( lr->lr_op == LOAD_COMPARE &&
+				  ( rc == LDAP_COMPARE_TRUE || rc == LDAP_COMPARE_FALSE ) ) );
+
+			load_histo_add( &lt->lt_ival, lat );
+			load_histo_add( &lt->lt_total[ lr->lr_op ], lat );
+			if ( err ) {
+				lt->lt_ival.h_errors++;
+				lt->lt_total[ lr->lr_op ].h_errors++;
+			}
+			if ( lr->lr_op == LOAD_BIND ) {
+				lc->lc_binding = 0;
+			}
+		}
+		ldap_pvt_thread_mutex_unlock( &lt->lt_mutex );
+
+		lc->lc_reqs[ i ] = lc->lc_reqs[ --lc->lc_outstanding ];
+	}
+
+	return 0;
+}
+
+static void *
+load_thread_main( void *arg )
+{
+	load_thread	*lt = arg;
+	double		period = rate > 0 ? 1000000.0 * nthreads / rate : 0;
+	double		due = load_start + period * lt->lt_idx / nthreads;
+	int		op = load_pick_op( lt );
+	int		draining = 0;
+
+	for ( ;; ) {
+		fd_set		readfds;
+		struct timeval	tv;
+		double		now = load_now(), wait;
+		ber_socket_t	maxfd = 0;
+		int		i, outstanding = 0;
+
+		if ( !draining && now >= load_end ) {
+			draining = 1;
+		}
+
+		/* send everything that is due, as far as the pipelines allow */
+		while ( !draining && ( period == 0 || due <= now ) ) {
+			load_conn *lc = load_pick_conn( lt, op );
+
+			if ( lc == NULL ) {
+				break;
+			}
+			if ( period == 0 ) {
+				due = now;
+			}
+			if ( load_send( lt, lc, op, due ) ) {
+				exit( EXIT_FAILURE );
+			}
+			if ( now - due > LATE_USEC ) {
+				lt->lt_late++;
+			}
+			due += period;
+			op = load_pick_op( lt );
+		}
+
+		FD_ZERO( &readfds );
+		for ( i = 0; i < lt->lt_nconns; i++ ) {
+			load_conn *lc = &lt->lt_conns[ i ];
+
+			if ( lc->lc_outstanding > 0 && lc->lc_fd != AC_SOCKET_INVALID ) {
+				FD_SET( lc->lc_fd, &readfds );
+				if ( lc->lc_fd > maxfd ) {
+					maxfd = lc->lc_fd;
+				}
+				outstanding += lc->lc_outstanding;
+			}
+		}
+
+		if ( draining && ( outstanding == 0 ||
+			now >= load_end + DRAIN_SECS * 1000000.0 ) )
+		{
+			break;
+		}
+
+		/* sleep until the next request is due or a response arrives */
+		wait = 100000.0;
+		if ( !draining && period > 0 && due - now < wait ) {
+			wait = due > now ? due - now : 0;
+			if ( load_pick_conn( lt, op ) == NULL ) {
+				wait = 100000.0;
+			}
+		}
+		tv.tv_sec = 0;
+		tv.tv_usec = (long)wait;
+
+		if ( outstanding == 0 ) {
+			if ( wait > 0 ) {
+				select( 0, NULL, NULL, NULL, &tv );
+			}
+			continue;
+		}
+
+		if ( select( maxfd + 1, &readfds, NULL, NULL, &tv ) < 0 ) {
+			continue;
+		}
+
+		/* libldap may have buffered more than select() can see */
+		for ( i = 0; i < lt->lt_nconns; i++ ) {
+			load_conn *lc = &lt->lt_conns[ i ];
+
+			if ( lc->lc_outstanding > 0 && load_receive( lt, lc ) ) {
+				exit( EXIT_FAILURE );
+			}
+		}
+	}
+
+	return NULL;
+}
+
+int
+main( int argc, char **argv )
+{
+	load_thread	*lts;
+	load_histo	ival, total, all;
+	double		last, now;
+	unsigned int	seed = 0;
+	unsigned long	late = 0;
+	int		i, j;
+	char		*p, *next;
+
+	config = tester_init( "slapd-load", TESTER_LOAD );
+
+	while ( (i = getopt( argc, argv, TESTER_COMMON_OPTS "A:a:b:c:e:f:I:k:m:o:P:q:s:T:" )) != EOF ) {
+		switch ( i ) {
+		case 'A':		/* attribute to modify */
+			modattr = optarg;
+			break;
+
+		case 'a':		/* attribute value assertion to compare */
+			p = strchr( optarg, ':' );
+			if ( p == NULL ) {
+				usage( argv[0], i );
+			}
+			*p++ = '\0';
+			cmpattr = optarg;
+			ber_str2bv( p, 0, 0, &cmpval );
+			break;
+
+		case 'b':		/* search base */
+			base = optarg;
+			break;
+
+		case 'c':		/* the number of connections */
+			if ( lutil_atoi( &nconns, optarg ) != 0 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'e':		/* DN to read, compare, modify */
+			entry = optarg;
+			break;
+
+		case 'f':		/* the search filter */
+			filter = optarg;
+			break;
+
+		case 'I':		/* reporting interval */
+			if ( lutil_atoi( &interval, optarg ) != 0 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'k':		/* range of the values substituted for %d */
+			if ( lutil_atoi( &range, optarg ) != 0 || range < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'm':		/* the number of threads */
+			if ( lutil_atoi( &nthreads, optarg ) != 0 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'o':		/* the operation mix */
+			memset( mix, 0, sizeof( mix ) );
+			mixtotal = 0;
+			for ( p = optarg; p != NULL; p = next ) {
+				char *w;
+
+				next = strchr( p, ',' );
+				if ( next ) {
+					*next++ = '\0';
+				}
+				w = strchr( p, '=' );
+				if ( w ) {
+					*w++ = '\0';
+				}
+				for ( j = 0; load_opname[ j ]; j++ ) {
+					if ( strcasecmp( p, load_opname[ j ] ) == 0 ) {
+						break;
+					}
+				}
+				if ( load_opname[ j ] == NULL ) {
+					usage( argv[0], i );
+				}
+				if ( w == NULL ) {
+					mix[ j ] = 1;
+				} else if ( lutil_atoi( &mix[ j ], w ) != 0 || mix[ j ] < 0 ) {
+					usage( argv[0], i );
+				}
+				mixtotal += mix[ j ];
+			}
+			break;
+
+		case 'P':		/* requests outstanding per connection */
+			if ( lutil_atoi( &depth, optarg ) != 0 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'q':		/* target rate, requests per second */
+			if ( lutil_atoi( &j, optarg ) != 0 || j < 0 ) {
+				usage( argv[0], i );
+			}
+			rate = j;
+			break;
+
+		case 's':		/* random seed */
+			if ( lutil_atou( &seed, optarg ) != 0 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'T':		/* run time in seconds */
+			if ( lutil_atoi( &duration, optarg ) != 0 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		default:
+			if ( tester_config_opt( config, i, optarg ) == LDAP_SUCCESS ) {
+				break;
+			}
+			usage( argv[0], i );
+			break;
+		}
+	}
+
+	if ( argv[optind] != NULL ) {
+		attrs = &argv[optind];
+	}
+
+	if ( mixtotal == 0 ) {
+		usage( argv[0], 0 );
+	}
+	if ( ( mix[ LOAD_READ ] || mix[ LOAD_COMPARE ] || mix[ LOAD_MODIFY ] )
+		&& entry == NULL )
+	{
+		fprintf( stderr, "%s: read, compare and modify need an entry (-e).\n",
+			argv[0] );
+		exit( EXIT_FAILURE );
+	}
+	if ( mix[ LOAD_COMPARE ] && cmpattr == NULL ) {
+		fprintf( stderr, "%s: compare needs an assertion (-a).\n",
+			argv[0] );
+		exit( EXIT_FAILURE );
+	}
+
+	if ( nthreads < 1 )
+		nthreads = 1;
+	if ( nthreads > MAXTHREAD )
+		nthreads = MAXTHREAD;
+	if ( nconns < nthreads )
+		nconns = nthreads;
+	if ( nconns > MAXCONN )
+		nconns = MAXCONN;
+	if ( depth < 1 )
+		depth = 1;
+	if ( depth > MAXDEPTH )
+		depth = MAXDEPTH;
+	if ( interval < 1 )
+		interval = 1;
+	if ( duration < 1 )
+		duration = 1;
+	if ( seed == 0 )
+		seed = pid;
+
+	tester_config_finish( config );
+	ldap_pvt_thread_initialize();
+
+	lts = calloc( nthreads, sizeof( load_thread ) );
+	if ( lts == NULL ) {
+		tester_error( "calloc failed" );
+		exit( EXIT_FAILURE );
+	}
+
+	/* connections are spread over the threads, each drives its own */
+	for ( i = 0; i < nthreads; i++ ) {
+		load_thread *lt = &lts[ i ];
+
+		lt->lt_idx = i;
+		lt->lt_seed = seed + i * 2654435761U;
+		if ( lt->lt_seed == 0 )
+			lt->lt_seed = 1;
+		lt->lt_nconns = nconns / nthreads + ( i < nconns % nthreads );
+		lt->lt_conns = calloc( lt->lt_nconns, sizeof( load_conn ) );
+		if ( lt->lt_conns == NULL ) {
+			tester_error( "calloc failed" );
+			exit( EXIT_FAILURE );
+		}
+		for ( j = 0; j < lt->lt_nconns; j++ ) {
+			load_conn *lc = &lt->lt_conns[ j ];
+
+			tester_init_ld( &lc->lc_ld, config, 0 );
+			lc->lc_fd = AC_SOCKET_INVALID;
+			ldap_get_option( lc->lc_ld, LDAP_OPT_DESC, &lc->lc_fd );
+		}
+		ldap_pvt_thread_mutex_init( &lt->lt_mutex );
+	}
+
+	printf( "slapd-load: %s threads=%d conns=%d depth=%d ",
+		config->uri, nthreads, nconns, depth );
+	if ( rate > 0 ) {
+		printf( "rate=%.0f/s ", rate );
+	} else {
+		printf( "rate=closed-loop " );
+	}
+	printf( "duration=%ds mix=", duration );
+	for ( i = 0, j = 0; i < LOAD_LAST; i++ ) {
+		if ( mix[ i ] ) {
+			printf( "%s%s=%d", j++ ? "," : "", load_opname[ i ], mix[ i ] );
+		}
+	}
+	printf( "\n%8s %10s %10s %8s %9s %9s %9s\n",
+		"time", "ops", "ops/s", "errors", "p50(ms)", "p99(ms)", "max(ms)" );
+	fflush( stdout );
+
+	load_start = load_now();
+	load_end = load_start + duration * 1000000.0;
+
+	for ( i = 0; i < nthreads; i++ ) {
+		ldap_pvt_thread_create( &lts[ i ].lt_tid, 0,
+			load_thread_main, &lts[ i ] );
+	}
+
+	/* report throughput and latency over time */
+	last = load_start;
+	do {
+		struct timeval tv;
+
+		tv.tv_sec = interval;
+		tv.tv_usec = 0;
+		select( 0, NULL, NULL, NULL, &tv );
+
+		memset( &ival, 0, sizeof( ival ) );
+		for ( i = 0; i < nthreads; i++ ) {
+			ldap_pvt_thread_mutex_lock( &lts[ i ].lt_mutex );
+			load_histo_merge( &ival, &lts[ i ].lt_ival );
+			memset( &lts[ i ].lt_ival, 0, sizeof( lts[ i ].lt_ival ) );
+			ldap_pvt_thread_mutex_unlock( &lts[ i ].lt_mutex );
+		}
+		now = load_now();
+
+		printf( "%7.1fs %10lu %10.1f %8lu %9.3f %9.3f %9.3f\n",
+			( now - load_start ) / 1000000.0, ival.h_n,
+			ival.h_n / ( ( now - last ) / 1000000.0 ), ival.h_errors,
+			load_histo_quantile( &ival, 0.50 ),
+			load_histo_quantile( &ival, 0.99 ),
+			ival.h_max / 1000.0 );
+		fflush( stdout );
+		last = now;
+	} while ( now < load_end );
+
+	for ( i = 0; i < nthreads; i++ ) {
+		ldap_pvt_thread_join( lts[ i ].lt_tid, NULL );
+	}
+	now = load_now();
+
+	printf( "\n%-8s %10s %10s %8s %9s %9s %9s %9s %9s\n",
+		"op", "count", "ops/s", "errors",
+		"p50(ms)", "p90(ms)", "p99(ms)", "p99.9(ms)", "max(ms)" );
+	memset( &all, 0, sizeof( all ) );
+	for ( j = 0; j < LOAD_LAST; j++ ) {
+		memset( &total, 0, sizeof( total ) );
+		for ( i = 0; i < nthreads; i++ ) {
+			load_histo_merge( &total, &lts[ i ].lt_total[ j ] );
+		}
+		if ( mix[ j ] ) {
+			load_histo_print( load_opname[ j ], &total, duration );
+		}
+		load_histo_merge( &all, &total );
+	}
+	load_histo_print( "all", &all, duration );
+
+	for ( i = 0; i < nthreads; i++ ) {
+		late += lts[ i ].lt_late;
+	}
+	printf( "elapsed %.1fs, %lu requests sent more than %.0fms late\n",
+		( now - load_start ) / 1000000.0, late, LATE_USEC / 1000.0 );
+
+	for ( i = 0; i < nthreads; i++ ) {
+		for ( j = 0; j < lts[ i ].lt_nconns; j++ ) {
+			ldap_unbind_ext( lts[ i ].lt_conns[ j ].lc_ld, NULL, NULL );
+		}
+		free( lts[ i ].lt_conns );
+		ldap_pvt_thread_mutex_destroy( &lts[ i ].lt_mutex );
+	}
+	free( lts );
+
+	exit( all.h_errors ? EXIT_FAILURE : EXIT_SUCCESS );
+}
+
+#else /* NO_THREADS */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int
+main( int argc, char **argv )
+{
+	fprintf( stderr, "%s: not available when configured --without-threads\n", argv[0] );
+	exit( EXIT_FAILURE );
+}
+
+#endif /* NO_THREADS */
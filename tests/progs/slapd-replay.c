@@ -0,0 +1,1600 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * This tool replays recorded traffic against a server.  With -F it
+ * converts a recording into a trace on standard output; the recording
+ * is either a slapd log with "loglevel stats", or an LDIF dump of an
+ * accesslog database (e.g. from slapcat or ldapsearch).  Without -F
+ * it replays a trace: each recorded connection gets a connection of
+ * its own, requests are sent at their recorded offsets (scaled by -S),
+ * and a request waits for the previous one on its connection to
+ * complete, as with a synchronous client.  Latencies are reported by
+ * operation type, next to the recorded ones where the recording has
+ * them (stats logs do, in their etime; the accesslog does not).
+ *
+ * Neither source records arrival times below a second (the fraction
+ * in reqStart is a sequence number), so requests recorded within the
+ * same second are spread evenly over it.  Syslog timestamps with a
+ * fraction of a second are used as they are.
+ *
+ * The stats log has no values for add, modify, modrdn and compare,
+ * so those can only be replayed from the accesslog.  Recorded simple
+ * binds are sent with the password given with -W, and skipped if there
+ * is none; SASL binds are never replayed.
+ *
+ * A trace has one request per line, with tab separated fields:
+ *
+ *	<usec> <conn> <op> <result> <etime usec> <args>...
+ *
+ * where result and etime are -1 if not recorded, and args are
+ *
+ *	bind	<dn>
+ *	search	<base> <scope> <deref> <sizelimit> <attrsonly> <filter> <attrs>
+ *	compare	<dn> <attr> <value>
+ *	add	<dn> <mod>...
+ *	delete	<dn>
+ *	modify	<dn> <mod>...
+ *	modrdn	<dn> <newrdn> <deleteoldrdn> <newsuperior>
+ *
+ * attrs is a comma separated list, and each mod is a '+', '-', '='
+ * or '#' followed by the attribute name and, optionally, ':' and a
+ * value.  Control characters and '\' in a field are escaped as '\'
+ * and two hex digits.
+ */
+
+#include "portable.h"
+
+/* Requires libldap with threads */
+#ifndef NO_THREADS
+
+#include <stdio.h>
+#include "ldap_pvt_thread.h"
+
+#include "ac/stdlib.h"
+
+#include "ac/ctype.h"
+#include "ac/param.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/time.h"
+#include "ac/unistd.h"
+
+#include <poll.h>
+
+#include "ldap.h"
+#include "ldif.h"
+#include "lutil.h"
+
+#include "ldap_pvt.h"
+
+#include "slapd-common.h"
+
+#define MAXTHREAD	64
+
+/* a request sent more than this late (usec) counts as late */
+#define LATE_USEC	1000.0
+
+enum {
+	RP_BIND,
+	RP_SEARCH,
+	RP_COMPARE,
+	RP_ADD,
+	RP_DELETE,
+	RP_MODIFY,
+	RP_MODRDN,
+	RP_LAST
+};
+
+static char *rp_opname[] = {
+	"bind", "search", "compare", "add", "delete", "modify", "modrdn", NULL
+};
+
+typedef struct rp_op {
+	double		ro_time;	/* recorded time, sec; in a trace, usec offset */
+	unsigned long	ro_conn;
+	int		ro_type;
+	int		ro_rc;		/* recorded result, or -1 */
+	double		ro_etime;	/* recorded latency, usec, or -1 */
+	char		**ro_args;
+	int		ro_nargs;
+
+	/* when converting */
+	unsigned long	ro_order;
+	int		ro_coarse;	/* ro_time is whole seconds */
+	unsigned long	ro_opid;
+
+	/* when replaying */
+	int		ro_res;
+	double		ro_lat;		/* usec, or -1 if not done */
+	double		ro_lag;		/* usec sent after due */
+} rp_op;
+
+typedef struct rp_conn {
+	LDAP		*rc_ld;
+	ber_socket_t	rc_fd;
+	unsigned long	rc_id;
+	int		*rc_ops;
+	int		rc_nops;
+	int		rc_next;
+	int		rc_msgid;	/* outstanding request, or -1 */
+	rp_op		*rc_cur;
+	double		rc_sent;
+} rp_conn;
+
+typedef struct rp_thread {
+	ldap_pvt_thread_t	rt_tid;
+	rp_conn		**rt_conns;
+	int		rt_nconns;
+} rp_thread;
+
+static struct tester_conn_args *config;
+
+static rp_op	*ops;
+static int	nops, maxops;
+
+static struct berval bindpw = BER_BVNULL;
+static double	speed = 1.0;
+static int	nthreads = 1;
+static double	rp_start;
+
+static void
+usage( char *name, char opt )
+{
+	if ( opt ) {
+		fprintf( stderr, "%s: unable to handle option \'%c\'\n\n",
+			name, opt );
+	}
+
+	fprintf( stderr, "usage: %s -F {stats|accesslog} [<recording>]\n"
+		"       %s " TESTER_COMMON_HELP
+		"[-m <threads>] "
+		"[-o <file>] "
+		"[-S <speed>] "
+		"[-W <bindpw>] "
+		"<trace>"
+		"\n",
+		name, name );
+	exit( EXIT_FAILURE );
+}
+
+static double
+rp_now( void )
+{
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return (double)tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+static void *
+rp_realloc( void *ptr, size_t size )
+{
+	ptr = realloc( ptr, size );
+	if ( ptr == NULL ) {
+		tester_error( "realloc failed" );
+		exit( EXIT_FAILURE );
+	}
+	return ptr;
+}
+
+static char *
+rp_strndup( const char *s, size_t len )
+{
+	char *p = rp_realloc( NULL, len + 1 );
+
+	memcpy( p, s, len );
+	p[ len ] = '\0';
+	return p;
+}
+
+static rp_op *
+rp_op_new( int type, unsigned long conn )
+{
+	rp_op *ro;
+
+	if ( nops == maxops ) {
+		maxops = maxops ? maxops * 2 : 1024;
+		ops = rp_realloc( ops, maxops * sizeof( rp_op ) );
+	}
+	ro = &ops[ nops++ ];
+	memset( ro, 0, sizeof( rp_op ) );
+	ro->ro_type = type;
+	ro->ro_conn = conn;
+	ro->ro_rc = -1;
+	ro->ro_etime = -1;
+	ro->ro_lat = -1;
+	return ro;
+}
+
+static void
+rp_op_arg( rp_op *ro, const char *val, size_t len )
+{
+	ro->ro_args = rp_realloc( ro->ro_args,
+		( ro->ro_nargs + 1 ) * sizeof( char * ) );
+	ro->ro_args[ ro->ro_nargs++ ] = rp_strndup( val, len );
+}
+
+static void
+rp_op_free( rp_op *ro )
+{
+	int i;
+
+	for ( i = 0; i < ro->ro_nargs; i++ ) {
+		free( ro->ro_args[ i ] );
+	}
+	free( ro->ro_args );
+}
+
+/* read a line of any length; returns NULL at EOF */
+static char *
+rp_getline( FILE *fp, char **bufp, size_t *lenp )
+{
+	size_t n = 0;
+
+	for ( ;; ) {
+		if ( *lenp - n < 2 ) {
+			*lenp = *lenp ? *lenp * 2 : BUFSIZ;
+			*bufp = rp_realloc( *bufp, *lenp );
+		}
+		if ( fgets( *bufp + n, *lenp - n, fp ) == NULL ) {
+			return n ? *bufp : NULL;
+		}
+		n += strlen( *bufp + n );
+		if ( n && (*bufp)[ n - 1 ] == '\n' ) {
+			(*bufp)[ --n ] = '\0';
+			if ( n && (*bufp)[ n - 1 ] == '\r' ) {
+				(*bufp)[ --n ] = '\0';
+			}
+			return *bufp;
+		}
+	}
+}
+
+/* days since 1970-01-01 of a proleptic Gregorian date */
+static long
+rp_days( long y, int m, int d )
+{
+	long era;
+	unsigned yoe, doy, doe;
+
+	y -= m <= 2;
+	era = ( y >= 0 ? y : y - 399 ) / 400;
+	yoe = (unsigned)( y - era * 400 );
+	doy = ( 153 * ( m + ( m > 2 ? -3 : 9 ) ) + 2 ) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (long)doe - 719468;
+}
+
+/*
+ * Timestamp at the start of a log line: slapd's own hex seconds,
+ * ISO 8601 as written by rsyslog, or traditional syslog (without a
+ * year, which does not matter for offsets within a recording).
+ * Returns the length consumed, 0 if there is none.
+ */
+static int
+rp_logtime( const char *line, double *t, int *coarse )
+{
+	static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+	char *end;
+	int y, mo, d, h, mi, s, n = 0;
+
+	if ( sscanf( line, "%4d-%2d-%2dT%2d:%2d:%2d%n",
+		&y, &mo, &d, &h, &mi, &s, &n ) == 6 && n )
+	{
+		*t = rp_days( y, mo, d ) * 86400.0 + h * 3600 + mi * 60 + s;
+		*coarse = 1;
+		if ( line[ n ] == '.' ) {
+			*t += strtod( line + n, &end );
+			n = end - line;
+			*coarse = 0;
+		}
+		return n;
+	}
+
+	if ( strlen( line ) > 15 && line[ 3 ] == ' ' &&
+		sscanf( line + 4, "%2d %2d:%2d:%2d%n", &d, &h, &mi, &s, &n ) == 4 )
+	{
+		for ( mo = 0; mo < 12; mo++ ) {
+			if ( strncmp( months + mo * 3, line, 3 ) == 0 ) {
+				break;
+			}
+		}
+		if ( mo < 12 ) {
+			*t = rp_days( 2000, mo + 1, d ) * 86400.0 + h * 3600 + mi * 60 + s;
+			*coarse = 1;
+			return n + 4;
+		}
+	}
+
+	*t = strtoul( line, &end, 16 );
+	if ( end - line >= 8 && *end == ' ' ) {
+		*coarse = 1;
+		return end - line;
+	}
+
+	return 0;
+}
+
+/* the value of name="..." in a stats line, up to the quote before stop */
+static int
+rp_quoted( rp_op *ro, const char *line, const char *name, const char *stop )
+{
+	const char *p, *q;
+
+	p = strstr( line, name );
+	if ( p == NULL ) {
+		return -1;
+	}
+	p += strlen( name );
+	if ( stop ) {
+		q = strstr( p, stop );
+	} else {
+		q = strrchr( p, '"' );
+	}
+	if ( q == NULL || q < p ) {
+		return -1;
+	}
+	rp_op_arg( ro, p, q - p );
+	return 0;
+}
+
+/* stats lines are matched to their op by conn and op number */
+#define RP_HASH	65536
+
+typedef struct rp_pending {
+	struct rp_pending *rp_next;
+	int		rp_idx;
+} rp_pending;
+
+static rp_pending *pending[ RP_HASH ];
+
+static unsigned
+rp_hash( unsigned long conn, unsigned long op )
+{
+	return ( conn * 2654435761UL + op ) % RP_HASH;
+}
+
+static int
+rp_find( unsigned long conn, unsigned long op, int unlink )
+{
+	rp_pending **pp, *p;
+
+	for ( pp = &pending[ rp_hash( conn, op ) ]; (p = *pp) != NULL; pp = &p->rp_next ) {
+		rp_op *ro = &ops[ p->rp_idx ];
+
+		if ( ro->ro_conn == conn && ro->ro_opid == op ) {
+			int idx = p->rp_idx;
+
+			if ( unlink ) {
+				*pp = p->rp_next;
+				free( p );
+			}
+			return idx;
+		}
+	}
+	return -1;
+}
+
+static void
+rp_pend( int idx )
+{
+	rp_pending *p = rp_realloc( NULL, sizeof( rp_pending ) );
+	unsigned h = rp_hash( ops[ idx ].ro_conn, ops[ idx ].ro_opid );
+
+	p->rp_idx = idx;
+	p->rp_next = pending[ h ];
+	pending[ h ] = p;
+}
+
+static unsigned long skipped[ RP_LAST + 1 ];
+
+static int
+rp_read_stats( FILE *fp )
+{
+	char *buf = NULL, *line, *p, *end;
+	size_t len = 0;
+	unsigned long lineno = 0;
+	double t = 0;
+	int i, coarse = 1;
+
+	while ( ( line = rp_getline( fp, &buf, &len ) ) != NULL ) {
+		unsigned long conn, opid;
+		double lt;
+		int lc, idx, type;
+		rp_op *ro;
+
+		lineno++;
+		if ( rp_logtime( line, &lt, &lc ) ) {
+			t = lt;
+			coarse = lc;
+		}
+
+		p = strstr( line, "conn=" );
+		if ( p == NULL ) {
+			continue;
+		}
+		conn = strtoul( p + STRLENOF( "conn=" ), &end, 10 );
+		if ( strncmp( end, " op=", STRLENOF( " op=" ) ) != 0 ) {
+			continue;
+		}
+		opid = strtoul( end + STRLENOF( " op=" ), &p, 10 );
+		if ( *p++ != ' ' ) {
+			continue;
+		}
+
+		if ( strncmp( p, "RESULT ", STRLENOF( "RESULT " ) ) == 0 ||
+			strncmp( p, "SEARCH RESULT ", STRLENOF( "SEARCH RESULT " ) ) == 0 )
+		{
+			idx = rp_find( conn, opid, 1 );
+			if ( idx < 0 ) {
+				continue;
+			}
+			ro = &ops[ idx ];
+			if ( ( end = strstr( p, " err=" ) ) != NULL ) {
+				ro->ro_rc = atoi( end + STRLENOF( " err=" ) );
+			}
+			if ( ( end = strstr( p, " etime=" ) ) != NULL ) {
+				ro->ro_etime = strtod( end + STRLENOF( " etime=" ), NULL ) * 1000000.0;
+			}
+			continue;
+		}
+
+		/* continuation lines of a request */
+		if ( strncmp( p, "SRCH attr=", STRLENOF( "SRCH attr=" ) ) == 0 ) {
+			char *a, *next;
+
+			idx = rp_find( conn, opid, 0 );
+			if ( idx < 0 || ops[ idx ].ro_nargs != 7 ) {
+				continue;
+			}
+			ro = &ops[ idx ];
+			for ( a = p + STRLENOF( "SRCH attr=" ); *a; a = next ) {
+				size_t l, ol = strlen( ro->ro_args[ 6 ] );
+
+				next = strchr( a, ' ' );
+				l = next ? next - a : strlen( a );
+				if ( l ) {
+					ro->ro_args[ 6 ] = rp_realloc( ro->ro_args[ 6 ], ol + l + 2 );
+					sprintf( ro->ro_args[ 6 ] + ol, "%s%.*s", ol ? "," : "", (int)l, a );
+				}
+				if ( next == NULL ) {
+					break;
+				}
+				next++;
+			}
+			continue;
+		}
+
+		if ( strncmp( p, "BIND dn=", STRLENOF( "BIND dn=" ) ) == 0 ) {
+			/* the second BIND line names the mech */
+			if ( rp_find( conn, opid, 0 ) >= 0 ) {
+				continue;
+			}
+			if ( strstr( p, " method=128" ) == NULL ) {
+				skipped[ RP_BIND ]++;
+				continue;
+			}
+			type = RP_BIND;
+		} else if ( strncmp( p, "SRCH base=", STRLENOF( "SRCH base=" ) ) == 0 ) {
+			type = RP_SEARCH;
+		} else if ( strncmp( p, "DEL dn=", STRLENOF( "DEL dn=" ) ) == 0 ) {
+			type = RP_DELETE;
+		} else {
+			if ( strncmp( p, "ADD ", 4 ) == 0 ) {
+				skipped[ RP_ADD ]++;
+			} else if ( strncmp( p, "MOD dn=", 7 ) == 0 ) {
+				skipped[ RP_MODIFY ]++;
+			} else if ( strncmp( p, "MODRDN ", 7 ) == 0 ) {
+				skipped[ RP_MODRDN ]++;
+			} else if ( strncmp( p, "CMP ", 4 ) == 0 ) {
+				skipped[ RP_COMPARE ]++;
+			}
+			continue;
+		}
+
+		ro = rp_op_new( type, conn );
+		ro->ro_opid = opid;
+		ro->ro_time = t;
+		ro->ro_coarse = coarse;
+		ro->ro_order = lineno;
+
+		switch ( type ) {
+		case RP_BIND:
+			if ( rp_quoted( ro, p, "dn=\"", "\" method=" ) ) {
+				goto bad;
+			}
+			break;
+
+		case RP_SEARCH: {
+			char num[ 16 ];
+
+			if ( rp_quoted( ro, p, "base=\"", "\" scope=" ) ) {
+				goto bad;
+			}
+			end = strstr( p, " scope=" );
+			rp_op_arg( ro, num, snprintf( num, sizeof( num ), "%d",
+				atoi( end + STRLENOF( " scope=" ) ) ) );
+			end = strstr( p, " deref=" );
+			rp_op_arg( ro, num, snprintf( num, sizeof( num ), "%d",
+				end ? atoi( end + STRLENOF( " deref=" ) ) : 0 ) );
+			rp_op_arg( ro, "0", 1 );
+			rp_op_arg( ro, "0", 1 );
+			if ( rp_quoted( ro, p, "filter=\"", NULL ) ) {
+				goto bad;
+			}
+			rp_op_arg( ro, "", 0 );
+			} break;
+
+		case RP_DELETE:
+			if ( rp_quoted( ro, p, "dn=\"", NULL ) ) {
+				goto bad;
+			}
+			break;
+		}
+
+		rp_pend( ro - ops );
+		continue;
+
+bad:
+		fprintf( stderr, "line %lu: can't parse request\n", lineno );
+		rp_op_free( ro );
+		nops--;
+	}
+
+	/* requests whose result was not logged */
+	for ( i = 0; i < RP_HASH; i++ ) {
+		rp_pending *p, *next;
+
+		for ( p = pending[ i ]; p; p = next ) {
+			next = p->rp_next;
+			free( p );
+		}
+		pending[ i ] = NULL;
+	}
+
+	free( buf );
+	return 0;
+}
+
+/* reqStart and reqEnd are generalizedTime with a sequence number */
+static int
+rp_gentime( const char *val, double *t, unsigned long *seq )
+{
+	int y, mo, d, h, mi, s, n = 0;
+
+	if ( sscanf( val, "%4d%2d%2d%2d%2d%2d%n", &y, &mo, &d, &h, &mi, &s, &n ) != 6 ) {
+		return -1;
+	}
+	*t = rp_days( y, mo, d ) * 86400.0 + h * 3600 + mi * 60 + s;
+	*seq = val[ n ] == '.' ? strtoul( val + n + 1, NULL, 10 ) : 0;
+	return 0;
+}
+
+/* maintained by the server, can't be replayed */
+static const char *rp_opattrs[] = {
+	"entryCSN", "entryUUID", "creatorsName", "createTimestamp",
+	"modifiersName", "modifyTimestamp", "structuralObjectClass",
+	"contextCSN", "entryDN", "subschemaSubentry", "hasSubordinates",
+	NULL
+};
+
+static int
+rp_read_accesslog( char *file )
+{
+	static const char *scopes[] = { "base", "one", "sub", "subord", NULL };
+	static const char *derefs[] = { "never", "searching", "finding", "always", NULL };
+	LDIFFP *fp;
+	unsigned long lineno = 0;
+	char *buf = NULL;
+	int lmax = 0;
+
+	fp = file ? ldif_open( file, "r" ) : NULL;
+	if ( fp == NULL ) {
+		if ( file ) {
+			tester_perror( "ldif_open", file );
+			return -1;
+		}
+		fp = rp_realloc( NULL, sizeof( LDIFFP ) );
+		fp->fp = stdin;
+		fp->prev = NULL;
+	}
+
+	while ( ldif_read_record( fp, &lineno, &buf, &lmax ) > 0 ) {
+		struct berval type, val, dn = BER_BVNULL, attrs = BER_BVNULL;
+		struct berval rtype = BER_BVNULL, filter = BER_BVNULL;
+		struct berval newrdn = BER_BVNULL, newsup = BER_BVNULL;
+		struct berval assertion = BER_BVNULL, method = BER_BVNULL;
+		char *next = buf, *line, *mods = NULL, num[ 16 ];
+		double t = -1;
+		unsigned long seq = 0, conn = 0;
+		int freeval, rc = -1, scope = 0, deref = 0, slimit = 0,
+			attrsonly = 0, deloldrdn = 0, i, op;
+		size_t modslen = 0;
+		rp_op *ro;
+
+		/* the mods are collected NUL separated */
+		while ( ( line = ldif_getline( &next ) ) != NULL ) {
+			if ( ldif_parse_line2( line, &type, &val, &freeval ) < 0 ) {
+				continue;
+			}
+
+#define IS(name)	( strcasecmp( type.bv_val, name ) == 0 )
+			if ( IS( "reqStart" ) ) {
+				rp_gentime( val.bv_val, &t, &seq );
+			} else if ( IS( "reqType" ) ) {
+				rtype.bv_val = rp_strndup( val.bv_val, val.bv_len );
+				rtype.bv_len = val.bv_len;
+			} else if ( IS( "reqSession" ) ) {
+				conn = strtoul( val.bv_val, NULL, 10 );
+			} else if ( IS( "reqDN" ) ) {
+				dn.bv_val = rp_strndup( val.bv_val, val.bv_len );
+				dn.bv_len = val.bv_len;
+			} else if ( IS( "reqResult" ) ) {
+				rc = atoi( val.bv_val );
+			} else if ( IS( "reqScope" ) ) {
+				for ( i = 0; scopes[ i ] && strcasecmp( val.bv_val, scopes[ i ] ); i++ )
+					;
+				scope = scopes[ i ] ? i : 0;
+			} else if ( IS( "reqDerefAliases" ) ) {
+				for ( i = 0; derefs[ i ] && strcasecmp( val.bv_val, derefs[ i ] ); i++ )
+					;
+				deref = derefs[ i ] ? i : 0;
+			} else if ( IS( "reqSizeLimit" ) ) {
+				slimit = atoi( val.bv_val );
+				if ( slimit < 0 ) {
+					slimit = 0;
+				}
+			} else if ( IS( "reqAttrsOnly" ) ) {
+				attrsonly = strcasecmp( val.bv_val, "TRUE" ) == 0;
+			} else if ( IS( "reqFilter" ) ) {
+				filter.bv_val = rp_strndup( val.bv_val, val.bv_len );
+				filter.bv_len = val.bv_len;
+			} else if ( IS( "reqAttr" ) ) {
+				attrs.bv_val = rp_realloc( attrs.bv_val, attrs.bv_len + val.bv_len + 2 );
+				if ( attrs.bv_len ) {
+					attrs.bv_val[ attrs.bv_len++ ] = ',';
+				}
+				memcpy( attrs.bv_val + attrs.bv_len, val.bv_val, val.bv_len );
+				attrs.bv_len += val.bv_len;
+				attrs.bv_val[ attrs.bv_len ] = '\0';
+			} else if ( IS( "reqAssertion" ) ) {
+				assertion.bv_val = rp_strndup( val.bv_val, val.bv_len );
+				assertion.bv_len = val.bv_len;
+			} else if ( IS( "reqMethod" ) ) {
+				method.bv_val = rp_strndup( val.bv_val, val.bv_len );
+				method.bv_len = val.bv_len;
+			} else if ( IS( "reqNewRDN" ) ) {
+				newrdn.bv_val = rp_strndup( val.bv_val, val.bv_len );
+				newrdn.bv_len = val.bv_len;
+			} else if ( IS( "reqNewSuperior" ) ) {
+				newsup.bv_val = rp_strndup( val.bv_val, val.bv_len );
+				newsup.bv_len = val.bv_len;
+			} else if ( IS( "reqDeleteOldRDN" ) ) {
+				deloldrdn = strcasecmp( val.bv_val, "TRUE" ) == 0;
+			} else if ( IS( "reqMod" ) ) {
+				/* "attr:<op> value", or "attr:<op>" for no values */
+				char *colon = memchr( val.bv_val, ':', val.bv_len );
+
+				if ( colon && colon + 1 < val.bv_val + val.bv_len &&
+					strchr( "+-=#", colon[ 1 ] ) )
+				{
+					size_t alen = colon - val.bv_val, vlen = 0;
+					char *v = colon + 2;
+
+					for ( i = 0; rp_opattrs[ i ]; i++ ) {
+						if ( strlen( rp_opattrs[ i ] ) == alen &&
+							strncasecmp( rp_opattrs[ i ], val.bv_val, alen ) == 0 )
+						{
+							break;
+						}
+					}
+					if ( rp_opattrs[ i ] ) {
+						goto next;
+					}
+					if ( v < val.bv_val + val.bv_len && *v == ' ' ) {
+						v++;
+						vlen = val.bv_val + val.bv_len - v;
+					}
+					mods = rp_realloc( mods, modslen + alen + vlen + 4 );
+					mods[ modslen++ ] = colon[ 1 ];
+					memcpy( mods + modslen, val.bv_val, alen );
+					modslen += alen;
+					if ( vlen || v > colon + 2 ) {
+						mods[ modslen++ ] = ':';
+						memcpy( mods + modslen, v, vlen );
+						modslen += vlen;
+					}
+					mods[ modslen++ ] = '\0';
+				}
+			}
+#undef IS
+next:
+			if ( freeval ) {
+				ber_memfree( val.bv_val );
+			}
+		}
+
+		op = -1;
+		if ( t >= 0 && rtype.bv_val != NULL ) {
+			for ( i = 0; rp_opname[ i ]; i++ ) {
+				if ( strcasecmp( rtype.bv_val, rp_opname[ i ] ) == 0 ) {
+					op = i;
+					break;
+				}
+			}
+		}
+		if ( op == RP_BIND && ( method.bv_val == NULL ||
+			strcasecmp( method.bv_val, "SIMPLE" ) != 0 ) )
+		{
+			skipped[ RP_BIND ]++;
+			op = -1;
+		}
+		if ( op == RP_COMPARE && ( assertion.bv_val == NULL ||
+			strchr( assertion.bv_val, '=' ) == NULL ) )
+		{
+			skipped[ RP_COMPARE ]++;
+			op = -1;
+		}
+		if ( op == RP_MODRDN && newrdn.bv_val == NULL ) {
+			skipped[ RP_MODRDN ]++;
+			op = -1;
+		}
+
+		if ( op >= 0 ) {
+			ro = rp_op_new( op, conn );
+			ro->ro_time = t;
+			ro->ro_coarse = 1;
+			ro->ro_order = seq;
+			ro->ro_rc = rc;
+			rp_op_arg( ro, dn.bv_val ? dn.bv_val : "", dn.bv_len );
+
+			switch ( op ) {
+			case RP_SEARCH:
+				rp_op_arg( ro, num, snprintf( num, sizeof( num ), "%d", scope ) );
+				rp_op_arg( ro, num, snprintf( num, sizeof( num ), "%d", deref ) );
+				rp_op_arg( ro, num, snprintf( num, sizeof( num ), "%d", slimit ) );
+				rp_op_arg( ro, num, snprintf( num, sizeof( num ), "%d", attrsonly ) );
+				rp_op_arg( ro, filter.bv_val ? filter.bv_val : "(objectClass=*)",
+					filter.bv_val ? filter.bv_len : STRLENOF( "(objectClass=*)" ) );
+				rp_op_arg( ro, attrs.bv_val ? attrs.bv_val : "", attrs.bv_len );
+				break;
+
+			case RP_COMPARE: {
+				char *eq = strchr( assertion.bv_val, '=' );
+
+				rp_op_arg( ro, assertion.bv_val, eq - assertion.bv_val );
+				rp_op_arg( ro, eq + 1, assertion.bv_len - ( eq + 1 - assertion.bv_val ) );
+				} break;
+
+			case RP_ADD:
+			case RP_MODIFY: {
+				size_t off;
+
+				for ( off = 0; off < modslen; off += strlen( mods + off ) + 1 ) {
+					rp_op_arg( ro, mods + off, strlen( mods + off ) );
+				}
+				} break;
+
+			case RP_MODRDN:
+				rp_op_arg( ro, newrdn.bv_val, newrdn.bv_len );
+				rp_op_arg( ro, deloldrdn ? "1" : "0", 1 );
+				rp_op_arg( ro, newsup.bv_val ? newsup.bv_val : "", newsup.bv_len );
+				break;
+			}
+		}
+
+		free( dn.bv_val );
+		free( attrs.bv_val );
+		free( rtype.bv_val );
+		free( filter.bv_val );
+		free( newrdn.bv_val );
+		free( newsup.bv_val );
+		free( assertion.bv_val );
+		free( method.bv_val );
+		free( mods );
+	}
+
+	ber_memfree( buf );
+	if ( file ) {
+		ldif_close( fp );
+	} else {
+		free( fp );
+	}
+	return 0;
+}
+
+static int
+rp_cmp_time( const void *a, const void *b )
+{
+	const rp_op *x = a, *y = b;
+
+	if ( x->ro_time != y->ro_time ) {
+		return x->ro_time < y->ro_time ? -1 : 1;
+	}
+	return x->ro_order < y->ro_order ? -1 : x->ro_order > y->ro_order;
+}
+
+static void
+rp_escape( FILE *fp, const char *s )
+{
+	for ( ; *s; s++ ) {
+		unsigned char c = *s;
+
+		if ( c < 0x20 || c == 0x7f || c == '\\' ) {
+			fprintf( fp, "\\%02x", c );
+		} else {
+			putc( c, fp );
+		}
+	}
+}
+
+/* sort, spread requests over the second they were recorded in, write */
+static void
+rp_write_trace( FILE *fp )
+{
+	double t0;
+	int i, j, k;
+
+	qsort( ops, nops, sizeof( rp_op ), rp_cmp_time );
+
+	for ( i = 0; i < nops; i = j ) {
+		for ( j = i + 1; j < nops && ops[ j ].ro_coarse &&
+			ops[ j ].ro_time == ops[ i ].ro_time; j++ )
+			;
+		if ( !ops[ i ].ro_coarse ) {
+			j = i + 1;
+			continue;
+		}
+		for ( k = i; k < j; k++ ) {
+			ops[ k ].ro_time += (double)( k - i ) / ( j - i );
+		}
+	}
+
+	t0 = nops ? ops[ 0 ].ro_time : 0;
+	for ( i = 0; i < nops; i++ ) {
+		rp_op *ro = &ops[ i ];
+
+		fprintf( fp, "%.0f\t%lu\t%s\t%d\t%.0f",
+			( ro->ro_time - t0 ) * 1000000.0, ro->ro_conn,
+			rp_opname[ ro->ro_type ], ro->ro_rc, ro->ro_etime );
+		for ( j = 0; j < ro->ro_nargs; j++ ) {
+			putc( '\t', fp );
+			rp_escape( fp, ro->ro_args[ j ] );
+		}
+		putc( '\n', fp );
+	}
+
+	for ( i = 0; i <= RP_LAST; i++ ) {
+		if ( skipped[ i ] ) {
+			fprintf( stderr, "%lu %s requests can't be replayed, skipped\n",
+				skipped[ i ], rp_opname[ i ] );
+		}
+	}
+}
+
+static int
+rp_convert( char *format, char *file )
+{
+	FILE *fp;
+	int rc;
+
+	if ( strcasecmp( format, "stats" ) == 0 ) {
+		fp = file ? fopen( file, "r" ) : stdin;
+		if ( fp == NULL ) {
+			tester_perror( "fopen", file );
+			return -1;
+		}
+		rc = rp_read_stats( fp );
+		if ( file ) {
+			fclose( fp );
+		}
+	} else if ( strcasecmp( format, "accesslog" ) == 0 ) {
+		rc = rp_read_accesslog( file );
+	} else {
+		return -1;
+	}
+
+	if ( rc == 0 ) {
+		rp_write_trace( stdout );
+	}
+	return rc;
+}
+
+static int
+rp_unhex( int c )
+{
+	return isdigit( c ) ? c - '0' : tolower( c ) - 'a' + 10;
+}
+
+static int
+rp_read_trace( char *file )
+{
+	FILE *fp;
+	char *buf = NULL, *line;
+	size_t len = 0;
+	unsigned long lineno = 0;
+
+	fp = fopen( file, "r" );
+	if ( fp == NULL ) {
+		tester_perror( "fopen", file );
+		return -1;
+	}
+
+	while ( ( line = rp_getline( fp, &buf, &len ) ) != NULL ) {
+		char *fields[ 5 ], *p, *next;
+		rp_op *ro;
+		int i;
+
+		lineno++;
+		if ( *line == '\0' || *line == '#' ) {
+			continue;
+		}
+		for ( i = 0, p = line; i < 5 && p; i++, p = next ) {
+			next = strchr( p, '\t' );
+			if ( next ) {
+				*next++ = '\0';
+			}
+			fields[ i ] = p;
+		}
+		if ( i < 5 ) {
+			goto bad;
+		}
+		for ( i = 0; rp_opname[ i ]; i++ ) {
+			if ( strcmp( fields[ 2 ], rp_opname[ i ] ) == 0 ) {
+				break;
+			}
+		}
+		if ( rp_opname[ i ] == NULL ) {
+			goto bad;
+		}
+
+		ro = rp_op_new( i, strtoul( fields[ 1 ], NULL, 10 ) );
+		ro->ro_time = strtod( fields[ 0 ], NULL );
+		ro->ro_rc = atoi( fields[ 3 ] );
+		ro->ro_etime = strtod( fields[ 4 ], NULL );
+
+		for ( ; p; p = next ) {
+			char *s, *d;
+
+			next = strchr( p, '\t' );
+			if ( next ) {
+				*next++ = '\0';
+			}
+			for ( s = d = p; *s; s++ ) {
+				if ( *s == '\\' && isxdigit( (unsigned char) s[ 1 ] ) &&
+					isxdigit( (unsigned char) s[ 2 ] ) )
+				{
+					*d++ = rp_unhex( s[ 1 ] ) << 4 | rp_unhex( s[ 2 ] );
+					s += 2;
+				} else {
+					*d++ = *s;
+				}
+			}
+			rp_op_arg( ro, p, d - p );
+		}
+
+		switch ( ro->ro_type ) {
+		case RP_BIND:
+		case RP_DELETE:
+			i = ro->ro_nargs == 1;
+			break;
+		case RP_SEARCH:
+			i = ro->ro_nargs == 7;
+			break;
+		case RP_COMPARE:
+			i = ro->ro_nargs == 3;
+			break;
+		case RP_MODRDN:
+			i = ro->ro_nargs == 4;
+			break;
+		default:
+			i = ro->ro_nargs >= 2;
+			break;
+		}
+		if ( !i ) {
+			rp_op_free( ro );
+			nops--;
+			goto bad;
+		}
+		continue;
+
+bad:
+		fprintf( stderr, "%s: line %lu: bad trace line, skipped\n",
+			file, lineno );
+	}
+
+	free( buf );
+	fclose( fp );
+	return 0;
+}
+
+/* make an LDAPMod array out of "<op><attr>[:<value>]" args */
+static LDAPMod **
+rp_mods( rp_op *ro, int add )
+{
+	LDAPMod **mods;
+	int i, n = 0, nv = 0;
+
+	mods = rp_realloc( NULL, ro->ro_nargs * sizeof( LDAPMod * ) );
+	for ( i = 1; i < ro->ro_nargs; i++ ) {
+		char *a = ro->ro_args[ i ], *v = strchr( a + 1, ':' );
+		size_t alen = v ? (size_t)( v - a - 1 ) : strlen( a + 1 );
+		LDAPMod *m = n ? mods[ n - 1 ] : NULL;
+		int mop;
+
+		switch ( *a ) {
+		case '-':	mop = LDAP_MOD_DELETE; break;
+		case '=':	mop = LDAP_MOD_REPLACE; break;
+		case '#':	mop = LDAP_MOD_INCREMENT; break;
+		default:	mop = LDAP_MOD_ADD; break;
+		}
+		if ( add ) {
+			mop = LDAP_MOD_ADD;
+		}
+
+		/* consecutive values of the same attribute and op go together */
+		if ( m == NULL || ( m->mod_op & ~LDAP_MOD_BVALUES ) != mop ||
+			strlen( m->mod_type ) != alen ||
+			strncasecmp( m->mod_type, a + 1, alen ) != 0 )
+		{
+			m = rp_realloc( NULL, sizeof( LDAPMod ) );
+			m->mod_op = mop | LDAP_MOD_BVALUES;
+			m->mod_type = rp_strndup( a + 1, alen );
+			m->mod_bvalues = NULL;
+			mods[ n++ ] = m;
+			nv = 0;
+		}
+		if ( v ) {
+			struct berval *bv = rp_realloc( NULL, sizeof( struct berval ) );
+
+			bv->bv_val = v + 1;
+			bv->bv_len = strlen( v + 1 );
+			m->mod_bvalues = rp_realloc( m->mod_bvalues,
+				( nv + 2 ) * sizeof( struct berval * ) );
+			m->mod_bvalues[ nv++ ] = bv;
+			m->mod_bvalues[ nv ] = NULL;
+		}
+	}
+	mods[ n ] = NULL;
+
+	return mods;
+}
+
+static void
+rp_mods_free( LDAPMod **mods )
+{
+	int i, j;
+
+	for ( i = 0; mods[ i ]; i++ ) {
+		if ( mods[ i ]->mod_bvalues ) {
+			for ( j = 0; mods[ i ]->mod_bvalues[ j ]; j++ ) {
+				free( mods[ i ]->mod_bvalues[ j ] );
+			}
+			free( mods[ i ]->mod_bvalues );
+		}
+		free( mods[ i ]->mod_type );
+		free( mods[ i ] );
+	}
+	free( mods );
+}
+
+static void
+rp_done( rp_conn *rc, int res, double now )
+{
+	rc->rc_cur->ro_res = res;
+	rc->rc_cur->ro_lat = now - rc->rc_sent;
+	rc->rc_cur = NULL;
+	rc->rc_msgid = -1;
+}
+
+static void
+rp_drop( rp_conn *rc )
+{
+	if ( rc->rc_ld ) {
+		ldap_unbind_ext( rc->rc_ld, NULL, NULL );
+		rc->rc_ld = NULL;
+	}
+	rc->rc_fd = AC_SOCKET_INVALID;
+}
+
+static int
+rp_send( rp_conn *rc, rp_op *ro )
+{
+	char		**a = ro->ro_args, **attrs = NULL;
+	int		rc2, msgid = -1;
+
+	if ( rc->rc_ld == NULL ) {
+		tester_init_ld( &rc->rc_ld, config, 0 );
+		rc->rc_fd = AC_SOCKET_INVALID;
+	}
+
+	switch ( ro->ro_type ) {
+	case RP_BIND:
+		rc2 = ldap_sasl_bind( rc->rc_ld, a[ 0 ], LDAP_SASL_SIMPLE,
+			&bindpw, NULL, NULL, &msgid );
+		break;
+
+	case RP_SEARCH:
+		if ( *a[ 6 ] ) {
+			char *p, *s;
+			int n = 2;
+
+			for ( p = a[ 6 ]; ( p = strchr( p, ',' ) ) != NULL; p++ ) {
+				n++;
+			}
+			attrs = rp_realloc( NULL, n * sizeof( char * ) + strlen( a[ 6 ] ) + 1 );
+			s = (char *)( attrs + n );
+			strcpy( s, a[ 6 ] );
+			for ( n = 0, p = s; p; p = s ) {
+				s = strchr( p, ',' );
+				if ( s ) {
+					*s++ = '\0';
+				}
+				attrs[ n++ ] = p;
+			}
+			attrs[ n ] = NULL;
+		}
+		/* requests on a connection go one at a time */
+		rc2 = atoi( a[ 2 ] );
+		ldap_set_option( rc->rc_ld, LDAP_OPT_DEREF, &rc2 );
+		rc2 = ldap_search_ext( rc->rc_ld, a[ 0 ], atoi( a[ 1 ] ), a[ 5 ],
+			attrs, atoi( a[ 4 ] ), NULL, NULL, NULL, atoi( a[ 3 ] ), &msgid );
+		free( attrs );
+		break;
+
+	case RP_COMPARE: {
+		struct berval bv;
+
+		ber_str2bv( a[ 2 ], 0, 0, &bv );
+		rc2 = ldap_compare_ext( rc->rc_ld, a[ 0 ], a[ 1 ], &bv,
+			NULL, NULL, &msgid );
+		} break;
+
+	case RP_ADD:
+	case RP_MODIFY: {
+		LDAPMod **mods = rp_mods( ro, ro->ro_type == RP_ADD );
+
+		if ( ro->ro_type == RP_ADD ) {
+			rc2 = ldap_add_ext( rc->rc_ld, a[ 0 ], mods, NULL, NULL, &msgid );
+		} else {
+			rc2 = ldap_modify_ext( rc->rc_ld, a[ 0 ], mods, NULL, NULL, &msgid );
+		}
+		rp_mods_free( mods );
+		} break;
+
+	case RP_DELETE:
+		rc2 = ldap_delete_ext( rc->rc_ld, a[ 0 ], NULL, NULL, &msgid );
+		break;
+
+	case RP_MODRDN:
+		rc2 = ldap_rename( rc->rc_ld, a[ 0 ], a[ 1 ], *a[ 3 ] ? a[ 3 ] : NULL,
+			atoi( a[ 2 ] ), NULL, NULL, &msgid );
+		break;
+
+	default:
+		assert( 0 );
+		return -1;
+	}
+
+	rc->rc_cur = ro;
+	rc->rc_sent = rp_now();
+	if ( rc2 != LDAP_SUCCESS ) {
+		rp_done( rc, rc2, rc->rc_sent );
+		rp_drop( rc );
+		return -1;
+	}
+	rc->rc_msgid = msgid;
+	if ( rc->rc_fd == AC_SOCKET_INVALID ) {
+		ldap_get_option( rc->rc_ld, LDAP_OPT_DESC, &rc->rc_fd );
+	}
+	return 0;
+}
+
+/* read whatever responses are available on rc without blocking */
+static void
+rp_receive( rp_conn *rc )
+{
+	struct timeval	zero = { 0, 0 };
+	LDAPMessage	*msg;
+	int		rc2, err;
+
+	while ( rc->rc_msgid >= 0 ) {
+		rc2 = ldap_result( rc->rc_ld, rc->rc_msgid, LDAP_MSG_ONE, &zero, &msg );
+		if ( rc2 == 0 ) {
+			break;
+		}
+		if ( rc2 < 0 ) {
+			rp_done( rc, LDAP_SERVER_DOWN, rp_now() );
+			rp_drop( rc );
+			break;
+		}
+		if ( rc2 == LDAP_RES_SEARCH_ENTRY ||
+			rc2 == LDAP_RES_SEARCH_REFERENCE ||
+			rc2 == LDAP_RES_INTERMEDIATE )
+		{
+			ldap_msgfree( msg );
+			continue;
+		}
+		if ( ldap_parse_result( rc->rc_ld, msg, &err,
+			NULL, NULL, NULL, NULL, 1 ) != LDAP_SUCCESS )
+		{
+			err = LDAP_OTHER;
+		}
+		rp_done( rc, err, rp_now() );
+	}
+}
+
+static void *
+rp_thread_main( void *arg )
+{
+	rp_thread	*rt = arg;
+	struct pollfd	*fds;
+	rp_conn		**pc;
+	int		nfds;
+
+	fds = rp_realloc( NULL, ( rt->rt_nconns + 1 ) * sizeof( struct pollfd ) );
+	pc = rp_realloc( NULL, ( rt->rt_nconns + 1 ) * sizeof( rp_conn * ) );
+
+	for ( ;; ) {
+		double	now = rp_now(), wait = 100000.0;
+		int	i, active = 0;
+
+		nfds = 0;
+		for ( i = 0; i < rt->rt_nconns; i++ ) {
+			rp_conn *rc = rt->rt_conns[ i ];
+
+			if ( rc->rc_msgid < 0 ) {
+				rp_op *ro;
+				double due;
+
+				if ( rc->rc_next == rc->rc_nops ) {
+					rp_drop( rc );
+					continue;
+				}
+				ro = &ops[ rc->rc_ops[ rc->rc_next ] ];
+				due = rp_start + ro->ro_time / speed;
+				if ( due > now ) {
+					if ( due - now < wait ) {
+						wait = due - now;
+					}
+					active++;
+					continue;
+				}
+				rc->rc_next++;
+				if ( ro->ro_type == RP_BIND && BER_BVISNULL( &bindpw ) ) {
+					active++;
+					continue;
+				}
+				rp_send( rc, ro );
+				ro->ro_lag = rc->rc_sent - due;
+				now = rc->rc_sent;
+			}
+			active++;
+			if ( rc->rc_msgid >= 0 && rc->rc_fd != AC_SOCKET_INVALID ) {
+				fds[ nfds ].fd = rc->rc_fd;
+				fds[ nfds ].events = POLLIN;
+				pc[ nfds++ ] = rc;
+			}
+		}
+
+		if ( active == 0 ) {
+			break;
+		}
+
+		/* libldap may have buffered more than poll() can see */
+		for ( i = 0; i < nfds; i++ ) {
+			rp_receive( pc[ i ] );
+		}
+
+		if ( poll( fds, nfds, (int)( wait / 1000.0 ) ) > 0 ) {
+			for ( i = 0; i < nfds; i++ ) {
+				if ( fds[ i ].revents ) {
+					rp_receive( pc[ i ] );
+				}
+			}
+		}
+	}
+
+	free( fds );
+	free( pc );
+	return NULL;
+}
+
+static int
+rp_cmp_double( const void *a, const void *b )
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double
+rp_quantile( double *v, int n, double q )
+{
+	int i = (int)( q * n );
+
+	if ( n == 0 ) {
+		return 0;
+	}
+	return v[ i < n ? i : n - 1 ] / 1000.0;
+}
+
+static int
+rp_replay( char *file, char *outfile )
+{
+	rp_thread	*rts;
+	rp_conn		*conns = NULL;
+	double		*rec, *lat, *delta, elapsed;
+	unsigned long	late = 0, unsent = 0;
+	int		nconns = 0, i, j, t, errors = 0;
+
+	if ( rp_read_trace( file ) ) {
+		return -1;
+	}
+
+	/* recorded connections, in order of first appearance */
+	for ( i = 0; i < nops; i++ ) {
+		rp_conn *rc = NULL;
+
+		for ( j = nconns - 1; j >= 0 && j >= nconns - 64; j-- ) {
+			if ( conns[ j ].rc_id == ops[ i ].ro_conn ) {
+				rc = &conns[ j ];
+				break;
+			}
+		}
+		if ( rc == NULL ) {
+			for ( j = 0; j < nconns; j++ ) {
+				if ( conns[ j ].rc_id == ops[ i ].ro_conn ) {
+					rc = &conns[ j ];
+					break;
+				}
+			}
+		}
+		if ( rc == NULL ) {
+			if ( nconns % 64 == 0 ) {
+				conns = rp_realloc( conns, ( nconns + 64 ) * sizeof( rp_conn ) );
+			}
+			rc = &conns[ nconns++ ];
+			memset( rc, 0, sizeof( rp_conn ) );
+			rc->rc_id = ops[ i ].ro_conn;
+			rc->rc_fd = AC_SOCKET_INVALID;
+			rc->rc_msgid = -1;
+		}
+		if ( rc->rc_nops % 16 == 0 ) {
+			rc->rc_ops = rp_realloc( rc->rc_ops, ( rc->rc_nops + 16 ) * sizeof( int ) );
+		}
+		rc->rc_ops[ rc->rc_nops++ ] = i;
+	}
+
+	if ( nthreads > nconns )
+		nthreads = nconns;
+	if ( nthreads < 1 )
+		nthreads = 1;
+	rts = calloc( nthreads, sizeof( rp_thread ) );
+	if ( rts == NULL ) {
+		tester_error( "calloc failed" );
+		return -1;
+	}
+	for ( i = 0; i < nconns; i++ ) {
+		rp_thread *rt = &rts[ i % nthreads ];
+
+		rt->rt_conns = rp_realloc( rt->rt_conns,
+			( rt->rt_nconns + 1 ) * sizeof( rp_conn * ) );
+		rt->rt_conns[ rt->rt_nconns++ ] = &conns[ i ];
+	}
+
+	printf( "slapd-replay: %s requests=%d conns=%d threads=%d speed=%g\n",
+		config->uri, nops, nconns, nthreads, speed );
+	fflush( stdout );
+
+	rp_start = rp_now();
+	for ( i = 0; i < nthreads; i++ ) {
+		ldap_pvt_thread_create( &rts[ i ].rt_tid, 0, rp_thread_main, &rts[ i ] );
+	}
+	for ( i = 0; i < nthreads; i++ ) {
+		ldap_pvt_thread_join( rts[ i ].rt_tid, NULL );
+	}
+	elapsed = ( rp_now() - rp_start ) / 1000000.0;
+
+	if ( outfile ) {
+		FILE *fp = fopen( outfile, "w" );
+
+		if ( fp == NULL ) {
+			tester_perror( "fopen", outfile );
+		} else {
+			fprintf( fp, "#usec\tconn\top\trecorded-rc\trc\trecorded-usec\tusec\tlag-usec\n" );
+			for ( i = 0; i < nops; i++ ) {
+				rp_op *ro = &ops[ i ];
+
+				fprintf( fp, "%.0f\t%lu\t%s\t%d\t%d\t%.0f\t%.0f\t%.0f\n",
+					ro->ro_time, ro->ro_conn, rp_opname[ ro->ro_type ],
+					ro->ro_rc, ro->ro_lat < 0 ? -1 : ro->ro_res,
+					ro->ro_etime, ro->ro_lat, ro->ro_lat < 0 ? -1 : ro->ro_lag );
+			}
+			fclose( fp );
+		}
+	}
+
+	rec = rp_realloc( NULL, ( nops + 1 ) * sizeof( double ) );
+	lat = rp_realloc( NULL, ( nops + 1 ) * sizeof( double ) );
+	delta = rp_realloc( NULL, ( nops + 1 ) * sizeof( double ) );
+
+	printf( "\n%-8s %8s %8s %8s | %9s %9s | %9s %9s %9s | %9s %9s\n",
+		"op", "count", "errors", "rcdiff",
+		"rec-p50", "rec-p99", "p50(ms)", "p90(ms)", "p99(ms)",
+		"d-p50", "d-p99" );
+	for ( t = 0; t < RP_LAST; t++ ) {
+		int n = 0, nrec = 0, ndelta = 0, err = 0, rcdiff = 0;
+
+		for ( i = 0; i < nops; i++ ) {
+			rp_op *ro = &ops[ i ];
+
+			if ( ro->ro_type != t || ro->ro_lat < 0 ) {
+				continue;
+			}
+			lat[ n++ ] = ro->ro_lat;
+			if ( ro->ro_res == LDAP_SERVER_DOWN || ro->ro_res < 0 ) {
+				err++;
+			} else if ( ro->ro_rc >= 0 && ro->ro_rc != ro->ro_res ) {
+				rcdiff++;
+			}
+			if ( ro->ro_etime >= 0 ) {
+				rec[ nrec++ ] = ro->ro_etime;
+				delta[ ndelta++ ] = ro->ro_lat - ro->ro_etime;
+			}
+			if ( ro->ro_lag > LATE_USEC ) {
+				late++;
+			}
+		}
+		if ( n == 0 ) {
+			continue;
+		}
+		errors += err;
+
+		qsort( lat, n, sizeof( double ), rp_cmp_double );
+		qsort( rec, nrec, sizeof( double ), rp_cmp_double );
+		qsort( delta, ndelta, sizeof( double ), rp_cmp_double );
+		printf( "%-8s %8d %8d %8d | ", rp_opname[ t ], n, err, rcdiff );
+		if ( nrec ) {
+			printf( "%9.3f %9.3f | ",
+				rp_quantile( rec, nrec, 0.50 ), rp_quantile( rec, nrec, 0.99 ) );
+		} else {
+			printf( "%9s %9s | ", "-", "-" );
+		}
+		printf( "%9.3f %9.3f %9.3f | ",
+			rp_quantile( lat, n, 0.50 ), rp_quantile( lat, n, 0.90 ),
+			rp_quantile( lat, n, 0.99 ) );
+		if ( ndelta ) {
+			printf( "%+9.3f %+9.3f\n",
+				rp_quantile( delta, ndelta, 0.50 ), rp_quantile( delta, ndelta, 0.99 ) );
+		} else {
+			printf( "%9s %9s\n", "-", "-" );
+		}
+	}
+
+	for ( i = 0; i < nops; i++ ) {
+		if ( ops[ i ].ro_lat < 0 ) {
+			unsent++;
+		}
+	}
+	printf( "elapsed %.1fs, %lu requests sent more than %.0fms late, "
+		"%lu not sent\n", elapsed, late, LATE_USEC / 1000.0, unsent );
+
+	free( rec );
+	free( lat );
+	free( delta );
+	for ( i = 0; i < nthreads; i++ ) {
+		free( rts[ i ].rt_conns );
+	}
+	free( rts );
+	for ( i = 0; i < nconns; i++ ) {
+		free( conns[ i ].rc_ops );
+	}
+	free( conns );
+
+	return errors ? -1 : 0;
+}
+
+int
+main( int argc, char **argv )
+{
+	char		*format = NULL, *outfile = NULL, *end;
+	int		i, rc;
+
+	config = tester_init( "slapd-replay", TESTER_REPLAY );
+
+	while ( (i = getopt( argc, argv, TESTER_COMMON_OPTS "F:m:o:S:W:" )) != EOF ) {
+		switch ( i ) {
+		case 'F':		/* convert a recording of this format */
+			format = optarg;
+			break;
+
+		case 'm':		/* the number of threads */
+			if ( lutil_atoi( &nthreads, optarg ) != 0 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'o':		/* per-request results */
+			outfile = optarg;
+			break;
+
+		case 'S':		/* replay speed, relative to the recording */
+			speed = strtod( optarg, &end );
+			if ( *end || speed <= 0 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'W':		/* password for recorded simple binds */
+			ber_str2bv( optarg, 0, 1, &bindpw );
+			break;
+
+		default:
+			if ( tester_config_opt( config, i, optarg ) == LDAP_SUCCESS ) {
+				break;
+			}
+			usage( argv[0], i );
+			break;
+		}
+	}
+
+	if ( format ) {
+		if ( argc - optind > 1 ) {
+			usage( argv[0], 0 );
+		}
+		rc = rp_convert( format, argv[ optind ] );
+		if ( rc ) {
+			usage( argv[0], 0 );
+		}
+		exit( EXIT_SUCCESS );
+	}
+
+	if ( argc - optind != 1 ) {
+		usage( argv[0], 0 );
+	}
+
+	if ( nthreads < 1 )
+		nthreads = 1;
+	if ( nthreads > MAXTHREAD )
+		nthreads = MAXTHREAD;
+
+	tester_config_finish( config );
+	ldap_pvt_thread_initialize();
+
+	rc = rp_replay( argv[ optind ], outfile );
+
+	for ( i = 0; i < nops; i++ ) {
+		rp_op_free( &ops[ i ] );
+	}
+	free( ops );
+
+	exit( rc ? EXIT_FAILURE : EXIT_SUCCESS );
+}
+
+#else /* NO_THREADS */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int
+main( int argc, char **argv )
+{
+	fprintf( stderr, "%s: not available when configured --without-threads\n", argv[0] );
+	exit( EXIT_FAILURE );
+}
+
+#endif /* NO_THREADS */
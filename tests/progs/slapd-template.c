@@ -0,0 +1,294 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include "ac/stdlib.h"
+
+#include "ac/ctype.h"
+#include "ac/param.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/unistd.h"
+#include "ac/wait.h"
+
+#include "ldap.h"
+#include "lutil.h"
+#include "ldif.h"
+
+#include "ldap_pvt.h"
+
+#include "slapd-common.h"
+
+static int
+do_register( LDAP *ld, char *base, int scope, char *filter,
+	char **attrs, int *idp );
+
+static int
+do_search( LDAP *ld, int id, char **vals, int nvals );
+
+static void
+usage( char *name, int opt )
+{
+	if ( opt ) {
+		fprintf( stderr, "%s: unable to handle option \'%c\'\n\n",
+			name, opt );
+	}
+
+	fprintf( stderr, "usage: %s " TESTER_COMMON_HELP
+		"-b <base> "
+		"-f <filter> "
+		"[-s <scope>] "
+		"[-I <id>] "
+		"[-N <templates>] "
+		"[-v <value> ...] "
+		"[<attrs>] "
+		"\n",
+		name );
+	exit( EXIT_FAILURE );
+}
+
+/*
+ * Register a search template, with the filter values of "?" as its
+ * parameters, then run one search with the Search Template control for
+ * each set of parameter values given with -v, printing the entries
+ * found as LDIF. With -N the template is registered that many times,
+ * and the searches use the last one; -I makes them name another ID.
+ */
+int
+main( int argc, char **argv )
+{
+	int		i;
+	char		*base = NULL;
+	char		*filter = NULL;
+	int		scope = LDAP_SCOPE_SUBTREE;
+	int		ntemplates = 1;
+	int		id = 0, useid = 0;
+	char		**vals = NULL;
+	int		nvals = 0, nparams = 0;
+	char		*p;
+	LDAP		*ld = NULL;
+	int		rc = LDAP_SUCCESS;
+	struct tester_conn_args	*config;
+
+	config = tester_init( "slapd-template", TESTER_TEMPLATE );
+
+	while ( ( i = getopt( argc, argv, TESTER_COMMON_OPTS "b:f:I:N:s:v:" ) ) != EOF )
+	{
+		switch ( i ) {
+		case 'b':		/* base DN of the template */
+			base = optarg;
+			break;
+
+		case 'f':		/* filter of the template */
+			filter = optarg;
+			break;
+
+		case 'I':		/* template ID the searches name */
+			if ( lutil_atoi( &useid, optarg ) != 0 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'N':		/* times to register the template */
+			if ( lutil_atoi( &ntemplates, optarg ) != 0 ||
+				ntemplates < 1 )
+			{
+				usage( argv[0], i );
+			}
+			break;
+
+		case 's':
+			scope = ldap_pvt_str2scope( optarg );
+			if ( scope == -1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'v':		/* a parameter value */
+			vals = realloc( vals, ( nvals + 1 ) * sizeof( char * ) );
+			vals[nvals++] = optarg;
+			break;
+
+		default:
+			if ( tester_config_opt( config, i, optarg ) == LDAP_SUCCESS ) {
+				break;
+			}
+			usage( argv[0], i );
+			break;
+		}
+	}
+
+	if ( base == NULL || filter == NULL )
+		usage( argv[0], 0 );
+
+	/* each "=?)" is an equality, ordering or approx parameter */
+	for ( p = filter; ( p = strstr( p, "=?)" ) ) != NULL; p++ )
+		nparams++;
+	if ( nparams ? nvals % nparams : nvals ) {
+		fprintf( stderr, "%s: %d values for %d parameters.\n",
+			argv[0], nvals, nparams );
+		exit( EXIT_FAILURE );
+	}
+
+	tester_config_finish( config );
+	tester_init_ld( &ld, config, 0 );
+
+	for ( i = 0; i < ntemplates; i++ ) {
+		rc = do_register( ld, base, scope, filter, &argv[optind], &id );
+		if ( rc != LDAP_SUCCESS )
+			goto done;
+	}
+	fprintf( stderr, "  PID=%ld - Template registered (id=%d).\n",
+		(long) pid, id );
+
+	if ( useid )
+		id = useid;
+
+	if ( nparams == 0 ) {
+		if ( nvals == 0 )
+			rc = do_search( ld, id, NULL, 0 );
+	} else {
+		for ( i = 0; i < nvals && rc == LDAP_SUCCESS; i += nparams )
+			rc = do_search( ld, id, &vals[i], nparams );
+	}
+
+done:;
+	ldap_unbind_ext( ld, NULL, NULL );
+	free( vals );
+
+	exit( rc );
+}
+
+static int
+do_register( LDAP *ld, char *base, int scope, char *filter,
+	char **attrs, int *idp )
+{
+	BerElement	*ber;
+	struct berval	reqdata, *retdata = NULL;
+	char		*retoid = NULL;
+	ber_int_t	id;
+	int		i, rc;
+
+	ber = ber_alloc_t( LBER_USE_DER );
+	ber_printf( ber, "{seebs{", base, (ber_int_t) scope,
+		(ber_int_t) LDAP_DEREF_NEVER, (ber_int_t) 0, filter );
+	for ( i = 0; attrs[i] != NULL; i++ )
+		ber_printf( ber, "s", attrs[i] );
+	if ( ber_printf( ber, /*{{*/ "N}N}" ) < 0 ||
+		ber_flatten2( ber, &reqdata, 0 ) < 0 )
+	{
+		tester_error( "unable to encode the search template request" );
+		ber_free( ber, 1 );
+		return LDAP_ENCODING_ERROR;
+	}
+
+	rc = ldap_extended_operation_s( ld, LDAP_EXOP_X_SEARCH_TEMPLATE,
+		&reqdata, NULL, NULL, &retoid, &retdata );
+	ber_free( ber, 1 );
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( ld, "ldap_extended_operation_s", NULL );
+		return rc;
+	}
+
+	rc = LDAP_DECODING_ERROR;
+	if ( retdata != NULL ) {
+		ber = ber_init( retdata );
+		if ( ber != NULL ) {
+			if ( ber_scanf( ber, "i", &id ) != LBER_ERROR ) {
+				*idp = id;
+				rc = LDAP_SUCCESS;
+			}
+			ber_free( ber, 1 );
+		}
+		ber_bvfree( retdata );
+	}
+	ldap_memfree( retoid );
+	if ( rc != LDAP_SUCCESS )
+		tester_error( "unable to decode the search template response" );
+	return rc;
+}
+
+static int
+do_search( LDAP *ld, int id, char **vals, int nvals )
+{
+	BerElement	*ber;
+	BerElement	*eber = NULL;
+	LDAPControl	c, *ctrls[2];
+	LDAPMessage	*res = NULL, *e;
+	struct berval	dn, bv, *bvals;
+	char		*attr, *out;
+	int		i, rc;
+
+	ber = ber_alloc_t( LBER_USE_DER );
+	ber_printf( ber, "{i{", (ber_int_t) id );
+	for ( i = 0; i < nvals; i++ )
+		ber_printf( ber, "s", vals[i] );
+	if ( ber_printf( ber, /*{{*/ "N}N}" ) < 0 ||
+		ber_flatten2( ber, &c.ldctl_value, 0 ) < 0 )
+	{
+		tester_error( "unable to encode the search template control" );
+		ber_free( ber, 1 );
+		return LDAP_ENCODING_ERROR;
+	}
+	c.ldctl_oid = LDAP_CONTROL_X_SEARCH_TEMPLATE;
+	c.ldctl_iscritical = 1;
+	ctrls[0] = &c;
+	ctrls[1] = NULL;
+
+	/* everything but the limits comes from the template */
+	rc = ldap_search_ext_s( ld, "", LDAP_SCOPE_BASE, "(objectClass=*)",
+		NULL, 0, ctrls, NULL, NULL, LDAP_NO_LIMIT, &res );
+	ber_free( ber, 1 );
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( ld, "ldap_search_ext_s", NULL );
+		ldap_msgfree( res );
+		return rc;
+	}
+
+	for ( e = ldap_first_entry( ld, res ); e != NULL;
+		e = ldap_next_entry( ld, e ) )
+	{
+		if ( ldap_get_dn_ber( ld, e, &eber, &dn ) != LDAP_SUCCESS )
+			continue;
+		/* wrapped as ldapsearch does */
+		out = ldif_put_wrap( LDIF_PUT_VALUE, "dn",
+			dn.bv_val, dn.bv_len, 0 );
+		fputs( out, stdout );
+		ber_memfree( out );
+
+		for ( rc = ldap_get_attribute_ber( ld, e, eber, &bv, &bvals );
+			rc == LDAP_SUCCESS && bv.bv_val != NULL;
+			rc = ldap_get_attribute_ber( ld, e, eber, &bv, &bvals ) )
+		{
+			attr = bv.bv_val;
+			for ( i = 0; bvals && bvals[i].bv_val != NULL; i++ ) {
+				out = ldif_put_wrap( LDIF_PUT_VALUE, attr,
+					bvals[i].bv_val, bvals[i].bv_len, 0 );
+				fputs( out, stdout );
+				ber_memfree( out );
+			}
+			ber_memfree( bvals );
+		}
+		ber_free( eber, 0 );
+		eber = NULL;
+		putchar( '\n' );
+	}
+	ldap_msgfree( res );
+
+	return LDAP_SUCCESS;
+}
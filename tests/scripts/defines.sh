@@ -149,6 +149,15 @@ PASSWDCONF=$DATADIR/slapd-passwd.conf
 UNDOCONF=$DATADIR/slapd-config-undo.conf
 NAKEDCONF=$DATADIR/slapd-config-naked.conf
 VALREGEXCONF=$DATADIR/slapd-valregex.conf
+COALESCECONF=$DATADIR/slapd-coalesce.conf
+SEARCHQUANTUMCONF=$DATADIR/slapd-searchquantum.conf
+TEMPLATECONF=$DATADIR/slapd-template.conf
+RANGECONF=$DATADIR/slapd-range.conf
+GROUPCACHECONF=$DATADIR/slapd-groupcache.conf
+AUTHZCACHECONF=$DATADIR/slapd-authzcache.conf
+PASSWDCACHECONF=$DATADIR/slapd-passwdcache.conf
+ACLMEMOCONF=$DATADIR/slapd-aclmemo.conf
+ENTRYCACHECONF=$DATADIR/slapd-entrycache.conf
 
 DYNAMICCONF=$DATADIR/slapd-dynamic.ldif
 
@@ -212,6 +221,9 @@ LDAPEXOP="$CLIENTDIR/ldapexop $TOOLARGS"
 SLAPDTESTER=$PROGDIR/slapd-tester
 LDIFFILTER=$PROGDIR/ldif-filter
 SLAPDMTREAD=$PROGDIR/slapd-mtread
+SLAPDLOAD=$PROGDIR/slapd-load
+SLAPDREPLAY=$PROGDIR/slapd-replay
+SLAPDTEMPLATE=$PROGDIR/slapd-template
 LVL=${SLAPD_DEBUG-0x4105}
 LOCALHOST=localhost
 LOCALIP=127.0.0.1